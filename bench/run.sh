@@ -0,0 +1,143 @@
+#!/bin/bash
+###### 此脚本由顶层makefile的bench目标在仓库根目录下执行，也可以直接运行 ######
+# 在无界面的bochs中启动hd60M.img，按session.txt键入命令，从调试端口的输出
+# guest.log中取出各项结果写到out/results.txt，再与baseline.txt比较。
+# 内核须已写进hd60M.img（make all）。
+#
+# 用法: bench/run.sh [-b]
+#   -b  运行后把结果保存为新的基准
+# 环境变量:
+#   BOCHS            bochs可执行文件，默认bochs-2.6.11/bochs
+#   BENCH_TOLERANCE  超过基准多少百分比算退化，默认10
+#   BENCH_TIMEOUT    bochs最多运行的秒数，默认900
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+ROOT_DIR=$(dirname "$BENCH_DIR")
+BOCHS_DIR="$ROOT_DIR/bochs-2.6.11"
+OUT_DIR="$BENCH_DIR/out"
+BOCHS=${BOCHS:-"$BOCHS_DIR/bochs"}
+TOLERANCE=${BENCH_TOLERANCE:-10}
+TIMEOUT=${BENCH_TIMEOUT:-900}
+RESULTS="$OUT_DIR/results.txt"
+BASELINE="$BENCH_DIR/baseline.txt"
+
+if [[ ! -x $BOCHS ]]; then
+    echo "bench: can't find bochs at $BOCHS"
+    exit 1
+fi
+
+rm -rf "$OUT_DIR"
+mkdir -p "$OUT_DIR/share"
+
+#用户程序放进共享目录，由会话中的import -a导入
+(cd "$ROOT_DIR/command" && \
+    SHARE_DIR="$OUT_DIR/share" bash compile_cat.sh && \
+    SHARE_DIR="$OUT_DIR/share" bash compile_fsbench.sh) || exit 1
+for prog in cat fsbench; do
+    if [[ ! -f $OUT_DIR/share/$prog ]]; then
+        echo "bench: building $prog failed"
+        exit 1
+    fi
+done
+#cat和管道用的文本文件
+for i in $(seq 1 40); do
+    echo "line $i of the bench text file"
+done > "$OUT_DIR/share/b"
+
+#bochs在关机端口收到Shutdown后退出，退出码不代表测试结果，结果看guest.log
+start=$(date +%s%N)
+(cd "$BOCHS_DIR" && timeout "$TIMEOUT" "$BOCHS" -q -f bochsrc.bench > "$OUT_DIR/screen.txt" 2>&1)
+end=$(date +%s%N)
+
+if ! grep -q "cannot access /_fsbench:" "$OUT_DIR/guest.log" 2>/dev/null; then
+    echo "bench: session did not finish, see $OUT_DIR/screen.txt and $OUT_DIR/bochs.out"
+    exit 1
+fi
+
+#guest.log每行以"[秒.微秒] "的虚拟时间开头
+awk -v wall_ms=$(( (end - start) / 1000000 )) '
+function key(s) { gsub(/ /, "_", s); return s }
+{
+    if(!match($0, /^\[ *[0-9]+\.[0-9]+\] /)) {
+        next
+    }
+    split(substr($0, 2, RLENGTH - 3), tv, ".")
+    t = tv[1] * 1000000 + tv[2]
+    line = substr($0, RLENGTH + 1)
+    #键入的命令不回显到宿主机，命令的输出接在提示符后面，行首的时间是上一条命令结束的时间
+    prompt = sub(/^huloves@huloves:[^$]*\$ /, "", line)
+}
+#第一次出现提示符时启动完成
+!booted && prompt {
+    printf("step.boot.us %d\n", t)
+    booted = 1
+    prev = t
+}
+match(line, /cannot access \/_[A-Za-z0-9]+:/) {
+    name = substr(line, RSTART + 15, RLENGTH - 16)
+    printf("step.%s.us %d\n", name, t - prev)
+    prev = t
+}
+#内核微基准: "名字: N iters, min A, median B, p99 C cycles"
+line ~ /: [0-9]+ iters, min [0-9]+, median [0-9]+, p99 [0-9]+ cycles$/ {
+    name = key(substr(line, 1, index(line, ": ") - 1))
+    n = split(line, f, /[ ,]+/)
+    printf("bench.%s.median %d\n", name, f[n - 3])
+    printf("bench.%s.p99 %d\n", name, f[n - 1])
+}
+#fsbench: "名字: 数量 单位 in N ticks, 速率 单位/s"
+match(line, / in [0-9]+ ticks, [0-9]+ [A-Za-z]+\/s$/) {
+    name = key(substr(line, 1, index(line, ": ") - 1))
+    split(substr(line, RSTART + 4), f, " ")
+    printf("fsbench.%s.ticks %d\n", name, f[1])
+}
+END {
+    printf("host.wall_ms %d\n", wall_ms)
+}' "$OUT_DIR/guest.log" > "$RESULTS"
+
+echo "bench: results in $RESULTS"
+
+if [[ $1 == "-b" ]]; then
+    cp "$RESULTS" "$BASELINE"
+    echo "bench: saved as the new baseline $BASELINE"
+    exit 0
+fi
+if [[ ! -f $BASELINE ]]; then
+    cat "$RESULTS"
+    echo "bench: no baseline yet, run make bench-baseline to save one"
+    exit 0
+fi
+
+#各项都是越小越好。宿主机的时间受机器负载影响，只列出不判定
+awk -v tol=$TOLERANCE '
+BEGIN {
+    printf("%-40s %12s %12s %8s\n", "result", "baseline", "current", "change")
+}
+NR == FNR {
+    base[$1] = $2
+    next
+}
+{
+    if(!($1 in base)) {
+        printf("%-40s %12s %12d %8s\n", $1, "-", $2, "new")
+        next
+    }
+    old = base[$1]
+    pct = old > 0 ? ($2 - old) * 100.0 / old : 0
+    status = ""
+    if($1 !~ /^host\./) {
+        if(pct > tol) {
+            status = "REGRESSED"
+            bad++
+        } else if(pct < -tol) {
+            status = "improved"
+        }
+    }
+    printf("%-40s %12d %12d %+7.1f%% %s\n", $1, old, $2, pct, status)
+}
+END {
+    if(bad > 0) {
+        printf("bench: %d results regressed by more than %d%%\n", bad, tol)
+        exit 1
+    }
+}' "$BASELINE" "$RESULTS"
@@ -139,6 +139,7 @@ void print_tree(bx_param_c *node, int level = 0, bx_bool xml = false);
 #if BX_ENABLE_STATISTICS
 // print statistics
 void print_statistics_tree(bx_param_c *node, int level = 0);
+void write_statistics_csv(FILE *fp, bx_param_c *node, const char *prefix, bx_bool header);
 #define INC_STAT(stat) (++(stat))
 #else
 #define INC_STAT(stat)
@@ -193,7 +194,12 @@ void print_statistics_tree(bx_param_c *node, int level = 0);
 #define BX_INP(addr, len)           bx_devices.inp(addr, len)
 #define BX_OUTP(addr, val, len)     bx_devices.outp(addr, val, len)
 #define BX_TICK1()                  bx_pc_system.tick1()
+#if BX_SUPPORT_SMP
+// in threaded SMP mode the clock is advanced between the slices only
+#define BX_TICKN(n)                 do { if (! bx_smp_slice_active) bx_pc_system.tickn(n); } while (0)
+#else
 #define BX_TICKN(n)                 bx_pc_system.tickn(n)
+#endif
 #define BX_INTR                     bx_pc_system.INTR
 #define BX_RAISE_INTR()             bx_pc_system.raise_INTR()
 #define BX_CLEAR_INTR()             bx_pc_system.clear_INTR()
@@ -242,9 +248,11 @@ void print_statistics_tree(bx_param_c *node, int level = 0);
 #  define BX_DBG_IO_REPORT(port, size, op, val) \
         if (bx_guard.report.io) bx_dbg_io_report(port, size, op, val)
 #  define BX_DBG_LIN_MEMORY_ACCESS(cpu, lin, phy, len, memtype, rw, data) \
-        bx_dbg_lin_memory_access(cpu, lin, phy, len, memtype, rw, data)
+        if (BX_CPU(cpu)->trace_mem || BX_DBG_WATCH_HIT(phy, len)) \
+          bx_dbg_lin_memory_access(cpu, lin, phy, len, memtype, rw, data)
 #  define BX_DBG_PHY_MEMORY_ACCESS(cpu, phy, len, memtype, rw, why, data) \
-        bx_dbg_phy_memory_access(cpu, phy, len, memtype, rw, why, data)
+        if (BX_CPU(cpu)->trace_mem || BX_DBG_WATCH_HIT(phy, len)) \
+          bx_dbg_phy_memory_access(cpu, phy, len, memtype, rw, why, data)
 #else  // #if BX_DEBUGGER
 // debugger not compiled in, use empty stubs
 #  define BX_DBG_ASYNC_INTR 1
@@ -259,6 +267,13 @@ void print_statistics_tree(bx_param_c *node, int level = 0);
 
 #define MAGIC_LOGNUM 0x12345678
 
+// state of one BX_INFO/BX_DEBUG/BX_ERROR call site for the rate limit
+typedef struct {
+  Bit64u window;      // virtual time in seconds of the current window
+  Bit32u count;       // messages logged in the window
+  Bit32u suppressed;  // messages dropped in the window
+} bx_log_site_t;
+
 typedef class BOCHSAPI logfunctions
 {
   char *name;
@@ -268,6 +283,9 @@ typedef class BOCHSAPI logfunctions
   // default log actions for all devices, declared and initialized
   // in logio.cc.
   BOCHSAPI_CYGONLY static int default_onoff[N_LOGLEV];
+  // maximum number of messages per call site and second, 0 = no limit
+  BOCHSAPI_CYGONLY static Bit32u rate_limit;
+  bx_bool ratelimit_check(int level, bx_log_site_t *site);
 public:
   logfunctions(void);
   logfunctions(class iofunctions *);
@@ -294,6 +312,12 @@ public:
     assert (level>=0 && level<N_LOGLEV);
     return onoff[level];
   }
+  // checked by the log macros before the message arguments are evaluated
+  bx_bool log_enabled(int level) const { return onoff[level] != ACT_IGNORE; }
+  bx_bool log_ratelimit(int level, bx_log_site_t *site) {
+    return (rate_limit == 0) || ratelimit_check(level, site);
+  }
+  static void set_rate_limit(Bit32u limit) { rate_limit = limit; }
   static void set_default_action(int loglev, int action) {
     assert (loglev >= 0 && loglev < N_LOGLEV);
     assert (action >= 0 && action < N_ACT);
@@ -307,13 +331,18 @@ public:
 
 #define BX_LOGPREFIX_LEN 20
 
+struct bx_log_entry_t;
+
 class BOCHSAPI iofunctions {
   int magic;
   char logprefix[BX_LOGPREFIX_LEN + 1];
   FILE *logfd;
   class logfunctions *log;
+  bx_bool async;
   void init(void);
   void flush(void);
+  void write_msg(int level, const char *prefix, Bit64u ticks, Bit32u eip, const char *msg, char *msgpfx);
+  void format_async(const bx_log_entry_t *entry);
 
 // Log Class types
 public:
@@ -329,6 +358,8 @@ public:
   void init_log(int fd);
   void init_log(FILE *fs);
   void exit_log();
+  void set_async(bx_bool enable);
+  unsigned drain_async(unsigned max);
   void set_log_prefix(const char *prefix);
   int get_n_logfns() const { return n_logfn; }
   logfunc_t *get_logfn(int index) { return logfn_list[index]; }
@@ -365,9 +396,18 @@ typedef class iofunctions iofunc_t;
 
 #else
 
-#define BX_INFO(x)  (LOG_THIS info) x
-#define BX_DEBUG(x) (LOG_THIS ldebug) x
-#define BX_ERROR(x) (LOG_THIS error) x
+// The level check comes first, so the arguments of disabled messages are
+// never evaluated. Each call site has its own rate limit state.
+#define BX_LOG_SITE(level, func, x) do { \
+    if (LOG_THIS log_enabled(level)) { \
+      static bx_log_site_t bx_log_site; \
+      if (LOG_THIS log_ratelimit(level, &bx_log_site)) (LOG_THIS func) x; \
+    } \
+  } while (0)
+
+#define BX_INFO(x)  BX_LOG_SITE(LOGLEV_INFO, info, x)
+#define BX_DEBUG(x) BX_LOG_SITE(LOGLEV_DEBUG, ldebug, x)
+#define BX_ERROR(x) BX_LOG_SITE(LOGLEV_ERROR, error, x)
 #define BX_PANIC(x) (LOG_THIS panic) x
 #define BX_FATAL(x) (LOG_THIS fatal1) x
 
@@ -470,6 +510,7 @@ enum {
 #include "memory/memory-bochs.h"
 #include "pc_system.h"
 #include "gui/gui.h"
+#include "smp.h"
 
 /* --- EXTERNS --- */
 
@@ -25,6 +25,61 @@
 
 static unsigned next_bpoint_id = 1;
 
+Bit32u bx_dbg_vir_bp_pages[BX_DBG_PAGE_FILTER_BITS/32];
+Bit32u bx_dbg_lin_bp_pages[BX_DBG_PAGE_FILTER_BITS/32];
+Bit32u bx_dbg_phy_bp_pages[BX_DBG_PAGE_FILTER_BITS/32];
+Bit32u bx_dbg_watch_pages[BX_DBG_PAGE_FILTER_BITS/32];
+
+static void bx_dbg_page_filter_set(Bit32u *filter, Bit64u addr, Bit64u len)
+{
+  if (len == 0) len = 1;
+  Bit64u first = addr >> 12, last = (addr + len - 1) >> 12;
+  if (last - first >= BX_DBG_PAGE_FILTER_BITS) {
+    // range covers every hash bucket
+    memset(filter, 0xff, BX_DBG_PAGE_FILTER_BITS/8);
+    return;
+  }
+
+  for (Bit64u page = first; page <= last; page++) {
+    unsigned n = (unsigned) page & (BX_DBG_PAGE_FILTER_BITS-1);
+    filter[n >> 5] |= (1 << (n & 31));
+  }
+}
+
+void bx_dbg_update_page_filters(void)
+{
+  unsigned i;
+
+  memset(bx_dbg_vir_bp_pages, 0, sizeof(bx_dbg_vir_bp_pages));
+  memset(bx_dbg_lin_bp_pages, 0, sizeof(bx_dbg_lin_bp_pages));
+  memset(bx_dbg_phy_bp_pages, 0, sizeof(bx_dbg_phy_bp_pages));
+  memset(bx_dbg_watch_pages, 0, sizeof(bx_dbg_watch_pages));
+
+#if (BX_DBG_MAX_VIR_BPOINTS > 0)
+  for (i=0; i<bx_guard.iaddr.num_virtual; i++) {
+    if (bx_guard.iaddr.vir[i].enabled)
+      bx_dbg_page_filter_set(bx_dbg_vir_bp_pages, bx_guard.iaddr.vir[i].eip, 1);
+  }
+#endif
+#if (BX_DBG_MAX_LIN_BPOINTS > 0)
+  for (i=0; i<bx_guard.iaddr.num_linear; i++) {
+    if (bx_guard.iaddr.lin[i].enabled)
+      bx_dbg_page_filter_set(bx_dbg_lin_bp_pages, bx_guard.iaddr.lin[i].addr, 1);
+  }
+#endif
+#if (BX_DBG_MAX_PHY_BPOINTS > 0)
+  for (i=0; i<bx_guard.iaddr.num_physical; i++) {
+    if (bx_guard.iaddr.phy[i].enabled)
+      bx_dbg_page_filter_set(bx_dbg_phy_bp_pages, bx_guard.iaddr.phy[i].addr, 1);
+  }
+#endif
+
+  for (i=0; i<num_read_watchpoints; i++)
+    bx_dbg_page_filter_set(bx_dbg_watch_pages, read_watchpoint[i].addr, read_watchpoint[i].len);
+  for (i=0; i<num_write_watchpoints; i++)
+    bx_dbg_page_filter_set(bx_dbg_watch_pages, write_watchpoint[i].addr, write_watchpoint[i].len);
+}
+
 void bx_dbg_breakpoint_changed(void)
 {
 #if (BX_DBG_MAX_VIR_BPOINTS > 0)
@@ -47,6 +102,8 @@ void bx_dbg_breakpoint_changed(void)
   else
     bx_guard.guard_for &= ~BX_DBG_GUARD_IADDR_PHY;
 #endif
+
+  bx_dbg_update_page_filters();
 }
 
 void bx_dbg_en_dis_breakpoint_command(unsigned handle, bx_bool enable)
@@ -80,6 +137,7 @@ bx_bool bx_dbg_en_dis_pbreak(unsigned handle, bx_bool enable)
   for (unsigned i=0; i<bx_guard.iaddr.num_physical; i++) {
     if (bx_guard.iaddr.phy[i].bpoint_id == handle) {
       bx_guard.iaddr.phy[i].enabled=enable;
+      bx_dbg_update_page_filters();
       return 1;
     }
   }
@@ -94,6 +152,7 @@ bx_bool bx_dbg_en_dis_lbreak(unsigned handle, bx_bool enable)
   for (unsigned i=0; i<bx_guard.iaddr.num_linear; i++) {
     if (bx_guard.iaddr.lin[i].bpoint_id == handle) {
       bx_guard.iaddr.lin[i].enabled=enable;
+      bx_dbg_update_page_filters();
       return 1;
     }
   }
@@ -108,6 +167,7 @@ bx_bool bx_dbg_en_dis_vbreak(unsigned handle, bx_bool enable)
   for (unsigned i=0; i<bx_guard.iaddr.num_virtual; i++) {
     if (bx_guard.iaddr.vir[i].bpoint_id == handle) {
       bx_guard.iaddr.vir[i].enabled=enable;
+      bx_dbg_update_page_filters();
       return 1;
     }
   }
@@ -151,6 +211,7 @@ bx_bool bx_dbg_del_pbreak(unsigned handle)
         bx_guard.iaddr.phy[j] = bx_guard.iaddr.phy[j+1];
       }
       bx_guard.iaddr.num_physical--;
+      bx_dbg_update_page_filters();
       return 1;
     }
   }
@@ -170,6 +231,7 @@ bx_bool bx_dbg_del_lbreak(unsigned handle)
         bx_guard.iaddr.lin[j] = bx_guard.iaddr.lin[j+1];
       }
       bx_guard.iaddr.num_linear--;
+      bx_dbg_update_page_filters();
       return 1;
     }
   }
@@ -189,6 +251,7 @@ bx_bool bx_dbg_del_vbreak(unsigned handle)
         bx_guard.iaddr.vir[j] = bx_guard.iaddr.vir[j+1];
       }
       bx_guard.iaddr.num_virtual--;
+      bx_dbg_update_page_filters();
       return 1;
     }
   }
@@ -230,6 +293,7 @@ int bx_dbg_vbreakpoint_command(BreakpointKind bk, Bit32u cs, bx_address eip, con
   bp->enabled=1;
   bx_guard.iaddr.num_virtual++;
   bx_guard.guard_for |= BX_DBG_GUARD_IADDR_VIR;
+  bx_dbg_update_page_filters();
   return bp->bpoint_id;
 
 #else
@@ -261,6 +325,7 @@ int bx_dbg_lbreakpoint_command(BreakpointKind bk, bx_address laddress, const cha
   bp->enabled=1;
   bx_guard.iaddr.num_linear++;
   bx_guard.guard_for |= BX_DBG_GUARD_IADDR_LIN;
+  bx_dbg_update_page_filters();
   return BpId;
 
 #else
@@ -291,6 +356,7 @@ int bx_dbg_pbreakpoint_command(BreakpointKind bk, bx_phy_address paddress, const
   bp->enabled=1;
   bx_guard.iaddr.num_physical++;
   bx_guard.guard_for |= BX_DBG_GUARD_IADDR_PHY;
+  bx_dbg_update_page_filters();
   return bp->bpoint_id;
 #else
   dbg_printf("Error: physical breakpoint support not compiled in.\n");
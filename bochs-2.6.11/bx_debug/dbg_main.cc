@@ -1892,6 +1892,7 @@ void bx_dbg_watch(int type, bx_phy_address address, Bit32u len)
     read_watchpoint[num_read_watchpoints].addr = address;
     read_watchpoint[num_read_watchpoints].len = len;
     num_read_watchpoints++;
+    bx_dbg_update_page_filters();
     dbg_printf("read watchpoint at 0x" FMT_PHY_ADDRX " len=%d inserted\n", address, len);
   }
   else if (type == BX_WRITE) {
@@ -1902,6 +1903,7 @@ void bx_dbg_watch(int type, bx_phy_address address, Bit32u len)
     write_watchpoint[num_write_watchpoints].addr = address;
     write_watchpoint[num_write_watchpoints].len = len;
     num_write_watchpoints++;
+    bx_dbg_update_page_filters();
     dbg_printf("write watchpoint at 0x" FMT_PHY_ADDRX " len=%d inserted\n", address, len);
   }
   else {
@@ -1912,6 +1914,7 @@ void bx_dbg_watch(int type, bx_phy_address address, Bit32u len)
 void bx_dbg_unwatch_all()
 {
   num_read_watchpoints = num_write_watchpoints = 0;
+  bx_dbg_update_page_filters();
   dbg_printf("All watchpoints removed\n");
 }
 
@@ -1926,6 +1929,7 @@ void bx_dbg_unwatch(bx_phy_address address)
         read_watchpoint[j] = read_watchpoint[j+1];
       }
       num_read_watchpoints--;
+      bx_dbg_update_page_filters();
       break;
     }
   }
@@ -1938,6 +1942,7 @@ void bx_dbg_unwatch(bx_phy_address address)
         write_watchpoint[j] = write_watchpoint[j+1];
       }
       num_write_watchpoints--;
+      bx_dbg_update_page_filters();
       break;
     }
   }
@@ -2011,7 +2016,9 @@ one_more:
       // Potential deadlock if all processors are halted.  Then
       // max_executed will be 0, tick will be incremented by zero, and
       // there will never be a timed event to wake them up.
-      // To avoid this, always tick by a minimum of 1.
+      // Only a timer can wake them up then, so skip straight to the next
+      // timed event instead of crawling there one tick per round.
+      if (max_executed < 1) max_executed = bx_pc_system.getNumCpuTicksLeftNextEvent();
       if (max_executed < 1) max_executed=1;
 
       // increment time tick only after all processors have had their chance.
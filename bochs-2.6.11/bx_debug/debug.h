@@ -341,6 +341,31 @@ extern bx_watchpoint write_watchpoint[BX_DBG_MAX_WATCHPONTS];
 extern bx_watchpoint read_watchpoint[BX_DBG_MAX_WATCHPONTS];
 extern bx_guard_t bx_guard;
 
+// Hashed per-page "has breakpoint/watchpoint" filters, rebuilt by
+// bx_dbg_update_page_filters() whenever a breakpoint or a watchpoint is
+// added, removed, enabled or disabled. A clear bit means no page hashing
+// to it carries one, so the per-instruction and per-memory-access checks
+// skip walking the lists. Vir breakpoints are hashed by their eip only.
+#define BX_DBG_PAGE_FILTER_BITS 4096
+
+extern Bit32u bx_dbg_vir_bp_pages[BX_DBG_PAGE_FILTER_BITS/32];
+extern Bit32u bx_dbg_lin_bp_pages[BX_DBG_PAGE_FILTER_BITS/32];
+extern Bit32u bx_dbg_phy_bp_pages[BX_DBG_PAGE_FILTER_BITS/32];
+extern Bit32u bx_dbg_watch_pages[BX_DBG_PAGE_FILTER_BITS/32];
+
+BX_CPP_INLINE bx_bool bx_dbg_page_filter(const Bit32u *filter, Bit64u addr)
+{
+  unsigned n = (unsigned)(addr >> 12) & (BX_DBG_PAGE_FILTER_BITS-1);
+  return (filter[n >> 5] >> (n & 31)) & 1;
+}
+
+// true if an access of len bytes at phy may touch a watched page
+#define BX_DBG_WATCH_HIT(phy, len) \
+  (bx_dbg_page_filter(bx_dbg_watch_pages, (phy)) || \
+   bx_dbg_page_filter(bx_dbg_watch_pages, (Bit64u)(phy) + (len) - 1))
+
+void bx_dbg_update_page_filters(void);
+
 #define IS_CODE_32(code_32_64) ((code_32_64 & 1) != 0)
 #define IS_CODE_64(code_32_64) ((code_32_64 & 2) != 0)
 
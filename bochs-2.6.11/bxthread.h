@@ -36,11 +36,14 @@
 #if BX_WITH_SDL2
 #define BX_THREAD_CREATE(name,arg,var) do { var = SDL_CreateThread(name, #name, (void*)arg); } while (0)
 #define BX_THREAD_KILL(var) SDL_DetachThread(var)
+#define BX_THREAD_JOIN(var) SDL_WaitThread(var, NULL)
 #else
 #define BX_THREAD_CREATE(name,arg,var) do { var = SDL_CreateThread(name, (void*)arg); } while (0)
 #define BX_THREAD_KILL(var) SDL_KillThread(var)
+#define BX_THREAD_JOIN(var) SDL_WaitThread(var, NULL)
 #endif
 #define BX_LOCK(mutex) SDL_LockMutex(mutex)
+#define BX_TRYLOCK(mutex) (SDL_TryLockMutex(mutex) == 0)
 #define BX_UNLOCK(mutex) SDL_UnlockMutex(mutex)
 #define BX_MUTEX(mutex) SDL_mutex (*mutex)
 #define BX_INIT_MUTEX(mutex) mutex = SDL_CreateMutex()
@@ -54,7 +57,9 @@
 #define BX_THREAD_EXIT return 0
 #define BX_THREAD_CREATE(name,arg,var) do { var = CreateThread(NULL, 0, name, arg, 0, NULL); } while (0)
 #define BX_THREAD_KILL(var) TerminateThread(var, 0)
+#define BX_THREAD_JOIN(var) do { WaitForSingleObject(var, INFINITE); CloseHandle(var); } while (0)
 #define BX_LOCK(mutex) EnterCriticalSection(&(mutex))
+#define BX_TRYLOCK(mutex) TryEnterCriticalSection(&(mutex))
 #define BX_UNLOCK(mutex) LeaveCriticalSection(&(mutex))
 #define BX_MUTEX(mutex) CRITICAL_SECTION (mutex)
 #define BX_INIT_MUTEX(mutex) InitializeCriticalSection(&(mutex))
@@ -71,7 +76,9 @@
 #define BX_THREAD_CREATE(name,arg,var) \
     pthread_create(&(var), NULL, (void *(*)(void *))&(name), arg)
 #define BX_THREAD_KILL(var) pthread_cancel(var); pthread_join(var, NULL)
+#define BX_THREAD_JOIN(var) pthread_join(var, NULL)
 #define BX_LOCK(mutex) pthread_mutex_lock(&(mutex));
+#define BX_TRYLOCK(mutex) (pthread_mutex_trylock(&(mutex)) == 0)
 #define BX_UNLOCK(mutex) pthread_mutex_unlock(&(mutex));
 #define BX_MUTEX(mutex) pthread_mutex_t (mutex)
 #define BX_INIT_MUTEX(mutex) pthread_mutex_init(&(mutex),NULL)
@@ -80,6 +87,48 @@
 
 #endif
 
+// thread local storage and atomic operations on guest/shared memory
+
+#if defined(_MSC_VER)
+
+#include <intrin.h>
+
+#define BX_THREAD_LOCAL __declspec(thread)
+#define BX_ATOMIC_OR8(ptr,val)   _InterlockedOr8((volatile char*)(ptr), (char)(val))
+#define BX_ATOMIC_OR32(ptr,val)  _InterlockedOr((volatile long*)(ptr), (long)(val))
+#define BX_ATOMIC_AND32(ptr,val) _InterlockedAnd((volatile long*)(ptr), (long)(val))
+#define BX_ATOMIC_OR64(ptr,val)  _InterlockedOr64((volatile __int64*)(ptr), (__int64)(val))
+#define BX_ATOMIC_CAS8(ptr,old,val) \
+    ((Bit8u) _InterlockedCompareExchange8((volatile char*)(ptr), (char)(val), (char)(old)) == (Bit8u)(old))
+#define BX_ATOMIC_CAS16(ptr,old,val) \
+    ((Bit16u) _InterlockedCompareExchange16((volatile short*)(ptr), (short)(val), (short)(old)) == (Bit16u)(old))
+#define BX_ATOMIC_CAS32(ptr,old,val) \
+    ((Bit32u) _InterlockedCompareExchange((volatile long*)(ptr), (long)(val), (long)(old)) == (Bit32u)(old))
+#define BX_ATOMIC_CAS64(ptr,old,val) \
+    ((Bit64u) _InterlockedCompareExchange64((volatile __int64*)(ptr), (__int64)(val), (__int64)(old)) == (Bit64u)(old))
+#define BX_ATOMIC_LOAD_ACQ(ptr) (_ReadWriteBarrier(), *(volatile Bit32u*)(ptr))
+#define BX_ATOMIC_STORE_REL(ptr,val) do { _ReadWriteBarrier(); *(volatile Bit32u*)(ptr) = (val); } while (0)
+#define BX_ATOMIC_INC32(ptr) _InterlockedIncrement((volatile long*)(ptr))
+
+#else
+
+#define BX_THREAD_LOCAL __thread
+#define BX_ATOMIC_OR8(ptr,val)   __atomic_fetch_or((Bit8u*)(ptr), (Bit8u)(val), __ATOMIC_SEQ_CST)
+#define BX_ATOMIC_OR32(ptr,val)  __atomic_fetch_or((Bit32u*)(ptr), (Bit32u)(val), __ATOMIC_SEQ_CST)
+#define BX_ATOMIC_AND32(ptr,val) __atomic_fetch_and((Bit32u*)(ptr), (Bit32u)(val), __ATOMIC_SEQ_CST)
+#define BX_ATOMIC_OR64(ptr,val)  __atomic_fetch_or((Bit64u*)(ptr), (Bit64u)(val), __ATOMIC_SEQ_CST)
+#define BX_ATOMIC_CAS_N(type,ptr,old,val) __extension__ ({ type bx_cas_old = (type)(old); \
+    __atomic_compare_exchange_n((type*)(ptr), &bx_cas_old, (type)(val), 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); })
+#define BX_ATOMIC_CAS8(ptr,old,val)  BX_ATOMIC_CAS_N(Bit8u,  ptr, old, val)
+#define BX_ATOMIC_CAS16(ptr,old,val) BX_ATOMIC_CAS_N(Bit16u, ptr, old, val)
+#define BX_ATOMIC_CAS32(ptr,old,val) BX_ATOMIC_CAS_N(Bit32u, ptr, old, val)
+#define BX_ATOMIC_CAS64(ptr,old,val) BX_ATOMIC_CAS_N(Bit64u, ptr, old, val)
+#define BX_ATOMIC_LOAD_ACQ(ptr) __atomic_load_n((Bit32u*)(ptr), __ATOMIC_ACQUIRE)
+#define BX_ATOMIC_STORE_REL(ptr,val) __atomic_store_n((Bit32u*)(ptr), (Bit32u)(val), __ATOMIC_RELEASE)
+#define BX_ATOMIC_INC32(ptr) __atomic_add_fetch((Bit32u*)(ptr), 1, __ATOMIC_SEQ_CST)
+
+#endif
+
 typedef struct
 {
 #if BX_WITH_SDL || BX_WITH_SDL2
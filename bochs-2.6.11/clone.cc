@@ -0,0 +1,139 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+/////////////////////////////////////////////////////////////////////////
+
+#include "bochs.h"
+#include "param_names.h"
+#include "iodev/iodev.h"
+#include "clone.h"
+
+#ifndef WIN32
+#include <sys/wait.h>
+#endif
+
+#define LOG_THIS genlog->
+
+static bx_bool clone_done = 0;
+static int clone_index = -1;
+
+int bx_clone_instance(void)
+{
+  return clone_index;
+}
+
+#ifndef WIN32
+// Detach the new process from the files it shares with the parent and the
+// other clones: the log file and the disk overlays get the instance number
+// appended to their names.
+static void clone_child(unsigned instance)
+{
+  const char *logfile = SIM->get_param_string(BXPN_LOG_FILENAME)->getptr();
+  char fname[BX_PATHNAME_LEN];
+
+  clone_index = instance;
+  if (strcmp(logfile, "-")) {
+    snprintf(fname, sizeof(fname), "%s.%u", logfile, instance);
+    io->exit_log();
+    io->init_log(fname);
+  }
+  io->set_async(SIM->get_param_bool(BXPN_LOG_ASYNC)->get());
+  if (!DEV_hd_clone_images(instance)) {
+    BX_PANIC(("clone %u: can't detach the disk images", instance));
+  }
+  BX_INFO(("clone %u of %u running as pid %d", instance,
+           (unsigned) SIM->get_param_num("count", SIM->get_param(BXPN_CLONE))->get(),
+           (int) getpid()));
+}
+#endif
+
+int bx_clone_instances(void)
+{
+  unsigned count = (unsigned) SIM->get_param_num("count", SIM->get_param(BXPN_CLONE))->get();
+
+  // a clone doesn't clone again
+  if ((count == 0) || clone_done) return -1;
+  clone_done = 1;
+
+#ifndef WIN32
+  // the gui holds connections to the host display, which can't be shared
+  if (strcmp(SIM->get_param_enum(BXPN_SEL_DISPLAY_LIBRARY)->get_selected(), "nogui")) {
+    BX_ERROR(("clone: requires 'display_library: nogui', not cloning"));
+    return -1;
+  }
+  if (!DEV_hd_clone_images(-1)) {
+    BX_ERROR(("clone: disk images can't be cloned, not cloning"));
+    return -1;
+  }
+
+  BX_INFO(("clone: forking %u instances at " FMT_TICK " ticks", count, bx_pc_system.time_ticks()));
+  // fork() only duplicates the calling thread, so the log writer is stopped
+  // and all buffered output is written before
+  io->set_async(0);
+#if BX_LARGE_RAMFILE
+  // the same for the memory overflow file writer, it starts again when needed
+  BX_MEM(0)->ramfile_sync(1);
+#endif
+  fflush(NULL);
+
+  pid_t *pids = new pid_t[count];
+  unsigned started = 0;
+  for (unsigned i = 0; i < count; i++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      delete [] pids;
+      clone_child(i);
+      return i;
+    }
+    if (pid < 0) {
+      BX_ERROR(("clone: fork of instance %u failed: %s", i, strerror(errno)));
+      break;
+    }
+    pids[started++] = pid;
+  }
+
+  // The parent doesn't run the guest any more, it only collects the clones.
+  // Bochs exits with status 1 after a guest shutdown as well, so only clones
+  // killed by a signal count as failed.
+  unsigned failed = count - started;
+  for (unsigned i = 0; i < started; i++) {
+    int status = 0;
+    while ((waitpid(pids[i], &status, 0) < 0) && (errno == EINTR));
+    if (WIFEXITED(status)) {
+      BX_INFO(("clone: instance %u (pid %d) exited with status %d", i, (int) pids[i], WEXITSTATUS(status)));
+    } else {
+      BX_INFO(("clone: instance %u (pid %d) was killed by signal %d", i, (int) pids[i], WTERMSIG(status)));
+    }
+    if (!WIFEXITED(status)) failed++;
+  }
+  delete [] pids;
+  BX_INFO(("clone: %u of %u instances failed", failed, count));
+
+  bx_user_quit = 1;
+#if BX_DEBUGGER
+  bx_dbg_exit(failed ? 1 : 0);
+#else
+  bx_atexit();
+  BX_EXIT(failed ? 1 : 0);
+#endif
+#else
+  BX_ERROR(("clone: not supported on this host"));
+#endif
+  return -1;
+}
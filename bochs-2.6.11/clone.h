@@ -0,0 +1,38 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_CLONE_H
+#define BX_CLONE_H
+
+// Boot once, clone many: when the guest writes to the clone port, Bochs
+// forks the configured number of host processes. They share the booted
+// guest RAM copy-on-write and each of them gets its own 'cow' disk overlays
+// and log files. The original process waits for all clones and exits.
+
+#define BX_CLONE_PORT 0x8918 // write: clone now, read: clone instance or ~0
+
+// Returns the instance number (0..count-1) in a new clone. In the parent
+// this only returns if cloning is disabled, already done or fails, with -1.
+int bx_clone_instances(void);
+// -1 if this process is not a clone
+int bx_clone_instance(void);
+
+#endif
@@ -22,6 +22,8 @@
 #include "bxversion.h"
 #include "iodev/iodev.h"
 #include "param_names.h"
+#include "profiler.h"
+#include "replay.h"
 #include <assert.h>
 
 #ifdef HAVE_LOCALE_H
@@ -347,6 +349,12 @@ void bx_init_options()
       "dumpstats mode",
       "dump statistics period",
       0, BX_MAX_BIT32U, 0);
+  // also log the statistics dumps to a CSV file, set by command line arg
+  new bx_param_filename_c(menu,
+      "dumpstats_csv",
+      "dumpstats CSV file",
+      "CSV file receiving one line per statistics dump",
+      "", BX_PATHNAME_LEN);
   // unlock disk images
   new bx_param_bool_c(menu,
       "unlock_images",
@@ -420,12 +428,27 @@ void bx_init_options()
       "Emulated instructions per second, used to calibrate bochs emulated time with wall clock time.",
       BX_MIN_IPS, BX_MAX_BIT32U,
       4000000);
+#if BX_CPU_LEVEL >= 5
+  new bx_param_num_c(cpu_param,
+      "tsc_freq", "TSC frequency (Hz)",
+      "Frequency of the time stamp counter in emulated time, 0 counts one tick per instruction",
+      0, BX_MAX_BIT32U,
+      0);
+  new bx_param_bool_c(cpu_param,
+      "pvclock", "Paravirtual clock page",
+      "Let the guest register a page through an MSR that Bochs fills with the emulated time and TSC scale",
+      0);
+#endif
 #if BX_SUPPORT_SMP
   new bx_param_num_c(cpu_param,
       "quantum", "Quantum ticks in SMP simulation",
       "Maximum amount of instructions allowed to execute before returning control to another CPU.",
       BX_SMP_QUANTUM_MIN, BX_SMP_QUANTUM_MAX,
       16);
+  new bx_param_bool_c(cpu_param,
+      "smp_threads", "Run each CPU on its own host thread",
+      "Run every emulated processor on a separate host thread, synchronized at timer events",
+      0);
 #endif
   new bx_param_bool_c(cpu_param,
       "reset_on_triple_fault", "Enable CPU reset on triple fault",
@@ -441,6 +464,12 @@ void bx_init_options()
       "cpuid_limit_winnt", "Limit max CPUID function to 3",
       "Limit max CPUID function reported to 3 to workaround WinNT issue",
       0);
+#if BX_CPU_LEVEL >= 6
+  new bx_param_bool_c(cpu_param,
+      "fast_fp", "Use host FPU for SSE floating point",
+      "Run SSE floating point on the host FPU when the result is exactly the same",
+      0);
+#endif
 #if BX_SUPPORT_MONITOR_MWAIT
   new bx_param_bool_c(cpu_param,
       "mwait_is_nop", "Don't put CPU to sleep state by MWAIT",
@@ -704,6 +733,26 @@ void bx_init_options()
   host_ramsize->set_ask_format("Enter host memory size (MB): [%d] ");
   ram->set_options(ram->SERIES_ASK);
 
+  bx_list_c *dedup = new bx_list_c(memory, "dedup", "Memory deduplication");
+  path = new bx_param_filename_c(dedup,
+      "store",
+      "Deduplication store",
+      "Pathname of the page store shared with other instances, empty to disable",
+      "", BX_PATHNAME_LEN);
+  path->set_format("Deduplication store: %s");
+  new bx_param_num_c(dedup,
+      "size",
+      "Deduplication store size (megabytes)",
+      "Number of megabytes of pages the store can hold when it is created",
+      1, 65536,
+      256);
+  new bx_param_num_c(dedup,
+      "scan",
+      "Pages scanned per pass",
+      "Number of guest pages looked at every 100 ms of emulated time",
+      1, BX_MAX_BIT32U,
+      1024);
+
   path = new bx_param_filename_c(rom,
       "file",
       "ROM BIOS image",
@@ -828,6 +877,10 @@ void bx_init_options()
       "rtc_sync", "Sync RTC speed with realtime",
       "If enabled, the RTC runs at realtime speed",
       0);
+  new bx_param_bool_c(clock_cmos,
+      "idle_skip", "Skip idle time of a halted CPU",
+      "If enabled, a halted CPU advances the time directly to the next timer event",
+      0);
   deplist = new bx_list_c(NULL);
   deplist->add(rtc_sync);
   clock_sync->set_dependent_list(deplist, 0);
@@ -982,6 +1035,12 @@ void bx_init_options()
       "If enabled, the VGA timer is based on realtime",
       1);
 
+  new bx_param_bool_c(display,
+      "vga_threaded",
+      "VGA display thread",
+      "If enabled, the screen is drawn by a separate host thread",
+      0);
+
   bx_param_num_c *vga_update_freq = new bx_param_num_c(display,
       "vga_update_frequency",
       "VGA Update Frequency",
@@ -1044,6 +1103,10 @@ void bx_init_options()
       "Defines the keyboard shortcut to be sent when you press the 'user' button in the headerbar.",
       "none", 20);
   user_shortcut->set_handler(bx_param_string_handler);
+  new bx_param_filename_c(keyboard,
+      "inject", "Input injection script",
+      "Pathname of a file or named pipe with send and expect commands for scripted keyboard input.",
+      "", BX_PATHNAME_LEN);
 
   static const char *mouse_type_list[] = {
     "none",
@@ -1590,6 +1653,11 @@ void bx_init_options()
       "Enable port 0xE9 hack",
       "Debug messages written to i/o port 0xE9 will be displayed on console",
       0);
+  new bx_param_filename_c(misc,
+      "port_e9_log",
+      "Port 0xE9 log file",
+      "Debug messages are written to this file with virtual time stamps instead of the console",
+      "", BX_PATHNAME_LEN);
 
   // GDB stub
   menu = new bx_list_c(misc, "gdbstub", "GDB Stub Options");
@@ -1627,6 +1695,121 @@ void bx_init_options()
     0);
   enabled->set_dependent_list(menu->clone());
 
+  // guest profiler
+  static const char *profile_unit_names[] = { "insn", "usec", NULL };
+  menu = new bx_list_c(misc, "profile", "Guest Profiler Options");
+  menu->set_options(menu->SHOW_PARENT | menu->USE_BOX_TITLE);
+  enabled = new bx_param_bool_c(menu,
+    "enabled",
+    "Enable guest profiler",
+    "Sample the guest instruction pointer and write a flat profile at exit",
+    0);
+  new bx_param_num_c(menu,
+    "interval",
+    "Sample interval",
+    "Number of instructions or microseconds between samples",
+    1, BX_MAX_BIT32U,
+    100000);
+  new bx_param_enum_c(menu,
+    "unit",
+    "Sample interval unit",
+    "Count the sample interval in instructions or emulated microseconds",
+    profile_unit_names,
+    BX_PROFILE_UNIT_INSN,
+    BX_PROFILE_UNIT_INSN);
+  new bx_param_filename_c(menu,
+    "symbols",
+    "Symbol map",
+    "nm style symbol map (address and name per line) used to name sampled addresses",
+    "", BX_PATHNAME_LEN);
+  new bx_param_filename_c(menu,
+    "file",
+    "Report file",
+    "The profile is written to this file when Bochs exits",
+    "profile.txt", BX_PATHNAME_LEN);
+  new bx_param_num_c(menu,
+    "callgraph",
+    "Call graph depth",
+    "Number of frame pointer links followed per sample, 0 disables the call graph",
+    0, BX_PROFILE_MAX_DEPTH,
+    0);
+  new bx_param_filename_c(menu,
+    "stacks",
+    "Call stack file",
+    "The call stacks are written to this file in the folded flame graph format",
+    "profile.folded", BX_PATHNAME_LEN);
+  enabled->set_dependent_list(menu->clone());
+
+  // deterministic record/replay
+  static const char *replay_mode_names[] = { "none", "record", "replay", NULL };
+  menu = new bx_list_c(misc, "replay", "Record/Replay Options");
+  menu->set_options(menu->SHOW_PARENT | menu->USE_BOX_TITLE);
+  new bx_param_enum_c(menu,
+    "mode",
+    "Record/replay mode",
+    "Record the input from the host, or replay a recorded run",
+    replay_mode_names,
+    BX_REPLAY_MODE_NONE,
+    BX_REPLAY_MODE_NONE);
+  new bx_param_filename_c(menu,
+    "file",
+    "Replay log",
+    "The log written when recording and read when replaying",
+    "bochs.rr", BX_PATHNAME_LEN);
+
+  // guest code coverage
+  static const char *coverage_mode_names[] = { "phys", "linear", NULL };
+  menu = new bx_list_c(misc, "coverage", "Guest Code Coverage Options");
+  menu->set_options(menu->SHOW_PARENT | menu->USE_BOX_TITLE);
+  enabled = new bx_param_bool_c(menu,
+    "enabled",
+    "Enable code coverage",
+    "Mark the guest code decoded into the trace cache and write the executed ranges at exit",
+    0);
+  new bx_param_enum_c(menu,
+    "mode",
+    "Coverage address mode",
+    "Mark code by physical address or by CR3 and linear address",
+    coverage_mode_names,
+    BX_COVERAGE_MODE_LINEAR,
+    BX_COVERAGE_MODE_PHYS);
+  new bx_param_filename_c(menu,
+    "symbols",
+    "Symbol map",
+    "nm style symbol map used for the per symbol coverage of supervisor code (linear mode)",
+    "", BX_PATHNAME_LEN);
+  new bx_param_filename_c(menu,
+    "file",
+    "Report file",
+    "The coverage report is written to this file when Bochs exits",
+    "coverage.txt", BX_PATHNAME_LEN);
+  enabled->set_dependent_list(menu->clone());
+
+  // port I/O statistics
+  menu = new bx_list_c(misc, "iostats", "Port I/O Statistics Options");
+  menu->set_options(menu->SHOW_PARENT | menu->USE_BOX_TITLE);
+  enabled = new bx_param_bool_c(menu,
+    "enabled",
+    "Enable port I/O statistics",
+    "Count accesses and host handler time per I/O port",
+    0);
+  new bx_param_filename_c(menu,
+    "file",
+    "Report file",
+    "The I/O statistics are written to this file when Bochs exits",
+    "iostats.txt", BX_PATHNAME_LEN);
+  enabled->set_dependent_list(menu->clone());
+
+  // boot once, clone many
+  menu = new bx_list_c(misc, "clone", "Clone Options");
+  menu->set_options(menu->SHOW_PARENT | menu->USE_BOX_TITLE);
+  new bx_param_num_c(menu,
+    "count",
+    "Number of clones",
+    "Number of processes forked when the guest writes to the clone port (0 = disabled)",
+    0, 256,
+    0);
+
 #if BX_PLUGINS
   // user plugin options
   menu = new bx_list_c(misc, "user_plugin", "User Plugin Options");
@@ -1664,6 +1847,17 @@ void bx_init_options()
       "%t%e%d", BX_LOGPREFIX_LEN);
   prefix->set_ask_format("Enter log prefix: [%s] ");
 
+  new bx_param_bool_c(menu,
+      "async",
+      "Asynchronous logging",
+      "Format and write log messages in a separate thread",
+      0);
+  new bx_param_num_c(menu,
+      "ratelimit",
+      "Log rate limit",
+      "Maximum number of messages per second from one log call site (0 = unlimited)",
+      0, BX_MAX_BIT32U, 0);
+
   path = new bx_param_filename_c(menu,
       "debugger_filename",
       "Debugger Log filename",
@@ -2565,10 +2759,21 @@ static int parse_line_formatted(const char *context, int num_params, char *param
       PARSE_ERR(("%s: floppy_bootsig_check directive malformed.", context));
     }
   } else if (!strcmp(params[0], "log")) {
-    if (num_params != 2) {
+    if (num_params < 2) {
       PARSE_ERR(("%s: log directive has wrong # args.", context));
     }
     SIM->get_param_string(BXPN_LOG_FILENAME)->set(params[1]);
+    for (i=2; i<num_params; i++) {
+      if (!strncmp(params[i], "async=", 6)) {
+        if (parse_param_bool(params[i], 6, BXPN_LOG_ASYNC) < 0) {
+          PARSE_ERR(("%s: log directive malformed.", context));
+        }
+      } else if (!strncmp(params[i], "ratelimit=", 10)) {
+        SIM->get_param_num(BXPN_LOG_RATELIMIT)->set(strtoul(&params[i][10], NULL, 10));
+      } else {
+        PARSE_ERR(("%s: log directive malformed.", context));
+      }
+    }
   } else if (!strcmp(params[0], "logprefix")) {
     if (num_params != 2) {
       PARSE_ERR(("%s: logprefix directive has wrong # args.", context));
@@ -2652,6 +2857,12 @@ static int parse_line_formatted(const char *context, int num_params, char *param
         SIM->get_param_num(BXPN_HOST_MEM_SIZE)->set(atol(&params[i][5]));
       } else if (!strncmp(params[i], "guest=", 6)) {
         SIM->get_param_num(BXPN_MEM_SIZE)->set(atol(&params[i][6]));
+      } else if (!strncmp(params[i], "dedup=", 6)) {
+        SIM->get_param_string(BXPN_MEM_DEDUP_STORE)->set(&params[i][6]);
+      } else if (!strncmp(params[i], "dedup_size=", 11)) {
+        SIM->get_param_num(BXPN_MEM_DEDUP_SIZE)->set(atol(&params[i][11]));
+      } else if (!strncmp(params[i], "dedup_scan=", 11)) {
+        SIM->get_param_num(BXPN_MEM_DEDUP_SCAN)->set(atol(&params[i][11]));
       } else {
         PARSE_ERR(("%s: memory directive malformed.", context));
       }
@@ -2747,6 +2958,8 @@ static int parse_line_formatted(const char *context, int num_params, char *param
         SIM->get_param_num(BXPN_VGA_UPDATE_FREQUENCY)->set(atol(&params[i][12]));
       } else if (!strncmp(params[i], "realtime=", 9)) {
         SIM->get_param_bool(BXPN_VGA_REALTIME)->set(atol(&params[i][9]));
+      } else if (!strncmp(params[i], "threaded=", 9)) {
+        SIM->get_param_bool(BXPN_VGA_THREADED)->set(atol(&params[i][9]));
       } else {
         PARSE_ERR(("%s: vga directive malformed.", context));
       }
@@ -2866,6 +3079,9 @@ static int parse_line_formatted(const char *context, int num_params, char *param
       else if (!strncmp(params[i], "rtc_sync=", 9)) {
         SIM->get_param_bool(BXPN_CLOCK_RTC_SYNC)->set(atol(&params[i][9]));
       }
+      else if (!strncmp(params[i], "idle_skip=", 10)) {
+        SIM->get_param_bool(BXPN_CLOCK_IDLE_SKIP)->set(atol(&params[i][10]));
+      }
       else if (!strcmp(params[i], "time0=local")) {
         SIM->get_param_num(BXPN_CLOCK_TIME0)->set(BX_CLOCK_TIME0_LOCAL);
       }
@@ -2980,6 +3196,36 @@ static int parse_line_formatted(const char *context, int num_params, char *param
     if (parse_debug_symbols(context, (const char **)(params + 1), num_params - 1) < 0) {
       return -1;
     }
+  } else if (!strcmp(params[0], "profile")) {
+    for (i=1; i<num_params; i++) {
+      if (bx_parse_param_from_list(context, params[i], (bx_list_c*) SIM->get_param(BXPN_PROFILE)) < 0) {
+        PARSE_ERR(("%s: profile directive malformed.", context));
+      }
+    }
+  } else if (!strcmp(params[0], "replay")) {
+    for (i=1; i<num_params; i++) {
+      if (bx_parse_param_from_list(context, params[i], (bx_list_c*) SIM->get_param(BXPN_REPLAY)) < 0) {
+        PARSE_ERR(("%s: replay directive malformed.", context));
+      }
+    }
+  } else if (!strcmp(params[0], "coverage")) {
+    for (i=1; i<num_params; i++) {
+      if (bx_parse_param_from_list(context, params[i], (bx_list_c*) SIM->get_param(BXPN_COVERAGE)) < 0) {
+        PARSE_ERR(("%s: coverage directive malformed.", context));
+      }
+    }
+  } else if (!strcmp(params[0], "iostats")) {
+    for (i=1; i<num_params; i++) {
+      if (bx_parse_param_from_list(context, params[i], (bx_list_c*) SIM->get_param(BXPN_IOSTATS)) < 0) {
+        PARSE_ERR(("%s: iostats directive malformed.", context));
+      }
+    }
+  } else if (!strcmp(params[0], "clone")) {
+    for (i=1; i<num_params; i++) {
+      if (bx_parse_param_from_list(context, params[i], (bx_list_c*) SIM->get_param(BXPN_CLONE)) < 0) {
+        PARSE_ERR(("%s: clone directive malformed.", context));
+      }
+    }
   } else if (!strcmp(params[0], "print_timestamps")) {
     if (num_params != 2) {
       PARSE_ERR(("%s: print_timestamps directive: wrong # args.", context));
@@ -2994,7 +3240,7 @@ static int parse_line_formatted(const char *context, int num_params, char *param
       PARSE_ERR(("%s: print_timestamps directive malformed.", context));
     }
   } else if (!strcmp(params[0], "port_e9_hack")) {
-    if (num_params != 2) {
+    if ((num_params < 2) || (num_params > 3)) {
       PARSE_ERR(("%s: port_e9_hack directive: wrong # args.", context));
     }
     if (strncmp(params[1], "enabled=", 8)) {
@@ -3003,6 +3249,12 @@ static int parse_line_formatted(const char *context, int num_params, char *param
     if (parse_param_bool(params[1], 8, BXPN_PORT_E9_HACK) < 0) {
       PARSE_ERR(("%s: port_e9_hack directive malformed.", context));
     }
+    if (num_params == 3) {
+      if (strncmp(params[2], "file=", 5)) {
+        PARSE_ERR(("%s: port_e9_hack directive malformed.", context));
+      }
+      SIM->get_param_string(BXPN_PORT_E9_LOG)->set(&params[2][5]);
+    }
   } else if (!strcmp(params[0], "load32bitOSImage")) {
 #if BX_LOAD32BITOSHACK
     if ((num_params!=4) && (num_params!=5)) {
@@ -3225,7 +3477,8 @@ int bx_write_clock_cmos_options(FILE *fp)
       fprintf(fp, ", time0=%u", SIM->get_param_num(BXPN_CLOCK_TIME0)->get());
   }
 
-  fprintf(fp, ", rtc_sync=%d\n", SIM->get_param_bool(BXPN_CLOCK_RTC_SYNC)->get());
+  fprintf(fp, ", rtc_sync=%d, idle_skip=%d\n", SIM->get_param_bool(BXPN_CLOCK_RTC_SYNC)->get(),
+          SIM->get_param_bool(BXPN_CLOCK_IDLE_SKIP)->get());
 
   if (strlen(SIM->get_param_string(BXPN_CMOSIMAGE_PATH)->getptr()) > 0) {
     fprintf(fp, "cmosimage: file=%s, ", SIM->get_param_string(BXPN_CMOSIMAGE_PATH)->getptr());
@@ -3243,7 +3496,14 @@ int bx_write_log_options(FILE *fp, bx_list_c *base)
   bx_param_num_c *mparam;
   int action, def_action, level, mod;
 
-  fprintf(fp, "log: %s\n", SIM->get_param_string("filename", base)->getptr());
+  fprintf(fp, "log: %s", SIM->get_param_string("filename", base)->getptr());
+  if (SIM->get_param_bool("async", base)->get()) {
+    fprintf(fp, ", async=1");
+  }
+  if (SIM->get_param_num("ratelimit", base)->get() > 0) {
+    fprintf(fp, ", ratelimit=%u", (Bit32u) SIM->get_param_num("ratelimit", base)->get());
+  }
+  fprintf(fp, "\n");
   fprintf(fp, "logprefix: %s\n", SIM->get_param_string("prefix", base)->getptr());
 
   strcpy(pname, "general.logfn");
@@ -3332,8 +3592,14 @@ int bx_write_configuration(const char *rc, int overwrite)
     fprintf(fp, ", options=\"%s\"\n", sparam->getptr());
   else
     fprintf(fp, "\n");
-  fprintf(fp, "memory: host=%d, guest=%d\n", SIM->get_param_num(BXPN_HOST_MEM_SIZE)->get(),
+  fprintf(fp, "memory: host=%d, guest=%d", SIM->get_param_num(BXPN_HOST_MEM_SIZE)->get(),
     SIM->get_param_num(BXPN_MEM_SIZE)->get());
+  sparam = SIM->get_param_string(BXPN_MEM_DEDUP_STORE);
+  if (!sparam->isempty()) {
+    fprintf(fp, ", dedup=%s, dedup_size=%d, dedup_scan=%d", sparam->getptr(),
+      SIM->get_param_num(BXPN_MEM_DEDUP_SIZE)->get(), SIM->get_param_num(BXPN_MEM_DEDUP_SCAN)->get());
+  }
+  fprintf(fp, "\n");
 
   bx_write_param_list(fp, (bx_list_c*) SIM->get_param(BXPN_ROMIMAGE), "romimage", 0);
   bx_write_param_list(fp, (bx_list_c*) SIM->get_param(BXPN_VGA_ROMIMAGE), "vgaromimage", 0);
@@ -3384,15 +3650,16 @@ int bx_write_configuration(const char *rc, int overwrite)
     }
   }
   fprintf(fp, "\n");
-  fprintf(fp, "vga: extension=%s, update_freq=%u, realtime=%u\n",
+  fprintf(fp, "vga: extension=%s, update_freq=%u, realtime=%u, threaded=%u\n",
     SIM->get_param_string(BXPN_VGA_EXTENSION)->getptr(),
     SIM->get_param_num(BXPN_VGA_UPDATE_FREQUENCY)->get(),
-    SIM->get_param_bool(BXPN_VGA_REALTIME)->get());
+    SIM->get_param_bool(BXPN_VGA_REALTIME)->get(),
+    SIM->get_param_bool(BXPN_VGA_THREADED)->get());
 #if BX_SUPPORT_SMP
-  fprintf(fp, "cpu: count=%u:%u:%u, ips=%u, quantum=%d, ",
+  fprintf(fp, "cpu: count=%u:%u:%u, ips=%u, quantum=%d, smp_threads=%d, ",
     SIM->get_param_num(BXPN_CPU_NPROCESSORS)->get(), SIM->get_param_num(BXPN_CPU_NCORES)->get(),
     SIM->get_param_num(BXPN_CPU_NTHREADS)->get(), SIM->get_param_num(BXPN_IPS)->get(),
-    SIM->get_param_num(BXPN_SMP_QUANTUM)->get());
+    SIM->get_param_num(BXPN_SMP_QUANTUM)->get(), SIM->get_param_bool(BXPN_SMP_THREADS)->get());
 #else
   fprintf(fp, "cpu: count=1, ips=%u, ", SIM->get_param_num(BXPN_IPS)->get());
 #endif
@@ -3402,6 +3669,11 @@ int bx_write_configuration(const char *rc, int overwrite)
     SIM->get_param_bool(BXPN_CPUID_LIMIT_WINNT)->get());
 #if BX_CPU_LEVEL >= 5
   fprintf(fp, ", ignore_bad_msrs=%d", SIM->get_param_bool(BXPN_IGNORE_BAD_MSRS)->get());
+  fprintf(fp, ", tsc_freq=%u", SIM->get_param_num(BXPN_TSC_FREQ)->get());
+  fprintf(fp, ", pvclock=%d", SIM->get_param_bool(BXPN_PVCLOCK)->get());
+#endif
+#if BX_CPU_LEVEL >= 6
+  fprintf(fp, ", fast_fp=%d", SIM->get_param_bool(BXPN_FAST_FP)->get());
 #endif
 #if BX_SUPPORT_MONITOR_MWAIT
   fprintf(fp, ", mwait_is_nop=%d", SIM->get_param_bool(BXPN_MWAIT_IS_NOP)->get());
@@ -3422,7 +3694,16 @@ int bx_write_configuration(const char *rc, int overwrite)
 
   fprintf(fp, "print_timestamps: enabled=%d\n", bx_dbg.print_timestamps);
   bx_write_debugger_options(fp);
-  fprintf(fp, "port_e9_hack: enabled=%d\n", SIM->get_param_bool(BXPN_PORT_E9_HACK)->get());
+  fprintf(fp, "port_e9_hack: enabled=%d", SIM->get_param_bool(BXPN_PORT_E9_HACK)->get());
+  if (strlen(SIM->get_param_string(BXPN_PORT_E9_LOG)->getptr()) > 0) {
+    fprintf(fp, ", file=%s", SIM->get_param_string(BXPN_PORT_E9_LOG)->getptr());
+  }
+  fprintf(fp, "\n");
+  bx_write_param_list(fp, (bx_list_c*) SIM->get_param(BXPN_PROFILE), NULL, 0);
+  bx_write_param_list(fp, (bx_list_c*) SIM->get_param(BXPN_REPLAY), NULL, 0);
+  bx_write_param_list(fp, (bx_list_c*) SIM->get_param(BXPN_COVERAGE), NULL, 0);
+  bx_write_param_list(fp, (bx_list_c*) SIM->get_param(BXPN_IOSTATS), NULL, 0);
+  bx_write_param_list(fp, (bx_list_c*) SIM->get_param(BXPN_CLONE), NULL, 0);
   fprintf(fp, "private_colormap: enabled=%d\n", SIM->get_param_bool(BXPN_PRIVATE_COLORMAP)->get());
 #if BX_WITH_AMIGAOS
   fprintf(fp, "fullscreen: enabled=%d\n", SIM->get_param_bool(BXPN_FULLSCREEN)->get());
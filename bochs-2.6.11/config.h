@@ -127,6 +127,8 @@
 #define BX_HAVE_REALTIME_USEC (BX_HAVE_GETTIMEOFDAY)
 #endif
 #define BX_HAVE_MKSTEMP 1
+#define BX_HAVE_FTRUNCATE 1
+#define BX_HAVE_POSIX_FALLOCATE 1
 #define BX_HAVE_SYS_MMAN_H 1
 #define BX_HAVE_XPM_H 1
 #define BX_HAVE_XRANDR_H 1
@@ -582,7 +584,7 @@ typedef
 
 
 // for now only term.cc requires a GUI sighandler.
-#define BX_GUI_SIGHANDLER (BX_WITH_TERM)
+#define BX_GUI_SIGHANDLER (BX_WITH_TERM || BX_WITH_NOGUI)
 
 #define HAVE_SIGACTION 1
 
@@ -691,6 +693,15 @@ typedef
 #define BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS 0
 #define BX_ENABLE_TRACE_LINKING 0
 
+// Fuse compare and branch pairs into one handler when a trace is built.
+// Every slot of a trace has to be dispatched from cpu_loop for that and
+// the instrumentation and gdb-stub have to see the single instructions.
+#if BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS == 0 && BX_GDBSTUB == 0 && BX_INSTRUMENTATION == 0
+#define BX_SUPPORT_INSTRUCTION_FUSION 1
+#else
+#define BX_SUPPORT_INSTRUCTION_FUSION 0
+#endif
+
 #if (BX_DEBUGGER || BX_GDBSTUB) && BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS
  #error "Handler-chaining-speedups are not supported together with internal debugger or gdb-stub!"
 #endif
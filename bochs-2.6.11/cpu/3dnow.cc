@@ -34,6 +34,7 @@ BX_CPP_INLINE void prepare_softfloat_status_word(float_status_t &status, int rou
   status.float_nan_handling_mode = float_first_operand_nan;
   status.float_rounding_mode = rounding_mode;
   status.flush_underflow_to_zero = 0;
+  status.host_fast_path = 0;
 }
 
 void BX_CPP_AttrRegparmN(1) BX_CPU_C::PFPNACC_PqQq(bxInstruction_c *i)
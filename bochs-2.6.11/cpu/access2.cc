@@ -598,6 +598,99 @@ BX_CPU_C::read_linear_zmmword_aligned(unsigned s, bx_address laddr, BxPackedZmmR
 // address translation info is kept across read/write calls //
 //////////////////////////////////////////////////////////////
 
+#if BX_SUPPORT_SMP
+
+// With the processors on their own threads the write of a read-modify-write
+// instruction only takes place if the memory still holds the value that
+// was read. Otherwise another processor wrote it in between and the
+// instruction is executed again. Misaligned accesses are not atomic.
+void BX_CPU_C::write_RMW_atomic(void *hostAddr, unsigned len, Bit64u val)
+{
+#ifdef BX_LITTLE_ENDIAN
+  if (((bx_ptr_equiv_t) hostAddr & (len - 1)) == 0) {
+    Bit64u old = BX_CPU_THIS_PTR address_xlation.rmw_old;
+    bx_bool ok;
+
+    switch(len) {
+    case 1:
+      ok = BX_ATOMIC_CAS8(hostAddr, old, val);
+      break;
+    case 2:
+      ok = BX_ATOMIC_CAS16(hostAddr, old, val);
+      break;
+    case 4:
+      ok = BX_ATOMIC_CAS32(hostAddr, old, val);
+      break;
+    default:
+      ok = BX_ATOMIC_CAS64(hostAddr, old, val);
+      break;
+    }
+    if (ok) return;
+
+    // restore RIP/RSP to value before the instruction and restart it
+    RIP = BX_CPU_THIS_PTR prev_rip;
+    if (BX_CPU_THIS_PTR speculative_rsp) {
+      RSP = BX_CPU_THIS_PTR prev_rsp;
+#if BX_SUPPORT_CET
+      SSP = BX_CPU_THIS_PTR prev_ssp;
+#endif
+    }
+    BX_CPU_THIS_PTR speculative_rsp = 0;
+    BX_CPU_THIS_PTR icount--; // counted again by the main loop
+    longjmp(BX_CPU_THIS_PTR jmp_buf_env, 1); // go back to main decode loop
+  }
+#endif
+
+  switch(len) {
+  case 1:
+    *(Bit8u *) hostAddr = (Bit8u) val;
+    break;
+  case 2:
+    WriteHostWordToLittleEndian((Bit16u *) hostAddr, (Bit16u) val);
+    break;
+  case 4:
+    WriteHostDWordToLittleEndian((Bit32u *) hostAddr, (Bit32u) val);
+    break;
+  default:
+    WriteHostQWordToLittleEndian((Bit64u *) hostAddr, val);
+    break;
+  }
+}
+
+// the R-M-W access was translated through the slow path and fits in one page
+void BX_CPU_C::write_RMW_physical(unsigned len, void *data)
+{
+  bx_phy_address paddr = BX_CPU_THIS_PTR address_xlation.paddress1;
+  Bit8u *hostAddr = (Bit8u *) getHostMemAddr(paddr, BX_WRITE);
+
+  if (hostAddr == NULL) {
+    // memory mapped device or monitored page
+    access_write_physical(paddr, len, data);
+    return;
+  }
+
+  Bit64u val;
+  switch(len) {
+  case 1:
+    val = *(Bit8u *) data;
+    break;
+  case 2:
+    val = *(Bit16u *) data;
+    break;
+  case 4:
+    val = *(Bit32u *) data;
+    break;
+  default:
+    val = *(Bit64u *) data;
+    break;
+  }
+
+  pageWriteStampTable.decWriteStamp(paddr, len);
+  write_RMW_atomic(hostAddr, len, val);
+}
+
+#endif
+
   Bit8u BX_CPP_AttrRegparmN(2)
 BX_CPU_C::read_RMW_linear_byte(unsigned s, bx_address laddr)
 {
@@ -617,6 +710,9 @@ BX_CPU_C::read_RMW_linear_byte(unsigned s, bx_address laddr)
       BX_CPU_THIS_PTR address_xlation.paddress1 = pAddr;
 #if BX_SUPPORT_MEMTYPE
       BX_CPU_THIS_PTR address_xlation.memtype1 = tlbEntry->get_memtype();
+#endif
+#if BX_SUPPORT_SMP
+      BX_CPU_THIS_PTR address_xlation.rmw_old = data;
 #endif
       BX_NOTIFY_LIN_MEMORY_ACCESS(laddr, pAddr, 1, tlbEntry->get_memtype(), BX_RW, (Bit8u*) &data);
       return data;
@@ -626,6 +722,9 @@ BX_CPU_C::read_RMW_linear_byte(unsigned s, bx_address laddr)
   if (access_read_linear(laddr, 1, CPL, BX_RW, 0x0, (void *) &data) < 0)
     exception(int_number(s), 0);
 
+#if BX_SUPPORT_SMP
+  BX_CPU_THIS_PTR address_xlation.rmw_old = data;
+#endif
   return data;
 }
 
@@ -652,6 +751,9 @@ BX_CPU_C::read_RMW_linear_word(unsigned s, bx_address laddr)
       BX_CPU_THIS_PTR address_xlation.paddress1 = pAddr;
 #if BX_SUPPORT_MEMTYPE
       BX_CPU_THIS_PTR address_xlation.memtype1 = tlbEntry->get_memtype();
+#endif
+#if BX_SUPPORT_SMP
+      BX_CPU_THIS_PTR address_xlation.rmw_old = data;
 #endif
       BX_NOTIFY_LIN_MEMORY_ACCESS(laddr, pAddr, 2, tlbEntry->get_memtype(), BX_RW, (Bit8u*) &data);
       return data;
@@ -661,6 +763,9 @@ BX_CPU_C::read_RMW_linear_word(unsigned s, bx_address laddr)
   if (access_read_linear(laddr, 2, CPL, BX_RW, 0x1, (void *) &data) < 0)
     exception(int_number(s), 0);
 
+#if BX_SUPPORT_SMP
+  BX_CPU_THIS_PTR address_xlation.rmw_old = data;
+#endif
   return data;
 }
 
@@ -687,6 +792,9 @@ BX_CPU_C::read_RMW_linear_dword(unsigned s, bx_address laddr)
       BX_CPU_THIS_PTR address_xlation.paddress1 = pAddr;
 #if BX_SUPPORT_MEMTYPE
       BX_CPU_THIS_PTR address_xlation.memtype1 = tlbEntry->get_memtype();
+#endif
+#if BX_SUPPORT_SMP
+      BX_CPU_THIS_PTR address_xlation.rmw_old = data;
 #endif
       BX_NOTIFY_LIN_MEMORY_ACCESS(laddr, pAddr, 4, tlbEntry->get_memtype(), BX_RW, (Bit8u*) &data);
       return data;
@@ -696,6 +804,9 @@ BX_CPU_C::read_RMW_linear_dword(unsigned s, bx_address laddr)
   if (access_read_linear(laddr, 4, CPL, BX_RW, 0x3, (void *) &data) < 0)
     exception(int_number(s), 0);
 
+#if BX_SUPPORT_SMP
+  BX_CPU_THIS_PTR address_xlation.rmw_old = data;
+#endif
   return data;
 }
 
@@ -722,6 +833,9 @@ BX_CPU_C::read_RMW_linear_qword(unsigned s, bx_address laddr)
       BX_CPU_THIS_PTR address_xlation.paddress1 = pAddr;
 #if BX_SUPPORT_MEMTYPE
       BX_CPU_THIS_PTR address_xlation.memtype1 = tlbEntry->get_memtype();
+#endif
+#if BX_SUPPORT_SMP
+      BX_CPU_THIS_PTR address_xlation.rmw_old = data;
 #endif
       BX_NOTIFY_LIN_MEMORY_ACCESS(laddr, pAddr, 8, tlbEntry->get_memtype(), BX_RW, (Bit8u*) &data);
       return data;
@@ -731,6 +845,9 @@ BX_CPU_C::read_RMW_linear_qword(unsigned s, bx_address laddr)
   if (access_read_linear(laddr, 8, CPL, BX_RW, 0x7, (void *) &data) < 0)
     exception(int_number(s), 0);
 
+#if BX_SUPPORT_SMP
+  BX_CPU_THIS_PTR address_xlation.rmw_old = data;
+#endif
   return data;
 }
 
@@ -743,10 +860,20 @@ BX_CPU_C::write_RMW_linear_byte(Bit8u val8)
   if (BX_CPU_THIS_PTR address_xlation.pages > 2) {
     // Pages > 2 means it stores a host address for direct access.
     Bit8u *hostAddr = (Bit8u *) BX_CPU_THIS_PTR address_xlation.pages;
+#if BX_SUPPORT_SMP
+    if (bx_smp_threaded)
+      write_RMW_atomic(hostAddr, 1, val8);
+    else
+#endif
     *hostAddr = val8;
   }
   else {
     // address_xlation.pages must be 1
+#if BX_SUPPORT_SMP
+    if (bx_smp_threaded)
+      write_RMW_physical(1, &val8);
+    else
+#endif
     access_write_physical(BX_CPU_THIS_PTR address_xlation.paddress1, 1, &val8);
   }
 }
@@ -757,12 +884,22 @@ BX_CPU_C::write_RMW_linear_word(Bit16u val16)
   if (BX_CPU_THIS_PTR address_xlation.pages > 2) {
     // Pages > 2 means it stores a host address for direct access.
     Bit16u *hostAddr = (Bit16u *) BX_CPU_THIS_PTR address_xlation.pages;
+#if BX_SUPPORT_SMP
+    if (bx_smp_threaded)
+      write_RMW_atomic(hostAddr, 2, val16);
+    else
+#endif
     WriteHostWordToLittleEndian(hostAddr, val16);
     BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID,
         BX_CPU_THIS_PTR address_xlation.paddress1, 2, MEMTYPE(BX_CPU_THIS_PTR address_xlation.memtype1),
         BX_WRITE, 0, (Bit8u*) &val16);
   }
   else if (BX_CPU_THIS_PTR address_xlation.pages == 1) {
+#if BX_SUPPORT_SMP
+    if (bx_smp_threaded)
+      write_RMW_physical(2, &val16);
+    else
+#endif
     access_write_physical(BX_CPU_THIS_PTR address_xlation.paddress1, 2, &val16);
     BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID,
         BX_CPU_THIS_PTR address_xlation.paddress1, 2, MEMTYPE(BX_CPU_THIS_PTR address_xlation.memtype1),
@@ -797,12 +934,22 @@ BX_CPU_C::write_RMW_linear_dword(Bit32u val32)
   if (BX_CPU_THIS_PTR address_xlation.pages > 2) {
     // Pages > 2 means it stores a host address for direct access.
     Bit32u *hostAddr = (Bit32u *) BX_CPU_THIS_PTR address_xlation.pages;
+#if BX_SUPPORT_SMP
+    if (bx_smp_threaded)
+      write_RMW_atomic(hostAddr, 4, val32);
+    else
+#endif
     WriteHostDWordToLittleEndian(hostAddr, val32);
     BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID,
         BX_CPU_THIS_PTR address_xlation.paddress1, 4, MEMTYPE(BX_CPU_THIS_PTR address_xlation.memtype1),
         BX_WRITE, 0, (Bit8u*) &val32);
   }
   else if (BX_CPU_THIS_PTR address_xlation.pages == 1) {
+#if BX_SUPPORT_SMP
+    if (bx_smp_threaded)
+      write_RMW_physical(4, &val32);
+    else
+#endif
     access_write_physical(BX_CPU_THIS_PTR address_xlation.paddress1, 4, &val32);
     BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID,
         BX_CPU_THIS_PTR address_xlation.paddress1, 4, MEMTYPE(BX_CPU_THIS_PTR address_xlation.memtype1),
@@ -847,12 +994,22 @@ BX_CPU_C::write_RMW_linear_qword(Bit64u val64)
   if (BX_CPU_THIS_PTR address_xlation.pages > 2) {
     // Pages > 2 means it stores a host address for direct access.
     Bit64u *hostAddr = (Bit64u *) BX_CPU_THIS_PTR address_xlation.pages;
+#if BX_SUPPORT_SMP
+    if (bx_smp_threaded)
+      write_RMW_atomic(hostAddr, 8, val64);
+    else
+#endif
     WriteHostQWordToLittleEndian(hostAddr, val64);
     BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID,
         BX_CPU_THIS_PTR address_xlation.paddress1, 8, MEMTYPE(BX_CPU_THIS_PTR address_xlation.memtype1),
         BX_WRITE, 0, (Bit8u*) &val64);
   }
   else if (BX_CPU_THIS_PTR address_xlation.pages == 1) {
+#if BX_SUPPORT_SMP
+    if (bx_smp_threaded)
+      write_RMW_physical(8, &val64);
+    else
+#endif
     access_write_physical(BX_CPU_THIS_PTR address_xlation.paddress1, 8, &val64);
     BX_DBG_PHY_MEMORY_ACCESS(BX_CPU_ID,
         BX_CPU_THIS_PTR address_xlation.paddress1, 8, MEMTYPE(BX_CPU_THIS_PTR address_xlation.memtype1),
@@ -911,6 +1068,10 @@ void BX_CPU_C::read_RMW_linear_dqword_aligned_64(unsigned s, bx_address laddr, B
       BX_CPU_THIS_PTR address_xlation.paddress1 = pAddr;
 #if BX_SUPPORT_MEMTYPE
       BX_CPU_THIS_PTR address_xlation.memtype1 = tlbEntry->get_memtype();
+#endif
+#if BX_SUPPORT_SMP
+      BX_CPU_THIS_PTR address_xlation.rmw_old = *lo;
+      BX_CPU_THIS_PTR address_xlation.rmw_old_hi = *hi;
 #endif
       BX_NOTIFY_LIN_MEMORY_ACCESS(laddr,     pAddr,     8, tlbEntry->get_memtype(), BX_RW, (Bit8u*) lo);
       BX_NOTIFY_LIN_MEMORY_ACCESS(laddr + 8, pAddr + 8, 8, tlbEntry->get_memtype(), BX_RW, (Bit8u*) hi);
@@ -929,6 +1090,10 @@ void BX_CPU_C::read_RMW_linear_dqword_aligned_64(unsigned s, bx_address laddr, B
 
   *lo = data.xmm64u(0);
   *hi = data.xmm64u(1);
+#if BX_SUPPORT_SMP
+  BX_CPU_THIS_PTR address_xlation.rmw_old = *lo;
+  BX_CPU_THIS_PTR address_xlation.rmw_old_hi = *hi;
+#endif
 }
 
 void BX_CPU_C::write_RMW_linear_dqword(Bit64u hi, Bit64u lo)
@@ -944,6 +1109,11 @@ void BX_CPU_C::write_RMW_linear_dqword(Bit64u hi, Bit64u lo)
     BX_ASSERT(BX_CPU_THIS_PTR address_xlation.pages == 1);
   }
   
+#if BX_SUPPORT_SMP
+  // the halves are compared one after the other, a conflict on the high
+  // half is seen by the instruction executed again as a changed low half
+  BX_CPU_THIS_PTR address_xlation.rmw_old = BX_CPU_THIS_PTR address_xlation.rmw_old_hi;
+#endif
   write_RMW_linear_qword(hi);
 }
 
@@ -146,6 +146,7 @@ int apic_bus_broadcast_interrupt(Bit8u vector, Bit8u delivery_mode, bx_bool trig
 
 static void apic_bus_broadcast_eoi(Bit8u vector)
 {
+  BX_SMP_LOCK_SCOPE();
   DEV_ioapic_receive_eoi(vector);
 }
 
@@ -820,6 +821,12 @@ void bx_local_apic_c::service_local_apic(void)
 
 bx_bool bx_local_apic_c::deliver(Bit8u vector, Bit8u delivery_mode, Bit8u trig_mode)
 {
+#if BX_SUPPORT_SMP
+  // the target processor accepts the interrupt on its own thread
+  if (BX_SMP_REMOTE(cpu))
+    return bx_smp_post_apic(cpu, vector, delivery_mode, trig_mode);
+#endif
+
   switch(delivery_mode) {
   case APIC_DM_FIXED:
   case APIC_DM_LOWPRI:
@@ -1053,6 +1060,8 @@ void bx_local_apic_c::periodic(void)
     // one-shot mode
     timer_current = 0;
     timer_active = 0;
+    // an expired TSC-deadline timer reads back as zero
+    if (timervec & 0x40000) ticksInitial = 0;
     BX_DEBUG(("local apic timer(one-shot) triggered int"));
     bx_pc_system.deactivate_timer(timer_handle);
   }
@@ -1068,6 +1077,37 @@ void bx_local_apic_c::set_divide_configuration(Bit32u value)
   BX_INFO(("set timer divide factor to %d", timer_divide_factor));
 }
 
+#if BX_SUPPORT_PERFMON
+// a performance counter overflowed: deliver the LVT performance counter
+// interrupt, the entry masks itself until the handler unmasks it
+void bx_local_apic_c::perfmon_overflow(void)
+{
+  Bit32u perfvec = lvt[APIC_LVT_PERFMON];
+
+  if (perfvec & 0x10000) {
+    BX_DEBUG(("local apic performance counter LVT masked"));
+    return;
+  }
+
+  switch((perfvec >> 8) & 7) {
+  case APIC_DM_FIXED:
+    trigger_irq(perfvec & 0xff, APIC_EDGE_TRIGGERED);
+    break;
+  case APIC_DM_SMI:
+    cpu->deliver_SMI();
+    break;
+  case APIC_DM_NMI:
+    cpu->deliver_NMI();
+    break;
+  default:
+    BX_ERROR(("perfmon_overflow: delivery mode %d not supported", (perfvec >> 8) & 7));
+    return;
+  }
+
+  lvt[APIC_LVT_PERFMON] |= 0x10000;
+}
+#endif
+
 void bx_local_apic_c::set_initial_timer_count(Bit32u value)
 {
 #if BX_CPU_LEVEL >= 6
@@ -1139,9 +1179,11 @@ void bx_local_apic_c::set_tsc_deadline(Bit64u deadline)
   ticksInitial = deadline;
   if (deadline != 0) {
     BX_DEBUG(("APIC: TSC-Deadline is set to " FMT_LL "d", deadline));
-    Bit64u currtime = bx_pc_system.time_ticks();
+    // one-shot timer for the emulated time left until the TSC reaches the deadline
+    Bit64u currtsc = cpu->get_TSC();
+    Bit64u ticks = (deadline > currtsc) ? cpu->tsc_to_ticks(deadline - currtsc) : 1;
     timer_active = 1;
-    bx_pc_system.activate_timer_ticks(timer_handle, (deadline > currtime) ? (deadline - currtime) : 1 , 0);
+    bx_pc_system.activate_timer_ticks(timer_handle, ticks, 0);
   }
 }
 
@@ -260,6 +260,9 @@ public:
   static void periodic_smf(void *);
   void periodic(void);
   void set_divide_configuration(Bit32u value);
+#if BX_SUPPORT_PERFMON
+  void perfmon_overflow(void);
+#endif
   void set_initial_timer_count(Bit32u value);
   Bit32u get_current_timer_count(void);
 
@@ -26,7 +26,11 @@
 
 #include "cpustats.h"
 
+#if BX_SUPPORT_SMP
+BX_THREAD_LOCAL jmp_buf BX_CPU_C::jmp_buf_env;
+#else
 jmp_buf BX_CPU_C::jmp_buf_env;
+#endif
 
 void BX_CPU_C::cpu_loop(void)
 {
@@ -80,6 +84,7 @@ void BX_CPU_C::cpu_loop(void)
     for(;;) {
       // want to allow changing of the instruction inside instrumentation callback
       BX_INSTR_BEFORE_EXECUTION(BX_CPU_ID, i);
+      INC_OPCODE_STAT(i);
       RIP += i->ilen();
       // when handlers chaining is enabled this single call will execute entire trace
       BX_CPU_CALL_METHOD(i->execute1, (i)); // might iterate repeat instruction
@@ -103,6 +108,7 @@ void BX_CPU_C::cpu_loop(void)
 
       // want to allow changing of the instruction inside instrumentation callback
       BX_INSTR_BEFORE_EXECUTION(BX_CPU_ID, i);
+      INC_OPCODE_STAT(i);
       RIP += i->ilen();
       BX_CPU_CALL_METHOD(i->execute1, (i)); // might iterate repeat instruction
       BX_CPU_THIS_PTR prev_rip = RIP; // commit new RIP
@@ -119,7 +125,7 @@ void BX_CPU_C::cpu_loop(void)
       if (BX_CPU_THIS_PTR async_event) break;
 
       if (++i == last) {
-        entry = getICacheEntry();
+        entry = getNextICacheEntry(entry);
         i = entry->i;
         last = i + (entry->tlen);
       }
@@ -151,6 +157,7 @@ void BX_CPU_C::cpu_run_trace(void)
 #if BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS
   // want to allow changing of the instruction inside instrumentation callback
   BX_INSTR_BEFORE_EXECUTION(BX_CPU_ID, i);
+  INC_OPCODE_STAT(i);
   RIP += i->ilen();
   // when handlers chaining is enabled this single call will execute entire trace
   BX_CPU_CALL_METHOD(i->execute1, (i)); // might iterate repeat instruction
@@ -165,6 +172,7 @@ void BX_CPU_C::cpu_run_trace(void)
   for(;;) {
     // want to allow changing of the instruction inside instrumentation callback
     BX_INSTR_BEFORE_EXECUTION(BX_CPU_ID, i);
+    INC_OPCODE_STAT(i);
     RIP += i->ilen();
     BX_CPU_CALL_METHOD(i->execute1, (i)); // might iterate repeat instruction
     BX_CPU_THIS_PTR prev_rip = RIP; // commit new RIP
@@ -205,7 +213,9 @@ bxICacheEntry_c* BX_CPU_C::getICacheEntry(void)
     // iCache miss. No validated instruction with matching fetch parameters
     // is in the iCache.
     INC_ICACHE_STAT(iCacheMisses);
+    BX_PMU_EVENT(BX_PMU_EVENT_ICACHE_MISS);
     entry = serveICacheMiss((Bit32u) eipBiased, pAddr);
+    INC_TRACE_LENGTH_STAT(entry->tlen);
   }
 
 #if BX_SUPPORT_CET
@@ -223,6 +233,43 @@ bxICacheEntry_c* BX_CPU_C::getICacheEntry(void)
   return entry;
 }
 
+#if BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS == 0
+
+// Called by cpu_loop when a trace ran to its end. Every trace remembers the
+// trace executed after it, so hot loops and call/return pairs go from trace
+// to trace without the iCache hash lookup. The link is only a hint: it is
+// taken only if the remembered entry still holds the trace for the current
+// physical address and fetch mode. A trace invalidated by handleSMC() or an
+// iCache flush, or moved to another way or the victim buffer, fails that
+// check, and any trace that passes it is correct to run.
+bxICacheEntry_c* BX_CPU_C::getNextICacheEntry(bxICacheEntry_c *prev)
+{
+  bx_address eipBiased = RIP + BX_CPU_THIS_PTR eipPageBias;
+
+  if (eipBiased >= BX_CPU_THIS_PTR eipPageWindowSize) {
+    prefetch();
+    eipBiased = RIP + BX_CPU_THIS_PTR eipPageBias;
+  }
+
+  bxICacheEntry_c *next = prev->next;
+  if (next != NULL && next->pAddr == BX_CPU_THIS_PTR pAddrFetchPage + eipBiased &&
+      next->fetchModeMask == BX_CPU_THIS_PTR fetchModeMask
+#if BX_SUPPORT_CET
+      && ! WaitingForEndbranch(CPL)
+#endif
+     )
+  {
+    INC_ICACHE_STAT(iCacheLookups);
+    return next;
+  }
+
+  next = getICacheEntry();
+  prev->next = next;
+  return next;
+}
+
+#endif
+
 #if BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS && BX_ENABLE_TRACE_LINKING
 
 // The function is called after taken branch instructions and tries to link the branch to the next trace
@@ -701,7 +748,9 @@ bx_bool BX_CPU_C::dbg_instruction_epilog(void)
   // see if debugger is looking for iaddr breakpoint of any type
   if (bx_guard.guard_for & BX_DBG_GUARD_IADDR_ALL) {
 #if (BX_DBG_MAX_VIR_BPOINTS > 0)
-    if (bx_guard.guard_for & BX_DBG_GUARD_IADDR_VIR) {
+    if ((bx_guard.guard_for & BX_DBG_GUARD_IADDR_VIR) &&
+         bx_dbg_page_filter(bx_dbg_vir_bp_pages, debug_eip))
+    {
       for (unsigned n=0; n<bx_guard.iaddr.num_virtual; n++) {
         if (bx_guard.iaddr.vir[n].enabled &&
            (bx_guard.iaddr.vir[n].cs  == cs) &&
@@ -717,7 +766,9 @@ bx_bool BX_CPU_C::dbg_instruction_epilog(void)
     }
 #endif
 #if (BX_DBG_MAX_LIN_BPOINTS > 0)
-    if (bx_guard.guard_for & BX_DBG_GUARD_IADDR_LIN) {
+    if ((bx_guard.guard_for & BX_DBG_GUARD_IADDR_LIN) &&
+         bx_dbg_page_filter(bx_dbg_lin_bp_pages, BX_CPU_THIS_PTR guard_found.laddr))
+    {
       for (unsigned n=0; n<bx_guard.iaddr.num_linear; n++) {
         if (bx_guard.iaddr.lin[n].enabled &&
            (bx_guard.iaddr.lin[n].addr == BX_CPU_THIS_PTR guard_found.laddr))
@@ -734,8 +785,15 @@ bx_bool BX_CPU_C::dbg_instruction_epilog(void)
 #if (BX_DBG_MAX_PHY_BPOINTS > 0)
     if (bx_guard.guard_for & BX_DBG_GUARD_IADDR_PHY) {
       bx_phy_address phy;
-      bx_bool valid = dbg_xlate_linear2phy(BX_CPU_THIS_PTR guard_found.laddr, &phy);
-      if (valid) {
+      bx_bool valid = 1;
+      // inside the current fetch window the physical address is known,
+      // only walk the page tables when RIP left the prefetched page
+      bx_address eipBiased = RIP + BX_CPU_THIS_PTR eipPageBias;
+      if (eipBiased < BX_CPU_THIS_PTR eipPageWindowSize)
+        phy = BX_CPU_THIS_PTR pAddrFetchPage + eipBiased;
+      else
+        valid = dbg_xlate_linear2phy(BX_CPU_THIS_PTR guard_found.laddr, &phy);
+      if (valid && bx_dbg_page_filter(bx_dbg_phy_bp_pages, phy)) {
         for (unsigned n=0; n<bx_guard.iaddr.num_physical; n++) {
           if (bx_guard.iaddr.phy[n].enabled && (bx_guard.iaddr.phy[n].addr == phy))
           {
@@ -654,6 +654,8 @@ typedef struct
 
   Bit32u ia32_spec_ctrl; // SCA
 
+  Bit64u pvclock; // guest physical address of the clock page, bit 0 enables
+
   /* TODO finish of the others */
 } bx_regs_msr_t;
 #endif
@@ -771,6 +773,10 @@ typedef struct {
 #include "svm.h"
 #endif
 
+#if BX_SUPPORT_PERFMON
+#include "pmu.h"
+#endif
+
 #if BX_SUPPORT_MONITOR_MWAIT
 struct monitor_addr_t {
 
@@ -910,7 +916,12 @@ public: // for now...
   // remember the time in ticks that it was reset to zero.  With a little
   // algebra, we can also support setting it to something other than zero.
   // Don't read this directly; use get_TSC and set_TSC to access the TSC.
+  // It is kept in TSC units, the ticks are scaled to tsc_freq first.
   Bit64u tsc_last_reset;
+  Bit32u tsc_freq; // TSC frequency in Hz, 0 if the TSC counts ticks
+  Bit32u tsc_ips;  // ticks per second of emulated time
+  bx_bool pvclock_enabled; // advertise the paravirtual clock MSR in CPUID
+  Bit32u pvclock_version;  // odd while the clock page is being rewritten
 #if BX_SUPPORT_VMX || BX_SUPPORT_SVM
   Bit64s tsc_offset;
 #endif
@@ -988,6 +999,10 @@ public: // for now...
   MSR *msrs[BX_MSR_MAX_INDEX];
 #endif
 
+#if BX_SUPPORT_PERFMON
+  bx_pmu_t pmu;
+#endif
+
 #if BX_SUPPORT_VMX
   bx_bool in_vmx;
   bx_bool in_vmx_guest;
@@ -1123,7 +1138,12 @@ public: // for now...
 #endif
 
   // for exceptions
+#if BX_SUPPORT_SMP
+  // every processor thread unwinds to its own loop
+  static BX_THREAD_LOCAL jmp_buf jmp_buf_env;
+#else
   static jmp_buf jmp_buf_env;
+#endif
   unsigned last_exception_type;
 
   // Boundaries of current code page, based on EIP
@@ -1191,8 +1211,9 @@ public: // for now...
 
 #define BX_DTLB_SIZE 2048
 #define BX_ITLB_SIZE 1024
-  TLB<BX_DTLB_SIZE> DTLB BX_CPP_AlignN(32);
-  TLB<BX_ITLB_SIZE> ITLB BX_CPP_AlignN(32);
+#define BX_TLB_ADDRESS_SPACES 4 /* address spaces kept in the TLBs */
+  TLB<BX_DTLB_SIZE, BX_TLB_ADDRESS_SPACES> DTLB BX_CPP_AlignN(32);
+  TLB<BX_ITLB_SIZE, BX_TLB_ADDRESS_SPACES> ITLB BX_CPP_AlignN(32);
 
 #if BX_CPU_LEVEL >= 6
   struct {
@@ -1200,6 +1221,16 @@ public: // for now...
   } PDPTR_CACHE;
 #endif
 
+  // Recently read PDEs of the legacy 2-level page walk, by physical address
+  // (i.e. by page directory and index), so they survive CR3 reloads. The
+  // cached PDEs are marked in pageWriteStampTable, a guest write to one of
+  // them ends up in pde_cache_invalidate().
+#define BX_PDE_CACHE_SIZE 512 /* must be power of two */
+  struct {
+    bx_phy_address addr;
+    Bit32u pde;
+  } pde_cache[BX_PDE_CACHE_SIZE];
+
   // An instruction cache.  Each entry should be exactly 32 bytes, and
   // this structure should be aligned on a 32-byte boundary to be friendly
   // with the host cache lines.
@@ -1223,6 +1254,13 @@ public: // for now...
 #if BX_SUPPORT_MEMTYPE
     BxMemtype memtype1;       // memory type of the page 1
     BxMemtype memtype2;       // memory type of the page 2
+#endif
+#if BX_SUPPORT_SMP
+    Bit64u rmw_old;           // value read by the R-M-W instruction, the
+                              // write compares against it in threaded SMP mode
+#if BX_SUPPORT_X86_64
+    Bit64u rmw_old_hi;        // high half of a 16 byte R-M-W access
+#endif
 #endif
   } address_xlation;
 
@@ -1283,6 +1321,9 @@ public: // for now...
 
   void initialize(void);
   void init_statistics(void);
+#if BX_ENABLE_STATISTICS
+  void print_opcode_statistics(unsigned max_lines);
+#endif
   void after_restore_state(void);
   void register_state(void);
   static Bit64s param_save_handler(void *devptr, bx_param_c *param);
@@ -1552,6 +1593,23 @@ public: // for now...
   BX_SMF void JLE_Jd(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
   BX_SMF void JNLE_Jd(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
 
+#if BX_SUPPORT_INSTRUCTION_FUSION
+  // compare and branch pairs fused by the trace builder
+  BX_SMF void CMP_EdGdM_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void CMP_GdEdM_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void CMP_GdEdR_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void CMP_EdIdM_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void CMP_EdIdR_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void CMP_GbEbR_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void CMP_EbIbM_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void CMP_EbIbR_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void TEST_EdGdR_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void TEST_EdIdR_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void TEST_EbGbR_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void INC_EdR_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  BX_SMF void DEC_EdR_Jcc(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+#endif
+
   BX_SMF void SETO_EbR(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
   BX_SMF void SETNO_EbR(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
   BX_SMF void SETB_EbR(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
@@ -4300,6 +4358,9 @@ public: // for now...
 
   BX_SMF bxICacheEntry_c *serveICacheMiss(Bit32u eipBiased, bx_phy_address pAddr);
   BX_SMF bxICacheEntry_c* getICacheEntry(void);
+#if BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS == 0
+  BX_SMF bxICacheEntry_c* getNextICacheEntry(bxICacheEntry_c *prev);
+#endif
   BX_SMF bx_bool mergeTraces(bxICacheEntry_c *entry, bxInstruction_c *i, bx_phy_address pAddr);
 #if BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS && BX_ENABLE_TRACE_LINKING
   BX_SMF void linkTrace(bxInstruction_c *i) BX_CPP_AttrRegparmN(1);
@@ -4474,8 +4535,14 @@ public: // for now...
   BX_SMF Bit8u* v2h_read_byte(bx_address laddr, bx_bool user) BX_CPP_AttrRegparmN(2);
   BX_SMF Bit8u* v2h_write_byte(bx_address laddr, bx_bool user) BX_CPP_AttrRegparmN(2);
 
+  BX_SMF Bit32u BulkRepINSW(Bit32u dstOff, Bit16u port, Bit32u wordCount);
+  BX_SMF Bit32u BulkRepOUTSW(unsigned srcSeg, Bit32u srcOff, Bit16u port, Bit32u wordCount);
+
   BX_SMF void branch_near16(Bit16u new_IP) BX_CPP_AttrRegparmN(1);
   BX_SMF void branch_near32(Bit32u new_EIP) BX_CPP_AttrRegparmN(1);
+#if BX_SUPPORT_INSTRUCTION_FUSION
+  BX_SMF void fused_branch32(bxInstruction_c *i, bx_bool taken) BX_CPP_AttrRegparmN(2);
+#endif
 #if BX_SUPPORT_X86_64
   BX_SMF void branch_near64(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
 #endif
@@ -4508,6 +4575,11 @@ public: // for now...
 
   BX_SMF void access_read_physical(bx_phy_address paddr, unsigned len, void *data);
   BX_SMF void access_write_physical(bx_phy_address paddr, unsigned len, void *data);
+  BX_SMF bx_bool set_entry_bits_atomic(bx_phy_address paddr, unsigned len, Bit64u bits);
+#if BX_SUPPORT_SMP
+  BX_SMF void write_RMW_atomic(void *hostAddr, unsigned len, Bit64u val);
+  BX_SMF void write_RMW_physical(unsigned len, void *data);
+#endif
 
   BX_SMF bx_hostpageaddr_t getHostMemAddr(bx_phy_address addr, unsigned rw);
 
@@ -4548,6 +4620,10 @@ public: // for now...
 #endif
   BX_SMF void TLB_flush(void);
   BX_SMF void TLB_invlpg(bx_address laddr);
+  BX_SMF void TLB_switchAddressSpace(bx_address cr3, bx_bool keep_global);
+  BX_SMF void TLB_flushInactive(void);
+  BX_SMF void pde_cache_flush(void);
+  BX_SMF void pde_cache_invalidate(bx_phy_address pAddr);
   BX_SMF void inhibit_interrupts(unsigned mask);
   BX_SMF bx_bool interrupts_inhibited(unsigned mask);
   BX_SMF const char *strseg(bx_segment_reg_t *seg);
@@ -4628,6 +4704,22 @@ public: // for now...
   BX_SMF bx_bool handle_unknown_wrmsr(Bit32u index, Bit64u  val_64) BX_CPP_AttrRegparmN(2);
 #endif
 
+#if BX_SUPPORT_PERFMON
+  BX_SMF void pmu_init(void);
+  BX_SMF void pmu_reset(void);
+  BX_SMF void pmu_sync(void);
+  BX_SMF void pmu_update(void);
+  BX_SMF void pmu_count(unsigned event);
+  BX_SMF void pmu_add(Bit64u counters, Bit64u delta);
+  BX_SMF void pmu_overflow(Bit64u counters);
+  BX_SMF bx_bool pmu_read_counter(Bit32u index, Bit64u *val);
+  BX_SMF bx_bool pmu_rdmsr(Bit32u index, Bit64u *msr);
+  BX_SMF bx_bool pmu_wrmsr(Bit32u index, Bit64u val_64);
+  BX_SMF void register_pmu_state(bx_param_c *parent);
+  static void pmu_timer_handler(void *);
+  BX_SMF void pmu_timer(void);
+#endif
+
 #if BX_SUPPORT_APIC
   BX_SMF bx_bool relocate_apic(Bit64u val_64);
 #endif
@@ -4855,6 +4947,9 @@ public: // for now...
 #if BX_CPU_LEVEL >= 5
   BX_SMF Bit64u get_TSC();
   BX_SMF void   set_TSC(Bit64u tsc);
+  BX_SMF Bit64u ticks_to_tsc(Bit64u ticks);
+  BX_SMF Bit64u tsc_to_ticks(Bit64u tsc);
+  BX_SMF void   pvclock_update(void);
 #endif
 
 #if BX_SUPPORT_PKEYS
@@ -5673,4 +5768,13 @@ class bxInstruction_c;
 
 #endif
 
+#if BX_SUPPORT_PERFMON
+#define BX_PMU_EVENT(event) {                                        \
+  if (BX_CPU_THIS_PTR pmu.event_mask & (1 << (event)))               \
+    BX_CPU_THIS_PTR pmu_count(event);                                \
+}
+#else
+#define BX_PMU_EVENT(event)
+#endif
+
 #endif  // #ifndef BX_CPU_H
@@ -433,7 +433,9 @@ void atom_n270_t::get_std_cpuid_leaf_A(cpuid_function_t *leaf) const
   leaf->ecx = 0x00000000;
   leaf->edx = 0x00002501;
 
+#if BX_SUPPORT_PERFMON == 0
   BX_INFO(("WARNING: Architectural Performance Monitoring is not implemented"));
+#endif
 }
 
 // leaf 0x80000000 //
@@ -483,7 +483,9 @@ void core2_penryn_t9600_t::get_std_cpuid_leaf_A(cpuid_function_t *leaf) const
   leaf->ecx = 0x00000000;
   leaf->edx = 0x00000503;
 
+#if BX_SUPPORT_PERFMON == 0
   BX_INFO(("WARNING: Architectural Performance Monitoring is not implemented"));
+#endif
 }
 
 // leaf 0x0000000B not supported //
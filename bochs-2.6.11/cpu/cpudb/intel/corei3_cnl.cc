@@ -703,7 +703,9 @@ void corei3_cnl_t::get_std_cpuid_leaf_A(cpuid_function_t *leaf) const
   leaf->ecx = 0x00000000;
   leaf->edx = 0x00000603;
 
+#if BX_SUPPORT_PERFMON == 0
   BX_INFO(("WARNING: Architectural Performance Monitoring is not implemented"));
+#endif
 }
 
 // leaf 0x0000000C reserved //
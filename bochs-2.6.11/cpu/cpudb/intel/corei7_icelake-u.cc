@@ -695,7 +695,9 @@ void corei7_icelake_t::get_std_cpuid_leaf_A(cpuid_function_t *leaf) const
   leaf->ecx = 0x0000000f;
   leaf->edx = 0x00008604;
 
+#if BX_SUPPORT_PERFMON == 0
   BX_INFO(("WARNING: Architectural Performance Monitoring is not implemented"));
+#endif
 }
 
 // leaf 0x0000000C - reserved //
@@ -307,7 +307,7 @@ typedef bx_cpuid_t* (*bx_create_cpuid_method)(BX_CPU_C *cpu);
 #define BX_CPUID_EXT_AVX                     (1 << 28)
 #define BX_CPUID_EXT_AVX_F16C                (1 << 29)
 #define BX_CPUID_EXT_RDRAND                  (1 << 30)
-#define BX_CPUID_EXT_RESERVED31              (1 << 31)
+#define BX_CPUID_EXT_HYPERVISOR              (1 << 31)
 
 // CPUID defines - EXT3 features CPUID[0x00000007].EBX
 // -----------------------------
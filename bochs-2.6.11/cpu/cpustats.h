@@ -29,9 +29,13 @@
 #define InstrumentTLBFlush 0
 #define InstrumentStackPrefetch 0
 #define InstrumentSMC 0
+#define InstrumentOpcodes 0
+#define InstrumentTraceLength 0
+#define InstrumentDecodeCache 0
 
 // indicate if any of the CPU statistics was compiled in
-#define InstrumentCPU (InstrumentICACHE + InstrumentTLB + InstrumentTLBFlush + InstrumentStackPrefetch + InstrumentSMC)
+#define InstrumentCPU (InstrumentICACHE + InstrumentTLB + InstrumentTLBFlush + InstrumentStackPrefetch + InstrumentSMC + \
+                       InstrumentOpcodes + InstrumentTraceLength + InstrumentDecodeCache)
 
 struct bx_cpu_statistics
 {
@@ -58,13 +62,23 @@ struct bx_cpu_statistics
   // self modifying code statistics
   Bit64u smc;
 
+  // executed instructions per decoder opcode (BX_IA_*), counted by cpu_loop.
+  // With handlers chaining only the first instruction of a trace is seen.
+  Bit64u *opcodeCount;
+
+  // length of the traces built on icache misses
+  Bit64u traceLength[BX_MAX_TRACE_LENGTH+1];
+
   bx_cpu_statistics():
       iCacheLookups(0), iCachePrefetch(0), iCacheMisses(0),
       tlbLookups(0), tlbExecuteLookups(0), tlbWriteLookups(0),
       tlbMisses(0), tlbExecuteMisses(0), tlbWriteMisses(0),
       tlbGlobalFlushes(0), tlbNonGlobalFlushes(0),
-      stackPrefetch(0), smc(0) {}
-  
+      stackPrefetch(0), smc(0), opcodeCount(NULL)
+  {
+    memset(traceLength, 0, sizeof(traceLength));
+  }
+  ~bx_cpu_statistics() { delete [] opcodeCount; }
 };
 
 #define INC_CPU_STAT(stat) INC_STAT(BX_CPU_THIS_PTR stats -> stat)
@@ -99,4 +113,25 @@ struct bx_cpu_statistics
   #define INC_SMC_STAT(stat)
 #endif
 
+#if InstrumentOpcodes
+  #define INC_OPCODE_STAT(i) INC_CPU_STAT(opcodeCount[(i)->getIaOpcode()])
+#else
+  #define INC_OPCODE_STAT(i)
+#endif
+
+#if InstrumentTraceLength
+  #define INC_TRACE_LENGTH_STAT(len) INC_CPU_STAT(traceLength[len])
+#else
+  #define INC_TRACE_LENGTH_STAT(len)
+#endif
+
+// the 32-bit decode cache is shared by all cpus (see fetchdecode32.cc)
+#if InstrumentDecodeCache
+  extern Bit64u bx_decode_cache_lookups;
+  extern Bit64u bx_decode_cache_hits;
+  #define INC_DECODE_CACHE_STAT(stat) INC_STAT(stat)
+#else
+  #define INC_DECODE_CACHE_STAT(stat)
+#endif
+
 #endif
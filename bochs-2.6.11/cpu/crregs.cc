@@ -1383,13 +1383,14 @@ bx_bool BX_CPP_AttrRegparmN(1) BX_CPU_C::SetCR3(bx_address val)
 
   BX_CPU_THIS_PTR cr3 = val;
 
-  // flush TLB even if value does not change
+  // flush TLB even if value does not change, the translations of other
+  // recently used address spaces are kept
 #if BX_CPU_LEVEL >= 6
   if (BX_CPU_THIS_PTR cr4.get_PGE())
-    TLB_flushNonGlobal(); // Don't flush Global entries.
+    TLB_switchAddressSpace(val, 1); // Don't flush Global entries.
   else
 #endif
-    TLB_flush();          // Flush Global entries also.
+    TLB_switchAddressSpace(val, 0); // Flush Global entries also.
 
   return 1;
 }
@@ -765,4 +765,228 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::LOOP32_Jb(bxInstruction_c *i)
   BX_NEXT_TRACE(i);
 }
 
+
+#if BX_SUPPORT_INSTRUCTION_FUSION
+
+// Condition of the conditional branch fused with a compare, test, inc or
+// dec, evaluated from the flags of that instruction instead of the lazy
+// flags it records. Bits 3..1 of cond select O, B, Z, BE, S, P, L or LE
+// and bit 0 inverts the condition, as in the Jcc opcode.
+static BX_CPP_INLINE bx_bool fused_condition(unsigned cond,
+    bx_bool cf, bx_bool zf, bx_bool sf, bx_bool of, Bit32u result)
+{
+  bx_bool taken;
+
+  switch(cond >> 1) {
+    case 0: taken = of; break;
+    case 1: taken = cf; break;
+    case 2: taken = zf; break;
+    case 3: taken = cf || zf; break;
+    case 4: taken = sf; break;
+    case 5: {
+      Bit32u temp = result & 0xff;
+      temp = (temp ^ (temp >> 4)) & 0x0F;
+      taken = (0x9669U >> temp) & 1;
+      break;
+    }
+    case 6: taken = (sf != of); break;
+    default: taken = zf || (sf != of); break;
+  }
+
+  return taken ^ (cond & 1);
+}
+
+// op1 - op2 = diff of the given operand size
+#define FUSED_SUB_CONDITION(cond, size, op1, op2, diff)                     \
+  fused_condition((cond), (op1) < (op2), (Bit##size##u)(diff) == 0,        \
+    ((diff) >> ((size) - 1)) & 1,                                           \
+    ((((op1) ^ (op2)) & ((op1) ^ (diff))) >> ((size) - 1)) & 1, (diff))
+
+// logical result, CF and OF are cleared
+#define FUSED_LOGIC_CONDITION(cond, size, result)                           \
+  fused_condition((cond), 0, (Bit##size##u)(result) == 0,                   \
+    ((result) >> ((size) - 1)) & 1, 0, (result))
+
+// The first instruction of a fused pair has executed and recorded its
+// flags: commit it the way cpu_loop does and execute the branch. RIP is
+// already past the branch.
+BX_CPP_INLINE void BX_CPP_AttrRegparmN(2) BX_CPU_C::fused_branch32(bxInstruction_c *i, bx_bool taken)
+{
+  bx_bool split = (BX_CPU_THIS_PTR async_event != 0);
+#if BX_DEBUGGER
+  // the debugger may stop between any two instructions
+  extern unsigned dbg_show_mask;
+  if (bx_guard.guard_for || bx_guard.interrupt_requested || dbg_show_mask ||
+      BX_CPU_THIS_PTR break_point || BX_CPU_THIS_PTR magic_break || BX_CPU_THIS_PTR trace)
+    split = 1;
+#endif
+
+  if (split) {
+    // Deliver the event (or single step trap) between the two instructions:
+    // stop after the first one and execute the branch from its own trace
+    RIP -= i->fusedJccLen();
+    BX_CPU_THIS_PTR async_event |= BX_ASYNC_EVENT_STOP_TRACE;
+    return;
+  }
+
+  BX_CPU_THIS_PTR prev_rip = RIP - i->fusedJccLen();
+  BX_CPU_THIS_PTR icount++;
+  BX_SYNC_TIME_IF_SINGLE_PROCESSOR(0);
+
+  if (taken) {
+    branch_near32(EIP + (Bit32s) i->fusedJccDisp());
+  }
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMP_EdGdM_Jcc(bxInstruction_c *i)
+{
+  bx_address eaddr = BX_CPU_RESOLVE_ADDR(i);
+
+  Bit32u op1_32 = read_virtual_dword(i->seg(), eaddr);
+  Bit32u op2_32 = BX_READ_32BIT_REG(i->src());
+  Bit32u diff_32 = op1_32 - op2_32;
+
+  SET_FLAGS_OSZAPC_SUB_32(op1_32, op2_32, diff_32);
+
+  fused_branch32(i, FUSED_SUB_CONDITION(i->fusedJccCond(), 32, op1_32, op2_32, diff_32));
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMP_GdEdM_Jcc(bxInstruction_c *i)
+{
+  bx_address eaddr = BX_CPU_RESOLVE_ADDR(i);
+
+  Bit32u op1_32 = BX_READ_32BIT_REG(i->dst());
+  Bit32u op2_32 = read_virtual_dword(i->seg(), eaddr);
+  Bit32u diff_32 = op1_32 - op2_32;
+
+  SET_FLAGS_OSZAPC_SUB_32(op1_32, op2_32, diff_32);
+
+  fused_branch32(i, FUSED_SUB_CONDITION(i->fusedJccCond(), 32, op1_32, op2_32, diff_32));
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMP_GdEdR_Jcc(bxInstruction_c *i)
+{
+  Bit32u op1_32 = BX_READ_32BIT_REG(i->dst());
+  Bit32u op2_32 = BX_READ_32BIT_REG(i->src());
+  Bit32u diff_32 = op1_32 - op2_32;
+
+  SET_FLAGS_OSZAPC_SUB_32(op1_32, op2_32, diff_32);
+
+  fused_branch32(i, FUSED_SUB_CONDITION(i->fusedJccCond(), 32, op1_32, op2_32, diff_32));
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMP_EdIdM_Jcc(bxInstruction_c *i)
+{
+  bx_address eaddr = BX_CPU_RESOLVE_ADDR(i);
+
+  Bit32u op1_32 = read_virtual_dword(i->seg(), eaddr);
+  Bit32u op2_32 = i->Id();
+  Bit32u diff_32 = op1_32 - op2_32;
+
+  SET_FLAGS_OSZAPC_SUB_32(op1_32, op2_32, diff_32);
+
+  fused_branch32(i, FUSED_SUB_CONDITION(i->fusedJccCond(), 32, op1_32, op2_32, diff_32));
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMP_EdIdR_Jcc(bxInstruction_c *i)
+{
+  Bit32u op1_32 = BX_READ_32BIT_REG(i->dst());
+  Bit32u op2_32 = i->Id();
+  Bit32u diff_32 = op1_32 - op2_32;
+
+  SET_FLAGS_OSZAPC_SUB_32(op1_32, op2_32, diff_32);
+
+  fused_branch32(i, FUSED_SUB_CONDITION(i->fusedJccCond(), 32, op1_32, op2_32, diff_32));
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMP_GbEbR_Jcc(bxInstruction_c *i)
+{
+  Bit32u op1_8 = BX_READ_8BIT_REGx(i->dst(), i->extend8bitL());
+  Bit32u op2_8 = BX_READ_8BIT_REGx(i->src(), i->extend8bitL());
+  Bit32u diff_8 = op1_8 - op2_8;
+
+  SET_FLAGS_OSZAPC_SUB_8(op1_8, op2_8, diff_8);
+
+  fused_branch32(i, FUSED_SUB_CONDITION(i->fusedJccCond(), 8, op1_8, op2_8, diff_8));
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMP_EbIbM_Jcc(bxInstruction_c *i)
+{
+  bx_address eaddr = BX_CPU_RESOLVE_ADDR(i);
+
+  Bit32u op1_8 = read_virtual_byte(i->seg(), eaddr);
+  Bit32u op2_8 = i->Ib();
+  Bit32u diff_8 = op1_8 - op2_8;
+
+  SET_FLAGS_OSZAPC_SUB_8(op1_8, op2_8, diff_8);
+
+  fused_branch32(i, FUSED_SUB_CONDITION(i->fusedJccCond(), 8, op1_8, op2_8, diff_8));
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMP_EbIbR_Jcc(bxInstruction_c *i)
+{
+  Bit32u op1_8 = BX_READ_8BIT_REGx(i->dst(), i->extend8bitL());
+  Bit32u op2_8 = i->Ib();
+  Bit32u diff_8 = op1_8 - op2_8;
+
+  SET_FLAGS_OSZAPC_SUB_8(op1_8, op2_8, diff_8);
+
+  fused_branch32(i, FUSED_SUB_CONDITION(i->fusedJccCond(), 8, op1_8, op2_8, diff_8));
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::TEST_EdGdR_Jcc(bxInstruction_c *i)
+{
+  Bit32u op1_32 = BX_READ_32BIT_REG(i->dst());
+  op1_32 &= BX_READ_32BIT_REG(i->src());
+
+  SET_FLAGS_OSZAPC_LOGIC_32(op1_32);
+
+  fused_branch32(i, FUSED_LOGIC_CONDITION(i->fusedJccCond(), 32, op1_32));
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::TEST_EdIdR_Jcc(bxInstruction_c *i)
+{
+  Bit32u op1_32 = BX_READ_32BIT_REG(i->dst());
+  op1_32 &= i->Id();
+
+  SET_FLAGS_OSZAPC_LOGIC_32(op1_32);
+
+  fused_branch32(i, FUSED_LOGIC_CONDITION(i->fusedJccCond(), 32, op1_32));
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::TEST_EbGbR_Jcc(bxInstruction_c *i)
+{
+  Bit32u op1_8 = BX_READ_8BIT_REGx(i->dst(), i->extend8bitL());
+  op1_8 &= BX_READ_8BIT_REGx(i->src(), i->extend8bitL());
+
+  SET_FLAGS_OSZAPC_LOGIC_8(op1_8);
+
+  fused_branch32(i, FUSED_LOGIC_CONDITION(i->fusedJccCond(), 8, op1_8));
+}
+
+// INC and DEC leave CF alone, it is read back only for B and BE
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::INC_EdR_Jcc(bxInstruction_c *i)
+{
+  Bit32u erx = ++BX_READ_32BIT_REG(i->dst());
+  SET_FLAGS_OSZAP_ADD_32(erx - 1, 0, erx);
+  BX_CLEAR_64BIT_HIGH(i->dst());
+
+  unsigned cond = i->fusedJccCond();
+  bx_bool cf = ((cond >> 1) == 1 || (cond >> 1) == 3) ? get_CF() : 0;
+  fused_branch32(i, fused_condition(cond, cf, erx == 0, erx >> 31, erx == 0x80000000, erx));
+}
+
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::DEC_EdR_Jcc(bxInstruction_c *i)
+{
+  Bit32u erx = --BX_READ_32BIT_REG(i->dst());
+  SET_FLAGS_OSZAP_SUB_32(erx + 1, 0, erx);
+  BX_CLEAR_64BIT_HIGH(i->dst());
+
+  unsigned cond = i->fusedJccCond();
+  bx_bool cf = ((cond >> 1) == 1 || (cond >> 1) == 3) ? get_CF() : 0;
+  fused_branch32(i, fused_condition(cond, cf, erx == 0, erx >> 31, erx == 0x7fffffff, erx));
+}
+
+#endif // BX_SUPPORT_INSTRUCTION_FUSION
+
 #endif
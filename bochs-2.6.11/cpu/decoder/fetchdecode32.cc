@@ -23,6 +23,9 @@
 #include "bochs.h"
 #ifndef BX_STANDALONE_DECODER
 #include "../cpu.h"
+#include "../cpustats.h"
+#else
+#define INC_DECODE_CACHE_STAT(stat)
 #endif
 
 #include "decoder.h"
@@ -2366,9 +2369,8 @@ Bit16u findOpcode(const Bit64u *opMap, Bit32u decmask)
   return ia_opcode;
 }
 
-int fetchDecode32(const Bit8u *iptr, bx_bool is_32, bxInstruction_c *i, unsigned remainingInPage)
+static int fetchDecode32Generic(const Bit8u *iptr, bx_bool is_32, bxInstruction_c *i, unsigned remainingInPage)
 {
-  if (remainingInPage > 15) remainingInPage = 15;
   i->setILen(remainingInPage);
 
   unsigned remain = remainingInPage; // remain must be at least 1
@@ -2497,6 +2499,196 @@ fetch_b1:
   return(0);
 }
 
+// Hand specialized decoding of the most frequent opcodes when there are no
+// prefixes: mov, push/pop, add/sub/cmp, test, lea, jcc, call/ret and jmp.
+// The opcode search of the generic decoder is replaced by a table lookup,
+// the table is built from the opcode maps on first use.
+
+#define BX_FAST32_NONE 0xffff
+
+static Bit16u fast32_ia_opcode[2 /* is_32 */][2 /* modC0 */][2 /* nnn == rm */][0x200];
+static bx_bool fast32_table_ready = 0;
+
+static void init_fast32_table(void)
+{
+  static const Bit16u fast32_opcodes[] = {
+    0x01, 0x03, 0x29, 0x2b, 0x39, 0x3b, 0x85, 0x89, 0x8b, 0x8d,
+    0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57,
+    0x58, 0x59, 0x5a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
+    0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77,
+    0x78, 0x79, 0x7a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f,
+    0xc3, 0xe8, 0xe9, 0xeb,
+    0x180, 0x181, 0x182, 0x183, 0x184, 0x185, 0x186, 0x187,
+    0x188, 0x189, 0x18a, 0x18b, 0x18c, 0x18d, 0x18e, 0x18f
+  };
+
+  for (unsigned n = 0; n < sizeof(fast32_ia_opcode) / sizeof(Bit16u); n++)
+    (&fast32_ia_opcode[0][0][0][0])[n] = BX_FAST32_NONE;
+
+  for (unsigned n = 0; n < sizeof(fast32_opcodes) / sizeof(fast32_opcodes[0]); n++) {
+    unsigned b1 = fast32_opcodes[n];
+    const BxOpcodeDecodeDescriptor32 *desc = &decode32_descriptor[b1];
+    const Bit64u *opmap = (const Bit64u *) desc->opcode_table;
+
+    for (unsigned is_32 = 0; is_32 < 2; is_32++) {
+      Bit32u decmask = (is_32 << OS32_OFFSET) | (is_32 << AS32_OFFSET);
+
+      if (desc->decode_method == &decoder32) {
+        // nnn and rm come from the opcode byte, the register form is implied
+        unsigned eq = (((b1 >> 3) & 7) == (b1 & 7));
+        fast32_ia_opcode[is_32][1][eq][b1] = findOpcode(opmap,
+          decmask | (1 << MODC0_OFFSET) | (eq << SRC_EQ_DST_OFFSET));
+      }
+      else if (desc->decode_method == &decoder32_modrm) {
+        // only usable if the opcode does not depend on the nnn and rm fields
+        for (unsigned modc0 = 0; modc0 < 2; modc0++) {
+          for (unsigned eq = 0; eq <= modc0; eq++) {
+            int ia_opcode = -1;
+            for (unsigned nnn = 0; nnn < 8; nnn++) {
+              for (unsigned rm = 0; rm < 8; rm++) {
+                if ((modc0 && (nnn == rm)) != eq) continue;
+                Bit16u op = findOpcode(opmap, decmask | (modc0 << MODC0_OFFSET) |
+                  (eq << SRC_EQ_DST_OFFSET) | (nnn << NNN_OFFSET) | (rm << RRR_OFFSET));
+                if (ia_opcode < 0) ia_opcode = op;
+                else if (ia_opcode != op) ia_opcode = BX_FAST32_NONE;
+              }
+            }
+            fast32_ia_opcode[is_32][modc0][eq][b1] = (Bit16u) ia_opcode;
+          }
+        }
+      }
+    }
+  }
+
+  fast32_table_ready = 1;
+}
+
+// returns 1 if the instruction is not handled here, the generic decoder
+// produces exactly the same result for the handled ones
+static int fetchDecode32Fast(const Bit8u *iptr, bx_bool is_32, bxInstruction_c *i, unsigned remainingInPage)
+{
+  unsigned remain = remainingInPage;
+  unsigned b1 = *iptr++;
+  unsigned nnn, rm, eq;
+  Bit16u ia_opcode;
+
+  if (! fast32_table_ready) init_fast32_table();
+
+  remain--;
+  if (b1 == 0x0f) {
+    if (remain == 0) return 1;
+    b1 = 0x100 | *iptr++;
+    remain--;
+  }
+  // the rows of the table are indexed with the modC0 and nnn == rm of the
+  // register form, so the first lookup also filters the unhandled opcodes
+  if (fast32_ia_opcode[is_32][1][0][b1] == BX_FAST32_NONE &&
+      fast32_ia_opcode[is_32][1][1][b1] == BX_FAST32_NONE) return 1;
+
+  i->setILen(remainingInPage);
+  i->init(/*os32*/ is_32,  /*as32*/ is_32,
+          /*os64*/     0,  /*as64*/     0);
+  i->setSeg(BX_SEG_REG_DS);
+#if BX_SUPPORT_CET
+  i->setSegOverride(BX_SEG_REG_NULL);
+#endif
+  i->modRMForm.Id = 0;
+
+  if (decode32_descriptor[b1].decode_method == &decoder32) {
+    nnn = (b1 >> 3) & 0x7;
+    rm = b1 & 0x7;
+    i->assertModC0();
+    ia_opcode = fast32_ia_opcode[is_32][1][nnn == rm][b1];
+  }
+  else {
+    struct bx_modrm modrm;
+    iptr = parseModrm32(iptr, remain, i, &modrm);
+    if (! iptr) return 1;
+    nnn = modrm.nnn;
+    rm = modrm.rm;
+    unsigned modc0 = i->modC0() ? 1 : 0;
+    eq = modc0 && (nnn == rm);
+    ia_opcode = fast32_ia_opcode[is_32][modc0][eq][b1];
+  }
+  if (ia_opcode == BX_FAST32_NONE) return 1;
+
+  if (fetchImmediate(iptr, remain, i, ia_opcode, false) < 0)
+    return 1;
+
+  assign_srcs(i, ia_opcode, nnn, rm);
+
+  i->setILen(remainingInPage - remain);
+  i->setIaOpcode(ia_opcode);
+
+  return 0;
+}
+
+// Decoded instructions are memoized by their bytes and the code segment
+// size, so that traces built again after a CR3 write or self modifying
+// code skip the decoder. The cache is direct mapped, indexed by a hash of
+// the first 4 instruction bytes and checked against all of them.
+
+#define BX_DECODE_CACHE_BITS 12
+#define BX_DECODE_CACHE_SIZE (1 << BX_DECODE_CACHE_BITS)
+
+struct bxDecodeCacheEntry32 {
+  Bit8u bytes[15];
+  Bit8u mode; // 0 = unused, otherwise is_32 + 1
+  bxInstruction_c i;
+};
+
+#if BX_SUPPORT_SMP && !defined(BX_STANDALONE_DECODER)
+// the processor threads fill it concurrently, each one gets a copy
+static BX_THREAD_LOCAL bxDecodeCacheEntry32 decode32_cache[BX_DECODE_CACHE_SIZE];
+#else
+static bxDecodeCacheEntry32 decode32_cache[BX_DECODE_CACHE_SIZE];
+#endif
+
+#if InstrumentDecodeCache
+Bit64u bx_decode_cache_lookups = 0;
+Bit64u bx_decode_cache_hits = 0;
+#endif
+
+void flushDecodeCache32(void)
+{
+  memset(decode32_cache, 0, sizeof(decode32_cache));
+}
+
+int fetchDecode32(const Bit8u *iptr, bx_bool is_32, bxInstruction_c *i, unsigned remainingInPage)
+{
+  if (remainingInPage > 15) remainingInPage = 15;
+
+  Bit32u key = 0;
+  for (unsigned n = 0; n < 4 && n < remainingInPage; n++)
+    key |= (Bit32u) iptr[n] << (n * 8);
+  key = (key ^ (is_32 ? 0x5bd1e995 : 0)) * 0x9e3779b1;
+  bxDecodeCacheEntry32 *entry = &decode32_cache[key >> (32 - BX_DECODE_CACHE_BITS)];
+
+  INC_DECODE_CACHE_STAT(bx_decode_cache_lookups);
+  if (entry->mode == (is_32 + 1)) {
+    unsigned ilen = entry->i.ilen();
+    if (ilen <= remainingInPage && ! memcmp(entry->bytes, iptr, ilen)) {
+      INC_DECODE_CACHE_STAT(bx_decode_cache_hits);
+      *i = entry->i;
+      return(0);
+    }
+  }
+
+  int ret = fetchDecode32Fast(iptr, is_32, i, remainingInPage);
+  if (ret > 0)
+    ret = fetchDecode32Generic(iptr, is_32, i, remainingInPage);
+
+  // undefined opcodes are not cached: the decoder may have looked at more
+  // bytes than the instruction length it reports for them
+  if (ret == 0 && i->getIaOpcode() != BX_IA_ERROR) {
+    memcpy(entry->bytes, iptr, i->ilen());
+    entry->mode = is_32 + 1;
+    entry->i = *i;
+  }
+
+  return ret;
+}
+
 #ifndef BX_STANDALONE_DECODER
 
 int assignHandler(bxInstruction_c *i, Bit32u fetchModeMask)
@@ -2650,6 +2842,12 @@ void BX_CPU_C::init_FetchDecodeTables(void)
     BxOpcodesTable[BX_IA_MOV_RqCR0].opflags |= BX_LOCKABLE;
 #endif
   }
+
+  // build the table before the processor threads may race for it
+  if (! fast32_table_ready) init_fast32_table();
+
+  // decoded instructions depend on the opcode table
+  flushDecodeCache32();
 }
 
 #endif
@@ -57,6 +57,12 @@ public:
   union {
     BxExecutePtr_tR execute2;
     bxInstruction_c *next;
+    // conditional branch fused into this instruction by the trace builder
+    struct {
+      Bit32u disp;
+      Bit8u cond; // low nibble of the Jcc opcode
+      Bit8u ilen;
+    } fusedJcc;
   } handlers;
 #endif
 
@@ -143,6 +149,21 @@ public:
   BX_CPP_INLINE BxExecutePtr_tR execute2(void) const {
     return handlers.execute2;
   }
+
+  BX_CPP_INLINE void setFusedJcc(Bit32u disp, unsigned cond, unsigned ilen) {
+    handlers.fusedJcc.disp = disp;
+    handlers.fusedJcc.cond = cond;
+    handlers.fusedJcc.ilen = ilen;
+  }
+  BX_CPP_INLINE Bit32u fusedJccDisp(void) const {
+    return handlers.fusedJcc.disp;
+  }
+  BX_CPP_INLINE unsigned fusedJccCond(void) const {
+    return handlers.fusedJcc.cond;
+  }
+  BX_CPP_INLINE unsigned fusedJccLen(void) const {
+    return handlers.fusedJcc.ilen;
+  }
 #endif
 
   BX_CPP_INLINE unsigned seg(void) const {
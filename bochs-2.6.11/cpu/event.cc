@@ -72,6 +72,7 @@ bx_bool BX_CPU_C::handleWaitForEvent(void)
 
     if (BX_HRQ && BX_DBG_ASYNC_DMA) {
       // handle DMA also when CPU is halted
+      BX_SMP_LOCK_SCOPE();
       DEV_dma_raise_hlda();
     }
 
@@ -99,7 +100,13 @@ bx_bool BX_CPU_C::handleWaitForEvent(void)
       return 1; // Return to caller of cpu_loop.
     }
 
-    BX_TICKN(10); // when in HLT run time faster for single CPU
+    if (bx_pc_system.idle_skip && !BX_HRQ) {
+      // nothing can happen before the next timer event: skip the idle time
+      BX_TICKN(bx_pc_system.getNumCpuTicksLeftNextEvent());
+    }
+    else {
+      BX_TICKN(10); // when in HLT run time faster for single CPU
+    }
   }
 
   return 0;
@@ -135,8 +142,11 @@ void BX_CPU_C::InterruptAcknowledge(void)
     vector = BX_CPU_THIS_PTR lapic.acknowledge_int();
   else
 #endif
+  {
     // if no local APIC, always acknowledge the PIC.
+    BX_SMP_LOCK_SCOPE();
     vector = DEV_pic_iac(); // may set INTR with next interrupt
+  }
 
   BX_CPU_THIS_PTR EXT = 1; /* external event */
 #if BX_SUPPORT_VMX
@@ -329,6 +339,7 @@ bx_bool BX_CPU_C::handleAsyncEvent(void)
   else if (BX_HRQ && BX_DBG_ASYNC_DMA) {
     // NOTE: similar code in ::take_dma()
     // assert Hold Acknowledge (HLDA) and go into a bus hold state
+    BX_SMP_LOCK_SCOPE();
     DEV_dma_raise_hlda();
   }
 
@@ -411,6 +422,12 @@ void BX_CPU_C::deliver_SIPI(unsigned vector)
 
 void BX_CPU_C::deliver_INIT(void)
 {
+#if BX_SUPPORT_SMP
+  if (BX_SMP_REMOTE(BX_CPU_THIS)) {
+    bx_smp_post(BX_CPU_THIS, BX_SMP_MSG_INIT);
+    return;
+  }
+#endif
   if (! is_masked_event(BX_EVENT_INIT)) {
     signal_event(BX_EVENT_INIT);
   }
@@ -418,21 +435,45 @@ void BX_CPU_C::deliver_INIT(void)
 
 void BX_CPU_C::deliver_NMI(void)
 {
+#if BX_SUPPORT_SMP
+  if (BX_SMP_REMOTE(BX_CPU_THIS)) {
+    bx_smp_post(BX_CPU_THIS, BX_SMP_MSG_NMI);
+    return;
+  }
+#endif
   signal_event(BX_EVENT_NMI);
 }
 
 void BX_CPU_C::deliver_SMI(void)
 {
+#if BX_SUPPORT_SMP
+  if (BX_SMP_REMOTE(BX_CPU_THIS)) {
+    bx_smp_post(BX_CPU_THIS, BX_SMP_MSG_SMI);
+    return;
+  }
+#endif
   signal_event(BX_EVENT_SMI);
 }
 
 void BX_CPU_C::raise_INTR(void)
 {
+#if BX_SUPPORT_SMP
+  if (BX_SMP_REMOTE(BX_CPU_THIS)) {
+    bx_smp_post_intr(BX_CPU_THIS, 1);
+    return;
+  }
+#endif
   signal_event(BX_EVENT_PENDING_INTR);
 }
 
 void BX_CPU_C::clear_INTR(void)
 {
+#if BX_SUPPORT_SMP
+  if (BX_SMP_REMOTE(BX_CPU_THIS)) {
+    bx_smp_post_intr(BX_CPU_THIS, 0);
+    return;
+  }
+#endif
   clear_event(BX_EVENT_PENDING_INTR);
 }
 
@@ -76,6 +76,7 @@ void BX_CPU_C::FPU_check_pending_exceptions(void)
      {
         // MSDOS compatibility external interrupt (IRQ13)
         BX_INFO(("math_abort: MSDOS compatibility FPU exception"));
+        BX_SMP_LOCK_SCOPE();
         DEV_pic_raise_irq(13);
      }
   }
@@ -58,6 +58,7 @@ float_status_t i387cw_to_softfloat_status_word(Bit16u control_word)
   status.flush_underflow_to_zero = 0;
   status.float_suppress_exception = 0;
   status.float_exception_masks = control_word & FPU_CW_Exceptions_Mask;
+  status.host_fast_path = 0;
   status.denormals_are_zeros = 0;
 
   return status;
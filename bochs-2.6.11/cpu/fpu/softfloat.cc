@@ -56,6 +56,97 @@ these four paragraphs for those parts of this code that are retained.
 *----------------------------------------------------------------------------*/
 #include "softfloat-specialize.h"
 
+/*----------------------------------------------------------------------------
+| Host FPU fast path.  When the status word allows it, the rounding mode is
+| round to nearest even and both operands and the result are normal numbers,
+| the host single and double precision operations produce bit identical
+| results.  The only exception such an operation can raise is inexact, which
+| is detected exactly without looking at the host status register.  Zeros,
+| denormals, infinities, NaNs, results close to underflow or overflow and all
+| other rounding modes take the software path.  The x87 C1 (rounded up)
+| indication is not produced, so only SSE status words enable the fast path.
+| Requires a host doing its floating point in SSE registers with the default
+| MXCSR (no FTZ/DAZ).
+*----------------------------------------------------------------------------*/
+#if defined(__SSE2_MATH__) || defined(_M_X64)
+#define FLOAT_HOST_FAST_PATH
+
+#include <string.h>
+#include <math.h>
+
+BX_CPP_INLINE float float32_to_host(float32 a) { float f; memcpy(&f, &a, 4); return f; }
+BX_CPP_INLINE float32 host_to_float32(float f) { float32 a; memcpy(&a, &f, 4); return a; }
+BX_CPP_INLINE double float64_to_host(float64 a) { double d; memcpy(&d, &a, 8); return d; }
+BX_CPP_INLINE float64 host_to_float64(double d) { float64 a; memcpy(&a, &d, 8); return a; }
+
+BX_CPP_INLINE int float32_host_operand(float32 a)
+{
+    Bit32u exp = (a >> 23) & 0xFF;
+    return exp != 0 && exp != 0xFF;
+}
+
+BX_CPP_INLINE int float64_host_operand(float64 a)
+{
+    Bit32u exp = (Bit32u)(a >> 52) & 0x7FF;
+    return exp != 0 && exp != 0x7FF;
+}
+
+// the lowest normal binade is excluded as well, so that tininess never
+// depends on whether it is detected before or after rounding
+BX_CPP_INLINE int float32_host_result(float32 z)
+{
+    Bit32u exp = (z >> 23) & 0xFF;
+    return exp > 1 && exp != 0xFF;
+}
+
+BX_CPP_INLINE int float64_host_result(float64 z)
+{
+    Bit32u exp = (Bit32u)(z >> 52) & 0x7FF;
+    return exp > 1 && exp != 0x7FF;
+}
+
+BX_CPP_INLINE int float_host_allowed(const float_status_t &status)
+{
+    return status.host_fast_path && status.float_rounding_mode == float_round_nearest_even;
+}
+
+// Sum of two normal numbers, inexact found by the error free TwoSum
+// transformation. An exact cancellation gives +0 just like softfloat.
+static int float32_host_add(float x, float y, float32 &z, float_status_t &status)
+{
+    float s = x + y;
+    z = host_to_float32(s);
+    if (! float32_host_result(z) && (z << 1) != 0) return 0;
+    float bb = s - x;
+    if ((x - (s - bb)) + (y - bb) != 0) float_raise(status, float_flag_inexact);
+    return 1;
+}
+
+static int float64_host_add(double x, double y, float64 &z, float_status_t &status)
+{
+    double s = x + y;
+    z = host_to_float64(s);
+    if (! float64_host_result(z) && (z << 1) != 0) return 0;
+    double bb = s - x;
+    if ((x - (s - bb)) + (y - bb) != 0) float_raise(status, float_flag_inexact);
+    return 1;
+}
+
+// True if the product of the significands of two normal doubles equals the
+// significand of 'a' shifted by 52 or 53 bits, i.e. x * y == a exactly for
+// the operands of a division or square root which returned x.
+static int float64_host_exact_product(float64 x, float64 y, float64 a)
+{
+    Bit64u xSig = extractFloat64Frac(x) | BX_CONST64(0x0010000000000000);
+    Bit64u ySig = extractFloat64Frac(y) | BX_CONST64(0x0010000000000000);
+    Bit64u aSig = extractFloat64Frac(a) | BX_CONST64(0x0010000000000000);
+    Bit64u hi, lo;
+    mul64To128(xSig, ySig, &hi, &lo);
+    return (hi == (aSig >> 12) && lo == (aSig << 52)) ||
+           (hi == (aSig >> 11) && lo == (aSig << 53));
+}
+#endif
+
 /*----------------------------------------------------------------------------
 | Returns the result of converting the 32-bit two's complement integer `a'
 | to the single-precision floating-point format.  The conversion is performed
@@ -1004,6 +1095,13 @@ static float32 subFloat32Sigs(float32 a, float32 b, int zSign, float_status_t &s
 
 float32 float32_add(float32 a, float32 b, float_status_t &status)
 {
+#ifdef FLOAT_HOST_FAST_PATH
+    if (float_host_allowed(status) && float32_host_operand(a) && float32_host_operand(b)) {
+        float32 z;
+        if (float32_host_add(float32_to_host(a), float32_to_host(b), z, status)) return z;
+    }
+#endif
+
     int aSign = extractFloat32Sign(a);
     int bSign = extractFloat32Sign(b);
 
@@ -1023,6 +1121,13 @@ float32 float32_add(float32 a, float32 b, float_status_t &status)
 
 float32 float32_sub(float32 a, float32 b, float_status_t &status)
 {
+#ifdef FLOAT_HOST_FAST_PATH
+    if (float_host_allowed(status) && float32_host_operand(a) && float32_host_operand(b)) {
+        float32 z;
+        if (float32_host_add(float32_to_host(a), -float32_to_host(b), z, status)) return z;
+    }
+#endif
+
     int aSign = extractFloat32Sign(a);
     int bSign = extractFloat32Sign(b);
 
@@ -1042,6 +1147,19 @@ float32 float32_sub(float32 a, float32 b, float_status_t &status)
 
 float32 float32_mul(float32 a, float32 b, float_status_t &status)
 {
+#ifdef FLOAT_HOST_FAST_PATH
+    if (float_host_allowed(status) && float32_host_operand(a) && float32_host_operand(b)) {
+        // the double product of two singles is exact
+        double p = (double) float32_to_host(a) * (double) float32_to_host(b);
+        float r = (float) p;
+        float32 z = host_to_float32(r);
+        if (float32_host_result(z)) {
+            if ((double) r != p) float_raise(status, float_flag_inexact);
+            return z;
+        }
+    }
+#endif
+
     int aSign, bSign, zSign;
     Bit16s aExp, bExp, zExp;
     Bit32u aSig, bSig;
@@ -1114,6 +1232,18 @@ float32 float32_mul(float32 a, float32 b, float_status_t &status)
 
 float32 float32_div(float32 a, float32 b, float_status_t &status)
 {
+#ifdef FLOAT_HOST_FAST_PATH
+    if (float_host_allowed(status) && float32_host_operand(a) && float32_host_operand(b)) {
+        float x = float32_to_host(a), y = float32_to_host(b);
+        float q = x / y;
+        float32 z = host_to_float32(q);
+        if (float32_host_result(z)) {
+            if ((double) q * (double) y != (double) x) float_raise(status, float_flag_inexact);
+            return z;
+        }
+    }
+#endif
+
     int aSign, bSign, zSign;
     Bit16s aExp, bExp, zExp;
     Bit32u aSig, bSig, zSig;
@@ -1185,6 +1315,15 @@ float32 float32_div(float32 a, float32 b, float_status_t &status)
 
 float32 float32_sqrt(float32 a, float_status_t &status)
 {
+#ifdef FLOAT_HOST_FAST_PATH
+    if (float_host_allowed(status) && float32_host_operand(a) && ! extractFloat32Sign(a)) {
+        float x = float32_to_host(a);
+        float r = sqrtf(x);
+        if ((double) r * (double) r != (double) x) float_raise(status, float_flag_inexact);
+        return host_to_float32(r);
+    }
+#endif
+
     int aSign;
     Bit16s aExp, zExp;
     Bit32u aSig, zSig;
@@ -1702,6 +1841,18 @@ Bit64u float64_to_uint64(float64 a, float_status_t &status)
 
 float32 float64_to_float32(float64 a, float_status_t &status)
 {
+#ifdef FLOAT_HOST_FAST_PATH
+    if (float_host_allowed(status) && float64_host_operand(a)) {
+        double x = float64_to_host(a);
+        float r = (float) x;
+        float32 z = host_to_float32(r);
+        if (float32_host_result(z)) {
+            if ((double) r != x) float_raise(status, float_flag_inexact);
+            return z;
+        }
+    }
+#endif
+
     int aSign;
     Bit16s aExp;
     Bit64u aSig;
@@ -2230,6 +2381,13 @@ static float64 subFloat64Sigs(float64 a, float64 b, int zSign, float_status_t &s
 
 float64 float64_add(float64 a, float64 b, float_status_t &status)
 {
+#ifdef FLOAT_HOST_FAST_PATH
+    if (float_host_allowed(status) && float64_host_operand(a) && float64_host_operand(b)) {
+        float64 z;
+        if (float64_host_add(float64_to_host(a), float64_to_host(b), z, status)) return z;
+    }
+#endif
+
     int aSign = extractFloat64Sign(a);
     int bSign = extractFloat64Sign(b);
 
@@ -2249,6 +2407,13 @@ float64 float64_add(float64 a, float64 b, float_status_t &status)
 
 float64 float64_sub(float64 a, float64 b, float_status_t &status)
 {
+#ifdef FLOAT_HOST_FAST_PATH
+    if (float_host_allowed(status) && float64_host_operand(a) && float64_host_operand(b)) {
+        float64 z;
+        if (float64_host_add(float64_to_host(a), -float64_to_host(b), z, status)) return z;
+    }
+#endif
+
     int aSign = extractFloat64Sign(a);
     int bSign = extractFloat64Sign(b);
 
@@ -2268,6 +2433,21 @@ float64 float64_sub(float64 a, float64 b, float_status_t &status)
 
 float64 float64_mul(float64 a, float64 b, float_status_t &status)
 {
+#ifdef FLOAT_HOST_FAST_PATH
+    if (float_host_allowed(status) && float64_host_operand(a) && float64_host_operand(b)) {
+        float64 z = host_to_float64(float64_to_host(a) * float64_to_host(b));
+        if (float64_host_result(z)) {
+            // the 105 or 106 bit product of the significands must fit in 53
+            Bit64u hi, lo;
+            mul64To128(extractFloat64Frac(a) | BX_CONST64(0x0010000000000000),
+                       extractFloat64Frac(b) | BX_CONST64(0x0010000000000000), &hi, &lo);
+            Bit64u dropped = (hi >> 41) ? BX_CONST64(0x001FFFFFFFFFFFFF) : BX_CONST64(0x000FFFFFFFFFFFFF);
+            if (lo & dropped) float_raise(status, float_flag_inexact);
+            return z;
+        }
+    }
+#endif
+
     int aSign, bSign, zSign;
     Bit16s aExp, bExp, zExp;
     Bit64u aSig, bSig, zSig0, zSig1;
@@ -2338,6 +2518,16 @@ float64 float64_mul(float64 a, float64 b, float_status_t &status)
 
 float64 float64_div(float64 a, float64 b, float_status_t &status)
 {
+#ifdef FLOAT_HOST_FAST_PATH
+    if (float_host_allowed(status) && float64_host_operand(a) && float64_host_operand(b)) {
+        float64 z = host_to_float64(float64_to_host(a) / float64_to_host(b));
+        if (float64_host_result(z)) {
+            if (! float64_host_exact_product(z, b, a)) float_raise(status, float_flag_inexact);
+            return z;
+        }
+    }
+#endif
+
     int aSign, bSign, zSign;
     Bit16s aExp, bExp, zExp;
     Bit64u aSig, bSig, zSig;
@@ -2417,6 +2607,14 @@ float64 float64_div(float64 a, float64 b, float_status_t &status)
 
 float64 float64_sqrt(float64 a, float_status_t &status)
 {
+#ifdef FLOAT_HOST_FAST_PATH
+    if (float_host_allowed(status) && float64_host_operand(a) && ! extractFloat64Sign(a)) {
+        float64 z = host_to_float64(sqrt(float64_to_host(a)));
+        if (! float64_host_exact_product(z, z, a)) float_raise(status, float_flag_inexact);
+        return z;
+    }
+#endif
+
     int aSign;
     Bit16s aExp, zExp;
     Bit64u aSig, zSig, doubleZSig;
@@ -135,6 +135,7 @@ struct float_status_t
     int float_nan_handling_mode;	/* flag register */
     int flush_underflow_to_zero;	/* flag register */
     int denormals_are_zeros;            /* flag register */
+    int host_fast_path;                 /* allow host FPU fast path */
 };
 
 /*----------------------------------------------------------------------------
@@ -340,12 +340,21 @@ void bx_generic_cpuid_t::get_std_cpuid_leaf_A(cpuid_function_t *leaf) const
   //  [12:5] Bit width of fixed-function performance counters (if Version ID > 1)
   // [31:13] reserved
 
+#if BX_SUPPORT_PERFMON
+  // version 2: four 48-bit general-purpose and three 48-bit fixed counters,
+  // the last-level cache and branch events are not emulated
+  leaf->eax = 0x07300402;
+  leaf->ebx = 0x00000078;
+  leaf->ecx = 0;
+  leaf->edx = 0x00000603;
+#else
   leaf->eax = 0;
   leaf->ebx = 0;
   leaf->ecx = 0;
   leaf->edx = 0;
 
   BX_INFO(("WARNING: Architectural Performance Monitoring is not implemented"));
+#endif
 }
 
 // leaf 0x0000000C - reserved //
@@ -443,7 +452,7 @@ void bx_generic_cpuid_t::get_ext_cpuid_leaf_7(cpuid_function_t *leaf) const
   leaf->eax = 0;
   leaf->ebx = 0;
   leaf->ecx = 0;
-  leaf->edx = 0;
+  leaf->edx = 0x00000100; // bit 8 - invariant TSC, it counts emulated time only
 }
 
 // leaf 0x80000008 //
@@ -545,6 +554,7 @@ void bx_generic_cpuid_t::init_cpu_extensions_bitmask(void)
     case BX_CPUID_SUPPORT_X2APIC:
       enable_cpu_extension(BX_ISA_XAPIC);
       enable_cpu_extension(BX_ISA_X2APIC);
+      enable_cpu_extension(BX_ISA_TSC_DEADLINE);
       break;
     case BX_CPUID_SUPPORT_XAPIC_EXT:
       enable_cpu_extension(BX_ISA_XAPIC);
@@ -1070,6 +1080,9 @@ Bit32u bx_generic_cpuid_t::get_extended_cpuid_features(void) const
   if (BX_CPUID_SUPPORT_ISA_EXTENSION(BX_ISA_X2APIC))
     features |= BX_CPUID_EXT_X2APIC;
 
+  if (BX_CPUID_SUPPORT_ISA_EXTENSION(BX_ISA_TSC_DEADLINE))
+    features |= BX_CPUID_EXT_TSC_DEADLINE;
+
   if (BX_CPUID_SUPPORT_ISA_EXTENSION(BX_ISA_MOVBE))
     features |= BX_CPUID_EXT_MOVBE;
 
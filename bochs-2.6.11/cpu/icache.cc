@@ -28,6 +28,7 @@
 
 #include "param_names.h"
 #include "cpustats.h"
+#include "profiler.h"
 
 #include "decoder/ia_opcodes.h"
 
@@ -42,8 +43,18 @@ extern int assignHandler(bxInstruction_c *i, Bit32u fetchModeMask);
 void flushICaches(void)
 {
   for (unsigned i=0; i<BX_SMP_PROCESSORS; i++) {
+#if BX_SUPPORT_SMP
+    if (BX_SMP_REMOTE(BX_CPU(i))) {
+      bx_smp_post(BX_CPU(i), BX_SMP_MSG_ICACHE_FLUSH);
+      continue;
+    }
+#endif
     BX_CPU(i)->iCache.flushICacheEntries();
     BX_CPU(i)->async_event |= BX_ASYNC_EVENT_STOP_TRACE;
+    // the write stamps protecting the cached PDEs and the TLB entries of
+    // other address spaces are gone
+    BX_CPU(i)->pde_cache_flush();
+    BX_CPU(i)->TLB_flushInactive();
   }
 
   pageWriteStampTable.resetWriteStamps();
@@ -54,8 +65,16 @@ void handleSMC(bx_phy_address pAddr, Bit32u mask)
   INC_SMC_STAT(smc);
 
   for (unsigned i=0; i<BX_SMP_PROCESSORS; i++) {
+#if BX_SUPPORT_SMP
+    if (BX_SMP_REMOTE(BX_CPU(i))) {
+      bx_smp_post_smc(BX_CPU(i), pAddr, mask);
+      continue;
+    }
+#endif
     BX_CPU(i)->async_event |= BX_ASYNC_EVENT_STOP_TRACE;
     BX_CPU(i)->iCache.handleSMC(pAddr, mask);
+    BX_CPU(i)->pde_cache_invalidate(pAddr);
+    BX_CPU(i)->TLB_flushInactive();
   }
 }
 
@@ -75,6 +94,101 @@ void genDummyICacheEntry(bxInstruction_c *i)
 
 #endif
 
+#if BX_SUPPORT_INSTRUCTION_FUSION
+
+// Fold a 32-bit conditional branch into the compare, test, inc or dec just
+// before it in the trace. The fused handler executes both instructions and
+// decides the branch from the operands, the flags are still recorded as
+// software can read them later.
+static bx_bool fuseBranch(bxInstruction_c *prev, bxInstruction_c *jcc)
+{
+  unsigned cond;
+
+  switch(jcc->getIaOpcode()) {
+    case BX_IA_JO_Jd:
+    case BX_IA_JO_Jbd:
+      cond = 0; break;
+    case BX_IA_JNO_Jd:
+    case BX_IA_JNO_Jbd:
+      cond = 1; break;
+    case BX_IA_JB_Jd:
+    case BX_IA_JB_Jbd:
+      cond = 2; break;
+    case BX_IA_JNB_Jd:
+    case BX_IA_JNB_Jbd:
+      cond = 3; break;
+    case BX_IA_JZ_Jd:
+    case BX_IA_JZ_Jbd:
+      cond = 4; break;
+    case BX_IA_JNZ_Jd:
+    case BX_IA_JNZ_Jbd:
+      cond = 5; break;
+    case BX_IA_JBE_Jd:
+    case BX_IA_JBE_Jbd:
+      cond = 6; break;
+    case BX_IA_JNBE_Jd:
+    case BX_IA_JNBE_Jbd:
+      cond = 7; break;
+    case BX_IA_JS_Jd:
+    case BX_IA_JS_Jbd:
+      cond = 8; break;
+    case BX_IA_JNS_Jd:
+    case BX_IA_JNS_Jbd:
+      cond = 9; break;
+    case BX_IA_JP_Jd:
+    case BX_IA_JP_Jbd:
+      cond = 10; break;
+    case BX_IA_JNP_Jd:
+    case BX_IA_JNP_Jbd:
+      cond = 11; break;
+    case BX_IA_JL_Jd:
+    case BX_IA_JL_Jbd:
+      cond = 12; break;
+    case BX_IA_JNL_Jd:
+    case BX_IA_JNL_Jbd:
+      cond = 13; break;
+    case BX_IA_JLE_Jd:
+    case BX_IA_JLE_Jbd:
+      cond = 14; break;
+    case BX_IA_JNLE_Jd:
+    case BX_IA_JNLE_Jbd:
+      cond = 15; break;
+    default:
+      return 0;
+  }
+
+  static const struct {
+    BxExecutePtr_tR execute, fused;
+  } fusable[] = {
+    { &BX_CPU_C::CMP_EdGdM, &BX_CPU_C::CMP_EdGdM_Jcc },
+    { &BX_CPU_C::CMP_GdEdM, &BX_CPU_C::CMP_GdEdM_Jcc },
+    { &BX_CPU_C::CMP_GdEdR, &BX_CPU_C::CMP_GdEdR_Jcc },
+    { &BX_CPU_C::CMP_EdIdM, &BX_CPU_C::CMP_EdIdM_Jcc },
+    { &BX_CPU_C::CMP_EdIdR, &BX_CPU_C::CMP_EdIdR_Jcc },
+    { &BX_CPU_C::CMP_GbEbR, &BX_CPU_C::CMP_GbEbR_Jcc },
+    { &BX_CPU_C::CMP_EbIbM, &BX_CPU_C::CMP_EbIbM_Jcc },
+    { &BX_CPU_C::CMP_EbIbR, &BX_CPU_C::CMP_EbIbR_Jcc },
+    { &BX_CPU_C::TEST_EdGdR, &BX_CPU_C::TEST_EdGdR_Jcc },
+    { &BX_CPU_C::TEST_EdIdR, &BX_CPU_C::TEST_EdIdR_Jcc },
+    { &BX_CPU_C::TEST_EbGbR, &BX_CPU_C::TEST_EbGbR_Jcc },
+    { &BX_CPU_C::INC_EdR, &BX_CPU_C::INC_EdR_Jcc },
+    { &BX_CPU_C::DEC_EdR, &BX_CPU_C::DEC_EdR_Jcc },
+  };
+
+  for (unsigned n=0; n < sizeof(fusable) / sizeof(fusable[0]); n++) {
+    if (prev->execute1 == fusable[n].execute) {
+      prev->execute1 = fusable[n].fused;
+      prev->setFusedJcc(jcc->Id(), cond, jcc->ilen());
+      prev->setILen(prev->ilen() + jcc->ilen());
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+#endif
+
 bxICacheEntry_c* BX_CPU_C::serveICacheMiss(Bit32u eipBiased, bx_phy_address pAddr)
 {
   bxICacheEntry_c *entry = BX_CPU_THIS_PTR iCache.get_entry(pAddr, BX_CPU_THIS_PTR fetchModeMask);
@@ -95,6 +209,11 @@ bxICacheEntry_c* BX_CPU_C::serveICacheMiss(Bit32u eipBiased, bx_phy_address pAdd
   Bit32u pageOffset = PAGE_OFFSET((Bit32u) pAddr);
   Bit32u traceMask = 0;
 
+  // linear address of the trace start minus its physical address
+  bx_address coverageBias = 0;
+  if (bx_coverage_enabled)
+    coverageBias = get_laddr(BX_SEG_REG_CS, RIP) - (bx_address) pAddr;
+
 #if BX_SUPPORT_SMP == 0
   if (PPFOf(pAddr) == BX_CPU_THIS_PTR pAddrStackPage)
     invalidate_stack_cache();
@@ -130,11 +249,14 @@ bxICacheEntry_c* BX_CPU_C::serveICacheMiss(Bit32u eipBiased, bx_phy_address pAdd
       entry->tlen = 1;
       boundaryFetch(fetchPtr, remainingInPage, i);
 
+      if (bx_coverage_enabled)
+        bx_coverage_mark(CPL, BX_CPU_THIS_PTR cr3, pAddr, (bx_address) pAddr + coverageBias, remainingInPage);
+
       // Add the instruction to trace cache
       entry->pAddr = ~entry->pAddr;
       entry->traceMask = 0x80000000; /* last line in page */
-      pageWriteStampTable.markICacheMask(entry->pAddr, entry->traceMask);
-      pageWriteStampTable.markICacheMask(BX_CPU_THIS_PTR pAddrFetchPage, 0x1);
+      pageWriteStampTable.markICache(entry->pAddr, remainingInPage);
+      pageWriteStampTable.markICache(BX_CPU_THIS_PTR pAddrFetchPage, i->ilen() - remainingInPage);
 
 #if BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS
       entry->tlen++; /* Add the inserted end of trace opcode */
@@ -149,7 +271,16 @@ bxICacheEntry_c* BX_CPU_C::serveICacheMiss(Bit32u eipBiased, bx_phy_address pAdd
 
     // add instruction to the trace
     unsigned iLen = i->ilen();
-    entry->tlen++;
+#if BX_SUPPORT_INSTRUCTION_FUSION
+    // a branch fused into the previous instruction doesn't take a slot
+    if (n > 0 && fuseBranch(i - 1, i))
+      i--;
+    else
+#endif
+      entry->tlen++;
+
+    if (bx_coverage_enabled)
+      bx_coverage_mark(CPL, BX_CPU_THIS_PTR cr3, pAddr, (bx_address) pAddr + coverageBias, iLen);
 
 #ifdef BX_INSTR_STORE_OPCODE_BYTES
     i->set_opcode_bytes(fetchPtr);
@@ -161,6 +292,7 @@ bxICacheEntry_c* BX_CPU_C::serveICacheMiss(Bit32u eipBiased, bx_phy_address pAdd
 
     traceMask |= 1 <<  (pageOffset >> 7);
     traceMask |= 1 << ((pageOffset + iLen - 1) >> 7);
+    pageWriteStampTable.markICache(pAddr, iLen);
 
     // continue to the next instruction
     remainingInPage -= iLen;
@@ -172,8 +304,8 @@ bxICacheEntry_c* BX_CPU_C::serveICacheMiss(Bit32u eipBiased, bx_phy_address pAdd
     // try to find a trace starting from current pAddr and merge
     if (remainingInPage >= 15) { // avoid merging with page split trace
       if (mergeTraces(entry, i, pAddr)) {
+          // the merged instructions are marked since their own trace was built
           entry->traceMask |= traceMask;
-          pageWriteStampTable.markICacheMask(pAddr, entry->traceMask);
           BX_CPU_THIS_PTR iCache.commit_trace(entry->tlen);
           return entry;
       }
@@ -184,8 +316,6 @@ bxICacheEntry_c* BX_CPU_C::serveICacheMiss(Bit32u eipBiased, bx_phy_address pAdd
 
   entry->traceMask |= traceMask;
 
-  pageWriteStampTable.markICacheMask(pAddr, entry->traceMask);
-
 #if BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS
   entry->tlen++; /* Add the inserted end of trace opcode */
   genDummyICacheEntry(i);
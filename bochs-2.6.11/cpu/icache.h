@@ -26,17 +26,79 @@
 
 extern void handleSMC(bx_phy_address pAddr, Bit32u mask);
 
+// users of the dirty page map, each one clears only its own bit
+#define BX_DIRTY_SNAPSHOT 0x01 /* incremental snapshots */
+#define BX_DIRTY_DEDUP    0x02 /* guest memory deduplication */
+#define BX_DIRTY_ALL      0xff
+
+// Code presence is tracked in two levels. fineGranularityMapping has a bit
+// for every 128 byte line of a page holding decoded code, which is what the
+// trace cache invalidates by. Below it codeGranules has a byte per line with
+// a bit for every 16 byte granule holding code bytes, so that data written
+// next to code in the same line does not flush the traces of that line.
+#define BX_CODE_GRANULE_SHIFT 4
+#define BX_CODE_GRANULES_PER_PAGE 32 /* one byte per 128 byte line */
+
 class bxPageWriteStampTable
 {
   const Bit32u PHY_MEM_PAGES = 1024*1024;
   Bit32u *fineGranularityMapping;
+  Bit8u *codeGranules;
+  // pages written since the last clearDirtyPages(), used to save only the
+  // changed part of guest memory in incremental snapshots and to find the
+  // pages that are stable enough to be deduplicated
+  Bit8u *dirtyPages;
+
+  // lines of the page covered by [offset, offset+len)
+  BX_CPP_INLINE static Bit32u lineMask(Bit32u offset, unsigned len)
+  {
+    Bit32u first = offset >> 7, last = (offset + len - 1) >> 7;
+    return (Bit32u)((BX_CONST64(2) << last) - (BX_CONST64(1) << first));
+  }
+
+  // granules of line n covered by [offset, offset+len)
+  BX_CPP_INLINE static Bit8u granuleMask(unsigned n, Bit32u offset, unsigned len)
+  {
+    Bit32u start = n << 7, end = start + 128;
+    if (offset > start) start = offset;
+    if (offset + len < end) end = offset + len;
+    unsigned first = (start & 0x7f) >> BX_CODE_GRANULE_SHIFT;
+    unsigned last = ((end - 1) & 0x7f) >> BX_CODE_GRANULE_SHIFT;
+    return (Bit8u)((2 << last) - (1 << first));
+  }
+
+  // does the write hit code bytes in one of the lines of the mask ?
+  BX_CPP_INLINE bx_bool writeHitsCode(Bit32u index, Bit32u offset, unsigned len, Bit32u mask) const
+  {
+    const Bit8u *granules = codeGranules + index * BX_CODE_GRANULES_PER_PAGE;
+    for (unsigned n = offset >> 7; n < 32 && (mask >> n); n++) {
+      if ((mask & (1 << n)) && (granules[n] & granuleMask(n, offset, len)))
+        return 1;
+    }
+    return 0;
+  }
+
+  BX_CPP_INLINE void clearGranules(Bit32u index, Bit32u mask)
+  {
+    Bit8u *granules = codeGranules + index * BX_CODE_GRANULES_PER_PAGE;
+    for (unsigned n = 0; n < 32 && (mask >> n); n++) {
+      if (mask & (1 << n)) granules[n] = 0;
+    }
+  }
 
 public:
+  // the tables start out zeroed and only the pages covering guest memory
+  // in use are ever touched
   bxPageWriteStampTable() {
-    fineGranularityMapping = new Bit32u[PHY_MEM_PAGES];
-    resetWriteStamps();
+    fineGranularityMapping = (Bit32u *) bx_alloc_zeroed(PHY_MEM_PAGES * sizeof(Bit32u));
+    codeGranules = (Bit8u *) bx_alloc_zeroed(PHY_MEM_PAGES * BX_CODE_GRANULES_PER_PAGE);
+    dirtyPages = (Bit8u *) bx_alloc_zeroed(PHY_MEM_PAGES);
+  }
+ ~bxPageWriteStampTable() {
+    bx_free_zeroed(fineGranularityMapping);
+    bx_free_zeroed(codeGranules);
+    bx_free_zeroed(dirtyPages);
   }
- ~bxPageWriteStampTable() { delete [] fineGranularityMapping; }
 
   BX_CPP_INLINE static Bit32u hash(bx_phy_address pAddr) {
     // can share writeStamps between multiple pages if >32 bit phy address
@@ -48,17 +110,25 @@ public:
     return fineGranularityMapping[hash(pAddr)];
   }
 
+  // len bytes at pAddr hold decoded code, assumption: does not split 4K page
   BX_CPP_INLINE void markICache(bx_phy_address pAddr, unsigned len)
   {
-    Bit32u mask  = 1 << (PAGE_OFFSET((Bit32u) pAddr) >> 7);
-           mask |= 1 << (PAGE_OFFSET((Bit32u) pAddr + len - 1) >> 7);
+    Bit32u index = hash(pAddr), offset = PAGE_OFFSET((Bit32u) pAddr);
+    Bit32u mask = lineMask(offset, len);
+    Bit8u *granules = codeGranules + index * BX_CODE_GRANULES_PER_PAGE;
 
-    fineGranularityMapping[hash(pAddr)] |= mask;
-  }
+#if BX_SUPPORT_SMP
+    // the processor threads mark and invalidate code concurrently
+    for (unsigned n = offset >> 7; n < 32 && (mask >> n); n++)
+      BX_ATOMIC_OR8(&granules[n], granuleMask(n, offset, len));
 
-  BX_CPP_INLINE void markICacheMask(bx_phy_address pAddr, Bit32u mask)
-  {
-    fineGranularityMapping[hash(pAddr)] |= mask;
+    BX_ATOMIC_OR32(&fineGranularityMapping[index], mask);
+#else
+    for (unsigned n = offset >> 7; n < 32 && (mask >> n); n++)
+      granules[n] |= granuleMask(n, offset, len);
+
+    fineGranularityMapping[index] |= mask;
+#endif
   }
 
   // whole page is being altered
@@ -66,8 +136,10 @@ public:
   {
     Bit32u index = hash(pAddr);
 
+    dirtyPages[index] = BX_DIRTY_ALL;
     if (fineGranularityMapping[index]) {
       handleSMC(pAddr, 0xffffffff); // one of the CPUs might be running trace from this page
+      clearGranules(index, fineGranularityMapping[index]);
       fineGranularityMapping[index] = 0;
     }
   }
@@ -77,15 +149,48 @@ public:
   {
     Bit32u index = hash(pAddr);
 
+    dirtyPages[index] = BX_DIRTY_ALL;
     if (fineGranularityMapping[index]) {
-       Bit32u mask  = 1 << (PAGE_OFFSET((Bit32u) pAddr) >> 7);
-              mask |= 1 << (PAGE_OFFSET((Bit32u) pAddr + len - 1) >> 7);
+       Bit32u offset = PAGE_OFFSET((Bit32u) pAddr);
+       Bit32u mask = lineMask(offset, len) & fineGranularityMapping[index];
 
-       if (fineGranularityMapping[index] & mask) {
+       if (mask && writeHitsCode(index, offset, len, mask)) {
           // one of the CPUs might be running trace from this page
           handleSMC(pAddr, mask);
+          clearGranules(index, mask);
+#if BX_SUPPORT_SMP
+          BX_ATOMIC_AND32(&fineGranularityMapping[index], ~mask);
+#else
           fineGranularityMapping[index] &= ~mask;
-       }       
+#endif
+       }
+    }
+  }
+
+  BX_CPP_INLINE bx_bool isPageDirty(bx_phy_address pAddr, Bit8u user) const
+  {
+    return (dirtyPages[hash(pAddr)] & user) != 0;
+  }
+
+  BX_CPP_INLINE bx_bool testAndClearPageDirty(bx_phy_address pAddr, Bit8u user)
+  {
+    Bit32u index = hash(pAddr);
+    if (! (dirtyPages[index] & user)) return 0;
+    dirtyPages[index] &= ~user;
+    return 1;
+  }
+
+  BX_CPP_INLINE void clearDirtyPages(Bit8u user)
+  {
+    if (user == BX_DIRTY_ALL) {
+      bx_clear_zeroed(dirtyPages, PHY_MEM_PAGES);
+      return;
+    }
+    // only write the entries that change, untouched parts of the map stay
+    // unbacked
+    for (Bit32u index = 0; index < PHY_MEM_PAGES; index++) {
+      if (dirtyPages[index] & user)
+        dirtyPages[index] &= ~user;
     }
   }
 
@@ -94,14 +199,19 @@ public:
 
 BX_CPP_INLINE void bxPageWriteStampTable::resetWriteStamps(void)
 {
-  for (Bit32u i=0; i<PHY_MEM_PAGES; i++) {
-    fineGranularityMapping[i] = 0;
-  }
+  bx_clear_zeroed(fineGranularityMapping, PHY_MEM_PAGES * sizeof(Bit32u));
+  bx_clear_zeroed(codeGranules, PHY_MEM_PAGES * BX_CODE_GRANULES_PER_PAGE);
 }
 
 extern bxPageWriteStampTable pageWriteStampTable;
 
+// The trace cache is 2-way set associative with one LRU bit per set.
+// Traces evicted from a set go to a small fully associative victim buffer
+// and are swapped back into their set when they are looked up again.
 #define BxICacheEntries (64  * 1024)  // Must be a power of 2.
+#define BxICacheWays    2             // the LRU bit only covers two ways
+#define BxICacheSets    (BxICacheEntries / BxICacheWays)
+#define BxICacheVictimEntries 16      // Must be a power of 2.
 #define BxICacheMemPool (576 * 1024)
 
 struct bxICacheEntry_c
@@ -111,6 +221,16 @@ struct bxICacheEntry_c
 
   Bit32u tlen;          // Trace length in instructions
   bxInstruction_c *i;
+
+  // fetch mode the trace was decoded for, the set index already tells the
+  // modes apart but a trace in the victim buffer needs it
+  Bit32u fetchModeMask;
+
+#if BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS == 0
+  // trace that was executed after this one the last time, see
+  // BX_CPU_C::getNextICacheEntry()
+  bxICacheEntry_c *next;
+#endif
 };
 
 #define BX_MAX_TRACE_LENGTH 32
@@ -132,10 +252,18 @@ BX_CPP_INLINE void flushSMC(bxICacheEntry_c *e)
 
 class BOCHSAPI bxICache_c {
 public:
-  bxICacheEntry_c entry[BxICacheEntries];
+  bxICacheEntry_c entry[BxICacheEntries]; // way w of set s is entry[s*BxICacheWays + w]
+  Bit8u lru[BxICacheSets];                // least recently used way of each set
+  bxICacheEntry_c victim[BxICacheVictimEntries];
+  unsigned nextVictim;
   bxInstruction_c mpool[BxICacheMemPool];
   unsigned mpindex;
 
+  // traces found in the victim buffer and valid traces evicted from a set,
+  // lookups and misses are counted by the cpu statistics
+  Bit64u victimHits;
+  Bit64u evictions;
+
   Bit32u traceLinkTimeStamp;
 
 #define BX_ICACHE_PAGE_SPLIT_ENTRIES 8 /* must be power of two */
@@ -146,12 +274,16 @@ public:
   int nextPageSplitIndex;
 
 public:
-  bxICache_c() { flushICacheEntries(); }
+  bxICache_c(): victimHits(0), evictions(0) { flushICacheEntries(); }
 
+  // The page offset selects the set within a page sized block of sets, so
+  // all traces of a page stay together for handleSMC(). The frame number is
+  // folded into the bits above it, pages a multiple of the cache size apart
+  // would all land in the same block otherwise.
   BX_CPP_INLINE static unsigned hash(bx_phy_address pAddr, unsigned fetchModeMask)
   {
-//  return ((pAddr + (pAddr << 2) + (pAddr>>6)) & (BxICacheEntries-1)) ^ fetchModeMask;
-    return ((pAddr) & (BxICacheEntries-1)) ^ fetchModeMask;
+    Bit32u ppf = (Bit32u) (pAddr >> 12);
+    return ((((ppf ^ (ppf >> 3) ^ (ppf >> 7)) << 12) | PAGE_OFFSET((Bit32u) pAddr)) & (BxICacheSets-1)) ^ fetchModeMask;
   }
 
   BX_CPP_INLINE void alloc_trace(bxICacheEntry_c *e)
@@ -162,6 +294,9 @@ public:
     }
     e->i = &mpool[mpindex];
     e->tlen = 0;
+#if BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS == 0
+    e->next = NULL;
+#endif
   }
 
   BX_CPP_INLINE void commit_trace(unsigned len) { mpindex += len; }
@@ -184,18 +319,65 @@ public:
 
   BX_CPP_INLINE void flushICacheEntries(void);
 
+  // the traces of a and b trade places, the page split index follows them
+  BX_CPP_INLINE void swap_entries(bxICacheEntry_c *a, bxICacheEntry_c *b)
+  {
+    bxICacheEntry_c tmp = *a;
+    *a = *b;
+    *b = tmp;
+
+    for (unsigned n=0; n < BX_ICACHE_PAGE_SPLIT_ENTRIES; n++) {
+      if (pageSplitIndex[n].e == a) pageSplitIndex[n].e = b;
+      else if (pageSplitIndex[n].e == b) pageSplitIndex[n].e = a;
+    }
+  }
+
+  // entry to build a new trace for pAddr in: a free way of the set or its
+  // least recently used one, whose trace goes to the victim buffer
   BX_CPP_INLINE bxICacheEntry_c* get_entry(bx_phy_address pAddr, unsigned fetchModeMask)
   {
-    return &(entry[hash(pAddr, fetchModeMask)]);
+    unsigned set = hash(pAddr, fetchModeMask);
+    unsigned way = lru[set];
+    bxICacheEntry_c *e = &entry[set * BxICacheWays];
+
+    if (e[way ^ 1].pAddr == BX_ICACHE_INVALID_PHY_ADDRESS)
+      way ^= 1;
+    e += way;
+
+    if (e->pAddr != BX_ICACHE_INVALID_PHY_ADDRESS) {
+      bxICacheEntry_c *v = &victim[nextVictim];
+      nextVictim = (nextVictim + 1) & (BxICacheVictimEntries-1);
+      // the oldest victim is dropped
+      v->pAddr = BX_ICACHE_INVALID_PHY_ADDRESS;
+      for (unsigned n=0; n < BX_ICACHE_PAGE_SPLIT_ENTRIES; n++) {
+        if (pageSplitIndex[n].e == v) pageSplitIndex[n].ppf = BX_ICACHE_INVALID_PHY_ADDRESS;
+      }
+      swap_entries(e, v);
+      evictions++;
+    }
+
+    lru[set] = way ^ 1;
+    e->fetchModeMask = fetchModeMask;
+    return e;
   }
 
+  BX_CPP_INLINE bxICacheEntry_c* find_victim(bx_phy_address pAddr, unsigned fetchModeMask, unsigned set);
+
   BX_CPP_INLINE bxICacheEntry_c* find_entry(bx_phy_address pAddr, unsigned fetchModeMask)
   {
-    bxICacheEntry_c* e = get_entry(pAddr, fetchModeMask);
-    if (e->pAddr != pAddr)
-       return NULL;
+    unsigned set = hash(pAddr, fetchModeMask);
+    bxICacheEntry_c *e = &entry[set * BxICacheWays];
 
-    return e;
+    if (e[0].pAddr == pAddr) {
+      lru[set] = 1;
+      return e;
+    }
+    if (e[1].pAddr == pAddr) {
+      lru[set] = 0;
+      return e + 1;
+    }
+
+    return find_victim(pAddr, fetchModeMask, set);
   }
 
   BX_CPP_INLINE bx_bool breakLinks()
@@ -209,6 +391,25 @@ public:
   }
 };
 
+// a trace found in the victim buffer is swapped with the least recently
+// used way of its set
+BX_CPP_INLINE bxICacheEntry_c* bxICache_c::find_victim(bx_phy_address pAddr, unsigned fetchModeMask, unsigned set)
+{
+  for (unsigned n=0; n < BxICacheVictimEntries; n++) {
+    bxICacheEntry_c *v = &victim[n];
+    if (v->pAddr == pAddr && v->fetchModeMask == fetchModeMask) {
+      unsigned way = lru[set];
+      bxICacheEntry_c *e = &entry[set * BxICacheWays + way];
+      swap_entries(e, v);
+      lru[set] = way ^ 1;
+      victimHits++;
+      return e;
+    }
+  }
+
+  return NULL;
+}
+
 BX_CPP_INLINE void bxICache_c::flushICacheEntries(void)
 {
   bxICacheEntry_c* e = entry;
@@ -218,6 +419,13 @@ BX_CPP_INLINE void bxICache_c::flushICacheEntries(void)
     e->pAddr = BX_ICACHE_INVALID_PHY_ADDRESS;
     e->traceMask = 0;
   }
+  memset(lru, 0, sizeof(lru));
+
+  for (i=0; i<BxICacheVictimEntries; i++) {
+    victim[i].pAddr = BX_ICACHE_INVALID_PHY_ADDRESS;
+    victim[i].traceMask = 0;
+  }
+  nextVictim = 0;
 
   nextPageSplitIndex = 0;
   for (i=0;i<BX_ICACHE_PAGE_SPLIT_ENTRIES;i++)
@@ -258,18 +466,27 @@ BX_CPP_INLINE void bxICache_c::handleSMC(bx_phy_address pAddr, Bit32u mask)
     }
   }
 
-  bxICacheEntry_c *e = get_entry(LPFOf(pAddr), 0);
+  // the sets of the page form one block, the fetch mode only moves a trace
+  // within the sets of its 128 byte line
+  bxICacheEntry_c *e = &entry[hash(LPFOf(pAddr), 0) * BxICacheWays];
 
   // go over 32 "cache lines" of 128 byte each
   for (unsigned n=0; n < 32; n++) {
     Bit32u line_mask = (1 << n);
     if (line_mask > mask) break;
-    for (unsigned index=0; index < 128; index++, e++) {
+    for (unsigned index=0; index < 128 * BxICacheWays; index++, e++) {
       if (pAddrIndex == bxPageWriteStampTable::hash(e->pAddr) && (e->traceMask & mask) != 0) {
         flushSMC(e);
       }
     }
   }
+
+  for (unsigned n=0; n < BxICacheVictimEntries; n++) {
+    e = &victim[n];
+    if (pAddrIndex == bxPageWriteStampTable::hash(e->pAddr) && (e->traceMask & mask) != 0) {
+      flushSMC(e);
+    }
+  }
 }
 
 extern void flushICaches(void);
@@ -27,6 +27,7 @@
 
 #include "param_names.h"
 #include "cpustats.h"
+#include "decoder/ia_opcodes.h"
 
 #include <stdlib.h>
 
@@ -129,6 +130,18 @@ void BX_CPU_C::initialize(void)
   // ignore bad MSRS if user asked for it
 #if BX_CPU_LEVEL >= 5
   BX_CPU_THIS_PTR ignore_bad_msrs = SIM->get_param_bool(BXPN_IGNORE_BAD_MSRS)->get();
+
+  // TSC frequency in emulated time, by default the TSC counts ticks
+  BX_CPU_THIS_PTR tsc_freq = SIM->get_param_num(BXPN_TSC_FREQ)->get();
+  BX_CPU_THIS_PTR tsc_ips = SIM->get_param_num(BXPN_IPS)->get();
+  if (BX_CPU_THIS_PTR tsc_freq == BX_CPU_THIS_PTR tsc_ips)
+    BX_CPU_THIS_PTR tsc_freq = 0;
+  BX_CPU_THIS_PTR pvclock_enabled = SIM->get_param_bool(BXPN_PVCLOCK)->get();
+#endif
+
+#if BX_CPU_LEVEL >= 6
+  extern bx_bool bx_sse_host_fast_fp;
+  bx_sse_host_fast_fp = SIM->get_param_bool(BXPN_FAST_FP)->get();
 #endif
 
   init_SMRAM();
@@ -137,6 +150,10 @@ void BX_CPU_C::initialize(void)
   init_VMCS();
 #endif
 
+#if BX_SUPPORT_PERFMON
+  pmu_init();
+#endif
+
   init_statistics();
 }
 
@@ -152,6 +169,8 @@ void BX_CPU_C::init_statistics(void)
   new bx_shadow_num_c(cpu, "iCacheLookups", &stats->iCacheLookups);
   new bx_shadow_num_c(cpu, "iCachePrefetch", &stats->iCachePrefetch);
   new bx_shadow_num_c(cpu, "iCacheMisses", &stats->iCacheMisses);
+  new bx_shadow_num_c(cpu, "iCacheVictimHits", &BX_CPU_THIS_PTR iCache.victimHits);
+  new bx_shadow_num_c(cpu, "iCacheEvictions", &BX_CPU_THIS_PTR iCache.evictions);
 #endif
 
 #if InstrumentTLB
@@ -176,9 +195,66 @@ void BX_CPU_C::init_statistics(void)
   new bx_shadow_num_c(cpu, "smc", &stats->smc);
 #endif
 
+#if InstrumentOpcodes
+  // too many to be shown in the statistics tree, see print_opcode_statistics()
+  stats->opcodeCount = new Bit64u[BX_IA_LAST];
+  memset(stats->opcodeCount, 0, BX_IA_LAST * sizeof(Bit64u));
+#endif
+
+#if InstrumentTraceLength
+  bx_list_c *tlen = new bx_list_c(cpu, "traceLength", "Trace length");
+  for (unsigned n=1; n <= BX_MAX_TRACE_LENGTH; n++) {
+    char name[8];
+    sprintf(name, "%u", n);
+    new bx_shadow_num_c(tlen, name, &stats->traceLength[n]);
+  }
+#endif
+
+#if InstrumentDecodeCache
+  new bx_shadow_num_c(cpu, "decodeCacheLookups", &bx_decode_cache_lookups);
+  new bx_shadow_num_c(cpu, "decodeCacheHits", &bx_decode_cache_hits);
+#endif
+
 #endif
 }
 
+#if BX_ENABLE_STATISTICS
+static int opcode_stat_compare(const void *a, const void *b)
+{
+  Bit64u count1 = ((const Bit64u *) a)[0];
+  Bit64u count2 = ((const Bit64u *) b)[0];
+  return (count1 > count2) ? -1 : (count1 < count2);
+}
+
+// print the most executed opcodes since the last dump together with their
+// share of all executed instructions
+void BX_CPU_C::print_opcode_statistics(unsigned max_lines)
+{
+#if InstrumentOpcodes
+  Bit64u (*sorted)[2] = new Bit64u[BX_IA_LAST][2];
+  Bit64u total = 0;
+  unsigned n, count = 0;
+
+  for (n=0; n < BX_IA_LAST; n++) {
+    if (stats->opcodeCount[n] == 0) continue;
+    sorted[count][0] = stats->opcodeCount[n];
+    sorted[count][1] = n;
+    total += stats->opcodeCount[n];
+    stats->opcodeCount[n] = 0; // like the statistics tree, count per dump
+    count++;
+  }
+  qsort(sorted, count, sizeof(sorted[0]), opcode_stat_compare);
+
+  printf("%s: " FMT_LL "u instructions, %u different opcodes\n", get_name(), total, count);
+  for (n=0; n < count && n < max_lines; n++) {
+    printf("  %-32s %12" FMT_64 "u  %5.2f%%\n", get_bx_opcode_name((Bit16u) sorted[n][1]) + /*"BX_IA_"*/ 6,
+        sorted[n][0], 100.0 * (double) sorted[n][0] / (double) total);
+  }
+  delete [] sorted;
+#endif
+}
+#endif
+
 // save/restore functionality
 void BX_CPU_C::register_state(void)
 {
@@ -270,6 +346,7 @@ void BX_CPU_C::register_state(void)
 
 #if BX_CPU_LEVEL >= 5
   BXRS_HEX_PARAM_FIELD(cpu, tsc_last_reset, tsc_last_reset);
+  BXRS_HEX_PARAM_FIELD(cpu, pvclock_version, pvclock_version);
 #if BX_SUPPORT_VMX || BX_SUPPORT_SVM
   BXRS_HEX_PARAM_FIELD(cpu, tsc_offset, tsc_offset);
 #endif
@@ -415,6 +492,9 @@ void BX_CPU_C::register_state(void)
   if (BX_CPUID_SUPPORT_ISA_EXTENSION(BX_ISA_SCA_MITIGATIONS)) {
     BXRS_HEX_PARAM_FIELD(MSR, ia32_spec_ctrl, msr.ia32_spec_ctrl);
   }
+  if (BX_CPU_THIS_PTR pvclock_enabled) {
+    BXRS_HEX_PARAM_FIELD(MSR, pvclock, msr.pvclock);
+  }
 
 #if BX_CONFIGURE_MSRS
   bx_list_c *MSRS = new bx_list_c(cpu, "USER_MSR");
@@ -491,6 +571,10 @@ void BX_CPU_C::register_state(void)
   register_svm_state(cpu);
 #endif
 
+#if BX_SUPPORT_PERFMON
+  register_pmu_state(cpu);
+#endif
+
   BXRS_HEX_PARAM_SIMPLE32(cpu, pending_event);
   BXRS_HEX_PARAM_SIMPLE32(cpu, event_mask);
   BXRS_HEX_PARAM_SIMPLE32(cpu, async_event);
@@ -640,6 +724,7 @@ void BX_CPU_C::param_restore(bx_param_c *param, Bit64s val)
 void BX_CPU_C::after_restore_state(void)
 {
   handleCpuContextChange();
+  pde_cache_flush();
 
   BX_CPU_THIS_PTR prev_rip = RIP;
 
@@ -656,6 +741,11 @@ void BX_CPU_C::after_restore_state(void)
   set_PKRU(BX_CPU_THIS_PTR pkru);
 #endif
 
+#if BX_SUPPORT_PERFMON
+  BX_CPU_THIS_PTR pmu.icount = BX_CPU_THIS_PTR icount;
+  pmu_update();
+#endif
+
   assert_checks();
   debug(RIP);
 }
@@ -932,6 +1022,8 @@ void BX_CPU_C::reset(unsigned source)
   BX_CPU_THIS_PTR tsc_offset = 0;
 #endif
   if (source == BX_RESET_HARDWARE) {
+    BX_CPU_THIS_PTR msr.pvclock = 0;
+    BX_CPU_THIS_PTR pvclock_version = 0;
     BX_CPU_THIS_PTR set_TSC(0); // do not change TSC on INIT
   }
 #endif // BX_CPU_LEVEL >= 5
@@ -1029,7 +1121,7 @@ void BX_CPU_C::reset(unsigned source)
   if (source == BX_RESET_HARDWARE) {
     for(n=0; n<BX_XMM_REGISTERS; n++) {
       BX_CLEAR_AVX_REG(n);
-    }
+    }
 
     BX_CPU_THIS_PTR mxcsr.mxcsr = MXCSR_RESET;
     BX_CPU_THIS_PTR mxcsr_mask = 0x0000ffbf;
@@ -1088,6 +1180,16 @@ void BX_CPU_C::reset(unsigned source)
 
   handleCpuContextChange();
 
+#if BX_SUPPORT_PERFMON
+  // the performance monitoring MSRs keep their values across INIT
+  if (source == BX_RESET_HARDWARE)
+    pmu_reset();
+  else {
+    pmu_sync();
+    pmu_update();
+  }
+#endif
+
 #if BX_CPU_LEVEL >= 4
   BX_CPU_THIS_PTR cpuid->dump_cpuid();
 
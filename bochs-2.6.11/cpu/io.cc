@@ -27,6 +27,90 @@
 
 #include "iodev/iodev.h"
 
+//
+// Bulk IO methods: hand a REP INSW/OUTSW run within one page to a device
+// which registered bulk handlers for the port. These don't depend on
+// the repeat speedups and work with the debugger, unless watchpoints are set.
+//
+
+Bit32u BX_CPU_C::BulkRepINSW(Bit32u dstOff, Bit16u port, Bit32u wordCount)
+{
+  bx_address laddrDst;
+
+  // only forward transfers go through the device bulk handlers
+  if (BX_CPU_THIS_PTR get_DF()) return 0;
+
+#if BX_DEBUGGER
+  if (num_write_watchpoints) return 0;
+#endif
+
+  bx_segment_reg_t *dstSegPtr = &BX_CPU_THIS_PTR sregs[BX_SEG_REG_ES];
+  if (dstSegPtr->cache.valid & SegAccessWOK4G) {
+    laddrDst = dstOff;
+  }
+  else {
+    if (!(dstSegPtr->cache.valid & SegAccessWOK))
+      return 0;
+    if ((dstOff | 0xfff) > dstSegPtr->cache.u.segment.limit_scaled)
+      return 0;
+
+    laddrDst = get_laddr32(BX_SEG_REG_ES, dstOff);
+  }
+
+  // check that the address is word aligned
+  if (laddrDst & 1) return 0;
+
+  Bit8u *hostAddrDst = v2h_write_byte(laddrDst, USER_PL);
+  // Check that native host access was not vetoed for that page
+  if (!hostAddrDst) return 0;
+
+  // Restrict word count to the number that will fit in this page.
+  Bit32u wordsFitDst = (0x1000 - PAGE_OFFSET(laddrDst)) >> 1;
+  if (wordCount > wordsFitDst)
+    wordCount = wordsFitDst;
+
+  return bx_devices.inp_bulk(port, 2, hostAddrDst, wordCount);
+}
+
+Bit32u BX_CPU_C::BulkRepOUTSW(unsigned srcSeg, Bit32u srcOff, Bit16u port, Bit32u wordCount)
+{
+  bx_address laddrSrc;
+
+  // only forward transfers go through the device bulk handlers
+  if (BX_CPU_THIS_PTR get_DF()) return 0;
+
+#if BX_DEBUGGER
+  if (num_read_watchpoints) return 0;
+#endif
+
+  bx_segment_reg_t *srcSegPtr = &BX_CPU_THIS_PTR sregs[srcSeg];
+  if (srcSegPtr->cache.valid & SegAccessROK4G) {
+    laddrSrc = srcOff;
+  }
+  else {
+    if (!(srcSegPtr->cache.valid & SegAccessROK))
+      return 0;
+    if ((srcOff | 0xfff) > srcSegPtr->cache.u.segment.limit_scaled)
+      return 0;
+
+    laddrSrc = get_laddr32(srcSeg, srcOff);
+  }
+
+  // check that the address is word aligned
+  if (laddrSrc & 1) return 0;
+
+  Bit8u *hostAddrSrc = v2h_read_byte(laddrSrc, USER_PL);
+  // Check that native host access was not vetoed for that page
+  if (!hostAddrSrc) return 0;
+
+  // Restrict word count to the number that will fit in this page.
+  Bit32u wordsFitSrc = (0x1000 - PAGE_OFFSET(laddrSrc)) >> 1;
+  if (wordCount > wordsFitSrc)
+    wordCount = wordsFitSrc;
+
+  return bx_devices.outp_bulk(port, 2, hostAddrSrc, wordCount);
+}
+
 //
 // Repeat Speedups methods
 //
@@ -81,6 +165,8 @@ Bit32u BX_CPU_C::FastRepINSW(Bit32u dstOff, Bit16u port, Bit32u wordCount)
 
   // If after all the restrictions, there is anything left to do...
   if (wordCount) {
+    // the bulk I/O fields of the devices are shared by the processors
+    BX_SMP_LOCK_SCOPE();
     for (count=0; count<wordCount; ) {
       bx_devices.bulkIOQuantumsTransferred = 0;
       if (BX_CPU_THIS_PTR get_DF()==0) { // Only do accel for DF=0
@@ -161,6 +247,8 @@ Bit32u BX_CPU_C::FastRepOUTSW(unsigned srcSeg, Bit32u srcOff, Bit16u port, Bit32
 
   // If after all the restrictions, there is anything left to do...
   if (wordCount) {
+    // the bulk I/O fields of the devices are shared by the processors
+    BX_SMP_LOCK_SCOPE();
     for (count=0; count<wordCount; ) {
       bx_devices.bulkIOQuantumsTransferred = 0;
       if (BX_CPU_THIS_PTR get_DF()==0) { // Only do accel for DF=0
@@ -323,7 +411,18 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::INSW32_YwDX(bxInstruction_c *i)
   Bit16u value16=0;
   Bit32u edi = EDI;
   unsigned increment = 2;
+  Bit32u bulkCount = 0;
 
+  if (i->repUsedL() && !BX_CPU_THIS_PTR async_event)
+    bulkCount = BulkRepINSW(edi, DX, ECX);
+
+  if (bulkCount) {
+    // the main cpu loop decrements eCX and ticks once more
+    BX_TICKN(bulkCount-1);
+    RCX = ECX - (bulkCount-1);
+    increment = bulkCount << 1;
+  }
+  else
 #if (BX_SUPPORT_REPEAT_SPEEDUPS) && (BX_DEBUGGER == 0)
   /* If conditions are right, we can transfer IO to physical memory
    * in a batch, rather than one instruction at a time.
@@ -574,7 +673,18 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::OUTSW32_DXXw(bxInstruction_c *i)
   Bit16u value16;
   Bit32u esi = ESI;
   unsigned increment = 2;
+  Bit32u bulkCount = 0;
 
+  if (i->repUsedL() && !BX_CPU_THIS_PTR async_event)
+    bulkCount = BulkRepOUTSW(i->seg(), esi, DX, ECX);
+
+  if (bulkCount) {
+    // the main cpu loop decrements eCX and ticks once more
+    BX_TICKN(bulkCount-1);
+    RCX = ECX - (bulkCount-1);
+    increment = bulkCount << 1;
+  }
+  else
 #if (BX_SUPPORT_REPEAT_SPEEDUPS) && (BX_DEBUGGER == 0)
   /* If conditions are right, we can transfer IO to physical memory
    * in a batch, rather than one instruction at a time.
@@ -48,6 +48,36 @@ bx_bool BX_CPP_AttrRegparmN(2) BX_CPU_C::rdmsr(Bit32u index, Bit64u *msr)
 #endif
 
   switch(index) {
+
+#if BX_SUPPORT_PERFMON
+    case BX_MSR_PMC0:
+    case BX_MSR_PMC1:
+    case BX_MSR_PMC2:
+    case BX_MSR_PMC3:
+    case BX_MSR_PMC4:
+    case BX_MSR_PMC5:
+    case BX_MSR_PMC6:
+    case BX_MSR_PMC7:
+    case BX_MSR_PERFEVTSEL0:
+    case BX_MSR_PERFEVTSEL1:
+    case BX_MSR_PERFEVTSEL2:
+    case BX_MSR_PERFEVTSEL3:
+    case BX_MSR_PERFEVTSEL4:
+    case BX_MSR_PERFEVTSEL5:
+    case BX_MSR_PERFEVTSEL6:
+    case BX_MSR_PERFEVTSEL7:
+    case BX_MSR_PERF_FIXED_CTR0:
+    case BX_MSR_PERF_FIXED_CTR1:
+    case BX_MSR_PERF_FIXED_CTR2:
+    case BX_MSR_FIXED_CTR_CTRL:
+    case BX_MSR_PERF_GLOBAL_STATUS:
+    case BX_MSR_PERF_GLOBAL_CTRL:
+    case BX_MSR_PERF_GLOBAL_OVF_CTRL:
+      if (! pmu_rdmsr(index, &val64))
+        return handle_unknown_rdmsr(index, msr);
+      break;
+#endif
+
 #if BX_CPU_LEVEL >= 6
     case BX_MSR_SYSENTER_CS:
       if (! is_cpu_extension_supported(BX_ISA_SYSENTER_SYSEXIT)) {
@@ -158,6 +188,14 @@ bx_bool BX_CPP_AttrRegparmN(2) BX_CPU_C::rdmsr(Bit32u index, Bit64u *msr)
       val64 = BX_CPU_THIS_PTR get_TSC();
       break;
 
+    case BX_MSR_PVCLOCK:
+      if (! BX_CPU_THIS_PTR pvclock_enabled) {
+        BX_ERROR(("RDMSR BX_MSR_PVCLOCK: paravirtual clock not enabled"));
+        return handle_unknown_rdmsr(index, msr);
+      }
+      val64 = BX_CPU_THIS_PTR msr.pvclock;
+      break;
+
 #if BX_SUPPORT_APIC
     case BX_MSR_APICBASE:
       val64 = BX_CPU_THIS_PTR msr.apicbase;
@@ -569,6 +607,14 @@ bx_bool BX_CPP_AttrRegparmN(2) BX_CPU_C::wrmsr(Bit32u index, Bit64u val_64)
   switch(index) {
 
 #if BX_SUPPORT_PERFMON
+    case BX_MSR_PMC0:
+    case BX_MSR_PMC1:
+    case BX_MSR_PMC2:
+    case BX_MSR_PMC3:
+    case BX_MSR_PMC4:
+    case BX_MSR_PMC5:
+    case BX_MSR_PMC6:
+    case BX_MSR_PMC7:
     case BX_MSR_PERFEVTSEL0:
     case BX_MSR_PERFEVTSEL1:
     case BX_MSR_PERFEVTSEL2:
@@ -577,8 +623,17 @@ bx_bool BX_CPP_AttrRegparmN(2) BX_CPU_C::wrmsr(Bit32u index, Bit64u val_64)
     case BX_MSR_PERFEVTSEL5:
     case BX_MSR_PERFEVTSEL6:
     case BX_MSR_PERFEVTSEL7:
-      BX_INFO(("WRMSR: write into IA32_PERFEVTSEL%d MSR: %08x:%08x", index - BX_MSR_PERFEVTSEL0, val32_hi, val32_lo));
-      return handle_unknown_wrmsr(index, val_64);
+    case BX_MSR_PERF_FIXED_CTR0:
+    case BX_MSR_PERF_FIXED_CTR1:
+    case BX_MSR_PERF_FIXED_CTR2:
+    case BX_MSR_FIXED_CTR_CTRL:
+    case BX_MSR_PERF_GLOBAL_STATUS:
+    case BX_MSR_PERF_GLOBAL_CTRL:
+    case BX_MSR_PERF_GLOBAL_OVF_CTRL:
+      // counters beyond the cpu model's CPUID leaf 0xA are unknown MSRs
+      if (! pmu_wrmsr(index, val_64))
+        return handle_unknown_wrmsr(index, val_64);
+      break;
 #endif
 
 #if BX_CPU_LEVEL >= 6
@@ -755,6 +810,20 @@ bx_bool BX_CPP_AttrRegparmN(2) BX_CPU_C::wrmsr(Bit32u index, Bit64u val_64)
       BX_CPU_THIS_PTR set_TSC(val_64);
       break;
 
+    case BX_MSR_PVCLOCK:
+      if (! BX_CPU_THIS_PTR pvclock_enabled) {
+        BX_ERROR(("WRMSR BX_MSR_PVCLOCK: paravirtual clock not enabled"));
+        return handle_unknown_wrmsr(index, val_64);
+      }
+      // the 32 byte clock structure has to be 4 byte aligned within one page
+      if ((val_64 & 0x6) || (val_64 & 0xfff) > 0xfe0 || ! IsValidPhyAddr(val_64 & ~BX_CONST64(1))) {
+        BX_ERROR(("WRMSR: attempt to write invalid address 0x%08x%08x to BX_MSR_PVCLOCK !", val32_hi, val32_lo));
+        return 0;
+      }
+      BX_CPU_THIS_PTR msr.pvclock = val_64;
+      BX_CPU_THIS_PTR pvclock_update();
+      break;
+
 #if BX_SUPPORT_APIC
     case BX_MSR_APICBASE:
       return relocate_apic(val_64);
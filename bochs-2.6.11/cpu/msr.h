@@ -98,7 +98,9 @@ enum MSR_Register {
   BX_MSR_PERF_FIXED_CTR1  = 0x30a,  /* Fixed Performance Counter 1 (R/W): Counts CPU_CLK_Unhalted.Core */
   BX_MSR_PERF_FIXED_CTR2  = 0x30b,  /* Fixed Performance Counter 2 (R/W): Counts CPU_CLK_Unhalted.Ref */
   BX_MSR_FIXED_CTR_CTRL   = 0x38d,  /* Fixed Performance Counter Control (R/W) */
+  BX_MSR_PERF_GLOBAL_STATUS = 0x38e,  /* Global Performance Counter Overflow Status (RO) */
   BX_MSR_PERF_GLOBAL_CTRL = 0x38f,  /* Global Performance Counter Control */
+  BX_MSR_PERF_GLOBAL_OVF_CTRL = 0x390,  /* Global Performance Counter Overflow Control */
 #endif
 
 #if BX_SUPPORT_VMX
@@ -152,6 +154,9 @@ enum MSR_Register {
   BX_SVM_IGNNE_MSR     = 0xc0010115,
   BX_SVM_SMM_CTL_MSR   = 0xc0010116,
   BX_SVM_HSAVE_PA_MSR  = 0xc0010117,
+
+  /* Bochs paravirtual clock, same number and page layout as KVM's kvmclock */
+  BX_MSR_PVCLOCK       = 0x4b564d01,
 };
 
 const unsigned BX_NUM_VARIABLE_RANGE_MTRRS = 8;
@@ -50,6 +50,12 @@ void BX_CPU_C::check_monitor(bx_phy_address begin_addr, unsigned len)
 
 void BX_CPU_C::wakeup_monitor(void)
 {
+#if BX_SUPPORT_SMP
+  if (BX_SMP_REMOTE(BX_CPU_THIS)) {
+    bx_smp_post(BX_CPU_THIS, BX_SMP_MSG_MONITOR);
+    return;
+  }
+#endif
   // wakeup from MWAIT state
   if(BX_CPU_THIS_PTR activity_state >= BX_ACTIVITY_STATE_MWAIT)
      BX_CPU_THIS_PTR activity_state = BX_ACTIVITY_STATE_ACTIVE;
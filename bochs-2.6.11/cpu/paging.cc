@@ -420,11 +420,44 @@ void BX_CPU_C::TLB_flushNonGlobal(void)
 }
 #endif
 
+// CR3 write: the TLBs switch to the entries of the new address space, see
+// TLB::switch_space()
+void BX_CPU_C::TLB_switchAddressSpace(bx_address cr3, bx_bool keep_global)
+{
+  INC_TLBFLUSH_STAT(tlbNonGlobalFlushes);
+
+  invalidate_prefetch_q();
+  invalidate_stack_cache();
+
+  BX_CPU_THIS_PTR DTLB.switch_space(cr3, keep_global);
+  BX_CPU_THIS_PTR ITLB.switch_space(cr3, keep_global);
+
+#if BX_SUPPORT_MONITOR_MWAIT
+  // invalidating of the TLB might change translation for monitored page
+  // and cause subsequent MWAIT instruction to wait forever
+  BX_CPU_THIS_PTR monitor.reset_monitor();
+#endif
+
+  // break all links bewteen traces
+  BX_CPU_THIS_PTR iCache.breakLinks();
+}
+
+// a paging structure entry was written (or any page with write stamps),
+// the translations kept for the other address spaces might be stale
+void BX_CPU_C::TLB_flushInactive(void)
+{
+  BX_CPU_THIS_PTR DTLB.flushInactive();
+  BX_CPU_THIS_PTR ITLB.flushInactive();
+}
+
 void BX_CPU_C::TLB_invlpg(bx_address laddr)
 {
   invalidate_prefetch_q();
   invalidate_stack_cache();
 
+  // like the hardware, drop all paging-structure cache entries
+  pde_cache_flush();
+
   BX_DEBUG(("TLB_invlpg(0x" FMT_ADDRX "): invalidate TLB entry", laddr));
   BX_CPU_THIS_PTR DTLB.invlpg(laddr);
   BX_CPU_THIS_PTR ITLB.invlpg(laddr);
@@ -439,6 +472,30 @@ void BX_CPU_C::TLB_invlpg(bx_address laddr)
   BX_CPU_THIS_PTR iCache.breakLinks();
 }
 
+void BX_CPU_C::pde_cache_flush(void)
+{
+  for (unsigned n=0; n < BX_PDE_CACHE_SIZE; n++)
+    BX_CPU_THIS_PTR pde_cache[n].addr = BX_ICACHE_INVALID_PHY_ADDRESS;
+}
+
+// called through handleSMC() when a page holding cached PDEs is written
+void BX_CPU_C::pde_cache_invalidate(bx_phy_address pAddr)
+{
+  Bit32u index = bxPageWriteStampTable::hash(pAddr);
+
+  for (unsigned n=0; n < BX_PDE_CACHE_SIZE; n++) {
+    if (bxPageWriteStampTable::hash(BX_CPU_THIS_PTR pde_cache[n].addr) == index)
+      BX_CPU_THIS_PTR pde_cache[n].addr = BX_ICACHE_INVALID_PHY_ADDRESS;
+  }
+}
+
+BX_CPP_INLINE unsigned pde_cache_index(bx_phy_address entry_addr)
+{
+  // mix in the page directory so the same index of different address
+  // spaces doesn't collide
+  return (unsigned) ((entry_addr >> 2) ^ (entry_addr >> 12)) & (BX_PDE_CACHE_SIZE-1);
+}
+
 void BX_CPP_AttrRegparmN(1) BX_CPU_C::INVLPG(bxInstruction_c* i)
 {
   // CPL is always 0 in real mode
@@ -839,7 +896,8 @@ void BX_CPU_C::update_access_dirty_PAE(bx_phy_address *entry_addr, Bit64u *entry
   for (unsigned level=max_level; level > leaf; level--) {
     if (!(entry[level] & 0x20)) {
       entry[level] |= 0x20;
-      access_write_physical(entry_addr[level], 8, &entry[level]);
+      if (! set_entry_bits_atomic(entry_addr[level], 8, 0x20))
+        access_write_physical(entry_addr[level], 8, &entry[level]);
       BX_NOTIFY_PHY_MEMORY_ACCESS(entry_addr[level], 8, entry_memtype[level], BX_WRITE,
             (BX_PTE_ACCESS + level), (Bit8u*)(&entry[level]));
     }
@@ -848,10 +906,18 @@ void BX_CPU_C::update_access_dirty_PAE(bx_phy_address *entry_addr, Bit64u *entry
   // Update A/D bits if needed
   if (!(entry[leaf] & 0x20) || (write && !(entry[leaf] & 0x40))) {
     entry[leaf] |= (0x20 | (write<<6)); // Update A and possibly D bits
-    access_write_physical(entry_addr[leaf], 8, &entry[leaf]);
+    if (! set_entry_bits_atomic(entry_addr[leaf], 8, 0x20 | (write<<6)))
+      access_write_physical(entry_addr[leaf], 8, &entry[leaf]);
     BX_NOTIFY_PHY_MEMORY_ACCESS(entry_addr[leaf], 8, entry_memtype[leaf], BX_WRITE,
             (BX_PTE_ACCESS + leaf), (Bit8u*)(&entry[leaf]));
   }
+
+#if BX_TLB_ADDRESS_SPACES > 1
+  // after the A/D updates, catch writes to the entries behind the new
+  // TLB entry, see TLB_flushInactive()
+  for (unsigned level = leaf; level <= max_level; level++)
+    pageWriteStampTable.markICache(entry_addr[level], 8);
+#endif
 }
 
 //          Format of Legacy PAE PDPTR entry (PDPTE)
@@ -1133,8 +1199,25 @@ bx_phy_address BX_CPU_C::translate_linear_legacy(bx_address laddr, Bit32u &lpf_m
 #if BX_SUPPORT_MEMTYPE
     entry_memtype[leaf] = resolve_memtype(memtype_by_mtrr(entry_addr[leaf]), memtype_by_pat(calculate_pcd_pwt(curr_entry)));
 #endif
-    access_read_physical(entry_addr[leaf], 4, &entry[leaf]);
-    BX_NOTIFY_PHY_MEMORY_ACCESS(entry_addr[leaf], 4, entry_memtype[leaf], BX_READ, (BX_PTE_ACCESS + leaf), (Bit8u*)(&entry[leaf]));
+    if (leaf == BX_LEVEL_PDE) {
+      unsigned index = pde_cache_index(entry_addr[leaf]);
+      if (BX_CPU_THIS_PTR pde_cache[index].addr == entry_addr[leaf]) {
+        entry[leaf] = BX_CPU_THIS_PTR pde_cache[index].pde;
+      }
+      else {
+        access_read_physical(entry_addr[leaf], 4, &entry[leaf]);
+        BX_NOTIFY_PHY_MEMORY_ACCESS(entry_addr[leaf], 4, entry_memtype[leaf], BX_READ, (BX_PTE_ACCESS + leaf), (Bit8u*)(&entry[leaf]));
+        if (entry[leaf] & 0x1) {
+          BX_CPU_THIS_PTR pde_cache[index].addr = entry_addr[leaf];
+          BX_CPU_THIS_PTR pde_cache[index].pde = entry[leaf];
+          pageWriteStampTable.markICache(entry_addr[leaf], 4);
+        }
+      }
+    }
+    else {
+      access_read_physical(entry_addr[leaf], 4, &entry[leaf]);
+      BX_NOTIFY_PHY_MEMORY_ACCESS(entry_addr[leaf], 4, entry_memtype[leaf], BX_READ, (BX_PTE_ACCESS + leaf), (Bit8u*)(&entry[leaf]));
+    }
 
     curr_entry = entry[leaf];
     if (!(curr_entry & 0x1)) {
@@ -1232,11 +1315,13 @@ bx_phy_address BX_CPU_C::translate_linear_legacy(bx_address laddr, Bit32u &lpf_m
 
 void BX_CPU_C::update_access_dirty(bx_phy_address *entry_addr, Bit32u *entry, BxMemtype *entry_memtype, unsigned leaf, unsigned write)
 {
+
   if (leaf == BX_LEVEL_PTE) {
     // Update PDE A bit if needed
     if (!(entry[BX_LEVEL_PDE] & 0x20)) {
       entry[BX_LEVEL_PDE] |= 0x20;
-      access_write_physical(entry_addr[BX_LEVEL_PDE], 4, &entry[BX_LEVEL_PDE]);
+      if (! set_entry_bits_atomic(entry_addr[BX_LEVEL_PDE], 4, 0x20))
+        access_write_physical(entry_addr[BX_LEVEL_PDE], 4, &entry[BX_LEVEL_PDE]);
       BX_NOTIFY_PHY_MEMORY_ACCESS(entry_addr[BX_LEVEL_PDE], 4, entry_memtype[BX_LEVEL_PDE], BX_WRITE, BX_PDE_ACCESS, (Bit8u*)(&entry[BX_LEVEL_PDE]));
     }
   }
@@ -1244,9 +1329,17 @@ void BX_CPU_C::update_access_dirty(bx_phy_address *entry_addr, Bit32u *entry, Bx
   // Update A/D bits if needed
   if (!(entry[leaf] & 0x20) || (write && !(entry[leaf] & 0x40))) {
     entry[leaf] |= (0x20 | (write<<6)); // Update A and possibly D bits
-    access_write_physical(entry_addr[leaf], 4, &entry[leaf]);
+    if (! set_entry_bits_atomic(entry_addr[leaf], 4, 0x20 | (write<<6)))
+      access_write_physical(entry_addr[leaf], 4, &entry[leaf]);
     BX_NOTIFY_PHY_MEMORY_ACCESS(entry_addr[leaf], 4, entry_memtype[leaf], BX_WRITE, (BX_PTE_ACCESS + leaf), (Bit8u*)(&entry[leaf]));
   }
+
+#if BX_TLB_ADDRESS_SPACES > 1
+  // after the A/D updates, catch writes to the entries behind the new
+  // TLB entry, see TLB_flushInactive()
+  for (unsigned level = leaf; level <= BX_LEVEL_PDE; level++)
+    pageWriteStampTable.markICache(entry_addr[level], 4);
+#endif
 }
 
 // Translate a linear address to a physical address
@@ -1312,6 +1405,7 @@ bx_phy_address BX_CPU_C::translate_linear(bx_TLB_entry *tlbEntry, bx_address lad
   if(BX_CPU_THIS_PTR cr0.get_PG())
   {
     BX_DEBUG(("page walk for%s address 0x" FMT_LIN_ADDRX, isShadowStack ? " shadow stack" : "", laddr));
+    BX_PMU_EVENT(isExecute ? BX_PMU_EVENT_ITLB_MISS : BX_PMU_EVENT_DTLB_MISS);
 
 #if BX_CPU_LEVEL >= 6
 #if BX_SUPPORT_X86_64
@@ -2056,7 +2150,8 @@ void BX_CPU_C::update_ept_access_dirty(bx_phy_address *entry_addr, Bit64u *entry
   for (unsigned level=BX_LEVEL_PML4; level > leaf; level--) {
     if (!(entry[level] & 0x100)) {
       entry[level] |= 0x100;
-      access_write_physical(entry_addr[level], 8, &entry[level]);
+      if (! set_entry_bits_atomic(entry_addr[level], 8, 0x100))
+        access_write_physical(entry_addr[level], 8, &entry[level]);
       BX_NOTIFY_PHY_MEMORY_ACCESS(entry_addr[level], 8, MEMTYPE(eptptr_memtype), BX_WRITE, (BX_EPT_PTE_ACCESS + level), (Bit8u*)(&entry[level]));
     }
   }
@@ -2064,7 +2159,8 @@ void BX_CPU_C::update_ept_access_dirty(bx_phy_address *entry_addr, Bit64u *entry
   // Update A/D bits if needed
   if (!(entry[leaf] & 0x100) || (write && !(entry[leaf] & 0x200))) {
     entry[leaf] |= (0x100 | (write<<9)); // Update A and possibly D bits
-    access_write_physical(entry_addr[leaf], 8, &entry[leaf]);
+    if (! set_entry_bits_atomic(entry_addr[leaf], 8, 0x100 | (write<<9)))
+      access_write_physical(entry_addr[leaf], 8, &entry[leaf]);
     BX_NOTIFY_PHY_MEMORY_ACCESS(entry_addr[leaf], 8, MEMTYPE(eptptr_memtype), BX_WRITE, (BX_EPT_PTE_ACCESS + leaf), (Bit8u*)(&entry[leaf]));
   }
 }
@@ -2632,6 +2728,31 @@ bx_hostpageaddr_t BX_CPU_C::getHostMemAddr(bx_phy_address paddr, unsigned rw)
   return (bx_hostpageaddr_t) BX_MEM(0)->getHostMemAddr(BX_CPU_THIS, paddr, rw);
 }
 
+// With the processors on their own threads the Accessed and Dirty bits
+// must be set with a locked OR, or a page table entry written by another
+// processor in the meantime would be overwritten with the stale copy.
+// Returns 0 if the caller has to write the entry back itself.
+bx_bool BX_CPU_C::set_entry_bits_atomic(bx_phy_address paddr, unsigned len, Bit64u bits)
+{
+#if BX_SUPPORT_SMP && defined(BX_LITTLE_ENDIAN)
+  if (! bx_smp_threaded || (paddr & (len-1)) != 0)
+    return 0;
+
+  Bit8u *hostAddr = (Bit8u *) getHostMemAddr(paddr, BX_WRITE);
+  if (hostAddr == NULL)
+    return 0;
+
+  pageWriteStampTable.decWriteStamp(paddr, len);
+  if (len == 8)
+    BX_ATOMIC_OR64(hostAddr, bits);
+  else
+    BX_ATOMIC_OR32(hostAddr, (Bit32u) bits);
+  return 1;
+#else
+  return 0;
+#endif
+}
+
 #if BX_LARGE_RAMFILE
 bx_bool BX_CPU_C::check_addr_in_tlb_buffers(const Bit8u *addr, const Bit8u *end)
 {
@@ -2649,7 +2770,7 @@ bx_bool BX_CPU_C::check_addr_in_tlb_buffers(const Bit8u *addr, const Bit8u *end)
   }
 #endif
 
-  for (unsigned tlb_entry_num=0; tlb_entry_num < BX_DTLB_SIZE; tlb_entry_num++) {
+  for (unsigned tlb_entry_num=0; tlb_entry_num < BX_DTLB_SIZE * BX_TLB_ADDRESS_SPACES; tlb_entry_num++) {
     bx_TLB_entry *tlbEntry = &BX_CPU_THIS_PTR DTLB.entry[tlb_entry_num];
     if (tlbEntry->valid()) {
       if ((tlbEntry->hostPageAddr >= (const bx_hostpageaddr_t)addr) &&
@@ -2658,7 +2779,7 @@ bx_bool BX_CPU_C::check_addr_in_tlb_buffers(const Bit8u *addr, const Bit8u *end)
     }
   }
 
-  for (unsigned tlb_entry_num=0; tlb_entry_num < BX_ITLB_SIZE; tlb_entry_num++) {
+  for (unsigned tlb_entry_num=0; tlb_entry_num < BX_ITLB_SIZE * BX_TLB_ADDRESS_SPACES; tlb_entry_num++) {
     bx_TLB_entry *tlbEntry = &BX_CPU_THIS_PTR ITLB.entry[tlb_entry_num];
     if (tlbEntry->valid()) {
       if ((tlbEntry->hostPageAddr >= (const bx_hostpageaddr_t)addr) &&
@@ -0,0 +1,371 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+//
+/////////////////////////////////////////////////////////////////////////
+
+#define NEED_CPU_REG_SHORTCUTS 1
+#include "bochs.h"
+#include "cpu.h"
+#include "msr.h"
+#define LOG_THIS BX_CPU_THIS_PTR
+
+#if BX_SUPPORT_PERFMON
+
+// event select and unit mask of the events that are emulated, the other
+// events are accepted and never count
+static unsigned pmu_decode_event(Bit64u evtsel)
+{
+  unsigned event = (unsigned)(evtsel & 0xff), umask = (unsigned)((evtsel >> 8) & 0xff);
+
+  switch (event) {
+    case 0x3c: // UnHalted Core Cycles (umask 0), UnHalted Reference Cycles (umask 1)
+      if (umask <= 1) return BX_PMU_EVENT_INSTRUCTIONS;
+      break;
+    case 0xc0: // Instructions Retired
+      if (umask == 0) return BX_PMU_EVENT_INSTRUCTIONS;
+      break;
+    case 0x08: // DTLB_LOAD_MISSES.ANY
+    case 0x49: // DTLB_MISSES.ANY
+      if (umask == 1) return BX_PMU_EVENT_DTLB_MISS;
+      break;
+    case 0x85: // ITLB_MISSES.ANY
+      if (umask == 1) return BX_PMU_EVENT_ITLB_MISS;
+      break;
+    case 0x80: // ICACHE.MISSES
+      if (umask == 2) return BX_PMU_EVENT_ICACHE_MISS;
+      break;
+  }
+  return BX_PMU_EVENT_NONE;
+}
+
+static Bit64u pmu_width_mask(unsigned width)
+{
+  if (width == 0) width = 40;
+  return (width >= 64) ? BX_CONST64(0xffffffffffffffff) : ((BX_CONST64(1) << width) - 1);
+}
+
+void BX_CPU_C::pmu_init(void)
+{
+  cpuid_function_t leaf;
+  Bit32u max_leaf;
+
+  memset(&BX_CPU_THIS_PTR pmu, 0, sizeof(bx_pmu_t));
+
+  BX_CPU_THIS_PTR cpuid->get_cpuid_leaf(0, 0, &leaf);
+  max_leaf = leaf.eax;
+  if (max_leaf >= 0xa) {
+    BX_CPU_THIS_PTR cpuid->get_cpuid_leaf(0xa, 0, &leaf);
+    unsigned version = leaf.eax & 0xff;
+    if (version > 0) {
+      // later versions add controls on top of version 2, these are not emulated
+      BX_CPU_THIS_PTR pmu.version = (version > 2) ? 2 : version;
+      BX_CPU_THIS_PTR pmu.gp_counters = (leaf.eax >> 8) & 0xff;
+      if (BX_CPU_THIS_PTR pmu.gp_counters > BX_PMU_MAX_GP_COUNTERS)
+        BX_CPU_THIS_PTR pmu.gp_counters = BX_PMU_MAX_GP_COUNTERS;
+      BX_CPU_THIS_PTR pmu.gp_mask = pmu_width_mask((leaf.eax >> 16) & 0xff);
+      if (version > 1) {
+        BX_CPU_THIS_PTR pmu.fixed_counters = leaf.edx & 0x1f;
+        if (BX_CPU_THIS_PTR pmu.fixed_counters > BX_PMU_MAX_FIXED_COUNTERS)
+          BX_CPU_THIS_PTR pmu.fixed_counters = BX_PMU_MAX_FIXED_COUNTERS;
+        BX_CPU_THIS_PTR pmu.fixed_mask = pmu_width_mask((leaf.edx >> 5) & 0xff);
+      }
+    }
+  }
+
+  BX_CPU_THIS_PTR pmu.timer_index = bx_pc_system.register_timer_ticks(BX_CPU_THIS,
+      BX_CPU_C::pmu_timer_handler, 1, 0, 0, "pmu");
+
+  if (BX_CPU_THIS_PTR pmu.version > 0)
+    BX_INFO(("PMU: architectural perfmon v%u, %u general and %u fixed counters",
+      BX_CPU_THIS_PTR pmu.version, BX_CPU_THIS_PTR pmu.gp_counters, BX_CPU_THIS_PTR pmu.fixed_counters));
+}
+
+void BX_CPU_C::pmu_reset(void)
+{
+  unsigned n;
+
+  for (n=0; n < BX_PMU_MAX_GP_COUNTERS; n++) {
+    BX_CPU_THIS_PTR pmu.evtsel[n] = 0;
+    BX_CPU_THIS_PTR pmu.gp[n] = 0;
+  }
+  for (n=0; n < BX_PMU_MAX_FIXED_COUNTERS; n++)
+    BX_CPU_THIS_PTR pmu.fixed[n] = 0;
+  BX_CPU_THIS_PTR pmu.fixed_ctrl = 0;
+  // the general counters are enabled globally after reset
+  BX_CPU_THIS_PTR pmu.global_ctrl = (BX_CONST64(1) << BX_CPU_THIS_PTR pmu.gp_counters) - 1;
+  BX_CPU_THIS_PTR pmu.global_status = 0;
+  BX_CPU_THIS_PTR pmu.icount = BX_CPU_THIS_PTR icount;
+  pmu_update();
+}
+
+void BX_CPU_C::pmu_timer_handler(void *this_ptr)
+{
+  BX_CPU_C *class_ptr = (BX_CPU_C *) this_ptr;
+  class_ptr->pmu_timer();
+}
+
+// an instruction counter may have wrapped, the timer ticks are only an
+// estimate of the instructions when the cpu was halted in between
+void BX_CPU_C::pmu_timer(void)
+{
+  pmu_sync();
+  pmu_update();
+}
+
+// Add delta to the counters in the global control bit layout, report the
+// counters that wrapped.
+void BX_CPU_C::pmu_add(Bit64u counters, Bit64u delta)
+{
+  Bit64u overflow = 0;
+  unsigned n;
+
+  for (n=0; n < BX_CPU_THIS_PTR pmu.gp_counters; n++) {
+    if (counters & (BX_CONST64(1) << n)) {
+      Bit64u val = BX_CPU_THIS_PTR pmu.gp[n] + delta;
+      if (val > BX_CPU_THIS_PTR pmu.gp_mask) overflow |= BX_CONST64(1) << n;
+      BX_CPU_THIS_PTR pmu.gp[n] = val & BX_CPU_THIS_PTR pmu.gp_mask;
+    }
+  }
+  for (n=0; n < BX_CPU_THIS_PTR pmu.fixed_counters; n++) {
+    if (counters & BX_PMU_FIXED_BIT(n)) {
+      Bit64u val = BX_CPU_THIS_PTR pmu.fixed[n] + delta;
+      if (val > BX_CPU_THIS_PTR pmu.fixed_mask) overflow |= BX_PMU_FIXED_BIT(n);
+      BX_CPU_THIS_PTR pmu.fixed[n] = val & BX_CPU_THIS_PTR pmu.fixed_mask;
+    }
+  }
+  if (overflow)
+    pmu_overflow(overflow);
+}
+
+void BX_CPU_C::pmu_overflow(Bit64u counters)
+{
+  bx_bool pmi = 0;
+  unsigned n;
+
+  if (BX_CPU_THIS_PTR pmu.version > 1)
+    BX_CPU_THIS_PTR pmu.global_status |= counters;
+
+  for (n=0; n < BX_CPU_THIS_PTR pmu.gp_counters; n++) {
+    if ((counters & (BX_CONST64(1) << n)) && (BX_CPU_THIS_PTR pmu.evtsel[n] & BX_PMU_EVTSEL_INT))
+      pmi = 1;
+  }
+  for (n=0; n < BX_CPU_THIS_PTR pmu.fixed_counters; n++) {
+    if ((counters & BX_PMU_FIXED_BIT(n)) && ((BX_CPU_THIS_PTR pmu.fixed_ctrl >> (n*4)) & BX_PMU_FIXED_PMI))
+      pmi = 1;
+  }
+#if BX_SUPPORT_APIC
+  if (pmi)
+    BX_CPU_THIS_PTR lapic.perfmon_overflow();
+#endif
+}
+
+// fold the instructions retired since the last sync into the counters
+void BX_CPU_C::pmu_sync(void)
+{
+  Bit64u delta = BX_CPU_THIS_PTR icount - BX_CPU_THIS_PTR pmu.icount;
+
+  BX_CPU_THIS_PTR pmu.icount = BX_CPU_THIS_PTR icount;
+  if (delta && BX_CPU_THIS_PTR pmu.counting[BX_PMU_EVENT_INSTRUCTIONS])
+    pmu_add(BX_CPU_THIS_PTR pmu.counting[BX_PMU_EVENT_INSTRUCTIONS], delta);
+}
+
+void BX_CPU_C::pmu_count(unsigned event)
+{
+  pmu_add(BX_CPU_THIS_PTR pmu.counting[event], 1);
+}
+
+// Work out what every counter counts at the current CPL. Called after a
+// control register changed and on every CPL change, pmu_sync() must have
+// folded in the instructions of the old setup before.
+void BX_CPU_C::pmu_update(void)
+{
+  Bit64u global = BX_CPU_THIS_PTR pmu.global_ctrl;
+  unsigned n, cpl = CPL;
+
+  if (BX_CPU_THIS_PTR pmu.version < 2) global = BX_CONST64(0xffffffffffffffff);
+
+  BX_CPU_THIS_PTR pmu.cpl = cpl;
+  for (n=0; n < BX_PMU_EVENTS; n++)
+    BX_CPU_THIS_PTR pmu.counting[n] = 0;
+  BX_CPU_THIS_PTR pmu.event_mask = 0;
+
+  for (n=0; n < BX_CPU_THIS_PTR pmu.gp_counters; n++) {
+    Bit64u evtsel = BX_CPU_THIS_PTR pmu.evtsel[n];
+    if (!(evtsel & BX_PMU_EVTSEL_EN) || !(global & (BX_CONST64(1) << n))) continue;
+    if (!(evtsel & ((cpl == 0) ? BX_PMU_EVTSEL_OS : BX_PMU_EVTSEL_USR))) continue;
+    unsigned event = pmu_decode_event(evtsel);
+    if (event == BX_PMU_EVENT_NONE) continue;
+    BX_CPU_THIS_PTR pmu.counting[event] |= BX_CONST64(1) << n;
+    BX_CPU_THIS_PTR pmu.event_mask |= 1 << event;
+  }
+  // fixed counters: instructions retired, core cycles, reference cycles
+  for (n=0; n < BX_CPU_THIS_PTR pmu.fixed_counters; n++) {
+    unsigned ctrl = (unsigned)(BX_CPU_THIS_PTR pmu.fixed_ctrl >> (n*4)) & 0xf;
+    if (!(global & BX_PMU_FIXED_BIT(n))) continue;
+    if (!(ctrl & ((cpl == 0) ? BX_PMU_FIXED_OS : BX_PMU_FIXED_USR))) continue;
+    BX_CPU_THIS_PTR pmu.counting[BX_PMU_EVENT_INSTRUCTIONS] |= BX_PMU_FIXED_BIT(n);
+    BX_CPU_THIS_PTR pmu.event_mask |= 1 << BX_PMU_EVENT_INSTRUCTIONS;
+  }
+
+  // wake up when the first instruction counter wraps
+  Bit64u counters = BX_CPU_THIS_PTR pmu.counting[BX_PMU_EVENT_INSTRUCTIONS], left = 0;
+  if (counters) {
+    for (n=0; n < BX_CPU_THIS_PTR pmu.gp_counters; n++) {
+      if (!(counters & (BX_CONST64(1) << n))) continue;
+      Bit64u val = BX_CPU_THIS_PTR pmu.gp_mask - BX_CPU_THIS_PTR pmu.gp[n] + 1;
+      if (left == 0 || val < left) left = val;
+    }
+    for (n=0; n < BX_CPU_THIS_PTR pmu.fixed_counters; n++) {
+      if (!(counters & BX_PMU_FIXED_BIT(n))) continue;
+      Bit64u val = BX_CPU_THIS_PTR pmu.fixed_mask - BX_CPU_THIS_PTR pmu.fixed[n] + 1;
+      if (left == 0 || val < left) left = val;
+    }
+    bx_pc_system.activate_timer_ticks(BX_CPU_THIS_PTR pmu.timer_index, left, 0);
+  }
+  else {
+    bx_pc_system.deactivate_timer(BX_CPU_THIS_PTR pmu.timer_index);
+  }
+}
+
+// counter selected by RDPMC: ECX[30] selects the fixed counters
+bx_bool BX_CPU_C::pmu_read_counter(Bit32u index, Bit64u *val)
+{
+  Bit32u n = index & 0x3fffffff;
+
+  pmu_sync();
+  if (index & 0x40000000) {
+    if (n >= BX_CPU_THIS_PTR pmu.fixed_counters) return 0;
+    *val = BX_CPU_THIS_PTR pmu.fixed[n];
+  }
+  else {
+    if (n >= BX_CPU_THIS_PTR pmu.gp_counters) return 0;
+    *val = BX_CPU_THIS_PTR pmu.gp[n];
+  }
+  return 1;
+}
+
+bx_bool BX_CPU_C::pmu_rdmsr(Bit32u index, Bit64u *msr)
+{
+  pmu_sync();
+
+  if (index >= BX_MSR_PMC0 && index < BX_MSR_PMC0 + BX_CPU_THIS_PTR pmu.gp_counters) {
+    *msr = BX_CPU_THIS_PTR pmu.gp[index - BX_MSR_PMC0];
+    return 1;
+  }
+  if (index >= BX_MSR_PERFEVTSEL0 && index < BX_MSR_PERFEVTSEL0 + BX_CPU_THIS_PTR pmu.gp_counters) {
+    *msr = BX_CPU_THIS_PTR pmu.evtsel[index - BX_MSR_PERFEVTSEL0];
+    return 1;
+  }
+  if (index >= BX_MSR_PERF_FIXED_CTR0 && index < BX_MSR_PERF_FIXED_CTR0 + BX_CPU_THIS_PTR pmu.fixed_counters) {
+    *msr = BX_CPU_THIS_PTR pmu.fixed[index - BX_MSR_PERF_FIXED_CTR0];
+    return 1;
+  }
+  if (BX_CPU_THIS_PTR pmu.version < 2) return 0;
+
+  switch(index) {
+    case BX_MSR_FIXED_CTR_CTRL:
+      *msr = BX_CPU_THIS_PTR pmu.fixed_ctrl;
+      return 1;
+    case BX_MSR_PERF_GLOBAL_CTRL:
+      *msr = BX_CPU_THIS_PTR pmu.global_ctrl;
+      return 1;
+    case BX_MSR_PERF_GLOBAL_STATUS:
+      *msr = BX_CPU_THIS_PTR pmu.global_status;
+      return 1;
+    case BX_MSR_PERF_GLOBAL_OVF_CTRL:
+      *msr = 0;
+      return 1;
+  }
+  return 0;
+}
+
+bx_bool BX_CPU_C::pmu_wrmsr(Bit32u index, Bit64u val_64)
+{
+  Bit64u gp_bits = (BX_CONST64(1) << BX_CPU_THIS_PTR pmu.gp_counters) - 1;
+  Bit64u fixed_bits = ((BX_CONST64(1) << BX_CPU_THIS_PTR pmu.fixed_counters) - 1) << 32;
+
+  pmu_sync();
+
+  if (index >= BX_MSR_PMC0 && index < BX_MSR_PMC0 + BX_CPU_THIS_PTR pmu.gp_counters) {
+    // only the low 32 bits are written, sign extended to the counter width
+    BX_CPU_THIS_PTR pmu.gp[index - BX_MSR_PMC0] = (Bit64u)(Bit64s)(Bit32s)(Bit32u) val_64 & BX_CPU_THIS_PTR pmu.gp_mask;
+  }
+  else if (index >= BX_MSR_PERFEVTSEL0 && index < BX_MSR_PERFEVTSEL0 + BX_CPU_THIS_PTR pmu.gp_counters) {
+    if (val_64 >> 32) {
+      BX_ERROR(("WRMSR: attempt to set reserved bits of IA32_PERFEVTSEL%d", index - BX_MSR_PERFEVTSEL0));
+      return 0;
+    }
+    BX_CPU_THIS_PTR pmu.evtsel[index - BX_MSR_PERFEVTSEL0] = val_64;
+  }
+  else if (index >= BX_MSR_PERF_FIXED_CTR0 && index < BX_MSR_PERF_FIXED_CTR0 + BX_CPU_THIS_PTR pmu.fixed_counters) {
+    BX_CPU_THIS_PTR pmu.fixed[index - BX_MSR_PERF_FIXED_CTR0] = val_64 & BX_CPU_THIS_PTR pmu.fixed_mask;
+  }
+  else {
+    if (BX_CPU_THIS_PTR pmu.version < 2) return 0;
+
+    switch(index) {
+      case BX_MSR_FIXED_CTR_CTRL:
+        if (val_64 & ~((BX_CONST64(1) << (BX_CPU_THIS_PTR pmu.fixed_counters * 4)) - 1)) {
+          BX_ERROR(("WRMSR: attempt to set reserved bits of IA32_FIXED_CTR_CTRL"));
+          return 0;
+        }
+        BX_CPU_THIS_PTR pmu.fixed_ctrl = val_64;
+        break;
+      case BX_MSR_PERF_GLOBAL_CTRL:
+        if (val_64 & ~(gp_bits | fixed_bits)) {
+          BX_ERROR(("WRMSR: attempt to set reserved bits of IA32_PERF_GLOBAL_CTRL"));
+          return 0;
+        }
+        BX_CPU_THIS_PTR pmu.global_ctrl = val_64;
+        break;
+      case BX_MSR_PERF_GLOBAL_OVF_CTRL:
+        BX_CPU_THIS_PTR pmu.global_status &= ~val_64;
+        break;
+      default: // IA32_PERF_GLOBAL_STATUS is read only
+        return 0;
+    }
+  }
+
+  pmu_update();
+  return 1;
+}
+
+void BX_CPU_C::register_pmu_state(bx_param_c *parent)
+{
+  char name[16];
+  unsigned n;
+
+  bx_list_c *pmu = new bx_list_c(parent, "PMU");
+  for (n=0; n < BX_PMU_MAX_GP_COUNTERS; n++) {
+    sprintf(name, "evtsel%u", n);
+    new bx_shadow_num_c(pmu, name, &BX_CPU_THIS_PTR pmu.evtsel[n], BASE_HEX);
+    sprintf(name, "pmc%u", n);
+    new bx_shadow_num_c(pmu, name, &BX_CPU_THIS_PTR pmu.gp[n], BASE_HEX);
+  }
+  for (n=0; n < BX_PMU_MAX_FIXED_COUNTERS; n++) {
+    sprintf(name, "fixed%u", n);
+    new bx_shadow_num_c(pmu, name, &BX_CPU_THIS_PTR pmu.fixed[n], BASE_HEX);
+  }
+  BXRS_HEX_PARAM_FIELD(pmu, fixed_ctrl, BX_CPU_THIS_PTR pmu.fixed_ctrl);
+  BXRS_HEX_PARAM_FIELD(pmu, global_ctrl, BX_CPU_THIS_PTR pmu.global_ctrl);
+  BXRS_HEX_PARAM_FIELD(pmu, global_status, BX_CPU_THIS_PTR pmu.global_status);
+}
+
+#endif // BX_SUPPORT_PERFMON
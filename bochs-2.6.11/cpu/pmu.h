@@ -0,0 +1,82 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_PMU_H
+#define BX_PMU_H
+
+// Architectural performance monitoring (version 1 and 2). The number and
+// width of the counters are taken from CPUID leaf 0xA of the cpu model.
+// Bochs retires one instruction per cycle, so the cycle events count the
+// retired instructions; both are folded in lazily from icount. The TLB and
+// trace cache misses are counted where they happen.
+
+#define BX_PMU_MAX_GP_COUNTERS    8
+#define BX_PMU_MAX_FIXED_COUNTERS 3
+
+// bit of a fixed counter in IA32_PERF_GLOBAL_CTRL/STATUS
+#define BX_PMU_FIXED_BIT(n) (BX_CONST64(1) << (32 + (n)))
+
+// IA32_PERFEVTSELx
+#define BX_PMU_EVTSEL_USR     (1 << 16)
+#define BX_PMU_EVTSEL_OS      (1 << 17)
+#define BX_PMU_EVTSEL_INT     (1 << 20)
+#define BX_PMU_EVTSEL_EN      (1 << 22)
+
+// IA32_FIXED_CTR_CTRL, 4 bits per counter
+#define BX_PMU_FIXED_OS       0x1
+#define BX_PMU_FIXED_USR      0x2
+#define BX_PMU_FIXED_PMI      0x8
+
+// emulated events
+enum {
+  BX_PMU_EVENT_INSTRUCTIONS = 0,  // instructions retired, unhalted cycles
+  BX_PMU_EVENT_DTLB_MISS,         // data TLB misses (page walks)
+  BX_PMU_EVENT_ITLB_MISS,         // instruction TLB misses
+  BX_PMU_EVENT_ICACHE_MISS,       // trace cache misses
+  BX_PMU_EVENTS,
+  BX_PMU_EVENT_NONE = BX_PMU_EVENTS
+};
+
+struct bx_pmu_t {
+  unsigned version;
+  unsigned gp_counters;
+  unsigned fixed_counters;
+  Bit64u gp_mask;       // counter width masks
+  Bit64u fixed_mask;
+
+  Bit64u evtsel[BX_PMU_MAX_GP_COUNTERS];
+  Bit64u gp[BX_PMU_MAX_GP_COUNTERS];
+  Bit64u fixed[BX_PMU_MAX_FIXED_COUNTERS];
+  Bit64u fixed_ctrl;
+  Bit64u global_ctrl;
+  Bit64u global_status;
+
+  // counters (global control bit layout) counting each event right now,
+  // for the CPL the cpu had at the last update
+  Bit64u counting[BX_PMU_EVENTS];
+  Bit32u event_mask;    // events with at least one counter
+  unsigned cpl;
+  Bit64u icount;        // icount folded into the counters
+  int timer_index;
+};
+
+#endif
@@ -109,6 +109,25 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::CPUID(bxInstruction_c *i)
   struct cpuid_function_t leaf;
   BX_CPU_THIS_PTR cpuid->get_cpuid_leaf(EAX, ECX, &leaf);
 
+#if BX_CPU_LEVEL >= 5
+  // the paravirtual clock is announced in the hypervisor leaves
+  if (BX_CPU_THIS_PTR pvclock_enabled) {
+    if (EAX == 1) {
+      leaf.ecx |= BX_CPUID_EXT_HYPERVISOR;
+    }
+    else if (EAX == 0x40000000) {
+      leaf.eax = 0x40000001;
+      leaf.ebx = 0x68636f42; // "BochsPVClock"
+      leaf.ecx = 0x43565073;
+      leaf.edx = 0x6b636f6c;
+    }
+    else if (EAX == 0x40000001) {
+      leaf.eax = (1 << 3);   // BX_MSR_PVCLOCK, the bit KVM uses for it
+      leaf.ebx = leaf.ecx = leaf.edx = 0;
+    }
+  }
+#endif
+
   RAX = leaf.eax;
   RBX = leaf.ebx;
   RCX = leaf.ecx;
@@ -177,6 +196,10 @@ void BX_CPU_C::enter_sleep_state(unsigned state)
 #endif
 
 #if BX_USE_IDLE_HACK
+#if BX_SUPPORT_SMP
+  // the GUI belongs to the main thread
+  if (! bx_smp_threaded)
+#endif
   bx_gui->sim_is_idle();
 #endif
 }
@@ -403,6 +426,14 @@ void BX_CPU_C::handleAlignmentCheck(void)
     BX_CPU_THIS_PTR alignment_check_mask = 0;
   }
 #endif
+
+#if BX_SUPPORT_PERFMON
+  // called on every CPL change, the OS/USR counter filters follow the CPL
+  if (CPL != BX_CPU_THIS_PTR pmu.cpl) {
+    pmu_sync();
+    pmu_update();
+  }
+#endif
 }
 #endif
 
@@ -572,6 +603,16 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::RDPMC(bxInstruction_c *i)
   }
 #endif
 
+#if BX_SUPPORT_PERFMON
+  Bit64u val_64;
+  if (! pmu_read_counter(ECX, &val_64)) {
+    BX_ERROR(("RDPMC: invalid counter index %08x", ECX));
+    exception(BX_GP_EXCEPTION, 0);
+  }
+
+  RAX = GET32L(val_64);
+  RDX = GET32H(val_64);
+#else
   /* According to manual, Pentium 4 has 18 counters,
    * previous versions have two.  And the P4 also can do
    * short read-out (EDX always 0).  Otherwise it is
@@ -598,15 +639,40 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::RDPMC(bxInstruction_c *i)
   RDX = 0; // if P4 and ECX & 0x10000000, then always 0 (short read 32 bits)
 
   BX_ERROR(("RDPMC: Performance Counters Support not implemented yet"));
+#endif
 #endif
 
   BX_NEXT_INSTR(i);
 }
 
 #if BX_CPU_LEVEL >= 5
+// a * mul / div without overflowing 64 bits for any a
+static Bit64u scale_ticks(Bit64u a, Bit32u mul, Bit32u div, bx_bool round_up)
+{
+  Bit64u rem = (a % div) * mul;
+  Bit64u result = (a / div) * mul + rem / div;
+  if (round_up && (rem % div) != 0) result++;
+  return result;
+}
+
+// The TSC runs at tsc_freq Hz of emulated time, one second of emulated
+// time is ips ticks. Both directions are exact when no frequency is set.
+Bit64u BX_CPU_C::ticks_to_tsc(Bit64u ticks)
+{
+  if (BX_CPU_THIS_PTR tsc_freq == 0) return ticks;
+  return scale_ticks(ticks, BX_CPU_THIS_PTR tsc_freq, BX_CPU_THIS_PTR tsc_ips, 0);
+}
+
+// rounds up, so that a timer set to the result does not fire early
+Bit64u BX_CPU_C::tsc_to_ticks(Bit64u tsc)
+{
+  if (BX_CPU_THIS_PTR tsc_freq == 0) return tsc;
+  return scale_ticks(tsc, BX_CPU_THIS_PTR tsc_ips, BX_CPU_THIS_PTR tsc_freq, 1);
+}
+
 Bit64u BX_CPU_C::get_TSC(void)
 {
-  Bit64u tsc = bx_pc_system.time_ticks() - BX_CPU_THIS_PTR tsc_last_reset;
+  Bit64u tsc = ticks_to_tsc(bx_pc_system.time_ticks()) - BX_CPU_THIS_PTR tsc_last_reset;
 #if BX_SUPPORT_VMX || BX_SUPPORT_SVM
 #if BX_SUPPORT_VMX
   if (BX_CPU_THIS_PTR in_vmx_guest) {
@@ -623,10 +689,82 @@ void BX_CPU_C::set_TSC(Bit64u newval)
 {
   // compute the correct setting of tsc_last_reset so that a get_TSC()
   // will return newval
-  BX_CPU_THIS_PTR tsc_last_reset = bx_pc_system.time_ticks() - newval;
+  BX_CPU_THIS_PTR tsc_last_reset = ticks_to_tsc(bx_pc_system.time_ticks()) - newval;
 
   // verify
   BX_ASSERT(get_TSC() == newval);
+
+#if BX_SUPPORT_APIC && BX_CPU_LEVEL >= 6
+  // an armed TSC-deadline timer now expires at a different time
+  Bit64u deadline = BX_CPU_THIS_PTR lapic.get_tsc_deadline();
+  if (deadline != 0)
+    BX_CPU_THIS_PTR lapic.set_tsc_deadline(deadline);
+#endif
+
+  // the guest's clock page maps the TSC to nanoseconds
+  pvclock_update();
+}
+
+// Find mul and shift so that ((tsc << shift) * mul) >> 32 converts base_hz
+// units to scaled_hz units, a negative shift shifts right (from KVM).
+static void pvclock_scale(Bit64u scaled_hz, Bit64u base_hz, Bit8s *shift, Bit32u *mul)
+{
+  Bit64u scaled64 = scaled_hz, tps64 = base_hz;
+  int n = 0;
+
+  while (tps64 > scaled64*2 || (tps64 >> 32) != 0) {
+    tps64 >>= 1;
+    n--;
+  }
+
+  Bit32u tps32 = (Bit32u) tps64;
+  while (tps32 <= scaled64 || (scaled64 >> 32) != 0) {
+    if ((scaled64 >> 32) != 0 || (tps32 & 0x80000000) != 0)
+      scaled64 >>= 1;
+    else
+      tps32 <<= 1;
+    n++;
+  }
+
+  *shift = (Bit8s) n;
+  *mul = (Bit32u) ((scaled64 << 32) / tps32);
+}
+
+// Rewrite the clock page registered through BX_MSR_PVCLOCK, which has the
+// layout of KVM's pvclock_vcpu_time_info:
+//    0  version, odd while the page is rewritten
+//    8  tsc_timestamp
+//   16  system_time, emulated nanoseconds since power on at tsc_timestamp
+//   24  tsc_to_system_mul
+//   28  tsc_shift
+//   29  flags
+// The TSC counts emulated time at a fixed rate, so the page only has to be
+// rewritten when it is registered and when the TSC is set.
+void BX_CPU_C::pvclock_update(void)
+{
+  if (! (BX_CPU_THIS_PTR msr.pvclock & 1)) return;
+
+  bx_phy_address paddr = (bx_phy_address)(BX_CPU_THIS_PTR msr.pvclock & ~BX_CONST64(1));
+  Bit64u ticks = bx_pc_system.time_ticks();
+  Bit64u tsc = ticks_to_tsc(ticks) - BX_CPU_THIS_PTR tsc_last_reset;
+  Bit64u system_time = scale_ticks(ticks, 1000000000, BX_CPU_THIS_PTR tsc_ips, 0);
+  Bit32u tsc_hz = BX_CPU_THIS_PTR tsc_freq ? BX_CPU_THIS_PTR tsc_freq : BX_CPU_THIS_PTR tsc_ips;
+  Bit32u mul;
+  Bit8s shift;
+  Bit8u flags = 0;
+
+  pvclock_scale(1000000000, tsc_hz, &shift, &mul);
+
+  Bit32u version = BX_CPU_THIS_PTR pvclock_version | 1;
+  access_write_physical(paddr, 4, &version);
+  access_write_physical(paddr + 8, 8, &tsc);
+  access_write_physical(paddr + 16, 8, &system_time);
+  access_write_physical(paddr + 24, 4, &mul);
+  access_write_physical(paddr + 28, 1, &shift);
+  access_write_physical(paddr + 29, 1, &flags);
+  version++;
+  access_write_physical(paddr, 4, &version);
+  BX_CPU_THIS_PTR pvclock_version = version;
 }
 #endif
 
@@ -24,6 +24,31 @@
 #include "cpu.h"
 #define LOG_THIS BX_CPU_THIS_PTR
 
+// Flat (base 0, 4G limit) data segments are what every protected mode OS
+// uses. Mark them as such right when they are loaded, so agen_read32() and
+// agen_write32() take the no-check path from the first access on instead of
+// going through read/write_virtual_checks() once per segment load. The
+// flags are the same those checks would set.
+BX_CPP_INLINE Bit32u segment_access_flags(const bx_descriptor_t *descriptor)
+{
+  if (descriptor->u.segment.base != 0 || descriptor->u.segment.limit_scaled != 0xffffffff)
+    return 0;
+
+  if (IS_CODE_SEGMENT(descriptor->type)) {
+    if (IS_CODE_SEGMENT_READABLE(descriptor->type))
+      return SegAccessROK | SegAccessROK4G;
+    return 0;
+  }
+
+  if (IS_DATA_SEGMENT_EXPAND_DOWN(descriptor->type))
+    return 0;
+
+  if (IS_DATA_SEGMENT_WRITEABLE(descriptor->type))
+    return SegAccessROK | SegAccessWOK | SegAccessROK4G | SegAccessWOK4G;
+
+  return SegAccessROK | SegAccessROK4G;
+}
+
   void BX_CPP_AttrRegparmN(2)
 BX_CPU_C::load_seg_reg(bx_segment_reg_t *seg, Bit16u new_value)
 {
@@ -89,7 +114,7 @@ BX_CPU_C::load_seg_reg(bx_segment_reg_t *seg, Bit16u new_value)
       /* load SS with selector, load SS cache with descriptor */
       BX_CPU_THIS_PTR sregs[BX_SEG_REG_SS].selector    = ss_selector;
       BX_CPU_THIS_PTR sregs[BX_SEG_REG_SS].cache       = descriptor;
-      BX_CPU_THIS_PTR sregs[BX_SEG_REG_SS].cache.valid = SegValidCache;
+      BX_CPU_THIS_PTR sregs[BX_SEG_REG_SS].cache.valid = SegValidCache | segment_access_flags(&descriptor);
 
       invalidate_stack_cache();
 
@@ -150,7 +175,7 @@ BX_CPU_C::load_seg_reg(bx_segment_reg_t *seg, Bit16u new_value)
       /* load segment register-cache with descriptor */
       seg->selector    = selector;
       seg->cache       = descriptor;
-      seg->cache.valid = SegValidCache;
+      seg->cache.valid = SegValidCache | segment_access_flags(&descriptor);
 
       return;
     }
@@ -532,7 +557,7 @@ BX_CPU_C::load_ss(bx_selector_t *selector, bx_descriptor_t *descriptor, Bit8u cp
   BX_CPU_THIS_PTR sregs[BX_SEG_REG_SS].selector = *selector;
   BX_CPU_THIS_PTR sregs[BX_SEG_REG_SS].cache = *descriptor;
   BX_CPU_THIS_PTR sregs[BX_SEG_REG_SS].selector.rpl = cpl;
-  BX_CPU_THIS_PTR sregs[BX_SEG_REG_SS].cache.valid = SegValidCache;
+  BX_CPU_THIS_PTR sregs[BX_SEG_REG_SS].cache.valid = SegValidCache | segment_access_flags(descriptor);
 
   invalidate_stack_cache();
 }
@@ -292,9 +292,13 @@ BX_CPP_INLINE Bit32u xmm_pcmpleuq_mask(const BxPackedXmmRegister *op1, const BxP
 
 BX_CPP_INLINE void xmm_pcmpgtb(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_cmpgt_epi8(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<16; n++) {
     op1->xmmubyte(n) = (op1->xmmsbyte(n) > op2->xmmsbyte(n)) ? 0xff : 0;
   }
+#endif
 }
 
 BX_CPP_INLINE Bit32u xmm_pcmpgtb_mask(const BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
@@ -308,9 +312,13 @@ BX_CPP_INLINE Bit32u xmm_pcmpgtb_mask(const BxPackedXmmRegister *op1, const BxPa
 
 BX_CPP_INLINE void xmm_pcmpgtw(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_cmpgt_epi16(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<8; n++) {
     op1->xmm16u(n) = (op1->xmm16s(n) > op2->xmm16s(n)) ? 0xffff : 0;
   }
+#endif
 }
 
 BX_CPP_INLINE Bit32u xmm_pcmpgtw_mask(const BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
@@ -324,9 +332,13 @@ BX_CPP_INLINE Bit32u xmm_pcmpgtw_mask(const BxPackedXmmRegister *op1, const BxPa
 
 BX_CPP_INLINE void xmm_pcmpgtd(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_cmpgt_epi32(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<4; n++) {
     op1->xmm32u(n) = (op1->xmm32s(n) > op2->xmm32s(n)) ? 0xffffffff : 0;
   }
+#endif
 }
 
 BX_CPP_INLINE Bit32u xmm_pcmpgtd_mask(const BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
@@ -556,9 +568,13 @@ BX_CPP_INLINE Bit32u xmm_pcmpgeuq_mask(const BxPackedXmmRegister *op1, const BxP
 
 BX_CPP_INLINE void xmm_pcmpeqb(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_cmpeq_epi8(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<16; n++) {
     op1->xmmubyte(n) = (op1->xmmubyte(n) == op2->xmmubyte(n)) ? 0xff : 0;
   }
+#endif
 }
 
 BX_CPP_INLINE Bit32u xmm_pcmpeqb_mask(const BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
@@ -572,9 +588,13 @@ BX_CPP_INLINE Bit32u xmm_pcmpeqb_mask(const BxPackedXmmRegister *op1, const BxPa
 
 BX_CPP_INLINE void xmm_pcmpeqw(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_cmpeq_epi16(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<8; n++) {
     op1->xmm16u(n) = (op1->xmm16u(n) == op2->xmm16u(n)) ? 0xffff : 0;
   }
+#endif
 }
 
 BX_CPP_INLINE Bit32u xmm_pcmpeqw_mask(const BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
@@ -588,9 +608,13 @@ BX_CPP_INLINE Bit32u xmm_pcmpeqw_mask(const BxPackedXmmRegister *op1, const BxPa
 
 BX_CPP_INLINE void xmm_pcmpeqd(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_cmpeq_epi32(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<4; n++) {
     op1->xmm32u(n) = (op1->xmm32u(n) == op2->xmm32u(n)) ? 0xffffffff : 0;
   }
+#endif
 }
 
 BX_CPP_INLINE Bit32u xmm_pcmpeqd_mask(const BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
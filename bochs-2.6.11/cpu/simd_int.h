@@ -65,16 +65,24 @@ BX_CPP_INLINE void xmm_pminsb(BxPackedXmmRegister *op1, const BxPackedXmmRegiste
 
 BX_CPP_INLINE void xmm_pminub(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_min_epu8(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<16; n++) {
     if(op2->xmmubyte(n) < op1->xmmubyte(n)) op1->xmmubyte(n) = op2->xmmubyte(n);
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_pminsw(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_min_epi16(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<8; n++) {
     if(op2->xmm16s(n) < op1->xmm16s(n)) op1->xmm16s(n) = op2->xmm16s(n);
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_pminuw(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
@@ -121,16 +129,24 @@ BX_CPP_INLINE void xmm_pmaxsb(BxPackedXmmRegister *op1, const BxPackedXmmRegiste
 
 BX_CPP_INLINE void xmm_pmaxub(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_max_epu8(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<16; n++) {
     if(op2->xmmubyte(n) > op1->xmmubyte(n)) op1->xmmubyte(n) = op2->xmmubyte(n);
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_pmaxsw(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_max_epi16(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<8; n++) {
     if(op2->xmm16s(n) > op1->xmm16s(n)) op1->xmm16s(n) = op2->xmm16s(n);
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_pmaxuw(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
@@ -334,8 +350,39 @@ BX_CPP_INLINE void xmm_packssdw(BxPackedXmmRegister *op1, const BxPackedXmmRegis
 
 // shuffle
 
+#if BX_HOST_SSE2 && defined(BX_HOST_SSSE3)
+#if BX_HOST_SSSE3 == 2
+__attribute__((target("ssse3")))
+#endif
+BX_CPP_INLINE void xmm_pshufb_host(BxPackedXmmRegister *r, const BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
+{
+  xmm_host_store(r, _mm_shuffle_epi8(xmm_host_load(op1), xmm_host_load(op2)));
+}
+
+#if BX_HOST_SSSE3 == 2
+BX_CPP_INLINE bx_bool host_has_ssse3(void)
+{
+  static int ssse3 = -1;
+  if (ssse3 < 0) {
+    __builtin_cpu_init();
+    ssse3 = __builtin_cpu_supports("ssse3") ? 1 : 0;
+  }
+  return ssse3;
+}
+#else
+#define host_has_ssse3() 1
+#endif
+#endif
+
 BX_CPP_INLINE void xmm_pshufb(BxPackedXmmRegister *r, const BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2 && defined(BX_HOST_SSSE3)
+  if (host_has_ssse3()) {
+    xmm_pshufb_host(r, op1, op2);
+    return;
+  }
+#endif
+
   for(unsigned n=0; n<16; n++)
   {
     unsigned mask = op2->xmmubyte(n);
@@ -454,6 +501,9 @@ BX_CPP_INLINE void xmm_psignd(BxPackedXmmRegister *op1, const BxPackedXmmRegiste
 
 BX_CPP_INLINE Bit32u xmm_pmovmskb(const BxPackedXmmRegister *op)
 {
+#if BX_HOST_SSE2
+  return (Bit32u) _mm_movemask_epi8(xmm_host_load(op));
+#else
   Bit32u mask = 0;
 
   if(op->xmmsbyte(0x0) < 0) mask |= 0x0001;
@@ -474,6 +524,7 @@ BX_CPP_INLINE Bit32u xmm_pmovmskb(const BxPackedXmmRegister *op)
   if(op->xmmsbyte(0xF) < 0) mask |= 0x8000;
 
   return mask;
+#endif
 }
 
 BX_CPP_INLINE Bit32u xmm_pmovmskw(const BxPackedXmmRegister *op)
@@ -702,132 +753,207 @@ BX_CPP_INLINE void xmm_blendvpd(BxPackedXmmRegister *op1, const BxPackedXmmRegis
 
 BX_CPP_INLINE void xmm_andps(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_and_si128(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for (unsigned n=0; n < 2; n++)
     op1->xmm64u(n) &= op2->xmm64u(n);
+#endif
 }
 
 BX_CPP_INLINE void xmm_andnps(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_andnot_si128(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for (unsigned n=0; n < 2; n++)
     op1->xmm64u(n) = ~(op1->xmm64u(n)) & op2->xmm64u(n);
+#endif
 }
 
 BX_CPP_INLINE void xmm_orps(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_or_si128(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for (unsigned n=0; n < 2; n++)
     op1->xmm64u(n) |= op2->xmm64u(n);
+#endif
 }
 
 BX_CPP_INLINE void xmm_xorps(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_xor_si128(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for (unsigned n=0; n < 2; n++)
     op1->xmm64u(n) ^= op2->xmm64u(n);
+#endif
 }
 
 // arithmetic (add/sub)
 
 BX_CPP_INLINE void xmm_paddb(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_add_epi8(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<16; n++) {
     op1->xmmubyte(n) += op2->xmmubyte(n);
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_paddw(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_add_epi16(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<8; n++) {
     op1->xmm16u(n) += op2->xmm16u(n);
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_paddd(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_add_epi32(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<4; n++) {
     op1->xmm32u(n) += op2->xmm32u(n);
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_paddq(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_add_epi64(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<2; n++) {
     op1->xmm64u(n) += op2->xmm64u(n);
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_psubb(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_sub_epi8(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<16; n++) {
     op1->xmmubyte(n) -= op2->xmmubyte(n);
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_psubw(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_sub_epi16(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<8; n++) {
     op1->xmm16u(n) -= op2->xmm16u(n);
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_psubd(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_sub_epi32(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<4; n++) {
     op1->xmm32u(n) -= op2->xmm32u(n);
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_psubq(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_sub_epi64(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<2; n++) {
     op1->xmm64u(n) -= op2->xmm64u(n);
   }
+#endif
 }
 
 // arithmetic (add/sub with saturation)
 
 BX_CPP_INLINE void xmm_paddsb(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_adds_epi8(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<16; n++) {
     op1->xmmsbyte(n) = SaturateWordSToByteS(Bit16s(op1->xmmsbyte(n)) + Bit16s(op2->xmmsbyte(n)));
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_paddsw(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_adds_epi16(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<8; n++) {
     op1->xmm16s(n) = SaturateDwordSToWordS(Bit32s(op1->xmm16s(n)) + Bit32s(op2->xmm16s(n)));
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_paddusb(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_adds_epu8(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<16; n++) {
     op1->xmmubyte(n) = SaturateWordSToByteU(Bit16s(op1->xmmubyte(n)) + Bit16s(op2->xmmubyte(n)));
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_paddusw(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_adds_epu16(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<8; n++) {
     op1->xmm16u(n) = SaturateDwordSToWordU(Bit32s(op1->xmm16u(n)) + Bit32s(op2->xmm16u(n)));
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_psubsb(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_subs_epi8(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<16; n++) {
     op1->xmmsbyte(n) = SaturateWordSToByteS(Bit16s(op1->xmmsbyte(n)) - Bit16s(op2->xmmsbyte(n)));
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_psubsw(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_subs_epi16(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<8; n++) {
     op1->xmm16s(n) = SaturateDwordSToWordS(Bit32s(op1->xmm16s(n)) - Bit32s(op2->xmm16s(n)));
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_psubusb(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_subs_epu8(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<16; n++)
   {
     if(op1->xmmubyte(n) > op2->xmmubyte(n))
@@ -835,10 +961,14 @@ BX_CPP_INLINE void xmm_psubusb(BxPackedXmmRegister *op1, const BxPackedXmmRegist
     else
       op1->xmmubyte(n) = 0;
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_psubusw(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_subs_epu16(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<8; n++)
   {
     if(op1->xmm16u(n) > op2->xmm16u(n))
@@ -846,6 +976,7 @@ BX_CPP_INLINE void xmm_psubusw(BxPackedXmmRegister *op1, const BxPackedXmmRegist
     else
       op1->xmm16u(n) = 0;
   }
+#endif
 }
 
 // arithmetic (horizontal add/sub)
@@ -922,16 +1053,24 @@ BX_CPP_INLINE void xmm_phsubsw(BxPackedXmmRegister *op1, const BxPackedXmmRegist
 
 BX_CPP_INLINE void xmm_pavgb(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_avg_epu8(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<16; n++) {
     op1->xmmubyte(n) = (op1->xmmubyte(n) + op2->xmmubyte(n) + 1) >> 1;
   }
+#endif
 }
 
 BX_CPP_INLINE void xmm_pavgw(BxPackedXmmRegister *op1, const BxPackedXmmRegister *op2)
 {
+#if BX_HOST_SSE2
+  xmm_host_store(op1, _mm_avg_epu16(xmm_host_load(op1), xmm_host_load(op2)));
+#else
   for(unsigned n=0; n<8; n++) {
     op1->xmm16u(n) = (op1->xmm16u(n) + op2->xmm16u(n) + 1) >> 1;
   }
+#endif
 }
 
 // multiply
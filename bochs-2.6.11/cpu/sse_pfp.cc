@@ -50,6 +50,9 @@ void BX_CPU_C::check_exceptionsSSE(int exceptions_flags)
   }
 }
 
+// set from the cpu 'fast_fp' option
+bx_bool bx_sse_host_fast_fp = 0;
+
 float_status_t mxcsr_to_softfloat_status_word(bx_mxcsr_t mxcsr)
 {
   float_status_t status;
@@ -63,6 +66,7 @@ float_status_t mxcsr_to_softfloat_status_word(bx_mxcsr_t mxcsr)
   status.float_exception_masks = mxcsr.get_exceptions_masks();
   status.float_suppress_exception = 0;
   status.denormals_are_zeros = mxcsr.get_DAZ();
+  status.host_fast_path = bx_sse_host_fast_fp;
 
   return status;
 }
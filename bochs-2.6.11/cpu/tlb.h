@@ -175,15 +175,37 @@ struct bx_TLB_entry
   BX_CPP_INLINE Bit32u get_memtype() const { return MEMTYPE(memtype); }
 };
 
-template <unsigned size>
+// The TLB is direct mapped. With spaces > 1 it keeps one bank of entries
+// for each of the last used address spaces, tagged with their CR3 value,
+// so switching between a few processes doesn't throw the translations of
+// the others away. All lookups go to the bank of the current address space.
+// A guest without PCID relies on the CR3 write to drop translations it has
+// changed meanwhile, so the paging structure entries behind the TLB entries
+// are write protected through pageWriteStampTable. When one of them is
+// written the inactive banks are flushed, and the current bank is not kept
+// once its address space is left (see BX_CPU_C::TLB_flushInactive).
+template <unsigned size, unsigned spaces = 1>
 struct TLB {
-  bx_TLB_entry entry[size];
+  bx_TLB_entry entry[size * spaces];
+  bx_TLB_entry *bank;       // entries of the current address space
+  unsigned current;         // index of the current bank
+  bx_address tag[spaces];   // CR3 value of each bank
+  Bit32u last_use[spaces];
+  Bit32u use_counter;
+  bx_bool inactive_valid;   // other banks might hold valid entries
+  bx_bool current_written;  // paging structures written since switching to current
 #if BX_CPU_LEVEL >= 5
   bx_bool split_large;
 #endif
 
 public:
-  TLB() { flush(); }
+  TLB(): bank(entry), current(0), use_counter(0), inactive_valid(0), current_written(0) {
+    for (unsigned n=0; n < spaces; n++) {
+      tag[n] = BX_INVALID_TLB_ENTRY;
+      last_use[n] = 0;
+    }
+    flush();
+  }
 
   BX_CPP_INLINE unsigned get_index_of(bx_address lpf, unsigned len = 0)
   {
@@ -193,25 +215,78 @@ public:
 
   BX_CPP_INLINE bx_TLB_entry *get_entry_of(bx_address lpf, unsigned len = 0)
   {
-    return &entry[get_index_of(lpf, len)];
+    return &bank[get_index_of(lpf, len)];
   }
 
   BX_CPP_INLINE void flush(void)
   {
-    for (unsigned n=0; n < size; n++)
+    for (unsigned n=0; n < size * spaces; n++)
       entry[n].invalidate();
 
+    inactive_valid = 0;
 #if BX_CPU_LEVEL >= 5
     split_large = false;  // flushing whole TLB
 #endif
   }
 
+  // drop the entries of all but the current address space
+  BX_CPP_INLINE void flushInactive(void)
+  {
+    current_written = 1;
+    if (! inactive_valid) return;
+
+    for (unsigned n=0; n < size * spaces; n++) {
+      if (n / size != current)
+        entry[n].invalidate();
+    }
+    inactive_valid = 0;
+  }
+
+  // CR3 was written: make the bank tagged with 'cr3' current, or recycle the
+  // least recently used one. Rewriting the current CR3 flushes its bank.
+  BX_CPP_INLINE void switch_space(bx_address cr3, bx_bool keep_global)
+  {
+    unsigned n = current, victim = 0;
+
+    if (tag[current] != cr3) {
+      last_use[current] = ++use_counter;
+      // without INVLPG the guest expects this CR3 write to drop what it
+      // changed, so never come back to the bank and recycle it first
+      if (current_written) {
+        tag[current] = BX_INVALID_TLB_ENTRY;
+        last_use[current] = 0;
+      }
+      current_written = 0;
+      inactive_valid = 1;
+      for (n=0; n < spaces; n++) {
+        if (tag[n] == cr3) {
+          current = n;
+          bank = &entry[n * size];
+          return;
+        }
+        if (last_use[n] < last_use[victim]) victim = n;
+      }
+      n = victim;
+      tag[n] = cr3;
+      current = n;
+      bank = &entry[n * size];
+    }
+    else {
+      current_written = 0;
+    }
+
+    for (unsigned i=0; i < size; i++) {
+      if (! keep_global || !(bank[i].accessBits & TLB_GlobalPage))
+        bank[i].invalidate();
+    }
+  }
+
 #if BX_CPU_LEVEL >= 6
   BX_CPP_INLINE void flushNonGlobal(void)
   {
     Bit32u lpf_mask = 0;
 
-    for (unsigned n=0; n<size; n++) {
+    for (unsigned n=0; n<size * spaces; n++) {
       bx_TLB_entry *tlbEntry = &entry[n];
       if (tlbEntry->valid()) {
         if (!(tlbEntry->accessBits & TLB_GlobalPage))
@@ -232,7 +307,7 @@ public:
       Bit32u lpf_mask = 0;
 
       // make sure INVLPG handles correctly large pages
-      for (unsigned n=0; n<size; n++) {
+      for (unsigned n=0; n<size * spaces; n++) {
         bx_TLB_entry *tlbEntry = &entry[n];
         if (tlbEntry->valid()) {
           bx_address entry_lpf_mask = tlbEntry->lpf_mask;
@@ -250,9 +325,13 @@ public:
     else
 #endif
     {
-      bx_TLB_entry *tlbEntry = get_entry_of(laddr);
-      if (LPFOf(tlbEntry->lpf) == LPFOf(laddr))
-        tlbEntry->invalidate();
+      // the page might be cached for any of the address spaces
+      unsigned index = get_index_of(laddr);
+      for (unsigned n=0; n < spaces; n++) {
+        bx_TLB_entry *tlbEntry = &entry[n * size + index];
+        if (LPFOf(tlbEntry->lpf) == LPFOf(laddr))
+          tlbEntry->invalidate();
+      }
     }
   }
 };
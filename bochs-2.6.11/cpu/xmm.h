@@ -63,6 +63,34 @@ union bx_xmm_reg_t {
 #define xmm64u(i)   xmm_u64[(i)]
 #endif
 
+// Little endian x86 hosts have the same lane layout as the guest, so the
+// most common packed integer helpers can use host SSE2 directly. SSE2 is
+// always present on x86-64; PSHUFB needs SSSE3 and is selected at runtime.
+#if defined(BX_LITTLE_ENDIAN) && defined(__SSE2__)
+#define BX_HOST_SSE2 1
+#include <emmintrin.h>
+
+BX_CPP_INLINE __m128i xmm_host_load(const BxPackedXmmRegister *op)
+{
+  return _mm_loadu_si128((const __m128i *) op);
+}
+
+BX_CPP_INLINE void xmm_host_store(BxPackedXmmRegister *op, __m128i val)
+{
+  _mm_storeu_si128((__m128i *) op, val);
+}
+
+#if defined(__SSSE3__)
+#define BX_HOST_SSSE3 1
+#include <tmmintrin.h>
+#elif defined(__GNUC__) && (defined(__clang__) || (__GNUC__ >= 5))
+#define BX_HOST_SSSE3 2 // compiled for SSSE3 on demand, checked at runtime
+#include <tmmintrin.h>
+#endif
+#else
+#define BX_HOST_SSE2 0
+#endif
+
 /* AVX REGISTER */
 
 typedef
@@ -64,7 +64,13 @@ static int hex(char ch)
   return(-1);
 }
 
+// largest packet payload accepted from gdb, advertised with qSupported;
+// big enough for a whole page in one 'm' reply or binary 'X' write
+#define GDBSTUB_PACKET_SIZE (2 * 4096 + 64)
+
 static char buf[4096], *bufptr = buf;
+static char inbuf[4096];
+static int inbuf_pos = 0, inbuf_len = 0;
 
 static void flush_debug_buffer()
 {
@@ -89,11 +95,14 @@ static void put_debug_char(char ch)
 
 static char get_debug_char(void)
 {
-  char ch;
-
-  recv(socket_fd, &ch, 1, 0);
+  if (inbuf_pos == inbuf_len) {
+    inbuf_pos = inbuf_len = 0;
+    int n = recv(socket_fd, inbuf, sizeof inbuf, 0);
+    if (n <= 0) return(0);
+    inbuf_len = n;
+  }
 
-  return(ch);
+  return(inbuf[inbuf_pos++]);
 }
 
 static const char hexchars[]="0123456789abcdef";
@@ -125,7 +134,8 @@ static void put_reply(const char* buffer)
   } while (get_debug_char() != '+');
 }
 
-static void get_command(char* buffer)
+// returns the payload length, binary 'X' data may contain NUL bytes
+static int get_command(char* buffer)
 {
   unsigned char checksum;
   unsigned char xmitcsum;
@@ -145,8 +155,11 @@ static void get_command(char* buffer)
       ch = get_debug_char();
       if (ch == '#') break;
       checksum = checksum + ch;
-      buffer[count] = ch;
-      count++;
+      if (count < GDBSTUB_PACKET_SIZE)
+      {
+        buffer[count] = ch;
+        count++;
+      }
     }
     buffer[count] = 0;
 
@@ -172,15 +185,17 @@ static void get_command(char* buffer)
       {
         put_debug_char(buffer[0]);
         put_debug_char(buffer[1]);
-        count = strlen(buffer);
         for (i = 3; i <= count; i++)
         {
           buffer[i - 3] = buffer[i];
         }
+        count -= 3;
       }
       flush_debug_buffer();
     }
   } while (checksum != xmitcsum);
+
+  return(count);
 }
 
 void hex2mem(char* buf, unsigned char* mem, int count)
@@ -195,6 +210,21 @@ void hex2mem(char* buf, unsigned char* mem, int count)
   }
 }
 
+// decode the binary data of an 'X' packet, '}' escapes the next byte
+static int bin2mem(const char* buf, int count, Bit8u* mem)
+{
+  int n = 0;
+
+  for (int i = 0; i < count; i++)
+  {
+    if (buf[i] == 0x7d && (i + 1) < count)
+      mem[n++] = buf[++i] ^ 0x20;
+    else
+      mem[n++] = buf[i];
+  }
+  return(n);
+}
+
 char* mem2hex(const Bit8u* mem, char* buf, int count)
 {
   for (int i = 0; i<count; i++)
@@ -245,6 +275,12 @@ static Bit32u registers[NUMREGS];
 static Bit64u breakpoints[MAX_BREAKPOINTS] = {0,};
 static unsigned nr_breakpoints = 0;
 
+// number of breakpoints per hashed page, lets bx_gdbstub_check() skip
+// the breakpoint list for code pages without any breakpoint
+#define BP_PAGE_BUCKETS (1024)
+static Bit8u bp_page_count[BP_PAGE_BUCKETS] = {0,};
+#define BP_PAGE_OF(addr) ((unsigned)((addr) >> 12) & (BP_PAGE_BUCKETS - 1))
+
 static int stub_trace_flag = 0;
 static int instr_count = 0;
 static int saved_eip = 0;
@@ -263,7 +299,7 @@ int bx_gdbstub_check(unsigned int eip)
 #if defined(__CYGWIN__) || defined(__MINGW32__) || defined(_MSC_VER)
   fd_set fds;
   struct timeval tv = {0, 0};
-#else
+#elif !defined(MSG_DONTWAIT)
   long arg;
 #endif
 
@@ -278,20 +314,30 @@ int bx_gdbstub_check(unsigned int eip)
 
   if ((instr_count % 500) == 0)
   {
-#if defined(__CYGWIN__) || defined(__MINGW32__) || defined(_MSC_VER)
-    FD_ZERO(&fds);
-    FD_SET(socket_fd, &fds);
-    r = select(socket_fd + 1, &fds, NULL, NULL, &tv);
-    if (r == 1)
+    if (inbuf_pos != inbuf_len)
     {
-      r = recv(socket_fd, (char *)&ch, 1, 0);
+      ch = inbuf[inbuf_pos++];
+      r = 1;
     }
+    else
+    {
+#if defined(__CYGWIN__) || defined(__MINGW32__) || defined(_MSC_VER)
+      FD_ZERO(&fds);
+      FD_SET(socket_fd, &fds);
+      r = select(socket_fd + 1, &fds, NULL, NULL, &tv);
+      if (r == 1)
+      {
+        r = recv(socket_fd, (char *)&ch, 1, 0);
+      }
+#elif defined(MSG_DONTWAIT)
+      r = recv(socket_fd, &ch, 1, MSG_DONTWAIT);
 #else
-    arg = fcntl(socket_fd, F_GETFL);
-    fcntl(socket_fd, F_SETFL, arg | O_NONBLOCK);
-    r = recv(socket_fd, &ch, 1, 0);
-    fcntl(socket_fd, F_SETFL, arg);
+      arg = fcntl(socket_fd, F_GETFL);
+      fcntl(socket_fd, F_SETFL, arg | O_NONBLOCK);
+      r = recv(socket_fd, &ch, 1, 0);
+      fcntl(socket_fd, F_SETFL, arg);
 #endif
+    }
     if (r == 1)
     {
       BX_INFO(("Got byte %x", (unsigned int)ch));
@@ -300,13 +346,16 @@ int bx_gdbstub_check(unsigned int eip)
     }
   }
 
-  for (i = 0; i < nr_breakpoints; i++)
+  if (bp_page_count[BP_PAGE_OF(eip)] != 0)
   {
-    if (eip == breakpoints[i])
+    for (i = 0; i < nr_breakpoints; i++)
     {
-      BX_INFO(("found breakpoint at %x", eip));
-      last_stop_reason = GDBSTUB_EXECUTION_BREAKPOINT;
-      return GDBSTUB_EXECUTION_BREAKPOINT;
+      if (eip == breakpoints[i])
+      {
+        BX_INFO(("found breakpoint at %x", eip));
+        last_stop_reason = GDBSTUB_EXECUTION_BREAKPOINT;
+        return GDBSTUB_EXECUTION_BREAKPOINT;
+      }
     }
   }
 
@@ -332,6 +381,7 @@ static int remove_breakpoint(Bit64u addr, int len)
     {
       BX_INFO(("Removing breakpoint at " FMT_ADDRX64, addr));
       breakpoints[i] = 0;
+      bp_page_count[BP_PAGE_OF(addr)]--;
       return(1);
     }
   }
@@ -349,6 +399,7 @@ static void insert_breakpoint(Bit64u addr)
     if (breakpoints[i] == 0)
     {
       breakpoints[i] = addr;
+      bp_page_count[BP_PAGE_OF(addr)]++;
       if (i >= nr_breakpoints)
       {
         nr_breakpoints = i + 1;
@@ -409,7 +460,7 @@ static int access_linear(Bit64u laddress,
                           data);
     if (!valid) return(0);
 
-    valid = access_linear(laddress,
+    valid = access_linear(laddress + (4096 - (laddress & 0xfff)),
                           len + (laddress & 0xfff) - 4096,
                           rw,
                           (Bit8u *)(data + (4096 - (laddress & 0xfff))));
@@ -428,17 +479,33 @@ static int access_linear(Bit64u laddress,
   return(valid);
 }
 
+// qXfer:memory-map:read, the whole linear address space is plain RAM
+// so gdb uses 'm'/'X' for everything and never asks about flash
+static const char memory_map_xml[] =
+  "<?xml version=\"1.0\"?>"
+  "<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\" "
+  "\"http://sourceware.org/gdb/gdb-memory-map.dtd\">"
+  "<memory-map>"
+#if BX_SUPPORT_X86_64
+  "<memory type=\"ram\" start=\"0x0\" length=\"0x800000000000\"/>"
+  "<memory type=\"ram\" start=\"0xffff800000000000\" length=\"0x800000000000\"/>"
+#else
+  "<memory type=\"ram\" start=\"0x0\" length=\"0x100000000\"/>"
+#endif
+  "</memory-map>";
+
 static void debug_loop(void)
 {
-  char buffer[255];
-  char obuf[1024];
+  static char buffer[GDBSTUB_PACKET_SIZE + 1];
+  static char obuf[GDBSTUB_PACKET_SIZE + 1];
+  static Bit8u mem[GDBSTUB_PACKET_SIZE / 2];
   int ne = 0;
-  Bit8u mem[255];
+  int count;
 
   while (ne == 0)
   {
     SIM->get_param_bool(BXPN_MOUSE_ENABLED)->set(0);
-    get_command(buffer);
+    count = get_command(buffer);
     BX_DEBUG(("get_buffer '%s'", buffer));
 
     // At a minimum, a stub is required to support the g and G commands for register access,
@@ -529,11 +596,15 @@ static void debug_loop(void)
       // each byte is transmitted as a two-digit hexadecimal number.
       case 'M':
       {
-        unsigned char mem[255];
         char* ebuf;
 
         Bit64u addr = strtoull(&buffer[1], &ebuf, 16);
         int len = strtoul(ebuf + 1, &ebuf, 16);
+        if (len > (int) sizeof(mem))
+        {
+          put_reply("E01");
+          break;
+        }
         hex2mem(ebuf + 1, mem, len);
 
         if (len == 1 && mem[0] == 0xcc)
@@ -576,14 +647,52 @@ static void debug_loop(void)
 
         addr = strtoull(&buffer[1], &ebuf, 16);
         len = strtoul(ebuf + 1, NULL, 16);
-        BX_INFO(("addr " FMT_ADDRX64 " len %x", addr, len));
+        BX_DEBUG(("addr " FMT_ADDRX64 " len %x", addr, len));
 
-        access_linear(addr, len, BX_READ, mem);
+        // whole pages go through dbg_fetch_mem() in one call each
+        if (len > (int) sizeof(mem))
+          len = sizeof(mem);
+        if (! access_linear(addr, len, BX_READ, mem))
+        {
+          put_reply("Eff");
+          break;
+        }
         mem2hex(mem, obuf, len);
         put_reply(obuf);
         break;
       }
 
+      // X addr,length:XX...
+      // Write length bytes of memory starting at address addr. XX... is binary
+      // data, with '#', '$' and '}' escaped by '}' and xor 0x20.
+      case 'X':
+      {
+        char* ebuf;
+
+        Bit64u addr = strtoull(&buffer[1], &ebuf, 16);
+        int len = strtoul(ebuf + 1, &ebuf, 16);
+        if (*ebuf != ':' || len > (int) sizeof(mem))
+        {
+          put_reply("E01");
+          break;
+        }
+        ebuf++;
+        if (bin2mem(ebuf, count - (int)(ebuf - buffer), mem) != len)
+        {
+          put_reply("E01");
+          break;
+        }
+        if (len == 0 || access_linear(addr, len, BX_WRITE, mem))
+        {
+          put_reply("OK");
+        }
+        else
+        {
+          put_reply("Eff");
+        }
+        break;
+      }
+
       // P n...=r...
       // Write register n... with value r... The register number n is in hexadecimal,
       // and r... contains two hex digits for each byte in the register (target byte order).
@@ -780,7 +889,29 @@ static void debug_loop(void)
         }
         else if (strncmp(&buffer[1], "Supported", strlen("Supported")) == 0)
         {
-          put_reply("");
+          sprintf(obuf, "PacketSize=%x;qXfer:memory-map:read+", GDBSTUB_PACKET_SIZE);
+          put_reply(obuf);
+        }
+        else if (strncmp(&buffer[1], "Xfer:memory-map:read::", strlen("Xfer:memory-map:read::")) == 0)
+        {
+          // qXfer:memory-map:read::offset,length
+          char* ebuf;
+          unsigned long offset = strtoul(&buffer[1 + strlen("Xfer:memory-map:read::")], &ebuf, 16);
+          unsigned long len = strtoul(ebuf + 1, NULL, 16);
+          unsigned long size = strlen(memory_map_xml);
+          if (offset >= size)
+          {
+            put_reply("l");
+          }
+          else
+          {
+            if (len > size - offset) len = size - offset;
+            if (len > GDBSTUB_PACKET_SIZE - 1) len = GDBSTUB_PACKET_SIZE - 1;
+            obuf[0] = (offset + len < size) ? 'm' : 'l';
+            memcpy(&obuf[1], memory_map_xml + offset, len);
+            obuf[len + 1] = 0;
+            put_reply(obuf);
+          }
         }
         else
         {
@@ -2663,6 +2663,7 @@ void DelWatchpoint(bx_watchpoint *wp_array, unsigned *TotEntries, int i)
     while (++i < (int) *TotEntries)
         wp_array[i-1] = wp_array[i];
     -- *TotEntries;
+    bx_dbg_update_page_filters();
 }
 
 void SetWatchpoint(unsigned *num_watchpoints, bx_watchpoint *watchpoint)
@@ -2695,6 +2696,7 @@ void SetWatchpoint(unsigned *num_watchpoints, bx_watchpoint *watchpoint)
             watchpoint[*num_watchpoints].len  = 1;
             watchpoint[*num_watchpoints].addr = (bx_phy_address) SelectedDataAddress;
             ++(*num_watchpoints);
+            bx_dbg_update_page_filters();
         }
     }
     Invalidate(DUMP_WND);   // redraw the MemDump window -- colors may have changed
@@ -146,6 +146,9 @@ bx_gui_c::bx_gui_c(void): disp_mode(DISP_MODE_SIM)
   snapshot_mode = 0;
   snapshot_buffer = NULL;
   memset(palette, 0, sizeof(palette));
+  display_thread = 0;
+  lock_depth = 0;
+  BX_INIT_MUTEX(display_mutex);
 }
 
 bx_gui_c::~bx_gui_c()
@@ -158,6 +161,7 @@ bx_gui_c::~bx_gui_c()
     console_cleanup();
   }
 #endif
+  BX_FINI_MUTEX(display_mutex);
 }
 
 void bx_gui_c::init(int argc, char **argv, unsigned max_xres, unsigned max_yres,
@@ -452,6 +456,51 @@ void bx_gui_c::make_text_snapshot(char **snapshot, Bit32u *length)
   *length = txt_addr;
 }
 
+void bx_gui_c::dump_text_screen(FILE *fp)
+{
+  char *text_snapshot;
+  Bit32u len;
+
+  make_text_snapshot(&text_snapshot, &len);
+  fwrite(text_snapshot, 1, len, fp);
+  fflush(fp);
+  delete [] text_snapshot;
+}
+
+// Returns the number of lines the text screen scrolled up since the last
+// update (0 if it didn't). In that case old_text is moved the same way, so
+// that the caller only redraws the lines that really changed after moving
+// the pixels on its side.
+unsigned bx_gui_c::text_scroll_check(Bit8u *old_text, Bit8u *new_text,
+                                     unsigned rows, unsigned cols, unsigned line_offset)
+{
+  unsigned n, y, matches, best = 0, best_matches = 0, bytes = cols * 2;
+
+  if (rows < 2) return 0;
+  for (y = 0; y < rows; y++) {
+    if (!memcmp(&new_text[y * line_offset], &old_text[y * line_offset], bytes))
+      best_matches++;
+  }
+  for (n = 1; n < rows; n++) {
+    // the top line of the new screen must come from old line n
+    if (memcmp(new_text, &old_text[n * line_offset], bytes))
+      continue;
+    matches = 0;
+    for (y = 0; y < (rows - n); y++) {
+      if (!memcmp(&new_text[y * line_offset], &old_text[(y + n) * line_offset], bytes))
+        matches++;
+    }
+    if (matches > best_matches) {
+      best = n;
+      best_matches = matches;
+    }
+  }
+  if (best > 0) {
+    memmove(old_text, &old_text[best * line_offset], (rows - best) * line_offset);
+  }
+  return best;
+}
+
 Bit32u bx_gui_c::set_snapshot_mode(bx_bool mode)
 {
   unsigned pixel_bytes, bufsize;
@@ -760,6 +809,10 @@ void bx_gui_c::save_restore_handler(void)
                             "Save Bochs state to folder...", "none",
                             bx_param_string_c::SELECT_FOLDER_DLG);
     if ((ret >= 0) && (strcmp(sr_path, "none"))) {
+#if BX_LARGE_RAMFILE
+      // blocks being written back must be in the memory overflow file
+      BX_MEM(0)->ramfile_sync(0);
+#endif
       if (SIM->save_state(sr_path)) {
         if (!SIM->ask_yes_no("WARNING",
               "The state of cpu, memory, devices and hard drive images is saved now.\n"
@@ -889,13 +942,17 @@ void bx_gui_c::unregister_statusitem(int id)
 void bx_gui_c::statusbar_setitem(int element, bx_bool active, bx_bool w)
 {
   if (element < 0) {
+    lock();
     for (unsigned i = 0; i < statusitem_count; i++) {
       statusbar_setitem_specific(i, 0, 0);
     }
+    unlock();
   } else if ((unsigned)element < statusitem_count) {
     if ((active != statusitem[element].active) ||
         (w != statusitem[element].mode)) {
+      lock();
       statusbar_setitem_specific(element, active, w);
+      unlock();
       statusitem[element].active = active;
       statusitem[element].mode = w;
     }
@@ -905,6 +962,41 @@ void bx_gui_c::statusbar_setitem(int element, bx_bool active, bx_bool w)
   }
 }
 
+void bx_gui_c::set_display_thread(bx_bool enabled)
+{
+  // the display thread may be stopped from a backend callback
+  if (display_thread && (lock_depth > 0)) {
+    BX_UNLOCK(display_mutex);
+  }
+  lock_depth = 0;
+  display_thread = enabled;
+}
+
+void bx_gui_c::lock(void)
+{
+  if (display_thread && (lock_depth++ == 0)) {
+    BX_LOCK(display_mutex);
+  }
+}
+
+// returns 0 if the display thread is drawing right now
+bx_bool bx_gui_c::trylock(void)
+{
+  if (display_thread) {
+    if ((lock_depth == 0) && !BX_TRYLOCK(display_mutex))
+      return 0;
+    lock_depth++;
+  }
+  return 1;
+}
+
+void bx_gui_c::unlock(void)
+{
+  if (display_thread && (--lock_depth == 0)) {
+    BX_UNLOCK(display_mutex);
+  }
+}
+
 void bx_gui_c::led_timer_handler(void *this_ptr)
 {
   bx_gui_c *class_ptr = (bx_gui_c *) this_ptr;
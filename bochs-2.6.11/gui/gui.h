@@ -18,6 +18,8 @@
 //  License along with this library; if not, write to the Free Software
 //  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
 
+#include "bxthread.h"
+
 // header bar and status bar stuff
 #define BX_HEADER_BAR_Y 32
 
@@ -148,6 +150,8 @@ public:
   virtual void beep_off();
   virtual void get_capabilities(Bit16u *xres, Bit16u *yres, Bit16u *bpp);
   virtual void set_mouse_mode_absxy(bx_bool mode) {}
+  // headless guis don't show anything, the VGA update timer stays off
+  virtual bx_bool headless(void) {return 0;}
 #if BX_USE_GUI_CONSOLE
   virtual void set_console_edit_mode(bx_bool mode) {}
 #endif
@@ -171,7 +175,19 @@ public:
   int register_statusitem(const char *text, bx_bool auto_off=0);
   void unregister_statusitem(int id);
   void statusbar_setitem(int element, bx_bool active, bx_bool w=0);
+  // With the threaded vga display the screen is drawn by a host thread.
+  // The simulation thread holds lock() around its own calls into the
+  // backend that touch the screen, it may nest them. The display thread
+  // draws a frame after display_trylock() succeeded.
+  void set_display_thread(bx_bool enabled);
+  bx_bool has_display_thread(void) {return display_thread;}
+  void lock(void);
+  bx_bool trylock(void);
+  void unlock(void);
+  bx_bool display_trylock(void) {return BX_TRYLOCK(display_mutex);}
+  void display_unlock(void) {BX_UNLOCK(display_mutex);}
   static void init_signal_handlers();
+  static void dump_text_screen(FILE *fp);
   static void toggle_mouse_enable(void);
   bx_bool mouse_toggle_check(Bit32u key, bx_bool pressed);
   const char* get_toggle_info(void);
@@ -212,6 +228,9 @@ protected:
   void headerbar_click(int x);
   // snapshot helper functions
   static void make_text_snapshot(char **snapshot, Bit32u *length);
+  // text mode scroll detection for guis that can move screen areas
+  static unsigned text_scroll_check(Bit8u *old_text, Bit8u *new_text,
+                                    unsigned rows, unsigned cols, unsigned line_offset);
   static Bit32u set_snapshot_mode(bx_bool mode);
   // status bar LED timer
   static void led_timer_handler(void *);
@@ -302,6 +321,10 @@ protected:
   int user_shortcut_len;
   // gui dialog capabilities
   Bit32u dialog_caps;
+  // threaded vga display
+  bx_bool display_thread;
+  unsigned lock_depth;
+  BX_MUTEX(display_mutex);
 #if BX_USE_GUI_CONSOLE
   struct {
     bx_bool present;
@@ -31,10 +31,18 @@
 #if BX_WITH_NOGUI
 #include "icon_bochs.h"
 
+#include <signal.h>
+
 class bx_nogui_gui_c : public bx_gui_c {
 public:
   bx_nogui_gui_c (void) {}
   DECLARE_GUI_VIRTUAL_METHODS()
+  virtual bx_bool headless(void) {return headless_mode;}
+  virtual Bit32u get_sighandler_mask();
+  virtual void sighandler(int sig);
+private:
+  bx_bool headless_mode;
+  volatile bx_bool dump_request;
 };
 
 // declare one instance of the gui object and call macro to insert the
@@ -70,12 +78,24 @@ IMPLEMENT_GUI_PLUGIN_CODE(nogui)
 void bx_nogui_gui_c::specific_init(int argc, char **argv, unsigned headerbar_y)
 {
   put("NOGUI");
-  UNUSED(argc);
-  UNUSED(argv);
   UNUSED(headerbar_y);
 
   UNUSED(bochs_icon_bits);  // global variable
 
+  headless_mode = 0;
+  dump_request = 0;
+  // parse nogui specific options
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "headless")) {
+        BX_INFO(("headless mode: text screen is dumped to stdout on demand and at exit"));
+        headless_mode = 1;
+      } else {
+        BX_PANIC(("Unknown nogui option '%s'", argv[i]));
+      }
+    }
+  }
+
   if (SIM->get_param_bool(BXPN_PRIVATE_COLORMAP)->get()) {
     BX_INFO(("private_colormap option ignored."));
   }
@@ -90,6 +110,10 @@ void bx_nogui_gui_c::specific_init(int argc, char **argv, unsigned headerbar_y)
 
 void bx_nogui_gui_c::handle_events(void)
 {
+  if (dump_request) {
+    dump_request = 0;
+    dump_text_screen(stdout);
+  }
 }
 
 
@@ -312,7 +336,29 @@ void bx_nogui_gui_c::replace_bitmap(unsigned hbar_id, unsigned bmap_id)
 
 void bx_nogui_gui_c::exit(void)
 {
-  BX_INFO(("bx_nogui_gui_c::exit() not implemented yet."));
+  if (headless_mode) {
+    dump_text_screen(stdout);
+  }
+}
+
+// ::GET_SIGHANDLER_MASK()
+//
+// In headless mode SIGUSR2 requests a dump of the text screen. The dump
+// itself is done from handle_events(), not from the signal handler.
+
+Bit32u bx_nogui_gui_c::get_sighandler_mask()
+{
+#ifdef SIGUSR2
+  if (headless_mode)
+    return (1<<SIGUSR2);
+#endif
+  return 0;
+}
+
+void bx_nogui_gui_c::sighandler(int sig)
+{
+  UNUSED(sig);
+  dump_request = 1;
 }
 
 
@@ -131,20 +131,30 @@ static struct _rfbKeyboardEvent {
 static unsigned long rfbKeyboardEvents = 0;
 static bx_bool bKeyboardInUse = 0;
 
-// Misc Stuff
-static struct _rfbUpdateRegion {
-    unsigned int x;
-    unsigned int y;
-    unsigned int width;
-    unsigned int height;
-    bx_bool updated;
-} rfbUpdateRegion;
-
 #define BX_RFB_MAX_XDIM 1280
 #define BX_RFB_MAX_YDIM 1024
 #define BX_RFB_DEF_XDIM 720
 #define BX_RFB_DEF_YDIM 480
 
+// Misc Stuff
+// Changed areas are tracked per 16x16 tile. Before sending, a dirty tile
+// is compared with a copy of what the client already shows, and the tiles
+// that really changed go out in one FramebufferUpdate message at most
+// every rfbUpdateInterval microseconds.
+#define RFB_TILE 16
+#define RFB_TILES_X ((BX_RFB_MAX_XDIM + RFB_TILE - 1) / RFB_TILE)
+#define RFB_TILES_Y ((BX_RFB_MAX_YDIM + 128 + RFB_TILE - 1) / RFB_TILE)
+static Bit8u rfbDirtyTile[RFB_TILES_Y][RFB_TILES_X];
+static bx_bool rfbUpdatePending = 0;
+static volatile bx_bool rfbFullUpdateRequest = 0;
+static char *rfbClientScreen;
+static bx_bool rfbClientHextile = 0;
+static bx_bool rfbClientCopyRect = 0;
+static unsigned rfbUpdateInterval = 1000000 / 25;
+static Bit64u rfbLastUpdate = 0;
+static char *rfbOutBuf = NULL;
+static unsigned rfbOutLen = 0, rfbOutSize = 0;
+
 const unsigned char status_led_green = 0x38;
 const unsigned char status_gray_text = 0xa4;
 const unsigned char status_led_red = 0x07;
@@ -193,6 +203,8 @@ void UpdateScreen(unsigned char *newBits, int x, int y, int width, int height,
         bx_bool update_client);
 void SendUpdate(int x, int y, int width, int height, Bit32u encoding);
 void rfbAddUpdateRegion(unsigned x0, unsigned y0, unsigned w, unsigned h);
+void rfbSendUpdates(bx_bool force);
+void rfbCopyRectUp(unsigned x, unsigned y, unsigned w, unsigned h, unsigned dy);
 void rfbSetStatusText(int element, const char *text, bx_bool active, bx_bool w = 0);
 static Bit32u convertStringToRfbKey(const char *string);
 #if BX_SHOW_IPS && defined(WIN32)
@@ -240,6 +252,14 @@ void bx_rfb_gui_c::specific_init(int argc, char **argv, unsigned headerbar_y)
         } else {
           BX_INFO(("connection timeout set to %d", timeout));
         }
+      } else if (!strncmp(argv[i], "fps=", 4)) {
+        int fps = atoi(&argv[i][4]);
+        if ((fps < 1) || (fps > 1000)) {
+          BX_PANIC(("invalid fps value: %d", fps));
+        } else {
+          BX_INFO(("client updates limited to %d per second", fps));
+          rfbUpdateInterval = 1000000 / fps;
+        }
 #if BX_SHOW_IPS
       } else if (!strcmp(argv[i], "hideIPS")) {
         BX_INFO(("hide IPS display in status bar"));
@@ -256,13 +276,11 @@ void bx_rfb_gui_c::specific_init(int argc, char **argv, unsigned headerbar_y)
   }
 
   rfbScreen = new char[rfbWindowX * rfbWindowY];
+  rfbClientScreen = new char[rfbWindowX * rfbWindowY];
   memset(&rfbPalette, 0, sizeof(rfbPalette));
 
-  rfbUpdateRegion.x = rfbWindowX;
-  rfbUpdateRegion.y = rfbWindowY;
-  rfbUpdateRegion.width  = 0;
-  rfbUpdateRegion.height = 0;
-  rfbUpdateRegion.updated = 0;
+  memset(rfbDirtyTile, 0, sizeof(rfbDirtyTile));
+  rfbUpdatePending = 0;
 
   clientEncodingsCount=0;
   clientEncodings=NULL;
@@ -329,15 +347,7 @@ void bx_rfb_gui_c::handle_events(void)
   }
   bKeyboardInUse = 0;
 
-  if (rfbUpdateRegion.updated) {
-    SendUpdate(rfbUpdateRegion.x, rfbUpdateRegion.y, rfbUpdateRegion.width,
-               rfbUpdateRegion.height, rfbEncodingRaw);
-    rfbUpdateRegion.x = rfbWindowX;
-    rfbUpdateRegion.y = rfbWindowY;
-    rfbUpdateRegion.width  = 0;
-    rfbUpdateRegion.height = 0;
-    rfbUpdateRegion.updated = 0;
-  }
+  rfbSendUpdates(0);
 #if BX_SHOW_IPS
   if (rfbIPSupdate) {
     rfbIPSupdate = 0;
@@ -353,6 +363,7 @@ void bx_rfb_gui_c::flush(void)
 void bx_rfb_gui_c::clear_screen(void)
 {
   memset(&rfbScreen[rfbWindowX * rfbHeaderbarY], 0, rfbWindowX * rfbDimensionY);
+  rfbAddUpdateRegion(0, rfbHeaderbarY, rfbDimensionX, rfbDimensionY);
 }
 
 void bx_rfb_gui_c::text_update(Bit8u *old_text, Bit8u *new_text, unsigned long cursor_x, unsigned long cursor_y, bx_vga_tminfo_t *tm_info)
@@ -379,6 +390,18 @@ void bx_rfb_gui_c::text_update(Bit8u *old_text, Bit8u *new_text, unsigned long c
     charmap_updated = 0;
   }
 
+  // let the client move scrolled text with CopyRect, only the new lines
+  // are drawn and sent
+  if (!force_update && rfbClientCopyRect && (sGlobal != INVALID_SOCKET)) {
+    unsigned lines = text_scroll_check(old_text, new_text, text_rows, text_cols,
+                                       tm_info->line_offset);
+    if (lines > 0) {
+      rfbCopyRectUp(0, rfbHeaderbarY, text_cols * font_width, text_rows * font_height,
+                    lines * font_height);
+      rfbCursorY = (rfbCursorY >= lines) ? (rfbCursorY - lines) : text_rows;
+    }
+  }
+
   // first invalidate character at previous and new cursor location
   if ((rfbCursorY < text_rows) && (rfbCursorX < text_cols)) {
     curs = rfbCursorY * tm_info->line_offset + rfbCursorX * 2;
@@ -512,14 +535,18 @@ void bx_rfb_gui_c::dimension_update(unsigned x, unsigned y, unsigned fheight, un
       rfbWindowY = rfbDimensionY + rfbHeaderbarY + rfbStatusbarY;
       delete [] rfbScreen;
       rfbScreen = new char[rfbWindowX * rfbWindowY];
+      delete [] rfbClientScreen;
+      rfbClientScreen = new char[rfbWindowX * rfbWindowY];
+      memset(rfbDirtyTile, 0, sizeof(rfbDirtyTile));
+      rfbUpdatePending = 0;
       SendUpdate(0, 0, rfbWindowX, rfbWindowY, rfbEncodingDesktopSize);
+      rfbFullUpdateRequest = 1;
       bx_gui->show_headerbar();
     } else {
       if ((x > BX_RFB_DEF_XDIM) || (y > BX_RFB_DEF_YDIM)) {
         BX_PANIC(("dimension_update(): RFB doesn't support graphics mode %dx%d", x, y));
       }
       clear_screen();
-      SendUpdate(0, rfbHeaderbarY, rfbDimensionX, rfbDimensionY, rfbEncodingRaw);
       rfbDimensionX = x;
       rfbDimensionY = y;
     }
@@ -1318,6 +1345,8 @@ void HandleRfbClient(SOCKET sClient)
     return;
   }
 
+  rfbClientHextile = 0;
+  rfbClientCopyRect = 0;
   client_connected = 1;
   sGlobal = sClient;
   while (keep_alive) {
@@ -1396,6 +1425,8 @@ void HandleRfbClient(SOCKET sClient)
           }
 
           // print supported encodings
+          rfbClientHextile = 0;
+          rfbClientCopyRect = 0;
           BX_INFO(("rfbSetEncodings : client supported encodings:"));
           for (i = 0; i < clientEncodingsCount; i++) {
             Bit32u j;
@@ -1406,6 +1437,10 @@ void HandleRfbClient(SOCKET sClient)
                 found=1;
                 if (clientEncodings[i] == rfbEncodingDesktopSize) {
                   desktop_resizable = 1;
+                } else if (clientEncodings[i] == rfbEncodingHextile) {
+                  rfbClientHextile = 1;
+                } else if (clientEncodings[i] == rfbEncodingCopyRect) {
+                  rfbClientCopyRect = 1;
                 }
                 break;
               }
@@ -1420,11 +1455,7 @@ void HandleRfbClient(SOCKET sClient)
 
           ReadExact(sClient, (char *)&fur, sizeof(rfbFramebufferUpdateRequestMessage));
           if(!fur.incremental) {
-            rfbUpdateRegion.x = 0;
-            rfbUpdateRegion.y = 0;
-            rfbUpdateRegion.width  = rfbWindowX;
-            rfbUpdateRegion.height = rfbWindowY;
-            rfbUpdateRegion.updated = 1;
+            rfbFullUpdateRequest = 1;
           } //else {
           //    if(fur.x < rfbUpdateRegion.x) rfbUpdateRegion.x = fur.x;
           //    if(fur.y < rfbUpdateRegion.x) rfbUpdateRegion.y = fur.y;
@@ -1609,19 +1640,7 @@ void UpdateScreen(unsigned char *newBits, int x, int y, int width, int height,
     y++;
   }
   if (update_client) {
-    if(sGlobal == INVALID_SOCKET) return;
-    rfbFramebufferUpdateMessage fum;
-    rfbFramebufferUpdateRectHeader furh;
-    fum.messageType = rfbFramebufferUpdate;
-    fum.numberOfRectangles = htons(1);
-    WriteExact(sGlobal, (char *)&fum, rfbFramebufferUpdateMessageSize);
-    furh.r.xPosition = htons(x0);
-    furh.r.yPosition = htons(y0);
-    furh.r.width = htons((short)width);
-    furh.r.height = htons((short)height);
-    furh.r.encodingType = htonl(rfbEncodingRaw);
-    WriteExact(sGlobal, (char *)&furh, rfbFramebufferUpdateRectHeaderSize);
-    WriteExact(sGlobal, (char *)newBits, width * height);
+    rfbAddUpdateRegion(x0, y0, width, height);
   }
 }
 
@@ -1662,18 +1681,257 @@ void SendUpdate(int x, int y, int width, int height, Bit32u encoding)
 
 void rfbAddUpdateRegion(unsigned x0, unsigned y0, unsigned w, unsigned h)
 {
-  if (x0 < rfbUpdateRegion.x) rfbUpdateRegion.x = x0;
-  if (y0 < rfbUpdateRegion.y) rfbUpdateRegion.y = y0;
-  if ((y0 + h - rfbUpdateRegion.y) > rfbUpdateRegion.height) {
-    rfbUpdateRegion.height = y0 + h - rfbUpdateRegion.y;
+  unsigned tx, ty;
+
+  if ((x0 >= rfbWindowX) || (y0 >= rfbWindowY) || (w == 0) || (h == 0))
+    return;
+  if ((x0 + w) > rfbWindowX) w = rfbWindowX - x0;
+  if ((y0 + h) > rfbWindowY) h = rfbWindowY - y0;
+  for (ty = y0 / RFB_TILE; ty <= (y0 + h - 1) / RFB_TILE; ty++) {
+    for (tx = x0 / RFB_TILE; tx <= (x0 + w - 1) / RFB_TILE; tx++) {
+      rfbDirtyTile[ty][tx] = 1;
+    }
+  }
+  rfbUpdatePending = 1;
+}
+
+static void rfbOutPut(const void *data, unsigned len)
+{
+  if ((rfbOutLen + len) > rfbOutSize) {
+    unsigned size = rfbOutSize * 2 + len + 4096;
+    char *buf = new char[size];
+    if (rfbOutLen > 0) memcpy(buf, rfbOutBuf, rfbOutLen);
+    delete [] rfbOutBuf;
+    rfbOutBuf = buf;
+    rfbOutSize = size;
+  }
+  memcpy(rfbOutBuf + rfbOutLen, data, len);
+  rfbOutLen += len;
+}
+
+static void rfbOutPutRectHeader(unsigned x, unsigned y, unsigned w, unsigned h, Bit32u encoding)
+{
+  rfbFramebufferUpdateRectHeader furh;
+
+  furh.r.xPosition = htons(x);
+  furh.r.yPosition = htons(y);
+  furh.r.width = htons((short)w);
+  furh.r.height = htons((short)h);
+  furh.r.encodingType = htonl(encoding);
+  rfbOutPut(&furh, rfbFramebufferUpdateRectHeaderSize);
+}
+
+// Encode one hextile tile (at most 16x16 pixels). Solid tiles take one or
+// two bytes, text characters a few subrectangles; raw is the fallback.
+// *bg keeps the background of the previous tile (-1 = undefined).
+static void rfbEncodeHextileTile(const Bit8u *t, unsigned w, unsigned h, int *bg)
+{
+  unsigned counts[256];
+  Bit8u done[RFB_TILE * RFB_TILE];
+  Bit8u sub[255 * 3];
+  Bit8u hdr[4];
+  unsigned i, x, y, ncolors = 0, nsub = 0, sublen = 0, hlen = 0;
+  Bit8u bgc = t[0], fgc = t[0], c;
+
+  memset(counts, 0, sizeof(counts));
+  for (i = 0; i < (w * h); i++) {
+    if (counts[t[i]]++ == 0) {
+      ncolors++;
+      if (t[i] != bgc) fgc = t[i];
+    }
+    if (counts[t[i]] > counts[bgc]) bgc = t[i];
+  }
+  if (ncolors == 1) {
+    if (*bg != bgc) {
+      hdr[0] = rfbHextileBackgroundSpecified;
+      hdr[1] = bgc;
+      rfbOutPut(hdr, 2);
+      *bg = bgc;
+    } else {
+      hdr[0] = 0;
+      rfbOutPut(hdr, 1);
+    }
+    return;
+  }
+  bx_bool mono = (ncolors == 2);
+  if (mono && (fgc == bgc)) fgc = t[0];
+
+  memset(done, 0, w * h);
+  for (y = 0; y < h; y++) {
+    for (x = 0; x < w; x++) {
+      i = y * w + x;
+      if ((t[i] == bgc) || done[i]) continue;
+      c = t[i];
+      unsigned rw = 1, rh = 1, j;
+      while (((x + rw) < w) && (t[i + rw] == c) && !done[i + rw]) rw++;
+      while ((y + rh) < h) {
+        for (j = 0; j < rw; j++) {
+          unsigned k = (y + rh) * w + x + j;
+          if ((t[k] != c) || done[k]) break;
+        }
+        if (j < rw) break;
+        rh++;
+      }
+      for (unsigned r = 0; r < rh; r++)
+        memset(&done[(y + r) * w + x], 1, rw);
+      if ((nsub == 255) || ((sublen + 3 + 4) >= (w * h))) {
+        // subrectangles would not be smaller than the raw tile
+        hdr[0] = rfbHextileRaw;
+        rfbOutPut(hdr, 1);
+        rfbOutPut(t, w * h);
+        *bg = -1;
+        return;
+      }
+      if (!mono) sub[sublen++] = c;
+      sub[sublen++] = rfbHextilePackXY(x, y);
+      sub[sublen++] = rfbHextilePackWH(rw, rh);
+      nsub++;
+    }
+  }
+  hdr[0] = rfbHextileAnySubrects;
+  hlen = 1;
+  if (*bg != bgc) {
+    hdr[0] |= rfbHextileBackgroundSpecified;
+    hdr[hlen++] = bgc;
+  }
+  if (mono) {
+    hdr[0] |= rfbHextileForegroundSpecified;
+    hdr[hlen++] = fgc;
+  } else {
+    hdr[0] |= rfbHextileSubrectsColoured;
+  }
+  hdr[hlen++] = nsub;
+  rfbOutPut(hdr, hlen);
+  rfbOutPut(sub, sublen);
+  *bg = bgc;
+}
+
+static void rfbEncodeRect(unsigned x, unsigned y, unsigned w, unsigned h)
+{
+  Bit8u tile[RFB_TILE * RFB_TILE];
+  unsigned i, tx, ty, tw, th;
+  int bg = -1;
+
+  if (!rfbClientHextile) {
+    rfbOutPutRectHeader(x, y, w, h, rfbEncodingRaw);
+    for (i = 0; i < h; i++) {
+      rfbOutPut(&rfbScreen[(y + i) * rfbWindowX + x], w);
+    }
+    return;
   }
-  if ((x0 + w - rfbUpdateRegion.x) > rfbUpdateRegion.width) {
-    rfbUpdateRegion.width = x0 + w - rfbUpdateRegion.x;
+  rfbOutPutRectHeader(x, y, w, h, rfbEncodingHextile);
+  for (ty = y; ty < (y + h); ty += RFB_TILE) {
+    th = ((y + h - ty) < RFB_TILE) ? (y + h - ty) : RFB_TILE;
+    for (tx = x; tx < (x + w); tx += RFB_TILE) {
+      tw = ((x + w - tx) < RFB_TILE) ? (x + w - tx) : RFB_TILE;
+      for (i = 0; i < th; i++) {
+        memcpy(&tile[i * tw], &rfbScreen[(ty + i) * rfbWindowX + tx], tw);
+      }
+      rfbEncodeHextileTile(tile, tw, th, &bg);
+    }
   }
-  if ((rfbUpdateRegion.x + rfbUpdateRegion.width) > rfbWindowX) {
-    rfbUpdateRegion.width = rfbWindowX - rfbUpdateRegion.x;
+}
+
+static bx_bool rfbTileChanged(unsigned tx, unsigned ty)
+{
+  unsigned x = tx * RFB_TILE, y = ty * RFB_TILE, w, h, i, ofs;
+
+  w = ((x + RFB_TILE) > rfbWindowX) ? (rfbWindowX - x) : RFB_TILE;
+  h = ((y + RFB_TILE) > rfbWindowY) ? (rfbWindowY - y) : RFB_TILE;
+  for (i = 0; i < h; i++) {
+    ofs = (y + i) * rfbWindowX + x;
+    if (memcmp(&rfbScreen[ofs], &rfbClientScreen[ofs], w)) return 1;
+  }
+  return 0;
+}
+
+// Send all dirty tiles that differ from the client's copy as one
+// FramebufferUpdate. Unless forced, updates are coalesced to the
+// configured frame rate.
+void rfbSendUpdates(bx_bool force)
+{
+  rfbFramebufferUpdateMessage fum;
+  unsigned tx, ty, tx0, x, y, w, h, i, nrects = 0;
+  unsigned tiles_x = (rfbWindowX + RFB_TILE - 1) / RFB_TILE;
+  unsigned tiles_y = (rfbWindowY + RFB_TILE - 1) / RFB_TILE;
+  bx_bool full = rfbFullUpdateRequest;
+
+  if (!rfbUpdatePending && !full) return;
+  if (sGlobal == INVALID_SOCKET) {
+    // a new client always starts with a full update request
+    memset(rfbDirtyTile, 0, sizeof(rfbDirtyTile));
+    rfbUpdatePending = 0;
+    return;
+  }
+  Bit64u now = bx_get_realtime64_usec();
+  if (!force && !full && ((now - rfbLastUpdate) < rfbUpdateInterval)) return;
+  rfbLastUpdate = now;
+  if (full) {
+    rfbFullUpdateRequest = 0;
+    memset(rfbDirtyTile, 1, sizeof(rfbDirtyTile));
+  }
+
+  rfbOutLen = 0;
+  rfbOutPut(&fum, rfbFramebufferUpdateMessageSize);
+  for (ty = 0; ty < tiles_y; ty++) {
+    tx = 0;
+    while (tx < tiles_x) {
+      if (!rfbDirtyTile[ty][tx] || (!full && !rfbTileChanged(tx, ty))) {
+        rfbDirtyTile[ty][tx] = 0;
+        tx++;
+        continue;
+      }
+      tx0 = tx;
+      while ((tx < tiles_x) && rfbDirtyTile[ty][tx] && (full || rfbTileChanged(tx, ty))) {
+        rfbDirtyTile[ty][tx] = 0;
+        tx++;
+      }
+      x = tx0 * RFB_TILE;
+      y = ty * RFB_TILE;
+      w = (((tx * RFB_TILE) > rfbWindowX) ? rfbWindowX : (tx * RFB_TILE)) - x;
+      h = (((y + RFB_TILE) > rfbWindowY) ? rfbWindowY : (y + RFB_TILE)) - y;
+      rfbEncodeRect(x, y, w, h);
+      for (i = 0; i < h; i++) {
+        memcpy(&rfbClientScreen[(y + i) * rfbWindowX + x], &rfbScreen[(y + i) * rfbWindowX + x], w);
+      }
+      nrects++;
+    }
+  }
+  memset(rfbDirtyTile, 0, sizeof(rfbDirtyTile));
+  rfbUpdatePending = 0;
+  if (nrects > 0) {
+    fum.messageType = rfbFramebufferUpdate;
+    fum.numberOfRectangles = htons(nrects);
+    memcpy(rfbOutBuf, &fum, rfbFramebufferUpdateMessageSize);
+    WriteExact(sGlobal, rfbOutBuf, rfbOutLen);
+  }
+}
+
+// Move the area (x, y + dy, w, h - dy) up by dy pixels, on the server side
+// and with a CopyRect on the client side.
+void rfbCopyRectUp(unsigned x, unsigned y, unsigned w, unsigned h, unsigned dy)
+{
+  rfbFramebufferUpdateMessage fum;
+  rfbCopyRect cr;
+  unsigned i;
+
+  if ((dy == 0) || (dy >= h)) return;
+  // the source area must be up to date on the client before it is copied
+  rfbSendUpdates(1);
+  for (i = y; i < (y + h - dy); i++) {
+    memmove(&rfbScreen[i * rfbWindowX + x], &rfbScreen[(i + dy) * rfbWindowX + x], w);
+    memmove(&rfbClientScreen[i * rfbWindowX + x], &rfbClientScreen[(i + dy) * rfbWindowX + x], w);
   }
-  rfbUpdateRegion.updated = 1;
+  if (sGlobal == INVALID_SOCKET) return;
+  fum.messageType = rfbFramebufferUpdate;
+  fum.numberOfRectangles = htons(1);
+  rfbOutLen = 0;
+  rfbOutPut(&fum, rfbFramebufferUpdateMessageSize);
+  rfbOutPutRectHeader(x, y, w, h - dy, rfbEncodingCopyRect);
+  cr.srcXPosition = htons(x);
+  cr.srcYPosition = htons(y + dy);
+  rfbOutPut(&cr, rfbCopyRectSize);
+  WriteExact(sGlobal, rfbOutBuf, rfbOutLen);
 }
 
 void rfbSetStatusText(int element, const char *text, bx_bool active, bx_bool w)
@@ -553,6 +553,8 @@ const char *hdimage_mode_names[] = {
   "vvfat",
   "vpc",
   "vbox",
+  "cow",
+  "compressed",
   NULL
 };
 
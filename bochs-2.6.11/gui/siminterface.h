@@ -562,9 +562,11 @@ enum {
   BX_HDIMAGE_MODE_VOLATILE,
   BX_HDIMAGE_MODE_VVFAT,
   BX_HDIMAGE_MODE_VPC,
-  BX_HDIMAGE_MODE_VBOX
+  BX_HDIMAGE_MODE_VBOX,
+  BX_HDIMAGE_MODE_COW,
+  BX_HDIMAGE_MODE_COMPRESSED
 };
-#define BX_HDIMAGE_MODE_LAST     BX_HDIMAGE_MODE_VBOX
+#define BX_HDIMAGE_MODE_LAST     BX_HDIMAGE_MODE_COMPRESSED
 #define BX_HDIMAGE_MODE_UNKNOWN  -1
 
 enum {
@@ -219,7 +219,7 @@ DWORD WINAPI vncShowIPSthread(LPVOID);
 
 void bx_vncsrv_gui_c::specific_init(int argc, char **argv, unsigned headerbar_y)
 {
-  int i, timeout = 30;
+  int i, timeout = 30, fps = 25;
 
   put("VNCSRV");
   UNUSED(bochs_icon_bits);
@@ -251,6 +251,14 @@ void bx_vncsrv_gui_c::specific_init(int argc, char **argv, unsigned headerbar_y)
         } else {
           BX_INFO(("connection timeout set to %d", timeout));
         }
+      } else if (!strncmp(argv[i], "fps=", 4)) {
+        fps = atoi(&argv[i][4]);
+        if ((fps < 1) || (fps > 1000)) {
+          BX_PANIC(("invalid fps value: %d", fps));
+          fps = 25;
+        } else {
+          BX_INFO(("client updates limited to %d per second", fps));
+        }
 #if BX_SHOW_IPS
       } else if (!strcmp(argv[i], "hideIPS")) {
         BX_INFO(("hide IPS display in status bar"));
@@ -273,6 +281,8 @@ void bx_vncsrv_gui_c::specific_init(int argc, char **argv, unsigned headerbar_y)
   screen->desktopName = "Bochs VNC Screen";
   screen->frameBuffer = new char[rfbWindowX * rfbWindowY * sizeof(rfbPixel)];
   screen->alwaysShared = TRUE;
+  // libvncserver coalesces the marked rectangles for this time
+  screen->deferUpdateTime = 1000 / fps;
   screen->ptrAddEvent = doptr;
   screen->kbdAddEvent = dokey;
   screen->newClientHook = newclient;
@@ -623,6 +623,13 @@ void bx_x_gui_c::specific_init(int argc, char **argv, unsigned headerbar_y)
     }
   }
 #endif
+  if (SIM->get_param_bool(BXPN_VGA_THREADED)->get()) {
+    // the vga display thread draws the screen while the simulation
+    // thread handles the events
+    if (XInitThreads() == 0) {
+      BX_PANIC(("the threaded vga display needs a threading X11."));
+    }
+  }
 
   /* connect to X server */
   if ((bx_x_display=XOpenDisplay(display_name)) == NULL)
@@ -0,0 +1,210 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+// bxmemtrace_sim: replay a memory trace written by the tracebuf library in
+// BXTRACE_MODE=mem through a set associative LRU cache model.
+//
+//   bxmemtrace_sim [-c size_kb] [-a ways] [-l line_size] [-L] [-d] bxtrace.0 ...
+//
+// -L simulates a linearly addressed cache, the default is physical
+// -d prints the decoded accesses instead of simulating
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "bxtrace.h"
+
+struct cache_t {
+  unsigned sets, ways, line_shift;
+  Bit64u *tag;      // sets * ways, ~0 = invalid
+  Bit64u *used;     // last use time for LRU
+  Bit64u time;
+  Bit64u accesses[2], misses[2]; // [0] reads, [1] writes
+};
+
+static int cache_init(cache_t *c, unsigned size_kb, unsigned ways, unsigned line)
+{
+  unsigned lines = size_kb * 1024 / line;
+
+  memset(c, 0, sizeof(*c));
+  if ((line & (line - 1)) || (ways == 0) || (lines < ways) || (lines % ways)) return 0;
+  while ((1U << c->line_shift) < line) c->line_shift++;
+  c->sets = lines / ways;
+  c->ways = ways;
+  c->tag = new Bit64u[lines];
+  c->used = new Bit64u[lines];
+  memset(c->tag, 0xff, lines * sizeof(Bit64u));
+  memset(c->used, 0, lines * sizeof(Bit64u));
+  return 1;
+}
+
+static void cache_access_line(cache_t *c, Bit64u line, unsigned write)
+{
+  Bit64u *tag = &c->tag[(line % c->sets) * c->ways];
+  Bit64u *used = &c->used[(line % c->sets) * c->ways];
+  unsigned w, victim = 0;
+
+  c->time++;
+  c->accesses[write]++;
+  for (w = 0; w < c->ways; w++) {
+    if (tag[w] == line) {
+      used[w] = c->time;
+      return;
+    }
+    if (used[w] < used[victim]) victim = w;
+  }
+  c->misses[write]++;
+  tag[victim] = line;
+  used[victim] = c->time;
+}
+
+static void cache_access(cache_t *c, Bit64u addr, unsigned size, unsigned rw)
+{
+  Bit64u first = addr >> c->line_shift;
+  Bit64u last = (addr + (size ? size : 1) - 1) >> c->line_shift;
+  unsigned write = (rw != BX_TRACE_MEM_READ);
+
+  // a read-modify-write access is counted as read and write
+  if (rw == BX_TRACE_MEM_RMW) {
+    for (Bit64u line = first; line <= last; line++)
+      cache_access_line(c, line, 0);
+  }
+  for (Bit64u line = first; line <= last; line++)
+    cache_access_line(c, line, write);
+}
+
+static int get_varint(FILE *fp, Bit64u *val)
+{
+  unsigned shift = 0;
+  int b;
+
+  *val = 0;
+  do {
+    if ((b = getc(fp)) == EOF) return 0;
+    *val |= (Bit64u)(b & 0x7f) << shift;
+    shift += 7;
+  } while ((b & 0x80) && (shift < 64));
+  return 1;
+}
+
+static Bit64u unzigzag(Bit64u val)
+{
+  return (val >> 1) ^ (Bit64u)(-(Bit64s)(val & 1));
+}
+
+static int replay_file(const char *fname, cache_t *c, int linear, int dump)
+{
+  static const char *rw_name[4] = { "RD", "WR", "EX", "RW" };
+  bx_trace_header_t header;
+  Bit64u lin = 0, offset = 0, delta, size, count = 0;
+  int flags;
+
+  FILE *fp = fopen(fname, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "%s: cannot open\n", fname);
+    return 1;
+  }
+  if ((fread(&header, sizeof(header), 1, fp) != 1) ||
+      memcmp(header.magic, BX_TRACE_MEM_MAGIC, sizeof(header.magic)) ||
+      (header.version != BX_TRACE_VERSION)) {
+    fprintf(stderr, "%s: not a bochs memory trace file\n", fname);
+    fclose(fp);
+    return 1;
+  }
+  setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+  while ((flags = getc(fp)) != EOF) {
+    if (! get_varint(fp, &delta)) break;
+    lin += unzigzag(delta);
+    if (! (flags & BX_TRACE_MEM_SAME_MAP)) {
+      if (! get_varint(fp, &delta)) break;
+      offset += unzigzag(delta);
+    }
+    size = flags >> BX_TRACE_MEM_SIZE_SHIFT;
+    if ((size == BX_TRACE_MEM_SIZE_ESC) && !get_varint(fp, &size)) break;
+
+    if (dump)
+      printf("%s lin=%016llx phy=%016llx size=%u\n", rw_name[flags & BX_TRACE_MEM_RW_MASK],
+        (unsigned long long) lin, (unsigned long long)(lin + offset), (unsigned) size);
+    else
+      cache_access(c, linear ? lin : (lin + offset), (unsigned) size, flags & BX_TRACE_MEM_RW_MASK);
+    count++;
+  }
+  if (! feof(fp))
+    fprintf(stderr, "%s: truncated record after %llu accesses\n", fname, (unsigned long long) count);
+  fclose(fp);
+
+  if (! dump)
+    printf("%s: cpu %u, %llu accesses\n", fname, header.cpu, (unsigned long long) count);
+  return 0;
+}
+
+static double percent(Bit64u part, Bit64u total)
+{
+  return total ? (100.0 * part / total) : 0.0;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned size_kb = 32, ways = 8, line = 64;
+  int i, linear = 0, dump = 0, ret = 0;
+  cache_t cache;
+
+  for (i = 1; (i < argc) && (argv[i][0] == '-'); i++) {
+    if (! strcmp(argv[i], "-L")) linear = 1;
+    else if (! strcmp(argv[i], "-d")) dump = 1;
+    else if (! strcmp(argv[i], "-c") && (i + 1 < argc)) size_kb = atoi(argv[++i]);
+    else if (! strcmp(argv[i], "-a") && (i + 1 < argc)) ways = atoi(argv[++i]);
+    else if (! strcmp(argv[i], "-l") && (i + 1 < argc)) line = atoi(argv[++i]);
+    else {
+      fprintf(stderr, "unknown option '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+  if (i == argc) {
+    fprintf(stderr, "usage: bxmemtrace_sim [-c size_kb] [-a ways] [-l line_size] [-L] [-d] tracefile ...\n");
+    return 1;
+  }
+  if (! cache_init(&cache, size_kb, ways, line)) {
+    fprintf(stderr, "invalid cache geometry: %u KB, %u ways, %u byte lines\n", size_kb, ways, line);
+    return 1;
+  }
+
+  // all files share one cache, as the cpus of a run share the caches
+  for (; i < argc; i++) {
+    ret |= replay_file(argv[i], &cache, linear, dump);
+  }
+
+  if (! dump) {
+    Bit64u accesses = cache.accesses[0] + cache.accesses[1];
+    Bit64u misses = cache.misses[0] + cache.misses[1];
+    printf("cache: %u KB, %u ways, %u byte lines, %s addresses\n", size_kb, ways, line,
+      linear ? "linear" : "physical");
+    printf("line reads:  %12llu  misses %12llu (%.2f%%)\n", (unsigned long long) cache.accesses[0],
+      (unsigned long long) cache.misses[0], percent(cache.misses[0], cache.accesses[0]));
+    printf("line writes: %12llu  misses %12llu (%.2f%%)\n", (unsigned long long) cache.accesses[1],
+      (unsigned long long) cache.misses[1], percent(cache.misses[1], cache.accesses[1]));
+    printf("total:       %12llu  misses %12llu (%.2f%%)\n", (unsigned long long) accesses,
+      (unsigned long long) misses, percent(misses, accesses));
+  }
+  return ret;
+}
@@ -0,0 +1,83 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+#ifndef BX_TRACE_FORMAT_H
+#define BX_TRACE_FORMAT_H
+
+// Binary trace file format shared by the tracebuf instrumentation library
+// and the bxtrace_dump decoder. Each cpu writes its own file: a header
+// followed by fixed size records in host byte order.
+
+#define BX_TRACE_MAGIC   "BXTRACE1"
+#define BX_TRACE_MEM_MAGIC "BXMTRC01"
+#define BX_TRACE_VERSION 1
+
+enum {
+  BX_TRACE_INSN = 1,     // addr1 = rip, size = instruction length
+  BX_TRACE_LIN_ACCESS,   // addr1 = linear, addr2 = physical, aux = rw | memtype << 4
+  BX_TRACE_PHY_ACCESS,   // addr2 = physical, aux = rw | memtype << 4
+  BX_TRACE_BRANCH,       // addr1 = branch rip, addr2 = target, aux = what
+                         // (0 = conditional not taken, 1 = conditional taken)
+  BX_TRACE_FAR_BRANCH,   // addr1 = branch rip, addr2 = target, aux = what, data = new cs
+  BX_TRACE_INTERRUPT,    // aux = vector
+  BX_TRACE_EXCEPTION,    // aux = vector, data = error code
+  BX_TRACE_HWINTERRUPT,  // aux = vector, addr1 = eip, data = cs
+  BX_TRACE_RESET,        // aux = reset type
+  BX_TRACE_LAST
+};
+
+struct bx_trace_header_t {
+  char   magic[8];
+  Bit32u version;
+  Bit32u record_size;
+  Bit32u cpu;
+  Bit32u reserved;
+};
+
+// In memory trace mode (BXTRACE_MODE=mem) the file uses the
+// BX_TRACE_MEM_MAGIC header and holds only data accesses, each of them
+// delta encoded against the previous access of the same cpu:
+//
+//   byte 0     bits 0-1 rw (BX_READ, BX_WRITE, BX_RW), bit 2 set if the
+//              physical - linear offset is unchanged, bits 3-7 size
+//              (31 = size follows as varint)
+//   varint     zigzag(linear - previous linear)
+//   varint     zigzag(offset - previous offset), only if bit 2 is clear
+//   varint     size, only if the size field is 31
+//
+// varints are little endian base 128, zigzag maps signed to unsigned.
+#define BX_TRACE_MEM_RW_MASK    0x03
+#define BX_TRACE_MEM_READ       0x00
+#define BX_TRACE_MEM_WRITE      0x01
+#define BX_TRACE_MEM_RMW        0x03
+#define BX_TRACE_MEM_SAME_MAP   0x04
+#define BX_TRACE_MEM_SIZE_SHIFT 3
+#define BX_TRACE_MEM_SIZE_ESC   31
+
+struct bx_trace_rec_t {
+  Bit8u  type;
+  Bit8u  size;
+  Bit16u aux;
+  Bit32u data;
+  Bit64u addr1;
+  Bit64u addr2;
+};
+
+#endif
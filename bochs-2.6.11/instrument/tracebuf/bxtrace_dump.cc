@@ -0,0 +1,167 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+// bxtrace_dump: print a binary trace written by the tracebuf
+// instrumentation library as text.
+//
+//   bxtrace_dump [-s] bxtrace.0 ...
+//
+// -s only prints the number of records of each type.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "bxtrace.h"
+
+static const char *rw_name(unsigned aux)
+{
+  static const char *names[4] = { "RD", "WR", "EX", "RW" };
+  return ((aux & 0xf) < 4) ? names[aux & 0xf] : "SS";
+}
+
+static const char *branch_name(unsigned what)
+{
+  static const char *names[] = {
+    "jmp", "jmp indirect", "call", "call indirect", "ret", "iret",
+    "int", "syscall", "sysret", "sysenter", "sysexit"
+  };
+
+  if (what == 0) return "not taken";
+  if (what == 1) return "taken";
+  if (what >= 10 && what <= 20) return names[what - 10];
+  return "?";
+}
+
+static void print_record(const bx_trace_rec_t *rec)
+{
+  switch(rec->type) {
+    case BX_TRACE_INSN:
+      printf("%016llx  insn  len=%u\n", (unsigned long long) rec->addr1, rec->size);
+      break;
+    case BX_TRACE_LIN_ACCESS:
+      printf("    %s lin=%016llx phy=%016llx size=%u memtype=%u\n", rw_name(rec->aux),
+        (unsigned long long) rec->addr1, (unsigned long long) rec->addr2, rec->size, rec->aux >> 4);
+      break;
+    case BX_TRACE_PHY_ACCESS:
+      printf("    %s phy=%016llx size=%u memtype=%u\n", rw_name(rec->aux),
+        (unsigned long long) rec->addr2, rec->size, rec->aux >> 4);
+      break;
+    case BX_TRACE_BRANCH:
+      if (rec->aux == 0)
+        printf("    branch not taken\n");
+      else
+        printf("    branch %s -> %016llx\n", branch_name(rec->aux), (unsigned long long) rec->addr2);
+      break;
+    case BX_TRACE_FAR_BRANCH:
+      printf("    far %s -> %04x:%016llx\n", branch_name(rec->aux), rec->data,
+        (unsigned long long) rec->addr2);
+      break;
+    case BX_TRACE_INTERRUPT:
+      printf("interrupt vector=%02x\n", rec->aux);
+      break;
+    case BX_TRACE_EXCEPTION:
+      printf("exception vector=%02x error=%08x\n", rec->aux, rec->data);
+      break;
+    case BX_TRACE_HWINTERRUPT:
+      printf("hw interrupt vector=%02x at %04x:%016llx\n", rec->aux, rec->data,
+        (unsigned long long) rec->addr1);
+      break;
+    case BX_TRACE_RESET:
+      printf("reset type=%u\n", rec->aux);
+      break;
+    default:
+      printf("unknown record type %u\n", rec->type);
+      break;
+  }
+}
+
+static int dump_file(const char *fname, int summary)
+{
+  static bx_trace_rec_t buf[4096];
+  unsigned long long count[BX_TRACE_LAST + 1];
+  bx_trace_header_t header;
+  size_t n, i;
+
+  FILE *fp = fopen(fname, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "%s: cannot open\n", fname);
+    return 1;
+  }
+  if (fread(&header, sizeof(header), 1, fp) != 1)
+    memset(&header, 0, sizeof(header));
+  if (! memcmp(header.magic, BX_TRACE_MEM_MAGIC, sizeof(header.magic))) {
+    fprintf(stderr, "%s: memory trace, use bxmemtrace_sim -d to decode it\n", fname);
+    fclose(fp);
+    return 1;
+  }
+  if (memcmp(header.magic, BX_TRACE_MAGIC, sizeof(header.magic)) ||
+      (header.version != BX_TRACE_VERSION) ||
+      (header.record_size != sizeof(bx_trace_rec_t))) {
+    fprintf(stderr, "%s: not a bochs trace file\n", fname);
+    fclose(fp);
+    return 1;
+  }
+
+  printf("# %s: cpu %u\n", fname, header.cpu);
+  memset(count, 0, sizeof(count));
+  while ((n = fread(buf, sizeof(bx_trace_rec_t), 4096, fp)) > 0) {
+    for (i = 0; i < n; i++) {
+      count[((buf[i].type >= BX_TRACE_INSN) && (buf[i].type < BX_TRACE_LAST)) ? buf[i].type : BX_TRACE_LAST]++;
+      if (! summary) print_record(&buf[i]);
+    }
+  }
+  fclose(fp);
+
+  if (summary) {
+    printf("instructions:       %llu\n", count[BX_TRACE_INSN]);
+    printf("linear accesses:    %llu\n", count[BX_TRACE_LIN_ACCESS]);
+    printf("physical accesses:  %llu\n", count[BX_TRACE_PHY_ACCESS]);
+    printf("near branches:      %llu\n", count[BX_TRACE_BRANCH]);
+    printf("far branches:       %llu\n", count[BX_TRACE_FAR_BRANCH]);
+    printf("interrupts:         %llu\n", count[BX_TRACE_INTERRUPT] + count[BX_TRACE_HWINTERRUPT]);
+    printf("exceptions:         %llu\n", count[BX_TRACE_EXCEPTION]);
+    printf("resets:             %llu\n", count[BX_TRACE_RESET]);
+    printf("unknown:            %llu\n", count[BX_TRACE_LAST]);
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  int i, summary = 0, ret = 0;
+
+  for (i = 1; (i < argc) && (argv[i][0] == '-'); i++) {
+    if (! strcmp(argv[i], "-s")) summary = 1;
+    else {
+      fprintf(stderr, "unknown option '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+  if (i == argc) {
+    fprintf(stderr, "usage: bxtrace_dump [-s] tracefile ...\n");
+    return 1;
+  }
+  for (; i < argc; i++) {
+    ret |= dump_file(argv[i], summary);
+  }
+  return ret;
+}
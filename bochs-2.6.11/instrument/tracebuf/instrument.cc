@@ -0,0 +1,257 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+#include <assert.h>
+
+#include "bochs.h"
+#include "bxthread.h"
+
+// The trace of cpu N is written to "<prefix>.N", the prefix is taken from
+// the BXTRACE_FILE environment variable (default "bxtrace").
+
+bx_trace_ring_t *bx_trace_ring = NULL;
+bx_trace_filter_t bx_trace_filter = { 0, 0, 0, 0, (bx_address) -1, 0xf };
+
+// delta encoder state of the memory trace mode
+static struct {
+  Bit64u prev_lin;
+  Bit64u prev_offset;
+} mem_enc[BX_SMP_PROCESSORS];
+
+static FILE *trace_file[BX_SMP_PROCESSORS];
+static volatile bx_bool drain_running = 0;
+static bx_bool drain_started = 0;
+static BX_THREAD_VAR(drain_thread);
+
+static logfunctions *instrument_log = new logfunctions();
+#define LOG_THIS instrument_log->
+
+static BX_CPP_INLINE unsigned put_varint(Bit8u *p, Bit64u val)
+{
+  unsigned n = 0;
+  while (val >= 0x80) {
+    p[n++] = (Bit8u)(val | 0x80);
+    val >>= 7;
+  }
+  p[n++] = (Bit8u) val;
+  return n;
+}
+
+static BX_CPP_INLINE Bit64u zigzag(Bit64u delta)
+{
+  return (delta << 1) ^ (Bit64u)((Bit64s) delta >> 63);
+}
+
+static void write_mem_records(unsigned cpu, const bx_trace_rec_t *rec, unsigned n)
+{
+  static Bit8u buf[BX_SMP_PROCESSORS][4096 * 32];
+  Bit8u *out = buf[cpu];
+  unsigned len = 0;
+
+  for (unsigned i = 0; i < n; i++, rec++) {
+    if (rec->type != BX_TRACE_LIN_ACCESS) continue;
+
+    Bit64u offset = rec->addr2 - rec->addr1;
+    unsigned size = (rec->size < BX_TRACE_MEM_SIZE_ESC) ? rec->size : BX_TRACE_MEM_SIZE_ESC;
+    Bit8u flags = (rec->aux & BX_TRACE_MEM_RW_MASK) | (size << BX_TRACE_MEM_SIZE_SHIFT);
+    if (offset == mem_enc[cpu].prev_offset) flags |= BX_TRACE_MEM_SAME_MAP;
+
+    out[len++] = flags;
+    len += put_varint(out + len, zigzag(rec->addr1 - mem_enc[cpu].prev_lin));
+    if (! (flags & BX_TRACE_MEM_SAME_MAP))
+      len += put_varint(out + len, zigzag(offset - mem_enc[cpu].prev_offset));
+    if (size == BX_TRACE_MEM_SIZE_ESC)
+      len += put_varint(out + len, rec->size);
+    mem_enc[cpu].prev_lin = rec->addr1;
+    mem_enc[cpu].prev_offset = offset;
+
+    // at most 32 bytes per record
+    if (len > (sizeof(buf[cpu]) - 32)) {
+      fwrite(out, 1, len, trace_file[cpu]);
+      len = 0;
+    }
+  }
+  if (len > 0) fwrite(out, 1, len, trace_file[cpu]);
+}
+
+// write all pending records of one cpu, returns the number of records
+static unsigned drain_ring(unsigned cpu)
+{
+  bx_trace_ring_t *ring = &bx_trace_ring[cpu];
+  Bit32u head = BX_TRACE_LOAD_ACQUIRE(&ring->head);
+  Bit32u tail = ring->tail;
+  unsigned count = head - tail;
+
+  while (tail != head) {
+    unsigned start = tail & (BX_TRACE_RING_SIZE - 1);
+    unsigned n = head - tail;
+    if ((start + n) > BX_TRACE_RING_SIZE) n = BX_TRACE_RING_SIZE - start;
+    if (trace_file[cpu] != NULL) {
+      if (bx_trace_filter.mem_only)
+        write_mem_records(cpu, &ring->rec[start], n);
+      else
+        fwrite(&ring->rec[start], sizeof(bx_trace_rec_t), n, trace_file[cpu]);
+    }
+    tail += n;
+    BX_TRACE_STORE_RELEASE(&ring->tail, tail);
+  }
+  return count;
+}
+
+BX_THREAD_FUNC(trace_drain_thread, arg)
+{
+  while (drain_running) {
+    unsigned count = 0;
+    for (unsigned cpu = 0; cpu < BX_SMP_PROCESSORS; cpu++)
+      count += drain_ring(cpu);
+    if (count == 0) BX_MSLEEP(1);
+  }
+  BX_THREAD_EXIT;
+}
+
+void bx_trace_wait(unsigned cpu)
+{
+  bx_trace_ring_t *ring = &bx_trace_ring[cpu];
+
+  while ((Bit32u)(ring->head - BX_TRACE_LOAD_ACQUIRE(&ring->tail)) >= BX_TRACE_RING_SIZE) {
+    if (! drain_running) {
+      drain_ring(cpu);
+      break;
+    }
+    BX_MSLEEP(1);
+  }
+}
+
+void bx_instr_init_env(void)
+{
+  const char *env;
+
+  env = getenv("BXTRACE_MODE");
+  if ((env != NULL) && !strcmp(env, "mem"))
+    bx_trace_filter.mem_only = 1;
+
+  env = getenv("BXTRACE_CR3");
+  if (env != NULL) {
+    bx_trace_filter.match_cr3 = 1;
+    bx_trace_filter.cr3 = (bx_address) strtoull(env, NULL, 16);
+  }
+
+  env = getenv("BXTRACE_RANGE");
+  if (env != NULL) {
+    char *end;
+    bx_trace_filter.lo = (bx_address) strtoull(env, &end, 16);
+    if (*end == '-')
+      bx_trace_filter.hi = (bx_address) strtoull(end + 1, NULL, 16);
+  }
+
+  env = getenv("BXTRACE_CPL");
+  if (env != NULL) {
+    bx_trace_filter.cpl_mask = 0;
+    for (; *env; env++) {
+      if ((*env >= '0') && (*env <= '3'))
+        bx_trace_filter.cpl_mask |= 1 << (*env - '0');
+    }
+  }
+}
+
+void bx_instr_exit_env(void)
+{
+  if (bx_trace_ring == NULL) return;
+
+  if (drain_started) {
+    drain_running = 0;
+    BX_THREAD_JOIN(drain_thread);
+    drain_started = 0;
+  }
+  for (unsigned cpu = 0; cpu < BX_SMP_PROCESSORS; cpu++) {
+    bx_trace_ring[cpu].active = 0;
+    drain_ring(cpu);
+    if (trace_file[cpu] != NULL) {
+      fclose(trace_file[cpu]);
+      trace_file[cpu] = NULL;
+    }
+  }
+}
+
+void bx_instr_initialize(unsigned cpu)
+{
+  assert(cpu < BX_SMP_PROCESSORS);
+
+  if (bx_trace_ring == NULL) {
+    bx_trace_ring = new bx_trace_ring_t[BX_SMP_PROCESSORS];
+    memset(bx_trace_ring, 0, sizeof(bx_trace_ring_t) * BX_SMP_PROCESSORS);
+  }
+
+  const char *prefix = getenv("BXTRACE_FILE");
+  char fname[BX_PATHNAME_LEN];
+  if (prefix == NULL) prefix = "bxtrace";
+  snprintf(fname, sizeof(fname), "%s.%u", prefix, cpu);
+
+  trace_file[cpu] = fopen(fname, "wb");
+  if (trace_file[cpu] == NULL) {
+    BX_ERROR(("could not create trace file '%s'", fname));
+    return;
+  }
+  setvbuf(trace_file[cpu], NULL, _IOFBF, 1 << 20);
+
+  bx_trace_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, bx_trace_filter.mem_only ? BX_TRACE_MEM_MAGIC : BX_TRACE_MAGIC, sizeof(header.magic));
+  header.version = BX_TRACE_VERSION;
+  header.record_size = sizeof(bx_trace_rec_t);
+  header.cpu = cpu;
+  fwrite(&header, sizeof(header), 1, trace_file[cpu]);
+
+  if (! drain_started) {
+    drain_running = 1;
+    BX_THREAD_CREATE(trace_drain_thread, NULL, drain_thread);
+    drain_started = 1;
+  }
+
+  BX_INFO(("cpu %u traced to '%s'", cpu, fname));
+}
+
+void bx_instr_exit(unsigned cpu)
+{
+  if (bx_trace_ring != NULL)
+    bx_trace_ring[cpu].active = 0;
+}
+
+void bx_instr_reset(unsigned cpu, unsigned type)
+{
+  bx_trace_ring[cpu].active = (trace_file[cpu] != NULL);
+  bx_trace_event(cpu, BX_TRACE_RESET, 0, type, 0, 0, 0);
+}
+
+// "instrument stop" and "instrument start" pause and resume tracing
+void bx_instr_debug_cmd(const char *cmd)
+{
+  bx_bool active;
+
+  if (! strcmp(cmd, "start")) active = 1;
+  else if (! strcmp(cmd, "stop")) active = 0;
+  else {
+    fprintf(stderr, "tracebuf: unknown command '%s', use 'start' or 'stop'\n", cmd);
+    return;
+  }
+
+  for (unsigned cpu = 0; cpu < BX_SMP_PROCESSORS; cpu++)
+    bx_trace_ring[cpu].active = active && (trace_file[cpu] != NULL);
+}
@@ -0,0 +1,246 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+// Batched binary tracing: every event is stored inline as a fixed size
+// record into a per-cpu single producer / single consumer ring. A host
+// thread drains the rings into one file per cpu, see bxtrace_dump for the
+// decoder. The hot path has no function call and no lock.
+//
+// With BXTRACE_MODE=mem only data accesses are recorded and written in a
+// delta encoded format for cache simulation with bxmemtrace_sim. Memory
+// accesses can be filtered by CR3 (BXTRACE_CR3), linear address range
+// (BXTRACE_RANGE=lo-hi) and CPL (BXTRACE_CPL, e.g. "3" or "03").
+
+#if BX_INSTRUMENTATION
+
+#include "bxtrace.h"
+
+class bxInstruction_c;
+
+// define if you want to store instruction opcode bytes in bxInstruction_c
+//#define BX_INSTR_STORE_OPCODE_BYTES
+
+#define BX_TRACE_RING_SIZE (1 << 16) // records per cpu, power of 2
+
+#if defined(__GNUC__)
+#define BX_TRACE_LOAD_ACQUIRE(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define BX_TRACE_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+// volatile accesses are ordered on the hosts supported by MSVC
+#define BX_TRACE_LOAD_ACQUIRE(p)     (*(p))
+#define BX_TRACE_STORE_RELEASE(p, v) (*(p) = (v))
+#endif
+
+struct bx_trace_ring_t {
+  volatile Bit32u head;   // written by the cpu only
+  bx_bool active;
+  Bit8u pad1[56];
+  volatile Bit32u tail;   // written by the drain thread only
+  Bit8u pad2[60];
+  bx_trace_rec_t rec[BX_TRACE_RING_SIZE];
+};
+
+extern bx_trace_ring_t *bx_trace_ring;
+
+struct bx_trace_filter_t {
+  bx_bool mem_only;       // data accesses only, delta encoded output
+  bx_bool match_cr3;
+  bx_address cr3;
+  bx_address lo, hi;      // linear address range, inclusive
+  unsigned cpl_mask;      // bit n set: trace accesses made at CPL n
+};
+
+extern bx_trace_filter_t bx_trace_filter;
+
+void bx_instr_init_env(void);
+void bx_instr_exit_env(void);
+void bx_instr_initialize(unsigned cpu);
+void bx_instr_exit(unsigned cpu);
+void bx_instr_reset(unsigned cpu, unsigned type);
+void bx_instr_debug_cmd(const char *cmd);
+
+// called when the ring of a cpu is full, waits for the drain thread
+void bx_trace_wait(unsigned cpu);
+
+BX_CPP_INLINE void bx_trace_put(unsigned cpu, unsigned type, unsigned size, unsigned aux,
+                                Bit32u data, Bit64u addr1, Bit64u addr2)
+{
+  bx_trace_ring_t *ring = &bx_trace_ring[cpu];
+  if (! ring->active) return;
+
+  Bit32u head = ring->head;
+  if ((Bit32u)(head - BX_TRACE_LOAD_ACQUIRE(&ring->tail)) >= BX_TRACE_RING_SIZE)
+    bx_trace_wait(cpu);
+
+  bx_trace_rec_t *rec = &ring->rec[head & (BX_TRACE_RING_SIZE - 1)];
+  rec->type = type;
+  rec->size = size;
+  rec->aux = aux;
+  rec->data = data;
+  rec->addr1 = addr1;
+  rec->addr2 = addr2;
+  BX_TRACE_STORE_RELEASE(&ring->head, head + 1);
+}
+
+// all events except memory accesses
+BX_CPP_INLINE void bx_trace_event(unsigned cpu, unsigned type, unsigned size, unsigned aux,
+                                  Bit32u data, Bit64u addr1, Bit64u addr2)
+{
+  if (! bx_trace_filter.mem_only)
+    bx_trace_put(cpu, type, size, aux, data, addr1, addr2);
+}
+
+BX_CPP_INLINE void bx_trace_lin_access(unsigned cpu, bx_address lin, bx_phy_address phy,
+          unsigned len, unsigned memtype, unsigned rw, unsigned cpl, bx_address cr3)
+{
+  if ((lin < bx_trace_filter.lo) || (lin > bx_trace_filter.hi)) return;
+  if (! (bx_trace_filter.cpl_mask & (1 << cpl))) return;
+  if (bx_trace_filter.match_cr3 && ((cr3 ^ bx_trace_filter.cr3) & ~(bx_address) 0xfff)) return;
+  if (bx_trace_filter.mem_only && (rw == BX_EXECUTE)) return;
+  bx_trace_put(cpu, BX_TRACE_LIN_ACCESS, len, rw | (memtype << 4), 0, lin, phy);
+}
+
+/* initialization/deinitialization of instrumentalization*/
+#define BX_INSTR_INIT_ENV() bx_instr_init_env()
+#define BX_INSTR_EXIT_ENV() bx_instr_exit_env()
+
+/* simulation init, shutdown, reset */
+#define BX_INSTR_INITIALIZE(cpu_id)      bx_instr_initialize(cpu_id)
+#define BX_INSTR_EXIT(cpu_id)            bx_instr_exit(cpu_id)
+#define BX_INSTR_RESET(cpu_id, type)     bx_instr_reset(cpu_id, type)
+#define BX_INSTR_HLT(cpu_id)
+#define BX_INSTR_MWAIT(cpu_id, addr, len, flags)
+
+/* called from command line debugger */
+#define BX_INSTR_DEBUG_PROMPT()
+#define BX_INSTR_DEBUG_CMD(cmd)          bx_instr_debug_cmd(cmd)
+
+/* branch resolution */
+#define BX_INSTR_CNEAR_BRANCH_TAKEN(cpu_id, branch_eip, new_eip) \
+  bx_trace_event(cpu_id, BX_TRACE_BRANCH, 0, 1, 0, branch_eip, new_eip)
+#define BX_INSTR_CNEAR_BRANCH_NOT_TAKEN(cpu_id, branch_eip) \
+  bx_trace_event(cpu_id, BX_TRACE_BRANCH, 0, 0, 0, branch_eip, 0)
+#define BX_INSTR_UCNEAR_BRANCH(cpu_id, what, branch_eip, new_eip) \
+  bx_trace_event(cpu_id, BX_TRACE_BRANCH, 0, what, 0, branch_eip, new_eip)
+#define BX_INSTR_FAR_BRANCH(cpu_id, what, prev_cs, prev_eip, new_cs, new_eip) \
+  bx_trace_event(cpu_id, BX_TRACE_FAR_BRANCH, 0, what, new_cs, prev_eip, new_eip)
+
+/* decoding completed */
+#define BX_INSTR_OPCODE(cpu_id, i, opcode, len, is32, is64)
+
+/* exceptional case and interrupt */
+#define BX_INSTR_EXCEPTION(cpu_id, vector, error_code) \
+  bx_trace_event(cpu_id, BX_TRACE_EXCEPTION, 0, vector, error_code, 0, 0)
+#define BX_INSTR_INTERRUPT(cpu_id, vector) \
+  bx_trace_event(cpu_id, BX_TRACE_INTERRUPT, 0, vector, 0, 0, 0)
+#define BX_INSTR_HWINTERRUPT(cpu_id, vector, cs, eip) \
+  bx_trace_event(cpu_id, BX_TRACE_HWINTERRUPT, 0, vector, cs, eip, 0)
+
+/* TLB/CACHE control instruction executed */
+#define BX_INSTR_CLFLUSH(cpu_id, laddr, paddr)
+#define BX_INSTR_CACHE_CNTRL(cpu_id, what)
+#define BX_INSTR_TLB_CNTRL(cpu_id, what, new_cr3)
+#define BX_INSTR_PREFETCH_HINT(cpu_id, what, seg, offset)
+
+/* execution, only expanded inside BX_CPU_C where RIP is the current instruction */
+#define BX_INSTR_BEFORE_EXECUTION(cpu_id, i) \
+  bx_trace_event(cpu_id, BX_TRACE_INSN, (i)->ilen(), 0, 0, RIP, 0)
+#define BX_INSTR_AFTER_EXECUTION(cpu_id, i)
+#define BX_INSTR_REPEAT_ITERATION(cpu_id, i)
+
+/* linear memory access, only expanded inside BX_CPU_C */
+#define BX_INSTR_LIN_ACCESS(cpu_id, lin, phy, len, memtype, rw) \
+  bx_trace_lin_access(cpu_id, lin, phy, len, memtype, rw, CPL, BX_CPU_THIS_PTR cr3)
+
+/* physical memory access */
+#define BX_INSTR_PHY_ACCESS(cpu_id, phy, len, memtype, rw) \
+  bx_trace_event(cpu_id, BX_TRACE_PHY_ACCESS, len, (rw) | ((memtype) << 4), 0, 0, phy)
+
+/* feedback from device units */
+#define BX_INSTR_INP(addr, len)
+#define BX_INSTR_INP2(addr, len, val)
+#define BX_INSTR_OUTP(addr, len, val)
+
+/* wrmsr callback */
+#define BX_INSTR_WRMSR(cpu_id, addr, value)
+
+/* vmexit callback */
+#define BX_INSTR_VMEXIT(cpu_id, reason, qualification)
+
+#else // BX_INSTRUMENTATION
+
+/* initialization/deinitialization of instrumentalization */
+#define BX_INSTR_INIT_ENV()
+#define BX_INSTR_EXIT_ENV()
+
+/* simulation init, shutdown, reset */
+#define BX_INSTR_INITIALIZE(cpu_id)
+#define BX_INSTR_EXIT(cpu_id)
+#define BX_INSTR_RESET(cpu_id, type)
+#define BX_INSTR_HLT(cpu_id)
+#define BX_INSTR_MWAIT(cpu_id, addr, len, flags)
+
+/* called from command line debugger */
+#define BX_INSTR_DEBUG_PROMPT()
+#define BX_INSTR_DEBUG_CMD(cmd)
+
+/* branch resolution */
+#define BX_INSTR_CNEAR_BRANCH_TAKEN(cpu_id, branch_eip, new_eip)
+#define BX_INSTR_CNEAR_BRANCH_NOT_TAKEN(cpu_id, branch_eip)
+#define BX_INSTR_UCNEAR_BRANCH(cpu_id, what, branch_eip, new_eip)
+#define BX_INSTR_FAR_BRANCH(cpu_id, what, prev_cs, prev_eip, new_cs, new_eip)
+
+/* decoding completed */
+#define BX_INSTR_OPCODE(cpu_id, i, opcode, len, is32, is64)
+
+/* exceptional case and interrupt */
+#define BX_INSTR_EXCEPTION(cpu_id, vector, error_code)
+#define BX_INSTR_INTERRUPT(cpu_id, vector)
+#define BX_INSTR_HWINTERRUPT(cpu_id, vector, cs, eip)
+
+/* TLB/CACHE control instruction executed */
+#define BX_INSTR_CLFLUSH(cpu_id, laddr, paddr)
+#define BX_INSTR_CACHE_CNTRL(cpu_id, what)
+#define BX_INSTR_TLB_CNTRL(cpu_id, what, new_cr3)
+#define BX_INSTR_PREFETCH_HINT(cpu_id, what, seg, offset)
+
+/* execution */
+#define BX_INSTR_BEFORE_EXECUTION(cpu_id, i)
+#define BX_INSTR_AFTER_EXECUTION(cpu_id, i)
+#define BX_INSTR_REPEAT_ITERATION(cpu_id, i)
+
+/* linear memory access */
+#define BX_INSTR_LIN_ACCESS(cpu_id, lin, phy, len, memtype, rw)
+
+/* physical memory access */
+#define BX_INSTR_PHY_ACCESS(cpu_id, phy, len, memtype, rw)
+
+/* feedback from device units */
+#define BX_INSTR_INP(addr, len)
+#define BX_INSTR_INP2(addr, len, val)
+#define BX_INSTR_OUTP(addr, len, val)
+
+/* wrmsr callback */
+#define BX_INSTR_WRMSR(cpu_id, addr, value)
+
+/* vmexit callback */
+#define BX_INSTR_VMEXIT(cpu_id, reason, qualification)
+
+#endif // BX_INSTRUMENTATION
@@ -30,6 +30,7 @@
 #include "iodev/sound/soundmod.h"
 #include "iodev/network/netmod.h"
 #include "iodev/usb/usb_common.h"
+#include "replay.h"
 
 #define LOG_THIS bx_devices.
 
@@ -42,6 +43,15 @@
 
 bx_devices_c bx_devices;
 
+#if BX_DEBUGGER
+// makes the I/O statistics available as 'info device iostats'
+class bx_iostats_info_c : public bx_devmodel_c {
+public:
+  virtual void debug_dump(int argc, char **argv) { bx_devices.iostats_dump(NULL); }
+};
+static bx_iostats_info_c *iostats_info = NULL;
+#endif
+
 
 // constructor for bx_devices_c
 bx_devices_c::bx_devices_c()
@@ -50,6 +60,7 @@ bx_devices_c::bx_devices_c()
 
   read_port_to_handler = NULL;
   write_port_to_handler = NULL;
+  iostats = NULL;
   io_read_handlers.next = NULL;
   io_read_handlers.handler_name = NULL;
   io_write_handlers.next = NULL;
@@ -131,6 +142,16 @@ void bx_devices_c::init(BX_MEM_C *newmem)
     write_port_to_handler[i] = &io_write_handlers;
   }
 
+  if (SIM->get_param_bool("enabled", SIM->get_param(BXPN_IOSTATS))->get()) {
+    iostats = new iostats_port_t *[PORTS];
+    memset(iostats, 0, PORTS * sizeof(iostats_port_t *));
+#if BX_DEBUGGER
+    if (iostats_info == NULL)
+      iostats_info = new bx_iostats_info_c;
+    bx_dbg_register_debug_info("iostats", iostats_info);
+#endif
+  }
+
   for (i=0; i < BX_MAX_IRQS; i++) {
     delete [] irq_handler_name[i];
     irq_handler_name[i] = NULL;
@@ -313,6 +334,7 @@ void bx_devices_c::init(BX_MEM_C *newmem)
   bulkIOHostAddr = 0;
   bulkIOQuantumsRequested = 0;
   bulkIOQuantumsTransferred = 0;
+  bulk_io_handler_cnt = 0;
 
   bx_init_plugins();
 
@@ -376,6 +398,23 @@ void bx_devices_c::after_restore_state()
 
 void bx_devices_c::exit()
 {
+  bulk_io_handler_cnt = 0;
+  if (iostats != NULL) {
+    // the handler names are needed for the report
+    const char *path = SIM->get_param_string("file", SIM->get_param(BXPN_IOSTATS))->getptr();
+    FILE *fp = fopen(path, "w");
+    if (fp != NULL) {
+      iostats_dump(fp);
+      fclose(fp);
+      BX_INFO(("I/O statistics written to '%s'", path));
+    } else {
+      BX_ERROR(("could not write I/O statistics to '%s'", path));
+    }
+    for (unsigned port = 0; port < PORTS; port++)
+      delete iostats[port];
+    delete [] iostats;
+    iostats = NULL;
+  }
   // delete i/o handlers before unloading plugins
   struct io_handler_struct *io_read_handler = io_read_handlers.next;
   struct io_handler_struct *curr = NULL;
@@ -570,8 +609,13 @@ void bx_devices_c::timer_handler(void *this_ptr)
 void bx_devices_c::timer()
 {
   SIM->periodic();
-  if (!bx_pc_system.kill_bochs_request)
+  if (!bx_pc_system.kill_bochs_request) {
+    bx_gui->lock();
     bx_gui->handle_events();
+    bx_gui->unlock();
+  }
+  if (BX_REPLAY_REPLAYING)
+    bx_replay_inject_input();
 }
 
 bx_bool bx_devices_c::register_irq(unsigned irq, const char *name)
@@ -1003,13 +1047,22 @@ bx_devices_c::inp(Bit16u addr, unsigned io_len)
 {
   struct io_handler_struct *io_read_handler;
   Bit32u ret;
+  // the processor threads share the devices
+  BX_SMP_LOCK_SCOPE();
 
   BX_INSTR_INP(addr, io_len);
 
   io_read_handler = read_port_to_handler[addr];
   if (io_read_handler->mask & io_len) {
-    ret = ((bx_read_handler_t)io_read_handler->funct)(io_read_handler->this_ptr, (Bit32u)addr, io_len);
+    if (iostats == NULL) {
+      ret = ((bx_read_handler_t)io_read_handler->funct)(io_read_handler->this_ptr, (Bit32u)addr, io_len);
+    } else {
+      Bit64u start = bx_get_realtime64_nsec();
+      ret = ((bx_read_handler_t)io_read_handler->funct)(io_read_handler->this_ptr, (Bit32u)addr, io_len);
+      iostats_add(addr, BX_READ, bx_get_realtime64_nsec() - start, 1);
+    }
   } else {
+    if (iostats != NULL) iostats_add(addr, BX_READ, 0, 1);
     switch (io_len) {
       case 1: ret = 0xff; break;
       case 2: ret = 0xffff; break;
@@ -1035,18 +1088,180 @@ bx_devices_c::inp(Bit16u addr, unsigned io_len)
 bx_devices_c::outp(Bit16u addr, Bit32u value, unsigned io_len)
 {
   struct io_handler_struct *io_write_handler;
+  BX_SMP_LOCK_SCOPE();
 
   BX_INSTR_OUTP(addr, io_len, value);
   BX_DBG_IO_REPORT(addr, io_len, BX_WRITE, value);
 
   io_write_handler = write_port_to_handler[addr];
   if (io_write_handler->mask & io_len) {
-    ((bx_write_handler_t)io_write_handler->funct)(io_write_handler->this_ptr, (Bit32u)addr, value, io_len);
-  } else if (addr != 0x0cf8) { // don't flood the logfile when probing PCI
-    BX_ERROR(("write to port 0x%04x with len %d ignored", addr, io_len));
+    if (iostats == NULL) {
+      ((bx_write_handler_t)io_write_handler->funct)(io_write_handler->this_ptr, (Bit32u)addr, value, io_len);
+    } else {
+      Bit64u start = bx_get_realtime64_nsec();
+      ((bx_write_handler_t)io_write_handler->funct)(io_write_handler->this_ptr, (Bit32u)addr, value, io_len);
+      iostats_add(addr, BX_WRITE, bx_get_realtime64_nsec() - start, 1);
+    }
+  } else {
+    if (iostats != NULL) iostats_add(addr, BX_WRITE, 0, 1);
+    if (addr != 0x0cf8) { // don't flood the logfile when probing PCI
+      BX_ERROR(("write to port 0x%04x with len %d ignored", addr, io_len));
+    }
   }
 }
 
+void bx_devices_c::iostats_add(Bit16u addr, unsigned rw, Bit64u nsec, Bit32u count)
+{
+  iostats_port_t *stats = iostats[addr];
+  unsigned bucket = 0;
+
+  if (stats == NULL) {
+    stats = iostats[addr] = new iostats_port_t;
+    memset(stats, 0, sizeof(iostats_port_t));
+  }
+  stats->count[rw] += count;
+  stats->nsec[rw] += nsec;
+  // bulk transfers are accounted as one handler call
+  for (nsec >>= 7; (nsec > 0) && (bucket < BX_IOSTATS_HIST_BUCKETS - 1); nsec >>= 1)
+    bucket++;
+  stats->hist[bucket]++;
+}
+
+static int iostats_compare(const void *a, const void *b)
+{
+  Bit64u total1 = ((const Bit64u *) a)[1];
+  Bit64u total2 = ((const Bit64u *) b)[1];
+  return (total1 > total2) ? -1 : (total1 < total2);
+}
+
+static void iostats_print(FILE *fp, const char *line)
+{
+#if BX_DEBUGGER
+  if (fp == NULL) {
+    dbg_printf("%s", line);
+    return;
+  }
+#endif
+  fputs(line, (fp != NULL) ? fp : stdout);
+}
+
+/*
+ * Print the I/O statistics, busiest ports first. Without a file the
+ * report goes to the debugger console.
+ */
+
+void bx_devices_c::iostats_dump(FILE *fp)
+{
+  static const char *hist_label[BX_IOSTATS_HIST_BUCKETS] = {
+    "<128ns", "<256ns", "<512ns", "<1us", "<2us", "<4us", "<8us", "<16us",
+    "<32us", "<64us", "<128us", ">=128us"
+  };
+  char line[512], num[4][32];
+  unsigned port, num_ports = 0, i;
+
+  if (iostats == NULL) {
+    if (fp == NULL) iostats_print(NULL, "I/O statistics not enabled (iostats option)\n");
+    return;
+  }
+  // (port, accesses) pairs, sorted by accesses
+  Bit64u *order = new Bit64u[PORTS * 2];
+  for (port = 0; port < PORTS; port++) {
+    if (iostats[port] == NULL) continue;
+    order[num_ports * 2] = port;
+    order[num_ports * 2 + 1] = iostats[port]->count[BX_READ] + iostats[port]->count[BX_WRITE];
+    num_ports++;
+  }
+  qsort(order, num_ports, sizeof(Bit64u) * 2, iostats_compare);
+
+  sprintf(line, "port  handler               reads     writes  read ns  write ns  total us  handler times\n");
+  iostats_print(fp, line);
+  for (i = 0; i < num_ports; i++) {
+    port = (unsigned) order[i * 2];
+    iostats_port_t *stats = iostats[port];
+    const char *name = (stats->count[BX_READ] > 0) ? read_port_to_handler[port]->handler_name :
+                                                     write_port_to_handler[port]->handler_name;
+    sprintf(num[0], FMT_LL "u", stats->count[BX_READ]);
+    sprintf(num[1], FMT_LL "u", stats->count[BX_WRITE]);
+    sprintf(num[2], FMT_LL "u", stats->count[BX_READ] ? stats->nsec[BX_READ] / stats->count[BX_READ] : 0);
+    sprintf(num[3], FMT_LL "u", stats->count[BX_WRITE] ? stats->nsec[BX_WRITE] / stats->count[BX_WRITE] : 0);
+    int len = sprintf(line, "%04x  %-18.18s %9s  %9s  %7s  %8s  %8u ", port, name, num[0], num[1],
+                      num[2], num[3], (Bit32u)((stats->nsec[BX_READ] + stats->nsec[BX_WRITE]) / 1000));
+    for (unsigned b = 0; b < BX_IOSTATS_HIST_BUCKETS; b++) {
+      if (stats->hist[b] > 0)
+        len += sprintf(line + len, " %s:" FMT_LL "u", hist_label[b], stats->hist[b]);
+    }
+    strcpy(line + len, "\n");
+    iostats_print(fp, line);
+  }
+  delete [] order;
+}
+
+
+/*
+ * Register bulk handlers for a port. REP INS/OUTS on the port hands
+ * a run of quantums to the device instead of one inp/outp per quantum.
+ */
+
+bx_bool bx_devices_c::register_bulk_io_handlers(void *this_ptr, bx_bulk_read_handler_t f_read,
+                                                bx_bulk_write_handler_t f_write, Bit32u addr,
+                                                const char *name)
+{
+  if (bulk_io_handler_cnt == BX_MAX_BULK_IO_HANDLERS) {
+    BX_ERROR(("too many bulk IO handlers, port 0x%04x (%s) not registered", addr, name));
+    return 0;
+  }
+  bulk_io_handlers[bulk_io_handler_cnt].addr = (Bit16u) addr;
+  bulk_io_handlers[bulk_io_handler_cnt].this_ptr = this_ptr;
+  bulk_io_handlers[bulk_io_handler_cnt].read = f_read;
+  bulk_io_handlers[bulk_io_handler_cnt].write = f_write;
+  bulk_io_handler_cnt++;
+  return 1;
+}
+
+/*
+ * Read up to 'count' quantums from a port into host memory. Returns the
+ * number of quantums transferred, 0 when the port has no bulk handler or
+ * the device can't take the fast path right now.
+ */
+
+Bit32u bx_devices_c::inp_bulk(Bit16u addr, unsigned io_len, Bit8u *dst, Bit32u count)
+{
+  BX_SMP_LOCK_SCOPE();
+
+  for (unsigned i=0; i<bulk_io_handler_cnt; i++) {
+    if (bulk_io_handlers[i].addr == addr && bulk_io_handlers[i].read != NULL) {
+      if (iostats == NULL)
+        return bulk_io_handlers[i].read(bulk_io_handlers[i].this_ptr, addr, io_len, dst, count);
+      Bit64u start = bx_get_realtime64_nsec();
+      Bit32u done = bulk_io_handlers[i].read(bulk_io_handlers[i].this_ptr, addr, io_len, dst, count);
+      if (done > 0) iostats_add(addr, BX_READ, bx_get_realtime64_nsec() - start, done);
+      return done;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Write up to 'count' quantums from host memory to a port, see inp_bulk().
+ */
+
+Bit32u bx_devices_c::outp_bulk(Bit16u addr, unsigned io_len, const Bit8u *src, Bit32u count)
+{
+  BX_SMP_LOCK_SCOPE();
+
+  for (unsigned i=0; i<bulk_io_handler_cnt; i++) {
+    if (bulk_io_handlers[i].addr == addr && bulk_io_handlers[i].write != NULL) {
+      if (iostats == NULL)
+        return bulk_io_handlers[i].write(bulk_io_handlers[i].this_ptr, addr, io_len, src, count);
+      Bit64u start = bx_get_realtime64_nsec();
+      Bit32u done = bulk_io_handlers[i].write(bulk_io_handlers[i].this_ptr, addr, io_len, src, count);
+      if (done > 0) iostats_add(addr, BX_WRITE, bx_get_realtime64_nsec() - start, done);
+      return done;
+    }
+  }
+  return 0;
+}
+
 bx_bool bx_devices_c::is_harddrv_enabled(void)
 {
   char pname[24];
@@ -1141,6 +1356,11 @@ void bx_devices_c::gen_scancode(Bit32u key)
 {
   bx_bool ret = 0;
 
+  // a replay only takes the logged keys
+  if (BX_REPLAY_REPLAYING && !bx_replay_injecting)
+    return;
+  if (BX_REPLAY_RECORDING)
+    bx_replay_record(BX_REPLAY_KEY, 0, &key, 4);
   bx_keyboard.bxkey_state[key & 0xff] = ((key & BX_KEY_RELEASED) == 0);
   if (bx_keyboard.dev != NULL) {
     ret = bx_keyboard.gen_scancode(bx_keyboard.dev, key);
@@ -1150,6 +1370,17 @@ void bx_devices_c::gen_scancode(Bit32u key)
   }
 }
 
+void bx_devices_c::paste_bytes(Bit8u *data, Bit32s length)
+{
+  if (BX_REPLAY_REPLAYING && !bx_replay_injecting) {
+    delete [] data;
+    return;
+  }
+  if (BX_REPLAY_RECORDING)
+    bx_replay_record(BX_REPLAY_PASTE, 0, data, (Bit32u) length);
+  pluginKeyboard->paste_bytes(data, length);
+}
+
 void bx_devices_c::release_keys()
 {
   for (int i = 0; i < BX_KEY_NBKEYS; i++) {
@@ -1163,6 +1394,12 @@ void bx_devices_c::release_keys()
 // common mouse device handlers
 void bx_devices_c::mouse_enabled_changed(bx_bool enabled)
 {
+  if (BX_REPLAY_REPLAYING && !bx_replay_injecting)
+    return;
+  if (BX_REPLAY_RECORDING) {
+    Bit8u en = (enabled != 0);
+    bx_replay_record(BX_REPLAY_MOUSE_EN, 0, &en, 1);
+  }
   mouse_captured = enabled;
 
   if ((bx_mouse[1].dev != NULL) && (bx_mouse[1].enabled_changed != NULL)) {
@@ -1182,6 +1419,16 @@ void bx_devices_c::mouse_motion(int delta_x, int delta_y, int delta_z, unsigned
   if (!mouse_captured)
     return;
 
+  if (BX_REPLAY_REPLAYING && !bx_replay_injecting)
+    return;
+  if (BX_REPLAY_RECORDING) {
+    Bit32s vals[4] = { delta_x, delta_y, delta_z, (Bit32s) button_state };
+    Bit8u abs = (absxy != 0);
+    bx_replay_put(BX_REPLAY_MOUSE, 0, 17);
+    bx_replay_put_data(vals, 16);
+    bx_replay_put_data(&abs, 1);
+  }
+
   // if a removable mouse is connected, redirect mouse data to the device
   if (bx_mouse[1].dev != NULL) {
     bx_mouse[1].enq_event(bx_mouse[1].dev, delta_x, delta_y, delta_z, button_state, absxy);
@@ -2390,7 +2390,7 @@ void bx_voodoo_vga_c::banshee_update_mode(void)
   v->banshee.half_mode = (v->banshee.io[io_vidProcCfg] >> 4) & 1;
   BX_INFO(("switched to %d x %d x %d @ %d Hz", v->fbi.width, v->fbi.height,
            v->banshee.disp_bpp, (unsigned)v->vertfreq));
-  bx_gui->dimension_update(v->fbi.width, v->fbi.height, 0, 0, v->banshee.disp_bpp);
+  BX_VVGA_THIS gui_dimension_update(v->fbi.width, v->fbi.height, 0, 0, v->banshee.disp_bpp);
   // compatibilty settings for VGA core
   BX_VVGA_THIS s.last_xres = v->fbi.width;
   BX_VVGA_THIS s.last_yres = v->fbi.height;
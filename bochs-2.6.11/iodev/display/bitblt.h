@@ -67,39 +67,197 @@ typedef void (*bx_bitblt_rop_t)(
   }
 
 #ifdef BX_USE_BINARY_ROP
-IMPLEMENT_FORWARD_BITBLT(0, *dst = 0)
-IMPLEMENT_FORWARD_BITBLT(src_and_dst, *dst = (*src) & (*dst))
+
+// The binary ROPs are done 16 or 32 bytes at a time with SSE2 / AVX2 on
+// x86 hosts. AVX2 is only used if the cpu supports it, SSE2 is part of the
+// x86-64 baseline. Vectors are not used when source and destination overlap
+// closer than one vector in the direction of the copy, these rows are done
+// byte by byte like on the real hardware.
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define BX_BITBLT_SSE2 1
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BX_BITBLT_AVX2 1
+#define BX_BITBLT_AVX2_FUNC
+#define bitblt_host_avx2() (1)
+#elif defined(__GNUC__) && (defined(__clang__) || (__GNUC__ >= 5))
+#include <immintrin.h>
+#define BX_BITBLT_AVX2 2
+#define BX_BITBLT_AVX2_FUNC __attribute__((target("avx2")))
+static bx_bool bitblt_host_avx2(void)
+{
+  static int avx2 = -1;
+  if (avx2 < 0) {
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+  }
+  return avx2;
+}
+#endif
+#endif
+
+#define BX_BITBLT_VECTOR_BYTES 32
+
+static BX_CPP_INLINE Bit8u bitblt_and(Bit8u a, Bit8u b) { return a & b; }
+static BX_CPP_INLINE Bit8u bitblt_or(Bit8u a, Bit8u b) { return a | b; }
+static BX_CPP_INLINE Bit8u bitblt_xor(Bit8u a, Bit8u b) { return a ^ b; }
+static BX_CPP_INLINE Bit8u bitblt_not(Bit8u a) { return ~a; }
+static BX_CPP_INLINE Bit8u bitblt_zero(Bit8u) { return 0; }
+static BX_CPP_INLINE Bit8u bitblt_ones(Bit8u) { return 0xff; }
+
+#ifdef BX_BITBLT_SSE2
+static BX_CPP_INLINE __m128i bitblt_and(__m128i a, __m128i b) { return _mm_and_si128(a, b); }
+static BX_CPP_INLINE __m128i bitblt_or(__m128i a, __m128i b) { return _mm_or_si128(a, b); }
+static BX_CPP_INLINE __m128i bitblt_xor(__m128i a, __m128i b) { return _mm_xor_si128(a, b); }
+static BX_CPP_INLINE __m128i bitblt_not(__m128i a) { return _mm_xor_si128(a, _mm_set1_epi32(-1)); }
+static BX_CPP_INLINE __m128i bitblt_zero(__m128i) { return _mm_setzero_si128(); }
+static BX_CPP_INLINE __m128i bitblt_ones(__m128i) { return _mm_set1_epi32(-1); }
+#endif
+
+#ifdef BX_BITBLT_AVX2
+BX_BITBLT_AVX2_FUNC static BX_CPP_INLINE __m256i bitblt_and(__m256i a, __m256i b) { return _mm256_and_si256(a, b); }
+BX_BITBLT_AVX2_FUNC static BX_CPP_INLINE __m256i bitblt_or(__m256i a, __m256i b) { return _mm256_or_si256(a, b); }
+BX_BITBLT_AVX2_FUNC static BX_CPP_INLINE __m256i bitblt_xor(__m256i a, __m256i b) { return _mm256_xor_si256(a, b); }
+BX_BITBLT_AVX2_FUNC static BX_CPP_INLINE __m256i bitblt_not(__m256i a) { return _mm256_xor_si256(a, _mm256_set1_epi32(-1)); }
+BX_BITBLT_AVX2_FUNC static BX_CPP_INLINE __m256i bitblt_zero(__m256i) { return _mm256_setzero_si256(); }
+BX_BITBLT_AVX2_FUNC static BX_CPP_INLINE __m256i bitblt_ones(__m256i) { return _mm256_set1_epi32(-1); }
+
+// process the leading multiple of 32 bytes of a row, returns the byte count
+#define IMPLEMENT_BITBLT_AVX2_ROW(name,op) \
+  BX_BITBLT_AVX2_FUNC static int bitblt_avx2_fwd_##name(Bit8u *dst, const Bit8u *src, int count) \
+  { \
+    int x; \
+    for (x = 0; (x + 32) <= count; x += 32) { \
+      __m256i s = _mm256_loadu_si256((const __m256i*)(src + x)); \
+      __m256i d = _mm256_loadu_si256((const __m256i*)(dst + x)); \
+      (void) s; (void) d; \
+      _mm256_storeu_si256((__m256i*)(dst + x), op); \
+    } \
+    return x; \
+  } \
+  BX_BITBLT_AVX2_FUNC static int bitblt_avx2_bkwd_##name(Bit8u *dst, const Bit8u *src, int count) \
+  { \
+    int x; \
+    for (x = 0; (x + 32) <= count; x += 32) { \
+      __m256i s = _mm256_loadu_si256((const __m256i*)(src - x - 31)); \
+      __m256i d = _mm256_loadu_si256((const __m256i*)(dst - x - 31)); \
+      (void) s; (void) d; \
+      _mm256_storeu_si256((__m256i*)(dst - x - 31), op); \
+    } \
+    return x; \
+  }
+#define BITBLT_AVX2_FWD(name) \
+  if (bitblt_host_avx2()) x = bitblt_avx2_fwd_##name(dst, src, bltwidth);
+#define BITBLT_AVX2_BKWD(name) \
+  if (bitblt_host_avx2()) x = bitblt_avx2_bkwd_##name(dst, src, bltwidth);
+#else
+#define IMPLEMENT_BITBLT_AVX2_ROW(name,op)
+#define BITBLT_AVX2_FWD(name)
+#define BITBLT_AVX2_BKWD(name)
+#endif
+
+#ifdef BX_BITBLT_SSE2
+#define BITBLT_SSE2_FWD(op) \
+  for (; (x + 16) <= bltwidth; x += 16) { \
+    __m128i s = _mm_loadu_si128((const __m128i*)(src + x)); \
+    __m128i d = _mm_loadu_si128((const __m128i*)(dst + x)); \
+    (void) s; (void) d; \
+    _mm_storeu_si128((__m128i*)(dst + x), op); \
+  }
+#define BITBLT_SSE2_BKWD(op) \
+  for (; (x + 16) <= bltwidth; x += 16) { \
+    __m128i s = _mm_loadu_si128((const __m128i*)(src - x - 15)); \
+    __m128i d = _mm_loadu_si128((const __m128i*)(dst - x - 15)); \
+    (void) s; (void) d; \
+    _mm_storeu_si128((__m128i*)(dst - x - 15), op); \
+  }
+#else
+#define BITBLT_SSE2_FWD(op)
+#define BITBLT_SSE2_BKWD(op)
+#endif
+
+// op is an expression of the source s and destination d, written with the
+// bitblt_* helpers so that it works for bytes and vectors
+#define IMPLEMENT_BINARY_ROP(name,op) \
+  IMPLEMENT_BITBLT_AVX2_ROW(name,op) \
+  static void bitblt_rop_fwd_##name( \
+    Bit8u *dst,const Bit8u *src, \
+    int dstpitch,int srcpitch, \
+    int bltwidth,int bltheight) \
+  { \
+    int x,y; \
+    for (y = 0; y < bltheight; y++) { \
+      x = 0; \
+      if (((dst - src) <= 0) || ((dst - src) >= BX_BITBLT_VECTOR_BYTES)) { \
+        BITBLT_AVX2_FWD(name) \
+        BITBLT_SSE2_FWD(op) \
+      } \
+      for (; x < bltwidth; x++) { \
+        Bit8u s = src[x], d = dst[x]; \
+        (void) s; (void) d; \
+        dst[x] = op; \
+      } \
+      dst += dstpitch; \
+      src += srcpitch; \
+    } \
+  } \
+  static void bitblt_rop_bkwd_##name( \
+    Bit8u *dst,const Bit8u *src, \
+    int dstpitch,int srcpitch, \
+    int bltwidth,int bltheight) \
+  { \
+    int x,y; \
+    for (y = 0; y < bltheight; y++) { \
+      x = 0; \
+      if (((src - dst) <= 0) || ((src - dst) >= BX_BITBLT_VECTOR_BYTES)) { \
+        BITBLT_AVX2_BKWD(name) \
+        BITBLT_SSE2_BKWD(op) \
+      } \
+      for (; x < bltwidth; x++) { \
+        Bit8u s = src[-x], d = dst[-x]; \
+        (void) s; (void) d; \
+        dst[-x] = op; \
+      } \
+      dst += dstpitch; \
+      src += srcpitch; \
+    } \
+  }
+
+IMPLEMENT_BINARY_ROP(0, bitblt_zero(d))
+IMPLEMENT_BINARY_ROP(src_and_dst, bitblt_and(s, d))
 IMPLEMENT_FORWARD_BITBLT(nop, (void)0)
-IMPLEMENT_FORWARD_BITBLT(src_and_notdst, *dst = (*src) & (~(*dst)))
-IMPLEMENT_FORWARD_BITBLT(notdst, *dst = ~(*dst))
-IMPLEMENT_FORWARD_BITBLT(src, *dst = *src)
-IMPLEMENT_FORWARD_BITBLT(1, *dst = 0xff)
-IMPLEMENT_FORWARD_BITBLT(notsrc_and_dst, *dst = (~(*src)) & (*dst))
-IMPLEMENT_FORWARD_BITBLT(src_xor_dst, *dst = (*src) ^ (*dst))
-IMPLEMENT_FORWARD_BITBLT(src_or_dst, *dst = (*src) | (*dst))
-IMPLEMENT_FORWARD_BITBLT(notsrc_or_notdst, *dst = (~(*src)) | (~(*dst)))
-IMPLEMENT_FORWARD_BITBLT(src_notxor_dst, *dst = ~((*src) ^ (*dst)))
-IMPLEMENT_FORWARD_BITBLT(src_or_notdst, *dst = (*src) | (~(*dst)))
-IMPLEMENT_FORWARD_BITBLT(notsrc, *dst = (~(*src)))
-IMPLEMENT_FORWARD_BITBLT(notsrc_or_dst, *dst = (~(*src)) | (*dst))
-IMPLEMENT_FORWARD_BITBLT(notsrc_and_notdst, *dst = (~(*src)) & (~(*dst)))
-
-IMPLEMENT_BACKWARD_BITBLT(0, *dst = 0)
-IMPLEMENT_BACKWARD_BITBLT(src_and_dst, *dst = (*src) & (*dst))
 IMPLEMENT_BACKWARD_BITBLT(nop, (void)0)
-IMPLEMENT_BACKWARD_BITBLT(src_and_notdst, *dst = (*src) & (~(*dst)))
-IMPLEMENT_BACKWARD_BITBLT(notdst, *dst = ~(*dst))
-IMPLEMENT_BACKWARD_BITBLT(src, *dst = *src)
-IMPLEMENT_BACKWARD_BITBLT(1, *dst = 0xff)
-IMPLEMENT_BACKWARD_BITBLT(notsrc_and_dst, *dst = (~(*src)) & (*dst))
-IMPLEMENT_BACKWARD_BITBLT(src_xor_dst, *dst = (*src) ^ (*dst))
-IMPLEMENT_BACKWARD_BITBLT(src_or_dst, *dst = (*src) | (*dst))
-IMPLEMENT_BACKWARD_BITBLT(notsrc_or_notdst, *dst = (~(*src)) | (~(*dst)))
-IMPLEMENT_BACKWARD_BITBLT(src_notxor_dst, *dst = ~((*src) ^ (*dst)))
-IMPLEMENT_BACKWARD_BITBLT(src_or_notdst, *dst = (*src) | (~(*dst)))
-IMPLEMENT_BACKWARD_BITBLT(notsrc, *dst = (~(*src)))
-IMPLEMENT_BACKWARD_BITBLT(notsrc_or_dst, *dst = (~(*src)) | (*dst))
-IMPLEMENT_BACKWARD_BITBLT(notsrc_and_notdst, *dst = (~(*src)) & (~(*dst)))
+IMPLEMENT_BINARY_ROP(src_and_notdst, bitblt_and(s, bitblt_not(d)))
+IMPLEMENT_BINARY_ROP(notdst, bitblt_not(d))
+IMPLEMENT_BINARY_ROP(src, s)
+IMPLEMENT_BINARY_ROP(1, bitblt_ones(d))
+IMPLEMENT_BINARY_ROP(notsrc_and_dst, bitblt_and(bitblt_not(s), d))
+IMPLEMENT_BINARY_ROP(src_xor_dst, bitblt_xor(s, d))
+IMPLEMENT_BINARY_ROP(src_or_dst, bitblt_or(s, d))
+IMPLEMENT_BINARY_ROP(notsrc_or_notdst, bitblt_not(bitblt_and(s, d)))
+IMPLEMENT_BINARY_ROP(src_notxor_dst, bitblt_not(bitblt_xor(s, d)))
+IMPLEMENT_BINARY_ROP(src_or_notdst, bitblt_or(s, bitblt_not(d)))
+IMPLEMENT_BINARY_ROP(notsrc, bitblt_not(s))
+IMPLEMENT_BINARY_ROP(notsrc_or_dst, bitblt_or(bitblt_not(s), d))
+IMPLEMENT_BINARY_ROP(notsrc_and_notdst, bitblt_not(bitblt_or(s, d)))
+
+// dst = (src & mask) | (dst & ~mask), mask holds 0x00 or 0xff per byte
+static BX_CPP_INLINE void bitblt_masked_copy(Bit8u *dst, const Bit8u *src, const Bit8u *mask, int count)
+{
+  int x = 0;
+#ifdef BX_BITBLT_SSE2
+  for (; (x + 16) <= count; x += 16) {
+    __m128i s = _mm_loadu_si128((const __m128i*)(src + x));
+    __m128i d = _mm_loadu_si128((const __m128i*)(dst + x));
+    __m128i m = _mm_loadu_si128((const __m128i*)(mask + x));
+    _mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(_mm_and_si128(m, s), _mm_andnot_si128(m, d)));
+  }
+#endif
+  for (; x < count; x++) {
+    dst[x] = (src[x] & mask[x]) | (dst[x] & ~mask[x]);
+  }
+}
 #endif
 
 #ifdef BX_USE_TERNARY_ROP
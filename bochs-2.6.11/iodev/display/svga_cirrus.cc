@@ -308,7 +308,7 @@ void bx_svga_cirrus_c::svga_init_members()
 
   // memory allocation.
   if (BX_CIRRUS_THIS s.memory == NULL)
-    BX_CIRRUS_THIS s.memory = new Bit8u[CIRRUS_VIDEO_MEMORY_BYTES];
+    BX_CIRRUS_THIS s.memory = (Bit8u *) bx_alloc_zeroed(CIRRUS_VIDEO_MEMORY_BYTES);
 
   // set some registers.
 
@@ -1163,7 +1163,7 @@ void bx_svga_cirrus_c::update(void)
   if (BX_CIRRUS_THIS svga_needs_update_mode) {
     width  = BX_CIRRUS_THIS svga_xres;
     height = BX_CIRRUS_THIS svga_yres;
-    bx_gui->dimension_update(width, height, 0, 0, BX_CIRRUS_THIS svga_dispbpp);
+    BX_CIRRUS_THIS gui_dimension_update(width, height, 0, 0, BX_CIRRUS_THIS svga_dispbpp);
     BX_CIRRUS_THIS s.last_bpp = BX_CIRRUS_THIS svga_dispbpp;
     BX_CIRRUS_THIS svga_needs_update_mode = 0;
     BX_CIRRUS_THIS svga_needs_update_dispentire = 1;
@@ -2776,63 +2776,45 @@ void bx_svga_cirrus_c::svga_colorexpand_transp_memsrc_static(void *this_ptr)
 
 void bx_svga_cirrus_c::svga_patterncopy()
 {
-  Bit8u color[4];
   Bit8u work_colorexp[256];
-  Bit8u *src, *dst;
-  Bit8u *dstc, *srcc, *src2;
-  int x, y, pattern_x, pattern_y, srcskipleft;
-  int patternbytes = 8 * BX_CIRRUS_THIS bitblt.pixelwidth;
+  Bit8u work_row[CIRRUS_BLT_ROWSIZE];
+  Bit8u *src, *dst, *srcc;
+  int x, y, n, pixels, count, pattern_x, pattern_y, srcskipleft;
+  int pixelwidth = BX_CIRRUS_THIS bitblt.pixelwidth;
+  int patternbytes = 8 * pixelwidth;
   int pattern_pitch = patternbytes;
-  int bltbytes = BX_CIRRUS_THIS bitblt.bltwidth;
-  unsigned bits, bits_xor, bitmask;
+  bx_bitblt_rop_t rop_handler = svga_get_fwd_rop_handler(BX_CIRRUS_THIS bitblt.bltrop);
 
-  if (BX_CIRRUS_THIS bitblt.pixelwidth == 3) {
+  if (pixelwidth == 3) {
     pattern_x = BX_CIRRUS_THIS control.reg[0x2f] & 0x1f;
     srcskipleft = pattern_x / 3;
   } else {
     srcskipleft = BX_CIRRUS_THIS control.reg[0x2f] & 0x07;
-    pattern_x = srcskipleft * BX_CIRRUS_THIS bitblt.pixelwidth;
+    pattern_x = srcskipleft * pixelwidth;
   }
+  // pixels from pattern_x to the end of the row, the last one may be partial
+  pixels = (BX_CIRRUS_THIS bitblt.bltwidth - pattern_x + pixelwidth - 1) / pixelwidth;
+  if (pixels <= 0) return;
+  count = pixels * pixelwidth;
+
   if (BX_CIRRUS_THIS bitblt.bltmode & CIRRUS_BLTMODE_COLOREXPAND) {
     if (BX_CIRRUS_THIS bitblt.bltmode & CIRRUS_BLTMODE_TRANSPARENTCOMP) {
-      color[0] = BX_CIRRUS_THIS control.shadow_reg1;
-      color[1] = BX_CIRRUS_THIS control.reg[0x11];
-      color[2] = BX_CIRRUS_THIS control.reg[0x13];
-      color[3] = BX_CIRRUS_THIS control.reg[0x15];
-      if (BX_CIRRUS_THIS bitblt.bltmodeext & CIRRUS_BLTMODEEXT_COLOREXPINV) {
-        bits_xor = 0xff;
-      } else {
-        bits_xor = 0x00;
-      }
-
+      svga_color_row(work_row, count);
       pattern_y = BX_CIRRUS_THIS bitblt.srcaddr & 0x07;
       for (y = 0; y < BX_CIRRUS_THIS bitblt.bltheight; y++) {
-        dst = BX_CIRRUS_THIS bitblt.dst + pattern_x;
-        bitmask = 0x80 >> srcskipleft;
-        bits = BX_CIRRUS_THIS bitblt.src[pattern_y] ^ bits_xor;
-        for (x = pattern_x; x < BX_CIRRUS_THIS bitblt.bltwidth; x+=BX_CIRRUS_THIS bitblt.pixelwidth) {
-          if ((bitmask & 0xff) == 0) {
-            bitmask = 0x80;
-            bits = BX_CIRRUS_THIS bitblt.src[pattern_y] ^ bits_xor;
-          }
-          if (bits & bitmask) {
-            (*BX_CIRRUS_THIS bitblt.rop_handler)(
-              dst, &color[0], 0, 0, BX_CIRRUS_THIS bitblt.pixelwidth, 1);
-          }
-          dst += BX_CIRRUS_THIS bitblt.pixelwidth;
-          bitmask >>= 1;
-        }
+        svga_colorexpand_transp_row(BX_CIRRUS_THIS bitblt.dst + pattern_x, work_row,
+          &BX_CIRRUS_THIS bitblt.src[pattern_y], 0, srcskipleft, pixels);
         pattern_y = (pattern_y + 1) & 7;
         BX_CIRRUS_THIS bitblt.dst += BX_CIRRUS_THIS bitblt.dstpitch;
       }
       return;
     } else {
-      svga_colorexpand(work_colorexp,BX_CIRRUS_THIS bitblt.src,8*8,BX_CIRRUS_THIS bitblt.pixelwidth);
+      svga_colorexpand(work_colorexp,BX_CIRRUS_THIS bitblt.src,8*8,pixelwidth);
       BX_CIRRUS_THIS bitblt.src = work_colorexp;
       BX_CIRRUS_THIS bitblt.bltmode &= ~CIRRUS_BLTMODE_COLOREXPAND;
     }
   } else {
-    if (BX_CIRRUS_THIS bitblt.pixelwidth == 3) {
+    if (pixelwidth == 3) {
       pattern_pitch = 32;
     }
   }
@@ -2845,15 +2827,18 @@ void bx_svga_cirrus_c::svga_patterncopy()
   dst = BX_CIRRUS_THIS bitblt.dst;
   pattern_y = BX_CIRRUS_THIS bitblt.srcaddr & 0x07;
   src = (Bit8u *)BX_CIRRUS_THIS bitblt.src;
+  // the pattern repeats every 8 pixels: build the first 8 pixels of the row,
+  // replicate them and do the ROP for the whole row at once
+  n = BX_MIN(pixels, 8) * pixelwidth;
   for (y = 0; y < BX_CIRRUS_THIS bitblt.bltheight; y++) {
     srcc = src + pattern_y * pattern_pitch;
-    dstc = dst + pattern_x;
-    for (x = pattern_x; x < bltbytes; x += BX_CIRRUS_THIS bitblt.pixelwidth) {
-      src2 = srcc + (x % patternbytes);
-      (*BX_CIRRUS_THIS bitblt.rop_handler)(
-        dstc, src2, 0, 0, BX_CIRRUS_THIS bitblt.pixelwidth, 1);
-      dstc += BX_CIRRUS_THIS bitblt.pixelwidth;
+    for (x = 0; x < n; x += pixelwidth) {
+      memcpy(work_row + x, srcc + ((pattern_x + x) % patternbytes), pixelwidth);
     }
+    for (x = n; x < count; x += n) {
+      memcpy(work_row + x, work_row, BX_MIN(n, count - x));
+    }
+    (*rop_handler)(dst + pattern_x, work_row, 0, 0, count, 1);
     pattern_y = (pattern_y + 1) & 7;
     dst += BX_CIRRUS_THIS bitblt.dstpitch;
   }
@@ -2861,12 +2846,11 @@ void bx_svga_cirrus_c::svga_patterncopy()
 
 void bx_svga_cirrus_c::svga_simplebitblt()
 {
-  Bit8u color[4];
   Bit8u work_colorexp[2048];
+  Bit8u work_row[CIRRUS_BLT_ROWSIZE];
   Bit16u w, x, y, pxcolor, trcolor;
   Bit8u *src, *dst;
-  unsigned bits, bits_xor, bitmask;
-  int pattern_x, srcskipleft;
+  int pattern_x, srcskipleft, pixels;
 
   if (BX_CIRRUS_THIS bitblt.pixelwidth == 3) {
     pattern_x = BX_CIRRUS_THIS control.reg[0x2f] & 0x1f;
@@ -2877,32 +2861,14 @@ void bx_svga_cirrus_c::svga_simplebitblt()
   }
   if (BX_CIRRUS_THIS bitblt.bltmode & CIRRUS_BLTMODE_COLOREXPAND) {
     if (BX_CIRRUS_THIS bitblt.bltmode & CIRRUS_BLTMODE_TRANSPARENTCOMP) {
-      color[0] = BX_CIRRUS_THIS control.shadow_reg1;
-      color[1] = BX_CIRRUS_THIS control.reg[0x11];
-      color[2] = BX_CIRRUS_THIS control.reg[0x13];
-      color[3] = BX_CIRRUS_THIS control.reg[0x15];
-      if (BX_CIRRUS_THIS bitblt.bltmodeext & CIRRUS_BLTMODEEXT_COLOREXPINV) {
-        bits_xor = 0xff;
-      } else {
-        bits_xor = 0x00;
-      }
-
+      pixels = (BX_CIRRUS_THIS bitblt.bltwidth - pattern_x + BX_CIRRUS_THIS bitblt.pixelwidth - 1) /
+               BX_CIRRUS_THIS bitblt.pixelwidth;
+      if (pixels <= 0) return;
+      svga_color_row(work_row, pixels * BX_CIRRUS_THIS bitblt.pixelwidth);
       for (y = 0; y < BX_CIRRUS_THIS bitblt.bltheight; y++) {
-        dst = BX_CIRRUS_THIS bitblt.dst + pattern_x;
-        bitmask = 0x80 >> srcskipleft;
-        bits = *BX_CIRRUS_THIS bitblt.src++ ^ bits_xor;
-        for (x = pattern_x; x < BX_CIRRUS_THIS bitblt.bltwidth; x+=BX_CIRRUS_THIS bitblt.pixelwidth) {
-          if ((bitmask & 0xff) == 0) {
-            bitmask = 0x80;
-            bits = *BX_CIRRUS_THIS bitblt.src++ ^ bits_xor;
-          }
-          if (bits & bitmask) {
-            (*BX_CIRRUS_THIS bitblt.rop_handler)(
-              dst, &color[0], 0, 0, BX_CIRRUS_THIS bitblt.pixelwidth, 1);
-          }
-          dst += BX_CIRRUS_THIS bitblt.pixelwidth;
-          bitmask >>= 1;
-        }
+        BX_CIRRUS_THIS bitblt.src += svga_colorexpand_transp_row(
+          BX_CIRRUS_THIS bitblt.dst + pattern_x, work_row,
+          BX_CIRRUS_THIS bitblt.src, 1, srcskipleft, pixels);
         BX_CIRRUS_THIS bitblt.dst += BX_CIRRUS_THIS bitblt.dstpitch;
       }
       return;
@@ -2972,26 +2938,18 @@ void bx_svga_cirrus_c::svga_simplebitblt()
 
 void bx_svga_cirrus_c::svga_solidfill()
 {
-  Bit8u color[4];
-  int x, y;
-  Bit8u *dst;
+  Bit8u work_color[CIRRUS_BLT_ROWSIZE];
+  int pixelwidth = BX_CIRRUS_THIS bitblt.pixelwidth;
+  int count = (BX_CIRRUS_THIS bitblt.bltwidth + pixelwidth - 1) / pixelwidth * pixelwidth;
 
   BX_DEBUG(("BLT: SOLIDFILL"));
 
-  color[0] = BX_CIRRUS_THIS control.shadow_reg1;
-  color[1] = BX_CIRRUS_THIS control.reg[0x11];
-  color[2] = BX_CIRRUS_THIS control.reg[0x13];
-  color[3] = BX_CIRRUS_THIS control.reg[0x15];
-
-  for (y = 0; y < BX_CIRRUS_THIS bitblt.bltheight; y++) {
-    dst = BX_CIRRUS_THIS bitblt.dst;
-    for (x = 0; x < BX_CIRRUS_THIS bitblt.bltwidth; x+=BX_CIRRUS_THIS bitblt.pixelwidth) {
-      (*BX_CIRRUS_THIS bitblt.rop_handler)(
-        dst, &color[0], 0, 0, BX_CIRRUS_THIS bitblt.pixelwidth, 1);
-        dst += BX_CIRRUS_THIS bitblt.pixelwidth;
-    }
-    BX_CIRRUS_THIS bitblt.dst += BX_CIRRUS_THIS bitblt.dstpitch;
-  }
+  // one ROP call for the whole rectangle with a source pitch of 0
+  svga_color_row(work_color, count);
+  (*BX_CIRRUS_THIS bitblt.rop_handler)(
+    BX_CIRRUS_THIS bitblt.dst, work_color, BX_CIRRUS_THIS bitblt.dstpitch, 0,
+    count, BX_CIRRUS_THIS bitblt.bltheight);
+  BX_CIRRUS_THIS bitblt.dst += BX_CIRRUS_THIS bitblt.dstpitch * BX_CIRRUS_THIS bitblt.bltheight;
   BX_CIRRUS_THIS redraw_area(BX_CIRRUS_THIS redraw.x, BX_CIRRUS_THIS redraw.y,
                              BX_CIRRUS_THIS redraw.w, BX_CIRRUS_THIS redraw.h);
 }
@@ -3045,11 +3003,8 @@ void bx_svga_cirrus_c::svga_simplebitblt_memsrc()
 
 void bx_svga_cirrus_c::svga_colorexpand_transp_memsrc()
 {
-  Bit8u *src = &BX_CIRRUS_THIS bitblt.memsrc[0];
-  Bit8u color[4];
-  int x, pattern_x, srcskipleft;
-  Bit8u *dst;
-  unsigned bits, bits_xor, bitmask;
+  Bit8u work_row[CIRRUS_BLT_ROWSIZE];
+  int pattern_x, srcskipleft, pixels;
 
   BX_DEBUG(("BLT, cpu-to-video, transparent"));
 
@@ -3060,31 +3015,74 @@ void bx_svga_cirrus_c::svga_colorexpand_transp_memsrc()
     srcskipleft = BX_CIRRUS_THIS control.reg[0x2f] & 0x07;
     pattern_x = srcskipleft * BX_CIRRUS_THIS bitblt.pixelwidth;
   }
+  pixels = (BX_CIRRUS_THIS bitblt.bltwidth - pattern_x + BX_CIRRUS_THIS bitblt.pixelwidth - 1) /
+           BX_CIRRUS_THIS bitblt.pixelwidth;
+  if (pixels <= 0) return;
+  svga_color_row(work_row, pixels * BX_CIRRUS_THIS bitblt.pixelwidth);
+  svga_colorexpand_transp_row(BX_CIRRUS_THIS bitblt.dst + pattern_x, work_row,
+    &BX_CIRRUS_THIS bitblt.memsrc[0], 1, srcskipleft, pixels);
+}
+
+// fill a row with the foreground color of the current pixel width
+void bx_svga_cirrus_c::svga_color_row(Bit8u *dst, int count)
+{
+  Bit8u color[4];
+  int x, pixelwidth = BX_CIRRUS_THIS bitblt.pixelwidth;
+
   color[0] = BX_CIRRUS_THIS control.shadow_reg1;
   color[1] = BX_CIRRUS_THIS control.reg[0x11];
   color[2] = BX_CIRRUS_THIS control.reg[0x13];
   color[3] = BX_CIRRUS_THIS control.reg[0x15];
+  for (x = 0; x < count; x++) {
+    dst[x] = color[x % pixelwidth];
+  }
+}
+
+// Transparent color expansion of one row: pixels with a set bit get the ROP
+// of the foreground color (colorrow), the others are left unchanged. The ROP
+// is done for the whole row in a work buffer and merged with a byte mask.
+// bitpitch is 0 for a pattern (the same 8 bits for every 8 pixels).
+// Returns the number of bytes of the bit stream used.
+int bx_svga_cirrus_c::svga_colorexpand_transp_row(Bit8u *dst, const Bit8u *colorrow,
+  const Bit8u *bits, int bitpitch, int srcskipleft, int pixels)
+{
+  Bit8u work_rop[CIRRUS_BLT_ROWSIZE];
+  Bit8u work_mask[CIRRUS_BLT_ROWSIZE];
+  const Bit8u *src = colorrow;
+  int x, i, pixelwidth = BX_CIRRUS_THIS bitblt.pixelwidth;
+  int count = pixels * pixelwidth;
+  unsigned bitval, bits_xor, bitmask;
+  int used = 1;
+  Bit8u mask;
+
   if (BX_CIRRUS_THIS bitblt.bltmodeext & CIRRUS_BLTMODEEXT_COLOREXPINV) {
     bits_xor = 0xff;
   } else {
     bits_xor = 0x00;
   }
 
-  dst = BX_CIRRUS_THIS bitblt.dst + pattern_x;
   bitmask = 0x80 >> srcskipleft;
-  bits = *src++ ^ bits_xor;
-  for (x = pattern_x; x < BX_CIRRUS_THIS bitblt.bltwidth; x+=BX_CIRRUS_THIS bitblt.pixelwidth) {
+  bitval = *bits ^ bits_xor;
+  for (x = 0; x < count; x += pixelwidth) {
     if ((bitmask & 0xff) == 0) {
       bitmask = 0x80;
-      bits = *src++ ^ bits_xor;
+      bits += bitpitch;
+      bitval = *bits ^ bits_xor;
+      used++;
     }
-    if (bits & bitmask) {
-      (*BX_CIRRUS_THIS bitblt.rop_handler)(
-          dst, &color[0], 0, 0, BX_CIRRUS_THIS bitblt.pixelwidth, 1);
+    mask = (bitval & bitmask) ? 0xff : 0x00;
+    for (i = 0; i < pixelwidth; i++) {
+      work_mask[x + i] = mask;
     }
-    dst += BX_CIRRUS_THIS bitblt.pixelwidth;
     bitmask >>= 1;
   }
+  if (BX_CIRRUS_THIS bitblt.bltrop != CIRRUS_ROP_SRC) {
+    memcpy(work_rop, dst, count);
+    (*svga_get_fwd_rop_handler(BX_CIRRUS_THIS bitblt.bltrop))(work_rop, colorrow, 0, 0, count, 1);
+    src = work_rop;
+  }
+  bitblt_masked_copy(dst, src, work_mask, count);
+  return used;
 }
 
   bx_bool // 1 if finished, 0 otherwise
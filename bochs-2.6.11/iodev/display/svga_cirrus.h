@@ -47,6 +47,8 @@
 
 // Size of internal cache memory for bitblt. (must be >= 256 and 4-byte aligned)
 #define CIRRUS_BLT_CACHESIZE (2048 * 4)
+// Size of a bitblt row work buffer (max. bltwidth + one 32-bit pixel)
+#define CIRRUS_BLT_ROWSIZE (8192 + 32)
 
 #if BX_SUPPORT_PCI
 #define CIRRUS_VIDEO_MEMORY_MB    4
@@ -121,6 +123,9 @@ private:
   BX_CIRRUS_SMF void  svga_bitblt();
 
   BX_CIRRUS_SMF void  svga_colorexpand(Bit8u *dst,const Bit8u *src,int count,int pixelwidth);
+  BX_CIRRUS_SMF void  svga_color_row(Bit8u *dst,int count);
+  BX_CIRRUS_SMF int   svga_colorexpand_transp_row(Bit8u *dst,const Bit8u *colorrow,
+                        const Bit8u *bits,int bitpitch,int srcskipleft,int pixels);
 
 #if BX_USE_CIRRUS_SMF
   #define svga_colorexpand_8_static svga_colorexpand_8
@@ -99,9 +99,11 @@ bx_bool bx_vga_c::init_vga_extension(void)
                                    BX_VGA_THIS vbe.base_address,
                                    BX_VGA_THIS vbe.base_address + VBE_DISPI_TOTAL_VIDEO_MEMORY_BYTES - 1);
     }
+    // the 16MB of VBE memory are only backed by the host as they are used
     if (BX_VGA_THIS s.memory == NULL)
-      BX_VGA_THIS s.memory = new Bit8u[VBE_DISPI_TOTAL_VIDEO_MEMORY_BYTES];
-    memset(BX_VGA_THIS s.memory, 0, VBE_DISPI_TOTAL_VIDEO_MEMORY_BYTES);
+      BX_VGA_THIS s.memory = (Bit8u *) bx_alloc_zeroed(VBE_DISPI_TOTAL_VIDEO_MEMORY_BYTES);
+    else
+      bx_clear_zeroed(BX_VGA_THIS s.memory, VBE_DISPI_TOTAL_VIDEO_MEMORY_BYTES);
     BX_VGA_THIS s.memsize = VBE_DISPI_TOTAL_VIDEO_MEMORY_BYTES;
     BX_VGA_THIS vbe.cur_dispi=VBE_DISPI_ID0;
     BX_VGA_THIS vbe.xres=640;
@@ -229,8 +231,8 @@ void bx_vga_c::after_restore_state(void)
   }
 #endif
   if (BX_VGA_THIS vbe.enabled) {
-    bx_gui->dimension_update(BX_VGA_THIS vbe.xres, BX_VGA_THIS vbe.yres, 0, 0,
-                             BX_VGA_THIS vbe.bpp);
+    BX_VGA_THIS gui_dimension_update(BX_VGA_THIS vbe.xres, BX_VGA_THIS vbe.yres, 0, 0,
+                                     BX_VGA_THIS vbe.bpp);
   }
 }
 
@@ -595,7 +597,7 @@ void bx_vga_c::update(void)
       BX_VGA_THIS determine_screen_dimensions(&iHeight, &iWidth);
       if ((iWidth != BX_VGA_THIS s.last_xres) || (iHeight != BX_VGA_THIS s.last_yres) ||
            (BX_VGA_THIS s.last_bpp > 8)) {
-        bx_gui->dimension_update(iWidth, iHeight);
+        BX_VGA_THIS gui_dimension_update(iWidth, iHeight);
         BX_VGA_THIS s.last_xres = iWidth;
         BX_VGA_THIS s.last_yres = iHeight;
         BX_VGA_THIS s.last_bpp = 8;
@@ -619,7 +621,7 @@ void bx_vga_c::update(void)
               }
             }
             SET_TILE_UPDATED(BX_VGA_THIS, xti, yti, 0);
-            bx_gui->graphics_tile_update_common(BX_VGA_THIS s.tile, xc, yc);
+            BX_VGA_THIS gui_tile_update(BX_VGA_THIS s.tile, xc, yc);
           }
         }
       }
@@ -1133,7 +1135,7 @@ Bit32u bx_vga_c::vbe_write(Bit32u address, Bit32u value, unsigned io_len)
               if ((value & VBE_DISPI_NOCLEARMEM) == 0) {
                 memset(BX_VGA_THIS s.memory, 0, BX_VGA_THIS vbe.visible_screen_size);
               }
-              bx_gui->dimension_update(BX_VGA_THIS vbe.xres, BX_VGA_THIS vbe.yres, 0, 0, depth);
+              BX_VGA_THIS gui_dimension_update(BX_VGA_THIS vbe.xres, BX_VGA_THIS vbe.yres, 0, 0, depth);
               BX_VGA_THIS s.last_bpp = depth;
               BX_VGA_THIS s.last_fh = 0;
             } else {
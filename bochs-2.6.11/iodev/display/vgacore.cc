@@ -65,19 +65,31 @@ static const Bit8u ccdat[16][4] = {
 bx_vgacore_c::bx_vgacore_c()
 {
   memset(&s, 0, sizeof(s));
+  memset(&display, 0, sizeof(display));
   timer_id = BX_NULL_TIMER_HANDLE;
 }
 
 bx_vgacore_c::~bx_vgacore_c()
 {
+  if (display.enabled) {
+    display_stop();
+  }
   if (s.memory != NULL) {
-    delete [] s.memory;
+    bx_free_zeroed(s.memory);
     s.memory = NULL;
   }
   if (s.vga_tile_updated != NULL) {
     delete [] s.vga_tile_updated;
     s.vga_tile_updated = NULL;
   }
+  if (s.tile_cache != NULL) {
+    delete [] s.tile_cache;
+    s.tile_cache = NULL;
+  }
+  if (s.tile_cache_valid != NULL) {
+    delete [] s.tile_cache_valid;
+    s.tile_cache_valid = NULL;
+  }
   SIM->get_param_num(BXPN_VGA_UPDATE_FREQUENCY)->set_handler(NULL);
 }
 
@@ -93,8 +105,9 @@ void bx_vgacore_c::init(void)
     // VGA memory not yet initialized
     BX_VGA_THIS s.memsize = 0x40000;
     if (BX_VGA_THIS s.memory == NULL)
-      BX_VGA_THIS s.memory = new Bit8u[BX_VGA_THIS s.memsize];
-    memset(BX_VGA_THIS s.memory, 0, BX_VGA_THIS s.memsize);
+      BX_VGA_THIS s.memory = (Bit8u *) bx_alloc_zeroed(BX_VGA_THIS s.memsize);
+    else
+      bx_clear_zeroed(BX_VGA_THIS s.memory, BX_VGA_THIS s.memsize);
   }
   BX_VGA_THIS init_gui();
 
@@ -106,6 +119,14 @@ void bx_vgacore_c::init(void)
   for (y = 0; y < BX_VGA_THIS s.num_y_tiles; y++)
     for (x = 0; x < BX_VGA_THIS s.num_x_tiles; x++)
       SET_TILE_UPDATED(BX_VGA_THIS, x, y, 0);
+  BX_VGA_THIS s.tile_cache = new Bit8u[BX_VGA_THIS s.num_x_tiles * BX_VGA_THIS s.num_y_tiles *
+                                       X_TILESIZE * Y_TILESIZE];
+  BX_VGA_THIS s.tile_cache_valid = new bx_bool[BX_VGA_THIS s.num_x_tiles * BX_VGA_THIS s.num_y_tiles];
+  BX_VGA_THIS invalidate_tile_cache();
+
+  if (!BX_VGA_THIS headless && SIM->get_param_bool(BXPN_VGA_THREADED)->get()) {
+    BX_VGA_THIS display_start();
+  }
 
   if (!BX_VGA_THIS pci_enabled) {
     BX_MEM(0)->load_ROM(SIM->get_param_string(BXPN_VGA_ROM_PATH)->getptr(), 0xc0000, 1);
@@ -244,9 +265,13 @@ void bx_vgacore_c::init_systemtimer(void)
   bx_param_num_c *vga_update_freq = SIM->get_param_num(BXPN_VGA_UPDATE_FREQUENCY);
   Bit32u update_interval = (Bit32u)(1000000 / vga_update_freq->get());
   BX_INFO(("interval=%u, mode=%s", update_interval, BX_VGA_THIS update_realtime ? "realtime":"standard"));
+  BX_VGA_THIS headless = bx_gui->headless();
+  if (BX_VGA_THIS headless) {
+    BX_INFO(("headless display: screen updates disabled"));
+  }
   if (BX_VGA_THIS timer_id == BX_NULL_TIMER_HANDLE) {
     BX_VGA_THIS timer_id = bx_virt_timer.register_timer(this, vga_timer_handler,
-       update_interval, 1, 1, BX_VGA_THIS update_realtime, "vga");
+       update_interval, 1, !BX_VGA_THIS headless, BX_VGA_THIS update_realtime, "vga");
     vga_update_freq->set_handler(vga_param_handler);
     vga_update_freq->set_device_param(this);
   }
@@ -840,7 +865,7 @@ void bx_vgacore_c::write(Bit32u address, Bit32u value, unsigned io_len, bx_bool
                   (unsigned) BX_VGA_THIS s.attribute_ctrl.video_enabled));
 #endif
         if (BX_VGA_THIS s.attribute_ctrl.video_enabled == 0)
-          bx_gui->clear_screen();
+          BX_VGA_THIS gui_clear_screen();
         else if (!prev_video_enabled) {
 #if !defined(VGA_TRACE_FEATURE)
           BX_DEBUG(("found enable transition"));
@@ -1310,8 +1335,9 @@ void bx_vgacore_c::set_override(bx_bool enabled, void *dev)
   BX_VGA_THIS s.nvgadev = (bx_nonvga_device_c*)dev;
 #endif
   if (!enabled) {
-    bx_gui->dimension_update(BX_VGA_THIS s.last_xres, BX_VGA_THIS s.last_yres,
-                             BX_VGA_THIS s.last_fh, BX_VGA_THIS s.last_fw, BX_VGA_THIS s.last_bpp);
+    BX_VGA_THIS gui_dimension_update(BX_VGA_THIS s.last_xres, BX_VGA_THIS s.last_yres,
+                                     BX_VGA_THIS s.last_fh, BX_VGA_THIS s.last_fw,
+                                     BX_VGA_THIS s.last_bpp);
     BX_VGA_THIS vga_redraw_area(0, 0, BX_VGA_THIS s.last_xres, BX_VGA_THIS s.last_yres);
   }
 }
@@ -1369,7 +1395,7 @@ bx_bool bx_vgacore_c::skip_update(void)
 
   /* handle clear screen request from the sequencer */
   if (BX_VGA_THIS s.sequencer.clear_screen) {
-    bx_gui->clear_screen();
+    BX_VGA_THIS gui_clear_screen();
     BX_VGA_THIS s.sequencer.clear_screen = 0;
   }
 
@@ -1439,10 +1465,11 @@ void bx_vgacore_c::update(void)
     if((iWidth != BX_VGA_THIS s.last_xres) || (iHeight != BX_VGA_THIS s.last_yres) ||
         (BX_VGA_THIS s.last_bpp > 8))
     {
-      bx_gui->dimension_update(iWidth, iHeight);
+      BX_VGA_THIS gui_dimension_update(iWidth, iHeight);
       BX_VGA_THIS s.last_xres = iWidth;
       BX_VGA_THIS s.last_yres = iHeight;
       BX_VGA_THIS s.last_bpp = 8;
+      BX_VGA_THIS invalidate_tile_cache();
     }
 
     if (skip_update()) return;
@@ -1478,7 +1505,7 @@ void bx_vgacore_c::update(void)
                   }
                 }
                 SET_TILE_UPDATED(BX_VGA_THIS, xti, yti, 0);
-                bx_gui->graphics_tile_update_common(BX_VGA_THIS s.tile, xc, yc);
+                BX_VGA_THIS tile_update_if_changed(xti, yti, xc, yc);
               }
             }
           }
@@ -1505,7 +1532,7 @@ void bx_vgacore_c::update(void)
                   }
                 }
                 SET_TILE_UPDATED(BX_VGA_THIS, xti, yti, 0);
-                bx_gui->graphics_tile_update_common(BX_VGA_THIS s.tile, xc, yc);
+                BX_VGA_THIS tile_update_if_changed(xti, yti, xc, yc);
               }
             }
           }
@@ -1542,7 +1569,7 @@ void bx_vgacore_c::update(void)
                 }
               }
               SET_TILE_UPDATED(BX_VGA_THIS, xti, yti, 0);
-              bx_gui->graphics_tile_update_common(BX_VGA_THIS s.tile, xc, yc);
+              BX_VGA_THIS tile_update_if_changed(xti, yti, xc, yc);
             }
           }
         }
@@ -1576,7 +1603,7 @@ void bx_vgacore_c::update(void)
                   }
                 }
                 SET_TILE_UPDATED(BX_VGA_THIS, xti, yti, 0);
-                bx_gui->graphics_tile_update_common(BX_VGA_THIS s.tile, xc, yc);
+                BX_VGA_THIS tile_update_if_changed(xti, yti, xc, yc);
               }
             }
           }
@@ -1600,7 +1627,7 @@ void bx_vgacore_c::update(void)
                   }
                 }
                 SET_TILE_UPDATED(BX_VGA_THIS, xti, yti, 0);
-                bx_gui->graphics_tile_update_common(BX_VGA_THIS s.tile, xc, yc);
+                BX_VGA_THIS tile_update_if_changed(xti, yti, xc, yc);
               }
             }
           }
@@ -1624,7 +1651,7 @@ void bx_vgacore_c::update(void)
                   }
                 }
                 SET_TILE_UPDATED(BX_VGA_THIS, xti, yti, 0);
-                bx_gui->graphics_tile_update_common(BX_VGA_THIS s.tile, xc, yc);
+                BX_VGA_THIS tile_update_if_changed(xti, yti, xc, yc);
               }
             }
           }
@@ -1709,7 +1736,7 @@ void bx_vgacore_c::update(void)
         (cWidth != BX_VGA_THIS s.last_fw) ||((MSL+1) != BX_VGA_THIS s.last_fh) ||
         (BX_VGA_THIS s.last_bpp > 8))
     {
-      bx_gui->dimension_update(iWidth, iHeight, MSL+1, cWidth);
+      BX_VGA_THIS gui_dimension_update(iWidth, iHeight, MSL+1, cWidth);
       BX_VGA_THIS s.last_xres = iWidth;
       BX_VGA_THIS s.last_yres = iHeight;
       BX_VGA_THIS s.last_fw = cWidth;
@@ -1729,9 +1756,7 @@ void bx_vgacore_c::update(void)
       cursor_x = ((cursor_address - start_address)/2) % (iWidth/cWidth);
       cursor_y = ((cursor_address - start_address)/2) / (iWidth/cWidth);
     }
-    bx_gui->text_update(BX_VGA_THIS s.text_snapshot,
-                        &BX_VGA_THIS s.memory[start_address],
-                        cursor_x, cursor_y, &tm_info);
+    BX_VGA_THIS gui_text_update(tm_info.line_offset*rows, cursor_x, cursor_y, &tm_info);
     if (BX_VGA_THIS s.vga_mem_updated) {
       // screen updated, copy new VGA memory contents into text snapshot
       memcpy(BX_VGA_THIS s.text_snapshot,
@@ -2280,6 +2305,18 @@ void bx_vgacore_c::get_text_snapshot(Bit8u **text_snapshot, unsigned *txHeight,
     MSL = BX_VGA_THIS s.CRTC.reg[0x09] & 0x1f;
     *txHeight = (VDE+1)/(MSL+1);
     *txWidth = BX_VGA_THIS s.CRTC.reg[1] + 1;
+    if (BX_VGA_THIS headless) {
+      // update() never runs, take the text straight from VGA memory
+      unsigned start_address = 2*((BX_VGA_THIS s.CRTC.reg[12] << 8) +
+                                  BX_VGA_THIS s.CRTC.reg[13]);
+      unsigned size = *txHeight * *txWidth * 2;
+      if ((size <= sizeof(BX_VGA_THIS s.text_snapshot)) &&
+          ((start_address + size) <= BX_VGA_THIS s.memsize)) {
+        memcpy(BX_VGA_THIS s.text_snapshot, &BX_VGA_THIS s.memory[start_address], size);
+      } else {
+        *txHeight = 0;
+      }
+    }
   } else {
     *txHeight = 0;
     *txWidth = 0;
@@ -2391,6 +2428,8 @@ void bx_vgacore_c::redraw_area(unsigned x0, unsigned y0, unsigned width, unsigne
     for (yti=yt0; yti<=yt1; yti++) {
       for (xti=xt0; xti<=xt1; xti++) {
         SET_TILE_UPDATED(BX_VGA_THIS, xti, yti, 1);
+        if ((xti < BX_VGA_THIS s.num_x_tiles) && (yti < BX_VGA_THIS s.num_y_tiles))
+          BX_VGA_THIS s.tile_cache_valid[xti + yti * BX_VGA_THIS s.num_x_tiles] = 0;
       }
     }
 
@@ -2398,27 +2437,283 @@ void bx_vgacore_c::redraw_area(unsigned x0, unsigned y0, unsigned width, unsigne
     // text mode
     memset(BX_VGA_THIS s.text_snapshot, 0,
            sizeof(BX_VGA_THIS s.text_snapshot));
+    if (BX_VGA_THIS display.enabled) {
+      BX_VGA_THIS display.frame[BX_VGA_THIS display.back].text_redraw = 1;
+    }
+    // text output overwrites whatever graphics tiles were on screen
+    BX_VGA_THIS invalidate_tile_cache();
+  }
+}
+
+// Forward the freshly converted tile in s.tile to the gui, unless it has
+// exactly the same pixels as the last time this tile was sent. Guests often
+// rewrite video memory with unchanged data (scrolling, full redraws), which
+// marks tiles dirty without changing what is displayed.
+void bx_vgacore_c::tile_update_if_changed(unsigned xti, unsigned yti, unsigned xc, unsigned yc)
+{
+  if ((xti >= BX_VGA_THIS s.num_x_tiles) || (yti >= BX_VGA_THIS s.num_y_tiles)) {
+    BX_VGA_THIS gui_tile_update(BX_VGA_THIS s.tile, xc, yc);
+    return;
+  }
+  unsigned idx = xti + yti * BX_VGA_THIS s.num_x_tiles;
+  Bit8u *cached = &BX_VGA_THIS s.tile_cache[idx * X_TILESIZE * Y_TILESIZE];
+  if (BX_VGA_THIS s.tile_cache_valid[idx] &&
+      !memcmp(cached, BX_VGA_THIS s.tile, X_TILESIZE * Y_TILESIZE)) {
+    return;
+  }
+  memcpy(cached, BX_VGA_THIS s.tile, X_TILESIZE * Y_TILESIZE);
+  BX_VGA_THIS s.tile_cache_valid[idx] = 1;
+  BX_VGA_THIS gui_tile_update(BX_VGA_THIS s.tile, xc, yc);
+}
+
+void bx_vgacore_c::invalidate_tile_cache(void)
+{
+  if (BX_VGA_THIS s.tile_cache_valid != NULL) {
+    memset(BX_VGA_THIS s.tile_cache_valid, 0,
+           BX_VGA_THIS s.num_x_tiles * BX_VGA_THIS s.num_y_tiles * sizeof(bx_bool));
+  }
+}
+
+// screen output
+
+void bx_vgacore_c::gui_dimension_update(unsigned x, unsigned y, unsigned fheight,
+                                        unsigned fwidth, unsigned bpp)
+{
+  bx_gui->lock();
+  // changes for the old screen are lost in the resize anyway
+  BX_VGA_THIS display_drop_frames();
+  bx_gui->dimension_update(x, y, fheight, fwidth, bpp);
+  bx_gui->unlock();
+}
+
+void bx_vgacore_c::gui_clear_screen(void)
+{
+  bx_gui->lock();
+  BX_VGA_THIS display_drop_frames();
+  bx_gui->clear_screen();
+  bx_gui->unlock();
+}
+
+void bx_vgacore_c::gui_tile_update(Bit8u *tile, unsigned xc, unsigned yc)
+{
+  unsigned xti = xc / X_TILESIZE, yti = yc / Y_TILESIZE;
+
+  if (BX_VGA_THIS display.recording &&
+      (xti < BX_VGA_THIS s.num_x_tiles) && (yti < BX_VGA_THIS s.num_y_tiles)) {
+    bx_vga_frame_t *frame = &BX_VGA_THIS display.frame[BX_VGA_THIS display.back];
+    unsigned idx = xti + yti * BX_VGA_THIS s.num_x_tiles;
+    memcpy(&frame->tiles[idx * X_TILESIZE * Y_TILESIZE], tile, X_TILESIZE * Y_TILESIZE);
+    frame->tile_dirty[idx] = 1;
+    frame->pending = 1;
+  } else {
+    bx_gui->graphics_tile_update_common(tile, xc, yc);
   }
 }
 
+// len bytes of text starting at tm_info->start_address
+void bx_vgacore_c::gui_text_update(unsigned len, unsigned cursor_x, unsigned cursor_y,
+                                   bx_vga_tminfo_t *tm_info)
+{
+  Bit8u *new_text = &BX_VGA_THIS s.memory[tm_info->start_address];
+
+  if (BX_VGA_THIS display.recording) {
+    bx_vga_frame_t *frame = &BX_VGA_THIS display.frame[BX_VGA_THIS display.back];
+    // the split screen part is addressed from the start of video memory
+    unsigned end = tm_info->start_address + len;
+    if (end > BX_VGA_THIS s.memsize) end = BX_VGA_THIS s.memsize;
+    if (end > BX_VGA_FRAME_TEXT_SIZE) end = BX_VGA_FRAME_TEXT_SIZE;
+    memcpy(frame->text_mem, BX_VGA_THIS s.memory, end);
+    frame->text_len = len;
+    frame->cursor_x = cursor_x;
+    frame->cursor_y = cursor_y;
+    frame->tm_info = *tm_info;
+    frame->text = 1;
+    frame->pending = 1;
+  } else if (BX_VGA_THIS display.enabled) {
+    // drawn here, keep the text of the display thread in line
+    bx_vga_frame_t *frame = &BX_VGA_THIS display.frame[BX_VGA_THIS display.back];
+    if (frame->text_redraw) {
+      memset(BX_VGA_THIS display.text_shown, 0, BX_VGA_FRAME_TEXT_SIZE / 2);
+      frame->text_redraw = 0;
+    }
+    bx_gui->text_update(BX_VGA_THIS display.text_shown, new_text,
+                        cursor_x, cursor_y, tm_info);
+    memcpy(BX_VGA_THIS display.text_shown, new_text, len);
+  } else {
+    bx_gui->text_update(BX_VGA_THIS s.text_snapshot, new_text,
+                        cursor_x, cursor_y, tm_info);
+  }
+}
+
+// threaded display
+
+BX_THREAD_FUNC(vga_display_thread, indata)
+{
+  ((bx_vgacore_c*)indata)->display_loop();
+  BX_THREAD_EXIT;
+}
+
+void bx_vgacore_c::display_start(void)
+{
+  unsigned tiles = BX_VGA_THIS s.num_x_tiles * BX_VGA_THIS s.num_y_tiles;
+
+  for (int i = 0; i < 2; i++) {
+    bx_vga_frame_t *frame = &BX_VGA_THIS display.frame[i];
+    frame->tile_dirty = new bx_bool[tiles];
+    memset(frame->tile_dirty, 0, tiles * sizeof(bx_bool));
+    frame->tiles = new Bit8u[tiles * X_TILESIZE * Y_TILESIZE];
+    frame->text_mem = new Bit8u[BX_VGA_FRAME_TEXT_SIZE];
+    frame->pending = 0;
+    frame->text = 0;
+    frame->text_redraw = 0;
+  }
+  BX_VGA_THIS display.text_shown = new Bit8u[BX_VGA_FRAME_TEXT_SIZE / 2];
+  memset(BX_VGA_THIS display.text_shown, 0, BX_VGA_FRAME_TEXT_SIZE / 2);
+  BX_VGA_THIS display.back = 0;
+  BX_VGA_THIS display.front_ready = 0;
+  BX_VGA_THIS display.recording = 0;
+  BX_VGA_THIS display.stop = 0;
+  BX_VGA_THIS display.exited = 0;
+  bx_create_event(&BX_VGA_THIS display.event);
+  bx_gui->set_display_thread(1);
+  BX_VGA_THIS display.enabled = 1;
+  BX_THREAD_CREATE(vga_display_thread, this, BX_VGA_THIS display.thread);
+  BX_INFO(("screen updates drawn by the display thread"));
+}
+
+void bx_vgacore_c::display_stop(void)
+{
+  BX_VGA_THIS display.stop = 1;
+  // the thread may be between its check and the wait, keep waking it
+  while (!BX_VGA_THIS display.exited) {
+    bx_set_event(&BX_VGA_THIS display.event);
+    BX_MSLEEP(1);
+  }
+  BX_THREAD_JOIN(BX_VGA_THIS display.thread);
+  bx_gui->set_display_thread(0);
+  BX_VGA_THIS display.enabled = 0;
+  bx_destroy_event(&BX_VGA_THIS display.event);
+  for (int i = 0; i < 2; i++) {
+    delete [] BX_VGA_THIS display.frame[i].tile_dirty;
+    delete [] BX_VGA_THIS display.frame[i].tiles;
+    delete [] BX_VGA_THIS display.frame[i].text_mem;
+  }
+  delete [] BX_VGA_THIS display.text_shown;
+}
+
+// Draw the front buffer whenever the vga timer hands one over. The gui
+// lock keeps the simulation thread out of the backend meanwhile; it only
+// swaps the buffers while holding the lock.
+void bx_vgacore_c::display_loop(void)
+{
+  while (!BX_VGA_THIS display.stop) {
+    if (!bx_gui->display_trylock()) {
+      BX_MSLEEP(1);
+      continue;
+    }
+    if (BX_VGA_THIS display.front_ready) {
+      BX_VGA_THIS display_present(&BX_VGA_THIS display.frame[BX_VGA_THIS display.back ^ 1]);
+      BX_VGA_THIS display.front_ready = 0;
+    }
+    bx_gui->display_unlock();
+    if (!BX_VGA_THIS display.stop) {
+      bx_wait_for_event(&BX_VGA_THIS display.event);
+    }
+  }
+  BX_VGA_THIS display.exited = 1;
+}
+
+// draw a buffer and leave it empty, the gui lock is held
+void bx_vgacore_c::display_present(bx_vga_frame_t *frame)
+{
+  unsigned xti, yti, idx;
+
+  for (yti = 0; yti < BX_VGA_THIS s.num_y_tiles; yti++) {
+    for (xti = 0; xti < BX_VGA_THIS s.num_x_tiles; xti++) {
+      idx = xti + yti * BX_VGA_THIS s.num_x_tiles;
+      if (frame->tile_dirty[idx]) {
+        bx_gui->graphics_tile_update_common(&frame->tiles[idx * X_TILESIZE * Y_TILESIZE],
+                                            xti * X_TILESIZE, yti * Y_TILESIZE);
+        frame->tile_dirty[idx] = 0;
+      }
+    }
+  }
+  if (frame->text) {
+    if (frame->text_redraw) {
+      memset(BX_VGA_THIS display.text_shown, 0, BX_VGA_FRAME_TEXT_SIZE / 2);
+      frame->text_redraw = 0;
+    }
+    Bit8u *new_text = &frame->text_mem[frame->tm_info.start_address];
+    bx_gui->text_update(BX_VGA_THIS display.text_shown, new_text,
+                        frame->cursor_x, frame->cursor_y, &frame->tm_info);
+    memcpy(BX_VGA_THIS display.text_shown, new_text, frame->text_len);
+    frame->text = 0;
+  }
+  bx_gui->flush();
+  frame->pending = 0;
+}
+
+// draw what the display thread has not drawn yet, the gui lock is held
+void bx_vgacore_c::display_sync(void)
+{
+  if (!BX_VGA_THIS display.enabled)
+    return;
+  if (BX_VGA_THIS display.front_ready) {
+    BX_VGA_THIS display_present(&BX_VGA_THIS display.frame[BX_VGA_THIS display.back ^ 1]);
+    BX_VGA_THIS display.front_ready = 0;
+  }
+  if (BX_VGA_THIS display.frame[BX_VGA_THIS display.back].pending) {
+    BX_VGA_THIS display_present(&BX_VGA_THIS display.frame[BX_VGA_THIS display.back]);
+  }
+}
+
+// forget the buffered tiles and text, the gui lock is held
+void bx_vgacore_c::display_drop_frames(void)
+{
+  if (!BX_VGA_THIS display.enabled)
+    return;
+  unsigned tiles = BX_VGA_THIS s.num_x_tiles * BX_VGA_THIS s.num_y_tiles;
+  for (int i = 0; i < 2; i++) {
+    bx_vga_frame_t *frame = &BX_VGA_THIS display.frame[i];
+    memset(frame->tile_dirty, 0, tiles * sizeof(bx_bool));
+    frame->text = 0;
+    frame->pending = 0;
+  }
+  BX_VGA_THIS display.front_ready = 0;
+}
+
 void bx_vgacore_c::refresh_display(void *this_ptr, bx_bool redraw)
 {
   bx_vgacore_c *vgadev = (bx_vgacore_c *) this_ptr;
+  // the caller may read the screen back right away, so everything is
+  // drawn here and not in the display thread
+  bx_gui->lock();
+  vgadev->display_sync();
 #if BX_SUPPORT_PCI
   if (vgadev->s.vga_override && (vgadev->s.nvgadev != NULL)) {
     vgadev->s.nvgadev->refresh_display(vgadev->s.nvgadev, redraw);
+    bx_gui->unlock();
     return;
   }
 #endif
   if (redraw) {
     vga_redraw_area(0, 0, vgadev->s.last_xres, vgadev->s.last_yres);
   }
-  vga_timer_handler(vgadev);
+  vgadev->update();
+  bx_gui->flush();
+  bx_gui->unlock();
 }
 
 void bx_vgacore_c::vga_timer_handler(void *this_ptr)
 {
   bx_vgacore_c *vgadev = (bx_vgacore_c *) this_ptr;
+  if (vgadev->display.enabled) {
+    // the display thread is still drawing, the changes stay marked
+    // for the next update
+    if (!bx_gui->trylock())
+      return;
+    vgadev->display.recording = 1;
+  }
 #if BX_SUPPORT_PCI
   if (vgadev->s.vga_override && (vgadev->s.nvgadev != NULL)) {
     vgadev->s.nvgadev->update();
@@ -2428,7 +2723,20 @@ void bx_vgacore_c::vga_timer_handler(void *this_ptr)
   {
     vgadev->update();
   }
-  bx_gui->flush();
+  if (vgadev->display.enabled) {
+    vgadev->display.recording = 0;
+    // flush at least; if the display thread is behind, the back buffer
+    // collects the changes until it took the last one
+    vgadev->display.frame[vgadev->display.back].pending = 1;
+    if (!vgadev->display.front_ready) {
+      vgadev->display.back ^= 1;
+      vgadev->display.front_ready = 1;
+    }
+    bx_gui->unlock();
+    bx_set_event(&vgadev->display.event);
+  } else {
+    bx_gui->flush();
+  }
 }
 
 #undef LOG_THIS
@@ -2441,8 +2749,10 @@ Bit64s bx_vgacore_c::vga_param_handler(bx_param_c *param, int set, Bit64s val)
     Bit32u update_interval = (Bit32u)(1000000 / val);
     bx_vgacore_c *vgadev = (bx_vgacore_c *)param->get_device_param();
     BX_INFO(("Changing timer interval to %d", update_interval));
-    vga_timer_handler(vgadev);
-    bx_virt_timer.activate_timer(vgadev->timer_id, update_interval, 1);
+    if (!vgadev->headless) {
+      vga_timer_handler(vgadev);
+      bx_virt_timer.activate_timer(vgadev->timer_id, update_interval, 1);
+    }
     if (update_interval < 266666) {
       vgadev->s.blink_counter = 266666 / (unsigned)update_interval;
     } else {
@@ -66,6 +66,25 @@ typedef struct {
   Bit16u vrstart;
 } bx_crtc_params_t;
 
+// video memory copied for a text update: start address and text size are
+// both below 128K
+#define BX_VGA_FRAME_TEXT_SIZE 0x40000
+
+// one buffer of the threaded display: the screen changes the display
+// thread has not drawn yet
+typedef struct {
+  bx_bool pending;      // something to draw or flush
+  bx_bool *tile_dirty;
+  Bit8u *tiles;         // converted 8 bpp tiles
+  bx_bool text;         // text update pending
+  bx_bool text_redraw;  // redraw all characters
+  Bit8u *text_mem;      // video memory up to the end of the screen
+  unsigned text_len;
+  unsigned cursor_x;
+  unsigned cursor_y;
+  bx_vga_tminfo_t tm_info;
+} bx_vga_frame_t;
+
 #if BX_SUPPORT_PCI
 class bx_nonvga_device_c : public bx_pci_device_c {
 public:
@@ -106,6 +125,8 @@ public:
   static void    vga_timer_handler(void *);
   static Bit64s  vga_param_handler(bx_param_c *param, int set, Bit64s val);
 
+  void display_loop(void);
+
 protected:
   void init_standard_vga(void);
   void init_gui(void);
@@ -123,6 +144,21 @@ protected:
   void determine_screen_dimensions(unsigned *piHeight, unsigned *piWidth);
   void calculate_retrace_timing(void);
   bx_bool skip_update(void);
+  void tile_update_if_changed(unsigned xti, unsigned yti, unsigned xc, unsigned yc);
+  void invalidate_tile_cache(void);
+
+  // screen output, buffered for the display thread if it is enabled
+  void gui_dimension_update(unsigned x, unsigned y, unsigned fheight=0,
+                            unsigned fwidth=0, unsigned bpp=8);
+  void gui_clear_screen(void);
+  void gui_tile_update(Bit8u *tile, unsigned xc, unsigned yc);
+  void gui_text_update(unsigned len, unsigned cursor_x, unsigned cursor_y,
+                       bx_vga_tminfo_t *tm_info);
+  void display_start(void);
+  void display_stop(void);
+  void display_present(bx_vga_frame_t *frame);
+  void display_sync(void);
+  void display_drop_frames(void);
 
   struct {
     struct {
@@ -225,6 +261,10 @@ protected:
     unsigned vertical_display_end;
     unsigned blink_counter;
     bx_bool  *vga_tile_updated;
+    // last converted content of each tile, used to drop tile updates
+    // when a dirty tile ends up with the same pixels as before
+    Bit8u *tile_cache;
+    bx_bool *tile_cache_valid;
     Bit8u *memory;
     Bit32u memsize;
     Bit8u text_snapshot[128 * 1024]; // current text snapshot
@@ -263,9 +303,25 @@ protected:
 #endif
   } s;  // state information
 
+  // threaded display: the vga timer converts the screen changes into the
+  // back buffer, the display thread draws the front buffer
+  struct {
+    bx_bool enabled;
+    bx_bool recording;    // screen output goes to the back buffer
+    bx_vga_frame_t frame[2];
+    unsigned back;
+    bx_bool front_ready;  // front buffer handed over, not drawn yet
+    Bit8u *text_shown;    // text the display thread has drawn
+    volatile bx_bool stop;
+    volatile bx_bool exited;
+    BX_THREAD_VAR(thread);
+    bx_thread_event_t event;
+  } display;
+
   int timer_id;
   bx_bool update_realtime;
   bx_bool vsync_realtime;
+  bx_bool headless;
   bx_param_string_c *vgaext;
   bx_bool pci_enabled;
 };
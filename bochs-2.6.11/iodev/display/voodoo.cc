@@ -1017,7 +1017,9 @@ bx_bool bx_voodoo_1_2_c::update_timing(void)
       (s.vdraw.height != v->fbi.height)) {
     s.vdraw.width = v->fbi.width;
     s.vdraw.height = v->fbi.height;
+    bx_gui->lock();
     bx_gui->dimension_update(v->fbi.width, v->fbi.height, 0, 0, 16);
+    bx_gui->unlock();
     vertical_timer_handler(NULL);
   }
   BX_INFO(("Voodoo output %dx%d@%uHz", v->fbi.width, v->fbi.height, (unsigned)v->vertfreq));
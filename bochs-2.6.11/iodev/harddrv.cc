@@ -32,6 +32,7 @@
 #include "harddrv.h"
 #include "hdimage/hdimage.h"
 #include "hdimage/cdrom.h"
+#include "replay.h"
 
 #define LOG_THIS theHardDrive->
 
@@ -130,6 +131,8 @@ bx_hard_drive_c::bx_hard_drive_c()
   for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
     for (Bit8u device=0; device<2; device ++) {
       channels[channel].drives[device].controller.buffer = NULL;
+      channels[channel].drives[device].prefetch_buf = NULL;
+      channels[channel].drives[device].prefetch_count = 0;
       channels[channel].drives[device].hdimage = NULL;
       channels[channel].drives[device].cdrom.cd = NULL;
       channels[channel].drives[device].seek_timer_index = BX_NULL_TIMER_HANDLE;
@@ -159,6 +162,9 @@ bx_hard_drive_c::~bx_hard_drive_c()
       if (channels[channel].drives[device].controller.buffer != NULL) {
         delete [] channels[channel].drives[device].controller.buffer;
       }
+      if (channels[channel].drives[device].prefetch_buf != NULL) {
+        delete [] channels[channel].drives[device].prefetch_buf;
+      }
       sprintf(ata_name, "ata.%d.%s", channel, (device==0)?"master":"slave");
       base = (bx_list_c*) SIM->get_param(ata_name);
       SIM->get_param_string("path", base)->set_handler(NULL);
@@ -224,6 +230,8 @@ void bx_hard_drive_c::init(void)
         DEV_register_iowrite_handler(this, write_handler,
                              BX_HD_THIS channels[channel].ioaddr1+addr, string, 1);
       }
+      DEV_register_bulk_io_handlers(this, bulk_read_handler, bulk_write_handler,
+                           BX_HD_THIS channels[channel].ioaddr1, string);
     }
 
     // We don't want to register addresses 0x3f6 and 0x3f7 as they are handled by the floppy controller
@@ -366,6 +374,9 @@ void bx_hard_drive_c::init(void)
         BX_HD_THIS channels[channel].drives[device].controller.buffer_total_size =
           MAX_MULTIPLE_SECTORS * sect_size;
         BX_HD_THIS channels[channel].drives[device].sect_size = sect_size;
+        BX_HD_THIS channels[channel].drives[device].prefetch_buf =
+          new Bit8u[MAX_MULTIPLE_SECTORS * sect_size];
+        BX_HD_THIS channels[channel].drives[device].prefetch_count = 0;
       } else if (SIM->get_param_enum("type", base)->get() == BX_ATA_DEVICE_CDROM) {
         bx_list_c *cdrom_rt = (bx_list_c*)SIM->get_param(BXPN_MENU_RUNTIME_CDROM);
         sprintf(pname, "cdrom%d", BX_HD_THIS cdrom_count + 1);
@@ -1121,6 +1132,100 @@ return_value8:
   return value8;
 }
 
+// static bulk IO callback handlers for REP INSW/OUTSW on the data port
+Bit32u bx_hard_drive_c::bulk_read_handler(void *this_ptr, Bit32u address, unsigned io_len, Bit8u *dst, Bit32u count)
+{
+  bx_hard_drive_c *class_ptr = (bx_hard_drive_c *) this_ptr;
+  return class_ptr->bulk_read(address, io_len, dst, count);
+}
+
+Bit32u bx_hard_drive_c::bulk_write_handler(void *this_ptr, Bit32u address, unsigned io_len, const Bit8u *src, Bit32u count)
+{
+  bx_hard_drive_c *class_ptr = (bx_hard_drive_c *) this_ptr;
+  return class_ptr->bulk_write(address, io_len, src, count);
+}
+
+// Copy up to 'count' quantums straight out of the sector buffer. The last
+// quantum of the buffer is always left to read(), which runs the
+// end-of-buffer logic (next sector, status, interrupt).
+Bit32u bx_hard_drive_c::bulk_read(Bit32u address, unsigned io_len, Bit8u *dst, Bit32u count)
+{
+  Bit8u channel;
+
+  for (channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
+    if (address == BX_HD_THIS channels[channel].ioaddr1)
+      break;
+  }
+  if (channel == BX_MAX_ATA_CHANNEL)
+    return 0;
+
+  controller_t *controller = &BX_SELECTED_CONTROLLER(channel);
+  if (controller->status.drq == 0)
+    return 0;
+  switch (controller->current_command) {
+    case 0x20: // READ SECTORS, with retries
+    case 0x21: // READ SECTORS, without retries
+    case 0xC4: // READ MULTIPLE SECTORS
+    case 0x24: // READ SECTORS EXT
+    case 0x29: // READ MULTIPLE EXT
+      break;
+    default:
+      return 0;
+  }
+  if (controller->buffer_index >= controller->buffer_size)
+    return 0;
+
+  Bit32u quantums = (controller->buffer_size - controller->buffer_index) / io_len;
+  if (quantums <= 1)
+    return 0;
+  quantums--;
+  if (quantums > count)
+    quantums = count;
+
+  memcpy(dst, &controller->buffer[controller->buffer_index], quantums * io_len);
+  controller->buffer_index += quantums * io_len;
+  return quantums;
+}
+
+// Copy up to 'count' quantums into the sector buffer, see bulk_read().
+Bit32u bx_hard_drive_c::bulk_write(Bit32u address, unsigned io_len, const Bit8u *src, Bit32u count)
+{
+  Bit8u channel;
+
+  for (channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
+    if (address == BX_HD_THIS channels[channel].ioaddr1)
+      break;
+  }
+  if (channel == BX_MAX_ATA_CHANNEL)
+    return 0;
+
+  controller_t *controller = &BX_SELECTED_CONTROLLER(channel);
+  if (controller->status.drq == 0)
+    return 0;
+  switch (controller->current_command) {
+    case 0x30: // WRITE SECTORS
+    case 0xC5: // WRITE MULTIPLE SECTORS
+    case 0x34: // WRITE SECTORS EXT
+    case 0x39: // WRITE MULTIPLE EXT
+      break;
+    default:
+      return 0;
+  }
+  if (controller->buffer_index >= controller->buffer_size)
+    return 0;
+
+  Bit32u quantums = (controller->buffer_size - controller->buffer_index) / io_len;
+  if (quantums <= 1)
+    return 0;
+  quantums--;
+  if (quantums > count)
+    quantums = count;
+
+  memcpy(&controller->buffer[controller->buffer_index], src, quantums * io_len);
+  controller->buffer_index += quantums * io_len;
+  return quantums;
+}
+
 // static IO port write callback handler
 // redirects to non-static class handler to avoid virtual functions
 
@@ -3303,6 +3408,29 @@ void bx_hard_drive_c::command_aborted(Bit8u channel, unsigned value)
   raise_interrupt(channel);
 }
 
+// Detach the disk images of a forked clone of the simulation from the
+// parent, see clone.cc. With instance < 0 only check that all disks can be
+// cloned: they must be 'cow' images or read-only.
+bx_bool bx_hard_drive_c::clone_images(int instance)
+{
+  for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
+    for (Bit8u device=0; device<2; device++) {
+      device_image_t *hdimage = BX_HD_THIS channels[channel].drives[device].hdimage;
+      if (!BX_DRIVE_IS_HD(channel, device) || (hdimage == NULL)) continue;
+      Bit32u caps = hdimage->get_capabilities();
+      if (caps & HDIMAGE_CAN_CLONE) {
+        if ((instance >= 0) && (hdimage->clone_instance(instance) < 0))
+          return 0;
+      } else if (!(caps & HDIMAGE_READONLY)) {
+        BX_ERROR(("ata%d-%s: image can't be shared by clones, use mode=cow",
+                  channel, device ? "slave" : "master"));
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
 Bit32u bx_hard_drive_c::get_first_cd_handle(void)
 {
   for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
@@ -3517,20 +3645,48 @@ bx_bool bx_hard_drive_c::ide_read_sector(Bit8u channel, Bit8u *buffer, Bit32u bu
       command_aborted(channel, controller->current_command);
       return 0;
     }
-    ret = BX_SELECTED_DRIVE(channel).hdimage->lseek(logical_sector * sect_size, SEEK_SET);
-    if (ret < 0) {
-      BX_ERROR(("could not lseek() hard drive image file"));
-      command_aborted(channel, controller->current_command);
-      return 0;
-    }
-    /* set status bar conditions for device */
-    bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1);
-    ret = BX_SELECTED_DRIVE(channel).hdimage->read((bx_ptr_t)bufptr, sect_size);
-    if (ret < sect_size) {
-      BX_ERROR(("could not read() hard drive image file at byte %lu", (unsigned long)logical_sector*sect_size));
-      command_aborted(channel, controller->current_command);
-      return 0;
+    Bit64s prefetch_index = logical_sector - BX_SELECTED_DRIVE(channel).prefetch_lsector;
+    if ((prefetch_index < 0) || (prefetch_index >= BX_SELECTED_DRIVE(channel).prefetch_count)) {
+      // read ahead the rest of the command (up to MAX_MULTIPLE_SECTORS) with
+      // one image access, the following DRQ blocks are served from memory
+      Bit64s max_count = BX_SELECTED_DRIVE(channel).hdimage->hd_size / sect_size - logical_sector;
+      Bit32u count = controller->num_sectors;
+      if (count > MAX_MULTIPLE_SECTORS) count = MAX_MULTIPLE_SECTORS;
+      if (count > max_count) count = (Bit32u)max_count;
+      if (count == 0) count = 1;
+      BX_SELECTED_DRIVE(channel).prefetch_count = 0;
+      Bit8u drive = channel * 2 + BX_SLAVE_SELECTED(channel);
+      if (BX_REPLAY_REPLAYING) {
+        // a replay reads what the recording read, the image may differ
+        ret = bx_replay_read(BX_REPLAY_DISK, drive, BX_SELECTED_DRIVE(channel).prefetch_buf,
+                             count * sect_size);
+      } else {
+        ret = BX_SELECTED_DRIVE(channel).hdimage->lseek(logical_sector * sect_size, SEEK_SET);
+        if (ret < 0) {
+          BX_ERROR(("could not lseek() hard drive image file"));
+          if (BX_REPLAY_RECORDING)
+            bx_replay_record(BX_REPLAY_DISK, drive, NULL, 0);
+          command_aborted(channel, controller->current_command);
+          return 0;
+        }
+        ret = BX_SELECTED_DRIVE(channel).hdimage->read((bx_ptr_t)BX_SELECTED_DRIVE(channel).prefetch_buf,
+                                                        count * sect_size);
+        if (BX_REPLAY_RECORDING)
+          bx_replay_record(BX_REPLAY_DISK, drive, BX_SELECTED_DRIVE(channel).prefetch_buf,
+                           (ret > 0) ? (Bit32u)ret : 0);
+      }
+      /* set status bar conditions for device */
+      bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1);
+      if (ret < (Bit64s)(count * sect_size)) {
+        BX_ERROR(("could not read() hard drive image file at byte %lu", (unsigned long)logical_sector*sect_size));
+        command_aborted(channel, controller->current_command);
+        return 0;
+      }
+      BX_SELECTED_DRIVE(channel).prefetch_lsector = logical_sector;
+      BX_SELECTED_DRIVE(channel).prefetch_count = count;
+      prefetch_index = 0;
     }
+    memcpy(bufptr, BX_SELECTED_DRIVE(channel).prefetch_buf + prefetch_index * sect_size, sect_size);
     increment_address(channel, &logical_sector);
     BX_SELECTED_DRIVE(channel).next_lsector = logical_sector;
     bufptr += sect_size;
@@ -3549,11 +3705,21 @@ bx_bool bx_hard_drive_c::ide_write_sector(Bit8u channel, Bit8u *buffer, Bit32u b
   unsigned sect_size = BX_SELECTED_DRIVE(channel).sect_size;
   int sector_count = (buffer_size / sect_size);
   Bit8u *bufptr = buffer;
+  // the read ahead data may be stale now
+  BX_SELECTED_DRIVE(channel).prefetch_count = 0;
   do {
     if (!calculate_logical_address(channel, &logical_sector)) {
       command_aborted(channel, controller->current_command);
       return 0;
     }
+    if (BX_REPLAY_REPLAYING) {
+      // the image keeps the state it had before the replay
+      bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1, 1 /* write */);
+      increment_address(channel, &logical_sector);
+      BX_SELECTED_DRIVE(channel).next_lsector = logical_sector;
+      bufptr += sect_size;
+      continue;
+    }
     ret = BX_SELECTED_DRIVE(channel).hdimage->lseek(logical_sector * sect_size, SEEK_SET);
     if (ret < 0) {
       BX_ERROR(("could not lseek() hard drive image file at byte %lu", (unsigned long)logical_sector * sect_size));
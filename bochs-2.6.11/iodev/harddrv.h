@@ -21,7 +21,7 @@
 #ifndef BX_IODEV_HDDRIVE_H
 #define BX_IODEV_HDDRIVE_H
 
-#define MAX_MULTIPLE_SECTORS 16
+#define MAX_MULTIPLE_SECTORS 128
 
 typedef enum _sense {
       SENSE_NONE = 0, SENSE_NOT_READY = 2, SENSE_ILLEGAL_REQUEST = 5,
@@ -172,6 +172,7 @@ public:
   virtual Bit32u   get_first_cd_handle(void);
   virtual bx_bool  get_cd_media_status(Bit32u handle);
   virtual bx_bool  set_cd_media_status(Bit32u handle, bx_bool status);
+  virtual bx_bool  clone_images(int instance);
 #if BX_SUPPORT_PCI
   virtual bx_bool  bmdma_read_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size);
   virtual bx_bool  bmdma_write_sector(Bit8u channel, Bit8u *buffer);
@@ -195,6 +196,10 @@ public:
 
   static Bit32u read_handler(void *this_ptr, Bit32u address, unsigned io_len);
   static void   write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len);
+  static Bit32u bulk_read_handler(void *this_ptr, Bit32u address, unsigned io_len, Bit8u *dst, Bit32u count);
+  static Bit32u bulk_write_handler(void *this_ptr, Bit32u address, unsigned io_len, const Bit8u *src, Bit32u count);
+  BX_HD_SMF Bit32u bulk_read(Bit32u address, unsigned io_len, Bit8u *dst, Bit32u count);
+  BX_HD_SMF Bit32u bulk_write(Bit32u address, unsigned io_len, const Bit8u *src, Bit32u count);
 
   static void seek_timer_handler(void *);
   BX_HD_SMF void seek_timer(void);
@@ -249,6 +254,10 @@ private:
       Bit64s curr_lsector;
       Bit64s next_lsector;
       unsigned sect_size;
+      // sectors read ahead from the image for the current read command
+      Bit8u *prefetch_buf;
+      Bit64s prefetch_lsector;
+      unsigned prefetch_count;
 
       Bit8u model_no[41];
       int statusbar_id;
@@ -0,0 +1,447 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+/////////////////////////////////////////////////////////////////////////
+
+// Read-only compressed disk image, see compressed.h for the file layout.
+// Blocks use the LZ4 block format; the codec is implemented here so the
+// image format doesn't depend on an external library.
+
+// Define BX_PLUGGABLE in files that can be compiled into plugins.  For
+// platforms that require a special tag on exported symbols, BX_PLUGGABLE
+// is used to know when we are exporting symbols and when we are importing.
+#define BX_PLUGGABLE
+
+#ifdef BXIMAGE
+#include "config.h"
+#include "misc/bxcompat.h"
+#include "misc/bswap.h"
+#include "osdep.h"
+#else
+#include "iodev.h"
+#endif
+#include "hdimage.h"
+#include "compressed.h"
+
+#define LOG_THIS bx_devices.pluginHDImageCtl->
+
+/*** LZ4 block format codec ***/
+
+#define LZ4_MINMATCH     4
+#define LZ4_LASTLITERALS 5    // the last 5 bytes are always literals
+#define LZ4_MFLIMIT      12   // no match may start in the last 12 bytes
+#define LZ4_HASH_BITS    12
+#define LZ4_MAX_OFFSET   65535
+
+static inline Bit32u lz4_read32(const Bit8u *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((Bit32u)p[3] << 24);
+}
+
+static inline Bit32u lz4_hash(Bit32u seq)
+{
+  return (seq * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+// Emit one sequence: literals, then a match unless mlen is 0 (last sequence).
+// Returns the new output pointer, NULL if it would overflow dst_end.
+static Bit8u *lz4_emit(Bit8u *op, Bit8u *dst_end, const Bit8u *lit, Bit32u litlen,
+                       Bit32u offset, Bit32u mlen)
+{
+  if (op + 1 + litlen / 255 + 1 + litlen + 2 + (mlen / 255) + 1 > dst_end)
+    return NULL;
+  Bit8u *token = op++;
+  if (litlen >= 15) {
+    *token = 15 << 4;
+    Bit32u len = litlen - 15;
+    for (; len >= 255; len -= 255) *op++ = 255;
+    *op++ = (Bit8u) len;
+  } else {
+    *token = (Bit8u)(litlen << 4);
+  }
+  memcpy(op, lit, litlen);
+  op += litlen;
+  if (mlen == 0)
+    return op;
+
+  *op++ = (Bit8u) offset;
+  *op++ = (Bit8u)(offset >> 8);
+  Bit32u ml = mlen - LZ4_MINMATCH;
+  if (ml >= 15) {
+    *token |= 15;
+    ml -= 15;
+    for (; ml >= 255; ml -= 255) *op++ = 255;
+    *op++ = (Bit8u) ml;
+  } else {
+    *token |= (Bit8u) ml;
+  }
+  return op;
+}
+
+// Greedy single-probe compressor. Returns the compressed size, or 0 if the
+// result doesn't fit in dst_len.
+static Bit32u lz4_compress(const Bit8u *src, Bit32u src_len, Bit8u *dst, Bit32u dst_len)
+{
+  Bit32u table[1 << LZ4_HASH_BITS];
+  Bit8u *op = dst, *dst_end = dst + dst_len;
+  Bit32u ip = 0, anchor = 0;
+
+  memset(table, 0xff, sizeof(table));
+  if (src_len > LZ4_MFLIMIT) {
+    Bit32u mflimit = src_len - LZ4_MFLIMIT;
+    Bit32u matchlimit = src_len - LZ4_LASTLITERALS;
+    while (ip < mflimit) {
+      Bit32u seq = lz4_read32(src + ip);
+      Bit32u h = lz4_hash(seq);
+      Bit32u ref = table[h];
+      table[h] = ip;
+      if ((ref == 0xffffffff) || (ip - ref > LZ4_MAX_OFFSET) || (lz4_read32(src + ref) != seq)) {
+        ip++;
+        continue;
+      }
+      Bit32u mlen = LZ4_MINMATCH;
+      while ((ip + mlen < matchlimit) && (src[ref + mlen] == src[ip + mlen])) mlen++;
+      op = lz4_emit(op, dst_end, src + anchor, ip - anchor, ip - ref, mlen);
+      if (op == NULL) return 0;
+      ip += mlen;
+      anchor = ip;
+    }
+  }
+  op = lz4_emit(op, dst_end, src + anchor, src_len - anchor, 0, 0);
+  if (op == NULL) return 0;
+  return (Bit32u)(op - dst);
+}
+
+// Returns the decompressed size, or -1 if the input is malformed or
+// doesn't decompress to exactly dst_len bytes.
+static int lz4_decompress(const Bit8u *src, Bit32u src_len, Bit8u *dst, Bit32u dst_len)
+{
+  const Bit8u *ip = src, *src_end = src + src_len;
+  Bit8u *op = dst, *dst_end = dst + dst_len;
+
+  while (ip < src_end) {
+    Bit32u token = *ip++;
+    Bit32u litlen = token >> 4;
+    if (litlen == 15) {
+      Bit8u b;
+      do {
+        if (ip >= src_end) return -1;
+        b = *ip++;
+        litlen += b;
+      } while (b == 255);
+    }
+    if ((litlen > (Bit32u)(src_end - ip)) || (litlen > (Bit32u)(dst_end - op)))
+      return -1;
+    memcpy(op, ip, litlen);
+    ip += litlen;
+    op += litlen;
+    if (ip == src_end)
+      break; // last sequence has no match
+
+    if (src_end - ip < 2) return -1;
+    Bit32u offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if ((offset == 0) || (offset > (Bit32u)(op - dst))) return -1;
+    Bit32u mlen = token & 15;
+    if (mlen == 15) {
+      Bit8u b;
+      do {
+        if (ip >= src_end) return -1;
+        b = *ip++;
+        mlen += b;
+      } while (b == 255);
+    }
+    mlen += LZ4_MINMATCH;
+    if (mlen > (Bit32u)(dst_end - op)) return -1;
+    // byte by byte: the match may overlap the bytes it produces
+    const Bit8u *match = op - offset;
+    while (mlen--) *op++ = *match++;
+  }
+  return (op == dst_end) ? (int)dst_len : -1;
+}
+
+/*** compressed_image_t function definitions ***/
+
+compressed_image_t::compressed_image_t()
+{
+  fd = -1;
+  index = NULL;
+  zbuf = NULL;
+  for (int i = 0; i < COMPRESSED_CACHE_BLOCKS; i++) {
+    cache[i].data = NULL;
+  }
+}
+
+compressed_image_t::~compressed_image_t()
+{
+  close();
+}
+
+int compressed_image_t::check_format(int fd, Bit64u imgsize)
+{
+  compressed_header_t header;
+
+  if (imgsize < sizeof(header))
+    return HDIMAGE_SIZE_ERROR;
+  if (bx_read_image(fd, 0, &header, sizeof(header)) != sizeof(header))
+    return HDIMAGE_READ_ERROR;
+  if ((strcmp((char*)header.standard.magic, STANDARD_HEADER_MAGIC) != 0) ||
+      (strcmp((char*)header.standard.type, COMPRESSED_TYPE) != 0) ||
+      (strcmp((char*)header.standard.subtype, COMPRESSED_SUBTYPE) != 0))
+    return HDIMAGE_NO_SIGNATURE;
+  if (dtoh32(header.standard.version) != COMPRESSED_VERSION)
+    return HDIMAGE_VERSION_ERROR;
+  return HDIMAGE_FORMAT_OK;
+}
+
+int compressed_image_t::open(const char* _pathname, int flags)
+{
+  compressed_header_t header;
+  Bit64u imgsize = 0;
+
+  pathname = _pathname;
+  if ((flags & O_ACCMODE) != O_RDONLY) {
+    BX_INFO(("compressed image '%s' is read-only, opening it read-only", pathname));
+  }
+  fd = hdimage_open_file(pathname, O_RDONLY, &imgsize, &mtime);
+  if (fd < 0)
+    return -1;
+  if (check_format(fd, imgsize) != HDIMAGE_FORMAT_OK) {
+    BX_ERROR(("'%s' is not a compressed disk image", pathname));
+    ::close(fd);
+    fd = -1;
+    return -1;
+  }
+  bx_read_image(fd, 0, &header, sizeof(header));
+  blocks = dtoh32(header.specific.blocks);
+  block_size = dtoh32(header.specific.block);
+  hd_size = dtoh64(header.specific.disk);
+
+  index = new Bit64u[blocks + 1];
+  int index_len = (blocks + 1) * sizeof(Bit64u);
+  if (bx_read_image(fd, STANDARD_HEADER_SIZE, index, index_len) != index_len) {
+    BX_ERROR(("compressed image '%s': can't read block index", pathname));
+    close();
+    return -1;
+  }
+  for (Bit32u i = 0; i <= blocks; i++) {
+    index[i] = dtoh64(index[i]);
+  }
+  zbuf = new Bit8u[block_size];
+  for (int i = 0; i < COMPRESSED_CACHE_BLOCKS; i++) {
+    cache[i].block = 0xffffffff;
+    cache[i].last_use = 0;
+    cache[i].data = new Bit8u[block_size];
+  }
+  use_counter = 0;
+  pos = 0;
+
+  BX_INFO(("'compressed' disk opened: %s, %d blocks of %d bytes", pathname, blocks, block_size));
+  return fd;
+}
+
+void compressed_image_t::close()
+{
+  if (fd > -1) {
+    bx_close_image(fd, pathname);
+    fd = -1;
+  }
+  delete [] index;
+  index = NULL;
+  delete [] zbuf;
+  zbuf = NULL;
+  for (int i = 0; i < COMPRESSED_CACHE_BLOCKS; i++) {
+    delete [] cache[i].data;
+    cache[i].data = NULL;
+  }
+}
+
+Bit64s compressed_image_t::lseek(Bit64s offset, int whence)
+{
+  if (whence == SEEK_SET) {
+    pos = offset;
+  } else if (whence == SEEK_CUR) {
+    pos += offset;
+  } else if (whence == SEEK_END) {
+    pos = hd_size + offset;
+  } else {
+    return -1;
+  }
+  if ((pos < 0) || ((Bit64u)pos > hd_size))
+    return -1;
+  return pos;
+}
+
+// Return the decompressed data of a block, from the cache if possible.
+// The least recently used cache entry is replaced on a miss.
+const Bit8u *compressed_image_t::get_block(Bit32u block)
+{
+  int victim = 0;
+
+  use_counter++;
+  for (int i = 0; i < COMPRESSED_CACHE_BLOCKS; i++) {
+    if (cache[i].block == block) {
+      cache[i].last_use = use_counter;
+      return cache[i].data;
+    }
+    if (cache[i].last_use < cache[victim].last_use)
+      victim = i;
+  }
+
+  Bit8u *data = cache[victim].data;
+  Bit32u len = block_size;
+  if ((Bit64u)(block + 1) * block_size > hd_size)
+    len = (Bit32u)(hd_size - (Bit64u)block * block_size);
+  Bit64u zlen = index[block + 1] - index[block];
+
+  cache[victim].block = 0xffffffff;
+  if (zlen == 0) {
+    memset(data, 0, len);
+  } else if (zlen == len) {
+    if (bx_read_image(fd, index[block], data, len) != (int)len)
+      return NULL;
+  } else {
+    if ((zlen > len) || (bx_read_image(fd, index[block], zbuf, (int)zlen) != (int)zlen))
+      return NULL;
+    if (lz4_decompress(zbuf, (Bit32u)zlen, data, len) < 0) {
+      BX_ERROR(("compressed image '%s': block %d is corrupt", pathname, block));
+      return NULL;
+    }
+  }
+  cache[victim].block = block;
+  cache[victim].last_use = use_counter;
+  return data;
+}
+
+ssize_t compressed_image_t::read(void* buf, size_t count)
+{
+  Bit8u *cbuf = (Bit8u*)buf;
+  size_t n = 0;
+
+  while ((n < count) && ((Bit64u)pos < hd_size)) {
+    Bit32u block = (Bit32u)(pos / block_size);
+    Bit32u offset = (Bit32u)(pos % block_size);
+    Bit32u len = block_size - offset;
+    if (len > count - n) len = count - n;
+    if ((Bit64u)(pos + len) > hd_size) len = (Bit32u)(hd_size - pos);
+
+    const Bit8u *data = get_block(block);
+    if (data == NULL)
+      return -1;
+    memcpy(cbuf, data + offset, len);
+    cbuf += len;
+    pos += len;
+    n += len;
+  }
+  return n;
+}
+
+ssize_t compressed_image_t::write(const void* buf, size_t count)
+{
+  UNUSED(buf);
+  UNUSED(count);
+  BX_ERROR(("compressed image '%s' is read-only", pathname));
+  return -1;
+}
+
+int compressed_image_t::create(const char *pathname, device_image_t *src, Bit64u size)
+{
+  compressed_header_t header;
+  Bit32u bs = COMPRESSED_BLOCK_SIZE;
+  Bit32u nblocks = (Bit32u)((size + bs - 1) / bs);
+  int ret = -1;
+
+  int ofd = ::open(pathname, O_RDWR | O_CREAT | O_TRUNC
+#ifdef O_BINARY
+                   | O_BINARY
+#endif
+                   , S_IWUSR | S_IRUSR | S_IRGRP | S_IWGRP);
+  if (ofd < 0)
+    return -1;
+
+  memset(&header, 0, sizeof(header));
+  strcpy((char*)header.standard.magic, STANDARD_HEADER_MAGIC);
+  strcpy((char*)header.standard.type, COMPRESSED_TYPE);
+  strcpy((char*)header.standard.subtype, COMPRESSED_SUBTYPE);
+  header.standard.version = htod32(COMPRESSED_VERSION);
+  header.standard.header = htod32(STANDARD_HEADER_SIZE);
+  header.specific.blocks = htod32(nblocks);
+  header.specific.block = htod32(bs);
+  header.specific.disk = htod64(size);
+
+  Bit64u *idx = new Bit64u[nblocks + 1];
+  Bit8u *data = new Bit8u[bs];
+  Bit8u *zdata = new Bit8u[bs];
+  Bit64u offset = STANDARD_HEADER_SIZE + (Bit64u)(nblocks + 1) * sizeof(Bit64u);
+  int idx_len = (nblocks + 1) * sizeof(Bit64u);
+
+  if (bx_write_image(ofd, 0, &header, sizeof(header)) != sizeof(header))
+    goto done;
+
+  for (Bit32u i = 0; i < nblocks; i++) {
+    Bit32u len = bs;
+    if ((Bit64u)(i + 1) * bs > size)
+      len = (Bit32u)(size - (Bit64u)i * bs);
+    idx[i] = htod64(offset);
+    if (src == NULL)
+      continue;
+    if ((src->lseek((Bit64u)i * bs, SEEK_SET) < 0) || (src->read(data, len) != (ssize_t)len))
+      goto done;
+
+    Bit32u j;
+    for (j = 0; (j < len) && (data[j] == 0); j++);
+    if (j == len)
+      continue; // zero block, no data
+
+    Bit32u zlen = lz4_compress(data, len, zdata, len - 1);
+    if (zlen > 0) {
+      if (bx_write_image(ofd, offset, zdata, zlen) != (int)zlen)
+        goto done;
+      offset += zlen;
+    } else {
+      if (bx_write_image(ofd, offset, data, len) != (int)len)
+        goto done;
+      offset += len;
+    }
+  }
+  idx[nblocks] = htod64(offset);
+  if (bx_write_image(ofd, STANDARD_HEADER_SIZE, idx, idx_len) == idx_len)
+    ret = 0;
+
+done:
+  ::close(ofd);
+  delete [] idx;
+  delete [] data;
+  delete [] zdata;
+  return ret;
+}
+
+#ifndef BXIMAGE
+bx_bool compressed_image_t::save_state(const char *backup_fname)
+{
+  // nothing changes in a read-only image
+  UNUSED(backup_fname);
+  return 1;
+}
+
+void compressed_image_t::restore_state(const char *backup_fname)
+{
+  UNUSED(backup_fname);
+}
+#endif
@@ -0,0 +1,99 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+/////////////////////////////////////////////////////////////////////////
+
+// Read-only compressed disk image. The disk is cut into fixed size blocks,
+// each stored LZ4 block compressed (or raw if it doesn't shrink). All-zero
+// blocks take no space at all. File layout:
+//   512 byte standard header
+//   index: (blocks + 1) little endian 64-bit file offsets; block i spans
+//          index[i] .. index[i+1], length 0 = zero block, length equal to
+//          the block size = stored raw
+//   block data
+
+#ifndef BX_COMPRESSED_IMAGE_H
+#define BX_COMPRESSED_IMAGE_H
+
+#define COMPRESSED_TYPE    "Compressed"
+#define COMPRESSED_SUBTYPE "LZ4"
+#define COMPRESSED_VERSION (0x00010000)
+#define COMPRESSED_BLOCK_SIZE (64 * 1024)
+#define COMPRESSED_CACHE_BLOCKS 16   // decompressed blocks kept in memory
+
+ typedef struct
+ {
+   // the fields in the header are kept in little endian
+   Bit32u  blocks;     // #blocks in the disk
+   Bit32u  block;      // block size in bytes
+   Bit64u  disk;       // disk size in bytes
+ } compressed_specific_header_t;
+
+ typedef struct
+ {
+   standard_header_t standard;
+   compressed_specific_header_t specific;
+
+   Bit8u padding[STANDARD_HEADER_SIZE - (sizeof (standard_header_t) + sizeof (compressed_specific_header_t))];
+ } compressed_header_t;
+
+class compressed_image_t : public device_image_t
+{
+  public:
+      compressed_image_t();
+      virtual ~compressed_image_t();
+
+      int open(const char* pathname, int flags);
+      void close();
+      Bit64s lseek(Bit64s offset, int whence);
+      ssize_t read(void* buf, size_t count);
+      ssize_t write(const void* buf, size_t count);
+
+      Bit32u get_capabilities() {return HDIMAGE_READONLY;}
+      static int check_format(int fd, Bit64u imgsize);
+
+      // Write a compressed image of 'size' bytes read from 'src' (all zero
+      // if src is NULL). Returns 0 on success.
+      static int create(const char *pathname, device_image_t *src, Bit64u size);
+
+#ifndef BXIMAGE
+      bx_bool save_state(const char *backup_fname);
+      void restore_state(const char *backup_fname);
+#endif
+
+  private:
+      const Bit8u *get_block(Bit32u block);
+
+      int fd;
+      const char *pathname;
+      Bit32u blocks;
+      Bit32u block_size;
+      Bit64u *index;
+      Bit8u *zbuf;           // compressed data of the block being loaded
+      Bit64s pos;
+      // LRU cache of decompressed blocks
+      struct {
+        Bit32u block;
+        Bit32u last_use;
+        Bit8u *data;
+      } cache[COMPRESSED_CACHE_BLOCKS];
+      Bit32u use_counter;
+};
+
+#endif
@@ -43,6 +43,7 @@
 #include "vvfat.h"
 #include "vpc-img.h"
 #include "vbox.h"
+#include "compressed.h"
 
 #if BX_HAVE_SYS_MMAN_H
 #include <sys/mman.h>
@@ -147,6 +148,14 @@ device_image_t* bx_hdimage_ctl_c::init_image(Bit8u image_mode, Bit64u disk_size,
       hdimage = new vbox_image_t();
       break;
 
+    case BX_HDIMAGE_MODE_COW:
+      hdimage = new cow_image_t(journal);
+      break;
+
+    case BX_HDIMAGE_MODE_COMPRESSED:
+      hdimage = new compressed_image_t();
+      break;
+
     default:
       BX_PANIC(("Disk image mode '%s' not available", hdimage_mode_names[image_mode]));
       break;
@@ -314,6 +323,8 @@ int hdimage_detect_image_mode(const char *pathname)
     result = BX_HDIMAGE_MODE_VPC;
   } else if (vbox_image_t::check_format(fd, image_size) >= HDIMAGE_FORMAT_OK) {
     result = BX_HDIMAGE_MODE_VBOX;
+  } else if (compressed_image_t::check_format(fd, image_size) == HDIMAGE_FORMAT_OK) {
+    result = BX_HDIMAGE_MODE_COMPRESSED;
   } else if (flat_image_t::check_format(fd, image_size) == HDIMAGE_FORMAT_OK) {
     result = BX_HDIMAGE_MODE_FLAT;
   }
@@ -527,6 +538,51 @@ void device_image_t::register_state(bx_list_c *parent)
 
 /*** flat_image_t function definitions ***/
 
+flat_image_t::flat_image_t()
+{
+  fd = -1;
+#if BX_HDIMAGE_READAHEAD
+  ra_started = 0;
+  ra_buf = NULL;
+#ifdef _POSIX_MAPPED_FILES
+  map = NULL;
+#endif
+#endif
+}
+
+#if BX_HDIMAGE_READAHEAD
+BX_THREAD_FUNC(hdimage_readahead_thread, indata)
+{
+  ((flat_image_t*)indata)->readahead_loop();
+  BX_THREAD_EXIT;
+}
+
+void flat_image_t::readahead_loop(void)
+{
+  while (1) {
+    BX_LOCK(ra_mutex);
+    if (ra_stop) {
+      ra_exited = 1;
+      BX_UNLOCK(ra_mutex);
+      break;
+    }
+    if (ra_pending) {
+      ra_pending = 0;
+      Bit32u len = BX_HDIMAGE_READAHEAD_SIZE;
+      if ((Bit64u)ra_req + len > hd_size)
+        len = (Bit32u)(hd_size - ra_req);
+      ssize_t ret = ::pread(fd, ra_buf, len, (off_t)ra_req);
+      ra_start = ra_req;
+      ra_len = (ret > 0) ? (Bit32u)ret : 0;
+      BX_UNLOCK(ra_mutex);
+    } else {
+      BX_UNLOCK(ra_mutex);
+      bx_wait_for_event(&ra_event);
+    }
+  }
+}
+#endif
+
 int flat_image_t::open(const char* _pathname, int flags)
 {
   pathname = _pathname;
@@ -538,16 +594,163 @@ int flat_image_t::open(const char* _pathname, int flags)
   if ((hd_size % sect_size) != 0) {
     BX_PANIC(("size of disk image must be multiple of %d bytes", sect_size));
   }
+#if BX_HDIMAGE_READAHEAD
+  pos = 0;
+  last_end = -1;
+#ifdef _POSIX_MAPPED_FILES
+  if ((Bit64u)(size_t)hd_size == hd_size) {
+    map_writable = ((flags & O_ACCMODE) != O_RDONLY);
+    void *addr = mmap(NULL, (size_t)hd_size, PROT_READ | (map_writable ? PROT_WRITE : 0),
+                      MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      BX_INFO(("failed to mmap flat disk image - using conventional file access"));
+    } else {
+      map = (Bit8u*)addr;
+#ifdef MADV_HUGEPAGE
+      // only honoured where the host supports huge pages for file mappings
+      madvise(map, (size_t)hd_size, MADV_HUGEPAGE);
+#endif
+      return fd;
+    }
+  }
+#endif
+  ra_stop = 0;
+  ra_exited = 0;
+  ra_pending = 0;
+  ra_len = 0;
+  if (ra_buf == NULL)
+    ra_buf = new Bit8u[BX_HDIMAGE_READAHEAD_SIZE];
+  BX_INIT_MUTEX(ra_mutex);
+  bx_create_event(&ra_event);
+  BX_THREAD_CREATE(hdimage_readahead_thread, this, ra_thread);
+  ra_started = 1;
+#endif
   return fd;
 }
 
 void flat_image_t::close()
 {
+#if BX_HDIMAGE_READAHEAD
+#ifdef _POSIX_MAPPED_FILES
+  if (map != NULL) {
+    // dirty pages reach the file through the page cache; make sure they're
+    // on disk before the image is closed
+    if (map_writable && (msync(map, (size_t)hd_size, MS_SYNC) != 0))
+      BX_ERROR(("failed to msync flat disk image"));
+    munmap(map, (size_t)hd_size);
+    map = NULL;
+  }
+#endif
+  if (ra_started) {
+    BX_LOCK(ra_mutex);
+    ra_stop = 1;
+    BX_UNLOCK(ra_mutex);
+    // the thread may be between its check and the wait, keep waking it
+    while (1) {
+      bx_set_event(&ra_event);
+      BX_LOCK(ra_mutex);
+      bx_bool exited = ra_exited;
+      BX_UNLOCK(ra_mutex);
+      if (exited) break;
+      BX_MSLEEP(1);
+    }
+    BX_THREAD_JOIN(ra_thread);
+    bx_destroy_event(&ra_event);
+    BX_FINI_MUTEX(ra_mutex);
+    delete [] ra_buf;
+    ra_buf = NULL;
+    ra_started = 0;
+  }
+#endif
   if (fd > -1) {
     bx_close_image(fd, pathname);
   }
 }
 
+#if BX_HDIMAGE_READAHEAD
+Bit64s flat_image_t::lseek(Bit64s offset, int whence)
+{
+  switch (whence) {
+    case SEEK_SET:
+      pos = offset;
+      break;
+    case SEEK_CUR:
+      pos += offset;
+      break;
+    case SEEK_END:
+      pos = (Bit64s)hd_size + offset;
+      break;
+    default:
+      return -1;
+  }
+  return pos;
+}
+
+ssize_t flat_image_t::read(void* buf, size_t count)
+{
+  ssize_t ret;
+  bx_bool sequential = (pos == last_end);
+
+#ifdef _POSIX_MAPPED_FILES
+  if (map != NULL) {
+    if ((pos < 0) || ((Bit64u)pos >= hd_size))
+      return 0;
+    if ((Bit64u)(pos + count) > hd_size)
+      count = (size_t)(hd_size - pos);
+    memcpy(buf, map + pos, count);
+    pos += count;
+    return count;
+  }
+#endif
+  BX_LOCK(ra_mutex);
+  if ((ra_len > 0) && (pos >= ra_start) &&
+      ((Bit64u)(pos + count) <= (Bit64u)(ra_start + ra_len))) {
+    memcpy(buf, ra_buf + (pos - ra_start), count);
+    ret = count;
+  } else {
+    ret = ::pread(fd, buf, count, (off_t)pos);
+  }
+  if (ret > 0) {
+    pos += ret;
+    last_end = pos;
+    // refill once less than half of the buffer is left ahead of the guest
+    Bit64s ahead = ra_start + ra_len - pos;
+    if (sequential && ((Bit64u)pos < hd_size) &&
+        ((ra_len == 0) || (pos < ra_start) || (ahead < BX_HDIMAGE_READAHEAD_SIZE / 2))) {
+      ra_req = pos;
+      ra_pending = 1;
+    }
+  }
+  bx_bool wake = ra_pending;
+  BX_UNLOCK(ra_mutex);
+  if (wake)
+    bx_set_event(&ra_event);
+  return ret;
+}
+
+ssize_t flat_image_t::write(const void* buf, size_t count)
+{
+#ifdef _POSIX_MAPPED_FILES
+  if (map != NULL) {
+    if (!map_writable || (pos < 0) || ((Bit64u)(pos + count) > hd_size))
+      return -1;
+    memcpy(map + pos, buf, count);
+    pos += count;
+    return count;
+  }
+#endif
+  BX_LOCK(ra_mutex);
+  ssize_t ret = ::pwrite(fd, (char*) buf, count, (off_t)pos);
+  if ((ret > 0) && (ra_len > 0) && (pos < ra_start + ra_len) &&
+      (pos + ret > ra_start)) {
+    ra_len = 0; // the read-ahead data is stale now
+  }
+  BX_UNLOCK(ra_mutex);
+  if (ret > 0)
+    pos += ret;
+  return ret;
+}
+#else
 Bit64s flat_image_t::lseek(Bit64s offset, int whence)
 {
   return (Bit64s)::lseek(fd, (off_t)offset, whence);
@@ -562,6 +765,7 @@ ssize_t flat_image_t::write(const void* buf, size_t count)
 {
   return ::write(fd, (char*) buf, count);
 }
+#endif
 
 int flat_image_t::check_format(int fd, Bit64u imgsize)
 {
@@ -579,6 +783,11 @@ int flat_image_t::check_format(int fd, Bit64u imgsize)
 #ifndef BXIMAGE
 bx_bool flat_image_t::save_state(const char *backup_fname)
 {
+#if BX_HDIMAGE_READAHEAD && defined(_POSIX_MAPPED_FILES)
+  // the backup reads the file, so flush the mapping first
+  if ((map != NULL) && map_writable)
+    msync(map, (size_t)hd_size, MS_SYNC);
+#endif
   return hdimage_backup_file(fd, backup_fname);
 }
 
@@ -1772,7 +1981,8 @@ ssize_t redolog_t::read(void* buf, size_t count)
   BX_DEBUG(("redolog : reading index %d, mapping to %d", extent_index, dtoh32(catalog[extent_index])));
 
   if (dtoh32(catalog[extent_index]) == REDOLOG_PAGE_NOT_ALLOCATED) {
-    // page not allocated
+    // page not allocated, skip the block so that multi-sector reads advance
+    lseek(512, SEEK_CUR);
     return 0;
   }
 
@@ -1795,6 +2005,7 @@ ssize_t redolog_t::read(void* buf, size_t count)
     BX_DEBUG(("read not in redolog"));
 
     // bitmap says block not in redolog
+    lseek(512, SEEK_CUR);
     return 0;
   }
 
@@ -2217,6 +2428,9 @@ ssize_t undoable_image_t::read(void* buf, size_t count)
     if ((size_t)redolog->read(cbuf, 512) != 512) {
       ret = ro_disk->read(cbuf, 512);
       if (ret < 0) break;
+    } else {
+      // keep the base image in step for multi-sector reads
+      ro_disk->lseek(redolog->lseek(0, SEEK_CUR), SEEK_SET);
     }
     cbuf += 512;
     n += 512;
@@ -2391,6 +2605,9 @@ ssize_t volatile_image_t::read(void* buf, size_t count)
     if ((size_t)redolog->read(cbuf, 512) != 512) {
       ret = ro_disk->read(cbuf, 512);
       if (ret < 0) break;
+    } else {
+      // keep the base image in step for multi-sector reads
+      ro_disk->lseek(redolog->lseek(0, SEEK_CUR), SEEK_SET);
     }
     cbuf += 512;
     n += 512;
@@ -2448,3 +2665,354 @@ void volatile_image_t::restore_state(const char *backup_fname)
 #endif
 }
 #endif
+
+/*** cow_image_t function definitions ***/
+
+cow_image_t::cow_image_t(const char* _overlay_name)
+{
+  ro_disk = NULL;
+  base_name = NULL;
+  base_mode = BX_HDIMAGE_MODE_UNKNOWN;
+  caps = 0;
+  fd = -1;
+  index = NULL;
+  cluster_buf = NULL;
+  pos = 0;
+  overlay_name = NULL;
+  if (_overlay_name != NULL) {
+    if ((strlen(_overlay_name) > 0) && (strcmp(_overlay_name,"none") != 0)) {
+      overlay_name = new char[strlen(_overlay_name) + 1];
+      strcpy(overlay_name, _overlay_name);
+    }
+  }
+}
+
+cow_image_t::~cow_image_t()
+{
+  delete ro_disk;
+  delete [] base_name;
+}
+
+int cow_image_t::open(const char* pathname, int flags)
+{
+  UNUSED(flags);
+  if (access(pathname, F_OK) < 0) {
+    BX_PANIC(("r/o disk image doesn't exist"));
+  }
+  int mode = hdimage_detect_image_mode(pathname);
+  if (mode == BX_HDIMAGE_MODE_UNKNOWN) {
+    BX_PANIC(("r/o disk image mode not detected"));
+    return -1;
+  } else {
+    BX_INFO(("base image mode = '%s'", hdimage_mode_names[mode]));
+  }
+  ro_disk = DEV_hdimage_init_image(mode, 0, NULL);
+  if (ro_disk == NULL) {
+    return -1;
+  }
+  if (ro_disk->open(pathname, O_RDONLY) < 0)
+    return -1;
+  base_mode = mode;
+  delete [] base_name;
+  base_name = new char[strlen(pathname) + 1];
+  strcpy(base_name, pathname);
+
+  hd_size = ro_disk->hd_size;
+  if (ro_disk->get_capabilities() & HDIMAGE_HAS_GEOMETRY) {
+    cylinders = ro_disk->cylinders;
+    heads = ro_disk->heads;
+    spt = ro_disk->spt;
+    caps = HDIMAGE_HAS_GEOMETRY;
+  } else if (cylinders == 0) {
+    caps = HDIMAGE_AUTO_GEOMETRY;
+  }
+  sect_size = ro_disk->sect_size;
+
+  // If not set, we make up the overlay filename from the pathname
+  if (overlay_name == NULL) {
+    overlay_name = new char[strlen(pathname) + COW_OVERLAY_EXTENSION_LENGTH + 1];
+    sprintf(overlay_name, "%s%s", pathname, COW_OVERLAY_EXTENSION);
+  }
+
+  if (open_overlay() < 0) {
+    if (create_overlay() < 0) {
+      BX_PANIC(("Can't open or create cow overlay '%s'", overlay_name));
+      return -1;
+    }
+  }
+  cluster_buf = new Bit8u[cluster_size];
+  caps |= HDIMAGE_CAN_CLONE;
+
+  BX_INFO(("'cow' disk opened: ro-file is '%s', overlay is '%s' (%d of %d clusters)",
+           pathname, overlay_name, allocated, clusters));
+
+  return 0;
+}
+
+// Open an existing overlay and load its index. Returns -1 if there is none.
+int cow_image_t::open_overlay(void)
+{
+  cow_header_t header;
+
+  fd = ::open(overlay_name, O_RDWR
+#ifdef O_BINARY
+              | O_BINARY
+#endif
+              );
+  if (fd < 0)
+    return -1;
+
+  if (bx_read_image(fd, 0, &header, sizeof(header)) != sizeof(header)) {
+    BX_PANIC(("cow overlay '%s': can't read header", overlay_name));
+    return -1;
+  }
+  if ((strcmp((char*)header.standard.magic, STANDARD_HEADER_MAGIC) != 0) ||
+      (strcmp((char*)header.standard.type, COW_TYPE) != 0) ||
+      (strcmp((char*)header.standard.subtype, COW_SUBTYPE) != 0) ||
+      (dtoh32(header.standard.version) != COW_VERSION)) {
+    BX_PANIC(("cow overlay '%s': bad header", overlay_name));
+    return -1;
+  }
+  if (dtoh64(header.specific.disk) != hd_size) {
+    BX_PANIC(("cow overlay '%s': size doesn't match the base image", overlay_name));
+    return -1;
+  }
+  clusters = dtoh32(header.specific.clusters);
+  cluster_size = dtoh32(header.specific.cluster);
+  data_start = dtoh64(header.specific.data);
+
+  index = new Bit32u[clusters];
+  if (bx_read_image(fd, STANDARD_HEADER_SIZE, index, clusters * sizeof(Bit32u)) !=
+      (int)(clusters * sizeof(Bit32u))) {
+    BX_PANIC(("cow overlay '%s': can't read cluster index", overlay_name));
+    return -1;
+  }
+  // a cluster is written before its index entry, so the highest entry
+  // tells where the next cluster goes even after a crash
+  allocated = 0;
+  for (Bit32u i = 0; i < clusters; i++) {
+    index[i] = dtoh32(index[i]);
+    if (index[i] > allocated) allocated = index[i];
+  }
+  return 0;
+}
+
+int cow_image_t::create_overlay(void)
+{
+  cow_header_t header;
+
+  BX_INFO(("cow : creating overlay %s", overlay_name));
+
+  fd = ::open(overlay_name, O_RDWR | O_CREAT | O_TRUNC
+#ifdef O_BINARY
+              | O_BINARY
+#endif
+              , S_IWUSR | S_IRUSR | S_IRGRP | S_IWGRP);
+  if (fd < 0)
+    return -1;
+
+  cluster_size = COW_CLUSTER_SIZE;
+  clusters = (Bit32u)((hd_size + cluster_size - 1) / cluster_size);
+  data_start = STANDARD_HEADER_SIZE + (Bit64s)clusters * sizeof(Bit32u);
+  data_start = (data_start + cluster_size - 1) & ~(Bit64s)(cluster_size - 1);
+  allocated = 0;
+
+  memset(&header, 0, sizeof(header));
+  strcpy((char*)header.standard.magic, STANDARD_HEADER_MAGIC);
+  strcpy((char*)header.standard.type, COW_TYPE);
+  strcpy((char*)header.standard.subtype, COW_SUBTYPE);
+  header.standard.version = htod32(COW_VERSION);
+  header.standard.header = htod32(STANDARD_HEADER_SIZE);
+  header.specific.clusters = htod32(clusters);
+  header.specific.cluster = htod32(cluster_size);
+  header.specific.disk = htod64(hd_size);
+  header.specific.data = htod64(data_start);
+
+  index = new Bit32u[clusters];
+  memset(index, 0, clusters * sizeof(Bit32u));
+  if ((bx_write_image(fd, 0, &header, sizeof(header)) != sizeof(header)) ||
+      (bx_write_image(fd, STANDARD_HEADER_SIZE, index, clusters * sizeof(Bit32u)) !=
+       (int)(clusters * sizeof(Bit32u)))) {
+    return -1;
+  }
+  return 0;
+}
+
+void cow_image_t::close()
+{
+  if (fd > -1) {
+    bx_close_image(fd, overlay_name);
+    fd = -1;
+  }
+  if (ro_disk != NULL)
+    ro_disk->close();
+
+  delete [] index;
+  index = NULL;
+  delete [] cluster_buf;
+  cluster_buf = NULL;
+  if (overlay_name != NULL)
+    delete [] overlay_name;
+  overlay_name = NULL;
+}
+
+Bit64s cow_image_t::lseek(Bit64s offset, int whence)
+{
+  if (whence == SEEK_SET) {
+    pos = offset;
+  } else if (whence == SEEK_CUR) {
+    pos += offset;
+  } else {
+    BX_ERROR(("cow: lseek() mode not supported yet"));
+    return -1;
+  }
+  if ((pos < 0) || ((Bit64u)pos > hd_size)) {
+    BX_ERROR(("cow: lseek() to byte %ld failed", (long)pos));
+    return -1;
+  }
+  return pos;
+}
+
+ssize_t cow_image_t::read(void* buf, size_t count)
+{
+  Bit8u *cbuf = (Bit8u*)buf;
+  size_t n = 0;
+
+  while (n < count) {
+    Bit32u cluster = (Bit32u)(pos / cluster_size);
+    Bit32u offset = (Bit32u)(pos % cluster_size);
+    Bit32u len = cluster_size - offset;
+    if (len > count - n) len = count - n;
+    if (cluster >= clusters) break;
+
+    if (index[cluster] != 0) {
+      if (bx_read_image(fd, cluster_offset(index[cluster]) + offset, cbuf, len) != (int)len)
+        return -1;
+    } else {
+      if ((ro_disk->lseek(pos, SEEK_SET) < 0) || (ro_disk->read(cbuf, len) != (ssize_t)len))
+        return -1;
+    }
+    cbuf += len;
+    pos += len;
+    n += len;
+  }
+  return n;
+}
+
+// Copy up a base image cluster into the overlay with len bytes at offset
+// replaced from buf. The cluster is written before its index entry.
+bx_bool cow_image_t::alloc_cluster(Bit32u cluster, Bit32u offset, const Bit8u *buf, Bit32u len)
+{
+  Bit64s base = (Bit64s)cluster * cluster_size;
+
+  if (len < cluster_size) {
+    Bit32u base_len = cluster_size;
+    if ((Bit64u)(base + base_len) > hd_size)
+      base_len = (Bit32u)(hd_size - base);
+    memset(cluster_buf, 0, cluster_size);
+    if ((ro_disk->lseek(base, SEEK_SET) < 0) ||
+        (ro_disk->read(cluster_buf, base_len) != (ssize_t)base_len))
+      return 0;
+  }
+  memcpy(cluster_buf + offset, buf, len);
+
+  Bit32u slot = allocated + 1;
+  if (bx_write_image(fd, cluster_offset(slot), cluster_buf, cluster_size) != (int)cluster_size)
+    return 0;
+  Bit32u entry = htod32(slot);
+  if (bx_write_image(fd, STANDARD_HEADER_SIZE + (Bit64s)cluster * sizeof(Bit32u),
+                     &entry, sizeof(entry)) != sizeof(entry))
+    return 0;
+  index[cluster] = slot;
+  allocated = slot;
+  return 1;
+}
+
+ssize_t cow_image_t::write(const void* buf, size_t count)
+{
+  const Bit8u *cbuf = (const Bit8u*)buf;
+  size_t n = 0;
+
+  while (n < count) {
+    Bit32u cluster = (Bit32u)(pos / cluster_size);
+    Bit32u offset = (Bit32u)(pos % cluster_size);
+    Bit32u len = cluster_size - offset;
+    if (len > count - n) len = count - n;
+    if (cluster >= clusters) break;
+
+    if (index[cluster] != 0) {
+      if (bx_write_image(fd, cluster_offset(index[cluster]) + offset, (void*)cbuf, len) != (int)len)
+        return -1;
+    } else {
+      if (!alloc_cluster(cluster, offset, cbuf, len))
+        return -1;
+    }
+    cbuf += len;
+    pos += len;
+    n += len;
+  }
+  return n;
+}
+
+#ifndef BXIMAGE
+bx_bool cow_image_t::save_state(const char *backup_fname)
+{
+  return hdimage_backup_file(fd, backup_fname);
+}
+
+void cow_image_t::restore_state(const char *backup_fname)
+{
+  bx_close_image(fd, overlay_name);
+  fd = -1;
+  delete [] index;
+  index = NULL;
+  if (!hdimage_copy_file(backup_fname, overlay_name)) {
+    BX_PANIC(("Failed to restore cow overlay '%s'", overlay_name));
+    return;
+  }
+  if (open_overlay() < 0) {
+    BX_PANIC(("Can't open restored cow overlay '%s'", overlay_name));
+  }
+}
+
+// Give a forked clone its own copy of the overlay, named "<overlay>.<instance>".
+// The file descriptors inherited from the parent share their file offset with
+// all other clones, so the base image is opened again and the overlay is
+// copied through a descriptor of its own. The cluster index in memory
+// matches the copy and is kept.
+int cow_image_t::clone_instance(unsigned instance)
+{
+  char *clone_name = new char[strlen(overlay_name) + 12];
+  sprintf(clone_name, "%s.%u", overlay_name, instance);
+
+  int src_fd = ::open(overlay_name, O_RDONLY
+#ifdef O_BINARY
+                      | O_BINARY
+#endif
+                      );
+  bx_bool copied = (src_fd >= 0) && hdimage_backup_file(src_fd, clone_name);
+  if (src_fd >= 0) ::close(src_fd);
+  int new_fd = copied ? ::open(clone_name, O_RDWR
+#ifdef O_BINARY
+                               | O_BINARY
+#endif
+                               ) : -1;
+  device_image_t *base = (new_fd >= 0) ? DEV_hdimage_init_image(base_mode, 0, NULL) : NULL;
+  if ((base == NULL) || (base->open(base_name, O_RDONLY) < 0)) {
+    BX_ERROR(("clone %u: can't set up cow overlay '%s'", instance, clone_name));
+    if (new_fd >= 0) ::close(new_fd);
+    delete base;
+    delete [] clone_name;
+    return -1;
+  }
+  // the old base instance belongs to the parent (a read ahead thread of it
+  // doesn't exist in this process), so it is left alone
+  ro_disk = base;
+  ::close(fd);
+  fd = new_fd;
+  delete [] overlay_name;
+  overlay_name = clone_name;
+  BX_INFO(("clone %u: cow overlay is '%s'", instance, overlay_name));
+  return 0;
+}
+#endif
@@ -30,6 +30,7 @@
 #define HDIMAGE_READONLY      1
 #define HDIMAGE_HAS_GEOMETRY  2
 #define HDIMAGE_AUTO_GEOMETRY 4
+#define HDIMAGE_CAN_CLONE     8
 
 // hdimage format check return values
 #define HDIMAGE_FORMAT_OK      0
@@ -85,6 +86,13 @@
 #define VOLATILE_REDOLOG_EXTENSION ".XXXXXX"
 #define VOLATILE_REDOLOG_EXTENSION_LENGTH (strlen(VOLATILE_REDOLOG_EXTENSION))
 
+#define COW_TYPE "Overlay"
+#define COW_SUBTYPE "Cow"
+#define COW_VERSION (0x00010000)
+#define COW_CLUSTER_SIZE (64 * 1024)
+#define COW_OVERLAY_EXTENSION ".cow"
+#define COW_OVERLAY_EXTENSION_LENGTH (strlen(COW_OVERLAY_EXTENSION))
+
  typedef struct
  {
    // the fields in the header are kept in little endian
@@ -120,6 +128,23 @@
    Bit8u padding[STANDARD_HEADER_SIZE - (sizeof (standard_header_t) + sizeof (redolog_specific_header_v1_t))];
  } redolog_header_v1_t;
 
+ typedef struct
+ {
+   // the fields in the header are kept in little endian
+   Bit32u  clusters;     // #entries in the cluster index
+   Bit32u  cluster;      // cluster size in bytes
+   Bit64u  disk;         // disk size in bytes
+   Bit64u  data;         // file offset of the first cluster
+ } cow_specific_header_t;
+
+ typedef struct
+ {
+   standard_header_t standard;
+   cow_specific_header_t specific;
+
+   Bit8u padding[STANDARD_HEADER_SIZE - (sizeof (standard_header_t) + sizeof (cow_specific_header_t))];
+ } cow_header_t;
+
 // htod : convert host to disk (little) endianness
 // dtoh : convert disk (little) to host endianness
 #if defined (BX_LITTLE_ENDIAN)
@@ -202,6 +227,9 @@ class device_image_t
       virtual void register_state(bx_list_c *parent);
       virtual bx_bool save_state(const char *backup_fname) {return 0;}
       virtual void restore_state(const char *backup_fname) {}
+      // Called in a forked clone of the simulation (HDIMAGE_CAN_CLONE) to
+      // detach the image from the parent. Returns non-negative if successful.
+      virtual int clone_instance(unsigned instance) {return -1;}
 #endif
 
       unsigned cylinders;
@@ -218,9 +246,21 @@ class device_image_t
 };
 
 // FLAT MODE
+// Flat images read ahead of sequential guest reads on a host thread, so
+// the emulator doesn't stall on the host disk for every sector.
+#if !defined(BXIMAGE) && !defined(WIN32)
+#define BX_HDIMAGE_READAHEAD 1
+#include "bxthread.h"
+#else
+#define BX_HDIMAGE_READAHEAD 0
+#endif
+#define BX_HDIMAGE_READAHEAD_SIZE 0x20000
+
 class flat_image_t : public device_image_t
 {
   public:
+      flat_image_t();
+
       // Open an image with specific flags. Returns non-negative if successful.
       int open(const char* pathname, int flags);
 
@@ -248,9 +288,37 @@ class flat_image_t : public device_image_t
       void restore_state(const char *backup_fname);
 #endif
 
+#if BX_HDIMAGE_READAHEAD
+      // Body of the read-ahead thread, runs until close()
+      void readahead_loop(void);
+#endif
+
   private:
       int fd;
       const char *pathname;
+#if BX_HDIMAGE_READAHEAD
+      Bit64s pos;           // file position, reads and writes use pread/pwrite
+      Bit64s last_end;      // end of the last guest read, to detect sequential access
+#ifdef _POSIX_MAPPED_FILES
+      // whole image mapped shared: sectors are copied straight from the
+      // mapping and the read-ahead thread isn't started
+      Bit8u *map;
+      bx_bool map_writable;
+#endif
+      // read-ahead buffer and the request for the thread; guarded by ra_mutex,
+      // which the thread also holds while reading so a guest access waits for it
+      BX_MUTEX(ra_mutex);
+      bx_thread_event_t ra_event;
+      BX_THREAD_VAR(ra_thread);
+      bx_bool ra_started;
+      bx_bool ra_stop;
+      bx_bool ra_exited;
+      bx_bool ra_pending;
+      Bit64s ra_req;
+      Bit8u *ra_buf;
+      Bit64s ra_start;
+      Bit32u ra_len;
+#endif
 };
 
 // CONCAT MODE
@@ -600,6 +668,69 @@ class volatile_image_t : public device_image_t
 };
 
 
+// COW MODE
+// Copy-on-write overlay over a read-only base image. The overlay file holds
+// a flat index with one entry per cluster (0 = still in the base image,
+// n = n-th cluster in the overlay), loaded into memory on open, so finding a
+// sector is a single array lookup. Removing the overlay file resets the disk
+// to the base image; a new overlay is just the header and a zeroed index.
+class cow_image_t : public device_image_t
+{
+  public:
+      // Contructor
+      cow_image_t(const char* overlay_name);
+      virtual ~cow_image_t();
+
+      // Open an image with specific flags. Returns non-negative if successful.
+      int open(const char* pathname, int flags);
+
+      // Close the image.
+      void close();
+
+      // Position ourselves. Return the resulting offset from the
+      // beginning of the file.
+      Bit64s lseek(Bit64s offset, int whence);
+
+      // Read count bytes to the buffer buf. Return the number of
+      // bytes read (count).
+      ssize_t read(void* buf, size_t count);
+
+      // Write count bytes from buf. Return the number of bytes
+      // written (count).
+      ssize_t write(const void* buf, size_t count);
+
+      // Get image capabilities
+      virtual Bit32u get_capabilities() {return caps;}
+
+#ifndef BXIMAGE
+      // Save/restore support
+      bx_bool save_state(const char *backup_fname);
+      void restore_state(const char *backup_fname);
+      int clone_instance(unsigned instance);
+#endif
+
+  private:
+      int    open_overlay(void);
+      int    create_overlay(void);
+      Bit64s cluster_offset(Bit32u slot) {return data_start + (Bit64s)(slot - 1) * cluster_size;}
+      bx_bool alloc_cluster(Bit32u cluster, Bit32u offset, const Bit8u *buf, Bit32u len);
+
+      device_image_t  *ro_disk;       // Read-only base disk instance
+      char            *base_name;     // Base image file name
+      int              base_mode;
+      char            *overlay_name;  // Overlay file name
+      int              fd;            // Overlay file
+      Bit32u          *index;         // Cluster index, host endianness
+      Bit32u           clusters;
+      Bit32u           cluster_size;
+      Bit32u           allocated;     // #clusters in the overlay
+      Bit64s           data_start;
+      Bit64s           pos;
+      Bit8u           *cluster_buf;   // Scratch buffer for copying up a base cluster
+      Bit32u           caps;
+};
+
+
 #ifndef BXIMAGE
 class bx_hdimage_ctl_c : public bx_hdimage_ctl_stub_c {
 public:
@@ -0,0 +1,527 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+// Paravirtual PCI device exporting the files of a host directory.
+//
+// The guest copies files out of the directory with a few port writes per
+// chunk, the data goes straight from the host file into guest memory.
+// Only regular files directly in the directory are visible, names with
+// path separators are refused so the guest can't leave it.
+// A recording logs the outcome of every command, a replay applies it
+// without looking at the directory.
+
+// Define BX_PLUGGABLE in files that can be compiled into plugins.  For
+// platforms that require a special tag on exported symbols, BX_PLUGGABLE
+// is used to know when we are exporting symbols and when we are importing.
+#define BX_PLUGGABLE
+
+#ifndef WIN32
+#include <dirent.h>
+#endif
+
+#include "iodev.h"
+
+#if BX_SUPPORT_PCI
+
+#include "pci.h"
+#include "hostshare.h"
+#include "replay.h"
+
+#define LOG_THIS theHostShare->
+#define BX_HOSTSHARE_THIS theHostShare->
+
+bx_hostshare_c *theHostShare = NULL;
+
+const Bit8u hostshare_iomask[32] = {4, 0, 0, 0, 4, 0, 0, 0, 4, 0, 0, 0, 4, 0, 0, 0,
+                                    4, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+// builtin configuration handling functions
+
+void hostshare_init_options(void)
+{
+  bx_param_c *misc = SIM->get_param("misc");
+  bx_list_c *menu = new bx_list_c(misc, "hostshare", "Host share device");
+  menu->set_options(menu->SHOW_PARENT);
+  bx_param_bool_c *enabled = new bx_param_bool_c(menu,
+    "enabled",
+    "Enable host share device",
+    "Enables the paravirtual PCI device exporting a host directory",
+    1);
+  new bx_param_filename_c(menu,
+    "dir",
+    "Shared directory",
+    "Host directory whose files the guest can read",
+    "", BX_PATHNAME_LEN);
+  enabled->set_dependent_list(menu->clone());
+}
+
+Bit32s hostshare_options_parser(const char *context, int num_params, char *params[])
+{
+  if (!strcmp(params[0], "hostshare")) {
+    bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_HOSTSHARE);
+    for (int i = 1; i < num_params; i++) {
+      if (SIM->parse_param_from_list(context, params[i], base) < 0) {
+        BX_ERROR(("%s: unknown parameter for hostshare ignored.", context));
+      }
+    }
+  } else {
+    BX_PANIC(("%s: unknown directive '%s'", context, params[0]));
+  }
+  return 0;
+}
+
+Bit32s hostshare_options_save(FILE *fp)
+{
+  return SIM->write_param_list(fp, (bx_list_c*) SIM->get_param(BXPN_HOSTSHARE), NULL, 0);
+}
+
+// device plugin entry points
+
+int CDECL libhostshare_LTX_plugin_init(plugin_t *plugin, plugintype_t type)
+{
+  theHostShare = new bx_hostshare_c();
+  BX_REGISTER_DEVICE_DEVMODEL(plugin, type, theHostShare, BX_PLUGIN_HOSTSHARE);
+  // add new configuration parameter for the config interface
+  hostshare_init_options();
+  // register add-on option for bochsrc and command line
+  SIM->register_addon_option("hostshare", hostshare_options_parser, hostshare_options_save);
+  return 0; // Success
+}
+
+void CDECL libhostshare_LTX_plugin_fini(void)
+{
+  SIM->unregister_addon_option("hostshare");
+  bx_list_c *menu = (bx_list_c*)SIM->get_param("misc");
+  menu->remove("hostshare");
+  delete theHostShare;
+}
+
+// the device object
+
+bx_hostshare_c::bx_hostshare_c()
+{
+  put("hostshare", "HSHARE");
+  memset(&s, 0, sizeof(s));
+  dir[0] = 0;
+  names = NULL;
+  sizes = NULL;
+  entries = 0;
+  fd = -1;
+  buf = NULL;
+  rr_buf = NULL;
+  rr_len = 0;
+  rr_size = 0;
+}
+
+bx_hostshare_c::~bx_hostshare_c()
+{
+  close_file();
+  free_listing();
+  delete [] buf;
+  delete [] rr_buf;
+  SIM->get_bochs_root()->remove("hostshare");
+  BX_DEBUG(("Exit"));
+}
+
+void bx_hostshare_c::init(void)
+{
+  bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_HOSTSHARE);
+  // Check if the device is disabled or not configured
+  if (!SIM->get_param_bool("enabled", base)->get() ||
+      SIM->get_param_string("dir", base)->isempty()) {
+    BX_INFO(("host share device disabled"));
+    // mark unused plugin for removal
+    ((bx_param_bool_c*)((bx_list_c*)SIM->get_param(BXPN_PLUGIN_CTRL))->get_by_name("hostshare"))->set(0);
+    return;
+  }
+  SIM->get_param_string("dir", base)->get(dir, BX_PATHNAME_LEN);
+
+  BX_HOSTSHARE_THIS s.devfunc = 0x00;
+  DEV_register_pci_handlers(this, &BX_HOSTSHARE_THIS s.devfunc, BX_PLUGIN_HOSTSHARE,
+                            "Host share device");
+
+  // initialize readonly registers, system peripheral of type "other"
+  init_pci_conf(HOSTSHARE_PCI_VENDOR, HOSTSHARE_PCI_DEVICE, 0x00, 0x088000, 0x00, 0);
+  BX_HOSTSHARE_THIS init_bar_io(0, 32, read_handler, write_handler, &hostshare_iomask[0]);
+
+  buf = new Bit8u[HOSTSHARE_MAX_SEG_LEN];
+
+  BX_INFO(("host share: directory '%s'", dir));
+}
+
+void bx_hostshare_c::reset(unsigned type)
+{
+  static const struct reset_vals_t {
+    unsigned      addr;
+    unsigned char val;
+  } reset_vals[] = {
+    { 0x04, 0x01 }, { 0x05, 0x00 }, // command_io
+    { 0x06, 0x00 }, { 0x07, 0x00 }, // status
+  };
+  for (unsigned i = 0; i < sizeof(reset_vals) / sizeof(*reset_vals); ++i) {
+    BX_HOSTSHARE_THIS pci_conf[reset_vals[i].addr] = reset_vals[i].val;
+  }
+  close_file();
+  free_listing();
+  BX_HOSTSHARE_THIS s.arg = 0;
+  BX_HOSTSHARE_THIS s.addr = 0;
+  BX_HOSTSHARE_THIS s.count = 0;
+  BX_HOSTSHARE_THIS s.status = HOSTSHARE_OK;
+  BX_HOSTSHARE_THIS s.value = 0;
+}
+
+void bx_hostshare_c::register_state(void)
+{
+  bx_list_c *list = new bx_list_c(SIM->get_bochs_root(), "hostshare", "Host Share Device State");
+  BXRS_HEX_PARAM_FIELD(list, arg, BX_HOSTSHARE_THIS s.arg);
+  BXRS_HEX_PARAM_FIELD(list, addr, BX_HOSTSHARE_THIS s.addr);
+  BXRS_HEX_PARAM_FIELD(list, count, BX_HOSTSHARE_THIS s.count);
+  BXRS_HEX_PARAM_FIELD(list, status, BX_HOSTSHARE_THIS s.status);
+  BXRS_HEX_PARAM_FIELD(list, value, BX_HOSTSHARE_THIS s.value);
+  register_pci_state(list);
+}
+
+void bx_hostshare_c::after_restore_state(void)
+{
+  bx_pci_device_c::after_restore_pci_state(NULL);
+  // the open file is not saved, the guest gets an error on its next read
+  close_file();
+  free_listing();
+}
+
+void bx_hostshare_c::free_listing(void)
+{
+  for (Bit32u i = 0; i < entries; i++) {
+    free(names[i]);
+  }
+  free(names);
+  free(sizes);
+  names = NULL;
+  sizes = NULL;
+  entries = 0;
+}
+
+void bx_hostshare_c::take_listing(void)
+{
+  Bit32u max = 0;
+
+  free_listing();
+#ifndef WIN32
+  DIR *d = opendir(dir);
+  struct dirent *entry;
+  if (d == NULL) {
+    BX_ERROR(("cannot open directory '%s'", dir));
+    return;
+  }
+  while ((entry = readdir(d)) != NULL) {
+    char path[BX_PATHNAME_LEN];
+    struct stat st;
+    snprintf(path, BX_PATHNAME_LEN, "%s/%s", dir, entry->d_name);
+    if ((stat(path, &st) < 0) || !S_ISREG(st.st_mode) || (st.st_size > 0xffffffff))
+      continue;
+    const char *name = entry->d_name;
+    Bit32u size = (Bit32u) st.st_size;
+#else
+  WIN32_FIND_DATA finddata;
+  char pattern[BX_PATHNAME_LEN];
+  snprintf(pattern, BX_PATHNAME_LEN, "%s\\*", dir);
+  HANDLE hFind = FindFirstFile(pattern, &finddata);
+  if (hFind == INVALID_HANDLE_VALUE) {
+    BX_ERROR(("cannot open directory '%s'", dir));
+    return;
+  }
+  do {
+    if ((finddata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || (finddata.nFileSizeHigh != 0))
+      continue;
+    const char *name = finddata.cFileName;
+    Bit32u size = finddata.nFileSizeLow;
+#endif
+    if (entries == max) {
+      max = (max == 0) ? 64 : max * 2;
+      names = (char**) realloc(names, max * sizeof(char*));
+      sizes = (Bit32u*) realloc(sizes, max * sizeof(Bit32u));
+    }
+    names[entries] = strdup(name);
+    sizes[entries] = size;
+    entries++;
+#ifndef WIN32
+  }
+  closedir(d);
+#else
+  } while (FindNextFile(hFind, &finddata));
+  FindClose(hFind);
+#endif
+}
+
+void bx_hostshare_c::close_file(void)
+{
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+Bit32u bx_hostshare_c::cmd_entry(void)
+{
+  if (BX_HOSTSHARE_THIS s.arg == 0) {
+    take_listing();
+  }
+  if (BX_HOSTSHARE_THIS s.arg >= entries) {
+    return HOSTSHARE_ERR_END;
+  }
+  const char *name = names[BX_HOSTSHARE_THIS s.arg];
+  Bit32u len = strlen(name) + 1;
+  if (len > BX_HOSTSHARE_THIS s.count) {
+    return HOSTSHARE_ERR_BADREQ;
+  }
+  write_guest(BX_HOSTSHARE_THIS s.addr, len, (Bit8u*) name);
+  BX_HOSTSHARE_THIS s.value = sizes[BX_HOSTSHARE_THIS s.arg];
+  return HOSTSHARE_OK;
+}
+
+Bit32u bx_hostshare_c::cmd_open(void)
+{
+  char name[HOSTSHARE_NAME_LEN], path[BX_PATHNAME_LEN];
+  struct stat st;
+  Bit32u len = BX_HOSTSHARE_THIS s.count;
+
+  close_file();
+  if ((len == 0) || (len >= HOSTSHARE_NAME_LEN)) {
+    return HOSTSHARE_ERR_BADREQ;
+  }
+  DEV_MEM_READ_PHYSICAL_DMA(BX_HOSTSHARE_THIS s.addr, len, (Bit8u*) name);
+  name[len] = 0;
+  if ((strlen(name) != len) || strchr(name, '/') || strchr(name, '\\') ||
+      !strcmp(name, ".") || !strcmp(name, "..")) {
+    return HOSTSHARE_ERR_BADREQ;
+  }
+  snprintf(path, BX_PATHNAME_LEN, "%s/%s", dir, name);
+  fd = ::open(path, O_RDONLY
+#ifdef O_BINARY
+              | O_BINARY
+#endif
+              );
+  if (fd < 0) {
+    return HOSTSHARE_ERR_NOENT;
+  }
+  if ((fstat(fd, &st) < 0) || !S_ISREG(st.st_mode) || (st.st_size > 0xffffffff)) {
+    close_file();
+    return HOSTSHARE_ERR_NOENT;
+  }
+  BX_HOSTSHARE_THIS s.value = (Bit32u) st.st_size;
+  return HOSTSHARE_OK;
+}
+
+// read the open file segment by segment, stop early at the end of file
+Bit32u bx_hostshare_c::cmd_read(void)
+{
+  Bit32u seg_table = BX_HOSTSHARE_THIS s.addr, total = 0;
+
+  if ((fd < 0) || (BX_HOSTSHARE_THIS s.count > HOSTSHARE_MAX_SEGS)) {
+    return HOSTSHARE_ERR_BADREQ;
+  }
+  if (lseek(fd, BX_HOSTSHARE_THIS s.arg, SEEK_SET) != (off_t) BX_HOSTSHARE_THIS s.arg) {
+    return HOSTSHARE_ERR_IO;
+  }
+  for (Bit32u i = 0; i < BX_HOSTSHARE_THIS s.count; i++) {
+    Bit32u addr, len;
+    DEV_MEM_READ_PHYSICAL(seg_table + i * 8, 4, (Bit8u*) &addr);
+    DEV_MEM_READ_PHYSICAL(seg_table + i * 8 + 4, 4, (Bit8u*) &len);
+    if (len > HOSTSHARE_MAX_SEG_LEN) {
+      return HOSTSHARE_ERR_BADREQ;
+    }
+    ssize_t ret = ::read(fd, buf, len);
+    if (ret < 0) {
+      return HOSTSHARE_ERR_IO;
+    }
+    write_guest(addr, (Bit32u) ret, buf);
+    total += (Bit32u) ret;
+    if ((Bit32u) ret < len) break;
+  }
+  BX_HOSTSHARE_THIS s.value = total;
+  return HOSTSHARE_OK;
+}
+
+// write the command data to the guest, keep a copy for the log
+void bx_hostshare_c::write_guest(Bit32u addr, Bit32u len, Bit8u *data)
+{
+  DEV_MEM_WRITE_PHYSICAL_DMA(addr, len, data);
+  if (BX_REPLAY_RECORDING) {
+    if ((rr_len + 8 + len) > rr_size) {
+      Bit32u size = rr_size * 2;
+      if (size < (rr_len + 8 + len)) size = rr_len + 8 + len;
+      Bit8u *tmp = new Bit8u[size];
+      if (rr_len > 0)
+        memcpy(tmp, rr_buf, rr_len);
+      delete [] rr_buf;
+      rr_buf = tmp;
+      rr_size = size;
+    }
+    memcpy(rr_buf + rr_len, &addr, 4);
+    memcpy(rr_buf + rr_len + 4, &len, 4);
+    memcpy(rr_buf + rr_len + 8, data, len);
+    rr_len += 8 + len;
+  }
+}
+
+// apply the logged outcome of a command: status, value, memory writes
+void bx_hostshare_c::replay_command(void)
+{
+  Bit32u len, addr, count;
+
+  if (!bx_replay_get(BX_REPLAY_HOSTSHARE, 0, &len)) {
+    bx_replay_diverged(BX_REPLAY_HOSTSHARE, 0);
+    return;
+  }
+  if (len < 8) {
+    BX_PANIC(("replay: bad hostshare record"));
+    return;
+  }
+  bx_replay_get_data(&BX_HOSTSHARE_THIS s.status, 4);
+  bx_replay_get_data(&BX_HOSTSHARE_THIS s.value, 4);
+  for (len -= 8; len >= 8; len -= count) {
+    bx_replay_get_data(&addr, 4);
+    bx_replay_get_data(&count, 4);
+    len -= 8;
+    if ((count > len) || (count > HOSTSHARE_MAX_SEG_LEN)) {
+      BX_PANIC(("replay: bad hostshare record"));
+      return;
+    }
+    bx_replay_get_data(buf, count);
+    DEV_MEM_WRITE_PHYSICAL_DMA(addr, count, buf);
+  }
+}
+
+void bx_hostshare_c::command(Bit32u cmd)
+{
+  BX_HOSTSHARE_THIS s.value = 0;
+  if (!(BX_HOSTSHARE_THIS pci_conf[0x04] & 0x04) && (cmd != HOSTSHARE_CMD_CLOSE)) {
+    BX_ERROR(("command 0x%02x with bus mastering disabled", cmd));
+    BX_HOSTSHARE_THIS s.status = HOSTSHARE_ERR_BADREQ;
+    return;
+  }
+  if (BX_REPLAY_REPLAYING) {
+    replay_command();
+    return;
+  }
+  rr_len = 0;
+  switch (cmd) {
+    case HOSTSHARE_CMD_ENTRY:
+      BX_HOSTSHARE_THIS s.status = cmd_entry();
+      break;
+    case HOSTSHARE_CMD_OPEN:
+      BX_HOSTSHARE_THIS s.status = cmd_open();
+      break;
+    case HOSTSHARE_CMD_READ:
+      BX_HOSTSHARE_THIS s.status = cmd_read();
+      break;
+    case HOSTSHARE_CMD_CLOSE:
+      close_file();
+      BX_HOSTSHARE_THIS s.status = HOSTSHARE_OK;
+      break;
+    default:
+      BX_ERROR(("unknown command 0x%02x", cmd));
+      BX_HOSTSHARE_THIS s.status = HOSTSHARE_ERR_BADREQ;
+  }
+  if (BX_REPLAY_RECORDING) {
+    bx_replay_put(BX_REPLAY_HOSTSHARE, 0, 8 + rr_len);
+    bx_replay_put_data(&BX_HOSTSHARE_THIS s.status, 4);
+    bx_replay_put_data(&BX_HOSTSHARE_THIS s.value, 4);
+    bx_replay_put_data(rr_buf, rr_len);
+  }
+}
+
+// static IO port read callback handler
+// redirects to non-static class handler to avoid virtual functions
+
+Bit32u bx_hostshare_c::read_handler(void *this_ptr, Bit32u address, unsigned io_len)
+{
+  bx_hostshare_c *class_ptr = (bx_hostshare_c *) this_ptr;
+  return class_ptr->read(address, io_len);
+}
+
+Bit32u bx_hostshare_c::read(Bit32u address, unsigned io_len)
+{
+  Bit32u val = 0;
+
+  switch (address - BX_HOSTSHARE_THIS pci_bar[0].addr) {
+    case HOSTSHARE_REG_ARG:
+      val = BX_HOSTSHARE_THIS s.arg;
+      break;
+    case HOSTSHARE_REG_ADDR:
+      val = BX_HOSTSHARE_THIS s.addr;
+      break;
+    case HOSTSHARE_REG_COUNT:
+      val = BX_HOSTSHARE_THIS s.count;
+      break;
+    case HOSTSHARE_REG_STATUS:
+      val = BX_HOSTSHARE_THIS s.status;
+      break;
+    case HOSTSHARE_REG_VALUE:
+      val = BX_HOSTSHARE_THIS s.value;
+      break;
+    default:
+      BX_ERROR(("read from write only register 0x%04x", address));
+  }
+  return val;
+}
+
+// static IO port write callback handler
+// redirects to non-static class handler to avoid virtual functions
+
+void bx_hostshare_c::write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len)
+{
+  bx_hostshare_c *class_ptr = (bx_hostshare_c *) this_ptr;
+  class_ptr->write(address, value, io_len);
+}
+
+void bx_hostshare_c::write(Bit32u address, Bit32u value, unsigned io_len)
+{
+  switch (address - BX_HOSTSHARE_THIS pci_bar[0].addr) {
+    case HOSTSHARE_REG_CMD:
+      command(value);
+      break;
+    case HOSTSHARE_REG_ARG:
+      BX_HOSTSHARE_THIS s.arg = value;
+      break;
+    case HOSTSHARE_REG_ADDR:
+      BX_HOSTSHARE_THIS s.addr = value;
+      break;
+    case HOSTSHARE_REG_COUNT:
+      BX_HOSTSHARE_THIS s.count = value;
+      break;
+    default:
+      BX_ERROR(("write to read only register 0x%04x", address));
+  }
+}
+
+// pci configuration space write callback handler
+void bx_hostshare_c::pci_write_handler(Bit8u address, Bit32u value, unsigned io_len)
+{
+  BX_DEBUG_PCI_WRITE(address, value, io_len);
+  for (unsigned i=0; i<io_len; i++) {
+    Bit8u value8 = (value >> (i*8)) & 0xff;
+    if ((address+i) == 0x04) {
+      BX_HOSTSHARE_THIS pci_conf[0x04] = value8 & 0x05;
+    }
+  }
+}
+
+#endif // BX_SUPPORT_PCI
@@ -0,0 +1,116 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+#ifndef BX_IODEV_HOSTSHARE_H
+#define BX_IODEV_HOSTSHARE_H
+
+// Paravirtual host share device
+//
+// Gives the guest read access to the regular files of one host directory.
+// The guest loads ARG, ADDR and COUNT and writes a command number to
+// HOSTSHARE_REG_CMD. The command completes before the write returns, its
+// status is in HOSTSHARE_REG_STATUS and its value in HOSTSHARE_REG_VALUE.
+//
+// HOSTSHARE_CMD_ENTRY: name of directory entry ARG is stored at ADDR as
+//   a NUL terminated string of at most COUNT bytes, VALUE = file size.
+//   The listing is taken again when ARG is 0.
+// HOSTSHARE_CMD_OPEN:  open the file named by the COUNT bytes at ADDR,
+//   VALUE = file size.
+// HOSTSHARE_CMD_READ:  read the open file from offset ARG into the COUNT
+//   segments of the table at ADDR, VALUE = bytes read.
+// HOSTSHARE_CMD_CLOSE: close the open file.
+//
+// segment:      +0 physical address, +4 byte count
+
+#define HOSTSHARE_PCI_VENDOR    0xfefe
+#define HOSTSHARE_PCI_DEVICE    0x0b11
+
+#define HOSTSHARE_REG_CMD       0x00   // command, w
+#define HOSTSHARE_REG_ARG       0x04   // index or file offset, r/w
+#define HOSTSHARE_REG_ADDR      0x08   // physical address of the buffer, r/w
+#define HOSTSHARE_REG_COUNT     0x0c   // buffer size or segment count, r/w
+#define HOSTSHARE_REG_STATUS    0x10   // status of the last command, r
+#define HOSTSHARE_REG_VALUE     0x14   // value of the last command, r
+
+#define HOSTSHARE_CMD_ENTRY     1
+#define HOSTSHARE_CMD_OPEN      2
+#define HOSTSHARE_CMD_READ      3
+#define HOSTSHARE_CMD_CLOSE     4
+
+#define HOSTSHARE_OK            0
+#define HOSTSHARE_ERR_END       1   // no entry with this index
+#define HOSTSHARE_ERR_NOENT     2   // no such file
+#define HOSTSHARE_ERR_IO        3   // host read failed
+#define HOSTSHARE_ERR_BADREQ    4   // bad arguments or no file open
+
+#define HOSTSHARE_NAME_LEN      256
+#define HOSTSHARE_MAX_SEGS      512
+#define HOSTSHARE_MAX_SEG_LEN   0x10000
+
+class bx_hostshare_c : public bx_pci_device_c {
+public:
+  bx_hostshare_c();
+  virtual ~bx_hostshare_c();
+  virtual void init(void);
+  virtual void reset(unsigned type);
+  virtual void register_state(void);
+  virtual void after_restore_state(void);
+
+  virtual void pci_write_handler(Bit8u address, Bit32u value, unsigned io_len);
+
+private:
+  struct {
+    Bit8u  devfunc;
+    Bit32u arg;
+    Bit32u addr;
+    Bit32u count;
+    Bit32u status;
+    Bit32u value;
+  } s;
+
+  char dir[BX_PATHNAME_LEN];
+  // snapshot of the regular files in the directory
+  char **names;
+  Bit32u *sizes;
+  Bit32u entries;
+  int fd;
+  Bit8u *buf;
+  // guest memory writes of the current command while recording
+  Bit8u *rr_buf;
+  Bit32u rr_len;
+  Bit32u rr_size;
+
+  void free_listing(void);
+  void take_listing(void);
+  void close_file(void);
+  Bit32u cmd_entry(void);
+  Bit32u cmd_open(void);
+  Bit32u cmd_read(void);
+  void write_guest(Bit32u addr, Bit32u len, Bit8u *data);
+  void replay_command(void);
+  void command(Bit32u cmd);
+
+  static Bit32u read_handler(void *this_ptr, Bit32u address, unsigned io_len);
+  static void   write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len);
+  Bit32u read(Bit32u address, unsigned io_len);
+  void   write(Bit32u address, Bit32u value, unsigned io_len);
+};
+
+#endif
@@ -44,6 +44,10 @@
 
 typedef Bit32u (*bx_read_handler_t)(void *, Bit32u, unsigned);
 typedef void   (*bx_write_handler_t)(void *, Bit32u, Bit32u, unsigned);
+// bulk handlers move up to 'count' quantums of 'io_len' bytes between the
+// port and host memory and return the number of quantums transferred
+typedef Bit32u (*bx_bulk_read_handler_t)(void *, Bit32u, unsigned, Bit8u *, Bit32u);
+typedef Bit32u (*bx_bulk_write_handler_t)(void *, Bit32u, unsigned, const Bit8u *, Bit32u);
 
 typedef bx_bool (*bx_kbd_gen_scancode_t)(void *, Bit32u);
 typedef void (*bx_mouse_enq_t)(void *, int, int, int, unsigned, bx_bool);
@@ -206,6 +210,8 @@ public:
   virtual void bmdma_complete(Bit8u channel) {
     STUBFUNC(HD, bmdma_complete);
   }
+  // no hard drive, nothing to detach in a clone
+  virtual bx_bool clone_images(int instance) { return 1; }
 };
 
 class BOCHSAPI bx_floppy_stub_c : public bx_devmodel_c {
@@ -430,6 +436,14 @@ public:
   bx_bool unregister_irq(unsigned irq, const char *name);
   Bit32u inp(Bit16u addr, unsigned io_len) BX_CPP_AttrRegparmN(2);
   void   outp(Bit16u addr, Bit32u value, unsigned io_len) BX_CPP_AttrRegparmN(3);
+  bx_bool register_bulk_io_handlers(void *this_ptr, bx_bulk_read_handler_t f_read,
+                                    bx_bulk_write_handler_t f_write, Bit32u addr,
+                                    const char *name);
+  Bit32u inp_bulk(Bit16u addr, unsigned io_len, Bit8u *dst, Bit32u count);
+  Bit32u outp_bulk(Bit16u addr, unsigned io_len, const Bit8u *src, Bit32u count);
+  // per-port access counts and handler times ('iostats' option), fp=NULL
+  // prints to the debugger console
+  void iostats_dump(FILE *fp);
 
   void register_removable_keyboard(void *dev, bx_kbd_gen_scancode_t kbd_gen_scancode);
   void unregister_removable_keyboard(void *dev);
@@ -437,6 +451,7 @@ public:
   void register_removable_mouse(void *dev, bx_mouse_enq_t mouse_enq, bx_mouse_enabled_changed_t mouse_enabled_changed);
   void unregister_removable_mouse(void *dev);
   void gen_scancode(Bit32u key);
+  void paste_bytes(Bit8u *data, Bit32s length);
   void release_keys(void);
   void mouse_enabled_changed(bx_bool enabled);
   void mouse_motion(int delta_x, int delta_y, int delta_z, unsigned button_state, bx_bool absxy);
@@ -534,6 +549,27 @@ private:
   struct io_handler_struct **read_port_to_handler;
   struct io_handler_struct **write_port_to_handler;
 
+  // ports with a bulk handler for REP INS/OUTS; only a few devices need one
+#define BX_MAX_BULK_IO_HANDLERS 8
+  struct {
+    Bit16u addr;
+    void *this_ptr;
+    bx_bulk_read_handler_t read;
+    bx_bulk_write_handler_t write;
+  } bulk_io_handlers[BX_MAX_BULK_IO_HANDLERS];
+  unsigned bulk_io_handler_cnt;
+
+  // per-port I/O statistics, allocated on the first access of a port;
+  // iostats is NULL unless enabled
+#define BX_IOSTATS_HIST_BUCKETS 12
+  typedef struct {
+    Bit64u count[2];  // reads, writes
+    Bit64u nsec[2];   // host time spent in the handlers
+    Bit64u hist[BX_IOSTATS_HIST_BUCKETS]; // handler time, bucket n: < 128ns << n
+  } iostats_port_t;
+  iostats_port_t **iostats;
+  void iostats_add(Bit16u addr, unsigned rw, Bit64u nsec, Bit32u count);
+
   // more for informative purposes, the names of the devices which
   // are use each of the IRQ 0..15 lines are stored here
   char *irq_handler_name[BX_MAX_IRQS];
@@ -604,14 +640,8 @@ BX_CPP_INLINE void DEV_MEM_READ_PHYSICAL(bx_phy_address phy_addr, unsigned len,
 
 BX_CPP_INLINE void DEV_MEM_READ_PHYSICAL_DMA(bx_phy_address phy_addr, unsigned len, Bit8u *ptr)
 {
-  while(len > 0) { 
-    unsigned remainingInPage = 0x1000 - (phy_addr & 0xfff);
-    if (len < remainingInPage) remainingInPage = len;
-    BX_MEM(0)->dmaReadPhysicalPage(phy_addr, remainingInPage, ptr);
-    ptr += remainingInPage;
-    phy_addr += remainingInPage;
-    len -= remainingInPage;
-  }
+  bx_dma_sg_t sg = { phy_addr, len };
+  BX_MEM(0)->dmaReadSG(&sg, 1, ptr);
 }
 
 // memory stub has an assumption that there are no memory accesses splitting 4K page
@@ -632,14 +662,8 @@ BX_CPP_INLINE void DEV_MEM_WRITE_PHYSICAL(bx_phy_address phy_addr, unsigned len,
 
 BX_CPP_INLINE void DEV_MEM_WRITE_PHYSICAL_DMA(bx_phy_address phy_addr, unsigned len, Bit8u *ptr)
 {
-  while(len > 0) { 
-    unsigned remainingInPage = 0x1000 - (phy_addr & 0xfff);
-    if (len < remainingInPage) remainingInPage = len;
-    BX_MEM(0)->dmaWritePhysicalPage(phy_addr, remainingInPage, ptr);
-    ptr += remainingInPage;
-    phy_addr += remainingInPage;
-    len -= remainingInPage;
-  }
+  bx_dma_sg_t sg = { phy_addr, len };
+  BX_MEM(0)->dmaWriteSG(&sg, 1, ptr);
 }
 
 BOCHSAPI extern bx_devices_c bx_devices;
@@ -54,8 +54,42 @@
 
 #define LOG_THIS  theKeyboard->
 
+#ifndef O_NONBLOCK
+#define O_NONBLOCK 0
+#endif
+
 bx_keyb_c *theKeyboard = NULL;
 
+// US layout keys of the input script characters other than letters and
+// digits. Control characters without an entry are typed as ctrl + letter.
+static const struct {
+  Bit8u  ascii;
+  Bit8u  shift;
+  Bit32u key;
+} inject_keys[] = {
+  { ' ',  0, BX_KEY_SPACE },
+  { '\n', 0, BX_KEY_ENTER },
+  { '\r', 0, BX_KEY_ENTER },
+  { '\t', 0, BX_KEY_TAB },
+  { '\b', 0, BX_KEY_BACKSPACE },
+  { 0x1b, 0, BX_KEY_ESC },
+  { '\'', 0, BX_KEY_SINGLE_QUOTE }, { '"', 1, BX_KEY_SINGLE_QUOTE },
+  { ',',  0, BX_KEY_COMMA },         { '<', 1, BX_KEY_COMMA },
+  { '.',  0, BX_KEY_PERIOD },        { '>', 1, BX_KEY_PERIOD },
+  { '/',  0, BX_KEY_SLASH },         { '?', 1, BX_KEY_SLASH },
+  { ';',  0, BX_KEY_SEMICOLON },     { ':', 1, BX_KEY_SEMICOLON },
+  { '=',  0, BX_KEY_EQUALS },        { '+', 1, BX_KEY_EQUALS },
+  { '[',  0, BX_KEY_LEFT_BRACKET },  { '{', 1, BX_KEY_LEFT_BRACKET },
+  { '\\', 0, BX_KEY_BACKSLASH },     { '|', 1, BX_KEY_BACKSLASH },
+  { ']',  0, BX_KEY_RIGHT_BRACKET }, { '}', 1, BX_KEY_RIGHT_BRACKET },
+  { '-',  0, BX_KEY_MINUS },         { '_', 1, BX_KEY_MINUS },
+  { '`',  0, BX_KEY_GRAVE },         { '~', 1, BX_KEY_GRAVE },
+  { '!',  1, BX_KEY_1 }, { '@', 1, BX_KEY_2 }, { '#', 1, BX_KEY_3 },
+  { '$',  1, BX_KEY_4 }, { '%', 1, BX_KEY_5 }, { '^', 1, BX_KEY_6 },
+  { '&',  1, BX_KEY_7 }, { '*', 1, BX_KEY_8 }, { '(', 1, BX_KEY_9 },
+  { ')',  1, BX_KEY_0 }
+};
+
 int CDECL libkeyboard_LTX_plugin_init(plugin_t *plugin, plugintype_t type)
 {
   // Create one instance of the keyboard device object.
@@ -78,6 +112,7 @@ bx_keyb_c::bx_keyb_c()
   put("keyboard", "KBD");
   memset(&s, 0, sizeof(s));
   pastebuf = NULL;
+  inject.fd = -1;
 }
 
 bx_keyb_c::~bx_keyb_c()
@@ -88,6 +123,9 @@ bx_keyb_c::~bx_keyb_c()
   if (pastebuf != NULL) {
     delete [] pastebuf;
   }
+  if (inject.fd >= 0) {
+    ::close(inject.fd);
+  }
   SIM->get_bochs_root()->remove("keyboard");
   BX_DEBUG(("Exit"));
 }
@@ -194,6 +232,8 @@ void bx_keyb_c::init(void)
   BX_KEY_THIS paste_service = 0;
   BX_KEY_THIS stop_paste = 0;
 
+  BX_KEY_THIS inject_init();
+
   // mouse port installed on system board
   DEV_cmos_set_reg(0x14, DEV_cmos_get_reg(0x14) | 0x04);
 
@@ -391,6 +431,16 @@ Bit32u bx_keyb_c::read(Bit32u address, unsigned io_len)
 
       DEV_pic_lower_irq(1);
       activate_timer();
+      if ((BX_KEY_THIS inject.fd >= 0) ||
+          (BX_KEY_THIS inject.text_ptr < BX_KEY_THIS inject.text_len)) {
+        // scripted input: hand over the next scancode right away instead
+        // of after the serial delay
+        unsigned retval = BX_KEY_THIS periodic(1);
+        if (retval & 0x01)
+          DEV_pic_raise_irq(1);
+        if (retval & 0x02)
+          DEV_pic_raise_irq(12);
+      }
       BX_DEBUG(("READ(%02x) = %02x", (unsigned) address, (unsigned) val));
       return val;
     } else {
@@ -759,6 +809,199 @@ void bx_keyb_c::paste_bytes(Bit8u *bytes, Bit32s length)
   BX_KEY_THIS service_paste_buf();
 }
 
+void bx_keyb_c::inject_init(void)
+{
+  bx_param_string_c *path = SIM->get_param_string(BXPN_KBD_INJECT);
+  struct stat stat_buf;
+
+  if (BX_KEY_THIS inject.fd >= 0) {
+    ::close(BX_KEY_THIS inject.fd);
+  }
+  BX_KEY_THIS inject.fd = -1;
+  BX_KEY_THIS inject.fifo = 0;
+  BX_KEY_THIS inject.buf_len = 0;
+  BX_KEY_THIS inject.text_len = 0;
+  BX_KEY_THIS inject.text_ptr = 0;
+  BX_KEY_THIS inject.expect = 0;
+  if (path->isempty()) return;
+
+  // a named pipe opened without a writer yet simply has no data
+  BX_KEY_THIS inject.fd = ::open(path->getptr(), O_RDONLY | O_NONBLOCK);
+  if (BX_KEY_THIS inject.fd < 0) {
+    BX_ERROR(("could not open input script '%s'", path->getptr()));
+    return;
+  }
+#ifdef S_ISFIFO
+  if (fstat(BX_KEY_THIS inject.fd, &stat_buf) == 0) {
+    BX_KEY_THIS inject.fifo = S_ISFIFO(stat_buf.st_mode);
+  }
+#endif
+  BX_INFO(("reading input script from '%s'", path->getptr()));
+}
+
+// inject_next_line() reads the next command of the input script into
+// inject.text. It returns 0 if no complete line is available yet.
+bx_bool bx_keyb_c::inject_next_line(void)
+{
+  char line[BX_KBD_INJECT_BUFSIZE];
+  unsigned len, used, n;
+
+  while (1) {
+    char *nl = (char *) memchr(BX_KEY_THIS inject.buf, '\n', BX_KEY_THIS inject.buf_len);
+    if (nl != NULL) {
+      len = nl - BX_KEY_THIS inject.buf;
+    } else if (BX_KEY_THIS inject.buf_len == BX_KBD_INJECT_BUFSIZE) {
+      BX_ERROR(("input script line too long, split"));
+      len = BX_KBD_INJECT_BUFSIZE - 1;
+    } else {
+      ssize_t ret = ::read(BX_KEY_THIS inject.fd, BX_KEY_THIS inject.buf + BX_KEY_THIS inject.buf_len,
+                           BX_KBD_INJECT_BUFSIZE - BX_KEY_THIS inject.buf_len);
+      if (ret > 0) {
+        BX_KEY_THIS inject.buf_len += ret;
+        continue;
+      }
+      // no data from a pipe only means the writer has not sent more yet
+      if ((ret < 0) || BX_KEY_THIS inject.fifo) return 0;
+      if (BX_KEY_THIS inject.buf_len == 0) {
+        BX_INFO(("end of input script"));
+        ::close(BX_KEY_THIS inject.fd);
+        BX_KEY_THIS inject.fd = -1;
+        return 0;
+      }
+      // last line without a newline
+      len = BX_KEY_THIS inject.buf_len;
+    }
+    memcpy(line, BX_KEY_THIS inject.buf, len);
+    line[len] = 0;
+    used = len + (nl != NULL);
+    BX_KEY_THIS inject.buf_len -= used;
+    memmove(BX_KEY_THIS inject.buf, BX_KEY_THIS inject.buf + used, BX_KEY_THIS inject.buf_len);
+    if ((len > 0) && (line[len-1] == '\r')) line[--len] = 0;
+
+    if ((len == 0) || (line[0] == '#')) {
+      continue;
+    } else if (!strncmp(line, "send ", 5)) {
+      const char *src = &line[5];
+      n = 0;
+      while (*src) {
+        char c = *src++;
+        if ((c == '\\') && *src) {
+          c = *src++;
+          switch (c) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'b': c = '\b'; break;
+            case 'e': c = 0x1b; break;
+            case 'x':
+              c = 0;
+              for (int i = 0; (i < 2) && isxdigit((unsigned char) *src); i++, src++) {
+                c = (c << 4) | (isdigit((unsigned char) *src) ? (*src - '0') : (tolower(*src) - 'a' + 10));
+              }
+              break;
+            default: // "\\" and other escaped characters stand for themselves
+              break;
+          }
+        }
+        BX_KEY_THIS inject.text[n++] = c;
+      }
+      BX_KEY_THIS inject.text[n] = 0;
+      BX_KEY_THIS inject.expect = 0;
+    } else if (!strncmp(line, "expect ", 7)) {
+      n = len - 7;
+      memcpy(BX_KEY_THIS inject.text, &line[7], n + 1);
+      BX_KEY_THIS inject.expect = 1;
+    } else {
+      BX_ERROR(("unknown input script command '%s'", line));
+      continue;
+    }
+    BX_KEY_THIS inject.text_len = n;
+    BX_KEY_THIS inject.text_ptr = 0;
+    return 1;
+  }
+}
+
+// inject_on_screen() looks for the pattern of an "expect" command on each
+// line of the text mode screen
+bx_bool bx_keyb_c::inject_on_screen(void)
+{
+  Bit8u *raw_snap = NULL;
+  unsigned txHeight = 0, txWidth = 0;
+  char line[257];
+
+  DEV_vga_get_text_snapshot(&raw_snap, &txHeight, &txWidth);
+  if ((raw_snap == NULL) || (txWidth > 256)) return 0;
+  for (unsigned i = 0; i < txHeight; i++) {
+    for (unsigned j = 0; j < txWidth; j++) {
+      Bit8u ch = raw_snap[(i * txWidth + j) * 2];
+      line[j] = ch ? (char) ch : ' ';
+    }
+    line[txWidth] = 0;
+    if (strstr(line, BX_KEY_THIS inject.text) != NULL) return 1;
+  }
+  return 0;
+}
+
+void bx_keyb_c::inject_char(Bit8u ch)
+{
+  Bit32u key = BX_KEY_NBKEYS, mod = BX_KEY_NBKEYS;
+
+  if ((ch >= 'a') && (ch <= 'z')) {
+    key = BX_KEY_A + (ch - 'a');
+  } else if ((ch >= 'A') && (ch <= 'Z')) {
+    key = BX_KEY_A + (ch - 'A');
+    mod = BX_KEY_SHIFT_L;
+  } else if ((ch >= '0') && (ch <= '9')) {
+    key = BX_KEY_0 + (ch - '0');
+  } else {
+    for (unsigned i = 0; i < sizeof(inject_keys) / sizeof(inject_keys[0]); i++) {
+      if (inject_keys[i].ascii == ch) {
+        key = inject_keys[i].key;
+        if (inject_keys[i].shift) mod = BX_KEY_SHIFT_L;
+        break;
+      }
+    }
+    if ((key == BX_KEY_NBKEYS) && (ch >= 1) && (ch <= 26)) {
+      key = BX_KEY_A + (ch - 1);
+      mod = BX_KEY_CTRL_L;
+    }
+  }
+  if (key == BX_KEY_NBKEYS) {
+    BX_ERROR(("input script character 0x%02x ignored", ch));
+    return;
+  }
+  if (mod != BX_KEY_NBKEYS)
+    BX_KEY_THIS gen_scancode(mod);
+  BX_KEY_THIS gen_scancode(key);
+  BX_KEY_THIS gen_scancode(key | BX_KEY_RELEASED);
+  if (mod != BX_KEY_NBKEYS)
+    BX_KEY_THIS gen_scancode(mod | BX_KEY_RELEASED);
+}
+
+// service_inject() types the input script into the internal keyboard
+// buffer while there is room for another key and the guest accepts
+// scancodes, and checks the screen for a pending "expect" pattern.
+void bx_keyb_c::service_inject(void)
+{
+  int fill_threshold = BX_KBD_ELEMENTS - 8;
+
+  while (1) {
+    if (BX_KEY_THIS inject.text_ptr < BX_KEY_THIS inject.text_len) {
+      if (BX_KEY_THIS inject.expect) {
+        if (!BX_KEY_THIS inject_on_screen()) return;
+        BX_INFO(("input script: found '%s'", BX_KEY_THIS inject.text));
+        BX_KEY_THIS inject.text_ptr = BX_KEY_THIS inject.text_len;
+      } else {
+        if ((BX_KEY_THIS s.kbd_internal_buffer.num_elements >= fill_threshold) ||
+            !BX_KEY_THIS s.kbd_controller.kbd_clock_enabled ||
+            !BX_KEY_THIS s.kbd_internal_buffer.scanning_enabled) return;
+        BX_KEY_THIS inject_char(BX_KEY_THIS inject.text[BX_KEY_THIS inject.text_ptr++]);
+      }
+    } else if ((BX_KEY_THIS inject.fd < 0) || !BX_KEY_THIS inject_next_line()) {
+      return;
+    }
+  }
+}
+
 void bx_keyb_c::gen_scancode(Bit32u key)
 {
   unsigned char *scancode;
@@ -1155,6 +1398,7 @@ unsigned bx_keyb_c::periodic(Bit32u usec_delta)
       BX_KEY_THIS service_paste_buf();
       count_before_paste=0;
     }
+    BX_KEY_THIS service_inject();
   }
 
   retval = BX_KEY_THIS s.kbd_controller.irq1_requested | (BX_KEY_THIS s.kbd_controller.irq12_requested << 1);
@@ -22,6 +22,7 @@
 #define _PCKEY_H
 
 #define BX_KBD_ELEMENTS 16
+#define BX_KBD_INJECT_BUFSIZE 1024
 
 // these keywords should only be used in keyboard.cc
 #if BX_USE_KEY_SMF
@@ -57,6 +58,11 @@ public:
 private:
   BX_KEY_SMF Bit8u    get_kbd_enable(void);
   BX_KEY_SMF void     service_paste_buf ();
+  BX_KEY_SMF void     inject_init(void);
+  BX_KEY_SMF bx_bool  inject_next_line(void);
+  BX_KEY_SMF bx_bool  inject_on_screen(void);
+  BX_KEY_SMF void     inject_char(Bit8u ch);
+  BX_KEY_SMF void     service_inject(void);
   BX_KEY_SMF void     create_mouse_packet(bx_bool force_enq);
   BX_KEY_SMF unsigned periodic(Bit32u usec_delta);
 
@@ -208,6 +214,22 @@ private:
   bx_bool paste_service;  // set to 1 when gen_scancode() is called from paste service
   bx_bool stop_paste;  // stop the current paste operation on keypress or hardware reset
 
+  // Scripted input is another bochs construction. Commands are read line
+  // by line from the file or named pipe given with "keyboard: inject=".
+  // The characters of a "send" command are typed as soon as the guest has
+  // taken the previous scancodes from port 0x60, an "expect" command holds
+  // the script until its text shows up on the text mode screen.
+  struct {
+    int fd;            // -1 if no script is open
+    bx_bool fifo;      // end of data only means the writer is gone
+    char buf[BX_KBD_INJECT_BUFSIZE];  // data read, not yet a full line
+    unsigned buf_len;
+    char text[BX_KBD_INJECT_BUFSIZE]; // "send" text or "expect" pattern
+    unsigned text_len;
+    unsigned text_ptr;
+    bx_bool expect;
+  } inject;
+
   BX_KEY_SMF void     resetinternals(bx_bool powerup);
   BX_KEY_SMF void     set_kbd_clock_enable(Bit8u value) BX_CPP_AttrRegparmN(1);
   BX_KEY_SMF void     set_aux_clock_enable(Bit8u value);
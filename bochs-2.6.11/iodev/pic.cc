@@ -671,149 +671,87 @@ void bx_pic_c::set_mode(bx_bool ma_sl, Bit8u mode)
   }
 }
 
-void bx_pic_c::clear_highest_interrupt(bx_pic_t *pic)
+// Priority rank of the highest priority IRQ set in mask, 0 is the rank of
+// the IRQ after lowest_priority. mask must not be zero.
+static BX_CPP_INLINE unsigned highest_priority_rank(Bit8u mask, Bit8u lowest_priority)
 {
-  int irq;
-  int lowest_priority;
-  int highest_priority;
-
-  /* clear highest current in service bit */
-  lowest_priority = pic->lowest_priority;
-  highest_priority = lowest_priority + 1;
-  if(highest_priority > 7)
-    highest_priority = 0;
-
-  irq = highest_priority;
-  do {
-    if (pic->isr & (1 << irq)) {
-      pic->isr &= ~(1 << irq);
-      break; /* Return mask of bit cleared. */
-    }
+  static const Bit8u lowest_bit[16] = { 0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0 };
 
-    irq ++;
-    if(irq > 7)
-      irq = 0;
-  } while(irq != highest_priority);
+  unsigned shift = (lowest_priority + 1) & 7;
+  Bit8u rotated = (Bit8u) ((mask >> shift) | (mask << (8 - shift)));
+  return (rotated & 0x0f) ? lowest_bit[rotated & 0x0f] : 4 + lowest_bit[rotated >> 4];
 }
 
-void bx_pic_c::service_master_pic(void)
+static BX_CPP_INLINE unsigned rank_to_irq(unsigned rank, Bit8u lowest_priority)
 {
-  Bit8u unmasked_requests;
-  int irq;
-  Bit8u isr, max_irq;
-  Bit8u highest_priority = BX_PIC_THIS s.master_pic.lowest_priority + 1;
-  if(highest_priority > 7)
-    highest_priority = 0;
+  return (rank + lowest_priority + 1) & 7;
+}
 
-  if (BX_PIC_THIS s.master_pic.INT) { /* last interrupt still not acknowleged */
-    return;
-  }
+// The IRQ the PIC has to signal for its current IRR, IMR and ISR, or -1.
+// Requests are checked first: after an EOI there is usually none pending
+// and the ISR isn't looked at.
+static int pic_pending_irq(const bx_pic_t *pic)
+{
+  Bit8u unmasked_requests = pic->irr & ~pic->imr;
 
-  isr = BX_PIC_THIS s.master_pic.isr;
-  if (BX_PIC_THIS s.master_pic.special_mask) {
+  if (pic->special_mask) {
     /* all priorities may be enabled.  check all IRR bits except ones
      * which have corresponding ISR bits set
      */
-    max_irq = highest_priority;
-  }
-  else { /* normal mode */
-    /* Find the highest priority IRQ that is enabled due to current ISR */
-    max_irq = highest_priority;
-    if (isr) {
-      while ((isr & (1 << max_irq)) == 0) {
-        max_irq++;
-        if(max_irq > 7)
-          max_irq = 0;
-      }
-      if (max_irq == highest_priority) return; /* Highest priority interrupt in-service,
-                                                * no other priorities allowed */
-      if (max_irq > 7) BX_PANIC(("error in service_master_pic()"));
-    }
+    unmasked_requests &= ~pic->isr;
   }
+  if (! unmasked_requests)
+    return -1;
 
-  /* now, see if there are any higher priority requests */
-  if ((unmasked_requests = (BX_PIC_THIS s.master_pic.irr & ~BX_PIC_THIS s.master_pic.imr))) {
-    irq = highest_priority;
-    do {
-      /* for special mode, since we're looking at all IRQ's, skip if
-       * current IRQ is already in-service
-       */
-      if (! (BX_PIC_THIS s.master_pic.special_mask && ((isr >> irq) & 0x01))) {
-        if (unmasked_requests & (1 << irq)) {
-          BX_DEBUG(("signalling IRQ(%u)", (unsigned) irq));
-          BX_PIC_THIS s.master_pic.INT = 1;
-          BX_PIC_THIS s.master_pic.irq = irq;
-          BX_RAISE_INTR();
-          return;
-        } /* if (unmasked_requests & ... */
-      }
+  unsigned rank = highest_priority_rank(unmasked_requests, pic->lowest_priority);
+  if (pic->isr && ! pic->special_mask) {
+    /* normal mode: only requests of higher priority than the highest
+     * priority IRQ in service are enabled
+     */
+    if (rank >= highest_priority_rank(pic->isr, pic->lowest_priority))
+      return -1;
+  }
 
-      irq ++;
-      if(irq > 7)
-        irq = 0;
-    } while(irq != max_irq); /* do ... */
-  } /* if (unmasked_requests = ... */
+  return rank_to_irq(rank, pic->lowest_priority);
 }
 
-void bx_pic_c::service_slave_pic(void)
+void bx_pic_c::clear_highest_interrupt(bx_pic_t *pic)
 {
-  Bit8u unmasked_requests;
-  int irq;
-  Bit8u isr, max_irq;
-  Bit8u highest_priority = BX_PIC_THIS s.slave_pic.lowest_priority + 1;
-  if(highest_priority > 7)
-    highest_priority = 0;
+  /* clear highest current in service bit */
+  if (pic->isr) {
+    unsigned irq = rank_to_irq(highest_priority_rank(pic->isr, pic->lowest_priority), pic->lowest_priority);
+    pic->isr &= ~(1 << irq);
+  }
+}
 
-  if (BX_PIC_THIS s.slave_pic.INT) { /* last interrupt still not acknowleged */
+void bx_pic_c::service_master_pic(void)
+{
+  if (BX_PIC_THIS s.master_pic.INT) { /* last interrupt still not acknowleged */
     return;
   }
 
-  isr = BX_PIC_THIS s.slave_pic.isr;
-  if (BX_PIC_THIS s.slave_pic.special_mask) {
-    /* all priorities may be enabled.  check all IRR bits except ones
-     * which have corresponding ISR bits set
-     */
-    max_irq = highest_priority;
-  }
-  else { /* normal mode */
-    /* Find the highest priority IRQ that is enabled due to current ISR */
-    max_irq = highest_priority;
-    if (isr) {
-      while ((isr & (1 << max_irq)) == 0) {
-        max_irq++;
-        if(max_irq > 7)
-          max_irq = 0;
-      }
-      if (max_irq == highest_priority) return; /* Highest priority interrupt in-service,
-                                                * no other priorities allowed */
-      if (max_irq > 7) BX_PANIC(("error in service_slave_pic()"));
-    }
+  int irq = pic_pending_irq(&BX_PIC_THIS s.master_pic);
+  if (irq >= 0) {
+    BX_DEBUG(("signalling IRQ(%u)", (unsigned) irq));
+    BX_PIC_THIS s.master_pic.INT = 1;
+    BX_PIC_THIS s.master_pic.irq = irq;
+    BX_RAISE_INTR();
   }
+}
 
-  /* now, see if there are any higher priority requests */
-  if ((unmasked_requests = (BX_PIC_THIS s.slave_pic.irr & ~BX_PIC_THIS s.slave_pic.imr))) {
-    irq = highest_priority;
-    do {
-      /* for special mode, since we're looking at all IRQ's, skip if
-       * current IRQ is already in-service
-       */
-      if (! (BX_PIC_THIS s.slave_pic.special_mask && ((isr >> irq) & 0x01))) {
-        if (unmasked_requests & (1 << irq)) {
-          BX_DEBUG(("slave: signalling IRQ(%u)", (unsigned) 8 + irq));
-
-          BX_PIC_THIS s.slave_pic.INT = 1;
-          BX_PIC_THIS s.slave_pic.irq = irq;
-          BX_PIC_THIS raise_irq(2); /* request IRQ 2 on master pic */
-          return;
-        } /* if (unmasked_requests & ... */
-      }
-
-      irq ++;
-      if(irq > 7)
-        irq = 0;
+void bx_pic_c::service_slave_pic(void)
+{
+  if (BX_PIC_THIS s.slave_pic.INT) { /* last interrupt still not acknowleged */
+    return;
+  }
 
-    } while(irq != max_irq); /* do ... */
-  } /* if (unmasked_requests = ... */
+  int irq = pic_pending_irq(&BX_PIC_THIS s.slave_pic);
+  if (irq >= 0) {
+    BX_DEBUG(("slave: signalling IRQ(%u)", (unsigned) 8 + irq));
+    BX_PIC_THIS s.slave_pic.INT = 1;
+    BX_PIC_THIS s.slave_pic.irq = irq;
+    BX_PIC_THIS raise_irq(2); /* request IRQ 2 on master pic */
+  }
 }
 
 /* CPU handshakes with PIC after acknowledging interrupt */
@@ -822,10 +760,12 @@ Bit8u bx_pic_c::IAC(void)
   Bit8u vector;
   Bit8u irq;
 
-  BX_CLEAR_INTR();
+  // INTR is left raised when the next interrupt is already pending, it is
+  // cleared below only if service_master_pic() doesn't signal one
   BX_PIC_THIS s.master_pic.INT = 0;
   // Check for spurious interrupt
   if (BX_PIC_THIS s.master_pic.irr == 0) {
+    BX_CLEAR_INTR();
     return (BX_PIC_THIS s.master_pic.interrupt_offset + 7);
   }
   // In level sensitive mode don't clear the irr bit.
@@ -845,6 +785,7 @@ Bit8u bx_pic_c::IAC(void)
     BX_PIC_THIS s.master_pic.IRQ_in &= ~(1 << 2);
     // Check for spurious interrupt
     if (BX_PIC_THIS s.slave_pic.irr == 0) {
+      BX_CLEAR_INTR();
       return (BX_PIC_THIS s.slave_pic.interrupt_offset + 7);
     }
     irq    = BX_PIC_THIS s.slave_pic.irq;
@@ -862,6 +803,7 @@ Bit8u bx_pic_c::IAC(void)
   }
 
   service_master_pic();
+  if (! BX_PIC_THIS s.master_pic.INT) BX_CLEAR_INTR();
 
   BX_DBG_IAC_REPORT(vector, irq);
   return(vector);
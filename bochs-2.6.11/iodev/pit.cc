@@ -123,7 +123,7 @@ void bx_pit_c::init(void)
 
   BX_PIT_THIS s.timer.init();
   BX_PIT_THIS s.timer.set_OUT_handler(0, irq_handler);
-  BX_PIT_THIS s.timer.set_OUT_handler(2, speaker_handler);
+  BX_PIT_THIS update_speaker_handler();
 
   Bit64u my_time_usec = bx_virt_timer.time_usec(BX_PIT_THIS is_realtime);
 
@@ -184,6 +184,7 @@ void bx_pit_c::register_state(void)
 
 void bx_pit_c::after_restore_state(void)
 {
+  BX_PIT_THIS update_speaker_handler();
   if (BX_PIT_THIS s.speaker_active && (BX_PIT_THIS s.timer.get_mode(2) == 3)) {
     Bit32u value32 = BX_PIT_THIS get_timer(2);
     if (value32 == 0) value32 = 0x10000;
@@ -330,6 +331,7 @@ void bx_pit_c::write(Bit32u address, Bit32u dvalue, unsigned io_len)
 
     case 0x43: /* timer 0-2 mode control */
       BX_PIT_THIS s.timer.write(3, value);
+      BX_PIT_THIS update_speaker_handler();
       break;
 
     case 0x61:
@@ -354,6 +356,7 @@ void bx_pit_c::write(Bit32u address, Bit32u dvalue, unsigned io_len)
           BX_PIT_THIS s.speaker_level = new_speaker_level;
         }
       }
+      BX_PIT_THIS update_speaker_handler();
       break;
 
     default:
@@ -423,6 +426,18 @@ void bx_pit_c::speaker_handler(bx_bool value)
   }
 }
 
+// The OUT edges of counter 2 only drive the speaker line in modes other
+// than 3 with the speaker data bit set. Without the handler the counter
+// is not clocked and never schedules a timer event.
+void bx_pit_c::update_speaker_handler(void)
+{
+  if (BX_PIT_THIS s.speaker_data_on && (BX_PIT_THIS s.timer.get_mode(2) != 3)) {
+    BX_PIT_THIS s.timer.set_OUT_handler(2, speaker_handler);
+  } else {
+    BX_PIT_THIS s.timer.set_OUT_handler(2, NULL);
+  }
+}
+
 Bit16u bx_pit_c::get_timer(int Timer)
 {
   return BX_PIT_THIS s.timer.get_inlatch(Timer);
@@ -68,6 +68,7 @@ void pit_82C54::print_cnum(Bit8u cnum)
   if (cnum>MAX_COUNTER) {
     BX_ERROR(("Bad counter index to print_cnum"));
   } else {
+    update_lazy(counter[cnum]);
     print_counter(counter[cnum]);
   }
 }
@@ -169,6 +170,67 @@ void BX_CPP_AttrRegparmN(1) pit_82C54::decrement (counter_type &thisctr)
   }
 }
 
+// A counter in mode 2 or 3 whose OUT pin nobody watches runs through
+// the same period until the guest touches it again. Instead of clocking
+// it, remember the reload value and the clock of the reload and compute
+// count and OUT from the elapsed clocks when they are read.
+void pit_82C54::start_lazy(counter_type &thisctr)
+{
+  if ((thisctr.out_handler != NULL) || !thisctr.GATE ||
+      (thisctr.write_state == MSByte_multiple) || (thisctr.inlatch == 1)) {
+    return;
+  }
+  thisctr.reload = thisctr.count_binary;
+  if (thisctr.mode == 3) {
+    thisctr.reload |= thisctr.state_bit_1;
+  }
+  if (thisctr.reload == 0) {
+    thisctr.reload = thisctr.bcd_mode ? 10000 : 0x10000;
+  }
+  thisctr.start_time = clock_time;
+  if ((thisctr.mode == 3) && !thisctr.OUTpin) {
+    //Reloaded for the low half, the period started with the high half;
+    thisctr.start_time -= (thisctr.reload + 1) / 2;
+  }
+  thisctr.lazy = 1;
+  thisctr.next_change_time = 0;
+}
+
+void pit_82C54::update_lazy(counter_type &thisctr)
+{
+  if (!thisctr.lazy) return;
+
+  Bit32u phase = (Bit32u)((ticks - thisctr.start_time) % thisctr.reload);
+  Bit32u value;
+  if (thisctr.mode == 2) {
+    value = thisctr.reload - phase;
+    thisctr.first_pass = (value == 1);
+    set_OUT(thisctr, value != 1);
+  } else {
+    Bit32u half = (thisctr.reload + 1) / 2;
+    bx_bool out = (phase < half);
+    if (!out) {
+      phase -= half;
+      half = thisctr.reload / 2;
+    }
+    value = (thisctr.reload & ~1) - 2 * phase;
+    thisctr.state_bit_2 = (phase == (half - 1));
+    set_OUT(thisctr, out);
+  }
+  thisctr.count_binary = value % (thisctr.bcd_mode ? 10000 : 0x10000);
+  set_count_to_binary(thisctr);
+}
+
+void pit_82C54::stop_lazy(counter_type &thisctr)
+{
+  if (!thisctr.lazy) return;
+
+  update_lazy(thisctr);
+  thisctr.lazy = 0;
+  //clock() continues from the computed state on the next clock;
+  thisctr.next_change_time = 1;
+}
+
 void pit_82C54::init(void)
 {
   put("pit82c54", "PIT81");
@@ -195,7 +257,12 @@ void pit_82C54::init(void)
     counter[i].status_latched=0;
     counter[i].next_change_time=0;
     counter[i].out_handler=NULL;
+    counter[i].lazy=0;
+    counter[i].reload=0;
+    counter[i].start_time=0;
   }
+  ticks=0;
+  clock_time=0;
   seen_problems=0;
 }
 
@@ -235,7 +302,11 @@ void pit_82C54::register_state(bx_param_c *parent)
     new bx_shadow_bool_c(tim, "state_bit_1", &counter[i].state_bit_1);
     new bx_shadow_bool_c(tim, "state_bit_2", &counter[i].state_bit_2);
     new bx_shadow_num_c(tim, "next_change_time", &counter[i].next_change_time);
+    new bx_shadow_bool_c(tim, "lazy", &counter[i].lazy);
+    new bx_shadow_num_c(tim, "reload", &counter[i].reload);
+    new bx_shadow_num_c(tim, "start_time", &counter[i].start_time);
   }
+  new bx_shadow_num_c(parent, "ticks", &ticks);
 }
 
 void BX_CPP_AttrRegparmN(2) pit_82C54::decrement_multiple(counter_type &thisctr, Bit32u cycles)
@@ -260,7 +331,9 @@ void pit_82C54::clock_multiple(Bit8u cnum, Bit32u cycles)
     BX_ERROR(("Counter number too high in clock"));
   } else {
     counter_type &thisctr = counter[cnum];
-    while(cycles>0) {
+    Bit32u total = cycles;
+    //Lazy counters are computed from the clocks counted by clock_all;
+    while ((cycles>0) && !thisctr.lazy) {
       if (thisctr.next_change_time==0) {
         if (thisctr.count_written) {
           switch(thisctr.mode) {
@@ -309,6 +382,7 @@ void pit_82C54::clock_multiple(Bit8u cnum, Bit32u cycles)
           } else {
             decrement_multiple(thisctr,(thisctr.next_change_time-1));
             cycles-=thisctr.next_change_time;
+            clock_time=ticks+(total-cycles);
             clock(cnum);
           }
           break;
@@ -320,6 +394,7 @@ void pit_82C54::clock_multiple(Bit8u cnum, Bit32u cycles)
           } else {
             decrement_multiple(thisctr,(thisctr.next_change_time-1)*2);
             cycles-=thisctr.next_change_time;
+            clock_time=ticks+(total-cycles);
             clock(cnum);
           }
           break;
@@ -423,6 +498,7 @@ void BX_CPP_AttrRegparmN(1) pit_82C54::clock(Bit8u cnum)
               BX_ERROR(("Undefined behavior when loading a half loaded count."));
             }
             thisctr.first_pass=0;
+            start_lazy(thisctr);
           } else {
             if (thisctr.GATE) {
               decrement(thisctr);
@@ -474,6 +550,7 @@ void BX_CPP_AttrRegparmN(1) pit_82C54::clock(Bit8u cnum)
             }
             thisctr.state_bit_2=0;
             thisctr.first_pass=0;
+            start_lazy(thisctr);
           } else {
             if (thisctr.GATE) {
               decrement(thisctr);
@@ -595,6 +672,7 @@ void pit_82C54::clock_all(Bit32u cycles)
     clock_multiple(0,cycles);
     clock_multiple(1,cycles);
     clock_multiple(2,cycles);
+    ticks+=cycles;
 }
 
 Bit8u pit_82C54::read(Bit8u address)
@@ -613,6 +691,7 @@ Bit8u pit_82C54::read(Bit8u address)
       //Read from a counter;
       BX_DEBUG(("PIT Read: Counter %d.",address));
       counter_type &thisctr=counter[address];
+      update_lazy(thisctr);
       if (thisctr.status_latched) {
         //Latched Status Read;
         if (thisctr.count_MSB_latched &&
@@ -685,6 +764,7 @@ void pit_82C54::write(Bit8u address, Bit8u data)
           if ((M>>i) & 0x1) {
             //If we are using this counter;
             counter_type &thisctr=counter[i];
+            update_lazy(thisctr);
             if (!((controlword>>5) & 1)) {
               //Latch Count;
               latch_counter(thisctr);
@@ -710,8 +790,10 @@ void pit_82C54::write(Bit8u address, Bit8u data)
         if (!RW) {
           //Counter Latch command;
           BX_DEBUG(("Counter Latch command.  SC=%d",SC));
+          update_lazy(thisctr);
           latch_counter(thisctr);
         } else {
+          stop_lazy(thisctr);
           //Counter Program Command;
           BX_DEBUG(("Counter Program command.  SC=%d, RW=%d, M=%d, BCD=%d",SC,RW,M,BCD));
           thisctr.null_count=1;
@@ -757,6 +839,7 @@ void pit_82C54::write(Bit8u address, Bit8u data)
       //Write to counter initial value.
       counter_type &thisctr = counter[address];
       BX_DEBUG(("Write Initial Count: counter=%d, count=%d",address,data));
+      stop_lazy(thisctr);
       switch(thisctr.write_state) {
       case LSByte_multiple:
         thisctr.inlatch = data;
@@ -823,6 +906,7 @@ void pit_82C54::set_GATE(Bit8u cnum, bx_bool data)
     counter_type &thisctr = counter[cnum];
     if (!((thisctr.GATE&&data) || (!(thisctr.GATE||data)))) {
       BX_DEBUG(("Changing GATE %d to: %d",cnum,data));
+      stop_lazy(thisctr);
       thisctr.GATE=data;
       if (thisctr.GATE) {
         thisctr.triggerGATE=1;
@@ -921,6 +1005,7 @@ bx_bool pit_82C54::read_OUT(Bit8u cnum)
     return 0;
   }
 
+  update_lazy(counter[cnum]);
   return counter[cnum].OUTpin;
 }
 
@@ -975,5 +1060,8 @@ Bit8u pit_82C54::get_mode(int countnum)
 
 void pit_82C54::set_OUT_handler(Bit8u counternum, out_handler_t outh)
 {
+  if (outh != NULL) {
+    stop_lazy(counter[counternum]);
+  }
   counter[counternum].out_handler = outh;
 }
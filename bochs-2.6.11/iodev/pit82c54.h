@@ -94,10 +94,18 @@ private:
     Bit32u next_change_time; //Next time something besides count changes.
                              //0 means never.
     out_handler_t out_handler; // OUT pin callback (for IRQ0)
+
+    //Event free periodic state (modes 2 and 3 without OUT handler);
+    bx_bool lazy; //Whether count and OUT are computed from start_time
+    Bit32u reload; //Initial count in clocks (0 counts as 0x10000)
+    Bit64u start_time; //Clock of the reload that started a period
   };
 
   counter_type counter[3];
 
+  Bit64u ticks; //Clocks seen by clock_all
+  Bit64u clock_time; //Clock processed by the current clock() call
+
   Bit8u controlword;
 
   int seen_problems;
@@ -118,6 +126,10 @@ private:
 
   void clock(Bit8u cnum) BX_CPP_AttrRegparmN(1);
 
+  void start_lazy(counter_type & thisctr);
+  void update_lazy(counter_type & thisctr);
+  void stop_lazy(counter_type & thisctr);
+
   void print_counter(counter_type & thisctr);
 
 public:
@@ -0,0 +1,564 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+// Paravirtual PCI block device with a shared memory request ring.
+//
+// An ATA command costs the guest a port access for every taskfile
+// register and one more per sector or DMA setup. Here the requests are
+// read from guest memory, so one doorbell write submits a whole batch.
+// The disk image is read and written by a host worker thread while the
+// guest keeps running; a timer hands finished requests back to the guest.
+// A replay takes the finished requests from the log instead and leaves
+// the image alone.
+
+// Define BX_PLUGGABLE in files that can be compiled into plugins.  For
+// platforms that require a special tag on exported symbols, BX_PLUGGABLE
+// is used to know when we are exporting symbols and when we are importing.
+#define BX_PLUGGABLE
+
+#include "iodev.h"
+
+#if BX_SUPPORT_PCI
+
+#include "pci.h"
+#include "hdimage/hdimage.h"
+#include "pvblk.h"
+#include "replay.h"
+
+#define LOG_THIS thePvBlkDevice->
+#define BX_PVBLK_THIS thePvBlkDevice->
+
+// how often finished requests are checked for while some are in flight
+#define PVBLK_POLL_USEC 20
+
+bx_pvblk_c *thePvBlkDevice = NULL;
+
+const Bit8u pvblk_iomask[16] = {4, 0, 0, 0, 4, 0, 0, 0, 4, 0, 0, 0, 4, 0, 0, 0};
+
+// builtin configuration handling functions
+
+void pvblk_init_options(void)
+{
+  bx_param_c *ata = SIM->get_param("ata");
+  bx_list_c *menu = new bx_list_c(ata, "pvblk", "Paravirtual block device");
+  menu->set_options(menu->SHOW_PARENT);
+  bx_param_bool_c *enabled = new bx_param_bool_c(menu,
+    "enabled",
+    "Enable paravirtual block device",
+    "Enables the paravirtual PCI block device",
+    1);
+  new bx_param_filename_c(menu,
+    "path",
+    "Path or physical device name",
+    "Pathname of the disk image served by the device",
+    "", BX_PATHNAME_LEN);
+  new bx_param_enum_c(menu,
+    "mode",
+    "Type of disk image",
+    "Mode of the disk image, see the ata disk options",
+    hdimage_mode_names,
+    BX_HDIMAGE_MODE_FLAT,
+    BX_HDIMAGE_MODE_FLAT);
+  new bx_param_filename_c(menu,
+    "journal",
+    "Path of journal file",
+    "Pathname of the journal file for undoable and volatile modes",
+    "", BX_PATHNAME_LEN);
+  enabled->set_dependent_list(menu->clone());
+}
+
+Bit32s pvblk_options_parser(const char *context, int num_params, char *params[])
+{
+  if (!strcmp(params[0], "pvblk")) {
+    bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_PVBLK);
+    for (int i = 1; i < num_params; i++) {
+      if (SIM->parse_param_from_list(context, params[i], base) < 0) {
+        BX_ERROR(("%s: unknown parameter for pvblk ignored.", context));
+      }
+    }
+  } else {
+    BX_PANIC(("%s: unknown directive '%s'", context, params[0]));
+  }
+  return 0;
+}
+
+Bit32s pvblk_options_save(FILE *fp)
+{
+  return SIM->write_param_list(fp, (bx_list_c*) SIM->get_param(BXPN_PVBLK), NULL, 0);
+}
+
+// device plugin entry points
+
+int CDECL libpvblk_LTX_plugin_init(plugin_t *plugin, plugintype_t type)
+{
+  thePvBlkDevice = new bx_pvblk_c();
+  BX_REGISTER_DEVICE_DEVMODEL(plugin, type, thePvBlkDevice, BX_PLUGIN_PVBLK);
+  // add new configuration parameter for the config interface
+  pvblk_init_options();
+  // register add-on option for bochsrc and command line
+  SIM->register_addon_option("pvblk", pvblk_options_parser, pvblk_options_save);
+  return 0; // Success
+}
+
+void CDECL libpvblk_LTX_plugin_fini(void)
+{
+  SIM->unregister_addon_option("pvblk");
+  bx_list_c *menu = (bx_list_c*)SIM->get_param("ata");
+  menu->remove("pvblk");
+  delete thePvBlkDevice;
+}
+
+// the worker thread
+
+BX_THREAD_FUNC(pvblk_worker_thread, indata)
+{
+  ((bx_pvblk_c*)indata)->worker_loop();
+  BX_THREAD_EXIT;
+}
+
+// Serve the requests between done and avail in order. Only this thread
+// touches the image once the device is initialized.
+void bx_pvblk_c::worker_loop(void)
+{
+  while (1) {
+    BX_LOCK(req_mutex);
+    if (worker_stop) {
+      worker_exited = 1;
+      BX_UNLOCK(req_mutex);
+      break;
+    }
+    if (s.done == s.avail) {
+      BX_UNLOCK(req_mutex);
+      bx_wait_for_event(&req_event);
+      continue;
+    }
+    pvblk_req_t *r = &req[s.done % PVBLK_RING_SIZE];
+    BX_UNLOCK(req_mutex);
+
+    if (r->status == PVBLK_STATUS_OK) {
+      Bit64s offset = (Bit64s)r->lba * 512;
+      ssize_t len = (ssize_t)r->sectors * 512;
+      if (image->lseek(offset, SEEK_SET) != offset) {
+        r->status = PVBLK_STATUS_IOERR;
+      } else if (r->flags & PVBLK_FLAG_WRITE) {
+        if (image->write(r->buf, len) != len)
+          r->status = PVBLK_STATUS_IOERR;
+      } else {
+        if (image->read(r->buf, len) != len)
+          r->status = PVBLK_STATUS_IOERR;
+      }
+    }
+
+    BX_LOCK(req_mutex);
+    s.done++;
+    BX_UNLOCK(req_mutex);
+  }
+}
+
+// the device object
+
+bx_pvblk_c::bx_pvblk_c()
+{
+  put("pvblk", "PVBLK");
+  memset(&s, 0, sizeof(s));
+  s.timer_index = BX_NULL_TIMER_HANDLE;
+  image = NULL;
+  sectors = 0;
+  for (unsigned i = 0; i < PVBLK_RING_SIZE; i++) {
+    req[i].buf = NULL;
+  }
+  worker_started = 0;
+}
+
+bx_pvblk_c::~bx_pvblk_c()
+{
+  if (worker_started) {
+    BX_LOCK(req_mutex);
+    worker_stop = 1;
+    BX_UNLOCK(req_mutex);
+    // the thread may be between its check and the wait, keep waking it
+    while (1) {
+      bx_set_event(&req_event);
+      BX_LOCK(req_mutex);
+      bx_bool exited = worker_exited;
+      BX_UNLOCK(req_mutex);
+      if (exited) break;
+      BX_MSLEEP(1);
+    }
+    BX_THREAD_JOIN(worker_thread);
+  }
+  if (image != NULL) {
+    bx_destroy_event(&req_event);
+    BX_FINI_MUTEX(req_mutex);
+    image->close();
+    delete image;
+  }
+  for (unsigned i = 0; i < PVBLK_RING_SIZE; i++) {
+    delete [] req[i].buf;
+  }
+  SIM->get_bochs_root()->remove("pvblk");
+  BX_DEBUG(("Exit"));
+}
+
+void bx_pvblk_c::init(void)
+{
+  bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_PVBLK);
+  // Check if the device is disabled or not configured
+  if (!SIM->get_param_bool("enabled", base)->get() ||
+      SIM->get_param_string("path", base)->isempty()) {
+    BX_INFO(("paravirtual block device disabled"));
+    // mark unused plugin for removal
+    ((bx_param_bool_c*)((bx_list_c*)SIM->get_param(BXPN_PLUGIN_CTRL))->get_by_name("pvblk"))->set(0);
+    return;
+  }
+
+  const char *path = SIM->get_param_string("path", base)->getptr();
+  Bit8u mode = (Bit8u) SIM->get_param_enum("mode", base)->get();
+  image = DEV_hdimage_init_image(mode, 0, SIM->get_param_string("journal", base)->getptr());
+  if (image == NULL) {
+    BX_PANIC(("pvblk: image mode '%s' not supported", hdimage_mode_names[mode]));
+    return;
+  }
+  if (image->open(path) < 0) {
+    BX_PANIC(("pvblk: could not open disk image file '%s'", path));
+    delete image;
+    image = NULL;
+    return;
+  }
+  Bit64u size = image->hd_size / 512;
+  sectors = (size > 0xffffffff) ? 0xffffffff : (Bit32u) size;
+
+  BX_PVBLK_THIS s.devfunc = 0x00;
+  DEV_register_pci_handlers(this, &BX_PVBLK_THIS s.devfunc, BX_PLUGIN_PVBLK,
+                            "Paravirtual block device");
+
+  // initialize readonly registers, mass storage controller of type "other"
+  init_pci_conf(PVBLK_PCI_VENDOR, PVBLK_PCI_DEVICE, 0x00, 0x018000, 0x00, BX_PCI_INTA);
+  BX_PVBLK_THIS init_bar_io(0, 16, read_handler, write_handler, &pvblk_iomask[0]);
+
+  for (unsigned i = 0; i < PVBLK_RING_SIZE; i++) {
+    req[i].buf = new Bit8u[PVBLK_MAX_SECTORS * 512];
+  }
+  if (BX_PVBLK_THIS s.timer_index == BX_NULL_TIMER_HANDLE) {
+    BX_PVBLK_THIS s.timer_index =
+      DEV_register_timer(this, timer_handler, PVBLK_POLL_USEC, 1, 0, "pvblk");
+  }
+  BX_PVBLK_THIS s.statusbar_id = bx_gui->register_statusitem("PVBLK", 1);
+
+  worker_stop = 0;
+  worker_exited = 0;
+  BX_INIT_MUTEX(req_mutex);
+  bx_create_event(&req_event);
+  if (!BX_REPLAY_REPLAYING) {
+    BX_THREAD_CREATE(pvblk_worker_thread, this, worker_thread);
+    worker_started = 1;
+  }
+
+  BX_INFO(("pvblk: '%s', '%s' mode, %u sectors", path, hdimage_mode_names[mode], sectors));
+}
+
+// wait for the worker to finish the requests it already has
+void bx_pvblk_c::wait_idle(void)
+{
+  while (1) {
+    BX_LOCK(req_mutex);
+    bx_bool idle = (s.done == s.avail);
+    BX_UNLOCK(req_mutex);
+    if (idle) break;
+    bx_set_event(&req_event);
+    BX_MSLEEP(1);
+  }
+}
+
+void bx_pvblk_c::reset(unsigned type)
+{
+  static const struct reset_vals_t {
+    unsigned      addr;
+    unsigned char val;
+  } reset_vals[] = {
+    { 0x04, 0x01 }, { 0x05, 0x00 }, // command_io
+    { 0x06, 0x00 }, { 0x07, 0x00 }, // status
+    { 0x3c, 0x00 },                 // IRQ
+  };
+  for (unsigned i = 0; i < sizeof(reset_vals) / sizeof(*reset_vals); ++i) {
+    BX_PVBLK_THIS pci_conf[reset_vals[i].addr] = reset_vals[i].val;
+  }
+
+  // requests still in flight are dropped, the guest starts over
+  if (worker_started) wait_idle();
+  BX_PVBLK_THIS s.ring_addr = 0;
+  BX_PVBLK_THIS s.avail = 0;
+  BX_PVBLK_THIS s.done = 0;
+  BX_PVBLK_THIS s.used = 0;
+  BX_PVBLK_THIS s.isr = 0;
+  bx_pc_system.deactivate_timer(BX_PVBLK_THIS s.timer_index);
+  set_irq_level(0);
+}
+
+void bx_pvblk_c::register_state(void)
+{
+  bx_list_c *list = new bx_list_c(SIM->get_bochs_root(), "pvblk", "Paravirtual Block Device State");
+  BXRS_HEX_PARAM_FIELD(list, ring_addr, BX_PVBLK_THIS s.ring_addr);
+  BXRS_HEX_PARAM_FIELD(list, isr, BX_PVBLK_THIS s.isr);
+  BXRS_DEC_PARAM_FIELD(list, avail, BX_PVBLK_THIS s.avail);
+  BXRS_DEC_PARAM_FIELD(list, used, BX_PVBLK_THIS s.used);
+  register_pci_state(list);
+}
+
+void bx_pvblk_c::after_restore_state(void)
+{
+  bx_pci_device_c::after_restore_pci_state(NULL);
+  // the host side of requests in flight is not saved, fail them
+  for (Bit32u n = BX_PVBLK_THIS s.used; n != BX_PVBLK_THIS s.avail; n++) {
+    pvblk_req_t *r = &req[n % PVBLK_RING_SIZE];
+    r->flags = 0;
+    r->seg_cnt = 0;
+    r->status = PVBLK_STATUS_IOERR;
+  }
+  BX_PVBLK_THIS s.done = BX_PVBLK_THIS s.avail;
+  if (BX_PVBLK_THIS s.used != BX_PVBLK_THIS s.avail) {
+    bx_pc_system.activate_timer(BX_PVBLK_THIS s.timer_index, PVBLK_POLL_USEC, 1);
+  }
+}
+
+void bx_pvblk_c::set_irq_level(bx_bool level)
+{
+  DEV_pci_set_irq(BX_PVBLK_THIS s.devfunc, BX_PVBLK_THIS pci_conf[0x3d], level);
+}
+
+// copy the descriptor in ring slot 'slot' and, for a write, its data
+void bx_pvblk_c::fetch_request(pvblk_req_t *r, Bit32u slot)
+{
+  bx_phy_address desc = BX_PVBLK_THIS s.ring_addr + PVBLK_RING_HDR_SIZE + slot * PVBLK_DESC_SIZE;
+  Bit32u seg_table, total = 0;
+
+  DEV_MEM_READ_PHYSICAL(desc, 4, (Bit8u *)&r->lba);
+  DEV_MEM_READ_PHYSICAL(desc + 4, 4, (Bit8u *)&r->sectors);
+  DEV_MEM_READ_PHYSICAL(desc + 8, 4, (Bit8u *)&r->flags);
+  DEV_MEM_READ_PHYSICAL(desc + 16, 4, (Bit8u *)&seg_table);
+  DEV_MEM_READ_PHYSICAL(desc + 20, 4, (Bit8u *)&r->seg_cnt);
+
+  r->status = PVBLK_STATUS_OK;
+  if ((r->sectors == 0) || (r->sectors > PVBLK_MAX_SECTORS) ||
+      (r->seg_cnt == 0) || (r->seg_cnt > PVBLK_MAX_SEGS) ||
+      ((Bit64u)r->lba + r->sectors > sectors)) {
+    BX_ERROR(("bad request: lba=%u sectors=%u segments=%u", r->lba, r->sectors, r->seg_cnt));
+    r->status = PVBLK_STATUS_BADREQ;
+    r->seg_cnt = 0;
+    return;
+  }
+  for (Bit32u i = 0; i < r->seg_cnt; i++) {
+    DEV_MEM_READ_PHYSICAL(seg_table + i * 8, 4, (Bit8u *)&r->seg[i].addr);
+    DEV_MEM_READ_PHYSICAL(seg_table + i * 8 + 4, 4, (Bit8u *)&r->seg[i].len);
+    total += r->seg[i].len;
+  }
+  if (total != r->sectors * 512) {
+    BX_ERROR(("bad request: segments hold %u bytes for %u sectors", total, r->sectors));
+    r->status = PVBLK_STATUS_BADREQ;
+    r->seg_cnt = 0;
+    return;
+  }
+  if (r->flags & PVBLK_FLAG_WRITE) {
+    Bit8u *p = r->buf;
+    for (Bit32u i = 0; i < r->seg_cnt; i++) {
+      DEV_MEM_READ_PHYSICAL_DMA(r->seg[i].addr, r->seg[i].len, p);
+      p += r->seg[i].len;
+    }
+  }
+}
+
+// take the new descriptors of the ring and pass them to the worker
+void bx_pvblk_c::notify(void)
+{
+  Bit32u avail, slots;
+
+  if (BX_PVBLK_THIS s.ring_addr == 0) {
+    BX_ERROR(("notify without a ring"));
+    return;
+  }
+  DEV_MEM_READ_PHYSICAL(BX_PVBLK_THIS s.ring_addr, 4, (Bit8u *)&avail);
+  slots = avail - BX_PVBLK_THIS s.avail;
+  if (slots == 0) return;
+  if ((avail - BX_PVBLK_THIS s.used) > PVBLK_RING_SIZE) {
+    BX_ERROR(("guest posted more than %d requests", PVBLK_RING_SIZE));
+    return;
+  }
+  // the worker does not look at requests past s.avail, they can be
+  // filled without holding the lock
+  for (Bit32u n = BX_PVBLK_THIS s.avail; n != avail; n++) {
+    fetch_request(&req[n % PVBLK_RING_SIZE], n % PVBLK_RING_SIZE);
+  }
+  BX_LOCK(req_mutex);
+  BX_PVBLK_THIS s.avail = avail;
+  BX_UNLOCK(req_mutex);
+  bx_set_event(&req_event);
+  bx_pc_system.activate_timer(BX_PVBLK_THIS s.timer_index, PVBLK_POLL_USEC, 1);
+  bx_gui->statusbar_setitem(BX_PVBLK_THIS s.statusbar_id, 1);
+}
+
+// hand a finished request back to the guest
+void bx_pvblk_c::complete_request(pvblk_req_t *r, Bit32u slot)
+{
+  bx_phy_address desc = BX_PVBLK_THIS s.ring_addr + PVBLK_RING_HDR_SIZE + slot * PVBLK_DESC_SIZE;
+
+  if ((r->status == PVBLK_STATUS_OK) && !(r->flags & PVBLK_FLAG_WRITE)) {
+    Bit8u *p = r->buf;
+    for (Bit32u i = 0; i < r->seg_cnt; i++) {
+      DEV_MEM_WRITE_PHYSICAL_DMA(r->seg[i].addr, r->seg[i].len, p);
+      p += r->seg[i].len;
+    }
+  }
+  DEV_MEM_WRITE_PHYSICAL(desc + 12, 4, (Bit8u *)&r->status);
+}
+
+void bx_pvblk_c::timer_handler(void *this_ptr)
+{
+  bx_pvblk_c *class_ptr = (bx_pvblk_c *) this_ptr;
+  class_ptr->timer();
+}
+
+void bx_pvblk_c::timer(void)
+{
+  Bit32u len;
+
+  BX_LOCK(req_mutex);
+  Bit32u done = BX_PVBLK_THIS s.done;
+  BX_UNLOCK(req_mutex);
+
+  if (BX_REPLAY_REPLAYING) {
+    // the requests the recording saw finished at this tick
+    while ((done != BX_PVBLK_THIS s.avail) && bx_replay_get(BX_REPLAY_PVBLK, 0, &len)) {
+      pvblk_req_t *r = &req[done % PVBLK_RING_SIZE];
+      bx_replay_get_data(&r->status, 4);
+      if ((len - 4) > PVBLK_MAX_SECTORS * 512) {
+        BX_PANIC(("replay: pvblk request with %u bytes of data", len - 4));
+        break;
+      }
+      bx_replay_get_data(r->buf, len - 4);
+      done++;
+    }
+    BX_PVBLK_THIS s.done = done;
+  }
+  if (done != BX_PVBLK_THIS s.used) {
+    for (; BX_PVBLK_THIS s.used != done; BX_PVBLK_THIS s.used++) {
+      Bit32u slot = BX_PVBLK_THIS s.used % PVBLK_RING_SIZE;
+      pvblk_req_t *r = &req[slot];
+      if (BX_REPLAY_RECORDING) {
+        len = ((r->status == PVBLK_STATUS_OK) && !(r->flags & PVBLK_FLAG_WRITE)) ?
+              r->sectors * 512 : 0;
+        bx_replay_put(BX_REPLAY_PVBLK, 0, 4 + len);
+        bx_replay_put_data(&r->status, 4);
+        if (len > 0)
+          bx_replay_put_data(r->buf, len);
+      }
+      complete_request(r, slot);
+    }
+    DEV_MEM_WRITE_PHYSICAL(BX_PVBLK_THIS s.ring_addr + 4, 4, (Bit8u *)&BX_PVBLK_THIS s.used);
+    BX_PVBLK_THIS s.isr |= PVBLK_ISR_DONE;
+    set_irq_level(1);
+  }
+  if (BX_PVBLK_THIS s.used == BX_PVBLK_THIS s.avail) {
+    bx_pc_system.deactivate_timer(BX_PVBLK_THIS s.timer_index);
+  } else if (done != BX_PVBLK_THIS s.avail) {
+    // the worker may have missed the last wakeup
+    bx_set_event(&req_event);
+  }
+}
+
+// static IO port read callback handler
+// redirects to non-static class handler to avoid virtual functions
+
+Bit32u bx_pvblk_c::read_handler(void *this_ptr, Bit32u address, unsigned io_len)
+{
+  bx_pvblk_c *class_ptr = (bx_pvblk_c *) this_ptr;
+  return class_ptr->read(address, io_len);
+}
+
+Bit32u bx_pvblk_c::read(Bit32u address, unsigned io_len)
+{
+  Bit32u val = 0;
+
+  switch (address - BX_PVBLK_THIS pci_bar[0].addr) {
+    case PVBLK_REG_RING:
+      val = BX_PVBLK_THIS s.ring_addr;
+      break;
+    case PVBLK_REG_ISR:
+      val = BX_PVBLK_THIS s.isr;
+      BX_PVBLK_THIS s.isr = 0;
+      set_irq_level(0);
+      break;
+    case PVBLK_REG_SECTORS:
+      val = sectors;
+      break;
+    default:
+      BX_ERROR(("read from write only register 0x%04x", address));
+  }
+  return val;
+}
+
+// static IO port write callback handler
+// redirects to non-static class handler to avoid virtual functions
+
+void bx_pvblk_c::write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len)
+{
+  bx_pvblk_c *class_ptr = (bx_pvblk_c *) this_ptr;
+  class_ptr->write(address, value, io_len);
+}
+
+void bx_pvblk_c::write(Bit32u address, Bit32u value, unsigned io_len)
+{
+  switch (address - BX_PVBLK_THIS pci_bar[0].addr) {
+    case PVBLK_REG_RING:
+      if (BX_PVBLK_THIS s.used != BX_PVBLK_THIS s.avail) {
+        BX_ERROR(("ring moved with requests in flight"));
+        break;
+      }
+      BX_PVBLK_THIS s.ring_addr = value;
+      // start from the indices the guest left in the ring
+      if (value != 0) {
+        DEV_MEM_READ_PHYSICAL(value, 4, (Bit8u *)&BX_PVBLK_THIS s.avail);
+        BX_LOCK(req_mutex);
+        BX_PVBLK_THIS s.done = BX_PVBLK_THIS s.avail;
+        BX_UNLOCK(req_mutex);
+        BX_PVBLK_THIS s.used = BX_PVBLK_THIS s.avail;
+        DEV_MEM_WRITE_PHYSICAL(value + 4, 4, (Bit8u *)&BX_PVBLK_THIS s.used);
+      }
+      break;
+    case PVBLK_REG_NOTIFY:
+      notify();
+      break;
+    default:
+      BX_ERROR(("write to read only register 0x%04x", address));
+  }
+}
+
+// pci configuration space write callback handler
+void bx_pvblk_c::pci_write_handler(Bit8u address, Bit32u value, unsigned io_len)
+{
+  BX_DEBUG_PCI_WRITE(address, value, io_len);
+  for (unsigned i=0; i<io_len; i++) {
+    Bit8u value8 = (value >> (i*8)) & 0xff;
+    if ((address+i) == 0x04) {
+      BX_PVBLK_THIS pci_conf[0x04] = value8 & 0x05;
+    }
+  }
+}
+
+#endif // BX_SUPPORT_PCI
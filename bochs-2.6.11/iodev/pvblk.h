@@ -0,0 +1,134 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+#ifndef BX_IODEV_PVBLK_H
+#define BX_IODEV_PVBLK_H
+
+#include "bxthread.h"
+
+// Paravirtual block device
+//
+// The guest keeps a ring of request descriptors in its own memory and
+// tells the device where it is by writing PVBLK_REG_RING. To submit it
+// fills descriptors, bumps the avail index in the ring header and writes
+// PVBLK_REG_NOTIFY once for any number of new descriptors. The device
+// completes descriptors in order, stores their status, advances the used
+// index and raises its PCI interrupt. Reading PVBLK_REG_ISR acknowledges it.
+//
+// ring header:  +0 avail index (guest), +4 used index (device), both
+//               free running, the slot of index n is n % PVBLK_RING_SIZE
+// descriptor:   +0 lba, +4 sector count, +8 flags, +12 status,
+//               +16 physical address of the segment table, +20 segment count
+// segment:      +0 physical address, +4 byte count
+
+#define PVBLK_PCI_VENDOR    0xfefe
+#define PVBLK_PCI_DEVICE    0x0b10
+
+#define PVBLK_REG_RING      0x00   // physical address of the ring, r/w
+#define PVBLK_REG_NOTIFY    0x04   // doorbell, w
+#define PVBLK_REG_ISR       0x08   // interrupt status, read clears it
+#define PVBLK_REG_SECTORS   0x0c   // disk size in sectors, r
+
+#define PVBLK_RING_SIZE     16
+#define PVBLK_RING_HDR_SIZE 16
+#define PVBLK_DESC_SIZE     32
+#define PVBLK_MAX_SECTORS   256
+#define PVBLK_MAX_SEGS      512
+
+#define PVBLK_FLAG_WRITE    0x01
+
+#define PVBLK_STATUS_OK     0
+#define PVBLK_STATUS_IOERR  1
+#define PVBLK_STATUS_BADREQ 2
+
+#define PVBLK_ISR_DONE      0x01
+
+typedef struct {
+  Bit32u addr;
+  Bit32u len;
+} pvblk_seg_t;
+
+// a request copied out of the guest ring, the data buffer holds the
+// sectors to write or receives the sectors read
+typedef struct {
+  Bit32u lba;
+  Bit32u sectors;
+  Bit32u flags;
+  Bit32u status;
+  Bit32u seg_cnt;
+  pvblk_seg_t seg[PVBLK_MAX_SEGS];
+  Bit8u *buf;
+} pvblk_req_t;
+
+class bx_pvblk_c : public bx_pci_device_c {
+public:
+  bx_pvblk_c();
+  virtual ~bx_pvblk_c();
+  virtual void init(void);
+  virtual void reset(unsigned type);
+  virtual void register_state(void);
+  virtual void after_restore_state(void);
+
+  virtual void pci_write_handler(Bit8u address, Bit32u value, unsigned io_len);
+
+  void worker_loop(void);
+
+private:
+  struct {
+    Bit8u  devfunc;
+    Bit32u ring_addr;
+    Bit32u isr;
+    // free running request counters: avail requests were taken from the
+    // ring, done requests were served by the worker thread and used
+    // requests were handed back to the guest
+    Bit32u avail;
+    Bit32u done;
+    Bit32u used;
+    int timer_index;
+    int statusbar_id;
+  } s;
+
+  device_image_t *image;
+  Bit32u sectors;
+  pvblk_req_t req[PVBLK_RING_SIZE];
+
+  bx_bool worker_started;
+  volatile bx_bool worker_stop;
+  volatile bx_bool worker_exited;
+  BX_THREAD_VAR(worker_thread);
+  BX_MUTEX(req_mutex);
+  bx_thread_event_t req_event;
+
+  void set_irq_level(bx_bool level);
+  void notify(void);
+  void fetch_request(pvblk_req_t *r, Bit32u slot);
+  void complete_request(pvblk_req_t *r, Bit32u slot);
+  void wait_idle(void);
+
+  static void timer_handler(void *);
+  void timer(void);
+
+  static Bit32u read_handler(void *this_ptr, Bit32u address, unsigned io_len);
+  static void   write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len);
+  Bit32u read(Bit32u address, unsigned io_len);
+  void   write(Bit32u address, Bit32u value, unsigned io_len);
+};
+
+#endif
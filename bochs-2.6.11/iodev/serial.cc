@@ -45,6 +45,7 @@ typedef int SOCKET;
 #endif
 
 #include "serial.h"
+#include "replay.h"
 
 #if defined(WIN32) && !defined(FILE_FLAG_FIRST_PIPE_INSTANCE)
 #define FILE_FLAG_FIRST_PIPE_INSTANCE 0
@@ -1523,6 +1524,8 @@ void bx_serial_c::rx_timer(void)
   bx_bool data_ready = 0;
   int db_usec = BX_SER_THIS s[port].databyte_usec;
   unsigned char chbuf = 0;
+  Bit8u io_mode = BX_SER_THIS s[port].io_mode;
+  Bit32u len;
 
   if (BX_SER_THIS s[port].io_mode == BX_SER_MODE_TERM) {
 #if BX_HAVE_SELECT && defined(SERIAL_ENABLE)
@@ -1540,7 +1543,16 @@ void bx_serial_c::rx_timer(void)
   }
   if ((BX_SER_THIS s[port].line_status.rxdata_ready == 0) ||
       (BX_SER_THIS s[port].fifo_cntl.enable)) {
-    switch (BX_SER_THIS s[port].io_mode) {
+    // a replay takes the received bytes from the log, the mouse data
+    // follows from the logged mouse input
+    if (BX_REPLAY_REPLAYING && (io_mode != BX_SER_MODE_MOUSE)) {
+      if (bx_replay_get(BX_REPLAY_SERIAL, port, &len)) {
+        bx_replay_get_data(&chbuf, 1);
+        data_ready = 1;
+      }
+      io_mode = BX_SER_MODE_NULL;
+    }
+    switch (io_mode) {
       case BX_SER_MODE_SOCKET_CLIENT:
       case BX_SER_MODE_SOCKET_SERVER:
 #if BX_HAVE_SELECT && defined(SERIAL_ENABLE)
@@ -1639,6 +1651,9 @@ void bx_serial_c::rx_timer(void)
 #endif
         break;
     }
+    if (BX_REPLAY_RECORDING && data_ready && (io_mode != BX_SER_MODE_MOUSE)) {
+      bx_replay_record(BX_REPLAY_SERIAL, port, &chbuf, 1);
+    }
     if (data_ready) {
       if (!BX_SER_THIS s[port].modem_cntl.local_loopback) {
         rx_fifo_enq(port, chbuf);
@@ -25,6 +25,8 @@
 // is used to know when we are exporting symbols and when we are importing.
 #define BX_PLUGGABLE
 #include "iodev.h"
+#include "cpu/cpu.h"
+#include "clone.h"
 #include "unmapped.h"
 
 #define LOG_THIS theUnmappedDevice->
@@ -46,10 +48,14 @@ void CDECL libunmapped_LTX_plugin_fini(void)
 bx_unmapped_c::bx_unmapped_c(void)
 {
   put("unmapped", "UNMAP");
+  s.log_fp = NULL;
 }
 
 bx_unmapped_c::~bx_unmapped_c(void)
 {
+  if (s.log_fp != NULL) {
+    fclose(s.log_fp);
+  }
   BX_DEBUG(("Exit"));
 }
 
@@ -62,6 +68,59 @@ void bx_unmapped_c::init(void)
   s.port8e = 0x00;
   s.shutdown = 0;
   s.port_e9_hack = SIM->get_param_bool(BXPN_PORT_E9_HACK)->get();
+  s.log_newline = 1;
+  s.log_addr = 0;
+  const char *logfile = SIM->get_param_string(BXPN_PORT_E9_LOG)->getptr();
+  if (s.port_e9_hack && (strlen(logfile) > 0)) {
+    s.log_fp = fopen(logfile, "w");
+    if (s.log_fp == NULL) {
+      BX_ERROR(("could not open port 0xE9 log file '%s'", logfile));
+    }
+  }
+}
+
+// Write guest debug output to the log file, each line prefixed with the
+// virtual time. Without a log file the output goes to the console.
+void bx_unmapped_c::guest_log_put(const Bit8u *buf, Bit32u len)
+{
+  if (BX_UM_THIS s.log_fp == NULL) {
+    fwrite(buf, 1, len, stdout);
+    fflush(stdout);
+    return;
+  }
+  for (Bit32u i = 0; i < len; i++) {
+    if (BX_UM_THIS s.log_newline) {
+      Bit64u usec = bx_pc_system.time_usec();
+      fprintf(BX_UM_THIS s.log_fp, "[%6u.%06u] ", (unsigned)(usec / 1000000), (unsigned)(usec % 1000000));
+    }
+    putc(buf[i], BX_UM_THIS s.log_fp);
+    BX_UM_THIS s.log_newline = (buf[i] == '\n');
+  }
+}
+
+// Copy a guest buffer to the log. The address is linear and translated
+// with the current page tables of cpu 0, so a kernel can pass a pointer.
+void bx_unmapped_c::guest_log_copy(bx_address laddr, Bit32u len)
+{
+  Bit8u buf[4096];
+
+  while (len > 0) {
+    Bit32u chunk = 0x1000 - (Bit32u)(laddr & 0xfff);
+    bx_phy_address paddr;
+    if (chunk > len) chunk = len;
+#if BX_DEBUGGER || BX_DISASM || BX_INSTRUMENTATION || BX_GDBSTUB
+    if (! BX_CPU(0)->dbg_xlate_linear2phy(laddr, &paddr)) {
+      BX_ERROR(("port 0xE9 log: buffer at 0x" FMT_ADDRX " not mapped", laddr));
+      return;
+    }
+#else
+    paddr = (bx_phy_address) laddr;
+#endif
+    DEV_MEM_READ_PHYSICAL_DMA(paddr, chunk, buf);
+    guest_log_put(buf, chunk);
+    laddr += chunk;
+    len -= chunk;
+  }
 }
 
 // static IO port read callback handler
@@ -112,6 +171,10 @@ Bit32u bx_unmapped_c::read(Bit32u address, unsigned io_len)
       }
       break;
 
+    case BX_CLONE_PORT:
+      retval = (Bit32u) bx_clone_instance();
+      break;
+
     case 0x03df:
       retval = 0xffffffff;
       BX_DEBUG(("unsupported IO read from port %04x (CGA)", address));
@@ -208,11 +271,39 @@ void bx_unmapped_c::write(Bit32u address, Bit32u value, unsigned io_len)
 
     case 0xe9:
       if (BX_UM_THIS s.port_e9_hack) {
-        putchar(value);
-        fflush(stdout);
+        Bit8u c = (Bit8u) value;
+        guest_log_put(&c, 1);
       }
       break;
 
+    // Buffered variant of the port 0xE9 hack: write the linear address of
+    // a string to port 0x8910, then its length to port 0x8914. The whole
+    // string is copied to the log with one i/o write.
+    case 0x8910:
+      BX_UM_THIS s.log_addr = value;
+      break;
+    case 0x8914:
+      if (BX_UM_THIS s.port_e9_hack) {
+        guest_log_copy(BX_UM_THIS s.log_addr, value);
+      }
+      break;
+
+    // Boot once, clone many: fork the configured number of clones here,
+    // each of them continues with its own port 0xE9 log file
+    case BX_CLONE_PORT: {
+      int instance = bx_clone_instances();
+      if ((instance >= 0) && (BX_UM_THIS s.log_fp != NULL)) {
+        char fname[BX_PATHNAME_LEN];
+        snprintf(fname, sizeof(fname), "%s.%d", SIM->get_param_string(BXPN_PORT_E9_LOG)->getptr(), instance);
+        fclose(BX_UM_THIS s.log_fp);
+        BX_UM_THIS s.log_fp = fopen(fname, "w");
+        if (BX_UM_THIS s.log_fp == NULL) {
+          BX_ERROR(("could not open port 0xE9 log file '%s'", fname));
+        }
+      }
+      break;
+    }
+
     case 0xed: // Dummy port used as I/O delay
       break;
     case 0xee: // ???
@@ -248,6 +339,8 @@ void bx_unmapped_c::write(Bit32u address, Bit32u value, unsigned io_len)
         // output 'D' to port 8900, and bochs quits to debugger
         case 'D': bx_debug_break(); break;
 #endif
+        // output 'T' to port 8900 to print the text screen to stdout
+        case 'T': bx_gui->dump_text_screen(stdout); BX_UM_THIS s.shutdown = 0; break;
         default : BX_UM_THIS s.shutdown = 0; break;
       }
       if (BX_UM_THIS s.shutdown == 8) {
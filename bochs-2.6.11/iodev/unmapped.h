@@ -40,6 +40,8 @@ private:
 
   static Bit32u read_handler(void *this_ptr, Bit32u address, unsigned io_len);
   static void   write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len);
+  BX_UM_SMF void guest_log_put(const Bit8u *buf, Bit32u len);
+  BX_UM_SMF void guest_log_copy(bx_address laddr, Bit32u len);
 #if !BX_USE_UM_SMF
   Bit32u read(Bit32u address, unsigned io_len);
   void   write(Bit32u address, Bit32u value, unsigned io_len);
@@ -50,6 +52,9 @@ private:
     Bit8u port8e;
     Bit8u shutdown;
     bx_bool port_e9_hack;
+    FILE *log_fp;         // port 0xE9 log file, NULL if not configured
+    bx_bool log_newline;  // next log byte starts a line
+    Bit32u log_addr;      // guest log buffer address
   } s;  // state information
 };
 
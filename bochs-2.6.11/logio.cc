@@ -34,6 +34,177 @@
 static int Allocio=0;
 BX_MUTEX(logio_mutex);
 
+// Asynchronous logging: out() copies the format string, the raw arguments
+// and the time stamp into a ring buffer and a host thread formats and
+// writes the messages. Panics, formats the capture code doesn't handle and
+// overlong strings are written synchronously, after the pending entries.
+
+#define BX_LOG_RING_SIZE 4096
+#define BX_LOG_MAX_ARGS  12
+#define BX_LOG_FMTLEN    160
+#define BX_LOG_STRLEN    192
+
+enum {
+  BX_LOG_ARG_INT,
+  BX_LOG_ARG_LONG,
+  BX_LOG_ARG_LLONG,
+  BX_LOG_ARG_SIZE,
+  BX_LOG_ARG_DOUBLE,
+  BX_LOG_ARG_STR,
+  BX_LOG_ARG_PTR,
+  BX_LOG_ARG_NONE, // "%%"
+  BX_LOG_ARG_BAD
+};
+
+struct bx_log_entry_t {
+  int level;
+  Bit32u eip;
+  Bit64u ticks;
+  char prefix[16];
+  char fmt[BX_LOG_FMTLEN];
+  Bit64u arg[BX_LOG_MAX_ARGS];
+  char str[BX_LOG_STRLEN]; // copies of the %s arguments
+};
+
+static bx_log_entry_t *log_ring = NULL;
+static Bit32u log_head = 0, log_tail = 0, log_dropped = 0;
+static volatile bx_bool log_writer_running = 0;
+static BX_THREAD_VAR(log_writer);
+
+// Parse the conversion specification after a '%'. *end is set behind the
+// conversion character and *stars to the number of '*' arguments.
+static int log_parse_conversion(const char *p, const char **end, unsigned *stars)
+{
+  int length = 0; // 1 = long, 2 = 64-bit, 3 = size_t, 4 = long double
+
+  *stars = 0;
+  if (*p == '%') {
+    *end = p + 1;
+    return BX_LOG_ARG_NONE;
+  }
+  while ((*p != 0) && (strchr("-+ #0", *p) != NULL)) p++;
+  if (*p == '*') {
+    (*stars)++;
+    p++;
+  } else {
+    while (isdigit(*p)) p++;
+  }
+  if (*p == '.') {
+    p++;
+    if (*p == '*') {
+      (*stars)++;
+      p++;
+    } else {
+      while (isdigit(*p)) p++;
+    }
+  }
+  if (*p == 'h') {
+    p++;
+    if (*p == 'h') p++;
+  } else if (*p == 'l') {
+    p++;
+    length = 1;
+    if (*p == 'l') {
+      p++;
+      length = 2;
+    }
+  } else if ((*p == 'q') || (*p == 'j')) {
+    p++;
+    length = 2;
+  } else if ((p[0] == 'I') && (p[1] == '6') && (p[2] == '4')) {
+    p += 3;
+    length = 2;
+  } else if ((*p == 'z') || (*p == 't')) {
+    p++;
+    length = 3;
+  } else if (*p == 'L') {
+    p++;
+    length = 4;
+  }
+  *end = p + 1;
+  switch (*p) {
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+      return (length == 4) ? BX_LOG_ARG_BAD : BX_LOG_ARG_INT + length;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+      return (length == 4) ? BX_LOG_ARG_BAD : BX_LOG_ARG_DOUBLE;
+    case 's':
+      return (length == 0) ? BX_LOG_ARG_STR : BX_LOG_ARG_BAD;
+    case 'p':
+      return BX_LOG_ARG_PTR;
+    default:
+      *end = p;
+      return BX_LOG_ARG_BAD;
+  }
+}
+
+// Copy the message arguments into a ring entry, returns 0 if the message
+// has to be formatted synchronously.
+static bx_bool log_capture(bx_log_entry_t *entry, const char *fmt, va_list ap)
+{
+  const char *p = fmt, *end;
+  unsigned n = 0, slen = 0, stars;
+  size_t len = strlen(fmt);
+
+  if (len >= BX_LOG_FMTLEN) return 0;
+  memcpy(entry->fmt, fmt, len + 1);
+
+  while ((p = strchr(p, '%')) != NULL) {
+    int type = log_parse_conversion(p + 1, &end, &stars);
+    p = end;
+    if (type == BX_LOG_ARG_NONE) continue;
+    if ((type == BX_LOG_ARG_BAD) || ((n + stars) >= BX_LOG_MAX_ARGS)) return 0;
+    while (stars-- > 0) {
+      entry->arg[n++] = (Bit64s) va_arg(ap, int);
+    }
+    switch (type) {
+      case BX_LOG_ARG_INT:
+        entry->arg[n++] = (Bit64s) va_arg(ap, int);
+        break;
+      case BX_LOG_ARG_LONG:
+        entry->arg[n++] = (Bit64s) va_arg(ap, long);
+        break;
+      case BX_LOG_ARG_LLONG:
+        entry->arg[n++] = va_arg(ap, Bit64u);
+        break;
+      case BX_LOG_ARG_SIZE:
+        entry->arg[n++] = va_arg(ap, size_t);
+        break;
+      case BX_LOG_ARG_DOUBLE: {
+        double d = va_arg(ap, double);
+        memcpy(&entry->arg[n++], &d, sizeof(d));
+        break;
+      }
+      case BX_LOG_ARG_PTR:
+        entry->arg[n++] = (bx_ptr_equiv_t) va_arg(ap, void*);
+        break;
+      case BX_LOG_ARG_STR: {
+        const char *str = va_arg(ap, const char*);
+        if (str == NULL) str = "(null)";
+        len = strlen(str);
+        if ((slen + len) >= BX_LOG_STRLEN) return 0;
+        memcpy(entry->str + slen, str, len + 1);
+        entry->arg[n++] = slen;
+        slen += (unsigned) len + 1;
+        break;
+      }
+    }
+  }
+  return 1;
+}
+
+BX_THREAD_FUNC(log_writer_thread, arg)
+{
+  iofunctions *logio = (iofunctions *) arg;
+
+  while (log_writer_running) {
+    BX_LOCK(logio_mutex);
+    unsigned count = logio->drain_async(256);
+    BX_UNLOCK(logio_mutex);
+    if (count == 0) BX_MSLEEP(1);
+  }
+  BX_THREAD_EXIT;
+}
+
 const char* iofunctions::getlevel(int i) const
 {
   static const char *loglevel[N_LOGLEV] = {
@@ -85,6 +256,7 @@ void iofunctions::init(void)
 
   // sets the default logprefix
   strcpy(logprefix,"%t%e%d");
+  async = 0;
   n_logfn = 0;
   init_log(stderr);
   log = new logfunc_t(this);
@@ -169,6 +341,7 @@ void iofunctions::init_log(int fd)
 
 void iofunctions::exit_log()
 {
+  set_async(0);
   flush();
   if (logfd != stderr) {
     fclose(logfd);
@@ -192,16 +365,13 @@ void iofunctions::set_log_prefix(const char* prefix)
 //  DO NOT nest out() from ::info() and the like.
 //    fmt and ap retained for direct printinf from iofunctions only!
 
-void iofunctions::out(int level, const char *prefix, const char *fmt, va_list ap)
+// Write one message with the configured prefix, the caller holds logio_mutex.
+// The prefix string is returned in msgpfx for the log viewer.
+void iofunctions::write_msg(int level, const char *prefix, Bit64u ticks, Bit32u eip,
+                            const char *msg, char *msgpfx)
 {
   char c = ' ', *s;
-  char tmpstr[80], msgpfx[80], msg[1024];
-
-  assert(magic==MAGIC_LOGNUM);
-  assert(this != NULL);
-  assert(logfd != NULL);
-
-  BX_LOCK(logio_mutex);
+  char tmpstr[80];
 
   switch (level) {
     case LOGLEV_INFO: c='i'; break;
@@ -223,11 +393,11 @@ void iofunctions::out(int level, const char *prefix, const char *fmt, va_list ap
             sprintf(tmpstr, "%s", prefix==NULL?"":prefix);
             break;
           case 't':
-            sprintf(tmpstr, FMT_TICK, bx_pc_system.time_ticks());
+            sprintf(tmpstr, FMT_TICK, ticks);
             break;
           case 'i':
 #if BX_SUPPORT_SMP == 0
-            sprintf(tmpstr, "%08x", BX_CPU(0)->get_eip());
+            sprintf(tmpstr, "%08x", eip);
 #endif
             break;
           case 'e':
@@ -252,8 +422,161 @@ void iofunctions::out(int level, const char *prefix, const char *fmt, va_list ap
   if(level==LOGLEV_PANIC)
     fprintf(logfd, ">>PANIC<< ");
 
-  vsnprintf(msg, sizeof(msg), fmt, ap);
   fprintf(logfd, "%s\n", msg);
+}
+
+// Format a message from the ring buffer, the caller holds logio_mutex.
+void iofunctions::format_async(const bx_log_entry_t *entry)
+{
+  char msg[1024], msgpfx[80], spec[32];
+  const char *p = entry->fmt, *end;
+  unsigned n = 0, stars;
+  size_t len = 0;
+
+  while ((*p != 0) && (len < sizeof(msg) - 1)) {
+    if (*p != '%') {
+      msg[len++] = *p++;
+      continue;
+    }
+    int type = log_parse_conversion(p + 1, &end, &stars);
+    if (type == BX_LOG_ARG_NONE) {
+      msg[len++] = '%';
+      p = end;
+      continue;
+    }
+    // copy the conversion with the '*' arguments filled in
+    unsigned slen = 0;
+    for (; (p < end) && (slen < sizeof(spec) - 12); p++) {
+      if (*p == '*')
+        slen += sprintf(spec + slen, "%d", (int) entry->arg[n++]);
+      else
+        spec[slen++] = *p;
+    }
+    spec[slen] = 0;
+    p = end;
+
+    size_t room = sizeof(msg) - len;
+    int ret = 0;
+    switch (type) {
+      case BX_LOG_ARG_INT:
+        ret = snprintf(msg + len, room, spec, (int) entry->arg[n]);
+        break;
+      case BX_LOG_ARG_LONG:
+        ret = snprintf(msg + len, room, spec, (long) entry->arg[n]);
+        break;
+      case BX_LOG_ARG_LLONG:
+        ret = snprintf(msg + len, room, spec, entry->arg[n]);
+        break;
+      case BX_LOG_ARG_SIZE:
+        ret = snprintf(msg + len, room, spec, (size_t) entry->arg[n]);
+        break;
+      case BX_LOG_ARG_DOUBLE: {
+        double d;
+        memcpy(&d, &entry->arg[n], sizeof(d));
+        ret = snprintf(msg + len, room, spec, d);
+        break;
+      }
+      case BX_LOG_ARG_PTR:
+        ret = snprintf(msg + len, room, spec, (void*)(bx_ptr_equiv_t) entry->arg[n]);
+        break;
+      case BX_LOG_ARG_STR:
+        ret = snprintf(msg + len, room, spec, entry->str + entry->arg[n]);
+        break;
+    }
+    n++;
+    if (ret > 0) len += ((size_t) ret < room) ? (size_t) ret : room - 1;
+  }
+  msg[len] = 0;
+  write_msg(entry->level, entry->prefix, entry->ticks, entry->eip, msg, msgpfx);
+}
+
+// Write up to max pending messages, the caller holds logio_mutex.
+unsigned iofunctions::drain_async(unsigned max)
+{
+  char msg[80], msgpfx[80];
+  unsigned count = 0;
+
+  while ((log_tail != log_head) && (count < max)) {
+    format_async(&log_ring[log_tail % BX_LOG_RING_SIZE]);
+    log_tail++;
+    count++;
+  }
+  if (log_dropped > 0) {
+    sprintf(msg, "%u log messages dropped, log buffer full", log_dropped);
+    log_dropped = 0;
+    write_msg(LOGLEV_ERROR, log->getprefix(), bx_pc_system.time_ticks(), 0, msg, msgpfx);
+    count++;
+  }
+  if (count > 0) fflush(logfd);
+  return count;
+}
+
+void iofunctions::set_async(bx_bool enable)
+{
+  if (enable && !log_writer_running) {
+    if (log_ring == NULL)
+      log_ring = new bx_log_entry_t[BX_LOG_RING_SIZE];
+    log_writer_running = 1;
+    BX_THREAD_CREATE(log_writer_thread, this, log_writer);
+    async = 1;
+  } else if (!enable && log_writer_running) {
+    log_writer_running = 0;
+    BX_THREAD_JOIN(log_writer);
+    BX_LOCK(logio_mutex);
+    async = 0;
+    drain_async(BX_LOG_RING_SIZE);
+    BX_UNLOCK(logio_mutex);
+  }
+}
+
+//  iofunctions::out(level, prefix, fmt, ap)
+//  DO NOT nest out() from ::info() and the like.
+//    fmt and ap retained for direct printinf from iofunctions only!
+
+void iofunctions::out(int level, const char *prefix, const char *fmt, va_list ap)
+{
+  char msgpfx[80], msg[1024];
+  Bit32u eip = 0;
+
+  assert(magic==MAGIC_LOGNUM);
+  assert(this != NULL);
+  assert(logfd != NULL);
+
+#if BX_SUPPORT_SMP == 0
+  eip = BX_CPU(0)->get_eip();
+#endif
+
+  BX_LOCK(logio_mutex);
+
+  if (async) {
+    if ((level != LOGLEV_PANIC) && !SIM->has_log_viewer()) {
+      if ((Bit32u)(log_head - log_tail) >= BX_LOG_RING_SIZE) {
+        log_dropped++;
+        BX_UNLOCK(logio_mutex);
+        return;
+      }
+      bx_log_entry_t *entry = &log_ring[log_head % BX_LOG_RING_SIZE];
+      va_list ap2;
+      va_copy(ap2, ap);
+      bx_bool captured = log_capture(entry, fmt, ap2);
+      va_end(ap2);
+      if (captured) {
+        entry->level = level;
+        entry->eip = eip;
+        entry->ticks = bx_pc_system.time_ticks();
+        strncpy(entry->prefix, (prefix == NULL) ? "" : prefix, sizeof(entry->prefix) - 1);
+        entry->prefix[sizeof(entry->prefix) - 1] = 0;
+        log_head++;
+        BX_UNLOCK(logio_mutex);
+        return;
+      }
+    }
+    // keep the order of the messages
+    drain_async(BX_LOG_RING_SIZE);
+  }
+
+  vsnprintf(msg, sizeof(msg), fmt, ap);
+  write_msg(level, prefix, bx_pc_system.time_ticks(), eip, msg, msgpfx);
   fflush(logfd);
   if (SIM->has_log_viewer()) {
     SIM->log_msg(msgpfx, level, msg);
@@ -295,6 +618,8 @@ iofunctions::~iofunctions(void)
 
 #define LOG_THIS genlog->
 
+Bit32u logfunctions::rate_limit = 0;
+
 int logfunctions::default_onoff[N_LOGLEV] =
 {
   ACT_IGNORE,  // ignore debug
@@ -390,6 +715,39 @@ void logfunctions::put(const char *n, const char *p)
   prefix = tmpbuf;
 }
 
+static void log_out(iofunc_t *logio, int level, const char *prefix, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  logio->out(level, prefix, fmt, ap);
+  va_end(ap);
+}
+
+// Allow at most rate_limit messages per second of emulated time from one
+// BX_INFO / BX_DEBUG / BX_ERROR call site. Messages with other actions than
+// "report" are never suppressed.
+bx_bool logfunctions::ratelimit_check(int level, bx_log_site_t *site)
+{
+  if (onoff[level] != ACT_REPORT) return 1;
+
+  Bit64u window = bx_pc_system.time_usec() / 1000000;
+  if (window != site->window) {
+    if (site->suppressed > 0) {
+      log_out(logio, level, prefix, "%u similar messages suppressed", site->suppressed);
+    }
+    site->window = window;
+    site->count = 0;
+    site->suppressed = 0;
+  }
+  if (site->count < rate_limit) {
+    site->count++;
+    return 1;
+  }
+  site->suppressed++;
+  return 0;
+}
+
 void logfunctions::info(const char *fmt, ...)
 {
   va_list ap;
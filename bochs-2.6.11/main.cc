@@ -21,6 +21,8 @@
 #include "bochs.h"
 #include "bxversion.h"
 #include "param_names.h"
+#include "profiler.h"
+#include "replay.h"
 #include "gui/textconfig.h"
 #if BX_USE_WIN32CONFIG
 #include "gui/win32dialog.h"
@@ -294,6 +296,33 @@ void print_statistics_tree(bx_param_c *node, int level)
       break;
   }
 }
+
+// append the numeric statistics as CSV columns, or their full names
+// if header is set
+void write_statistics_csv(FILE *fp, bx_param_c *node, const char *prefix, bx_bool header)
+{
+  char path[BX_PATHNAME_LEN];
+
+  if (node == NULL) return;
+  if (prefix == NULL) {
+    path[0] = 0; // skip the name of the root
+  } else if (prefix[0] == 0) {
+    snprintf(path, sizeof(path), "%s", node->get_name());
+  } else {
+    snprintf(path, sizeof(path), "%s.%s", prefix, node->get_name());
+  }
+  if (node->get_type() == BXT_PARAM_NUM) {
+    if (header)
+      fprintf(fp, ",%s", path);
+    else
+      fprintf(fp, "," FMT_LL "d", ((bx_param_num_c*) node)->get64());
+  } else if (node->get_type() == BXT_LIST) {
+    bx_list_c *list = (bx_list_c*) node;
+    for (int i=0; i < list->get_size(); i++) {
+      write_statistics_csv(fp, list->get(i), (prefix != NULL) ? path : "", header);
+    }
+  }
+}
 #endif
 
 int bxmain(void)
@@ -567,6 +596,7 @@ void print_usage(void)
     "  -benchmark N     run bochs in benchmark mode for N millions of emulated ticks\n"
 #if BX_ENABLE_STATISTICS
     "  -dumpstats N     dump bochs stats every N millions of emulated ticks\n"
+    "  -statscsv file   also write MIPS and the stats of every dump to a CSV file\n"
 #endif
     "  -r path          restore the Bochs state from path\n"
     "  -log filename    specify Bochs log file name\n"
@@ -724,6 +754,10 @@ int bx_init_main(int argc, char *argv[])
       if (++arg >= argc) BX_PANIC(("-dumpstats must be followed by a number"));
       else SIM->get_param_num(BXPN_DUMP_STATS)->set(atoi(argv[arg]));
     }
+    else if (!strcmp("-statscsv", argv[arg])) {
+      if (++arg >= argc) BX_PANIC(("-statscsv must be followed by a filename"));
+      else SIM->get_param_string(BXPN_DUMP_STATS_CSV)->set(argv[arg]);
+    }
 #endif
     else if (!strcmp("-r", argv[arg])) {
       if (++arg >= argc) BX_PANIC(("-r must be followed by a path"));
@@ -966,8 +1000,8 @@ bx_bool load_and_init_display_lib(void)
 #if BX_GUI_SIGHANDLER
   // set the flag for guis requiring a GUI sighandler.
   // useful when guis are compiled as plugins
-  // only term for now
-  if (!strcmp(gui_name, "term")) {
+  // term and nogui (headless screen dumps) for now
+  if (!strcmp(gui_name, "term") || !strcmp(gui_name, "nogui")) {
     bx_gui_sighandler = 1;
   }
 #endif
@@ -1066,6 +1100,10 @@ int bx_begin_simulation(int argc, char *argv[])
       // that kill_bochs_request was set by the GUI interface.
     }
 #if BX_SUPPORT_SMP
+    else if (SIM->get_param_bool(BXPN_SMP_THREADS)->get() && bx_smp_init()) {
+      // every processor on a host thread of its own, see smp.h
+      bx_smp_run();
+    }
     else {
       // SMP simulation: do a few instructions on each processor, then switch
       // to another.  Increasing quantum speeds up overall performance, but
@@ -1076,7 +1114,7 @@ int bx_begin_simulation(int argc, char *argv[])
 
       static int quantum = SIM->get_param_num(BXPN_SMP_QUANTUM)->get();
       Bit32u executed = 0, processor = 0;
-      bool run = true;
+      bool run = true, all_halted = true;
 
       if (setjmp(BX_CPU_C::jmp_buf_env)) {
         // can get here only from exception function or VMEXIT
@@ -1093,12 +1131,22 @@ int bx_begin_simulation(int argc, char *argv[])
          // see how many instruction it was able to run
          Bit32u n = (Bit32u)(BX_CPU(processor)->get_icount() - BX_CPU(processor)->icount_last_sync);
          if (n == 0) n = quantum; // the CPU was halted
+         else all_halted = false;
          executed += n;
 
          if (++processor == BX_SMP_PROCESSORS) {
            processor = 0;
+           if (all_halted) {
+             // nothing but a timer can wake the processors up, so jump
+             // to the next timed event instead of ticking a quantum a round
+             BX_TICKN(bx_pc_system.getNumCpuTicksLeftNextEvent());
+             executed = 0;
+           }
+           else {
            BX_TICKN(executed / BX_SMP_PROCESSORS);
            executed %= BX_SMP_PROCESSORS;
+           }
+           all_halted = true;
          }
 
          BX_CPU(processor)->icount_last_sync = BX_CPU(processor)->get_icount();
@@ -1127,6 +1175,7 @@ void bx_stop_simulation(void)
 
 void bx_sr_after_restore_state(void)
 {
+  bx_pc_system.after_restore_state();
 #if BX_SUPPORT_SMP == 0
   BX_CPU(0)->after_restore_state();
 #else
@@ -1172,6 +1221,9 @@ void bx_init_hardware()
 
   // all configuration has been read, now initialize everything.
 
+  // a recording or replay decides the clock options
+  bx_replay_open();
+
   bx_pc_system.initialize(SIM->get_param_num(BXPN_IPS)->get());
 
   if (SIM->get_param_string(BXPN_LOG_FILENAME)->getptr()[0]!='-') {
@@ -1180,6 +1232,8 @@ void bx_init_hardware()
   }
 
   io->set_log_prefix(SIM->get_param_string(BXPN_LOG_PREFIX)->getptr());
+  logfunctions::set_rate_limit((Bit32u) SIM->get_param_num(BXPN_LOG_RATELIMIT)->get());
+  io->set_async(SIM->get_param_bool(BXPN_LOG_ASYNC)->get());
 
   // Output to the log file the cpu and device settings
   // This will by handy for bug reports
@@ -1319,9 +1373,22 @@ void bx_init_hardware()
     BX_INFO(("Dump statistics every %d millions of ticks", dumpstats));
     bx_pc_system.register_timer_ticks(&bx_pc_system, bx_pc_system_c::dumpStatsTimer,
         (Bit64u) dumpstats * 1000000, 1 /* continuous */, 1, "dumpstats.timer");
+    if (!SIM->get_param_string(BXPN_DUMP_STATS_CSV)->isempty()) {
+      bx_pc_system.open_stats_csv(SIM->get_param_string(BXPN_DUMP_STATS_CSV)->getptr());
+    }
   }
 #endif
 
+  // set periodic timer for sampling the guest instruction pointer
+  if (SIM->get_param_bool("enabled", SIM->get_param(BXPN_PROFILE))->get()) {
+    bx_profiler_init();
+  }
+  bx_replay_init();
+  // code coverage must be set up before the first trace is decoded
+  if (SIM->get_param_bool("enabled", SIM->get_param(BXPN_COVERAGE))->get()) {
+    bx_coverage_init();
+  }
+
   // set up memory and CPU objects
   bx_param_num_c *bxp_memsize = SIM->get_param_num(BXPN_MEM_SIZE);
   Bit64u memSize = bxp_memsize->get64() * BX_CONST64(1024*1024);
@@ -1443,6 +1510,10 @@ int bx_atexit(void)
   }
 #endif
 
+  bx_profiler_exit();
+  bx_replay_exit();
+  bx_coverage_exit();
+
   BX_MEM(0)->cleanup_memory();
 
   bx_pc_system.exit();
@@ -65,6 +65,12 @@ typedef bx_bool (*memory_handler_t)(bx_phy_address addr, unsigned len, void *dat
 // same format as getHostMemAddr method
 typedef Bit8u* (*memory_direct_access_handler_t)(bx_phy_address addr, unsigned rw, void *param);
 
+// one entry of a scatter-gather list, may cross page boundaries
+struct bx_dma_sg_t {
+  bx_phy_address addr;
+  Bit32u len;
+};
+
 struct memory_handler_struct {
   struct memory_handler_struct *next;
   void *param;
@@ -79,9 +85,39 @@ struct memory_handler_struct {
 #define SMRAM_CODE  1
 #define SMRAM_DATA  2
 
+#if BX_LARGE_RAMFILE
+#include "bxthread.h"
+
+// Staging buffers between the emulation thread and the ramfile worker thread,
+// which does the overflow file I/O. Evicted blocks are copied into a slot and
+// written back in the background, sequential blocks are read ahead into free
+// slots. Slots are served in the order they were queued.
+#define BX_RAMFILE_SLOTS    8
+#define BX_RAMFILE_PREFETCH 2 // blocks read ahead after a block is swapped in
+
+enum {
+  BX_RAMFILE_FREE = 0,
+  BX_RAMFILE_WRITE,    // queued for write-back
+  BX_RAMFILE_WRITING,  // being written, contents still valid
+  BX_RAMFILE_READ,     // queued for read-ahead
+  BX_RAMFILE_READING,  // being read
+  BX_RAMFILE_READY     // read ahead, contents valid
+};
+
+struct bx_ramfile_slot_t {
+  Bit8u  *buf;
+  Bit32u  block;
+  Bit32u  seq;   // queue order
+  volatile Bit8u state;
+};
+#endif
+
 class BOCHSAPI BX_MEM_C : public logfunctions {
 private:
   struct memory_handler_struct **memory_handlers;
+  // the handler of each 4K page, NULL for pages without one: a table of
+  // 256 pages for each megabyte that has handlers, NULL for the others
+  struct memory_handler_struct ***page_handlers;
   bx_bool pci_enabled;
   bx_bool bios_write_enabled;
   bx_bool smram_available;
@@ -90,6 +126,7 @@ private:
 
   Bit64u  len, allocated;  // could be > 4G
   Bit8u   *actual_vector;
+  Bit64u  actual_len; // size of the host mapping, 0 if allocated with new[]
   Bit8u   *vector;   // aligned correctly
   Bit8u  **blocks;
   Bit8u   *rom;      // 512k BIOS rom space + 128k expansion rom space
@@ -100,12 +137,61 @@ private:
   Bit32u used_blocks;
 #if BX_LARGE_RAMFILE
   static Bit8u * const swapped_out; // NULL; // (NULL - sizeof(Bit8u));
-  Bit32u  next_swapout_idx;
+  Bit32u  next_swapout_idx; // clock hand for choosing the block to evict
   FILE    *overflow_file;
+  Bit8u   *block_ref;       // per block: accessed since the clock hand passed
+  bx_ramfile_slot_t ramfile_slots[BX_RAMFILE_SLOTS];
+  Bit32u   ramfile_seq;
+  bx_bool  ramfile_started;
+  volatile bx_bool ramfile_stop;
+  volatile bx_bool ramfile_exited;
+  BX_THREAD_VAR(ramfile_thread);
+  BX_MUTEX(ramfile_mutex);  // slot states
+  BX_MUTEX(overflow_mutex); // file position of overflow_file
+  bx_thread_event_t ramfile_event;
+  Bit64u   ramfile_reads, ramfile_prefetch_hits, ramfile_writes;
+  // incremental snapshots: only blocks changed since the last full snapshot
+  // (the base) are saved, the others are taken from the base on restore
+  char    *snapshot_base;   // memory file of the base, empty if none
+  Bit8u   *base_dirty;      // per block: may differ from the base
+  Bit8u   *snapshot_blocks; // per block: stored in the snapshot file itself
+  bx_param_string_c *snapshot_base_param;
+  Bit8u   *base_map;        // base memory file mapped during restore
+  Bit64u   base_map_len;
 
   BX_MEM_SMF void   read_block(Bit32u block);
+  BX_MEM_SMF Bit32u choose_victim(void);
+  BX_MEM_SMF bx_ramfile_slot_t* get_free_slot(void);
+  BX_MEM_SMF bx_bool fill_from_slot(Bit32u block, Bit8u *buf);
+  BX_MEM_SMF void   queue_prefetch(Bit32u block);
+  BX_MEM_SMF void   start_ramfile_worker(void);
+  BX_MEM_SMF void   collect_dirty_blocks(void);
+  BX_MEM_SMF void   map_snapshot_base(void);
+  BX_MEM_SMF void   read_base_block(Bit32u block, Bit8u *buf);
+  BX_MEM_SMF void   unmap_snapshot_base(void);
 #endif
 
+  // deduplication of stable guest RAM pages against a store file that all
+  // instances using the same file share, see dedup_scan()
+  int      dedup_fd;
+  Bit8u   *dedup_store;     // store file: header, hash slots, pages
+  Bit64u   dedup_store_len;
+  Bit8u   *dedup_state;     // per host page of the vector
+  Bit32u   dedup_cursor;    // next guest page to scan
+  Bit32u   dedup_scan_pages;
+  Bit32u   dedup_maps;      // host pages mapped from the store
+  int      dedup_timer;
+
+  BX_MEM_SMF void    dedup_init(void);
+  BX_MEM_SMF void    dedup_cleanup(void);
+  BX_MEM_SMF void    dedup_forget(Bit8u *host, Bit32u len);
+  BX_MEM_SMF void    dedup_scan(void);
+  BX_MEM_SMF bx_bool dedup_merge_page(Bit8u *page, Bit8u *state);
+  static void dedup_timer_handler(void *this_ptr);
+
+  BX_MEM_SMF void update_page_handlers(bx_phy_address begin_addr, bx_phy_address end_addr);
+  BX_MEM_SMF BX_CPP_INLINE struct memory_handler_struct *get_page_handler(bx_phy_address a20addr);
+
 public:
   BX_MEM_C();
  ~BX_MEM_C();
@@ -113,6 +199,11 @@ public:
   BX_MEM_SMF Bit8u*  get_vector(bx_phy_address addr);
   BX_MEM_SMF void    init_memory(Bit64u guest, Bit64u host);
   BX_MEM_SMF void    cleanup_memory(void);
+#if BX_LARGE_RAMFILE
+  // finish the queued overflow file I/O, stop the worker thread if 'stop'
+  BX_MEM_SMF void    ramfile_sync(bx_bool stop);
+  void ramfile_worker(void);
+#endif
 
   BX_MEM_SMF void    enable_smram(bx_bool enable, bx_bool restricted);
   BX_MEM_SMF void    disable_smram(void);
@@ -131,6 +222,8 @@ public:
 
   BX_MEM_SMF void    dmaReadPhysicalPage(bx_phy_address addr, unsigned len, Bit8u *data);
   BX_MEM_SMF void    dmaWritePhysicalPage(bx_phy_address addr, unsigned len, Bit8u *data);
+  BX_MEM_SMF void    dmaReadSG(const bx_dma_sg_t *sg, unsigned count, Bit8u *data);
+  BX_MEM_SMF void    dmaWriteSG(const bx_dma_sg_t *sg, unsigned count, Bit8u *data);
 
   BX_MEM_SMF void    load_ROM(const char *path, bx_phy_address romaddress, Bit8u type);
   BX_MEM_SMF void    load_RAM(const char *path, bx_phy_address romaddress);
@@ -157,6 +250,8 @@ public:
   BX_MEM_SMF Bit64u  get_memory_len(void);
   BX_MEM_SMF void allocate_block(Bit32u index);
   BX_MEM_SMF Bit8u* alloc_vector_aligned(Bit64u bytes, Bit64u alignment);
+  BX_MEM_SMF void   free_vector(void);
+  BX_MEM_SMF bx_bool map_ROM(int fd, unsigned long offset, unsigned long size);
 
 #if BX_SUPPORT_MONITOR_MWAIT
   BX_MEM_SMF bx_bool is_monitor(bx_phy_address begin_addr, unsigned len);
@@ -166,6 +261,7 @@ public:
   void register_state(void);
 
   friend void ramfile_save_handler(void *devptr, FILE *fp);
+  friend void memory_restore_handler(void *devptr, bx_list_c *list);
   friend Bit64s memory_param_save_handler(void *devptr, bx_param_c *param);
   friend void memory_param_restore_handler(void *devptr, bx_param_c *param, Bit64s val);
 };
@@ -186,6 +282,7 @@ BX_CPP_INLINE Bit8u* BX_MEM_C::get_vector(bx_phy_address addr)
 {
   Bit32u block = (Bit32u)(addr / BX_MEM_BLOCK_LEN);
 #if (BX_LARGE_RAMFILE)
+  BX_MEM_THIS block_ref[block] = 1;
   if (!BX_MEM_THIS blocks[block] || (BX_MEM_THIS blocks[block] == BX_MEM_THIS swapped_out))
 #else
   if (!BX_MEM_THIS blocks[block])
@@ -195,6 +292,12 @@ BX_CPP_INLINE Bit8u* BX_MEM_C::get_vector(bx_phy_address addr)
   return BX_MEM_THIS blocks[block] + (Bit32u)(addr & (BX_MEM_BLOCK_LEN-1));
 }
 
+BX_CPP_INLINE struct memory_handler_struct *BX_MEM_C::get_page_handler(bx_phy_address a20addr)
+{
+  struct memory_handler_struct **pages = BX_MEM_THIS page_handlers[a20addr >> 20];
+  return pages ? pages[(a20addr >> 12) & 0xff] : NULL;
+}
+
 BX_CPP_INLINE Bit64u BX_MEM_C::get_memory_len(void)
 {
   return (BX_MEM_THIS len);
@@ -69,17 +69,16 @@ void BX_MEM_C::writePhysicalPage(BX_CPU_C *cpu, bx_phy_address addr, unsigned le
     }
   }
 
-  memory_handler = BX_MEM_THIS memory_handlers[a20addr >> 20];
-  while (memory_handler) {
-    if (memory_handler->write_handler != NULL) {
-      if (memory_handler->begin <= a20addr &&
-          memory_handler->end >= a20addr &&
-          memory_handler->write_handler(a20addr, len, data, memory_handler->param))
-      {
-        return;
-      }
+  memory_handler = BX_MEM_THIS get_page_handler(a20addr);
+  if (memory_handler && memory_handler->write_handler != NULL) {
+    // the handlers belong to the devices, serialize the processor threads
+    BX_SMP_LOCK_SCOPE();
+    if (memory_handler->begin <= a20addr &&
+        memory_handler->end >= a20addr &&
+        memory_handler->write_handler(a20addr, len, data, memory_handler->param))
+    {
+      return;
     }
-    memory_handler = memory_handler->next;
   }
 
 mem_write:
@@ -245,15 +244,15 @@ void BX_MEM_C::readPhysicalPage(BX_CPU_C *cpu, bx_phy_address addr, unsigned len
     }
   }
 
-  memory_handler = BX_MEM_THIS memory_handlers[a20addr >> 20];
-  while (memory_handler) {
+  memory_handler = BX_MEM_THIS get_page_handler(a20addr);
+  if (memory_handler) {
+    BX_SMP_LOCK_SCOPE();
     if (memory_handler->begin <= a20addr &&
           memory_handler->end >= a20addr &&
           memory_handler->read_handler(a20addr, len, data, memory_handler->param))
     {
       return;
     }
-    memory_handler = memory_handler->next;
   }
 
 mem_read:
@@ -424,3 +423,93 @@ void BX_MEM_C::dmaWritePhysicalPage(bx_phy_address addr, unsigned len, Bit8u *da
     }
   }
 }
+
+// Scatter-gather DMA: the host pointer of each guest page is looked up once
+// and runs of pages that are contiguous on the host are copied with a single
+// memcpy. Pages without direct access (memory handlers, vetoed areas) fall
+// back to the per byte path of dmaRead/WritePhysicalPage.
+void BX_MEM_C::dmaReadSG(const bx_dma_sg_t *sg, unsigned count, Bit8u *data)
+{
+  for (unsigned n = 0; n < count; n++) {
+    bx_phy_address addr = sg[n].addr;
+    Bit32u len = sg[n].len;
+    Bit8u *span = NULL;
+    Bit32u span_len = 0;
+
+    while (len > 0) {
+      unsigned chunk = 0x1000 - (unsigned)(addr & 0xfff);
+      if (chunk > len) chunk = len;
+      Bit8u *memptr = getHostMemAddr(NULL, addr, BX_READ);
+      if (memptr != NULL) {
+        if ((span != NULL) && (span + span_len == memptr)) {
+          span_len += chunk;
+        } else {
+          if (span != NULL) {
+            memcpy(data, span, span_len);
+            data += span_len;
+          }
+          span = memptr;
+          span_len = chunk;
+        }
+      } else {
+        if (span != NULL) {
+          memcpy(data, span, span_len);
+          data += span_len;
+          span = NULL;
+        }
+        dmaReadPhysicalPage(addr, chunk, data);
+        data += chunk;
+      }
+      addr += chunk;
+      len -= chunk;
+    }
+    if (span != NULL) {
+      memcpy(data, span, span_len);
+      data += span_len;
+    }
+  }
+}
+
+void BX_MEM_C::dmaWriteSG(const bx_dma_sg_t *sg, unsigned count, Bit8u *data)
+{
+  for (unsigned n = 0; n < count; n++) {
+    bx_phy_address addr = sg[n].addr;
+    Bit32u len = sg[n].len;
+    Bit8u *span = NULL;
+    Bit32u span_len = 0;
+
+    while (len > 0) {
+      unsigned chunk = 0x1000 - (unsigned)(addr & 0xfff);
+      if (chunk > len) chunk = len;
+      Bit8u *memptr = getHostMemAddr(NULL, addr, BX_WRITE);
+      if (memptr != NULL) {
+        // invalidate traces decoded from the page before it changes
+        pageWriteStampTable.decWriteStamp(addr, chunk);
+        if ((span != NULL) && (span + span_len == memptr)) {
+          span_len += chunk;
+        } else {
+          if (span != NULL) {
+            memcpy(span, data, span_len);
+            data += span_len;
+          }
+          span = memptr;
+          span_len = chunk;
+        }
+      } else {
+        if (span != NULL) {
+          memcpy(span, data, span_len);
+          data += span_len;
+          span = NULL;
+        }
+        dmaWritePhysicalPage(addr, chunk, data);
+        data += chunk;
+      }
+      addr += chunk;
+      len -= chunk;
+    }
+    if (span != NULL) {
+      memcpy(span, data, span_len);
+      data += span_len;
+    }
+  }
+}
@@ -26,14 +26,70 @@
 #include "param_names.h"
 #include "cpu/cpu.h"
 #include "iodev/iodev.h"
+#if BX_HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#if BX_HAVE_SYS_MMAN_H && defined(MAP_ANONYMOUS) && defined(MAP_FIXED)
+#include <sys/file.h>
+#define BX_MEM_DEDUP 1
+#else
+#define BX_MEM_DEDUP 0
+#endif
 #define LOG_THIS BX_MEM(0)->
 
 // alignment of memory vector, must be a power of 2
 #define BX_MEM_VECTOR_ALIGN 4096
+// alignment used when the vector is mapped, lets the host back guest RAM
+// with transparent huge pages
+#define BX_MEM_HUGEPAGE_ALIGN (2 * 1024 * 1024)
 #define BX_MEM_HANDLERS   ((BX_CONST64(1) << BX_PHY_ADDRESS_WIDTH) >> 20) /* one per megabyte */
 
+// Memory deduplication. A scan pass looks at a few guest pages each timer
+// tick. A page that was not written for two passes is hashed and looked up
+// in the store file. If the store holds the same page, or it gets copied
+// there, the host page is replaced by a private mapping of the store page:
+// the instances share one copy in the host page cache and the kernel breaks
+// the sharing with copy-on-write when the guest writes, so host pointers
+// held by the TLBs stay valid. Zero pages are just given back to the host.
+#define BX_MEM_DEDUP_MAGIC    "BXDEDUP1"
+#define BX_MEM_DEDUP_INTERVAL 100000 /* usec between scan passes */
+// every page mapped from the store is a separate host mapping, stay well
+// below the default per process limit of the host (65530 on Linux)
+#define BX_MEM_DEDUP_MAX_MAPS 32768
+
+// dedup_state values, one per host page
+#define BX_DEDUP_NEW    0x00 /* written since the last pass */
+#define BX_DEDUP_STABLE 0x01 /* not written for one pass */
+#define BX_DEDUP_DONE   0x02 /* merged or not mergeable until written again */
+#define BX_DEDUP_FILE   0x80 /* the host page is mapped from the store */
+
+// first page of the store file, followed by the hash slots and the pages
+struct bx_dedup_header_t {
+  char   magic[8];
+  Bit32u slots;   // power of two, twice the number of pages or more
+  Bit32u pages;   // capacity
+  Bit32u used;    // pages in use, only changed with the file locked
+};
+
+struct bx_dedup_slot_t {
+  Bit64u hash;
+  Bit32u page;    // index + 1, 0 if the slot is free
+  Bit32u reserved;
+};
+
+static Bit64u dedup_data_offset(Bit32u slots)
+{
+  return 4096 + (((Bit64u) slots * sizeof(bx_dedup_slot_t) + 4095) & ~BX_CONST64(4095));
+}
+
 #if BX_LARGE_RAMFILE
 Bit8u* const BX_MEM_C::swapped_out = ((Bit8u*)NULL - sizeof(Bit8u));
+
+BX_THREAD_FUNC(ramfile_worker_thread, indata)
+{
+  ((BX_MEM_C*)indata)->ramfile_worker();
+  BX_THREAD_EXIT;
+}
 #endif
 
 BX_MEM_C::BX_MEM_C()
@@ -42,20 +98,76 @@ BX_MEM_C::BX_MEM_C()
 
   vector = NULL;
   actual_vector = NULL;
+  actual_len = 0;
   blocks = NULL;
   len    = 0;
   used_blocks = 0;
 
   memory_handlers = NULL;
+  page_handlers = NULL;
 
 #if BX_LARGE_RAMFILE
   next_swapout_idx = 0;
   overflow_file = NULL;
+  block_ref = NULL;
+  for (unsigned i = 0; i < BX_RAMFILE_SLOTS; i++) {
+    ramfile_slots[i].buf = NULL;
+    ramfile_slots[i].state = BX_RAMFILE_FREE;
+  }
+  ramfile_seq = 0;
+  ramfile_started = 0;
+  ramfile_stop = 0;
+  ramfile_exited = 0;
+  BX_INIT_MUTEX(ramfile_mutex);
+  BX_INIT_MUTEX(overflow_mutex);
+  bx_create_event(&ramfile_event);
+  ramfile_reads = 0;
+  ramfile_prefetch_hits = 0;
+  ramfile_writes = 0;
+  snapshot_base = new char[BX_PATHNAME_LEN];
+  snapshot_base[0] = 0;
+  base_dirty = NULL;
+  snapshot_blocks = NULL;
+  snapshot_base_param = NULL;
+  base_map = NULL;
+  base_map_len = 0;
 #endif
+
+  dedup_fd = -1;
+  dedup_store = NULL;
+  dedup_store_len = 0;
+  dedup_state = NULL;
+  dedup_cursor = 0;
+  dedup_scan_pages = 0;
+  dedup_maps = 0;
+  dedup_timer = BX_NULL_TIMER_HANDLE;
 }
 
 Bit8u* BX_MEM_C::alloc_vector_aligned(Bit64u bytes, Bit64u alignment)
 {
+#if BX_HAVE_SYS_MMAN_H && defined(MAP_ANONYMOUS)
+  // Anonymous mappings are only backed by host memory once a page is
+  // touched, so large guest RAM sizes don't cost anything at startup.
+  if (alignment < BX_MEM_HUGEPAGE_ALIGN)
+    alignment = BX_MEM_HUGEPAGE_ALIGN;
+  int map_flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+  map_flags |= MAP_NORESERVE;
+#endif
+  void *map = mmap(NULL, (size_t)(bytes + alignment), PROT_READ | PROT_WRITE,
+                   map_flags, -1, 0);
+  if (map != MAP_FAILED) {
+    BX_MEM_THIS actual_vector = (Bit8u *) map;
+    BX_MEM_THIS actual_len = bytes + alignment;
+    Bit8u *vector = (Bit8u *)(((bx_ptr_equiv_t) map + alignment - 1) & ~(bx_ptr_equiv_t)(alignment - 1));
+#ifdef MADV_HUGEPAGE
+    madvise(vector, (size_t)(bytes & ~(Bit64u)(alignment - 1)), MADV_HUGEPAGE);
+#endif
+    return vector;
+  }
+  BX_INFO(("alloc_vector_aligned: mmap failed, falling back to heap allocation"));
+  alignment = BX_MEM_VECTOR_ALIGN;
+#endif
   Bit64u test_mask = alignment - 1;
   BX_MEM_THIS actual_vector = new Bit8u [(Bit32u)(bytes + test_mask)];
   if (BX_MEM_THIS actual_vector == 0) {
@@ -73,11 +185,30 @@ Bit8u* BX_MEM_C::alloc_vector_aligned(Bit64u bytes, Bit64u alignment)
   return vector;
 }
 
+void BX_MEM_C::free_vector(void)
+{
+#if BX_HAVE_SYS_MMAN_H && defined(MAP_ANONYMOUS)
+  if (BX_MEM_THIS actual_len > 0) {
+    munmap(BX_MEM_THIS actual_vector, (size_t) BX_MEM_THIS actual_len);
+    BX_MEM_THIS actual_len = 0;
+  } else
+#endif
+  delete [] BX_MEM_THIS actual_vector;
+  BX_MEM_THIS actual_vector = NULL;
+}
+
 BX_MEM_C::~BX_MEM_C()
 {
 #if BX_LARGE_RAMFILE
+  ramfile_sync(1);
+  for (unsigned i = 0; i < BX_RAMFILE_SLOTS; i++)
+    delete [] ramfile_slots[i].buf;
+  bx_destroy_event(&ramfile_event);
+  BX_FINI_MUTEX(ramfile_mutex);
+  BX_FINI_MUTEX(overflow_mutex);
   if (overflow_file)
     fclose(BX_MEM_THIS overflow_file);
+  delete [] snapshot_base;
 #endif
 
   cleanup_memory();
@@ -95,8 +226,14 @@ void BX_MEM_C::init_memory(Bit64u guest, Bit64u host)
 
   if (BX_MEM_THIS actual_vector != NULL) {
     BX_INFO(("freeing existing memory vector"));
-    delete [] BX_MEM_THIS actual_vector;
-    BX_MEM_THIS actual_vector = NULL;
+#if BX_LARGE_RAMFILE
+    // the slots refer to blocks of the old vector
+    BX_MEM_THIS ramfile_sync(1);
+    for (i = 0; i < BX_RAMFILE_SLOTS; i++)
+      BX_MEM_THIS ramfile_slots[i].state = BX_RAMFILE_FREE;
+#endif
+    dedup_cleanup();
+    free_vector();
     BX_MEM_THIS vector = NULL;
     BX_MEM_THIS blocks = NULL;
   }
@@ -131,10 +268,26 @@ void BX_MEM_C::init_memory(Bit64u guest, Bit64u host)
     }
     BX_MEM_THIS used_blocks = 0;
   }
+#if BX_LARGE_RAMFILE
+  BX_MEM_THIS snapshot_base[0] = 0;
+  delete [] BX_MEM_THIS base_dirty;
+  delete [] BX_MEM_THIS snapshot_blocks;
+  delete [] BX_MEM_THIS block_ref;
+  BX_MEM_THIS block_ref = new Bit8u[num_blocks];
+  memset(BX_MEM_THIS block_ref, 0, num_blocks);
+  BX_MEM_THIS next_swapout_idx = 0;
+  BX_MEM_THIS base_dirty = new Bit8u[num_blocks];
+  BX_MEM_THIS snapshot_blocks = new Bit8u[num_blocks];
+  memset(BX_MEM_THIS base_dirty, 0, num_blocks);
+  memset(BX_MEM_THIS snapshot_blocks, 1, num_blocks);
+#endif
 
   BX_MEM_THIS memory_handlers = new struct memory_handler_struct *[BX_MEM_HANDLERS];
-  for (idx = 0; idx < BX_MEM_HANDLERS; idx++)
+  BX_MEM_THIS page_handlers = new struct memory_handler_struct **[BX_MEM_HANDLERS];
+  for (idx = 0; idx < BX_MEM_HANDLERS; idx++) {
     BX_MEM_THIS memory_handlers[idx] = NULL;
+    BX_MEM_THIS page_handlers[idx] = NULL;
+  }
 
   BX_MEM_THIS pci_enabled = SIM->get_param_bool(BXPN_PCI_ENABLED)->get();
   BX_MEM_THIS bios_write_enabled = 0;
@@ -150,6 +303,9 @@ void BX_MEM_C::init_memory(Bit64u guest, Bit64u host)
   }
 
   BX_MEM_THIS register_state();
+
+  if (! SIM->get_param_string(BXPN_MEM_DEDUP_STORE)->isempty())
+    dedup_init();
 }
 
 #if BX_LARGE_RAMFILE
@@ -157,6 +313,14 @@ void BX_MEM_C::read_block(Bit32u block)
 {
   const Bit64u block_address = ((Bit64u)block)*BX_MEM_BLOCK_LEN;
 
+  // restoring an incremental snapshot: blocks it doesn't hold come from the base
+  if ((BX_MEM_THIS base_map != NULL) && !BX_MEM_THIS snapshot_blocks[block]) {
+    read_base_block(block, BX_MEM_THIS blocks[block]);
+    return;
+  }
+
+  // the worker thread moves the file position as well
+  BX_LOCK(BX_MEM_THIS overflow_mutex);
   if (fseeko64(BX_MEM_THIS overflow_file, block_address, SEEK_SET))
     BX_PANIC(("FATAL ERROR: Could not seek to 0x" FMT_LL "x in memory overflow file!", block_address));
 
@@ -164,58 +328,590 @@ void BX_MEM_C::read_block(Bit32u block)
   if ((fread(BX_MEM_THIS blocks[block], BX_MEM_BLOCK_LEN, 1, BX_MEM_THIS overflow_file) != 1) && 
       (!feof(BX_MEM_THIS overflow_file))) 
     BX_PANIC(("FATAL ERROR: Could not read from 0x" FMT_LL "x in memory overflow file!", block_address)); 
+  BX_UNLOCK(BX_MEM_THIS overflow_mutex);
+  BX_MEM_THIS ramfile_reads++;
+}
+
+// Second chance clock over the resident blocks: a block accessed through
+// get_vector() since the hand last passed loses its bit and stays for one
+// more round. Blocks the CPUs hold in their TLBs are never replaced.
+Bit32u BX_MEM_C::choose_victim(void)
+{
+  const Bit32u num_blocks = (Bit32u)(BX_MEM_THIS len / BX_MEM_BLOCK_LEN);
+
+  // the first round clears all bits, the second only skips the TLB blocks
+  for (Bit32u n = 0; n < 2 * num_blocks; n++) {
+    if (++(BX_MEM_THIS next_swapout_idx) >= num_blocks)
+      BX_MEM_THIS next_swapout_idx = 0;
+    Bit32u idx = BX_MEM_THIS next_swapout_idx;
+    Bit8u *buffer = BX_MEM_THIS blocks[idx];
+    if ((!buffer) || (buffer == BX_MEM_C::swapped_out)) continue;
+    if (BX_MEM_THIS block_ref[idx]) {
+      BX_MEM_THIS block_ref[idx] = 0;
+      continue;
+    }
+    bx_bool used_for_tlb = 0;
+    const Bit8u* buffer_end = buffer+BX_MEM_BLOCK_LEN;
+    for (int i=0; i<BX_SMP_PROCESSORS && !used_for_tlb;i++)
+      used_for_tlb = BX_CPU(i)->check_addr_in_tlb_buffers(buffer, buffer_end);
+    if (!used_for_tlb) return idx;
+  }
+  BX_PANIC(("FATAL ERROR: Insufficient working RAM, all blocks are currently used for TLB entries!"));
+  return 0;
+}
+
+// A slot for a block to write back: a free one, else the oldest read-ahead,
+// which is dropped. Waits for the worker if all slots hold write-backs.
+bx_ramfile_slot_t* BX_MEM_C::get_free_slot(void)
+{
+  while (1) {
+    bx_ramfile_slot_t *found = NULL;
+    BX_LOCK(BX_MEM_THIS ramfile_mutex);
+    for (unsigned i = 0; i < BX_RAMFILE_SLOTS; i++) {
+      bx_ramfile_slot_t *slot = &BX_MEM_THIS ramfile_slots[i];
+      if (slot->state == BX_RAMFILE_FREE) {
+        found = slot;
+        break;
+      }
+      if (((slot->state == BX_RAMFILE_READ) || (slot->state == BX_RAMFILE_READY)) &&
+          ((found == NULL) || (slot->seq < found->seq)))
+        found = slot;
+    }
+    if (found != NULL)
+      found->state = BX_RAMFILE_FREE;
+    BX_UNLOCK(BX_MEM_THIS ramfile_mutex);
+    if (found != NULL) return found;
+    bx_set_event(&BX_MEM_THIS ramfile_event);
+    BX_MSLEEP(1);
+  }
+}
+
+// Copy the contents of a swapped out block from a slot into buf: its latest
+// write-back that may not be in the file yet, or its read-ahead data. Returns
+// 0 if the block must be read from the file.
+bx_bool BX_MEM_C::fill_from_slot(Bit32u block, Bit8u *buf)
+{
+  while (1) {
+    bx_ramfile_slot_t *found = NULL;
+    bx_bool reading = 0;
+    BX_LOCK(BX_MEM_THIS ramfile_mutex);
+    for (unsigned i = 0; i < BX_RAMFILE_SLOTS; i++) {
+      bx_ramfile_slot_t *slot = &BX_MEM_THIS ramfile_slots[i];
+      if ((slot->state == BX_RAMFILE_FREE) || (slot->block != block)) continue;
+      if (slot->state == BX_RAMFILE_READ) {
+        // not started yet, the caller reads it right away
+        slot->state = BX_RAMFILE_FREE;
+      } else if (slot->state == BX_RAMFILE_READING) {
+        reading = 1;
+      } else if ((found == NULL) || (slot->seq > found->seq)) {
+        found = slot;
+      }
+    }
+    BX_UNLOCK(BX_MEM_THIS ramfile_mutex);
+    if (reading) {
+      // queued after any write-back of the block, so it has the latest data
+      bx_set_event(&BX_MEM_THIS ramfile_event);
+      BX_MSLEEP(1);
+      continue;
+    }
+    if (found == NULL) return 0;
+    // the worker only reads the buffer of a write-back, and a ready slot is
+    // only released here
+    memcpy(buf, found->buf, BX_MEM_BLOCK_LEN);
+    if (found->state == BX_RAMFILE_READY) {
+      BX_LOCK(BX_MEM_THIS ramfile_mutex);
+      found->state = BX_RAMFILE_FREE;
+      BX_UNLOCK(BX_MEM_THIS ramfile_mutex);
+      BX_MEM_THIS ramfile_prefetch_hits++;
+    }
+    return 1;
+  }
+}
+
+// Queue a read-ahead of a swapped out block into a free slot. Nothing is
+// dropped for it, the guest didn't ask for the block yet.
+void BX_MEM_C::queue_prefetch(Bit32u block)
+{
+  if ((block >= (Bit32u)(BX_MEM_THIS len / BX_MEM_BLOCK_LEN)) ||
+      (BX_MEM_THIS blocks[block] != BX_MEM_C::swapped_out) ||
+      // restoring an incremental snapshot, the block may come from the base
+      (BX_MEM_THIS base_map != NULL))
+    return;
+
+  bx_ramfile_slot_t *found = NULL;
+  BX_LOCK(BX_MEM_THIS ramfile_mutex);
+  for (unsigned i = 0; i < BX_RAMFILE_SLOTS; i++) {
+    bx_ramfile_slot_t *slot = &BX_MEM_THIS ramfile_slots[i];
+    if (slot->state == BX_RAMFILE_FREE) {
+      if (found == NULL) found = slot;
+    } else if (slot->block == block) {
+      // still being written back or already queued
+      found = NULL;
+      break;
+    }
+  }
+  if (found != NULL) {
+    found->block = block;
+    found->seq = BX_MEM_THIS ramfile_seq++;
+    found->state = BX_RAMFILE_READ;
+  }
+  BX_UNLOCK(BX_MEM_THIS ramfile_mutex);
+  if (found != NULL)
+    bx_set_event(&BX_MEM_THIS ramfile_event);
+}
+
+void BX_MEM_C::start_ramfile_worker(void)
+{
+  for (unsigned i = 0; i < BX_RAMFILE_SLOTS; i++) {
+    if (BX_MEM_THIS ramfile_slots[i].buf == NULL)
+      BX_MEM_THIS ramfile_slots[i].buf = new Bit8u[BX_MEM_BLOCK_LEN];
+  }
+  BX_MEM_THIS ramfile_stop = 0;
+  BX_MEM_THIS ramfile_exited = 0;
+  BX_THREAD_CREATE(ramfile_worker_thread, BX_MEM(0), BX_MEM_THIS ramfile_thread);
+  BX_MEM_THIS ramfile_started = 1;
+}
+
+// The worker thread serves the queued slots oldest first, so a read-ahead
+// of a block always sees its write-backs queued before.
+void BX_MEM_C::ramfile_worker(void)
+{
+  while (1) {
+    bx_ramfile_slot_t *slot = NULL;
+    BX_LOCK(BX_MEM_THIS ramfile_mutex);
+    if (BX_MEM_THIS ramfile_stop) {
+      BX_MEM_THIS ramfile_exited = 1;
+      BX_UNLOCK(BX_MEM_THIS ramfile_mutex);
+      break;
+    }
+    for (unsigned i = 0; i < BX_RAMFILE_SLOTS; i++) {
+      bx_ramfile_slot_t *s = &BX_MEM_THIS ramfile_slots[i];
+      if (((s->state == BX_RAMFILE_WRITE) || (s->state == BX_RAMFILE_READ)) &&
+          ((slot == NULL) || (s->seq < slot->seq)))
+        slot = s;
+    }
+    if (slot == NULL) {
+      BX_UNLOCK(BX_MEM_THIS ramfile_mutex);
+      bx_wait_for_event(&BX_MEM_THIS ramfile_event);
+      continue;
+    }
+    bx_bool write = (slot->state == BX_RAMFILE_WRITE);
+    slot->state = write ? BX_RAMFILE_WRITING : BX_RAMFILE_READING;
+    BX_UNLOCK(BX_MEM_THIS ramfile_mutex);
+
+    const Bit64u address = ((Bit64u)slot->block)*BX_MEM_BLOCK_LEN;
+    BX_LOCK(BX_MEM_THIS overflow_mutex);
+    if (fseeko64(BX_MEM_THIS overflow_file, address, SEEK_SET))
+      BX_PANIC(("FATAL ERROR: Could not seek to 0x" FMT_LL "x in overflow file!", address));
+    if (write) {
+      if (1 != fwrite(slot->buf, BX_MEM_BLOCK_LEN, 1, BX_MEM_THIS overflow_file))
+        BX_PANIC(("FATAL ERROR: Could not write at 0x" FMT_LL "x in overflow file!", address));
+    } else {
+      size_t got = fread(slot->buf, 1, BX_MEM_BLOCK_LEN, BX_MEM_THIS overflow_file);
+      if (got < BX_MEM_BLOCK_LEN)
+        memset(slot->buf + got, 0, BX_MEM_BLOCK_LEN - got);
+    }
+    BX_UNLOCK(BX_MEM_THIS overflow_mutex);
+
+    BX_LOCK(BX_MEM_THIS ramfile_mutex);
+    slot->state = write ? BX_RAMFILE_FREE : BX_RAMFILE_READY;
+    BX_UNLOCK(BX_MEM_THIS ramfile_mutex);
+  }
+}
+
+// Snapshots copy the overflow file and fork() doesn't duplicate the worker
+// thread, so both wait for the queued write-backs first. Read-aheads not
+// started yet are dropped, the ready ones stay valid.
+void BX_MEM_C::ramfile_sync(bx_bool stop)
+{
+  if (!BX_MEM_THIS ramfile_started) return;
+
+  while (1) {
+    bx_bool busy = 0;
+    BX_LOCK(BX_MEM_THIS ramfile_mutex);
+    for (unsigned i = 0; i < BX_RAMFILE_SLOTS; i++) {
+      bx_ramfile_slot_t *slot = &BX_MEM_THIS ramfile_slots[i];
+      if (slot->state == BX_RAMFILE_READ)
+        slot->state = BX_RAMFILE_FREE;
+      else if ((slot->state == BX_RAMFILE_WRITE) || (slot->state == BX_RAMFILE_WRITING) ||
+               (slot->state == BX_RAMFILE_READING))
+        busy = 1;
+    }
+    BX_UNLOCK(BX_MEM_THIS ramfile_mutex);
+    if (!busy) break;
+    bx_set_event(&BX_MEM_THIS ramfile_event);
+    BX_MSLEEP(1);
+  }
+  // the snapshot code copies the file from the current position
+  fflush(BX_MEM_THIS overflow_file);
+  rewind(BX_MEM_THIS overflow_file);
+
+  if (stop) {
+    BX_LOCK(BX_MEM_THIS ramfile_mutex);
+    BX_MEM_THIS ramfile_stop = 1;
+    BX_UNLOCK(BX_MEM_THIS ramfile_mutex);
+    // the thread may be between its check and the wait, keep waking it
+    while (1) {
+      bx_set_event(&BX_MEM_THIS ramfile_event);
+      BX_LOCK(BX_MEM_THIS ramfile_mutex);
+      bx_bool exited = BX_MEM_THIS ramfile_exited;
+      BX_UNLOCK(BX_MEM_THIS ramfile_mutex);
+      if (exited) break;
+      BX_MSLEEP(1);
+    }
+    BX_THREAD_JOIN(BX_MEM_THIS ramfile_thread);
+    BX_MEM_THIS ramfile_started = 0;
+  }
+}
+
+// Fold the pages written since the last snapshot into the per block map of
+// changes against the base snapshot.
+void BX_MEM_C::collect_dirty_blocks(void)
+{
+  Bit32u num_blocks = (Bit32u)(BX_MEM_THIS len / BX_MEM_BLOCK_LEN);
+
+  for (Bit32u idx = 0; idx < num_blocks; idx++) {
+    if (BX_MEM_THIS base_dirty[idx]) continue;
+    bx_phy_address addr = ((bx_phy_address)idx)*BX_MEM_BLOCK_LEN;
+    for (unsigned page = 0; page < (BX_MEM_BLOCK_LEN >> 12); page++) {
+      if (pageWriteStampTable.isPageDirty(addr + (page << 12), BX_DIRTY_SNAPSHOT)) {
+        BX_MEM_THIS base_dirty[idx] = 1;
+        break;
+      }
+    }
+  }
+  pageWriteStampTable.clearDirtyPages(BX_DIRTY_SNAPSHOT);
+}
+
+void BX_MEM_C::map_snapshot_base(void)
+{
+  const char *path = BX_MEM_THIS snapshot_base_param->getptr();
+#if BX_HAVE_SYS_MMAN_H
+  struct stat stat_buf;
+  int fd = open(path, O_RDONLY);
+  if ((fd < 0) || fstat(fd, &stat_buf) || (stat_buf.st_size == 0)) {
+    if (fd >= 0) close(fd);
+    BX_PANIC(("Could not open snapshot base memory file '%s'", path));
+    return;
+  }
+  void *map = mmap(NULL, (size_t)stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    BX_PANIC(("Could not map snapshot base memory file '%s'", path));
+    return;
+  }
+  BX_MEM_THIS base_map = (Bit8u *) map;
+  BX_MEM_THIS base_map_len = (Bit64u)stat_buf.st_size;
+  BX_INFO(("using snapshot base memory file '%s'", path));
+#else
+  BX_PANIC(("Incremental memory snapshot '%s' not supported on this host", path));
+#endif
+}
+
+// Copy a block from the mapped base snapshot into buf. Parts past the end of
+// the (sparse) file read as zero.
+void BX_MEM_C::read_base_block(Bit32u block, Bit8u *buf)
+{
+  const Bit64u block_address = ((Bit64u)block)*BX_MEM_BLOCK_LEN;
+  Bit64u avail = 0;
+
+  if (block_address < BX_MEM_THIS base_map_len) {
+    avail = BX_MEM_THIS base_map_len - block_address;
+    if (avail > BX_MEM_BLOCK_LEN) avail = BX_MEM_BLOCK_LEN;
+    memcpy(buf, BX_MEM_THIS base_map + block_address, (size_t)avail);
+  }
+  if (avail < BX_MEM_BLOCK_LEN)
+    memset(buf + avail, 0, (size_t)(BX_MEM_BLOCK_LEN - avail));
+}
+
+void BX_MEM_C::unmap_snapshot_base(void)
+{
+#if BX_HAVE_SYS_MMAN_H
+  if (BX_MEM_THIS base_map != NULL)
+    munmap(BX_MEM_THIS base_map, (size_t)BX_MEM_THIS base_map_len);
+#endif
+  BX_MEM_THIS base_map = NULL;
+  BX_MEM_THIS base_map_len = 0;
+}
+#endif
+
+void BX_MEM_C::dedup_init(void)
+{
+#if BX_MEM_DEDUP
+  const char *path = SIM->get_param_string(BXPN_MEM_DEDUP_STORE)->getptr();
+  struct stat stat_buf;
+  bx_dedup_header_t header;
+
+  if (BX_MEM_THIS actual_len == 0) {
+    BX_ERROR(("memory deduplication needs a mapped memory vector, disabled"));
+    return;
+  }
+  int fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    BX_ERROR(("could not open deduplication store '%s', disabled", path));
+    return;
+  }
+  // the first instance creates the store, the others use its geometry
+  flock(fd, LOCK_EX);
+  bx_bool ok = (fstat(fd, &stat_buf) == 0);
+  if (ok && (stat_buf.st_size == 0)) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BX_MEM_DEDUP_MAGIC, 8);
+    header.pages = SIM->get_param_num(BXPN_MEM_DEDUP_SIZE)->get() * 256;
+    header.slots = 1;
+    while (header.slots < header.pages * 2)
+      header.slots <<= 1;
+    ok = (ftruncate(fd, (off_t)(dedup_data_offset(header.slots) + (Bit64u) header.pages * 4096)) == 0) &&
+         (pwrite(fd, &header, sizeof(header), 0) == sizeof(header)) &&
+         (fstat(fd, &stat_buf) == 0);
+  } else if (ok) {
+    ok = (pread(fd, &header, sizeof(header), 0) == sizeof(header)) &&
+         !memcmp(header.magic, BX_MEM_DEDUP_MAGIC, 8) && (header.pages > 0) &&
+         ((header.slots & (header.slots - 1)) == 0) && (header.slots >= header.pages * 2);
+  }
+  flock(fd, LOCK_UN);
+  Bit64u store_len = dedup_data_offset(header.slots) + (Bit64u) header.pages * 4096;
+  if (!ok || ((Bit64u) stat_buf.st_size < store_len)) {
+    close(fd);
+    BX_ERROR(("'%s' is not a usable deduplication store, disabled", path));
+    return;
+  }
+  void *map = mmap(NULL, (size_t) store_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    BX_ERROR(("could not map deduplication store '%s', disabled", path));
+    return;
+  }
+  BX_MEM_THIS dedup_fd = fd;
+  BX_MEM_THIS dedup_store = (Bit8u *) map;
+  BX_MEM_THIS dedup_store_len = store_len;
+  Bit32u host_pages = (Bit32u)(BX_MEM_THIS allocated >> 12);
+  BX_MEM_THIS dedup_state = new Bit8u[host_pages];
+  memset(BX_MEM_THIS dedup_state, BX_DEDUP_NEW, host_pages);
+  BX_MEM_THIS dedup_cursor = 0;
+  BX_MEM_THIS dedup_maps = 0;
+  BX_MEM_THIS dedup_scan_pages = SIM->get_param_num(BXPN_MEM_DEDUP_SCAN)->get();
+#ifdef MADV_NOHUGEPAGE
+  // huge pages would be collapsed again over the pages given back
+  madvise(BX_MEM_THIS vector, (size_t) BX_MEM_THIS allocated, MADV_NOHUGEPAGE);
+#endif
+  if (BX_MEM_THIS dedup_timer == BX_NULL_TIMER_HANDLE) {
+    BX_MEM_THIS dedup_timer = bx_pc_system.register_timer(BX_MEM(0), dedup_timer_handler,
+      BX_MEM_DEDUP_INTERVAL, 1, 1, "memory.dedup");
+  }
+  BX_INFO(("deduplicating guest memory with '%s' (%u of %u pages used)",
+           path, header.used, header.pages));
+#else
+  BX_ERROR(("memory deduplication not supported on this host"));
+#endif
 }
+
+void BX_MEM_C::dedup_cleanup(void)
+{
+#if BX_MEM_DEDUP
+  if (BX_MEM_THIS dedup_state == NULL) return;
+  BX_INFO(("deduplication: %u host pages mapped from the store", BX_MEM_THIS dedup_maps));
+  munmap(BX_MEM_THIS dedup_store, (size_t) BX_MEM_THIS dedup_store_len);
+  close(BX_MEM_THIS dedup_fd);
+  delete [] BX_MEM_THIS dedup_state;
+  BX_MEM_THIS dedup_state = NULL;
+  BX_MEM_THIS dedup_store = NULL;
+  BX_MEM_THIS dedup_store_len = 0;
+  BX_MEM_THIS dedup_fd = -1;
 #endif
+}
+
+// Contents of host pages replaced without going through the dirty page map:
+// they are looked at again as if written.
+void BX_MEM_C::dedup_forget(Bit8u *host, Bit32u len)
+{
+  if (BX_MEM_THIS dedup_state == NULL) return;
+  Bit32u first = (Bit32u)((host - BX_MEM_THIS vector) >> 12);
+  for (Bit32u page = 0; page < (len >> 12); page++)
+    BX_MEM_THIS dedup_state[first + page] &= BX_DEDUP_FILE;
+}
+
+void BX_MEM_C::dedup_timer_handler(void *this_ptr)
+{
+  ((BX_MEM_C *) this_ptr)->dedup_scan();
+}
+
+void BX_MEM_C::dedup_scan(void)
+{
+#if BX_MEM_DEDUP
+  Bit32u guest_pages = (Bit32u)(BX_MEM_THIS len >> 12);
+  bx_bool locked = 0;
+
+  if (BX_MEM_THIS dedup_state == NULL) return;
+
+  for (Bit32u n = 0; n < BX_MEM_THIS dedup_scan_pages; n++) {
+    bx_phy_address addr = ((bx_phy_address) BX_MEM_THIS dedup_cursor) << 12;
+    if (++BX_MEM_THIS dedup_cursor >= guest_pages)
+      BX_MEM_THIS dedup_cursor = 0;
+
+    Bit8u *block = BX_MEM_THIS blocks[(Bit32u)(addr / BX_MEM_BLOCK_LEN)];
+#if BX_LARGE_RAMFILE
+    if (block == BX_MEM_C::swapped_out) continue;
+#endif
+    if (block == NULL) continue;
+    Bit8u *host = block + (Bit32u)(addr & (BX_MEM_BLOCK_LEN-1));
+    Bit8u *state = &BX_MEM_THIS dedup_state[(host - BX_MEM_THIS vector) >> 12];
+
+    if (pageWriteStampTable.testAndClearPageDirty(addr, BX_DIRTY_DEDUP)) {
+      // a page mapped from the store is a private copy by now
+      *state &= BX_DEDUP_FILE;
+      continue;
+    }
+    switch (*state & ~BX_DEDUP_FILE) {
+      case BX_DEDUP_NEW:
+        *state |= BX_DEDUP_STABLE;
+        break;
+      case BX_DEDUP_STABLE:
+        // other instances insert pages concurrently
+        if (! locked) {
+          flock(BX_MEM_THIS dedup_fd, LOCK_EX);
+          locked = 1;
+        }
+        dedup_merge_page(host, state);
+        *state = (*state & BX_DEDUP_FILE) | BX_DEDUP_DONE;
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (locked)
+    flock(BX_MEM_THIS dedup_fd, LOCK_UN);
+#endif
+}
+
+// Share one stable host page with the store, returns 0 if the page stays
+// as it is. The store file must be locked.
+bx_bool BX_MEM_C::dedup_merge_page(Bit8u *page, Bit8u *state)
+{
+#if BX_MEM_DEDUP
+  const Bit64u *words = (const Bit64u *) page;
+  Bit64u hash = BX_CONST64(0xcbf29ce484222325), bits = 0;
+  unsigned i;
+
+  for (i = 0; i < 4096 / sizeof(Bit64u); i++) {
+    hash = (hash ^ words[i]) * BX_CONST64(0x100000001b3);
+    bits |= words[i];
+  }
+
+  if (bits == 0) {
+    // zero page: give it back, the host supplies zeroes on the next touch
+    if (*state & BX_DEDUP_FILE) {
+      if (mmap(page, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+        BX_PANIC(("deduplication: could not remap host page %p", page));
+      *state &= ~BX_DEDUP_FILE;
+      BX_MEM_THIS dedup_maps--;
+    }
+    else {
+      madvise(page, 4096, MADV_DONTNEED);
+    }
+    return 1;
+  }
+
+  if (BX_MEM_THIS dedup_maps >= BX_MEM_DEDUP_MAX_MAPS) return 0;
+
+  bx_dedup_header_t *header = (bx_dedup_header_t *) BX_MEM_THIS dedup_store;
+  bx_dedup_slot_t *slots = (bx_dedup_slot_t *)(BX_MEM_THIS dedup_store + 4096);
+  Bit64u data_offset = dedup_data_offset(header->slots);
+  Bit8u *data = BX_MEM_THIS dedup_store + data_offset;
+  Bit32u mask = header->slots - 1, index;
+
+  for (i = (Bit32u) hash & mask;; i = (i + 1) & mask) {
+    if (slots[i].page == 0) {
+      if (header->used >= header->pages) return 0; // store full
+      index = header->used++;
+      memcpy(data + (Bit64u) index * 4096, page, 4096);
+      slots[i].hash = hash;
+      slots[i].page = index + 1;
+      break;
+    }
+    if ((slots[i].hash == hash) && !memcmp(data + (Bit64u)(slots[i].page - 1) * 4096, page, 4096)) {
+      index = slots[i].page - 1;
+      break;
+    }
+  }
+
+  // the old mapping may be gone if this fails, the store page holds the same data
+  Bit8u *shared = data + (Bit64u) index * 4096;
+  if (mmap(page, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, BX_MEM_THIS dedup_fd,
+           (off_t)(data_offset + (Bit64u) index * 4096)) == MAP_FAILED) {
+    if (mmap(page, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+      BX_PANIC(("deduplication: could not remap host page %p", page));
+    memcpy(page, shared, 4096);
+    if (*state & BX_DEDUP_FILE) {
+      *state &= ~BX_DEDUP_FILE;
+      BX_MEM_THIS dedup_maps--;
+    }
+    return 0;
+  }
+  if (! (*state & BX_DEDUP_FILE)) {
+    *state |= BX_DEDUP_FILE;
+    BX_MEM_THIS dedup_maps++;
+  }
+  return 1;
+#else
+  return 0;
+#endif
+}
 
 void BX_MEM_C::allocate_block(Bit32u block)
 {
   const Bit32u max_blocks = (Bit32u)(BX_MEM_THIS allocated / BX_MEM_BLOCK_LEN);
 
+#if BX_SUPPORT_SMP
+  // another processor thread may have allocated the block in the meantime
+  BX_SMP_LOCK_SCOPE();
+  if (BX_MEM_THIS blocks[block] && BX_MEM_THIS blocks[block] != BX_MEM_C::swapped_out)
+    return;
+#endif
+
 #if BX_LARGE_RAMFILE
   /* 
    * Match block to vector address
    * First, see if there is any spare host memory blocks we can still freely allocate
    */
   if (BX_MEM_THIS used_blocks >= max_blocks) {
-    Bit32u original_replacement_block = BX_MEM_THIS next_swapout_idx;
-    // Find a block to replace
-    bx_bool used_for_tlb;
-    Bit8u *buffer;
-    do {
-      do {
-        // Wrap if necessary
-        if (++(BX_MEM_THIS next_swapout_idx)==((BX_MEM_THIS len)/BX_MEM_BLOCK_LEN))
-          BX_MEM_THIS next_swapout_idx = 0;
-        if (BX_MEM_THIS next_swapout_idx == original_replacement_block)
-          BX_PANIC(("FATAL ERROR: Insufficient working RAM, all blocks are currently used for TLB entries!"));
-        buffer = BX_MEM_THIS blocks[BX_MEM_THIS next_swapout_idx];
-      } while ((!buffer) || (buffer == BX_MEM_C::swapped_out));
-
-      used_for_tlb = false;
-      // tlb buffer check loop
-      const Bit8u* buffer_end = buffer+BX_MEM_BLOCK_LEN;
-      // Don't replace it if any CPU is using it as a TLB entry
-      for (int i=0; i<BX_SMP_PROCESSORS && !used_for_tlb;i++)
-        used_for_tlb = BX_CPU(i)->check_addr_in_tlb_buffers(buffer, buffer_end);
-    } while (used_for_tlb);
-    // Flush the block to be replaced
-    bx_phy_address address = ((bx_phy_address)BX_MEM_THIS next_swapout_idx)*BX_MEM_BLOCK_LEN;
+    Bit32u victim = BX_MEM_THIS choose_victim();
+    Bit8u *buffer = BX_MEM_THIS blocks[victim];
+    bx_bool swapped = (BX_MEM_THIS blocks[block] == BX_MEM_C::swapped_out);
     // Create overflow file if it does not currently exist.
     if (!BX_MEM_THIS overflow_file) {
       BX_MEM_THIS overflow_file = tmpfile64();
       if (!BX_MEM_THIS overflow_file)
         BX_PANIC(("Unable to allocate memory overflow file"));
     }
-    // Write swapped out block
-    if (fseeko64(BX_MEM_THIS overflow_file, address, SEEK_SET))
-      BX_PANIC(("FATAL ERROR: Could not seek to 0x" FMT_PHY_ADDRX " in overflow file!", address)); 
-    if (1 != fwrite (BX_MEM_THIS blocks[BX_MEM_THIS next_swapout_idx], BX_MEM_BLOCK_LEN, 1, BX_MEM_THIS overflow_file))
-      BX_PANIC(("FATAL ERROR: Could not write at 0x" FMT_PHY_ADDRX " in overflow file!", address));
+    if (!BX_MEM_THIS ramfile_started)
+      BX_MEM_THIS start_ramfile_worker();
+    // Hand a copy of the replaced block to the worker thread for writing
+    bx_ramfile_slot_t *slot = BX_MEM_THIS get_free_slot();
+    memcpy(slot->buf, buffer, BX_MEM_BLOCK_LEN);
+    BX_LOCK(BX_MEM_THIS ramfile_mutex);
+    slot->block = victim;
+    slot->seq = BX_MEM_THIS ramfile_seq++;
+    slot->state = BX_RAMFILE_WRITE;
+    BX_UNLOCK(BX_MEM_THIS ramfile_mutex);
+    bx_set_event(&BX_MEM_THIS ramfile_event);
+    BX_MEM_THIS ramfile_writes++;
     // Mark swapped out block
-    BX_MEM_THIS blocks[BX_MEM_THIS next_swapout_idx] = BX_MEM_C::swapped_out;
+    BX_MEM_THIS blocks[victim] = BX_MEM_C::swapped_out;
     BX_MEM_THIS blocks[block] = buffer;
-    read_block(block);
-    BX_DEBUG(("allocate_block: block=0x%x, replaced 0x%x", block, BX_MEM_THIS next_swapout_idx));
+    dedup_forget(buffer, BX_MEM_BLOCK_LEN);
+    if (!swapped) {
+      // never written, not in the file
+      memset(buffer, 0, BX_MEM_BLOCK_LEN);
+    } else {
+      if (!BX_MEM_THIS fill_from_slot(block, buffer))
+        read_block(block);
+      // guests tend to touch memory in order, so do the following blocks
+      for (Bit32u n = 1; n <= BX_RAMFILE_PREFETCH; n++)
+        BX_MEM_THIS queue_prefetch(block + n);
+    }
+    BX_DEBUG(("allocate_block: block=0x%x, replaced 0x%x", block, victim));
   }
   else {
     BX_MEM_THIS blocks[block] = BX_MEM_THIS vector + (BX_MEM_THIS used_blocks++ * BX_MEM_BLOCK_LEN);
@@ -236,12 +932,35 @@ void BX_MEM_C::allocate_block(Bit32u block)
 }
 
 #if BX_LARGE_RAMFILE
-// The blocks in RAM must also be flushed to the save file.
+// The blocks in RAM must also be flushed to the save file. The first snapshot
+// holds all of memory and becomes the base, later ones only hold the blocks
+// written since then and refer to the base for the rest.
 void ramfile_save_handler(void *devptr, FILE *fp)
 {
-  for (Bit32u idx = 0; idx < (BX_MEM(0)->len / BX_MEM_BLOCK_LEN); idx++) {
+  Bit32u num_blocks = (Bit32u)(BX_MEM(0)->len / BX_MEM_BLOCK_LEN);
+  char ram_path[BX_PATHNAME_LEN];
+  struct stat stat_buf;
+
+  snprintf(ram_path, BX_PATHNAME_LEN, "%s/memory.ram",
+           SIM->get_param_string(BXPN_RESTORE_PATH)->getptr());
+  BX_MEM(0)->collect_dirty_blocks();
+  // save everything if there is no base or the base itself is overwritten
+  bx_bool full = (BX_MEM(0)->snapshot_base[0] == 0) ||
+                 !strcmp(BX_MEM(0)->snapshot_base, ram_path) ||
+                 (stat(BX_MEM(0)->snapshot_base, &stat_buf) != 0);
+#if !BX_HAVE_SYS_MMAN_H
+  full = 1;
+#endif
+
+  for (Bit32u idx = 0; idx < num_blocks; idx++) {
+    // swapped out blocks are already in the file, copied from the overflow file
+    BX_MEM(0)->snapshot_blocks[idx] = 1;
     if ((BX_MEM(0)->blocks[idx]) && (BX_MEM(0)->blocks[idx] != BX_MEM(0)->swapped_out))
     {
+      if (!full && !BX_MEM(0)->base_dirty[idx]) {
+        BX_MEM(0)->snapshot_blocks[idx] = 0;
+        continue;
+      }
       bx_phy_address address = ((bx_phy_address)idx)*BX_MEM_BLOCK_LEN;
       if (fseeko64(fp, address, SEEK_SET))
         BX_PANIC(("FATAL ERROR: Could not seek to 0x" FMT_PHY_ADDRX " in overflow file!", address)); 
@@ -249,6 +968,36 @@ void ramfile_save_handler(void *devptr, FILE *fp)
         BX_PANIC(("FATAL ERROR: Could not write at 0x" FMT_PHY_ADDRX " in overflow file!", address));
     }
   }
+
+  if (full) {
+    strcpy(BX_MEM(0)->snapshot_base, ram_path);
+    memset(BX_MEM(0)->base_dirty, 0, num_blocks);
+    BX_MEM(0)->snapshot_base_param->set("");
+  } else {
+    BX_MEM(0)->snapshot_base_param->set(BX_MEM(0)->snapshot_base);
+  }
+}
+
+// Called once the whole memory state is restored. The restored snapshot (or
+// its base) is the base for following incremental snapshots.
+void memory_restore_handler(void *devptr, bx_list_c *list)
+{
+  Bit32u num_blocks = (Bit32u)(BX_MEM(0)->len / BX_MEM_BLOCK_LEN);
+
+  BX_MEM(0)->unmap_snapshot_base();
+  if (BX_MEM(0)->snapshot_base_param->isempty()) {
+    snprintf(BX_MEM(0)->snapshot_base, BX_PATHNAME_LEN, "%s/memory.ram",
+             SIM->get_param_string(BXPN_RESTORE_PATH)->getptr());
+    memset(BX_MEM(0)->base_dirty, 0, num_blocks);
+  } else {
+    strncpy(BX_MEM(0)->snapshot_base, BX_MEM(0)->snapshot_base_param->getptr(), BX_PATHNAME_LEN - 1);
+    BX_MEM(0)->snapshot_base[BX_PATHNAME_LEN - 1] = 0;
+    memcpy(BX_MEM(0)->base_dirty, BX_MEM(0)->snapshot_blocks, num_blocks);
+  }
+  memset(BX_MEM(0)->snapshot_blocks, 1, num_blocks);
+  pageWriteStampTable.clearDirtyPages(BX_DIRTY_SNAPSHOT);
+  // the restored blocks don't show up in the dirty page map
+  BX_MEM(0)->dedup_forget(BX_MEM(0)->vector, (Bit32u) BX_MEM(0)->allocated);
 }
 #endif
 
@@ -279,8 +1028,23 @@ void memory_param_restore_handler(void *devptr, bx_param_c *param, Bit64s val)
   if (! strncmp(pname, "blk", 3)) {
     Bit32u blk_index = atoi(pname + 3);
 #if BX_LARGE_RAMFILE
+    if (!BX_MEM(0)->snapshot_base_param->isempty() && !BX_MEM(0)->snapshot_blocks[blk_index] &&
+        (BX_MEM(0)->base_map == NULL)) {
+      // incremental snapshot: map the base, read_block() takes blocks from it
+      BX_MEM(0)->map_snapshot_base();
+    }
     if ((Bit32s) val == -2) {
       BX_MEM(0)->blocks[blk_index] = BX_MEM(0)->swapped_out;
+      if ((BX_MEM(0)->base_map != NULL) && !BX_MEM(0)->snapshot_blocks[blk_index]) {
+        // not in the snapshot file: move it from the base to the overflow file
+        Bit8u *buf = new Bit8u[BX_MEM_BLOCK_LEN];
+        bx_phy_address address = ((bx_phy_address)blk_index)*BX_MEM_BLOCK_LEN;
+        BX_MEM(0)->read_base_block(blk_index, buf);
+        if (fseeko64(BX_MEM(0)->overflow_file, address, SEEK_SET) ||
+            (1 != fwrite(buf, BX_MEM_BLOCK_LEN, 1, BX_MEM(0)->overflow_file)))
+          BX_PANIC(("FATAL ERROR: Could not write at 0x" FMT_PHY_ADDRX " in overflow file!", address));
+        delete [] buf;
+      }
       return;
     }
 #endif
@@ -304,6 +1068,9 @@ void BX_MEM_C::register_state()
 #if BX_LARGE_RAMFILE
   bx_shadow_filedata_c *ramfile = new bx_shadow_filedata_c(list, "ram", &(BX_MEM_THIS overflow_file));
   ramfile->set_sr_handlers(this, ramfile_save_handler, (filedata_restore_handler)NULL);
+  BX_MEM_THIS snapshot_base_param = new bx_param_string_c(list, "snapshot_base", "", "", "", BX_PATHNAME_LEN);
+  new bx_shadow_data_c(list, "snapshot_blocks", BX_MEM_THIS snapshot_blocks, num_blocks);
+  list->set_restore_handler(this, memory_restore_handler);
 #else
   new bx_shadow_data_c(list, "ram", BX_MEM_THIS vector, BX_MEM_THIS allocated);
 #endif
@@ -332,14 +1099,27 @@ void BX_MEM_C::cleanup_memory()
   unsigned idx;
 
   if (BX_MEM_THIS vector != NULL) {
-    delete [] BX_MEM_THIS actual_vector;
-    BX_MEM_THIS actual_vector = NULL;
+    dedup_cleanup();
+    free_vector();
     BX_MEM_THIS vector = NULL;
     BX_MEM_THIS rom = NULL;
     BX_MEM_THIS bogus = NULL;
     delete [] BX_MEM_THIS blocks;
     BX_MEM_THIS blocks = 0;
     BX_MEM_THIS used_blocks = 0;
+#if BX_LARGE_RAMFILE
+    if (BX_MEM_THIS ramfile_writes > 0) {
+      BX_INFO(("ramfile: " FMT_LL "u blocks written back, " FMT_LL "u read, " FMT_LL "u read ahead",
+               BX_MEM_THIS ramfile_writes, BX_MEM_THIS ramfile_reads, BX_MEM_THIS ramfile_prefetch_hits));
+    }
+    delete [] BX_MEM_THIS block_ref;
+    BX_MEM_THIS block_ref = NULL;
+    delete [] BX_MEM_THIS base_dirty;
+    BX_MEM_THIS base_dirty = NULL;
+    delete [] BX_MEM_THIS snapshot_blocks;
+    BX_MEM_THIS snapshot_blocks = NULL;
+    BX_MEM_THIS unmap_snapshot_base();
+#endif
     if (BX_MEM_THIS memory_handlers != NULL) {
       for (idx = 0; idx < BX_MEM_HANDLERS; idx++) {
         struct memory_handler_struct *memory_handler = BX_MEM_THIS memory_handlers[idx];
@@ -352,6 +1132,10 @@ void BX_MEM_C::cleanup_memory()
       }
       delete [] BX_MEM_THIS memory_handlers;
       BX_MEM_THIS memory_handlers = NULL;
+      for (idx = 0; idx < BX_MEM_HANDLERS; idx++)
+        delete [] BX_MEM_THIS page_handlers[idx];
+      delete [] BX_MEM_THIS page_handlers;
+      BX_MEM_THIS page_handlers = NULL;
     }
   }
 }
@@ -472,6 +1256,10 @@ void BX_MEM_C::load_ROM(const char *path, bx_phy_address romaddress, Bit8u type)
       }
     }
   }
+  if (map_ROM(fd, offset, size)) {
+    offset += size;
+    size = 0;
+  }
   while (size > 0) {
     ret = read(fd, (bx_ptr_t) &BX_MEM_THIS rom[offset], size);
     if (ret <= 0) {
@@ -502,6 +1290,35 @@ void BX_MEM_C::load_ROM(const char *path, bx_phy_address romaddress, Bit8u type)
                          path));
 }
 
+// Map a page aligned ROM image straight from the file instead of copying it.
+// The mapping is private: the pages are shared with the host page cache (and
+// other Bochs instances using the same image) until the guest writes to
+// shadowed ROM, which then gets its own copy as before.
+bx_bool BX_MEM_C::map_ROM(int fd, unsigned long offset, unsigned long size)
+{
+#if BX_HAVE_SYS_MMAN_H && defined(MAP_ANONYMOUS) && defined(MAP_FIXED)
+  if ((BX_MEM_THIS actual_len == 0) || (size == 0) ||
+      ((offset | size) & (BX_MEM_VECTOR_ALIGN - 1)) ||
+      (((bx_ptr_equiv_t) BX_MEM_THIS rom) & (BX_MEM_VECTOR_ALIGN - 1)))
+    return 0;
+  void *map = mmap(&BX_MEM_THIS rom[offset], size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_FIXED, fd, 0);
+  if (map == MAP_FAILED) {
+    // a failed fixed mapping may have punched a hole into the vector
+    map = mmap(&BX_MEM_THIS rom[offset], size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    if (map == MAP_FAILED) {
+      BX_PANIC(("ROM: unable to restore ROM space mapping"));
+    }
+    memset(&BX_MEM_THIS rom[offset], 0xff, size);
+    return 0;
+  }
+  return 1;
+#else
+  return 0;
+#endif
+}
+
 void BX_MEM_C::load_RAM(const char *path, bx_phy_address ramaddress)
 {
   struct stat stat_buf;
@@ -724,16 +1541,17 @@ Bit8u *BX_MEM_C::getHostMemAddr(BX_CPU_C *cpu, bx_phy_address addr, unsigned rw)
   }
 #endif
 
-  struct memory_handler_struct *memory_handler = BX_MEM_THIS memory_handlers[a20addr >> 20];
-  while (memory_handler) {
+  struct memory_handler_struct *memory_handler = BX_MEM_THIS get_page_handler(a20addr);
+  if (memory_handler) {
     if (memory_handler->begin <= a20addr &&
         memory_handler->end >= a20addr) {
-      if (memory_handler->da_handler)
+      if (memory_handler->da_handler) {
+        BX_SMP_LOCK_SCOPE();
         return memory_handler->da_handler(a20addr, rw, memory_handler->param);
+      }
       else
         return(NULL); // Vetoed! memory handler for i/o apic, vram, mmio and PCI PnP
     }
-    memory_handler = memory_handler->next;
   }
 
   if (! write) {
@@ -838,6 +1656,8 @@ BX_MEM_C::registerMemoryHandlers(void *param, memory_handler_t read_handler,
     if (BX_MEM_THIS memory_handlers[page_idx] != NULL) {
       if ((bitmap & BX_MEM_THIS memory_handlers[page_idx]->bitmap) != 0) {
         BX_ERROR(("Register failed: overlapping memory handlers!"));
+        // the megabytes before this one stay registered
+        BX_MEM_THIS update_page_handlers(begin_addr, end_addr);
         return 0;
       } else {
         bitmap |= BX_MEM_THIS memory_handlers[page_idx]->bitmap;
@@ -854,6 +1674,7 @@ BX_MEM_C::registerMemoryHandlers(void *param, memory_handler_t read_handler,
     memory_handler->end = end_addr;
     memory_handler->bitmap = bitmap;
   }
+  BX_MEM_THIS update_page_handlers(begin_addr, end_addr);
   return 1;
 }
 
@@ -891,9 +1712,38 @@ BX_MEM_C::unregisterMemoryHandlers(void *param, bx_phy_address begin_addr, bx_ph
       BX_MEM_THIS memory_handlers[page_idx] = memory_handler->next;
     delete memory_handler;
   }
+  BX_MEM_THIS update_page_handlers(begin_addr, end_addr);
   return ret;
 }
 
+// Rebuild the page table entries of the pages in begin_addr..end_addr from
+// the handler lists. The 64K granularity overlap check guarantees that at
+// most one handler covers a page.
+void BX_MEM_C::update_page_handlers(bx_phy_address begin_addr, bx_phy_address end_addr)
+{
+  for (Bit64u page = begin_addr >> 12; page <= (Bit64u)(end_addr >> 12); page++) {
+    bx_phy_address page_begin = (bx_phy_address)(page << 12);
+    bx_phy_address page_end = page_begin + 0xfff;
+    Bit32u mb_idx = (Bit32u)(page >> 8);
+
+    struct memory_handler_struct *memory_handler = BX_MEM_THIS memory_handlers[mb_idx];
+    while (memory_handler) {
+      if (memory_handler->begin <= page_end && memory_handler->end >= page_begin)
+        break;
+      memory_handler = memory_handler->next;
+    }
+
+    struct memory_handler_struct **pages = BX_MEM_THIS page_handlers[mb_idx];
+    if (pages == NULL) {
+      if (memory_handler == NULL) continue;
+      pages = new struct memory_handler_struct *[256];
+      memset(pages, 0, 256 * sizeof(struct memory_handler_struct *));
+      BX_MEM_THIS page_handlers[mb_idx] = pages;
+    }
+    pages[page & 0xff] = memory_handler;
+  }
+}
+
 void BX_MEM_C::enable_smram(bx_bool enable, bx_bool restricted)
 {
   BX_MEM_THIS smram_available = 1;
@@ -0,0 +1,1528 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+/////////////////////////////////////////////////////////////////////////
+
+// Build and check file systems of the guest kernel in flat disk images
+// without booting the guest.
+// Format a partition the way the kernel's partition_format() does.
+// Copy a host directory tree into a partition, every file in one run of
+// blocks with its index blocks in front of the data they map.
+// Check the directory tree, the inode and the block bitmaps offline.
+//
+// The on-disk layout below must match fs/super_block.h, fs/inode.h,
+// fs/dir.h and fs/journal.h of the kernel.
+
+#include "config.h"
+#include "bxcompat.h"
+
+#ifndef WIN32
+#  include <dirent.h>
+#endif
+
+#include "osdep.h"
+
+#define BXFSIMAGE_MODE_NULL    0
+#define BXFSIMAGE_MODE_INFO    1
+#define BXFSIMAGE_MODE_FORMAT  2
+#define BXFSIMAGE_MODE_COPY    3
+#define BXFSIMAGE_MODE_FSCK    4
+
+#define FS_SECTOR_SIZE        512
+#define FS_BLOCK_SIZE         4096
+#define FS_BLOCK_SECS         (FS_BLOCK_SIZE / FS_SECTOR_SIZE)
+#define FS_BITS_PER_SECTOR    (FS_SECTOR_SIZE * 8)
+#define FS_MAGIC              0x19590320
+#define FS_MAX_INODES         4096   // MAX_FILES_PER_PART
+#define FS_NAME_LEN           16
+#define FS_ENTRIES_PER_SEC    (FS_SECTOR_SIZE / sizeof(fs_dir_entry_t))
+#define FS_DIRECT_BLOCKS      12
+#define FS_IND                12
+#define FS_TIND               14
+#define FS_PTRS_PER_BLOCK     (FS_BLOCK_SIZE / 4)
+#define FS_DIR_INDEX          13     // index block of a hashed directory
+#define FS_DIR_BUCKETS        64
+#define FS_DIR_MAX_BLOCKS     (FS_DIRECT_BLOCKS + FS_PTRS_PER_BLOCK)
+#define FS_INODE_GROUP_SECTS  FS_BLOCK_SECS
+
+#define FT_UNKNOWN            0
+#define FT_REGULAR            1
+#define FT_DIRECTORY          2
+
+#define JOURNAL_SECTS         1024
+#define JOURNAL_MAGIC         0x4a4f5552
+#define JOURNAL_SUPER         1
+#define JOURNAL_DESC          2
+#define JOURNAL_COMMIT        3
+#define JOURNAL_DESC_LBAS     ((FS_SECTOR_SIZE - 16) / 4)
+
+#define MBR_PART_TYPE         0x83
+#define MBR_PART_START        2048
+#define MAX_PRIMARY_PARTS     4
+#define MAX_LOGICAL_PARTS     8
+
+#define FSCK_PRINT_MAX        20
+#define COPY_RUN_BLOCKS       64     // blocks written with one host write
+#define HOST_PATH_LEN         1024
+
+typedef struct {
+  Bit32u magic;
+  Bit32u sec_cnt;
+  Bit32u inode_cnt;
+  Bit32u part_lba_base;
+  Bit32u journal_lba;
+  Bit32u journal_sects;
+  Bit32u block_bitmap_lba;
+  Bit32u block_bitmap_sects;
+  Bit32u inode_bitmap_lba;
+  Bit32u inode_bitmap_sects;
+  Bit32u inode_table_lba;
+  Bit32u inode_table_sects;
+  Bit32u data_start_lba;
+  Bit32u root_inode_no;
+  Bit32u dir_entry_size;
+  Bit32u block_size;
+  Bit32u inode_table_uninit;
+  Bit32u free_blocks;
+  Bit32u free_inodes;
+  Bit8u  pad[436];
+} fs_super_block_t;
+
+// the part of the kernel's struct inode that is stored on disk
+typedef struct {
+  Bit32u i_no;
+  Bit32u i_size;
+  Bit32u i_open_cnts;
+  Bit32u write_deny;
+  Bit32u i_sectors[15];
+  Bit32u list_prev;   // inode_tag.prev of the 32-bit kernel, unused on disk
+} fs_inode_t;
+
+typedef struct {
+  char   filename[FS_NAME_LEN];
+  Bit32u i_no;
+  Bit32u f_type;
+} fs_dir_entry_t;
+
+typedef struct {
+  Bit32u magic;
+  Bit32u type;
+  Bit32u seq;
+  Bit32u cnt;
+  Bit32u lbas[JOURNAL_DESC_LBAS];
+} journal_header_t;
+
+typedef struct {
+  Bit8u  bootable;
+  Bit8u  start_chs[3];
+  Bit8u  fs_type;
+  Bit8u  end_chs[3];
+  Bit32u start_lba;
+  Bit32u sec_cnt;
+} mbr_part_entry_t;
+
+typedef struct {
+  Bit32u start_lba;
+  Bit32u sec_cnt;
+} partition_t;
+
+// a sector written by a committed journal transaction
+typedef struct {
+  Bit32u lba;
+  Bit8u  data[FS_SECTOR_SIZE];
+} journal_sector_t;
+
+// an index block of a file being copied, kept in memory until the file is done
+typedef struct fs_table {
+  Bit32u lba;
+  Bit32u ptrs[FS_PTRS_PER_BLOCK];
+  struct fs_table *child[FS_PTRS_PER_BLOCK];
+} fs_table_t;
+
+int  bxfsimage_mode;
+int  bx_part_no;
+int  bx_inode_cnt;
+int  bx_new_mbr;
+char bx_image_name[HOST_PATH_LEN];
+char bx_host_dir[HOST_PATH_LEN];
+char bx_dest_dir[HOST_PATH_LEN];
+
+int image_fd = -1;
+partition_t primary_parts[MAX_PRIMARY_PARTS], logical_parts[MAX_LOGICAL_PARTS];
+int primary_cnt, logical_cnt;
+Bit32u ext_lba_base;
+
+fs_super_block_t sb;
+Bit8u *block_bitmap, *inode_bitmap;
+Bit32u data_blocks;   // blocks of the data area that the block bitmap may hand out
+Bit32u alloc_goal;    // bitmap index tried first by the next block allocation
+
+journal_sector_t *journal_sectors;
+Bit32u journal_sector_cnt, journal_seq;
+
+Bit32u copied_files, copied_dirs, skipped;
+Bit64u copied_bytes;
+
+void fatal(const char *c)
+{
+  printf("%s\n", c);
+  if (image_fd >= 0) {
+    ::close(image_fd);
+  }
+  exit(1);
+}
+
+// image access
+
+void image_read(Bit32u lba, void *buf, Bit32u cnt)
+{
+  if ((lseek(image_fd, (off_t)lba * FS_SECTOR_SIZE, SEEK_SET) < 0) ||
+      (::read(image_fd, buf, cnt * FS_SECTOR_SIZE) != (ssize_t)(cnt * FS_SECTOR_SIZE))) {
+    fatal("ERROR: image read failed");
+  }
+}
+
+void image_write(Bit32u lba, const void *buf, Bit32u cnt)
+{
+  if ((lseek(image_fd, (off_t)lba * FS_SECTOR_SIZE, SEEK_SET) < 0) ||
+      (::write(image_fd, buf, cnt * FS_SECTOR_SIZE) != (ssize_t)(cnt * FS_SECTOR_SIZE))) {
+    fatal("ERROR: image write failed");
+  }
+}
+
+// read sectors as the kernel sees them after replaying the journal
+void read_sectors(Bit32u lba, void *buf, Bit32u cnt)
+{
+  image_read(lba, buf, cnt);
+  for (Bit32u i = 0; i < journal_sector_cnt; i++) {
+    Bit32u idx = journal_sectors[i].lba - lba;
+    if (idx < cnt) {
+      memcpy((Bit8u*)buf + idx * FS_SECTOR_SIZE, journal_sectors[i].data, FS_SECTOR_SIZE);
+    }
+  }
+}
+
+// read or write len bytes at byte offset off from sector lba
+void read_bytes(Bit32u lba, Bit32u off, void *buf, Bit32u len)
+{
+  Bit8u sect[2 * FS_SECTOR_SIZE];
+  lba += off / FS_SECTOR_SIZE;
+  off %= FS_SECTOR_SIZE;
+  read_sectors(lba, sect, (off + len > FS_SECTOR_SIZE) ? 2 : 1);
+  memcpy(buf, sect + off, len);
+}
+
+void write_bytes(Bit32u lba, Bit32u off, const void *buf, Bit32u len)
+{
+  Bit8u sect[2 * FS_SECTOR_SIZE];
+  Bit32u cnt;
+  lba += off / FS_SECTOR_SIZE;
+  off %= FS_SECTOR_SIZE;
+  cnt = (off + len > FS_SECTOR_SIZE) ? 2 : 1;
+  read_sectors(lba, sect, cnt);
+  memcpy(sect + off, buf, len);
+  image_write(lba, sect, cnt);
+}
+
+void zero_sectors(Bit32u lba, Bit32u cnt)
+{
+  static const Bit8u zero[FS_BLOCK_SIZE] = {0};
+  while (cnt > 0) {
+    Bit32u n = (cnt < FS_BLOCK_SECS) ? cnt : FS_BLOCK_SECS;
+    image_write(lba, zero, n);
+    lba += n;
+    cnt -= n;
+  }
+}
+
+// partition table, scanned like partition_scan() of the kernel so that
+// partition numbers match the kernel's sdb1, sdb5, ...
+
+void scan_partitions(Bit32u ext_lba, int depth)
+{
+  Bit8u sect[FS_SECTOR_SIZE];
+  mbr_part_entry_t table[4];
+
+  if (depth > MAX_LOGICAL_PARTS) {
+    return;
+  }
+  image_read(ext_lba, sect, 1);
+  if ((sect[510] != 0x55) || (sect[511] != 0xaa)) {
+    return;
+  }
+  memcpy(table, sect + 446, sizeof(table));
+  for (int i = 0; i < 4; i++) {
+    mbr_part_entry_t *p = &table[i];
+    if (p->fs_type == 0x05) {
+      if (ext_lba_base != 0) {
+        scan_partitions(p->start_lba + ext_lba_base, depth + 1);
+      } else {
+        ext_lba_base = p->start_lba;
+        scan_partitions(p->start_lba, depth + 1);
+      }
+    } else if (p->fs_type != 0) {
+      if (ext_lba == 0) {
+        if (primary_cnt < MAX_PRIMARY_PARTS) {
+          primary_parts[primary_cnt].start_lba = p->start_lba;
+          primary_parts[primary_cnt++].sec_cnt = p->sec_cnt;
+        }
+      } else {
+        logical_parts[logical_cnt].start_lba = ext_lba + p->start_lba;
+        logical_parts[logical_cnt++].sec_cnt = p->sec_cnt;
+        if (logical_cnt >= MAX_LOGICAL_PARTS) return;
+      }
+    }
+  }
+}
+
+partition_t *find_partition(int part_no)
+{
+  if ((part_no >= 1) && (part_no <= primary_cnt)) {
+    return &primary_parts[part_no - 1];
+  } else if ((part_no >= 5) && (part_no < 5 + logical_cnt)) {
+    return &logical_parts[part_no - 5];
+  }
+  return NULL;
+}
+
+// replace the partition table with one primary partition covering the image
+void write_mbr(void)
+{
+  Bit8u sect[FS_SECTOR_SIZE];
+  mbr_part_entry_t entry;
+  off_t size = lseek(image_fd, 0, SEEK_END);
+  Bit64u sectors = (Bit64u)size / FS_SECTOR_SIZE;
+
+  if (sectors <= MBR_PART_START) {
+    fatal("ERROR: image too small for a partition table");
+  }
+  if (sectors > 0xffffffff) {
+    sectors = 0xffffffff;
+  }
+  image_read(0, sect, 1);
+  memset(sect + 446, 0, 64);
+  memset(&entry, 0, sizeof(entry));
+  entry.start_chs[0] = entry.end_chs[0] = 0xfe;
+  entry.start_chs[1] = entry.end_chs[1] = 0xff;
+  entry.start_chs[2] = entry.end_chs[2] = 0xff;
+  entry.fs_type = MBR_PART_TYPE;
+  entry.start_lba = MBR_PART_START;
+  entry.sec_cnt = (Bit32u)(sectors - MBR_PART_START);
+  memcpy(sect + 446, &entry, sizeof(entry));
+  sect[510] = 0x55;
+  sect[511] = 0xaa;
+  image_write(0, sect, 1);
+}
+
+// bitmaps
+
+bx_bool bit_test(const Bit8u *map, Bit32u idx)
+{
+  return (map[idx / 8] >> (idx % 8)) & 1;
+}
+
+void bit_set(Bit8u *map, Bit32u idx, bx_bool val)
+{
+  if (val) {
+    map[idx / 8] |= (1 << (idx % 8));
+  } else {
+    map[idx / 8] &= ~(1 << (idx % 8));
+  }
+}
+
+Bit32u bitmap_count_zero(const Bit8u *map, Bit32u bits)
+{
+  Bit32u cnt = 0;
+  for (Bit32u idx = 0; idx < bits; idx++) {
+    if (!bit_test(map, idx)) cnt++;
+  }
+  return cnt;
+}
+
+// index of the first run of cnt free blocks at or after from, or -1
+Bit32s find_free_run(Bit32u from, Bit32u cnt)
+{
+  Bit32u run = 0;
+  for (Bit32u idx = from; idx < data_blocks; idx++) {
+    if (bit_test(block_bitmap, idx)) {
+      run = 0;
+    } else if (++run == cnt) {
+      return idx + 1 - cnt;
+    }
+  }
+  return -1;
+}
+
+// allocate the block at alloc_goal, or the first free block when it is
+// taken. The caller has checked that enough blocks are free.
+Bit32u block_alloc(void)
+{
+  Bit32u idx = alloc_goal;
+  if ((idx >= data_blocks) || bit_test(block_bitmap, idx)) {
+    for (idx = 0; (idx < data_blocks) && bit_test(block_bitmap, idx); idx++);
+    if (idx == data_blocks) {
+      fatal("ERROR: out of blocks");
+    }
+  }
+  bit_set(block_bitmap, idx, 1);
+  sb.free_blocks--;
+  alloc_goal = idx + 1;
+  return sb.data_start_lba + idx * FS_BLOCK_SECS;
+}
+
+Bit32u block_index(Bit32u lba)
+{
+  return (lba - sb.data_start_lba) / FS_BLOCK_SECS;
+}
+
+// inodes
+
+void inode_read(Bit32u ino, fs_inode_t *inode)
+{
+  read_bytes(sb.inode_table_lba, ino * sizeof(fs_inode_t), inode, sizeof(fs_inode_t));
+}
+
+void inode_write(const fs_inode_t *inode)
+{
+  write_bytes(sb.inode_table_lba, inode->i_no * sizeof(fs_inode_t), inode, sizeof(fs_inode_t));
+}
+
+// allocate an inode, zeroing its group of the inode table first when the
+// kernel has not done that yet (see inode_table_prepare() in fs/file.c)
+Bit32u inode_alloc(void)
+{
+  Bit32u ino;
+  for (ino = 0; (ino < sb.inode_cnt) && bit_test(inode_bitmap, ino); ino++);
+  if (ino == sb.inode_cnt) {
+    fatal("ERROR: out of inodes");
+  }
+  bit_set(inode_bitmap, ino, 1);
+  sb.free_inodes--;
+  if (sb.inode_table_uninit > 0) {
+    Bit32u inited = sb.inode_table_sects - sb.inode_table_uninit;
+    Bit32u last_sec = ((ino + 1) * sizeof(fs_inode_t) - 1) / FS_SECTOR_SIZE;
+    if (last_sec >= inited) {
+      Bit32u end = (last_sec / FS_INODE_GROUP_SECTS + 1) * FS_INODE_GROUP_SECTS;
+      if (end > sb.inode_table_sects) {
+        end = sb.inode_table_sects;
+      }
+      zero_sectors(sb.inode_table_lba + inited, end - inited);
+      sb.inode_table_uninit = sb.inode_table_sects - end;
+    }
+  }
+  return ino;
+}
+
+// journal: committed transactions are applied like journal_replay() does
+
+void journal_load(void)
+{
+  journal_header_t hdr;
+  Bit32u pos = 1;
+
+  image_read(sb.journal_lba, &hdr, 1);
+  if ((hdr.magic != JOURNAL_MAGIC) || (hdr.type != JOURNAL_SUPER)) {
+    journal_seq = 1;
+    return;
+  }
+  journal_seq = hdr.seq;
+  while (1) {
+    Bit32u end = pos;
+    bx_bool complete = 0;
+    while (end < sb.journal_sects) {
+      image_read(sb.journal_lba + end, &hdr, 1);
+      if ((hdr.magic != JOURNAL_MAGIC) || (hdr.seq != journal_seq)) {
+        break;
+      }
+      if (hdr.type == JOURNAL_COMMIT) {
+        complete = 1;
+        break;
+      }
+      if ((hdr.type != JOURNAL_DESC) || (hdr.cnt > JOURNAL_DESC_LBAS)) {
+        break;
+      }
+      end += 1 + hdr.cnt;
+    }
+    if (!complete) {
+      break;
+    }
+    while (pos < end) {
+      image_read(sb.journal_lba + pos, &hdr, 1);
+      journal_sectors = (journal_sector_t*)realloc(journal_sectors, (journal_sector_cnt + hdr.cnt) * sizeof(journal_sector_t));
+      if (journal_sectors == NULL) {
+        fatal("ERROR: out of memory");
+      }
+      for (Bit32u i = 0; i < hdr.cnt; i++) {
+        journal_sector_t *js = &journal_sectors[journal_sector_cnt++];
+        js->lba = hdr.lbas[i];
+        image_read(sb.journal_lba + pos + 1 + i, js->data, 1);
+      }
+      pos += 1 + hdr.cnt;
+    }
+    pos = end + 1;
+    journal_seq++;
+  }
+}
+
+// write the replayed sectors home and empty the journal, as mounting does
+void journal_flush(void)
+{
+  journal_header_t hdr;
+
+  for (Bit32u i = 0; i < journal_sector_cnt; i++) {
+    image_write(journal_sectors[i].lba, journal_sectors[i].data, 1);
+  }
+  free(journal_sectors);
+  journal_sectors = NULL;
+  journal_sector_cnt = 0;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = JOURNAL_MAGIC;
+  hdr.type = JOURNAL_SUPER;
+  hdr.seq = journal_seq + 1;
+  image_write(sb.journal_lba, &hdr, 1);
+}
+
+// file system
+
+void fs_format(const partition_t *part, Bit32u inode_cnt)
+{
+  Bit8u *buf;
+  Bit32u inode_bitmap_sects = (inode_cnt + FS_BITS_PER_SECTOR - 1) / FS_BITS_PER_SECTOR;
+  Bit32u inode_table_sects = (inode_cnt * sizeof(fs_inode_t) + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE;
+  Bit32u used_sects = 2 + JOURNAL_SECTS + inode_bitmap_sects + inode_table_sects;
+  Bit32u free_sects, block_bitmap_sects, bit_len, buf_size;
+
+  if (part->sec_cnt < used_sects + 4 * FS_BLOCK_SECS) {
+    fatal("ERROR: partition too small");
+  }
+  // same sizing as partition_format() of the kernel
+  free_sects = part->sec_cnt - used_sects;
+  block_bitmap_sects = (free_sects / FS_BLOCK_SECS + FS_BITS_PER_SECTOR - 1) / FS_BITS_PER_SECTOR;
+  bit_len = (free_sects - block_bitmap_sects) / FS_BLOCK_SECS;
+  block_bitmap_sects = (bit_len + FS_BITS_PER_SECTOR - 1) / FS_BITS_PER_SECTOR;
+
+  memset(&sb, 0, sizeof(sb));
+  sb.magic = FS_MAGIC;
+  sb.sec_cnt = part->sec_cnt;
+  sb.inode_cnt = inode_cnt;
+  sb.part_lba_base = part->start_lba;
+  sb.journal_lba = sb.part_lba_base + 2;
+  sb.journal_sects = JOURNAL_SECTS;
+  sb.block_bitmap_lba = sb.journal_lba + sb.journal_sects;
+  sb.block_bitmap_sects = block_bitmap_sects;
+  sb.inode_bitmap_lba = sb.block_bitmap_lba + sb.block_bitmap_sects;
+  sb.inode_bitmap_sects = inode_bitmap_sects;
+  sb.inode_table_lba = sb.inode_bitmap_lba + sb.inode_bitmap_sects;
+  sb.inode_table_sects = inode_table_sects;
+  sb.data_start_lba = sb.inode_table_lba + sb.inode_table_sects;
+  sb.root_inode_no = 0;
+  sb.dir_entry_size = sizeof(fs_dir_entry_t);
+  sb.block_size = FS_BLOCK_SIZE;
+  // the whole inode table is zeroed here, the kernel has nothing left to do
+  sb.inode_table_uninit = 0;
+
+  buf_size = block_bitmap_sects;
+  if (buf_size < inode_bitmap_sects) buf_size = inode_bitmap_sects;
+  buf_size *= FS_SECTOR_SIZE;
+  if (buf_size < FS_BLOCK_SIZE) buf_size = FS_BLOCK_SIZE;
+  buf = new Bit8u[buf_size];
+
+  // block bitmap: blocks 0 and 1 hold the root directory and its index,
+  // bits past the end are set like the kernel sets them
+  memset(buf, 0, buf_size);
+  buf[0] |= 0x03;
+  Bit32u last_byte = bit_len / 8;
+  Bit8u last_bit = bit_len % 8;
+  memset(&buf[last_byte], 0xff, FS_SECTOR_SIZE - (last_byte % FS_SECTOR_SIZE));
+  for (Bit8u bit_idx = 0; bit_idx <= last_bit; bit_idx++) {
+    buf[last_byte] &= ~(1 << bit_idx);
+  }
+  image_write(sb.block_bitmap_lba, buf, sb.block_bitmap_sects);
+  sb.free_blocks = bitmap_count_zero(buf, sb.block_bitmap_sects * FS_BITS_PER_SECTOR);
+
+  // inode bitmap: inode 0 is the root directory
+  memset(buf, 0, buf_size);
+  buf[0] |= 0x01;
+  for (Bit32u bit = inode_cnt; bit < inode_bitmap_sects * FS_BITS_PER_SECTOR; bit++) {
+    bit_set(buf, bit, 1);
+  }
+  image_write(sb.inode_bitmap_lba, buf, sb.inode_bitmap_sects);
+  sb.free_inodes = inode_cnt - 1;
+
+  // inode table with the root directory, a hashed directory
+  zero_sectors(sb.inode_table_lba, sb.inode_table_sects);
+  fs_inode_t root;
+  memset(&root, 0, sizeof(root));
+  root.i_no = 0;
+  root.i_size = 2 * sizeof(fs_dir_entry_t);
+  root.i_sectors[0] = sb.data_start_lba;
+  root.i_sectors[FS_DIR_INDEX] = sb.data_start_lba + FS_BLOCK_SECS;
+  write_bytes(sb.inode_table_lba, 0, &root, sizeof(root));
+
+  // root directory block with . and .., and its empty index block
+  memset(buf, 0, buf_size);
+  fs_dir_entry_t *de = (fs_dir_entry_t*)buf;
+  strcpy(de[0].filename, ".");
+  de[0].f_type = FT_DIRECTORY;
+  strcpy(de[1].filename, "..");
+  de[1].f_type = FT_DIRECTORY;
+  image_write(sb.data_start_lba, buf, FS_BLOCK_SECS);
+  zero_sectors(sb.data_start_lba + FS_BLOCK_SECS, FS_BLOCK_SECS);
+
+  // journal super block
+  memset(buf, 0, buf_size);
+  journal_header_t *jsb = (journal_header_t*)buf;
+  jsb->magic = JOURNAL_MAGIC;
+  jsb->type = JOURNAL_SUPER;
+  jsb->seq = 1;
+  image_write(sb.journal_lba, buf, 1);
+
+  // the super block goes last, a partly formatted partition has no magic
+  image_write(part->start_lba + 1, &sb, 1);
+  delete [] buf;
+}
+
+// load the super block and the bitmaps, replaying committed journal
+// transactions. Only a writable image gets the replayed sectors written.
+void fs_open(const partition_t *part, bx_bool writable)
+{
+  image_read(part->start_lba + 1, &sb, 1);
+  if ((sb.magic != FS_MAGIC) || (sb.block_size != FS_BLOCK_SIZE)) {
+    fatal("ERROR: no file system on this partition");
+  }
+  if ((sb.dir_entry_size != sizeof(fs_dir_entry_t)) || (sb.inode_cnt > FS_MAX_INODES) ||
+      (sb.data_start_lba - sb.part_lba_base > sb.sec_cnt)) {
+    fatal("ERROR: corrupt super block");
+  }
+  journal_load();
+  if (journal_sector_cnt > 0) {
+    printf("journal: %d sectors of committed transactions %s\n", journal_sector_cnt,
+           writable ? "replayed" : "applied in memory");
+  }
+  if (writable) {
+    journal_flush();
+  }
+  read_sectors(part->start_lba + 1, &sb, 1);
+
+  block_bitmap = new Bit8u[sb.block_bitmap_sects * FS_SECTOR_SIZE];
+  read_sectors(sb.block_bitmap_lba, block_bitmap, sb.block_bitmap_sects);
+  inode_bitmap = new Bit8u[sb.inode_bitmap_sects * FS_SECTOR_SIZE];
+  read_sectors(sb.inode_bitmap_lba, inode_bitmap, sb.inode_bitmap_sects);
+
+  data_blocks = (sb.sec_cnt - (sb.data_start_lba - sb.part_lba_base)) / FS_BLOCK_SECS;
+  if (data_blocks > sb.block_bitmap_sects * FS_BITS_PER_SECTOR) {
+    data_blocks = sb.block_bitmap_sects * FS_BITS_PER_SECTOR;
+  }
+  // recounted like mounting does, the recorded counts may lag behind
+  sb.free_blocks = bitmap_count_zero(block_bitmap, sb.block_bitmap_sects * FS_BITS_PER_SECTOR);
+  sb.free_inodes = bitmap_count_zero(inode_bitmap, sb.inode_bitmap_sects * FS_BITS_PER_SECTOR);
+  alloc_goal = 0;
+}
+
+void fs_close(bx_bool writable)
+{
+  if (writable) {
+    image_write(sb.block_bitmap_lba, block_bitmap, sb.block_bitmap_sects);
+    image_write(sb.inode_bitmap_lba, inode_bitmap, sb.inode_bitmap_sects);
+    image_write(sb.part_lba_base + 1, &sb, 1);
+  }
+  delete [] block_bitmap;
+  delete [] inode_bitmap;
+  free(journal_sectors);
+  journal_sectors = NULL;
+  journal_sector_cnt = 0;
+}
+
+// directories
+
+// same hash as dir_name_hash() in fs/dir.c
+Bit32u dir_name_hash(const char *name)
+{
+  Bit32u hash = 0;
+  for (int idx = 0; (idx < FS_NAME_LEN) && name[idx]; idx++) {
+    hash = hash * 31 + (Bit8u)name[idx];
+  }
+  return hash % FS_DIR_BUCKETS;
+}
+
+Bit32u dir_index_get(Bit32u index_lba, Bit32u slot)
+{
+  Bit16u val;
+  read_bytes(index_lba, slot * 2, &val, 2);
+  return val;
+}
+
+void dir_index_set(Bit32u index_lba, Bit32u slot, Bit32u val)
+{
+  Bit16u v = (Bit16u)val;
+  write_bytes(index_lba, slot * 2, &v, 2);
+}
+
+// address of block block_idx of a directory, 0 when it has none
+Bit32u dir_block_lba(const fs_inode_t *dir, Bit32u block_idx)
+{
+  Bit32u lba;
+  if (block_idx < FS_DIRECT_BLOCKS) {
+    return dir->i_sectors[block_idx];
+  }
+  if (dir->i_sectors[FS_IND] == 0) {
+    return 0;
+  }
+  read_bytes(dir->i_sectors[FS_IND], (block_idx - FS_DIRECT_BLOCKS) * 4, &lba, 4);
+  return lba;
+}
+
+bx_bool dir_block_search(Bit32u block_lba, const char *name, fs_dir_entry_t *entry)
+{
+  Bit8u buf[FS_BLOCK_SIZE];
+  read_sectors(block_lba, buf, FS_BLOCK_SECS);
+  for (Bit32u sec = 0; sec < FS_BLOCK_SECS; sec++) {
+    fs_dir_entry_t *de = (fs_dir_entry_t*)(buf + sec * FS_SECTOR_SIZE);
+    for (Bit32u i = 0; i < FS_ENTRIES_PER_SEC; i++) {
+      if ((de[i].f_type != FT_UNKNOWN) && !strncmp(de[i].filename, name, FS_NAME_LEN)) {
+        memcpy(entry, &de[i], sizeof(fs_dir_entry_t));
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+bx_bool dir_lookup(const fs_inode_t *dir, const char *name, fs_dir_entry_t *entry)
+{
+  Bit32u index_lba = dir->i_sectors[FS_DIR_INDEX];
+  if ((index_lba != 0) && strcmp(name, ".") && strcmp(name, "..")) {
+    for (Bit32u block_idx = dir_index_get(index_lba, dir_name_hash(name)); block_idx != 0;
+         block_idx = dir_index_get(index_lba, FS_DIR_BUCKETS + block_idx)) {
+      if (dir_block_search(dir_block_lba(dir, block_idx), name, entry)) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+  Bit32u block_cnt = (index_lba != 0) ? 1 : FS_DIR_MAX_BLOCKS;
+  for (Bit32u block_idx = 0; block_idx < block_cnt; block_idx++) {
+    Bit32u block_lba = dir_block_lba(dir, block_idx);
+    if ((block_lba != 0) && dir_block_search(block_lba, name, entry)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+bx_bool dir_block_insert(Bit32u block_lba, const fs_dir_entry_t *entry)
+{
+  Bit8u buf[FS_SECTOR_SIZE];
+  for (Bit32u sec = 0; sec < FS_BLOCK_SECS; sec++) {
+    fs_dir_entry_t *de = (fs_dir_entry_t*)buf;
+    read_sectors(block_lba + sec, buf, 1);
+    for (Bit32u i = 0; i < FS_ENTRIES_PER_SEC; i++) {
+      if (de[i].f_type == FT_UNKNOWN) {
+        memcpy(&de[i], entry, sizeof(fs_dir_entry_t));
+        image_write(block_lba + sec, buf, 1);
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+// give a directory block block_idx holding only entry
+void dir_block_new(fs_inode_t *dir, Bit32u block_idx, const fs_dir_entry_t *entry)
+{
+  Bit8u buf[FS_SECTOR_SIZE];
+  Bit32u block_lba;
+  if ((block_idx >= FS_DIRECT_BLOCKS) && (dir->i_sectors[FS_IND] == 0)) {
+    dir->i_sectors[FS_IND] = block_alloc();
+    zero_sectors(dir->i_sectors[FS_IND], FS_BLOCK_SECS);
+  }
+  block_lba = block_alloc();
+  if (block_idx < FS_DIRECT_BLOCKS) {
+    dir->i_sectors[block_idx] = block_lba;
+  } else {
+    write_bytes(dir->i_sectors[FS_IND], (block_idx - FS_DIRECT_BLOCKS) * 4, &block_lba, 4);
+  }
+  zero_sectors(block_lba, FS_BLOCK_SECS);
+  memset(buf, 0, sizeof(buf));
+  memcpy(buf, entry, sizeof(fs_dir_entry_t));
+  image_write(block_lba, buf, 1);
+}
+
+// add entry to a directory like sync_dir_entry() in fs/dir.c, the caller
+// writes the directory inode. At most two blocks are allocated.
+void dir_insert(fs_inode_t *dir, const fs_dir_entry_t *entry)
+{
+  Bit32u index_lba = dir->i_sectors[FS_DIR_INDEX];
+  Bit32u block_idx;
+
+  if (index_lba != 0) {
+    Bit32u bucket = dir_name_hash(entry->filename);
+    for (block_idx = dir_index_get(index_lba, bucket); block_idx != 0;
+         block_idx = dir_index_get(index_lba, FS_DIR_BUCKETS + block_idx)) {
+      if (dir_block_insert(dir_block_lba(dir, block_idx), entry)) {
+        dir->i_size += sizeof(fs_dir_entry_t);
+        return;
+      }
+    }
+    for (block_idx = 1; (block_idx < FS_DIR_MAX_BLOCKS) && (dir_block_lba(dir, block_idx) != 0); block_idx++);
+    if (block_idx == FS_DIR_MAX_BLOCKS) {
+      fatal("ERROR: directory is full");
+    }
+    dir_block_new(dir, block_idx, entry);
+    dir_index_set(index_lba, FS_DIR_BUCKETS + block_idx, dir_index_get(index_lba, bucket));
+    dir_index_set(index_lba, bucket, block_idx);
+    dir->i_size += sizeof(fs_dir_entry_t);
+    return;
+  }
+  for (block_idx = 0; block_idx < FS_DIR_MAX_BLOCKS; block_idx++) {
+    Bit32u block_lba = dir_block_lba(dir, block_idx);
+    if (block_lba == 0) {
+      dir_block_new(dir, block_idx, entry);
+      dir->i_size += sizeof(fs_dir_entry_t);
+      return;
+    }
+    if (dir_block_insert(block_lba, entry)) {
+      dir->i_size += sizeof(fs_dir_entry_t);
+      return;
+    }
+  }
+  fatal("ERROR: directory is full");
+}
+
+void make_entry(fs_dir_entry_t *entry, const char *name, Bit32u ino, Bit32u f_type)
+{
+  memset(entry, 0, sizeof(fs_dir_entry_t));
+  memcpy(entry->filename, name, strlen(name));
+  entry->i_no = ino;
+  entry->f_type = f_type;
+}
+
+// create a hashed directory name in parent like sys_mkdir() does.
+// Returns 0 when the partition has no room for it.
+bx_bool fs_mkdir(fs_inode_t *parent, const char *name, fs_inode_t *dir)
+{
+  Bit8u buf[FS_SECTOR_SIZE];
+  fs_dir_entry_t entry;
+
+  if ((sb.free_inodes == 0) || (sb.free_blocks < 4)) {
+    return 0;
+  }
+  memset(dir, 0, sizeof(fs_inode_t));
+  dir->i_no = inode_alloc();
+  dir->i_sectors[0] = block_alloc();
+  dir->i_sectors[FS_DIR_INDEX] = block_alloc();
+  zero_sectors(dir->i_sectors[0], FS_BLOCK_SECS);
+  zero_sectors(dir->i_sectors[FS_DIR_INDEX], FS_BLOCK_SECS);
+  memset(buf, 0, sizeof(buf));
+  make_entry((fs_dir_entry_t*)buf, ".", dir->i_no, FT_DIRECTORY);
+  make_entry((fs_dir_entry_t*)buf + 1, "..", parent->i_no, FT_DIRECTORY);
+  image_write(dir->i_sectors[0], buf, 1);
+  dir->i_size = 2 * sizeof(fs_dir_entry_t);
+  inode_write(dir);
+
+  make_entry(&entry, name, dir->i_no, FT_DIRECTORY);
+  dir_insert(parent, &entry);
+  inode_write(parent);
+  return 1;
+}
+
+// files
+
+// blocks taken by a file of data_cnt data blocks, index blocks included
+Bit32u file_blocks(Bit32u data_cnt)
+{
+  Bit32u total = data_cnt;
+  if (data_cnt <= FS_DIRECT_BLOCKS) {
+    return total;
+  }
+  data_cnt -= FS_DIRECT_BLOCKS;
+  Bit32u span = FS_PTRS_PER_BLOCK;
+  while (data_cnt > 0) {
+    Bit32u cnt = (data_cnt < span) ? data_cnt : span;
+    // index blocks of a tree mapping cnt blocks, one per level and entry used
+    for (Bit32u sub = span / FS_PTRS_PER_BLOCK; sub >= 1; sub /= FS_PTRS_PER_BLOCK) {
+      total += (cnt + sub * FS_PTRS_PER_BLOCK - 1) / (sub * FS_PTRS_PER_BLOCK);
+    }
+    data_cnt -= cnt;
+    span *= FS_PTRS_PER_BLOCK;
+  }
+  return total;
+}
+
+// allocate data block block_idx of a new file in file order, the index
+// blocks on its path first, the same order the kernel's inode_bmap() takes
+Bit32u file_bmap(fs_inode_t *inode, fs_table_t **tops, Bit32u block_idx)
+{
+  if (block_idx < FS_DIRECT_BLOCKS) {
+    return inode->i_sectors[block_idx] = block_alloc();
+  }
+  block_idx -= FS_DIRECT_BLOCKS;
+  Bit32u levels = 1, span = FS_PTRS_PER_BLOCK;
+  while (block_idx >= span) {
+    block_idx -= span;
+    span *= FS_PTRS_PER_BLOCK;
+    levels++;
+  }
+  Bit32u *slot = &inode->i_sectors[FS_IND + levels - 1];
+  fs_table_t **table = &tops[levels - 1];
+  while (1) {
+    if (levels == 0) {
+      return *slot = block_alloc();
+    }
+    if (*table == NULL) {
+      *table = new fs_table_t;
+      memset(*table, 0, sizeof(fs_table_t));
+      (*table)->lba = *slot = block_alloc();
+    }
+    span /= FS_PTRS_PER_BLOCK;
+    slot = &(*table)->ptrs[block_idx / span];
+    table = &(*table)->child[block_idx / span];
+    block_idx %= span;
+    levels--;
+  }
+}
+
+void file_tables_write(fs_table_t *table)
+{
+  if (table == NULL) {
+    return;
+  }
+  image_write(table->lba, table->ptrs, FS_BLOCK_SECS);
+  for (int i = 0; i < FS_PTRS_PER_BLOCK; i++) {
+    file_tables_write(table->child[i]);
+  }
+  delete table;
+}
+
+// copy the host file path into parent as name.
+// Returns 0 when the partition has no room for it.
+bx_bool fs_copy_file(fs_inode_t *parent, const char *name, const char *path, Bit32u size)
+{
+  fs_inode_t inode;
+  fs_table_t *tops[3] = {NULL, NULL, NULL};
+  fs_dir_entry_t entry;
+  Bit8u *buf;
+  Bit32u data_cnt = (Bit32u)(((Bit64u)size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE);
+  Bit32u need = file_blocks(data_cnt);
+  Bit32u done = 0, run_lba = 0, run_cnt = 0;
+
+  // room for the file and for the directory to grow by a block and its index block
+  if ((sb.free_inodes == 0) || (sb.free_blocks < need + 2)) {
+    return 0;
+  }
+  int fd = ::open(path, O_RDONLY
+#ifdef O_BINARY
+                  | O_BINARY
+#endif
+                 );
+  if (fd < 0) {
+    printf("%s: cannot open, skipped\n", path);
+    skipped++;
+    return 1;
+  }
+  memset(&inode, 0, sizeof(inode));
+  inode.i_no = inode_alloc();
+  if (need > 0) {
+    // files follow each other in copy order, the partition start is
+    // searched again only when the end has no room
+    Bit32s start = find_free_run(alloc_goal, need);
+    if (start < 0) {
+      start = find_free_run(0, need);
+    }
+    if (start >= 0) {
+      alloc_goal = start;
+    }
+  }
+  buf = new Bit8u[COPY_RUN_BLOCKS * FS_BLOCK_SIZE];
+  for (Bit32u block_idx = 0; block_idx < data_cnt; block_idx++) {
+    Bit32u lba = file_bmap(&inode, tops, block_idx);
+    if ((run_cnt > 0) && ((lba != run_lba + run_cnt * FS_BLOCK_SECS) || (run_cnt == COPY_RUN_BLOCKS))) {
+      image_write(run_lba, buf, run_cnt * FS_BLOCK_SECS);
+      run_cnt = 0;
+    }
+    if (run_cnt == 0) {
+      run_lba = lba;
+    }
+    Bit8u *block = buf + run_cnt * FS_BLOCK_SIZE;
+    Bit32u len = (size - done < FS_BLOCK_SIZE) ? size - done : FS_BLOCK_SIZE;
+    memset(block, 0, FS_BLOCK_SIZE);
+    if (::read(fd, block, len) != (ssize_t)len) {
+      // the blocks are allocated already, keep the size and warn
+      printf("%s: read failed, file truncated with zeros\n", path);
+    }
+    done += len;
+    run_cnt++;
+  }
+  if (run_cnt > 0) {
+    image_write(run_lba, buf, run_cnt * FS_BLOCK_SECS);
+  }
+  delete [] buf;
+  ::close(fd);
+  for (int i = 0; i < 3; i++) {
+    file_tables_write(tops[i]);
+  }
+  inode.i_size = size;
+  inode_write(&inode);
+
+  make_entry(&entry, name, inode.i_no, FT_REGULAR);
+  dir_insert(parent, &entry);
+  inode_write(parent);
+  copied_files++;
+  copied_bytes += size;
+  return 1;
+}
+
+// host directories
+
+int compare_names(const void *a, const void *b)
+{
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// sorted names in a host directory, so that images come out the same
+// every time. Returns the number of names, -1 on error.
+int list_host_dir(const char *path, char ***names)
+{
+  int cnt = 0;
+  *names = NULL;
+#ifndef WIN32
+  DIR *d = opendir(path);
+  struct dirent *entry;
+  if (d == NULL) {
+    return -1;
+  }
+  while ((entry = readdir(d)) != NULL) {
+    if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+      continue;
+    }
+    *names = (char**)realloc(*names, (cnt + 1) * sizeof(char*));
+    (*names)[cnt++] = strdup(entry->d_name);
+  }
+  closedir(d);
+#else
+  char pattern[HOST_PATH_LEN];
+  WIN32_FIND_DATA finddata;
+  snprintf(pattern, sizeof(pattern), "%s\\*", path);
+  HANDLE hFind = FindFirstFile(pattern, &finddata);
+  if (hFind == INVALID_HANDLE_VALUE) {
+    return -1;
+  }
+  do {
+    if (!strcmp(finddata.cFileName, ".") || !strcmp(finddata.cFileName, "..")) {
+      continue;
+    }
+    *names = (char**)realloc(*names, (cnt + 1) * sizeof(char*));
+    (*names)[cnt++] = strdup(finddata.cFileName);
+  } while (FindNextFile(hFind, &finddata));
+  FindClose(hFind);
+#endif
+  if (cnt > 0) {
+    qsort(*names, cnt, sizeof(char*), compare_names);
+  }
+  return cnt;
+}
+
+// copy the contents of host directory path into dir. Existing
+// directories are merged, existing files are left alone.
+// Returns 0 when the partition ran out of room.
+bx_bool fs_copy_tree(fs_inode_t *dir, const char *path)
+{
+  char **names;
+  char child[HOST_PATH_LEN];
+  struct stat st;
+  bx_bool ret = 1;
+  int cnt = list_host_dir(path, &names);
+
+  if (cnt < 0) {
+    printf("%s: cannot read directory, skipped\n", path);
+    skipped++;
+    return 1;
+  }
+  for (int i = 0; i < cnt; i++) {
+    fs_dir_entry_t entry;
+    fs_inode_t sub;
+    if (!ret) {
+      free(names[i]);
+      continue;
+    }
+    snprintf(child, sizeof(child), "%s/%s", path, names[i]);
+    if ((stat(child, &st) < 0) || (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode))) {
+      printf("%s: not a regular file or directory, skipped\n", child);
+      skipped++;
+    } else if (strlen(names[i]) >= FS_NAME_LEN) {
+      printf("%s: name longer than %d characters, skipped\n", child, FS_NAME_LEN - 1);
+      skipped++;
+    } else if (S_ISDIR(st.st_mode)) {
+      if (dir_lookup(dir, names[i], &entry)) {
+        if (entry.f_type != FT_DIRECTORY) {
+          printf("%s: exists in the image as a file, skipped\n", child);
+          skipped++;
+          free(names[i]);
+          continue;
+        }
+        inode_read(entry.i_no, &sub);
+      } else if (fs_mkdir(dir, names[i], &sub)) {
+        copied_dirs++;
+      } else {
+        printf("%s: no room left in the partition\n", child);
+        ret = 0;
+      }
+      if (ret) {
+        ret = fs_copy_tree(&sub, child);
+      }
+    } else if (dir_lookup(dir, names[i], &entry)) {
+      printf("%s: exists in the image, skipped\n", child);
+      skipped++;
+    } else if ((Bit64u)st.st_size > 0xffffffff) {
+      printf("%s: larger than 4GB, skipped\n", child);
+      skipped++;
+    } else if (!fs_copy_file(dir, names[i], child, (Bit32u)st.st_size)) {
+      printf("%s: no room left in the partition\n", child);
+      ret = 0;
+    }
+    free(names[i]);
+  }
+  free(names);
+  return ret;
+}
+
+// look up the image path dest, creating missing directories
+void fs_open_dest(const char *dest, fs_inode_t *dir)
+{
+  char name[FS_NAME_LEN + 1];
+  inode_read(sb.root_inode_no, dir);
+  while (*dest) {
+    fs_dir_entry_t entry;
+    const char *end;
+    while (*dest == '/') dest++;
+    if (*dest == 0) break;
+    end = strchr(dest, '/');
+    if (end == NULL) end = dest + strlen(dest);
+    if (end - dest >= FS_NAME_LEN) {
+      fatal("ERROR: destination name too long");
+    }
+    memcpy(name, dest, end - dest);
+    name[end - dest] = 0;
+    if (dir_lookup(dir, name, &entry)) {
+      if (entry.f_type != FT_DIRECTORY) {
+        fatal("ERROR: destination is not a directory");
+      }
+      inode_read(entry.i_no, dir);
+    } else {
+      fs_inode_t sub;
+      if (!fs_mkdir(dir, name, &sub)) {
+        fatal("ERROR: partition full");
+      }
+      copied_dirs++;
+      memcpy(dir, &sub, sizeof(fs_inode_t));
+    }
+    dest = end;
+  }
+}
+
+// offline check, the checks of sys_fsck() in fs/fsck.c plus the hash chains
+
+typedef struct {
+  Bit8u *blocks_used;
+  Bit8u *inodes_seen;
+  Bit32u *stack;
+  Bit32u depth;
+  Bit32u errors, dirs, files, blocks;
+} fsck_state_t;
+
+void fsck_error(fsck_state_t *st, const char *msg, Bit32u no)
+{
+  if (st->errors++ < FSCK_PRINT_MAX) {
+    printf("fsck: %s %d\n", msg, no);
+  }
+}
+
+bx_bool fsck_mark_block(fsck_state_t *st, Bit32u block_lba)
+{
+  if ((block_lba < sb.data_start_lba) || ((block_lba - sb.data_start_lba) % FS_BLOCK_SECS != 0) ||
+      (block_index(block_lba) >= data_blocks)) {
+    fsck_error(st, "bad block address", block_lba);
+    return 0;
+  }
+  Bit32u idx = block_index(block_lba);
+  if (bit_test(st->blocks_used, idx)) {
+    fsck_error(st, "block referenced twice", block_lba);
+    return 0;
+  }
+  bit_set(st->blocks_used, idx, 1);
+  st->blocks++;
+  if (!bit_test(block_bitmap, idx)) {
+    fsck_error(st, "block in use but free in bitmap", block_lba);
+  }
+  return 1;
+}
+
+Bit32u fsck_block_tree(fsck_state_t *st, Bit32u block_lba, Bit32u levels)
+{
+  Bit32u table[FS_PTRS_PER_BLOCK], data_cnt = 0;
+  if (!fsck_mark_block(st, block_lba)) {
+    return 0;
+  }
+  if (levels == 0) {
+    return 1;
+  }
+  read_sectors(block_lba, table, FS_BLOCK_SECS);
+  for (int i = 0; i < FS_PTRS_PER_BLOCK; i++) {
+    if (table[i] != 0) {
+      data_cnt += fsck_block_tree(st, table[i], levels - 1);
+    }
+  }
+  return data_cnt;
+}
+
+void fsck_inode(fsck_state_t *st, const fs_inode_t *inode, bx_bool is_dir)
+{
+  Bit32u data_cnt = 0;
+  for (int i = 0; i < FS_DIRECT_BLOCKS; i++) {
+    if ((inode->i_sectors[i] != 0) && fsck_mark_block(st, inode->i_sectors[i])) {
+      data_cnt++;
+    }
+  }
+  for (int i = FS_IND; i <= FS_TIND; i++) {
+    if (inode->i_sectors[i] == 0) {
+      continue;
+    }
+    if (is_dir && (i == FS_DIR_INDEX)) {
+      fsck_mark_block(st, inode->i_sectors[i]);
+    } else {
+      data_cnt += fsck_block_tree(st, inode->i_sectors[i], i - FS_IND + 1);
+    }
+  }
+  if (!is_dir && (data_cnt != (Bit32u)(((Bit64u)inode->i_size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE))) {
+    fsck_error(st, "file blocks do not match i_size, inode", inode->i_no);
+  }
+}
+
+// every block of a hashed directory but block 0 is on one bucket chain,
+// chain[] gets the bucket of each block or -1
+void fsck_hash_chains(fsck_state_t *st, const fs_inode_t *dir, Bit32s *chain)
+{
+  Bit32u index_lba = dir->i_sectors[FS_DIR_INDEX];
+  for (Bit32u b = 0; b < FS_DIR_MAX_BLOCKS; b++) {
+    chain[b] = -1;
+  }
+  for (Bit32u bucket = 0; bucket < FS_DIR_BUCKETS; bucket++) {
+    for (Bit32u b = dir_index_get(index_lba, bucket); b != 0; b = dir_index_get(index_lba, FS_DIR_BUCKETS + b)) {
+      if ((b >= FS_DIR_MAX_BLOCKS) || (dir_block_lba(dir, b) == 0)) {
+        fsck_error(st, "hash chain points to a missing block, directory", dir->i_no);
+        break;
+      }
+      if (chain[b] != -1) {
+        fsck_error(st, "block on two hash chains or a loop, directory", dir->i_no);
+        break;
+      }
+      chain[b] = bucket;
+    }
+  }
+}
+
+void fsck_dir(fsck_state_t *st, Bit32u ino, Bit32u parent_ino)
+{
+  fs_inode_t dir;
+  Bit8u buf[FS_BLOCK_SIZE];
+  Bit32s chain[FS_DIR_MAX_BLOCKS];
+  Bit32u entry_cnt = 0;
+
+  inode_read(ino, &dir);
+  bx_bool hashed = (dir.i_sectors[FS_DIR_INDEX] != 0);
+  if (hashed) {
+    fsck_hash_chains(st, &dir, chain);
+  }
+  for (Bit32u b = 0; b < FS_DIR_MAX_BLOCKS; b++) {
+    Bit32u block_lba = dir_block_lba(&dir, b);
+    if ((block_lba == 0) || (block_lba < sb.data_start_lba) || (block_index(block_lba) >= data_blocks)) {
+      continue;
+    }
+    read_sectors(block_lba, buf, FS_BLOCK_SECS);
+    for (Bit32u sec = 0; sec < FS_BLOCK_SECS; sec++) {
+      fs_dir_entry_t *de = (fs_dir_entry_t*)(buf + sec * FS_SECTOR_SIZE);
+      for (Bit32u i = 0; i < FS_ENTRIES_PER_SEC; i++) {
+        fs_dir_entry_t entry;
+        fs_inode_t inode;
+        if (de[i].f_type == FT_UNKNOWN) {
+          continue;
+        }
+        memcpy(&entry, &de[i], sizeof(entry));
+        entry_cnt++;
+        if (!strncmp(entry.filename, ".", FS_NAME_LEN) || !strncmp(entry.filename, "..", FS_NAME_LEN)) {
+          if (entry.i_no != ((entry.filename[1] == '.') ? parent_ino : ino)) {
+            fsck_error(st, "bad . or .. in directory", ino);
+          }
+          continue;
+        }
+        if (hashed && ((Bit32u)chain[b] != dir_name_hash(entry.filename))) {
+          fsck_error(st, "entry not on its hash chain, inode", entry.i_no);
+        }
+        if (entry.i_no >= sb.inode_cnt) {
+          fsck_error(st, "bad inode number in directory", ino);
+          continue;
+        }
+        if (bit_test(st->inodes_seen, entry.i_no)) {
+          fsck_error(st, "inode referenced twice", entry.i_no);
+          continue;
+        }
+        bit_set(st->inodes_seen, entry.i_no, 1);
+        if (!bit_test(inode_bitmap, entry.i_no)) {
+          fsck_error(st, "inode in use but free in bitmap", entry.i_no);
+        }
+        inode_read(entry.i_no, &inode);
+        if (inode.i_no != entry.i_no) {
+          fsck_error(st, "inode number does not match its slot, inode", entry.i_no);
+        }
+        fsck_inode(st, &inode, entry.f_type == FT_DIRECTORY);
+        if (entry.f_type == FT_DIRECTORY) {
+          st->dirs++;
+          st->stack[st->depth++] = entry.i_no;
+          st->stack[st->depth++] = ino;
+        } else {
+          st->files++;
+        }
+      }
+    }
+  }
+  if (dir.i_size != entry_cnt * sizeof(fs_dir_entry_t)) {
+    fsck_error(st, "directory i_size does not match entries, inode", ino);
+  }
+}
+
+Bit32u fs_check(void)
+{
+  fsck_state_t st;
+  fs_inode_t root;
+  Bit32u idx, recorded_blocks, recorded_inodes;
+
+  memset(&st, 0, sizeof(st));
+  st.blocks_used = new Bit8u[sb.block_bitmap_sects * FS_SECTOR_SIZE];
+  memset(st.blocks_used, 0, sb.block_bitmap_sects * FS_SECTOR_SIZE);
+  st.inodes_seen = new Bit8u[sb.inode_bitmap_sects * FS_SECTOR_SIZE];
+  memset(st.inodes_seen, 0, sb.inode_bitmap_sects * FS_SECTOR_SIZE);
+  st.stack = new Bit32u[sb.inode_cnt * 2];
+
+  bit_set(st.inodes_seen, sb.root_inode_no, 1);
+  if (!bit_test(inode_bitmap, sb.root_inode_no)) {
+    fsck_error(&st, "inode in use but free in bitmap", sb.root_inode_no);
+  }
+  inode_read(sb.root_inode_no, &root);
+  fsck_inode(&st, &root, 1);
+  st.dirs = 1;
+  st.stack[st.depth++] = sb.root_inode_no;
+  st.stack[st.depth++] = sb.root_inode_no;
+  while (st.depth > 0) {
+    Bit32u parent_ino = st.stack[--st.depth];
+    Bit32u ino = st.stack[--st.depth];
+    fsck_dir(&st, ino, parent_ino);
+  }
+
+  for (idx = 0; idx < sb.inode_cnt; idx++) {
+    if (bit_test(inode_bitmap, idx) && !bit_test(st.inodes_seen, idx)) {
+      fsck_error(&st, "inode allocated but unreachable", idx);
+    }
+  }
+  for (idx = 0; idx < data_blocks; idx++) {
+    if (bit_test(block_bitmap, idx) && !bit_test(st.blocks_used, idx)) {
+      fsck_error(&st, "block allocated but unreferenced", sb.data_start_lba + idx * FS_BLOCK_SECS);
+    }
+  }
+
+  // the kernel recounts these when mounting, a stale count is only reported
+  fs_super_block_t disk_sb;
+  read_sectors(sb.part_lba_base + 1, &disk_sb, 1);
+  recorded_blocks = disk_sb.free_blocks;
+  recorded_inodes = disk_sb.free_inodes;
+  if ((recorded_blocks != sb.free_blocks) || (recorded_inodes != sb.free_inodes)) {
+    printf("fsck: super block free counts %d/%d, bitmaps %d/%d (recounted on mount)\n",
+           recorded_blocks, recorded_inodes, sb.free_blocks, sb.free_inodes);
+  }
+
+  printf("fsck: %d dirs, %d files, %d blocks, %d errors\n", st.dirs, st.files, st.blocks, st.errors);
+  delete [] st.blocks_used;
+  delete [] st.inodes_seen;
+  delete [] st.stack;
+  return st.errors;
+}
+
+void print_partition_info(int part_no, const partition_t *part)
+{
+  fs_super_block_t psb;
+  printf("partition %d: start_lba %d, %d sectors", part_no, part->start_lba, part->sec_cnt);
+  image_read(part->start_lba + 1, &psb, 1);
+  if ((psb.magic == FS_MAGIC) && (psb.block_size == FS_BLOCK_SIZE)) {
+    printf(", file system with %d inodes, data at lba %d\n", psb.inode_cnt, psb.data_start_lba);
+  } else {
+    printf(", no file system\n");
+  }
+}
+
+void print_usage()
+{
+  fprintf(stderr,
+    "Usage: bxfsimage [options] image [hostdir]\n\n"
+    "Supported options:\n"
+    "  -mode=...     operation mode (info, format, copy, fsck)\n"
+    "  -part=...     partition number as the guest kernel counts them,\n"
+    "                1-4 primary, 5-12 logical (default 1)\n"
+    "  -inodes=...   format: number of inodes (default and maximum %d)\n"
+    "  -dest=...     format/copy: directory in the image that receives the\n"
+    "                host tree, created when missing (default /)\n"
+    "  -mbr          format: write a new partition table with a single\n"
+    "                primary partition covering the image\n"
+    "  --help        display this help and exit\n\n"
+    "Other arguments:\n"
+    "  image         flat hard disk image\n"
+    "  hostdir       format/copy: host directory tree to copy into the partition\n\n",
+    FS_MAX_INODES);
+}
+
+int parse_cmdline(int argc, char *argv[])
+{
+  int arg = 1;
+  int fnargs = 0;
+
+  bxfsimage_mode = BXFSIMAGE_MODE_NULL;
+  bx_part_no = 1;
+  bx_inode_cnt = FS_MAX_INODES;
+  bx_new_mbr = 0;
+  bx_image_name[0] = 0;
+  bx_host_dir[0] = 0;
+  strcpy(bx_dest_dir, "/");
+  while (arg < argc) {
+    if (!strcmp("--help", argv[arg]) || !strncmp("/?", argv[arg], 2)) {
+      print_usage();
+      return 0;
+    } else if (!strncmp("-mode=", argv[arg], 6)) {
+      if (!strcmp(&argv[arg][6], "info")) {
+        bxfsimage_mode = BXFSIMAGE_MODE_INFO;
+      } else if (!strcmp(&argv[arg][6], "format")) {
+        bxfsimage_mode = BXFSIMAGE_MODE_FORMAT;
+      } else if (!strcmp(&argv[arg][6], "copy")) {
+        bxfsimage_mode = BXFSIMAGE_MODE_COPY;
+      } else if (!strcmp(&argv[arg][6], "fsck")) {
+        bxfsimage_mode = BXFSIMAGE_MODE_FSCK;
+      } else {
+        printf("Unknown bxfsimage mode '%s'\n\n", &argv[arg][6]);
+        return 0;
+      }
+    } else if (!strncmp("-part=", argv[arg], 6)) {
+      bx_part_no = atoi(&argv[arg][6]);
+    } else if (!strncmp("-inodes=", argv[arg], 8)) {
+      bx_inode_cnt = atoi(&argv[arg][8]);
+      if ((bx_inode_cnt < 1) || (bx_inode_cnt > FS_MAX_INODES)) {
+        printf("Inode count must be between 1 and %d\n\n", FS_MAX_INODES);
+        return 0;
+      }
+    } else if (!strncmp("-dest=", argv[arg], 6)) {
+      strncpy(bx_dest_dir, &argv[arg][6], sizeof(bx_dest_dir) - 1);
+      bx_dest_dir[sizeof(bx_dest_dir) - 1] = 0;
+    } else if (!strcmp("-mbr", argv[arg])) {
+      bx_new_mbr = 1;
+    } else if (argv[arg][0] == '-') {
+      printf("Unknown option: %s\n\n", argv[arg]);
+      return 0;
+    } else if (fnargs == 0) {
+      strncpy(bx_image_name, argv[arg], sizeof(bx_image_name) - 1);
+      fnargs++;
+    } else if (fnargs == 1) {
+      strncpy(bx_host_dir, argv[arg], sizeof(bx_host_dir) - 1);
+      fnargs++;
+    } else {
+      printf("Ignoring extra parameter: %s\n\n", argv[arg]);
+    }
+    arg++;
+  }
+  if ((bxfsimage_mode == BXFSIMAGE_MODE_NULL) || (bx_image_name[0] == 0)) {
+    print_usage();
+    return 0;
+  }
+  if ((bxfsimage_mode == BXFSIMAGE_MODE_COPY) && (bx_host_dir[0] == 0)) {
+    printf("Copy mode needs a host directory\n\n");
+    return 0;
+  }
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  partition_t *part;
+  int ret = 0;
+
+#ifdef BX_BIG_ENDIAN
+  fatal("bxfsimage: big endian hosts are not supported");
+#endif
+  if (!parse_cmdline(argc, argv))
+    exit(1);
+
+  bx_bool writable = (bxfsimage_mode == BXFSIMAGE_MODE_FORMAT) || (bxfsimage_mode == BXFSIMAGE_MODE_COPY);
+  image_fd = ::open(bx_image_name, (writable ? O_RDWR : O_RDONLY)
+#ifdef O_BINARY
+                    | O_BINARY
+#endif
+                   );
+  if (image_fd < 0) {
+    fatal("ERROR: cannot open image");
+  }
+  if ((bxfsimage_mode == BXFSIMAGE_MODE_FORMAT) && bx_new_mbr) {
+    write_mbr();
+  }
+  scan_partitions(0, 0);
+
+  if (bxfsimage_mode == BXFSIMAGE_MODE_INFO) {
+    for (int i = 0; i < primary_cnt; i++) {
+      print_partition_info(i + 1, &primary_parts[i]);
+    }
+    for (int i = 0; i < logical_cnt; i++) {
+      print_partition_info(i + 5, &logical_parts[i]);
+    }
+    if (primary_cnt + logical_cnt == 0) {
+      printf("no partitions\n");
+    }
+    ::close(image_fd);
+    return 0;
+  }
+
+  part = find_partition(bx_part_no);
+  if (part == NULL) {
+    fatal("ERROR: no such partition");
+  }
+  if (bxfsimage_mode == BXFSIMAGE_MODE_FORMAT) {
+    fs_format(part, bx_inode_cnt);
+    printf("partition %d formatted, %d inodes, data at lba %d\n", bx_part_no, sb.inode_cnt, sb.data_start_lba);
+  }
+  if (bxfsimage_mode == BXFSIMAGE_MODE_FSCK) {
+    fs_open(part, 0);
+    ret = (fs_check() > 0) ? 1 : 0;
+    fs_close(0);
+  } else if (bx_host_dir[0] != 0) {
+    fs_inode_t dest;
+    fs_open(part, 1);
+    fs_open_dest(bx_dest_dir, &dest);
+    if (!fs_copy_tree(&dest, bx_host_dir)) {
+      ret = 1;
+    }
+    fs_close(1);
+    printf("copied %d files (%d KB), %d directories, %d skipped, %d blocks free\n", copied_files,
+           (Bit32u)(copied_bytes / 1024), copied_dirs, skipped, sb.free_blocks);
+  }
+  ::close(image_fd);
+  return ret;
+}
@@ -76,6 +76,7 @@
 #include "iodev/hdimage/vmware3.h"
 #include "iodev/hdimage/vmware4.h"
 #include "iodev/hdimage/vpc-img.h"
+#include "iodev/hdimage/compressed.h"
 
 #define BXIMAGE_MODE_NULL            0
 #define BXIMAGE_MODE_CREATE_IMAGE    1
@@ -86,6 +87,8 @@
 
 #define BX_MAX_CYL_BITS 24 // 8 TB
 
+#define BXIMAGE_CONVERT_CHUNK 0x100000
+
 const int bx_max_hd_megs = (int)(((1 << BX_MAX_CYL_BITS) - 1) * 16.0 * 63.0 / 2048.0);
 
 const char *hdimage_mode_names[] = {
@@ -101,6 +104,9 @@ const char *hdimage_mode_names[] = {
   "volatile",
   "vvfat",
   "vpc",
+  "vbox",
+  "cow",
+  "compressed",
   NULL
 };
 
@@ -111,6 +117,7 @@ int  bx_min_hd_megs = 10;
 int  bx_hdsize;
 int  bx_imagemode;
 int  bx_backup;
+int  bx_prealloc;
 int  bx_interactive;
 int  bx_sectsize_idx;
 unsigned bx_sectsize_val;
@@ -144,12 +151,12 @@ const unsigned fdsize_sectors[] = { 320, 360, 640, 720, 1440, 2400, 2880, 3360,
 int fdsize_n_choices = 10;
 
 // menu data for choosing disk mode
-const char *hdmode_menu = "\nWhat kind of image should I create?\nPlease type flat, sparse, growing, vpc or vmware4. ";
-const char *hdmode_choices[] = {"flat", "sparse", "growing", "vpc", "vmware4" };
+const char *hdmode_menu = "\nWhat kind of image should I create?\nPlease type flat, sparse, growing, vpc, vmware4 or compressed. ";
+const char *hdmode_choices[] = {"flat", "sparse", "growing", "vpc", "vmware4", "compressed" };
 const int hdmode_choice_id[] = {BX_HDIMAGE_MODE_FLAT, BX_HDIMAGE_MODE_SPARSE,
                                 BX_HDIMAGE_MODE_GROWING, BX_HDIMAGE_MODE_VPC,
-                                BX_HDIMAGE_MODE_VMWARE4};
-int hdmode_n_choices = 5;
+                                BX_HDIMAGE_MODE_VMWARE4, BX_HDIMAGE_MODE_COMPRESSED};
+int hdmode_n_choices = 6;
 
 // menu data for choosing hard disk sector size
 const char *sectsize_menu = "\nChoose the size of hard disk sectors.\nPlease type 512, 1024 or 4096. ";
@@ -397,6 +404,10 @@ device_image_t* init_image(Bit8u image_mode)
       hdimage = new vpc_image_t();
       break;
 
+    case BX_HDIMAGE_MODE_COMPRESSED:
+      hdimage = new compressed_image_t();
+      break;
+
     default:
       fatal("unsupported disk image mode");
       break;
@@ -418,11 +429,39 @@ int create_image_file(const char *filename)
   return fd;
 }
 
+// Without -prealloc the image is a sparse file: the size is set with
+// ftruncate() and the host filesystem allocates blocks on first write.
 void create_flat_image(const char *filename, Bit64u size)
 {
   char buffer[512];
 
   int fd = create_image_file(filename);
+  if (bx_prealloc) {
+#if BX_HAVE_POSIX_FALLOCATE
+    if (posix_fallocate(fd, 0, (off_t)size) == 0) {
+      close(fd);
+      return;
+    }
+    // not supported by the filesystem, fill the image with zeros
+#endif
+    char zero_buf[0x10000];
+    Bit64u offset;
+
+    memset(zero_buf, 0, sizeof(zero_buf));
+    for (offset = 0; offset < size; offset += sizeof(zero_buf)) {
+      size_t len = (size - offset < sizeof(zero_buf)) ? (size_t)(size - offset) : sizeof(zero_buf);
+      if (bx_write_image(fd, offset, zero_buf, (int)len) != (int)len)
+        fatal("ERROR: while writing block in flat file !");
+    }
+    close(fd);
+    return;
+  }
+#if BX_HAVE_FTRUNCATE
+  if (ftruncate(fd, (off_t)size) == 0) {
+    close(fd);
+    return;
+  }
+#endif
   memset(buffer, 0, 512);
   if (bx_write_image(fd, size - 512, buffer, 512) != 512)
     fatal("ERROR: while writing block in flat file !");
@@ -755,6 +794,12 @@ void create_hard_disk_image(const char *filename, int imgmode, Bit64u size)
       create_vmware4_image(filename, size);
       break;
 
+    case BX_HDIMAGE_MODE_COMPRESSED:
+      // an empty disk: every block is a zero block
+      if (compressed_image_t::create(filename, NULL, size) < 0)
+        fatal("ERROR: The disk image is not complete");
+      break;
+
     default:
       fatal("image mode not implemented yet");
   }
@@ -764,8 +809,11 @@ void convert_image(int newimgmode, Bit64u newsize)
 {
   device_image_t *source_image, *dest_image;
   int mode = -1;
-  Bit64u i, sc, s;
-  char buffer[512], null_sector[512];
+  static char buffer[BXIMAGE_CONVERT_CHUNK];
+  char null_sector[512];
+  Bit64u offset;
+  size_t len, i, end;
+  int percent, last_percent = 0;
   bx_bool error = 0;
 
   printf("\n");
@@ -797,6 +845,22 @@ void convert_image(int newimgmode, Bit64u newsize)
   if (source_image->open(bx_filename_1, O_RDONLY) < 0)
     fatal("cannot open source disk image");
 
+  if (newimgmode == BX_HDIMAGE_MODE_COMPRESSED) {
+    // compressed images are read-only, they are written in one pass
+    if (newsize > 0)
+      fatal("compressed images can't be resized");
+    printf("\nCompressing image file ...");
+    fflush(stdout);
+    error = (compressed_image_t::create(bx_filename_2, source_image, source_image->hd_size) < 0);
+    source_image->close();
+    delete source_image;
+    if (error) {
+      fatal("image conversion failed");
+    } else {
+      printf(" Done.\n");
+    }
+    return;
+  }
   if (newsize > 0) {
     create_hard_disk_image(bx_filename_2, newimgmode, newsize);
   } else {
@@ -808,27 +872,44 @@ void convert_image(int newimgmode, Bit64u newsize)
 
   printf("\nConverting image file: [  0%%]");
 
-  sc = source_image->hd_size / 512;
-  s = 0;
-  for (i = 0; i < source_image->hd_size; i+=512) {
-    printf("\x8\x8\x8\x8\x8%3d%%]", (int)((s+1)*100/sc));
-    fflush(stdout);
-    if (source_image->lseek(i, SEEK_SET) < 0) {
+  // Stream the source in large chunks. Zero sectors are skipped, so the
+  // destination stays sparse, and each run of data sectors is written with
+  // a single call.
+  for (offset = 0; offset < source_image->hd_size; offset += len) {
+    len = BXIMAGE_CONVERT_CHUNK;
+    if ((source_image->hd_size - offset) < len)
+      len = (size_t)(source_image->hd_size - offset);
+    if (source_image->lseek(offset, SEEK_SET) < 0) {
       error = 1;
       break;
     }
-    if ((source_image->read(buffer, 512) == 512) &&
-        (memcmp(buffer, null_sector, 512) != 0)) {
-      if (dest_image->lseek(i, SEEK_SET) < 0) {
-        error = 1;
-        break;
+    if (source_image->read(buffer, len) != (ssize_t)len) {
+      // retry sector by sector, unreadable sectors are treated as zero
+      for (i = 0; i < len; i += 512) {
+        if ((source_image->lseek(offset + i, SEEK_SET) < 0) ||
+            (source_image->read(buffer + i, 512) != 512))
+          memset(buffer + i, 0, 512);
       }
-      if (dest_image->write(buffer, 512) < 0) {
+    }
+    for (i = 0; i < len; i = end) {
+      end = i + 512;
+      if (memcmp(buffer + i, null_sector, 512) == 0)
+        continue;
+      while ((end < len) && (memcmp(buffer + end, null_sector, 512) != 0))
+        end += 512;
+      if ((dest_image->lseek(offset + i, SEEK_SET) < 0) ||
+          (dest_image->write(buffer + i, end - i) < 0)) {
         error = 1;
         break;
       }
     }
-    s++;
+    if (error) break;
+    percent = (int)((offset + len) * 100 / source_image->hd_size);
+    if (percent != last_percent) {
+      printf("\x8\x8\x8\x8\x8%3d%%]", percent);
+      fflush(stdout);
+      last_percent = percent;
+    }
   }
 
   source_image->close();
@@ -892,6 +973,8 @@ void print_usage()
     "                or gigabytes (G)\n"
     "  -imgmode=...  create/convert: hard disk image mode\n"
     "  -sectsize=... create: hard disk sector size\n"
+    "  -prealloc     create/convert: allocate the whole flat image on the host\n"
+    "                instead of creating a sparse file\n"
     "  -b            convert/resize: create a backup of the source image\n"
     "                commit: create backups of the base image and redolog file\n"
     "  -q            quiet mode (don't prompt for user input)\n"
@@ -952,6 +1035,7 @@ int parse_cmdline(int argc, char *argv[])
   bx_hdsize = 0;
   bx_imagemode = -1;
   bx_backup = 0;
+  bx_prealloc = 0;
   bx_interactive = 1;
   bx_sectsize_idx = 0;
   bx_sectsize_val = 512;
@@ -1027,6 +1111,9 @@ int parse_cmdline(int argc, char *argv[])
     else if (!strcmp("-b", argv[arg])) {
       bx_backup = 1;
     }
+    else if (!strcmp("-prealloc", argv[arg])) {
+      bx_prealloc = 1;
+    }
     else if (!strcmp("-q", argv[arg])) {
       bx_interactive = 0;
     }
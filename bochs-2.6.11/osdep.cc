@@ -31,6 +31,9 @@
 
 #include "bochs.h"
 #include "bxthread.h"
+#if BX_HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 //////////////////////////////////////////////////////////////////////
 // Missing library functions.  These should work on any platform
@@ -369,4 +372,73 @@ Bit64u bx_get_realtime64_usec(void)
   return mytime;
 }
 #endif
+
+Bit64u bx_get_realtime64_nsec(void)
+{
+#if defined(CLOCK_MONOTONIC)
+  struct timespec thetime;
+  clock_gettime(CLOCK_MONOTONIC, &thetime);
+  return (Bit64u)thetime.tv_sec*BX_CONST64(1000000000)+(Bit64u)thetime.tv_nsec;
+#else
+  return bx_get_realtime64_usec()*1000;
+#endif
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// Zero filled memory for large tables and device memory. Anonymous
+// mappings are only backed by host pages when they are touched, so the
+// cost doesn't depend on the size. The block size is kept in a header
+// page in front of the returned pointer.
+//////////////////////////////////////////////////////////////////////
+
+#define BX_ZALLOC_HEADER 4096
+
+void *bx_alloc_zeroed(size_t len)
+{
+  Bit8u *block = NULL;
+
+#if BX_HAVE_SYS_MMAN_H && defined(MAP_ANONYMOUS)
+  void *map = mmap(NULL, len + BX_ZALLOC_HEADER, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map != MAP_FAILED) {
+    block = (Bit8u *) map;
+    ((size_t *) block)[1] = 1;
+  }
 #endif
+  if (block == NULL) {
+    block = (Bit8u *) calloc(1, len + BX_ZALLOC_HEADER);
+    if (block == NULL) return NULL;
+  }
+  ((size_t *) block)[0] = len;
+  return block + BX_ZALLOC_HEADER;
+}
+
+void bx_free_zeroed(void *ptr)
+{
+  if (ptr == NULL) return;
+  size_t *header = (size_t *)((Bit8u *) ptr - BX_ZALLOC_HEADER);
+#if BX_HAVE_SYS_MMAN_H && defined(MAP_ANONYMOUS)
+  if (header[1]) {
+    munmap(header, header[0] + BX_ZALLOC_HEADER);
+    return;
+  }
+#endif
+  free(header);
+}
+
+// Zero len bytes of a block from bx_alloc_zeroed(). Whole pages of a mapped
+// block are handed back to the host instead of being written.
+void bx_clear_zeroed(void *ptr, size_t len)
+{
+  Bit8u *p = (Bit8u *) ptr;
+#if BX_HAVE_SYS_MMAN_H && defined(MAP_ANONYMOUS) && defined(MADV_DONTNEED)
+  size_t *header = (size_t *)((Bit8u *) ptr - BX_ZALLOC_HEADER);
+  size_t pages = len & ~(size_t)(BX_ZALLOC_HEADER - 1);
+  if (header[1] && (pages > 0) && !madvise(p, pages, MADV_DONTNEED)) {
+    p += pages;
+    len -= pages;
+  }
+#endif
+  memset(p, 0, len);
+}
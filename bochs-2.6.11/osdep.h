@@ -346,8 +346,16 @@ BX_CPP_INLINE void bx_ppc_store_le64(Bit64u *p, Bit64u v)
 #if BX_HAVE_REALTIME_USEC
 // 64-bit time in useconds.
 BOCHSAPI_MSVCONLY extern Bit64u bx_get_realtime64_usec (void);
+// 64-bit monotonic time in nanoseconds, for timing short host operations.
+BOCHSAPI_MSVCONLY extern Bit64u bx_get_realtime64_nsec (void);
 #endif
 
+// Zero filled memory, backed by the host only as it is touched. Free it
+// with bx_free_zeroed(), bx_clear_zeroed() zeroes (a part of) it again.
+BOCHSAPI_MSVCONLY extern void *bx_alloc_zeroed(size_t len);
+BOCHSAPI_MSVCONLY extern void bx_free_zeroed(void *ptr);
+BOCHSAPI_MSVCONLY extern void bx_clear_zeroed(void *ptr, size_t len);
+
 #ifdef WIN32
 #undef BX_HAVE_MSLEEP
 #define BX_HAVE_MSLEEP 1
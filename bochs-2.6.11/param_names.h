@@ -30,6 +30,7 @@
 #define BXPN_BOCHS_START                 "general.start_mode"
 #define BXPN_BOCHS_BENCHMARK             "general.benchmark"
 #define BXPN_DUMP_STATS                  "general.dumpstats"
+#define BXPN_DUMP_STATS_CSV              "general.dumpstats_csv"
 #define BXPN_RESTORE_FLAG                "general.restore"
 #define BXPN_RESTORE_PATH                "general.restore_path"
 #define BXPN_DEBUG_RUNNING               "general.debug_running"
@@ -40,12 +41,16 @@
 #define BXPN_CPU_NTHREADS                "cpu.n_threads"
 #define BXPN_CPU_MODEL                   "cpu.model"
 #define BXPN_IPS                         "cpu.ips"
+#define BXPN_TSC_FREQ                    "cpu.tsc_freq"
+#define BXPN_PVCLOCK                     "cpu.pvclock"
 #define BXPN_SMP_QUANTUM                 "cpu.quantum"
+#define BXPN_SMP_THREADS                 "cpu.smp_threads"
 #define BXPN_RESET_ON_TRIPLE_FAULT       "cpu.reset_on_triple_fault"
 #define BXPN_IGNORE_BAD_MSRS             "cpu.ignore_bad_msrs"
 #define BXPN_CONFIGURABLE_MSRS_PATH      "cpu.msrs"
 #define BXPN_CPUID_LIMIT_WINNT           "cpu.cpuid_limit_winnt"
 #define BXPN_MWAIT_IS_NOP                "cpu.mwait_is_nop"
+#define BXPN_FAST_FP                     "cpu.fast_fp"
 #define BXPN_VENDOR_STRING               "cpuid.vendor_string"
 #define BXPN_BRAND_STRING                "cpuid.brand_string"
 #define BXPN_CPUID_LEVEL                 "cpuid.level"
@@ -89,9 +94,13 @@
 #define BXPN_VGA_ROM_PATH                "memory.standard.vgarom.file"
 #define BXPN_OPTROM_BASE                 "memory.optrom"
 #define BXPN_OPTRAM_BASE                 "memory.optram"
+#define BXPN_MEM_DEDUP_STORE             "memory.dedup.store"
+#define BXPN_MEM_DEDUP_SIZE              "memory.dedup.size"
+#define BXPN_MEM_DEDUP_SCAN              "memory.dedup.scan"
 #define BXPN_CLOCK_SYNC                  "clock_cmos.clock_sync"
 #define BXPN_CLOCK_TIME0                 "clock_cmos.time0"
 #define BXPN_CLOCK_RTC_SYNC              "clock_cmos.rtc_sync"
+#define BXPN_CLOCK_IDLE_SKIP             "clock_cmos.idle_skip"
 #define BXPN_CMOSIMAGE_ENABLED           "clock_cmos.cmosimage.enabled"
 #define BXPN_CMOSIMAGE_PATH              "clock_cmos.cmosimage.path"
 #define BXPN_CMOSIMAGE_RTC_INIT          "clock_cmos.cmosimage.rtc_init"
@@ -107,6 +116,7 @@
 #define BXPN_VGA_EXTENSION               "display.vga_extension"
 #define BXPN_VGA_UPDATE_FREQUENCY        "display.vga_update_frequency"
 #define BXPN_VGA_REALTIME                "display.vga_realtime"
+#define BXPN_VGA_THREADED                "display.vga_threaded"
 #define BXPN_VOODOO                      "display.voodoo"
 #define BXPN_KEYBOARD                    "keyboard_mouse.keyboard"
 #define BXPN_KBD_TYPE                    "keyboard_mouse.keyboard.type"
@@ -114,6 +124,7 @@
 #define BXPN_KBD_PASTE_DELAY             "keyboard_mouse.keyboard.paste_delay"
 #define BXPN_KBD_USEMAPPING              "keyboard_mouse.keyboard.use_mapping"
 #define BXPN_KBD_KEYMAP                  "keyboard_mouse.keyboard.keymap"
+#define BXPN_KBD_INJECT                  "keyboard_mouse.keyboard.inject"
 #define BXPN_USER_SHORTCUT               "keyboard_mouse.keyboard.user_shortcut"
 #define BXPN_MOUSE                       "keyboard_mouse.mouse"
 #define BXPN_MOUSE_TYPE                  "keyboard_mouse.mouse.type"
@@ -153,6 +164,7 @@
 #define BXPN_ATA1_SLAVE                  "ata.1.slave"
 #define BXPN_ATA2_SLAVE                  "ata.2.slave"
 #define BXPN_ATA3_SLAVE                  "ata.3.slave"
+#define BXPN_PVBLK                       "ata.pvblk"
 #define BXPN_USB_UHCI                    "ports.usb.uhci"
 #define BXPN_UHCI_ENABLED                "ports.usb.uhci.enabled"
 #define BXPN_USB_OHCI                    "ports.usb.ohci"
@@ -178,9 +190,18 @@
 #define BXPN_SOUND_SB16                  "sound.sb16"
 #define BXPN_SOUND_ES1370                "sound.es1370"
 #define BXPN_PORT_E9_HACK                "misc.port_e9_hack"
+#define BXPN_PORT_E9_LOG                 "misc.port_e9_log"
 #define BXPN_GDBSTUB                     "misc.gdbstub"
+#define BXPN_PROFILE                     "misc.profile"
+#define BXPN_REPLAY                      "misc.replay"
+#define BXPN_COVERAGE                    "misc.coverage"
+#define BXPN_IOSTATS                     "misc.iostats"
+#define BXPN_CLONE                       "misc.clone"
+#define BXPN_HOSTSHARE                   "misc.hostshare"
 #define BXPN_LOG_FILENAME                "log.filename"
 #define BXPN_LOG_PREFIX                  "log.prefix"
+#define BXPN_LOG_ASYNC                   "log.async"
+#define BXPN_LOG_RATELIMIT               "log.ratelimit"
 #define BXPN_DEBUGGER_LOG_FILENAME       "log.debugger_filename"
 #define BXPN_MENU_DISK                   "menu.disk"
 #define BXPN_MENU_DISK_WIN32             "menu.disk_win32"
@@ -55,12 +55,14 @@ bx_pc_system_c::bx_pc_system_c()
   timer[0].funct      = nullTimer;
   timer[0].this_ptr   = this;
   numTimers = 1; // So far, only the nullTimer.
+  timerHeapSize = 0;
 }
 
 void bx_pc_system_c::initialize(Bit32u ips)
 {
   ticksTotal = 0;
   timer[0].timeToFire = NullTimerInterval;
+  rebuildTimerHeap();
   currCountdown       = NullTimerInterval;
   currCountdownPeriod = NullTimerInterval;
   lastTimeUsec = 0;
@@ -68,6 +70,7 @@ void bx_pc_system_c::initialize(Bit32u ips)
   triggeredTimer = 0;
   HRQ = 0;
   kill_bochs_request = 0;
+  idle_skip = SIM->get_param_bool(BXPN_CLOCK_IDLE_SKIP)->get();
 
   // parameter 'ips' is the processor speed in Instructions-Per-Second
   m_ips = double(ips) / 1000000.0L;
@@ -78,8 +81,14 @@ void bx_pc_system_c::initialize(Bit32u ips)
 void bx_pc_system_c::set_HRQ(bx_bool val)
 {
   HRQ = val;
-  if (val)
+  if (val) {
+#if BX_SUPPORT_SMP
+    if (BX_SMP_REMOTE(BX_CPU(0)))
+      bx_smp_post(BX_CPU(0), BX_SMP_MSG_KICK);
+    else
+#endif
     BX_CPU(0)->async_event = 1;
+  }
 }
 
 void bx_pc_system_c::raise_INTR(void)
@@ -173,18 +182,40 @@ bx_bool bx_pc_system_c::get_enable_a20(void)
 
 void bx_pc_system_c::MemoryMappingChanged(void)
 {
-  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++)
+  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++) {
+#if BX_SUPPORT_SMP
+    if (BX_SMP_REMOTE(BX_CPU(i))) {
+      bx_smp_post(BX_CPU(i), BX_SMP_MSG_TLB_FLUSH);
+      continue;
+    }
+#endif
     BX_CPU(i)->TLB_flush();
+  }
 }
 
 void bx_pc_system_c::invlpg(bx_address addr)
 {
-  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++)
+  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++) {
+#if BX_SUPPORT_SMP
+    if (BX_SMP_REMOTE(BX_CPU(i))) {
+      bx_smp_post(BX_CPU(i), BX_SMP_MSG_TLB_FLUSH);
+      continue;
+    }
+#endif
     BX_CPU(i)->TLB_invlpg(addr);
+  }
 }
 
 int bx_pc_system_c::Reset(unsigned type)
 {
+#if BX_SUPPORT_SMP
+  if (bx_smp_cpu != NULL) {
+    // the processors are running, the main thread resets after the slice
+    bx_smp_request_reset(type);
+    return(0);
+  }
+#endif
+
   // type is BX_RESET_HARDWARE or BX_RESET_SOFTWARE
   BX_INFO(("bx_pc_system_c::Reset(%s) called",type==BX_RESET_HARDWARE?"HARDWARE":"SOFTWARE"));
 
@@ -212,6 +243,7 @@ void bx_pc_system_c::exit(void)
 {
   // delete all registered timers (exception: null timer and APIC timer)
   numTimers = 1 + BX_SUPPORT_APIC;
+  rebuildTimerHeap();
   bx_devices.exit();
   if (bx_gui) {
     bx_gui->cleanup();
@@ -249,6 +281,73 @@ void bx_pc_system_c::register_state(void)
 // Bochs internal timer delivery framework features
 // ================================================
 
+void bx_pc_system_c::timerHeapSiftUp(unsigned pos)
+{
+  unsigned i = timerHeap[pos];
+  while (pos > 0) {
+    unsigned parent = (pos - 1) / 2;
+    if (! timerBefore(i, timerHeap[parent])) break;
+    timerHeap[pos] = timerHeap[parent];
+    timer[timerHeap[pos]].heapPos = pos;
+    pos = parent;
+  }
+  timerHeap[pos] = i;
+  timer[i].heapPos = pos;
+}
+
+void bx_pc_system_c::timerHeapSiftDown(unsigned pos)
+{
+  unsigned i = timerHeap[pos];
+  for (;;) {
+    unsigned child = 2 * pos + 1;
+    if (child >= timerHeapSize) break;
+    if (child + 1 < timerHeapSize && timerBefore(timerHeap[child + 1], timerHeap[child]))
+      child++;
+    if (! timerBefore(timerHeap[child], i)) break;
+    timerHeap[pos] = timerHeap[child];
+    timer[timerHeap[pos]].heapPos = pos;
+    pos = child;
+  }
+  timerHeap[pos] = i;
+  timer[i].heapPos = pos;
+}
+
+void bx_pc_system_c::timerHeapInsert(unsigned i)
+{
+  timerHeap[timerHeapSize] = i;
+  timerHeapSiftUp(timerHeapSize++);
+}
+
+void bx_pc_system_c::timerHeapRemove(unsigned i)
+{
+  unsigned pos = timer[i].heapPos;
+  unsigned last = timerHeap[--timerHeapSize];
+  if (last != i) {
+    timerHeap[pos] = last;
+    timer[last].heapPos = pos;
+    timerHeapUpdate(last);
+  }
+}
+
+// re-establish the heap order after the timeToFire of timer i changed
+void bx_pc_system_c::timerHeapUpdate(unsigned i)
+{
+  unsigned pos = timer[i].heapPos;
+  if (pos > 0 && timerBefore(i, timerHeap[(pos - 1) / 2]))
+    timerHeapSiftUp(pos);
+  else
+    timerHeapSiftDown(pos);
+}
+
+void bx_pc_system_c::rebuildTimerHeap(void)
+{
+  timerHeapSize = 0;
+  for (unsigned i = 0; i < numTimers; i++) {
+    if (timer[i].inUse && timer[i].active)
+      timerHeapInsert(i);
+  }
+}
+
 int bx_pc_system_c::register_timer(void *this_ptr, void (*funct)(void *),
   Bit32u useconds, bx_bool continuous, bx_bool active, const char *id)
 {
@@ -300,6 +399,7 @@ int bx_pc_system_c::register_timer_ticks(void* this_ptr, bx_timer_handler_t func
   timer[i].param      = 0;
 
   if (active) {
+    timerHeapInsert(i);
     if (ticks < Bit64u(currCountdown)) {
       // This new timer needs to fire before the current countdown.
       // Skew the current countdown and countdown period to be smaller
@@ -320,9 +420,8 @@ int bx_pc_system_c::register_timer_ticks(void* this_ptr, bx_timer_handler_t func
 
 void bx_pc_system_c::countdownEvent(void)
 {
-  unsigned i, first = numTimers, last = 0;
-  Bit64u   minTimeToFire;
-  bx_bool  triggered[BX_MAX_TIMERS];
+  unsigned i, n, numTriggered = 0;
+  unsigned triggered[BX_MAX_TIMERS];
 
   // The countdown decremented to 0.  We need to service all the active
   // timers, and invoke callbacks from those timers which have fired.
@@ -334,49 +433,45 @@ void bx_pc_system_c::countdownEvent(void)
   // Increment global ticks counter by number of ticks which have
   // elapsed since the last update.
   ticksTotal += Bit64u(currCountdownPeriod);
-  minTimeToFire = (Bit64u) -1;
 
-  for (i = 0; i < numTimers; i++) {
-    triggered[i] = 0; // Reset triggered flag.
-    if (timer[i].active) {
+  // Pop the timers which are ready to fire.  They come out in index
+  // order, which is also the order the callbacks are called in.
+  while (timerHeapSize > 0) {
+    i = timerHeap[0];
 #if BX_TIMER_DEBUG
-      if (ticksTotal > timer[i].timeToFire)
-        BX_PANIC(("countdownEvent: ticksTotal > timeToFire[%u], D " FMT_LL "u", i,
-                  timer[i].timeToFire-ticksTotal));
+    if (ticksTotal > timer[i].timeToFire)
+      BX_PANIC(("countdownEvent: ticksTotal > timeToFire[%u], D " FMT_LL "u", i,
+                timer[i].timeToFire-ticksTotal));
 #endif
-      if (ticksTotal == timer[i].timeToFire) {
-        // This timer is ready to fire.
-        triggered[i] = 1;
-
-        if (timer[i].continuous==0) {
-          // If triggered timer is one-shot, deactive.
-          timer[i].active = 0;
-        } else {
-          // Continuous timer, increment time-to-fire by period.
-          timer[i].timeToFire += timer[i].period;
-          if (timer[i].timeToFire < minTimeToFire)
-            minTimeToFire = timer[i].timeToFire;
-        }
-        if (i < first) first = i;
-        last = i;
-      } else {
-        // This timer is not ready to fire yet.
-        if (timer[i].timeToFire < minTimeToFire)
-          minTimeToFire = timer[i].timeToFire;
-      }
+    if (ticksTotal != timer[i].timeToFire) break;
+    timerHeapRemove(i);
+    triggered[numTriggered++] = i;
+  }
+
+  for (n = 0; n < numTriggered; n++) {
+    i = triggered[n];
+    if (timer[i].continuous==0) {
+      // If triggered timer is one-shot, deactive.
+      timer[i].active = 0;
+    } else {
+      // Continuous timer, increment time-to-fire by period.
+      timer[i].timeToFire += timer[i].period;
+      timerHeapInsert(i);
     }
   }
 
   // Calculate next countdown period.  We need to do this before calling
   // any of the callbacks, as they may call timer features, which need
-  // to be advanced to the next countdown cycle.
+  // to be advanced to the next countdown cycle.  The null timer is always
+  // active, so the heap is never empty.
   currCountdown = currCountdownPeriod =
-      Bit32u(minTimeToFire - ticksTotal);
+      Bit32u(timer[timerHeap[0]].timeToFire - ticksTotal);
 
-  for (i = first; i <= last; i++) {
+  for (n = 0; n < numTriggered; n++) {
+    i = triggered[n];
     // Call requested timer function.  It may request a different
     // timer period or deactivate etc.
-    if (triggered[i] && (timer[i].funct != NULL)) {
+    if (timer[i].funct != NULL) {
       triggeredTimer = i;
       timer[i].funct(timer[i].this_ptr);
       triggeredTimer = 0;
@@ -418,10 +513,56 @@ void bx_pc_system_c::benchmarkTimer(void* this_ptr)
 }
 
 #if BX_ENABLE_STATISTICS
+// one line per statistics dump: emulation speed plus all counters
+static FILE *stats_csv = NULL;
+static Bit64u stats_csv_usec, stats_csv_icount;
+
+static Bit64u get_total_icount(void)
+{
+  Bit64u icount = 0;
+  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++)
+    icount += BX_CPU(i)->get_icount();
+  return icount;
+}
+
+void bx_pc_system_c::open_stats_csv(const char *path)
+{
+#if BX_HAVE_REALTIME_USEC
+  stats_csv = fopen(path, "w");
+  if (stats_csv == NULL) {
+    BX_ERROR(("could not open statistics file '%s'", path));
+    return;
+  }
+  fprintf(stats_csv, "ticks,host_usec,mips");
+  write_statistics_csv(stats_csv, SIM->get_statistics_root(), NULL, 1);
+  fprintf(stats_csv, "\n");
+  stats_csv_usec = bx_get_realtime64_usec();
+  stats_csv_icount = get_total_icount();
+#else
+  BX_ERROR(("statistics file not supported: no host timer"));
+#endif
+}
+
 void bx_pc_system_c::dumpStatsTimer(void* this_ptr)
 {
+#if BX_HAVE_REALTIME_USEC
+  if (stats_csv != NULL) {
+    Bit64u usec = bx_get_realtime64_usec(), icount = get_total_icount();
+    Bit64u usec_delta = usec - stats_csv_usec;
+    fprintf(stats_csv, FMT_LL "u," FMT_LL "u,%.2f", bx_pc_system.time_ticks(), usec_delta,
+            usec_delta ? (double)(icount - stats_csv_icount) / (double) usec_delta : 0.0);
+    // must come first, printing the tree clears the counters
+    write_statistics_csv(stats_csv, SIM->get_statistics_root(), NULL, 0);
+    fprintf(stats_csv, "\n");
+    fflush(stats_csv);
+    stats_csv_usec = usec;
+    stats_csv_icount = icount;
+  }
+#endif
   printf("=== statistics dump " FMT_LL "u ===\n", bx_pc_system.time_ticks());
   print_statistics_tree(SIM->get_statistics_root());
+  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++)
+    BX_CPU(i)->print_opcode_statistics(20);
   fflush(stdout);
 }
 #endif
@@ -472,6 +613,9 @@ void bx_pc_system_c::start_timers(void) { }
 
 void bx_pc_system_c::activate_timer_ticks(unsigned i, Bit64u ticks, bx_bool continuous)
 {
+  // processors may program their local timers concurrently
+  BX_SMP_LOCK_SCOPE();
+
 #if BX_TIMER_DEBUG
   if (i >= numTimers)
     BX_PANIC(("activate_timer_ticks: timer %u OOB", i));
@@ -492,8 +636,13 @@ void bx_pc_system_c::activate_timer_ticks(unsigned i, Bit64u ticks, bx_bool cont
 
   timer[i].period = ticks;
   timer[i].timeToFire = (ticksTotal + Bit64u(currCountdownPeriod-currCountdown)) + ticks;
-  timer[i].active     = 1;
   timer[i].continuous = continuous;
+  if (timer[i].active) {
+    timerHeapUpdate(i);
+  } else {
+    timer[i].active = 1;
+    timerHeapInsert(i);
+  }
 
   if (ticks < Bit64u(currCountdown)) {
     // This new timer needs to fire before the current countdown.
@@ -506,6 +655,8 @@ void bx_pc_system_c::activate_timer_ticks(unsigned i, Bit64u ticks, bx_bool cont
 
 void bx_pc_system_c::activate_timer(unsigned i, Bit32u useconds, bx_bool continuous)
 {
+  BX_SMP_LOCK_SCOPE();
+
   Bit64u ticks;
 
 #if BX_TIMER_DEBUG
@@ -537,6 +688,8 @@ void bx_pc_system_c::activate_timer(unsigned i, Bit32u useconds, bx_bool continu
 
 void bx_pc_system_c::activate_timer_nsec(unsigned i, Bit64u nseconds, bx_bool continuous)
 {
+  BX_SMP_LOCK_SCOPE();
+
   Bit64u ticks;
 
   // if nseconds = 0, use default stored in period field
@@ -561,6 +714,8 @@ void bx_pc_system_c::activate_timer_nsec(unsigned i, Bit64u nseconds, bx_bool co
 
 void bx_pc_system_c::deactivate_timer(unsigned i)
 {
+  BX_SMP_LOCK_SCOPE();
+
 #if BX_TIMER_DEBUG
   if (i >= numTimers)
     BX_PANIC(("deactivate_timer: timer %u OOB", i));
@@ -568,11 +723,16 @@ void bx_pc_system_c::deactivate_timer(unsigned i)
     BX_PANIC(("deactivate_timer: timer 0 is the nullTimer!"));
 #endif
 
-  timer[i].active = 0;
+  if (timer[i].active) {
+    timerHeapRemove(i);
+    timer[i].active = 0;
+  }
 }
 
 bx_bool bx_pc_system_c::unregisterTimer(unsigned timerIndex)
 {
+  BX_SMP_LOCK_SCOPE();
+
 #if BX_TIMER_DEBUG
   if (timerIndex >= numTimers)
     BX_PANIC(("unregisterTimer: timer %u OOB", timerIndex));
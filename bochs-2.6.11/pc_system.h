@@ -54,8 +54,24 @@ private:
 #define BxMaxTimerIDLen 32
     char id[BxMaxTimerIDLen];  // String ID of timer.
     Bit32u param;              // Device-specific value assigned to timer (optional)
+    unsigned heapPos;          // Index in timerHeap[] while active.
   } timer[BX_MAX_TIMERS];
 
+  // Active timers as a binary min-heap ordered by timeToFire (ties by
+  // timer index), so the next deadline is always timerHeap[0].
+  unsigned   timerHeap[BX_MAX_TIMERS];
+  unsigned   timerHeapSize;
+  BX_CPP_INLINE bx_bool timerBefore(unsigned a, unsigned b) const {
+    return (timer[a].timeToFire < timer[b].timeToFire) ||
+           (timer[a].timeToFire == timer[b].timeToFire && a < b);
+  }
+  void timerHeapSiftUp(unsigned pos);
+  void timerHeapSiftDown(unsigned pos);
+  void timerHeapInsert(unsigned i);
+  void timerHeapRemove(unsigned i);
+  void timerHeapUpdate(unsigned i);
+  void rebuildTimerHeap(void);
+
   unsigned   numTimers;  // Number of currently allocated timers.
   unsigned   triggeredTimer;  // ID of the actually triggered timer.
   Bit32u     currCountdown; // Current countdown ticks value (decrements to 0).
@@ -141,6 +157,7 @@ public:
   static void benchmarkTimer(void* this_ptr);
 #if BX_ENABLE_STATISTICS
   static void dumpStatsTimer(void* this_ptr);
+  void open_stats_csv(const char *path);
 #endif
   void isa_bus_delay(void);
 
@@ -167,6 +184,9 @@ public:
 
   volatile bx_bool kill_bochs_request;
 
+  // a halted cpu jumps straight to the next timer event
+  bx_bool idle_skip;
+
   void set_HRQ(bx_bool val);  // set the Hold ReQuest line
 
   void raise_INTR(void);
@@ -186,6 +206,7 @@ public:
   void    invlpg(bx_address addr);    // flush TLB page in all CPUs
   void    exit(void);
   void    register_state(void);
+  void    after_restore_state(void) { rebuildTimerHeap(); }
 };
 
 #endif
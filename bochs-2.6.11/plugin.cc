@@ -870,6 +870,10 @@ static builtin_plugin_t builtin_plugins[] = {
 #if BX_SUPPORT_PCIPNIC
   BUILTIN_OPT_PLUGIN_ENTRY(pcipnic),
 #endif
+#if BX_SUPPORT_PCI
+  BUILTIN_OPT_PLUGIN_ENTRY(pvblk),
+  BUILTIN_OPT_PLUGIN_ENTRY(hostshare),
+#endif
 #if BX_SUPPORT_SB16
   BUILTIN_OPT_PLUGIN_ENTRY(sb16),
 #endif
@@ -67,6 +67,8 @@ extern "C" {
 #define BX_PLUGIN_USB_EHCI  "usb_ehci"
 #define BX_PLUGIN_USB_XHCI  "usb_xhci"
 #define BX_PLUGIN_PCIPNIC   "pcipnic"
+#define BX_PLUGIN_PVBLK     "pvblk"
+#define BX_PLUGIN_HOSTSHARE "hostshare"
 #define BX_PLUGIN_E1000     "e1000"
 #define BX_PLUGIN_GAMEPORT  "gameport"
 #define BX_PLUGIN_SPEAKER   "speaker"
@@ -147,6 +149,7 @@ extern "C" {
 #define DEV_register_state() {bx_devices.register_state(); }
 #define DEV_after_restore_state() {bx_devices.after_restore_state(); }
 #define DEV_register_timer(a,b,c,d,e,f) bx_pc_system.register_timer(a,b,c,d,e,f)
+#define DEV_register_bulk_io_handlers(a,b,c,d,e) bx_devices.register_bulk_io_handlers(a,b,c,d,e)
 
 ///////// Removable devices macros
 #define DEV_optional_key_enq(a) (bx_devices.optional_key_enq(a))
@@ -173,8 +176,7 @@ extern "C" {
 
 ///////// keyboard macros
 #define DEV_kbd_gen_scancode(key) (bx_devices.gen_scancode(key))
-#define DEV_kbd_paste_bytes(bytes, count) \
-    (bx_devices.pluginKeyboard->paste_bytes(bytes,count))
+#define DEV_kbd_paste_bytes(bytes, count) (bx_devices.paste_bytes(bytes,count))
 #define DEV_kbd_release_keys() (bx_devices.release_keys())
 
 ///////// mouse macros
@@ -195,6 +197,7 @@ extern "C" {
 #define DEV_hd_bmdma_read_sector(a,b,c) bx_devices.pluginHardDrive->bmdma_read_sector(a,b,c)
 #define DEV_hd_bmdma_write_sector(a,b) bx_devices.pluginHardDrive->bmdma_write_sector(a,b)
 #define DEV_hd_bmdma_complete(a) bx_devices.pluginHardDrive->bmdma_complete(a)
+#define DEV_hd_clone_images(a) bx_devices.pluginHardDrive->clone_images(a)
 #define DEV_hdimage_init_image(a,b,c) bx_devices.pluginHDImageCtl->init_image(a,b,c)
 #define DEV_hdimage_init_cdrom(a) bx_devices.pluginHDImageCtl->init_cdrom(a)
 
@@ -436,6 +439,8 @@ DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(es1370)
 DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(netmod)
 DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(ne2k)
 DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(pcipnic)
+DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(pvblk)
+DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(hostshare)
 DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(e1000)
 DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(extfpuirq)
 DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(gameport)
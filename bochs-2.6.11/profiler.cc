@@ -0,0 +1,683 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+/////////////////////////////////////////////////////////////////////////
+
+#include "bochs.h"
+#include "param_names.h"
+#include "cpu/cpu.h"
+#include "profiler.h"
+
+#define LOG_THIS genlog->
+
+typedef struct {
+  bx_address laddr;
+  bx_address cr3;    // 0 for supervisor samples, the kernel is mapped everywhere
+  Bit32u cpl;
+  Bit64u count;      // 0 = free bucket
+} bx_profile_bucket_t;
+
+// a sampled call stack, frames[0] is the sampled address
+typedef struct {
+  bx_address *frames;
+  Bit32u depth;
+  Bit32u cpl;
+  bx_address cr3;
+  Bit64u count;      // 0 = free bucket
+} bx_profile_stack_t;
+
+typedef struct {
+  bx_address addr;
+  char *name;
+  Bit64u count;
+} bx_profile_symbol_t;
+
+// one line of the report
+typedef struct {
+  const char *name;
+  bx_address addr;
+  Bit64u count;
+} bx_profile_entry_t;
+
+static struct {
+  int timer_id;
+  bx_profile_bucket_t *buckets;
+  Bit32u used;
+  Bit64u samples;
+  Bit64u dropped;     // samples lost because all buckets were in use
+  Bit64u cpl_samples[4];
+  bx_profile_symbol_t *symbols;
+  unsigned num_symbols;
+  unsigned max_depth;
+  bx_profile_stack_t *stacks;
+  Bit32u used_stacks;
+  Bit64u dropped_stacks;
+} profile;
+
+static void bx_profiler_print(FILE *fp, Bit64u count, double total, const char *name)
+{
+  char num[32];
+
+  sprintf(num, FMT_LL "u", count);
+  fprintf(fp, "%9s  %6.2f  %s\n", num, 100.0 * count / total, name);
+}
+
+static void bx_profiler_add(bx_address laddr, bx_address cr3, unsigned cpl)
+{
+  Bit32u hash = ((Bit32u) laddr ^ (Bit32u)(cr3 >> 12) ^ cpl) * 0x9e3779b1;
+  Bit32u idx = (hash >> 16) & (BX_PROFILE_BUCKETS - 1);
+
+  profile.samples++;
+  profile.cpl_samples[cpl]++;
+  for (unsigned probe = 0; probe < BX_PROFILE_BUCKETS; probe++) {
+    bx_profile_bucket_t *b = &profile.buckets[idx];
+    if (b->count == 0) {
+      if (profile.used >= BX_PROFILE_BUCKETS / 4 * 3) break;
+      b->laddr = laddr;
+      b->cr3 = cr3;
+      b->cpl = cpl;
+      b->count = 1;
+      profile.used++;
+      return;
+    }
+    if ((b->laddr == laddr) && (b->cr3 == cr3) && (b->cpl == cpl)) {
+      b->count++;
+      return;
+    }
+    idx = (idx + 1) & (BX_PROFILE_BUCKETS - 1);
+  }
+  profile.dropped++;
+}
+
+// Read a word of guest memory through the debugger access path, the guest
+// TLB and the paging state are left alone. Only RAM is read, a stray frame
+// pointer must not reach video memory or unallocated blocks.
+static bx_bool bx_profiler_read_word(BX_CPU_C *cpu, bx_address laddr, unsigned len, bx_address *val)
+{
+#if (BX_DEBUGGER || BX_DISASM || BX_GDBSTUB)
+  bx_phy_address paddr;
+  Bit64u buf;
+
+  if ((laddr & (len - 1)) != 0) return 0;
+  if (!cpu->dbg_xlate_linear2phy(laddr, &paddr)) return 0;
+  if (((paddr >= 0xa0000) && (paddr < 0x100000)) ||
+      ((paddr + len) > BX_MEM(0)->get_memory_len())) return 0;
+  if (!BX_MEM(0)->dbg_fetch_mem(cpu, paddr, len, (Bit8u*) &buf)) return 0;
+  *val = (len == 8) ? (bx_address) ReadHostQWordFromLittleEndian(&buf) :
+                      (bx_address) ReadHostDWordFromLittleEndian((Bit32u*) &buf);
+  return 1;
+#else
+  return 0; // no debug memory access in this configuration
+#endif
+}
+
+// Follow the saved frame pointers from the sampled frame upwards. The walk
+// ends at a link that doesn't point higher up the same stack and, for
+// supervisor samples, at the first return address below the symbol map
+// (the interrupted user code).
+static unsigned bx_profiler_walk(BX_CPU_C *cpu, unsigned cpl, bx_address laddr, bx_address *frames)
+{
+  unsigned len = 4, depth = 0;
+  bx_address fp, next_fp, ret;
+
+#if BX_SUPPORT_X86_64
+  if (cpu->long64_mode()) {
+    len = 8;
+    fp = cpu->get_reg64(BX_64BIT_REG_RBP);
+  }
+  else
+#endif
+    fp = cpu->get_reg32(BX_32BIT_REG_EBP);
+
+  frames[depth++] = laddr;
+  while (depth <= profile.max_depth) {
+    if (!bx_profiler_read_word(cpu, fp, len, &next_fp) ||
+        !bx_profiler_read_word(cpu, fp + len, len, &ret) || (ret == 0))
+      break;
+    if ((cpl < 3) && (profile.num_symbols > 0) && (ret < profile.symbols[0].addr))
+      break;
+    frames[depth++] = ret;
+    if ((next_fp <= fp) || ((next_fp - fp) > 0x10000))
+      break;
+    fp = next_fp;
+  }
+  return depth;
+}
+
+static void bx_profiler_add_stack(const bx_address *frames, unsigned depth, bx_address cr3, unsigned cpl)
+{
+  Bit32u hash = 0x811c9dc5 ^ cpl ^ (Bit32u)(cr3 >> 12);
+  unsigned i;
+
+  for (i = 0; i < depth; i++)
+    hash = (hash ^ (Bit32u) frames[i]) * 0x01000193;
+  Bit32u idx = (hash >> 8) & (BX_PROFILE_STACKS - 1);
+  for (unsigned probe = 0; probe < BX_PROFILE_STACKS; probe++) {
+    bx_profile_stack_t *s = &profile.stacks[idx];
+    if (s->count == 0) {
+      if (profile.used_stacks >= BX_PROFILE_STACKS / 4 * 3) break;
+      s->frames = new bx_address[depth];
+      memcpy(s->frames, frames, depth * sizeof(bx_address));
+      s->depth = depth;
+      s->cpl = cpl;
+      s->cr3 = cr3;
+      s->count = 1;
+      profile.used_stacks++;
+      return;
+    }
+    if ((s->depth == depth) && (s->cpl == cpl) && (s->cr3 == cr3) &&
+        !memcmp(s->frames, frames, depth * sizeof(bx_address))) {
+      s->count++;
+      return;
+    }
+    idx = (idx + 1) & (BX_PROFILE_STACKS - 1);
+  }
+  profile.dropped_stacks++;
+}
+
+static void bx_profiler_timer(void *this_ptr)
+{
+  bx_address frames[BX_PROFILE_MAX_DEPTH + 1];
+
+  for (int i=0; i<BX_SMP_PROCESSORS; i++) {
+    BX_CPU_C *cpu = BX_CPU(i);
+#if BX_SUPPORT_SMP
+    if (cpu == NULL) continue;
+#endif
+    unsigned cpl = cpu->sregs[BX_SEG_REG_CS].selector.rpl;
+    bx_address laddr = cpu->get_laddr(BX_SEG_REG_CS, cpu->get_instruction_pointer());
+    bx_profiler_add(laddr, (cpl == 3) ? cpu->cr3 : 0, cpl);
+    if (profile.stacks != NULL) {
+      unsigned depth = bx_profiler_walk(cpu, cpl, laddr, frames);
+      bx_profiler_add_stack(frames, depth, (cpl == 3) ? cpu->cr3 : 0, cpl);
+    }
+  }
+}
+
+static int bx_profile_symbol_cmp(const void *a, const void *b)
+{
+  bx_address addr1 = ((const bx_profile_symbol_t *) a)->addr;
+  bx_address addr2 = ((const bx_profile_symbol_t *) b)->addr;
+  return (addr1 < addr2) ? -1 : (addr1 > addr2);
+}
+
+static int bx_profile_entry_cmp(const void *a, const void *b)
+{
+  Bit64u count1 = ((const bx_profile_entry_t *) a)->count;
+  Bit64u count2 = ((const bx_profile_entry_t *) b)->count;
+  return (count1 > count2) ? -1 : (count1 < count2);
+}
+
+// Read a symbol map. Both 'nm' output ("c0001500 T main") and the symbol
+// lines of an ld -Map file ("0x00000000c0001500    main") are accepted,
+// everything else is skipped.
+static unsigned bx_profiler_load_symbols(const char *path, bx_profile_symbol_t **psymbols)
+{
+  char buf[512], name[512], extra[512], rest[512];
+  unsigned max_symbols = 1024, num_symbols = 0;
+  bx_profile_symbol_t *symbols;
+
+  *psymbols = NULL;
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) {
+    BX_ERROR(("could not open symbol map '%s'", path));
+    return 0;
+  }
+  symbols = new bx_profile_symbol_t[max_symbols];
+  while (fgets(buf, sizeof(buf), fp)) {
+    char *ptr = buf, *end;
+    while (isspace(*ptr)) ptr++;
+    bx_address addr = (bx_address) strtoull(ptr, &end, 16);
+    if ((end == ptr) || !isspace(*end)) continue;
+    int n = sscanf(end, "%511s %511s %511s", name, extra, rest);
+    if ((n == 2) && (strlen(name) == 1)) {
+      // nm format: type letter, then the name
+      strcpy(name, extra);
+    } else if (n != 1) {
+      continue;
+    }
+    if (!isalpha(name[0]) && (name[0] != '_') && (name[0] != '.')) continue;
+    if (num_symbols == max_symbols) {
+      bx_profile_symbol_t *tmp = new bx_profile_symbol_t[max_symbols * 2];
+      memcpy(tmp, symbols, max_symbols * sizeof(bx_profile_symbol_t));
+      delete [] symbols;
+      symbols = tmp;
+      max_symbols *= 2;
+    }
+    symbols[num_symbols].addr = addr;
+    symbols[num_symbols].name = strdup(name);
+    symbols[num_symbols].count = 0;
+    num_symbols++;
+  }
+  fclose(fp);
+  qsort(symbols, num_symbols, sizeof(bx_profile_symbol_t), bx_profile_symbol_cmp);
+  BX_INFO(("%u symbols loaded from '%s'", num_symbols, path));
+  *psymbols = symbols;
+  return num_symbols;
+}
+
+static void bx_profiler_free_symbols(bx_profile_symbol_t *symbols, unsigned num_symbols)
+{
+  for (unsigned i = 0; i < num_symbols; i++)
+    free(symbols[i].name);
+  delete [] symbols;
+}
+
+// symbol containing laddr, NULL if laddr is below the first one
+static bx_profile_symbol_t *bx_profiler_find_symbol(bx_profile_symbol_t *symbols,
+                                                    unsigned num_symbols, bx_address laddr)
+{
+  int lo = 0, hi = (int) num_symbols - 1, found = -1;
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (symbols[mid].addr <= laddr) {
+      found = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return (found < 0) ? NULL : &symbols[found];
+}
+
+// One line per call stack, the outermost caller first: "a;b;c count".
+// Addresses without a symbol are written in hex, user stacks get their
+// address space as the root frame.
+static void bx_profiler_write_stacks(const char *path)
+{
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL) {
+    BX_ERROR(("profile: could not write call stacks to '%s'", path));
+    return;
+  }
+  for (unsigned i = 0; i < BX_PROFILE_STACKS; i++) {
+    bx_profile_stack_t *s = &profile.stacks[i];
+    if (s->count == 0) continue;
+    if (s->cpl == 3)
+      fprintf(fp, "[cr3 0x" FMT_ADDRX "];", s->cr3);
+    for (int j = (int) s->depth - 1; j >= 0; j--) {
+      bx_profile_symbol_t *sym = NULL;
+      if (s->cpl < 3)
+        sym = bx_profiler_find_symbol(profile.symbols, profile.num_symbols, s->frames[j]);
+      if (sym != NULL) {
+        fputs(sym->name, fp);
+      } else {
+        fprintf(fp, "0x" FMT_ADDRX, s->frames[j]);
+      }
+      fputc((j > 0) ? ';' : ' ', fp);
+    }
+    fprintf(fp, FMT_LL "u\n", s->count);
+  }
+  fclose(fp);
+  BX_INFO(("profile: %u call stacks written to '%s'", profile.used_stacks, path));
+}
+
+void bx_profiler_init(void)
+{
+  bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_PROFILE);
+  Bit32u interval = (Bit32u) SIM->get_param_num("interval", base)->get();
+  bx_bool usec = (SIM->get_param_enum("unit", base)->get() == BX_PROFILE_UNIT_USEC);
+
+  memset(&profile, 0, sizeof(profile));
+  profile.buckets = new bx_profile_bucket_t[BX_PROFILE_BUCKETS];
+  memset(profile.buckets, 0, BX_PROFILE_BUCKETS * sizeof(bx_profile_bucket_t));
+  if (!SIM->get_param_string("symbols", base)->isempty()) {
+    profile.num_symbols = bx_profiler_load_symbols(SIM->get_param_string("symbols", base)->getptr(),
+                                                   &profile.symbols);
+  }
+  profile.max_depth = (unsigned) SIM->get_param_num("callgraph", base)->get();
+  if (profile.max_depth > 0) {
+    profile.stacks = new bx_profile_stack_t[BX_PROFILE_STACKS];
+    memset(profile.stacks, 0, BX_PROFILE_STACKS * sizeof(bx_profile_stack_t));
+  }
+  if (usec) {
+    profile.timer_id = bx_pc_system.register_timer(NULL, bx_profiler_timer,
+        interval, 1 /* continuous */, 1, "profile.timer");
+  } else {
+    profile.timer_id = bx_pc_system.register_timer_ticks(NULL, bx_profiler_timer,
+        (Bit64u) interval, 1 /* continuous */, 1, "profile.timer");
+  }
+  BX_INFO(("profile: sampling guest every %u %s", interval, usec ? "usec" : "instructions"));
+  if (profile.max_depth > 0)
+    BX_INFO(("profile: call graph up to %u frames", profile.max_depth));
+}
+
+void bx_profiler_exit(void)
+{
+  bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_PROFILE);
+  const char *path = SIM->get_param_string("file", base)->getptr();
+  bx_profile_entry_t *entries;
+  char name[32];
+  unsigned i, num_entries = 0, num_user = 0;
+  Bit64u unknown = 0;
+
+  if (profile.buckets == NULL) return;
+  bx_pc_system.unregisterTimer(profile.timer_id);
+
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL) {
+    BX_ERROR(("profile: could not write report to '%s'", path));
+  } else {
+    double total = (profile.samples > 0) ? (double) profile.samples : 1.0;
+    entries = new bx_profile_entry_t[profile.used + 1];
+
+    fprintf(fp, "Bochs guest profile: " FMT_LL "u samples, every %u %s\n", profile.samples,
+            (Bit32u) SIM->get_param_num("interval", base)->get(),
+            (SIM->get_param_enum("unit", base)->get() == BX_PROFILE_UNIT_USEC) ? "usec" : "instructions");
+    for (i = 0; i < 4; i++) {
+      if (profile.cpl_samples[i] > 0)
+        fprintf(fp, "  CPL %u: " FMT_LL "u (%.2f%%)\n", i, profile.cpl_samples[i],
+                100.0 * profile.cpl_samples[i] / total);
+    }
+    if (profile.dropped > 0)
+      fprintf(fp, "  " FMT_LL "u samples dropped, too many distinct addresses\n", profile.dropped);
+    if (profile.dropped_stacks > 0)
+      fprintf(fp, "  " FMT_LL "u call stacks dropped, too many distinct stacks\n", profile.dropped_stacks);
+
+    // supervisor samples by symbol, addresses without a symbol on their own
+    for (i = 0; i < BX_PROFILE_BUCKETS; i++) {
+      bx_profile_bucket_t *b = &profile.buckets[i];
+      if ((b->count == 0) || (b->cpl == 3)) continue;
+      bx_profile_symbol_t *sym = bx_profiler_find_symbol(profile.symbols, profile.num_symbols, b->laddr);
+      if (sym != NULL) {
+        sym->count += b->count;
+      } else if (profile.num_symbols > 0) {
+        unknown += b->count;
+      } else {
+        entries[num_entries].name = NULL;
+        entries[num_entries].addr = b->laddr;
+        entries[num_entries++].count = b->count;
+      }
+    }
+    for (i = 0; i < profile.num_symbols; i++) {
+      if (profile.symbols[i].count == 0) continue;
+      entries[num_entries].name = profile.symbols[i].name;
+      entries[num_entries].addr = profile.symbols[i].addr;
+      entries[num_entries++].count = profile.symbols[i].count;
+    }
+    if (unknown > 0) {
+      entries[num_entries].name = "[no symbol]";
+      entries[num_entries].addr = 0;
+      entries[num_entries++].count = unknown;
+    }
+    qsort(entries, num_entries, sizeof(bx_profile_entry_t), bx_profile_entry_cmp);
+    fprintf(fp, "\nSupervisor mode (CPL 0-2):\n  samples       %%  symbol\n");
+    for (i = 0; i < num_entries; i++) {
+      if (entries[i].name != NULL) {
+        bx_profiler_print(fp, entries[i].count, total, entries[i].name);
+      } else {
+        sprintf(name, "0x" FMT_ADDRX, entries[i].addr);
+        bx_profiler_print(fp, entries[i].count, total, name);
+      }
+    }
+
+    // user samples by address space
+    for (i = 0; i < BX_PROFILE_BUCKETS; i++) {
+      bx_profile_bucket_t *b = &profile.buckets[i];
+      if ((b->count == 0) || (b->cpl != 3)) continue;
+      unsigned j;
+      for (j = 0; j < num_user; j++) {
+        if (entries[j].addr == b->cr3) break;
+      }
+      if (j == num_user) {
+        entries[j].name = NULL;
+        entries[j].addr = b->cr3;
+        entries[j].count = 0;
+        num_user++;
+      }
+      entries[j].count += b->count;
+    }
+    qsort(entries, num_user, sizeof(bx_profile_entry_t), bx_profile_entry_cmp);
+    fprintf(fp, "\nUser mode (CPL 3) by address space:\n  samples       %%  cr3\n");
+    for (i = 0; i < num_user; i++) {
+      sprintf(name, "0x" FMT_ADDRX, entries[i].addr);
+      bx_profiler_print(fp, entries[i].count, total, name);
+    }
+    fclose(fp);
+    delete [] entries;
+    BX_INFO(("profile: " FMT_LL "u samples written to '%s'", profile.samples, path));
+  }
+
+  if (profile.stacks != NULL) {
+    bx_profiler_write_stacks(SIM->get_param_string("stacks", base)->getptr());
+    for (i = 0; i < BX_PROFILE_STACKS; i++)
+      delete [] profile.stacks[i].frames;
+    delete [] profile.stacks;
+  }
+  bx_profiler_free_symbols(profile.symbols, profile.num_symbols);
+  delete [] profile.buckets;
+  memset(&profile, 0, sizeof(profile));
+}
+
+// Code coverage: the bytes of every instruction decoded into the trace
+// cache are marked in a per page bitmap. A trace is only decoded again
+// after it was evicted or invalidated, so the cost is paid per trace build
+// and not per executed instruction.
+
+typedef struct {
+  bx_address space;  // cr3 of user mode code, 0 otherwise (and in phys mode)
+  bx_address page;   // address >> 12
+  Bit8u bits[512];   // one bit per byte
+} bx_coverage_page_t;
+
+bx_bool bx_coverage_enabled = 0;
+
+static struct {
+  bx_bool linear;
+  bx_coverage_page_t **table;  // open addressing hash table
+  Bit32u size, used;
+  bx_coverage_page_t *last;    // most recently marked page
+} coverage;
+
+static BX_CPP_INLINE Bit32u bx_coverage_hash(bx_address space, bx_address page)
+{
+  return ((Bit32u) page ^ (Bit32u)(space >> 12)) * 0x9e3779b1;
+}
+
+static void bx_coverage_insert(bx_coverage_page_t *p)
+{
+  Bit32u idx = bx_coverage_hash(p->space, p->page) & (coverage.size - 1);
+  while (coverage.table[idx] != NULL)
+    idx = (idx + 1) & (coverage.size - 1);
+  coverage.table[idx] = p;
+}
+
+static bx_coverage_page_t *bx_coverage_get_page(bx_address space, bx_address page)
+{
+  Bit32u idx = bx_coverage_hash(space, page) & (coverage.size - 1);
+  bx_coverage_page_t *p;
+
+  while ((p = coverage.table[idx]) != NULL) {
+    if ((p->page == page) && (p->space == space)) return p;
+    idx = (idx + 1) & (coverage.size - 1);
+  }
+
+  if (coverage.used >= coverage.size / 4 * 3) {
+    bx_coverage_page_t **old_table = coverage.table;
+    Bit32u old_size = coverage.size;
+    coverage.size *= 2;
+    coverage.table = new bx_coverage_page_t*[coverage.size];
+    memset(coverage.table, 0, coverage.size * sizeof(bx_coverage_page_t*));
+    for (Bit32u i = 0; i < old_size; i++) {
+      if (old_table[i] != NULL) bx_coverage_insert(old_table[i]);
+    }
+    delete [] old_table;
+  }
+  p = new bx_coverage_page_t;
+  memset(p, 0, sizeof(bx_coverage_page_t));
+  p->space = space;
+  p->page = page;
+  bx_coverage_insert(p);
+  coverage.used++;
+  return p;
+}
+
+void bx_coverage_mark(unsigned cpl, bx_address cr3, bx_phy_address paddr, bx_address laddr, unsigned len)
+{
+  bx_address space = 0, addr = (bx_address) paddr;
+
+  if (coverage.linear) {
+    addr = laddr;
+    if (cpl == 3) space = cr3 & ~(bx_address) 0xfff;
+  }
+
+  bx_coverage_page_t *p = coverage.last;
+  if ((p == NULL) || (p->page != (addr >> 12)) || (p->space != space))
+    coverage.last = p = bx_coverage_get_page(space, addr >> 12);
+
+  unsigned offset = (unsigned) addr & 0xfff;
+  if (len > 4096 - offset) len = 4096 - offset;
+  for (unsigned n = offset; n < offset + len; n++)
+    p->bits[n >> 3] |= 1 << (n & 7);
+}
+
+static int bx_coverage_page_cmp(const void *a, const void *b)
+{
+  const bx_coverage_page_t *p1 = *(const bx_coverage_page_t **) a;
+  const bx_coverage_page_t *p2 = *(const bx_coverage_page_t **) b;
+  if (p1->space != p2->space) return (p1->space < p2->space) ? -1 : 1;
+  return (p1->page < p2->page) ? -1 : (p1->page > p2->page);
+}
+
+// print one covered range and add its supervisor bytes to the symbols
+static void bx_coverage_range(FILE *fp, bx_address start, bx_address end, bx_address space,
+                              bx_profile_symbol_t *symbols, unsigned num_symbols)
+{
+  fprintf(fp, "  " FMT_ADDRX " " FMT_ADDRX "\n", start, end);
+  if ((space != 0) || (num_symbols == 0)) return;
+
+  for (bx_address addr = start; addr < end;) {
+    bx_profile_symbol_t *sym = bx_profiler_find_symbol(symbols, num_symbols, addr);
+    bx_address next = end;
+    if (sym == NULL) {
+      if (symbols[0].addr < next) next = symbols[0].addr;
+    } else {
+      if (((unsigned)(sym - symbols) + 1 < num_symbols) && (sym[1].addr < next)) next = sym[1].addr;
+      sym->count += next - addr;
+    }
+    addr = next;
+  }
+}
+
+void bx_coverage_init(void)
+{
+  bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_COVERAGE);
+
+  memset(&coverage, 0, sizeof(coverage));
+  coverage.linear = (SIM->get_param_enum("mode", base)->get() == BX_COVERAGE_MODE_LINEAR);
+  coverage.size = 1024;
+  coverage.table = new bx_coverage_page_t*[coverage.size];
+  memset(coverage.table, 0, coverage.size * sizeof(bx_coverage_page_t*));
+  bx_coverage_enabled = 1;
+  BX_INFO(("coverage: marking executed code by %s address", coverage.linear ? "linear" : "physical"));
+}
+
+void bx_coverage_exit(void)
+{
+  bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_COVERAGE);
+  const char *path = SIM->get_param_string("file", base)->getptr();
+  bx_profile_symbol_t *symbols = NULL;
+  unsigned i, num_symbols = 0, num_pages = 0;
+  Bit64u covered = 0;
+
+  if (coverage.table == NULL) return;
+  bx_coverage_enabled = 0;
+
+  bx_coverage_page_t **pages = new bx_coverage_page_t*[coverage.used + 1];
+  for (i = 0; i < coverage.size; i++) {
+    if (coverage.table[i] != NULL) pages[num_pages++] = coverage.table[i];
+  }
+  qsort(pages, num_pages, sizeof(bx_coverage_page_t*), bx_coverage_page_cmp);
+  for (i = 0; i < num_pages; i++) {
+    for (unsigned n = 0; n < 512; n++) {
+      for (Bit8u b = pages[i]->bits[n]; b; b &= b - 1) covered++;
+    }
+  }
+
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL) {
+    BX_ERROR(("coverage: could not write report to '%s'", path));
+  } else {
+    if (coverage.linear && !SIM->get_param_string("symbols", base)->isempty()) {
+      num_symbols = bx_profiler_load_symbols(SIM->get_param_string("symbols", base)->getptr(), &symbols);
+    }
+
+    fprintf(fp, "Bochs guest coverage: " FMT_LL "u code bytes executed, %s addresses\n",
+            covered, coverage.linear ? "linear" : "physical");
+
+    // walk the covered byte ranges in address order
+    bx_address space = 0, start = 0, end = 0;
+    bx_bool in_range = 0, header = 0;
+    for (i = 0; i < num_pages; i++) {
+      for (unsigned n = 0; n < 4096; n++) {
+        bx_address addr = (pages[i]->page << 12) + n;
+        if (! ((pages[i]->bits[n >> 3] >> (n & 7)) & 1)) {
+          if (in_range) bx_coverage_range(fp, start, end, space, symbols, num_symbols);
+          in_range = 0;
+          continue;
+        }
+        if (in_range && (pages[i]->space == space) && (addr == end)) {
+          end++;
+          continue;
+        }
+        if (in_range) bx_coverage_range(fp, start, end, space, symbols, num_symbols);
+        if (!header || (pages[i]->space != space)) {
+          space = pages[i]->space;
+          header = 1;
+          fprintf(fp, "\n%s ranges (start, end exclusive)", coverage.linear ? "Linear" : "Physical");
+          if (coverage.linear) {
+            if (space != 0)
+              fprintf(fp, ", user mode cr3=0x" FMT_ADDRX, space);
+            else
+              fprintf(fp, ", supervisor mode");
+          }
+          fprintf(fp, ":\n");
+        }
+        start = addr;
+        end = addr + 1;
+        in_range = 1;
+      }
+    }
+    if (in_range) bx_coverage_range(fp, start, end, space, symbols, num_symbols);
+
+    if (num_symbols > 0) {
+      fprintf(fp, "\nSupervisor mode by symbol:\n  covered     size       %%  symbol\n");
+      for (i = 0; i < num_symbols; i++) {
+        if (symbols[i].count == 0) continue;
+        if ((i + 1) < num_symbols) {
+          Bit64u size = symbols[i + 1].addr - symbols[i].addr;
+          fprintf(fp, "%9u %8u  %6.2f  %s\n", (unsigned) symbols[i].count, (unsigned) size,
+                  100.0 * symbols[i].count / size, symbols[i].name);
+        } else {
+          fprintf(fp, "%9u        -       -  %s\n", (unsigned) symbols[i].count, symbols[i].name);
+        }
+      }
+    }
+    fclose(fp);
+    bx_profiler_free_symbols(symbols, num_symbols);
+    BX_INFO(("coverage: " FMT_LL "u code bytes written to '%s'", covered, path));
+  }
+
+  for (i = 0; i < num_pages; i++)
+    delete pages[i];
+  delete [] pages;
+  delete [] coverage.table;
+  memset(&coverage, 0, sizeof(coverage));
+}
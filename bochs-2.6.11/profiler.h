@@ -0,0 +1,54 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_PROFILER_H
+#define BX_PROFILER_H
+
+// Host side guest profiler: a pc_system timer samples the linear instruction
+// pointer, CPL and CR3 of every cpu, and a flat profile named with an nm style
+// symbol map is written when Bochs exits. The guest doesn't notice anything.
+// With a call graph depth set, every sample also follows the saved frame
+// pointers on the guest stack and the call stacks are written in the folded
+// format of the flame graph tools.
+// The coverage mode marks the code decoded into the trace cache in a bitmap
+// and writes the executed address ranges, and per symbol coverage, at exit.
+
+#define BX_PROFILE_UNIT_INSN 0
+#define BX_PROFILE_UNIT_USEC 1
+
+#define BX_PROFILE_BUCKETS 65536 // distinct sampled addresses, power of 2
+#define BX_PROFILE_STACKS  16384 // distinct call stacks, power of 2
+#define BX_PROFILE_MAX_DEPTH 64
+
+#define BX_COVERAGE_MODE_PHYS   0
+#define BX_COVERAGE_MODE_LINEAR 1
+
+void bx_profiler_init(void);
+void bx_profiler_exit(void);
+
+extern bx_bool bx_coverage_enabled;
+
+void bx_coverage_init(void);
+void bx_coverage_exit(void);
+// called for every instruction decoded into the trace cache
+void bx_coverage_mark(unsigned cpl, bx_address cr3, bx_phy_address paddr, bx_address laddr, unsigned len);
+
+#endif
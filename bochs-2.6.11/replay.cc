@@ -0,0 +1,445 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+/////////////////////////////////////////////////////////////////////////
+
+#include "bochs.h"
+#include "param_names.h"
+#include "cpu/cpu.h"
+#include "iodev/iodev.h"
+#include "replay.h"
+
+#define LOG_THIS genlog->
+
+#define BX_REPLAY_MAGIC       "BXREPLAY"
+#define BX_REPLAY_END_MAGIC   "BXRREND!"
+#define BX_REPLAY_VERSION     1
+// instructions between two checks of the cpu state
+#define BX_REPLAY_CHECK_TICKS 1000000
+#define BX_REPLAY_BUFSIZE     (1024 * 1024)
+
+int bx_replay_mode = BX_REPLAY_MODE_NONE;
+bx_bool bx_replay_injecting = 0;
+
+static const char *replay_type_names[] = {
+  "none", "key", "mouse", "paste", "mouse capture", "serial", "disk",
+  "pvblk", "hostshare", "check", "end"
+};
+
+static struct {
+  FILE *fp;
+  char *iobuf;
+  Bit64u last_tick;   // tick of the previous record
+  Bit64u records;
+  Bit64u bytes;
+  int check_timer;
+  int end_timer;
+  // replaying: header of the next record, its payload is still in the file
+  bx_bool have_next;
+  Bit8u next_type;
+  Bit8u next_channel;
+  Bit64u next_tick;
+  Bit32u next_len;
+  Bit32u unread;      // payload bytes of the taken record not read yet
+} replay;
+
+// the header written at the start of the log
+typedef struct {
+  char   magic[8];
+  Bit32u version;
+  Bit32u ips;
+  Bit64s time0;
+  Bit64u mem_size;
+} bx_replay_header_t;
+
+static void bx_replay_put_varint(Bit64u val)
+{
+  Bit8u buf[10];
+  unsigned n = 0;
+
+  do {
+    buf[n] = (Bit8u)(val & 0x7f);
+    val >>= 7;
+    if (val != 0) buf[n] |= 0x80;
+    n++;
+  } while (val != 0);
+  fwrite(buf, 1, n, replay.fp);
+  replay.bytes += n;
+}
+
+static bx_bool bx_replay_get_varint(Bit64u *val)
+{
+  unsigned shift = 0;
+  int c;
+
+  *val = 0;
+  do {
+    if ((c = fgetc(replay.fp)) == EOF || (shift > 63)) return 0;
+    *val |= (Bit64u)(c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return 1;
+}
+
+// drops the part of the taken record's payload nobody read
+static void bx_replay_skip_unread(void)
+{
+  if (replay.unread > 0) {
+    fseek(replay.fp, replay.unread, SEEK_CUR);
+    replay.unread = 0;
+  }
+}
+
+// reads the header of the next record, at the end of the log there is none
+static void bx_replay_read_next(void)
+{
+  Bit64u delta, len;
+  int type, channel;
+
+  bx_replay_skip_unread();
+  replay.have_next = 0;
+  if (((type = fgetc(replay.fp)) == EOF) || ((channel = fgetc(replay.fp)) == EOF) ||
+      !bx_replay_get_varint(&delta) || !bx_replay_get_varint(&len)) {
+    return;
+  }
+  replay.have_next = 1;
+  replay.next_type = (Bit8u) type;
+  replay.next_channel = (Bit8u) channel;
+  replay.next_tick = replay.last_tick + delta;
+  replay.next_len = (Bit32u) len;
+  replay.last_tick = replay.next_tick;
+}
+
+static const char *bx_replay_type_name(Bit8u type)
+{
+  return (type <= BX_REPLAY_END) ? replay_type_names[type] : "unknown";
+}
+
+// the replay can't go on: the guest did something else than when recording
+void bx_replay_diverged(Bit8u type, Bit8u channel)
+{
+  Bit64u now = bx_pc_system.time_ticks();
+
+  if (replay.have_next) {
+    BX_PANIC(("replay: diverged at tick " FMT_LL "u: wanted %s record (channel %u), "
+              "the log has %s (channel %u) at tick " FMT_LL "u", now,
+              bx_replay_type_name(type), channel, bx_replay_type_name(replay.next_type),
+              replay.next_channel, replay.next_tick));
+  } else {
+    BX_PANIC(("replay: diverged at tick " FMT_LL "u: wanted %s record (channel %u) "
+              "past the end of the log", now, bx_replay_type_name(type), channel));
+  }
+  // no input from the log makes sense from here on
+  bx_replay_mode = BX_REPLAY_MODE_NONE;
+  bx_stop_simulation();
+}
+
+// one hash over the architectural state that matters for control flow
+static Bit32u bx_replay_cpu_hash(void)
+{
+  Bit32u hash = 0x811c9dc5;
+
+  for (int i=0; i<BX_SMP_PROCESSORS; i++) {
+    BX_CPU_C *cpu = BX_CPU(i);
+#if BX_SUPPORT_SMP
+    if (cpu == NULL) continue;
+#endif
+    Bit64u vals[BX_GENERAL_REGISTERS + 3];
+    unsigned n;
+    for (n = 0; n < BX_GENERAL_REGISTERS; n++) {
+#if BX_SUPPORT_X86_64
+      vals[n] = cpu->get_reg64(n);
+#else
+      vals[n] = cpu->get_reg32(n);
+#endif
+    }
+    vals[n++] = cpu->get_instruction_pointer();
+    vals[n++] = cpu->read_eflags();
+    vals[n++] = cpu->cr3;
+    const Bit8u *p = (const Bit8u *) vals;
+    for (unsigned b = 0; b < n * sizeof(Bit64u); b++)
+      hash = (hash ^ p[b]) * 0x01000193;
+  }
+  return hash;
+}
+
+static void bx_replay_check_timer(void *this_ptr)
+{
+  Bit32u hash = bx_replay_cpu_hash(), logged;
+
+  if (BX_REPLAY_RECORDING) {
+    bx_replay_record(BX_REPLAY_CHECK, 0, &hash, 4);
+  } else if (BX_REPLAY_REPLAYING) {
+    if (bx_replay_read(BX_REPLAY_CHECK, 0, &logged, 4) != 4) return;
+    if (logged != hash) {
+      BX_PANIC(("replay: cpu state differs from the recording at tick " FMT_LL "u",
+                bx_pc_system.time_ticks()));
+      bx_replay_mode = BX_REPLAY_MODE_NONE;
+      bx_stop_simulation();
+    }
+  }
+}
+
+static void bx_replay_end_timer(void *this_ptr)
+{
+  BX_INFO(("replay: end of the recording reached at tick " FMT_LL "u", bx_pc_system.time_ticks()));
+  bx_stop_simulation();
+}
+
+void bx_replay_open(void)
+{
+  bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_REPLAY);
+  int mode = SIM->get_param_enum("mode", base)->get();
+  const char *path = SIM->get_param_string("file", base)->getptr();
+  bx_replay_header_t header;
+
+  memset(&replay, 0, sizeof(replay));
+  replay.check_timer = BX_NULL_TIMER_HANDLE;
+  replay.end_timer = BX_NULL_TIMER_HANDLE;
+  if (mode == BX_REPLAY_MODE_NONE) return;
+
+  if (SIM->get_param_bool(BXPN_RESTORE_FLAG)->get()) {
+    BX_PANIC(("replay: recording and replaying start at power on, not from a saved state"));
+    return;
+  }
+  // host time must not drive the emulated clock
+  bx_param_enum_c *sync = SIM->get_param_enum(BXPN_CLOCK_SYNC);
+  if ((sync->get() == BX_CLOCK_SYNC_REALTIME) || (sync->get() == BX_CLOCK_SYNC_BOTH)) {
+    BX_INFO(("replay: clock sync realtime is replaced by %s",
+             (sync->get() == BX_CLOCK_SYNC_BOTH) ? "slowdown" : "none"));
+    sync->set((sync->get() == BX_CLOCK_SYNC_BOTH) ? BX_CLOCK_SYNC_SLOWDOWN : BX_CLOCK_SYNC_NONE);
+  }
+
+  replay.fp = fopen(path, (mode == BX_REPLAY_MODE_RECORD) ? "wb" : "rb");
+  if (replay.fp == NULL) {
+    BX_PANIC(("replay: could not open log file '%s'", path));
+    return;
+  }
+  replay.iobuf = new char[BX_REPLAY_BUFSIZE];
+  setvbuf(replay.fp, replay.iobuf, _IOFBF, BX_REPLAY_BUFSIZE);
+
+  bx_param_num_c *time0 = SIM->get_param_num(BXPN_CLOCK_TIME0);
+  if (mode == BX_REPLAY_MODE_RECORD) {
+    // the start time is taken once and kept in the log
+    if ((time0->get() == BX_CLOCK_TIME0_LOCAL) || (time0->get() == BX_CLOCK_TIME0_UTC)) {
+      time_t now = time(NULL);
+#if BX_HAVE_GMTIME && BX_HAVE_MKTIME
+      if (time0->get() == BX_CLOCK_TIME0_UTC) {
+        struct tm *utc = gmtime(&now);
+        utc->tm_isdst = -1;
+        now = mktime(utc);
+      }
+#endif
+      time0->set((Bit64s) now);
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BX_REPLAY_MAGIC, 8);
+    header.version = BX_REPLAY_VERSION;
+    header.ips = (Bit32u) SIM->get_param_num(BXPN_IPS)->get();
+    header.time0 = time0->get64();
+    header.mem_size = SIM->get_param_num(BXPN_MEM_SIZE)->get64();
+    fwrite(&header, sizeof(header), 1, replay.fp);
+    BX_INFO(("replay: recording to '%s'", path));
+  } else {
+    if ((fread(&header, sizeof(header), 1, replay.fp) != 1) ||
+        memcmp(header.magic, BX_REPLAY_MAGIC, 8) || (header.version != BX_REPLAY_VERSION)) {
+      BX_PANIC(("replay: '%s' is not a replay log", path));
+      fclose(replay.fp);
+      replay.fp = NULL;
+      return;
+    }
+    if (header.mem_size != SIM->get_param_num(BXPN_MEM_SIZE)->get64()) {
+      BX_PANIC(("replay: the log was recorded with " FMT_LL "u MB of memory", header.mem_size));
+    }
+    // the recording decides how instructions map to emulated time
+    SIM->get_param_num(BXPN_IPS)->set(header.ips);
+    time0->set(header.time0);
+    bx_replay_read_next();
+    BX_INFO(("replay: replaying '%s'", path));
+  }
+  bx_replay_mode = mode;
+}
+
+void bx_replay_init(void)
+{
+  if (bx_replay_mode == BX_REPLAY_MODE_NONE) return;
+
+  replay.check_timer = bx_pc_system.register_timer_ticks(NULL, bx_replay_check_timer,
+      BX_REPLAY_CHECK_TICKS, 1 /* continuous */, 1, "replay.check");
+  if (BX_REPLAY_REPLAYING) {
+    // the end record is the last one in the file, find it without reading all
+    char magic[8];
+    Bit64u end_tick;
+    long pos = ftell(replay.fp);
+    if ((fseek(replay.fp, -16, SEEK_END) == 0) && (fread(magic, 8, 1, replay.fp) == 1) &&
+        (fread(&end_tick, 8, 1, replay.fp) == 1) && !memcmp(magic, BX_REPLAY_END_MAGIC, 8)) {
+      if (end_tick > bx_pc_system.time_ticks()) {
+        replay.end_timer = bx_pc_system.register_timer_ticks(NULL, bx_replay_end_timer,
+            end_tick - bx_pc_system.time_ticks(), 0, 1, "replay.end");
+      }
+    } else {
+      BX_ERROR(("replay: the log has no end record, the recording did not end normally"));
+    }
+    fseek(replay.fp, pos, SEEK_SET);
+  }
+}
+
+void bx_replay_exit(void)
+{
+  if (replay.fp == NULL) return;
+
+  if (BX_REPLAY_RECORDING) {
+    Bit64u now = bx_pc_system.time_ticks();
+    bx_replay_put(BX_REPLAY_END, 0, 16);
+    bx_replay_put_data(BX_REPLAY_END_MAGIC, 8);
+    bx_replay_put_data(&now, 8);
+    BX_INFO(("replay: recorded " FMT_LL "u records (" FMT_LL "u bytes) over " FMT_LL "u instructions",
+             replay.records, replay.bytes, now));
+  } else if (BX_REPLAY_REPLAYING) {
+    BX_INFO(("replay: " FMT_LL "u records replayed", replay.records));
+  }
+  fclose(replay.fp);
+  replay.fp = NULL;
+  delete [] replay.iobuf;
+  replay.iobuf = NULL;
+  bx_replay_mode = BX_REPLAY_MODE_NONE;
+}
+
+void bx_replay_put(Bit8u type, Bit8u channel, Bit32u len)
+{
+  Bit64u now = bx_pc_system.time_ticks();
+
+  fputc(type, replay.fp);
+  fputc(channel, replay.fp);
+  replay.bytes += 2;
+  bx_replay_put_varint(now - replay.last_tick);
+  bx_replay_put_varint(len);
+  replay.last_tick = now;
+  replay.records++;
+}
+
+void bx_replay_put_data(const void *data, Bit32u len)
+{
+  if (len == 0) return;
+  if (fwrite(data, 1, len, replay.fp) != len) {
+    BX_PANIC(("replay: could not write the log"));
+  }
+  replay.bytes += len;
+}
+
+void bx_replay_record(Bit8u type, Bit8u channel, const void *data, Bit32u len)
+{
+  bx_replay_put(type, channel, len);
+  bx_replay_put_data(data, len);
+}
+
+Bit8u bx_replay_peek(void)
+{
+  if (!replay.have_next || (replay.next_tick != bx_pc_system.time_ticks()))
+    return 0;
+  return replay.next_type;
+}
+
+bx_bool bx_replay_get(Bit8u type, Bit8u channel, Bit32u *len)
+{
+  if (!replay.have_next) return 0;
+  Bit64u now = bx_pc_system.time_ticks();
+  if (replay.next_tick < now) {
+    // nobody took it when it was due
+    bx_replay_diverged(replay.next_type, replay.next_channel);
+    return 0;
+  }
+  if ((replay.next_tick != now) || (replay.next_type != type) || (replay.next_channel != channel))
+    return 0;
+  *len = replay.next_len;
+  replay.unread = replay.next_len;
+  replay.records++;
+  // the payload is read before the next header
+  replay.have_next = 0;
+  if (replay.unread == 0)
+    bx_replay_read_next();
+  return 1;
+}
+
+void bx_replay_get_data(void *data, Bit32u len)
+{
+  if (len == 0) return;
+  if (len > replay.unread) {
+    BX_PANIC(("replay: read past the end of a record"));
+    len = replay.unread;
+  }
+  if (fread(data, 1, len, replay.fp) != len) {
+    BX_PANIC(("replay: the log ends in the middle of a record"));
+  }
+  replay.unread -= len;
+  if (replay.unread == 0)
+    bx_replay_read_next();
+}
+
+Bit32s bx_replay_read(Bit8u type, Bit8u channel, void *data, Bit32u maxlen)
+{
+  Bit32u len;
+
+  if (!BX_REPLAY_REPLAYING) return -1;
+  if (!bx_replay_get(type, channel, &len)) {
+    bx_replay_diverged(type, channel);
+    return -1;
+  }
+  if (len > maxlen) {
+    bx_replay_diverged(type, channel);
+    return -1;
+  }
+  if (len > 0)
+    bx_replay_get_data(data, len);
+  return (Bit32s) len;
+}
+
+void bx_replay_inject_input(void)
+{
+  Bit8u type;
+  Bit32u len;
+
+  bx_replay_injecting = 1;
+  while (BX_REPLAY_REPLAYING &&
+         ((type = bx_replay_peek()) >= BX_REPLAY_KEY) && (type <= BX_REPLAY_MOUSE_EN)) {
+    bx_replay_get(type, 0, &len);
+    if (type == BX_REPLAY_KEY) {
+      Bit32u key;
+      bx_replay_get_data(&key, 4);
+      DEV_kbd_gen_scancode(key);
+    } else if (type == BX_REPLAY_MOUSE) {
+      Bit32s vals[4];
+      Bit8u absxy;
+      bx_replay_get_data(vals, 16);
+      bx_replay_get_data(&absxy, 1);
+      DEV_mouse_motion(vals[0], vals[1], vals[2], (unsigned) vals[3], absxy);
+    } else if (type == BX_REPLAY_PASTE) {
+      // the keyboard frees the buffer when the paste is done
+      Bit8u *bytes = new Bit8u[len];
+      if (len > 0)
+        bx_replay_get_data(bytes, len);
+      DEV_kbd_paste_bytes(bytes, (Bit32s) len);
+    } else {
+      Bit8u enabled;
+      bx_replay_get_data(&enabled, 1);
+      DEV_mouse_enabled_changed(enabled);
+    }
+  }
+  bx_replay_injecting = 0;
+}
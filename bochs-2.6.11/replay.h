@@ -0,0 +1,86 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_REPLAY_H
+#define BX_REPLAY_H
+
+// Deterministic record/replay. With the clock driven by the instruction
+// count only, everything the guest sees follows from the data that enters
+// from the host. A recording logs that data with the instruction count it
+// arrived at; a replay feeds the logged data back at the same counts and
+// never asks the host, so the run repeats exactly, also with the profiler
+// or an instrumentation library watching it.
+//
+// The log is one stream of records in the order they were made: type,
+// channel, the tick delta and the payload length as varints, the payload.
+// Consumers take the records in the same order when replaying.
+
+#define BX_REPLAY_MODE_NONE   0
+#define BX_REPLAY_MODE_RECORD 1
+#define BX_REPLAY_MODE_REPLAY 2
+
+// record types, the channel tells the device instances apart
+#define BX_REPLAY_KEY       1  // Bit32u bochs key code
+#define BX_REPLAY_MOUSE     2  // 4 x Bit32s deltas/buttons, Bit8u absxy
+#define BX_REPLAY_PASTE     3  // pasted bytes
+#define BX_REPLAY_MOUSE_EN  4  // Bit8u mouse capture state
+#define BX_REPLAY_SERIAL    5  // received byte, channel = port
+#define BX_REPLAY_DISK      6  // data read from an ATA disk image, channel = drive
+#define BX_REPLAY_PVBLK     7  // completed request: Bit32u status, read data
+#define BX_REPLAY_HOSTSHARE 8  // command result: status, value, memory writes
+#define BX_REPLAY_CHECK     9  // Bit32u hash of the cpu state
+#define BX_REPLAY_END       10 // end of the recording
+
+extern int bx_replay_mode;
+// set while logged input is given to the devices
+extern bx_bool bx_replay_injecting;
+
+#define BX_REPLAY_RECORDING (bx_replay_mode == BX_REPLAY_MODE_RECORD)
+#define BX_REPLAY_REPLAYING (bx_replay_mode == BX_REPLAY_MODE_REPLAY)
+
+// opens the log and pins the clock options, before the pc_system starts
+void bx_replay_open(void);
+// registers the timers, after the pc_system started
+void bx_replay_init(void);
+void bx_replay_exit(void);
+
+// recording: a record of len bytes at the current tick, the payload
+// follows in one or more bx_replay_put_data() calls
+void bx_replay_put(Bit8u type, Bit8u channel, Bit32u len);
+void bx_replay_put_data(const void *data, Bit32u len);
+void bx_replay_record(Bit8u type, Bit8u channel, const void *data, Bit32u len);
+
+// replaying: type of the record due at the current tick, 0 if none
+Bit8u bx_replay_peek(void);
+// takes the record due now if it has this type and channel
+bx_bool bx_replay_get(Bit8u type, Bit8u channel, Bit32u *len);
+void bx_replay_get_data(void *data, Bit32u len);
+// takes a record that must be due now, returns its length (at most maxlen
+// bytes are copied) or -1 after reporting the divergence
+Bit32s bx_replay_read(Bit8u type, Bit8u channel, void *data, Bit32u maxlen);
+
+// replaying: reports that the guest left the recorded run and ends the replay
+void bx_replay_diverged(Bit8u type, Bit8u channel);
+
+// replaying: hands the keyboard and mouse input due now to the devices
+void bx_replay_inject_input(void);
+
+#endif
@@ -0,0 +1,419 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+/////////////////////////////////////////////////////////////////////////
+
+#include "bochs.h"
+#include "param_names.h"
+#include "cpu/cpu.h"
+#include "replay.h"
+
+#define LOG_THIS genlog->
+
+#if BX_SUPPORT_SMP
+
+// upper bound of a slice in instructions, the next timer event usually
+// ends it earlier
+#define BX_SMP_SLICE_MAX   2048
+// iterations a waiting thread spins before it yields the host cpu
+#define BX_SMP_SPIN_COUNT  4096
+// code writes remembered for a processor before its whole trace cache
+// is flushed instead
+#define BX_SMP_SMC_ENTRIES 16
+
+bx_bool bx_smp_threaded = 0;
+volatile bx_bool bx_smp_slice_active = 0;
+BX_THREAD_LOCAL BX_CPU_C *bx_smp_cpu = NULL;
+
+struct bx_smp_msgs_t {
+  Bit32u msg;
+  bx_bool intr;
+  Bit32u fixed[8];    // fixed and lowest priority APIC interrupts
+  Bit32u level[8];    // level triggered ones among them
+  Bit32u extint[8];
+  bx_bool sipi;
+  Bit8u sipi_vector;
+  unsigned smc_count;
+  struct {
+    bx_phy_address pAddr;
+    Bit32u mask;
+  } smc[BX_SMP_SMC_ENTRIES];
+};
+
+struct bx_smp_mailbox_t {
+  BX_THREAD_VAR(thread);
+  BX_MUTEX(lock);
+  volatile bx_bool pending;
+  bx_smp_msgs_t m;
+};
+
+static bx_smp_mailbox_t *smp_mailbox = NULL;
+
+static BX_MUTEX(smp_big_lock);
+static BX_THREAD_LOCAL unsigned smp_lock_depth = 0;
+
+// slice control, written by the main thread between the slices
+static Bit32u smp_generation = 0;
+static Bit32u smp_done = 0;
+static Bit32u smp_slice_len = 0;
+static volatile bx_bool smp_quit = 0;
+// set by a processor to end the slice early
+static volatile bx_bool smp_stop = 0;
+static volatile unsigned smp_reset_type = 0;
+
+void bx_smp_lock_slow(void)
+{
+  if (smp_lock_depth++ == 0)
+    BX_LOCK(smp_big_lock);
+}
+
+void bx_smp_unlock_slow(void)
+{
+  if (--smp_lock_depth == 0)
+    BX_UNLOCK(smp_big_lock);
+}
+
+// an exception unwinds with longjmp() past the lock guards
+static void smp_lock_release_all(void)
+{
+  if (smp_lock_depth > 0) {
+    smp_lock_depth = 0;
+    BX_UNLOCK(smp_big_lock);
+  }
+}
+
+// the target breaks out of its trace and looks at the mailbox
+static BX_CPP_INLINE void smp_notify(BX_CPU_C *cpu)
+{
+  BX_ATOMIC_OR32(&cpu->async_event, BX_ASYNC_EVENT_STOP_TRACE);
+}
+
+void bx_smp_post(BX_CPU_C *cpu, Bit32u msg)
+{
+  bx_smp_mailbox_t *mb = &smp_mailbox[cpu->bx_cpuid];
+
+  BX_LOCK(mb->lock);
+  mb->m.msg |= msg;
+  mb->pending = 1;
+  BX_UNLOCK(mb->lock);
+  smp_notify(cpu);
+}
+
+void bx_smp_post_intr(BX_CPU_C *cpu, bx_bool level)
+{
+  bx_smp_mailbox_t *mb = &smp_mailbox[cpu->bx_cpuid];
+
+  BX_LOCK(mb->lock);
+  mb->m.msg |= BX_SMP_MSG_INTR;
+  mb->m.intr = level;
+  mb->pending = 1;
+  BX_UNLOCK(mb->lock);
+  smp_notify(cpu);
+}
+
+void bx_smp_post_smc(BX_CPU_C *cpu, bx_phy_address pAddr, Bit32u mask)
+{
+  bx_smp_mailbox_t *mb = &smp_mailbox[cpu->bx_cpuid];
+
+  BX_LOCK(mb->lock);
+  if (! (mb->m.msg & BX_SMP_MSG_ICACHE_FLUSH)) {
+    if (mb->m.smc_count < BX_SMP_SMC_ENTRIES) {
+      mb->m.smc[mb->m.smc_count].pAddr = pAddr;
+      mb->m.smc[mb->m.smc_count].mask = mask;
+      mb->m.smc_count++;
+    }
+    else {
+      mb->m.msg |= BX_SMP_MSG_ICACHE_FLUSH;
+    }
+  }
+  mb->pending = 1;
+  BX_UNLOCK(mb->lock);
+  smp_notify(cpu);
+}
+
+bx_bool bx_smp_post_apic(BX_CPU_C *cpu, Bit8u vector, Bit8u delivery_mode, Bit8u trig_mode)
+{
+#if BX_SUPPORT_APIC
+  bx_smp_mailbox_t *mb = &smp_mailbox[cpu->bx_cpuid];
+  Bit32u bit = 1 << (vector & 31);
+
+  BX_LOCK(mb->lock);
+  switch(delivery_mode) {
+  case APIC_DM_FIXED:
+  case APIC_DM_LOWPRI:
+    mb->m.fixed[vector >> 5] |= bit;
+    if (trig_mode)
+      mb->m.level[vector >> 5] |= bit;
+    else
+      mb->m.level[vector >> 5] &= ~bit;
+    break;
+  case APIC_DM_SMI:
+    mb->m.msg |= BX_SMP_MSG_SMI;
+    break;
+  case APIC_DM_NMI:
+    mb->m.msg |= BX_SMP_MSG_NMI;
+    break;
+  case APIC_DM_INIT:
+    mb->m.msg |= BX_SMP_MSG_INIT;
+    break;
+  case APIC_DM_SIPI:
+    mb->m.sipi = 1;
+    mb->m.sipi_vector = vector;
+    break;
+  case APIC_DM_EXTINT:
+    mb->m.extint[vector >> 5] |= bit;
+    break;
+  default:
+    BX_UNLOCK(mb->lock);
+    return 0;
+  }
+  mb->pending = 1;
+  BX_UNLOCK(mb->lock);
+  smp_notify(cpu);
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+bx_bool bx_smp_receive(BX_CPU_C *cpu)
+{
+  bx_smp_mailbox_t *mb = &smp_mailbox[cpu->bx_cpuid];
+  bx_smp_msgs_t m;
+  unsigned n;
+
+  if (! bx_smp_threaded || ! mb->pending) return 0;
+
+  BX_LOCK(mb->lock);
+  m = mb->m;
+  memset(&mb->m, 0, sizeof(mb->m));
+  mb->pending = 0;
+  BX_UNLOCK(mb->lock);
+
+  if (m.msg & BX_SMP_MSG_TLB_FLUSH)
+    cpu->TLB_flush();
+
+  if (m.msg & BX_SMP_MSG_ICACHE_FLUSH) {
+    cpu->iCache.flushICacheEntries();
+    cpu->pde_cache_flush();
+    cpu->TLB_flushInactive();
+  }
+  else if (m.smc_count) {
+    for (n = 0; n < m.smc_count; n++) {
+      cpu->iCache.handleSMC(m.smc[n].pAddr, m.smc[n].mask);
+      cpu->pde_cache_invalidate(m.smc[n].pAddr);
+    }
+    cpu->TLB_flushInactive();
+  }
+
+#if BX_SUPPORT_MONITOR_MWAIT
+  if (m.msg & BX_SMP_MSG_MONITOR)
+    cpu->wakeup_monitor();
+#endif
+
+  if (m.msg & BX_SMP_MSG_INTR) {
+    if (m.intr)
+      cpu->raise_INTR();
+    else
+      cpu->clear_INTR();
+  }
+  if (m.msg & BX_SMP_MSG_NMI)
+    cpu->deliver_NMI();
+  if (m.msg & BX_SMP_MSG_SMI)
+    cpu->deliver_SMI();
+  if (m.msg & BX_SMP_MSG_INIT)
+    cpu->deliver_INIT();
+
+#if BX_SUPPORT_APIC
+  for (n = 0; n < 256; n++) {
+    Bit32u bit = 1 << (n & 31);
+    if (m.fixed[n >> 5] & bit)
+      cpu->lapic.deliver(n, APIC_DM_FIXED, (m.level[n >> 5] & bit) != 0);
+    if (m.extint[n >> 5] & bit)
+      cpu->lapic.deliver(n, APIC_DM_EXTINT, 0);
+  }
+  if (m.sipi)
+    cpu->lapic.deliver(m.sipi_vector, APIC_DM_SIPI, 0);
+#endif
+
+  if (m.msg & BX_SMP_MSG_KICK)
+    cpu->async_event = 1;
+
+  return 1;
+}
+
+void bx_smp_request_reset(unsigned type)
+{
+  BX_SMP_LOCK_SCOPE();
+
+  // a hardware reset includes the software one
+  if (smp_reset_type != BX_RESET_HARDWARE)
+    smp_reset_type = type;
+  smp_stop = 1;
+}
+
+bx_bool bx_smp_init(void)
+{
+  if (bx_replay_mode != BX_REPLAY_MODE_NONE) {
+    BX_ERROR(("smp_threads: not available with record/replay, the processors share one thread"));
+    return 0;
+  }
+#if BX_LARGE_RAMFILE
+  if (SIM->get_param_num(BXPN_HOST_MEM_SIZE)->get64() < SIM->get_param_num(BXPN_MEM_SIZE)->get64()) {
+    BX_ERROR(("smp_threads: not available when guest memory is swapped to a file, the processors share one thread"));
+    return 0;
+  }
+#endif
+
+  BX_INIT_MUTEX(smp_big_lock);
+  smp_mailbox = new bx_smp_mailbox_t[BX_SMP_PROCESSORS];
+  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++) {
+    BX_INIT_MUTEX(smp_mailbox[i].lock);
+    smp_mailbox[i].pending = 0;
+    memset(&smp_mailbox[i].m, 0, sizeof(smp_mailbox[i].m));
+  }
+
+  bx_smp_threaded = 1;
+  BX_INFO(("smp_threads: running %d processors on their own host threads", BX_SMP_PROCESSORS));
+  return 1;
+}
+
+// Runs up to 'slice' instructions on the processor. A halted processor
+// gives up the rest of the slice, an interrupt posted to it is taken at
+// the start of the next one.
+static void smp_run_slice(BX_CPU_C *cpu, Bit32u slice)
+{
+  bx_smp_mailbox_t *mb = &smp_mailbox[cpu->bx_cpuid];
+  Bit64u stop = cpu->icount + slice;
+
+  if (setjmp(BX_CPU_C::jmp_buf_env)) {
+    // can get here only from exception function or VMEXIT
+    smp_lock_release_all();
+    cpu->icount++;
+  }
+
+  while (cpu->icount < stop) {
+    if (mb->pending) bx_smp_receive(cpu);
+
+    Bit64u before = cpu->icount;
+    cpu->cpu_run_trace();
+    if (cpu->icount == before && cpu->activity_state != BX_CPU_C::BX_ACTIVITY_STATE_ACTIVE)
+      break;
+
+    if (smp_stop || bx_pc_system.kill_bochs_request)
+      break;
+  }
+}
+
+static void smp_wait(Bit32u *var, Bit32u old)
+{
+  unsigned spins = 0;
+
+  while (BX_ATOMIC_LOAD_ACQ(var) == old) {
+    if (++spins < BX_SMP_SPIN_COUNT) continue;
+    // the guest is idle or the host is overcommitted
+    BX_MSLEEP((spins < 64 * BX_SMP_SPIN_COUNT) ? 0 : 1);
+  }
+}
+
+BX_THREAD_FUNC(smp_cpu_thread, arg)
+{
+  BX_CPU_C *cpu = BX_CPU((unsigned)(bx_ptr_equiv_t) arg);
+  Bit32u generation = 0;
+
+  bx_smp_cpu = cpu;
+  while (1) {
+    smp_wait(&smp_generation, generation);
+    generation = BX_ATOMIC_LOAD_ACQ(&smp_generation);
+    if (smp_quit) break;
+    smp_run_slice(cpu, smp_slice_len);
+    BX_ATOMIC_INC32(&smp_done);
+  }
+  BX_THREAD_EXIT;
+}
+
+void bx_smp_run(void)
+{
+  const unsigned n = BX_SMP_PROCESSORS;
+  unsigned i;
+
+  for (i=1; i<n; i++)
+    BX_THREAD_CREATE(smp_cpu_thread, (void *)(bx_ptr_equiv_t) i, smp_mailbox[i].thread);
+
+  while (1) {
+    Bit32u slice = (Bit32u) bx_pc_system.getNumCpuTicksLeftNextEvent();
+    if (slice > BX_SMP_SLICE_MAX) slice = BX_SMP_SLICE_MAX;
+    if (slice == 0) slice = 1;
+
+    Bit64u executed = 0;
+    for (i=0; i<n; i++)
+      executed -= BX_CPU(i)->get_icount();
+
+    smp_slice_len = slice;
+    smp_stop = 0;
+    BX_ATOMIC_STORE_REL(&smp_done, 0);
+    bx_smp_slice_active = 1;
+    bx_smp_cpu = BX_CPU(0);
+    // start the other processors
+    BX_ATOMIC_STORE_REL(&smp_generation, smp_generation + 1);
+
+    smp_run_slice(BX_CPU(0), slice);
+
+    Bit32u done;
+    while ((done = BX_ATOMIC_LOAD_ACQ(&smp_done)) != n - 1)
+      smp_wait(&smp_done, done);
+    bx_smp_cpu = NULL;
+    bx_smp_slice_active = 0;
+
+    // all processors stopped, messages still pending are applied here
+    bx_bool woken = 0;
+    for (i=0; i<n; i++) {
+      if (bx_smp_receive(BX_CPU(i))) woken = 1;
+      executed += BX_CPU(i)->get_icount();
+      BX_CPU(i)->sync_icount();
+    }
+
+    if (smp_reset_type) {
+      unsigned type = smp_reset_type;
+      smp_reset_type = 0;
+      bx_pc_system.Reset(type);
+      woken = 1;
+    }
+
+    if (bx_pc_system.kill_bochs_request)
+      break;
+
+    if (executed == 0 && !woken) {
+      // nothing but a timer can wake the processors up, so jump
+      // to the next timed event
+      BX_TICKN(bx_pc_system.getNumCpuTicksLeftNextEvent());
+    }
+    else {
+      BX_TICKN(slice);
+    }
+  }
+
+  smp_quit = 1;
+  BX_ATOMIC_STORE_REL(&smp_generation, smp_generation + 1);
+  for (i=1; i<n; i++)
+    BX_THREAD_JOIN(smp_mailbox[i].thread);
+  bx_smp_threaded = 0;
+}
+
+#endif
@@ -0,0 +1,105 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_SMP_H
+#define BX_SMP_H
+
+// Threaded SMP simulation. With 'cpu: smp_threads=1' the main thread runs
+// CPU 0 and every other processor gets a host thread of its own. All of
+// them run in lockstep slices that end at the next timer event, so the
+// virtual clock is only advanced between two slices, by the main thread,
+// when no processor is running. Timers and the GUI therefore always run
+// on the main thread.
+//
+// During a slice the device models, the timer list and the memory
+// handlers are serialized by one recursive lock. A processor never
+// changes the state of another one directly: TLB and trace cache
+// invalidations, interrupts, INIT and SIPI are posted to the mailbox of
+// the target, which applies them between two traces.
+
+#if BX_SUPPORT_SMP
+
+class BX_CPU_C;
+
+// mailbox messages
+#define BX_SMP_MSG_TLB_FLUSH    0x0001
+#define BX_SMP_MSG_ICACHE_FLUSH 0x0002
+#define BX_SMP_MSG_MONITOR      0x0004  // wake up from MWAIT, clear the monitor
+#define BX_SMP_MSG_NMI          0x0008
+#define BX_SMP_MSG_SMI          0x0010
+#define BX_SMP_MSG_INIT         0x0020
+#define BX_SMP_MSG_INTR         0x0040  // INTR line changed, the last level wins
+#define BX_SMP_MSG_KICK         0x0080  // look at the async events again (DMA)
+
+// set when the processors run on their own threads
+extern bx_bool bx_smp_threaded;
+// set while the processors execute a slice
+extern volatile bx_bool bx_smp_slice_active;
+// the processor run by the calling thread during a slice, NULL otherwise
+extern BX_THREAD_LOCAL BX_CPU_C *bx_smp_cpu;
+
+// is the processor run by another thread than the caller ?
+#define BX_SMP_REMOTE(cpu) (bx_smp_cpu != NULL && bx_smp_cpu != (cpu))
+
+void bx_smp_lock_slow(void);
+void bx_smp_unlock_slow(void);
+
+// the device lock is only taken from a processor thread during a slice,
+// it may be taken again by the thread holding it
+BX_CPP_INLINE void bx_smp_lock(void)
+{
+  if (bx_smp_cpu != NULL) bx_smp_lock_slow();
+}
+
+BX_CPP_INLINE void bx_smp_unlock(void)
+{
+  if (bx_smp_cpu != NULL) bx_smp_unlock_slow();
+}
+
+class bx_smp_lock_c {
+public:
+  bx_smp_lock_c() { bx_smp_lock(); }
+ ~bx_smp_lock_c() { bx_smp_unlock(); }
+};
+
+#define BX_SMP_LOCK_SCOPE() bx_smp_lock_c bx_smp_lock_guard
+
+void bx_smp_post(BX_CPU_C *cpu, Bit32u msg);
+void bx_smp_post_intr(BX_CPU_C *cpu, bx_bool level);
+void bx_smp_post_smc(BX_CPU_C *cpu, bx_phy_address pAddr, Bit32u mask);
+bx_bool bx_smp_post_apic(BX_CPU_C *cpu, Bit8u vector, Bit8u delivery_mode, Bit8u trig_mode);
+// apply the messages posted to the processor, returns 0 if there were none
+bx_bool bx_smp_receive(BX_CPU_C *cpu);
+
+// a reset requested by a processor is done by the main thread after the slice
+void bx_smp_request_reset(unsigned type);
+
+// checks the configuration, returns 0 if the threaded mode can't be used
+bx_bool bx_smp_init(void);
+void bx_smp_run(void);
+
+#else
+
+#define BX_SMP_LOCK_SCOPE()
+
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+###### 由kernel.bin的大小生成loader用的kernel_sectors.inc，写到标准输出 ######
+###### 用法: sh boot/kernel_sectors.sh build/kernel.bin boot/include/boot.inc ######
+###### kernel.bin超出暂存区，或各段装入后越过KERNEL_IMAGE_LIMIT时报错退出 ######
+
+kernel=$1
+inc=$2
+
+#取boot.inc中的常量
+boot_val() {
+    awk -v name="$1" '$1 == name { print $3; exit }' "$inc"
+}
+
+max_sectors=$(( $(boot_val KERNEL_MAX_SECTORS) ))
+virt_base=$(( $(boot_val KERNEL_VIRT_BASE) ))
+image_limit=$(( $(boot_val KERNEL_IMAGE_LIMIT) ))
+
+size=$(stat -c %s "$kernel") || exit 1
+sectors=$(( (size + 511) / 512 ))
+if [ $sectors -gt $max_sectors ]; then
+    echo "$kernel: $sectors sectors, more than KERNEL_MAX_SECTORS ($max_sectors)" >&2
+    exit 1
+fi
+
+#_end为.bss的结束地址，各段都装在它之下
+end=$(nm "$kernel" | awk '$3 == "_end" { print $1 }')
+if [ -z "$end" ]; then
+    echo "$kernel: no _end symbol" >&2
+    exit 1
+fi
+image_end=$(( 0x$end - virt_base ))
+if [ $image_end -gt $image_limit ]; then
+    printf '%s: image ends at 0x%x, above KERNEL_IMAGE_LIMIT (0x%x)\n' "$kernel" $image_end $image_limit >&2
+    exit 1
+fi
+
+echo ";由makefile按kernel.bin的大小生成,不要手改"
+echo "KERNEL_SECTOR_CNT       equ $sectors"
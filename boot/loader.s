@@ -2,6 +2,7 @@
     ;创建日期:2020-2-18 23:15
     
     %include "boot.inc"
+    %include "kernel_sectors.inc"
 
 ;=======================================================
     section loader vstart=LOADER_BASE_ADDR
@@ -44,6 +45,8 @@
 ;========================================================
 loader_start:                   ;#0x900+0xb00+0x100 = 0x900+0x300 = 0xc00
 
+    mov [boot_drive],dl         ;mbr传来的启动盘号,int 0x13读盘要用
+
     xor ebx,ebx                 ;第一次调用时,ebx值为0
     mov edx,0x534d4150          ;只赋值一次,在循环体中不会改变
     mov di,ards_buf             ;ards 结构缓冲区
@@ -55,8 +58,11 @@ loader_start:                   ;#0x900+0xb00+0x100 = 0x900+0x300 = 0xc00
     jc .e820_failed_so_try_e801 ;若cf位为1,则发生错误,就去尝试使用0xe801子功能
     add di,cx                   ;使di增加20字节指向缓冲区中新的ards结构的位置
     inc word [ards_nr]          ;记录ARDS的数量
+    cmp word [ards_nr],12       ;ards_buf只能放12个ARDS,放满后不再取,免得覆盖后面的代码
+    je .e820_get_done
     cmp ebx,0                   ;若ebx为0,且cf不为1,说明ARDS全部返回,当前已经是最后一个
     jnz .e820_mem_get_loop
+.e820_get_done:
 
     ;在所有ARDS结构中,找出(base_add_low + length_low)的最大值,即内存的容量
     mov cx,[ards_nr]            ;遍历每一个ARDS结构体,循环次数为ARDS的数量
@@ -128,6 +134,9 @@ loader_start:                   ;#0x900+0xb00+0x100 = 0x900+0x300 = 0xc00
 
     mov [total_mem_bytes],edx
 
+    ;实模式下先试着用BIOS扩展读把kernel.bin读到暂存区,不支持时进入保护模式后再用端口读
+    call bios_load_kernel
+
 ;------------ 准备进入保护模式 ------------
 ;1 打开A20
 ;2 加载GDT
@@ -166,12 +175,25 @@ p_mode_start:
     ;jmp $
 
 ;--------------------------------------------------------
-    ;加载kernel.bin
+    ;加载kernel.bin,实模式下已经用BIOS读入时跳过
+    cmp byte [kernel_loaded],1
+    je .kernel_ready
     mov eax,KERNEL_START_SECTOR             ;kernel.bin所在扇区号
-    mov ebx,KERNEL_BIN_BASE_ADDR            ;kernel.bin的起始物理地址
-    mov ecx,200                             ;读入的扇区数
+    mov ebx,KERNEL_BIN_BASE_ADDR            ;kernel.bin暂存的物理地址
+    mov ecx,KERNEL_SECTOR_CNT               ;读入的扇区数
 
     call rd_disk_m_32
+.kernel_ready:
+
+    ;暂存区在1MB以上,分页后访问不到,在分页前按物理地址装好各段
+    call kernel_init
+
+    ;暂存区属于内核物理内存池,清0后再交给内核
+    cld
+    xor eax,eax
+    mov edi,KERNEL_BIN_BASE_ADDR
+    mov ecx,KERNEL_SECTOR_CNT * 128
+    rep stosd
 
 ;--------------------------------------------------------
     ;创建页目录及页表并初始化页内存位图
@@ -208,12 +230,11 @@ p_mode_start:
 
 enter_kernel:
     mov byte [gs:162],'V'
-    call kernel_init
     mov esp,0xc009f000
     jmp KERNEL_ENTRY_POINT              ;用地址0x1500访问测试
 
 ;--------------------------------------------------------
-kernel_init:                            ;初始化内核的代码
+kernel_init:                            ;把暂存区中kernel.bin的各段复制到物理地址p_vaddr-KERNEL_VIRT_BASE
     xor eax,eax
     xor ebx,ebx                         ;记录程序头表地址
     xor ecx,ecx                         ;cx记录程序头表中的program header数量
@@ -227,16 +248,32 @@ kernel_init:                            ;初始化内核的代码
 .each_segment:
     cmp byte [ebx + 0],PT_NULL          ;若p_type 等于NULL,说明次program header未使用
     je .PTNULL
+    mov eax,[ebx + 8]
+    add eax,[ebx + 16]
+    cmp eax,KERNEL_ENTRY_POINT          ;整个在内核入口之下的段只有ELF头,内核用不到,
+    jbe .PTNULL                         ;复制到0x1000会覆盖loader自己,跳过
     
     ;为函数memcpy压入参数,参数从右向左一次压入,函数原型类似于memcpy(dst, src, size)
     push dword [ebx + 16]               ;程序头p_filesize,压入函数memcpy的第三个参数:size
     mov eax,[ebx + 4]                   ;p_offset
     add eax,KERNEL_BIN_BASE_ADDR        ;加上kernel.bin被加载到的物理地址,eax为该段的物理地址
     push eax                            ;压入函数的第二个参数:源地址,src
-    push dword [ebx + 8]                ;压入函数的第一个参数,目的地址,dst
+    mov eax,[ebx + 8]                   ;p_vaddr
+    sub eax,KERNEL_VIRT_BASE            ;还没有分页,换成物理地址
+    push eax                            ;压入函数的第一个参数,目的地址,dst
 
     call mem_cpy                        ;段复制
     add esp,12                          ;清理栈中压入的三个参数
+
+    ;段在内存中比文件中多出的部分(.bss)清0
+    push ecx
+    mov edi,eax
+    add edi,[ebx + 16]                  ;dst + p_filesz
+    mov ecx,[ebx + 20]                  ;p_memsz
+    sub ecx,[ebx + 16]
+    xor eax,eax
+    rep stosb
+    pop ecx
 .PTNULL:
     add ebx,edx                         ;edx为program header大小,即e_phentsize
 
@@ -258,6 +295,10 @@ mem_cpy:                        ;mem_cpy(dst, src, size)
     mov edi,[ebp + 8]           ;dst
     mov esi,[ebp + 12]          ;src
     mov ecx,[ebp + 16]          ;size
+    shr ecx,2                   ;先按4字节复制
+    rep movsd
+    mov ecx,[ebp + 16]
+    and ecx,3                   ;再复制不足4字节的尾部
     rep movsb
 
     pop ecx
@@ -315,48 +356,83 @@ set_page:                       ;创建页目录及页表
 
 ;----------------------------------------------------
 rd_disk_m_32:						;eax=LBA扇区号
-									;bx=将数据写入的内存地址
-									;cx=读入的扇区数
+									;ebx=将数据写入的内存地址
+									;ecx=读入的扇区数,按DISK_BATCH_SECTORS分批读
+	cld
+	push eax						;备份eax
+	mov edi,ebx						;rep insw写入es:edi
+	mov ebp,ecx						;ebp记录还没读入的扇区数
 	
-	mov esi,eax						;备份eax
-	mov di,cx						;备份cx
-;读写硬盘:
-;step 1:设置要读取的扇区数
+;step 1:设置READ MULTIPLE每块的扇区数,硬盘不支持时退回每块一个扇区的READ SECTORS
+	mov dx,0x1f6
+	mov al,0xe0						;lba模式,主盘
+	out dx,al
+	mov dx,0x1f2
+	mov al,DISK_BLOCK_SECTORS
+	out dx,al
+	mov dx,0x1f7
+	mov al,0xc6						;SET MULTIPLE MODE
+	out dx,al
+.set_multiple_wait:
+	in al,dx
+	test al,0x80					;等待硬盘不忙
+	jnz .set_multiple_wait
+	mov ebx,DISK_BLOCK_SECTORS		;ebx为每块的扇区数
+	mov esi,0xc4					;esi为读命令,READ MULTIPLE
+	test al,0x01					;ERR位为1表示命令失败
+	jz .set_count
+	mov ebx,1
+	mov esi,0x20					;READ SECTORS
+
+;step 2:设置这一批要读取的扇区数
+.set_count:
+	pop ecx							;ecx为这一批的LBA地址
+.next_batch:
+	mov eax,ebp
+	cmp eax,DISK_BATCH_SECTORS
+	jbe .batch_size_ok
+	mov eax,DISK_BATCH_SECTORS
+.batch_size_ok:
+	sub ebp,eax
+	push ebp						;这一批之后还没读入的扇区数
+	mov ebp,eax						;ebp记录这一批还没读入的扇区数
 	mov dx,0x1f2
-	mov al,cl
 	out dx,al						;读取的扇区数
 
-	mov eax,esi						;恢复eax
+	mov eax,ecx
+	add ecx,ebp
+	push ecx						;下一批的LBA地址
 
-;step 2:将LBA地址存入0x1f3~0x1f6
+;step 3:将LBA地址存入0x1f3~0x1f6
 
 	;LBA地址7~0位写入0x1f3
 	mov dx,0x1f3
 	out dx,al
 
 	;LBA地址15~8位写入0x1f4
-	mov cl,8
-	shr eax,cl
+	shr eax,8
 	mov dx,0x1f4
 	out dx,al
 
 	;LBA地址23~16位写入0x1f5
-	shr eax,cl
+	shr eax,8
 	mov dx,0x1f5
 	out dx,al
 
-	shr eax,cl
+	shr eax,8
 	and al,0x0f						;lba第27~24位
 	or al,0xe0						;设置0x1f6 7~4位1110,表示lba模式
 	mov dx,0x1f6
 	out dx,al
 
-;step 3:向0x1f7端口写入读命令,0x20
+;step 4:向0x1f7端口写入读命令
 	mov dx,0x1f7
-	mov al,0x20
+	mov eax,esi
 	out dx,al
 
-;step 4:检测硬盘状态
+;step 5:每块检测一次硬盘状态,再从0x1f0端口整块读入
+.next_block:
+	mov dx,0x1f7
 .not_ready:
 	;同一端口,写时表示命令字,读时表示读入硬盘状态
 	nop								;空操作,什么也不做,为了增加延迟,减少打扰硬盘的工作
@@ -365,17 +441,126 @@ rd_disk_m_32:						;eax=LBA扇区号
 	cmp al,0x08
 	jnz .not_ready
 
-;step 5:从0x1f0端口读数据
-	mov ax,di
-	mov dx,256
-	mul dx
-	mov cx,ax						;设置循环次数,每次读取一个字,一个扇区512字节
-
+	mov ecx,ebx
+	cmp ecx,ebp
+	jbe .block_size_ok
+	mov ecx,ebp						;最后一块不足整块
+.block_size_ok:
+	sub ebp,ecx
+	shl ecx,8						;每个扇区256个字
 	mov dx,0x1f0
-.go_on_read:
-	in ax,dx
-	mov [ebx],ax
-	add ebx,2
-	loop .go_on_read
+	rep insw
+
+	cmp ebp,0
+	jnz .next_block
+
+	pop ecx
+	pop ebp
+	cmp ebp,0
+	jnz .next_batch
 	
 	ret    
+
+;----------------------------------------------------
+	[bits 16]
+;----------------------------------------------------
+bios_load_kernel:					;用int 0x13扩展读把kernel.bin分块读到KERNEL_BOUNCE_ADDR,
+									;每块再用int 0x15 ah=0x87搬到1MB以上的KERNEL_BIN_BASE_ADDR
+									;全部读入时置kernel_loaded为1,BIOS不支持或出错时直接返回
+
+	;ah=0x41检测是否支持扩展读
+	mov ah,0x41
+	mov bx,0x55aa
+	mov dl,[boot_drive]
+	int 0x13
+	jc .done
+	cmp bx,0xaa55
+	jne .done
+	test cx,1						;cx第0位表示支持ah=0x42等磁盘访问功能
+	jz .done
+
+	mov dword [dap_lba],KERNEL_START_SECTOR
+	mov dword [move_dst],KERNEL_BIN_BASE_ADDR
+	mov cx,KERNEL_SECTOR_CNT		;cx记录还没读入的扇区数
+.next_chunk:
+	mov ax,cx
+	cmp ax,BIOS_READ_SECTORS
+	jbe .chunk_size_ok
+	mov ax,BIOS_READ_SECTORS
+.chunk_size_ok:
+	mov [dap_cnt],ax
+	push cx
+	push ax
+	mov si,disk_addr_packet
+	mov ah,0x42
+	mov dl,[boot_drive]
+	int 0x13
+	jc .chunk_done
+
+	;目的描述符的段基址设为这一块在暂存区中的位置,es:si指向int 0x15要用的gdt
+	mov eax,[move_dst]
+	mov [move_dst_desc + 2],ax
+	shr eax,16
+	mov [move_dst_desc + 4],al
+	mov [move_dst_desc + 7],ah
+	pop cx
+	push cx
+	shl cx,8						;搬动的字数,每个扇区256个字
+	mov si,move_gdt
+	mov ah,0x87
+	int 0x15
+.chunk_done:
+	pop ax
+	pop cx
+	jc .done						;出错时退回端口读,从头重读
+
+	sub cx,ax
+	movzx eax,ax
+	add [dap_lba],eax
+	shl eax,9						;每个扇区512字节
+	add [move_dst],eax
+	cmp cx,0
+	jnz .next_chunk
+
+	mov byte [kernel_loaded],1
+.done:
+	ret
+
+;----------------------------------------------------
+	;int 0x13扩展读的磁盘地址包
+disk_addr_packet:
+	db 0x10							;包的大小
+	db 0
+dap_cnt:
+	dw 0							;读入的扇区数
+dap_off:
+	dw 0							;缓冲区的偏移
+dap_seg:
+	dw KERNEL_BOUNCE_ADDR >> 4		;缓冲区的段
+dap_lba:
+	dq 0							;起始扇区的LBA地址
+
+;----------------------------------------------------
+	;int 0x15 ah=0x87搬动内存用的gdt,第0,1,4,5项由BIOS填写
+move_gdt:
+	dq 0
+	dq 0
+move_src_desc:						;源:KERNEL_BOUNCE_ADDR
+	dw 0xffff						;段界限
+	dw KERNEL_BOUNCE_ADDR & 0xffff	;段基址15~0位
+	db (KERNEL_BOUNCE_ADDR >> 16) & 0xff	;段基址23~16位
+	db 0x93							;存在,可读写的数据段
+	dw (KERNEL_BOUNCE_ADDR >> 16) & 0xff00	;段基址31~24位在高字节
+move_dst_desc:						;目的:暂存区中这一块的位置,每块读入后设置
+	dw 0xffff
+	dw 0
+	db 0
+	db 0x93
+	dw 0
+	dq 0
+	dq 0
+
+move_dst		dd 0				;下一块在暂存区中的物理地址
+
+boot_drive		db 0				;启动盘号
+kernel_loaded	db 0				;kernel.bin是否已在实模式下读入
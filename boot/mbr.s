@@ -9,6 +9,7 @@ SECTION MBR vstart=0x7c00
     mov ss,ax
     mov fs,ax
     mov sp,0x7c00
+    push dx							;BIOS在dl中传来启动盘号,留给loader用int 0x13读盘
     mov ax,0xb800
     mov gs,ax
 ;清屏
@@ -49,9 +50,10 @@ SECTION MBR vstart=0x7c00
 
 	mov eax,LOADER_START_SECTOR		;起始扇区lba地址
 	mov bx,LOADER_BASE_ADDR			;写入的地址
-	mov cx,4						;待读取的扇区数
+	mov cx,LOADER_SECTOR_CNT		;待读取的扇区数
 	call rd_disk_m_16				;读取程序的起始部分(一个扇区)
 
+	pop dx							;dl为启动盘号
 	jmp LOADER_BASE_ADDR + 0x300
 
 ;------------------------------------------------------------------
@@ -112,14 +114,12 @@ rd_disk_m_16:						;eax=LBA扇区号
 	mov ax,di
 	mov dx,256
 	mul dx
-	mov cx,ax						;设置循环次数,每次读取一个字,一个扇区512字节
+	mov cx,ax						;设置读取的字数,一个扇区512字节
 
+	mov di,bx						;rep insw写入es:di
 	mov dx,0x1f0
-.go_on_read:
-	in ax,dx
-	mov [bx],ax
-	add bx,2
-	loop .go_on_read
+	cld
+	rep insw
 	
 	ret
 
@@ -4,7 +4,7 @@
 
 int main(int argc, char** argv)
 {
-    if(argc > 2 || argc == 1) {
+    if(argc > 2) {
         printf("cat: only support 1 argument.\neg: cat filename\n");
         exit(-2);
     }
@@ -15,12 +15,21 @@ int main(int argc, char** argv)
         printf("cat: malloc memory failed\n");
         return -1;
     }
+    //不带参数时把标准输入复制到标准输出，用在管道线的后面
+    if(argc == 1) {
+        int got;
+        while((got = read(0, buf, buf_size)) > 0) {
+            write(1, buf, got);
+        }
+        free(buf);
+        return 0;
+    }
     if(argv[1][0] != '/') {
         getcwd(abs_path, 512);
         strcat(abs_path, "/");
         strcat(abs_path, argv[1]);
     } else {
-        strcpy(abs_path, argv);
+        strcpy(abs_path, argv[1]);
     }
     int fd = open(abs_path, O_RDONLY);
     int read_bytes = 0;
@@ -28,12 +37,12 @@ int main(int argc, char** argv)
         printf("cat: open: open %s failed\n", argv[1]);
         return -1;
     }
+    //文件内容在内核中直接送到标准输出或管道，不再经过buf中转
     while(1) {
-        read_bytes = read(fd, buf, buf_size);
-        if(read_bytes == -1) {
+        read_bytes = sendfile(1, fd, NULL, buf_size);
+        if(read_bytes <= 0) {
             break;
         }
-        write(1, buf, read_bytes);
     }
     free(buf);
     close(fd);
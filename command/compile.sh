@@ -16,17 +16,16 @@ CFLAGS="-m32 -Wall -c -fno-builtin -fno-stack-protector -W -Wstrict-prototypes \
 		 -Wmissing-prototypes -Wsystem-headers"
 LIB="-I ../lib -I ../lib/user -I ../fs"
 OBJS="../build/string.o ../build/syscall.o \
-      ../build/stdio.o ../build/assert.o start.o"
-DD_IN=$BIN
-DD_OUT="/home/huloves/bochs-2.6.11/hd60M.img"
+      ../build/stdio.o ../build/assert.o ../build/mutex.o ../build/malloc.o ../build/stream.o start.o"
+#编译好的程序放进bochs的hostshare目录，在系统中用import命令导入，不用重启
+SHARE_DIR=${SHARE_DIR:-"/home/huloves/bochs-2.6.11/share"}   #可用环境变量SHARE_DIR指定
 
 nasm -f elf ./start.s -o ./start.o
 ar rcs simple_crt.a $OBJS start.o
 gcc $CFLAGS -I $LIB -o $BIN".o" $BIN".c"
 ld -m elf_i386 $BIN".o" simple_crt.a -o $BIN
-SET_CNT=$(ls -l $BIN|awk '{printf("%d", ($5+511)/512)}')
 
 if [[ -f $BIN ]];then
-    dd if=./$DD_IN of=$DD_OUT bs=512 \
-    count=20 seek=300 conv=notrunc
+    mkdir -p $SHARE_DIR
+    cp ./$BIN $SHARE_DIR/
 fi
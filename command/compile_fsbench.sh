@@ -0,0 +1,32 @@
+###### 此脚本在command目录下执行 ######
+
+if [[ ! -d "../lib" || ! -d "../build" ]];then
+    echo "dependent dir don\'t exist"
+    cwd=$(pwd)
+    cwd=${cwd##*/}
+    cwd=${cwd%/}
+    if [ $cwd != "command" ];then
+        echo -e "you\'d better in command dir\n"
+    fi
+    exit
+fi
+
+BIN="fsbench"
+CFLAGS="-nostdinc -m32 -Wall -c -fno-builtin -fno-stack-protector -W -Wstrict-prototypes \
+		 -Wmissing-prototypes -Wsystem-headers"
+LIB="-I ../lib -I ../lib/user/ -I ../lib/kernel/ -I ../kernel/ -I ../device/ -I ../thread/ \
+     -I ../userprog/ -I ../fs/ -I ../shell/"
+OBJS="../build/string.o ../build/syscall.o \
+      ../build/stdio.o ../build/assert.o ../build/mutex.o ../build/malloc.o ../build/stream.o start.o ../build/print.o ../build/vdso.o"
+#编译好的程序放进bochs的hostshare目录，在系统中用import命令导入，不用重启
+SHARE_DIR=${SHARE_DIR:-"/home/huloves/bochs-2.6.11/share"}   #可用环境变量SHARE_DIR指定
+
+nasm -f elf ./start.s -o ./start.o
+ar rcs simple_crt.a $OBJS start.o
+gcc $CFLAGS $LIB -o $BIN".o" $BIN".c"
+ld -m elf_i386 $BIN".o" simple_crt.a -o $BIN
+
+if [[ -f $BIN ]];then
+    mkdir -p $SHARE_DIR
+    cp ./$BIN $SHARE_DIR/
+fi
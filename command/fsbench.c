@@ -0,0 +1,341 @@
+#include "syscall.h"
+#include "stdio.h"
+#include "string.h"
+#include "fs.h"
+#include "dir.h"
+#include "vdso.h"
+
+#define TICKS_PER_SEC 100   //时钟中断的频率，与内核的IRQ0_FREQUENCY一致
+#define BENCH_DIR "/fsbench"
+#define BENCH_FILE "/fsbench/data"
+#define FILE_SIZE (512 * 1024)   //测试文件大小，比块缓存大，顺序读要读硬盘
+#define IO_SIZE 4096   //顺序读写时每次读写的字节数
+#define SEQ_PASSES 4   //顺序读写的遍数
+#define RAND_READS 1000   //随机读的次数
+#define META_FILES 64   //创建删除测试和目录测试的文件数
+#define READDIR_PASSES 50   //遍历目录的遍数
+#define MIX_FILES 32   //随机混合负载中轮流使用的文件名数
+#define MIX_DIRS 8   //随机混合负载中轮流使用的目录名数
+#define MIX_OPS 600   //随机混合负载的操作数
+#define MIX_WRITE_MAX 3000   //随机混合负载中一次追加写的最大字节数
+
+static char io_buf[IO_SIZE];
+static uint32_t rand_seed = 12345;
+
+/*线性同余伪随机数*/
+static uint32_t bench_rand(void)
+{
+    rand_seed = rand_seed * 1103515245 + 12345;
+    return rand_seed >> 16;
+}
+
+/*打印一项结果，amount是ticks个滴答内完成的量*/
+static void report(const char* name, uint32_t amount, const char* unit, uint32_t ticks)
+{
+    if(ticks == 0) {   //不足一个滴答，按一个算
+        ticks = 1;
+    }
+    printf("%s: %d %s in %d ticks, %d %s/s\n", name, amount, unit, ticks, amount * TICKS_PER_SEC / ticks, unit);
+}
+
+/*把i拼在prefix后面作为文件名写入buf*/
+static void make_name(char* buf, const char* prefix, uint32_t i)
+{
+    sprintf(buf, "%s/%s%d", BENCH_DIR, prefix, i);
+}
+
+/*顺序写：每遍新建文件写满FILE_SIZE字节并fsync*/
+static int32_t bench_seq_write(void)
+{
+    uint32_t start = vdso_uptime();
+    uint32_t pass;
+    for(pass = 0; pass < SEQ_PASSES; pass++) {
+        unlink(BENCH_FILE);
+        int32_t fd = open(BENCH_FILE, O_CREAT | O_RDWR);
+        if(fd == -1) {
+            printf("fsbench: create %s failed\n", BENCH_FILE);
+            return -1;
+        }
+        uint32_t done;
+        for(done = 0; done < FILE_SIZE; done += IO_SIZE) {
+            memset(io_buf, (char)(pass + done / IO_SIZE), IO_SIZE);
+            if(write(fd, io_buf, IO_SIZE) != IO_SIZE) {
+                printf("fsbench: write failed\n");
+                close(fd);
+                return -1;
+            }
+        }
+        fsync(fd);
+        close(fd);
+    }
+    report("seq write", SEQ_PASSES * FILE_SIZE / 1024, "KB", vdso_uptime() - start);
+    return 0;
+}
+
+/*顺序读：按IO_SIZE读完整个文件，文件比块缓存大，每遍都要读硬盘，能看出预读的效果*/
+static int32_t bench_seq_read(void)
+{
+    int32_t fd = open(BENCH_FILE, O_RDONLY);
+    if(fd == -1) {
+        printf("fsbench: open %s failed\n", BENCH_FILE);
+        return -1;
+    }
+    uint32_t start = vdso_uptime();
+    uint32_t pass, total = 0;
+    for(pass = 0; pass < SEQ_PASSES; pass++) {
+        lseek(fd, 0, SEEK_SET);
+        int32_t bytes;
+        while((bytes = read(fd, io_buf, IO_SIZE)) > 0) {
+            total += bytes;
+        }
+    }
+    report("seq read", total / 1024, "KB", vdso_uptime() - start);
+    close(fd);
+    return 0;
+}
+
+/*随机读：在文件内随机选512字节对齐的位置读一个扇区*/
+static int32_t bench_rand_read(void)
+{
+    int32_t fd = open(BENCH_FILE, O_RDONLY);
+    if(fd == -1) {
+        printf("fsbench: open %s failed\n", BENCH_FILE);
+        return -1;
+    }
+    uint32_t start = vdso_uptime();
+    uint32_t i;
+    for(i = 0; i < RAND_READS; i++) {
+        lseek(fd, (bench_rand() % (FILE_SIZE / 512)) * 512, SEEK_SET);
+        if(read(fd, io_buf, 512) != 512) {
+            printf("fsbench: random read failed\n");
+            close(fd);
+            return -1;
+        }
+    }
+    report("rand read 512B", RAND_READS, "ops", vdso_uptime() - start);
+    close(fd);
+    return 0;
+}
+
+/*元数据操作：创建、删除文件和创建、删除目录*/
+static int32_t bench_meta(void)
+{
+    char name[MAX_PATH_LEN];
+    uint32_t i, start;
+
+    start = vdso_uptime();
+    for(i = 0; i < META_FILES; i++) {
+        make_name(name, "f", i);
+        int32_t fd = open(name, O_CREAT | O_RDWR);
+        if(fd == -1) {
+            printf("fsbench: create %s failed\n", name);
+            return -1;
+        }
+        close(fd);
+    }
+    report("create", META_FILES, "ops", vdso_uptime() - start);
+
+    start = vdso_uptime();
+    for(i = 0; i < META_FILES; i++) {
+        make_name(name, "f", i);
+        unlink(name);
+    }
+    report("unlink", META_FILES, "ops", vdso_uptime() - start);
+
+    start = vdso_uptime();
+    for(i = 0; i < META_FILES; i++) {
+        make_name(name, "d", i);
+        if(mkdir(name) == -1) {
+            printf("fsbench: mkdir %s failed\n", name);
+            return -1;
+        }
+    }
+    report("mkdir", META_FILES, "ops", vdso_uptime() - start);
+
+    start = vdso_uptime();
+    for(i = 0; i < META_FILES; i++) {
+        make_name(name, "d", i);
+        rmdir(name);
+    }
+    report("rmdir", META_FILES, "ops", vdso_uptime() - start);
+    return 0;
+}
+
+/*目录遍历：在有META_FILES个文件的目录上反复readdir*/
+static int32_t bench_readdir(void)
+{
+    char name[MAX_PATH_LEN];
+    uint32_t i;
+    for(i = 0; i < META_FILES; i++) {
+        make_name(name, "r", i);
+        int32_t fd = open(name, O_CREAT | O_RDWR);
+        if(fd == -1) {
+            printf("fsbench: create %s failed\n", name);
+            return -1;
+        }
+        close(fd);
+    }
+
+    struct dir* dir = opendir(BENCH_DIR);
+    if(dir == NULL) {
+        printf("fsbench: opendir %s failed\n", BENCH_DIR);
+        return -1;
+    }
+    uint32_t start = vdso_uptime();
+    uint32_t pass, entries = 0;
+    for(pass = 0; pass < READDIR_PASSES; pass++) {
+        rewinddir(dir);
+        while(readdir(dir) != NULL) {
+            entries++;
+        }
+    }
+    report("readdir", entries, "entries", vdso_uptime() - start);
+    closedir(dir);
+
+    for(i = 0; i < META_FILES; i++) {
+        make_name(name, "r", i);
+        unlink(name);
+    }
+    return 0;
+}
+
+/*随机混合负载：随机建文件、追加写、删文件、建删目录和遍历目录，边做边核对文件大小和目录项数*/
+static int32_t bench_mix(void)
+{
+    static uint32_t file_size[MIX_FILES];   //各文件应有的大小
+    static bool file_exist[MIX_FILES], dir_exist[MIX_DIRS];
+    char name[MAX_PATH_LEN];
+    uint32_t entries = 2;   //目录中应有的项数，含.和..
+    uint32_t i, ops = 0, errors = 0;
+    memset(file_exist, 0, sizeof(file_exist));
+    memset(dir_exist, 0, sizeof(dir_exist));
+
+    uint32_t start = vdso_uptime();
+    for(i = 0; i < MIX_OPS; i++) {
+        uint32_t op = bench_rand() % 6;
+        uint32_t f = bench_rand() % MIX_FILES, d = bench_rand() % MIX_DIRS;
+        if(op == 0 && !file_exist[f]) {   //建文件
+            make_name(name, "m", f);
+            int32_t fd = open(name, O_CREAT | O_RDWR);
+            if(fd == -1) {
+                printf("fsbench: create %s failed\n", name);
+                return -1;
+            }
+            close(fd);
+            file_exist[f] = true;
+            file_size[f] = 0;
+            entries++;
+        } else if(op == 1 && file_exist[f]) {   //追加写，写完核对大小
+            make_name(name, "m", f);
+            int32_t fd = open(name, O_RDWR);
+            uint32_t len = bench_rand() % MIX_WRITE_MAX + 1;
+            memset(io_buf, (char)f, len);
+            if(fd == -1 || write(fd, io_buf, len) != len) {
+                printf("fsbench: write %s failed\n", name);
+                return -1;
+            }
+            close(fd);
+            file_size[f] += len;
+            struct stat st;
+            if(stat(name, &st) == -1 || st.st_size != file_size[f]) {
+                printf("fsbench: %s size %d, expect %d\n", name, st.st_size, file_size[f]);
+                errors++;
+            }
+        } else if(op == 2 && file_exist[f]) {   //删文件
+            make_name(name, "m", f);
+            if(unlink(name) == -1) {
+                printf("fsbench: unlink %s failed\n", name);
+                errors++;
+            }
+            file_exist[f] = false;
+            entries--;
+        } else if(op == 3 && !dir_exist[d]) {   //建目录
+            make_name(name, "n", d);
+            if(mkdir(name) == -1) {
+                printf("fsbench: mkdir %s failed\n", name);
+                return -1;
+            }
+            dir_exist[d] = true;
+            entries++;
+        } else if(op == 4 && dir_exist[d]) {   //删目录
+            make_name(name, "n", d);
+            if(rmdir(name) == -1) {
+                printf("fsbench: rmdir %s failed\n", name);
+                errors++;
+            }
+            dir_exist[d] = false;
+            entries--;
+        } else if(op == 5) {   //遍历目录，核对项数
+            struct dir* dir = opendir(BENCH_DIR);
+            uint32_t cnt = 0;
+            if(dir == NULL) {
+                printf("fsbench: opendir %s failed\n", BENCH_DIR);
+                return -1;
+            }
+            while(readdir(dir) != NULL) {
+                cnt++;
+            }
+            closedir(dir);
+            if(cnt != entries) {
+                printf("fsbench: readdir got %d entries, expect %d\n", cnt, entries);
+                errors++;
+            }
+        } else {
+            continue;   //选中的操作做不了，不计数
+        }
+        ops++;
+    }
+    report("random mix", ops, "ops", vdso_uptime() - start);
+
+    for(i = 0; i < MIX_FILES; i++) {
+        if(file_exist[i]) {
+            make_name(name, "m", i);
+            unlink(name);
+        }
+    }
+    for(i = 0; i < MIX_DIRS; i++) {
+        if(dir_exist[i]) {
+            make_name(name, "n", i);
+            rmdir(name);
+        }
+    }
+    if(errors > 0) {
+        printf("fsbench: random mix found %d errors\n", errors);
+        return -1;
+    }
+    return 0;
+}
+
+/*跑完一项后检查文件系统的元数据，有不一致返回-1*/
+static int32_t bench_check(const char* name)
+{
+    struct fsck_report check;
+    int32_t errors = fsck(&check);
+    if(errors != 0) {
+        printf("fsbench: fsck after %s: %d errors\n", name, errors);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc UNUSED, char** argv UNUSED)
+{
+    struct stat st;
+    if(stat(BENCH_DIR, &st) == -1 && mkdir(BENCH_DIR) == -1) {
+        printf("fsbench: mkdir %s failed\n", BENCH_DIR);
+        return -1;
+    }
+    printf("fsbench: %d ticks per second\n", TICKS_PER_SEC);
+    int32_t ret = 0;
+    if(bench_seq_write() == -1 || bench_check("seq write") == -1 || bench_seq_read() == -1 || \
+       bench_rand_read() == -1 || bench_meta() == -1 || bench_check("meta") == -1 || \
+       bench_readdir() == -1 || bench_check("readdir") == -1 || bench_mix() == -1 || bench_check("random mix") == -1) {
+        ret = -1;
+    }
+    unlink(BENCH_FILE);
+    rmdir(BENCH_DIR);
+    if(ret == 0) {
+        ret = bench_check("cleanup");
+    }
+    return ret;
+}
@@ -3,6 +3,16 @@
 #include "stdint.h"
 #include "sync.h"
 #include "thread.h"
+#include "io.h"
+#include "string.h"
+
+#define VGA_BASE ((uint16_t*)0xc00b8000)   //显存文本模式起始地址，低端1M内存映射在内核空间
+#define VGA_COLS 80
+#define VGA_ROWS 25
+#define VGA_BLANK 0x0720   //黑底白字的空格
+#define VGA_ATTR 0x0700   //黑底白字的属性字节
+#define CRTC_ADDR 0x03d4   //CRT控制器索引寄存器
+#define CRTC_DATA 0x03d5   //CRT控制器数据寄存器
 
 static struct lock console_lock;   //控制台锁
 
@@ -24,20 +34,75 @@ void console_release()
     lock_release(&console_lock);
 }
 
-/*终端中输出字符串*/
-void console_put_str(char* str)
+/*从CRT控制器读出光标位置。put_str等汇编例程也会移动光标，所以每次写之前重新读*/
+static uint32_t cursor_get(void)
+{
+    outb(CRTC_ADDR, 0x0e);
+    uint32_t pos = inb(CRTC_DATA) << 8;
+    outb(CRTC_ADDR, 0x0f);
+    pos |= inb(CRTC_DATA);
+    return pos;
+}
+
+/*把光标设置到pos*/
+static void cursor_put(uint32_t pos)
+{
+    outb(CRTC_ADDR, 0x0e);
+    outb(CRTC_DATA, pos >> 8);
+    outb(CRTC_ADDR, 0x0f);
+    outb(CRTC_DATA, pos & 0xff);
+}
+
+/*屏幕上滚一行，以双字为单位一次搬动前24行，最后一行填空格*/
+static void screen_roll(void)
+{
+    uint32_t dword_cnt = (VGA_ROWS - 1) * VGA_COLS * 2 / 4;
+    void* src = VGA_BASE + VGA_COLS;
+    void* dst = VGA_BASE;
+    asm volatile ("cld; rep movsl" : "+S"(src), "+D"(dst), "+c"(dword_cnt) : : "memory");
+    uint32_t blank = VGA_BLANK | (VGA_BLANK << 16);
+    dword_cnt = VGA_COLS * 2 / 4;
+    asm volatile ("rep stosl" : "+D"(dst), "+c"(dword_cnt) : "a"(blank) : "memory");
+}
+
+/*把buf中len个字符直接写入显存，回车换行退格的处理同put_char，光标只在最后设置一次*/
+void console_write(const char* buf, uint32_t len)
 {
     console_acquire();
-    put_str(str);
+    volatile uint16_t* vga = VGA_BASE;
+    uint32_t pos = cursor_get();
+    uint32_t idx;
+    for(idx = 0; idx < len; idx++) {
+        uint8_t c = buf[idx];
+        if(c == '\n' || c == '\r') {
+            pos = pos - pos % VGA_COLS + VGA_COLS;
+        } else if(c == '\b') {
+            if(pos > 0) {
+                vga[--pos] = VGA_BLANK;
+            }
+            continue;
+        } else {
+            vga[pos++] = VGA_ATTR | c;
+        }
+        if(pos >= VGA_COLS * VGA_ROWS) {
+            screen_roll();
+            pos -= VGA_COLS;
+        }
+    }
+    cursor_put(pos);
     console_release();
 }
 
+/*终端中输出字符串*/
+void console_put_str(char* str)
+{
+    console_write(str, strlen(str));
+}
+
 /*终端中输出字符*/
 void console_put_char(uint8_t char_asci)
 {
-    console_acquire();
-    put_char(char_asci);
-    console_release();
+    console_write((const char*)&char_asci, 1);
 }
 
 /*终端输出十六进制整数*/
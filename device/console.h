@@ -8,6 +8,8 @@ void console_init(void);
 void console_acquire(void);
 /*释放终端*/
 void console_release(void);
+/*把buf中len个字符直接写入显存，光标只在最后设置一次*/
+void console_write(const char* buf, uint32_t len);
 /*终端中输出字符串*/
 void console_put_str(char* str);
 /*终端中输出字符*/
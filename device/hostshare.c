@@ -0,0 +1,184 @@
+#include "hostshare.h"
+#include "stdint.h"
+#include "global.h"
+#include "stdio-kernel.h"
+#include "string.h"
+#include "io.h"
+#include "memory.h"
+#include "pci.h"
+#include "sync.h"
+#include "fs.h"
+
+/*宿主机共享设备：宿主机上一个目录中的普通文件，导入时设备把文件内容直接写进本机内存，
+  每块数据只需几次端口读写，不必先dd进硬盘映像再重启从扇区读出*/
+
+#define PCI_CLASS_SYSTEM    0x08   //系统外设
+#define PCI_SUBCLASS_OTHER  0x80
+#define HOSTSHARE_VENDOR    0xfefe
+#define HOSTSHARE_DEVICE    0x0b11
+
+/*bar0中的寄存器，写命令寄存器时设备同步执行命令*/
+#define HOSTSHARE_REG_CMD       0x00   //命令
+#define HOSTSHARE_REG_ARG       0x04   //目录项序号或文件偏移
+#define HOSTSHARE_REG_ADDR      0x08   //缓冲区或段表的物理地址
+#define HOSTSHARE_REG_COUNT     0x0c   //缓冲区字节数或段表项数
+#define HOSTSHARE_REG_STATUS    0x10   //上条命令的状态
+#define HOSTSHARE_REG_VALUE     0x14   //上条命令的结果，文件大小或读出的字节数
+
+#define HOSTSHARE_CMD_ENTRY     1   //取目录项
+#define HOSTSHARE_CMD_OPEN      2   //按名字打开文件
+#define HOSTSHARE_CMD_READ      3   //按段表读打开的文件
+#define HOSTSHARE_CMD_CLOSE     4   //关闭文件
+
+#define HOSTSHARE_OK            0
+#define HOSTSHARE_ERR_END       1   //没有这一项
+#define HOSTSHARE_ERR_BADREQ    4   //参数不对，目录项时表示缓冲区放不下文件名
+
+#define HOSTSHARE_NAME_LEN  256   //设备接受的最长文件名，含结尾的0
+#define IMPORT_PAGES        16   //每条读命令传输的页数
+
+/*段表的一项，一段物理上连续的内存*/
+struct hostshare_seg
+{
+    uint32_t phys_addr;
+    uint32_t byte_cnt;
+};
+
+static uint16_t hostshare_io;   //bar0的io基址，为0表示没有设备
+static struct lock hostshare_lock;   //设备寄存器同一时刻只给一个命令用
+static void* hostshare_page;   //存放文件名和段表，占一页
+
+/*执行命令cmd，返回设备给出的状态，结果存入*value。需持有hostshare_lock*/
+static uint32_t hostshare_cmd(uint32_t cmd, uint32_t arg, uint32_t addr, uint32_t count, uint32_t* value)
+{
+    outl(hostshare_io + HOSTSHARE_REG_ARG, arg);
+    outl(hostshare_io + HOSTSHARE_REG_ADDR, addr);
+    outl(hostshare_io + HOSTSHARE_REG_COUNT, count);
+    outl(hostshare_io + HOSTSHARE_REG_CMD, cmd);
+    if(value != NULL) {
+        *value = inl(hostshare_io + HOSTSHARE_REG_VALUE);
+    }
+    return inl(hostshare_io + HOSTSHARE_REG_STATUS);
+}
+
+/*查找宿主机共享设备，没有时导入相关的系统调用都返回-1*/
+void hostshare_init(void)
+{
+    struct pci_dev pdev;
+    if(!pci_find_class(PCI_CLASS_SYSTEM, PCI_SUBCLASS_OTHER, &pdev) || \
+       pci_config_read(&pdev, PCI_VENDOR_ID) != ((HOSTSHARE_DEVICE << 16) | HOSTSHARE_VENDOR)) {
+        return;
+    }
+    uint32_t bar0 = pci_config_read(&pdev, PCI_BAR0);
+    if(!(bar0 & 0x1)) {
+        return;
+    }
+    hostshare_page = get_kernel_pages(1);
+    if(hostshare_page == NULL) {
+        return;
+    }
+    uint32_t cmd = pci_config_read(&pdev, PCI_COMMAND);
+    pci_config_write(&pdev, PCI_COMMAND, cmd | PCI_CMD_IO | PCI_CMD_MASTER);
+    lock_init(&hostshare_lock);
+    hostshare_io = bar0 & 0xfffc;
+    printk("hostshare at 0x%x\n", hostshare_io);
+}
+
+/*取共享目录中第idx个文件的名字和大小存入entry，idx为0时设备重新列目录。
+  成功返回0，文件名太长、无法导入时返回1，idx超出范围或没有设备返回-1*/
+int32_t sys_hostshare_list(uint32_t idx, struct hostshare_entry* entry)
+{
+    if(hostshare_io == 0) {
+        return -1;
+    }
+    char* name = hostshare_page;
+    char kname[MAX_FILE_NAME_LEN];   //先复制到内核栈上，entry在用户空间，写它可能缺页，放在锁外
+    uint32_t size;
+    int32_t ret = -1;
+    lock_acquire(&hostshare_lock);
+    if(hostshare_cmd(HOSTSHARE_CMD_ENTRY, idx, addr_v2p((uint32_t)name), HOSTSHARE_NAME_LEN, &size) == HOSTSHARE_OK) {
+        ret = strlen(name) < MAX_FILE_NAME_LEN ? 0 : 1;
+        memcpy(kname, name, MAX_FILE_NAME_LEN - 1);
+        kname[MAX_FILE_NAME_LEN - 1] = 0;
+    }
+    lock_release(&hostshare_lock);
+    if(ret != -1) {
+        strcpy(entry->name, kname);
+        entry->size = size;
+    }
+    return ret;
+}
+
+/*按buf所在的物理页填写段表，物理上相接的页并成一段，返回段数*/
+static uint32_t import_segs(struct hostshare_seg* segs, void* buf)
+{
+    uint32_t seg_idx = 0, pg_idx;
+    for(pg_idx = 0; pg_idx < IMPORT_PAGES; pg_idx++) {
+        uint32_t paddr = addr_v2p((uint32_t)buf + pg_idx * PG_SIZE);
+        if(seg_idx > 0 && segs[seg_idx - 1].phys_addr + segs[seg_idx - 1].byte_cnt == paddr) {
+            segs[seg_idx - 1].byte_cnt += PG_SIZE;
+        } else {
+            segs[seg_idx].phys_addr = paddr;
+            segs[seg_idx].byte_cnt = PG_SIZE;
+            seg_idx++;
+        }
+    }
+    return seg_idx;
+}
+
+/*把共享目录中的文件name复制到本机文件系统的path，path已存在时先删除。返回复制的字节数，失败返回-1*/
+int32_t sys_hostshare_import(const char* name, const char* path)
+{
+    uint32_t name_len = strlen(name);
+    if(hostshare_io == 0 || name_len == 0 || name_len >= HOSTSHARE_NAME_LEN) {
+        return -1;
+    }
+    void* buf = get_kernel_pages(IMPORT_PAGES);
+    if(buf == NULL) {
+        return -1;
+    }
+    int32_t fd = sys_open(path, O_CREAT | O_WRONLY);
+    if(fd == -1) {   //已存在的文件先删除再新建，删除会让命令查找缓存中的旧解析结果失效
+        sys_unlink(path);
+        fd = sys_open(path, O_CREAT | O_WRONLY);
+    }
+    if(fd == -1) {
+        mfree_page(PF_KERNEL, buf, IMPORT_PAGES);
+        return -1;
+    }
+
+    lock_acquire(&hostshare_lock);
+    char* kname = hostshare_page;
+    memcpy(kname, name, name_len);
+    uint32_t size, done = 0;
+    int32_t ret = -1;
+    if(hostshare_cmd(HOSTSHARE_CMD_OPEN, 0, addr_v2p((uint32_t)kname), name_len, &size) == HOSTSHARE_OK) {
+        struct hostshare_seg* segs = hostshare_page;   //文件名已经用过，这一页改放段表
+        uint32_t seg_cnt = import_segs(segs, buf);
+        while(done < size) {
+            uint32_t got;
+            if(hostshare_cmd(HOSTSHARE_CMD_READ, done, addr_v2p((uint32_t)segs), seg_cnt, &got) != HOSTSHARE_OK || got == 0) {
+                break;
+            }
+            if(got > size - done) {   //导入过程中宿主机上的文件变长了，只取打开时的大小
+                got = size - done;
+            }
+            if(sys_write(fd, buf, got) != (int32_t)got) {
+                break;
+            }
+            done += got;
+        }
+        hostshare_cmd(HOSTSHARE_CMD_CLOSE, 0, 0, 0, NULL);
+        if(done == size) {
+            ret = done;
+        }
+    }
+    lock_release(&hostshare_lock);
+
+    sys_close(fd);
+    if(ret == -1) {   //不留下只复制了一部分的文件
+        sys_unlink(path);
+    }
+    mfree_page(PF_KERNEL, buf, IMPORT_PAGES);
+    return ret;
+}
@@ -0,0 +1,22 @@
+#ifndef __DEVICE_HOSTSHARE_H
+#define __DEVICE_HOSTSHARE_H
+#include "stdint.h"
+#include "global.h"
+#include "dir.h"
+
+/*sys_hostshare_list返回的一项，宿主机共享目录中的一个文件*/
+struct hostshare_entry
+{
+    char name[MAX_FILE_NAME_LEN];   //文件名，过长时截断
+    uint32_t size;   //文件字节数
+};
+
+/*查找宿主机共享设备，没有时导入相关的系统调用都返回-1*/
+void hostshare_init(void);
+/*取共享目录中第idx个文件的名字和大小存入entry，idx为0时设备重新列目录。
+  成功返回0，文件名太长、无法导入时返回1，idx超出范围或没有设备返回-1*/
+int32_t sys_hostshare_list(uint32_t idx, struct hostshare_entry* entry);
+/*把共享目录中的文件name复制到本机文件系统的path，path已存在时先删除。返回复制的字节数，失败返回-1*/
+int32_t sys_hostshare_import(const char* name, const char* path);
+
+#endif
@@ -0,0 +1,202 @@
+#include "hrtimer.h"
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "io.h"
+#include "print.h"
+#include "debug.h"
+#include "interrupt.h"
+#include "thread.h"
+#include "smp.h"
+
+#define PIT_INPUT_FREQUENCY 1193180
+#define PIT_CONTROL_PORT 0x43
+#define PIT_COUNTER2_PORT 0x42
+#define PIT_COUNTER2_ONESHOT 0xb0   //2号计数器，先低后高字节，模式0：计数到0时输出变为1
+#define PIT_GATE_PORT 0x61   //位0为2号计数器的gate，位1为扬声器，位5为2号计数器的输出
+#define PIT_GATE2 0x01
+#define PIT_SPEAKER 0x02
+#define PIT_OUT2 0x20
+#define CALIBRATE_MS 10   //校准时让2号计数器计的毫秒数
+
+static uint32_t tsc_per_us;   //每微秒的时钟周期数，由hrtimer_init校准
+static uint64_t boot_tsc;   //校准时的时间戳计数器，作为hrtimer_now_us的零点
+static struct list hrtimer_list;   //等待到期的定时器，按到期时刻从早到晚排列
+
+static uint64_t rdtsc(void)
+{
+    uint64_t tsc;
+    asm volatile ("rdtsc" : "=A"(tsc));
+    return tsc;
+}
+
+/*64位数除以32位数，商超过32位时返回0xffffffff。内核不链接libgcc，没有64位除法*/
+uint32_t div_u64_u32(uint64_t n, uint32_t d)
+{
+    uint32_t hi = (uint32_t)(n >> 32);
+    if(hi >= d) {
+        return 0xffffffff;
+    }
+    uint32_t quot, rem;
+    asm ("divl %4" : "=a"(quot), "=d"(rem) : "a"((uint32_t)n), "d"(hi), "rm"(d));
+    return quot;
+}
+
+/*用8253的2号计数器单次计CALIBRATE_MS毫秒，数这段时间的时钟周期，不依赖中断*/
+void hrtimer_init(void)
+{
+    put_str("hrtimer_init start\n");
+    list_init(&hrtimer_list);
+    uint16_t count = PIT_INPUT_FREQUENCY / 1000 * CALIBRATE_MS;
+    uint8_t gate = inb(PIT_GATE_PORT);
+    outb(PIT_GATE_PORT, (gate & ~PIT_SPEAKER) | PIT_GATE2);
+    outb(PIT_CONTROL_PORT, PIT_COUNTER2_ONESHOT);
+    outb(PIT_COUNTER2_PORT, (uint8_t)count);
+    outb(PIT_COUNTER2_PORT, (uint8_t)(count >> 8));   //写完高字节开始计数
+    uint64_t start = rdtsc();
+    while(!(inb(PIT_GATE_PORT) & PIT_OUT2));
+    boot_tsc = rdtsc();
+    outb(PIT_GATE_PORT, gate);
+    tsc_per_us = div_u64_u32(boot_tsc - start, CALIBRATE_MS * 1000);
+    if(tsc_per_us == 0) {
+        tsc_per_us = 1;
+    }
+    put_str("   tsc cycles per us: "); put_int(tsc_per_us); put_char('\n');
+    put_str("hrtimer_init done\n");
+}
+
+/*返回开机以来的微秒数，由时间戳计数器推算，其他cpu的时间戳计数器可能与0号cpu略有偏差*/
+uint64_t hrtimer_now_us(void)
+{
+    uint64_t delta = rdtsc() - boot_tsc;
+    uint32_t hi = div_u64_u32(delta >> 32, tsc_per_us);   //先除高32位，避免商溢出
+    uint64_t rest = ((uint64_t)((uint32_t)(delta >> 32) - hi * tsc_per_us) << 32) | (uint32_t)delta;
+    return ((uint64_t)hi << 32) | div_u64_u32(rest, tsc_per_us);
+}
+
+/*忙等us微秒*/
+void udelay(uint32_t us)
+{
+    uint64_t end = rdtsc() + (uint64_t)us * tsc_per_us;
+    while((int64_t)(rdtsc() - end) < 0) {
+        asm volatile ("pause");
+    }
+}
+
+/*按队首的到期时刻设定0号cpu的单次中断，队列为空时停止。没有单次中断时靠时钟滴答检查*/
+static void hrtimer_program(void)
+{
+    if(!lapic_oneshot_ready()) {
+        return;
+    }
+    if(list_empty(&hrtimer_list)) {
+        lapic_oneshot_arm(0);
+        return;
+    }
+    struct hrtimer* first = elem2entry(struct hrtimer, tag, hrtimer_list.head.next);
+    int64_t left = (int64_t)(first->expires - rdtsc());
+    uint32_t us = left <= 0 ? 1 : div_u64_u32(left, tsc_per_us) + 1;   //向上取整，宁晚勿早
+    lapic_oneshot_arm(us);
+}
+
+/*让timer在us微秒后到期调用func，已在队列中时先摘下，需关中断调用*/
+void hrtimer_start(struct hrtimer* timer, uint32_t us, hrtimer_func func)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    if(timer->pending) {
+        list_remove(&timer->tag);
+    }
+    timer->expires = rdtsc() + (uint64_t)us * tsc_per_us;
+    timer->func = func;
+    timer->pending = true;
+
+    //按到期时刻插入，同一时刻的排在后面
+    struct list_elem* elem = hrtimer_list.head.next;
+    while(elem != &hrtimer_list.tail) {
+        struct hrtimer* t = elem2entry(struct hrtimer, tag, elem);
+        if((int64_t)(t->expires - timer->expires) > 0) {
+            break;
+        }
+        elem = elem->next;
+    }
+    list_insert_before(elem, &timer->tag);
+    if(hrtimer_list.head.next == &timer->tag) {   //成为最早到期的才需要重设
+        hrtimer_program();
+    }
+}
+
+/*摘下还没到期的timer，摘下返回true，已到期或没启动返回false，需关中断调用。
+  不重设单次中断，提前来的中断在hrtimer_expire中什么也不做*/
+bool hrtimer_cancel(struct hrtimer* timer)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    if(!timer->pending) {
+        return false;
+    }
+    list_remove(&timer->tag);
+    timer->pending = false;
+    return true;
+}
+
+/*处理到期的定时器并重新设定单次中断，由0号cpu的本地定时器中断和时钟中断关中断调用*/
+void hrtimer_expire(void)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    if(list_empty(&hrtimer_list)) {
+        return;
+    }
+    uint64_t now = rdtsc();
+    while(!list_empty(&hrtimer_list)) {
+        struct hrtimer* timer = elem2entry(struct hrtimer, tag, hrtimer_list.head.next);
+        if((int64_t)(timer->expires - now) > 0) {
+            break;
+        }
+        list_remove(&timer->tag);
+        timer->pending = false;
+        timer->func(timer);
+    }
+    hrtimer_program();
+}
+
+/*没有单次中断可用、要靠时钟滴答检查到期时返回true，此时0号cpu不能进入无滴答模式*/
+bool hrtimer_need_tick(void)
+{
+    return !list_empty(&hrtimer_list) && !lapic_oneshot_ready();
+}
+
+/*休眠中的线程，定时器到期时唤醒它*/
+struct hrtimer_sleeper
+{
+    struct hrtimer timer;
+    struct task_struct* task;
+};
+
+static void hrtimer_wakeup(struct hrtimer* timer)
+{
+    struct hrtimer_sleeper* sleeper = elem2entry(struct hrtimer_sleeper, timer, timer);
+    thread_unblock(sleeper->task);
+}
+
+/*以微秒为单位的sleep。很短的直接忙等，其余的挂上定时器阻塞，到期由0号cpu的单次中断唤醒，
+  没有单次中断时由时钟滴答唤醒，精度退化为一个滴答*/
+void utime_sleep(uint32_t us)
+{
+    if(us <= HRTIMER_SPIN_US) {
+        udelay(us);
+        return;
+    }
+    struct hrtimer_sleeper sleeper;
+    sleeper.timer.pending = false;
+    sleeper.task = running_thread();
+    enum intr_status old_status = intr_disable();
+    hrtimer_start(&sleeper.timer, us, hrtimer_wakeup);
+    thread_block(TASK_BLOCKED);
+    intr_set_status(old_status);
+}
+
+/*以微秒为单位的sleep，供用户进程调用，返回0*/
+int32_t sys_usleep(uint32_t us)
+{
+    utime_sleep(us);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef __DEVICE_HRTIMER_H
+#define __DEVICE_HRTIMER_H
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+
+#define HRTIMER_SPIN_US 20   //不超过这么多微秒的休眠直接忙等，不值得切换线程
+
+struct hrtimer;
+typedef void (*hrtimer_func)(struct hrtimer* timer);
+
+/*高精度定时器，到期时刻以时间戳计数器计。到期后在0号cpu上关中断调用func，func不能阻塞*/
+struct hrtimer
+{
+    uint64_t expires;   //到期时的时间戳计数器值
+    hrtimer_func func;
+    struct list_elem tag;   //在定时器队列中的标记
+    bool pending;   //是否在定时器队列中
+};
+
+/*用8253的2号计数器校准时间戳计数器，不依赖中断*/
+void hrtimer_init(void);
+/*64位数除以32位数，商超过32位时返回0xffffffff*/
+uint32_t div_u64_u32(uint64_t n, uint32_t d);
+/*返回开机以来的微秒数，由时间戳计数器推算*/
+uint64_t hrtimer_now_us(void);
+/*忙等us微秒*/
+void udelay(uint32_t us);
+/*让timer在us微秒后到期调用func，已在队列中时先摘下，需关中断调用*/
+void hrtimer_start(struct hrtimer* timer, uint32_t us, hrtimer_func func);
+/*摘下还没到期的timer，摘下返回true，已到期或没启动返回false，需关中断调用*/
+bool hrtimer_cancel(struct hrtimer* timer);
+/*处理到期的定时器并重新设定单次中断，由0号cpu的本地定时器中断和时钟中断关中断调用*/
+void hrtimer_expire(void);
+/*没有单次中断可用、要靠时钟滴答检查到期时返回true，此时0号cpu不能进入无滴答模式*/
+bool hrtimer_need_tick(void);
+/*以微秒为单位的sleep*/
+void utime_sleep(uint32_t us);
+/*以微秒为单位的sleep，供用户进程调用，返回0*/
+int32_t sys_usleep(uint32_t us);
+
+#endif
@@ -8,6 +8,14 @@
 #include "timer.h"
 #include "interrupt.h"
 #include "string.h"
+#include "memory.h"
+#include "pci.h"
+#include "thread.h"
+#include "init.h"
+#include "softirq.h"
+#include "hrtimer.h"
+#include "pvblk.h"
+#include "stripe.h"
 
 //ata通道不同寄存器的端口
 #define reg_data(channel)       (channel->port_base + 0)
@@ -26,6 +34,11 @@
 #define BIT_STAT_BSY        0x80   //硬盘忙，勿扰
 #define BIT_STAT_DRDY       0x40   //驱动器准备好，等待命令
 #define BIT_STAT_DRQ        0x8    //数据传输准备好了，随时可以输出
+#define BIT_STAT_ERR        0x1    //上一条命令出错
+
+/*pci配置空间中ide控制器的类号*/
+#define PCI_CLASS_STORAGE   0x01   //大容量存储控制器
+#define PCI_SUBCLASS_IDE    0x01   //ide控制器
 
 /*device寄存器的一些关键位*/
 #define BIT_DEV_MBS     0xa0   //MBS位，第7,5位固定位1
@@ -36,12 +49,41 @@
 #define CMD_IDENTIFY        0xec   //identify指令，硬盘识别，用来获取硬盘的身份信息
 #define CMD_READ_SECTOR     0x20   //读扇区指令
 #define CMD_WRITE_SECTOR    0x30   //写扇区指令
+#define CMD_READ_DMA        0xc8   //dma读扇区指令
+#define CMD_WRITE_DMA       0xca   //dma写扇区指令
+#define CMD_READ_MULTIPLE   0xc4   //多扇区模式读，每块扇区一次中断
+#define CMD_WRITE_MULTIPLE  0xc5   //多扇区模式写
+#define CMD_SET_MULTIPLE    0xc6   //设置多扇区模式一块的扇区数
+#define CMD_READ_SECTOR_EXT     0x24   //48位lba的各条指令
+#define CMD_WRITE_SECTOR_EXT    0x34
+#define CMD_READ_DMA_EXT        0x25
+#define CMD_WRITE_DMA_EXT       0x35
+#define CMD_READ_MULTIPLE_EXT   0x29
+#define CMD_WRITE_MULTIPLE_EXT  0x39
+
+#define LBA28_LIMIT 0x10000000   //28位lba能寻址的扇区数
+#define MULTI_SECS_MAX 16   //多扇区模式一块最多的扇区数
+#define BUSY_WAIT_POLL_US 100   //busy_wait两次查询之间休眠的微秒数
+
+/*总线主控寄存器，相对通道的bmdma_base*/
+#define BM_CMD          0   //命令寄存器
+#define BM_STATUS       2   //状态寄存器
+#define BM_PRDT         4   //物理区域描述符表的物理地址
+#define BM_CMD_START    0x1   //开始dma传输
+#define BM_CMD_READ     0x8   //传输方向为从硬盘到内存
+#define BM_STAT_ERR     0x2   //传输出错，写1清除
+#define BM_STAT_INTR    0x4   //硬盘已发出中断，写1清除
+
+#define PRD_EOT 0x8000   //表中最后一项的标记
 
-/*定义可读写的最大扇区数，调试用的*/
-#define max_lba ((80*1024*1024/512) - 1)   //只支持80MB硬盘
+#define SECTOR_SIZE 512
+#define BOUNCE_OBJ_SIZE 1024   //中转缓冲区对象的大小，两个扇区，更大的请求直接按页分配
+#define POLL_SPIN_LIMIT 1000000   //不能睡眠时轮询状态寄存器的最多次数
+#define ASYNC_WRITE_MAX 64   //每个通道最多积压的异步写请求数，超过时写者等待
+#define VEC_BATCH_BIOS 16   //io向量每批一起提交的请求数
 
 uint8_t channel_cnt;   //按硬盘数计算的通道数
-struct ide_channel channels[2];   //通道数组，有两个ide通道
+struct ide_channel channels[CHANNEL_MAX];   //通道数组，ide通道在前，然后是半虚拟化块设备和条带设备
 
 /*用于记录总扩展分区的起始lba，初始为0，partition_scan时以此为标记*/
 int32_t ext_lba_base = 0;
@@ -50,6 +92,21 @@ uint8_t p_no = 0, l_no = 0;   //用来记录硬盘主分区和逻辑分区的下
 
 struct list partition_list;   //分区队列
 
+static struct kmem_cache* bounce_cache;   //用户空间请求的中转缓冲区，也用作异步写的数据副本
+static struct kmem_cache* bio_cache;   //异步请求的bio
+
+extern uint32_t ticks;
+
+/*物理区域描述符，描述一段物理上连续、不跨64KB边界的内存*/
+struct prd_entry
+{
+    uint32_t phys_addr;   //物理地址
+    uint16_t byte_cnt;   //字节数，为0表示64KB
+    uint16_t flags;   //最高位为1表示表中的最后一项
+};
+
+#define PRD_MAX_CNT (PG_SIZE / sizeof(struct prd_entry))   //一页能容纳的描述符数
+
 /*分区表项，构建16字节大小的结构体*/
 struct partition_table_entry
 {
@@ -85,12 +142,26 @@ static void select_disk(struct disk* hd)
     outb(reg_dev(hd->my_channel), reg_device);
 }
 
-/*向硬盘控制器写入起始扇区地址及要读写的扇区数*/
-static void select_sector(struct disk* hd, uint32_t lba, uint8_t sec_cnt)
+/*向硬盘控制器写入起始扇区地址及要读写的扇区数，ext为true时按48位lba写入*/
+static void select_sector(struct disk* hd, uint32_t lba, uint32_t sec_cnt, bool ext)
 {
-    ASSERT(lba <= max_lba);
+    ASSERT(lba + sec_cnt <= hd->sectors);
     struct ide_channel* channel = hd->my_channel;
 
+    //48位lba的各个寄存器都是两字节深的fifo，先写高字节，再写低字节
+    if(ext) {
+        outb(reg_sect_cnt(channel), sec_cnt >> 8);
+        outb(reg_lba_l(channel), lba >> 24);   //lba地址的24~31位，32~47位恒为0
+        outb(reg_lba_m(channel), 0);
+        outb(reg_lba_h(channel), 0);
+        outb(reg_sect_cnt(channel), sec_cnt);
+        outb(reg_lba_l(channel), lba);
+        outb(reg_lba_m(channel), lba >> 8);
+        outb(reg_lba_h(channel), lba >> 16);
+        outb(reg_dev(channel), BIT_DEV_MBS | BIT_DEV_LBA | (hd->dev_no == 1 ? BIT_DEV_DEV : 0));
+        return;
+    }
+
     //写入读写的扇区数
     outb(reg_sect_cnt(channel), sec_cnt);   //如果sec_cnt 为0，则表示写入256个扇区
 
@@ -103,6 +174,33 @@ static void select_sector(struct disk* hd, uint32_t lba, uint8_t sec_cnt)
     outb(reg_dev(channel), BIT_DEV_MBS | BIT_DEV_LBA | (hd->dev_no == 1 ? BIT_DEV_DEV : 0) | lba >> 24);
 }
 
+/*批次中最后一个扇区超出28位lba时要用48位指令*/
+static bool need_ext(struct disk* hd, uint32_t lba, uint32_t sec_cnt)
+{
+    return hd->lba48 && lba + sec_cnt > LBA28_LIMIT;
+}
+
+/*选出读写指令，dma为false时按硬盘是否启用多扇区模式选择pio指令*/
+static uint8_t rw_cmd(struct disk* hd, bool write, bool ext, bool dma)
+{
+    if(dma) {
+        if(ext) {
+            return write ? CMD_WRITE_DMA_EXT : CMD_READ_DMA_EXT;
+        }
+        return write ? CMD_WRITE_DMA : CMD_READ_DMA;
+    }
+    if(hd->multi_secs > 1) {
+        if(ext) {
+            return write ? CMD_WRITE_MULTIPLE_EXT : CMD_READ_MULTIPLE_EXT;
+        }
+        return write ? CMD_WRITE_MULTIPLE : CMD_READ_MULTIPLE;
+    }
+    if(ext) {
+        return write ? CMD_WRITE_SECTOR_EXT : CMD_READ_SECTOR_EXT;
+    }
+    return write ? CMD_WRITE_SECTOR : CMD_READ_SECTOR;
+}
+
 /*向通道channel发命令cmd*/
 static void cmd_out(struct ide_channel* channel, uint8_t cmd)
 {
@@ -136,120 +234,710 @@ static void write2sector(struct disk* hd, void* buf, uint8_t sec_cnt)
     outsw(reg_data(hd->my_channel), buf, size_in_byte / 2);
 }
 
-/*等待30s，函数为忙等待，一般忙等待是指cpu空转*/
+/*等待硬盘退出忙状态，最多等30s。每次查询之间休眠BUSY_WAIT_POLL_US微秒，不必浪费整个滴答*/
 static bool busy_wait(struct disk* hd)
 {
     struct ide_channel* channel = hd->my_channel;
-    uint16_t time_limit = 30 * 1000;   //可以等待3000ms
-    while((time_limit -= 10) >= 0) {
+    uint64_t deadline = hrtimer_now_us() + 30 * 1000 * 1000;
+    while(hrtimer_now_us() < deadline) {
         if(!(inb(reg_status(channel)) & BIT_STAT_BSY)) {
             return (inb(reg_status(channel)) & BIT_STAT_DRQ);   //DRQ位为1表示硬盘已经准备号数据了
         } else {
-            mtime_sleep(10);
+            utime_sleep(BUSY_WAIT_POLL_US);
         }
     }
     return false;
 }
 
-/*从硬盘读取sec_cnt个扇区到buf*/
-void ide_read(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt)
+/*不睡眠地等待硬盘退出忙状态，可在中断处理程序中调用，DRQ位为1时返回true*/
+static bool poll_drq(struct disk* hd)
 {
-    ASSERT(lba <= max_lba);
-    ASSERT(sec_cnt > 0);
-    lock_acquire(&hd->my_channel->lock);
+    struct ide_channel* channel = hd->my_channel;
+    uint32_t spins = POLL_SPIN_LIMIT;
+    while(spins-- > 0) {
+        uint8_t status = inb(reg_status(channel));
+        if(!(status & BIT_STAT_BSY)) {
+            return status & BIT_STAT_DRQ;
+        }
+    }
+    return false;
+}
 
-    //1. 选择操作的硬盘
-    select_disk(hd);
+/*请求在电梯中的排序键，同一通道上主盘的请求排在从盘前面*/
+static uint64_t bio_key(struct bio* bio)
+{
+    return ((uint64_t)bio->hd->dev_no << 32) | bio->lba;
+}
 
-    uint32_t secs_op;   //每次操作的扇区数
-    uint32_t secs_done = 0;   //已完成的扇区数
-    while(secs_done < sec_cnt) {
-        if((secs_done + 256) <= sec_cnt) {
-            secs_op = 256;
+/*尝试把bio并入队列中与它lba首尾相接的同向请求批次，成功返回true*/
+static bool bio_try_merge(struct ide_channel* channel, struct bio* bio)
+{
+    struct list_elem* elem = channel->bio_queue.head.next;
+    while(elem != &channel->bio_queue.tail) {
+        struct bio* batch = elem2entry(struct bio, queue_tag, elem);
+        if(batch->hd == bio->hd && batch->write == bio->write && batch->batch_secs + bio->sec_cnt <= 256) {
+            if(batch->lba + batch->batch_secs == bio->lba) {   //接在批次末尾
+                struct bio* last = batch;
+                while(last->merged_next != NULL) {
+                    last = last->merged_next;
+                }
+                last->merged_next = bio;
+                batch->batch_secs += bio->sec_cnt;
+                return true;
+            }
+            if(bio->lba + bio->sec_cnt == batch->lba) {   //接在批次前面，由bio作为新的批次首个请求
+                bio->merged_next = batch;
+                bio->batch_secs = bio->sec_cnt + batch->batch_secs;
+                list_insert_before(&batch->queue_tag, &bio->queue_tag);
+                list_remove(&batch->queue_tag);
+                return true;
+            }
+        }
+        elem = elem->next;
+    }
+    return false;
+}
+
+/*按排序键把bio插入请求队列*/
+static void bio_enqueue(struct ide_channel* channel, struct bio* bio)
+{
+    uint64_t key = bio_key(bio);
+    struct list_elem* elem = channel->bio_queue.head.next;
+    while(elem != &channel->bio_queue.tail) {
+        if(bio_key(elem2entry(struct bio, queue_tag, elem)) > key) {
+            break;
+        }
+        elem = elem->next;
+    }
+    list_insert_before(elem, &bio->queue_tag);
+}
+
+/*C-LOOK电梯：取第一个不低于磁头当前位置的批次，没有就回到队首重新向上扫描*/
+static struct bio* elevator_next(struct ide_channel* channel)
+{
+    struct list_elem* elem = channel->bio_queue.head.next;
+    while(elem != &channel->bio_queue.tail) {
+        struct bio* batch = elem2entry(struct bio, queue_tag, elem);
+        if(bio_key(batch) >= channel->head_pos) {
+            return batch;
+        }
+        elem = elem->next;
+    }
+    return elem2entry(struct bio, queue_tag, channel->bio_queue.head.next);
+}
+
+/*在当前pio批次中传输一块扇区，一块可能跨越批次中的多个请求*/
+static void pio_transfer(struct ide_channel* channel, bool write)
+{
+    struct disk* hd = channel->cur_bio->hd;
+    uint32_t sec_cnt = channel->pio_left < hd->multi_secs ? channel->pio_left : hd->multi_secs;
+    channel->pio_left -= sec_cnt;
+    while(sec_cnt > 0) {
+        struct bio* bio = channel->pio_bio;
+        uint32_t secs_op = bio->sec_cnt - channel->pio_off;
+        if(secs_op > sec_cnt) {
+            secs_op = sec_cnt;
+        }
+        void* addr = (void*)((uint32_t)bio->kbuf + channel->pio_off * SECTOR_SIZE);
+        if(write) {
+            write2sector(hd, addr, secs_op);
         } else {
-            secs_op = sec_cnt - secs_done;
+            read_from_sector(hd, addr, secs_op);
         }
+        sec_cnt -= secs_op;
+        channel->pio_off += secs_op;
+        if(channel->pio_off == bio->sec_cnt) {
+            channel->pio_bio = bio->merged_next;
+            channel->pio_off = 0;
+        }
+    }
+}
 
-        //2. 写入待读取的扇区数和起始扇区号
-        select_sector(hd, lba + secs_done, secs_op);
+/*按批次中各请求的缓冲区填写通道的物理区域描述符表，每项不超过一页，页框不会跨64KB边界*/
+static void prdt_build(struct ide_channel* channel, struct bio* batch)
+{
+    uint32_t prd_idx = 0;
+    struct bio* bio;
+    for(bio = batch; bio != NULL; bio = bio->merged_next) {
+        uint32_t vaddr = (uint32_t)bio->kbuf;
+        uint32_t left = bio->sec_cnt * SECTOR_SIZE;
+        while(left > 0) {
+            uint32_t chunk = PG_SIZE - (vaddr & 0xfff);
+            if(chunk > left) {
+                chunk = left;
+            }
+            ASSERT(prd_idx < PRD_MAX_CNT);
+            channel->prdt[prd_idx].phys_addr = addr_v2p(vaddr);
+            channel->prdt[prd_idx].byte_cnt = chunk;
+            channel->prdt[prd_idx].flags = 0;
+            prd_idx++;
+            vaddr += chunk;
+            left -= chunk;
+        }
+    }
+    channel->prdt[prd_idx - 1].flags = PRD_EOT;
+}
 
-        //3. 执行的命令写入reg_cmd寄存器
-        cmd_out(hd->my_channel, CMD_READ_SECTOR);   //准备开始读数据
+/*用总线主控dma执行一批请求，硬盘传输完成后发中断*/
+static void ide_dma_start(struct ide_channel* channel, struct bio* batch)
+{
+    uint16_t bm = channel->bmdma_base;
+    uint8_t direction = batch->write ? 0 : BM_CMD_READ;
+    prdt_build(channel, batch);
+    outb(bm + BM_CMD, 0);
+    outl(bm + BM_PRDT, addr_v2p((uint32_t)channel->prdt));
+    outb(bm + BM_STATUS, inb(bm + BM_STATUS) | BM_STAT_ERR | BM_STAT_INTR);
+    outb(bm + BM_CMD, direction);
 
-        //阻塞自己的时机
-        //在硬盘已经开始工作后才能阻塞自己，将自己阻塞，等待硬盘完成读操作后通过中断处理程序唤醒自己
-        sema_down(&hd->my_channel->disk_done);
+    bool ext = need_ext(batch->hd, batch->lba, batch->batch_secs);
+    select_disk(batch->hd);
+    select_sector(batch->hd, batch->lba, batch->batch_secs, ext);
+    cmd_out(channel, rw_cmd(batch->hd, batch->write, ext, true));
+    outb(bm + BM_CMD, direction | BM_CMD_START);
+}
 
-        //4. 检测硬盘状态是否可读，醒来后执行下面的代码
-        if(!busy_wait(hd)) {
+/*从通道的请求队列中按电梯顺序取下一个批次，队列为空返回NULL，需关中断调用*/
+struct bio* ide_next_batch(struct ide_channel* channel)
+{
+    if(list_empty(&channel->bio_queue)) {
+        return NULL;
+    }
+    struct bio* batch = elevator_next(channel);
+    list_remove(&batch->queue_tag);
+    channel->head_pos = bio_key(batch) + batch->batch_secs;
+    return batch;
+}
+
+/*通道空闲且有请求时，向硬盘发出下一批请求的命令，需关中断调用*/
+static void ide_start(struct ide_channel* channel)
+{
+    if(channel->pv != NULL) {   //半虚拟化设备一次能接收多批请求，不受cur_bio限制
+        pvblk_start(channel);
+        return;
+    }
+    if(channel->stripe != NULL) {   //条带设备由分发线程拆给成员，同样不受cur_bio限制
+        stripe_start(channel);
+        return;
+    }
+    if(channel->cur_bio != NULL) {
+        return;
+    }
+    struct bio* batch = ide_next_batch(channel);
+    if(batch == NULL) {
+        return;
+    }
+    channel->cur_bio = batch;
+
+    if(channel->bmdma_base != 0) {
+        ide_dma_start(channel, batch);
+        return;
+    }
+
+    //pio方式，每传输一块扇区硬盘发一次中断
+    struct disk* hd = batch->hd;
+    bool ext = need_ext(hd, batch->lba, batch->batch_secs);
+    channel->pio_bio = batch;
+    channel->pio_off = 0;
+    channel->pio_left = batch->batch_secs;
+    select_disk(hd);
+    select_sector(hd, batch->lba, batch->batch_secs, ext);   //28位lba时256个扇区截断为0，硬盘同样理解为256
+    cmd_out(channel, rw_cmd(hd, batch->write, ext, false));
+
+    //写命令要先把第一块数据交给硬盘，硬盘写完这块才发中断
+    if(batch->write) {
+        if(!poll_drq(hd)) {
             char error[64];
-            sprintf(error, "%s, read sector %d failed!!!!!!\n", hd->name, lba);
+            sprintf(error, "%s write sector %d failed!!!!!!\n", hd->name, batch->lba);
             PANIC(error);
         }
+        pio_transfer(channel, true);
+    }
+}
 
-        //5. 把数据从硬盘的缓冲区中读出
-        read_from_sector(hd, (void*)((uint32_t)buf + secs_done * 512), secs_op);
-        secs_done += secs_op;
+/*初始化对硬盘hd从lba起sec_cnt个扇区的请求，write为true时把buf写入硬盘*/
+void bio_init(struct bio* bio, struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt, bool write)
+{
+    ASSERT(sec_cnt > 0 && sec_cnt <= 256);
+    ASSERT(lba + sec_cnt <= hd->sectors);
+    bio->hd = hd;
+    bio->lba = lba;
+    bio->sec_cnt = sec_cnt;
+    bio->buf = buf;
+    bio->write = write;
+    bio->batch_secs = sec_cnt;
+    bio->merged_next = NULL;
+    bio->end_io = NULL;
+    bio->private = NULL;
+    bio->part = NULL;
+    sema_init(&bio->done, 0);
+
+    //中断到来时可能是别的进程在运行，用户空间的缓冲区要经内核缓冲区中转
+    bio->kbuf = buf;
+    if((uint32_t)buf < 0xc0000000) {
+        uint32_t size = sec_cnt * SECTOR_SIZE;
+        if(size <= BOUNCE_OBJ_SIZE) {
+            bio->kbuf = kmem_cache_alloc(bounce_cache);
+        } else {
+            bio->kbuf = get_kernel_pages(DIV_ROUND_UP(size, PG_SIZE));
+        }
+        if(bio->kbuf == NULL) {
+            PANIC("bio_init: no memory for bounce buffer\n");
+        }
+        if(write) {
+            memcpy(bio->kbuf, buf, size);
+        }
     }
-    lock_release(&hd->my_channel->lock);
 }
 
-/*将buf中sec_cnt扇区数据写入硬盘*/
-void ide_write(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt)
+/*在通道队列中查找与bio扇区重叠、尚未下发的写请求*/
+static struct bio* queued_write_overlap(struct ide_channel* channel, struct bio* bio)
 {
-    ASSERT(lba <= max_lba);
-    ASSERT(sec_cnt > 0);
-    lock_acquire(&hd->my_channel->lock);
+    struct list_elem* elem = channel->bio_queue.head.next;
+    while(elem != &channel->bio_queue.tail) {
+        struct bio* queued = elem2entry(struct bio, queue_tag, elem);
+        for(; queued != NULL; queued = queued->merged_next) {
+            if(queued->write && queued->hd == bio->hd && \
+               queued->lba < bio->lba + bio->sec_cnt && bio->lba < queued->lba + queued->sec_cnt) {
+                return queued;
+            }
+        }
+        elem = elem->next;
+    }
+    return NULL;
+}
 
-    //1. 选择要操作的硬盘
-    select_disk(hd);
+/*当前线程等到通道完成下一批请求，需关中断调用*/
+static void ide_wait(struct ide_channel* channel)
+{
+    list_append(&channel->io_waiters, &running_thread()->general_tag);
+    thread_block(TASK_BLOCKED);
+}
 
-    uint32_t secs_op;   //每次操作的扇区数
-    uint32_t secs_done = 0;   //已完成的扇区数
-    while(secs_done < sec_cnt) {
-        if(secs_done + 256 < sec_cnt) {
-            secs_op = 256;
+/*累计st的忙碌时间和队列深度，再把未完成的请求数改变delta，需关中断调用*/
+static void io_stats_tick(struct io_stats* st, int32_t delta)
+{
+    uint32_t now = ticks;
+    if(st->in_flight > 0) {
+        st->busy_ticks += now - st->stamp;
+        st->queue_ticks += (now - st->stamp) * st->in_flight;
+    }
+    st->stamp = now;
+    st->in_flight += delta;
+}
+
+/*把新提交的bio计入st，merged表示它并入了队列中的请求，需关中断调用*/
+static void io_stats_submit(struct io_stats* st, struct bio* bio, bool merged)
+{
+    io_stats_tick(st, 1);
+    if(bio->write) {
+        st->writes++;
+        st->write_secs += bio->sec_cnt;
+    } else {
+        st->reads++;
+        st->read_secs += bio->sec_cnt;
+    }
+    if(merged) {
+        st->merged++;
+    }
+}
+
+/*返回hd上lba所在的分区，不在任何分区内时返回NULL*/
+static struct partition* lba_partition(struct disk* hd, uint32_t lba)
+{
+    uint8_t part_idx;
+    for(part_idx = 0; part_idx < 12; part_idx++) {
+        struct partition* part = part_idx < 4 ? &hd->prim_parts[part_idx] : &hd->logic_parts[part_idx - 4];
+        if(part->sec_cnt != 0 && lba >= part->start_lba && lba - part->start_lba < part->sec_cnt) {
+            return part;
+        }
+    }
+    return NULL;
+}
+
+/*bio加入通道的请求队列，需关中断调用*/
+static void bio_queue_add(struct ide_channel* channel, struct bio* bio)
+{
+    bool merged = bio_try_merge(channel, bio);
+    if(!merged) {
+        bio_enqueue(channel, bio);
+    }
+    bio->part = lba_partition(bio->hd, bio->lba);
+    struct task_struct* cur = running_thread();   //请求总在发起者的上下文中提交
+    if(bio->write) {
+        cur->stats.write_secs += bio->sec_cnt;
+    } else {
+        cur->stats.read_secs += bio->sec_cnt;
+    }
+    io_stats_submit(&bio->hd->stats, bio, merged);
+    if(bio->part != NULL) {
+        io_stats_submit(&bio->part->stats, bio, merged);
+    }
+}
+
+/*把请求加入通道的请求队列，通道空闲时立即开始执行*/
+void ide_submit(struct bio* bio)
+{
+    struct ide_channel* channel = bio->hd->my_channel;
+    enum intr_status old_status = intr_disable();
+    //电梯会打乱顺序，与尚未下发的写请求重叠时先等它下发，保证读到新数据、后写的覆盖先写的
+    while(queued_write_overlap(channel, bio) != NULL) {
+        ide_wait(channel);
+    }
+    bio_queue_add(channel, bio);
+    ide_start(channel);
+    intr_set_status(old_status);
+}
+
+/*把cnt个请求一起加入请求队列后再开始执行，lba相连的请求能合并成一条命令。
+  逐个提交的话通道空闲时第一个请求会单独下发，所有请求须在同一通道上*/
+void ide_submit_batch(struct bio** bios, uint32_t cnt)
+{
+    ASSERT(cnt > 0);
+    struct ide_channel* channel = bios[0]->hd->my_channel;
+    enum intr_status old_status = intr_disable();
+    uint32_t idx;
+    for(idx = 0; idx < cnt; idx++) {
+        struct bio* bio = bios[idx];
+        ASSERT(bio->hd->my_channel == channel);
+        while(queued_write_overlap(channel, bio) != NULL) {
+            ide_start(channel);   //已入队的请求先开始，免得等不到完成
+            ide_wait(channel);
+        }
+        bio_queue_add(channel, bio);
+    }
+    ide_start(channel);
+    intr_set_status(old_status);
+}
+
+/*等待请求完成*/
+void bio_wait(struct bio* bio)
+{
+    sema_down(&bio->done);
+    if(bio->kbuf != bio->buf) {
+        uint32_t size = bio->sec_cnt * SECTOR_SIZE;
+        if(!bio->write) {
+            memcpy(bio->buf, bio->kbuf, size);
+        }
+        if(size <= BOUNCE_OBJ_SIZE) {
+            kmem_cache_free(bounce_cache, bio->kbuf);
         } else {
-            secs_op = sec_cnt - secs_done;
+            mfree_page(PF_KERNEL, bio->kbuf, DIV_ROUND_UP(size, PG_SIZE));
         }
+    }
+}
+
+/*分配一个异步请求用的bio，失败返回NULL*/
+struct bio* bio_alloc(void)
+{
+    return kmem_cache_alloc(bio_cache);
+}
 
-        //2. 写入待写入的扇区数和起始扇区号
-        select_sector(hd, lba + secs_done, secs_op);
+/*释放bio_alloc分配的bio*/
+void bio_free(struct bio* bio)
+{
+    kmem_cache_free(bio_cache, bio);
+}
 
-        //3. 执行的命令写入reg_cmd寄存器
-        cmd_out(hd->my_channel, CMD_WRITE_SECTOR);   //准备写数据
+/*异步写请求完成后的收尾，在通道的io线程中执行，释放数据副本和bio*/
+static void async_write_done(struct bio* bio)
+{
+    uint32_t size = bio->sec_cnt * SECTOR_SIZE;
+    if(size <= BOUNCE_OBJ_SIZE) {
+        kmem_cache_free(bounce_cache, bio->kbuf);
+    } else {
+        mfree_page(PF_KERNEL, bio->kbuf, DIV_ROUND_UP(size, PG_SIZE));
+    }
+    kmem_cache_free(bio_cache, bio);
+}
 
-        //4. 检测硬盘状态是否可读
-        if(!busy_wait(hd)) {
-            char error[64];
-            sprintf(error, "%s write sector %d failed!!!!!!\n", hd->name, lba);
-            PANIC(error);
+/*把buf中sec_cnt个扇区复制一份后异步写入硬盘，不等待写完*/
+void ide_write_async(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt)
+{
+    struct ide_channel* channel = hd->my_channel;
+    //积压太多时等通道消化一些，免得数据副本耗尽内核内存
+    enum intr_status old_status = intr_disable();
+    while(channel->async_cnt >= ASYNC_WRITE_MAX) {
+        ide_wait(channel);
+    }
+    channel->async_cnt++;
+    intr_set_status(old_status);
+
+    uint32_t size = sec_cnt * SECTOR_SIZE;
+    struct bio* bio = kmem_cache_alloc(bio_cache);
+    void* copy = size <= BOUNCE_OBJ_SIZE ? kmem_cache_alloc(bounce_cache) : get_kernel_pages(DIV_ROUND_UP(size, PG_SIZE));
+    if(bio == NULL || copy == NULL) {
+        PANIC("ide_write_async: no memory for bio\n");
+    }
+    memcpy(copy, buf, size);
+    bio_init(bio, hd, lba, copy, sec_cnt, true);
+    bio->end_io = async_write_done;
+    ide_submit(bio);
+}
+
+/*等hd所在通道积压的异步写全部写完，hd为NULL表示所有通道*/
+void ide_sync(struct disk* hd)
+{
+    uint8_t channel_no;
+    for(channel_no = 0; channel_no < channel_cnt; channel_no++) {
+        struct ide_channel* channel = &channels[channel_no];
+        if(hd != NULL && hd->my_channel != channel) {
+            continue;
+        }
+        enum intr_status old_status = intr_disable();
+        while(channel->async_cnt > 0) {
+            ide_wait(channel);
+        }
+        intr_set_status(old_status);
+    }
+}
+
+/*通道的io线程，为本通道完成的异步请求收尾，收尾可能睡眠，不能放在中断处理程序里*/
+static void ide_worker(void* arg)
+{
+    struct ide_channel* channel = arg;
+    while(1) {
+        sema_down(&channel->io_done);
+        enum intr_status old_status = intr_disable();
+        struct bio* bio = elem2entry(struct bio, queue_tag, list_pop(&channel->done_list));
+        intr_set_status(old_status);
+        bio->end_io(bio);
+    }
+}
+
+/*按io向量读写硬盘并等待完成。每段按每条命令最多256个扇区拆成请求，每批请求一起提交，
+  电梯把lba相连的合并成一条命令，dma时合并后的各段缓冲区各占prd表的一项*/
+static void ide_rw_vec(struct disk* hd, struct io_seg* segs, uint32_t seg_cnt, bool write)
+{
+    struct bio* bios[VEC_BATCH_BIOS];
+    uint32_t seg_idx = 0, secs_done = 0;   //下一个请求从第seg_idx段的第secs_done个扇区开始
+    while(seg_idx < seg_cnt) {
+        uint32_t bio_cnt = 0;
+        while(seg_idx < seg_cnt && bio_cnt < VEC_BATCH_BIOS) {
+            struct io_seg* seg = &segs[seg_idx];
+            ASSERT(seg->sec_cnt > 0);
+            uint32_t secs_op = seg->sec_cnt - secs_done < 256 ? seg->sec_cnt - secs_done : 256;
+            struct bio* bio = bio_alloc();
+            if(bio == NULL) {
+                PANIC("ide_rw_vec: no memory for bio\n");
+            }
+            bio_init(bio, hd, seg->lba + secs_done, (void*)((uint32_t)seg->buf + secs_done * SECTOR_SIZE), secs_op, write);
+            bios[bio_cnt++] = bio;
+            secs_done += secs_op;
+            if(secs_done == seg->sec_cnt) {
+                seg_idx++;
+                secs_done = 0;
+            }
         }
+        ide_submit_batch(bios, bio_cnt);
+        uint32_t bio_idx;
+        for(bio_idx = 0; bio_idx < bio_cnt; bio_idx++) {
+            bio_wait(bios[bio_idx]);
+            bio_free(bios[bio_idx]);
+        }
+    }
+}
+
+/*按io向量segs从硬盘读取seg_cnt段扇区，lba相连的段合并成一条命令，全部读完才返回*/
+void ide_readv(struct disk* hd, struct io_seg* segs, uint32_t seg_cnt)
+{
+    ide_rw_vec(hd, segs, seg_cnt, false);
+}
+
+/*按io向量segs把seg_cnt段数据写入硬盘，lba相连的段合并成一条命令，全部写完才返回*/
+void ide_writev(struct disk* hd, struct io_seg* segs, uint32_t seg_cnt)
+{
+    ide_rw_vec(hd, segs, seg_cnt, true);
+}
 
-        //5. 将数据写入硬盘
-        write2sector(hd, (void*)((uint32_t)buf + secs_done * 512), secs_op);
+/*从硬盘读取sec_cnt个扇区到buf*/
+void ide_read(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt)
+{
+    ASSERT(sec_cnt > 0);
+    struct io_seg seg = {lba, buf, sec_cnt};
+    ide_readv(hd, &seg, 1);
+}
 
-        //在硬盘响应期间阻塞自己
-        sema_down(&hd->my_channel->disk_done);
+/*将buf中sec_cnt扇区数据写入硬盘，数据复制后即返回，由通道在后台写完*/
+void ide_write(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt)
+{
+    ASSERT(sec_cnt > 0);
+    uint32_t secs_op;
+    uint32_t secs_done = 0;
+    while(secs_done < sec_cnt) {
+        secs_op = sec_cnt - secs_done < 256 ? sec_cnt - secs_done : 256;
+        ide_write_async(hd, lba + secs_done, (void*)((uint32_t)buf + secs_done * SECTOR_SIZE), secs_op);
         secs_done += secs_op;
     }
-    lock_release(&hd->my_channel->lock);
 }
 
-/*硬盘中断处理程序*/
+/*批次出错时停机*/
+static void batch_failed(struct bio* batch)
+{
+    char error[64];
+    sprintf(error, "%s, %s sector %d failed!!!!!!\n", batch->hd->name, batch->write ? "write" : "read", batch->lba);
+    PANIC(error);
+}
+
+/*pio批次收到中断，传输下一块，整批完成时返回true。读时每块数据就绪发一次中断，
+  写时每写完一块发一次中断，以状态寄存器为准过滤掉不属于这一步的中断*/
+static bool ide_pio_done(struct ide_channel* channel, struct bio* batch, uint8_t status)
+{
+    if(status & BIT_STAT_BSY) {
+        return false;
+    }
+    if(status & BIT_STAT_ERR) {
+        batch_failed(batch);
+    }
+    if(!batch->write) {
+        if(!(status & BIT_STAT_DRQ)) {
+            return false;
+        }
+        pio_transfer(channel, false);
+        return channel->pio_left == 0;
+    }
+    if(channel->pio_left > 0) {
+        if(status & BIT_STAT_DRQ) {
+            pio_transfer(channel, true);
+        }
+        return false;
+    }
+    return !(status & BIT_STAT_DRQ);
+}
+
+/*dma批次收到中断，完成时停下总线主控并返回true*/
+static bool ide_dma_done(struct ide_channel* channel, struct bio* batch, uint8_t status)
+{
+    uint16_t bm = channel->bmdma_base;
+    uint8_t bm_status = inb(bm + BM_STATUS);
+    if(!(bm_status & BM_STAT_INTR)) {   //不是这次传输发出的中断
+        return false;
+    }
+    outb(bm + BM_CMD, 0);
+    outb(bm + BM_STATUS, bm_status | BM_STAT_ERR | BM_STAT_INTR);
+    if((bm_status & BM_STAT_ERR) || (status & BIT_STAT_ERR)) {
+        batch_failed(batch);
+    }
+    return true;
+}
+
+/*把各硬盘和分区的io统计复制到buf，最多cnt项，返回复制的项数。统计中的忙碌时间累计到当前时刻*/
+int32_t sys_iostat(struct iostat_entry* buf, uint32_t cnt)
+{
+    uint32_t entry_cnt = 0;
+    uint8_t channel_no, dev_no, part_idx;
+    for(channel_no = 0; channel_no < channel_cnt; channel_no++) {
+        for(dev_no = 0; dev_no < 2; dev_no++) {
+            struct disk* hd = &channels[channel_no].devices[dev_no];
+            if(hd->my_channel == NULL) {   //半虚拟化通道只有一块硬盘
+                continue;
+            }
+            for(part_idx = 0; part_idx <= 12 && entry_cnt < cnt; part_idx++) {   //编号0是硬盘本身
+                struct io_stats* st;
+                const char* name;
+                if(part_idx == 0) {
+                    st = &hd->stats;
+                    name = hd->name;
+                } else {
+                    struct partition* part = part_idx <= 4 ? &hd->prim_parts[part_idx - 1] : &hd->logic_parts[part_idx - 5];
+                    if(part->sec_cnt == 0) {
+                        continue;
+                    }
+                    st = &part->stats;
+                    name = part->name;
+                }
+                struct iostat_entry* entry = &buf[entry_cnt++];
+                struct io_stats snap;   //先复制到内核栈上，写用户缓冲区可能缺页，不能关着中断
+                enum intr_status old_status = intr_disable();
+                io_stats_tick(st, 0);
+                snap = *st;
+                intr_set_status(old_status);
+                entry->stats = snap;
+                strcpy(entry->name, name);
+                entry->is_disk = part_idx == 0;
+            }
+        }
+    }
+    return entry_cnt;
+}
+
+/*硬盘中断处理程序(上半部)，读出状态并交给软中断，pio传输和唤醒都在软中断中开着中断进行*/
 void intr_hd_handler(uint8_t irq_no)
 {
     ASSERT(irq_no == 0x2e || irq_no == 0x2f);
     uint8_t ch_no = irq_no - 0x2e;   //获取通道号
     struct ide_channel* channel = &channels[ch_no];
     ASSERT(channel->irq_no == irq_no);
-    //不用担心此中断是否对应的是这一次的expecting_intr，每次读写硬盘时会申请锁，从而保证同步一致性
-    if(channel->expecting_intr) {
+    //读取状态寄存器是硬盘控制器认为此次的中断已被处理，从而硬盘可以继续执行新的读写
+    channel->intr_status = inb(reg_status(channel));
+    channel->intr_pending = true;
+    softirq_raise(SOFTIRQ_IDE);
+}
+
+/*批次完成，唤醒其中的同步请求，异步请求交给io线程收尾，需关中断调用*/
+void ide_batch_done(struct ide_channel* channel, struct bio* batch)
+{
+    //等待者醒来后请求所在的栈可能被回收，先取下一个再唤醒
+    struct bio* bio = batch;
+    while(bio != NULL) {
+        struct bio* next = bio->merged_next;
+        io_stats_tick(&bio->hd->stats, -1);
+        if(bio->part != NULL) {
+            io_stats_tick(&bio->part->stats, -1);
+        }
+        if(bio->end_io != NULL) {
+            if(bio->write) {
+                channel->async_cnt--;
+            }
+            list_append(&channel->done_list, &bio->queue_tag);
+            sema_up(&channel->io_done);
+        } else {
+            sema_up(&bio->done);
+        }
+        bio = next;
+    }
+    while(!list_empty(&channel->io_waiters)) {
+        thread_unblock(elem2entry(struct task_struct, general_tag, list_pop(&channel->io_waiters)));
+    }
+}
+
+/*处理通道的一次中断，当前批次完成时唤醒其中的所有请求并直接开始下一批。
+  在下一批开始前通道不会再发中断，所以这里不会与本通道的上半部交错*/
+static void ide_channel_intr(struct ide_channel* channel, uint8_t status)
+{
+    if(channel->pv != NULL) {
+        pvblk_intr(channel);
+        return;
+    }
+    struct bio* batch = channel->cur_bio;
+    if(batch != NULL) {
+        bool done = channel->bmdma_base != 0 ? ide_dma_done(channel, batch, status) : ide_pio_done(channel, batch, status);
+        if(!done) {
+            return;
+        }
+        channel->expecting_intr = false;
+        channel->cur_bio = NULL;
+        ide_batch_done(channel, batch);
+        ide_start(channel);
+    } else if(channel->expecting_intr) {   //identify等不经请求队列的命令
         channel->expecting_intr = false;
         sema_up(&channel->disk_done);
+    }
+}
 
-        //读取状态寄存器是硬盘控制器认为此次的中断已被处理，从而硬盘可以继续执行新的读写
-        inb(reg_status(channel));
+/*硬盘软中断(下半部)，处理各通道待处理的中断*/
+static void ide_softirq(void)
+{
+    uint8_t ch_no;
+    for(ch_no = 0; ch_no < channel_cnt; ch_no++) {
+        struct ide_channel* channel = &channels[ch_no];
+        enum intr_status old_status = intr_disable();
+        bool pending = channel->intr_pending;
+        uint8_t status = channel->intr_status;
+        channel->intr_pending = false;
+        intr_set_status(old_status);
+        if(pending) {
+            ide_channel_intr(channel, status);
+        }
     }
 }
 
@@ -264,6 +952,20 @@ static void swap_pairs_bytes(const char* dst, char* buf, uint32_t len)
     buf[idx] = '\0';
 }
 
+/*开启多扇区模式，一次中断传输multi_secs个扇区，硬盘不接受时保持单扇区*/
+static void set_multiple(struct disk* hd, uint8_t multi_secs)
+{
+    struct ide_channel* channel = hd->my_channel;
+    select_disk(hd);
+    outb(reg_sect_cnt(channel), multi_secs);
+    cmd_out(channel, CMD_SET_MULTIPLE);
+    sema_down(&channel->disk_done);
+    if(!(inb(reg_status(channel)) & BIT_STAT_ERR)) {
+        hd->multi_secs = multi_secs;
+        printk("      MULTIPLE: %d sectors\n", multi_secs);
+    }
+}
+
 /*获得硬盘参数信息*/
 static void identify_disk(struct disk* hd)
 {
@@ -289,8 +991,25 @@ static void identify_disk(struct disk* hd)
     swap_pairs_bytes(&id_info[md_start], buf, md_len);
     printk("      MODULE: Z%s\n", buf);   //输出硬盘型号（长度为40的字符串）
     uint32_t sectors = *(uint32_t*)&id_info[60 * 2];   //获取可供用户使用的扇区数（长度为2的整形）
-    printk("      SECTORS: %d\n", sectors);   //输出用户可用的扇区数（长度为2的整形）
-    printk("      CAPACITY: %dMB\n", sectors * 512 / 1024 / 1024);   //输出用户可用的硬盘存储空间（MB为单位）
+    //第83个字的第10位表示支持48位lba，此时第100~103个字是扇区总数，高32位不为0时只用低4G个扇区
+    hd->lba48 = (*(uint16_t*)&id_info[83 * 2] & 0x400) != 0;
+    if(hd->lba48) {
+        sectors = *(uint32_t*)&id_info[102 * 2] != 0 ? 0xffffffff : *(uint32_t*)&id_info[100 * 2];
+    }
+    hd->sectors = sectors;
+    printk("      SECTORS: %d%s\n", sectors, hd->lba48 ? " (lba48)" : "");   //输出用户可用的扇区数
+    printk("      CAPACITY: %dMB\n", sectors / 2048);   //输出用户可用的硬盘存储空间（MB为单位）
+
+    //第47个字的低8位是多扇区模式一块最多的扇区数
+    hd->multi_secs = 1;
+    uint8_t multi_max = *(uint16_t*)&id_info[47 * 2] & 0xff;
+    if(multi_max >= 2) {
+        uint8_t multi_secs = MULTI_SECS_MAX;
+        while(multi_secs > multi_max) {
+            multi_secs >>= 1;
+        }
+        set_multiple(hd, multi_secs);
+    }
 }
 
 /*扫描硬盘hd中地址为ext_lba的扇区中的所有分区*/
@@ -313,24 +1032,27 @@ static void partition_scan(struct disk* hd, uint32_t ext_lba)
                 partition_scan(hd, p->start_lba);
             }
         } else if(p->fs_type != 0) {   //若是有效的分区类型，1(p)有效，2,3无效，4有效(e)
+            struct partition* part;
             if(ext_lba == 0) {   //此时全是主分区
-                hd->prim_parts[p_no].start_lba = ext_lba + p->start_lba;   //该分区的起始lba地址
-                hd->prim_parts[p_no].sec_cnt = p->sec_cnt;   //该分区的扇区数
-                hd->prim_parts[p_no].my_disk = hd;   //该分区对应的硬盘
-                list_append(&partition_list, &hd->prim_parts[p_no].part_tag);   //加入分区队列
-                sprintf(hd->prim_parts[p_no].name, "%s%d", hd->name, p_no + 1);   //该分区的名字
+                part = &hd->prim_parts[p_no];
+                sprintf(part->name, "%s%d", hd->name, p_no + 1);   //该分区的名字
                 p_no++;
                 ASSERT(p_no < 4);
             } else {
-                hd->logic_parts[l_no].start_lba = ext_lba + p->start_lba;   //该逻辑分区的lba地址
-                hd->logic_parts[l_no].sec_cnt = p->sec_cnt;   //该逻辑分区的扇区数
-                hd->logic_parts[l_no].my_disk = hd;   //该逻辑分区对应硬盘
-                list_append(&partition_list, &hd->logic_parts[l_no].part_tag);   //加入分区队列
-                sprintf(hd->logic_parts[l_no].name, "%s%d", hd->name, l_no + 5);   //该逻辑分区的名字
+                part = &hd->logic_parts[l_no];
+                sprintf(part->name, "%s%d", hd->name, l_no + 5);   //该逻辑分区的名字
                 l_no++;
-
-                if(l_no >= 8) return;
             }
+            part->start_lba = ext_lba + p->start_lba;   //该分区的起始lba地址
+            part->sec_cnt = p->sec_cnt;   //该分区的扇区数
+            part->my_disk = hd;   //该分区对应的硬盘
+            part->fs_type = p->fs_type;
+            if(p->fs_type == PART_TYPE_STRIPE) {   //条带设备的成员不单独挂载，不加入分区队列
+                stripe_add_member(part);
+            } else {
+                list_append(&partition_list, &part->part_tag);   //加入分区队列
+            }
+            if(l_no >= 8) return;
         }
         p++;
     }
@@ -345,6 +1067,24 @@ static bool partition_info(struct list_elem* pelem, int arg UNUSED)
     return false;   //返回false为了让主调函数list_traversal继续向下遍历元素
 }
 
+/*初始化通道的请求队列和完成队列，并启动通道的io线程*/
+static void channel_queue_init(struct ide_channel* channel)
+{
+    list_init(&channel->bio_queue);
+    channel->cur_bio = NULL;
+    channel->head_pos = 0;
+    list_init(&channel->done_list);
+    sema_init(&channel->io_done, 0);
+    list_init(&channel->io_waiters);
+    channel->async_cnt = 0;
+    channel->intr_pending = false;
+
+    //每个通道一个io线程，各通道的请求各自推进、互不等待
+    char worker_name[16];
+    sprintf(worker_name, "%s_io", channel->name);
+    thread_start(worker_name, 31, ide_worker, channel);
+}
+
 /*硬盘数据结构初始化*/
 void ide_init()
 {
@@ -355,6 +1095,22 @@ void ide_init()
     channel_cnt = DIV_ROUND_UP(hd_cnt, 2);   //hd_cnt向上取整，一个ide通道上有两个硬盘，根据硬盘数量反推有几个ide。
 
     list_init(&partition_list);
+    bounce_cache = kmem_cache_create("ide_bounce", BOUNCE_OBJ_SIZE, NULL);
+    bio_cache = kmem_cache_create("bio", sizeof(struct bio), NULL);
+    softirq_register(SOFTIRQ_IDE, ide_softirq);
+
+    //查找ide控制器，bar4是总线主控寄存器的io基址，两个通道各占8个端口。找不到时只用pio
+    uint16_t bmdma_base = 0;
+    struct pci_dev ide_pdev;
+    if(pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &ide_pdev)) {
+        uint32_t bar4 = pci_config_read(&ide_pdev, PCI_BAR0 + 4 * 4);
+        if(bar4 & 0x1) {
+            bmdma_base = bar4 & 0xfffc;
+            uint32_t cmd = pci_config_read(&ide_pdev, PCI_COMMAND);
+            pci_config_write(&ide_pdev, PCI_COMMAND, cmd | PCI_CMD_IO | PCI_CMD_MASTER);
+            printk("   bus master dma at 0x%x\n", bmdma_base);
+        }
+    }
     
     struct ide_channel* channel;
     uint8_t channel_no = 0, dev_no = 0;
@@ -377,12 +1133,22 @@ void ide_init()
         }
 
         channel->expecting_intr = false;   //未向硬盘写入指令时不期待硬盘的中断
-        lock_init(&channel->lock);
+        channel->pv = NULL;
+        channel->stripe = NULL;
+        channel->bmdma_base = 0;
+        channel->prdt = NULL;
+        if(bmdma_base != 0) {
+            channel->prdt = get_kernel_pages(1);   //一页不会跨64KB边界
+            if(channel->prdt != NULL) {
+                channel->bmdma_base = bmdma_base + channel_no * 8;
+            }
+        }
         //信号量初始化为0，目的是向硬盘控制器请求数据后，硬盘驱动sema_down此信号会阻塞线程，知道硬盘完成后通过发中断
         //由中断处理程序将此信号量sema_up，唤醒线程
         sema_init(&channel->disk_done, 0);
 
         register_handler(channel->irq_no, intr_hd_handler);
+        channel_queue_init(channel);
 
         //分别获取两个硬盘的参数及分区信息
         while(dev_no < 2) {
@@ -390,9 +1156,16 @@ void ide_init()
             hd->my_channel = channel;   //该硬盘对应的通多
             hd->dev_no = dev_no;   //该硬盘的硬盘号，是主盘还是从盘
             sprintf(hd->name, "sd%c", 'a' + channel_no * 2 + dev_no);
+            char stage_name[BOOT_STAGE_NAME_LEN];
+            sprintf(stage_name, "identify %s", hd->name);
+            int32_t stage = boot_stage_begin(stage_name);
             identify_disk(hd);   //获取硬盘参数
+            boot_stage_end(stage);
             if(dev_no != 0) {
+                sprintf(stage_name, "scan %s", hd->name);
+                stage = boot_stage_begin(stage_name);
                 partition_scan(hd, 0);   //扫描该硬盘的分区
+                boot_stage_end(stage);
             }
             p_no = 0, l_no = 0;   //清零，用于下一个硬盘的处理
             dev_no++;
@@ -400,6 +1173,41 @@ void ide_init()
         dev_no = 0;   //将硬盘驱动号置为0，用于下一个channel的两个硬盘初始化
         channel_no++;
     }
+
+    //半虚拟化块设备放在ide通道之后，作为只有一块硬盘vda的通道，与ata硬盘共用请求队列和分区
+    channel = &channels[channel_cnt];
+    if(pvblk_probe(channel)) {
+        strcpy(channel->name, "pvblk");
+        channel->stripe = NULL;
+        channel->port_base = 0;
+        channel->bmdma_base = 0;
+        channel->prdt = NULL;
+        channel->expecting_intr = false;
+        sema_init(&channel->disk_done, 0);
+        channel_queue_init(channel);
+        struct disk* hd = &channel->devices[0];
+        hd->my_channel = channel;
+        hd->dev_no = 0;
+        strcpy(hd->name, "vda");
+        channel_cnt++;
+        ext_lba_base = 0;
+        partition_scan(hd, 0);
+        p_no = 0, l_no = 0;
+    }
+
+    //类型为PART_TYPE_STRIPE的分区组成条带设备md0，放在最后一个通道，它没有中断，只有请求队列和io线程
+    channel = &channels[channel_cnt];
+    channel->pv = NULL;
+    if(stripe_probe(channel)) {
+        strcpy(channel->name, "md0");
+        channel->port_base = 0;
+        channel->bmdma_base = 0;
+        channel->prdt = NULL;
+        channel->expecting_intr = false;
+        sema_init(&channel->disk_done, 0);
+        channel_queue_init(channel);
+        channel_cnt++;
+    }
     printk("\n   all partition info\n");
     list_traversal(&partition_list, partition_info, (int)NULL);
     printk("ide_init done\n");
@@ -6,6 +6,31 @@
 #include "list.h"
 #include "bitmap.h"
 
+#define IOSTAT_MAX 67   //sys_iostat最多返回的统计项数，4块ata硬盘和1块半虚拟化硬盘各自加上12个分区，条带设备和它的1个分区
+#define CHANNEL_MAX 4   //两个ide通道，再加半虚拟化块设备和条带设备各一个通道
+
+/*硬盘或分区的io统计，提交请求时和请求完成时累计*/
+struct io_stats
+{
+    uint32_t reads;   //读请求数
+    uint32_t writes;   //写请求数
+    uint32_t read_secs;   //读入的扇区数
+    uint32_t write_secs;   //写出的扇区数
+    uint32_t merged;   //提交时并入别的请求、没有单独占一条命令的请求数
+    uint32_t in_flight;   //已提交尚未完成的请求数，即当前的队列深度
+    uint32_t busy_ticks;   //有请求未完成的滴答数
+    uint32_t queue_ticks;   //队列深度对滴答数的累积，除以busy_ticks得平均队列深度
+    uint32_t stamp;   //上次累计busy_ticks的时刻
+};
+
+/*sys_iostat返回的一项统计*/
+struct iostat_entry
+{
+    char name[8];   //硬盘或分区的名称
+    bool is_disk;   //是硬盘还是分区
+    struct io_stats stats;
+};
+
 /*分区结构*/
 struct partition
 {
@@ -15,9 +40,16 @@ struct partition
     struct list_elem part_tag;    //用于队列中的标记
     char name[8];                 //分区名称
     struct super_block* sb;       //本分区的超级块
-    struct bitmap block_bitmap;   //块位图，这里一个块由一个扇区组成
+    uint8_t fs_type;              //分区表中的分区类型
+    struct bitmap block_bitmap;   //块位图，每位代表一个BLOCK_SIZE大小的块
     struct bitmap inode_bitmap;   //inode节点位图
-    struct list open_inodes;      //本分区打开的inode节点队列
+    struct bitmap bitmap_dirty;   //两个位图中已修改还没写入块缓存的扇区，前block_bitmap_sects位对应块位图
+    struct list* inode_hash;      //内存inode按i_no散列的哈希桶，挂载时分配INODE_HASH_CNT个
+    struct list inode_lru;        //没有打开者但仍缓存着的inode，队首最久未用
+    uint32_t inode_lru_cnt;       //inode_lru中的inode数
+    struct rwlock inode_lock;     //保护inode_hash、inode_lru和i_open_cnts，查找持读锁，增删持写锁
+    struct lock alloc_lock;       //保护两个位图的分配和回收，持有期间不再申请inode的锁和日志
+    struct io_stats stats;   //落在本分区内的请求的统计
 };
 
 /*硬盘结构*/
@@ -26,31 +58,107 @@ struct disk
     char name[8];   //本硬盘的名称
     struct ide_channel* my_channel;   //此块硬盘归属于哪个ide通道
     uint8_t dev_no;   //本硬盘是主0，还是从1
+    uint32_t sectors;   //可寻址的扇区总数
+    bool lba48;   //是否支持48位lba
+    uint8_t multi_secs;   //pio时一次中断传输的扇区数，1表示未启用多扇区模式
     struct partition prim_parts[4];   //主分区最多是4个
     struct partition logic_parts[8];   //逻辑分区数量无限，但总得有个支持的上限
+    struct io_stats stats;   //本硬盘的请求统计
 };
 
+/*块io请求，提交后由硬盘中断驱动完成，完成时唤醒等待者*/
+struct bio
+{
+    struct disk* hd;   //读写的硬盘
+    uint32_t lba;   //起始扇区
+    uint32_t sec_cnt;   //扇区数，最多256个
+    void* buf;   //调用者的缓冲区
+    void* kbuf;   //实际传输数据的缓冲区，buf在用户空间时是内核中的中转缓冲区，中断处理程序不能访问别的进程的用户空间
+    bool write;   //是否为写请求
+    uint32_t batch_secs;   //作为合并批次的首个请求时，整批的扇区数
+    struct bio* merged_next;   //与本请求lba相连、合并到同一条命令中的下一个请求
+    struct list_elem queue_tag;   //在通道请求队列中的标记，完成后借用它挂到通道的完成队列
+    struct semaphore done;   //同步请求完成时up
+    void (*end_io)(struct bio* bio);   //异步请求完成后由通道的io线程调用，为NULL表示同步请求
+    void* private;   //供end_io使用的调用者数据
+    struct partition* part;   //请求起始扇区所在的分区，不在任何分区内时为NULL，用于统计
+    uint32_t child_cnt;   //条带设备上的批次还未完成的子请求数
+};
+
+/*io向量中的一段，lba起的sec_cnt个扇区对应buf*/
+struct io_seg
+{
+    uint32_t lba;
+    void* buf;
+    uint32_t sec_cnt;
+};
+
+struct prd_entry;
+struct pvblk;
+struct stripe;
+
 /*通道结构*/
 struct ide_channel
 {
     char name[8];   //本ata通道名称
     uint16_t port_base;   //本通道的起始端口号
     uint8_t irq_no;   //本通道所用的中断号
-    struct lock lock;   //通道锁
+    struct list bio_queue;   //待处理的请求，按(硬盘号, lba)升序排列，只存放每个合并批次的首个请求
+    struct bio* cur_bio;   //硬盘正在执行的请求批次，为NULL表示通道空闲
+    uint64_t head_pos;   //上一批请求结束处的排序键，电梯从这里继续向上扫描
+    struct bio* pio_bio;   //pio批次中正在传输的请求
+    uint32_t pio_off;   //pio_bio中已传输的扇区数
+    uint32_t pio_left;   //pio批次中还未传输的扇区数
+    struct list done_list;   //已完成、等待io线程收尾的异步请求
+    struct semaphore io_done;   //done_list中每加入一个请求up一次，唤醒io线程
+    struct list io_waiters;   //等待某批请求完成的线程，每批请求完成时全部唤醒
+    uint32_t async_cnt;   //尚未完成的异步写请求数，异步读不计入
+    uint16_t bmdma_base;   //本通道总线主控dma寄存器的起始端口，为0表示只用pio
+    struct prd_entry* prdt;   //dma的物理区域描述符表，占一页
+    struct pvblk* pv;   //半虚拟化块设备，为NULL表示ata通道
+    struct stripe* stripe;   //条带设备，不为NULL时请求拆给各成员所在的通道
     bool expecting_intr;   //表示等待硬盘的中断，中断处理程序利用此位判断此次的中断是否因为之前的硬盘操作命令引起的
     struct semaphore disk_done;   //用于阻塞、唤醒驱动程序。驱动程序向硬盘发送命令后，在等待硬盘工作期间通过此命令阻塞自己。
+    bool intr_pending;   //中断处理程序已读出状态、等待软中断处理
+    uint8_t intr_status;   //中断处理程序读出的状态寄存器
     struct disk devices[2];   //一个通道上连接两个硬盘，一主一从
 };
 
 extern uint8_t channel_cnt;   //按硬盘数计算的通道数
-extern struct ide_channel channels[2];   //通道数组，有两个ide通道
+extern struct ide_channel channels[CHANNEL_MAX];   //通道数组，ide通道在前，然后是半虚拟化块设备和条带设备
 extern struct list partition_list;   //分区队列
 
+/*初始化对硬盘hd从lba起sec_cnt个扇区的请求，write为true时把buf写入硬盘*/
+void bio_init(struct bio* bio, struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt, bool write);
+/*把请求加入通道的请求队列，通道空闲时立即开始执行*/
+void ide_submit(struct bio* bio);
+/*把cnt个请求一起加入请求队列后再开始执行，lba相连的请求能合并成一条命令*/
+void ide_submit_batch(struct bio** bios, uint32_t cnt);
+/*等待请求完成*/
+void bio_wait(struct bio* bio);
+/*分配一个异步请求用的bio，失败返回NULL*/
+struct bio* bio_alloc(void);
+/*释放bio_alloc分配的bio*/
+void bio_free(struct bio* bio);
+/*把buf中sec_cnt个扇区复制一份后异步写入硬盘，不等待写完*/
+void ide_write_async(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt);
+/*等hd所在通道积压的异步写全部写完，hd为NULL表示所有通道*/
+void ide_sync(struct disk* hd);
+/*按io向量segs从硬盘读取seg_cnt段扇区，lba相连的段合并成一条命令，全部读完才返回*/
+void ide_readv(struct disk* hd, struct io_seg* segs, uint32_t seg_cnt);
+/*按io向量segs把seg_cnt段数据写入硬盘，lba相连的段合并成一条命令，全部写完才返回*/
+void ide_writev(struct disk* hd, struct io_seg* segs, uint32_t seg_cnt);
 /*从硬盘读取sec_cnt个扇区到buf*/
 void ide_read(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt);
-/*将buf中sec_cnt扇区数据写入硬盘*/
+/*将buf中sec_cnt扇区数据写入硬盘，数据复制后即返回，由通道在后台写完*/
 void ide_write(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt);
-/*硬盘中断处理程序*/
+/*把各硬盘和分区的io统计复制到buf，最多cnt项，返回复制的项数*/
+int32_t sys_iostat(struct iostat_entry* buf, uint32_t cnt);
+/*从通道的请求队列中按电梯顺序取下一个批次，队列为空返回NULL，需关中断调用*/
+struct bio* ide_next_batch(struct ide_channel* channel);
+/*批次完成，唤醒其中的同步请求，异步请求交给io线程收尾，需关中断调用*/
+void ide_batch_done(struct ide_channel* channel, struct bio* batch);
+/*硬盘中断处理程序(上半部)*/
 void intr_hd_handler(uint8_t irq_no);
 /*硬盘数据结构初始化*/
 void ide_init(void);
@@ -2,26 +2,38 @@
 #include "interrupt.h"
 #include "global.h"
 #include "debug.h"
+#include "string.h"
+#include "poll.h"
 
-/*初始化io队列ioq*/
-void ioqueue_init(struct ioqueue* ioq)
+/*用调用者提供的size字节的buf做ioq的环形缓冲区，初始化io队列ioq*/
+void ioqueue_init_buf(struct ioqueue* ioq, char* buf, uint32_t size)
 {
+    ASSERT(size >= 2);
     lock_init(&ioq->lock);   //初始化io队列的锁
     ioq->producer = ioq->consumer = NULL;   //生产者和消费者置空
+    ioq->buf = buf;
+    ioq->size = size;
     ioq->head = ioq->tail = 0;   //队列的收尾指针指向缓冲区数组第0个位置
+    wait_queue_init(&ioq->poll_wq);
+}
+
+/*初始化io队列ioq，使用结构体内bufsize大小的缓冲区*/
+void ioqueue_init(struct ioqueue* ioq)
+{
+    ioqueue_init_buf(ioq, ioq->inline_buf, bufsize);
 }
 
-/*返回pos在缓冲区中的下一个位置值*/
-static int32_t next_pos(int32_t pos)
+/*返回pos在ioq缓冲区中的下一个位置值*/
+static int32_t next_pos(struct ioqueue* ioq, int32_t pos)
 {
-    return (pos + 1) % bufsize;
+    return (pos + 1) % ioq->size;
 }
 
 /*判断队列是否已满*/
 bool ioq_full(struct ioqueue* ioq)
 {
     ASSERT(intr_get_status() == INTR_OFF);
-    return next_pos(ioq->head) == ioq->tail;
+    return next_pos(ioq, ioq->head) == ioq->tail;
 }
 
 /*判断队列是否已空*/
@@ -62,7 +74,7 @@ char ioq_getchar(struct ioqueue* ioq)
     }
 
     char byte = ioq->buf[ioq->tail];   //从缓冲区中取出
-    ioq->tail = next_pos(ioq->tail);   //吧读游标移到下一个位置
+    ioq->tail = next_pos(ioq, ioq->tail);   //吧读游标移到下一个位置
 
     if(ioq->producer != NULL) {
         wakeup(&ioq->producer);   //唤醒生产者
@@ -85,11 +97,12 @@ void ioq_putchar(struct ioqueue* ioq, char byte)
         lock_release(&ioq->lock);
     }
     ioq->buf[ioq->head] = byte;   //白字节放入缓冲区
-    ioq->head = next_pos(ioq->head);   //吧游标移到下一位置
+    ioq->head = next_pos(ioq, ioq->head);   //吧游标移到下一位置
 
     if(ioq->consumer != NULL) {
         wakeup(&ioq->consumer);
     }
+    wait_queue_wake_all(&ioq->poll_wq);
 }
 
 /*返回环形缓冲区中的数据长度*/
@@ -99,7 +112,83 @@ uint32_t ioq_length(struct ioqueue* ioq)
     if(ioq->head >= ioq->tail) {
         len = ioq->head - ioq->tail;
     } else {
-        len = bufsize - (ioq->tail - ioq->head);
+        len = ioq->size - (ioq->tail - ioq->head);
     }
     return len;
 }
+
+/*返回环形缓冲区中的空闲长度，队首和队尾之间要空一格区分满和空*/
+uint32_t ioq_space(struct ioqueue* ioq)
+{
+    return ioq->size - 1 - ioq_length(ioq);
+}
+
+/*从ioq中取出已有的最多len个字节到buf，不等待，返回取出的字节数。
+  数据在缓冲区中最多分成队尾到缓冲区末尾、缓冲区开头到队首两段，各用一次memcpy，取完只唤醒一次生产者*/
+uint32_t ioq_read_bulk(struct ioqueue* ioq, char* buf, uint32_t len)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    uint32_t avail = ioq_length(ioq);
+    if(len > avail) {
+        len = avail;
+    }
+    if(len == 0) {
+        return 0;
+    }
+    uint32_t first = ioq->size - ioq->tail;   //第一段到缓冲区末尾为止
+    if(first > len) {
+        first = len;
+    }
+    memcpy(buf, &ioq->buf[ioq->tail], first);
+    if(len > first) {   //绕回缓冲区开头的第二段
+        memcpy(buf + first, ioq->buf, len - first);
+    }
+    ioq->tail = (ioq->tail + len) % ioq->size;
+
+    if(ioq->producer != NULL) {
+        wakeup(&ioq->producer);
+    }
+    return len;
+}
+
+/*把buf中的len个字节全部放入ioq，队列满时等待消费者取走。
+  每批按当前空闲空间放入，最多分成队首到缓冲区末尾、缓冲区开头两段各复制一次，
+  一批放完只唤醒一次消费者，睡眠前消费者已被唤醒所以不会互相等待*/
+void ioq_write_bulk(struct ioqueue* ioq, const char* buf, uint32_t len)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    while(len > 0) {
+        while(ioq_full(ioq)) {
+            lock_acquire(&ioq->lock);
+            ioq_wait(&ioq->producer);
+            lock_release(&ioq->lock);
+        }
+        uint32_t batch = ioq_space(ioq);
+        if(batch > len) {
+            batch = len;
+        }
+        uint32_t first = ioq->size - ioq->head;
+        if(first > batch) {
+            first = batch;
+        }
+        memcpy(&ioq->buf[ioq->head], buf, first);
+        if(batch > first) {
+            memcpy(ioq->buf, buf + first, batch - first);
+        }
+        ioq->head = (ioq->head + batch) % ioq->size;
+        buf += batch;
+        len -= batch;
+
+        if(ioq->consumer != NULL) {
+            wakeup(&ioq->consumer);
+        }
+        wait_queue_wake_all(&ioq->poll_wq);
+    }
+}
+
+/*返回ioq的就绪事件，有数据时可读，pt不为NULL时登记到poll_wq，需关中断调用*/
+uint32_t ioq_poll(struct ioqueue* ioq, struct poll_table* pt)
+{
+    poll_wait(&ioq->poll_wq, pt);
+    return ioq_empty(ioq) ? 0 : POLLIN;
+}
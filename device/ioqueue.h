@@ -13,17 +13,32 @@ struct ioqueue
     struct lock lock;
     struct task_struct* producer;   //生产者，缓冲区不满时就继续往里面放数据，否则就睡眠，此项记录哪个生产者在此缓冲区上睡眠
     struct task_struct* consumer;   //消费者，缓冲区不空时就从里面拿数据，否则就睡眠，此项记录哪个生产者在此缓冲区上睡眠
-    char buf[bufsize];   //缓冲区大小
+    char* buf;   //环形缓冲区，默认指向下面的inline_buf
+    uint32_t size;   //缓冲区大小，最多存放size-1个字节
+    char inline_buf[bufsize];   //默认的缓冲区
     int32_t head;   //队首，数据往队首处写入
     int32_t tail;   //对尾，数据从对尾处读出
+    struct wait_queue poll_wq;   //在poll中等数据的线程
 };
 
+struct poll_table;
+
 void ioqueue_init(struct ioqueue* ioq);
+/*用调用者提供的size字节的buf做ioq的环形缓冲区*/
+void ioqueue_init_buf(struct ioqueue* ioq, char* buf, uint32_t size);
 bool ioq_full(struct ioqueue* ioq);
 bool ioq_empty(struct ioqueue* ioq);
 char ioq_getchar(struct ioqueue* ioq);
 void ioq_putchar(struct ioqueue* ioq, char byte);
 /*返回环形缓冲区中的数据长度*/
 uint32_t ioq_length(struct ioqueue* ioq);
+/*返回ioq的就绪事件，有数据时可读，pt不为NULL时登记到poll_wq*/
+uint32_t ioq_poll(struct ioqueue* ioq, struct poll_table* pt);
+/*返回环形缓冲区中的空闲长度*/
+uint32_t ioq_space(struct ioqueue* ioq);
+/*从ioq中取出已有的最多len个字节到buf，不等待，返回取出的字节数*/
+uint32_t ioq_read_bulk(struct ioqueue* ioq, char* buf, uint32_t len);
+/*把buf中的len个字节全部放入ioq，队列满时等待消费者取走*/
+void ioq_write_bulk(struct ioqueue* ioq, const char* buf, uint32_t len);
 
 #endif
@@ -4,8 +4,10 @@
 #include "io.h"
 #include "global.h"
 #include "ioqueue.h"
+#include "softirq.h"
 
 #define KBD_BUF_PORT 0x60   //键盘buffer寄存器端口号为0x60
+#define KBD_RAW_SIZE 64   //上半部存放原始扫描码的缓冲区大小
 
 /*用转义字符定义部分控制字符*/
 #define esc         '\033'   //八进制表示字符，也可以用十六进制'\x1b'
@@ -37,6 +39,10 @@
 
 struct ioqueue kbd_buf;   //定义键盘缓冲区
 
+/*上半部存入、下半部取出的原始扫描码，下标只增不减，取模得到位置*/
+static uint8_t raw_buf[KBD_RAW_SIZE];
+static uint32_t raw_head, raw_tail;
+
 /*定义一下变量记录相应键是否按下的状态
   ext_scancode 用于记录makecode是否是以0xe0开头*/
 static bool ctrl_status, shift_status, alt_status, caps_lock_status, ext_scancode;
@@ -107,8 +113,8 @@ static char keymap[][2] = {
     //其他按键暂不处理
 };
 
-/*键盘中断处理程序*/
-static void intr_keyboard_handler(void)
+/*把一个扫描码转换成字符放入kbd_buf，或更新控制键的状态*/
+static void keyboard_scancode(uint16_t scancode)
 {
     //这次中断发生的上一次中断，以下任意三个键是否有按下
     bool ctrl_down_last = ctrl_status;
@@ -116,7 +122,6 @@ static void intr_keyboard_handler(void)
     bool caps_lock_last = caps_lock_status;
 
     bool break_code;
-    uint16_t scancode = inb(KBD_BUF_PORT);
 
     //若扫描码scancode是e0开头的，表示此键的按下将产生多个扫描码，
     //所以马上结束此次中断处理函数，等待下一个扫描码进来
@@ -177,10 +182,12 @@ static void intr_keyboard_handler(void)
                 cur_char -= 'a';
             }
             //若kbd_buf中未满且待加入的cur_char不为0，则将其加入到缓冲区kbd_buf中
+            enum intr_status old_status = intr_disable();
             if(!ioq_full(&kbd_buf)) {
                 //put_char(cur_char);   //临时
                 ioq_putchar(&kbd_buf, cur_char);
             }
+            intr_set_status(old_status);
             return;
         }
         //记录本次是否按下了下面几类控制键之一，供下次键入时判组合键
@@ -196,11 +203,37 @@ static void intr_keyboard_handler(void)
     }
 }
 
+/*键盘中断处理程序(上半部)：读出扫描码使键盘可以送下一个，存入原始扫描码缓冲区，转换留给软中断*/
+static void intr_keyboard_handler(void)
+{
+    uint8_t scancode = inb(KBD_BUF_PORT);
+    if(raw_tail - raw_head < KBD_RAW_SIZE) {   //满了丢弃新来的扫描码
+        raw_buf[raw_tail++ % KBD_RAW_SIZE] = scancode;
+    }
+    softirq_raise(SOFTIRQ_KEYBOARD);
+}
+
+/*键盘软中断(下半部)：开着中断逐个转换原始扫描码缓冲区中的扫描码*/
+static void keyboard_softirq(void)
+{
+    while(1) {
+        enum intr_status old_status = intr_disable();
+        if(raw_head == raw_tail) {
+            intr_set_status(old_status);
+            break;
+        }
+        uint8_t scancode = raw_buf[raw_head++ % KBD_RAW_SIZE];
+        intr_set_status(old_status);
+        keyboard_scancode(scancode);
+    }
+}
+
 /*键盘初始化*/
 void keyboard_init()
 {
     put_str("keyboard init start\n");
     ioqueue_init(&kbd_buf);
+    softirq_register(SOFTIRQ_KEYBOARD, keyboard_softirq);
     register_handler(0x21, intr_keyboard_handler);
     put_str("keyboard init done\n");
 }
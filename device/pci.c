@@ -0,0 +1,61 @@
+#include "pci.h"
+#include "stdint.h"
+#include "global.h"
+#include "io.h"
+
+#define PCI_CONFIG_ADDRESS 0xcf8   //配置地址端口
+#define PCI_CONFIG_DATA    0xcfc   //配置数据端口
+#define PCI_ENABLE         0x80000000   //配置地址的最高位，置1才会产生配置访问
+
+/*拼出pdev配置空间offset处的配置地址*/
+static uint32_t pci_config_addr(struct pci_dev* pdev, uint8_t offset)
+{
+    return PCI_ENABLE | ((uint32_t)pdev->bus << 16) | ((uint32_t)pdev->dev << 11) | \
+           ((uint32_t)pdev->func << 8) | (offset & 0xfc);
+}
+
+/*读取pdev配置空间offset处的双字，offset须4字节对齐*/
+uint32_t pci_config_read(struct pci_dev* pdev, uint8_t offset)
+{
+    outl(PCI_CONFIG_ADDRESS, pci_config_addr(pdev, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+/*向pdev配置空间offset处写入双字，offset须4字节对齐*/
+void pci_config_write(struct pci_dev* pdev, uint8_t offset, uint32_t value)
+{
+    outl(PCI_CONFIG_ADDRESS, pci_config_addr(pdev, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+/*查找第一个类号为class_code、子类号为subclass的功能，找到返回true并填入pdev。
+  厂商号为0xffff表示没有这个设备，单功能设备只看0号功能*/
+bool pci_find_class(uint8_t class_code, uint8_t subclass, struct pci_dev* pdev)
+{
+    struct pci_dev cur;
+    uint32_t bus, dev, func;
+    for(bus = 0; bus < 256; bus++) {
+        for(dev = 0; dev < 32; dev++) {
+            for(func = 0; func < 8; func++) {
+                cur.bus = bus;
+                cur.dev = dev;
+                cur.func = func;
+                if((pci_config_read(&cur, PCI_VENDOR_ID) & 0xffff) == 0xffff) {
+                    if(func == 0) {
+                        break;
+                    }
+                    continue;
+                }
+                uint32_t class_reg = pci_config_read(&cur, PCI_CLASS);
+                if((class_reg >> 24) == class_code && ((class_reg >> 16) & 0xff) == subclass) {
+                    *pdev = cur;
+                    return true;
+                }
+                if(func == 0 && !(pci_config_read(&cur, PCI_HEADER_TYPE) & 0x800000)) {
+                    break;
+                }
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,31 @@
+#ifndef __DEVICE_PCI_H
+#define __DEVICE_PCI_H
+#include "stdint.h"
+#include "global.h"
+
+/*配置空间中的一些寄存器偏移*/
+#define PCI_VENDOR_ID   0x00   //低16位厂商号，高16位设备号
+#define PCI_COMMAND     0x04   //低16位命令寄存器，高16位状态寄存器
+#define PCI_CLASS       0x08   //低8位修订号，往上依次为编程接口、子类、类
+#define PCI_HEADER_TYPE 0x0c   //第16~23位为头部类型，最高位为1表示多功能设备
+#define PCI_BAR0        0x10   //基址寄存器，共6个，每个4字节
+
+#define PCI_CMD_IO      0x1   //允许响应io空间访问
+#define PCI_CMD_MASTER  0x4   //允许设备作为总线主控发起dma
+
+/*一个pci功能的地址*/
+struct pci_dev
+{
+    uint8_t bus;
+    uint8_t dev;
+    uint8_t func;
+};
+
+/*读取pdev配置空间offset处的双字，offset须4字节对齐*/
+uint32_t pci_config_read(struct pci_dev* pdev, uint8_t offset);
+/*向pdev配置空间offset处写入双字，offset须4字节对齐*/
+void pci_config_write(struct pci_dev* pdev, uint8_t offset, uint32_t value);
+/*查找第一个类号为class_code、子类号为subclass的功能，找到返回true并填入pdev*/
+bool pci_find_class(uint8_t class_code, uint8_t subclass, struct pci_dev* pdev);
+
+#endif
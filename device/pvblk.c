@@ -0,0 +1,213 @@
+#include "pvblk.h"
+#include "ide.h"
+#include "stdint.h"
+#include "global.h"
+#include "stdio.h"
+#include "stdio-kernel.h"
+#include "debug.h"
+#include "io.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "pci.h"
+#include "softirq.h"
+
+/*半虚拟化块设备：请求描述符放在内存中的环里，设备直接读写内存，
+  一批请求只写一次门铃寄存器，不用像ata那样每条命令写一遍任务文件寄存器*/
+
+/*pci配置空间中的类号，大容量存储控制器中的“其他”类*/
+#define PCI_CLASS_STORAGE   0x01
+#define PCI_SUBCLASS_OTHER  0x80
+#define PVBLK_VENDOR        0xfefe
+#define PVBLK_DEVICE        0x0b10
+#define PCI_INTR_LINE       0x3c   //低8位是bios分配的中断号
+
+/*bar0中的寄存器*/
+#define PVBLK_REG_RING      0x00   //请求环的物理地址
+#define PVBLK_REG_NOTIFY    0x04   //门铃，写入即通知设备取新请求
+#define PVBLK_REG_ISR       0x08   //中断状态，读出即应答中断
+#define PVBLK_REG_SECTORS   0x0c   //硬盘的扇区数
+
+#define SECTOR_SIZE 512
+#define PVBLK_RING_SIZE 16   //环中描述符数，与设备一致
+#define PVBLK_MAX_SEGS  512   //一个描述符最多的内存段数，段表正好占一页
+#define PVBLK_FLAG_WRITE 0x1   //写请求
+#define PVBLK_STATUS_OK  0   //设备完成请求时填入的状态，非0表示出错
+
+/*请求描述符，描述一批lba相连的请求*/
+struct pvblk_desc
+{
+    uint32_t lba;   //起始扇区
+    uint32_t sec_cnt;   //扇区数，最多256个
+    uint32_t flags;
+    volatile uint32_t status;   //设备完成时填写
+    uint32_t seg_addr;   //段表的物理地址
+    uint32_t seg_cnt;   //段表的项数
+    uint32_t reserved[2];
+};
+
+/*段表的一项，一段物理上连续的内存*/
+struct pvblk_seg
+{
+    uint32_t phys_addr;
+    uint32_t byte_cnt;
+};
+
+/*请求环，序号只增不减，序号n的请求在第n % PVBLK_RING_SIZE个描述符中*/
+struct pvblk_ring
+{
+    volatile uint32_t avail_idx;   //驱动已提交的请求数
+    volatile uint32_t used_idx;   //设备已完成的请求数
+    uint32_t reserved[2];
+    struct pvblk_desc desc[PVBLK_RING_SIZE];
+};
+
+struct pvblk
+{
+    uint16_t io_base;   //bar0的io基址
+    uint8_t irq;   //pci中断号
+    struct pvblk_ring* ring;   //请求环，占一页
+    struct pvblk_seg* segs[PVBLK_RING_SIZE];   //每个描述符的段表，各占一页
+    struct bio* slots[PVBLK_RING_SIZE];   //每个描述符对应的请求批次
+    uint32_t avail;   //下一个请求的序号
+    uint32_t used;   //下一个待完成请求的序号
+};
+
+static struct pvblk pvblk_dev;   //只支持一个设备
+static struct ide_channel* pvblk_channel;
+
+/*按批次中各请求的缓冲区填写段表，物理上相接的页并成一段，返回段数*/
+static uint32_t seg_build(struct pvblk_seg* segs, struct bio* batch)
+{
+    uint32_t seg_idx = 0;
+    struct bio* bio;
+    for(bio = batch; bio != NULL; bio = bio->merged_next) {
+        uint32_t vaddr = (uint32_t)bio->kbuf;
+        uint32_t left = bio->sec_cnt * SECTOR_SIZE;
+        while(left > 0) {
+            uint32_t chunk = PG_SIZE - (vaddr & 0xfff);
+            if(chunk > left) {
+                chunk = left;
+            }
+            uint32_t paddr = addr_v2p(vaddr);
+            if(seg_idx > 0 && segs[seg_idx - 1].phys_addr + segs[seg_idx - 1].byte_cnt == paddr) {
+                segs[seg_idx - 1].byte_cnt += chunk;
+            } else {
+                ASSERT(seg_idx < PVBLK_MAX_SEGS);
+                segs[seg_idx].phys_addr = paddr;
+                segs[seg_idx].byte_cnt = chunk;
+                seg_idx++;
+            }
+            vaddr += chunk;
+            left -= chunk;
+        }
+    }
+    return seg_idx;
+}
+
+/*把通道请求队列中的批次放进请求环，一次写门铃提交全部新请求，需关中断调用*/
+void pvblk_start(struct ide_channel* channel)
+{
+    struct pvblk* pv = channel->pv;
+    uint32_t posted = 0;
+    while(pv->avail - pv->used < PVBLK_RING_SIZE) {
+        struct bio* batch = ide_next_batch(channel);
+        if(batch == NULL) {
+            break;
+        }
+        uint32_t slot = pv->avail % PVBLK_RING_SIZE;
+        struct pvblk_desc* desc = &pv->ring->desc[slot];
+        desc->lba = batch->lba;
+        desc->sec_cnt = batch->batch_secs;
+        desc->flags = batch->write ? PVBLK_FLAG_WRITE : 0;
+        desc->seg_addr = addr_v2p((uint32_t)pv->segs[slot]);
+        desc->seg_cnt = seg_build(pv->segs[slot], batch);
+        pv->slots[slot] = batch;
+        pv->avail++;
+        posted++;
+    }
+    if(posted > 0) {
+        //描述符写完才能更新序号，设备读到序号时描述符必须已经就绪
+        asm volatile ("" : : : "memory");
+        pv->ring->avail_idx = pv->avail;
+        outl(pv->io_base + PVBLK_REG_NOTIFY, 0);
+    }
+}
+
+/*处理设备的完成中断，按顺序完成环中已处理的批次并提交新的请求*/
+void pvblk_intr(struct ide_channel* channel)
+{
+    struct pvblk* pv = channel->pv;
+    uint32_t used_idx = pv->ring->used_idx;
+    asm volatile ("" : : : "memory");   //先读序号，再读它之前的描述符状态
+    while(pv->used != used_idx) {
+        uint32_t slot = pv->used % PVBLK_RING_SIZE;
+        struct bio* batch = pv->slots[slot];
+        if(pv->ring->desc[slot].status != PVBLK_STATUS_OK) {
+            char error[64];
+            sprintf(error, "%s, %s sector %d failed!!!!!!\n", batch->hd->name, batch->write ? "write" : "read", batch->lba);
+            PANIC(error);
+        }
+        pv->slots[slot] = NULL;
+        pv->used++;
+        ide_batch_done(channel, batch);
+    }
+    pvblk_start(channel);
+}
+
+/*设备中断处理程序(上半部)，应答中断后交给硬盘软中断完成请求*/
+static void intr_pvblk_handler(uint8_t irq_no UNUSED)
+{
+    //读中断状态寄存器后设备撤下中断信号，电平触发的中断不会重复进来
+    if(inl(pvblk_dev.io_base + PVBLK_REG_ISR) != 0) {
+        pvblk_channel->intr_pending = true;
+        softirq_raise(SOFTIRQ_IDE);
+    }
+}
+
+/*查找半虚拟化块设备，找到时建立请求环并填好通道上的硬盘参数，返回true*/
+bool pvblk_probe(struct ide_channel* channel)
+{
+    struct pci_dev pdev;
+    if(!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_OTHER, &pdev) || \
+       pci_config_read(&pdev, PCI_VENDOR_ID) != ((PVBLK_DEVICE << 16) | PVBLK_VENDOR)) {
+        return false;
+    }
+    uint32_t bar0 = pci_config_read(&pdev, PCI_BAR0);
+    if(!(bar0 & 0x1)) {
+        return false;
+    }
+    struct pvblk* pv = &pvblk_dev;
+    pv->io_base = bar0 & 0xfffc;
+    pv->irq = pci_config_read(&pdev, PCI_INTR_LINE) & 0xff;
+    pv->ring = get_kernel_pages(1);
+    if(pv->ring == NULL) {
+        return false;
+    }
+    uint32_t slot;
+    for(slot = 0; slot < PVBLK_RING_SIZE; slot++) {
+        pv->segs[slot] = get_kernel_pages(1);
+        if(pv->segs[slot] == NULL) {
+            return false;
+        }
+        pv->slots[slot] = NULL;
+    }
+    pv->avail = 0;
+    pv->used = 0;
+    pv->ring->avail_idx = 0;
+    pv->ring->used_idx = 0;
+
+    uint32_t cmd = pci_config_read(&pdev, PCI_COMMAND);
+    pci_config_write(&pdev, PCI_COMMAND, cmd | PCI_CMD_IO | PCI_CMD_MASTER);
+    outl(pv->io_base + PVBLK_REG_RING, addr_v2p((uint32_t)pv->ring));
+
+    channel->pv = pv;
+    channel->irq_no = 0x20 + pv->irq;
+    channel->devices[0].sectors = inl(pv->io_base + PVBLK_REG_SECTORS);
+    channel->devices[0].lba48 = false;
+    channel->devices[0].multi_secs = 1;
+    pvblk_channel = channel;
+    register_handler(channel->irq_no, intr_pvblk_handler);
+    pic_irq_unmask(pv->irq);
+    printk("   pvblk at 0x%x, irq %d, %d sectors\n", pv->io_base, pv->irq, channel->devices[0].sectors);
+    return true;
+}
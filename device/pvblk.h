@@ -0,0 +1,15 @@
+#ifndef __DEVICE_PVBLK_H
+#define __DEVICE_PVBLK_H
+#include "stdint.h"
+#include "global.h"
+
+struct ide_channel;
+
+/*查找半虚拟化块设备，找到时建立请求环并填好通道上的硬盘参数，返回true*/
+bool pvblk_probe(struct ide_channel* channel);
+/*把通道请求队列中的批次放进请求环，一次写门铃提交全部新请求，需关中断调用*/
+void pvblk_start(struct ide_channel* channel);
+/*处理设备的完成中断，按顺序完成环中已处理的批次并提交新的请求*/
+void pvblk_intr(struct ide_channel* channel);
+
+#endif
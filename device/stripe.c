@@ -0,0 +1,200 @@
+#include "stripe.h"
+#include "ide.h"
+#include "stdint.h"
+#include "global.h"
+#include "stdio.h"
+#include "stdio-kernel.h"
+#include "debug.h"
+#include "interrupt.h"
+#include "thread.h"
+#include "sync.h"
+#include "string.h"
+
+/*条带设备(RAID-0)：md0的扇区按STRIPE_CHUNK_SECS个一段轮流分给各成员分区，第n段在第n % 成员数个成员上。
+  md0像半虚拟化块设备一样是只有一块硬盘的通道，请求照常在它的队列里排序、合并，
+  分发线程把每个批次拆成各成员上的子请求提交给成员所在的通道，成员在不同通道上时各通道同时传输*/
+
+#define SECTOR_SIZE 512
+#define STRIPE_CHUNK_SECS 16   //每段的扇区数，8KB
+#define STRIPE_SUBMIT_BIOS 16   //每个成员攒够这么多子请求就一起提交，相连的能合并成一条命令
+
+struct stripe
+{
+    struct partition* members[STRIPE_MAX_MEMBERS];   //按扫描顺序排列的成员分区
+    uint32_t member_cnt;
+    uint32_t member_secs;   //每个成员用到的扇区数，按最小的成员向下取整到段
+    struct semaphore kick;   //唤醒分发线程
+    bool kicked;   //已唤醒、分发线程还没开始取批次，免得信号量累加
+};
+
+static struct stripe stripe_dev;   //只支持一个条带设备
+static struct ide_channel* stripe_channel;
+
+/*记下分区表中类型为PART_TYPE_STRIPE的分区，扫描分区时按硬盘顺序调用，这个顺序就是条带的顺序*/
+void stripe_add_member(struct partition* part)
+{
+    if(stripe_dev.member_cnt == STRIPE_MAX_MEMBERS) {
+        printk("   %s ignored, md0 has %d members already\n", part->name, STRIPE_MAX_MEMBERS);
+        return;
+    }
+    stripe_dev.members[stripe_dev.member_cnt++] = part;
+}
+
+/*通道请求队列中有新批次，唤醒分发线程，需关中断调用*/
+void stripe_start(struct ide_channel* channel UNUSED)
+{
+    if(!stripe_dev.kicked) {
+        stripe_dev.kicked = true;
+        sema_up(&stripe_dev.kick);
+    }
+}
+
+/*放下对批次的一次引用，子请求全部完成且分发线程拆完后批次完成*/
+static void stripe_put(struct bio* batch)
+{
+    enum intr_status old_status = intr_disable();
+    if(--batch->child_cnt == 0) {
+        ide_batch_done(stripe_channel, batch);
+    }
+    intr_set_status(old_status);
+}
+
+/*子请求完成后的收尾，在成员通道的io线程中执行*/
+static void stripe_child_done(struct bio* child)
+{
+    struct bio* batch = child->private;
+    bio_free(child);
+    stripe_put(batch);
+}
+
+/*把攒下的cnt个子请求一起提交给成员所在的通道。子请求都是异步请求，
+  写请求完成时成员通道会减它的async_cnt，提交时先加上，ide_sync成员硬盘时也会等它们*/
+static void stripe_submit(struct bio* batch, struct bio** bios, uint32_t cnt)
+{
+    enum intr_status old_status = intr_disable();
+    batch->child_cnt += cnt;
+    if(batch->write) {
+        bios[0]->hd->my_channel->async_cnt += cnt;
+    }
+    intr_set_status(old_status);
+    ide_submit_batch(bios, cnt);
+}
+
+/*把批次拆成各成员上的子请求并提交。子请求不跨段，也不跨批次中原来的请求，因为各请求的缓冲区互不相连，
+  成员上lba相连的子请求由成员通道的电梯合并成一条命令*/
+static void stripe_split(struct bio* batch)
+{
+    struct stripe* st = &stripe_dev;
+    struct bio* pending[STRIPE_MAX_MEMBERS][STRIPE_SUBMIT_BIOS];
+    uint32_t pending_cnt[STRIPE_MAX_MEMBERS];
+    memset(pending_cnt, 0, sizeof(pending_cnt));
+    batch->child_cnt = 1;   //拆的过程中先完成的子请求不能让批次提前完成
+
+    struct bio* bio;
+    for(bio = batch; bio != NULL; bio = bio->merged_next) {
+        uint32_t off = 0;
+        while(off < bio->sec_cnt) {
+            uint32_t lba = bio->lba + off;
+            uint32_t chunk = lba / STRIPE_CHUNK_SECS;
+            uint32_t in_chunk = lba % STRIPE_CHUNK_SECS;
+            uint32_t secs = STRIPE_CHUNK_SECS - in_chunk;
+            if(secs > bio->sec_cnt - off) {
+                secs = bio->sec_cnt - off;
+            }
+            uint32_t member_idx = chunk % st->member_cnt;
+            struct partition* part = st->members[member_idx];
+            uint32_t member_lba = part->start_lba + chunk / st->member_cnt * STRIPE_CHUNK_SECS + in_chunk;
+
+            struct bio* child = bio_alloc();
+            if(child == NULL) {
+                PANIC("stripe_split: no memory for bio\n");
+            }
+            //批次的缓冲区在内核中，子请求直接用它，不再中转
+            bio_init(child, part->my_disk, member_lba, (void*)((uint32_t)bio->kbuf + off * SECTOR_SIZE), secs, bio->write);
+            child->end_io = stripe_child_done;
+            child->private = batch;
+            pending[member_idx][pending_cnt[member_idx]++] = child;
+            if(pending_cnt[member_idx] == STRIPE_SUBMIT_BIOS) {
+                stripe_submit(batch, pending[member_idx], STRIPE_SUBMIT_BIOS);
+                pending_cnt[member_idx] = 0;
+            }
+            off += secs;
+        }
+    }
+    uint32_t member_idx;
+    for(member_idx = 0; member_idx < st->member_cnt; member_idx++) {
+        if(pending_cnt[member_idx] > 0) {
+            stripe_submit(batch, pending[member_idx], pending_cnt[member_idx]);
+        }
+    }
+    stripe_put(batch);
+}
+
+/*分发线程，按电梯顺序取出md0请求队列中的批次拆给各成员。
+  拆的时候要分配bio、可能等成员通道的队列，不能放在关中断的stripe_start里*/
+static void stripe_dispatch(void* arg UNUSED)
+{
+    while(1) {
+        sema_down(&stripe_dev.kick);
+        enum intr_status old_status = intr_disable();
+        stripe_dev.kicked = false;   //此后提交的批次会再唤醒一次
+        intr_set_status(old_status);
+        while(1) {
+            old_status = intr_disable();
+            struct bio* batch = ide_next_batch(stripe_channel);
+            intr_set_status(old_status);
+            if(batch == NULL) {
+                break;
+            }
+            stripe_split(batch);
+        }
+    }
+}
+
+/*成员分区不少于两个时把通道channel建成条带设备md0，填好md0的硬盘和分区参数，返回true*/
+bool stripe_probe(struct ide_channel* channel)
+{
+    struct stripe* st = &stripe_dev;
+    if(st->member_cnt < 2) {
+        if(st->member_cnt == 1) {
+            printk("   %s ignored, md0 needs at least 2 members\n", st->members[0]->name);
+        }
+        return false;
+    }
+    uint32_t member_idx;
+    st->member_secs = st->members[0]->sec_cnt;
+    for(member_idx = 1; member_idx < st->member_cnt; member_idx++) {
+        if(st->members[member_idx]->sec_cnt < st->member_secs) {
+            st->member_secs = st->members[member_idx]->sec_cnt;
+        }
+    }
+    st->member_secs -= st->member_secs % STRIPE_CHUNK_SECS;
+    sema_init(&st->kick, 0);
+    st->kicked = false;
+    stripe_channel = channel;
+    channel->stripe = st;
+
+    struct disk* hd = &channel->devices[0];
+    hd->my_channel = channel;
+    hd->dev_no = 0;
+    strcpy(hd->name, "md0");
+    hd->sectors = st->member_secs * st->member_cnt;
+    hd->lba48 = false;
+    hd->multi_secs = 1;
+    printk("   md0: %d members, chunk %d sectors, %dMB\n", st->member_cnt, STRIPE_CHUNK_SECS, hd->sectors / 2048);
+    for(member_idx = 0; member_idx < st->member_cnt; member_idx++) {
+        printk("      member %s\n", st->members[member_idx]->name);
+    }
+
+    //md0上没有分区表，整个设备作为一个分区交给文件系统
+    struct partition* part = &hd->prim_parts[0];
+    part->start_lba = 0;
+    part->sec_cnt = hd->sectors;
+    part->my_disk = hd;
+    part->fs_type = 0;
+    strcpy(part->name, STRIPE_PART_NAME);
+    list_append(&partition_list, &part->part_tag);
+
+    thread_start("md0_dispatch", 31, stripe_dispatch, NULL);
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef __DEVICE_STRIPE_H
+#define __DEVICE_STRIPE_H
+#include "stdint.h"
+#include "global.h"
+
+#define PART_TYPE_STRIPE 0xfd   //分区表中的类型，这种分区不单独挂载，合起来组成条带设备md0
+#define STRIPE_MAX_MEMBERS 4   //条带设备最多的成员分区数
+#define STRIPE_PART_NAME "md0p1"   //条带设备上唯一的分区，覆盖整个md0
+
+struct ide_channel;
+struct partition;
+
+/*记下分区表中类型为PART_TYPE_STRIPE的分区，扫描分区时按硬盘顺序调用，这个顺序就是条带的顺序*/
+void stripe_add_member(struct partition* part);
+/*成员分区不少于两个时把通道channel建成条带设备md0，填好md0的硬盘和分区参数，返回true*/
+bool stripe_probe(struct ide_channel* channel);
+/*通道请求队列中有新批次，唤醒分发线程，需关中断调用*/
+void stripe_start(struct ide_channel* channel);
+
+#endif
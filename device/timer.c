@@ -4,8 +4,13 @@
 #include "thread.h"
 #include "debug.h"
 #include "stdint.h"
+#include "list.h"
+#include "interrupt.h"
+#include "vdata.h"
+#include "profile.h"
+#include "hrtimer.h"
+#include "rcu.h"
 
-#define IRQ0_FREQUENCY      100   //时钟中断的频率为1s 100次
 #define INPUT_FREQUENCY     1193180
 #define COUNTER0_VALUE      INPUT_FREQUENCY / IRQ0_FREQUENCY
 #define COUNTER0_PORT       0x40
@@ -13,10 +18,18 @@
 #define COUNTER_MODE        2
 #define READ_WRITE_LATCH    3
 #define PIT_CONTROL_PORT    0x43
+#define ONESHOT_MODE        0   //计数到0时输出一次中断，之后不再重装
+#define PIT_READ_BACK       0xe2   //读回0号计数器的状态字
+#define PIT_STATUS_OUT      0x80   //状态字中的OUT引脚位，单次模式下计数到0后变为1
+#define TICKLESS_MAX_TICKS  (0xffff / (COUNTER0_VALUE))   //16位计数器单次最多能定时的滴答数
 
 #define mil_seconds_per_intr (1000 / IRQ0_FREQUENCY)   //每多少毫秒(10ms)发生一次中断，以毫秒计算的中断周期
 
 uint32_t ticks;   //ticks是内核字中断开启以来总共的滴答数
+static struct list sleep_list;   //休眠的任务，按唤醒时刻从早到晚排列，借用general_tag串起来
+static uint32_t tickless_ticks;   //单次定时跳过的滴答数，为0表示时钟处于周期模式
+static uint32_t intr_per_tick = 1;   //每个滴答的时钟中断数，采样时调快8253，多出的中断只采样
+static uint32_t intr_in_tick;   //本滴答内已经来过的时钟中断数
 
 /*把操作的计数器counter_no、读写锁属性rwl、计数器模式counter_mode写入模式控制寄存器并赋予初始值counter_value*/
 static void frequency_set(uint8_t counter_port, \
@@ -30,46 +43,190 @@ static void frequency_set(uint8_t counter_port, \
     //先写入counter_value的低8位
     outb(counter_port, (uint8_t)counter_value);
     //在写入counter_value的高8位
-    outb(counter_port, (uint8_t)counter_value >> 8);
+    outb(counter_port, (uint8_t)(counter_value >> 8));
 }
 
-/*时钟的中断处理函数*/
-static void intr_timer_handler(void)
+/*恢复周期性的时钟中断*/
+static void timer_periodic_restore(void)
+{
+    frequency_set(COUNTER0_PORT, COUNTER0_NO, READ_WRITE_LATCH, COUNTER_MODE, (COUNTER0_VALUE) / intr_per_tick);
+    tickless_ticks = 0;
+}
+
+/*本cpu的一次时钟滴答：记录当前任务的运行时间，时间片用完就标记需要调度*/
+void timer_local_tick(void)
 {
     struct task_struct* cur_thread = running_thread();
 
     ASSERT(cur_thread->stack_magic == 0x19870916);
 
     cur_thread->elapsed_ticks++;   //记录此线程占用cpu的时间
-    ticks++;   //从内核第一次处理时间中断后开始至今的滴答数，内核态和用户态总共的滴答数
-
-    if(cur_thread->ticks == 0) {   //若时间片用完，就开始调度新的进程上cpu
-        schedule();
+    //时钟中断本身持一层大内核锁，只有这一层说明被打断的是用户态
+    if(cur_thread->pgdir != NULL && cur_thread->bkl_depth == 1) {
+        cur_thread->stats.utime++;
+    } else {
+        cur_thread->stats.stime++;
+    }
+    if(cur_thread->ticks == 0) {   //若时间片用完，标记需要调度，在中断返回等抢占点换下
+        cur_thread->need_resched = true;
     } else {
         cur_thread->ticks--;
     }
+    cpu_group_charge(cur_thread);
+}
+
+/*时钟的中断处理函数，8253只向0号cpu发中断，全局的滴答数和休眠队列在这里维护*/
+static void intr_timer_handler(void)
+{
+    profile_sample();
+    if(intr_per_tick > 1 && ++intr_in_tick < intr_per_tick) {   //调快后的中断只用来采样
+        return;
+    }
+    intr_in_tick = 0;
+
+    //单次定时到期，补上空闲期间跳过的滴答，再回到周期模式
+    bool periodic = tickless_ticks == 0;
+    if(!periodic) {
+        ticks += tickless_ticks - 1;
+        timer_periodic_restore();
+    }
+    ticks++;   //从内核第一次处理时间中断后开始至今的滴答数，内核态和用户态总共的滴答数
+    vdata_tick(periodic);
+
+    //唤醒到期的休眠任务，队列有序，只需看队首
+    while(!list_empty(&sleep_list)) {
+        struct task_struct* sleeper = elem2entry(struct task_struct, general_tag, sleep_list.head.next);
+        if((int32_t)(ticks - sleeper->wakeup_tick) < 0) {
+            break;
+        }
+        list_remove(&sleeper->general_tag);
+        thread_unblock(sleeper);
+    }
+    hrtimer_expire();   //没有单次中断时高精度定时器靠这里到期，有时也顺便兜底
+    rcu_tick();
+    cpu_group_tick();   //到了新周期的cpu带宽控制组解除限流
+
+    timer_local_tick();
+}
+
+/*只剩idle可运行时由0号cpu在hlt前调用，把时钟改为单次触发，到最早的休眠任务到期时才中断。
+  需关中断调用，最近的到期时刻不足2个滴答时保持周期模式*/
+void timer_tickless_enter(void)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    if(intr_per_tick > 1 || hrtimer_need_tick() || cpu_group_need_tick()) {   //采样期间、高精度定时器靠滴答到期和有组被限流时保持周期模式
+        return;
+    }
+    uint32_t sleep_ticks = TICKLESS_MAX_TICKS;
+    if(!list_empty(&sleep_list)) {
+        struct task_struct* sleeper = elem2entry(struct task_struct, general_tag, sleep_list.head.next);
+        int32_t delta = (int32_t)(sleeper->wakeup_tick - ticks);
+        if(delta < (int32_t)sleep_ticks) {
+            sleep_ticks = delta;
+        }
+    }
+    if((int32_t)sleep_ticks < 2) {
+        return;
+    }
+    tickless_ticks = sleep_ticks;
+    frequency_set(COUNTER0_PORT, COUNTER0_NO, READ_WRITE_LATCH, ONESHOT_MODE, sleep_ticks * (COUNTER0_VALUE));
+}
+
+/*hlt被唤醒后由0号cpu调用，需关中断。单次定时已到期时留给时钟中断处理函数补滴答，
+  被其他中断提前唤醒时按计数器剩余值补上已过去的滴答并恢复周期模式*/
+void timer_tickless_exit(void)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    if(tickless_ticks == 0) {
+        return;
+    }
+    outb(PIT_CONTROL_PORT, PIT_READ_BACK);
+    uint8_t status = inb(COUNTER0_PORT);
+    if(status & PIT_STATUS_OUT) {   //到期的时钟中断已在PIC中挂起，开中断后就会处理
+        return;
+    }
+    outb(PIT_CONTROL_PORT, COUNTER0_NO << 6);   //锁存0号计数器的当前值
+    uint32_t remain = inb(COUNTER0_PORT);
+    remain |= (uint32_t)inb(COUNTER0_PORT) << 8;
+    ticks += (tickless_ticks * (COUNTER0_VALUE) - remain) / (COUNTER0_VALUE);
+    timer_periodic_restore();
+    vdata_tick(false);   //计数器从现在重新开始一个周期，下一次时钟中断仍可用来校准
+}
+
+/*把8253调成每个滴答中断per_tick次，per_tick为1时恢复正常频率，滴答数的走速不变。
+  处于单次定时时先补上已过去的滴答，到期的中断还没处理时由它按新频率恢复周期模式*/
+void timer_intr_per_tick_set(uint32_t per_tick)
+{
+    ASSERT(per_tick >= 1 && per_tick <= TIMER_INTR_PER_TICK_MAX);
+    enum intr_status old_status = intr_disable();
+    timer_tickless_exit();
+    intr_per_tick = per_tick;
+    intr_in_tick = 0;
+    if(tickless_ticks == 0) {
+        timer_periodic_restore();
+    }
+    intr_set_status(old_status);
+}
+
+/*把当前任务按唤醒时刻wakeup_tick挂上休眠队列并阻塞，到期由时钟中断处理函数唤醒，需关中断调用*/
+void timer_block_until(uint32_t wakeup_tick)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    struct task_struct* cur = running_thread();
+    cur->wakeup_tick = wakeup_tick;
+
+    //按唤醒时刻插入休眠队列，同一时刻的排在后面
+    struct list_elem* elem = sleep_list.head.next;
+    while(elem != &sleep_list.tail) {
+        struct task_struct* sleeper = elem2entry(struct task_struct, general_tag, elem);
+        if((int32_t)(sleeper->wakeup_tick - cur->wakeup_tick) > 0) {
+            break;
+        }
+        elem = elem->next;
+    }
+    list_insert_before(elem, &cur->general_tag);
+
+    //阻塞自己，由时钟中断处理函数到期唤醒
+    thread_block(TASK_BLOCKED);
+}
+
+/*把还在休眠队列上的pthread提前摘下并唤醒，需关中断调用*/
+void timer_wakeup_early(struct task_struct* pthread)
+{
+    ASSERT(intr_get_status() == INTR_OFF && pthread->status == TASK_BLOCKED);
+    list_remove(&pthread->general_tag);
+    thread_unblock(pthread);
+}
+
+/*把毫秒数换算成滴答数，不足一个滴答的按一个算*/
+uint32_t timer_ms_to_ticks(uint32_t m_seconds)
+{
+    return DIV_ROUND_UP(m_seconds, mil_seconds_per_intr);
 }
 
 /*让任务休眠。以tick为单位的sleep，任何时间形式的sleep会转换此ticks形式*/
 //sleep_ticks是要休眠的中断发生次数ticks，即滴答数
 static void ticks_to_sleep(uint32_t sleep_ticks)
 {
-    uint32_t start_tick = ticks;
-
-    //若间隔的ticks数不够便让出cpu
-    while(ticks - start_tick < sleep_ticks) {
-        thread_yield();
-    }
+    enum intr_status old_status = intr_disable();
+    timer_block_until(ticks + sleep_ticks);
+    intr_set_status(old_status);
 }
 
 /*以毫秒为单位的sleep  1s = 1000ms*/
 void mtime_sleep(uint32_t m_seconds)
 {
-    uint32_t sleep_ticks = DIV_ROUND_UP(m_seconds, mil_seconds_per_intr);   //将要休眠的毫秒数转换成时钟中断数ticks
+    uint32_t sleep_ticks = timer_ms_to_ticks(m_seconds);   //将要休眠的毫秒数转换成时钟中断数ticks
     ASSERT(sleep_ticks > 0);
     ticks_to_sleep(sleep_ticks);
 }
 
+/*返回开机以来的时钟滴答数*/
+uint32_t sys_uptime(void)
+{
+    return ticks;
+}
+
 /*初始化PIT8253*/
 void timer_init()
 {
@@ -79,6 +236,8 @@ void timer_init()
                   READ_WRITE_LATCH, \
                   COUNTER_MODE, \
                   COUNTER0_VALUE);
+    list_init(&sleep_list);
+    vdata_init(IRQ0_FREQUENCY);
     register_handler(0x20, intr_timer_handler);
     put_str("timer_init done\n");
 }
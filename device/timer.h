@@ -2,8 +2,29 @@
 #define __DEVICE_TIMER_H
 #include "stdint.h"
 
+#define IRQ0_FREQUENCY 100   //时钟中断的频率为1s 100次，即每秒的滴答数
+#define TIMER_INTR_PER_TICK_MAX 100   //每个滴答最多的时钟中断数，即最高采样频率为10kHz
+
 void timer_init(void);   //初始化PIT
 /*以毫秒为单位的sleep  1s = 1000ms*/
 void mtime_sleep(uint32_t m_seconds);
+/*本cpu的一次时钟滴答，从处理器的本地apic定时器中断也调用它*/
+void timer_local_tick(void);
+/*只剩idle可运行时把时钟改为单次触发，需关中断调用*/
+void timer_tickless_enter(void);
+/*idle被唤醒后补上跳过的滴答并恢复周期性时钟中断，需关中断调用*/
+void timer_tickless_exit(void);
+struct task_struct;
+
+/*把当前任务挂上休眠队列并阻塞到滴答数wakeup_tick，需关中断调用*/
+void timer_block_until(uint32_t wakeup_tick);
+/*把还在休眠队列上的pthread提前摘下并唤醒，需关中断调用*/
+void timer_wakeup_early(struct task_struct* pthread);
+/*把毫秒数换算成滴答数，不足一个滴答的按一个算*/
+uint32_t timer_ms_to_ticks(uint32_t m_seconds);
+/*返回开机以来的时钟滴答数*/
+uint32_t sys_uptime(void);
+/*把8253调成每个滴答中断per_tick次，用于提高采样频率，per_tick为1时恢复正常*/
+void timer_intr_per_tick_set(uint32_t per_tick);
 
 #endif
@@ -0,0 +1,142 @@
+#include "tty.h"
+#include "stdint.h"
+#include "global.h"
+#include "ioqueue.h"
+#include "keyboard.h"
+#include "console.h"
+#include "string.h"
+#include "poll.h"
+#include "stdio-kernel.h"
+
+/*控制台tty，夹在键盘缓冲区和0号描述符之间。
+  行的编辑在读者的上下文中进行，只在从键盘缓冲区取字符时阻塞，几个读者轮流续写同一行*/
+static struct
+{
+    uint32_t mode;   //TTY_ICANON、TTY_ECHO的组合
+    char line[TTY_LINE_MAX];   //正在编辑或已完成的一行
+    uint32_t len;   //line中的字节数
+    uint32_t off;   //已完成的行中已被读走的字节数
+    bool ready;   //line中是完整的一行
+} tty;
+
+/*初始化控制台tty，默认为规范模式并回显*/
+void tty_init(void)
+{
+    tty.mode = TTY_ICANON | TTY_ECHO;
+    tty.len = tty.off = 0;
+    tty.ready = false;
+}
+
+/*回显模式下把c显示出来*/
+static void tty_echo(char c)
+{
+    if(tty.mode & TTY_ECHO) {
+        console_put_char(c);
+    }
+}
+
+/*规范模式下处理键入的原始字符c，完成一行时置ready。
+  回车换行结束一行，ctrl+l也结束一行并留在行尾交给读者重画屏幕，退格删一个字符，ctrl+u删除整行*/
+static void tty_input(char c)
+{
+    switch(c) {
+        case '\r':
+        case '\n':
+            tty.line[tty.len++] = '\n';
+            tty_echo('\n');
+            tty.ready = true;
+            break;
+        case TTY_CTRL_L:
+            tty.line[tty.len++] = c;
+            tty.ready = true;
+            break;
+        case '\b':
+            if(tty.len > 0) {
+                tty.len--;
+                tty_echo('\b');
+            }
+            break;
+        case TTY_CTRL_U:
+            while(tty.len > 0) {
+                tty.len--;
+                tty_echo('\b');
+            }
+            break;
+        default:
+            if(tty.len < TTY_LINE_MAX - 1) {   //留一格给换行符，满了丢弃
+                tty.line[tty.len++] = c;
+                tty_echo(c);
+            }
+    }
+}
+
+/*从line中已完成的行取出最多count个字节到buf，取完后开始新的一行，返回取出的字节数*/
+static uint32_t tty_take(char* buf, uint32_t count)
+{
+    uint32_t size = tty.len - tty.off < count ? tty.len - tty.off : count;
+    memcpy(buf, tty.line + tty.off, size);
+    tty.off += size;
+    if(tty.off == tty.len) {
+        tty.len = tty.off = 0;
+        tty.ready = false;
+    }
+    return size;
+}
+
+/*从控制台tty读入最多count个字节到buf，返回读入的字节数，需关中断调用。
+  规范模式下等到一整行，一次调用读完一行，count不够时余下的留给下次读。
+  原始模式下先交出模式切换前留在行缓冲区的内容，再等到至少一个字节，连同已到的一并取走*/
+int32_t tty_read(void* buf, uint32_t count)
+{
+    char* dst = buf;
+    if(count == 0) {
+        return 0;
+    }
+    if(tty.mode & TTY_ICANON) {
+        while(!tty.ready) {
+            tty_input(ioq_getchar(&kbd_buf));
+        }
+        return tty_take(dst, count);
+    }
+
+    if(tty.len > tty.off) {
+        tty.ready = true;
+        return tty_take(dst, count);
+    }
+    dst[0] = ioq_getchar(&kbd_buf);
+    uint32_t size = 1 + ioq_read_bulk(&kbd_buf, dst + 1, count - 1);
+    uint32_t idx;
+    for(idx = 0; idx < size; idx++) {
+        tty_echo(dst[idx]);
+    }
+    return size;
+}
+
+/*返回控制台tty的就绪事件，pt不为NULL时登记到键盘缓冲区的等待队列，需关中断调用。
+  规范模式下先把已到的字符编辑进行缓冲区，有完整的一行才算可读*/
+uint32_t tty_poll(struct poll_table* pt)
+{
+    uint32_t mask = ioq_poll(&kbd_buf, pt);
+    if(tty.mode & TTY_ICANON) {
+        while(!tty.ready && !ioq_empty(&kbd_buf)) {
+            tty_input(ioq_getchar(&kbd_buf));
+        }
+        return tty.ready ? POLLIN : 0;
+    }
+    return tty.len > tty.off ? POLLIN : mask;
+}
+
+/*对控制台tty执行cmd命令，成功返回模式，失败返回-1*/
+int32_t tty_ioctl(uint32_t cmd, uint32_t arg)
+{
+    switch(cmd) {
+        case TTY_GET_MODE:
+            return tty.mode;
+        case TTY_SET_MODE:
+            tty.mode = arg & (TTY_ICANON | TTY_ECHO);
+            return tty.mode;
+        default:
+            printk("tty_ioctl: unsupported cmd %d\n", cmd);
+            return -1;
+    }
+}
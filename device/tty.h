@@ -0,0 +1,31 @@
+#ifndef __DEVICE_TTY_H
+#define __DEVICE_TTY_H
+#include "stdint.h"
+
+#define TTY_LINE_MAX 512   //规范模式下一行最多的字节数，含结尾的换行符
+
+#define TTY_ICANON 0x02   //规范模式，按行读入，内核处理退格和删除整行
+#define TTY_ECHO 0x08   //回显键入的字符
+
+#define TTY_CTRL_L ('l' - 'a')   //键盘驱动把ctrl+l转换成的字符
+#define TTY_CTRL_U ('u' - 'a')   //键盘驱动把ctrl+u转换成的字符
+
+/*tty_ioctl的命令*/
+enum tty_ioctl_cmd
+{
+    TTY_GET_MODE = 0x5401,   //返回当前模式
+    TTY_SET_MODE = 0x5402    //把模式设为参数中的TTY_ICANON、TTY_ECHO的组合
+};
+
+struct poll_table;
+
+/*初始化控制台tty，默认为规范模式并回显*/
+void tty_init(void);
+/*从控制台tty读入最多count个字节到buf。规范模式下等到一整行，原始模式下等到至少一个字节*/
+int32_t tty_read(void* buf, uint32_t count);
+/*返回控制台tty的就绪事件，pt不为NULL时登记到键盘缓冲区的等待队列*/
+uint32_t tty_poll(struct poll_table* pt);
+/*对控制台tty执行cmd命令，成功返回模式，失败返回-1*/
+int32_t tty_ioctl(uint32_t cmd, uint32_t arg);
+
+#endif
@@ -0,0 +1,356 @@
+#include "bcache.h"
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "sync.h"
+#include "string.h"
+#include "debug.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "ide.h"
+#include "fs.h"
+#include "stdio-kernel.h"
+#include "thread.h"
+#include "timer.h"
+#include "journal.h"
+#include "workqueue.h"
+
+extern uint32_t ticks;
+
+static struct buffer_head bufs[BCACHE_BLOCKS];
+static struct list hash_buckets[BCACHE_HASH_CNT];   //按(硬盘, lba)散列的缓存块
+static struct list lru_list;   //引用计数为0的缓存块，队首是最久未用的
+static struct list dirty_list;   //脏块，按变脏的先后排列
+static uint32_t dirty_cnt;   //脏块数
+
+/*按(硬盘, lba)求哈希桶*/
+static struct list* bcache_bucket(struct disk* hd, uint32_t lba)
+{
+    return &hash_buckets[(lba ^ ((uint32_t)hd >> 4)) % BCACHE_HASH_CNT];
+}
+
+/*给bh加一次引用，需关中断调用*/
+static void bh_get(struct buffer_head* bh)
+{
+    if(bh->ref_cnt++ == 0) {
+        list_remove(&bh->lru_tag);
+    }
+}
+
+/*把bh标记为脏，需关中断调用*/
+static void bh_mark_dirty(struct buffer_head* bh)
+{
+    if(!bh->dirty) {
+        bh->dirty = true;
+        bh->dirty_tick = ticks;
+        list_append(&dirty_list, &bh->dirty_tag);
+        dirty_cnt++;
+    }
+}
+
+/*bh是脏块时写回硬盘，调用者须持有bh的引用。ide_write复制数据后就返回，持有信号量期间数据不会被改一半*/
+static void bh_flush(struct buffer_head* bh)
+{
+    sema_down(&bh->sema);
+    enum intr_status old_status = intr_disable();
+    bool need_write = bh->dirty && !bh->jdirty;
+    if(need_write) {
+        bh->dirty = false;
+        list_remove(&bh->dirty_tag);
+        dirty_cnt--;
+    }
+    intr_set_status(old_status);
+    if(need_write) {
+        ide_write(bh->hd, bh->lba, bh->data, 1);
+    }
+    sema_up(&bh->sema);
+}
+
+/*写回hd上变脏已至少min_age个滴答的最旧的一块，hd为NULL表示不限硬盘，没有这样的脏块返回false*/
+static bool flush_one(struct disk* hd, uint32_t min_age)
+{
+    enum intr_status old_status = intr_disable();
+    struct list_elem* elem = dirty_list.head.next;
+    while(elem != &dirty_list.tail) {
+        struct buffer_head* bh = elem2entry(struct buffer_head, dirty_tag, elem);
+        if(ticks - bh->dirty_tick < min_age) {   //队列按变脏先后排列，后面的更新
+            break;
+        }
+        if((hd == NULL || bh->hd == hd) && !bh->jdirty) {   //日志事务中的块提交后才能写回
+            bh_get(bh);
+            intr_set_status(old_status);
+            bh_flush(bh);
+            brelse(bh);
+            return true;
+        }
+        elem = elem->next;
+    }
+    intr_set_status(old_status);
+    return false;
+}
+
+/*找到或分配hd上lba处扇区的缓存块并加一次引用，不读数据。
+  没命中时换出最久未用的干净块，全是脏块时先写回最久未用的那块再找*/
+static struct buffer_head* bget(struct disk* hd, uint32_t lba)
+{
+    while(1) {
+        enum intr_status old_status = intr_disable();
+        struct list* bucket = bcache_bucket(hd, lba);
+        struct list_elem* elem = bucket->head.next;
+        struct buffer_head* bh;
+        while(elem != &bucket->tail) {
+            bh = elem2entry(struct buffer_head, hash_tag, elem);
+            if(bh->hd == hd && bh->lba == lba) {
+                bh_get(bh);
+                intr_set_status(old_status);
+                return bh;
+            }
+            elem = elem->next;
+        }
+
+        if(list_empty(&lru_list)) {
+            PANIC("bget: all buffers are in use\n");
+        }
+        elem = lru_list.head.next;
+        while(elem != &lru_list.tail) {
+            bh = elem2entry(struct buffer_head, lru_tag, elem);
+            if(!bh->dirty) {
+                list_remove(&bh->lru_tag);
+                if(bh->hd != NULL) {
+                    list_remove(&bh->hash_tag);
+                }
+                bh->hd = hd;
+                bh->lba = lba;
+                bh->valid = false;
+                bh->ref_cnt = 1;
+                list_push(bucket, &bh->hash_tag);
+                intr_set_status(old_status);
+                return bh;
+            }
+            elem = elem->next;
+        }
+
+        //写回期间可能睡眠，别的线程可能已经读入了要找的块，写完回到开头重新查找
+        bh = elem2entry(struct buffer_head, lru_tag, lru_list.head.next);
+        bh_get(bh);
+        intr_set_status(old_status);
+        bh_flush(bh);
+        brelse(bh);
+    }
+}
+
+/*给不在缓存中的hd上lba处扇区分配一块缓存，加一次引用并持有它的信号量，已在缓存中或没有干净的空闲块时返回NULL。
+  预读不值得为腾地方而写回脏块*/
+static struct buffer_head* bget_nowait(struct disk* hd, uint32_t lba)
+{
+    enum intr_status old_status = intr_disable();
+    struct list* bucket = bcache_bucket(hd, lba);
+    struct list_elem* elem = bucket->head.next;
+    struct buffer_head* bh;
+    while(elem != &bucket->tail) {
+        bh = elem2entry(struct buffer_head, hash_tag, elem);
+        if(bh->hd == hd && bh->lba == lba) {
+            intr_set_status(old_status);
+            return NULL;
+        }
+        elem = elem->next;
+    }
+    elem = lru_list.head.next;
+    while(elem != &lru_list.tail) {
+        bh = elem2entry(struct buffer_head, lru_tag, elem);
+        if(!bh->dirty) {
+            list_remove(&bh->lru_tag);
+            if(bh->hd != NULL) {
+                list_remove(&bh->hash_tag);
+            }
+            bh->hd = hd;
+            bh->lba = lba;
+            bh->valid = false;
+            bh->ref_cnt = 1;
+            list_push(bucket, &bh->hash_tag);
+            //空闲块没有人持有信号量，关中断期间拿到，别的线程命中这块后只能等读完
+            sema_down(&bh->sema);
+            intr_set_status(old_status);
+            return bh;
+        }
+        elem = elem->next;
+    }
+    intr_set_status(old_status);
+    return NULL;
+}
+
+/*预读请求完成后的收尾，在通道的io线程中执行，唤醒等这块数据的线程*/
+static void readahead_done(struct bio* bio)
+{
+    struct buffer_head* bh = bio->private;
+    bh->valid = true;
+    sema_up(&bh->sema);
+    brelse(bh);
+    bio_free(bio);
+}
+
+/*把hd上从lba起sec_cnt个扇区中不在缓存里的异步读入缓存，不等读完。
+  每批的请求一起提交，lba相连的在通道队列里合并成一条多扇区命令*/
+void bcache_readahead(struct disk* hd, uint32_t lba, uint32_t sec_cnt)
+{
+    struct bio* bios[BCACHE_RA_BATCH];
+    if(lba >= hd->sectors) {
+        return;
+    }
+    if(sec_cnt > hd->sectors - lba) {
+        sec_cnt = hd->sectors - lba;
+    }
+    uint32_t sec_idx = 0;
+    while(sec_idx < sec_cnt) {
+        uint32_t bio_cnt = 0;
+        for(; sec_idx < sec_cnt && bio_cnt < BCACHE_RA_BATCH; sec_idx++) {
+            struct buffer_head* bh = bget_nowait(hd, lba + sec_idx);
+            if(bh == NULL) {
+                continue;
+            }
+            struct bio* bio = bio_alloc();
+            if(bio == NULL) {   //留给bread同步读入
+                sema_up(&bh->sema);
+                brelse(bh);
+                sec_idx = sec_cnt;
+                break;
+            }
+            bio_init(bio, hd, lba + sec_idx, bh->data, 1, false);
+            bio->end_io = readahead_done;
+            bio->private = bh;
+            bios[bio_cnt++] = bio;
+        }
+        if(bio_cnt > 0) {
+            ide_submit_batch(bios, bio_cnt);
+        }
+    }
+}
+
+/*取得hd上lba处扇区的缓存块，引用计数加1，数据已读入*/
+struct buffer_head* bread(struct disk* hd, uint32_t lba)
+{
+    struct buffer_head* bh = bget(hd, lba);
+    sema_down(&bh->sema);
+    if(!bh->valid) {
+        ide_read(hd, lba, bh->data, 1);
+        bh->valid = true;
+    }
+    sema_up(&bh->sema);
+    return bh;
+}
+
+/*标记bh已被修改，由回写线程稍后写回，调用者须持有bh的引用。脏块太多时写者自己先写回一些。
+  元数据操作中修改的块先记入日志的事务，提交后才变脏*/
+void bwrite(struct buffer_head* bh)
+{
+    ASSERT(bh->ref_cnt > 0);
+    if(journal_dirty(bh)) {
+        return;
+    }
+    enum intr_status old_status = intr_disable();
+    bh_mark_dirty(bh);
+    intr_set_status(old_status);
+    while(dirty_cnt > BCACHE_DIRTY_MAX && flush_one(NULL, 0));
+}
+
+/*释放对bh的引用，引用计数归0时放到lru队尾*/
+void brelse(struct buffer_head* bh)
+{
+    enum intr_status old_status = intr_disable();
+    ASSERT(bh->ref_cnt > 0);
+    if(--bh->ref_cnt == 0) {
+        list_append(&lru_list, &bh->lru_tag);
+    }
+    intr_set_status(old_status);
+}
+
+/*bh所在的事务已写入日志，转为普通脏块由回写线程按时写回原位置，并去掉事务持有的引用*/
+void bjournal_done(struct buffer_head* bh)
+{
+    enum intr_status old_status = intr_disable();
+    ASSERT(bh->jdirty);
+    bh->jdirty = false;
+    bh_mark_dirty(bh);
+    intr_set_status(old_status);
+    brelse(bh);
+}
+
+/*经缓存读取从lba起的sec_cnt个扇区到buf，多个扇区时先把没命中的一起提交，合并成多扇区命令*/
+void bcache_read(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt)
+{
+    uint32_t sec_idx;
+    if(sec_cnt > 1) {
+        bcache_readahead(hd, lba, sec_cnt);
+    }
+    for(sec_idx = 0; sec_idx < sec_cnt; sec_idx++) {
+        struct buffer_head* bh = bread(hd, lba + sec_idx);
+        memcpy((uint8_t*)buf + sec_idx * SECTOR_SIZE, bh->data, SECTOR_SIZE);
+        brelse(bh);
+    }
+}
+
+/*经缓存把buf中sec_cnt个扇区写入从lba起的扇区，稍后写回硬盘。整扇区覆盖，不必先读入*/
+void bcache_write(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt)
+{
+    uint32_t sec_idx;
+    for(sec_idx = 0; sec_idx < sec_cnt; sec_idx++) {
+        struct buffer_head* bh = bget(hd, lba + sec_idx);
+        sema_down(&bh->sema);   //等别的线程的读入或写回完成，免得旧数据盖掉新数据
+        memcpy(bh->data, (uint8_t*)buf + sec_idx * SECTOR_SIZE, SECTOR_SIZE);
+        bh->valid = true;
+        sema_up(&bh->sema);
+        bwrite(bh);
+        brelse(bh);
+    }
+}
+
+/*把hd上的脏块全部写回并等硬盘写完，hd为NULL表示所有硬盘*/
+void bcache_sync(struct disk* hd)
+{
+    while(flush_one(hd, 0));
+    ide_sync(hd);
+}
+
+static struct delayed_work flush_dwork;
+
+/*回写工作，由工作线程定期执行，写回变脏时间超过BCACHE_DIRTY_EXPIRE的块后重新定时*/
+static void bcache_flusher(struct work_struct* work UNUSED)
+{
+    fs_writeback();   //先把文件系统记在内存中的脏元数据交给块缓存
+    while(flush_one(NULL, BCACHE_DIRTY_EXPIRE));
+    queue_delayed_work(&flush_dwork, BCACHE_FLUSH_INTERVAL);
+}
+
+/*初始化块缓存并开始定期回写，数据区从内核内存池整页分配*/
+void bcache_init(void)
+{
+    printk("bcache_init start\n");
+    uint8_t* data = get_kernel_pages(DIV_ROUND_UP(BCACHE_BLOCKS * SECTOR_SIZE, PG_SIZE));
+    if(data == NULL) {
+        PANIC("bcache_init: alloc memory failed!");
+    }
+    uint32_t idx;
+    for(idx = 0; idx < BCACHE_HASH_CNT; idx++) {
+        list_init(&hash_buckets[idx]);
+    }
+    list_init(&lru_list);
+    list_init(&dirty_list);
+    dirty_cnt = 0;
+    for(idx = 0; idx < BCACHE_BLOCKS; idx++) {
+        struct buffer_head* bh = &bufs[idx];
+        bh->hd = NULL;
+        bh->ref_cnt = 0;
+        bh->valid = false;
+        bh->dirty = false;
+        bh->jdirty = false;
+        bh->data = data + idx * SECTOR_SIZE;
+        sema_init(&bh->sema, 1);
+        list_elem_init(&bh->hash_tag);
+        list_elem_init(&bh->dirty_tag);
+        list_elem_init(&bh->j_tag);
+        list_append(&lru_list, &bh->lru_tag);
+    }
+    delayed_work_init(&flush_dwork, bcache_flusher);
+    queue_delayed_work(&flush_dwork, BCACHE_FLUSH_INTERVAL);
+    printk("bcache_init done, %d blocks\n", BCACHE_BLOCKS);
+}
@@ -0,0 +1,54 @@
+#ifndef __FS_BCACHE_H
+#define __FS_BCACHE_H
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "sync.h"
+
+#define BCACHE_BLOCKS 256   //缓存的块数，每块一个扇区，改这里调整缓存大小
+#define BCACHE_HASH_CNT 64   //哈希桶数
+#define BCACHE_DIRTY_MAX (BCACHE_BLOCKS / 2)   //脏块超过这个数时写者自己回写最旧的脏块
+#define BCACHE_DIRTY_EXPIRE 300   //脏块最多在内存中停留的滴答数，到期由回写线程写回
+#define BCACHE_FLUSH_INTERVAL 1000   //回写工作的检查间隔，毫秒
+#define BCACHE_RA_BATCH 32   //预读时一次提交的最多扇区数
+
+struct disk;
+
+/*缓存中的一块，对应硬盘hd上lba处的一个扇区*/
+struct buffer_head
+{
+    struct disk* hd;   //为NULL表示这块缓存还没有用过
+    uint32_t lba;
+    uint32_t ref_cnt;   //引用计数，为0时才可以被换出
+    bool valid;   //data中是否已是硬盘上的数据
+    bool dirty;   //data是否比硬盘上的新
+    uint32_t dirty_tick;   //变脏的时刻
+    bool jdirty;   //在元数据日志运行中的事务里，提交前不能写回原位置
+    uint8_t* data;   //一个扇区的数据
+    struct semaphore sema;   //读入或写回数据期间持有，让同时访问这块的其他线程等待。异步读入由io线程释放，所以不用锁
+    struct list_elem hash_tag;   //在哈希桶中的标记
+    struct list_elem lru_tag;   //引用计数为0时在lru队列中的标记
+    struct list_elem dirty_tag;   //在脏块队列中的标记
+    struct list_elem j_tag;   //在日志运行中的事务里的标记
+};
+
+/*初始化块缓存并开始定期回写*/
+void bcache_init(void);
+/*取得hd上lba处扇区的缓存块，引用计数加1，数据已读入*/
+struct buffer_head* bread(struct disk* hd, uint32_t lba);
+/*标记bh已被修改，由回写线程稍后写回，调用者须持有bh的引用*/
+void bwrite(struct buffer_head* bh);
+/*释放对bh的引用*/
+void brelse(struct buffer_head* bh);
+/*bh所在的事务已写入日志，转为普通脏块，并去掉事务持有的引用*/
+void bjournal_done(struct buffer_head* bh);
+/*经缓存读取从lba起的sec_cnt个扇区到buf*/
+void bcache_read(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt);
+/*把hd上从lba起sec_cnt个扇区中不在缓存里的异步读入缓存，不等读完*/
+void bcache_readahead(struct disk* hd, uint32_t lba, uint32_t sec_cnt);
+/*经缓存把buf中sec_cnt个扇区写入从lba起的扇区，稍后写回硬盘*/
+void bcache_write(struct disk* hd, uint32_t lba, void* buf, uint32_t sec_cnt);
+/*把hd上的脏块全部写回并等硬盘写完，hd为NULL表示所有硬盘*/
+void bcache_sync(struct disk* hd);
+
+#endif
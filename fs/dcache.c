@@ -0,0 +1,125 @@
+#include "dcache.h"
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "string.h"
+#include "interrupt.h"
+#include "stdio-kernel.h"
+#include "dir.h"
+
+static struct dentry dentries[DCACHE_ENTRIES];
+static struct list hash_buckets[DCACHE_HASH_CNT];   //按(目录, 名字)散列的缓存项
+static struct list lru_list;   //所有缓存项，队首是最久未用的
+static uint32_t dcache_gen;   //版本号，每次失效时加1
+
+/*按(目录, 名字)求哈希桶*/
+static struct list* dcache_bucket(uint32_t parent_i_no, const char* name)
+{
+    uint32_t hash = parent_i_no;
+    while(*name) {
+        hash = hash * 31 + *name++;
+    }
+    return &hash_buckets[hash % DCACHE_HASH_CNT];
+}
+
+/*在缓存中找(目录, 名字)对应的项，找不到返回NULL，需关中断调用*/
+static struct dentry* dcache_find(struct partition* part, uint32_t parent_i_no, const char* name)
+{
+    struct list* bucket = dcache_bucket(parent_i_no, name);
+    struct list_elem* elem = bucket->head.next;
+    while(elem != &bucket->tail) {
+        struct dentry* dentry = elem2entry(struct dentry, hash_tag, elem);
+        if(dentry->part == part && dentry->parent_i_no == parent_i_no && !strcmp(dentry->name, name)) {
+            return dentry;
+        }
+        elem = elem->next;
+    }
+    return NULL;
+}
+
+/*初始化目录项缓存*/
+void dcache_init(void)
+{
+    uint32_t idx;
+    for(idx = 0; idx < DCACHE_HASH_CNT; idx++) {
+        list_init(&hash_buckets[idx]);
+    }
+    list_init(&lru_list);
+    for(idx = 0; idx < DCACHE_ENTRIES; idx++) {
+        dentries[idx].part = NULL;
+        list_append(&lru_list, &dentries[idx].lru_tag);
+    }
+    dcache_gen = 0;
+    printk("dcache_init done, %d entries\n", DCACHE_ENTRIES);
+}
+
+/*在缓存中查找part分区上inode编号为parent_i_no的目录中的name，若命中目录项存入dir_e。
+  gen存入当前的版本号，查目录后用它调用dcache_add*/
+enum dcache_result dcache_lookup(struct partition* part, uint32_t parent_i_no, const char* name, \
+                                 struct dir_entry* dir_e, uint32_t* gen)
+{
+    enum dcache_result ret = DCACHE_MISS;
+    enum intr_status old_status = intr_disable();
+    *gen = dcache_gen;
+    struct dentry* dentry = dcache_find(part, parent_i_no, name);
+    if(dentry != NULL) {
+        //命中的项移到lru队尾
+        list_remove(&dentry->lru_tag);
+        list_append(&lru_list, &dentry->lru_tag);
+        if(dentry->negative) {
+            ret = DCACHE_NEGATIVE;
+        } else {
+            memcpy(dir_e, &dentry->de, sizeof(struct dir_entry));
+            ret = DCACHE_POSITIVE;
+        }
+    }
+    intr_set_status(old_status);
+    return ret;
+}
+
+/*缓存一次查目录的结果，dir_e为NULL表示没找到。gen是查目录之前dcache_lookup给出的版本号，期间有失效的就不缓存*/
+void dcache_add(struct partition* part, uint32_t parent_i_no, const char* name, const struct dir_entry* dir_e, uint32_t gen)
+{
+    //名字必须能完整存下，超长的名字不缓存
+    if(strlen(name) >= MAX_FILE_NAME_LEN) {
+        return;
+    }
+    enum intr_status old_status = intr_disable();
+    //查目录时可能阻塞，期间目录若有变化，查到的结果可能已过时
+    if(gen != dcache_gen || dcache_find(part, parent_i_no, name) != NULL) {
+        intr_set_status(old_status);
+        return;
+    }
+
+    //换出最久未用的一项
+    struct dentry* dentry = elem2entry(struct dentry, lru_tag, list_pop(&lru_list));
+    if(dentry->part != NULL) {
+        list_remove(&dentry->hash_tag);
+    }
+    dentry->part = part;
+    dentry->parent_i_no = parent_i_no;
+    strcpy(dentry->name, name);
+    dentry->negative = dir_e == NULL;
+    if(dir_e != NULL) {
+        memcpy(&dentry->de, dir_e, sizeof(struct dir_entry));
+    }
+    list_push(dcache_bucket(parent_i_no, name), &dentry->hash_tag);
+    list_append(&lru_list, &dentry->lru_tag);
+    intr_set_status(old_status);
+}
+
+/*目录中name对应的目录项被增加或删除时调用，使缓存中的相应项失效*/
+void dcache_invalidate(struct partition* part, uint32_t parent_i_no, const char* name)
+{
+    enum intr_status old_status = intr_disable();
+    dcache_gen++;
+    struct dentry* dentry = dcache_find(part, parent_i_no, name);
+    if(dentry != NULL) {
+        list_remove(&dentry->hash_tag);
+        dentry->part = NULL;
+        //失效的项放到lru队首，最先被重用
+        list_remove(&dentry->lru_tag);
+        list_push(&lru_list, &dentry->lru_tag);
+    }
+    intr_set_status(old_status);
+}
@@ -0,0 +1,44 @@
+#ifndef __FS_DCACHE_H
+#define __FS_DCACHE_H
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "dir.h"
+
+#define DCACHE_ENTRIES 256   //缓存的目录项数
+#define DCACHE_HASH_CNT 64   //哈希桶数
+
+struct partition;
+
+/*缓存的一次目录查找结果，negative为true表示目录中没有这个名字*/
+struct dentry
+{
+    struct partition* part;   //为NULL表示这项还没有用过
+    uint32_t parent_i_no;   //所在目录的inode编号
+    char name[MAX_FILE_NAME_LEN];
+    bool negative;
+    struct dir_entry de;   //negative为false时是找到的目录项
+    struct list_elem hash_tag;   //在哈希桶中的标记
+    struct list_elem lru_tag;   //在lru队列中的标记
+};
+
+/*dcache_lookup的结果*/
+enum dcache_result
+{
+    DCACHE_MISS,       //缓存中没有，要查目录
+    DCACHE_NEGATIVE,   //目录中没有这个名字
+    DCACHE_POSITIVE    //找到了，目录项已存入dir_e
+};
+
+/*初始化目录项缓存*/
+void dcache_init(void);
+/*在缓存中查找part分区上inode编号为parent_i_no的目录中的name，若命中目录项存入dir_e。
+  gen存入当前的版本号，查目录后用它调用dcache_add*/
+enum dcache_result dcache_lookup(struct partition* part, uint32_t parent_i_no, const char* name, \
+                                 struct dir_entry* dir_e, uint32_t* gen);
+/*缓存一次查目录的结果，dir_e为NULL表示没找到。gen是查目录之前dcache_lookup给出的版本号，期间有失效的就不缓存*/
+void dcache_add(struct partition* part, uint32_t parent_i_no, const char* name, const struct dir_entry* dir_e, uint32_t gen);
+/*目录中name对应的目录项被增加或删除时调用，使缓存中的相应项失效*/
+void dcache_invalidate(struct partition* part, uint32_t parent_i_no, const char* name);
+
+#endif
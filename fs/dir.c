@@ -1,6 +1,8 @@
 #include "dir.h"
 #include "stdint.h"
 #include "ide.h"
+#include "bcache.h"
+#include "dcache.h"
 #include "inode.h"
 #include "super_block.h"
 #include "file.h"
@@ -12,82 +14,122 @@
 #include "debug.h"
 
 struct dir root_dir;   //根目录
+struct kmem_cache* dir_cache;   //打开目录的对象缓存
 
 /*打开根目录*/
 void open_root_dir(struct partition* part)
 {
     root_dir.inode = inode_open(part, part->sb->root_inode_no);
     root_dir.dir_pos = 0;
+    root_dir.scan_off = 0;
 }
 
 /*在分区part上打开i节点号为inode_no的目录并返回目录指针*/
 struct dir* dir_open(struct partition* part, uint32_t inode_no)
 {
-    struct dir* pdir = (struct dir*)sys_malloc(sizeof(struct dir));
+    struct dir* pdir = kmem_cache_alloc(dir_cache);
+    if(pdir == NULL) {
+        return NULL;
+    }
     pdir->inode = inode_open(part, inode_no);
     pdir->dir_pos = 0;
+    pdir->scan_off = 0;
     return pdir;
 }
 
-/*在part分区内的pdir目录内寻找名为name的文件或目录，
-找到后返回true并将其目录项存入dir_e，否则返回false*/
-bool search_dir_entry(struct partition* part, struct dir* pdir, const char* name, struct dir_entry* dir_e)
+/*目录名字的哈希值，在哈希目录中决定目录项放在哪个桶。名字可能占满MAX_FILE_NAME_LEN字节而没有结尾的0*/
+static uint32_t dir_name_hash(const char* name)
 {
-    uint32_t block_cnt = 140;   //12个直接块，128个一级间接块
-    uint32_t* all_blocks = (uint32_t*)sys_malloc(48 + 512);   //块地址数组
-    if(all_blocks == NULL) {
-        printk("search_dir_entry: sys_malloc for all_blocks failed");
-        return false;
+    uint32_t hash = 0, idx;
+    for(idx = 0; idx < MAX_FILE_NAME_LEN && name[idx]; idx++) {
+        hash = hash * 31 + (uint8_t)name[idx];
     }
+    return hash % DIR_HASH_BUCKETS;
+}
 
-    uint32_t block_idx = 0;
-    while(block_idx < 12) {
-        all_blocks[block_idx] = pdir->inode->i_sectors[block_idx];
-        block_idx++;
-    }
-    block_idx = 0;
+/*读索引块index_lba中第slot项*/
+static uint32_t dir_index_get(struct partition* part, uint32_t index_lba, uint32_t slot)
+{
+    struct buffer_head* bh = bread(part->my_disk, index_lba + slot / DIR_INDEX_PER_SEC);
+    uint32_t val = ((uint16_t*)bh->data)[slot % DIR_INDEX_PER_SEC];
+    brelse(bh);
+    return val;
+}
 
-    if(pdir->inode->i_sectors[12] != 0) {
-        ide_read(part->my_disk, pdir->inode->i_sectors[12], all_blocks + 12, 1);
-    }
-    //至此，all_block中存储的是该文件或目录的所有扇区地址
+/*把索引块index_lba中第slot项设为val*/
+static void dir_index_set(struct partition* part, uint32_t index_lba, uint32_t slot, uint32_t val)
+{
+    struct buffer_head* bh = bread(part->my_disk, index_lba + slot / DIR_INDEX_PER_SEC);
+    ((uint16_t*)bh->data)[slot % DIR_INDEX_PER_SEC] = val;
+    bwrite(bh);
+    brelse(bh);
+}
 
-    //写目录项的时候已保证目录项不跨扇区，这样读目录项时容易处理，只申请容纳1个扇区的内存
-    uint8_t* buf = (uint8_t*)sys_malloc(SECTOR_SIZE);
+/*在目录块block_lba的各扇区中找名为name的目录项，找到后存入dir_e并返回true，buf至少1扇区*/
+static bool dir_block_search(struct partition* part, uint32_t block_lba, const char* name, struct dir_entry* dir_e, void* buf)
+{
     struct dir_entry* p_de = (struct dir_entry*)buf;   //p_de为指向目录项的指针，值为buf起始地址
     uint32_t dir_entry_size = part->sb->dir_entry_size;
     uint32_t dir_entry_cnt = SECTOR_SIZE / dir_entry_size;   //一扇区可容纳的目录个数
-
-    //在所有块中查找目录项
-    while(block_idx < block_cnt) {
-        //地址为0时表示该块中无数据，继续在其他块中找
-        if(all_blocks[block_idx] == 0) {
-            block_idx++;
-            continue;
-        }
-        ide_read(part->my_disk, all_blocks[block_idx], buf, 1);
-
-        uint32_t dir_entry_idx = 0;
+    uint32_t sec_idx, dir_entry_idx;
+    for(sec_idx = 0; sec_idx < BLOCK_SECS; sec_idx++) {
+        bcache_read(part->my_disk, block_lba + sec_idx, buf, 1);
         //遍历扇区中所有目录项
-        while(dir_entry_idx < dir_entry_cnt) {
-            if(!strcmp(p_de->filename, name)) {
-                memcpy(dir_e, p_de, dir_entry_size);
-                sys_free(buf);
-                sys_free(all_blocks);
+        for(dir_entry_idx = 0; dir_entry_idx < dir_entry_cnt; dir_entry_idx++) {
+            if(p_de[dir_entry_idx].f_type != FT_UNKNOWN && !strncmp(p_de[dir_entry_idx].filename, name, MAX_FILE_NAME_LEN)) {
+                memcpy(dir_e, p_de + dir_entry_idx, dir_entry_size);
                 return true;
             }
-            dir_entry_idx++;
-            p_de++;
         }
-        block_idx++;
-        p_de = (struct dir_entry*)buf;   //此时p_de已经指向扇区内最后一个完整目录项，恢复p_de指向buf
-        memset(buf, 0, SECTOR_SIZE);
     }
-    sys_free(buf);
-    sys_free(all_blocks);
     return false;
 }
 
+/*在part分区内的pdir目录内寻找名为name的文件或目录，
+找到后返回true并将其目录项存入dir_e，否则返回false。先查目录项缓存，查过的目录再找时不必读硬盘。
+哈希目录只查name所在桶的块链，线性目录查所有块*/
+bool search_dir_entry(struct partition* part, struct dir* pdir, const char* name, struct dir_entry* dir_e)
+{
+    uint32_t gen;
+    enum dcache_result cached = dcache_lookup(part, pdir->inode->i_no, name, dir_e, &gen);
+    if(cached != DCACHE_MISS) {
+        return cached == DCACHE_POSITIVE;
+    }
+
+    //写目录项的时候已保证目录项不跨扇区，这样读目录项时容易处理，只申请容纳1个扇区的内存
+    uint8_t* buf = (uint8_t*)sys_malloc(SECTOR_SIZE);
+    if(buf == NULL) {
+        printk("search_dir_entry: sys_malloc for buf failed");
+        return false;
+    }
+    down_read(&pdir->inode->i_rwsem);   //增删目录项的一方持写锁，调用者已持写锁时也可以进来
+
+    bool found = false;
+    uint32_t index_lba = pdir->inode->i_sectors[DIR_INDEX];
+    uint32_t block_idx;
+    if(index_lba != 0 && strcmp(name, ".") && strcmp(name, "..")) {
+        block_idx = dir_index_get(part, index_lba, dir_name_hash(name));
+        while(!found && block_idx != 0) {
+            found = dir_block_search(part, inode_bmap(part, pdir->inode, block_idx, false), name, dir_e, buf);
+            block_idx = dir_index_get(part, index_lba, DIR_HASH_BUCKETS + block_idx);
+        }
+    } else {
+        //哈希目录的.和..在第0块，线性目录在所有块中查找，块地址由inode_bmap查找
+        uint32_t block_cnt = index_lba != 0 ? 1 : DIR_MAX_BLOCKS;
+        for(block_idx = 0; !found && block_idx < block_cnt; block_idx++) {
+            uint32_t block_lba = inode_bmap(part, pdir->inode, block_idx, false);
+            //地址为0时表示该块中无数据，继续在其他块中找
+            if(block_lba != 0) {
+                found = dir_block_search(part, block_lba, name, dir_e, buf);
+            }
+        }
+    }
+    dcache_add(part, pdir->inode->i_no, name, found ? dir_e : NULL, gen);
+    up_read(&pdir->inode->i_rwsem);
+    sys_free(buf);
+    return found;
+}
+
 /*关闭目录*/
 void dir_close(struct dir* dir)
 {
@@ -96,7 +138,7 @@ void dir_close(struct dir* dir)
         return;
     }
     inode_close(dir->inode);
-    sys_free(dir);
+    kmem_cache_free(dir_cache, dir);
 }
 
 /*在内存中初始化目录项p_de*/
@@ -110,7 +152,45 @@ void create_dir_entry(char* filename, uint32_t inode_no, uint8_t file_type, stru
     p_de->f_type = file_type;
 }
 
-/*将目录项p_de写入父目录parent_dir中，io_but由主调函数提供*/
+/*在目录块block_lba的各扇区中找空位写入目录项p_de，没有空位返回false，io_buf至少1扇区*/
+static bool dir_block_insert(struct partition* part, uint32_t block_lba, struct dir_entry* p_de, void* io_buf)
+{
+    struct dir_entry* dir_e = (struct dir_entry*)io_buf;
+    uint32_t dir_entry_size = part->sb->dir_entry_size;
+    uint32_t dir_entrys_per_sec = (SECTOR_SIZE / dir_entry_size);   //每扇区最大的目录想数目
+    uint32_t sec_idx, dir_entry_idx;
+    for(sec_idx = 0; sec_idx < BLOCK_SECS; sec_idx++) {
+        bcache_read(part->my_disk, block_lba + sec_idx, io_buf, 1);
+        for(dir_entry_idx = 0; dir_entry_idx < dir_entrys_per_sec; dir_entry_idx++) {
+            if((dir_e + dir_entry_idx)->f_type == FT_UNKNOWN) {   //FT_UNKNOWN = 0，将目录项删除或是初始化后的值都会是0
+                memcpy(dir_e + dir_entry_idx, p_de, dir_entry_size);
+                bcache_write(part->my_disk, block_lba + sec_idx, io_buf, 1);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*为目录dir_inode分配第block_idx块，清零后把目录项p_de写入它的第一个扇区，失败返回false*/
+static bool dir_block_new(struct partition* part, struct inode* dir_inode, uint32_t block_idx, struct dir_entry* p_de, void* io_buf)
+{
+    //途经的一级间接块表由inode_bmap一并分配，位图随分配同步
+    int32_t block_lba = inode_bmap(part, dir_inode, block_idx, true);
+    if(block_lba == -1) {
+        printk("alloc block bitmap for sync_dir_entry failed\n");
+        return false;
+    }
+    block_zero(part, block_lba);
+    memset(io_buf, 0, SECTOR_SIZE);
+    memcpy(io_buf, p_de, part->sb->dir_entry_size);
+    bcache_write(part->my_disk, block_lba, io_buf, 1);
+    return true;
+}
+
+/*将目录项p_de写入父目录parent_dir中，io_but由主调函数提供。
+  哈希目录只在p_de所在桶的块链中找空位，都满了就新分配一块挂到链首；
+  线性目录遍历所有块寻找空位，遇到还没分配的块就分配新块*/
 bool sync_dir_entry(struct dir* parent_dir, struct dir_entry* p_de, void* io_buf)
 {
     struct inode* dir_inode = parent_dir->inode;
@@ -118,202 +198,149 @@ bool sync_dir_entry(struct dir* parent_dir, struct dir_entry* p_de, void* io_buf
     uint32_t dir_entry_size = cur_part->sb->dir_entry_size;
 
     ASSERT(dir_size % dir_entry_size == 0);   //dir_size应该是dir_entry_size的整数倍
-
-    uint32_t dir_entrys_per_sec = (512 / dir_entry_size);   //每扇区最大的目录想数目
-    int32_t block_lba = -1;   //记录分配的块地址
-
-    //将该目录的所有扇区地址存入all_block
-    uint8_t block_idx = 0;
-    uint32_t all_blocks[140] = {0};   //all_block保存目录所有的块
-
-    //将12个直接块存入all_block
-    while(block_idx < 12) {
-        all_blocks[block_idx] = dir_inode->i_sectors[block_idx];
-        block_idx++;
+    dcache_invalidate(cur_part, dir_inode->i_no, p_de->filename);   //去掉缓存中这个名字的不存在记录
+
+    uint32_t index_lba = dir_inode->i_sectors[DIR_INDEX];
+    uint32_t block_idx;
+    if(index_lba != 0) {
+        uint32_t bucket = dir_name_hash(p_de->filename);
+        for(block_idx = dir_index_get(cur_part, index_lba, bucket); block_idx != 0; \
+            block_idx = dir_index_get(cur_part, index_lba, DIR_HASH_BUCKETS + block_idx)) {
+            if(dir_block_insert(cur_part, inode_bmap(cur_part, dir_inode, block_idx, false), p_de, io_buf)) {
+                dir_inode->i_size += dir_entry_size;
+                return true;
+            }
+        }
+        //桶中的块都满了，找一个还没用的块号，第0块存放.和..不用于桶
+        for(block_idx = 1; block_idx < DIR_MAX_BLOCKS && inode_bmap(cur_part, dir_inode, block_idx, false) != 0; block_idx++);
+        if(block_idx == DIR_MAX_BLOCKS) {
+            printk("directory is full!\n");
+            return false;
+        }
+        if(!dir_block_new(cur_part, dir_inode, block_idx, p_de, io_buf)) {
+            return false;
+        }
+        dir_index_set(cur_part, index_lba, DIR_HASH_BUCKETS + block_idx, dir_index_get(cur_part, index_lba, bucket));
+        dir_index_set(cur_part, index_lba, bucket, block_idx);
+        dir_inode->i_size += dir_entry_size;
+        return true;
     }
 
-    struct dir_entry* dir_e = (struct dir_entry*)io_buf;
-    int32_t block_bitmap_idx = -1;
-
-    //遍历所有块以寻找目录项空位，若已有扇区中没有空闲位，在不超过文件大小的情况下申请新扇区来存储目录项
-    block_idx = 0;
-    while(block_idx < 140) {
-        block_bitmap_idx = -1;
-        if(all_blocks[block_idx] == 0) {
-            block_lba = block_bitmap_alloc(cur_part);
-            if(block_lba == -1) {
-                printk("alloc block bitmap for sync_dir_entry failed\n");
+    //遍历所有块以寻找目录项空位，若已有块中没有空闲位，在不超过目录大小的情况下申请新块来存储目录项
+    for(block_idx = 0; block_idx < DIR_MAX_BLOCKS; block_idx++) {
+        uint32_t block_lba = inode_bmap(cur_part, dir_inode, block_idx, false);
+        if(block_lba == 0) {
+            if(!dir_block_new(cur_part, dir_inode, block_idx, p_de, io_buf)) {
                 return false;
             }
-            //每分配一个块就同步一次block_bitmap
-            block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
-            ASSERT(block_bitmap_idx != -1);
-            bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
-
-            block_bitmap_idx = -1;
-            if(block_idx < 12) {   //若是直接块
-                dir_inode->i_sectors[block_idx] = all_blocks[block_idx] = block_lba;
-            } else if(block_idx == 12) {   //若是尚未分配一级间接块表(block_idx等于12表示第0个间接块地址为0)
-                dir_inode->i_sectors[12] = block_lba;   //将上面分配的块作为一级间接块表地址
-                block_lba = -1;
-                block_lba = block_bitmap_alloc(cur_part);   //在分配一个块作为第0个间接块
-                if(block_lba == -1) {
-                    block_bitmap_idx = dir_inode->i_sectors[12] - cur_part->sb->data_start_lba;
-                    bitmap_set(&cur_part->block_bitmap, block_bitmap_idx, 0);
-                    dir_inode->i_sectors[12] = 0;
-                    printk("alloc block bitmap for sync_dir_entry failed\n");
-                    return false;
-                }
-                //每分配一个块就同步一次block_bitmap
-                block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
-                ASSERT(block_bitmap_idx != -1);
-                bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
-
-                all_blocks[12] = block_lba;
-                //把新分配的第0个间接块地址写入一级间接块表
-                ide_write(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
-            } else {
-                all_blocks[block_idx] = block_lba;
-                //把新分配的第(block_idx - 12)个间接块地址写入一级间接块表
-                ide_write(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
-            }
-
-            //在将新目录项p_de写入新分配的间接块
-            memset(io_buf, 0, 512);
-            memcpy(io_buf, p_de, dir_entry_size);
-            ide_write(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
             dir_inode->i_size += dir_entry_size;
             return true;
         }
-        //block_idx块已存在，将其读进内存，然后在该块中查找空目录项
-        ide_read(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
-        uint8_t dir_entry_idx = 0;
-        while(dir_entry_idx < dir_entrys_per_sec) {
-            if((dir_e + dir_entry_idx)->f_type  == FT_UNKNOWN) {   //FT_UNKNOWN = 0，将目录项删除或是初始化后的值都会是0
-                memcpy(dir_e + dir_entry_idx, p_de, dir_entry_size);
-                ide_write(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
-                dir_inode->i_size += dir_entry_size;
-                return true;
-            }
-            dir_entry_idx++;
+        //block_idx块已存在，在其中查找空目录项
+        if(dir_block_insert(cur_part, block_lba, p_de, io_buf)) {
+            dir_inode->i_size += dir_entry_size;
+            return true;
         }
-        block_idx++;
     }
     printk("directory is full!\n");
     return false;
 }
 
-/*把分区part目录pdir中编号为inode_no的目录项删除*/
-bool delete_dir_entry(struct partition* part, struct dir* pdir, uint32_t inode_no, void* io_buf)
+/*统计目录块block_lba中除.和..以外的目录项数，io_buf至少1扇区*/
+static uint32_t dir_block_entries(struct partition* part, uint32_t block_lba, void* io_buf)
 {
-    struct inode* dir_inode = pdir->inode;
-    uint32_t block_idx = 0, all_blocks[140] = {0};
-
-    //收集目录全部块地址
-    while(block_idx < 12) {
-        all_blocks[block_idx] = dir_inode->i_sectors[block_idx];
-        block_idx++;
-    }
-    if(dir_inode->i_sectors[12]) {
-        ide_read(part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
+    struct dir_entry* dir_e = (struct dir_entry*)io_buf;
+    uint32_t dir_entrys_per_sec = SECTOR_SIZE / part->sb->dir_entry_size;
+    uint32_t cnt = 0, sec_idx, dir_entry_idx;
+    for(sec_idx = 0; sec_idx < BLOCK_SECS; sec_idx++) {
+        bcache_read(part->my_disk, block_lba + sec_idx, io_buf, 1);
+        for(dir_entry_idx = 0; dir_entry_idx < dir_entrys_per_sec; dir_entry_idx++) {
+            if(dir_e[dir_entry_idx].f_type != FT_UNKNOWN && strncmp(dir_e[dir_entry_idx].filename, ".", MAX_FILE_NAME_LEN) && \
+               strncmp(dir_e[dir_entry_idx].filename, "..", MAX_FILE_NAME_LEN)) {
+                cnt++;
+            }
+        }
     }
+    return cnt;
+}
 
-    //目录项在存储时保证不会跨扇区
-    uint32_t dir_entry_size = part->sb->dir_entry_size;
-    uint32_t dir_entrys_per_sec = (SECTOR_SIZE / dir_entry_size);   //每扇区最大的目录项数目
+/*在目录块block_lba中找编号为inode_no的目录项（不含.和..），找到后在sec_idx和dir_entry_idx中返回其位置，
+  该扇区留在io_buf中*/
+static bool dir_block_locate(struct partition* part, uint32_t block_lba, uint32_t inode_no, \
+                             uint32_t* sec_idx, uint32_t* dir_entry_idx, void* io_buf)
+{
     struct dir_entry* dir_e = (struct dir_entry*)io_buf;
-    struct dir_entry* dir_entry_found = NULL;
-    uint8_t dir_entry_idx, dir_entry_cnt;
-    bool is_dir_first_block = false;   //目录的第一个块
-
-    //遍历所有块，寻找目录项
-    block_idx = 0;
-    while(block_idx < 140) {
-        is_dir_first_block = false;
-        if(all_blocks[block_idx] == 0) {
-            block_idx++;
-            continue;
-        }
-        dir_entry_idx = dir_entry_cnt = 0;
-        memset(io_buf, 0, SECTOR_SIZE);
-        //读取扇区，获得目录项
-        ide_read(part->my_disk, all_blocks[block_idx], io_buf, 1);
-
-        //遍历所有的目录项，统计该扇区的目录项数量及是否有待删除的目录项
-        while(dir_entry_idx < dir_entrys_per_sec) {
-            if((dir_e + dir_entry_idx)->f_type != FT_UNKNOWN) {
-                if(!strcmp((dir_e + dir_entry_idx)->filename, ".")) {
-                    is_dir_first_block = true;
-                } else if(strcmp((dir_e + dir_entry_idx)->i_no, ".") && strcmp((dir_e + dir_entry_idx)->filename, "..")) {
-                    dir_entry_cnt++;   //统计此扇区内的目录项个数，用来判断删除目录项后是否回收该扇区
-                    if((dir_e + dir_entry_idx)->i_no == inode_no) {
-                        ASSERT(dir_entry_found == NULL);   //确保目录中只有一个编号是inode_no的inode
-                        dir_entry_found = dir_e + dir_entry_idx;
-                    }
-                }
+    uint32_t dir_entrys_per_sec = SECTOR_SIZE / part->sb->dir_entry_size;
+    for(*sec_idx = 0; *sec_idx < BLOCK_SECS; (*sec_idx)++) {
+        bcache_read(part->my_disk, block_lba + *sec_idx, io_buf, 1);
+        for(*dir_entry_idx = 0; *dir_entry_idx < dir_entrys_per_sec; (*dir_entry_idx)++) {
+            struct dir_entry* de = dir_e + *dir_entry_idx;
+            if(de->f_type != FT_UNKNOWN && de->i_no == inode_no && strncmp(de->filename, ".", MAX_FILE_NAME_LEN) && strncmp(de->filename, "..", MAX_FILE_NAME_LEN)) {
+                return true;
             }
-            dir_entry_idx++;
         }
+    }
+    return false;
+}
 
-        //若此扇区中未找到该目录项，继续在下一个扇区中找
-        if((dir_entry_found == NULL)) {
+uint32_t dir_entry_gen;   //目录项删除的次数，记下的路径到inode号的解析结果在它变化后可能已失效
+
+/*把分区part目录pdir中编号为inode_no、名为name的目录项删除。哈希目录按name找到所在桶的块链，线性目录遍历所有块*/
+bool delete_dir_entry(struct partition* part, struct dir* pdir, uint32_t inode_no, const char* name, void* io_buf)
+{
+    dir_entry_gen++;
+    struct inode* dir_inode = pdir->inode;
+    uint32_t dir_entry_size = part->sb->dir_entry_size;
+    uint32_t index_lba = dir_inode->i_sectors[DIR_INDEX];
+    uint32_t bucket = dir_name_hash(name);
+    uint32_t prev_idx = 0;   //哈希目录中前一块的块号，为0表示当前块在链首
+    uint32_t block_idx = index_lba != 0 ? dir_index_get(part, index_lba, bucket) : 0;
+    uint32_t block_lba = 0, sec_idx = 0, dir_entry_idx = 0;
+    bool found = false;
+
+    //目录项在存储时保证不会跨扇区
+    while(block_idx < DIR_MAX_BLOCKS) {
+        if(index_lba != 0 && block_idx == 0) {   //桶的块链走完了
+            break;
+        }
+        block_lba = inode_bmap(part, dir_inode, block_idx, false);
+        if(block_lba != 0 && dir_block_locate(part, block_lba, inode_no, &sec_idx, &dir_entry_idx, io_buf)) {
+            found = true;
+            break;
+        }
+        if(index_lba != 0) {
+            prev_idx = block_idx;
+            block_idx = dir_index_get(part, index_lba, DIR_HASH_BUCKETS + block_idx);
+        } else {
             block_idx++;
-            continue;
         }
-
-        //在此扇区中找到目录项后，清楚该目录项并判断是否回收扇区，随后退出循环直接返回
-        ASSERT(dir_entry_cnt >= 1);
-        if(dir_entry_cnt == 1 && !is_dir_first_block) {   //除目录第一个扇区外，若该扇区只有该目录项自己，则将整个扇区回收
-            //a 在块位图中回收该块
-            uint32_t block_bitmap_idx = all_blocks[block_idx] - part->sb->data_start_lba;
-            bitmap_set(&part->block_bitmap, block_bitmap_idx, 0);
-            bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
-
-            //b 将块地址从数组i_sectors或索引表中去掉
-            if(block_idx < 12) {
-                dir_inode->i_sectors[block_idx] = 0;
-            } else {   //在一级间接索引表中擦除该间接块地址
-                //先判断一级间索引表中间接块的数量，如果只有这一个间接块，连同简介索引表所在的块一同回收
-                uint32_t indirect_blocks = 0;   //记录间接块个数
-                uint32_t indirect_block_idx = 12;   //间接块索引
-                while(indirect_block_idx < 140) {   //!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-                    if(all_blocks[indirect_block_idx] != 0) {
-                        indirect_blocks++;
-                    }
-                    indirect_block_idx++;
-                }
-                ASSERT(indirect_blocks >= 1);   //包括当前间接块
-
-                if(indirect_blocks > 1) {   //简介索引表中还包括其他块，仅在索引表中擦除当前这个间接块表地址
-                    all_blocks[block_idx] = 0;
-                    ide_write(part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
-                } else {   //简介索引表中就当前这1个间接块
-                    //直接将简介索引表所在的块回收，然后擦除间接索引表块地址
-                    block_bitmap_idx = dir_inode->i_sectors[12] - part->sb->data_start_lba;
-                    bitmap_set(&part->block_bitmap, block_bitmap_idx, 0);
-                    bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
-
-                    //将简介索引表地址清0
-                    dir_inode->i_sectors[12] = 0;
-                }
-            }
-        } else {   //仅将该目录项清空
-            memset(dir_entry_found, 0, dir_entry_size);
-            //!!!!!!清空目录项占用的数据
-            ide_write(part->my_disk, all_blocks[block_idx], io_buf, 1);
+    }
+    //所有块中未找到则返回false
+    if(!found) {
+        return false;
+    }
+    dcache_invalidate(part, dir_inode->i_no, ((struct dir_entry*)io_buf)[dir_entry_idx].filename);
+
+    //清除该目录项，除目录第一个块外，若该块只有该目录项自己，则将整个块回收
+    if(block_idx != 0 && dir_block_entries(part, block_lba, io_buf) == 1) {
+        if(index_lba != 0) {   //把该块从桶的块链中摘下
+            uint32_t next_idx = dir_index_get(part, index_lba, DIR_HASH_BUCKETS + block_idx);
+            dir_index_set(part, index_lba, prev_idx == 0 ? bucket : DIR_HASH_BUCKETS + prev_idx, next_idx);
+            dir_index_set(part, index_lba, DIR_HASH_BUCKETS + block_idx, 0);
         }
-
-        //更新i节点信息并同步到硬盘
-        ASSERT(dir_inode->i_size >= dir_entry_size);
-        dir_inode->i_size -= dir_entry_size;
-        memset(io_buf, 0, SECTOR_SIZE * 2);
-        inode_sync(part, dir_inode, io_buf);
-
-        return true;
+        inode_unmap(part, dir_inode, block_idx);
+    } else {   //仅将该目录项清空
+        bcache_read(part->my_disk, block_lba + sec_idx, io_buf, 1);
+        memset((struct dir_entry*)io_buf + dir_entry_idx, 0, dir_entry_size);
+        bcache_write(part->my_disk, block_lba + sec_idx, io_buf, 1);
     }
 
-    //所有块中未找到则返回false
-    return false;
+    //更新i节点信息并同步到硬盘
+    ASSERT(dir_inode->i_size >= dir_entry_size);
+    dir_inode->i_size -= dir_entry_size;
+    memset(io_buf, 0, SECTOR_SIZE * 2);
+    inode_sync(part, dir_inode, io_buf);
+    return true;
 }
 
 /*读取目录，成功返回1个目录项，失败返回NULL*/
@@ -321,53 +348,49 @@ struct dir_entry* dir_read(struct dir* dir)
 {
     struct dir_entry* dir_e = (struct dir_entry*)dir->dir_buf;
     struct inode* dir_inode = dir->inode;
-    uint32_t all_blocks[140] = {0}, block_cnt = 12;
-    uint32_t block_idx = 0, dir_entry_idx = 0;
-    while(block_idx < 12) {
-        all_blocks[block_idx] = dir_inode->i_sectors[block_idx];
-        block_idx++;
-    }
-    if(dir_inode->i_sectors[12] != 0) {
-        ide_read(cur_part->my_disk, dir_inode->i_sectors[12], all_blocks + 12, 1);
-        block_cnt = 140;
-    }
-    block_idx = 0;
-
-    uint32_t cur_dir_entry_pos = 0;   //当前目录项的偏移，此项用来判断是否是之前已经返回过的目录项
     uint32_t dir_entry_size = cur_part->sb->dir_entry_size;
     uint32_t dir_entrys_per_sec = SECTOR_SIZE / dir_entry_size;   //1扇区可容纳的目录项个数
-    //在目录大小内遍历目录
-    while(dir->dir_pos < dir_inode->i_size) {
-        if(dir->dir_pos >= dir_inode->i_size) {
-            return NULL;
-        }
-        if(all_blocks[block_idx] == 0) {
-            block_idx++;
+
+    down_read(&dir_inode->i_rwsem);
+    //从scan_off所在的扇区接着找，不必每次从目录开头重读。目录项不跨扇区，扇区末尾不足一项的字节不用
+    while(dir->dir_pos < dir_inode->i_size && dir->scan_off < DIR_MAX_BLOCKS * BLOCK_SIZE) {
+        uint32_t block_idx = dir->scan_off / BLOCK_SIZE;
+        uint32_t block_lba = inode_bmap(cur_part, dir_inode, block_idx, false);
+        if(block_lba == 0) {   //哈希目录中间可能有没分配的块
+            dir->scan_off = (block_idx + 1) * BLOCK_SIZE;
             continue;
         }
-        memset(dir_e, 0, SECTOR_SIZE);
-        ide_read(cur_part->my_disk, all_blocks[block_idx], dir_e, 1);
-        dir_entry_idx = 0;
-        //遍历扇区内所有目录项
-        while(dir_entry_idx < dir_entrys_per_sec) {
+        uint32_t sec_start = dir->scan_off - dir->scan_off % SECTOR_SIZE;   //所在扇区的开头
+        bcache_read(cur_part->my_disk, block_lba + sec_start % BLOCK_SIZE / SECTOR_SIZE, dir_e, 1);
+        uint32_t dir_entry_idx;
+        //遍历扇区内剩下的目录项
+        for(dir_entry_idx = dir->scan_off % SECTOR_SIZE / dir_entry_size; dir_entry_idx < dir_entrys_per_sec; dir_entry_idx++) {
             if((dir_e + dir_entry_idx)->f_type) {   //如果f_type不是0，及不等于FT_UNKNOWN
-                //判断是不是最新的目录项，避免返回怎经已经返回过得目录项
-                if(cur_dir_entry_pos < dir->dir_pos) {
-                    cur_dir_entry_pos += dir_entry_size;
-                    dir_entry_idx++;
-                    continue;
-                }
-                ASSERT(cur_dir_entry_pos == dir->dir_pos);
-                dir->dir_pos += dir_entry_size;   //更新为新位置，即下一个返回的目录项地址
+                //下次从后一项找起，这是扇区最后一项时从下一扇区找起
+                dir->scan_off = dir_entry_idx + 1 < dir_entrys_per_sec ? \
+                                sec_start + (dir_entry_idx + 1) * dir_entry_size : sec_start + SECTOR_SIZE;
+                dir->dir_pos += dir_entry_size;   //已返回的目录项的总大小
+                up_read(&dir_inode->i_rwsem);
                 return dir_e + dir_entry_idx;
             }
-            dir_entry_idx++;
         }
-        block_idx++;
+        dir->scan_off = sec_start + SECTOR_SIZE;
     }
+    up_read(&dir_inode->i_rwsem);
     return NULL;
 }
 
+/*从dir中接着读出最多cnt个目录项到buf，返回读到的个数，读完时返回0*/
+uint32_t dir_read_batch(struct dir* dir, struct dir_entry* buf, uint32_t cnt)
+{
+    uint32_t read_cnt = 0;
+    struct dir_entry* dir_e;
+    while(read_cnt < cnt && (dir_e = dir_read(dir)) != NULL) {
+        memcpy(&buf[read_cnt++], dir_e, sizeof(struct dir_entry));
+    }
+    return read_cnt;
+}
+
 /*判断目录是否为空*/
 bool dir_is_empty(struct dir* dir)
 {
@@ -375,13 +398,18 @@ bool dir_is_empty(struct dir* dir)
     return (dir_inode->i_size == cur_part->sb->dir_entry_size * 2);
 }
 
-/*在父目录parent_dir中删除child_dir*/
-int32_t dir_remove(struct dir* parent_dir, struct dir* child_dir)
+/*在父目录parent_dir中删除名为name的子目录child_dir*/
+int32_t dir_remove(struct dir* parent_dir, struct dir* child_dir, const char* name)
 {
     struct inode* child_dir_inode = child_dir->inode;
+    //哈希目录的索引块不是二级间接块，先单独回收，inode_release才不会把它当作块表
+    if(child_dir_inode->i_sectors[DIR_INDEX] != 0) {
+        block_bitmap_free(cur_part, child_dir_inode->i_sectors[DIR_INDEX]);
+        child_dir_inode->i_sectors[DIR_INDEX] = 0;
+    }
     //空目录只在inode->i_sectors[0]中有扇区，其他扇区都应该为空
     int32_t block_idx = 1;
-    while(block_idx < 13) {
+    while(block_idx <= INODE_TIND) {
         ASSERT(child_dir_inode->i_sectors[block_idx] == 0);
         block_idx++;
     }
@@ -392,7 +420,7 @@ int32_t dir_remove(struct dir* parent_dir, struct dir* child_dir)
     }
 
     //在父目录parent_dir中删除child_dir对应的目录项
-    delete_dir_entry(cur_part, parent_dir, child_dir_inode->i_no, io_buf);
+    delete_dir_entry(cur_part, parent_dir, child_dir_inode->i_no, name, io_buf);
 
     //回收inode中i_sectors中占用的扇区，并同步inode_bitmap和block_bitmap
     inode_release(cur_part, child_dir_inode->i_no);
@@ -8,11 +8,19 @@
 
 #define MAX_FILE_NAME_LEN 16   //最大文件名长度
 
+/*哈希目录：i_sectors[DIR_INDEX]不为0的目录，该项指向索引块，为0的是原来的线性目录。
+  索引块是uint16_t数组，前DIR_HASH_BUCKETS项是各桶块链首的块号，之后第DIR_HASH_BUCKETS + n项是第n块在链中的下一块，
+  块号为0表示没有，第0块只存放.和..*/
+#define DIR_INDEX INODE_DIND   //目录不用二级间接块，这一项存哈希目录的索引块
+#define DIR_HASH_BUCKETS 64   //哈希目录的桶数，(DIR_HASH_BUCKETS + DIR_MAX_BLOCKS) * 2不能超过BLOCK_SIZE
+#define DIR_INDEX_PER_SEC (SECTOR_SIZE / 2)   //索引块一个扇区中的项数
+
 /*目录结构*/
 struct dir
 {
     struct inode* inode;   //该目录对应的inode，用于指向内存中的inode
     uint32_t dir_pos;      //记录在目录内的偏移
+    uint32_t scan_off;     //下一个要检查的目录项在目录块中的偏移，按块号乘BLOCK_SIZE计，dir_read从这里接着找
     uint8_t dir_buf[512];  //目录的数据缓存
 };
 
@@ -24,7 +32,16 @@ struct dir_entry
     enum file_types f_type;   //文件类型
 };
 
+/*getdents_stat读出的目录项，带上文件大小，ls -l不必再逐个stat*/
+struct dir_entry_stat
+{
+    struct dir_entry entry;
+    uint32_t st_size;
+};
+
 extern struct dir root_dir;   //根目录
+extern struct kmem_cache* dir_cache;
+extern uint32_t dir_entry_gen;   //目录项删除的次数，记下的路径到inode号的解析结果在它变化后可能已失效
 
 /*打开根目录*/
 void open_root_dir(struct partition* part);
@@ -39,13 +56,15 @@ void dir_close(struct dir* dir);
 void create_dir_entry(char* filename, uint32_t inode_no, uint8_t file_type, struct dir_entry* p_de);
 /*将目录项p_de写入父目录parent_dir中，io_but由主调函数提供*/
 bool sync_dir_entry(struct dir* parent_dir, struct dir_entry* p_de, void* io_buf);
-/*把分区part目录pdir中编号为inode_no的目录项删除*/
-bool delete_dir_entry(struct partition* part, struct dir* pdir, uint32_t inode_no, void* io_buf);
+/*把分区part目录pdir中编号为inode_no、名为name的目录项删除*/
+bool delete_dir_entry(struct partition* part, struct dir* pdir, uint32_t inode_no, const char* name, void* io_buf);
 /*读取目录，成功返回1个目录项，失败返回NULL*/
 struct dir_entry* dir_read(struct dir* dir);
+/*从dir中接着读出最多cnt个目录项到buf，返回读到的个数，读完时返回0*/
+uint32_t dir_read_batch(struct dir* dir, struct dir_entry* buf, uint32_t cnt);
 /*判断目录是否为空*/
 bool dir_is_empty(struct dir* dir);
-/*在父目录parent_dir中删除child_dir*/
-int32_t dir_remove(struct dir* parent_dir, struct dir* child_dir);
+/*在父目录parent_dir中删除名为name的子目录child_dir*/
+int32_t dir_remove(struct dir* parent_dir, struct dir* child_dir, const char* name);
 
 #endif
@@ -9,88 +9,430 @@
 #include "memory.h"
 #include "debug.h"
 #include "interrupt.h"
+#include "bcache.h"
+#include "journal.h"
+#include "pcache.h"
+#include "pipe.h"
+#include "bitmap.h"
+#include "exec.h"
+#include "console.h"
+#include "tty.h"
+#include "klog.h"
+
+/*已打开的文件*/
+struct list file_list;
+struct spinlock file_list_lock;
+struct kmem_cache* file_cache;   //文件结构的对象缓存，开关文件时O(1)分配和归还
+
+struct kmem_cache* io_buf_cache;   //文件读写缓冲区的对象缓存，每个缓冲区2个扇区，inode_sync跨扇区时也够用
+
+/*普通文件的写操作，打开时没有写权限则失败*/
+static int32_t regular_write(struct file* file, const void* buf, uint32_t count)
+{
+    if(!(file->fd_flag & (O_WRONLY | O_RDWR))) {
+        console_put_str("sys_write: not allowed to write file without flag O_RDWR or O_WRONLY");
+        return -1;
+    }
+    return file_write(file, buf, count);
+}
 
-/*文件表*/
-struct file file_table[MAX_FILE_OPEN];
+const struct file_operations regular_fops = {file_read, regular_write, file_close};
 
-/*从文件表file_table中获取一个空闲位，成功返回下标，失败返回-1*/
-int32_t get_free_slot_in_global(void)
+/*控制台经tty按行读入*/
+static int32_t tty_file_read(struct file* file UNUSED, void* buf, uint32_t count)
 {
-    uint32_t fd_idx = 3;
-    while(fd_idx < MAX_FILE_OPEN) {
-        if(file_table[fd_idx].fd_inode == NULL) {
-            break;
+    return tty_read(buf, count);
+}
+
+static int32_t tty_file_write(struct file* file UNUSED, const void* buf, uint32_t count)
+{
+    console_write(buf, count);
+    klog_host_write(buf, count);   //用户进程的输出也送到宿主机，无界面运行时可以从日志文件中取结果
+    return count;
+}
+
+static const struct file_operations tty_fops = {tty_file_read, tty_file_write, NULL};   //标准输入输出不会被关闭
+
+/*标准输入输出占用的文件结构，各任务的0、1、2号描述符都指向这里，不会被关闭*/
+static struct file std_files[3] = {{.fd_ops = &tty_fops}, {.fd_ops = &tty_fops}, {.fd_ops = &tty_fops}};
+
+/*分配一个清零的文件结构，引用数为1，加入file_list，失败返回NULL*/
+struct file* file_alloc(void)
+{
+    struct file* file = kmem_cache_alloc(file_cache);
+    if(file == NULL) {
+        printk("file_alloc: kmem_cache_alloc for file failed\n");
+        return NULL;
+    }
+    memset(file, 0, sizeof(struct file));
+    file->fd_refs = 1;
+    enum intr_status old_status = spin_lock_irqsave(&file_list_lock);
+    list_append(&file_list, &file->file_tag);
+    spin_unlock_irqrestore(&file_list_lock, old_status);
+    return file;
+}
+
+/*把文件结构从file_list中摘下并归还，不关闭文件*/
+void file_free(struct file* file)
+{
+    enum intr_status old_status = spin_lock_irqsave(&file_list_lock);
+    list_remove(&file->file_tag);
+    spin_unlock_irqrestore(&file_list_lock, old_status);
+    kmem_cache_free(file_cache, file);
+}
+
+/*判断file是否是控制台标准输入输出的文件结构，这些结构不计引用*/
+bool file_is_std(struct file* file)
+{
+    return file >= std_files && file < std_files + 3;
+}
+
+/*为新增的一个文件描述符增加对file的引用*/
+void file_get(struct file* file)
+{
+    if(file_is_std(file)) {
+        return;
+    }
+    enum intr_status old_status = spin_lock_irqsave(&file_list_lock);
+    file->fd_refs++;
+    spin_unlock_irqrestore(&file_list_lock, old_status);
+}
+
+/*释放对file的一次引用，最后一个引用释放时关闭文件或管道并归还文件结构，成功返回0，失败返回-1*/
+int32_t file_put(struct file* file)
+{
+    if(file_is_std(file)) {
+        return 0;
+    }
+    enum intr_status old_status = spin_lock_irqsave(&file_list_lock);
+    bool last = --file->fd_refs == 0;
+    spin_unlock_irqrestore(&file_list_lock, old_status);
+    if(!last) {
+        return 0;
+    }
+    int32_t ret = file->fd_ops->release(file);
+    file_free(file);
+    return ret;
+}
+
+/*为内嵌表以外的fd_size个槽求存放描述符数组和其后占用位图所需的页数*/
+static uint32_t fd_table_pages(uint32_t fd_size)
+{
+    return DIV_ROUND_UP(fd_size * sizeof(struct file*) + fd_size / 8, PG_SIZE);
+}
+
+/*把pthread的文件描述符数组换成大一倍的表，页数从1页起翻倍，已到上限或内存不足时返回false*/
+static bool fd_table_grow(struct task_struct* pthread)
+{
+    if(pthread->fd_size >= MAX_FILES_OPEN_PER_PROC) {
+        return false;
+    }
+    uint32_t pg_cnt = pthread->fd_table == pthread->fd_inline ? 1 : fd_table_pages(pthread->fd_size) * 2;
+    //每个槽占一个指针加位图中的一位，槽数取32的倍数
+    uint32_t new_size = pg_cnt * PG_SIZE * 8 / (sizeof(struct file*) * 8 + 1) / 32 * 32;
+    if(new_size > MAX_FILES_OPEN_PER_PROC) {
+        new_size = MAX_FILES_OPEN_PER_PROC;
+    }
+    struct file** new_table = get_kernel_pages(fd_table_pages(new_size));   //页已清零，新增的槽都空闲
+    if(new_table == NULL) {
+        return false;
+    }
+    uint8_t* new_bits = (uint8_t*)(new_table + new_size);
+    memcpy(new_table, pthread->fd_table, pthread->fd_size * sizeof(struct file*));
+    memcpy(new_bits, pthread->fd_bitmap.bits, pthread->fd_bitmap.btmp_bytes_len);
+    fd_table_release(pthread);
+    pthread->fd_table = new_table;
+    pthread->fd_size = new_size;
+    pthread->fd_bitmap.bits = new_bits;
+    pthread->fd_bitmap.btmp_bytes_len = new_size / 8;
+    return true;
+}
+
+/*将文件结构安装到当前进程或线程的文件描述符数组fd_table中最小的空闲位置，成功返回描述符，失败返回-1*/
+int32_t pcb_fd_install(struct file* file)
+{
+    struct task_struct* cur = running_thread()->group_leader;   //进程的各线程共用主线程的描述符表
+    int32_t local_fd_idx = bitmap_scan(&cur->fd_bitmap, 1);
+    if(local_fd_idx == -1) {
+        if(!fd_table_grow(cur)) {
+            printk("excees max open files_per_proc\n");
+            return -1;
         }
-        fd_idx++;
+        local_fd_idx = bitmap_scan(&cur->fd_bitmap, 1);
     }
-    if(fd_idx == MAX_FILE_OPEN) {
-        printk("exceed max open files\n");
+    bitmap_set(&cur->fd_bitmap, local_fd_idx, 1);
+    cur->fd_table[local_fd_idx] = file;
+    return local_fd_idx;
+}
+
+/*清空当前进程或线程的文件描述符local_fd*/
+void pcb_fd_uninstall(int32_t local_fd)
+{
+    struct task_struct* cur = running_thread()->group_leader;
+    cur->fd_table[local_fd] = NULL;
+    bitmap_set(&cur->fd_bitmap, local_fd, 0);
+}
+
+/*把当前进程重定向过的标准描述符local_fd改回控制台*/
+void pcb_fd_reset_std(int32_t local_fd)
+{
+    ASSERT(local_fd >= stdin_no && local_fd <= stderr_no);
+    running_thread()->group_leader->fd_table[local_fd] = &std_files[local_fd];
+}
+
+/*使当前进程的描述符local_fd指向file，原先打开的文件释放一次引用。local_fd须小于描述符表的槽数，成功返回0，失败返回-1*/
+int32_t pcb_fd_replace(int32_t local_fd, struct file* file)
+{
+    struct task_struct* cur = running_thread()->group_leader;
+    if(local_fd < 0 || (uint32_t)local_fd >= cur->fd_size) {
         return -1;
     }
-    return fd_idx;
+    struct file* old = cur->fd_table[local_fd];
+    file_get(file);
+    cur->fd_table[local_fd] = file;
+    bitmap_set(&cur->fd_bitmap, local_fd, 1);
+    if(old != NULL) {
+        file_put(old);
+    }
+    return 0;
 }
 
-/*将全局描述符下标安装到进程或线程自己的文件描述符数组fd_table中，成功返回下标，失败返回-1*/
-int32_t pcb_fd_install(int32_t global_fd_idx)
+/*初始化pthread的文件描述符数组，先用pcb中内嵌的槽，预留标准输入输出*/
+void fd_table_init(struct task_struct* pthread)
 {
-    struct task_struct* cur = running_thread();
-    uint8_t local_fd_idx = 3;
-    while(local_fd_idx < MAX_FILES_OPEN_PER_PROC) {
-        if(cur->fd_table[local_fd_idx] == -1) {   //-1表示free_slot，可用
-            cur->fd_table[local_fd_idx] = global_fd_idx;
-            break;
+    pthread->fd_table = pthread->fd_inline;
+    pthread->fd_size = FD_INLINE;
+    pthread->fd_bitmap.bits = pthread->fd_inline_bits;
+    pthread->fd_bitmap.btmp_bytes_len = FD_INLINE / 8;
+    pthread->fd_bitmap.summary = NULL;
+    bitmap_init(&pthread->fd_bitmap);
+    memset(pthread->fd_inline, 0, sizeof(pthread->fd_inline));
+    uint32_t fd_idx;
+    for(fd_idx = 0; fd_idx < 3; fd_idx++) {
+        pthread->fd_table[fd_idx] = &std_files[fd_idx];
+        bitmap_set(&pthread->fd_bitmap, fd_idx, 1);
+    }
+}
+
+/*fork复制pcb后为子进程child复制一份文件描述符数组，共用的文件结构各加一次引用，成功返回0，失败返回-1*/
+int32_t fd_table_fork(struct task_struct* child, struct task_struct* parent)
+{
+    if(parent->fd_table == parent->fd_inline) {   //内嵌的表已随pcb复制，指回子进程自己的pcb
+        child->fd_table = child->fd_inline;
+        child->fd_bitmap.bits = child->fd_inline_bits;
+    } else {
+        uint32_t pg_cnt = fd_table_pages(parent->fd_size);
+        child->fd_table = get_kernel_pages(pg_cnt);
+        if(child->fd_table == NULL) {
+            fd_table_init(child);   //退出时不要释放父进程的表
+            return -1;
         }
-        local_fd_idx++;
+        memcpy(child->fd_table, parent->fd_table, pg_cnt * PG_SIZE);
+        child->fd_bitmap.bits = (uint8_t*)(child->fd_table + child->fd_size);
     }
-    if(local_fd_idx == MAX_FILES_OPEN_PER_PROC) {
-        printk("excees max open files_per_proc\n");
-        return -1;
+
+    enum intr_status old_status = spin_lock_irqsave(&file_list_lock);
+    uint32_t fd_idx;
+    for(fd_idx = 0; fd_idx < child->fd_size; fd_idx++) {   //标准描述符可能被重定向为管道，也要加引用
+        if(child->fd_table[fd_idx] != NULL && !file_is_std(child->fd_table[fd_idx])) {
+            child->fd_table[fd_idx]->fd_refs++;
+        }
     }
-    return local_fd_idx;
-} 
+    spin_unlock_irqrestore(&file_list_lock, old_status);
+    return 0;
+}
+
+/*spawn新建的子进程child继承父进程的文件描述符，child的pcb是新初始化的，先复制描述符表的大小和位图再按fork的方式复制。
+  成功返回0，失败返回-1*/
+int32_t fd_table_inherit(struct task_struct* child, struct task_struct* parent)
+{
+    child->fd_size = parent->fd_size;
+    child->fd_bitmap = parent->fd_bitmap;
+    memcpy(child->fd_inline, parent->fd_inline, sizeof(child->fd_inline));
+    memcpy(child->fd_inline_bits, parent->fd_inline_bits, sizeof(child->fd_inline_bits));
+    return fd_table_fork(child, parent);
+}
+
+/*释放pthread从内核分配的文件描述符数组，进程退出时在关闭全部文件后调用*/
+void fd_table_release(struct task_struct* pthread)
+{
+    if(pthread->fd_table != pthread->fd_inline) {
+        mfree_page(PF_KERNEL, pthread->fd_table, fd_table_pages(pthread->fd_size));
+    }
+}
 
-/*分配一个i节点，返回i节点号*/
+static uint8_t zero_block[BLOCK_SIZE];   //清零块时写出的全0数据
+
+/*inode_no所在的i节点表扇区还没清零时，把从第一个没清零的扇区到其所在组的末尾清零并更新超级块，需持alloc_lock。
+  格式化时只清零第一组，其余的随inode分配逐组清零，分配时在日志操作中，清零和超级块与新inode在同一个事务里*/
+static void inode_table_prepare(struct partition* part, uint32_t inode_no)
+{
+    struct super_block* sb = part->sb;
+    uint32_t inited = sb->inode_table_sects - sb->inode_table_uninit;   //已清零的扇区数
+    uint32_t last_sec = ((inode_no + 1) * INODE_DISK_SIZE - 1) / SECTOR_SIZE;   //inode最后一个字节所在的扇区
+    if(last_sec < inited) {
+        return;
+    }
+    uint32_t end = (last_sec / INODE_TABLE_GROUP_SECTS + 1) * INODE_TABLE_GROUP_SECTS;
+    if(end > sb->inode_table_sects) {
+        end = sb->inode_table_sects;
+    }
+    while(inited < end) {
+        uint32_t sec_cnt = end - inited < BLOCK_SECS ? end - inited : BLOCK_SECS;
+        bcache_write(part->my_disk, sb->inode_table_lba + inited, zero_block, sec_cnt);
+        inited += sec_cnt;
+    }
+    sb->inode_table_uninit = sb->inode_table_sects - end;
+    bcache_write(part->my_disk, part->start_lba + 1, sb, 1);
+}
+
+/*分配一个i节点，返回i节点号。所在的i节点表扇区还没清零时先清零*/
 int32_t inode_bitmap_alloc(struct partition* part)
 {
-    int32_t bit_idx = bitmap_scan(&part->inode_bitmap, 1);
-    if(bit_idx == -1) {
-        return -1;
+    lock_acquire(&part->alloc_lock);
+    int32_t bit_idx = part->sb->free_inodes == 0 ? -1 : bitmap_scan(&part->inode_bitmap, 1);   //用完时不必扫描位图
+    if(bit_idx != -1) {
+        bitmap_set(&part->inode_bitmap, bit_idx, 1);
+        part->sb->free_inodes--;
+        if(part->sb->inode_table_uninit > 0) {
+            inode_table_prepare(part, bit_idx);
+        }
     }
-    bitmap_set(&part->inode_bitmap, bit_idx, 1);
+    lock_release(&part->alloc_lock);
     return bit_idx;
 }
 
-/*分配一个扇区，返回其扇区地址*/
+/*回收i节点inode_no并同步inode位图*/
+void inode_bitmap_free(struct partition* part, uint32_t inode_no)
+{
+    lock_acquire(&part->alloc_lock);
+    bitmap_set(&part->inode_bitmap, inode_no, 0);
+    bitmap_sync(part, inode_no, INODE_BITMAP);
+    part->sb->free_inodes++;
+    lock_release(&part->alloc_lock);
+}
+
+/*分配一个块，返回其起始扇区地址*/
 int32_t block_bitmap_alloc(struct partition* part)
 {
-    int32_t bit_idx = bitmap_scan(&part->block_bitmap, 1);
-    if(bit_idx == -1) {
+    lock_acquire(&part->alloc_lock);
+    int32_t bit_idx = part->sb->free_blocks == 0 ? -1 : bitmap_scan(&part->block_bitmap, 1);   //用完时不必扫描位图
+    if(bit_idx != -1) {
+        bitmap_set(&part->block_bitmap, bit_idx, 1);
+        part->sb->free_blocks--;
+    }
+    lock_release(&part->alloc_lock);
+    return bit_idx == -1 ? -1 : (int32_t)(part->sb->data_start_lba + bit_idx * BLOCK_SECS);
+}
+
+/*回收起始扇区为block_lba的块并同步块位图*/
+void block_bitmap_free(struct partition* part, uint32_t block_lba)
+{
+    uint32_t bit_idx = block_bitmap_index(part, block_lba);
+    ASSERT(bit_idx > 0);
+    lock_acquire(&part->alloc_lock);
+    bitmap_set(&part->block_bitmap, bit_idx, 0);
+    bitmap_sync(part, bit_idx, BLOCK_BITMAP);
+    part->sb->free_blocks++;
+    lock_release(&part->alloc_lock);
+}
+
+/*从块goal_lba起分配至多cnt个相连的块，goal_lba为0或该块已被占用时改从第一段能容纳cnt块的空闲区分配，
+  再没有就分配任意一块。分到的块数存入alloc_cnt，返回第一块的起始扇区地址，失败返回-1。块位图随之同步到硬盘*/
+int32_t block_bitmap_alloc_run(struct partition* part, uint32_t goal_lba, uint32_t cnt, uint32_t* alloc_cnt)
+{
+    struct bitmap* btmp = &part->block_bitmap;
+    uint32_t bit_len = btmp->btmp_bytes_len * 8;
+    int32_t bit_idx = -1;
+    lock_acquire(&part->alloc_lock);
+    if(part->sb->free_blocks == 0) {
+        lock_release(&part->alloc_lock);
         return -1;
     }
-    bitmap_set(&part->block_bitmap, bit_idx, 1);
-    return (part->sb->data_start_lba + bit_idx);
+    if(goal_lba >= part->sb->data_start_lba) {
+        uint32_t goal_idx = block_bitmap_index(part, goal_lba);
+        if(goal_idx < bit_len && !bitmap_scan_test(btmp, goal_idx)) {
+            bit_idx = goal_idx;
+        }
+    }
+    if(bit_idx == -1) {
+        bit_idx = bitmap_scan(btmp, cnt);
+        if(bit_idx == -1) {
+            bit_idx = bitmap_scan(btmp, 1);
+        }
+        if(bit_idx == -1) {
+            lock_release(&part->alloc_lock);
+            return -1;
+        }
+    }
+
+    uint32_t got = 0;
+    while(got < cnt && bit_idx + got < bit_len && !bitmap_scan_test(btmp, bit_idx + got)) {
+        bitmap_set(btmp, bit_idx + got, 1);
+        got++;
+    }
+    part->sb->free_blocks -= got;
+    //这段块在位图中最多跨两个扇区，各同步一次
+    bitmap_sync(part, bit_idx, BLOCK_BITMAP);
+    if((bit_idx + got - 1) / BITS_PER_SECTOR != (uint32_t)bit_idx / BITS_PER_SECTOR) {
+        bitmap_sync(part, bit_idx + got - 1, BLOCK_BITMAP);
+    }
+    lock_release(&part->alloc_lock);
+    *alloc_cnt = got;
+    return part->sb->data_start_lba + bit_idx * BLOCK_SECS;
+}
+
+/*返回起始扇区为block_lba的块在块位图中的下标*/
+uint32_t block_bitmap_index(struct partition* part, uint32_t block_lba)
+{
+    ASSERT(block_lba >= part->sb->data_start_lba && (block_lba - part->sb->data_start_lba) % BLOCK_SECS == 0);
+    return (block_lba - part->sb->data_start_lba) / BLOCK_SECS;
+}
+
+/*把起始扇区为block_lba的整块清零*/
+void block_zero(struct partition* part, uint32_t block_lba)
+{
+    bcache_write(part->my_disk, block_lba, zero_block, BLOCK_SECS);
 }
 
-/*将内存中bitmap第bit_idx位所在的512字节同步到硬盘*/
+/*将内存中bitmap第bit_idx位所在的512字节记为脏，由bitmap_flush在同步点或回写线程检查时一并写入块缓存，
+  分配和释放时只改内存，同一扇区多次修改只写一次*/
 void bitmap_sync(struct partition* part, uint32_t bit_idx, uint8_t btmp_type)
 {
-    uint32_t off_sec = bit_idx / 4096;   //本i节点索引相对于位图的扇区偏移量
-    uint32_t off_size = off_sec * BLOCK_SIZE;   //本i节点索引相对于位图的字节偏移量
-    uint32_t sec_lba;
-    uint8_t* bitmap_off;
+    uint32_t off_sec = bit_idx / BITS_PER_SECTOR;   //本i节点索引相对于位图的扇区偏移量
+    if(btmp_type == INODE_BITMAP) {
+        off_sec += part->sb->block_bitmap_sects;
+    }
+    bitmap_set(&part->bitmap_dirty, off_sec, 1);
+}
 
-    //需要被同步到硬盘的位图只有inode_bitmap and block_bitmap
-    switch(btmp_type) {
-        case INODE_BITMAP:
-            sec_lba = part->sb->inode_bitmap_lba + off_sec;
-            bitmap_off = part->inode_bitmap.bits + off_size;
-            break;
-        case BLOCK_BITMAP:
-            sec_lba = part->sb->block_bitmap_lba + off_sec;
-            bitmap_off = part->block_bitmap.bits + off_size;
-            break;
+/*把分区part两个位图中记为脏的扇区写入块缓存，稍后由块缓存写回硬盘，位图有变化时超级块中的空闲计数也一并写入。
+  不持alloc_lock，日志提交时也会调用，写入期间被改的扇区会再记为脏，下次再写*/
+void bitmap_flush(struct partition* part)
+{
+    if(part->bitmap_dirty.bits == NULL) {   //分区还没挂载完
+        return;
+    }
+    uint32_t block_sects = part->sb->block_bitmap_sects;
+    uint32_t dirty_idx;
+    bool flushed = false;
+    for(dirty_idx = 0; dirty_idx < block_sects + part->sb->inode_bitmap_sects; dirty_idx++) {
+        if(!bitmap_scan_test(&part->bitmap_dirty, dirty_idx)) {
+            continue;
+        }
+        flushed = true;
+        bitmap_set(&part->bitmap_dirty, dirty_idx, 0);   //先清除，写入期间再变脏的下次再写
+        if(dirty_idx < block_sects) {
+            bcache_write(part->my_disk, part->sb->block_bitmap_lba + dirty_idx, \
+                         part->block_bitmap.bits + dirty_idx * SECTOR_SIZE, 1);
+        } else {
+            bcache_write(part->my_disk, part->sb->inode_bitmap_lba + dirty_idx - block_sects, \
+                         part->inode_bitmap.bits + (dirty_idx - block_sects) * SECTOR_SIZE, 1);
+        }
+    }
+    if(flushed) {
+        bcache_write(part->my_disk, part->start_lba + 1, part->sb, 1);
     }
-    ide_write(part->my_disk, sec_lba, bitmap_off, 1);
 }
 
 /*创建文件，若成功则返回文件描述符，否则返回-1*/
@@ -112,27 +454,26 @@ int32_t file_create(struct dir* parent_dir, char* filename, uint8_t flag)
         return -1;
     }
 
-    //此inode要从堆中申请内存，不可生成局部变量（函数退出时会释放），因此file_table数组中的文件描述符指向的文件结构的inode指针要指向它
-    struct inode* new_file_inode = (struct inode*)sys_malloc(sizeof(struct inode));
+    //此inode要从inode缓存中申请，不可生成局部变量（函数退出时会释放），因此文件描述符指向的文件结构的inode指针要指向它
+    struct inode* new_file_inode = kmem_cache_alloc(inode_cache);
     if(new_file_inode == NULL) {
-        printk("file_create: sys_malloc for inode failed\n");
+        printk("file_create: kmem_cache_alloc for inode failed\n");
         rollback_step = 1;
         goto rollback;
     }
     inode_init(inode_no, new_file_inode);   //初始化i节点
 
-    //返回的是file_table（文件表中存储文件结构）数组的下标
-    int fd_idx = get_free_slot_in_global();
-    if(fd_idx == -1) {
-        printk("seceed max open files\n");
+    //从文件结构缓存中分配，各字段已清零
+    struct file* file = file_alloc();
+    if(file == NULL) {
         rollback_step = 2;
         goto rollback;
     }
 
-    file_table[fd_idx].fd_inode = new_file_inode;
-    file_table[fd_idx].fd_pos = 0;
-    file_table[fd_idx].fd_flag = flag;
-    file_table[fd_idx].fd_inode->write_deny = false;
+    file->fd_inode = new_file_inode;
+    file->fd_flag = flag;
+    file->fd_ops = &regular_fops;
+    file->fd_inode->write_deny = false;
 
     struct dir_entry new_dir_entry;
     memset(&new_dir_entry, 0, sizeof(struct dir_entry));
@@ -157,24 +498,27 @@ int32_t file_create(struct dir* parent_dir, char* filename, uint8_t flag)
     //d 将inode_bitmap位图同步到硬盘
     bitmap_sync(cur_part, inode_no, INODE_BITMAP);
 
-    //e 将创建的文件i节点添加到open_inodes链表
-    list_push(&cur_part->open_inodes, &new_file_inode->inode_tag);
-    new_file_inode->i_open_cnts = 1;
+    //e 将创建的文件i节点添加到内存inode缓存
+    inode_cache_add(cur_part, new_file_inode);
 
     sys_free(io_buf);
-    return pcb_fd_install(fd_idx);
+    int32_t fd = pcb_fd_install(file);
+    if(fd == -1) {   //文件已建好，只是描述符用完了，关掉即可
+        file_put(file);
+    }
+    return fd;
 
 //创建文件需要创建相关的多个资源，若某步失败则会执行到下面的回滚步骤
 rollback:
     switch(rollback_step) {
         case 3:
-            //失败时，将file_table中的相应位清空
-            memset(&file_table[fd_idx], 0, sizeof(struct file));
+            //失败时，归还文件结构
+            file_free(file);
         case 2:
-            sys_free(new_file_inode);
+            kmem_cache_free(inode_cache, new_file_inode);
         case 1:
             //如果新文件的i节点创建失败，之前位图中分配的inode_no也要恢复
-            bitmap_set(&cur_part->inode_bitmap, inode_no, 0);
+            inode_bitmap_free(cur_part, inode_no);
             break;
     }
     sys_free(io_buf);
@@ -184,15 +528,14 @@ rollback:
 /*打开编号为inode_no的inode对应的文件，成功返回文件描述符，否则返回-1*/
 int32_t file_open(uint32_t inode_no, uint8_t flag)
 {
-    int fd_idx = get_free_slot_in_global();
-    if(fd_idx == -1) {
-        printk("exceed max open files\n");
+    struct file* file = file_alloc();
+    if(file == NULL) {
         return -1;
     }
-    file_table[fd_idx].fd_inode = inode_open(cur_part, inode_no);
-    file_table[fd_idx].fd_pos = 0;
-    file_table[fd_idx].fd_flag = flag;
-    bool* write_deny = &file_table[fd_idx].fd_inode->write_deny;
+    file->fd_inode = inode_open(cur_part, inode_no);
+    file->fd_flag = flag;
+    file->fd_ops = &regular_fops;
+    bool* write_deny = &file->fd_inode->write_deny;
 
     if(flag & O_WRONLY || flag & O_RDWR) {   //只要是关于写文件，判断是否有其他进程正在写此文件，若是读文件，不考虑write_deny
         //一下进入临界区前先关中断
@@ -203,10 +546,16 @@ int32_t file_open(uint32_t inode_no, uint8_t flag)
         } else {
             intr_set_status(old_status);
             printk("file can't be write now, try again later\n");
+            inode_close(file->fd_inode);
+            file_free(file);
             return -1;
         }
     }
-    return pcb_fd_install(fd_idx);
+    int32_t fd = pcb_fd_install(file);
+    if(fd == -1) {
+        file_put(file);
+    }
+    return fd;
 }
 
 /*关闭文件*/
@@ -221,203 +570,248 @@ int32_t file_close(struct file* file)
     return 0;
 }
 
-/*把buf中的count个字节写入file，成功则返回写入的字节数，失败则返回-1*/
-int32_t file_write(struct file* file, const void* buf, uint32_t count)
+/*在iovec数组上顺序移动的位置，读写按扇区进行时一个扇区的数据可以跨越相邻的iovec*/
+struct iov_iter
 {
-    if((file->fd_inode->i_size + count) > (BLOCK_SIZE * 140)) {
-        printk("exceed max file_size 71680 bytes, write file failed\n");
-        return -1;
+    const struct iovec* iov;   //当前的iovec
+    uint32_t cnt;   //剩余的iovec个数，含当前这个
+    uint32_t off;   //在当前iovec中的偏移
+};
+
+/*返回it当前iovec中剩余的连续字节数，base返回其起始地址，跳过已用完的和长度为0的iovec*/
+static uint32_t iov_iter_span(struct iov_iter* it, uint8_t** base)
+{
+    while(it->cnt > 0 && it->off == it->iov->iov_len) {
+        it->iov++;
+        it->cnt--;
+        it->off = 0;
     }
-    uint8_t* io_buf = sys_malloc(512);
-    if(io_buf == NULL) {
-        printk("file_write: sys_malloc for io_buf failed\n");
+    if(it->cnt == 0) {
+        return 0;
+    }
+    *base = (uint8_t*)it->iov->iov_base + it->off;
+    return it->iov->iov_len - it->off;
+}
+
+/*在it当前位置和kbuf之间复制len个字节，to_iov为true时从kbuf复制到iovec，否则反之。调用者保证iovec中剩余的字节够len个*/
+static void iov_iter_copy(struct iov_iter* it, uint8_t* kbuf, uint32_t len, bool to_iov)
+{
+    while(len > 0) {
+        uint8_t* base;
+        uint32_t span = iov_iter_span(it, &base);
+        if(span > len) {
+            span = len;
+        }
+        if(to_iov) {
+            memcpy(base, kbuf, span);
+        } else {
+            memcpy(kbuf, base, span);
+        }
+        kbuf += span;
+        it->off += span;
+        len -= span;
+    }
+}
+
+/*求iov中iovcnt个缓冲区的总字节数存入total，超过文件的最大尺寸时返回false*/
+static bool iov_total(const struct iovec* iov, uint32_t iovcnt, uint32_t* total)
+{
+    *total = 0;
+    uint32_t idx;
+    for(idx = 0; idx < iovcnt; idx++) {
+        if(iov[idx].iov_len > INODE_MAX_SIZE - *total) {
+            return false;
+        }
+        *total += iov[idx].iov_len;
+    }
+    return true;
+}
+
+/*把iov中iovcnt个缓冲区共count个字节依次写入file，成功则返回写入的字节数，失败则返回-1，需持inode的写锁。
+  整个向量只查一次预留位置、只同步一次inode，前一个缓冲区末尾不足一扇区的数据和后一个的开头拼成一个扇区写*/
+static int32_t file_writev_locked(struct file* file, const struct iovec* iov, uint32_t iovcnt, uint32_t count)
+{
+    if(count > INODE_MAX_SIZE - file->fd_inode->i_size) {
+        printk("exceed max file_size 0x%x bytes, write file failed\n", INODE_MAX_SIZE);
         return -1;
     }
-    uint32_t* all_blocks = (uint32_t*)sys_malloc(BLOCK_SIZE + 48);   //用来记录文件所有的块地址
-    if(all_blocks == NULL) {
-        printk("file_write: sys_malloc for all_block failed\n");
+    uint8_t* io_buf = kmem_cache_alloc(io_buf_cache);
+    if(io_buf == NULL) {
+        printk("file_write: kmem_cache_alloc for io_buf failed\n");
         return -1;
     }
 
-    const uint8_t* src = buf;   //用src指向buf中待写入的数据
+    struct iov_iter it = {iov, iovcnt, 0};   //待写入的数据
     uint32_t bytes_written = 0;   //记录已写入数据大小
     uint32_t size_left = count;   //记录未写入数据大小
-    int32_t block_lba = -1;   //块地址
-    uint32_t block_bitmap_idx = 0;   //用来记录block对应于block_bitmap中的索引，作为参数传给bitmap_sync
-    uint32_t sec_idx;   //用来索引扇区
+    uint32_t block_idx;   //用来索引块
+    int32_t block_lba;   //块的起始扇区地址
     uint32_t sec_lba;   //扇区地址
     uint32_t sec_off_bytes;   //扇区内字节偏移量
     uint32_t sec_left_bytes;   //扇区内剩余字节量
     uint32_t chunk_size;   //每次写入硬盘的数据块大小
-    int32_t indirect_block_table;   //用来获取一级间接表地址
-    uint32_t block_idx;   //块索引
 
-    //判断文件是否第一次写，如果是，先为其分配一个块
-    if(file->fd_inode->i_sectors[0] == 0) {
-        block_lba = block_bitmap_alloc(cur_part);
-        if(block_lba == -1) {
-            printk("file_write: block_bitmap_alloc failed\n");
-            return -1;
+    //新块紧接文件最后一块分配，并按FILE_PREALLOC_BLOCKS预留，这样和别的文件交替写时数据仍在硬盘上相连
+    file->fd_inode->prealloc_want = FILE_PREALLOC_BLOCKS;
+    if(file->fd_inode->alloc_goal == 0 && file->fd_inode->i_size > 0) {
+        int32_t last_lba = inode_bmap(cur_part, file->fd_inode, (file->fd_inode->i_size - 1) / BLOCK_SIZE, false);
+        if(last_lba > 0) {
+            file->fd_inode->alloc_goal = last_lba + BLOCK_SECS;
         }
-        file->fd_inode->i_sectors[0] = block_lba;
-
-        //没分配一个块就将位图同步到硬盘
-        block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
-        ASSERT(block_bitmap_idx != 0);
-        bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
     }
 
-    //写入count个字节前，该文件已经占用的块数
-    uint32_t file_has_used_blocks = file->fd_inode->i_size / BLOCK_SIZE + 1;
-
-    //存储count字节后该文件将占用的块数
-    uint32_t file_will_use_blocks = (file->fd_inode->i_size + count) / BLOCK_SIZE + 1;
-    ASSERT(file_will_use_blocks < 140);
-
-    //通过此增量判断是否需要分配扇区，如增量为0，表示原扇区够用
-    uint32_t add_block = file_will_use_blocks - file_has_used_blocks;
-
-    //将写文件所用到的块地址收集到all_blocks，系统中块大小等于扇区大小，后面都统一在all_blocks中获取写入扇区地址
-    if(add_block == 0) {
-        //在同一扇区写入数据，不涉及到分配新扇区
-        if(file_will_use_blocks <= 12) {
-            block_idx = file_has_used_blocks - 1;   //指向最后一个已有数据的扇区
-            all_blocks[block_idx] = file->fd_inode->i_sectors[block_idx];
-        } else {
-            //未写入新数据之前已经占用了间接块，需要将间接块地址读进来
-            ASSERT(file->fd_inode->i_sectors[12] != 0);
-            indirect_block_table = file->fd_inode->i_sectors[12];
-            ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
+    //数据总是追加在文件末尾，每块的地址由inode_bmap查找，还没有的块和途经的间接块随写随分配。
+    //块内按扇区写，新块的扇区在写到时才填充，文件末尾以后的扇区不会被读到
+    file->fd_pos = file->fd_inode->i_size;   //下面在写数据时随时更新
+    while(bytes_written < count) {
+        cond_resched();   //大文件的写入很长，每写一段让时间片用完或等着交互的任务有机会运行
+        block_idx = file->fd_inode->i_size / BLOCK_SIZE;   //最后数据所在块索引
+        //分配块和途经的间接块是元数据修改，记日志；数据本身不记，直接写回原位置
+        journal_begin();
+        block_lba = inode_bmap(cur_part, file->fd_inode, block_idx, true);   //最后数据所在块的lba
+        journal_end();
+        if(block_lba == -1) {
+            printk("file_write: block_bitmap_alloc failed\n");
+            break;
         }
-    } else {   //若有增量，涉及到分配新扇区及是否分配一级间接表，下面分三种情况处理
-        //1. 12个直接块够用
-        if(file_will_use_blocks <= 12) {
-            //先将剩余空间的可继续用的扇区写入all_blocks
-            block_idx = file_has_used_blocks - 1;
-            ASSERT(file->fd_inode->i_sectors[block_idx] != 0);
-            all_blocks[block_idx] = file->fd_inode->i_sectors[block_idx];
-
-            //再将未来要用的扇区分配好写入all_blocks
-            block_idx = file_has_used_blocks;   //指向第一个要分配的新扇区
-            while(block_idx < file_will_use_blocks) {
-                block_lba = block_bitmap_alloc(cur_part);
-                if(block_lba == -1) {
-                    printk("file_write: block_bitmap_alloc for situation 1 failed\n");
-                    return -1;
-                }
-                //写文件时，不应该存在块未使用，但已经分配扇区的请扩，当文件删除时，就会把块地址清0
-                ASSERT(file->fd_inode->i_sectors[block_lba] == 0);   //确保未分配扇区地址
-                file->fd_inode->i_sectors[block_idx] = all_blocks[block_idx] = block_lba;
-                //每分配一个块就要将位图同步到硬盘
-                block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
-                bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
-                block_idx++;   //下一个分配的新扇区
-            }
-        } else if(file_has_used_blocks <= 12 && file_will_use_blocks > 12) {   
-            //第2种情况：旧数据在12个直接块内，新数据将使用间接块
-            //先将有剩余空间的可用直接扇区地址收集到all_blocks
-            block_idx = file_has_used_blocks - 1;   //指向旧数据所在的最后一个扇区
-            all_blocks[block_idx] = file->fd_inode->i_sectors[block_idx];
-
-            //创建一级间接块表
-            block_lba = block_bitmap_alloc(cur_part);
-            if(block_lba == -1) {
-                printk("file_write: block_bitmap_alloc for situation 2 failed\n");
-                return -1;
+        sec_lba = block_lba + file->fd_inode->i_size % BLOCK_SIZE / SECTOR_SIZE;   //最后数据所在扇区的lba
+        sec_off_bytes = file->fd_inode->i_size % SECTOR_SIZE;   //最后数据在扇区中的偏移字节
+        sec_left_bytes = SECTOR_SIZE - sec_off_bytes;   //扇区内剩余字节量
+
+        //从扇区开头起当前缓冲区中有整扇区的数据时，块内的这些扇区直接从调用者的缓冲区写入块缓存，不经io_buf中转
+        uint8_t* src;
+        uint32_t span = iov_iter_span(&it, &src);
+        if(sec_off_bytes == 0 && span >= SECTOR_SIZE) {
+            uint32_t sec_cnt = span / SECTOR_SIZE;
+            uint32_t block_secs_left = BLOCK_SECS - file->fd_inode->i_size % BLOCK_SIZE / SECTOR_SIZE;
+            if(sec_cnt > block_secs_left) {
+                sec_cnt = block_secs_left;
             }
-
-            ASSERT(file->fd_inode->i_sectors[12] == 0);   //确保一级间接块表未分配
-            //分配一级间接块索引表
-            indirect_block_table = file->fd_inode->i_sectors[12] = block_lba;
-
-            block_idx = file_has_used_blocks;   //第一个未使用的块，及本文件最后一个已经使用的直接块的下一块
-
-            while(block_idx < file_will_use_blocks) {
-                block_lba = block_bitmap_alloc(cur_part);
-                if(block_lba == -1) {
-                    printk("file_write: block_bitmap_alloc for situation 2 failed\n");
-                    return -1;
-                }
-                if(block_idx < 12) {
-                    ASSERT(file->fd_inode->i_sectors[block_idx] == 0);   //确保未分配扇区地址
-                    file->fd_inode->i_sectors[block_idx] = all_blocks[block_idx] = block_lba;
-                } else {   //间接块只写到all_block数组中，待全部分配完成后一次性同步到硬盘
-                    all_blocks[block_idx] = block_lba;
-                }
-
-                //每分配一个块就将位图同步到硬盘
-                block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
-                bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
-                block_idx++;
-            }
-            ide_write(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);   //同步一级间接块表到硬盘
-        } else if(file_has_used_blocks > 12) {
-            //第3种情况：新数据占据间接块
-            ASSERT(file->fd_inode->i_sectors[12] != 0);   //已经具备一级间接块biao
-            indirect_block_table = file->fd_inode->i_sectors[12];   //获取一级间接块表
-
-            //已使用的间接块也将被读入all_blocks，无需单独收录
-            ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
-
-            block_idx = file_has_used_blocks;   //第一个未使用的间接块，即已经使用的间接块的下一块
-            while(block_idx < file_will_use_blocks) {
-                block_lba = block_bitmap_alloc(cur_part);
-                if(block_lba == -1) {
-                    printk("file_write: block_bitmap_alloc for situation 3 failed\n");
-                    return -1;
-                }
-                all_blocks[block_idx++] = block_lba;
-
-                //没分配一个块就将位图同步到硬盘
-                block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
-                bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
-            }
-            ide_write(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);   //同步一级间接块表到硬盘
+            chunk_size = sec_cnt * SECTOR_SIZE;
+            bcache_write(cur_part->my_disk, sec_lba, src, sec_cnt);
+            pcache_update(cur_part, file->fd_inode->i_no, file->fd_inode->i_size, src, chunk_size);
+            it.off += chunk_size;
+            file->fd_inode->i_size += chunk_size;
+            file->fd_pos += chunk_size;
+            bytes_written += chunk_size;
+            size_left -= chunk_size;
+            continue;
         }
-    }
 
-    //用到的块地址已经收集到all_blocks中，下面开始写数据
-    bool first_write_block = true;   //含有剩余空间的块标识
-    file->fd_pos = file->fd_inode->i_size - 1;   //值fd_pos为文件大小-1，下面在写数据时随时更新
-    while(bytes_written < count) {
-        //printk("!!!!!!!!!!!!!!!!!!!!!!!!\n");
-        memset(io_buf, 0, BLOCK_SIZE);
-        sec_idx = file->fd_inode->i_size / BLOCK_SIZE;   //最后数据所在扇区索引
-        sec_lba = all_blocks[sec_idx];   //最后数据所在扇区的lba
-        //printk("data_start_lba = 0x%x\n", cur_part->sb->data_start_lba);
-        //while(1);
-        //printk("sec_idx = %d\n", sec_idx);
-        sec_off_bytes = file->fd_inode->i_size % BLOCK_SIZE;   //最后数据在扇区中的偏移字节
-        sec_left_bytes = BLOCK_SIZE - sec_off_bytes;   //扇区内剩余字节量
-
-        //判断此次写入硬盘的数据大小
+        //不足一扇区的部分经io_buf拼成整扇区，可以来自几个缓冲区，扇区中已有数据时先读出来，从扇区开头写时不必读
         chunk_size = size_left < sec_left_bytes ? size_left : sec_left_bytes;
-        if(first_write_block) {
-            ide_read(cur_part->my_disk, sec_lba, io_buf, 1);
-            first_write_block = false;
+        if(sec_off_bytes != 0) {
+            bcache_read(cur_part->my_disk, sec_lba, io_buf, 1);
+        } else {
+            memset(io_buf, 0, SECTOR_SIZE);
         }
-        memcpy(io_buf + sec_off_bytes, src, chunk_size);
-        ide_write(cur_part->my_disk, sec_lba, io_buf, 1);
-        printk("file_write at lba 0x%x\n", sec_lba);   //调试用
+        iov_iter_copy(&it, io_buf + sec_off_bytes, chunk_size, false);
+        bcache_write(cur_part->my_disk, sec_lba, io_buf, 1);
+        pcache_update(cur_part, file->fd_inode->i_no, file->fd_inode->i_size, io_buf + sec_off_bytes, chunk_size);
 
-        src += chunk_size;   //将指针推移到下一个新数据
         file->fd_inode->i_size += chunk_size;   //更新文件大小
         file->fd_pos += chunk_size;
         bytes_written += chunk_size;
         size_left -= chunk_size;
     }
+    journal_begin();
     inode_sync(cur_part, file->fd_inode, io_buf);
-    sys_free(all_blocks);
-    sys_free(io_buf);
-    return bytes_written;
+    journal_end();
+    kmem_cache_free(io_buf_cache, io_buf);
+    return bytes_written == 0 ? -1 : (int32_t)bytes_written;
 }
 
-/*从文件file中读取count个字节写入buf，返回读出的字节数，若到文件尾则返回-1*/
-int32_t file_read(struct file* file, void* buf, uint32_t count)
+/*把buf中的count个字节写入file，成功则返回写入的字节数，失败则返回-1。
+  写入期间持inode的写锁，不同文件的写入互不等待*/
+int32_t file_write(struct file* file, const void* buf, uint32_t count)
+{
+    struct iovec iov = {(void*)buf, count};
+    return file_writev(file, &iov, 1);
+}
+
+/*把iov中iovcnt个缓冲区的数据依次写入file，成功则返回写入的总字节数，失败则返回-1。
+  整个向量在一次持inode写锁期间写完，中间不会插入别的写入*/
+int32_t file_writev(struct file* file, const struct iovec* iov, uint32_t iovcnt)
+{
+    uint32_t count;
+    if(!iov_total(iov, iovcnt, &count)) {
+        printk("exceed max file_size 0x%x bytes, write file failed\n", INODE_MAX_SIZE);
+        return -1;
+    }
+    struct inode* inode = file->fd_inode;
+    down_write(&inode->i_rwsem);
+    exec_cache_invalidate(cur_part, inode->i_no);   //写过的程序下次执行要重新解析和加载
+    int32_t ret = file_writev_locked(file, iov, iovcnt, count);
+    up_write(&inode->i_rwsem);
+    return ret;
+}
+
+/*把inode从第start到第end块按lba相连的段交给块缓存异步读入*/
+static void file_readahead(struct inode* inode, uint32_t start, uint32_t end)
 {
-    // printk("count=%d\n", count);
-    // printk("buf=%x\n", buf);
-    uint8_t* buf_dst = (uint8_t*)buf;
+    uint32_t run_lba = 0, run_cnt = 0;   //正在累积的相连段
+    uint32_t block_idx;
+    for(block_idx = start; block_idx <= end; block_idx++) {
+        //已在页缓存中的块不必再读
+        uint32_t block_lba = pcache_cached(cur_part, inode->i_no, block_idx * BLOCK_SIZE / PG_SIZE) ? \
+                             0 : inode_bmap(cur_part, inode, block_idx, false);
+        if(run_cnt > 0 && block_lba == run_lba + run_cnt * BLOCK_SECS) {
+            run_cnt++;
+            continue;
+        }
+        if(run_cnt > 0) {
+            bcache_readahead(cur_part->my_disk, run_lba, run_cnt * BLOCK_SECS);
+        }
+        run_lba = block_lba;
+        run_cnt = block_lba != 0 ? 1 : 0;   //还没分配的块不读
+    }
+    if(run_cnt > 0) {
+        bcache_readahead(cur_part->my_disk, run_lba, run_cnt * BLOCK_SECS);
+    }
+}
+
+/*取得inode第pgoff页的页缓存，没缓存时分配一页经块缓存填充后放入，内存紧张拿不到页时返回NULL*/
+static struct pcache_page* file_page_get(struct inode* inode, uint32_t pgoff)
+{
+    struct pcache_page* page = pcache_lookup(cur_part, inode->i_no, pgoff);
+    if(page != NULL) {
+        return page;
+    }
+    uint32_t gen;
+    page = pcache_alloc(&gen);
+    if(page == NULL) {
+        return NULL;
+    }
+
+    //只读到文件末尾所在的扇区，之后的部分和没分配的块都是0
+    uint32_t pos = pgoff * PG_SIZE, end = pos + PG_SIZE;
+    if(end > inode->i_size) {
+        end = DIV_ROUND_UP(inode->i_size, SECTOR_SIZE) * SECTOR_SIZE;
+    }
+    uint8_t* dst = page->data;
+    while(pos < end) {
+        uint32_t block_lba = inode_bmap(cur_part, inode, pos / BLOCK_SIZE, false);
+        uint32_t chunk_size = BLOCK_SIZE - pos % BLOCK_SIZE;
+        if(chunk_size > end - pos) {
+            chunk_size = end - pos;
+        }
+        if(block_lba != 0) {
+            bcache_read(cur_part->my_disk, block_lba + pos % BLOCK_SIZE / SECTOR_SIZE, dst, chunk_size / SECTOR_SIZE);
+        } else {
+            memset(dst, 0, chunk_size);
+        }
+        dst += chunk_size;
+        pos += chunk_size;
+    }
+    memset(dst, 0, page->data + PG_SIZE - dst);
+    return pcache_insert(page, cur_part, inode->i_no, pgoff, gen);
+}
+
+/*从文件file中读取共count个字节依次填入iov中iovcnt个缓冲区，返回读出的字节数，若到文件尾则返回-1，需持inode的读锁。
+  预读窗口按整个向量计算，跨越缓冲区边界的扇区只读一次*/
+static int32_t file_readv_locked(struct file* file, const struct iovec* iov, uint32_t iovcnt, uint32_t count)
+{
+    struct iov_iter it = {iov, iovcnt, 0};   //读出的数据放到这里
     uint32_t size = count, size_left = size;
 
     //若读取的字节数超过了文件刻度的剩余量，就用剩余量作为待读取的字节数
@@ -428,81 +822,141 @@ int32_t file_read(struct file* file, void* buf, uint32_t count)
             return -1;
         }
     }
+    if(size == 0) {
+        return 0;
+    }
 
-    uint8_t* io_buf = sys_malloc(BLOCK_SIZE);
+    uint8_t* io_buf = kmem_cache_alloc(io_buf_cache);
     if(io_buf == NULL) {
-        printk("file_read: sys_malloc for io_buf failed\n");
+        printk("file_read: kmem_cache_alloc for io_buf failed\n");
     }
-    // printk("io_buf_start:%x\n", io_buf);
-    uint32_t* all_blocks = (uint32_t*)sys_malloc(BLOCK_SIZE + 48);   //用来记录文件所有的块地址
-    if(all_blocks == NULL) {
-        printk("file_read: sys_malloc for all_blocks failed\n");
-        return -1;
-    }
-    // printk("all_blocks_start:%x", all_blocks);
 
-    uint32_t block_read_start_idx = file->fd_pos / BLOCK_SIZE;   //数据所在块的起始地址
-    uint32_t block_read_end_idx = (file->fd_pos + size) / BLOCK_SIZE;   //数据所在块的终止地址
-    uint32_t read_blocks = block_read_end_idx - block_read_start_idx;   //如增量为0，表示数据在同一扇区
-    ASSERT(block_read_start_idx < 139 && block_read_end_idx < 139);
-
-    int32_t indirect_block_table;   //用来获取一级间接表地址
-    uint32_t block_idx;   //获取待读的块地址
-
-    //一下开始构建all_blockds块地址数组，专门存储用到的块地址（本程序中块大小同扇区大小）
-    if(read_blocks == 0) {   //在统一扇区内读数据，不涉及跨扇区读
-        ASSERT(block_read_end_idx == block_read_start_idx);
-        if(block_read_end_idx < 12) {
-            block_idx = block_read_end_idx;
-            all_blocks[block_idx] = file->fd_inode->i_sectors[block_idx];
-        } else {
-            indirect_block_table = file->fd_inode->i_sectors[12];
-            ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
+    //从上次读完的地方接着读就是顺序读，窗口逐次翻倍，否则停止预读
+    if(file->fd_pos == file->ra_pos) {
+        file->ra_window = file->ra_window == 0 ? FILE_RA_MIN : file->ra_window * 2;
+        if(file->ra_window > FILE_RA_MAX) {
+            file->ra_window = FILE_RA_MAX;
         }
-    } else {   //要读入多个扇区的情况
-        if(block_read_end_idx < 12) {   //数据结束所在的块属于直接块
-            block_idx = block_read_start_idx;
-            while(block_idx < block_read_end_idx) {
-                all_blocks[block_idx] = file->fd_inode->i_sectors[block_idx];
-                block_idx++;
-            }
-        } else if(block_read_start_idx > 12 && block_read_end_idx >= 12) {
-            block_idx = block_read_start_idx;
-            while(block_idx < 12) {
-                all_blocks[block_idx] = file->fd_inode->i_sectors[block_idx];
-                block_idx++;
-            }
-            ASSERT(file->fd_inode->i_sectors[12] != 0);
+    } else {
+        file->ra_window = 0;
+    }
 
-            indirect_block_table = file->fd_inode->i_sectors[12];
-            ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
-        } else {
-            ASSERT(file->fd_inode->i_sectors[12] != 0);
-            indirect_block_table = file->fd_inode->i_sectors[12];
-            ide_read(cur_part->my_disk, indirect_block_table, all_blocks + 12, 1);
-        }
+    uint32_t block_read_start_idx = file->fd_pos / BLOCK_SIZE;   //数据所在块的起始地址
+    uint32_t block_read_end_idx = (file->fd_pos + size - 1) / BLOCK_SIZE;   //数据最后一个字节所在块的地址
+    uint32_t file_end_idx = (file->fd_inode->i_size - 1) / BLOCK_SIZE;   //文件最后一块的地址
+    uint32_t block_ra_end_idx = block_read_end_idx + file->ra_window;   //预读到的最后一块
+    if(block_ra_end_idx > file_end_idx) {
+        block_ra_end_idx = file_end_idx;
     }
+    uint32_t ra_next_idx = block_read_start_idx;   //下一个还没提交预读的块
 
-    //用到的块地址已经收集到all_blocks中，下面开始读数据
-    uint32_t sec_idx, sec_lba, sec_off_bytes, sec_left_bytes, chunk_size;
+    //下面开始读数据，块地址由inode_bmap经块缓存中的间接块查找
+    uint32_t block_idx, block_lba, sec_off_bytes, sec_left_bytes, chunk_size;
     uint32_t bytes_read = 0;
     while(bytes_read < size) {
-        sec_idx = file->fd_pos / BLOCK_SIZE;   //数据所在扇区索引
-        sec_lba = all_blocks[sec_idx];   //数据所在的扇区地址
-        sec_off_bytes = file->fd_pos % BLOCK_SIZE;   //数据在所在扇区中的字节偏移量
-        sec_left_bytes = BLOCK_SIZE - sec_off_bytes;   //数据开始处到扇区结束的字节大小
+        cond_resched();   //同写入，每读一段是一个抢占点
+        block_idx = file->fd_pos / BLOCK_SIZE;   //数据所在块索引
+        //本次要读的块和其后的预读窗口按lba相连的段提交，读这些块时只需等待。
+        //大块读按FILE_RA_CHUNK分批，读到上一批的一半时提交下一批，免得预读的块还没用就被换出
+        if(ra_next_idx <= block_ra_end_idx && block_idx + FILE_RA_CHUNK / 2 >= ra_next_idx) {
+            uint32_t ra_chunk_end = ra_next_idx + FILE_RA_CHUNK - 1;
+            if(ra_chunk_end > block_ra_end_idx) {
+                ra_chunk_end = block_ra_end_idx;
+            }
+            file_readahead(file->fd_inode, ra_next_idx, ra_chunk_end);
+            ra_next_idx = ra_chunk_end + 1;
+        }
+
+        //先经页缓存读，常用的文件页留在内存里，再读时不必找块缓存。拿不到页时退回下面按扇区经块缓存读
+        struct pcache_page* page = file_page_get(file->fd_inode, file->fd_pos / PG_SIZE);
+        if(page != NULL) {
+            uint32_t pg_off = file->fd_pos % PG_SIZE;
+            chunk_size = PG_SIZE - pg_off < size_left ? PG_SIZE - pg_off : size_left;
+            iov_iter_copy(&it, page->data + pg_off, chunk_size, true);
+            pcache_put(page);
+            file->fd_pos += chunk_size;
+            bytes_read += chunk_size;
+            size_left -= chunk_size;
+            continue;
+        }
+
+        block_lba = inode_bmap(cur_part, file->fd_inode, block_idx, false);   //数据所在块的起始扇区地址
+        sec_off_bytes = file->fd_pos % SECTOR_SIZE;   //数据在所在扇区中的字节偏移量
+        sec_left_bytes = SECTOR_SIZE - sec_off_bytes;   //数据开始处到扇区结束的字节大小
         chunk_size = size_left < sec_left_bytes ? size_left : sec_left_bytes;   //待读入的数据大小
 
-        memset(io_buf, 0, BLOCK_SIZE);   //不清空也可以
-        ide_read(cur_part->my_disk, sec_lba, io_buf, 1);
-        memcpy(buf_dst, io_buf + sec_off_bytes, chunk_size);
+        //从扇区开头起当前缓冲区放得下整扇区时，块内的这些扇区直接从块缓存复制到调用者的缓冲区，不经io_buf中转
+        uint8_t* buf_dst;
+        uint32_t span = iov_iter_span(&it, &buf_dst);
+        if(span > size_left) {
+            span = size_left;
+        }
+        if(sec_off_bytes == 0 && span >= SECTOR_SIZE) {
+            uint32_t sec_cnt = span / SECTOR_SIZE;
+            uint32_t block_secs_left = BLOCK_SECS - file->fd_pos % BLOCK_SIZE / SECTOR_SIZE;
+            if(sec_cnt > block_secs_left) {
+                sec_cnt = block_secs_left;
+            }
+            chunk_size = sec_cnt * SECTOR_SIZE;
+            if(block_lba != 0) {
+                bcache_read(cur_part->my_disk, block_lba + file->fd_pos % BLOCK_SIZE / SECTOR_SIZE, buf_dst, sec_cnt);
+            } else {
+                memset(buf_dst, 0, chunk_size);
+            }
+            it.off += chunk_size;
+        } else {
+            if(block_lba != 0) {
+                bcache_read(cur_part->my_disk, block_lba + file->fd_pos % BLOCK_SIZE / SECTOR_SIZE, io_buf, 1);
+            } else {   //没分配的块读出0
+                memset(io_buf, 0, SECTOR_SIZE);
+            }
+            iov_iter_copy(&it, io_buf + sec_off_bytes, chunk_size, true);
+        }
 
-        buf_dst += chunk_size;
         file->fd_pos += chunk_size;
         bytes_read += chunk_size;
         size_left -= chunk_size;
     }
-    sys_free(all_blocks);
-    sys_free(io_buf);
+    file->ra_pos = file->fd_pos;
+    kmem_cache_free(io_buf_cache, io_buf);
     return bytes_read;
 }
+
+/*从文件file中读取count个字节写入buf，返回读出的字节数，若到文件尾则返回-1。
+  读取期间持inode的读锁，同一文件的多个读者可以同时等硬盘，写者要等读者都读完*/
+int32_t file_read(struct file* file, void* buf, uint32_t count)
+{
+    struct iovec iov = {buf, count};
+    return file_readv(file, &iov, 1);
+}
+
+/*从文件file中依次读入iov中iovcnt个缓冲区，返回读出的总字节数，若到文件尾则返回-1。
+  整个向量在一次持inode读锁期间读完*/
+int32_t file_readv(struct file* file, const struct iovec* iov, uint32_t iovcnt)
+{
+    uint32_t count;
+    if(!iov_total(iov, iovcnt, &count)) {
+        printk("file_readv: total length too large\n");
+        return -1;
+    }
+    struct inode* inode = file->fd_inode;
+    down_read(&inode->i_rwsem);
+    int32_t ret = file_readv_locked(file, iov, iovcnt, count);
+    up_read(&inode->i_rwsem);
+    return ret;
+}
+
+/*把文件file从pos起len字节所在的块交给块缓存异步读入，不等硬盘，之后再读这些块时只需等待。
+  超出文件末尾的部分不读，用于一次提交多个读请求时先把要读的块都排进硬盘队列*/
+void file_prefetch(struct file* file, uint32_t pos, uint32_t len)
+{
+    struct inode* inode = file->fd_inode;
+    down_read(&inode->i_rwsem);
+    if(len > 0 && pos < inode->i_size) {
+        if(len > inode->i_size - pos) {
+            len = inode->i_size - pos;
+        }
+        file_readahead(inode, pos / BLOCK_SIZE, (pos + len - 1) / BLOCK_SIZE);
+    }
+    up_read(&inode->i_rwsem);
+}
@@ -4,15 +4,36 @@
 #include "ide.h"
 #include "dir.h"
 #include "global.h"
+#include "list.h"
 
-#define MAX_FILE_OPEN 32   //系统可打开的最大文件数
+#define FILE_RA_MIN DIV_ROUND_UP(2048, BLOCK_SIZE)   //发现顺序读后的首个预读窗口块数，约2KB
+#define FILE_RA_MAX (32768 / BLOCK_SIZE)   //预读窗口的最大块数，32KB
+#define FILE_RA_CHUNK (65536 / BLOCK_SIZE)   //大块读时每批提交预读的块数，64KB
+#define FILE_PREALLOC_BLOCKS (32768 / BLOCK_SIZE)   //写文件时每次预留的相连块数，32KB
+
+struct iovec;
+struct file;
+
+/*按打开对象的类型分派的文件操作，读写的返回值与sys_read、sys_write相同，release在最后一个引用释放时调用*/
+struct file_operations
+{
+    int32_t (*read)(struct file* file, void* buf, uint32_t count);
+    int32_t (*write)(struct file* file, const void* buf, uint32_t count);
+    int32_t (*release)(struct file* file);
+};
 
 /*文件结构*/
 struct file
 {
     uint32_t fd_pos;   //记录当前文件操作的偏移地址，以0为起始，最大为文件大小-1
     uint32_t fd_flag;   //文件操作标识，如O_RDONLY
-    struct inode* fd_inode;   //指向inode队列part->open_inodes中的inode
+    struct inode* fd_inode;   //指向分区内存inode缓存中的inode，控制台和管道为NULL
+    const struct file_operations* fd_ops;   //按文件类型分派的读写和关闭操作
+    void* fd_private;   //类型相关的数据，管道指向struct pipe
+    uint32_t ra_pos;   //上次读结束处的偏移，本次从这里开始读说明是顺序读
+    uint32_t ra_window;   //预读窗口的块数，顺序读时逐次翻倍，跳读时归0
+    uint32_t fd_refs;   //指向此文件结构的文件描述符数，fork后父子进程共用，最后一个关闭时才释放
+    struct list_elem file_tag;   //在已打开文件链表file_list中的标记
 };
 
 /*标准文件描述符*/
@@ -30,19 +51,59 @@ enum bitmap_type
     BLOCK_BITMAP    //块位图
 };
 
-/*文件表*/
-extern struct file file_table[MAX_FILE_OPEN];
+struct task_struct;
+
+/*已打开的文件*/
+extern struct list file_list;
+extern struct spinlock file_list_lock;   //修改file_list和fd_refs时持有
+extern struct kmem_cache* file_cache;   //文件结构的对象缓存
+extern struct kmem_cache* io_buf_cache;   //文件读写缓冲区的对象缓存
+extern const struct file_operations regular_fops;   //普通文件的操作
 
-/*从文件表file_table中获取一个空闲位，成功返回下标，失败返回-1*/
-int32_t get_free_slot_in_global(void);
-/*将全局描述符下标安装到进程或线程自己的文件描述符数组fd_table中，成功返回下标，失败返回-1*/
-int32_t pcb_fd_install(int32_t global_fd_idx);
+/*分配一个清零的文件结构，引用数为1，加入file_list，失败返回NULL*/
+struct file* file_alloc(void);
+/*把文件结构从file_list中摘下并归还，不关闭文件*/
+void file_free(struct file* file);
+/*判断file是否是控制台标准输入输出的文件结构，这些结构不计引用*/
+bool file_is_std(struct file* file);
+/*为新增的一个文件描述符增加对file的引用*/
+void file_get(struct file* file);
+/*释放对file的一次引用，最后一个引用释放时关闭文件或管道并归还文件结构，成功返回0，失败返回-1*/
+int32_t file_put(struct file* file);
+/*将文件结构安装到当前进程或线程的文件描述符数组fd_table中最小的空闲位置，成功返回描述符，失败返回-1*/
+int32_t pcb_fd_install(struct file* file);
+/*清空当前进程或线程的文件描述符local_fd*/
+void pcb_fd_uninstall(int32_t local_fd);
+/*把当前进程重定向过的标准描述符local_fd改回控制台*/
+void pcb_fd_reset_std(int32_t local_fd);
+/*使当前进程的描述符local_fd指向file，原先打开的文件释放一次引用。local_fd须小于描述符表的槽数，成功返回0，失败返回-1*/
+int32_t pcb_fd_replace(int32_t local_fd, struct file* file);
+/*初始化pthread的文件描述符数组，预留标准输入输出*/
+void fd_table_init(struct task_struct* pthread);
+/*fork复制pcb后为子进程child复制一份文件描述符数组，共用的文件结构各加一次引用，成功返回0，失败返回-1*/
+int32_t fd_table_fork(struct task_struct* child, struct task_struct* parent);
+/*spawn新建的子进程child继承父进程的文件描述符，成功返回0，失败返回-1*/
+int32_t fd_table_inherit(struct task_struct* child, struct task_struct* parent);
+/*释放pthread从内核分配的文件描述符数组，进程退出时在关闭全部文件后调用*/
+void fd_table_release(struct task_struct* pthread);
 /*分配一个i节点，返回i节点号*/
 int32_t inode_bitmap_alloc(struct partition* part);
-/*分配一个扇区，返回其扇区地址*/
+/*回收i节点inode_no并同步inode位图*/
+void inode_bitmap_free(struct partition* part, uint32_t inode_no);
+/*分配一个块，返回其起始扇区地址*/
 int32_t block_bitmap_alloc(struct partition* part);
-/*将内存中bitmap第bit_idx位所在的512字节同步到硬盘*/
+/*回收起始扇区为block_lba的块并同步块位图*/
+void block_bitmap_free(struct partition* part, uint32_t block_lba);
+/*从块goal_lba起分配至多cnt个相连的块，分到的块数存入alloc_cnt，返回第一块的起始扇区地址，失败返回-1*/
+int32_t block_bitmap_alloc_run(struct partition* part, uint32_t goal_lba, uint32_t cnt, uint32_t* alloc_cnt);
+/*返回起始扇区为block_lba的块在块位图中的下标*/
+uint32_t block_bitmap_index(struct partition* part, uint32_t block_lba);
+/*把起始扇区为block_lba的整块清零*/
+void block_zero(struct partition* part, uint32_t block_lba);
+/*将内存中bitmap第bit_idx位所在的512字节记为脏，稍后由bitmap_flush写入块缓存*/
 void bitmap_sync(struct partition* part, uint32_t bit_idx, uint8_t btmp_type);
+/*把分区part两个位图中记为脏的扇区写入块缓存*/
+void bitmap_flush(struct partition* part);
 /*创建文件，若成功则返回文件描述符，否则返回-1*/
 int32_t file_create(struct dir* parent_dir, char* filename, uint8_t flag);
 /*打开编号为inode_no的inode对应的文件，成功返回文件描述符，否则返回-1*/
@@ -53,5 +114,11 @@ int32_t file_close(struct file* file);
 int32_t file_write(struct file* file, const void* buf, uint32_t count);
 /*从文件file中读取count个字节写入buf，返回读出的字节数，若到文件尾则返回-1*/
 int32_t file_read(struct file* file, void* buf, uint32_t count);
+/*把iov中iovcnt个缓冲区的数据依次写入file，成功则返回写入的总字节数，失败则返回-1*/
+int32_t file_writev(struct file* file, const struct iovec* iov, uint32_t iovcnt);
+/*从文件file中依次读入iov中iovcnt个缓冲区，返回读出的总字节数，若到文件尾则返回-1*/
+int32_t file_readv(struct file* file, const struct iovec* iov, uint32_t iovcnt);
+/*把文件file从pos起len字节所在的块交给块缓存异步读入，不等读完就返回*/
+void file_prefetch(struct file* file, uint32_t pos, uint32_t len);
 
 #endif
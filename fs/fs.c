@@ -7,14 +7,22 @@
 #include "list.h"
 #include "string.h"
 #include "ide.h"
+#include "bcache.h"
+#include "dcache.h"
+#include "pcache.h"
+#include "journal.h"
 #include "global.h"
 #include "debug.h"
 #include "memory.h"
 #include "file.h"
 #include "console.h"
-#include "keyboard.h"
-#include "ioqueue.h"
+#include "tty.h"
 #include "pipe.h"
+#include "stdio.h"
+#include "init.h"
+#include "swap.h"
+#include "klog.h"
+#include "stripe.h"
 
 struct partition* cur_part;   //默认情况下操作的是哪个分区
 
@@ -38,16 +46,24 @@ static bool mount_partition(struct list_elem* pelem, int arg)
 
         //读入超级块
         memset(sb_buf, 0, SECTOR_SIZE);
-        ide_read(hd, cur_part->start_lba + 1, sb_buf, 1);
+        bcache_read(hd, cur_part->start_lba + 1, sb_buf, 1);
         memcpy(cur_part->sb, sb_buf, sizeof(struct super_block));
 
+        //先重放日志，下面读入的位图才是最新的
+        journal_init(cur_part);
+
         //将硬盘上的块位图读入内存
         cur_part->block_bitmap.bits = (uint8_t*)sys_malloc(sb_buf->block_bitmap_sects * SECTOR_SIZE);
         if(cur_part->block_bitmap.bits == NULL) {
             PANIC("alloc memory failed!");
         }
         cur_part->block_bitmap.btmp_bytes_len = sb_buf->block_bitmap_sects * SECTOR_SIZE;
-        ide_read(hd, sb_buf->block_bitmap_lba, cur_part->block_bitmap.bits, sb_buf->block_bitmap_sects);
+        bcache_read(hd, sb_buf->block_bitmap_lba, cur_part->block_bitmap.bits, sb_buf->block_bitmap_sects);
+        cur_part->block_bitmap.summary = (uint32_t*)sys_malloc(BITMAP_SUMMARY_BYTES(cur_part->block_bitmap.btmp_bytes_len));
+        if(cur_part->block_bitmap.summary == NULL) {
+            PANIC("alloc memory failed!");
+        }
+        bitmap_summary_init(&cur_part->block_bitmap, cur_part->block_bitmap.summary);
 
         //将硬盘上的inode位图读入内存
         cur_part->inode_bitmap.bits = (uint8_t*)sys_malloc(sb_buf->inode_bitmap_sects * SECTOR_SIZE);
@@ -55,9 +71,29 @@ static bool mount_partition(struct list_elem* pelem, int arg)
             PANIC("alloc memory failed!");
         }
         cur_part->inode_bitmap.btmp_bytes_len = sb_buf->inode_bitmap_sects * SECTOR_SIZE;
-        ide_read(hd, sb_buf->inode_bitmap_lba, cur_part->inode_bitmap.bits, sb_buf->inode_bitmap_sects);
+        bcache_read(hd, sb_buf->inode_bitmap_lba, cur_part->inode_bitmap.bits, sb_buf->inode_bitmap_sects);
+        cur_part->inode_bitmap.summary = (uint32_t*)sys_malloc(BITMAP_SUMMARY_BYTES(cur_part->inode_bitmap.btmp_bytes_len));
+        if(cur_part->inode_bitmap.summary == NULL) {
+            PANIC("alloc memory failed!");
+        }
+        bitmap_summary_init(&cur_part->inode_bitmap, cur_part->inode_bitmap.summary);
+
+        //空闲计数按位图重算，日志重放后位图是准的，超级块中记的计数可能没赶上最后一次修改
+        cur_part->sb->free_blocks = bitmap_count_zero(&cur_part->block_bitmap);
+        cur_part->sb->free_inodes = bitmap_count_zero(&cur_part->inode_bitmap);
+
+        inode_cache_init(cur_part);
 
-        list_init(&cur_part->open_inodes);
+        //位图的脏扇区记录，最后分配，回写线程据此判断分区是否挂载完
+        uint32_t bitmap_sects = sb_buf->block_bitmap_sects + sb_buf->inode_bitmap_sects;
+        uint8_t* dirty_bits = (uint8_t*)sys_malloc(DIV_ROUND_UP(bitmap_sects, 8));
+        if(dirty_bits == NULL) {
+            PANIC("alloc memory failed!");
+        }
+        cur_part->bitmap_dirty.btmp_bytes_len = DIV_ROUND_UP(bitmap_sects, 8);
+        cur_part->bitmap_dirty.summary = NULL;
+        cur_part->bitmap_dirty.bits = dirty_bits;
+        bitmap_init(&cur_part->bitmap_dirty);
         printk("mount %s done!\n", part->name);
 
         return true;   //使list_traversal停止遍历
@@ -65,31 +101,37 @@ static bool mount_partition(struct list_elem* pelem, int arg)
     return false;   //使list_traversal继续遍历
 }
 
-/*格式化分区，也就是初始化分区的元信息，创建文件系统*/
-static void partition_format(struct partition* part)
+/*格式化分区，也就是初始化分区的元信息，创建文件系统，inode_cnt为建立的inode数。
+  i节点表只清零第一组，其余的在分配到其中的inode时才清零，格式化不必写整个i节点表*/
+static void partition_format(struct partition* part, uint32_t inode_cnt)
 {
-    //block_bitmap_init 为方便实现，一个块大小是以扇区
+    //block_bitmap_init 块大小为BLOCK_SIZE，块位图中每位代表BLOCK_SECS个扇区
     uint32_t boot_sector_sects = 1;   //ebr扇区
     uint32_t super_block_sects = 1;   //超级块扇区
-    uint32_t inode_bitmap_sects = DIV_ROUND_UP(MAX_FILES_PER_PART, BITS_PER_SECTOR);   //i节点位图占用的扇区数，最多支持4096个文件
-    uint32_t inode_table_sects = DIV_ROUND_UP(((sizeof(struct inode) * MAX_FILES_PER_PART)), SECTOR_SIZE);   //inode表扇区数
-    uint32_t used_sects = boot_sector_sects + super_block_sects + inode_bitmap_sects + inode_table_sects;   //已使用扇区数
+    uint32_t journal_sects = JOURNAL_SECTS;   //元数据日志区扇区数
+    uint32_t inode_bitmap_sects = DIV_ROUND_UP(inode_cnt, BITS_PER_SECTOR);   //i节点位图占用的扇区数
+    uint32_t inode_table_sects = DIV_ROUND_UP(((INODE_DISK_SIZE * inode_cnt)), SECTOR_SIZE);   //inode表扇区数
+    uint32_t inode_inited_sects = inode_table_sects < INODE_TABLE_GROUP_SECTS ? inode_table_sects : INODE_TABLE_GROUP_SECTS;   //格式化时清零的扇区数
+    uint32_t used_sects = boot_sector_sects + super_block_sects + journal_sects + inode_bitmap_sects + inode_table_sects;   //已使用扇区数
     uint32_t free_sects = part->sec_cnt - used_sects;   //分区中空闲扇区数
 
     // 简单处理块位图占据的扇区数
     uint32_t block_bitmap_sects;
-    block_bitmap_sects = DIV_ROUND_UP(free_sects, BITS_PER_SECTOR);
-    uint32_t block_bitmap_bit_len = free_sects - block_bitmap_sects;   //位图中位的长度，也是可用块的数量
+    block_bitmap_sects = DIV_ROUND_UP(free_sects / BLOCK_SECS, BITS_PER_SECTOR);
+    uint32_t block_bitmap_bit_len = (free_sects - block_bitmap_sects) / BLOCK_SECS;   //位图中位的长度，也是可用块的数量
     block_bitmap_sects = DIV_ROUND_UP(block_bitmap_bit_len, BITS_PER_SECTOR);
 
     // 超级块初始化
     struct super_block sb;
-    sb.magic = 0x19590318;
+    sb.magic = FS_MAGIC;
     sb.sec_cnt = part->sec_cnt;
-    sb.inode_cnt = MAX_FILES_PER_PART;
+    sb.inode_cnt = inode_cnt;
     sb.part_lba_base = part->start_lba;
 
-    sb.block_bitmap_lba = sb.part_lba_base + 2;   //第0块是引导块，第1块是超级块
+    sb.journal_lba = sb.part_lba_base + 2;   //第0块是引导块，第1块是超级块
+    sb.journal_sects = journal_sects;
+
+    sb.block_bitmap_lba = sb.journal_lba + sb.journal_sects;
     sb.block_bitmap_sects = block_bitmap_sects;
 
     sb.inode_bitmap_lba = sb.block_bitmap_lba + sb.block_bitmap_sects;
@@ -101,26 +143,34 @@ static void partition_format(struct partition* part)
     sb.data_start_lba = sb.inode_table_lba + sb.inode_table_sects;
     sb.root_inode_no = 0;   //super_block inode-number
     sb.dir_entry_size = sizeof(struct dir_entry);
+    sb.block_size = BLOCK_SIZE;
+    sb.inode_table_uninit = inode_table_sects - inode_inited_sects;
+    sb.free_blocks = block_bitmap_bit_len - 2;   //根目录占去两块
+    sb.free_inodes = inode_cnt - 1;   //根目录占去一个inode
+    memset(sb.pad, 0, sizeof(sb.pad));
 
     printk("%s info:\n", part->name);
     //printk("   magic:0x%x\n   part_lba_base:0x%x\n   all_sectors:0x%x\n   inode_cnt:0x%x\n   block_bitmap_lba:%x\n   block_bitmap_sectors:0x%x\n   inode_bitmap_lba:0x%x\n   inode_bitmap_sectors:0x%x\n   inode_table_lba:0x%x\n   inode_table_sectors:0x%x\n   data_start_lba:0x%x\n", \
     //       sb.magic, sb.part_lba_base, sb.sec_cnt, sb.inode_cnt, sb.block_bitmap_lba, sb.block_bitmap_sects, sb.inode_bitmap_lba, \
     //       sb.inode_bitmap_sects, sb.inode_table_lba, sb.inode_table_sects, sb.data_start_lba);
-    printk("   magic:0x%x\n   part_lba_base:0x%x\n   all_sectors:0x%x\n   inode_cnt:0x%x\n   block_bitmap_lba:0x%x\n   block_bitmap_sectors:0x%x\n   inode_bitmap_lba:0x%x\n   inode_bitmap_sectors:0x%x\n   inode_table_lba:0x%x\n   inode_table_sectors:0x%x\n   data_start_lba:0x%x\n", sb.magic, sb.part_lba_base, sb.sec_cnt, sb.inode_cnt, sb.block_bitmap_lba, sb.block_bitmap_sects, sb.inode_bitmap_lba, sb.inode_bitmap_sects, sb.inode_table_lba, sb.inode_table_sects, sb.data_start_lba);
+    printk("   magic:0x%x\n   part_lba_base:0x%x\n   all_sectors:0x%x\n   inode_cnt:0x%x\n   journal_lba:0x%x\n   journal_sectors:0x%x\n   block_bitmap_lba:0x%x\n   block_bitmap_sectors:0x%x\n   inode_bitmap_lba:0x%x\n   inode_bitmap_sectors:0x%x\n   inode_table_lba:0x%x\n   inode_table_sectors:0x%x\n   data_start_lba:0x%x\n   block_size:%d\n", sb.magic, sb.part_lba_base, sb.sec_cnt, sb.inode_cnt, sb.journal_lba, sb.journal_sects, sb.block_bitmap_lba, sb.block_bitmap_sects, sb.inode_bitmap_lba, sb.inode_bitmap_sects, sb.inode_table_lba, sb.inode_table_sects, sb.data_start_lba, sb.block_size);
 
     struct disk* hd = part->my_disk;
     // 1. 将超级块写入本分区的1扇区
-    ide_write(hd, part->start_lba + 1, &sb, 1);   //跨过引导扇区
+    bcache_write(hd, part->start_lba + 1, &sb, 1);   //跨过引导扇区
     printk("   super_block_lba:0x%x\n", part->start_lba + 1);
 
     // 找出数据量最大的元信息，用其尺寸做存储缓冲区
     uint32_t buf_size = (sb.block_bitmap_sects >= sb.inode_bitmap_sects ? sb.block_bitmap_sects : sb.inode_bitmap_sects);
-    buf_size = (buf_size >= sb.inode_table_sects ? buf_size : sb.inode_table_sects) * SECTOR_SIZE;   //最终缓冲区大小
+    buf_size = (buf_size >= inode_inited_sects ? buf_size : inode_inited_sects) * SECTOR_SIZE;   //最终缓冲区大小
+    if(buf_size < BLOCK_SIZE) {   //根目录的整块也要用它写
+        buf_size = BLOCK_SIZE;
+    }
     uint8_t* buf = (uint8_t*)sys_malloc(buf_size);   //申请的内存由内存管理系统清0后返回
 
     // 2. 将块位图初始化并写入sb.block_bitmap_lba
     // 初始化块位图
-    buf[0] |= 0x01;   //第0个块预留给根目录，位图中先占位
+    buf[0] |= 0x03;   //第0个块预留给根目录，第1个块是根目录的索引块，位图中先占位
     uint32_t block_bitmap_last_byte = block_bitmap_bit_len / 8;
     uint8_t block_bitmap_last_bit = block_bitmap_bit_len % 8;
     uint32_t last_size = SECTOR_SIZE - (block_bitmap_last_byte % SECTOR_SIZE);   //位图所在最有一个扇区中，不足一扇区的其余部分
@@ -132,20 +182,26 @@ static void partition_format(struct partition* part)
     while(bit_idx <= block_bitmap_last_bit) {
         buf[block_bitmap_last_byte] &= ~(1 << bit_idx++);
     }
-    ide_write(hd, sb.block_bitmap_lba, buf, sb.block_bitmap_sects);   //写入硬盘
+    bcache_write(hd, sb.block_bitmap_lba, buf, sb.block_bitmap_sects);   //写入硬盘
 
     // 3. 将inode位图初始化并写入sb.inode_bitmap_lba
     memset(buf, 0, buf_size);   //清空缓冲区
     buf[0] |= 0x1;   //第0个inode分配给了根目录
-    ide_write(hd, sb.inode_bitmap_lba, buf, sb.inode_bitmap_sects);   //inode_bitmap占一个扇区没有无效位，直接写入硬盘
+    //超出inode_cnt的位置为已占用
+    uint32_t inode_bit;
+    for(inode_bit = inode_cnt; inode_bit < sb.inode_bitmap_sects * BITS_PER_SECTOR; inode_bit++) {
+        buf[inode_bit / 8] |= 1 << (inode_bit % 8);
+    }
+    bcache_write(hd, sb.inode_bitmap_lba, buf, sb.inode_bitmap_sects);
 
-    // 4. 将inode数组初始化并写入sb.inode_table_lba
+    // 4. 将inode数组的第一组初始化并写入sb.inode_table_lba，其余的分配时再清零
     memset(buf, 0, buf_size);
     struct inode* i = (struct inode*)buf;
     i->i_size = sb.dir_entry_size * 2;   //初始化根目录inode .和..
     i->i_no = 0;   //根目录占inode数组中第0个inode
     i->i_sectors[0] = sb.data_start_lba;   //由于上面的memset，i_sectors数组的其他元素都初始化为0
-    ide_write(hd, sb.inode_table_lba, buf, sb.inode_table_sects);
+    i->i_sectors[DIR_INDEX] = sb.data_start_lba + BLOCK_SECS;   //根目录也是哈希目录
+    bcache_write(hd, sb.inode_table_lba, buf, inode_inited_sects);
 
     // 5. 将根目录写入sb.data_start_lba
     memset(buf, 0, buf_size);
@@ -162,8 +218,20 @@ static void partition_format(struct partition* part)
     p_de->i_no = 0;
     p_de->f_type = FT_DIRECTORY;
 
-    //sb.data_start_lba已经分配给根目录，里面是根目录的目录项
-    ide_write(hd, sb.data_start_lba, buf, 1);
+    //sb.data_start_lba已经分配给根目录，里面是根目录的目录项，块内其余扇区一并清零
+    bcache_write(hd, sb.data_start_lba, buf, BLOCK_SECS);
+
+    // 6. 根目录的索引块清零，各桶都为空
+    memset(buf, 0, buf_size);
+    bcache_write(hd, sb.data_start_lba + BLOCK_SECS, buf, BLOCK_SECS);
+
+    // 7. 写日志超级块，日志区其余扇区不必清零，恢复时按魔数和序号识别
+    memset(buf, 0, buf_size);
+    struct journal_header* jsb = (struct journal_header*)buf;
+    jsb->magic = JOURNAL_MAGIC;
+    jsb->type = JOURNAL_SUPER;
+    jsb->seq = 1;
+    bcache_write(hd, sb.journal_lba, buf, 1);
 
     printk("   root_dir_lba:0x%x\n", sb.data_start_lba);
     printk("%s format done\n", part->name);
@@ -324,7 +392,17 @@ int32_t sys_open(const char* pathname, uint8_t flags)
     switch(flags & O_CREAT) {
         case O_CREAT:
             printk("creating file\n");
-            fd = file_create(searched_record.parent_dir, (strrchr(pathname, '/') + 1), flags);
+            //按锁的顺序先锁父目录再开始日志操作，加锁前别的任务可能已建了同名的文件，要再查一次
+            struct dir_entry dir_e;
+            down_write(&searched_record.parent_dir->inode->i_rwsem);
+            journal_begin();
+            if(search_dir_entry(cur_part, searched_record.parent_dir, strrchr(pathname, '/') + 1, &dir_e)) {
+                printk("%s has already exist\n", pathname);
+            } else {
+                fd = file_create(searched_record.parent_dir, (strrchr(pathname, '/') + 1), flags);
+            }
+            journal_end();
+            up_write(&searched_record.parent_dir->inode->i_rwsem);
             printk("sys_open: fd = %d\n", fd);
             dir_close(searched_record.parent_dir);
             break;
@@ -336,106 +414,283 @@ int32_t sys_open(const char* pathname, uint8_t flags)
     return fd;
 }
 
-/*将文件描述符转化为文件表的下标*/
-uint32_t fd_local2global(uint32_t local_fd)
+/*将当前任务的文件描述符转化为所指的文件结构，描述符无效时返回NULL*/
+struct file* fd_local2file(int32_t local_fd)
 {
-    struct task_struct* cur = running_thread();
-    int32_t global_fd = cur->fd_table[local_fd];
-    ASSERT(global_fd >=0 && global_fd < MAX_FILE_OPEN);
-    return (uint32_t)global_fd;
+    struct task_struct* cur = running_thread()->group_leader;   //进程的各线程共用主线程的描述符表
+    if(local_fd < 0 || (uint32_t)local_fd >= cur->fd_size) {
+        return NULL;
+    }
+    return cur->fd_table[local_fd];
 }
 
-/*关闭文件描述符fd指向的文件，成功返回0，失败则返回-1*/
+/*关闭文件描述符fd指向的文件，成功返回0，失败则返回-1。控制台的标准输入输出不能关闭，重定向过的标准描述符关闭后改回控制台*/
 int32_t sys_close(int32_t fd)
 {
-    int32_t ret = -1;   //返回值默认为-1，即失败
-    if(fd > 2) {
-        uint32_t global_fd = fd_local2global(fd);
-        if(is_pipe(fd)) {
-            if(--file_table[global_fd].fd_pos == 0) {
-                mfree_page(PF_KERNEL, file_table[global_fd].fd_inode, 1);
-                file_table[global_fd].fd_inode = NULL;
-            }
-            ret = 0;
-        } else {
-            ret = file_close(&file_table[global_fd]);
-        }
-        running_thread()->fd_table[fd] = -1;   //使该文件描述符可用
+    struct file* file = fd_local2file(fd);
+    if(file == NULL || (fd <= stderr_no && file_is_std(file))) {
+        return -1;
     }
-    return ret;
+    if(fd <= stderr_no) {
+        pcb_fd_reset_std(fd);
+    } else {
+        pcb_fd_uninstall(fd);   //使该文件描述符可用
+    }
+    return file_put(file);   //fork出的进程还在用时只减引用
+}
+
+/*复制文件描述符fd到最小的空闲描述符，两者指向同一个文件结构，成功返回新的描述符，失败返回-1*/
+int32_t sys_dup(int32_t fd)
+{
+    struct file* file = fd_local2file(fd);
+    if(file == NULL) {
+        return -1;
+    }
+    int32_t new_fd = pcb_fd_install(file);
+    if(new_fd != -1) {
+        file_get(file);
+    }
+    return new_fd;
+}
+
+/*使new_fd指向old_fd的文件结构，new_fd原先打开的文件先关闭。标准输入输出只能重定向为管道或改回控制台，
+  读写标准描述符的路径只认这两种。成功返回new_fd，失败返回-1*/
+int32_t sys_dup2(int32_t old_fd, int32_t new_fd)
+{
+    struct file* file = fd_local2file(old_fd);
+    if(file == NULL) {
+        return -1;
+    }
+    if(new_fd >= stdin_no && new_fd <= stderr_no && !file_is_std(file) && file->fd_ops != &pipe_fops) {
+        printk("sys_dup2: std fd can only be redirected to a pipe\n");
+        return -1;
+    }
+    if(old_fd == new_fd) {
+        return new_fd;
+    }
+    return pcb_fd_replace(new_fd, file) == -1 ? -1 : new_fd;
 }
 
 /*将buf中连续count个字节写入文件描述符fd，成功则返回写入的字节数，失败返回-1*/
 int sys_write(int32_t fd, const void* buf, uint32_t count)
 {
-    if(fd < 0) {
+    struct file* wr_file = fd_local2file(fd);   //标准输出有可能被重定向为管道
+    if(wr_file == NULL) {
         printk("sys_write: fd error\n");
         return -1;
     }
-    if(fd == stdout_no) {
-        if(is_pipe(fd)) {   //标准输出有可能被重定向为管道缓冲区
-            return pipe_write(fd, buf, count);
-        } else {
-            char tmp_buf[1024] = {0};
-            memcpy(tmp_buf, buf, count);
-            console_put_str(tmp_buf);
-            return count;
-        }
-    } else if(is_pipe(fd)) {
-        return pipe_write(fd, buf, count);
-    } else {
-        uint32_t _fd = fd_local2global(fd);
-        //printk("_fd = %d\n", _fd);
-        struct file* wr_file = &file_table[_fd];
-        if(wr_file->fd_flag & O_WRONLY || wr_file->fd_flag & O_RDWR) {
-            uint32_t bytes_written = file_write(wr_file, buf, count);
-            return bytes_written;
-        } else {
-            console_put_str("sys_write: not allowed to write file without flag O_RDWR or O_WRONLY");
-            return -1;
-        }
-    }
+    return wr_file->fd_ops->write(wr_file, buf, count);
 }
 
 /*从文件描述符fd指向的文件中读取count个字节到buf，若成功返回读出字节数，到文件尾则返回-1*/
 int32_t sys_read(int32_t fd, void* buf, uint32_t count)
 {
     ASSERT(buf != NULL);
-    int32_t ret = -1;
-    if(fd < 0 || fd == stdout_no || fd == stderr_no) {
+    struct file* rd_file = fd_local2file(fd);   //标准输入有可能被重定向为管道
+    if(rd_file == NULL || fd == stdout_no || fd == stderr_no) {
         printk("sys_read: fd error\n");
-    } else if(fd == stdin_no) {
-        if(is_pipe(fd)) {
-            ret = pipe_read(fd, buf, count);
-        } else {
-            char* buffer = buf;
-            uint32_t bytes_read = 0;
-            while(bytes_read < count) {
-                *buffer = ioq_getchar(&kbd_buf);
-                bytes_read++;
-                buffer++;
+        return -1;
+    }
+    return rd_file->fd_ops->read(rd_file, buf, count);
+}
+
+/*把iov中iovcnt个缓冲区的数据依次写入fd，返回写入的总字节数，失败返回-1。
+  普通文件在一次加锁、一次inode同步中写完整个向量，控制台和管道逐个缓冲区写*/
+int32_t sys_writev(int32_t fd, const struct iovec* iov, uint32_t iovcnt)
+{
+    if(fd < 0 || fd == stdin_no || iovcnt == 0 || iovcnt > IOV_MAX) {
+        printk("sys_writev: argument error\n");
+        return -1;
+    }
+    if(fd > stderr_no && !is_pipe(fd)) {
+        struct file* wr_file = fd_local2file(fd);
+        if(wr_file == NULL || !(wr_file->fd_flag & (O_WRONLY | O_RDWR))) {
+            printk("sys_writev: fd error\n");
+            return -1;
+        }
+        return file_writev(wr_file, iov, iovcnt);
+    }
+    int32_t total = 0;
+    uint32_t idx;
+    for(idx = 0; idx < iovcnt; idx++) {
+        if(iov[idx].iov_len == 0) {
+            continue;
+        }
+        int32_t written = sys_write(fd, iov[idx].iov_base, iov[idx].iov_len);
+        if(written < 0) {
+            return total > 0 ? total : -1;
+        }
+        total += written;
+    }
+    return total;
+}
+
+/*从fd依次读入iov中iovcnt个缓冲区，返回读出的总字节数，到文件尾或失败返回-1。
+  普通文件在一次加锁中读完整个向量，控制台和管道逐个缓冲区读，某次没读满就返回*/
+int32_t sys_readv(int32_t fd, const struct iovec* iov, uint32_t iovcnt)
+{
+    if(fd < 0 || fd == stdout_no || fd == stderr_no || iovcnt == 0 || iovcnt > IOV_MAX) {
+        printk("sys_readv: argument error\n");
+        return -1;
+    }
+    if(fd > stderr_no && !is_pipe(fd)) {
+        struct file* rd_file = fd_local2file(fd);
+        if(rd_file == NULL || (rd_file->fd_flag & O_WRONLY)) {
+            printk("sys_readv: fd error\n");
+            return -1;
+        }
+        return file_readv(rd_file, iov, iovcnt);
+    }
+    int32_t total = 0;
+    uint32_t idx;
+    for(idx = 0; idx < iovcnt; idx++) {
+        if(iov[idx].iov_len == 0) {
+            continue;
+        }
+        int32_t got = sys_read(fd, iov[idx].iov_base, iov[idx].iov_len);
+        if(got <= 0) {
+            return total > 0 ? total : got;
+        }
+        total += got;
+        if((uint32_t)got < iov[idx].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+/*内核中把in_fd的最多count个字节搬到out_fd，数据只经一页内核内存中转，不进出用户空间。
+  两端可以是普通文件、管道，写端还可以是标准输出。读普通文件经页缓存，读端是管道时先等到有数据，搬过一批后只取已有的数据，写端是管道时满了等读端取走。
+  offset不为NULL时从in_fd的*offset处读并更新*offset，in_fd的读写位置不变。返回搬运的字节数，出错返回-1*/
+static int32_t fd_splice(int32_t in_fd, int32_t out_fd, uint32_t* offset, uint32_t count)
+{
+    struct file* in_file = fd_local2file(in_fd);
+    struct file* out_file = fd_local2file(out_fd);
+    bool in_pipe = is_pipe(in_fd), out_pipe = is_pipe(out_fd);
+    if(in_file == NULL || out_file == NULL || in_file == out_file \
+       || (in_pipe && ((in_file->fd_flag & O_WRONLY) || (out_pipe && out_file->fd_private == in_file->fd_private))) \
+       || (out_pipe && !(out_file->fd_flag & O_WRONLY)) \
+       || (!in_pipe && (in_fd < 3 || (in_file->fd_flag & O_WRONLY))) \
+       || (!out_pipe && (out_fd == stdin_no || (out_fd > 2 && !(out_file->fd_flag & (O_WRONLY | O_RDWR))))) \
+       || (in_pipe && offset != NULL)) {
+        printk("fd_splice: fd error\n");
+        return -1;
+    }
+    uint8_t* buf = get_kernel_pages(1);
+    if(buf == NULL) {
+        printk("fd_splice: get_kernel_pages failed\n");
+        return -1;
+    }
+
+    struct file pos_file;   //指定了offset时用文件结构的副本读
+    if(offset != NULL) {
+        pos_file = *in_file;
+        pos_file.fd_pos = *offset;
+        in_file = &pos_file;
+    }
+
+    uint32_t moved = 0;
+    while(moved < count) {
+        uint32_t chunk = count - moved < PG_SIZE ? count - moved : PG_SIZE;
+        int32_t got = 0;
+        if(in_pipe) {
+            if(moved > 0 && pipe_length(in_fd) == 0) {   //已经搬过一批，不再等写端
+                break;
             }
-            ret = (bytes_read == 0 ? -1 : (int32_t)bytes_read);
+            got = pipe_read(in_fd, buf, chunk);
+        } else if(in_file->fd_pos < in_file->fd_inode->i_size) {
+            got = file_read(in_file, buf, chunk);
+        }
+        if(got <= 0) {   //管道空了或到文件尾
+            break;
+        }
+
+        int32_t put = got;
+        if(out_pipe) {
+            put = pipe_write(out_fd, buf, got);
+        } else if(out_fd <= stderr_no) {
+            console_write((const char*)buf, got);
+            klog_host_write((const char*)buf, got);
+        } else {
+            put = file_write(out_file, buf, got);
+        }
+        if(put > 0) {
+            moved += put;
+        }
+        if(put != got) {
+            break;
         }
-    } else if(is_pipe(fd)) {
-        ret = pipe_read(fd, buf, count);
-    } else {
-        uint32_t global_fd = fd_local2global(fd);
-        ret = file_read(&file_table[global_fd], buf, count);
     }
-    return ret;
+    if(offset != NULL) {
+        *offset = pos_file.fd_pos;
+    }
+    mfree_page(PF_KERNEL, buf, 1);
+    return moved;
+}
+
+/*在内核中把普通文件args->in_fd的最多count个字节送到args->out_fd，成功返回送出的字节数，失败返回-1*/
+int32_t sys_sendfile(const struct sendfile_args* args)
+{
+    if(is_pipe(args->in_fd)) {
+        printk("sys_sendfile: in_fd must be a regular file\n");
+        return -1;
+    }
+    return fd_splice(args->in_fd, args->out_fd, args->offset, args->count);
+}
+
+/*在内核中把in_fd的最多count个字节搬到out_fd，至少一端是管道，成功返回搬运的字节数，失败返回-1。读写普通文件的一端用它的读写位置*/
+int32_t sys_splice(int32_t in_fd, int32_t out_fd, uint32_t count)
+{
+    if(!is_pipe(in_fd) && !is_pipe(out_fd)) {
+        printk("sys_splice: neither fd is a pipe\n");
+        return -1;
+    }
+    return fd_splice(in_fd, out_fd, NULL, count);
+}
+
+/*对文件描述符fd执行cmd命令，目前只支持取和设置管道缓冲区大小，成功返回缓冲区大小，失败返回-1*/
+int32_t sys_fcntl(int32_t fd, uint32_t cmd, uint32_t arg)
+{
+    if(!is_pipe(fd)) {
+        printk("sys_fcntl: fd is not a pipe\n");
+        return -1;
+    }
+    switch(cmd) {
+        case F_GETPIPE_SZ:
+            return pipe_get_size(fd);
+        case F_SETPIPE_SZ:
+            return pipe_set_size(fd, arg);
+        default:
+            printk("sys_fcntl: unsupported cmd %d\n", cmd);
+            return -1;
+    }
+}
+
+/*对文件描述符fd执行cmd命令，目前只支持控制台tty取和设置模式，成功返回模式，失败返回-1*/
+int32_t sys_ioctl(int32_t fd, uint32_t cmd, uint32_t arg)
+{
+    if(fd < 0 || fd > stderr_no || is_pipe(fd)) {
+        printk("sys_ioctl: fd is not a tty\n");
+        return -1;
+    }
+    return tty_ioctl(cmd, arg);
+}
+
+/*fd是控制台tty时返回1，否则返回0。标准输入输出没有重定向为管道时就是控制台，不像ioctl那样对管道打印错误*/
+int32_t sys_isatty(int32_t fd)
+{
+    return fd >= 0 && fd <= stderr_no && !is_pipe(fd);
 }
 
 /*重置用于文件读写操作的便宜指针。成功返回新的偏移量，失败返回-1*/
 int32_t sys_lseek(int32_t fd, int32_t offset, uint8_t whence)
 {
-    if(fd < 0) {
+    struct file* pf = fd_local2file(fd);
+    if(pf == NULL || fd < 3) {
         printk("sys_lseek: fd error\n");
         return -1;
     }
     ASSERT(whence > 0 && whence < 4);
-    uint32_t _fd = fd_local2global(fd);
-    struct file* pf = &file_table[_fd];
     int32_t new_pos = 0;   //新的偏移量必须位于文件大小之内
     int32_t file_size = (int32_t)pf->fd_inode->i_size;
     switch(whence) {
@@ -455,6 +710,13 @@ int32_t sys_lseek(int32_t fd, int32_t offset, uint8_t whence)
     return pf->fd_pos;
 }
 
+/*文件系统各把会阻塞的锁按下面的顺序申请，反过来可能死锁：
+  1. 目录inode的i_rwsem，增删目录项持写锁，查找持读锁。要锁两层时先父目录后子目录，如sys_rmdir
+  2. 普通文件inode的i_rwsem，sys_unlink持父目录的写锁后检查文件没有被打开，不再锁文件本身
+  3. journal_begin，日志提交要等所有操作结束，持着操作再等inode的锁会和等提交的持锁者互相等待
+  4. 分区的alloc_lock，只在位图分配回收时短暂持有，持有期间不再申请上面的锁
+  inode_lock、各缓存的关中断或自旋锁临界区内不阻塞，不在此列*/
+
 /*删除文件（非目录），成功返回0，失败返回-1*/
 int32_t sys_unlink(const char* pathname)
 {
@@ -471,37 +733,58 @@ int32_t sys_unlink(const char* pathname)
     }
     if(searched_record.file_type == FT_DIRECTORY) {
         printk("can't delete a directory with unlink(), use rmdir() to instead\n");
+        dir_close(searched_record.parent_dir);
         return -1;
     }
-    
-    //检查是否在已打开文件列表（文件表）中
-    uint32_t file_idx = 0;
-    while(file_idx < MAX_FILE_OPEN) {
-        if(file_table[file_idx].fd_inode != NULL && (uint32_t)inode_no == file_table[file_idx].fd_inode->i_no) {
+
+    //删除期间持父目录的写锁，加锁前别的任务可能已删了这一项，要再查一次
+    struct dir* parent_dir = searched_record.parent_dir;
+    char* filename = strrchr(searched_record.searched_path, '/') + 1;
+    struct dir_entry dir_e;
+    down_write(&parent_dir->inode->i_rwsem);
+    if(!search_dir_entry(cur_part, parent_dir, filename, &dir_e) || dir_e.i_no != (uint32_t)inode_no) {
+        up_write(&parent_dir->inode->i_rwsem);
+        dir_close(parent_dir);
+        printk("file %s not found!\n", pathname);
+        return -1;
+    }
+
+    //检查是否在已打开文件链表中，管道的fd_inode为NULL，要跳过
+    bool in_use = false;
+    enum intr_status old_status = spin_lock_irqsave(&file_list_lock);
+    struct list_elem* elem = file_list.head.next;
+    while(elem != &file_list.tail) {
+        struct file* file = elem2entry(struct file, file_tag, elem);
+        if(file->fd_inode != NULL && (uint32_t)inode_no == file->fd_inode->i_no) {
+            in_use = true;
             break;
         }
-        file_idx++;
+        elem = elem->next;
     }
-    if(file_idx < MAX_FILE_OPEN) {
-        dir_close(searched_record.parent_dir);
+    spin_unlock_irqrestore(&file_list_lock, old_status);
+    if(in_use) {
+        up_write(&parent_dir->inode->i_rwsem);
+        dir_close(parent_dir);
         printk("file %s is in use, not allow to delete!\n", pathname);
         return -1;
     }
-    ASSERT(file_idx == MAX_FILE_OPEN);
 
     //为delete_dir_entry申请缓冲区
     void* io_buf = sys_malloc(SECTOR_SIZE + SECTOR_SIZE);
     if(io_buf == NULL) {
-        dir_close(searched_record.parent_dir);
+        up_write(&parent_dir->inode->i_rwsem);
+        dir_close(parent_dir);
         printk("sys_unlink: malloc for io_buf failed\n");
         return -1;
     }
 
-    struct dir* parent_dir = searched_record.parent_dir;
-    delete_dir_entry(cur_part, parent_dir, inode_no, io_buf);
+    journal_begin();   //删目录项和释放inode在同一个事务里
+    delete_dir_entry(cur_part, parent_dir, inode_no, filename, io_buf);
     inode_release(cur_part, inode_no);
+    journal_end();
+    up_write(&parent_dir->inode->i_rwsem);
     sys_free(io_buf);
-    dir_close(searched_record.parent_dir);
+    dir_close(parent_dir);
     return 0;   //成功删除文件
 }
 
@@ -514,7 +797,6 @@ int32_t sys_mkdir(const char* pathname)
         printk("sys_mkdir: sys_malloc for io_buf failed\n");
         return -1;
     }
-
     struct path_search_record searched_record;
     memset(&searched_record, 0, sizeof(struct path_search_record));
     int inode_no = -1;
@@ -536,10 +818,19 @@ int32_t sys_mkdir(const char* pathname)
     struct dir* parent_dir = searched_record.parent_dir;
     //目录名称后可能会有字符'/'，所以最好直接用searched_record.searched_path，无'/'
     char* dirname = strrchr(searched_record.searched_path, '/') + 1;
+    //按锁的顺序先锁父目录再开始日志操作，加锁前别的任务可能已建了同名的文件，要再查一次
+    down_write(&parent_dir->inode->i_rwsem);
+    journal_begin();   //新目录的各个块和父目录的修改在同一个事务里
+    struct dir_entry dir_e;
+    if(search_dir_entry(cur_part, parent_dir, dirname, &dir_e)) {
+        printk("sys_mkdir: file or dirctory %s exist!\n", pathname);
+        rollback_step = 2;
+        goto rollback;
+    }
     inode_no = inode_bitmap_alloc(cur_part);
     if(inode_no == -1) {
         printk("sys_mkdir: allocate inode failed\n");
-        rollback_step = 1;
+        rollback_step = 2;
         goto rollback;
     }
 
@@ -552,14 +843,28 @@ int32_t sys_mkdir(const char* pathname)
     block_lba = block_bitmap_alloc(cur_part);
     if(block_lba == -1) {
         printk("sys_mkdir: block_bitmap_alloc for create directory failed\n");
-        rollback_step = 2;
+        rollback_step = 3;
         goto rollback;
     }
     new_dir_inode.i_sectors[0] = block_lba;
     //每分配一个块就将位图同步到硬盘
-    block_bitmap_idx = block_lba - cur_part->sb->data_start_lba;
+    block_bitmap_idx = block_bitmap_index(cur_part, block_lba);
     ASSERT(block_bitmap_idx != 0);
     bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
+    //目录项只写在块的第一个扇区，其余扇区先清零，查找空位时才不会读到旧数据
+    block_zero(cur_part, block_lba);
+
+    //新目录都是哈希目录，再分配一块作为索引块，各桶初始为空
+    int32_t index_lba = block_bitmap_alloc(cur_part);
+    if(index_lba == -1) {
+        printk("sys_mkdir: block_bitmap_alloc for directory index failed\n");
+        block_bitmap_free(cur_part, block_lba);
+        rollback_step = 3;
+        goto rollback;
+    }
+    bitmap_sync(cur_part, block_bitmap_index(cur_part, index_lba), BLOCK_BITMAP);
+    block_zero(cur_part, index_lba);
+    new_dir_inode.i_sectors[DIR_INDEX] = index_lba;
     //将当前目录的目录项'.'和'..'写入目录
     memset(io_buf, 0, SECTOR_SIZE * 2);
     struct dir_entry* p_de = (struct dir_entry*)io_buf;
@@ -574,7 +879,7 @@ int32_t sys_mkdir(const char* pathname)
     memcpy(p_de->filename, "..", 2);
     p_de->i_no = parent_dir->inode->i_no;
     p_de->f_type = FT_DIRECTORY;
-    ide_write(cur_part->my_disk, new_dir_inode.i_sectors[0], io_buf, 1);
+    bcache_write(cur_part->my_disk, new_dir_inode.i_sectors[0], io_buf, 1);
 
     new_dir_inode.i_size = 2 * cur_part->sb->dir_entry_size;
 
@@ -585,7 +890,7 @@ int32_t sys_mkdir(const char* pathname)
     memset(io_buf, 0, SECTOR_SIZE * 2);
     if(!sync_dir_entry(parent_dir, &new_dir_entry, io_buf)) {
         printk("sys_mkdir: sync_dir_entry to disk failed!\n");
-        rollback_step = 2;
+        rollback_step = 3;
         goto rollback;
     }
 
@@ -602,14 +907,19 @@ int32_t sys_mkdir(const char* pathname)
 
     sys_free(io_buf);
 
+    journal_end();
+    up_write(&parent_dir->inode->i_rwsem);
     //关闭所创建目录的父目录
     dir_close(searched_record.parent_dir);
     return 0;
 
 rollback:
     switch(rollback_step) {
+        case 3:
+            inode_bitmap_free(cur_part, inode_no);   //如果新文件的inode创建失败，之前位图中分配的inode_no也要恢复
         case 2:
-            bitmap_set(&cur_part->inode_bitmap, inode_no, 0);   //如果新文件的inode创建失败，之前位图中分配的inode_no也要恢复
+            journal_end();
+            up_write(&searched_record.parent_dir->inode->i_rwsem);
         case 1:
             //关闭锁创建目录的父目录
             dir_close(searched_record.parent_dir);
@@ -664,10 +974,45 @@ struct dir_entry* sys_readdir(struct dir* dir)
     return dir_read(dir);
 }
 
+/*从目录dir中接着读出目录项填入buf，最多填count字节，返回填入的字节数，读完时返回0，buf放不下一项时返回-1。
+  目录记着读到的位置，整个目录分几次读完只需把各扇区读一遍*/
+int32_t sys_getdents(struct dir* dir, struct dir_entry* buf, uint32_t count)
+{
+    ASSERT(dir != NULL);
+    uint32_t cnt = count / sizeof(struct dir_entry);
+    if(cnt == 0) {
+        printk("sys_getdents: buffer too small\n");
+        return -1;
+    }
+    return dir_read_batch(dir, buf, cnt) * sizeof(struct dir_entry);
+}
+
+/*同sys_getdents，每项还带上文件大小。大小从inode缓存取，按inode号打开，不必逐个解析路径*/
+int32_t sys_getdents_stat(struct dir* dir, struct dir_entry_stat* buf, uint32_t count)
+{
+    ASSERT(dir != NULL);
+    uint32_t cnt = count / sizeof(struct dir_entry_stat);
+    if(cnt == 0) {
+        printk("sys_getdents_stat: buffer too small\n");
+        return -1;
+    }
+    uint32_t read_cnt = 0;
+    struct dir_entry* dir_e;
+    while(read_cnt < cnt && (dir_e = dir_read(dir)) != NULL) {
+        memcpy(&buf[read_cnt].entry, dir_e, sizeof(struct dir_entry));
+        struct inode* inode = inode_open(cur_part, dir_e->i_no);
+        buf[read_cnt].st_size = inode->i_size;
+        inode_close(inode);
+        read_cnt++;
+    }
+    return read_cnt * sizeof(struct dir_entry_stat);
+}
+
 /*把目录dir的指针dir_pos置0*/
 void sys_rewinddir(struct dir* dir)
 {
     dir->dir_pos = 0;
+    dir->scan_off = 0;
 }
 
 /*删除空目录，成功时返回0，失败时返回-1*/
@@ -685,14 +1030,26 @@ int32_t sys_rmdir(const char* pathname)
         if(searched_record.file_type == FT_REGULAR) {
             printk("%s is regular file!\n", pathname);
         } else {
+            //按锁的顺序先锁父目录再锁子目录，加锁后再确认目录项还在、子目录仍为空
             struct dir* dir = dir_open(cur_part, inode_no);
-            if(!dir_is_empty(dir)) {
+            struct dir* parent_dir = searched_record.parent_dir;
+            char* dirname = strrchr(searched_record.searched_path, '/') + 1;
+            struct dir_entry dir_e;
+            down_write(&parent_dir->inode->i_rwsem);
+            down_write(&dir->inode->i_rwsem);
+            if(!search_dir_entry(cur_part, parent_dir, dirname, &dir_e) || dir_e.i_no != (uint32_t)inode_no) {
+                printk("In %s, sub path %s not exist\n", pathname, searched_record.searched_path);
+            } else if(!dir_is_empty(dir)) {
                 printk("dir %s is not empty, it is not allowed to delete a nonempty directory!\n", pathname);
             } else {
-                if(!dir_remove(searched_record.parent_dir, dir)) {
+                journal_begin();
+                if(!dir_remove(parent_dir, dir, dirname)) {
                     retval = 0;
                 }
+                journal_end();
             }
+            up_write(&dir->inode->i_rwsem);
+            up_write(&parent_dir->inode->i_rwsem);
             dir_close(dir);
         }
     }
@@ -708,10 +1065,10 @@ static uint32_t get_parent_dir_inode_nr(uint32_t child_inode_nr, void* io_buf)
     uint32_t block_lba = child_dir_inode->i_sectors[0];
     ASSERT(block_lba >= cur_part->sb->data_start_lba);
     inode_close(child_dir_inode);
-    ide_read(cur_part->my_disk, block_lba, io_buf, 1);
+    bcache_read(cur_part->my_disk, block_lba, io_buf, 1);
     struct dir_entry* dir_e = (struct dir_entry*)io_buf;
     //第0个目录项为.，第1个目录项为..
-    ASSERT(dir_e[1].i_no < 4096 && dir_e[1].f_type == FT_DIRECTORY);
+    ASSERT(dir_e[1].i_no < cur_part->sb->inode_cnt && dir_e[1].f_type == FT_DIRECTORY);
     return dir_e[1].i_no;
 }
 
@@ -719,40 +1076,33 @@ static uint32_t get_parent_dir_inode_nr(uint32_t child_inode_nr, void* io_buf)
 static int get_child_dir_name(uint32_t p_inode_nr, uint32_t c_inode_nr, char* path, void* io_buf)
 {
     struct inode* parent_dir_inode = inode_open(cur_part, p_inode_nr);
-    //填充all_blocks，将该目录所占扇区全部地址写入all_blocks
-    uint32_t block_idx = 0;
-    uint32_t all_blocks[140] = {0}, block_cnt = 12;
-    while(block_idx < 12) {
-        all_blocks[block_idx] = parent_dir_inode->i_sectors[block_idx];
-        block_idx++;
-    }
-    if(parent_dir_inode->i_sectors[12]) {
-        ide_read(cur_part->my_disk, parent_dir_inode->i_sectors[12], all_blocks + 12, 1);
-        block_cnt = 140;
-    }
-    inode_close(parent_dir_inode);
-
     struct dir_entry* dir_e = (struct dir_entry*)io_buf;
     uint32_t dir_entry_size = cur_part->sb->dir_entry_size;
-    uint32_t dir_entrys_per_sec = (512 / dir_entry_size);
-    block_idx = 0;
-    //遍历所有块
-    while(block_idx < block_cnt) {
-        if(all_blocks[block_idx]) {
-            ide_read(cur_part->my_disk, all_blocks[block_idx], io_buf, 1);
+    uint32_t dir_entrys_per_sec = (SECTOR_SIZE / dir_entry_size);
+    uint32_t block_idx;
+    //遍历所有块的每个扇区
+    for(block_idx = 0; block_idx < DIR_MAX_BLOCKS; block_idx++) {
+        uint32_t block_lba = inode_bmap(cur_part, parent_dir_inode, block_idx, false);
+        if(block_lba == 0) {
+            continue;
+        }
+        uint32_t sec_idx;
+        for(sec_idx = 0; sec_idx < BLOCK_SECS; sec_idx++) {
+            bcache_read(cur_part->my_disk, block_lba + sec_idx, io_buf, 1);
             uint8_t dir_e_idx = 0;
             //遍历目录项
             while(dir_e_idx < dir_entrys_per_sec) {
                 if((dir_e + dir_e_idx)->i_no == c_inode_nr) {
                     strcat(path, "/");
                     strcat(path, (dir_e + dir_e_idx)->filename);
+                    inode_close(parent_dir_inode);
                     return 0;
                 }
                 dir_e_idx++;
             }
         }
-        block_idx++;
     }
+    inode_close(parent_dir_inode);
     return -1;
 }
 
@@ -768,7 +1118,7 @@ char* sys_getcwd(char* buf, uint32_t size)
 
     struct task_struct* cur_thread = running_thread();
     int32_t parent_inode_nr = 0;
-    int32_t child_inode_nr = cur_thread->cwd_inode_nr;
+    int32_t child_inode_nr = cur_thread->group_leader->cwd_inode_nr;
     ASSERT(child_inode_nr >= 0 && child_inode_nr < 4096);   //最大支持4096个inode
     //若当前目录是根目录，直接返回'/'
     if(child_inode_nr == 0) {
@@ -811,7 +1161,7 @@ int32_t sys_chdir(const char* path)
     int inode_no = search_file(path, &searched_record);
     if(inode_no != -1) {
         if(searched_record.file_type == FT_DIRECTORY) {
-            running_thread()->cwd_inode_nr = inode_no;
+            running_thread()->group_leader->cwd_inode_nr = inode_no;
             ret = 0;
         } else {
             printk("sys_chdir: %s id regular file or other!\n");
@@ -838,6 +1188,7 @@ int32_t sys_stat(const char* path, struct stat* buf)
     if(inode_no != -1) {
         struct inode* obj_inode = inode_open(cur_part, inode_no);   //只为获取文件大小
         buf->st_size = obj_inode->i_size;
+        inode_close(obj_inode);
         buf->st_filetype = searched_record.file_type;
         buf->st_ino = inode_no;
         ret = 0;
@@ -848,12 +1199,86 @@ int32_t sys_stat(const char* path, struct stat* buf)
     return ret;
 }
 
+/*解析path得到普通文件的inode号，并把当前的目录项删除次数存入gen，两者交给spawn_inode跳过路径解析。
+  成功返回inode号，找不到或不是普通文件返回-1*/
+int32_t sys_exec_lookup(const char* path, uint32_t* gen)
+{
+    struct path_search_record searched_record;
+    memset(&searched_record, 0, sizeof(struct path_search_record));
+    *gen = dir_entry_gen;   //先于查找记下，查找期间有删除时解析结果按失效处理
+    int32_t i_no = search_file(path, &searched_record);
+    dir_close(searched_record.parent_dir);
+    if(i_no == -1 || searched_record.file_type != FT_REGULAR) {
+        return -1;
+    }
+    return i_no;
+}
+
+/*将文件描述符fd所指文件的属性填入buf，成功返回0，失败返回-1。文件已打开，直接用它的inode，不必解析路径*/
+int32_t sys_fstat(int32_t fd, struct stat* buf)
+{
+    struct file* file = fd_local2file(fd);
+    if(fd < 3 || file == NULL || is_pipe(fd)) {
+        printk("sys_fstat: fd error\n");
+        return -1;
+    }
+    buf->st_ino = file->fd_inode->i_no;
+    buf->st_size = file->fd_inode->i_size;
+    buf->st_filetype = FT_REGULAR;   //目录不用文件描述符打开
+    return 0;
+}
+
+/*将当前分区的容量信息填入buf，成功返回0。空闲数取超级块中随分配回收更新的计数，不必扫描位图*/
+int32_t sys_statfs(struct statfs* buf)
+{
+    struct super_block* sb = cur_part->sb;
+    memcpy(buf->f_name, cur_part->name, sizeof(buf->f_name));
+    buf->f_bsize = sb->block_size;
+    buf->f_blocks = (sb->sec_cnt - (sb->data_start_lba - sb->part_lba_base)) / BLOCK_SECS;
+    buf->f_bfree = sb->free_blocks;
+    buf->f_files = sb->inode_cnt;
+    buf->f_ffree = sb->free_inodes;
+    return 0;
+}
+
 /*向屏幕输出一个字符*/
 void sys_putchar(char char_asci)
 {
     return console_put_char(char_asci);
 }
 
+/*把所有脏块写回硬盘*/
+void sys_sync(void)
+{
+    fs_writeback();
+    bcache_sync(NULL);
+}
+
+/*提交元数据日志，只记在内存中的位图随之写入块缓存，在同步点和回写线程每次检查时调用。
+  回写线程每次检查之间完成的元数据操作合成一次日志写入*/
+void fs_writeback(void)
+{
+    if(cur_part != NULL) {
+        journal_commit();
+    }
+}
+
+/*把文件fd的修改写回硬盘，成功返回0，失败返回-1。
+  缓存不记录块属于哪个文件，这里写回文件所在硬盘的全部脏块*/
+int32_t sys_fsync(int32_t fd)
+{
+    if(fd_local2file(fd) == NULL) {
+        printk("sys_fsync: fd error\n");
+        return -1;
+    }
+    if(fd < 3 || is_pipe(fd)) {   //标准输入输出和管道不落盘
+        return 0;
+    }
+    fs_writeback();
+    bcache_sync(cur_part->my_disk);
+    return 0;
+}
+
 void sys_help(void)
 {
     printk("\
@@ -863,7 +1288,23 @@ void sys_help(void)
     rm: remove a empty directory\n\
     pwd: show current work directory\n\
     ps: show process indormation\n\
+    free/meminfo: show memory usage\n\
+    sched [-d]: summarize or dump recent scheduler events\n\
+    iostat: show per-disk and per-partition io statistics\n\
+    top: refresh per-process cpu, syscall, fault, disk and switch counts, q to quit\n\
+    df: show free space and inodes of the file system\n\
+    fsck: check consistency of the file system metadata\n\
+    dmesg: show the kernel log buffer\n\
+    boottime: show time spent in each boot stage\n\
+    bench [name]: run microbenchmarks whose names start with name\n\
+    prof start [hz] | stop | dump: sample interrupted eips on the timer interrupt\n\
+    stats: show kernel event counters summed over all cpus\n\
+    sync: write cached data back to disk\n\
+    poweroff: write cached data back to disk and power off\n\
     clear: clear creen\n\
+    hash [-r]: show or forget the cached inodes of external commands\n\
+    import [-a | name [dest]]: list or copy files from the host share directory\n\
+    cmd1 | cmd2: pipe the output of cmd1 to cmd2, buildin commands run inside the shell\n\
     shortcut key: \n\
     ctrl+l: clear screen\n\
     ctrl+u: clear input\n\n");
@@ -874,6 +1315,18 @@ void filesys_init()
 {
     uint8_t channel_no = 0, dev_no, part_idx = 0;
 
+    //创建文件系统用到的对象缓存
+    inode_cache = kmem_cache_create("inode", sizeof(struct inode), NULL);
+    dir_cache = kmem_cache_create("dir", sizeof(struct dir), NULL);
+    io_buf_cache = kmem_cache_create("io_buf", SECTOR_SIZE * 2, NULL);
+    file_cache = kmem_cache_create("file", sizeof(struct file), NULL);
+    if(inode_cache == NULL || dir_cache == NULL || io_buf_cache == NULL || file_cache == NULL) {
+        PANIC("create kmem cache failed!");
+    }
+    bcache_init();   //文件系统的读写都经过块缓存
+    dcache_init();   //路径查找先查目录项缓存
+    pcache_init();   //文件页缓存
+
     //sb_buf用来存储硬盘上读入的超级块
     struct super_block* sb_buf = (struct super_block*)sys_malloc(SECTOR_SIZE);
 
@@ -881,10 +1334,11 @@ void filesys_init()
         PANIC("alloc memory failed!");
     }
     printk("searching filesystem......\n");
+    int32_t search_stage = boot_stage_begin("fs search");
     while(channel_no < channel_cnt) {
         dev_no = 0;
         while(dev_no < 2) {
-            if(dev_no == 0) {
+            if(dev_no == 0 && channels[channel_no].stripe == NULL) {   //条带设备md0是它的通道上的0号硬盘
                 dev_no++;
                 continue;
             }
@@ -896,17 +1350,28 @@ void filesys_init()
                 }            
                 //partition中的成员默认为0.若partition未初始化，则partition的成员仍未0
                 //处理存在的分区
-                if(part->sec_cnt != 0) {
+                if(part->sec_cnt != 0 && !strcmp(part->name, SWAP_PART_NAME)) {   //交换区不放文件系统
+                    printk("%s is swap area\n", part->name);
+                } else if(part->sec_cnt != 0 && part->fs_type == PART_TYPE_STRIPE) {   //文件系统在md0上
+                    printk("%s is a member of md0\n", part->name);
+                } else if(part->sec_cnt != 0) {
                     memset(sb_buf, 0, SECTOR_SIZE);
 
                     //读取分区的超级块，分局魔数是否正确来判断是否存在文件系统
-                    ide_read(hd, part->start_lba + 1, sb_buf, 1);
+                    bcache_read(hd, part->start_lba + 1, sb_buf, 1);
                     //只支持自己的文件系统，若磁盘上已经有文件系统就不在格式化了
-                    if(sb_buf->magic == 0x19590318) {
+                    if(sb_buf->magic == FS_MAGIC && sb_buf->block_size == BLOCK_SIZE) {
                         printk("%s has filesystem\n", part->name);
                     } else {
+                        if(sb_buf->magic == FS_MAGIC) {   //块大小与内核编译时选定的不同，无法挂载
+                            printk("%s block size %d mismatch, expect %d\n", part->name, sb_buf->block_size, BLOCK_SIZE);
+                        }
                         printk("formatting %s's partition %s......\n", hd->name, part->name);
-                        partition_format(part);
+                        char stage_name[BOOT_STAGE_NAME_LEN];
+                        sprintf(stage_name, "format %s", part->name);
+                        int32_t stage = boot_stage_begin(stage_name);
+                        partition_format(part, MAX_FILES_PER_PART);
+                        boot_stage_end(stage);
                     }
                 }
                 part_idx++;
@@ -917,19 +1382,23 @@ void filesys_init()
         channel_no++;   //下一个通道
     }
     sys_free(sb_buf);
+    boot_stage_end(search_stage);
     
-    //确认默认操作的分区
+    //确认默认操作的分区，组成了条带设备时挂载md0上的分区
     char default_part[8] = "sdb1";
     //挂载分区
-    list_traversal(&partition_list, mount_partition, (int)default_part);
+    int32_t mount_stage = boot_stage_begin("fs mount");
+    list_traversal(&partition_list, mount_partition, (int)STRIPE_PART_NAME);
+    if(cur_part == NULL) {
+        list_traversal(&partition_list, mount_partition, (int)default_part);
+    }
+    boot_stage_end(mount_stage);
 
     //将当前分区的根目录打开
     open_root_dir(cur_part);
 
-    //初始化文件表
-    uint32_t fd_idx = 0;
-    while(fd_idx < MAX_FILE_OPEN) {
-        file_table[fd_idx++].fd_inode = NULL;
-    }
+    //初始化已打开文件链表
+    list_init(&file_list);
+    spin_init(&file_list_lock);
     printk("filesys init done!!!!!!\n");
 }
@@ -2,10 +2,12 @@
 #define __FS_FS_H
 #include "stdint.h"
 
-#define MAX_FILES_PER_PART 4096   //每个分区所支持的最大创建的文件数，最多建立4096个inode
+#define MAX_FILES_PER_PART 4096   //格式化分区时默认建立的inode数，即分区最多能创建的文件数，实际数目记在超级块中
+#define INODE_TABLE_GROUP_SECTS BLOCK_SECS   //i节点表按组延迟清零，每组的扇区数
 #define BITS_PER_SECTOR 4096   //每扇区的位数,512(扇区字节大小)*8(一字节位数)
 #define SECTOR_SIZE 512   //扇区字节大小
-#define BLOCK_SIZE SECTOR_SIZE   //块字节大小
+#define BLOCK_SIZE 4096   //块字节大小，须为扇区大小的整数倍，格式化时记入超级块，与超级块中不同的分区会被重新格式化
+#define BLOCK_SECS (BLOCK_SIZE / SECTOR_SIZE)   //每块的扇区数
 
 #define MAX_PATH_LEN 512   //路径最大长度
 
@@ -28,6 +30,13 @@ enum oflags
     O_CREAT = 4 //100
 };
 
+/*fcntl的命令*/
+enum fcntl_cmd
+{
+    F_SETPIPE_SZ = 1031,   //设置管道缓冲区大小
+    F_GETPIPE_SZ = 1032    //取管道缓冲区大小
+};
+
 /*文件读写位置偏移量*/
 enum whence
 {
@@ -36,6 +45,9 @@ enum whence
     SEEK_END
 };
 
+struct file;
+struct dir_entry_stat;
+
 /*记录查找文件过程中已找到的上级路径，也就是查找文件过程中“走过的地方”*/
 struct path_search_record
 {
@@ -52,6 +64,44 @@ struct stat
     enum file_types st_filetype;   //文件尺寸
 };
 
+#define IOV_MAX 16   //readv和writev一次最多处理的缓冲区数
+
+/*readv和writev的一个缓冲区*/
+struct iovec
+{
+    void* iov_base;
+    uint32_t iov_len;
+};
+
+/*文件系统的容量信息，由statfs填写*/
+struct statfs
+{
+    char f_name[8];   //分区名
+    uint32_t f_bsize;   //块字节大小
+    uint32_t f_blocks;   //数据区的总块数
+    uint32_t f_bfree;   //空闲块数
+    uint32_t f_files;   //inode总数
+    uint32_t f_ffree;   //空闲inode数
+};
+
+/*fsck的检查结果*/
+struct fsck_report
+{
+    uint32_t dirs;   //遍历到的目录数，含根目录
+    uint32_t files;   //遍历到的普通文件数
+    uint32_t blocks;   //被文件和目录引用的块数，含间接块和索引块
+    uint32_t errors;   //发现的不一致数
+};
+
+/*sendfile的参数，系统调用最多传3个参数，打包成结构体传指针*/
+struct sendfile_args
+{
+    int32_t out_fd;
+    int32_t in_fd;
+    uint32_t* offset;   //不为NULL时从in_fd的*offset处读并更新*offset，in_fd的读写位置不变
+    uint32_t count;
+};
+
 /*将最上层路径名称解析出来，name_store用于存储最上层路径名
 功能：将最上层路径名称解析出来存储到name_store中，调用结束后返回除顶层路径之外的子路径字符串地址*/
 char* path_parse(char* pathname, char* name_store);
@@ -61,10 +111,28 @@ int32_t path_depth_cnt(char* pathname);
 int32_t sys_open(const char* pathname, uint8_t flags);
 /*关闭文件描述符fd指向的文件，成功返回0，失败则返回-1*/
 int32_t sys_close(int32_t fd);
+/*复制文件描述符fd到最小的空闲描述符，两者指向同一个文件结构，成功返回新的描述符，失败返回-1*/
+int32_t sys_dup(int32_t fd);
+/*使new_fd指向old_fd的文件结构，new_fd原先打开的文件先关闭。标准输入输出只能重定向为管道或改回控制台，成功返回new_fd，失败返回-1*/
+int32_t sys_dup2(int32_t old_fd, int32_t new_fd);
 /*将buf中连续count个字节写入文件描述符fd，成功则返回写入的字节数，失败返回-1*/
 int sys_write(int32_t fd, const void* buf, uint32_t count);
 /*从文件描述符fd指向的文件中读取count个字节到buf，若成功返回读出字节数，到文件尾则返回-1*/
 int32_t sys_read(int32_t fd, void* buf, uint32_t count);
+/*把iov中iovcnt个缓冲区的数据依次写入fd，返回写入的总字节数，失败返回-1*/
+int32_t sys_writev(int32_t fd, const struct iovec* iov, uint32_t iovcnt);
+/*从fd依次读入iov中iovcnt个缓冲区，返回读出的总字节数，到文件尾或失败返回-1*/
+int32_t sys_readv(int32_t fd, const struct iovec* iov, uint32_t iovcnt);
+/*在内核中把普通文件args->in_fd的最多count个字节送到args->out_fd，成功返回送出的字节数，失败返回-1*/
+int32_t sys_sendfile(const struct sendfile_args* args);
+/*在内核中把in_fd的最多count个字节搬到out_fd，至少一端是管道，成功返回搬运的字节数，失败返回-1*/
+int32_t sys_splice(int32_t in_fd, int32_t out_fd, uint32_t count);
+/*对文件描述符fd执行cmd命令，目前只支持取和设置管道缓冲区大小，成功返回缓冲区大小，失败返回-1*/
+int32_t sys_fcntl(int32_t fd, uint32_t cmd, uint32_t arg);
+/*对文件描述符fd执行cmd命令，目前只支持控制台tty取和设置模式，成功返回模式，失败返回-1*/
+int32_t sys_ioctl(int32_t fd, uint32_t cmd, uint32_t arg);
+/*fd是控制台tty时返回1，否则返回0*/
+int32_t sys_isatty(int32_t fd);
 /*重置用于文件读写操作的便宜指针。成功返回新的偏移量，失败返回-1*/
 int32_t sys_lseek(int32_t fd, int32_t offset, uint8_t whence);
 /*删除文件（非目录），成功返回0，失败返回-1*/
@@ -77,6 +145,10 @@ struct dir* sys_opendir(const char* name);
 int32_t sys_closedir(struct dir* dir);
 /*读取目录dir的1个目录项，成功后返回其目录项地址，到目录尾时或出错时返回NULL*/
 struct dir_entry* sys_readdir(struct dir* dir);
+/*从目录dir中接着读出目录项填入buf，最多填count字节，返回填入的字节数，读完时返回0，失败返回-1*/
+int32_t sys_getdents(struct dir* dir, struct dir_entry* buf, uint32_t count);
+/*同sys_getdents，每项还带上从inode缓存查到的文件大小*/
+int32_t sys_getdents_stat(struct dir* dir, struct dir_entry_stat* buf, uint32_t count);
 /*把目录dir的指针dir_pos置0*/
 void sys_rewinddir(struct dir* dir);
 /*删除空目录，成功时返回0，失败时返回-1*/
@@ -87,12 +159,24 @@ char* sys_getcwd(char* buf, uint32_t size);
 int32_t sys_chdir(const char* path);
 /*在buf中填充文件结构相关信息，成功时返回0，失败返回-1*/
 int32_t sys_stat(const char* path, struct stat* buf);
+/*解析path得到普通文件的inode号，并把当前的目录项删除次数存入gen，成功返回inode号，失败返回-1*/
+int32_t sys_exec_lookup(const char* path, uint32_t* gen);
+/*将文件描述符fd所指文件的属性填入buf，成功返回0，失败返回-1*/
+int32_t sys_fstat(int32_t fd, struct stat* buf);
+/*将当前分区的容量信息填入buf，成功返回0*/
+int32_t sys_statfs(struct statfs* buf);
 /*向屏幕输出一个字符*/
 void sys_putchar(char char_asci);
 void sys_help(void);
+/*把所有脏块写回硬盘*/
+void sys_sync(void);
+/*把只记在内存中的元数据写入块缓存*/
+void fs_writeback(void);
+/*把文件fd的修改写回硬盘，成功返回0，失败返回-1*/
+int32_t sys_fsync(int32_t fd);
 /*在磁盘上搜索文件系统，若没有则格式化分区创建文件系统*/
 void filesys_init(void);
-/*将文件描述符转化为文件表的下标*/
-uint32_t fd_local2global(uint32_t local_fd);
+/*将当前任务的文件描述符转化为所指的文件结构，描述符无效时返回NULL*/
+struct file* fd_local2file(int32_t local_fd);
 
 #endif
@@ -0,0 +1,233 @@
+#include "fsck.h"
+#include "stdint.h"
+#include "global.h"
+#include "fs.h"
+#include "inode.h"
+#include "dir.h"
+#include "super_block.h"
+#include "file.h"
+#include "ide.h"
+#include "bcache.h"
+#include "bitmap.h"
+#include "memory.h"
+#include "string.h"
+#include "stdio-kernel.h"
+
+/*一次检查的状态*/
+struct fsck_state
+{
+    struct partition* part;
+    struct bitmap blocks_used;   //遍历中被引用或被打开的文件预留的块
+    struct bitmap inodes_seen;   //遍历中到达的inode
+    uint32_t block_cnt;   //数据区的总块数
+    struct fsck_report* report;
+};
+
+/*记一条不一致，前FSCK_PRINT_MAX条打印出来*/
+static void fsck_error(struct fsck_state* st, const char* msg, uint32_t no)
+{
+    if(st->report->errors++ < FSCK_PRINT_MAX) {
+        printk("fsck: %s %d\n", msg, no);
+    }
+}
+
+/*标记块block_lba被引用，检查它在数据区内、块位图中已占用且没有被别处引用过，返回块是否有效*/
+static bool fsck_mark_block(struct fsck_state* st, uint32_t block_lba)
+{
+    struct super_block* sb = st->part->sb;
+    if(block_lba < sb->data_start_lba || (block_lba - sb->data_start_lba) % BLOCK_SECS != 0 || \
+       (block_lba - sb->data_start_lba) / BLOCK_SECS >= st->block_cnt) {
+        fsck_error(st, "bad block address", block_lba);
+        return false;
+    }
+    uint32_t bit_idx = block_bitmap_index(st->part, block_lba);
+    if(bitmap_scan_test(&st->blocks_used, bit_idx)) {
+        fsck_error(st, "block referenced twice", block_lba);
+        return false;
+    }
+    bitmap_set(&st->blocks_used, bit_idx, 1);
+    st->report->blocks++;
+    if(!bitmap_scan_test(&st->part->block_bitmap, bit_idx)) {
+        fsck_error(st, "block in use but free in bitmap", block_lba);
+    }
+    return true;
+}
+
+/*标记以block_lba为根、有levels级间接的块树中的所有块，返回其中数据块的个数*/
+static uint32_t fsck_block_tree(struct fsck_state* st, uint32_t block_lba, uint32_t levels)
+{
+    if(!fsck_mark_block(st, block_lba)) {
+        return 0;
+    }
+    if(levels == 0) {
+        return 1;
+    }
+    uint32_t data_cnt = 0, sec_idx;
+    for(sec_idx = 0; sec_idx < BLOCK_SECS; sec_idx++) {
+        struct buffer_head* bh = bread(st->part->my_disk, block_lba + sec_idx);
+        uint32_t* table = (uint32_t*)bh->data;
+        uint32_t idx;
+        for(idx = 0; idx < PTRS_PER_SECTOR; idx++) {
+            if(table[idx] != 0) {
+                data_cnt += fsck_block_tree(st, table[idx], levels - 1);
+            }
+        }
+        brelse(bh);
+    }
+    return data_cnt;
+}
+
+/*检查inode的块，普通文件的数据块数要和i_size相符，打开者预留的块也算被引用*/
+static void fsck_inode(struct fsck_state* st, struct inode* inode, bool is_dir)
+{
+    uint32_t data_cnt = 0, block_idx;
+    for(block_idx = 0; block_idx < INODE_DIRECT_BLOCKS; block_idx++) {
+        if(inode->i_sectors[block_idx] != 0 && fsck_mark_block(st, inode->i_sectors[block_idx])) {
+            data_cnt++;
+        }
+    }
+    for(block_idx = INODE_IND; block_idx <= INODE_TIND; block_idx++) {
+        if(inode->i_sectors[block_idx] == 0) {
+            continue;
+        }
+        if(is_dir && block_idx == DIR_INDEX) {   //哈希目录的索引块只是一块
+            fsck_mark_block(st, inode->i_sectors[block_idx]);
+        } else {
+            data_cnt += fsck_block_tree(st, inode->i_sectors[block_idx], block_idx - INODE_IND + 1);
+        }
+    }
+    if(!is_dir && data_cnt != DIV_ROUND_UP(inode->i_size, BLOCK_SIZE)) {
+        fsck_error(st, "file blocks do not match i_size, inode", inode->i_no);
+    }
+
+    uint32_t prealloc_idx;
+    for(prealloc_idx = 0; prealloc_idx < inode->prealloc_cnt; prealloc_idx++) {
+        if(fsck_mark_block(st, inode->alloc_goal + prealloc_idx * BLOCK_SECS)) {
+            st->report->blocks--;   //预留的块不算文件的块
+        }
+    }
+}
+
+/*检查目录ino：各目录项指向位图中已占用的inode且只被引用一次，.和..正确，i_size等于目录项总大小。
+  子目录的inode号压入stack，返回压入后的栈深*/
+static uint32_t fsck_dir(struct fsck_state* st, uint32_t ino, uint32_t parent_ino, uint32_t* stack, uint32_t depth)
+{
+    struct super_block* sb = st->part->sb;
+    struct dir* dir = dir_open(st->part, ino);
+    uint32_t entry_cnt = 0;
+    struct dir_entry* dir_e;
+    while((dir_e = dir_read(dir)) != NULL) {
+        struct dir_entry entry;
+        memcpy(&entry, dir_e, sizeof(struct dir_entry));
+        entry_cnt++;
+        if(!strncmp(entry.filename, ".", MAX_FILE_NAME_LEN) || !strncmp(entry.filename, "..", MAX_FILE_NAME_LEN)) {
+            if(entry.i_no != (entry.filename[1] == '.' ? parent_ino : ino)) {
+                fsck_error(st, "bad . or .. in directory", ino);
+            }
+            continue;
+        }
+        if(entry.i_no >= sb->inode_cnt) {
+            fsck_error(st, "bad inode number in directory", ino);
+            continue;
+        }
+        if(bitmap_scan_test(&st->inodes_seen, entry.i_no)) {
+            fsck_error(st, "inode referenced twice", entry.i_no);
+            continue;
+        }
+        bitmap_set(&st->inodes_seen, entry.i_no, 1);
+        if(!bitmap_scan_test(&st->part->inode_bitmap, entry.i_no)) {
+            fsck_error(st, "inode in use but free in bitmap", entry.i_no);
+        }
+        struct inode* inode = inode_open(st->part, entry.i_no);
+        fsck_inode(st, inode, entry.f_type == FT_DIRECTORY);
+        inode_close(inode);
+        if(entry.f_type == FT_DIRECTORY) {
+            st->report->dirs++;
+            stack[depth++] = entry.i_no;
+            stack[depth++] = ino;
+        } else {
+            st->report->files++;
+        }
+    }
+    if(dir->inode->i_size != entry_cnt * sb->dir_entry_size) {
+        fsck_error(st, "directory i_size does not match entries, inode", ino);
+    }
+    dir_close(dir);
+    return depth;
+}
+
+/*从根目录遍历当前分区，交叉检查inode位图、块位图、目录项、i_size和超级块中的空闲计数，结果填入report。
+  返回发现的不一致数，内存不足无法检查时返回-1。检查期间别的任务修改文件系统会报出假的不一致，应在空闲时运行*/
+int32_t sys_fsck(struct fsck_report* report)
+{
+    struct fsck_state st;
+    struct super_block* sb = cur_part->sb;
+    memset(report, 0, sizeof(struct fsck_report));
+    st.part = cur_part;
+    st.report = report;
+    st.block_cnt = (sb->sec_cnt - (sb->data_start_lba - sb->part_lba_base)) / BLOCK_SECS;
+    st.blocks_used.btmp_bytes_len = cur_part->block_bitmap.btmp_bytes_len;
+    st.blocks_used.bits = sys_malloc(st.blocks_used.btmp_bytes_len);
+    st.blocks_used.summary = NULL;
+    st.inodes_seen.btmp_bytes_len = cur_part->inode_bitmap.btmp_bytes_len;
+    st.inodes_seen.bits = sys_malloc(st.inodes_seen.btmp_bytes_len);
+    st.inodes_seen.summary = NULL;
+    uint32_t* stack = sys_malloc(sb->inode_cnt * 2 * sizeof(uint32_t));   //待检查的目录和它的父目录，每个目录只压入一次
+    if(st.blocks_used.bits == NULL || st.inodes_seen.bits == NULL || stack == NULL) {
+        printk("sys_fsck: sys_malloc failed\n");
+        if(st.blocks_used.bits != NULL) {
+            sys_free(st.blocks_used.bits);
+        }
+        if(st.inodes_seen.bits != NULL) {
+            sys_free(st.inodes_seen.bits);
+        }
+        if(stack != NULL) {
+            sys_free(stack);
+        }
+        return -1;
+    }
+    bitmap_init(&st.blocks_used);
+    bitmap_init(&st.inodes_seen);
+
+    //1. 从根目录起遍历目录树，根目录的..是它自己
+    bitmap_set(&st.inodes_seen, sb->root_inode_no, 1);
+    struct inode* root = inode_open(cur_part, sb->root_inode_no);
+    fsck_inode(&st, root, true);
+    inode_close(root);
+    report->dirs = 1;
+    uint32_t depth = 0;
+    stack[depth++] = sb->root_inode_no;
+    stack[depth++] = sb->root_inode_no;
+    while(depth > 0) {
+        uint32_t parent_ino = stack[--depth];
+        uint32_t ino = stack[--depth];
+        depth = fsck_dir(&st, ino, parent_ino, stack, depth);
+    }
+
+    //2. 位图中占用的都要被引用到，否则是泄漏的inode或块
+    uint32_t idx;
+    for(idx = 0; idx < sb->inode_cnt; idx++) {
+        if(bitmap_scan_test(&cur_part->inode_bitmap, idx) && !bitmap_scan_test(&st.inodes_seen, idx)) {
+            fsck_error(&st, "inode allocated but unreachable", idx);
+        }
+    }
+    for(idx = 0; idx < st.block_cnt; idx++) {
+        if(bitmap_scan_test(&cur_part->block_bitmap, idx) && !bitmap_scan_test(&st.blocks_used, idx)) {
+            fsck_error(&st, "block allocated but unreferenced", sb->data_start_lba + idx * BLOCK_SECS);
+        }
+    }
+
+    //3. 超级块中的空闲计数要和位图一致
+    if(sb->free_blocks != bitmap_count_zero(&cur_part->block_bitmap)) {
+        fsck_error(&st, "superblock free_blocks mismatch, recorded", sb->free_blocks);
+    }
+    if(sb->free_inodes != bitmap_count_zero(&cur_part->inode_bitmap)) {
+        fsck_error(&st, "superblock free_inodes mismatch, recorded", sb->free_inodes);
+    }
+
+    sys_free(st.blocks_used.bits);
+    sys_free(st.inodes_seen.bits);
+    sys_free(stack);
+    printk("fsck %s: %d dirs, %d files, %d blocks, %d errors\n", cur_part->name, report->dirs, report->files, report->blocks, report->errors);
+    return report->errors;
+}
@@ -0,0 +1,12 @@
+#ifndef __FS_FSCK_H
+#define __FS_FSCK_H
+#include "stdint.h"
+#include "fs.h"
+
+#define FSCK_PRINT_MAX 16   //最多打印的不一致条数，之后只计数
+
+/*从根目录遍历当前分区，交叉检查inode位图、块位图、目录项、i_size和超级块中的空闲计数，结果填入report。
+  返回发现的不一致数，内存不足无法检查时返回-1*/
+int32_t sys_fsck(struct fsck_report* report);
+
+#endif
@@ -1,6 +1,7 @@
 #include "inode.h"
 #include "stdint.h"
 #include "ide.h"
+#include "bcache.h"
 #include "super_block.h"
 #include "dir.h"
 #include "fs.h"
@@ -9,6 +10,11 @@
 #include "string.h"
 #include "interrupt.h"
 #include "file.h"
+#include "memory.h"
+#include "pcache.h"
+#include "exec.h"
+
+struct kmem_cache* inode_cache;   //内存中inode的对象缓存
 
 /*记录inode所在的扇区地址及在扇区内的偏移量，用于定位inode在磁盘上的位置*/
 struct inode_position
@@ -24,7 +30,7 @@ static void inode_locate(struct partition* part, uint32_t inode_no, struct inode
     ASSERT(inode_no < 4096);
     uint32_t inode_table_lba = part->sb->inode_table_lba;
 
-    uint32_t inode_size = sizeof(struct inode);
+    uint32_t inode_size = INODE_DISK_SIZE;
     uint32_t off_size = inode_no * inode_size;   //第inode_no个i节点相对于inode_table_lba的字节偏移量
     uint32_t off_sec = off_size / 512;   //第inode_no个i节点相对于inode_table_lba的扇区偏移量
     uint32_t off_size_in_sec = off_size % 512;   //待查找的inode在所在扇区中的起始字节地址
@@ -55,81 +61,186 @@ void inode_sync(struct partition* part, struct inode* inode, void* io_buf)
     //一下的sane成员只存在内存中
     pure_inode.i_open_cnts = 0;
     pure_inode.write_deny = false;   //置为false，保证在硬盘中读出时为可写
-    pure_inode.inode_tag.prev = pure_inode.inode_tag.next = NULL;
+    list_elem_init(&pure_inode.inode_tag);
 
     char* inode_buf = (char*)io_buf;
     if(inode_pos.two_sec) {
         //读写硬盘是以扇区为单位，若写入的数据小于一扇区，将原硬盘的内容先读出来再和新数据拼接成一扇区后写入
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
-        memcpy((inode_buf + inode_pos.off_size), &pure_inode, sizeof(struct inode));
-        ide_write(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
+        bcache_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
+        memcpy((inode_buf + inode_pos.off_size), &pure_inode, INODE_DISK_SIZE);
+        bcache_write(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
     } else {
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
-        memcpy((inode_buf + inode_pos.off_size), &pure_inode, sizeof(struct inode));
-        ide_write(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+        bcache_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+        memcpy((inode_buf + inode_pos.off_size), &pure_inode, INODE_DISK_SIZE);
+        bcache_write(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
     }
 }
 
-/*根据i节点号返回相应的i节点*/
-struct inode* inode_open(struct partition* part, uint32_t inode_no)
+/*初始化分区part的内存inode缓存*/
+void inode_cache_init(struct partition* part)
 {
-    //先在已打开的inode链表中找inode，此链表是为提速创建的缓冲区
-    struct list_elem* elem = part->open_inodes.head.next;
-    struct inode* inode_found;
-    while(elem != &part->open_inodes.tail) {
-        inode_found = elem2entry(struct inode, inode_tag, elem);
+    part->inode_hash = (struct list*)sys_malloc(sizeof(struct list) * INODE_HASH_CNT);
+    if(part->inode_hash == NULL) {
+        PANIC("alloc memory failed!");
+    }
+    uint32_t idx;
+    for(idx = 0; idx < INODE_HASH_CNT; idx++) {
+        list_init(&part->inode_hash[idx]);
+    }
+    list_init(&part->inode_lru);
+    part->inode_lru_cnt = 0;
+    rwlock_init(&part->inode_lock);
+    lock_init(&part->alloc_lock);
+}
+
+/*在part的inode哈希桶中找inode_no，找不到返回NULL，需持有inode_lock*/
+static struct inode* inode_cache_find(struct partition* part, uint32_t inode_no)
+{
+    struct list* bucket = &part->inode_hash[inode_no % INODE_HASH_CNT];
+    struct list_elem* elem = bucket->head.next;
+    while(elem != &bucket->tail) {
+        struct inode* inode_found = elem2entry(struct inode, inode_tag, elem);
         if(inode_found->i_no == inode_no) {
-            inode_found->i_open_cnts++;
             return inode_found;
         }
         elem = elem->next;
     }
+    return NULL;
+}
+
+/*增加缓存中inode的打开数，原来没有打开者时将其移出inode_lru，需持有inode_lock的写锁*/
+static void inode_cache_get(struct partition* part, struct inode* inode)
+{
+    if(inode->i_open_cnts == 0) {
+        list_remove(&inode->lru_tag);
+        part->inode_lru_cnt--;
+    }
+    inode->i_open_cnts++;
+}
+
+/*将新建的inode加入分区part的内存inode缓存，打开数置为1*/
+void inode_cache_add(struct partition* part, struct inode* inode)
+{
+    inode->i_open_cnts = 1;
+    enum intr_status old_status = write_lock(&part->inode_lock);
+    ASSERT(inode_cache_find(part, inode->i_no) == NULL);
+    list_push(&part->inode_hash[inode->i_no % INODE_HASH_CNT], &inode->inode_tag);
+    write_unlock(&part->inode_lock, old_status);
+}
+
+/*根据i节点号返回相应的i节点*/
+struct inode* inode_open(struct partition* part, uint32_t inode_no)
+{
+    //先在内存inode缓存中找，已打开的inode只需原子地增加打开数，持读锁即可。
+    //持读锁时打开数不会减少，别的读者可能同时在增加，所以要原子地加
+    enum intr_status old_status = read_lock(&part->inode_lock);
+    struct inode* inode_found = inode_cache_find(part, inode_no);
+    if(inode_found != NULL && inode_found->i_open_cnts > 0) {
+        asm volatile ("lock incl %0" : "+m"(inode_found->i_open_cnts) : : "memory");
+        read_unlock(&part->inode_lock, old_status);
+        return inode_found;
+    }
+    read_unlock(&part->inode_lock, old_status);
+
+    //在inode_lru中的inode要移出链表，需持写锁，释放读锁期间它可能已被换出，要再找一次
+    if(inode_found != NULL) {
+        old_status = write_lock(&part->inode_lock);
+        inode_found = inode_cache_find(part, inode_no);
+        if(inode_found != NULL) {
+            inode_cache_get(part, inode_found);
+        }
+        write_unlock(&part->inode_lock, old_status);
+        if(inode_found != NULL) {
+            return inode_found;
+        }
+    }
 
-    //由于open_inodes链表中找不到，从硬盘上读取此inode并加入到此链表
+    //缓存中找不到，从硬盘上读取此inode并加入缓存
     struct inode_position inode_pos;
     inode_locate(part, inode_no, &inode_pos);   //定位此inode
 
-    //为使通过sys_malloc创建的新inode被所有任务共享，需要将inode只与内核空间
-    //所以需要临时将cur_pcb->pgdir置为NULL
-    struct task_struct* cur = running_thread();
-    uint32_t* cur_pagedir_bak = cur->pgdir;
-    cur->pgdir = NULL;   //后面分配的内存将位于内核区
-    inode_found = (struct indoe*)sys_malloc(sizeof(struct inode));
-    cur->pgdir = cur_pagedir_bak;   //恢复pgdir
+    //inode要被所有任务共享，从内核的inode缓存中分配
+    inode_found = kmem_cache_alloc(inode_cache);
+    if(inode_found == NULL) {
+        return NULL;
+    }
 
     char* inode_buf;   //从硬盘读取inode的缓冲区
     if(inode_pos.two_sec) {
         inode_buf = (char*)sys_malloc(1024);
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
+        bcache_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
     } else {
         inode_buf = (char*)sys_malloc(512);
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+        bcache_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
     }
-    memcpy(inode_found, inode_buf + inode_pos.off_size, sizeof(struct inode));
+    memcpy(inode_found, inode_buf + inode_pos.off_size, INODE_DISK_SIZE);
+    inode_found->bmap_lba = 0;
+    inode_found->alloc_goal = inode_found->prealloc_cnt = inode_found->prealloc_want = 0;
+    rwsem_init(&inode_found->i_rwsem);
 
-    //根据程序局部性原理，一会很可能会用到此inode，将其插入到队首便于提前检索到
-    list_push(&part->open_inodes, &inode_found->inode_tag);
-    inode_found->i_open_cnts = 1;
-    
     sys_free(inode_buf);
+
+    //读盘时可能阻塞，期间别的任务也许已经打开了此inode，加入缓存前要再找一次
+    old_status = write_lock(&part->inode_lock);
+    struct inode* inode_exist = inode_cache_find(part, inode_no);
+    if(inode_exist == NULL) {
+        inode_found->i_open_cnts = 1;
+        list_push(&part->inode_hash[inode_no % INODE_HASH_CNT], &inode_found->inode_tag);
+    } else {
+        inode_cache_get(part, inode_exist);
+    }
+    write_unlock(&part->inode_lock, old_status);
+
+    if(inode_exist != NULL) {
+        kmem_cache_free(inode_cache, inode_found);
+        inode_found = inode_exist;
+    }
     return inode_found;
 }
 
-/*关闭inode或减少inode的打开数*/
-void inode_close(struct inode* inode)
+/*减少inode的打开数。没有打开者时归还预留的块，drop为false则放到inode_lru队尾继续缓存，
+  超出INODE_LRU_MAX时换出最久未用的；drop为true则直接从缓存中去掉释放*/
+static void inode_put(struct partition* part, struct inode* inode, bool drop)
 {
-    //若没有进程在打开此文件，将此inode去掉并释放空间
-    enum intr_status old_status = intr_disable();
+    struct inode* victim = NULL;   //要释放的inode
+    uint32_t prealloc_lba = 0, prealloc_cnt = 0;   //要归还的预留块
+    enum intr_status old_status = write_lock(&part->inode_lock);
     if(--inode->i_open_cnts == 0) {
-        list_remove(&inode->inode_tag);   //将i节点从part->open_inodes中去掉
-        //释放inode空间，该部分内存在内核空间
-        struct task_struct* cur = running_thread();
-        uint32_t* cur_pagedir_bak = cur->pgdir;
-        cur->pgdir = NULL;
-        sys_free(inode);
-        cur->pgdir = cur_pagedir_bak;
+        //解锁后inode可能被别的任务换出，预留块先取下来
+        prealloc_lba = inode->alloc_goal;
+        prealloc_cnt = inode->prealloc_cnt;
+        inode->prealloc_cnt = 0;
+        if(drop) {
+            victim = inode;
+        } else {
+            list_append(&part->inode_lru, &inode->lru_tag);
+            if(++part->inode_lru_cnt > INODE_LRU_MAX) {
+                victim = elem2entry(struct inode, lru_tag, list_pop(&part->inode_lru));
+                part->inode_lru_cnt--;
+            }
+        }
+        if(victim != NULL) {
+            list_remove(&victim->inode_tag);   //将i节点从哈希桶中去掉
+        }
+    }
+    write_unlock(&part->inode_lock, old_status);
+
+    //归还预留了还没用的块
+    while(prealloc_cnt-- > 0) {
+        block_bitmap_free(part, prealloc_lba);
+        prealloc_lba += BLOCK_SECS;
+    }
+
+    //释放inode空间，归还内核的inode缓存。归还时可能在缓存锁上阻塞，不能持有自旋的写锁
+    if(victim != NULL) {
+        kmem_cache_free(inode_cache, victim);
     }
-    intr_set_status(old_status);
+}
+
+/*关闭inode或减少inode的打开数*/
+void inode_close(struct inode* inode)
+{
+    inode_put(cur_part, inode, false);
 }
 
 /*初始化new_indoe*/
@@ -139,10 +250,13 @@ void inode_init(uint32_t inode_no, struct inode* new_inode)
     new_inode->i_size = 0;
     new_inode->i_open_cnts = 0;
     new_inode->write_deny = false;
+    new_inode->bmap_lba = 0;
+    new_inode->alloc_goal = new_inode->prealloc_cnt = new_inode->prealloc_want = 0;
+    rwsem_init(&new_inode->i_rwsem);
 
     //初始化索引数组i_sector
     uint8_t sec_idx = 0;
-    while(sec_idx < 13) {
+    while(sec_idx <= INODE_TIND) {
         new_inode->i_sectors[sec_idx] = 0;
         sec_idx++;
     }
@@ -158,14 +272,174 @@ void inode_delete(struct partition* part, uint32_t inode_no, void* io_buf)
 
     char* inode_buf = (char*)io_buf;
     if(inode_pos.two_sec) {   //inode跨扇区，读入2个扇区
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
-        memset((inode_buf + inode_pos.off_size), 0, sizeof(struct inode));   //将inode_buf清0
-        ide_write(part->my_disk, inode_pos.sec_lba, inode_buf, 2);   //用清0的内存数据覆盖磁盘
+        bcache_read(part->my_disk, inode_pos.sec_lba, inode_buf, 2);
+        memset((inode_buf + inode_pos.off_size), 0, INODE_DISK_SIZE);   //将inode_buf清0
+        bcache_write(part->my_disk, inode_pos.sec_lba, inode_buf, 2);   //用清0的内存数据覆盖磁盘
     } else {
-        ide_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
-        memset((inode_buf + inode_pos.off_size), 0, sizeof(struct inode));
-        ide_write(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+        bcache_read(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+        memset((inode_buf + inode_pos.off_size), 0, INODE_DISK_SIZE);
+        bcache_write(part->my_disk, inode_pos.sec_lba, inode_buf, 1);
+    }
+}
+
+/*在part上为inode分配一块并同步块位图，失败返回-1。块紧接inode上次分配的块，使文件的块在硬盘上相连。
+  预留的块用完时按prealloc_want一次预留一段，之后直接从中取*/
+static int32_t block_alloc(struct partition* part, struct inode* inode)
+{
+    if(inode->prealloc_cnt == 0) {
+        uint32_t want = inode->prealloc_want != 0 ? inode->prealloc_want : 1;
+        int32_t run_lba = block_bitmap_alloc_run(part, inode->alloc_goal, want, &inode->prealloc_cnt);
+        if(run_lba == -1) {
+            return -1;
+        }
+        inode->alloc_goal = run_lba;
+    }
+    int32_t block_lba = inode->alloc_goal;
+    inode->alloc_goal += BLOCK_SECS;
+    inode->prealloc_cnt--;
+    return block_lba;
+}
+
+/*取inode的间接块table_lba中第idx项，为0时create为true则分配一块填进去，分配的是间接块时清零。
+  间接块按扇区经块缓存读写，第idx项在第idx / PTRS_PER_SECTOR个扇区。
+  末级块表(is_table为false)的扇区复制到inode->bmap_ptrs，再查同一扇区时不必经块缓存。
+  返回该项的块地址，没分配返回0，分配失败返回-1*/
+static int32_t bmap_entry(struct partition* part, struct inode* inode, uint32_t table_lba, uint32_t idx, bool create, bool is_table)
+{
+    uint32_t sec_lba = table_lba + idx / PTRS_PER_SECTOR;
+    idx %= PTRS_PER_SECTOR;
+    if(!is_table && inode->bmap_lba == sec_lba && (inode->bmap_ptrs[idx] != 0 || !create)) {
+        return inode->bmap_ptrs[idx];
+    }
+
+    struct buffer_head* bh = bread(part->my_disk, sec_lba);
+    uint32_t* table = (uint32_t*)bh->data;
+    int32_t block_lba = table[idx];
+    if(block_lba == 0 && create) {
+        block_lba = block_alloc(part, inode);
+        if(block_lba != -1) {
+            if(is_table) {
+                block_zero(part, block_lba);
+            }
+            table[idx] = block_lba;
+            bwrite(bh);
+        }
+    }
+    if(!is_table) {
+        memcpy(inode->bmap_ptrs, table, SECTOR_SIZE);
+        inode->bmap_lba = sec_lba;
     }
+    brelse(bh);
+    return block_lba;
+}
+
+/*返回inode第block_idx块的起始扇区地址，没分配时create为true则分配，否则返回0。分配失败返回-1。
+  0~11块是直接块，之后依次经一级、二级、三级间接块查找，间接块经块缓存读写。
+  分配了间接块时inode被修改，由调用者同步到硬盘*/
+int32_t inode_bmap(struct partition* part, struct inode* inode, uint32_t block_idx, bool create)
+{
+    ASSERT(block_idx < INODE_MAX_BLOCKS);
+    if(block_idx < INODE_DIRECT_BLOCKS) {
+        if(inode->i_sectors[block_idx] == 0 && create) {
+            int32_t block_lba = block_alloc(part, inode);
+            if(block_lba == -1) {
+                return -1;
+            }
+            inode->i_sectors[block_idx] = block_lba;
+        }
+        return inode->i_sectors[block_idx];
+    }
+
+    //确定间接的级数，levels为经过的间接块数，block_idx变为该级间接树内的下标
+    block_idx -= INODE_DIRECT_BLOCKS;
+    uint32_t levels = 1, span = PTRS_PER_BLOCK;   //span为该级间接树能映射的块数
+    while(block_idx >= span) {
+        block_idx -= span;
+        span *= PTRS_PER_BLOCK;
+        levels++;
+    }
+    uint32_t top = INODE_IND + levels - 1;
+    if(inode->i_sectors[top] == 0) {
+        if(!create) {
+            return 0;
+        }
+        int32_t table_lba = block_alloc(part, inode);
+        if(table_lba == -1) {
+            return -1;
+        }
+        block_zero(part, table_lba);
+        inode->i_sectors[top] = table_lba;
+    }
+
+    int32_t block_lba = inode->i_sectors[top];
+    while(levels > 0) {
+        span /= PTRS_PER_BLOCK;   //下一级每一项映射的块数
+        block_lba = bmap_entry(part, inode, block_lba, block_idx / span, create, levels > 1);
+        if(block_lba <= 0) {
+            return block_lba;
+        }
+        block_idx %= span;
+        levels--;
+    }
+    return block_lba;
+}
+
+/*回收以block_lba为根、有levels级间接的块树，levels为0时只是一个数据块*/
+static void block_tree_free(struct partition* part, uint32_t block_lba, uint32_t levels)
+{
+    uint32_t sec_idx;
+    for(sec_idx = 0; levels > 0 && sec_idx < BLOCK_SECS; sec_idx++) {
+        struct buffer_head* bh = bread(part->my_disk, block_lba + sec_idx);
+        uint32_t* table = (uint32_t*)bh->data;
+        uint32_t idx;
+        for(idx = 0; idx < PTRS_PER_SECTOR; idx++) {
+            if(table[idx] != 0) {
+                block_tree_free(part, table[idx], levels - 1);
+            }
+        }
+        brelse(bh);
+    }
+    block_bitmap_free(part, block_lba);
+}
+
+/*回收目录inode的第block_idx块并从索引中去掉，一级间接块表空了也一并回收。
+  inode被修改，由调用者同步到硬盘*/
+void inode_unmap(struct partition* part, struct inode* inode, uint32_t block_idx)
+{
+    ASSERT(block_idx < DIR_MAX_BLOCKS);
+    if(block_idx < INODE_DIRECT_BLOCKS) {
+        ASSERT(inode->i_sectors[block_idx] != 0);
+        block_bitmap_free(part, inode->i_sectors[block_idx]);
+        inode->i_sectors[block_idx] = 0;
+        return;
+    }
+
+    //在一级间接块表中擦除该块地址
+    block_idx -= INODE_DIRECT_BLOCKS;
+    uint32_t table_lba = inode->i_sectors[INODE_IND];
+    ASSERT(table_lba != 0);
+    struct buffer_head* bh = bread(part->my_disk, table_lba + block_idx / PTRS_PER_SECTOR);
+    uint32_t* table = (uint32_t*)bh->data;
+    ASSERT(table[block_idx % PTRS_PER_SECTOR] != 0);
+    block_bitmap_free(part, table[block_idx % PTRS_PER_SECTOR]);
+    table[block_idx % PTRS_PER_SECTOR] = 0;
+    bwrite(bh);
+    brelse(bh);
+    inode->bmap_lba = 0;   //缓存的块表扇区已过时
+
+    //表中已没有别的块时连同表所在的块一起回收
+    uint32_t sec_idx, idx;
+    for(sec_idx = 0; sec_idx < BLOCK_SECS; sec_idx++) {
+        bh = bread(part->my_disk, table_lba + sec_idx);
+        table = (uint32_t*)bh->data;
+        for(idx = 0; idx < PTRS_PER_SECTOR && table[idx] == 0; idx++);
+        brelse(bh);
+        if(idx < PTRS_PER_SECTOR) {
+            return;
+        }
+    }
+    block_bitmap_free(part, table_lba);
+    inode->i_sectors[INODE_IND] = 0;
 }
 
 /*回收inode的数据块和inode本身*/
@@ -174,50 +448,31 @@ void inode_release(struct partition* part, uint32_t inode_no)
     struct inode* inode_to_del = inode_open(part, inode_no);
     ASSERT(inode_to_del->i_no == inode_no);
 
-    //1. 回收inode占用的所有块
-    uint8_t block_idx = 0, block_cnt = 12;
-    uint32_t block_bitmap_idx;
-    uint32_t all_blocks[140] = {0};   //12个直接块 + 128个间接块
-
-    //a 先将前12个直接块存入all_blocks
-    while(block_idx < 12) {
-        all_blocks[block_idx] = inode_to_del->i_sectors[block_idx];
-        block_idx++;
-    }
-
-    //b 如果一级间接块表存在，将其128个间接块索引读到all_blocks[12~]，并释放一级间接块表所占的扇区
-    if(inode_to_del->i_sectors[12] != 0) {
-        ide_read(part->my_disk, inode_to_del->i_sectors[12], all_blocks + 12, 1);
-        block_cnt = 140;
-
-        //回收一级间接块表占用的扇区
-        block_bitmap_idx = inode_to_del->i_sectors[12] - part->sb->data_start_lba;
-        ASSERT(block_bitmap_idx > 0);
-        bitmap_set(&part->block_bitmap, block_bitmap_idx, 0);
-        bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
-    }
-
-    //c inode所有的块地址已经收集到all_blocks中，下面逐个回收
-    block_idx = 0;
-    while(block_idx < block_cnt) {
-        if(all_blocks[block_idx] != 0) {
-            block_bitmap_idx = 0;
-            block_bitmap_idx = all_blocks[block_idx] - part->sb->data_start_lba;
-            ASSERT(block_bitmap_idx > 0);
-            bitmap_set(&part->block_bitmap, block_bitmap_idx, 0);
-            bitmap_sync(cur_part, block_bitmap_idx, BLOCK_BITMAP);
+    //1. 回收inode占用的所有块，直接块和各级间接块树
+    uint32_t block_idx;
+    for(block_idx = 0; block_idx < INODE_DIRECT_BLOCKS; block_idx++) {
+        if(inode_to_del->i_sectors[block_idx] != 0) {
+            block_bitmap_free(part, inode_to_del->i_sectors[block_idx]);
+        }
+    }
+    for(block_idx = INODE_IND; block_idx <= INODE_TIND; block_idx++) {
+        if(inode_to_del->i_sectors[block_idx] != 0) {
+            block_tree_free(part, inode_to_del->i_sectors[block_idx], block_idx - INODE_IND + 1);
         }
-        block_idx++;
     }
 
     //2. 回收该inode所占用的inode
-    bitmap_set(&part->inode_bitmap, inode_no, 0);
-    bitmap_sync(cur_part, inode_no, INODE_BITMAP);
+    inode_bitmap_free(part, inode_no);
 
     //一下inode_delete是调试用
     void* io_buf = sys_malloc(1024);
     inode_delete(part, inode_no, io_buf);
     sys_free(io_buf);
 
-    inode_close(inode_to_del);
+    //文件的缓存页也要丢掉，否则inode号再分配后会读到旧文件的内容
+    pcache_drop(part, inode_no);
+    exec_cache_invalidate(part, inode_no);
+
+    //inode已删除，不能留在缓存里，否则inode号再分配时会找到旧的inode
+    inode_put(part, inode_to_del, true);
 }
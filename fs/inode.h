@@ -4,6 +4,21 @@
 #include "global.h"
 #include "list.h"
 #include "ide.h"
+#include "fs.h"
+
+#define INODE_DIRECT_BLOCKS 12   //直接块数
+#define INODE_IND 12   //i_sectors中一级间接块的下标
+#define INODE_DIND 13   //二级间接块的下标
+#define INODE_TIND 14   //三级间接块的下标
+#define PTRS_PER_BLOCK (BLOCK_SIZE / 4)   //一个间接块中的块地址数
+#define PTRS_PER_SECTOR (SECTOR_SIZE / 4)   //间接块一个扇区中的块地址数
+#define INODE_MAX_BLOCKS (INODE_DIRECT_BLOCKS + PTRS_PER_BLOCK + PTRS_PER_BLOCK * PTRS_PER_BLOCK + \
+                          PTRS_PER_BLOCK * PTRS_PER_BLOCK * PTRS_PER_BLOCK)   //一个文件最多的块数
+#define INODE_MAX_SIZE ((uint64_t)BLOCK_SIZE * INODE_MAX_BLOCKS > 0xffffffff ? 0xffffffff : \
+                        (uint32_t)((uint64_t)BLOCK_SIZE * INODE_MAX_BLOCKS))   //文件最大字节数，i_size是32位的
+#define DIR_MAX_BLOCKS (INODE_DIRECT_BLOCKS + PTRS_PER_BLOCK)   //目录只用直接块和一级间接块
+#define INODE_HASH_CNT 64   //每个分区内存inode的哈希桶数
+#define INODE_LRU_MAX 64   //每个分区最多缓存的没有打开者的inode数
 
 /*inode结构*/
 struct inode
@@ -15,12 +30,28 @@ struct inode
     uint32_t i_open_cnts;   //记录此文件被打开的次数
     bool write_deny;        //写文件不能并行，进程写文件前检查此标志
 
-    uint32_t i_sectors[13]; //0~11是直接块，12永远存储一级间接块指针
-    struct list_elem inode_tag;   //此inode的标识，用于加入已打开的inode列表
+    uint32_t i_sectors[15]; //0~11是直接块，12、13、14分别存储一级、二级、三级间接块指针
+    struct list_elem inode_tag;   //此inode的标识，用于加入分区的inode哈希桶
+    struct list_elem lru_tag;   //没有打开者时用于加入分区的inode_lru
+    uint32_t bmap_lba;   //bmap_ptrs是哪个末级块表扇区的副本，为0表示没有
+    uint32_t bmap_ptrs[PTRS_PER_SECTOR];   //最近查找经过的末级块表扇区，顺序读写时多数块地址在这里就能查到
+    uint32_t alloc_goal;   //下次分配块的目标地址，紧接上次分配的块，为0表示没有目标
+    uint32_t prealloc_cnt;   //从alloc_goal起已预留还没用的块数
+    uint32_t prealloc_want;   //用完后每次预留的块数，为0时不预留，由file_write设置
+    struct rw_semaphore i_rwsem;   //读文件和查目录持读锁，写文件和增删目录项持写锁
 };
 
+/*inode在硬盘上占的字节数，到inode_tag.prev为止，其后的成员只在内存中有意义，不写入硬盘，这样inode表的格式保持不变*/
+#define INODE_DISK_SIZE (offset(struct inode, inode_tag) + sizeof(struct list_elem*))
+
 /*将inode写入到分区part，io_buf是用于硬盘io的缓冲区*/
 void inode_sync(struct partition* part, struct inode* inode, void* io_buf);
+extern struct kmem_cache* inode_cache;
+
+/*初始化分区part的内存inode缓存*/
+void inode_cache_init(struct partition* part);
+/*将新建的inode加入分区part的内存inode缓存，打开数置为1*/
+void inode_cache_add(struct partition* part, struct inode* inode);
 /*根据i节点号返回相应的i节点*/
 struct inode* inode_open(struct partition* part, uint32_t inode_no);
 /*关闭inode或减少inode的打开数*/
@@ -29,6 +60,10 @@ void inode_close(struct inode* inode);
 void inode_init(uint32_t inode_no, struct inode* new_inode);
 /*将硬盘分区part上的inode清空*/
 void inode_delete(struct partition* part, uint32_t inode_no, void* io_buf);
+/*返回inode第block_idx块的起始扇区地址，没分配时create为true则分配，否则返回0。分配失败返回-1*/
+int32_t inode_bmap(struct partition* part, struct inode* inode, uint32_t block_idx, bool create);
+/*回收目录inode的第block_idx块并从索引中去掉，一级间接块表空了也一并回收*/
+void inode_unmap(struct partition* part, struct inode* inode, uint32_t block_idx);
 /*回收inode的数据块和inode本身*/
 void inode_release(struct partition* part, uint32_t inode_no);
 
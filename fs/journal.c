@@ -0,0 +1,269 @@
+#include "journal.h"
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "sync.h"
+#include "thread.h"
+#include "interrupt.h"
+#include "debug.h"
+#include "string.h"
+#include "ide.h"
+#include "bcache.h"
+#include "file.h"
+#include "super_block.h"
+#include "stdio-kernel.h"
+
+/*元数据日志。修改元数据的操作在journal_begin和journal_end之间进行，期间写入块缓存的块记入运行中的事务，
+  钉在缓存里不写回原位置。提交时等进行中的操作都结束，把事务中的块一次顺序写入日志区，
+  再写提交扇区，之后这些块转为普通脏块由回写线程按时写回，日志区快满时才全部写回并从头开始*/
+static struct journal
+{
+    struct partition* part;   //日志所在的分区，为NULL表示还没有挂载，不记日志
+    uint32_t lba;   //日志区起始扇区，即日志超级块
+    uint32_t sects;   //日志区扇区数
+    uint32_t head;   //下一个事务写入的位置，相对于lba
+    uint32_t seq;   //下一个提交的事务序号
+    uint32_t handles;   //运行中的事务里尚未结束的操作数
+    bool committing;   //正在提交，新操作要等提交完
+    struct task_struct* committer;   //等handles归0的提交者
+    struct list waiters;   //等提交完才能开始操作的线程
+    struct lock commit_lock;   //同一时刻只有一个提交者
+    struct list running;   //运行中的事务修改过的缓存块
+    uint32_t running_cnt;
+} journal;
+
+static struct journal_header desc_buf;   //描述扇区，恢复时也用来读各种日志扇区
+static struct journal_header commit_buf;
+static uint8_t replay_buf[SECTOR_SIZE];
+static struct io_seg segs[JOURNAL_TRANS_MAX + 1];
+
+/*把日志超级块写成从头开始、首个事务序号为journal.seq，已提交的事务都已写回原位置后才能调用*/
+static void journal_reset(struct disk* hd)
+{
+    memset(&commit_buf, 0, SECTOR_SIZE);
+    commit_buf.magic = JOURNAL_MAGIC;
+    commit_buf.type = JOURNAL_SUPER;
+    commit_buf.seq = journal.seq;
+    struct io_seg seg = {journal.lba, &commit_buf, 1};
+    ide_writev(hd, &seg, 1);
+    journal.head = 1;
+}
+
+/*从日志区开头重放同序号相连、带提交扇区的事务，返回重放的事务数，不完整的事务及其后的内容丢弃*/
+static uint32_t journal_replay(struct disk* hd)
+{
+    struct journal_header* hdr = &desc_buf;
+    ide_read(hd, journal.lba, hdr, 1);
+    if(hdr->magic != JOURNAL_MAGIC || hdr->type != JOURNAL_SUPER) {
+        printk("journal: bad journal super block, skip recovery\n");
+        journal.seq = 1;
+        return 0;
+    }
+    journal.seq = hdr->seq;
+
+    uint32_t pos = 1, replayed = 0;
+    while(1) {
+        //先确认事务完整，即各描述扇区之后有同序号的提交扇区
+        uint32_t end = pos;
+        bool complete = false;
+        while(end < journal.sects) {
+            ide_read(hd, journal.lba + end, hdr, 1);
+            if(hdr->magic != JOURNAL_MAGIC || hdr->seq != journal.seq) {
+                break;
+            }
+            if(hdr->type == JOURNAL_COMMIT) {
+                complete = true;
+                break;
+            }
+            if(hdr->type != JOURNAL_DESC || hdr->cnt > JOURNAL_DESC_LBAS) {
+                break;
+            }
+            end += 1 + hdr->cnt;
+        }
+        if(!complete) {
+            break;
+        }
+
+        //再把各扇区写回原位置
+        while(pos < end) {
+            ide_read(hd, journal.lba + pos, hdr, 1);
+            uint32_t idx;
+            for(idx = 0; idx < hdr->cnt; idx++) {
+                ide_read(hd, journal.lba + pos + 1 + idx, replay_buf, 1);
+                bcache_write(hd, hdr->lbas[idx], replay_buf, 1);
+            }
+            pos += 1 + hdr->cnt;
+        }
+        pos = end + 1;
+        journal.seq++;
+        replayed++;
+    }
+    return replayed;
+}
+
+/*挂载分区part时调用，重放日志中已提交的事务，之后part上的元数据修改都先记日志*/
+void journal_init(struct partition* part)
+{
+    struct disk* hd = part->my_disk;
+    journal.lba = part->sb->journal_lba;
+    journal.sects = part->sb->journal_sects;
+    journal.handles = 0;
+    journal.committing = false;
+    journal.committer = NULL;
+    list_init(&journal.waiters);
+    lock_init(&journal.commit_lock);
+    list_init(&journal.running);
+    journal.running_cnt = 0;
+
+    bcache_sync(hd);   //格式化时写的日志超级块还在块缓存里，先落盘，下面直接读写硬盘上的日志区
+    uint32_t replayed = journal_replay(hd);
+    if(replayed > 0) {
+        bcache_sync(hd);
+        printk("journal: replayed %d transactions\n", replayed);
+    }
+    journal.seq++;   //跳过可能写了一半的那个序号，免得残留的扇区被当成新事务的一部分
+    journal_reset(hd);
+    journal.part = part;
+}
+
+/*开始一个修改元数据的操作，期间写入块缓存的块都记入运行中的事务，可嵌套。正在提交时等提交完再开始*/
+void journal_begin(void)
+{
+    struct task_struct* cur = running_thread();
+    if(cur->journal_nest++ > 0 || journal.part == NULL) {
+        return;
+    }
+    if(journal.running_cnt >= JOURNAL_TRANS_SOFT) {   //事务太大，趁还没开始先提交，免得钉住太多缓存块
+        journal_commit();
+    }
+    enum intr_status old_status = intr_disable();
+    while(journal.committing) {
+        list_append(&journal.waiters, &cur->general_tag);
+        thread_block(TASK_BLOCKED);
+    }
+    journal.handles++;
+    intr_set_status(old_status);
+}
+
+/*结束journal_begin开始的操作，最后一个操作结束时唤醒等待的提交者*/
+void journal_end(void)
+{
+    struct task_struct* cur = running_thread();
+    ASSERT(cur->journal_nest > 0);
+    if(--cur->journal_nest > 0 || journal.part == NULL) {
+        return;
+    }
+    enum intr_status old_status = intr_disable();
+    ASSERT(journal.handles > 0);
+    if(--journal.handles == 0 && journal.committer != NULL) {
+        thread_unblock(journal.committer);
+        journal.committer = NULL;
+    }
+    intr_set_status(old_status);
+}
+
+/*当前线程在操作中时把bh记入运行中的事务并返回true，否则返回false，由bwrite调用，调用者持有bh的引用。
+  事务已满时返回false，超出的块直接按普通脏块写回*/
+bool journal_dirty(struct buffer_head* bh)
+{
+    if(journal.part == NULL || running_thread()->journal_nest == 0 || bh->hd != journal.part->my_disk) {
+        return false;
+    }
+    bool ret = true;
+    enum intr_status old_status = intr_disable();
+    if(!bh->jdirty) {
+        if(journal.running_cnt < JOURNAL_TRANS_MAX) {
+            bh->jdirty = true;
+            bh->ref_cnt++;   //调用者持有引用，块不在lru队列中，直接加。提交后才去掉
+            list_append(&journal.running, &bh->j_tag);
+            journal.running_cnt++;
+        } else {
+            ret = false;
+        }
+    }
+    intr_set_status(old_status);
+    return ret;
+}
+
+/*把运行中的事务写入日志区：描述扇区和各块数据一次顺序写入，写完再写提交扇区。
+  之后各块交给回写线程写回原位置，调用时没有进行中的操作*/
+static void journal_write(struct disk* hd)
+{
+    ASSERT(journal.head + journal.running_cnt + 2 <= journal.sects);
+    uint32_t lba = journal.lba + journal.head;
+    uint32_t seg_cnt = 0;
+    memset(&desc_buf, 0, SECTOR_SIZE);
+    desc_buf.magic = JOURNAL_MAGIC;
+    desc_buf.type = JOURNAL_DESC;
+    desc_buf.seq = journal.seq;
+    segs[seg_cnt].lba = lba++;
+    segs[seg_cnt].buf = &desc_buf;
+    segs[seg_cnt++].sec_cnt = 1;
+
+    //没有进行中的操作，事务中的块不会再被修改，直接从缓存块写出，不必另外复制
+    struct list_elem* elem = journal.running.head.next;
+    while(elem != &journal.running.tail) {
+        struct buffer_head* bh = elem2entry(struct buffer_head, j_tag, elem);
+        desc_buf.lbas[desc_buf.cnt++] = bh->lba;
+        segs[seg_cnt].lba = lba++;
+        segs[seg_cnt].buf = bh->data;
+        segs[seg_cnt++].sec_cnt = 1;
+        elem = elem->next;
+    }
+    ide_writev(hd, segs, seg_cnt);   //各段lba相连，合并成一条命令
+
+    memset(&commit_buf, 0, SECTOR_SIZE);
+    commit_buf.magic = JOURNAL_MAGIC;
+    commit_buf.type = JOURNAL_COMMIT;
+    commit_buf.seq = journal.seq;
+    struct io_seg seg = {lba, &commit_buf, 1};
+    ide_writev(hd, &seg, 1);
+    journal.head += seg_cnt + 1;
+    journal.seq++;
+
+    while(!list_empty(&journal.running)) {
+        struct buffer_head* bh = elem2entry(struct buffer_head, j_tag, list_pop(&journal.running));
+        bjournal_done(bh);
+    }
+    journal.running_cnt = 0;
+}
+
+/*把运行中的事务连同内存中的脏位图一次写入日志，期间完成的各操作都在这一次提交里。
+  日志区剩余空间不够下一个事务时做检查点：已提交的块全部写回原位置，日志区从头开始*/
+void journal_commit(void)
+{
+    if(journal.part == NULL) {
+        return;
+    }
+    lock_acquire(&journal.commit_lock);
+    struct task_struct* cur = running_thread();
+    enum intr_status old_status = intr_disable();
+    journal.committing = true;
+    if(journal.handles > 0) {   //等已开始的操作都结束
+        journal.committer = cur;
+        thread_block(TASK_BLOCKED);
+    }
+    intr_set_status(old_status);
+
+    //两次提交之间位图只改在内存中，此时没有进行中的操作，位图与已完成的操作一致，一并记入本事务
+    cur->journal_nest++;
+    bitmap_flush(journal.part);
+    cur->journal_nest--;
+
+    struct disk* hd = journal.part->my_disk;
+    if(journal.running_cnt > 0) {
+        journal_write(hd);
+        if(journal.sects - journal.head < JOURNAL_RESERVE) {
+            bcache_sync(hd);
+            journal_reset(hd);
+        }
+    }
+
+    old_status = intr_disable();
+    journal.committing = false;
+    while(!list_empty(&journal.waiters)) {
+        thread_unblock(elem2entry(struct task_struct, general_tag, list_pop(&journal.waiters)));
+    }
+    intr_set_status(old_status);
+    lock_release(&journal.commit_lock);
+}
@@ -0,0 +1,46 @@
+#ifndef __FS_JOURNAL_H
+#define __FS_JOURNAL_H
+#include "stdint.h"
+#include "global.h"
+#include "fs.h"
+
+#define JOURNAL_SECTS 1024   //日志区占用的扇区数，第一个扇区是日志超级块
+#define JOURNAL_MAGIC 0x4a4f5552   //日志区中各描述扇区的标志
+#define JOURNAL_DESC_LBAS ((SECTOR_SIZE - 16) / 4)   //一个描述扇区最多记录的扇区数
+#define JOURNAL_TRANS_MAX JOURNAL_DESC_LBAS   //一个事务最多记录的元数据扇区数，这些块在提交前都钉在块缓存里
+#define JOURNAL_TRANS_SOFT (JOURNAL_TRANS_MAX / 2)   //运行中的事务超过这个数时，新操作开始前先提交
+#define JOURNAL_RESERVE (JOURNAL_TRANS_MAX + 2)   //日志区剩余不足一个最大的事务时做检查点
+
+struct partition;
+struct buffer_head;
+
+/*日志区中扇区的类型*/
+enum journal_type
+{
+    JOURNAL_SUPER = 1,   //日志超级块，记录日志区开头第一个事务的序号
+    JOURNAL_DESC,   //描述扇区，后面紧跟cnt个扇区的数据
+    JOURNAL_COMMIT   //提交扇区，出现在硬盘上说明同序号的事务已完整写入
+};
+
+/*日志区中的描述扇区，日志超级块和提交扇区也用这个格式*/
+struct journal_header
+{
+    uint32_t magic;
+    uint32_t type;
+    uint32_t seq;   //事务序号
+    uint32_t cnt;   //lbas中有效的个数
+    uint32_t lbas[JOURNAL_DESC_LBAS];   //后面各扇区数据的原位置
+};
+
+/*挂载分区part时调用，重放日志中已提交的事务，之后part上的元数据修改都先记日志*/
+void journal_init(struct partition* part);
+/*开始一个修改元数据的操作，期间写入块缓存的块都记入运行中的事务，可嵌套*/
+void journal_begin(void);
+/*结束journal_begin开始的操作*/
+void journal_end(void);
+/*当前线程在操作中时把bh记入运行中的事务并返回true，否则返回false，由bwrite调用*/
+bool journal_dirty(struct buffer_head* bh);
+/*把运行中的事务连同内存中的脏位图一次写入日志，期间完成的各操作都在这一次提交里*/
+void journal_commit(void);
+
+#endif
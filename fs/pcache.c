@@ -0,0 +1,252 @@
+#include "pcache.h"
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "string.h"
+#include "debug.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "stdio-kernel.h"
+
+static struct pcache_page* descs;   //所有页描述符
+static struct list hash_buckets[PCACHE_HASH_CNT];   //按(inode编号, 页号)散列的缓存页
+static struct list clock_list;   //缓存中的页，队首是时钟指针所指的页
+static struct list free_descs;   //不在缓存中的描述符，data为NULL
+static uint32_t page_cnt;   //缓存中的页数
+static uint32_t free_min;   //内核内存池空闲页框低于此数时不再新分配页
+static uint32_t pcache_gen;   //文件每次写入或删除加1，填充一页期间变了就不放入缓存
+
+/*按(inode编号, 页号)求哈希桶*/
+static struct list* pcache_bucket(uint32_t i_no, uint32_t pgoff)
+{
+    return &hash_buckets[(i_no * 31 + pgoff) % PCACHE_HASH_CNT];
+}
+
+/*在缓存中查找part上i_no文件的第pgoff页，需关中断调用*/
+static struct pcache_page* pcache_find(struct partition* part, uint32_t i_no, uint32_t pgoff)
+{
+    struct list* bucket = pcache_bucket(i_no, pgoff);
+    struct list_elem* elem = bucket->head.next;
+    while(elem != &bucket->tail) {
+        struct pcache_page* page = elem2entry(struct pcache_page, hash_tag, elem);
+        if(page->part == part && page->i_no == i_no && page->pgoff == pgoff) {
+            return page;
+        }
+        elem = elem->next;
+    }
+    return NULL;
+}
+
+/*按时钟算法找一页可换出的页，从缓存中摘下返回，没有返回NULL，需关中断调用。
+  指针扫过的页若最近访问过先清掉访问位，第二圈还没被访问才换出*/
+static struct pcache_page* pcache_evict(void)
+{
+    uint32_t scan = page_cnt * 2;
+    while(scan-- > 0) {
+        struct pcache_page* page = elem2entry(struct pcache_page, clock_tag, list_pop(&clock_list));
+        if(page->ref_cnt > 0 || page->referenced) {
+            page->referenced = false;
+            list_append(&clock_list, &page->clock_tag);
+            continue;
+        }
+        list_remove(&page->hash_tag);
+        page->part = NULL;
+        page_cnt--;
+        return page;
+    }
+    return NULL;
+}
+
+/*把不在缓存中的page的页框还给内核内存池，描述符放回空闲链表*/
+static void pcache_release(struct pcache_page* page)
+{
+    mfree_page(PF_KERNEL, page->data, 1);
+    page->data = NULL;
+    enum intr_status old_status = intr_disable();
+    list_push(&free_descs, &page->clock_tag);
+    intr_set_status(old_status);
+}
+
+/*内核内存池页框不够时由内存管理调用，换出最多pg_cnt页并释放页框，返回释放的页数*/
+static uint32_t pcache_reclaim(uint32_t pg_cnt)
+{
+    uint32_t freed = 0;
+    while(freed < pg_cnt) {
+        enum intr_status old_status = intr_disable();
+        struct pcache_page* page = pcache_evict();
+        intr_set_status(old_status);
+        if(page == NULL) {
+            break;
+        }
+        pcache_release(page);
+        freed++;
+    }
+    return freed;
+}
+
+/*在缓存中查找part上i_no文件的第pgoff页，命中时加一次引用返回，否则返回NULL*/
+struct pcache_page* pcache_lookup(struct partition* part, uint32_t i_no, uint32_t pgoff)
+{
+    enum intr_status old_status = intr_disable();
+    struct pcache_page* page = pcache_find(part, i_no, pgoff);
+    if(page != NULL) {
+        page->ref_cnt++;
+        page->referenced = true;
+    }
+    intr_set_status(old_status);
+    return page;
+}
+
+/*part上i_no文件的第pgoff页是否在缓存中*/
+bool pcache_cached(struct partition* part, uint32_t i_no, uint32_t pgoff)
+{
+    enum intr_status old_status = intr_disable();
+    bool cached = pcache_find(part, i_no, pgoff) != NULL;
+    intr_set_status(old_status);
+    return cached;
+}
+
+/*分配一页供调用者填充，引用计数为1，不在缓存中。gen存入当前的版本号，填充后用它调用pcache_insert。
+  内核内存池还宽裕时新分配页框，否则换出最久没用的页，内存紧张又没有可换出的页时返回NULL*/
+struct pcache_page* pcache_alloc(uint32_t* gen)
+{
+    enum intr_status old_status = intr_disable();
+    *gen = pcache_gen;
+    struct pcache_page* page = NULL;
+    if(!list_empty(&free_descs) && mem_free_pages(PF_KERNEL) > free_min) {
+        page = elem2entry(struct pcache_page, clock_tag, list_pop(&free_descs));
+        intr_set_status(old_status);
+        page->data = get_kernel_pages(1);
+        if(page->data != NULL) {
+            page->ref_cnt = 1;
+            struct page_frame* frame = virt_to_page(page->data);
+            frame->flags |= FRAME_CACHE;
+            frame->owner = page;
+            return page;
+        }
+        old_status = intr_disable();
+        list_push(&free_descs, &page->clock_tag);
+    }
+    page = pcache_evict();
+    if(page != NULL) {
+        page->ref_cnt = 1;
+    }
+    intr_set_status(old_status);
+    return page;
+}
+
+/*把填充好的page作为part上i_no文件的第pgoff页放入缓存，返回缓存中的这一页，已有时释放page返回已有的。
+  填充期间文件被写过时不放入，返回page本身，用完pcache_put时释放*/
+struct pcache_page* pcache_insert(struct pcache_page* page, struct partition* part, uint32_t i_no, uint32_t pgoff, uint32_t gen)
+{
+    enum intr_status old_status = intr_disable();
+    if(gen != pcache_gen) {   //填充时读到的可能是旧内容
+        intr_set_status(old_status);
+        return page;
+    }
+    struct pcache_page* cached = pcache_find(part, i_no, pgoff);
+    if(cached != NULL) {   //别的线程已经放进来了
+        cached->ref_cnt++;
+        cached->referenced = true;
+        intr_set_status(old_status);
+        pcache_put(page);
+        return cached;
+    }
+    page->part = part;
+    page->i_no = i_no;
+    page->pgoff = pgoff;
+    page->referenced = true;
+    list_push(pcache_bucket(i_no, pgoff), &page->hash_tag);
+    list_append(&clock_list, &page->clock_tag);
+    page_cnt++;
+    intr_set_status(old_status);
+    return page;
+}
+
+/*释放对page的引用，不在缓存中的页引用归0时释放*/
+void pcache_put(struct pcache_page* page)
+{
+    enum intr_status old_status = intr_disable();
+    ASSERT(page->ref_cnt > 0);
+    bool release = --page->ref_cnt == 0 && page->part == NULL;
+    intr_set_status(old_status);
+    if(release) {
+        pcache_release(page);
+    }
+}
+
+/*文件写入后调用，把buf中从文件pos处起的len字节同步到已缓存的页*/
+void pcache_update(struct partition* part, uint32_t i_no, uint32_t pos, const void* buf, uint32_t len)
+{
+    const uint8_t* src = buf;
+    enum intr_status old_status = intr_disable();
+    pcache_gen++;
+    intr_set_status(old_status);
+    while(len > 0) {
+        uint32_t pg_off = pos % PG_SIZE;
+        uint32_t chunk = PG_SIZE - pg_off < len ? PG_SIZE - pg_off : len;
+        struct pcache_page* page = pcache_lookup(part, i_no, pos / PG_SIZE);
+        if(page != NULL) {
+            memcpy(page->data + pg_off, src, chunk);
+            pcache_put(page);
+        }
+        src += chunk;
+        pos += chunk;
+        len -= chunk;
+    }
+}
+
+/*文件删除时调用，丢弃part上i_no文件的所有缓存页，正在用的页等最后的pcache_put时释放*/
+void pcache_drop(struct partition* part, uint32_t i_no)
+{
+    struct list dropped;
+    list_init(&dropped);
+    enum intr_status old_status = intr_disable();
+    pcache_gen++;
+    struct list_elem* elem = clock_list.head.next;
+    while(elem != &clock_list.tail) {
+        struct pcache_page* page = elem2entry(struct pcache_page, clock_tag, elem);
+        elem = elem->next;
+        if(page->part != part || page->i_no != i_no) {
+            continue;
+        }
+        list_remove(&page->hash_tag);
+        list_remove(&page->clock_tag);
+        page->part = NULL;
+        page_cnt--;
+        if(page->ref_cnt == 0) {
+            list_append(&dropped, &page->clock_tag);
+        }
+    }
+    intr_set_status(old_status);
+    while(!list_empty(&dropped)) {
+        pcache_release(elem2entry(struct pcache_page, clock_tag, list_pop(&dropped)));
+    }
+}
+
+/*初始化页缓存并向内存管理登记回收函数。页框随用随从内核内存池分配，空闲内存多时缓存就大*/
+void pcache_init(void)
+{
+    printk("pcache_init start\n");
+    descs = get_kernel_pages(DIV_ROUND_UP(PCACHE_MAX_PAGES * sizeof(struct pcache_page), PG_SIZE));
+    if(descs == NULL) {
+        PANIC("pcache_init: alloc memory failed!");
+    }
+    uint32_t idx;
+    for(idx = 0; idx < PCACHE_HASH_CNT; idx++) {
+        list_init(&hash_buckets[idx]);
+    }
+    list_init(&clock_list);
+    list_init(&free_descs);
+    for(idx = 0; idx < PCACHE_MAX_PAGES; idx++) {
+        descs[idx].part = NULL;
+        descs[idx].data = NULL;
+        descs[idx].ref_cnt = 0;
+        list_append(&free_descs, &descs[idx].clock_tag);
+    }
+    page_cnt = 0;
+    pcache_gen = 0;
+    free_min = mem_free_pages(PF_KERNEL) / PCACHE_FREE_RATIO;
+    mem_reclaim_register(pcache_reclaim);
+    printk("pcache_init done, keep %d kernel pages free\n", free_min);
+}
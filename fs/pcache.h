@@ -0,0 +1,45 @@
+#ifndef __FS_PCACHE_H
+#define __FS_PCACHE_H
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+
+#define PCACHE_MAX_PAGES 2048   //最多缓存的页数，描述符在初始化时一次分配
+#define PCACHE_HASH_CNT 256   //哈希桶数
+#define PCACHE_FREE_RATIO 4   //内核内存池空闲页少于开机时的1/PCACHE_FREE_RATIO后不再新分配页，改为换出旧页
+
+struct partition;
+
+/*页缓存中的一页，缓存part分区上inode编号为i_no的文件第pgoff页的内容*/
+struct pcache_page
+{
+    struct partition* part;   //为NULL表示不在缓存中
+    uint32_t i_no;
+    uint32_t pgoff;
+    uint32_t ref_cnt;   //为0时才可以被换出
+    bool referenced;   //时钟算法的访问位，被换出前先清掉一次
+    uint8_t* data;   //一页内容，从内核内存池分配
+    struct list_elem hash_tag;   //在哈希桶中的标记
+    struct list_elem clock_tag;   //在时钟队列中的标记，不在缓存中时挂在空闲描述符链表上
+};
+
+/*初始化页缓存并向内存管理登记回收函数*/
+void pcache_init(void);
+/*在缓存中查找part上i_no文件的第pgoff页，命中时加一次引用返回，否则返回NULL*/
+struct pcache_page* pcache_lookup(struct partition* part, uint32_t i_no, uint32_t pgoff);
+/*part上i_no文件的第pgoff页是否在缓存中*/
+bool pcache_cached(struct partition* part, uint32_t i_no, uint32_t pgoff);
+/*分配一页供调用者填充，引用计数为1，不在缓存中。gen存入当前的版本号，填充后用它调用pcache_insert。
+  内存紧张又没有可换出的页时返回NULL*/
+struct pcache_page* pcache_alloc(uint32_t* gen);
+/*把填充好的page作为part上i_no文件的第pgoff页放入缓存，返回缓存中的这一页，已有时释放page返回已有的。
+  填充期间文件被写过时不放入，返回page本身，用完pcache_put时释放*/
+struct pcache_page* pcache_insert(struct pcache_page* page, struct partition* part, uint32_t i_no, uint32_t pgoff, uint32_t gen);
+/*释放对page的引用*/
+void pcache_put(struct pcache_page* page);
+/*文件写入后调用，把buf中从文件pos处起的len字节同步到已缓存的页*/
+void pcache_update(struct partition* part, uint32_t i_no, uint32_t pos, const void* buf, uint32_t len);
+/*文件删除时调用，丢弃part上i_no文件的所有缓存页*/
+void pcache_drop(struct partition* part, uint32_t i_no);
+
+#endif
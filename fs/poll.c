@@ -0,0 +1,119 @@
+#include "poll.h"
+#include "stdint.h"
+#include "global.h"
+#include "fs.h"
+#include "file.h"
+#include "pipe.h"
+#include "tty.h"
+#include "sync.h"
+#include "thread.h"
+#include "memory.h"
+#include "interrupt.h"
+#include "timer.h"
+#include "stdio-kernel.h"
+
+/*可读写对象的就绪检查函数在返回就绪状态前调用，把当前线程登记到wq上，pt为NULL时什么也不做。
+  节点用完时不再登记，此后只靠超时或别的节点唤醒*/
+void poll_wait(struct wait_queue* wq, struct poll_table* pt)
+{
+    if(pt == NULL || pt->cnt == pt->max) {
+        return;
+    }
+    wait_entry_add(wq, &pt->entries[pt->cnt++], pt->timed);
+}
+
+/*摘下pt登记的全部节点*/
+static void poll_table_clear(struct poll_table* pt)
+{
+    uint32_t idx;
+    for(idx = 0; idx < pt->cnt; idx++) {
+        wait_entry_del(&pt->entries[idx]);
+    }
+    pt->cnt = 0;
+}
+
+/*返回描述符fd当前发生的事件，pt不为NULL时登记到fd的等待队列。
+  管道看缓冲区，标准输入看控制台tty，普通文件和控制台输出不会因为没数据而等待，总是就绪*/
+static uint32_t fd_poll(int32_t fd, struct poll_table* pt)
+{
+    if(fd_local2file(fd) == NULL) {
+        return POLLNVAL;
+    }
+    if(is_pipe(fd)) {
+        return pipe_poll(fd, pt);
+    }
+    if(fd == stdin_no) {
+        return tty_poll(pt);
+    }
+    if(fd == stdout_no || fd == stderr_no) {
+        return POLLOUT;
+    }
+    return POLLIN | POLLOUT;
+}
+
+/*检查fds中的各项，填入revents，返回就绪的项数，pt不为NULL时顺便登记*/
+static int32_t poll_scan(struct pollfd* fds, uint32_t nfds, struct poll_table* pt)
+{
+    int32_t ready = 0;
+    uint32_t idx;
+    for(idx = 0; idx < nfds; idx++) {
+        fds[idx].revents = 0;
+        if(fds[idx].fd < 0) {   //负的描述符忽略
+            continue;
+        }
+        uint32_t mask = fd_poll(fds[idx].fd, pt);
+        fds[idx].revents = mask & (fds[idx].events | POLLERR | POLLHUP | POLLNVAL);
+        if(fds[idx].revents != 0) {
+            ready++;
+        }
+    }
+    return ready;
+}
+
+/*等待fds中的nfds个描述符就绪，最多等timeout毫秒，为-1时一直等，为0时只检查一次，返回就绪的描述符数，出错返回-1。
+  没有就绪的就把自己登记到各描述符的等待队列上睡眠，任何一个被唤醒后摘下全部节点重新检查*/
+int32_t sys_poll(struct pollfd* fds, uint32_t nfds, int32_t timeout)
+{
+    if(nfds > POLL_MAX_FDS) {
+        printk("sys_poll: too many fds\n");
+        return -1;
+    }
+    struct poll_table table;
+    table.entries = NULL;
+    table.cnt = 0;
+    table.max = 0;
+    table.timed = timeout > 0;
+    if(timeout != 0) {
+        table.entries = get_kernel_pages(1);
+        if(table.entries == NULL) {
+            printk("sys_poll: get_kernel_pages failed\n");
+            return -1;
+        }
+        table.max = PG_SIZE / sizeof(struct wait_entry);
+    }
+
+    enum intr_status old_status = intr_disable();
+    uint32_t deadline = sys_uptime() + (timeout > 0 ? timer_ms_to_ticks(timeout) : 0);
+    int32_t ready = 0;
+    while(1) {
+        ready = poll_scan(fds, nfds, timeout != 0 ? &table : NULL);
+        if(ready > 0 || timeout == 0) {
+            break;
+        }
+        if(timeout < 0) {
+            thread_block(TASK_BLOCKED);
+        } else if((int32_t)(deadline - sys_uptime()) > 0) {
+            timer_block_until(deadline);
+        } else {
+            break;
+        }
+        poll_table_clear(&table);
+    }
+    poll_table_clear(&table);
+    intr_set_status(old_status);
+
+    if(table.entries != NULL) {
+        mfree_page(PF_KERNEL, table.entries, 1);
+    }
+    return ready;
+}
@@ -0,0 +1,39 @@
+#ifndef __FS_POLL_H
+#define __FS_POLL_H
+#include "stdint.h"
+#include "global.h"
+
+#define POLLIN 0x01   //有数据可读
+#define POLLOUT 0x04   //可以写入而不阻塞
+#define POLLERR 0x08   //出错，如管道的读端都已关闭，总会报告
+#define POLLHUP 0x10   //对端已关闭，如管道的写端都已关闭，总会报告
+#define POLLNVAL 0x20   //描述符无效，总会报告
+
+#define POLL_MAX_FDS 64   //一次poll最多的描述符数
+
+/*poll的一项，events是关心的事件，revents由内核填入发生的事件*/
+struct pollfd
+{
+    int32_t fd;
+    int16_t events;
+    int16_t revents;
+};
+
+struct wait_queue;
+struct wait_entry;
+
+/*poll登记等待队列用的表，各节点放在一页内核内存里*/
+struct poll_table
+{
+    struct wait_entry* entries;
+    uint32_t cnt;   //已用的节点数
+    uint32_t max;
+    bool timed;   //本次poll带超时
+};
+
+/*可读写对象的就绪检查函数在返回就绪状态前调用，把当前线程登记到wq上，pt为NULL时什么也不做*/
+void poll_wait(struct wait_queue* wq, struct poll_table* pt);
+/*等待fds中的nfds个描述符就绪，最多等timeout毫秒，为-1时一直等，为0时只检查一次，返回就绪的描述符数，出错返回-1*/
+int32_t sys_poll(struct pollfd* fds, uint32_t nfds, int32_t timeout);
+
+#endif
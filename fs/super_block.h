@@ -2,6 +2,8 @@
 #define __FS_SUPER_BLOCK_H
 #include "stdint.h"
 
+#define FS_MAGIC 0x19590320   //本文件系统的标志，inode格式或分区布局改变时随之改变，旧格式的分区挂载时会重新格式化
+
 /*超级块*/
 struct super_block
 {
@@ -10,6 +12,9 @@ struct super_block
     uint32_t inode_cnt;             //本分区中inode数量
     uint32_t part_lba_base;        //本分区的起始lba地址
 
+    uint32_t journal_lba;           //元数据日志区起始扇区地址
+    uint32_t journal_sects;         //元数据日志区占用的扇区数量
+
     uint32_t block_bitmap_lba;      //块位图本身起始扇区地址
     uint32_t block_bitmap_sects;    //块位图本身占用的扇区数量
 
@@ -22,8 +27,12 @@ struct super_block
     uint32_t data_start_lba;        //数据区开始的第一个扇区号
     uint32_t root_inode_no;         //根目录所在的i节点号
     uint32_t dir_entry_size;        //目录项大小
+    uint32_t block_size;            //块字节大小，块位图中每位代表一块
+    uint32_t inode_table_uninit;    //i节点表末尾还没清零的扇区数，分配到其中的inode时才按组清零，旧分区上为0
+    uint32_t free_blocks;           //空闲块数，分配回收时随位图更新，挂载时按位图重算
+    uint32_t free_inodes;           //空闲inode数，同上
 
-    uint8_t pad[460];   //加上460字节，凑够512字节1扇区大小
+    uint8_t pad[436];   //加上436字节，凑够512字节1扇区大小
 }__attribute__ ((packed));
 
 #endif
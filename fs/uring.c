@@ -0,0 +1,108 @@
+#include "uring.h"
+#include "stdint.h"
+#include "global.h"
+#include "fs.h"
+#include "file.h"
+#include "inode.h"
+#include "pipe.h"
+#include "stdio-kernel.h"
+
+/*sqe要读的是可以预读的普通文件时返回它的文件结构，否则返回NULL*/
+static struct file* sqe_read_file(const struct uring_sqe* sqe)
+{
+    if(sqe->op != URING_OP_READ || sqe->fd <= stderr_no || is_pipe(sqe->fd)) {
+        return NULL;
+    }
+    struct file* file = fd_local2file(sqe->fd);
+    if(file == NULL || (file->fd_flag & O_WRONLY)) {
+        return NULL;
+    }
+    return file;
+}
+
+/*在普通文件fd的off处读写len字节，文件原来的读写位置不变，返回读写的字节数，读到文件尾或失败返回-1。
+  在文件结构的副本上操作，同mmap填充页时一样*/
+static int32_t uring_rw_at(int32_t fd, void* buf, uint32_t len, uint32_t off, bool write)
+{
+    struct file* file = fd <= stderr_no || is_pipe(fd) ? NULL : fd_local2file(fd);   //控制台和管道没有读写位置
+    if(file == NULL) {
+        return -1;
+    }
+    struct file at = *file;
+    at.fd_pos = off;
+    if(write) {
+        if(!(file->fd_flag & (O_WRONLY | O_RDWR)) || off > file->fd_inode->i_size) {
+            return -1;
+        }
+        return file_write(&at, buf, len);
+    }
+    if((file->fd_flag & O_WRONLY) || off >= file->fd_inode->i_size) {
+        return -1;
+    }
+    return file_read(&at, buf, len);
+}
+
+/*执行一个提交项，返回放入完成项的结果*/
+static int32_t uring_exec(const struct uring_sqe* sqe)
+{
+    if((sqe->op == URING_OP_READ || sqe->op == URING_OP_WRITE) && (sqe->buf == NULL || sqe->off < -1)) {
+        return -1;
+    }
+    switch(sqe->op) {
+        case URING_OP_NOP:
+            return 0;
+        case URING_OP_READ:
+            return sqe->off == -1 ? sys_read(sqe->fd, sqe->buf, sqe->len) : \
+                   uring_rw_at(sqe->fd, sqe->buf, sqe->len, sqe->off, false);
+        case URING_OP_WRITE:
+            return sqe->off == -1 ? sys_write(sqe->fd, sqe->buf, sqe->len) : \
+                   uring_rw_at(sqe->fd, sqe->buf, sqe->len, sqe->off, true);
+        case URING_OP_FSYNC:
+            return sys_fsync(sqe->fd);
+        default:
+            return -1;
+    }
+}
+
+/*执行ring中最多to_submit个已提交的请求，结果放入完成环，返回执行的请求数，出错返回-1。
+  完成环放不下的请求留在提交环中，下次再执行。先把所有读普通文件的请求要读的块一起交给硬盘队列，
+  再按提交顺序逐个执行，后面的读不必等前面的读完才开始访问硬盘，一次系统调用就处理完整批请求*/
+int32_t sys_uring_enter(struct uring* ring, uint32_t to_submit)
+{
+    if(ring == NULL || ring->entries == 0 || ring->entries > URING_ENTRIES_MAX \
+       || (ring->entries & (ring->entries - 1)) != 0 || ring->sqes == NULL || ring->cqes == NULL) {
+        printk("sys_uring_enter: bad ring\n");
+        return -1;
+    }
+    uint32_t mask = ring->entries - 1;
+    uint32_t sq_head = ring->sq_head;
+    uint32_t pending = ring->sq_tail - sq_head;
+    uint32_t cq_space = ring->entries - (ring->cq_tail - ring->cq_head);
+    if(pending > ring->entries || cq_space > ring->entries) {
+        printk("sys_uring_enter: ring indexes corrupted\n");
+        return -1;
+    }
+    uint32_t cnt = to_submit < pending ? to_submit : pending;
+    if(cnt > cq_space) {
+        cnt = cq_space;
+    }
+
+    uint32_t idx;
+    for(idx = 0; idx < cnt; idx++) {
+        const struct uring_sqe* sqe = &ring->sqes[(sq_head + idx) & mask];
+        struct file* file = sqe_read_file(sqe);
+        if(file != NULL) {
+            file_prefetch(file, sqe->off == -1 ? file->fd_pos : (uint32_t)sqe->off, sqe->len);
+        }
+    }
+
+    for(idx = 0; idx < cnt; idx++) {
+        const struct uring_sqe* sqe = &ring->sqes[(sq_head + idx) & mask];
+        struct uring_cqe* cqe = &ring->cqes[ring->cq_tail & mask];
+        cqe->user_data = sqe->user_data;
+        cqe->res = uring_exec(sqe);
+        ring->sq_head = sq_head + idx + 1;
+        ring->cq_tail++;   //完成项填好后才让用户看到
+    }
+    return cnt;
+}
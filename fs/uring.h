@@ -0,0 +1,52 @@
+#ifndef __FS_URING_H
+#define __FS_URING_H
+#include "stdint.h"
+#include "global.h"
+
+#define URING_ENTRIES_MAX 64   //环的最大项数，须为2的幂
+
+/*提交项的操作*/
+enum uring_op
+{
+    URING_OP_NOP,   //什么也不做，结果为0
+    URING_OP_READ,   //同read，off不小于0时从off处读，文件的读写位置不变
+    URING_OP_WRITE,   //同write，off不小于0时写到off处，文件的读写位置不变
+    URING_OP_FSYNC   //同fsync，不用buf、len和off
+};
+
+/*提交项，由用户填写*/
+struct uring_sqe
+{
+    uint32_t op;   //enum uring_op
+    int32_t fd;
+    void* buf;
+    uint32_t len;
+    int32_t off;   //为-1时从文件当前的读写位置起，只对普通文件有效
+    uint32_t user_data;   //原样带回完成项，用来认出是哪个请求
+};
+
+/*完成项，由内核填写*/
+struct uring_cqe
+{
+    uint32_t user_data;
+    int32_t res;   //同对应系统调用的返回值
+};
+
+/*提交环和完成环，连同两个项数组都放在用户内存中。
+  各下标只增不减，对entries取模后才是项的位置。用户填好sqes后增加sq_tail，内核执行后增加sq_head；
+  内核把结果放进cqes后增加cq_tail，用户取走后增加cq_head*/
+struct uring
+{
+    uint32_t entries;   //两个环各自的项数
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    struct uring_sqe* sqes;
+    struct uring_cqe* cqes;
+};
+
+/*执行ring中最多to_submit个已提交的请求，结果放入完成环，返回执行的请求数，出错返回-1*/
+int32_t sys_uring_enter(struct uring* ring, uint32_t to_submit);
+
+#endif
@@ -0,0 +1,189 @@
+#include "bench.h"
+#include "stdint.h"
+#include "global.h"
+#include "string.h"
+#include "memory.h"
+#include "thread.h"
+#include "sync.h"
+#include "ide.h"
+#include "fs.h"
+#include "pipe.h"
+
+#define BENCH_PIPE_CHUNK 2048   //管道基准每次写入再读出的字节数，小于管道的默认缓冲区
+#define BENCH_IDE_MAX_SECS 256   //硬盘基准一次最多读的扇区数
+
+/*上下文切换基准：body和pong线程经两个信号量来回交替，一个样本是一来一回两次切换*/
+static struct semaphore ping, pong;
+static volatile bool pong_stop;
+
+/*基准运行时用的缓冲区和管道，同一时刻只有一项基准在运行*/
+static void* bench_buf;
+static int32_t bench_pipe[2];
+
+/*pong线程：等ping后回pong，收到停止时回最后一次pong后退出*/
+static void pong_thread(void* arg UNUSED)
+{
+    while(1) {
+        sema_down(&ping);
+        if(pong_stop) {
+            break;
+        }
+        sema_up(&pong);
+    }
+    sema_up(&pong);
+    thread_exit(running_thread(), true);
+}
+
+static bool ctx_switch_setup(uint32_t arg UNUSED)
+{
+    sema_init(&ping, 0);
+    sema_init(&pong, 0);
+    pong_stop = false;
+    return thread_start("bench_pong", 31, pong_thread, NULL) != NULL;
+}
+
+static void ctx_switch_body(uint32_t arg UNUSED)
+{
+    sema_up(&ping);
+    sema_down(&pong);
+}
+
+static void ctx_switch_teardown(uint32_t arg UNUSED)
+{
+    pong_stop = true;
+    sema_up(&ping);
+    sema_down(&pong);
+}
+
+/*sys_malloc基准：分配并立即释放arg字节，每项对应一种内存块规格。经系统调用运行时用的是调用进程的内存块*/
+static void malloc_body(uint32_t arg)
+{
+    sys_free(sys_malloc(arg));
+}
+
+/*内核页基准：分配并立即释放arg页*/
+static void kernel_pages_body(uint32_t arg)
+{
+    mfree_page(PF_KERNEL, get_kernel_pages(arg), arg);
+}
+
+/*管道基准：在当前进程中建一个管道，每次写入arg字节再读出*/
+static bool pipe_setup(uint32_t arg UNUSED)
+{
+    bench_buf = get_kernel_pages(1);
+    if(bench_buf == NULL) {
+        return false;
+    }
+    if(sys_pipe(bench_pipe) == -1) {
+        mfree_page(PF_KERNEL, bench_buf, 1);
+        return false;
+    }
+    return true;
+}
+
+static void pipe_body(uint32_t arg)
+{
+    pipe_write(bench_pipe[1], bench_buf, arg);
+    pipe_read(bench_pipe[0], bench_buf, arg);
+}
+
+static void pipe_teardown(uint32_t arg UNUSED)
+{
+    sys_close(bench_pipe[0]);
+    sys_close(bench_pipe[1]);
+    mfree_page(PF_KERNEL, bench_buf, 1);
+}
+
+/*硬盘基准：从当前分区的起始处直接读arg个扇区，不经过块缓存*/
+static bool ide_setup(uint32_t arg UNUSED)
+{
+    if(cur_part == NULL) {
+        return false;
+    }
+    bench_buf = get_kernel_pages(BENCH_IDE_MAX_SECS * SECTOR_SIZE / PG_SIZE);
+    return bench_buf != NULL;
+}
+
+static void ide_body(uint32_t arg)
+{
+    ide_read(cur_part->my_disk, cur_part->start_lba, bench_buf, arg);
+}
+
+static void ide_teardown(uint32_t arg UNUSED)
+{
+    mfree_page(PF_KERNEL, bench_buf, BENCH_IDE_MAX_SECS * SECTOR_SIZE / PG_SIZE);
+}
+
+static struct bench benches[] = {
+    {"ctx switch", 256, 0, ctx_switch_setup, ctx_switch_body, ctx_switch_teardown},
+    {"malloc 16", 256, 16, NULL, malloc_body, NULL},
+    {"malloc 32", 256, 32, NULL, malloc_body, NULL},
+    {"malloc 64", 256, 64, NULL, malloc_body, NULL},
+    {"malloc 128", 256, 128, NULL, malloc_body, NULL},
+    {"malloc 256", 256, 256, NULL, malloc_body, NULL},
+    {"malloc 512", 256, 512, NULL, malloc_body, NULL},
+    {"malloc 1024", 256, 1024, NULL, malloc_body, NULL},
+    {"get_kernel_pages 1", 256, 1, NULL, kernel_pages_body, NULL},
+    {"pipe 2048B", 256, BENCH_PIPE_CHUNK, pipe_setup, pipe_body, pipe_teardown},
+    {"ide_read 1", 64, 1, ide_setup, ide_body, ide_teardown},
+    {"ide_read 8", 64, 8, ide_setup, ide_body, ide_teardown},
+    {"ide_read 256", 16, 256, ide_setup, ide_body, ide_teardown}
+};
+
+#define BENCH_CNT (sizeof(benches) / sizeof(benches[0]))
+
+/*把cnt个样本从小到大排序，统计最小值、中位数和99分位数存入res。样本不多，用插入排序*/
+static void bench_summarize(uint64_t* samples, uint32_t cnt, struct bench_result* res)
+{
+    uint32_t i, j;
+    for(i = 1; i < cnt; i++) {
+        uint64_t cur = samples[i];
+        for(j = i; j > 0 && samples[j - 1] > cur; j--) {
+            samples[j] = samples[j - 1];
+        }
+        samples[j] = cur;
+    }
+    res->min = samples[0];
+    res->median = samples[cnt / 2];
+    res->p99 = samples[cnt * 99 / 100];
+}
+
+/*取第idx项内核微基准的名字和循环次数存入res，run为true时运行它并存入统计。成功返回0，idx超出范围返回-1。
+  准备失败时res->iters为0*/
+int32_t sys_bench(uint32_t idx, struct bench_result* res, bool run)
+{
+    if(idx >= BENCH_CNT || res == NULL) {
+        return -1;
+    }
+    struct bench* b = &benches[idx];
+    memset(res, 0, sizeof(struct bench_result));
+    strcpy(res->name, b->name);
+    res->iters = b->iters;
+    if(!run) {
+        return 0;
+    }
+    uint64_t* samples = sys_malloc(b->iters * sizeof(uint64_t));
+    if(samples == NULL) {
+        res->iters = 0;
+        return 0;
+    }
+    if(b->setup != NULL && !b->setup(b->arg)) {
+        sys_free(samples);
+        res->iters = 0;
+        return 0;
+    }
+    uint32_t iter;
+    for(iter = 0; iter < b->iters; iter++) {
+        uint64_t start, end;
+        asm volatile ("rdtsc" : "=A"(start));
+        b->body(b->arg);
+        asm volatile ("rdtsc" : "=A"(end));
+        samples[iter] = end - start;
+    }
+    if(b->teardown != NULL) {
+        b->teardown(b->arg);
+    }
+    bench_summarize(samples, b->iters, res);
+    sys_free(samples);
+    return 0;
+}
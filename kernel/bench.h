@@ -0,0 +1,32 @@
+#ifndef __KERNEL_BENCH_H
+#define __KERNEL_BENCH_H
+#include "stdint.h"
+#include "global.h"
+
+#define BENCH_NAME_LEN 24
+
+/*一项微基准的结果，各次循环的耗时以rdtsc计的时钟周期数为单位*/
+struct bench_result
+{
+    char name[BENCH_NAME_LEN];
+    uint32_t iters;   //循环次数，准备失败没有运行时为0
+    uint64_t min;
+    uint64_t median;
+    uint64_t p99;
+};
+
+/*一项内核微基准，body每次执行计一个样本。setup失败返回false，此时不运行也不调用teardown*/
+struct bench
+{
+    const char* name;
+    uint32_t iters;
+    uint32_t arg;   //传给各回调的参数，如分配的大小、读的扇区数
+    bool (*setup)(uint32_t arg);
+    void (*body)(uint32_t arg);
+    void (*teardown)(uint32_t arg);
+};
+
+/*取第idx项内核微基准的名字和循环次数存入res，run为true时运行它并存入统计。成功返回0，idx超出范围返回-1*/
+int32_t sys_bench(uint32_t idx, struct bench_result* res, bool run);
+
+#endif
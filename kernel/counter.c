@@ -0,0 +1,57 @@
+#include "counter.h"
+#include "stdint.h"
+#include "global.h"
+#include "string.h"
+#include "interrupt.h"
+#include "thread.h"
+#include "smp.h"
+#include "debug.h"
+
+/*各cpu一行，一行正好两个缓存行，cpu只写自己那一行，加计数不用锁，缓存行也不会在cpu间来回搬*/
+static uint32_t counter_values[MAX_CPUS][COUNTER_MAX] __attribute__((aligned(64)));
+static char counter_names[COUNTER_MAX][COUNTER_NAME_LEN];
+static uint32_t counter_cnt = 1;   //已登记的计数器数，0号是空计数器
+
+/*登记名为name的计数器，返回计数器号，在各子系统初始化时调用。登记满时返回0号空计数器，加在上面的数不显示*/
+uint32_t counter_register(const char* name)
+{
+    if(counter_cnt == COUNTER_MAX) {
+        return 0;
+    }
+    ASSERT(strlen(name) < COUNTER_NAME_LEN);
+    strcpy(counter_names[counter_cnt], name);
+    return counter_cnt++;
+}
+
+/*在本cpu的份上给id号计数器加n，可在中断处理函数中调用。
+  关中断只为取cpu号和加计数之间不被换到别的cpu上，任务的cpu字段比读本地apic的编号便宜。
+  还没登记的计数器号为0，线程环境建立前就会用到，这时什么也不做*/
+void counter_add(uint32_t id, uint32_t n)
+{
+    if(id == 0) {
+        return;
+    }
+    enum intr_status old_status = intr_disable();
+    counter_values[running_thread()->cpu][id] += n;
+    intr_set_status(old_status);
+}
+
+/*把各计数器在各cpu上的份求和后连同名字复制到buf，最多cnt项，返回复制的项数，失败返回-1。
+  读时不加锁，别的cpu正在加的几次可能没算进来*/
+int32_t sys_stats(struct counter_entry* buf, uint32_t cnt)
+{
+    if(buf == NULL) {
+        return -1;
+    }
+    uint32_t id, entry_cnt = 0;
+    for(id = 1; id < counter_cnt && entry_cnt < cnt; id++) {
+        struct counter_entry* entry = &buf[entry_cnt++];
+        memset(entry, 0, sizeof(struct counter_entry));
+        strcpy(entry->name, counter_names[id]);
+        uint32_t cpu;
+        for(cpu = 0; cpu < MAX_CPUS; cpu++) {
+            entry->value += counter_values[cpu][id];
+        }
+    }
+    return entry_cnt;
+}
@@ -0,0 +1,24 @@
+#ifndef __KERNEL_COUNTER_H
+#define __KERNEL_COUNTER_H
+#include "stdint.h"
+#include "global.h"
+
+#define COUNTER_MAX 32   //最多登记的计数器数，含0号空计数器
+#define COUNTER_NAME_LEN 24
+
+/*sys_stats返回的一项，value是各cpu上的份之和*/
+struct counter_entry
+{
+    char name[COUNTER_NAME_LEN];
+    uint32_t value;
+};
+
+/*登记名为name的计数器，返回计数器号，在各子系统初始化时调用。登记满时返回0号空计数器，加在上面的数不显示*/
+uint32_t counter_register(const char* name);
+/*在本cpu的份上给id号计数器加n，可在中断处理函数中调用*/
+void counter_add(uint32_t id, uint32_t n);
+#define counter_inc(id) counter_add(id, 1)
+/*把各计数器在各cpu上的份求和后连同名字复制到buf，最多cnt项，返回复制的项数，失败返回-1*/
+int32_t sys_stats(struct counter_entry* buf, uint32_t cnt);
+
+#endif
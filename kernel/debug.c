@@ -1,18 +1,55 @@
 #include "debug.h"
 #include "print.h"
 #include "interrupt.h"
+#include "klog.h"
+#include "ksym.h"
+#include "global.h"
 
-/*打印文件名，行号，函数名，条件并使程序悬停*/
+#define BACKTRACE_MAX 16   //panic时最多回溯的栈帧数
+
+/*打印地址addr，能找到所在的内核函数时附上函数名和偏移*/
+void put_sym(uint32_t addr)
+{
+    uint32_t offset;
+    const char* name = addr2sym(addr, &offset);
+    put_str("0x");put_int(addr);
+    if(name != NULL) {
+        put_str(" <");put_str((char*)name);put_str("+0x");put_int(offset);put_str(">");
+    }
+    put_str("\n");
+}
+
+/*沿ebp链回溯调用栈，打印各层的返回地址。内核不省略帧指针，栈帧地址逐层升高，
+  遇到用户态或不再升高的ebp就停下，不在panic时再触发页错误*/
+static void backtrace(void)
+{
+    uint32_t* ebp;
+    asm volatile ("movl %%ebp, %0" : "=r"(ebp));
+    put_str("call trace:\n");
+    uint32_t depth;
+    for(depth = 0; depth < BACKTRACE_MAX && (uint32_t)ebp >= 0xc0000000; depth++) {
+        put_str("  ");put_sym(ebp[1]);
+        uint32_t* next = (uint32_t*)ebp[0];
+        if(next <= ebp) {
+            break;
+        }
+        ebp = next;
+    }
+}
+
+/*打印文件名，行号，函数名，条件和调用栈并使程序悬停*/
 void panic_spin(char* filename, \
                 int line, \
                 const char* func, \
                 const char* condition)
 {
     intr_disable();   //因为有时候会单独调用panic_spin,所以在此处关中断
+    klog_panic_flush();   //先输出还在日志缓冲区中的消息
     put_str("\n\n\n!!!!!! error !!!!!!\n");
     put_str("filename:");put_str(filename);put_str("\n");
     put_str("line:0x");put_int(line);put_str("\n");
     put_str("function:");put_str((char*)func);put_str("\n");
     put_str("condition:");put_str((char*)condition);put_str("\n");
+    backtrace();
     while(1);
 }
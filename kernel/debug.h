@@ -1,6 +1,9 @@
 #ifndef __KERNEL_DEBUG_H
 #define __KERNEL_DEBUG_H
+#include "stdint.h"
 void panic_spin(char* filename, int line, const char* func, const char* condition);
+/*打印地址addr，能找到所在的内核函数时附上函数名和偏移*/
+void put_sym(uint32_t addr);
 
 /******* _VA_ARGS_ ******
  * _VA_ARGS是预处理器所支持的专用标识符
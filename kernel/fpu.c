@@ -0,0 +1,188 @@
+#include "fpu.h"
+#include "stdint.h"
+#include "global.h"
+#include "string.h"
+#include "print.h"
+#include "debug.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "thread.h"
+#include "smp.h"
+
+#define CR0_MP 0x2   //wait/fwait也受TS控制
+#define CR0_EM 0x4   //置1时fpu指令全部触发#NM，表示没有fpu
+#define CR0_TS 0x8   //任务切换后置1，下次执行fpu指令时触发#NM
+#define CR0_NE 0x20   //fpu错误走#MF而不是外部中断
+#define CR4_OSFXSR 0x200   //允许fxsave/fxrstor和sse指令
+#define CR4_OSXMMEXCPT 0x400   //sse浮点异常走#XF
+
+static bool fpu_available;   //是否有fpu
+static bool fpu_fxsr;   //是否支持fxsave，不支持时用fnsave
+static struct kmem_cache* fpu_cache;   //fpu保存区的对象缓存
+static struct task_struct* fpu_owner[MAX_CPUS];   //各cpu的fpu寄存器里是谁的状态
+
+/*把fpu寄存器保存到state*/
+static void fpu_save(void* state)
+{
+    if(fpu_fxsr) {
+        asm volatile ("fxsave (%0)" : : "r"(state) : "memory");
+    } else {
+        asm volatile ("fnsave (%0); fwait" : : "r"(state) : "memory");
+    }
+}
+
+/*从state恢复fpu寄存器*/
+static void fpu_restore(void* state)
+{
+    if(fpu_fxsr) {
+        asm volatile ("fxrstor (%0)" : : "r"(state) : "memory");
+    } else {
+        asm volatile ("frstor (%0)" : : "r"(state) : "memory");
+    }
+}
+
+/*置cr0.TS*/
+static void fpu_set_ts(void)
+{
+    uint32_t cr0;
+    asm volatile ("movl %%cr0, %0; orl %1, %0; movl %0, %%cr0" : "=&r"(cr0) : "i"(CR0_TS) : "memory");
+}
+
+/*#NM的处理函数，任务在本cpu上第一次使用fpu时进来，换入它的fpu状态*/
+static void intr_fpu_handler(uint8_t vec_nr UNUSED)
+{
+    struct task_struct* cur = running_thread();
+    //分配保存区时可能阻塞而被换下，换回来时TS又会被置上，所以先分配再清TS
+    if(cur->fpu_state == NULL) {
+        cur->fpu_state = kmem_cache_alloc(fpu_cache);
+        if(cur->fpu_state == NULL) {
+            PANIC("intr_fpu_handler: no memory for fpu state\n");
+        }
+    }
+
+    uint8_t cpu_id = smp_cpu_id();
+    asm volatile ("clts" : : : "memory");
+    if(fpu_owner[cpu_id] == cur) {
+        return;
+    }
+    if(fpu_owner[cpu_id] != NULL) {
+        fpu_save(fpu_owner[cpu_id]->fpu_state);
+    }
+    if(cur->fpu_used) {
+        fpu_restore(cur->fpu_state);
+    } else {
+        asm volatile ("fninit" : : : "memory");
+        cur->fpu_used = true;
+    }
+    fpu_owner[cpu_id] = cur;
+}
+
+/*在switch_to之前调用，next的fpu状态不在本cpu的寄存器里时设置cr0.TS，等它第一次用fpu时再恢复。
+  多cpu时任务可能被别的cpu偷走，寄存器里的状态无法跨cpu取回，所以换下时就保存*/
+void fpu_switch(struct task_struct* cur, struct task_struct* next)
+{
+    if(!fpu_available) {
+        return;
+    }
+    uint8_t cpu_id = smp_cpu_id();
+    if(cpu_cnt > 1 && fpu_owner[cpu_id] == cur) {
+        asm volatile ("clts" : : : "memory");
+        fpu_save(cur->fpu_state);
+        fpu_owner[cpu_id] = NULL;
+    }
+    if(fpu_owner[cpu_id] == next) {
+        asm volatile ("clts" : : : "memory");
+    } else {
+        fpu_set_ts();
+    }
+}
+
+/*让child继承parent的fpu状态，parent是当前任务*/
+void fpu_fork(struct task_struct* child, struct task_struct* parent)
+{
+    child->fpu_state = NULL;
+    child->fpu_used = false;
+    if(!parent->fpu_used) {
+        return;
+    }
+    child->fpu_state = kmem_cache_alloc(fpu_cache);
+    if(child->fpu_state == NULL) {
+        return;   //子进程从干净的fpu状态开始
+    }
+    enum intr_status old_status = intr_disable();
+    if(fpu_owner[smp_cpu_id()] == parent) {
+        //fnsave会重新初始化fpu，存完要恢复回去
+        fpu_save(parent->fpu_state);
+        if(!fpu_fxsr) {
+            fpu_restore(parent->fpu_state);
+        }
+    }
+    intr_set_status(old_status);
+    memcpy(child->fpu_state, parent->fpu_state, FPU_STATE_SIZE);
+    child->fpu_used = true;
+}
+
+/*exec后新程序从干净的fpu状态开始，保存区留着下次用*/
+void fpu_exec(struct task_struct* pthread)
+{
+    enum intr_status old_status = intr_disable();
+    uint8_t cpu_id = smp_cpu_id();
+    if(fpu_owner[cpu_id] == pthread) {
+        fpu_owner[cpu_id] = NULL;
+        fpu_set_ts();
+    }
+    pthread->fpu_used = false;
+    intr_set_status(old_status);
+}
+
+/*释放pthread的fpu保存区*/
+void fpu_release(struct task_struct* pthread)
+{
+    enum intr_status old_status = intr_disable();
+    uint8_t cpu_id;
+    for(cpu_id = 0; cpu_id < MAX_CPUS; cpu_id++) {
+        if(fpu_owner[cpu_id] == pthread) {
+            fpu_owner[cpu_id] = NULL;
+        }
+    }
+    void* state = pthread->fpu_state;
+    pthread->fpu_state = NULL;
+    pthread->fpu_used = false;
+    intr_set_status(old_status);
+    if(state != NULL) {
+        kmem_cache_free(fpu_cache, state);
+    }
+}
+
+/*在本cpu上打开fpu和sse，TS先置上，谁先用fpu谁触发#NM*/
+void fpu_cpu_init(void)
+{
+    if(!fpu_available) {
+        return;
+    }
+    uint32_t reg;
+    asm volatile ("movl %%cr0, %0; andl %1, %0; orl %2, %0; movl %0, %%cr0" \
+                  : "=&r"(reg) : "i"(~CR0_EM), "i"(CR0_MP | CR0_NE | CR0_TS) : "memory");
+    if(fpu_fxsr) {
+        asm volatile ("movl %%cr4, %0; orl %1, %0; movl %0, %%cr4" \
+                      : "=&r"(reg) : "i"(CR4_OSFXSR | CR4_OSXMMEXCPT) : "memory");
+    }
+}
+
+/*fpu初始化，没有fpu时什么也不做，fpu指令仍按cr0.EM触发异常*/
+void fpu_init(void)
+{
+    put_str("fpu_init start\n");
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if(!(edx & 0x1)) {
+        put_str("fpu_init: no fpu\n");
+        return;
+    }
+    fpu_available = true;
+    fpu_fxsr = (edx & (1 << 24)) != 0;
+    fpu_cache = kmem_cache_create("fpu_state", FPU_STATE_SIZE, NULL);
+    register_handler(7, intr_fpu_handler);
+    fpu_cpu_init();
+    put_str("fpu_init done\n");
+}
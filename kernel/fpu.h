@@ -0,0 +1,21 @@
+#ifndef __KERNEL_FPU_H
+#define __KERNEL_FPU_H
+#include "stdint.h"
+
+struct task_struct;
+
+#define FPU_STATE_SIZE 512   //fxsave保存区的大小，须16字节对齐
+
+void fpu_init(void);
+/*在本cpu上打开fpu和sse*/
+void fpu_cpu_init(void);
+/*在switch_to之前调用，next的fpu状态不在本cpu的寄存器里时设置cr0.TS，等它第一次用fpu时再恢复*/
+void fpu_switch(struct task_struct* cur, struct task_struct* next);
+/*让child继承parent的fpu状态*/
+void fpu_fork(struct task_struct* child, struct task_struct* parent);
+/*exec后新程序从干净的fpu状态开始*/
+void fpu_exec(struct task_struct* pthread);
+/*释放pthread的fpu保存区*/
+void fpu_release(struct task_struct* pthread);
+
+#endif
@@ -2,28 +2,135 @@
 #include "print.h"
 #include "interrupt.h"
 #include "../device/timer.h"
+#include "hrtimer.h"
+#include "workqueue.h"
 #include "memory.h"
 #include "thread.h"
 #include "console.h"
+#include "klog.h"
 #include "keyboard.h"
+#include "tty.h"
 #include "tss.h"
 #include "syscall-init.h"
 #include "ide.h"
 #include "fs.h"
+#include "hostshare.h"
+#include "smp.h"
+#include "swap.h"
+#include "fpu.h"
+#include "string.h"
+#include "stdio-kernel.h"
+#include "io.h"
+
+extern uint32_t ticks;
+
+static struct boot_stage boot_stages[BOOT_STAGE_MAX];   //按开始的先后排列
+static uint64_t boot_stage_tsc[BOOT_STAGE_MAX];   //各阶段开始时的时钟周期数
+static uint32_t boot_stage_tick[BOOT_STAGE_MAX];   //各阶段开始时的滴答数
+static uint32_t boot_stage_cnt;
+static uint32_t boot_stage_depth;   //正在记录的阶段数
+
+/*开始记录名为name的启动阶段，返回阶段的下标，记满时返回-1。只在启动时由主线程调用，不加锁*/
+int32_t boot_stage_begin(const char* name)
+{
+    if(boot_stage_cnt == BOOT_STAGE_MAX) {
+        return -1;
+    }
+    int32_t idx = boot_stage_cnt++;
+    struct boot_stage* stage = &boot_stages[idx];
+    uint32_t len = 0;
+    while(name[len] != 0 && len < BOOT_STAGE_NAME_LEN - 1) {   //过长的名字截断
+        stage->name[len] = name[len];
+        len++;
+    }
+    stage->name[len] = 0;
+    stage->depth = boot_stage_depth++;
+    boot_stage_tick[idx] = ticks;
+    asm volatile ("rdtsc" : "=A"(boot_stage_tsc[idx]));
+    return idx;
+}
+
+/*结束下标为idx的启动阶段，idx为-1时什么也不做*/
+void boot_stage_end(int32_t idx)
+{
+    if(idx == -1) {
+        return;
+    }
+    uint64_t now;
+    asm volatile ("rdtsc" : "=A"(now));
+    boot_stages[idx].cycles = now - boot_stage_tsc[idx];
+    boot_stages[idx].ticks = ticks - boot_stage_tick[idx];
+    boot_stage_depth--;
+}
+
+/*把各启动阶段的耗时复制到buf，最多cnt项，返回复制的项数，失败返回-1*/
+int32_t sys_boot_stats(struct boot_stage* buf, uint32_t cnt)
+{
+    if(buf == NULL) {
+        return -1;
+    }
+    if(cnt > boot_stage_cnt) {
+        cnt = boot_stage_cnt;
+    }
+    memcpy(buf, boot_stages, cnt * sizeof(struct boot_stage));
+    return cnt;
+}
+
+/*把缓存的修改写回硬盘后关机。bochs下写关机端口就退出，真机上没有这个端口，关中断停在hlt*/
+void sys_poweroff(void)
+{
+    sys_sync();
+    const char* cmd = "Shutdown";
+    while(*cmd) {
+        outb(POWEROFF_PORT, *cmd++);
+    }
+    intr_disable();
+    while(1) {
+        asm volatile ("hlt");
+    }
+}
+
+/*打印各启动阶段的耗时，时钟周期以1024为单位*/
+static void boot_stage_show(void)
+{
+    printk("boot stages:\n");
+    uint32_t idx;
+    for(idx = 0; idx < boot_stage_cnt; idx++) {
+        struct boot_stage* stage = &boot_stages[idx];
+        printk("   %s%s%s: %dK cycles, %d ticks\n", stage->depth > 0 ? "  " : "", stage->depth > 1 ? "  " : "", \
+               stage->name, (uint32_t)(stage->cycles >> 10), stage->ticks);
+    }
+}
+
+/*记录fn_call的耗时，阶段名为函数名*/
+#define BOOT_STAGE(fn_call, name) do { \
+    int32_t stage_idx = boot_stage_begin(name); \
+    fn_call; \
+    boot_stage_end(stage_idx); \
+} while(0)
 
 /*负责初始化所有模块*/
 void init_all()
 {
     put_str("init_all\n");
-    idt_init();   //初始化中断
-    mem_init();   //初始化内存池，内存管理系统
-    thread_init();   //线程初始化
-    timer_init(); //初始化PIT
-    console_init();   //控制台初始化
-    keyboard_init();   //键盘初始化
-    tss_init();   //tss初始化
-    syscall_init();   //系统调用初始化
+    BOOT_STAGE(idt_init(), "idt_init");   //初始化中断
+    BOOT_STAGE(mem_init(), "mem_init");   //初始化内存池，内存管理系统
+    BOOT_STAGE(thread_init(), "thread_init");   //线程初始化
+    BOOT_STAGE(timer_init(), "timer_init"); //初始化PIT
+    BOOT_STAGE(hrtimer_init(), "hrtimer_init");   //校准时间戳计数器
+    BOOT_STAGE(workqueue_init(), "workqueue_init");   //工作线程池
+    BOOT_STAGE(console_init(), "console_init");   //控制台初始化
+    BOOT_STAGE(klog_init(), "klog_init");   //内核日志初始化
+    BOOT_STAGE(keyboard_init(), "keyboard_init");   //键盘初始化
+    BOOT_STAGE(tty_init(), "tty_init");   //控制台tty初始化
+    BOOT_STAGE(tss_init(), "tss_init");   //tss初始化
+    BOOT_STAGE(syscall_init(), "syscall_init");   //系统调用初始化
+    BOOT_STAGE(fpu_init(), "fpu_init");   //fpu初始化
     intr_enable();   //后面的需要开中断
-    ide_init();   //分区初始化
-    filesys_init();   //文件系统初始化
+    BOOT_STAGE(ide_init(), "ide_init");   //分区初始化
+    BOOT_STAGE(filesys_init(), "filesys_init");   //文件系统初始化
+    BOOT_STAGE(hostshare_init(), "hostshare_init");   //宿主机共享目录
+    BOOT_STAGE(swap_init(), "swap_init");   //启用交换区
+    BOOT_STAGE(smp_init(), "smp_init");   //启动从处理器
+    boot_stage_show();
 }
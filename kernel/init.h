@@ -1,6 +1,28 @@
 #ifndef __KERNEL_INIT_H
 #define __KERNEL_INIT_H
+#include "stdint.h"
+
+#define BOOT_STAGE_MAX 32   //最多记录的启动阶段数
+#define BOOT_STAGE_NAME_LEN 16
+#define POWEROFF_PORT 0x8900   //bochs的关机端口，依次写入"Shutdown"各字符后bochs退出
+
+/*一个启动阶段的耗时，嵌套在上一层阶段中的depth加1*/
+struct boot_stage
+{
+    char name[BOOT_STAGE_NAME_LEN];
+    uint32_t depth;
+    uint64_t cycles;   //rdtsc计的时钟周期数
+    uint32_t ticks;   //时钟滴答数，开中断前的阶段为0
+};
 
 void init_all(void);   //初始化各个模块
+/*开始记录名为name的启动阶段，返回阶段的下标，记满时返回-1*/
+int32_t boot_stage_begin(const char* name);
+/*结束下标为idx的启动阶段，idx为-1时什么也不做*/
+void boot_stage_end(int32_t idx);
+/*把各启动阶段的耗时复制到buf，最多cnt项，返回复制的项数，失败返回-1*/
+int32_t sys_boot_stats(struct boot_stage* buf, uint32_t cnt);
+/*把缓存的修改写回硬盘后关机，不返回*/
+void sys_poweroff(void);
 
 #endif
\ No newline at end of file
@@ -4,6 +4,17 @@
 #include "print.h"
 #include "global.h"
 #include "io.h"
+#include "memory.h"
+#include "exec.h"
+#include "mmap.h"
+#include "vdata.h"
+#include "smp.h"
+#include "thread.h"
+#include "sched_trace.h"
+#include "debug.h"
+#include "softirq.h"
+#include "swap.h"
+#include "counter.h"
 
 #define IDT_DESC_CNT 0x81       //目前总共支持的中断数
 
@@ -17,7 +28,7 @@
                                              popl %0" \
                                              : "=g"(EFLAG_VAR))
 
-extern uint32_t syscall_handler(void);
+extern uint32_t syscall_entry(void);
 
 /*中断门描述符结构体*/
 struct gate_desc
@@ -32,7 +43,10 @@ struct gate_desc
 static struct gate_desc idt[IDT_DESC_CNT]; //idt是中段描述符表，本质上是个中断描述符数组
 extern intr_handler intr_entry_table[IDT_DESC_CNT]; //声明引用定义在kernel.s中的中断处理程序入口数组 intr_handler = void*
 char* intr_name[IDT_DESC_CNT];   //用于保存异常的名字
-intr_handler idt_table[IDT_DESC_CNT];   //中断处理函数地址 intr_handler = void*
+intr_handler idt_table[IDT_DESC_CNT];   //中断入口调用的函数，都是intr_dispatch
+static intr_handler intr_handlers[IDT_DESC_CNT];   //真正的中断处理函数地址 intr_handler = void*
+static struct intr_stack* intr_frames[MAX_CPUS];   //各cpu正在处理的中断保存的现场
+static uint32_t intr_counter, page_fault_counter;
 
 //静态函数声明，非必须
 static void make_idt_desc(struct gate_desc* p_gdesc, uint8_t attr, intr_handler function);
@@ -60,6 +74,18 @@ static void pic_init(void)
     put_str("   pic_init done\n");
 }
 
+/*打开8259A上第irq号中断引脚，pci设备的中断号由bios分配，驱动找到设备后再打开*/
+void pic_irq_unmask(uint8_t irq)
+{
+    enum intr_status old_status = intr_disable();
+    if(irq < 8) {
+        outb(PIC_M_DATA, inb(PIC_M_DATA) & ~(1 << irq));
+    } else {
+        outb(PIC_S_DATA, inb(PIC_S_DATA) & ~(1 << (irq - 8)));
+    }
+    intr_set_status(old_status);
+}
+
 /*创建中断门描述符*/
 static void make_idt_desc(struct gate_desc* p_gdesc, uint8_t attr, intr_handler function)
 {
@@ -77,8 +103,8 @@ static void idt_desc_init(void)
     for(i=0; i<IDT_DESC_CNT; i++) {
         make_idt_desc(&idt[i], IDT_DESC_ATTR_DPL0, intr_entry_table[i]);
     }
-    //单独处理系统调用，系统调用对应的中断门dpl为3，中断处理程序为单独的syscall_handler
-    make_idt_desc(&idt[lastindex], IDT_DESC_ATTR_DPL3, syscall_handler);
+    //单独处理系统调用，系统调用对应的中断门dpl为3，中断处理程序为单独的syscall_entry
+    make_idt_desc(&idt[lastindex], IDT_DESC_ATTR_DPL3, syscall_entry);
     put_str("idt_desc_init done\n");
 }
 
@@ -105,19 +131,69 @@ static void general_intr_handler(uint8_t vec_nr)
         asm ("movl %%cr2, %0" : "=r"(page_fault_vaddr));   //cr2是存放造成page_fault的地址
         put_str("\npage fault addr is "); put_int(page_fault_vaddr);
     }
+    struct intr_stack* frame = intr_frame();
+    if(frame != NULL) {
+        put_str("\neip is "); put_sym((uint32_t)frame->eip);
+    }
     put_str("\n!!!!!!   excetion message end   !!!!!!\n");
     //能进入中断处理程序就表示已经处在关中断情况下，不会出现调度进程的情况。故下面的死循环不会再被中断
     while(1);
 }
 
+/*页错误的处理函数，写时复制、进程映像按需加载、mmap映射区和用户堆等可恢复的页错误在此处理，其余的仍按异常处理*/
+static void page_fault_handler(uint8_t vec_nr)
+{
+    uint32_t page_fault_vaddr = 0;
+    asm ("movl %%cr2, %0" : "=r"(page_fault_vaddr));   //cr2是存放造成page_fault的地址
+    counter_inc(page_fault_counter);
+    running_thread()->stats.page_faults++;
+    //换出的页要先于按需分配的堆页处理，否则会被当成没分配过的页填零
+    if(page_cow_fault(page_fault_vaddr) || swap_page_fault(page_fault_vaddr) || segment_page_fault(page_fault_vaddr) \
+       || mmap_page_fault(page_fault_vaddr) || heap_page_fault(page_fault_vaddr) || vdata_page_fault(page_fault_vaddr)) {
+        return;
+    }
+    general_intr_handler(vec_nr);
+}
+
+/*所有中断入口先到这里，持有大内核锁调用真正的处理函数。
+  入口压入的中断号就是中断栈intr_stack的第一项，参数vec_nr所在的位置即是被打断的现场*/
+static void intr_dispatch(uint32_t vec_nr)
+{
+    sched_trace_record(SEV_IRQ_ENTER, running_thread()->pid, 0, vec_nr, 0);
+    counter_inc(intr_counter);
+    bkl_acquire();
+    uint8_t cpu = smp_cpu_id();
+    struct intr_stack* outer = intr_frames[cpu];   //处理函数中可能再发生异常，返回时恢复
+    intr_frames[cpu] = (struct intr_stack*)&vec_nr;
+    ((void (*)(uint8_t))intr_handlers[vec_nr])(vec_nr);
+    intr_frames[cpu] = outer;
+    //被打断处开着中断时运行下半部，关中断时发生的异常不能在这里开中断
+    if(((struct intr_stack*)&vec_nr)->eflags & EFLAGS_IF) {
+        softirq_run();
+        //被打断处开着中断，不在临界区中，时钟或唤醒标记了需要调度时在这里换下被打断的任务
+        preempt_check_resched();
+    }
+    bkl_release();
+    sched_trace_record(SEV_IRQ_EXIT, running_thread()->pid, 0, vec_nr, 0);
+}
+
+/*返回本cpu正在处理的中断保存的现场，只在中断处理函数中调用*/
+struct intr_stack* intr_frame(void)
+{
+    return intr_frames[smp_cpu_id()];
+}
+
 /*完成一般中断处理函数注册及异常名称注册*/
 static void exception_init(void)
 {
     int i;
+    intr_counter = counter_register("interrupts");
+    page_fault_counter = counter_register("page_faults");
     for(i=0; i<IDT_DESC_CNT; i++) {
         //idt_table数组中的函数是在进入中断后根据中断向量号调用的
-        idt_table[i] = general_intr_handler;   //默认为general_intr_handler
-                                               //以后会有register_handler来注册具体处理函数
+        idt_table[i] = intr_dispatch;
+        intr_handlers[i] = general_intr_handler;   //默认为general_intr_handler
+                                                   //以后会有register_handler来注册具体处理函数
         intr_name[i] = "unknow";   //先统一赋值为unknow
     }
     intr_name[0] = "#DE Divide Error";
@@ -135,6 +211,7 @@ static void exception_init(void)
     intr_name[12] = "#SS Stack Fault Exception";
     intr_name[13] = "#GP General Protection Exception";
     intr_name[14] = "#PF Page-Fault Exception";
+    intr_handlers[14] = page_fault_handler;
     //intr_name[15] 第15项是intel保留项，未使用
     intr_name[16] = "#MF x86 FPU Floating-Point Error";
     intr_name[17] = "#AC Alignment Check Exception";
@@ -187,8 +264,21 @@ enum intr_status intr_get_status()
 /*在中断处理程序数组第vector_no个元素中注册安装中断处理程序function*/
 void register_handler(uint8_t vector_no, intr_handler function)
 {
-    //idt_table数组中的函数是在进入中断后根据中断向量号调用的
-    idt_table[vector_no] = function;
+    //intr_handlers数组中的函数是在进入中断后由intr_dispatch根据中断向量号调用的
+    intr_handlers[vector_no] = function;
+}
+
+/*把第vector_no个中断门的入口换成entry，用于kernel.s中没有入口的向量*/
+void register_intr_entry(uint8_t vector_no, intr_handler entry)
+{
+    make_idt_desc(&idt[vector_no], IDT_DESC_ATTR_DPL0, entry);
+}
+
+/*在本cpu上加载IDT*/
+void idt_load(void)
+{
+    uint64_t idt_operand = ((sizeof(idt) - 1) | ( (uint64_t)(uint32_t)idt << 16 ));
+    asm volatile("lidt %0" : : "m"(idt_operand));
 }
 
 /*完成中断的所有初始化工作*/
@@ -200,7 +290,6 @@ void idt_init()
     pic_init();         //初始化8259A
 
     /* 加载IDT */
-    uint64_t idt_operand = ((sizeof(idt) - 1) | ( (uint64_t)(uint32_t)idt << 16 ));
-    asm volatile("lidt %0" : : "m"(idt_operand));
+    idt_load();
     put_str("idt_init done\n");
 }
@@ -3,6 +3,7 @@
 #include "stdint.h"
 
 typedef void* intr_handler;
+struct intr_stack;
 
 /*定义中断的两种状态：
     INTR_OFF值为0，表示关中断
@@ -14,10 +15,18 @@ enum intr_status        //中断状态
 };
 
 void register_handler(uint8_t vector_no, intr_handler function);
+/*把第vector_no个中断门的入口换成entry*/
+void register_intr_entry(uint8_t vector_no, intr_handler entry);
+/*打开8259A上第irq号中断引脚*/
+void pic_irq_unmask(uint8_t irq);
+/*在本cpu上加载IDT*/
+void idt_load(void);
 enum intr_status intr_get_status(void);
 enum intr_status intr_set_status(enum intr_status);
 enum intr_status intr_enable(void);
 enum intr_status intr_disable(void);
+/*返回本cpu正在处理的中断保存的现场，只在中断处理函数中调用*/
+struct intr_stack* intr_frame(void);
 
 void idt_init(void);   //完成中断的所有初始化工作
 
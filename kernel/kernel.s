@@ -22,11 +22,16 @@ intr%1entry:                        ;每个中断处理程序都要压入中断
     push fs
     push gs
     pushad                          ;压入32位寄存器，eax,ecx,edx,ebx,esp,ebp,esi,edi
+    cld                             ;被打断的代码可能正在memmove中倒着复制，处理函数要按DF=0运行，iretd时恢复原来的DF
 
-    ;如果是从片上进入的中断，除了往从片上发送EOI外，还要往主片上发送EOI
+    ;只向发出中断的8259A发送EOI，从片上进入的中断还要往主片上发送EOI，异常不发
+%if %1 >= 0x20 && %1 <= 0x2f
     mov al,0x20                     ;中断结束命令EOI
+%if %1 >= 0x28
     out 0xa0,al                     ;向从片发送
+%endif
     out 0x20,al                     ;向主片发送
+%endif
 
     push %1                         ;不管idt_table中的目标程序是否需要参数
                                     ;都压入中断向量号，调试时方便
@@ -114,6 +119,7 @@ syscall_handler:
     push fs
     push gs
     pushad
+    cld         ;c代码要求DF=0，用户态可能把它置上了
 
     push 0x80   ;压入0x80也是为了保持统一的栈格式
 
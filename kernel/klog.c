@@ -0,0 +1,123 @@
+#include "klog.h"
+#include "stdint.h"
+#include "global.h"
+#include "interrupt.h"
+#include "sync.h"
+#include "thread.h"
+#include "console.h"
+#include "print.h"
+#include "string.h"
+#include "io.h"
+
+/*内核日志，head和con_pos都是从开机起写入的总字节数，对KLOG_BUF_SIZE取模得到在buf中的位置*/
+static struct
+{
+    char buf[KLOG_BUF_SIZE];
+    uint32_t head;   //下一个字节写入的位置
+    uint32_t con_pos;   //下一个要输出到控制台的字节
+    bool ready;   //klogd已启动，之前的printk直接写控制台
+    struct wait_queue wq;   //klogd没有日志可输出时在这里睡眠
+} klog;
+
+/*从日志的pos处复制len个字节到dst，需关中断调用，调用者保证这些字节还没被覆盖*/
+static void klog_copy(char* dst, uint32_t pos, uint32_t len)
+{
+    uint32_t off = pos % KLOG_BUF_SIZE;
+    uint32_t first = KLOG_BUF_SIZE - off < len ? KLOG_BUF_SIZE - off : len;
+    memcpy(dst, klog.buf + off, first);
+    memcpy(dst + first, klog.buf, len - first);
+}
+
+/*klogd线程，把新写入的日志分块输出到控制台。控制台锁只在这里持有，printk不会因为它阻塞*/
+static void klogd(void* arg UNUSED)
+{
+    char chunk[KLOG_DRAIN_CHUNK];
+    while(1) {
+        enum intr_status old_status = intr_disable();
+        while(klog.con_pos == klog.head) {
+            wait_queue_sleep(&klog.wq);
+        }
+        if(klog.head - klog.con_pos > KLOG_BUF_SIZE) {   //来不及输出的已被覆盖，从还在的最旧的字节接着输出
+            klog.con_pos = klog.head - KLOG_BUF_SIZE;
+        }
+        uint32_t len = klog.head - klog.con_pos;
+        if(len > KLOG_DRAIN_CHUNK) {
+            len = KLOG_DRAIN_CHUNK;
+        }
+        klog_copy(chunk, klog.con_pos, len);
+        klog.con_pos += len;
+        intr_set_status(old_status);
+        console_write(chunk, len);
+    }
+}
+
+/*把str中len个字节交给bochs写到宿主机，两次端口写就输出整串，不经过VGA，也不会因滚屏丢失。
+  地址按当前页表翻译，用户缓冲区也可以直接传。没有开启port_e9_hack时这两个端口没有设备，写入被忽略*/
+void klog_host_write(const char* str, uint32_t len)
+{
+    outl(KLOG_HOST_ADDR_PORT, (uint32_t)str);
+    outl(KLOG_HOST_LEN_PORT, len);
+}
+
+/*把str中len个字节追加到日志并唤醒klogd，不睡眠，中断处理程序中也可调用。
+  klogd还没启动时直接写控制台*/
+void klog_write(const char* str, uint32_t len)
+{
+    klog_host_write(str, len);   //同时写到宿主机
+    enum intr_status old_status = intr_disable();
+    if(!klog.ready) {
+        intr_set_status(old_status);
+        console_write(str, len);
+        return;
+    }
+    if(len > KLOG_BUF_SIZE) {   //只保留末尾能放下的部分
+        str += len - KLOG_BUF_SIZE;
+        klog.head += len - KLOG_BUF_SIZE;
+        len = KLOG_BUF_SIZE;
+    }
+    uint32_t off = klog.head % KLOG_BUF_SIZE;
+    uint32_t first = KLOG_BUF_SIZE - off < len ? KLOG_BUF_SIZE - off : len;
+    memcpy(klog.buf + off, str, first);
+    memcpy(klog.buf, str + first, len - first);
+    klog.head += len;
+    wait_queue_wake_one(&klog.wq);
+    intr_set_status(old_status);
+}
+
+/*panic时调用，用汇编例程直接输出klogd还没输出的日志，出错前的最后几条消息不会丢*/
+void klog_panic_flush(void)
+{
+    if(!klog.ready) {
+        return;
+    }
+    if(klog.head - klog.con_pos > KLOG_BUF_SIZE) {
+        klog.con_pos = klog.head - KLOG_BUF_SIZE;
+    }
+    while(klog.con_pos != klog.head) {
+        put_char(klog.buf[klog.con_pos++ % KLOG_BUF_SIZE]);
+    }
+}
+
+/*把缓冲区中保留的最近至多count字节日志复制到buf，返回复制的字节数*/
+uint32_t sys_dmesg(char* buf, uint32_t count)
+{
+    enum intr_status old_status = intr_disable();
+    uint32_t len = klog.head < KLOG_BUF_SIZE ? klog.head : KLOG_BUF_SIZE;
+    if(len > count) {
+        len = count;
+    }
+    klog_copy(buf, klog.head - len, len);
+    intr_set_status(old_status);
+    return len;
+}
+
+/*初始化内核日志并启动klogd线程，此后printk只写缓冲区*/
+void klog_init(void)
+{
+    put_str("klog_init start\n");
+    klog.head = klog.con_pos = 0;
+    wait_queue_init(&klog.wq);
+    thread_start("klogd", 4, klogd, NULL);
+    klog.ready = true;
+    put_str("klog_init done\n");
+}
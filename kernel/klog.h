@@ -0,0 +1,21 @@
+#ifndef __KERNEL_KLOG_H
+#define __KERNEL_KLOG_H
+#include "stdint.h"
+
+#define KLOG_BUF_SIZE 16384   //内核日志环形缓冲区大小，须为2的幂，写满后覆盖最旧的内容
+#define KLOG_DRAIN_CHUNK 256   //klogd每次从缓冲区取出输出到控制台的字节数
+#define KLOG_HOST_ADDR_PORT 0x8910   //bochs的port_e9_hack缓冲输出：先写字符串的线性地址
+#define KLOG_HOST_LEN_PORT 0x8914   //再写长度，bochs一次把整串复制到宿主机的日志文件
+
+/*初始化内核日志并启动把日志输出到控制台的klogd线程，之前的printk直接输出*/
+void klog_init(void);
+/*把str中len个字节追加到日志并唤醒klogd，不睡眠，中断处理程序中也可调用*/
+void klog_write(const char* str, uint32_t len);
+/*只把str中len个字节交给bochs写到宿主机的日志文件，不进日志缓冲区，用户进程的控制台输出经此送到宿主机*/
+void klog_host_write(const char* str, uint32_t len);
+/*panic时调用，用汇编例程直接输出klogd还没输出的日志*/
+void klog_panic_flush(void);
+/*把缓冲区中保留的最近至多count字节日志复制到buf，返回复制的字节数*/
+uint32_t sys_dmesg(char* buf, uint32_t count);
+
+#endif
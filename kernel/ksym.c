@@ -0,0 +1,43 @@
+#include "ksym.h"
+#include "stdint.h"
+#include "global.h"
+#include "string.h"
+
+/*查找addr所在的函数，返回函数名并把addr相对函数起点的偏移存入offset，找不到返回NULL。
+  二分查找地址不大于addr的最后一个符号*/
+const char* addr2sym(uint32_t addr, uint32_t* offset)
+{
+    if(ksym_cnt == 0 || addr < ksyms[0].addr) {
+        return NULL;
+    }
+    uint32_t low = 0, high = ksym_cnt;   //答案在[low, high)中
+    while(high - low > 1) {
+        uint32_t mid = (low + high) / 2;
+        if(ksyms[mid].addr <= addr) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    if(offset != NULL) {
+        *offset = addr - ksyms[low].addr;
+    }
+    return &ksym_names[ksyms[low].name_off];
+}
+
+/*把addr所在的内核函数名复制到name，至多len字节含结尾的0，返回addr相对函数起点的偏移，找不到返回-1*/
+int32_t sys_ksym(uint32_t addr, char* name, uint32_t len)
+{
+    uint32_t offset;
+    const char* sym = addr2sym(addr, &offset);
+    if(sym == NULL || name == NULL || len == 0) {
+        return -1;
+    }
+    uint32_t sym_len = strlen(sym);
+    if(sym_len >= len) {
+        sym_len = len - 1;
+    }
+    memcpy(name, sym, sym_len);
+    name[sym_len] = 0;
+    return offset;
+}
@@ -0,0 +1,23 @@
+#ifndef __KERNEL_KSYM_H
+#define __KERNEL_KSYM_H
+#include "stdint.h"
+
+#define KSYM_NAME_LEN 32   //取函数名时的缓冲区大小，更长的名字被截断
+
+/*内核符号表的一项，按地址从小到大排列，由链接后的nm输出生成*/
+struct ksym
+{
+    uint32_t addr;
+    uint32_t name_off;   //名字在ksym_names中的偏移
+};
+
+extern const uint32_t ksym_cnt;
+extern const struct ksym ksyms[];
+extern const char ksym_names[];
+
+/*查找addr所在的函数，返回函数名并把addr相对函数起点的偏移存入offset，找不到返回NULL*/
+const char* addr2sym(uint32_t addr, uint32_t* offset);
+/*把addr所在的内核函数名复制到name，至多len字节含结尾的0，返回addr相对函数起点的偏移，找不到返回-1*/
+int32_t sys_ksym(uint32_t addr, char* name, uint32_t len);
+
+#endif
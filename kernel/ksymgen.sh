@@ -0,0 +1,26 @@
+###### 从标准输入读nm -n的输出，生成内核符号表的c代码写到标准输出 ######
+###### 标准输入为空时生成空表，用于第一次链接 ######
+
+awk '
+BEGIN {
+    print "#include \"ksym.h\""
+    cnt = 0
+    off = 0
+}
+$2 == "T" || $2 == "t" {
+    addr[cnt] = $1
+    name_off[cnt] = off
+    names = names $3 "\\0"
+    off += length($3) + 1
+    cnt++
+}
+END {
+    printf "const uint32_t ksym_cnt = %d;\n", cnt
+    print "const struct ksym ksyms[] = {"
+    for(i = 0; i < cnt; i++) {
+        printf "    {0x%s, %d},\n", addr[i], name_off[i]
+    }
+    print "    {0, 0}"
+    print "};"
+    printf "const char ksym_names[] = \"%s\";\n", names
+}'
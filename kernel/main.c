@@ -23,20 +23,7 @@ void init(void);
 int main(void) {
    put_str("I am kernel\n");
    init_all();
-
-   // sys_unlink("/prog_arg");
-   // uint32_t file_size = 10004;
-   // uint32_t sec_cnt = DIV_ROUND_UP(file_size, 512);
-   // struct disk* sda = &channels[0].devices[0];
-   // void* prog_buf = sys_malloc(file_size);
-   // ide_read(sda, 300, prog_buf, sec_cnt);
-   // int32_t fd = sys_open("/cat", O_CREAT|O_RDWR);
-   // if(fd != -1) {
-   //    if(sys_write(fd, prog_buf, file_size) == -1) {
-   //       printk("file write error!\n");
-   //       while(1);
-   //    }
-   // }
+   //用户程序不再从硬盘第300扇区装入，在shell中用import命令从宿主机共享目录导入
 
    //cls_screen();
    console_put_str("huloves@huloves:~/ $" );
@@ -51,10 +38,12 @@ void init(void)
       int status;
       int child_pid;
       printf("AAAAAAAAAAAAAAa\n");
-      //init在此处不停的回收僵尸进程
+      //init在此处不停的回收僵尸进程，被唤醒一次就把已经退出的都收掉，不必每个都阻塞一次
       while(1) {
          child_pid = wait(&status);
-         printf("i'am init, my pid is 1, i recieve a child, it's pid is %d, status is %d\n", child_pid, status);
+         do {
+            printf("i'am init, my pid is 1, i recieve a child, it's pid is %d, status is %d\n", child_pid, status);
+         } while((child_pid = waitopt(&status, WNOHANG)) > 0);
       }
    } else {
       my_shell();
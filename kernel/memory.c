@@ -9,28 +9,74 @@
 #include "thread.h"
 #include "interrupt.h"
 #include "stdio-kernel.h"
+#include "swap.h"
+#include "counter.h"
 
-/******* 位图地址 ******
- * 因为0xc009f000是内核主线程栈顶，0xc009e000是内核主线程的pcd。
- * 一个页框大小的位图可表示128MB内存，位图位置安排在地址0xc009a000，
- * 这样本系统最大支持4个页框的位图，即512MB
+/******* loader留下的内存信息 ******
+ * loader在0xb00处存放按最大地址估算的内存容量，其后是gdt_ptr，
+ * 再后面是int 0x15 e820返回的ARDS数组和个数，缓冲区只有244字节，最多12项
 */
-#define MEM_BITMAP_BASE 0xc009a000
+#define TOTAL_MEM_ADDR 0xb00
+#define ARDS_BUF_ADDR 0xb0a
+#define ARDS_NR_ADDR 0xbfe
+#define ARDS_MAX 12
+#define ARDS_TYPE_RAM 1   //可用内存
+#define KERNEL_POOL_MAX_PAGES 0x20000   //内核内存池最多512MB，内核页都映射在内核堆中，要给内核虚拟地址空间留余量
 
 /*0xc0000000是内核从虚拟地址3G起。0x100000意指跨过低端1MB内存， 使虚拟地址在逻辑上连续*/
 #define K_HEAP_START 0xc0100000
 #define PDE_IDX(addr) ((addr & 0xffc00000) >> 22)
 #define PTE_IDX(addr) ((addr & 0x003ff000) >> 12)
 
+#define KMEM_CACHE_MAX 8   //对象缓存的最大个数
+#define KMEM_EMPTY_MAX 2   //每个对象缓存最多保留的空闲slab数，多出来的归还内存池
+#define SLAB_FREE_END 0xff   //slab空闲对象链表的结束标记
+#define TLB_FLUSH_ALL_THRESHOLD 32   //一次解除映射的页数超过此值就整体刷新tlb
+
+#define BUDDY_MAX_ORDER 10   //伙伴系统的最大阶，最大的块为2^10个页框，即4MB
+#define FRAME_NONE 0xffffffff   //空闲链表的结束标记
+#define ZERO_POOL_MAX 64   //每个内存池预清零链表的页框上限
+
 /*内存池结构，生成两个实例用于管理内核内存池和用户内存池*/
 struct pool
 {
-    struct bitmap pool_bitmap;   //本内存池用到的位图结构，用于管理物理内存
+    struct page_frame* frames;   //本内存池的页框描述符数组，用于管理物理内存
+    uint32_t free_area[BUDDY_MAX_ORDER + 1];   //各阶空闲块链表的表头，存放首页框下标
+    uint32_t free_pages;   //本内存池的空闲页框数，不含预清零链表上的页框
+    uint32_t zero_list;   //预清零链表的表头，链表上的页框已从伙伴系统取出并清零
+    uint16_t zero_cnt;   //预清零链表上的页框数
+    uint32_t peak_used_pages;   //已用页框数的最高值
     uint32_t phy_addr_start;   //本内存池所管理物理内存的起始地址
     uint32_t pool_size;   //本内存池字节容量
     struct lock lock;   //申请内存时互斥
 };
 
+/*对象缓存，管理同一种定长内核对象。对象小于半页时按slab切分页框，否则每个对象独占一页*/
+struct kmem_cache
+{
+    const char* name;   //缓存名，便于调试和统计
+    uint32_t obj_size;   //对象大小，已按4字节对齐
+    uint32_t objs_per_slab;   //每个slab容纳的对象数，为0表示整页对象
+    uint32_t obj_offset;   //slab中第一个对象相对页首的偏移
+    void (*ctor)(void*);   //对象构造函数，slab创建时对每个对象调用一次，可为NULL
+    struct list slabs_partial;   //部分对象被占用的slab
+    struct list slabs_full;   //对象全部被占用的slab
+    struct list slabs_empty;   //对象全部空闲的slab
+    uint32_t empty_cnt;   //slabs_empty中的个数，整页对象时为free_pages中的个数
+    void* free_pages[KMEM_EMPTY_MAX];   //整页对象的空闲页，不在页内挂链表，因为退出的线程释放pcb后仍在用它的栈
+    struct lock lock;
+};
+
+/*slab头，位于slab所在页的最前面，其后是空闲对象链表和对象*/
+struct slab
+{
+    struct list_elem slab_tag;   //挂在所属cache的某个slab链表上
+    struct kmem_cache* cache;
+    uint16_t inuse;   //已分配的对象数
+    uint16_t free_idx;   //第一个空闲对象的下标
+    uint8_t next_free[];   //空闲对象链表，next_free[i]是对象i之后的空闲对象下标。链表不放在对象内，以免破坏已构造的对象
+};
+
 /*内存仓库*/
 struct arena
 {
@@ -40,42 +86,278 @@ struct arena
 };
 
 struct mem_block_desc k_block_descs[DESC_CNT];   //内核内存块描述符数组
+static uint32_t malloc_hist[MALLOC_HIST_CNT];   //sys_malloc请求大小的直方图
+static uint32_t large_allocs;   //大块分配的累计次数
+static uint32_t k_large_cnt, k_large_pages;   //内核尚未释放的大块分配。用户进程退出时整体回收内存，不经过sys_free，所以只统计内核
+
+static struct kmem_cache kmem_caches[KMEM_CACHE_MAX];   //所有对象缓存
+static uint32_t kmem_cache_cnt = 0;
 
 struct pool kernel_pool, user_pool;  //生成内核内存池和用户内存池
 struct virtual_addr kernel_vaddr;   //此结构用来给内核分配虚拟地址
+static uint32_t kmap_window_vaddr;   //内核临时映射窗口，用于访问未映射到内核空间的物理页框
+static uint32_t zero_window_vaddr;   //idle线程清零页框专用的映射窗口
+static bool pge_enabled = false;   //是否已打开cr4的PGE，打开后内核页为全局页
+static bool pse_enabled = false;   //是否已打开cr4的PSE，打开后用户的大映射区可以用4MB的大页
+static uint32_t large_page_counter, large_fallback_counter;   //映射的大页数，因没有4MB物理块退回4KB页的次数
+static uint32_t zero_page_phy;   //全局只读的零页，没写过的.bss、堆和匿名映射页都映射到它，不计引用
+static uint32_t zero_page_counter;   //映射零页的次数
+static uint32_t (*mem_reclaim)(uint32_t pg_cnt);   //内核内存池页框不够时回收缓存页的函数，由页缓存登记
+
+/*重新计算节点n的max_cnt*/
+static void extent_update(struct vaddr_extents* ext, uint16_t n)
+{
+    struct vaddr_extent* node = &ext->nodes[n];
+    uint32_t max_cnt = node->pg_cnt;
+    if(ext->nodes[node->left].max_cnt > max_cnt) {
+        max_cnt = ext->nodes[node->left].max_cnt;
+    }
+    if(ext->nodes[node->right].max_cnt > max_cnt) {
+        max_cnt = ext->nodes[node->right].max_cnt;
+    }
+    node->max_cnt = max_cnt;
+}
 
-/*在pf表示的虚拟内存池中申请pg_cnt个虚拟页，成功返回虚拟页的起始地址，失败返回NULL*/
-static void* vaddr_get(enum pool_flags pf, uint32_t pg_cnt)
+/*将以t为根的树按起始页号分裂，start小于key的节点归*l，其余归*r*/
+static void extent_split(struct vaddr_extents* ext, uint16_t t, uint32_t key, uint16_t* l, uint16_t* r)
 {
-    int vaddr_start = 0, bit_idx_start = -1;
-    uint32_t cnt = 0;
-    if(pf == PF_KERNEL) {   //内核内存池
-        bit_idx_start = bitmap_scan(&kernel_vaddr.vaddr_bitmap, pg_cnt);
-        if(bit_idx_start == -1) {
-            return NULL;
-        }
-        while(cnt < pg_cnt) {
-            bitmap_set(&kernel_vaddr.vaddr_bitmap, bit_idx_start + cnt++, 1);
-        }
-        vaddr_start = kernel_vaddr.vaddr_start + bit_idx_start * PG_SIZE;
+    if(t == EXTENT_NIL) {
+        *l = *r = EXTENT_NIL;
+        return;
+    }
+    if(ext->nodes[t].start < key) {
+        extent_split(ext, ext->nodes[t].right, key, &ext->nodes[t].right, r);
+        *l = t;
     } else {
-        //用户内存池，将来实现用户进程补充
-        struct task_struct* cur = running_thread();
-        bit_idx_start = bitmap_scan(&cur->userprog_vaddr.vaddr_bitmap, pg_cnt);
-        if(bit_idx_start == -1) {
-            return NULL;
+        extent_split(ext, ext->nodes[t].left, key, l, &ext->nodes[t].left);
+        *r = t;
+    }
+    extent_update(ext, t);
+}
+
+/*合并两棵树，l中所有节点的起始页号都小于r，返回新的根*/
+static uint16_t extent_merge(struct vaddr_extents* ext, uint16_t l, uint16_t r)
+{
+    if(l == EXTENT_NIL) {
+        return r;
+    }
+    if(r == EXTENT_NIL) {
+        return l;
+    }
+    if(ext->nodes[l].prio > ext->nodes[r].prio) {
+        ext->nodes[l].right = extent_merge(ext, ext->nodes[l].right, r);
+        extent_update(ext, l);
+        return l;
+    }
+    ext->nodes[r].left = extent_merge(ext, l, ext->nodes[r].left);
+    extent_update(ext, r);
+    return r;
+}
+
+/*申请一个节点记录空闲区段[start, start + pg_cnt)，节点耗尽时置overflow并返回EXTENT_NIL*/
+static uint16_t extent_node_new(struct vaddr_extents* ext, uint32_t start, uint32_t pg_cnt)
+{
+    uint16_t n = ext->free_node;
+    if(n == EXTENT_NIL) {
+        ext->overflow = true;
+        return EXTENT_NIL;
+    }
+    ext->free_node = ext->nodes[n].left;
+    struct vaddr_extent* node = &ext->nodes[n];
+    node->start = start;
+    node->pg_cnt = node->max_cnt = pg_cnt;
+    node->prio = start * 2654435761U;   //用乘法散列当作随机优先级
+    node->left = node->right = EXTENT_NIL;
+    return n;
+}
+
+/*回收节点n*/
+static void extent_node_free(struct vaddr_extents* ext, uint16_t n)
+{
+    ext->nodes[n].left = ext->free_node;
+    ext->free_node = n;
+}
+
+/*回收以t为根的整棵子树，返回其中最后一个区段的结束页号，空树返回0*/
+static uint32_t extent_free_tree(struct vaddr_extents* ext, uint16_t t)
+{
+    if(t == EXTENT_NIL) {
+        return 0;
+    }
+    extent_free_tree(ext, ext->nodes[t].left);
+    uint32_t end = ext->nodes[t].start + ext->nodes[t].pg_cnt;
+    uint32_t right_end = extent_free_tree(ext, ext->nodes[t].right);
+    extent_node_free(ext, t);
+    return right_end > end ? right_end : end;
+}
+
+/*返回以t为根的树中起始页号最大的节点*/
+static uint16_t extent_last(struct vaddr_extents* ext, uint16_t t)
+{
+    while(ext->nodes[t].right != EXTENT_NIL) {
+        t = ext->nodes[t].right;
+    }
+    return t;
+}
+
+/*返回以t为根的树中起始页号最小的节点*/
+static uint16_t extent_first(struct vaddr_extents* ext, uint16_t t)
+{
+    while(ext->nodes[t].left != EXTENT_NIL) {
+        t = ext->nodes[t].left;
+    }
+    return t;
+}
+
+/*将空闲区段树ext初始化为只含从start起的pg_cnt页这一个空闲区段*/
+void extents_init(struct vaddr_extents* ext, uint32_t start, uint32_t pg_cnt)
+{
+    memset(ext, 0, sizeof(struct vaddr_extents));
+    uint16_t n;
+    for(n = EXTENT_NODE_CNT - 1; n > EXTENT_NIL; n--) {
+        extent_node_free(ext, n);
+    }
+    ext->root = extent_node_new(ext, start, pg_cnt);
+}
+
+/*把[start, start + pg_cnt)从空闲区段中去掉，其中已被占用的部分忽略*/
+static void extent_remove_range(struct vaddr_extents* ext, uint32_t start, uint32_t pg_cnt)
+{
+    uint32_t end = start + pg_cnt, tail_end = 0;
+    uint16_t l, m, r, p;
+    extent_split(ext, ext->root, start, &l, &r);
+
+    //起始页号在start之前的最后一个区段可能伸进范围内，截掉伸进来的部分
+    if(l != EXTENT_NIL) {
+        p = extent_last(ext, l);
+        uint32_t p_end = ext->nodes[p].start + ext->nodes[p].pg_cnt;
+        if(p_end > start) {
+            extent_split(ext, l, ext->nodes[p].start, &l, &p);
+            ext->nodes[p].pg_cnt = start - ext->nodes[p].start;
+            extent_update(ext, p);
+            l = extent_merge(ext, l, p);
+            tail_end = p_end;
+        }
+    }
+
+    //起始页号落在范围内的区段全部去掉，最后一个可能伸出范围
+    extent_split(ext, r, end, &m, &r);
+    uint32_t m_end = extent_free_tree(ext, m);
+    if(m_end > tail_end) {
+        tail_end = m_end;
+    }
+
+    //伸出范围的尾巴重新作为空闲区段
+    if(tail_end > end) {
+        uint16_t n = extent_node_new(ext, end, tail_end - end);
+        r = extent_merge(ext, n, r);
+    }
+    ext->root = extent_merge(ext, l, r);
+}
+
+/*在ext中按首次适配分配连续pg_cnt页，成功返回起始页号，失败返回-1*/
+static int32_t extent_alloc(struct vaddr_extents* ext, uint32_t pg_cnt)
+{
+    uint16_t t = ext->root;
+    if(ext->nodes[t].max_cnt < pg_cnt) {
+        return -1;
+    }
+    //左子树够大就往左，自己够大就用自己，否则往右，保证取到地址最低的合适区段
+    while(1) {
+        struct vaddr_extent* node = &ext->nodes[t];
+        if(ext->nodes[node->left].max_cnt >= pg_cnt) {
+            t = node->left;
+        } else if(node->pg_cnt >= pg_cnt) {
+            break;
+        } else {
+            t = node->right;
         }
+    }
+    uint32_t start = ext->nodes[t].start;
+    extent_remove_range(ext, start, pg_cnt);
+    return start;
+}
 
-        while(cnt < pg_cnt) {
-            bitmap_set(&cur->userprog_vaddr.vaddr_bitmap, bit_idx_start + cnt++, 1);
+/*将[start, start + pg_cnt)归还给ext，并与前后相邻的空闲区段合并*/
+static void extent_free(struct vaddr_extents* ext, uint32_t start, uint32_t pg_cnt)
+{
+    uint16_t l, r, n;
+    extent_split(ext, ext->root, start, &l, &r);
+
+    //与前一个区段相接就把它并进来
+    if(l != EXTENT_NIL) {
+        n = extent_last(ext, l);
+        if(ext->nodes[n].start + ext->nodes[n].pg_cnt == start) {
+            extent_split(ext, l, ext->nodes[n].start, &l, &n);
+            start = ext->nodes[n].start;
+            pg_cnt += ext->nodes[n].pg_cnt;
+            extent_node_free(ext, n);
         }
-        vaddr_start = cur->userprog_vaddr.vaddr_start + bit_idx_start * PG_SIZE;
-        //0xc0000000 - PG_SIZE作为用户3级栈已经在start_process被分配
-        ASSERT((uint32_t)vaddr_start < (0xc0000000 - PG_SIZE));
     }
+    //与后一个区段相接也并进来
+    if(r != EXTENT_NIL) {
+        n = extent_first(ext, r);
+        if(ext->nodes[n].start == start + pg_cnt) {
+            extent_split(ext, r, start + pg_cnt + 1, &n, &r);
+            pg_cnt += ext->nodes[n].pg_cnt;
+            extent_node_free(ext, n);
+        }
+    }
+
+    n = extent_node_new(ext, start, pg_cnt);
+    ext->root = extent_merge(ext, extent_merge(ext, l, n), r);
+}
+
+/*返回pf对应的虚拟地址池*/
+static struct virtual_addr* vaddr_pool(enum pool_flags pf)
+{
+    return pf == PF_KERNEL ? &kernel_vaddr : &running_thread()->userprog_vaddr;
+}
+
+/*在pf表示的虚拟内存池中申请pg_cnt个虚拟页，成功返回虚拟页的起始地址，失败返回NULL*/
+void* vaddr_get(enum pool_flags pf, uint32_t pg_cnt)
+{
+    struct virtual_addr* vpool = vaddr_pool(pf);
+    int bit_idx_start = -1;
+    uint32_t cnt = 0;
+
+    //优先在空闲区段树中查找，节点耗尽后退回位图扫描
+    enum intr_status old_status = intr_disable();
+    if(vpool->extents != NULL && !vpool->extents->overflow) {
+        bit_idx_start = extent_alloc(vpool->extents, pg_cnt);
+    } else {
+        bit_idx_start = bitmap_scan(&vpool->vaddr_bitmap, pg_cnt);
+    }
+    if(bit_idx_start == -1) {
+        intr_set_status(old_status);
+        return NULL;
+    }
+    while(cnt < pg_cnt) {
+        bitmap_set(&vpool->vaddr_bitmap, bit_idx_start + cnt++, 1);
+    }
+    intr_set_status(old_status);
+
+    uint32_t vaddr_start = vpool->vaddr_start + bit_idx_start * PG_SIZE;
+    //0xc0000000 - PG_SIZE作为用户3级栈已经在start_process被分配
+    ASSERT(pf == PF_KERNEL || vaddr_start < (0xc0000000 - PG_SIZE));
     return (void*)vaddr_start;
 }
 
+/*在pf虚拟地址池中将从vaddr起的pg_cnt页标记为已占用，不建立映射*/
+void vaddr_mark(enum pool_flags pf, void* vaddr, uint32_t pg_cnt)
+{
+    struct virtual_addr* vpool = vaddr_pool(pf);
+    uint32_t bit_idx_start = ((uint32_t)vaddr - vpool->vaddr_start) / PG_SIZE, cnt = 0;
+    enum intr_status old_status = intr_disable();
+    if(vpool->extents != NULL && !vpool->extents->overflow) {
+        extent_remove_range(vpool->extents, bit_idx_start, pg_cnt);
+    }
+    while(cnt < pg_cnt) {
+        bitmap_set(&vpool->vaddr_bitmap, bit_idx_start + cnt++, 1);
+    }
+    intr_set_status(old_status);
+}
+
 /*得到虚拟地址vaddr对应的pte指针*/
 uint32_t* pte_ptr(uint32_t vaddr)
 {
@@ -92,23 +374,186 @@ uint32_t* pde_ptr(uint32_t vaddr)
     return pde;
 }
 
+/*将以下标idx的页框为首、阶为order的空闲块挂到空闲链表的表头*/
+static void buddy_list_add(struct pool* m_pool, uint32_t idx, uint8_t order)
+{
+    struct page_frame* frame = &m_pool->frames[idx];
+    frame->order = order;
+    frame->flags |= FRAME_FREE;
+    frame->prev = FRAME_NONE;
+    frame->next = m_pool->free_area[order];
+    if(frame->next != FRAME_NONE) {
+        m_pool->frames[frame->next].prev = idx;
+    }
+    m_pool->free_area[order] = idx;
+}
+
+/*将以下标idx的页框为首的空闲块从它所在的空闲链表中摘下*/
+static void buddy_list_del(struct pool* m_pool, uint32_t idx)
+{
+    struct page_frame* frame = &m_pool->frames[idx];
+    ASSERT(frame->flags & FRAME_FREE);
+    if(frame->prev != FRAME_NONE) {
+        m_pool->frames[frame->prev].next = frame->next;
+    } else {
+        m_pool->free_area[frame->order] = frame->next;
+    }
+    if(frame->next != FRAME_NONE) {
+        m_pool->frames[frame->next].prev = frame->prev;
+    }
+    frame->flags &= ~FRAME_FREE;
+}
+
+/*在m_pool中分配2^order个连续页框，成功返回首页框下标，失败返回-1*/
+static int32_t buddy_alloc(struct pool* m_pool, uint8_t order)
+{
+    enum intr_status old_status = intr_disable();   //pfree可能在未持锁时调用，链表操作要保证原子
+    uint8_t cur_order = order;
+
+    //从order阶开始向上找第一个非空的空闲链表
+    while(cur_order <= BUDDY_MAX_ORDER && m_pool->free_area[cur_order] == FRAME_NONE) {
+        cur_order++;
+    }
+    if(cur_order > BUDDY_MAX_ORDER) {
+        intr_set_status(old_status);
+        return -1;
+    }
+
+    uint32_t idx = m_pool->free_area[cur_order];
+    buddy_list_del(m_pool, idx);
+
+    //块比需要的大，就逐级对半拆分，把后一半挂回低一阶的空闲链表
+    while(cur_order > order) {
+        cur_order--;
+        buddy_list_add(m_pool, idx + (1 << cur_order), cur_order);
+    }
+    m_pool->free_pages -= (1 << order);
+    uint32_t used_pages = m_pool->pool_size / PG_SIZE - m_pool->free_pages - m_pool->zero_cnt;
+    if(used_pages > m_pool->peak_used_pages) {
+        m_pool->peak_used_pages = used_pages;
+    }
+    intr_set_status(old_status);
+    return idx;
+}
+
+/*将以下标idx的页框为首、阶为order的块归还给m_pool，并与空闲的伙伴逐级合并*/
+static void buddy_free(struct pool* m_pool, uint32_t idx, uint8_t order)
+{
+    enum intr_status old_status = intr_disable();
+    uint32_t frame_cnt = m_pool->pool_size / PG_SIZE;
+    ASSERT(idx < frame_cnt && !(m_pool->frames[idx].flags & FRAME_FREE));
+    m_pool->free_pages += (1 << order);
+    //页框的用途随释放一并清除
+    uint32_t cnt;
+    for(cnt = 0; cnt < (1U << order); cnt++) {
+        ASSERT(!(m_pool->frames[idx + cnt].flags & FRAME_LOCKED));
+        m_pool->frames[idx + cnt].flags &= ~FRAME_USE_MASK;
+        m_pool->frames[idx + cnt].owner = NULL;
+    }
+
+    while(order < BUDDY_MAX_ORDER) {
+        uint32_t buddy_idx = idx ^ (1 << order);   //伙伴块的首页框下标
+        //伙伴超出内存池，或者伙伴不是同阶的空闲块，都不能合并
+        if(buddy_idx + (1 << order) > frame_cnt) {
+            break;
+        }
+        struct page_frame* buddy = &m_pool->frames[buddy_idx];
+        if(!(buddy->flags & FRAME_FREE) || buddy->order != order) {
+            break;
+        }
+        buddy_list_del(m_pool, buddy_idx);
+        idx &= ~(1 << order);   //合并后的块以两者中靠前的为首
+        order++;
+    }
+    buddy_list_add(m_pool, idx, order);
+    intr_set_status(old_status);
+}
+
+/*将从下标idx_start起的cnt个页框按尽量大的对齐块归还给m_pool*/
+static void buddy_free_range(struct pool* m_pool, uint32_t idx_start, uint32_t cnt)
+{
+    uint32_t idx = idx_start, idx_end = idx_start + cnt;
+    while(idx < idx_end) {
+        uint8_t order = 0;
+        //块首要按块大小对齐，且不能越过范围末尾
+        while(order < BUDDY_MAX_ORDER && (idx & (1 << order)) == 0 && idx + (2 << order) <= idx_end) {
+            order++;
+        }
+        buddy_free(m_pool, idx, order);
+        idx += (1 << order);
+    }
+}
+
+/*从m_pool的预清零链表中取1个页框，成功返回页框的物理地址，链表为空返回NULL*/
+static void* palloc_zeroed(struct pool* m_pool)
+{
+    enum intr_status old_status = intr_disable();
+    uint32_t idx = m_pool->zero_list;
+    if(idx == FRAME_NONE) {
+        intr_set_status(old_status);
+        return NULL;
+    }
+    m_pool->zero_list = m_pool->frames[idx].next;
+    m_pool->zero_cnt--;
+    m_pool->frames[idx].flags &= ~FRAME_ZERO;
+    m_pool->frames[idx].ref_cnt = 1;
+    intr_set_status(old_status);
+    return (void*)((idx * PG_SIZE) + m_pool->phy_addr_start);
+}
+
 /*在m_pool指向的物理内存池中分配1个物理页，成功则返回页框的物理地址，失败则返回NULL*/
 static void* palloc(struct pool* m_pool)
 {
-    //扫描或设置要保证原子操作
-    int bit_idx = bitmap_scan(&m_pool->pool_bitmap, 1);   //找到一个物理页面
-    if(bit_idx == -1) {
-        return NULL;
+    int32_t idx = buddy_alloc(m_pool, 0);   //找到一个物理页面
+    if(idx == -1) {
+        return palloc_zeroed(m_pool);   //伙伴系统耗尽时，预清零的页框也可以用
     }
-    bitmap_set(&m_pool->pool_bitmap, bit_idx, 1);   //将此位置1
-    uint32_t page_phyaddr = ((bit_idx * PG_SIZE) + m_pool->phy_addr_start);
+    m_pool->frames[idx].ref_cnt = 1;
+    uint32_t page_phyaddr = ((idx * PG_SIZE) + m_pool->phy_addr_start);
     return (void*)page_phyaddr;
 }
 
+/*在m_pool中分配pg_cnt个物理地址连续的页框，成功返回首页框物理地址，失败返回NULL*/
+static void* palloc_contig(struct pool* m_pool, uint32_t pg_cnt)
+{
+    uint8_t order = 0;
+    while((1U << order) < pg_cnt) {
+        order++;
+    }
+    if(order > BUDDY_MAX_ORDER) {
+        return NULL;
+    }
+    int32_t idx = buddy_alloc(m_pool, order);
+    if(idx == -1) {
+        return NULL;
+    }
+    //块的后半部分多余的页框立即归还
+    buddy_free_range(m_pool, idx + pg_cnt, (1 << order) - pg_cnt);
+    uint32_t pg_idx;
+    for(pg_idx = 0; pg_idx < pg_cnt; pg_idx++) {
+        m_pool->frames[idx + pg_idx].ref_cnt = 1;
+    }
+    return (void*)((idx * PG_SIZE) + m_pool->phy_addr_start);
+}
+
+/*刷新整个tlb，打开PGE后重新加载cr3刷不掉全局页，要通过开关PGE来刷新*/
+void tlb_flush_all(void)
+{
+    uint32_t reg;
+    if(pge_enabled) {
+        asm volatile ("movl %%cr4, %0; andl $0xffffff7f, %0; movl %0, %%cr4; orl $0x80, %0; movl %0, %%cr4" : "=r"(reg) : : "memory");
+    } else {
+        asm volatile ("movl %%cr3, %0; movl %0, %%cr3" : "=r"(reg) : : "memory");
+    }
+}
+
 /*页表中添加虚拟地址_vaddr与物理地址_page_phyaddr的映射*/
 static void page_table_add(void* _vaddr, void* _page_phyaddr)
 {
     uint32_t vaddr = (uint32_t)_vaddr, page_phyaddr = (uint32_t)_page_phyaddr;
+    if(vaddr >= 0xc0000000) {   //内核空间为所有进程共享，映射为全局页
+        page_phyaddr |= PG_G;
+    }
     uint32_t* pde = pde_ptr(vaddr);
     uint32_t* pte = pte_ptr(vaddr);
 
@@ -127,22 +572,42 @@ static void page_table_add(void* _vaddr, void* _page_phyaddr)
             *pte = (page_phyaddr | PG_US_U | PG_RW_W | PG_P_1);
         }
     } else {   //页目录项不存在，所以要先创建页目录项在创建页表项
-        //页表中用到的页框一律从内核空间分配
-        uint32_t pde_phyaddr = (uint32_t)palloc(&kernel_pool);
+        //页表中用到的页框一律从内核空间分配，优先用预清零的页框
+        uint32_t pde_phyaddr = (uint32_t)palloc_zeroed(&kernel_pool);
+        bool zeroed = pde_phyaddr != 0;
+        if(!zeroed) {
+            pde_phyaddr = (uint32_t)palloc(&kernel_pool);
+        }
         
         *pde = (pde_phyaddr | PG_US_U | PG_RW_W | PG_P_1);
+        if(vaddr < 0xc0000000) {
+            uint32_t pde_idx = vaddr >> 22;
+            running_thread()->group_leader->pde_used[pde_idx / 32] |= 1U << (pde_idx % 32);
+        }
         
         //分配道德物理页地址pde_phyaddr对应的物理内存清0，避免里面的陈旧数据编程页表项，让页表混乱
         //访问到pde对应的物理地址，用pte取高20位便可。因为pte基于该pde对应的物理地址内在寻址，第12位置0便是对应的物理页的起始地址
-        memset((void*)((int)pte & 0xfffff000), 0, PG_SIZE);
+        if(!zeroed) {
+            memset((void*)((int)pte & 0xfffff000), 0, PG_SIZE);
+        }
 
         ASSERT(!(*pte & 0x00000001));
         *pte = (page_phyaddr | PG_US_U | PG_RW_W | PG_P_1);
     }
 }
 
-/*分配pg_cnt个页空间，成功则返回虚拟地址，失败时返回NULL*/
-void* malloc_page(enum pool_flags pf, uint32_t pg_cnt)
+/*从用户内存池分配一个页框，返回物理地址，失败返回NULL。池中没有空闲页框时先换出一些用户页再试*/
+static void* palloc_user(void)
+{
+    void* page_phyaddr = palloc(&user_pool);
+    if(page_phyaddr == NULL && swap_reclaim(SWAP_RECLAIM_BATCH) > 0) {
+        page_phyaddr = palloc(&user_pool);
+    }
+    return page_phyaddr;
+}
+
+/*分配pg_cnt个页空间，zero为true时保证页内容全为0，成功则返回虚拟地址，失败时返回NULL*/
+static void* page_alloc(enum pool_flags pf, uint32_t pg_cnt, bool zero)
 {
     ASSERT(pg_cnt > 0 && pg_cnt < 3840);
     //1.通过vaddr_get在虚拟内存池中申请虚拟地址
@@ -156,27 +621,77 @@ void* malloc_page(enum pool_flags pf, uint32_t pg_cnt)
     uint32_t vaddr = (uint32_t)vaddr_start, cnt = pg_cnt;
     struct pool* mem_pool = pf & PF_KERNEL ? &kernel_pool : &user_pool;
 
+    //多页时优先从伙伴系统拿一段物理连续的页框，拿不到再逐页分配。
+    //要求清零且预清零链表够用时，逐页取预清零的页框更快
+    if(pg_cnt > 1 && !(zero && mem_pool->zero_cnt >= pg_cnt)) {
+        uint32_t page_phyaddr = (uint32_t)palloc_contig(mem_pool, pg_cnt);
+        if(page_phyaddr != 0) {
+            while(cnt-- > 0) {
+                page_table_add((void*)vaddr, (void*)page_phyaddr);
+                vaddr += PG_SIZE;
+                page_phyaddr += PG_SIZE;
+            }
+            if(zero) {
+                memset(vaddr_start, 0, pg_cnt * PG_SIZE);
+            }
+            return vaddr_start;
+        }
+    }
+
     //因为虚拟地址是连续的，但物理地址可以使不连续的，所以逐个映射
     while(cnt-- > 0) {
-        void* page_phyaddr = palloc(mem_pool);
+        void* page_phyaddr = zero ? palloc_zeroed(mem_pool) : NULL;
+        bool need_clear = zero && page_phyaddr == NULL;   //没拿到预清零的页框，映射后自己清零
+        if(page_phyaddr == NULL) {
+            page_phyaddr = pf & PF_KERNEL ? palloc(mem_pool) : palloc_user();
+        }
+        if(page_phyaddr == NULL && (pf & PF_KERNEL) && mem_reclaim != NULL && mem_reclaim(1) > 0) {   //先让页缓存腾出页框再试
+            page_phyaddr = palloc(mem_pool);
+        }
         if(page_phyaddr == NULL) {
-            //失败时要将已申请的虚拟地址和物理页全部回滚，在将在完成内存回收时再补充
+            //失败时将已映射的页连同页框释放，还没映射的只归还虚拟地址
+            uint32_t done = (vaddr - (uint32_t)vaddr_start) / PG_SIZE;
+            if(done > 0) {
+                mfree_page(pf, vaddr_start, done);
+            }
+            vaddr_remove(pf, (void*)vaddr, pg_cnt - done);
             return NULL;
         }
         page_table_add((void*)vaddr, page_phyaddr);   //在页表中做映射
+        if(need_clear) {
+            memset((void*)vaddr, 0, PG_SIZE);
+        }
         vaddr += PG_SIZE;   //下一个虚拟页
     }
     return vaddr_start;
 }
 
+/*分配pg_cnt个页空间，成功则返回虚拟地址，失败时返回NULL*/
+void* malloc_page(enum pool_flags pf, uint32_t pg_cnt)
+{
+    return page_alloc(pf, pg_cnt, false);
+}
+
 /*从内核物理内存池中申请1页内存，成功返回虚拟地址，失败返回NULL*/
 void* get_kernel_pages(uint32_t pg_cnt)
 {
     lock_acquire(&kernel_pool.lock);
-    void* vaddr = malloc_page(PF_KERNEL, pg_cnt);
-    if(vaddr != NULL) {   //若分配的地址不为空，将页框清0后返回
-        memset(vaddr, 0, pg_cnt * PG_SIZE);
+    void* vaddr = page_alloc(PF_KERNEL, pg_cnt, true);   //页框清0后返回
+    lock_release(&kernel_pool.lock);
+    return vaddr;
+}
+
+/*同get_kernel_pages，内核内存池的锁被别的线程占着时不等待，直接返回NULL，供不能阻塞的idle线程使用*/
+void* get_kernel_pages_try(uint32_t pg_cnt)
+{
+    enum intr_status old_status = intr_disable();   //关着中断检查和加锁，中间不会被别的线程抢走
+    if(kernel_pool.lock.holder != NULL) {
+        intr_set_status(old_status);
+        return NULL;
     }
+    lock_acquire(&kernel_pool.lock);
+    intr_set_status(old_status);
+    void* vaddr = page_alloc(PF_KERNEL, pg_cnt, true);
     lock_release(&kernel_pool.lock);
     return vaddr;
 }
@@ -185,10 +700,7 @@ void* get_kernel_pages(uint32_t pg_cnt)
 void* get_user_pages(uint32_t pg_cnt)
 {
     lock_acquire(&user_pool.lock);
-    void* vaddr = malloc_page(PF_USER, pg_cnt);
-    if(vaddr != NULL) {
-        memset(vaddr, 0, pg_cnt * PG_SIZE);
-    }
+    void* vaddr = page_alloc(PF_USER, pg_cnt, true);
     lock_release(&user_pool.lock);
     return vaddr;
 }
@@ -202,22 +714,16 @@ void* get_a_page(enum pool_flags pf, uint32_t vaddr)
 
     //先将虚拟地址对应的位图置1
     struct task_struct* cur = running_thread();
-    int32_t bit_idx = -1;
 
     //若当前是用户进程申请用户内存，就修改用户进程自己的虚拟地址位图
-    if(cur->pgdir != NULL && pf == PF_USER) {
-        bit_idx = (vaddr - cur->userprog_vaddr.vaddr_start) / PG_SIZE;
-        ASSERT(bit_idx > 0);
-        bitmap_set(&cur->userprog_vaddr.vaddr_bitmap, bit_idx, 1);
-    } else if(cur->pgdir == NULL && pf == PF_KERNEL) {   //如果是内核内核线程申请内核内存，就修改kernel_vaddr
-        bit_idx = (vaddr - kernel_vaddr.vaddr_start) / PG_SIZE;
-        ASSERT(bit_idx > 0);
-        bitmap_set(&kernel_vaddr.vaddr_bitmap, bit_idx, 1);
+    //如果是内核内核线程申请内核内存，就修改kernel_vaddr
+    if((cur->pgdir != NULL && pf == PF_USER) || (cur->pgdir == NULL && pf == PF_KERNEL)) {
+        vaddr_mark(pf, (void*)vaddr, 1);
     } else {
         PANIC("get_a_page: not allow kernel alloc userapace or user alloc kernelspace by get_a_page");
     }
 
-    void* page_phyaddr = palloc(mem_pool);
+    void* page_phyaddr = pf & PF_KERNEL ? palloc(mem_pool) : palloc_user();
     if(page_phyaddr == NULL) {
         lock_release(&mem_pool->lock);
         return NULL;
@@ -232,7 +738,7 @@ void* get_a_page_without_opvaddrbitmap(enum pool_flags pf, uint32_t vaddr)
 {
     struct pool* mem_pool = pf & PF_KERNEL ? &kernel_pool : &user_pool;
     lock_acquire(&mem_pool->lock);
-    void* page_phyaddr = palloc(mem_pool);
+    void* page_phyaddr = pf & PF_KERNEL ? palloc(mem_pool) : palloc_user();
     if(page_phyaddr == NULL) {
         lock_release(&mem_pool->lock);
         return NULL;
@@ -245,6 +751,10 @@ void* get_a_page_without_opvaddrbitmap(enum pool_flags pf, uint32_t vaddr)
 /*得到虚拟地址映射到的物理地址*/
 uint32_t addr_v2p(uint32_t vaddr)
 {
+    uint32_t pde = *pde_ptr(vaddr);
+    if(pde & PG_PS) {   //大页没有页表，物理地址直接由页目录项给出
+        return (pde & 0xffc00000) + (vaddr & (LARGE_PG_SIZE - 1));
+    }
     uint32_t* pte = pte_ptr(vaddr);   //(*pte)的值是页表所在的物理页框地址，去掉其低12位的页表属性+虚拟地址vaddr的低12位
     return ((*pte & 0xfffff000) + (vaddr & 0x00000fff));
 }
@@ -260,6 +770,7 @@ void block_desc_init(struct mem_block_desc* desc_array)
 
         //初始化arena中内存块数量
         desc_array[desc_idx].blocks_per_arena = (PG_SIZE - sizeof(struct arena)) / block_size;
+        desc_array[desc_idx].arena_cnt = 0;
 
         list_init(&desc_array[desc_idx].free_list);
 
@@ -279,6 +790,24 @@ static struct arena* block2arena(struct mem_block* b)
     return (struct arena*)((uint32_t)b & 0xfffff000);   //arena占据一个页框
 }
 
+/*返回能容纳size字节的最小内存块规格在descs中的下标*/
+static uint8_t block_desc_idx(struct mem_block_desc* descs, uint32_t size)
+{
+    uint8_t desc_idx;
+    for(desc_idx = 0; desc_idx < DESC_CNT; desc_idx++) {
+        if(size <= descs[desc_idx].block_size) {
+            break;
+        }
+    }
+    return desc_idx;
+}
+
+/*返回pthread在pf内存池上的内存块缓存数组*/
+static struct mem_magazine* thread_mags(struct task_struct* pthread, enum pool_flags pf)
+{
+    return pf == PF_KERNEL ? pthread->k_mags : pthread->group_leader->u_mags;   //用户堆由进程的各线程共用
+}
+
 /*在堆中申请size字节内存*/
 void* sys_malloc(uint32_t size)
 {
@@ -298,7 +827,7 @@ void* sys_malloc(uint32_t size)
         PF = PF_USER;   //为用户线程，用户进程pcb中的pgdir会在为其分配页目录表时创建
         pool_size = user_pool.pool_size;
         mem_pool = &user_pool;
-        descs = cur_thread->u_block_desc;
+        descs = cur_thread->group_leader->u_block_desc;
     }
 
     //若申请的内存不在内存池容量范围内，则直接返回NULL
@@ -306,22 +835,44 @@ void* sys_malloc(uint32_t size)
         return NULL;
     }
 
+    //按请求大小计入直方图
+    uint8_t hist_idx = 0;
+    while(hist_idx < MALLOC_HIST_CNT - 1 && size > (16U << hist_idx)) {
+        hist_idx++;
+    }
+    malloc_hist[hist_idx]++;
+
     struct arena* a;
     struct mem_block* b;
 
+    //小内存块优先从本线程的缓存中取，缓存只属于当前线程，无需加锁
+    if(size <= 1024) {
+        uint8_t desc_idx = block_desc_idx(descs, size);
+        struct mem_magazine* mag = &thread_mags(cur_thread, PF)[desc_idx];
+        if(mag->cnt > 0) {
+            b = mag->blocks[--mag->cnt];
+            memset(b, 0, descs[desc_idx].block_size);
+            return (void*)b;
+        }
+    }
+
     lock_acquire(&mem_pool->lock);
 
     //超过最大内存块1024，就分配页框
     if(size > 1024) {
         uint32_t page_cnt = DIV_ROUND_UP(size + sizeof(struct arena), PG_SIZE);   //向上取整获得需要的页框数
-        a = malloc_page(PF, page_cnt);   //在PF内存池中分配page_cnt个页框
+        a = page_alloc(PF, page_cnt, true);   //在PF内存池中分配page_cnt个清零的页框
 
         if(a != NULL) {
-            memset(a, 0, page_cnt * PG_SIZE);   //将分配的内存清零
             //对于分配的大块页框，将desc置为NULL，cnt置为页框数，large置为true
             a->desc = NULL;
             a->cnt = page_cnt;
             a->large = true;
+            large_allocs++;
+            if(PF == PF_KERNEL) {
+                k_large_cnt++;
+                k_large_pages += page_cnt;
+            }
 
             lock_release(&mem_pool->lock);
             return (void*)(a + 1);   //跨过arena大小，把剩下的内存返回
@@ -330,40 +881,31 @@ void* sys_malloc(uint32_t size)
             return NULL;
         }
     } else {
-        uint8_t desc_idx;
-
         //从内存块描述符中匹配合适的内存块规格
-        for(desc_idx = 0; desc_idx < DESC_CNT; desc_idx++) {
-            if(size <= descs[desc_idx].block_size) {
-                break;
-            }
-        }
+        uint8_t desc_idx = block_desc_idx(descs, size);
 
         //若mem_block_desc的free_list中已经没有可用的mem_block，就创建新的arena提供mem_block
         if(list_empty(&descs[desc_idx].free_list)) {
-            a = malloc_page(PF, 1);   //分配一页作为arena
+            a = page_alloc(PF, 1, true);   //分配一页清零的页框作为arena
             if(a == NULL) {
                 lock_release(&mem_pool->lock);
                 return NULL;
             }
-            memset(a, 0, PG_SIZE);   //分配的页框内容清零
 
             //对于分配的小内存块，将desc置为相应内存块描述符，cnt置为arena可用的内存块数量，large置为false
             a->desc = &descs[desc_idx];
             a->large = false;
             a->cnt = descs[desc_idx].blocks_per_arena;
+            descs[desc_idx].arena_cnt++;
             
             uint32_t block_idx;
-            enum intr_status old_status = intr_disable();
 
-            //开始将arena拆分成内存块，并添加到内存块描述符的free_lsit中
+            //开始将arena拆分成内存块，并添加到内存块描述符的free_lsit中。free_list只在持有内存池的锁时访问，不必关中断
             for(block_idx = 0; block_idx < descs[desc_idx].blocks_per_arena; block_idx++) {
                 b = arena2block(a, block_idx);
                 ASSERT(!elem_find(&a->desc->free_list, &b->free_elem));
                 list_append(&a->desc->free_list, &b->free_elem);
             }
-
-            intr_set_status(old_status);
         }
 
         //开始分配内存块
@@ -377,19 +919,128 @@ void* sys_malloc(uint32_t size)
     }
 }
 
-/*将物理地址pg_phy_addr回收到物理内存池。将物理页对应的位图中的那一位值0*/
+/*返回物理地址pg_phy_addr所在的内存池，frame_idx带回页框在池中的下标*/
+static struct pool* phy_addr2pool(uint32_t pg_phy_addr, uint32_t* frame_idx)
+{
+    struct pool* mem_pool = pg_phy_addr >= user_pool.phy_addr_start ? &user_pool : &kernel_pool;
+    *frame_idx = (pg_phy_addr - mem_pool->phy_addr_start) / PG_SIZE;
+    return mem_pool;
+}
+
+/*将物理地址pg_phy_addr回收到物理内存池。引用计数减为0时才把该页框交还伙伴系统*/
 void pfree(uint32_t pg_phy_addr)
 {
-    struct pool* mem_pool;
-    uint32_t bit_idx = 0;
-    if(pg_phy_addr >= user_pool.phy_addr_start) {   //用户物理内存池
-        mem_pool = &user_pool;
-        bit_idx = (pg_phy_addr - user_pool.phy_addr_start) / PG_SIZE;
-    } else {   //内核物理内存池
-        mem_pool = &kernel_pool;
-        bit_idx = (pg_phy_addr - kernel_pool.phy_addr_start) / PG_SIZE;
+    if(pg_phy_addr == zero_page_phy) {   //零页永不释放
+        return;
+    }
+    uint32_t frame_idx = 0;
+    struct pool* mem_pool = phy_addr2pool(pg_phy_addr, &frame_idx);
+    enum intr_status old_status = intr_disable();
+    ASSERT(mem_pool->frames[frame_idx].ref_cnt > 0);
+    if(--mem_pool->frames[frame_idx].ref_cnt == 0) {
+        buddy_free(mem_pool, frame_idx, 0);
+    }
+    intr_set_status(old_status);
+}
+
+/*释放cnt个页表项ptes中存在的页框和交换项占的交换槽，引用计数减为0的页框中物理地址相连的合成一段，
+  按尽量大的对齐块交给伙伴系统，连续映射的大块内存不必逐页合并。不改动页表*/
+void pfree_ptes(const uint32_t* ptes, uint32_t cnt)
+{
+    struct pool* run_pool = NULL;   //正在累积的相连页框段
+    uint32_t run_start = 0, run_cnt = 0;
+    enum intr_status old_status = intr_disable();
+    uint32_t idx;
+    for(idx = 0; idx < cnt; idx++) {
+        if(!(ptes[idx] & PG_P_1)) {
+            if(pte_is_swap(ptes[idx])) {   //换出的页只放掉交换槽
+                swap_free(pte_swap_slot(ptes[idx]));
+            }
+            continue;
+        }
+        if((ptes[idx] & 0xfffff000) == zero_page_phy) {
+            continue;
+        }
+        uint32_t frame_idx = 0;
+        struct pool* mem_pool = phy_addr2pool(ptes[idx] & 0xfffff000, &frame_idx);
+        ASSERT(mem_pool->frames[frame_idx].ref_cnt > 0);
+        if(--mem_pool->frames[frame_idx].ref_cnt != 0) {   //还有别的进程在用
+            continue;
+        }
+        if(run_cnt > 0 && mem_pool == run_pool && frame_idx == run_start + run_cnt) {
+            run_cnt++;
+            continue;
+        }
+        if(run_cnt > 0) {
+            buddy_free_range(run_pool, run_start, run_cnt);
+        }
+        run_pool = mem_pool;
+        run_start = frame_idx;
+        run_cnt = 1;
+    }
+    if(run_cnt > 0) {
+        buddy_free_range(run_pool, run_start, run_cnt);
+    }
+    intr_set_status(old_status);
+}
+
+/*返回pthread所在进程从pde_idx起第一个建立了页表的用户页目录项下标，没有返回-1*/
+int32_t user_pde_next(struct task_struct* pthread, uint32_t pde_idx)
+{
+    uint32_t* used = pthread->group_leader->pde_used;
+    while(pde_idx < USER_PDE_CNT) {
+        uint32_t word = used[pde_idx / 32] >> (pde_idx % 32);
+        if(word != 0) {
+            uint32_t bit;
+            asm ("bsfl %1, %0" : "=r"(bit) : "rm"(word));
+            return pde_idx + bit;
+        }
+        pde_idx = (pde_idx / 32 + 1) * 32;
+    }
+    return -1;
+}
+
+/*增加物理页框pg_phy_addr的引用计数*/
+void page_ref_inc(uint32_t pg_phy_addr)
+{
+    if(pg_phy_addr == zero_page_phy) {   //映射零页的页表项可能比16位的计数还多，不计引用
+        return;
+    }
+    uint32_t frame_idx = 0;
+    struct pool* mem_pool = phy_addr2pool(pg_phy_addr, &frame_idx);
+    enum intr_status old_status = intr_disable();
+    mem_pool->frames[frame_idx].ref_cnt++;
+    intr_set_status(old_status);
+}
+
+/*返回物理页框pg_phy_addr的引用计数*/
+uint32_t page_ref_cnt(uint32_t pg_phy_addr)
+{
+    uint32_t frame_idx = 0;
+    struct pool* mem_pool = phy_addr2pool(pg_phy_addr, &frame_idx);
+    return mem_pool->frames[frame_idx].ref_cnt;
+}
+
+/*返回页框号pfn的描述符，页框不归内存池管理时返回NULL。两个内存池的描述符数组首尾相接，可以统一按页框号换算*/
+struct page_frame* pfn_to_page(uint32_t pfn)
+{
+    uint32_t pg_phy_addr = pfn << 12;
+    if(pg_phy_addr < kernel_pool.phy_addr_start || pg_phy_addr >= user_pool.phy_addr_start + user_pool.pool_size) {
+        return NULL;
     }
-    bitmap_set(&mem_pool->pool_bitmap, bit_idx, 0);   //将位图中该位清0
+    return &kernel_pool.frames[(pg_phy_addr - kernel_pool.phy_addr_start) / PG_SIZE];
+}
+
+/*返回描述符page对应的页框号*/
+uint32_t page_to_pfn(struct page_frame* page)
+{
+    return (kernel_pool.phy_addr_start / PG_SIZE) + (page - kernel_pool.frames);
+}
+
+/*返回已映射的虚拟地址vaddr所在页框的描述符*/
+struct page_frame* virt_to_page(void* vaddr)
+{
+    return pfn_to_page(addr_v2p((uint32_t)vaddr) >> 12);
 }
 
 /*去掉页表中虚拟地址vaddr的映射，只去掉vaddr的pte。将vaddr对应的页表项的p位置0*/
@@ -397,70 +1048,422 @@ static void page_table_pte_remove(uint32_t vaddr)
 {
     uint32_t *pte = pte_ptr(vaddr);   //获得虚拟地址的pte地址
     *pte &= ~PG_P_1;   //将pte的p位置0
-    asm volatile ("invlpg %0" : : "m"(vaddr) : "memory");   //更新块表tlb
+    asm volatile ("invlpg %0" : : "m"(*(uint8_t*)vaddr) : "memory");   //更新块表tlb，操作数是vaddr处的内存而不是变量vaddr本身
 }
 
-/*在虚拟地址池中释放以_vaddr起始的连续pg_cnt个虚拟地址页。将虚拟页对应的位图中的那一位置0*/
-static void vaddr_remove(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt)
+/*在虚拟地址池中释放以_vaddr起始的连续pg_cnt个虚拟地址页。将虚拟页对应的位图中的那一位置0并归还空闲区段*/
+void vaddr_remove(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt)
 {
-    uint32_t bit_idx_start = 0, vaddr = (uint32_t)_vaddr, cnt = 0;
-
-    if(pf == PF_KERNEL) {
-        bit_idx_start = (vaddr - kernel_vaddr.vaddr_start) / PG_SIZE;
-        while(cnt < pg_cnt) {
-            bitmap_set(&kernel_vaddr.vaddr_bitmap, bit_idx_start + cnt++, 0);
-        }
-    } else {
-        struct task_struct* cur_thread = running_thread();
-        bit_idx_start = (vaddr - cur_thread->userprog_vaddr.vaddr_start) / PG_SIZE;
-        while(cnt < pg_cnt) {
-            bitmap_set(&cur_thread->userprog_vaddr.vaddr_bitmap, bit_idx_start + cnt++, 0);
-        }
+    struct virtual_addr* vpool = vaddr_pool(pf);
+    uint32_t bit_idx_start = ((uint32_t)_vaddr - vpool->vaddr_start) / PG_SIZE, cnt = 0;
+    enum intr_status old_status = intr_disable();
+    while(cnt < pg_cnt) {
+        bitmap_set(&vpool->vaddr_bitmap, bit_idx_start + cnt++, 0);
     }
+    if(vpool->extents != NULL && !vpool->extents->overflow) {
+        extent_free(vpool->extents, bit_idx_start, pg_cnt);
+    }
+    intr_set_status(old_status);
 }
 
-/*释放以虚拟地址vaddr起始的cnt个物理页框*/
+/*释放以虚拟地址vaddr起始的cnt个物理页框，整段一次性解除映射*/
 void mfree_page(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt)
 {
-    uint32_t pg_phy_addr;
     uint32_t vaddr = (int32_t)_vaddr, page_cnt = 0;
     ASSERT(pg_cnt >= 1 && vaddr % PG_SIZE == 0);
-    pg_phy_addr = addr_v2p(vaddr);   //获取虚拟地址vaddr对应的物理地址
-
-    //确保待释放的物理内存在低端1MB+1KB的页目录+1KB的页表地址范围外
-    ASSERT((pg_phy_addr % PG_SIZE) == 0 && pg_phy_addr >= 0x102000);
-
-    //判断pg_phy_addr属于用户物理内存池还是内核物理内存池
-    if(pg_phy_addr >= user_pool.phy_addr_start) {
-        vaddr -= PG_SIZE;
-        while(page_cnt < pg_cnt) {
-            vaddr += PG_SIZE;
-            pg_phy_addr = addr_v2p(vaddr);
-            //确保物理地址属于用户物理内存池
-            ASSERT((pg_phy_addr & PG_SIZE) == 0 && pg_phy_addr >= user_pool.phy_addr_start);
-            //1. 先将对应的物理页框归还到内存池
-            pfree(pg_phy_addr);
-            //2. 从也表中清楚此虚拟地址所在的页表项pte
-            page_table_pte_remove(vaddr);
-            page_cnt++;
-        }
-        //3. 清空虚拟地址中的位图中的相应位
-        vaddr_remove(pf, _vaddr, pg_cnt);
+
+    //页表在0xffc00000处按页目录项顺序连续映射，所以连续虚拟页的pte也是连续的，跨页表时同样成立
+    uint32_t* pte = pte_ptr(vaddr);
+    while(page_cnt < pg_cnt) {
+        uint32_t pg_phy_addr = *pte & 0xfffff000;
+        //确保待释放的物理内存在低端1MB+1KB的页目录+1KB的页表地址范围外，且属于pf对应的物理内存池
+        ASSERT(pg_phy_addr >= 0x102000);
+        ASSERT(pf == PF_USER ? pg_phy_addr >= user_pool.phy_addr_start : pg_phy_addr < user_pool.phy_addr_start);
+        //1. 先将对应的物理页框归还到内存池
+        pfree(pg_phy_addr);
+        //2. 从页表中清除此虚拟地址所在的页表项pte
+        *pte &= ~PG_P_1;
+        pte++;
+        page_cnt++;
+    }
+
+    //3. 刷新tlb，页数较多时直接重新加载cr3
+    if(pg_cnt <= TLB_FLUSH_ALL_THRESHOLD) {
+        for(page_cnt = 0; page_cnt < pg_cnt; page_cnt++) {
+            asm volatile ("invlpg %0" : : "m"(*(uint8_t*)(vaddr + page_cnt * PG_SIZE)) : "memory");
+        }
     } else {
-        vaddr -= PG_SIZE;
-        while(page_cnt < pg_cnt) {
-            vaddr += PG_SIZE;
-            pg_phy_addr = addr_v2p(vaddr);
-            //确保待释放的物理内存只属于内核物理内存池
-            ASSERT((pg_phy_addr % PG_SIZE) == 0 && pg_phy_addr >= kernel_pool.phy_addr_start && pg_phy_addr < user_pool.phy_addr_start);
-            //1. 将对应的物理页框归还到内存池
-            pfree(pg_phy_addr);
-            //2. 从页表中清除此虚拟地址所在的页表项pte
-            page_table_pte_remove(vaddr);
-            page_cnt++;
+        tlb_flush_all();
+    }
+
+    //4. 清空虚拟地址中的位图中的相应位
+    vaddr_remove(pf, _vaddr, pg_cnt);
+}
+
+/*将物理页框pg_phy_addr映射到内核临时窗口，返回窗口的虚拟地址。窗口只有一个，调用者需关中断并及时kunmap_window*/
+void* kmap_window(uint32_t pg_phy_addr)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    uint32_t* pte = pte_ptr(kmap_window_vaddr);
+    ASSERT(!(*pte & PG_P_1));
+    *pte = pg_phy_addr | PG_G | PG_US_S | PG_RW_W | PG_P_1;
+    asm volatile ("invlpg %0" : : "m"(*(uint8_t*)kmap_window_vaddr) : "memory");
+    return (void*)kmap_window_vaddr;
+}
+
+/*撤销内核临时窗口的映射*/
+void kunmap_window(void)
+{
+    page_table_pte_remove(kmap_window_vaddr);
+}
+
+/*从伙伴系统取一个空闲页框清零后挂到预清零链表，由idle线程在系统空闲时调用。
+ *预清零链表都已满或没有空闲页框时返回false*/
+bool page_prezero(void)
+{
+    //优先补充预清零页框较少的内存池
+    struct pool* m_pool = user_pool.zero_cnt <= kernel_pool.zero_cnt ? &user_pool : &kernel_pool;
+    if(m_pool->zero_cnt >= ZERO_POOL_MAX) {
+        return false;
+    }
+    int32_t idx = buddy_alloc(m_pool, 0);
+    if(idx == -1) {
+        return false;
+    }
+
+    //清零窗口只有idle线程使用，清零时不必关中断
+    uint32_t* pte = pte_ptr(zero_window_vaddr);
+    *pte = (idx * PG_SIZE + m_pool->phy_addr_start) | PG_G | PG_US_S | PG_RW_W | PG_P_1;
+    asm volatile ("invlpg %0" : : "m"(*(uint8_t*)zero_window_vaddr) : "memory");
+    memset((void*)zero_window_vaddr, 0, PG_SIZE);
+    page_table_pte_remove(zero_window_vaddr);
+
+    enum intr_status old_status = intr_disable();
+    m_pool->frames[idx].flags |= FRAME_ZERO;
+    m_pool->frames[idx].next = m_pool->zero_list;
+    m_pool->zero_list = idx;
+    m_pool->zero_cnt++;
+    intr_set_status(old_status);
+    return true;
+}
+
+/*从pf内存池分配一个清零的页框，不建立映射，返回物理地址，失败返回0。优先用预清零的页框，否则经临时窗口清零*/
+uint32_t page_frame_alloc(enum pool_flags pf)
+{
+    struct pool* mem_pool = pf & PF_KERNEL ? &kernel_pool : &user_pool;
+    lock_acquire(&mem_pool->lock);
+    uint32_t pg_phy_addr = (uint32_t)palloc_zeroed(mem_pool);
+    bool zeroed = pg_phy_addr != 0;
+    if(!zeroed) {
+        pg_phy_addr = (uint32_t)(pf & PF_KERNEL ? palloc(mem_pool) : palloc_user());
+    }
+    lock_release(&mem_pool->lock);
+    if(pg_phy_addr != 0 && !zeroed) {
+        enum intr_status old_status = intr_disable();
+        memset(kmap_window(pg_phy_addr), 0, PG_SIZE);
+        kunmap_window();
+        intr_set_status(old_status);
+    }
+    return pg_phy_addr;
+}
+
+/*把页框pg_phy_addr作为共享页映射到当前进程的vaddr，页框引用计数加1，writable为false时映射为只读。
+ *页表项打上PG_SHARED，fork时不做写时复制，解除映射和进程退出时照常经pfree减引用。
+ *页框一般来自用户内存池，内核自己持有引用的页如全局数据页也可以来自内核内存池*/
+void page_map_shared(uint32_t vaddr, uint32_t pg_phy_addr, bool writable)
+{
+    ASSERT(vaddr < 0xc0000000 && pg_phy_addr >= 0x102000);
+    page_ref_inc(pg_phy_addr);
+    lock_acquire(&user_pool.lock);
+    page_table_add((void*)vaddr, (void*)(pg_phy_addr | PG_SHARED));
+    lock_release(&user_pool.lock);
+    if(!writable) {
+        *pte_ptr(vaddr) &= ~PG_RW_W;
+        asm volatile ("invlpg %0" : : "m"(*(uint8_t*)vaddr) : "memory");
+    }
+}
+
+/*把用户页框pg_phy_addr作为写时复制页映射到当前进程的vaddr，页框引用计数加1，第一次写入时才复制出自己的一页*/
+void page_map_cow(uint32_t vaddr, uint32_t pg_phy_addr)
+{
+    ASSERT(vaddr < 0xc0000000 && pg_phy_addr >= user_pool.phy_addr_start);
+    page_ref_inc(pg_phy_addr);
+    lock_acquire(&user_pool.lock);
+    page_table_add((void*)vaddr, (void*)pg_phy_addr);
+    lock_release(&user_pool.lock);
+    uint32_t* pte = pte_ptr(vaddr);
+    *pte = (*pte & ~PG_RW_W) | PG_COW;
+    asm volatile ("invlpg %0" : : "m"(*(uint8_t*)vaddr) : "memory");
+}
+
+/*为当前进程的用户空间建立写时复制的副本，填入子进程的页目录child_pgdir。
+ *页表逐个复制，可写的页在父子进程中都改为只读并打上PG_COW标记，共享内存页保持可写，页框引用计数加1，
+ *打了PG_PRIVATE的页不复制，成功返回0，失败返回-1*/
+int32_t pgdir_copy_cow(uint32_t* child_pgdir)
+{
+    enum intr_status old_status = intr_disable();
+    preempt_disable();   //复制到一半时不能在释放锁处被换下，否则同进程的其他线程会改到父进程的页表
+    int32_t pde_idx = -1;
+    //只处理建立过页表的用户空间，子进程的pcb复制自父进程，记录的页目录项正好是这里复制的
+    while((pde_idx = user_pde_next(running_thread(), pde_idx + 1)) != -1) {
+        uint32_t* parent_pde = pde_ptr(pde_idx * 0x400000);
+        if(!(*parent_pde & PG_P_1)) {
+            continue;
+        }
+        //大页先在父进程中拆成4KB页，再照常逐页写时复制
+        if((*parent_pde & PG_PS) && !large_page_split(pde_idx * 0x400000)) {
+            preempt_enable();
+            intr_set_status(old_status);
+            return -1;
+        }
+
+        //子进程的页表用到的页框一律从内核空间分配
+        lock_acquire(&kernel_pool.lock);
+        uint32_t pt_phyaddr = (uint32_t)palloc(&kernel_pool);
+        lock_release(&kernel_pool.lock);
+        if(pt_phyaddr == 0) {
+            preempt_enable();
+            intr_set_status(old_status);
+            return -1;
+        }
+
+        uint32_t* parent_pt = pte_ptr(pde_idx * 0x400000);   //父进程页表的首个pte
+        uint32_t* child_pt = kmap_window(pt_phyaddr);
+        uint32_t pte_idx;
+        for(pte_idx = 0; pte_idx < 1024; pte_idx++) {
+            uint32_t pte = parent_pt[pte_idx];
+            if(pte & PG_PRIVATE) {   //只属于父进程的页，子进程用到时自己另建
+                pte = 0;
+            } else if(pte & PG_P_1) {
+                if((pte & PG_RW_W) && !(pte & PG_SHARED)) {
+                    pte = (pte & ~PG_RW_W) | PG_COW;
+                    parent_pt[pte_idx] = pte;
+                }
+                page_ref_inc(pte & 0xfffff000);
+            } else if(pte_is_swap(pte)) {   //换出的页父子进程共用交换槽，各自换入时再各得一份
+                swap_dup(pte_swap_slot(pte));
+            }
+            child_pt[pte_idx] = pte;
         }
-        //3. 清空虚拟地址中位图中的相应位
-        vaddr_remove(pf, _vaddr, pg_cnt);
+        kunmap_window();
+        child_pgdir[pde_idx] = pt_phyaddr | PG_US_U | PG_RW_W | PG_P_1;
+    }
+
+    //父进程的页表项改成了只读，重新加载cr3刷新整个tlb
+    uint32_t cr3;
+    asm volatile ("movl %%cr3, %0; movl %0, %%cr3" : "=r"(cr3) : : "memory");
+    preempt_enable();
+    intr_set_status(old_status);
+    return 0;
+}
+
+/*处理写时复制引起的页错误，vaddr为引起错误的地址，是写时复制页返回true，否则返回false*/
+bool page_cow_fault(uint32_t vaddr)
+{
+    if(running_thread()->pgdir == NULL || vaddr >= 0xc0000000) {
+        return false;
+    }
+    uint32_t* pde = pde_ptr(vaddr);
+    if(!(*pde & PG_P_1) || (*pde & PG_PS)) {   //大页不做写时复制，fork时已拆成4KB页
+        return false;
+    }
+    uint32_t* pte = pte_ptr(vaddr);
+    if(!(*pte & PG_P_1) || !(*pte & PG_COW)) {
+        return false;
+    }
+
+    uint32_t vaddr_page = vaddr & 0xfffff000;
+    uint32_t old_phyaddr = *pte & 0xfffff000;
+
+    //第一次写零页，换上一个清零的页框，优先用idle线程预清零的
+    if(old_phyaddr == zero_page_phy) {
+        uint32_t new_phyaddr = page_frame_alloc(PF_USER);
+        if(new_phyaddr == 0) {
+            return false;
+        }
+        *pte = new_phyaddr | PG_US_U | PG_RW_W | PG_P_1;
+        asm volatile ("invlpg %0" : : "m"(*(uint8_t*)vaddr_page) : "memory");
+        return true;
+    }
+
+    //页框只剩自己在用，恢复可写即可，不必复制
+    if(page_ref_cnt(old_phyaddr) == 1) {
+        *pte = (*pte & ~PG_COW) | PG_RW_W;
+        asm volatile ("invlpg %0" : : "m"(*(uint8_t*)vaddr_page) : "memory");
+        return true;
+    }
+
+    lock_acquire(&user_pool.lock);
+    uint32_t new_phyaddr = (uint32_t)palloc_user();
+    lock_release(&user_pool.lock);
+    if(new_phyaddr == 0) {
+        return false;
+    }
+
+    //复制期间不能被打断，临时窗口只有一个
+    enum intr_status old_status = intr_disable();
+    memcpy(kmap_window(new_phyaddr), (void*)vaddr_page, PG_SIZE);
+    kunmap_window();
+    *pte = new_phyaddr | PG_US_U | PG_RW_W | PG_P_1;
+    asm volatile ("invlpg %0" : : "m"(*(uint8_t*)vaddr_page) : "memory");
+    intr_set_status(old_status);
+
+    pfree(old_phyaddr);   //放弃对原页框的引用
+    return true;
+}
+
+/*处理内容全为0的页的缺页。由读引起时把全局零页只读映射到当前进程vaddr所在的页并返回true，
+ *writable为true时打上PG_COW，第一次写入时由page_cow_fault换成自己的页框，从不写入的页不占内存。
+ *由写引起时返回false，调用者照常分配清零的页框，免得映射零页后马上又要写时复制*/
+bool zero_page_fault(uint32_t vaddr, bool writable)
+{
+    struct intr_stack* frame = intr_frame();
+    if(frame == NULL || (frame->err_code & 0x2)) {   //错误码第1位为1表示写入
+        return false;
+    }
+    uint32_t vaddr_page = vaddr & 0xfffff000;
+    lock_acquire(&user_pool.lock);
+    page_table_add((void*)vaddr_page, (void*)zero_page_phy);
+    lock_release(&user_pool.lock);
+    uint32_t* pte = pte_ptr(vaddr_page);
+    *pte &= ~PG_RW_W;
+    if(writable) {
+        *pte |= PG_COW;
+    }
+    asm volatile ("invlpg %0" : : "m"(*(uint8_t*)vaddr_page) : "memory");
+    counter_inc(zero_page_counter);
+    return true;
+}
+
+/*用一个清零的大页映射当前进程vaddr所在的4MB对齐区域，writable为false时只读。
+ *区域须整个属于调用者的一个映射区，且还没有建立页表。大页的1024个页框各自带引用计数，拆分后可以逐页释放。
+ *伙伴系统中没有4MB的空闲块时返回false，调用者退回按4KB映射；区域已被同进程的其他线程映射成大页时返回true*/
+bool large_page_map(uint32_t vaddr, bool writable)
+{
+    uint32_t vaddr_large = vaddr & ~(LARGE_PG_SIZE - 1);
+    if(!pse_enabled || vaddr_large >= 0xc0000000) {
+        return false;
+    }
+    uint32_t* pde = pde_ptr(vaddr_large);
+    lock_acquire(&user_pool.lock);
+    if(*pde & PG_P_1) {
+        lock_release(&user_pool.lock);
+        return (*pde & PG_PS) != 0;
+    }
+    //用户内存池的起点按4MB对齐，最大阶的块在物理上也是4MB对齐的
+    int32_t idx = buddy_alloc(&user_pool, BUDDY_MAX_ORDER);
+    if(idx == -1) {
+        lock_release(&user_pool.lock);
+        counter_inc(large_fallback_counter);
+        return false;
+    }
+    uint32_t pg_idx;
+    for(pg_idx = 0; pg_idx < LARGE_PG_PAGES; pg_idx++) {
+        user_pool.frames[idx + pg_idx].ref_cnt = 1;
+    }
+    *pde = (idx * PG_SIZE + user_pool.phy_addr_start) | PG_PS | PG_US_U | PG_RW_W | PG_P_1;
+    uint32_t pde_idx = vaddr_large >> 22;
+    running_thread()->group_leader->pde_used[pde_idx / 32] |= 1U << (pde_idx % 32);
+    //经用户地址清零，cr0的WP打开后内核也写不了只读页，所以先可写映射，清零后再去掉写权限
+    memset((void*)vaddr_large, 0, LARGE_PG_SIZE);
+    if(!writable) {
+        *pde &= ~PG_RW_W;
+        asm volatile ("invlpg %0" : : "m"(*(uint8_t*)vaddr_large) : "memory");
+    }
+    lock_release(&user_pool.lock);
+    counter_inc(large_page_counter);
+    return true;
+}
+
+/*把当前进程vaddr所在的大页拆成一张页表中的1024个4KB页，页框和权限不变，不是大页时什么也不做。
+ *fork和只释放大页一部分时调用，分配不到页表时返回false*/
+bool large_page_split(uint32_t vaddr)
+{
+    uint32_t vaddr_large = vaddr & ~(LARGE_PG_SIZE - 1);
+    uint32_t* pde = pde_ptr(vaddr_large);
+    if(!(*pde & PG_PS)) {
+        return true;
+    }
+    lock_acquire(&kernel_pool.lock);
+    uint32_t pt_phyaddr = (uint32_t)palloc(&kernel_pool);
+    lock_release(&kernel_pool.lock);
+    if(pt_phyaddr == 0) {
+        return false;
+    }
+
+    enum intr_status old_status = intr_disable();
+    uint32_t page_phyaddr = *pde & 0xffc00000;
+    uint32_t attr = *pde & (PG_US_U | PG_RW_W | PG_P_1);
+    uint32_t* pt = kmap_window(pt_phyaddr);
+    uint32_t pg_idx;
+    for(pg_idx = 0; pg_idx < LARGE_PG_PAGES; pg_idx++) {
+        pt[pg_idx] = (page_phyaddr + pg_idx * PG_SIZE) | attr;
+    }
+    kunmap_window();
+    *pde = pt_phyaddr | PG_US_U | PG_RW_W | PG_P_1;
+    //大页的tlb项和页表自映射区中把大页首页当作页表的tlb项都要作废
+    asm volatile ("invlpg %0" : : "m"(*(uint8_t*)vaddr_large) : "memory");
+    asm volatile ("invlpg %0" : : "m"(*(uint8_t*)pte_ptr(vaddr_large)) : "memory");
+    intr_set_status(old_status);
+    return true;
+}
+
+/*解除当前进程vaddr所在大页的映射并释放页框，不改动虚拟地址位图。页目录项在pde_used中的记录保留，清零后遍历时跳过*/
+void large_page_unmap(uint32_t vaddr)
+{
+    uint32_t vaddr_large = vaddr & ~(LARGE_PG_SIZE - 1);
+    uint32_t* pde = pde_ptr(vaddr_large);
+    ASSERT(*pde & PG_PS);
+    uint32_t pg_phy_addr = *pde & 0xffc00000;
+    *pde = 0;
+    asm volatile ("invlpg %0" : : "m"(*(uint8_t*)vaddr_large) : "memory");
+    large_page_free(pg_phy_addr);
+}
+
+/*释放从pg_phy_addr起的大页占用的页框，不改动页表。页框照常按引用计数释放，都只有自己在用时整块归还伙伴系统*/
+void large_page_free(uint32_t pg_phy_addr)
+{
+    uint32_t frame_idx = 0;
+    struct pool* mem_pool = phy_addr2pool(pg_phy_addr, &frame_idx);
+    uint32_t run_start = frame_idx, run_cnt = 0;
+    enum intr_status old_status = intr_disable();
+    uint32_t idx;
+    for(idx = frame_idx; idx < frame_idx + LARGE_PG_PAGES; idx++) {
+        ASSERT(mem_pool->frames[idx].ref_cnt > 0);
+        if(--mem_pool->frames[idx].ref_cnt != 0) {
+            if(run_cnt > 0) {
+                buddy_free_range(mem_pool, run_start, run_cnt);
+            }
+            run_cnt = 0;
+            continue;
+        }
+        if(run_cnt == 0) {
+            run_start = idx;
+        }
+        run_cnt++;
+    }
+    if(run_cnt > 0) {
+        buddy_free_range(mem_pool, run_start, run_cnt);
+    }
+    intr_set_status(old_status);
+}
+
+/*将小内存块b归还到它所在的arena，arena全空时释放arena，调用者需持有内存池的锁*/
+static void block_release(enum pool_flags pf, struct mem_block* b)
+{
+    struct arena* a = block2arena(b);
+    //先将内存块回收到free_list
+    list_append(&a->desc->free_list, &b->free_elem);
+    //再判断此arena中的内存块是否都是空闲，如果是就释放arena
+    if(++a->cnt == a->desc->blocks_per_arena) {
+        uint32_t block_idx;
+        for(block_idx = 0; block_idx < a->desc->blocks_per_arena; block_idx++) {
+            struct mem_block* b = arena2block(a, block_idx);
+            ASSERT(elem_find(&a->desc->free_list, &b->free_elem));
+            list_remove(&b->free_elem);
+        }
+        a->desc->arena_cnt--;
+        mfree_page(pf, a, 1);
     }
 }
 
@@ -471,41 +1474,332 @@ void sys_free(void* ptr)
     if(ptr != NULL) {
         enum pool_flags PF;
         struct pool* mem_pool;
+        struct mem_block_desc* descs;
+        struct task_struct* cur_thread = running_thread();
 
         //判断是线程，还是进程
-        if(running_thread()->pgdir == NULL) {   //kernel-thread
+        if(cur_thread->pgdir == NULL) {   //kernel-thread
             ASSERT((uint32_t)ptr >= K_HEAP_START);
             PF = PF_KERNEL;
             mem_pool = &kernel_pool;
+            descs = k_block_descs;
         } else {   //user program
             PF = PF_USER;
             mem_pool = &user_pool;
+            descs = cur_thread->group_leader->u_block_desc;
         }
 
-        lock_acquire(&mem_pool->lock);
         struct mem_block* b = ptr;   //将ptr赋值给内存块指针b
         struct arena* a = block2arena(b);   //把mem_block转换成arena，获取元信息，内存块b的元信息为struct arena* a
         ASSERT(a->large == 0 || a->large == 1);
+
+        //小内存块先放进本线程的缓存，缓存满了才归还arena
+        if(a->desc != NULL) {
+            struct mem_magazine* mag = &thread_mags(cur_thread, PF)[block_desc_idx(descs, a->desc->block_size)];
+            if(mag->cnt < MAG_SIZE) {
+                mag->blocks[mag->cnt++] = b;
+                return;
+            }
+        }
+
+        lock_acquire(&mem_pool->lock);
         if(a->desc == NULL && a->large == true) {
+            if(PF == PF_KERNEL) {
+                k_large_cnt--;
+                k_large_pages -= a->cnt;
+            }
             mfree_page(PF, a, a->cnt);
         } else {
-            //先将内存块回收到free_list
-            list_append(&a->desc->free_list, &b->free_elem);
-            //再判断此arena中的内存块是否都是空闲，如果是就释放arena
-            if(++a->cnt == a->desc->blocks_per_arena) {
-                uint32_t block_idx;
-                for(block_idx = 0; block_idx < a->desc->blocks_per_arena; block_idx++) {
-                    struct mem_block* b = arena2block(a, block_idx);
-                    ASSERT(elem_find(&a->desc->free_list, &b->free_elem));
-                    list_remove(&b->free_elem);
-                }
-                mfree_page(PF, a, 1);
-            }
+            block_release(PF, b);
         }
         lock_release(&mem_pool->lock);
     }
 }
 
+/*将pthread缓存的内核内存块全部归还arena。用户内存块随进程页框一并回收，不必处理*/
+void mem_magazine_drain(struct task_struct* pthread)
+{
+    uint8_t desc_idx;
+    lock_acquire(&kernel_pool.lock);
+    for(desc_idx = 0; desc_idx < DESC_CNT; desc_idx++) {
+        struct mem_magazine* mag = &pthread->k_mags[desc_idx];
+        while(mag->cnt > 0) {
+            block_release(PF_KERNEL, mag->blocks[--mag->cnt]);
+        }
+    }
+    lock_release(&kernel_pool.lock);
+}
+
+/*返回pf内存池中可分配的空闲页框数，含预清零的页框*/
+uint32_t mem_free_pages(enum pool_flags pf)
+{
+    struct pool* mem_pool = pf & PF_KERNEL ? &kernel_pool : &user_pool;
+    return mem_pool->free_pages + mem_pool->zero_cnt;
+}
+
+/*登记内核内存池页框不够时调用的回收函数，reclaim释放最多pg_cnt个页框并返回释放的个数*/
+void mem_reclaim_register(uint32_t (*reclaim)(uint32_t pg_cnt))
+{
+    mem_reclaim = reclaim;
+}
+
+/*将内存池m_pool的使用情况填入info*/
+static void pool_info_fill(struct pool* m_pool, struct pool_info* info)
+{
+    info->total_pages = m_pool->pool_size / PG_SIZE;
+    info->free_pages = m_pool->free_pages;
+    info->zero_pages = m_pool->zero_cnt;
+    info->peak_used_pages = m_pool->peak_used_pages;
+}
+
+/*将内存块描述符数组descs及线程缓存mags的使用情况填入info*/
+static void desc_info_fill(struct mem_block_desc* descs, struct mem_magazine* mags, struct desc_info* info)
+{
+    uint8_t desc_idx;
+    for(desc_idx = 0; desc_idx < DESC_CNT; desc_idx++) {
+        info[desc_idx].block_size = descs[desc_idx].block_size;
+        info[desc_idx].arena_cnt = descs[desc_idx].arena_cnt;
+        info[desc_idx].free_blocks = list_len(&descs[desc_idx].free_list) + mags[desc_idx].cnt;
+    }
+}
+
+/*将内存统计信息填入info，成功返回0*/
+int32_t sys_meminfo(struct meminfo* info)
+{
+    struct task_struct* cur = running_thread();
+    memset(info, 0, sizeof(struct meminfo));
+
+    lock_acquire(&kernel_pool.lock);
+    pool_info_fill(&kernel_pool, &info->k_pool);
+    desc_info_fill(k_block_descs, cur->k_mags, info->k_descs);
+    info->k_large_cnt = k_large_cnt;
+    info->k_large_pages = k_large_pages;
+    lock_release(&kernel_pool.lock);
+
+    lock_acquire(&user_pool.lock);
+    pool_info_fill(&user_pool, &info->u_pool);
+    if(cur->pgdir != NULL) {
+        desc_info_fill(cur->group_leader->u_block_desc, cur->group_leader->u_mags, info->u_descs);
+    }
+    lock_release(&user_pool.lock);
+
+    info->large_allocs = large_allocs;
+    memcpy(info->malloc_hist, malloc_hist, sizeof(malloc_hist));
+    return 0;
+}
+
+/*创建对象大小为size的对象缓存，ctor为对象构造函数，成功返回缓存指针，失败返回NULL*/
+struct kmem_cache* kmem_cache_create(const char* name, uint32_t size, void (*ctor)(void*))
+{
+    ASSERT(size > 0 && size <= PG_SIZE);
+    if(kmem_cache_cnt == KMEM_CACHE_MAX) {
+        return NULL;
+    }
+    struct kmem_cache* cache = &kmem_caches[kmem_cache_cnt++];
+    cache->name = name;
+    cache->obj_size = DIV_ROUND_UP(size, 4) * 4;
+    cache->ctor = ctor;
+    cache->objs_per_slab = 0;
+    cache->obj_offset = 0;
+
+    //小于半页的对象才切分slab，slab头、空闲链表和对象共处一页，首个对象按16字节对齐，大小是16倍数的对象（如fxsave保存区）因而都是16字节对齐的
+    if(cache->obj_size <= PG_SIZE / 2) {
+        uint32_t objs = (PG_SIZE - sizeof(struct slab)) / (cache->obj_size + 1);
+        if(objs >= SLAB_FREE_END) {
+            objs = SLAB_FREE_END - 1;
+        }
+        while(DIV_ROUND_UP(sizeof(struct slab) + objs, 16) * 16 + objs * cache->obj_size > PG_SIZE) {
+            objs--;
+        }
+        cache->objs_per_slab = objs;
+        cache->obj_offset = DIV_ROUND_UP(sizeof(struct slab) + objs, 16) * 16;
+    }
+
+    list_init(&cache->slabs_partial);
+    list_init(&cache->slabs_full);
+    list_init(&cache->slabs_empty);
+    cache->empty_cnt = 0;
+    lock_init(&cache->lock);
+    return cache;
+}
+
+/*从内核内存池分配一页，不清零*/
+static void* kmem_page_alloc(void)
+{
+    lock_acquire(&kernel_pool.lock);
+    void* page = malloc_page(PF_KERNEL, 1);
+    lock_release(&kernel_pool.lock);
+    return page;
+}
+
+/*将一页归还内核内存池*/
+static void kmem_page_free(void* page)
+{
+    lock_acquire(&kernel_pool.lock);
+    mfree_page(PF_KERNEL, page, 1);
+    lock_release(&kernel_pool.lock);
+}
+
+/*为cache新建一个slab，并对其中每个对象调用构造函数*/
+static struct slab* slab_create(struct kmem_cache* cache)
+{
+    struct slab* slab = kmem_page_alloc();
+    if(slab == NULL) {
+        return NULL;
+    }
+    struct page_frame* frame = virt_to_page(slab);
+    frame->flags |= FRAME_SLAB;
+    frame->owner = cache;
+    slab->cache = cache;
+    slab->inuse = 0;
+    slab->free_idx = 0;
+    uint32_t obj_idx;
+    for(obj_idx = 0; obj_idx < cache->objs_per_slab; obj_idx++) {
+        slab->next_free[obj_idx] = obj_idx + 1 < cache->objs_per_slab ? obj_idx + 1 : SLAB_FREE_END;
+        if(cache->ctor != NULL) {
+            cache->ctor((uint8_t*)slab + cache->obj_offset + obj_idx * cache->obj_size);
+        }
+    }
+    return slab;
+}
+
+/*从cache中分配一个对象，成功返回对象地址，失败返回NULL。对象不会被清零，保持构造函数或上次释放时的状态*/
+void* kmem_cache_alloc(struct kmem_cache* cache)
+{
+    void* obj = NULL;
+
+    //整页对象直接复用空闲页，释放可能发生在关中断的线程退出路径上，所以这里用关中断代替锁
+    if(cache->objs_per_slab == 0) {
+        enum intr_status old_status = intr_disable();
+        if(cache->empty_cnt > 0) {
+            obj = cache->free_pages[--cache->empty_cnt];
+        }
+        intr_set_status(old_status);
+        if(obj == NULL) {
+            obj = kmem_page_alloc();
+            if(obj != NULL && cache->ctor != NULL) {
+                cache->ctor(obj);
+            }
+        }
+        return obj;
+    }
+
+    lock_acquire(&cache->lock);
+
+    //依次从部分占用、全空的slab中找，都没有时再新建slab
+    struct slab* slab;
+    if(!list_empty(&cache->slabs_partial)) {
+        slab = elem2entry(struct slab, slab_tag, cache->slabs_partial.head.next);
+    } else {
+        if(!list_empty(&cache->slabs_empty)) {
+            slab = elem2entry(struct slab, slab_tag, list_pop(&cache->slabs_empty));
+            cache->empty_cnt--;
+        } else {
+            slab = slab_create(cache);
+            if(slab == NULL) {
+                lock_release(&cache->lock);
+                return NULL;
+            }
+        }
+        list_push(&cache->slabs_partial, &slab->slab_tag);
+    }
+
+    uint32_t obj_idx = slab->free_idx;
+    slab->free_idx = slab->next_free[obj_idx];
+    obj = (uint8_t*)slab + cache->obj_offset + obj_idx * cache->obj_size;
+    if(++slab->inuse == cache->objs_per_slab) {
+        list_remove(&slab->slab_tag);
+        list_push(&cache->slabs_full, &slab->slab_tag);
+    }
+    lock_release(&cache->lock);
+    return obj;
+}
+
+/*将对象obj归还cache，调用者应使对象恢复为构造后的状态*/
+void kmem_cache_free(struct kmem_cache* cache, void* obj)
+{
+    ASSERT(obj != NULL);
+
+    //整页对象：空闲页不多就留着复用，否则归还内存池。不能睡眠，否则会改写退出线程的状态
+    if(cache->objs_per_slab == 0) {
+        enum intr_status old_status = intr_disable();
+        if(cache->empty_cnt < KMEM_EMPTY_MAX) {
+            cache->free_pages[cache->empty_cnt++] = obj;
+        } else {
+            mfree_page(PF_KERNEL, obj, 1);
+        }
+        intr_set_status(old_status);
+        return;
+    }
+
+    lock_acquire(&cache->lock);
+
+    struct slab* slab = (struct slab*)((uint32_t)obj & 0xfffff000);
+    ASSERT(slab->cache == cache);
+    uint32_t obj_idx = ((uint32_t)obj - (uint32_t)slab - cache->obj_offset) / cache->obj_size;
+    slab->next_free[obj_idx] = slab->free_idx;
+    slab->free_idx = obj_idx;
+
+    if(slab->inuse-- == cache->objs_per_slab) {   //原来是满的，移到部分占用链表
+        list_remove(&slab->slab_tag);
+        list_push(&cache->slabs_partial, &slab->slab_tag);
+    }
+    if(slab->inuse == 0) {
+        list_remove(&slab->slab_tag);
+        if(cache->empty_cnt < KMEM_EMPTY_MAX) {
+            list_push(&cache->slabs_empty, &slab->slab_tag);
+            cache->empty_cnt++;
+        } else {
+            kmem_page_free(slab);
+        }
+    }
+    lock_release(&cache->lock);
+}
+
+/*e820返回的地址范围描述符*/
+struct ards
+{
+    uint32_t base_low;
+    uint32_t base_high;
+    uint32_t len_low;
+    uint32_t len_high;
+    uint32_t type;
+};
+
+/*返回从1MB起连续可用的物理内存的末尾。按e820的内存表找出包含1MB的可用区段，
+  4GB以上的部分用不到，截在4GB以下；loader没拿到e820内存表时用它估算的容量*/
+static uint32_t mem_detect(void)
+{
+    uint16_t ards_nr = *(uint16_t*)ARDS_NR_ADDR;
+    struct ards* ards = (struct ards*)ARDS_BUF_ADDR;
+    if(ards_nr == 0) {
+        return *(uint32_t*)TOTAL_MEM_ADDR;
+    }
+    if(ards_nr > ARDS_MAX) {
+        ards_nr = ARDS_MAX;
+    }
+    uint32_t mem_end = 0x100000;
+    bool extended = true;
+    while(extended) {   //区段未必按地址排好，也可能首尾相接，反复延伸到不再变长
+        extended = false;
+        uint16_t idx;
+        for(idx = 0; idx < ards_nr; idx++) {
+            if(ards[idx].type != ARDS_TYPE_RAM || ards[idx].base_high != 0) {
+                continue;
+            }
+            uint64_t end = (uint64_t)ards[idx].base_low + ards[idx].len_low + ((uint64_t)ards[idx].len_high << 32);
+            if(end > 0xfffff000) {
+                end = 0xfffff000;
+            }
+            if(ards[idx].base_low <= mem_end && end > mem_end) {
+                mem_end = end;
+                extended = true;
+            }
+        }
+    }
+    return mem_end;
+}
+
 /*初始化内存池*/
 static void mem_pool_init(uint32_t all_mem)
 {
@@ -514,67 +1808,97 @@ static void mem_pool_init(uint32_t all_mem)
                                                 //第769~1022个页目录项共指向254个页表，共256个页框
     uint32_t used_mem = page_table_size + 0x100000;   //0x100000为低端1MB内存
     uint32_t free_mem = all_mem - used_mem;
-    uint16_t all_free_pages = free_mem / PG_SIZE;   //1页为4KB，不管总内存是不是4K的倍数
+    uint32_t all_free_pages = free_mem / PG_SIZE;   //1页为4KB，不管总内存是不是4K的倍数
                                                     //对于以页为单位的内存分配策略，不足1页的内存不用考虑
-    uint16_t kernel_free_pages = all_free_pages / 2;   //可给内核分配的内存页数
-    uint16_t user_free_pages = all_free_pages - kernel_free_pages;   //可给用户程序分配的内存页数
+    uint32_t kernel_free_pages = all_free_pages / 2;   //可给内核分配的内存页数
+    if(kernel_free_pages > KERNEL_POOL_MAX_PAGES) {   //多出的都给用户内存池，用户页框只经临时窗口访问，不占内核虚拟地址
+        kernel_free_pages = KERNEL_POOL_MAX_PAGES;
+    }
+    //用户内存池的起点向下对齐到4MB，伙伴系统最大阶的块在物理上也就是4MB对齐的，可以直接作为大页。内核内存池为此最多让出不到4MB
+    uint32_t up_aligned = (used_mem + kernel_free_pages * PG_SIZE) & ~(LARGE_PG_SIZE - 1);
+    if(up_aligned > used_mem + kernel_free_pages * PG_SIZE / 2) {
+        kernel_free_pages = (up_aligned - used_mem) / PG_SIZE;
+    }
+    uint32_t user_free_pages = all_free_pages - kernel_free_pages;   //可给用户程序分配的内存页数
 
     //为简化位图操作，余数不处理，坏处是这样做会丢内存。
     //好处是不用做内存的越界检查，因为位图表示的内存少于实际物理内存
-    uint32_t kbm_length = kernel_free_pages / 8;   //Kernel Bitmap的长度，位图中的一位表示一页，以字节为单位
-    uint32_t ubm_length = user_free_pages / 8;   //User Bitmap的长度，以字节为单位
+    uint32_t kbm_length = kernel_free_pages / 8;   //内核虚拟地址位图的长度，位图中的一位表示一页，以字节为单位
 
     uint32_t kp_start = used_mem;   //kernel pool start，内核物理内存池的起始地址
     uint32_t up_start = kp_start + kernel_free_pages * PG_SIZE;   //user pool start，用户物理内存池的起始地址
 
+    /*
+     * ****** 页框描述符数组和内核虚拟地址位图 ******
+     * 每个物理页框都要一个描述符，32MB内存约需128KB，
+     * 低端1MB中放不下，所以从内核内存池最前面拿出frame_pages个页框存放，
+     * 并映射到内核堆的起始K_HEAP_START处。之后一页存放内核虚拟地址的空闲区段树，
+     * 再之后是内核虚拟地址位图和它的摘要，都按实际内存大小分配
+     * **********************************************
+    */
+    uint32_t frame_pages = DIV_ROUND_UP(all_free_pages * sizeof(struct page_frame), PG_SIZE);
+    uint32_t kbm_bytes = DIV_ROUND_UP(kbm_length, 4) * 4 + BITMAP_SUMMARY_BYTES(kbm_length);
+    uint32_t meta_pages = frame_pages + 1 + DIV_ROUND_UP(kbm_bytes, PG_SIZE);
+    struct page_frame* frames = (struct page_frame*)K_HEAP_START;
+    uint32_t pg_idx;
+    for(pg_idx = 0; pg_idx < meta_pages; pg_idx++) {
+        page_table_add((void*)(K_HEAP_START + pg_idx * PG_SIZE), (void*)(kp_start + pg_idx * PG_SIZE));
+    }
+    memset(frames, 0, frame_pages * PG_SIZE);
+
     //初始化内存池结构体
-    kernel_pool.phy_addr_start = kp_start;
+    kernel_pool.phy_addr_start = kp_start + meta_pages * PG_SIZE;
     user_pool.phy_addr_start = up_start;
 
-    kernel_pool.pool_size = kernel_free_pages * PG_SIZE;
+    kernel_pool.pool_size = (kernel_free_pages - meta_pages) * PG_SIZE;
     user_pool.pool_size = user_free_pages * PG_SIZE;
 
-    kernel_pool.pool_bitmap.btmp_bytes_len = kbm_length;
-    user_pool.pool_bitmap.btmp_bytes_len = ubm_length;
-
-    /*
-     * ****** 内核内存池和用户内存池位图 ******
-     * 位图是全局的数据，长度不固定。
-     * 全局或静态的数组需要在编译时知道其长度，
-     * 而我们需要根据总内存大小算出需要多少字节，
-     * 所以改为指定一块内存来生成位图
-     * ***************************************
-    */
-    //内核使用的最高地址是0xc009f000，这是主线程的栈地址（内核大小预计为70KB左右）
-    //32MB内存占用的位图是2KB，内核内存池的位图先定在MEM_BITMAP_BASE(0xc009a000)处
-    kernel_pool.pool_bitmap.bits = (void*)MEM_BITMAP_BASE;
-    /*用户内存池的位图紧跟在内核内存池位图之后*/
-    user_pool.pool_bitmap.bits = (void*)(MEM_BITMAP_BASE + kbm_length);
+    kernel_pool.frames = frames;
+    user_pool.frames = frames + (kernel_free_pages - meta_pages);
 
     //输出内存池信息
-    put_str("   kernel_pool_bitmap_start:");
-    put_int((int)kernel_pool.pool_bitmap.bits);
+    put_str("   kernel_pool_frames_start:");
+    put_int((int)kernel_pool.frames);
     put_str("\n");
     put_str("  kerenl_pool_phy_addr_start:");
     put_int(kernel_pool.phy_addr_start);
     put_str("\n");
-    put_str("user_pool_bitmap_start:");
-    put_int((int)user_pool.pool_bitmap.bits);
+    put_str("user_pool_frames_start:");
+    put_int((int)user_pool.frames);
     put_str("\n");
     put_str("user_pool_phy_addr_start:");
     put_int(user_pool.phy_addr_start);
     put_str("\n");
 
-    //将位图置0
-    bitmap_init(&kernel_pool.pool_bitmap);
-    bitmap_init(&user_pool.pool_bitmap);
+    //所有页框初始都是空闲的，按对齐的最大块挂入伙伴系统
+    uint8_t order;
+    for(order = 0; order <= BUDDY_MAX_ORDER; order++) {
+        kernel_pool.free_area[order] = FRAME_NONE;
+        user_pool.free_area[order] = FRAME_NONE;
+    }
+    kernel_pool.free_pages = 0;
+    user_pool.free_pages = 0;
+    kernel_pool.zero_list = user_pool.zero_list = FRAME_NONE;
+    kernel_pool.zero_cnt = user_pool.zero_cnt = 0;
+    kernel_pool.peak_used_pages = user_pool.peak_used_pages = 0;
+    buddy_free_range(&kernel_pool, 0, kernel_pool.pool_size / PG_SIZE);
+    buddy_free_range(&user_pool, 0, user_pool.pool_size / PG_SIZE);
 
     //下面初始化内核虚拟地址的位图，按实际物理内存大小生成数组
     kernel_vaddr.vaddr_bitmap.btmp_bytes_len = kbm_length;   //用于维护内核堆栈的虚拟地址，所以要和内核内存池大小一致
-    kernel_vaddr.vaddr_bitmap.bits = (void*)(MEM_BITMAP_BASE + kbm_length + ubm_length);   //位图的数组指向一块未使用的内存，目前定位在内核内存池和用户内存池之外
+    kernel_vaddr.vaddr_bitmap.bits = (void*)(K_HEAP_START + (frame_pages + 1) * PG_SIZE);
+    kernel_vaddr.vaddr_bitmap.summary = (void*)((uint32_t)kernel_vaddr.vaddr_bitmap.bits + DIV_ROUND_UP(kbm_length, 4) * 4);   //摘要紧跟在位图之后
     kernel_vaddr.vaddr_start = K_HEAP_START;
     
     bitmap_init(&kernel_vaddr.vaddr_bitmap);
+    //页框描述符数组、空闲区段树和位图已占用内核堆最前面的虚拟页，紧随其后的两页留作内核临时映射窗口和清零窗口
+    for(pg_idx = 0; pg_idx < meta_pages + 2; pg_idx++) {
+        bitmap_set(&kernel_vaddr.vaddr_bitmap, pg_idx, 1);
+    }
+    kmap_window_vaddr = K_HEAP_START + meta_pages * PG_SIZE;
+    zero_window_vaddr = kmap_window_vaddr + PG_SIZE;
+    kernel_vaddr.extents = (struct vaddr_extents*)(K_HEAP_START + frame_pages * PG_SIZE);
+    extents_init(kernel_vaddr.extents, meta_pages + 2, kbm_length * 8 - (meta_pages + 2));
 
     lock_init(&kernel_pool.lock);
     lock_init(&user_pool.lock);
@@ -582,27 +1906,67 @@ static void mem_pool_init(uint32_t all_mem)
     put_str("mem_init done\n");
 }
 
-/*根据物理页框地址pg_phy_addr在相应的内存池的位图清零，不改动页表*/
+/*根据物理页框地址pg_phy_addr将页框归还相应的内存池，不改动页表*/
 void free_a_phy_addr(uint32_t pg_phy_addr)
 {
-    struct pool* mem_pool;
-    uint32_t bit_idx = 0;
-    if(pg_phy_addr >= user_pool.phy_addr_start) {
-        mem_pool = &user_pool;
-        bit_idx = (pg_phy_addr - user_pool.phy_addr_start) / PG_SIZE;
-    } else {
-        mem_pool = &kernel_pool;
-        bit_idx = (pg_phy_addr - kernel_pool.phy_addr_start) / PG_SIZE;
-    }
-    bitmap_set(&mem_pool->pool_bitmap, bit_idx, 0);
+    pfree(pg_phy_addr);
 }
 
 /*内存管理部分初始化入口*/
 void mem_init()
 {
     put_str("mem_init start\n");
-    uint32_t mem_bytes_total = *((uint32_t*)(0xb00));
+    uint32_t mem_bytes_total = mem_detect();
     mem_pool_init(mem_bytes_total);   //初始化内存池
     block_desc_init(k_block_descs);   //初始化mem_block_descs数组descs，为malloc做准备
+
+    //打开cr0的WP位，使内核写只读的用户页时也触发页错误，这样写时复制对内核代写用户内存同样生效
+    uint32_t cr0;
+    asm volatile ("movl %%cr0, %0; orl $0x10000, %0; movl %0, %%cr0" : "=r"(cr0) : : "memory");
+
+    //cpu支持PGE时，把内核低端1MB的映射标为全局页并打开cr4的PGE，
+    //这样切换到用户进程重新加载cr3时，内核的tlb项得以保留
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if(edx & (1 << 13)) {
+        uint32_t vaddr;
+        for(vaddr = 0xc0000000; vaddr < K_HEAP_START; vaddr += PG_SIZE) {
+            uint32_t* pte = pte_ptr(vaddr);
+            if(*pte & PG_P_1) {
+                *pte |= PG_G;
+            }
+        }
+        uint32_t cr4;
+        asm volatile ("movl %%cr4, %0; orl $0x80, %0; movl %0, %%cr4" : "=r"(cr4) : : "memory");
+        pge_enabled = true;
+    }
+    //cpu支持PSE时打开cr4的PSE，页目录项可以直接映射4MB的大页，只用于用户申请的大映射区
+    if(edx & (1 << 3)) {
+        uint32_t cr4;
+        asm volatile ("movl %%cr4, %0; orl $0x10, %0; movl %0, %%cr4" : "=r"(cr4) : : "memory");
+        pse_enabled = true;
+    }
+    large_page_counter = counter_register("large_pages");
+    large_fallback_counter = counter_register("large_page_fallbacks");
+
+    //零页从用户内存池取，mfree_page等按用户页检查的地方照常通过。此时只有一个执行流，不必加锁
+    zero_page_phy = (uint32_t)palloc(&user_pool);
+    ASSERT(zero_page_phy != 0);
+    memset(kmap_window(zero_page_phy), 0, PG_SIZE);
+    kunmap_window();
+    zero_page_counter = counter_register("zero_page_maps");
     put_str("mem_init done\n");
 }
+
+/*在从处理器上打开与0号cpu相同的分页特性*/
+void mem_ap_init(void)
+{
+    uint32_t reg;
+    asm volatile ("movl %%cr0, %0; orl $0x10000, %0; movl %0, %%cr0" : "=r"(reg) : : "memory");
+    if(pge_enabled) {
+        asm volatile ("movl %%cr4, %0; orl $0x80, %0; movl %0, %%cr4" : "=r"(reg) : : "memory");
+    }
+    if(pse_enabled) {
+        asm volatile ("movl %%cr4, %0; orl $0x10, %0; movl %0, %%cr4" : "=r"(reg) : : "memory");
+    }
+}
@@ -10,8 +10,39 @@
 #define PG_RW_W 2   //R/W属性位值，读/写/执行
 #define PG_US_S 0   //U/S属性位值，系统级
 #define PG_US_U 4   //用户级
+#define PG_A 0x20   //访问位，cpu访问该页时置1
+#define PG_PS 0x80   //页目录项的PS位，cr4的PSE打开后该项不指向页表，直接映射一个4MB的大页
+#define PG_G 0x100   //G属性位，全局页，cr4的PGE打开后重新加载cr3时不会被刷出tlb
+#define PG_COW 0x200   //页表项中供软件使用的位，表示该页是写时复制页
+#define PG_SHARED 0x400   //页表项中供软件使用的位，表示该页是共享内存页，fork时父子进程仍共用可写的页框
+#define PG_PRIVATE 0x800   //页表项中供软件使用的位，表示该页只属于本进程，fork时不复制给子进程
+#define USER_PDE_CNT 768   //用户空间的页目录项数，768以上是共享的内核空间
+#define LARGE_PG_SIZE 0x400000   //大页的字节数，一个页目录项管辖的范围
+#define LARGE_PG_PAGES (LARGE_PG_SIZE / PG_SIZE)   //一个大页含的4KB页数
+
+/*页框描述符的标志*/
+#define FRAME_FREE 1   //页框是某个空闲块的首页框，挂在对应阶的空闲链表上
+#define FRAME_ZERO 2   //页框已清零，挂在预清零链表上
+#define FRAME_DIRTY 4   //页框内容比后备存储新，回收前要先写回
+#define FRAME_LOCKED 8   //页框正在做io，不能释放或回收
+#define FRAME_CACHE 0x10   //页框属于页缓存，owner指向pcache_page
+#define FRAME_SLAB 0x20   //页框是对象缓存的slab，owner指向kmem_cache
+#define FRAME_USE_MASK (FRAME_DIRTY | FRAME_LOCKED | FRAME_CACHE | FRAME_SLAB)   //页框释放时清除的用途标志
 
 #define DESC_CNT 7   //内存块描述符个数
+#define MAG_SIZE 4   //每种规格的线程内存块缓存容量
+#define MALLOC_HIST_CNT 10   //sys_malloc请求大小直方图的桶数，前9个桶依次统计不超过16、32……4096字节的请求，最后一个统计更大的
+
+/*物理页框描述符，每个物理页框一个，伙伴系统、引用计数和各种用途的标记都记在这里*/
+struct page_frame
+{
+    uint32_t prev;   //空闲链表中前一个空闲块首页框的下标
+    uint32_t next;   //空闲链表中后一个空闲块首页框的下标
+    uint8_t order;   //以本页框为首的空闲块的阶，仅FRAME_FREE时有效
+    uint8_t flags;   //FRAME_*标志
+    uint16_t ref_cnt;   //映射到此页框的页表项个数，写时复制的页框会被多个进程共享
+    void* owner;   //页框的属主，按flags解释，用于从页框反查使用者
+};
 
 extern struct pool kernel_pool, user_pool;
 
@@ -22,11 +53,36 @@ enum pool_flags
     PF_USER = 2   //用户内存池
 };
 
+#define EXTENT_NIL 0   //空闲区段树的空节点下标，nodes[0]不存放数据
+#define EXTENT_NODE_CNT 204   //(4096 - 8) / 20，一页能容纳的节点数
+
+/*虚拟地址空闲区段树（treap）的节点，按起始页号排序。
+  节点之间用数组下标互相引用，整页复制后依然有效，fork时直接复制即可*/
+struct vaddr_extent
+{
+    uint32_t start;   //空闲区段的起始页号，相对于vaddr_start
+    uint32_t pg_cnt;   //空闲区段的页数
+    uint32_t max_cnt;   //以本节点为根的子树中最大的pg_cnt，用于按首次适配查找
+    uint32_t prio;   //treap的堆优先级
+    uint16_t left;
+    uint16_t right;
+};
+
+/*虚拟地址空闲区段树，正好占一页*/
+struct vaddr_extents
+{
+    uint16_t root;
+    uint16_t free_node;   //空闲节点链表，借用left串起来
+    bool overflow;   //节点耗尽后置true，此后退回用位图扫描分配
+    struct vaddr_extent nodes[EXTENT_NODE_CNT];
+};
+
 /*虚拟地址池，用于虚拟地址管理*/
 struct virtual_addr
 {
     struct bitmap vaddr_bitmap;   //虚拟地址用到的位图结构
     uint32_t vaddr_start;   //虚拟地址起始地址
+    struct vaddr_extents* extents;   //空闲区段树，分配时按它查找，位图仍记录每一页的占用情况，为NULL时只用位图
 };
 
 /*内存块*/
@@ -41,12 +97,63 @@ struct mem_block_desc
     uint32_t block_size;   //内存块大小，描述本描述符的规格
     uint32_t blocks_per_arena;   //本arena中可容纳此memory_block的数量
     struct list free_list;   //空闲内存块链表，目前可用的mem_block链表
+    uint32_t arena_cnt;   //本规格现有的arena数
+};
+
+/*一个内存池的使用情况*/
+struct pool_info
+{
+    uint32_t total_pages;   //内存池的页框总数
+    uint32_t free_pages;   //伙伴系统中的空闲页框数
+    uint32_t zero_pages;   //预清零链表上的页框数，同样可以分配
+    uint32_t peak_used_pages;   //已用页框数的最高值
+};
+
+/*一种规格内存块的使用情况*/
+struct desc_info
+{
+    uint32_t block_size;
+    uint32_t arena_cnt;   //现有的arena数
+    uint32_t free_blocks;   //空闲内存块数，含当前线程缓存的内存块
+};
+
+/*sys_meminfo返回的内存统计信息*/
+struct meminfo
+{
+    struct pool_info k_pool;   //内核内存池
+    struct pool_info u_pool;   //用户内存池
+    struct desc_info k_descs[DESC_CNT];   //内核内存块的各规格
+    struct desc_info u_descs[DESC_CNT];   //当前进程用户内存块的各规格
+    uint32_t large_allocs;   //开机以来超过1024字节的大块分配次数
+    uint32_t k_large_cnt;   //内核尚未释放的大块分配个数
+    uint32_t k_large_pages;   //内核尚未释放的大块分配占用的页框数
+    uint32_t malloc_hist[MALLOC_HIST_CNT];   //开机以来sys_malloc请求大小的直方图
+};
+
+/*线程私有的内存块缓存，存放最近释放的同规格内存块，分配和释放时免锁*/
+struct mem_magazine
+{
+    uint32_t cnt;   //缓存中的内存块数量
+    struct mem_block* blocks[MAG_SIZE];
 };
 
+struct task_struct;
+struct kmem_cache;
+
 uint32_t* pte_ptr(uint32_t vaddr);
+/*将空闲区段树ext初始化为只含从start起的pg_cnt页这一个空闲区段*/
+void extents_init(struct vaddr_extents* ext, uint32_t start, uint32_t pg_cnt);
+/*在pf虚拟地址池中申请pg_cnt个连续的虚拟页，不建立映射，成功返回起始地址，失败返回NULL*/
+void* vaddr_get(enum pool_flags pf, uint32_t pg_cnt);
+/*在pf虚拟地址池中将从vaddr起的pg_cnt页标记为已占用，不建立映射*/
+void vaddr_mark(enum pool_flags pf, void* vaddr, uint32_t pg_cnt);
+/*在pf虚拟地址池中释放从vaddr起的pg_cnt页，不改动页表*/
+void vaddr_remove(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt);
 uint32_t* pde_ptr(uint32_t vaddr);
 void* malloc_page(enum pool_flags pf, uint32_t pg_cnt);
 void* get_kernel_pages(uint32_t pg_cnt);
+/*同get_kernel_pages，内核内存池的锁被占用时不等待，直接返回NULL*/
+void* get_kernel_pages_try(uint32_t pg_cnt);
 void* get_user_pages(uint32_t pg_cnt);
 void* get_a_page(enum pool_flags pf, uint32_t vaddr);
 /*安装1页大小的vaddr，专门针对fork时虚拟地址位图无需操作的情况*/
@@ -54,6 +161,8 @@ void* get_a_page_without_opvaddrbitmap(enum pool_flags pf, uint32_t vaddr);
 void mem_init(void);
 /*得到虚拟地址映射到的物理地址*/
 uint32_t addr_v2p(uint32_t vaddr);
+/*初始化内存块描述符数组desc_array，为malloc做准备*/
+void block_desc_init(struct mem_block_desc* desc_array);
 /*在堆中申请size字节内存*/
 void* sys_malloc(uint32_t size);
 /*将物理地址pg_phy_addr回收到物理内存池*/
@@ -62,7 +171,65 @@ void pfree(uint32_t pg_phy_addr);
 void mfree_page(enum pool_flags pf, void* _vaddr, uint32_t pg_cnt);
 /*回收内存ptr*/
 void sys_free(void* ptr);
-/*根据物理页框地址pg_phy_addr在相应的内存池的位图清零，不改动页表*/
+/*释放cnt个页表项ptes中存在的页框，物理地址相连的页框合成一段交给伙伴系统，不改动页表*/
+void pfree_ptes(const uint32_t* ptes, uint32_t cnt);
+/*返回pthread所在进程从pde_idx起第一个建立了页表的用户页目录项下标，没有返回-1*/
+int32_t user_pde_next(struct task_struct* pthread, uint32_t pde_idx);
+/*根据物理页框地址pg_phy_addr将页框归还相应的内存池，不改动页表*/
 void free_a_phy_addr(uint32_t pg_phy_addr);
+/*增加物理页框pg_phy_addr的引用计数*/
+void page_ref_inc(uint32_t pg_phy_addr);
+/*返回物理页框pg_phy_addr的引用计数*/
+uint32_t page_ref_cnt(uint32_t pg_phy_addr);
+/*返回页框号pfn的描述符，页框不归内存池管理时返回NULL*/
+struct page_frame* pfn_to_page(uint32_t pfn);
+/*返回描述符page对应的页框号*/
+uint32_t page_to_pfn(struct page_frame* page);
+/*返回已映射的虚拟地址vaddr所在页框的描述符*/
+struct page_frame* virt_to_page(void* vaddr);
+/*从pf内存池分配一个清零的页框，不建立映射，返回物理地址，失败返回0*/
+uint32_t page_frame_alloc(enum pool_flags pf);
+/*将物理页框pg_phy_addr映射到内核临时窗口，返回窗口的虚拟地址，需关中断调用*/
+void* kmap_window(uint32_t pg_phy_addr);
+/*撤销内核临时窗口的映射*/
+void kunmap_window(void);
+/*把用户页框pg_phy_addr作为共享页映射到当前进程的vaddr，页框引用计数加1*/
+void page_map_shared(uint32_t vaddr, uint32_t pg_phy_addr, bool writable);
+/*把用户页框pg_phy_addr作为写时复制页映射到当前进程的vaddr，页框引用计数加1*/
+void page_map_cow(uint32_t vaddr, uint32_t pg_phy_addr);
+/*为当前进程的用户空间建立写时复制的副本，填入子进程的页目录child_pgdir*/
+int32_t pgdir_copy_cow(uint32_t* child_pgdir);
+/*处理写时复制引起的页错误，是写时复制页返回true，否则返回false*/
+bool page_cow_fault(uint32_t vaddr);
+/*读引起的缺页把全局零页只读映射到vaddr所在的页并返回true，writable时第一次写入再分配页框；写引起的缺页返回false*/
+bool zero_page_fault(uint32_t vaddr, bool writable);
+/*用一个清零的大页映射当前进程vaddr所在的4MB对齐区域，拿不到4MB对齐的物理块时返回false，调用者退回按4KB映射*/
+bool large_page_map(uint32_t vaddr, bool writable);
+/*把当前进程vaddr所在的大页拆成一张页表中的4KB页，页框不变，分配不到页表时返回false*/
+bool large_page_split(uint32_t vaddr);
+/*解除当前进程vaddr所在大页的映射并释放页框，不改动虚拟地址位图*/
+void large_page_unmap(uint32_t vaddr);
+/*释放从pg_phy_addr起的大页占用的页框，不改动页表*/
+void large_page_free(uint32_t pg_phy_addr);
+/*刷新本cpu的整个tlb，包括全局页*/
+void tlb_flush_all(void);
+/*在从处理器上打开与0号cpu相同的分页特性*/
+void mem_ap_init(void);
+/*清零一个空闲页框放入预清零链表，没有可做的返回false，由idle线程调用*/
+bool page_prezero(void);
+/*创建对象大小为size的对象缓存，ctor为对象构造函数*/
+struct kmem_cache* kmem_cache_create(const char* name, uint32_t size, void (*ctor)(void*));
+/*从cache中分配一个对象*/
+void* kmem_cache_alloc(struct kmem_cache* cache);
+/*将对象obj归还cache*/
+void kmem_cache_free(struct kmem_cache* cache, void* obj);
+/*将内存统计信息填入info，成功返回0*/
+int32_t sys_meminfo(struct meminfo* info);
+/*将pthread缓存的内核内存块全部归还arena*/
+void mem_magazine_drain(struct task_struct* pthread);
+/*返回pf内存池中可分配的空闲页框数，含预清零的页框*/
+uint32_t mem_free_pages(enum pool_flags pf);
+/*登记内核内存池页框不够时调用的回收函数，reclaim释放最多pg_cnt个页框并返回释放的个数*/
+void mem_reclaim_register(uint32_t (*reclaim)(uint32_t pg_cnt));
 
 #endif
@@ -0,0 +1,84 @@
+#include "profile.h"
+#include "stdint.h"
+#include "global.h"
+#include "string.h"
+#include "memory.h"
+#include "thread.h"
+#include "interrupt.h"
+#include "timer.h"
+#include "smp.h"
+
+#define PROFILE_PAGES DIV_ROUND_UP(PROFILE_MAX_SAMPLES * sizeof(struct profile_sample), PG_SIZE)
+
+static struct profile_sample* samples;   //第一次开始采样时分配，之后一直保留
+static volatile bool profiling;
+static uint32_t sample_cnt;   //缓冲区中的样本数
+static uint32_t sample_total;   //开始以来的样本总数，含缓冲区满后没存下的
+
+/*在时钟中断处理函数中调用，正在采样时记录被打断的现场。持有大内核锁，各cpu不会同时进来*/
+void profile_sample(void)
+{
+    if(!profiling) {
+        return;
+    }
+    sample_total++;
+    if(sample_cnt == PROFILE_MAX_SAMPLES) {
+        return;
+    }
+    struct intr_stack* frame = intr_frame();
+    struct profile_sample* s = &samples[sample_cnt++];
+    s->eip = (uint32_t)frame->eip;
+    s->pid = running_thread()->pid;
+    s->cpl = frame->cs & 0x3;
+    s->cpu = smp_cpu_id();
+}
+
+/*清空样本并开始采样，hz为采样频率，为0或不超过滴答频率时每个滴答采样一次，成功返回0，失败返回-1*/
+static int32_t profile_start(uint32_t hz)
+{
+    if(samples == NULL) {
+        samples = get_kernel_pages(PROFILE_PAGES);
+        if(samples == NULL) {
+            return -1;
+        }
+    }
+    uint32_t per_tick = hz / IRQ0_FREQUENCY;
+    if(per_tick < 1) {
+        per_tick = 1;
+    } else if(per_tick > TIMER_INTR_PER_TICK_MAX) {
+        per_tick = TIMER_INTR_PER_TICK_MAX;
+    }
+    enum intr_status old_status = intr_disable();
+    sample_cnt = 0;
+    sample_total = 0;
+    profiling = true;
+    intr_set_status(old_status);
+    timer_intr_per_tick_set(per_tick);
+    return 0;
+}
+
+/*执行采样命令cmd。START成功返回0；STOP返回开始以来的样本总数；DUMP返回复制的样本数；失败返回-1*/
+int32_t sys_profile(uint32_t cmd, uint32_t arg, struct profile_sample* buf)
+{
+    switch(cmd) {
+        case PROFILE_START:
+            return profile_start(arg);
+        case PROFILE_STOP:
+            if(profiling) {
+                profiling = false;
+                timer_intr_per_tick_set(1);
+            }
+            return sample_total;
+        case PROFILE_DUMP:
+            if(buf == NULL) {
+                return -1;
+            }
+            if(arg > sample_cnt) {
+                arg = sample_cnt;
+            }
+            memcpy(buf, samples, arg * sizeof(struct profile_sample));
+            return arg;
+        default:
+            return -1;
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef __KERNEL_PROFILE_H
+#define __KERNEL_PROFILE_H
+#include "stdint.h"
+
+#define PROFILE_MAX_SAMPLES 8192   //采样缓冲区能存的样本数，满了之后的样本只计数
+
+/*sys_profile的命令*/
+enum profile_cmd
+{
+    PROFILE_START,   //清空样本并开始采样，arg为采样频率(Hz)，为0时每个滴答采样一次
+    PROFILE_STOP,   //停止采样，恢复时钟频率
+    PROFILE_DUMP   //把至多arg个样本复制到buf
+};
+
+/*一个样本：时钟中断打断的位置*/
+struct profile_sample
+{
+    uint32_t eip;
+    int16_t pid;
+    uint8_t cpl;   //被打断时的特权级，0为内核，3为用户
+    uint8_t cpu;
+};
+
+/*在时钟中断处理函数中调用，正在采样时记录被打断的现场*/
+void profile_sample(void);
+/*执行采样命令cmd。START成功返回0；STOP返回记录的样本数；DUMP返回复制的样本数；失败返回-1*/
+int32_t sys_profile(uint32_t cmd, uint32_t arg, struct profile_sample* buf);
+
+#endif
@@ -0,0 +1,574 @@
+#include "smp.h"
+#include "stdint.h"
+#include "global.h"
+#include "print.h"
+#include "string.h"
+#include "debug.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "thread.h"
+#include "tss.h"
+#include "timer.h"
+#include "fpu.h"
+#include "profile.h"
+#include "hrtimer.h"
+
+#define LAPIC_BASE 0xfee00000   //本地apic寄存器的物理地址，按相同的虚拟地址映射
+#define LAPIC_ID 0x020   //本地apic id寄存器，高8位为id
+#define LAPIC_EOI 0x0b0   //中断结束寄存器
+#define LAPIC_SVR 0x0f0   //伪中断向量寄存器，第8位为apic软件使能位
+#define LAPIC_ICR_LOW 0x300   //中断命令寄存器低32位，写入即发送
+#define LAPIC_ICR_HIGH 0x310   //中断命令寄存器高32位，高8位为目标apic id
+#define LAPIC_LVT_TIMER 0x320   //本地定时器的本地向量表项
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_TIMER_INIT 0x380   //定时器初始计数
+#define LAPIC_TIMER_CUR 0x390   //定时器当前计数
+#define LAPIC_TIMER_DIV 0x3e0   //定时器分频
+
+#define LAPIC_SVR_ENABLE 0x100
+#define LAPIC_LVT_MASKED 0x10000
+#define LAPIC_TIMER_PERIODIC 0x20000
+#define LAPIC_DELIVERY_EXTINT 0x700
+#define LAPIC_DELIVERY_NMI 0x400
+#define LAPIC_ICR_PENDING 0x1000   //ICR的发送状态位
+#define LAPIC_ICR_INIT_ASSERT 0xc500   //电平触发的INIT
+#define LAPIC_ICR_INIT_DEASSERT 0x8500
+#define LAPIC_ICR_STARTUP 0x600   //低8位为启动代码所在的物理页号
+
+#define LAPIC_TIMER_VEC 0x30   //从处理器本地定时器的中断向量号
+#define LAPIC_HRTIMER_VEC 0x31   //0号cpu本地定时器单次中断的向量号，其他cpu也用它通知0号cpu重设定时器
+#define LAPIC_SPURIOUS_VEC 0x3f   //本地apic伪中断的向量号
+
+#define AP_TRAMPOLINE_PHY 0x90000   //从处理器启动代码的物理地址，必须在1MB以下且4K对齐
+
+#define MP_TYPE_PROCESSOR 0   //mp配置表中的处理器表项，长20字节，其他表项长8字节
+
+/*mp浮点结构，BIOS放在EBDA或0xf0000~0xfffff的某个16字节边界上*/
+struct mp_float
+{
+    char signature[4];   //"_MP_"
+    uint32_t config_phy;   //mp配置表的物理地址
+    uint8_t length;   //以16字节为单位的长度
+    uint8_t revision;
+    uint8_t checksum;
+    uint8_t feature[5];
+} __attribute__((packed));
+
+/*mp配置表的表头，表项紧随其后*/
+struct mp_config
+{
+    char signature[4];   //"PCMP"
+    uint16_t length;   //表头和表项总长度
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_length;
+    uint16_t entry_cnt;
+    uint32_t lapic_phy;   //本地apic的物理地址
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+} __attribute__((packed));
+
+uint8_t cpu_cnt = 1;
+bool smp_active = false;
+
+static uint8_t cpu_apic_id[MAX_CPUS];   //各cpu的本地apic id
+static uint8_t apic2cpu[256];   //本地apic id到cpu编号的映射
+static uint8_t mp_cpu_cnt;   //mp配置表中登记的可用cpu个数
+static uint32_t lapic_count_per_tick;   //本地定时器一个滴答的计数值，由0号cpu校准
+static bool lapic_oneshot_ok;   //0号cpu的本地定时器是否已校准、可用作高精度定时器的单次中断
+
+static volatile uint32_t bkl_locked;   //大内核锁，1表示被某个cpu持有
+static uint8_t bkl_owner;   //最后一个持有大内核锁的cpu
+static volatile uint8_t ap_booting;   //正在启动的从处理器编号
+static volatile bool ap_online;   //正在启动的从处理器是否已就绪
+
+extern char ap_trampoline[], ap_trampoline_end[], ap_stack[];
+void ap_main(void);
+
+/*从处理器的启动代码，启动时处于实模式，cs为AP_TRAMPOLINE_PHY>>4。
+  借用loader的gdt进入保护模式，加载内核页目录并打开分页后跳到ap_main。
+  这段代码被复制到AP_TRAMPOLINE_PHY处执行，引用自身的地址都要换算成相对偏移*/
+asm (
+    ".text\n"
+    ".code16\n"
+    ".globl ap_trampoline\n"
+    "ap_trampoline:\n"
+    "    cli\n"
+    "    movw %cs, %ax\n"
+    "    movw %ax, %ds\n"
+    "    lgdtl ap_gdt_ptr - ap_trampoline\n"
+    "    movl %cr0, %eax\n"
+    "    orl $0x1, %eax\n"
+    "    movl %eax, %cr0\n"
+    "    ljmpl $0x08, $(0x90000 + ap_pm - ap_trampoline)\n"
+    ".code32\n"
+    "ap_pm:\n"
+    "    movw $0x10, %ax\n"
+    "    movw %ax, %ds\n"
+    "    movw %ax, %es\n"
+    "    movw %ax, %fs\n"
+    "    movw %ax, %ss\n"
+    "    movw $0x18, %ax\n"
+    "    movw %ax, %gs\n"
+    "    movl $0x100000, %eax\n"   //内核页目录的物理地址
+    "    movl %eax, %cr3\n"
+    "    movl %cr0, %eax\n"
+    "    orl $0x80000000, %eax\n"
+    "    movl %eax, %cr0\n"
+    "    movl (0xc0090000 + ap_stack - ap_trampoline), %esp\n"
+    "    movl $ap_main, %eax\n"
+    "    jmp *%eax\n"
+    ".p2align 2\n"
+    "ap_gdt_ptr:\n"
+    "    .word 4 * 8 - 1\n"   //只用到loader的前4个描述符
+    "    .long 0x900\n"   //gdt的物理地址
+    ".globl ap_stack\n"
+    "ap_stack:\n"
+    "    .long 0\n"   //由启动处理器填入从处理器idle线程的栈顶
+    ".globl ap_trampoline_end\n"
+    "ap_trampoline_end:\n"
+);
+
+/*系统调用入口。与kernel.s中的syscall_handler相同，只是在调用子功能前后获取和释放大内核锁，子功能经syscall_dispatch调用以便统计。
+  bkl_acquire会破坏eax、ecx、edx，所以参数从栈中保存的上下文里重新取*/
+asm (
+    ".text\n"
+    ".globl syscall_entry\n"
+    "syscall_entry:\n"
+    "    pushl $0\n"
+    "    pushl %ds\n"
+    "    pushl %es\n"
+    "    pushl %fs\n"
+    "    pushl %gs\n"
+    "    pushal\n"
+    "    cld\n"   //c代码要求DF=0，被打断的代码可能置上了它，iret时恢复
+    "    pushl $0x80\n"
+    "    call bkl_acquire\n"
+    "    movl 32(%esp), %eax\n"
+    "    movl 20(%esp), %ebx\n"
+    "    movl 28(%esp), %ecx\n"
+    "    movl 24(%esp), %edx\n"
+    "    pushl %edx\n"
+    "    pushl %ecx\n"
+    "    pushl %ebx\n"
+    "    pushl %eax\n"
+    "    call syscall_dispatch\n"
+    "    addl $16, %esp\n"
+    "    movl %eax, 32(%esp)\n"   //返回值存入栈中eax的位置
+    "    call bkl_release\n"
+    "    jmp intr_exit\n"
+);
+
+/*sysenter的入口。sysenter不保存用户态的返回地址和栈，由用户态的调用代码放在esi和ebp中，
+  这里按中断的格式补齐上下文，之后fork和exec照常从中断返回。返回时用sysexit，eip和esp取自栈中的上下文，
+  用户栈段和代码段压入SELECTOR_U_DATA(0x33)和SELECTOR_U_CODE(0x2b)，经iret返回时也一样能用*/
+asm (
+    ".text\n"
+    ".globl sysenter_entry\n"
+    "sysenter_entry:\n"
+    "    pushl $0x33\n"
+    "    pushl %ebp\n"
+    "    pushfl\n"
+    "    orl $0x200, (%esp)\n"   //sysenter清了IF，返回用户态后要开中断
+    "    pushl $0x2b\n"
+    "    pushl %esi\n"
+    "    pushl $0\n"
+    "    pushl %ds\n"
+    "    pushl %es\n"
+    "    pushl %fs\n"
+    "    pushl %gs\n"
+    "    pushal\n"
+    "    cld\n"
+    "    pushl $0x80\n"
+    "    call bkl_acquire\n"
+    "    movl 32(%esp), %eax\n"
+    "    movl 20(%esp), %ebx\n"
+    "    movl 28(%esp), %ecx\n"
+    "    movl 24(%esp), %edx\n"
+    "    pushl %edx\n"
+    "    pushl %ecx\n"
+    "    pushl %ebx\n"
+    "    pushl %eax\n"
+    "    call syscall_dispatch\n"
+    "    addl $16, %esp\n"
+    "    movl %eax, 32(%esp)\n"
+    "    call bkl_release\n"
+    "    addl $4, %esp\n"
+    "    popal\n"
+    "    popl %gs\n"
+    "    popl %fs\n"
+    "    popl %es\n"
+    "    popl %ds\n"
+    "    addl $4, %esp\n"
+    "    movl (%esp), %edx\n"   //sysexit返回到edx，栈顶为ecx
+    "    movl 12(%esp), %ecx\n"
+    "    andl $0xfffffdff, 8(%esp)\n"   //先关着中断恢复eflags，sti的下一条指令执行完才响应中断
+    "    pushl 8(%esp)\n"
+    "    popfl\n"
+    "    sti\n"
+    "    sysexit\n"
+);
+
+/*从内核直接返回用户态时使用，先释放大内核锁再从中断返回*/
+asm (
+    ".text\n"
+    ".globl bkl_intr_exit\n"
+    "bkl_intr_exit:\n"
+    "    call bkl_release\n"
+    "    jmp intr_exit\n"
+);
+
+/*本地定时器中断的入口，格式与kernel.s中的入口相同，但中断来自本地apic，不向8259A发EOI*/
+asm (
+    ".text\n"
+    ".globl lapic_timer_entry\n"
+    "lapic_timer_entry:\n"
+    "    pushl $0\n"
+    "    pushl %ds\n"
+    "    pushl %es\n"
+    "    pushl %fs\n"
+    "    pushl %gs\n"
+    "    pushal\n"
+    "    cld\n"
+    "    pushl $0x30\n"
+    "    call *(idt_table + 0x30 * 4)\n"
+    "    jmp intr_exit\n"
+    ".globl lapic_hrtimer_entry\n"
+    "lapic_hrtimer_entry:\n"
+    "    pushl $0\n"
+    "    pushl %ds\n"
+    "    pushl %es\n"
+    "    pushl %fs\n"
+    "    pushl %gs\n"
+    "    pushal\n"
+    "    cld\n"
+    "    pushl $0x31\n"
+    "    call *(idt_table + 0x31 * 4)\n"
+    "    jmp intr_exit\n"
+    ".globl lapic_spurious_entry\n"
+    "lapic_spurious_entry:\n"   //伪中断不需要EOI，直接返回
+    "    iret\n"
+);
+
+extern void lapic_timer_entry(void);
+extern void lapic_hrtimer_entry(void);
+extern void lapic_spurious_entry(void);
+
+/*读本地apic寄存器*/
+static uint32_t lapic_read(uint32_t reg)
+{
+    return *(volatile uint32_t*)(LAPIC_BASE + reg);
+}
+
+/*写本地apic寄存器*/
+static void lapic_write(uint32_t reg, uint32_t val)
+{
+    *(volatile uint32_t*)(LAPIC_BASE + reg) = val;
+}
+
+/*返回当前cpu的编号，0号为启动处理器*/
+uint8_t smp_cpu_id(void)
+{
+    if(!smp_active) {
+        return 0;
+    }
+    return apic2cpu[lapic_read(LAPIC_ID) >> 24];
+}
+
+/*当前线程获取大内核锁，可嵌套，需关中断调用。
+  锁的嵌套深度记在线程中，所以线程在内核里被换下时，锁随cpu交给换上来的线程*/
+void bkl_acquire(void)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    struct task_struct* cur = running_thread();
+    if(cur->bkl_depth++ > 0 || !smp_active) {
+        return;
+    }
+    uint32_t old = 1;
+    asm volatile ("xchgl %0, %1" : "+r"(old), "+m"(bkl_locked) : : "memory");
+    while(old != 0) {
+        asm volatile ("pause");
+        old = 1;
+        asm volatile ("xchgl %0, %1" : "+r"(old), "+m"(bkl_locked) : : "memory");
+    }
+
+    //没有核间中断做tlb同步，只能在锁换cpu时刷新本cpu的tlb，
+    //内核映射只在持锁时修改，用户页表只被它自己的线程使用，这样就不会用到过时的映射
+    uint8_t cpu_id = smp_cpu_id();
+    if(bkl_owner != cpu_id) {
+        bkl_owner = cpu_id;
+        tlb_flush_all();
+    }
+}
+
+/*当前线程释放一层大内核锁，需关中断调用*/
+void bkl_release(void)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    struct task_struct* cur = running_thread();
+    ASSERT(cur->bkl_depth > 0);
+    if(--cur->bkl_depth > 0 || !smp_active) {
+        return;
+    }
+    asm volatile ("movl $0, %0" : "=m"(bkl_locked) : : "memory");
+}
+
+/*计算从addr起len字节的校验和，为0表示有效*/
+static uint8_t mp_checksum(uint8_t* addr, uint32_t len)
+{
+    uint8_t sum = 0;
+    uint32_t idx;
+    for(idx = 0; idx < len; idx++) {
+        sum += addr[idx];
+    }
+    return sum;
+}
+
+/*在物理地址phy_start起的len字节内查找mp浮点结构，找不到返回NULL*/
+static struct mp_float* mp_search(uint32_t phy_start, uint32_t len)
+{
+    uint8_t* addr = (uint8_t*)(0xc0000000 + phy_start);
+    uint8_t* end = addr + len;
+    for(; addr + sizeof(struct mp_float) <= end; addr += 16) {
+        if(memcmp(addr, "_MP_", 4) == 0 && mp_checksum(addr, sizeof(struct mp_float)) == 0) {
+            return (struct mp_float*)addr;
+        }
+    }
+    return NULL;
+}
+
+/*解析mp配置表，登记可用的cpu，成功返回true*/
+static bool mp_parse(void)
+{
+    //依次查找EBDA的前1KB、常规内存的最后1KB和BIOS只读区
+    uint32_t ebda_phy = (uint32_t)(*(uint16_t*)0xc000040e) << 4;
+    struct mp_float* mpf = NULL;
+    if(ebda_phy != 0) {
+        mpf = mp_search(ebda_phy, 1024);
+    }
+    if(mpf == NULL) {
+        mpf = mp_search(0x9fc00, 1024);
+    }
+    if(mpf == NULL) {
+        mpf = mp_search(0xf0000, 0x10000);
+    }
+    //配置表不在低端1MB时没有现成的映射，这种情况按单处理器处理
+    if(mpf == NULL || mpf->config_phy == 0 || mpf->config_phy >= 0x100000) {
+        return false;
+    }
+
+    struct mp_config* conf = (struct mp_config*)(0xc0000000 + mpf->config_phy);
+    if(memcmp(conf->signature, "PCMP", 4) != 0 || mp_checksum((uint8_t*)conf, conf->length) != 0 || \
+       conf->lapic_phy != LAPIC_BASE) {
+        return false;
+    }
+
+    uint8_t* entry = (uint8_t*)(conf + 1);
+    uint16_t idx;
+    for(idx = 0; idx < conf->entry_cnt; idx++) {
+        if(entry[0] == MP_TYPE_PROCESSOR) {
+            //entry[1]为本地apic id，entry[3]第0位表示可用，第1位表示启动处理器
+            if((entry[3] & 0x1) && mp_cpu_cnt < MAX_CPUS) {
+                if(entry[3] & 0x2) {
+                    //启动处理器总是0号，原先登记在0号的挪到后面
+                    cpu_apic_id[mp_cpu_cnt] = cpu_apic_id[0];
+                    cpu_apic_id[0] = entry[1];
+                } else {
+                    cpu_apic_id[mp_cpu_cnt] = entry[1];
+                }
+                mp_cpu_cnt++;
+            }
+            entry += 20;
+        } else {
+            entry += 8;
+        }
+    }
+    return mp_cpu_cnt > 0;
+}
+
+/*向apic_id发送核间中断，icr_low为命令低32位，等待发送完成*/
+static void lapic_send_ipi(uint8_t apic_id, uint32_t icr_low)
+{
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, icr_low);
+    while(lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING);
+}
+
+/*打开本cpu的本地apic，8259A的中断经LINT0以ExtINT方式进来，LINT1接NMI*/
+static void lapic_init(void)
+{
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VEC);
+    if(smp_cpu_id() == 0) {
+        lapic_write(LAPIC_LVT_LINT0, LAPIC_DELIVERY_EXTINT);
+    } else {
+        lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);   //8259A只接到0号cpu
+    }
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_DELIVERY_NMI);
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/*用8253校准本地定时器，算出一个滴答对应的计数值，在0号cpu上开中断调用*/
+static void lapic_timer_calibrate(void)
+{
+    lapic_write(LAPIC_TIMER_DIV, 0x3);   //16分频
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_VEC);
+    lapic_write(LAPIC_TIMER_INIT, 0xffffffff);
+    mtime_sleep(100);
+    uint32_t elapsed = 0xffffffff - lapic_read(LAPIC_TIMER_CUR);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+    lapic_count_per_tick = elapsed / 10;   //100ms是10个滴答
+}
+
+/*本地定时器的中断处理函数，只在从处理器上使用*/
+static void intr_lapic_timer_handler(void)
+{
+    lapic_write(LAPIC_EOI, 0);
+    profile_sample();
+    timer_local_tick();
+}
+
+/*0号cpu本地定时器单次中断的处理函数，也处理其他cpu发来的重设通知*/
+static void intr_lapic_hrtimer_handler(void)
+{
+    lapic_write(LAPIC_EOI, 0);
+    hrtimer_expire();
+}
+
+/*0号cpu的本地定时器是否已校准、可用作单次定时*/
+bool lapic_oneshot_ready(void)
+{
+    return lapic_oneshot_ok;
+}
+
+/*让0号cpu的本地定时器在us微秒后中断一次，us为0时停止，需关中断调用。
+  各cpu的本地apic在同一地址，在其他cpu上调用时只能发核间中断，让0号cpu在中断中自己重设*/
+void lapic_oneshot_arm(uint32_t us)
+{
+    ASSERT(lapic_oneshot_ok);
+    if(smp_cpu_id() != 0) {
+        lapic_send_ipi(cpu_apic_id[0], LAPIC_HRTIMER_VEC);
+        return;
+    }
+    if(us == 0) {
+        lapic_write(LAPIC_TIMER_INIT, 0);
+        return;
+    }
+    uint32_t count = div_u64_u32((uint64_t)us * lapic_count_per_tick, 1000000 / IRQ0_FREQUENCY);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_HRTIMER_VEC);   //单次模式
+    lapic_write(LAPIC_TIMER_INIT, count == 0 ? 1 : count);
+}
+
+/*从处理器进入内核后的入口，运行在它的idle线程的栈上*/
+void ap_main(void)
+{
+    uint8_t cpu_id = ap_booting;
+    tss_ap_init(cpu_id);
+    idt_load();
+    mem_ap_init();
+    fpu_cpu_init();
+    lapic_init();
+    lapic_write(LAPIC_TIMER_DIV, 0x3);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_TIMER_VEC);
+    lapic_write(LAPIC_TIMER_INIT, lapic_count_per_tick);
+    ap_online = true;
+
+    bkl_acquire();
+    intr_enable();
+    thread_ap_idle();
+}
+
+/*启动cpu_id号从处理器，等待它就绪，成功返回true*/
+static bool ap_boot(uint8_t cpu_id)
+{
+    struct task_struct* idle = thread_ap_idle_create(cpu_id);
+    if(idle == NULL) {
+        return false;
+    }
+    *(uint32_t*)(0xc0000000 + AP_TRAMPOLINE_PHY + (ap_stack - ap_trampoline)) = (uint32_t)idle + PG_SIZE;
+    ap_booting = cpu_id;
+    ap_online = false;
+
+    //INIT-SIPI-SIPI
+    uint8_t apic_id = cpu_apic_id[cpu_id];
+    lapic_send_ipi(apic_id, LAPIC_ICR_INIT_ASSERT);
+    mtime_sleep(10);
+    lapic_send_ipi(apic_id, LAPIC_ICR_INIT_DEASSERT);
+    mtime_sleep(10);
+    lapic_send_ipi(apic_id, LAPIC_ICR_STARTUP | (AP_TRAMPOLINE_PHY >> 12));
+    mtime_sleep(10);
+    lapic_send_ipi(apic_id, LAPIC_ICR_STARTUP | (AP_TRAMPOLINE_PHY >> 12));
+
+    uint32_t wait_ms = 0;
+    while(!ap_online && wait_ms < 1000) {
+        mtime_sleep(10);
+        wait_ms += 10;
+    }
+    return ap_online;
+}
+
+/*查找并启动从处理器，没有多处理器信息时保持单处理器运行*/
+void smp_init(void)
+{
+    put_str("smp_init start\n");
+    if(!mp_parse() || (*pde_ptr(LAPIC_BASE) & PG_P_1) == 0) {
+        put_str("smp_init: uniprocessor\n");
+        return;
+    }
+
+    //本地apic的寄存器不能被缓存
+    *pte_ptr(LAPIC_BASE) = LAPIC_BASE | PG_G | 0x10 | 0x8 | PG_RW_W | PG_P_1;   //PCD | PWT，与其他内核映射一样是全局页
+    asm volatile ("invlpg %0" : : "m"(*(char*)LAPIC_BASE) : "memory");
+
+    uint8_t idx;
+    for(idx = 0; idx < mp_cpu_cnt; idx++) {
+        apic2cpu[cpu_apic_id[idx]] = idx;
+    }
+    if((lapic_read(LAPIC_ID) >> 24) != cpu_apic_id[0]) {
+        put_str("smp_init: bsp apic id mismatch, uniprocessor\n");
+        return;
+    }
+
+    register_intr_entry(LAPIC_TIMER_VEC, lapic_timer_entry);
+    register_intr_entry(LAPIC_SPURIOUS_VEC, lapic_spurious_entry);
+    register_handler(LAPIC_TIMER_VEC, intr_lapic_timer_handler);
+    lapic_init();
+    lapic_timer_calibrate();
+    if(lapic_count_per_tick == 0) {
+        put_str("smp_init: lapic timer not running, uniprocessor\n");
+        return;
+    }
+
+    //只有一个cpu时也用本地定时器做高精度定时器的单次中断
+    register_intr_entry(LAPIC_HRTIMER_VEC, lapic_hrtimer_entry);
+    register_handler(LAPIC_HRTIMER_VEC, intr_lapic_hrtimer_handler);
+    enum intr_status old_status = intr_disable();
+    lapic_oneshot_ok = true;
+    hrtimer_expire();   //按已有的定时器设定第一次中断
+    intr_set_status(old_status);
+    if(mp_cpu_cnt < 2) {
+        put_str("smp_init: uniprocessor\n");
+        return;
+    }
+
+    //此刻0号cpu正在内核中运行，让它直接持有大内核锁
+    old_status = intr_disable();
+    bkl_locked = 1;
+    bkl_owner = 0;
+    smp_active = true;
+    intr_set_status(old_status);
+
+    memcpy((void*)(0xc0000000 + AP_TRAMPOLINE_PHY), ap_trampoline, ap_trampoline_end - ap_trampoline);
+    for(idx = 1; idx < mp_cpu_cnt; idx++) {
+        if(!ap_boot(idx)) {
+            put_str("smp_init: cpu "); put_int(idx); put_str(" no response\n");
+            break;
+        }
+        cpu_cnt++;
+    }
+    put_str("smp_init done, cpus: "); put_int(cpu_cnt); put_char('\n');
+}
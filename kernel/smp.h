@@ -0,0 +1,24 @@
+#ifndef __KERNEL_SMP_H
+#define __KERNEL_SMP_H
+#include "stdint.h"
+#include "global.h"
+
+#define MAX_CPUS 4   //最多支持的cpu个数
+
+extern uint8_t cpu_cnt;   //已启动的cpu个数，至少为1
+extern bool smp_active;   //从处理器启动流程是否已开始，开始后才真正使用大内核锁
+
+/*返回当前cpu的编号，0号为启动处理器*/
+uint8_t smp_cpu_id(void);
+/*当前线程获取大内核锁，可嵌套，需关中断调用*/
+void bkl_acquire(void);
+/*当前线程释放一层大内核锁，需关中断调用*/
+void bkl_release(void);
+/*0号cpu的本地定时器是否已校准、可用作单次定时*/
+bool lapic_oneshot_ready(void);
+/*让0号cpu的本地定时器在us微秒后中断一次，us为0时停止，需关中断调用*/
+void lapic_oneshot_arm(uint32_t us);
+/*查找并启动从处理器，没有多处理器信息时保持单处理器运行*/
+void smp_init(void);
+
+#endif
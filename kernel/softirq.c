@@ -0,0 +1,59 @@
+#include "softirq.h"
+#include "stdint.h"
+#include "global.h"
+#include "debug.h"
+#include "interrupt.h"
+#include "smp.h"
+
+#define SOFTIRQ_MAX_RESTART 10   //一次最多重新检查待处理软中断的轮数，剩下的留到下次中断返回
+
+static softirq_handler softirq_handlers[SOFTIRQ_CNT];
+/*待处理的软中断位图。8259A只向0号cpu发中断，持大内核锁修改*/
+static uint32_t softirq_pending;
+static bool softirq_active[MAX_CPUS];   //各cpu是否正在运行软中断，防止中断返回时嵌套进来
+
+/*注册第nr个软中断的处理函数，处理函数开着中断运行，不能阻塞*/
+void softirq_register(enum softirq_nr nr, softirq_handler handler)
+{
+    ASSERT(nr < SOFTIRQ_CNT);
+    softirq_handlers[nr] = handler;
+}
+
+/*在中断处理函数(上半部)中调用，标记第nr个软中断待处理，中断返回前运行*/
+void softirq_raise(enum softirq_nr nr)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    softirq_pending |= 1 << nr;
+}
+
+/*运行所有待处理的软中断，由intr_dispatch在返回前调用，需关中断调用，返回时仍关中断。
+  处理期间开中断，新来的中断只做上半部，标记的软中断在这里的下一轮处理*/
+void softirq_run(void)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    uint8_t cpu = smp_cpu_id();
+    if(softirq_pending == 0 || softirq_active[cpu]) {
+        return;
+    }
+    softirq_active[cpu] = true;
+    uint32_t restart = 0;
+    while(softirq_pending != 0 && restart++ < SOFTIRQ_MAX_RESTART) {
+        uint32_t pending = softirq_pending;
+        softirq_pending = 0;
+        intr_enable();
+        uint32_t nr;
+        for(nr = 0; nr < SOFTIRQ_CNT; nr++) {
+            if((pending & (1 << nr)) && softirq_handlers[nr] != NULL) {
+                softirq_handlers[nr]();
+            }
+        }
+        intr_disable();
+    }
+    softirq_active[cpu] = false;
+}
+
+/*本cpu是否正在运行软中断*/
+bool in_softirq(void)
+{
+    return softirq_active[smp_cpu_id()];
+}
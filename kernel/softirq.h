@@ -0,0 +1,25 @@
+#ifndef __KERNEL_SOFTIRQ_H
+#define __KERNEL_SOFTIRQ_H
+#include "stdint.h"
+#include "global.h"
+
+/*软中断号，编号小的先处理*/
+enum softirq_nr
+{
+    SOFTIRQ_KEYBOARD,   //键盘扫描码的转换
+    SOFTIRQ_IDE,   //硬盘请求的完成
+    SOFTIRQ_CNT
+};
+
+typedef void (*softirq_handler)(void);
+
+/*注册第nr个软中断的处理函数，处理函数开着中断运行，不能阻塞*/
+void softirq_register(enum softirq_nr nr, softirq_handler handler);
+/*在中断处理函数(上半部)中调用，标记第nr个软中断待处理，中断返回前运行*/
+void softirq_raise(enum softirq_nr nr);
+/*运行所有待处理的软中断，由intr_dispatch在返回前调用，需关中断调用，返回时仍关中断*/
+void softirq_run(void);
+/*本cpu是否正在运行软中断*/
+bool in_softirq(void);
+
+#endif
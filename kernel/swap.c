@@ -0,0 +1,336 @@
+#include "swap.h"
+#include "stdint.h"
+#include "global.h"
+#include "string.h"
+#include "debug.h"
+#include "memory.h"
+#include "interrupt.h"
+#include "thread.h"
+#include "sync.h"
+#include "list.h"
+#include "ide.h"
+#include "fs.h"
+#include "mmap.h"
+#include "smp.h"
+#include "print.h"
+#include "stdio-kernel.h"
+#include "counter.h"
+
+#define SWAP_SECS_PER_SLOT (PG_SIZE / SECTOR_SIZE)   //一个交换槽存一页
+#define SWAP_SLOTS_MAX 0x10000   //最多使用的交换槽数，即256MB
+#define SWAP_WRITE_MAX 16   //同时进行的换出写请求数
+#define SWAP_MAP_MAX 0xff   //交换槽引用计数的上限
+
+/*一次正在进行的换出写，写完之前换入直接从页副本复制*/
+struct swap_write
+{
+    uint32_t slot;
+    void* page;   //页内容的副本，占一个内核页
+    bool busy;
+};
+
+static struct partition* swap_part;   //交换区所在的分区，为NULL表示没有交换区
+static uint8_t* swap_map;   //各交换槽的引用计数，0表示空闲，换出写未完成时写请求也占一个引用
+static uint32_t swap_slot_cnt;
+static uint32_t swap_hint;   //下次从这里开始找空闲槽
+static struct swap_write swap_writes[SWAP_WRITE_MAX];
+static struct semaphore swap_write_sema;   //空闲的swap_writes项数
+
+/*时钟指针，指向上次停下的进程和它用户堆中的下一页*/
+static pid_t hand_pid;
+static uint32_t hand_vaddr;
+
+static uint32_t swap_out_counter, swap_in_counter;
+
+/*分配一个交换槽，引用计数置为2，一个给页表项，一个给换出写，没有空闲槽返回-1*/
+static int32_t swap_slot_alloc(void)
+{
+    enum intr_status old_status = intr_disable();
+    uint32_t cnt;
+    for(cnt = 0; cnt < swap_slot_cnt; cnt++) {
+        uint32_t slot = (swap_hint + cnt) % swap_slot_cnt;
+        if(swap_map[slot] == 0) {
+            swap_map[slot] = 2;
+            swap_hint = slot + 1;
+            intr_set_status(old_status);
+            return slot;
+        }
+    }
+    intr_set_status(old_status);
+    return -1;
+}
+
+/*交换槽slot多了一个页表项引用，fork复制交换项时调用*/
+void swap_dup(uint32_t slot)
+{
+    enum intr_status old_status = intr_disable();
+    ASSERT(slot < swap_slot_cnt && swap_map[slot] > 0 && swap_map[slot] < SWAP_MAP_MAX);
+    swap_map[slot]++;
+    intr_set_status(old_status);
+}
+
+/*放掉交换槽slot的一个引用，减为0时交换槽空闲*/
+void swap_free(uint32_t slot)
+{
+    enum intr_status old_status = intr_disable();
+    ASSERT(slot < swap_slot_cnt && swap_map[slot] > 0);
+    swap_map[slot]--;
+    intr_set_status(old_status);
+}
+
+/*换出写完成后由io线程调用，放掉写请求占的引用并释放页副本*/
+static void swap_write_done(struct bio* bio)
+{
+    struct swap_write* w = bio->private;
+    enum intr_status old_status = intr_disable();
+    w->busy = false;
+    intr_set_status(old_status);
+    swap_free(w->slot);
+    mfree_page(PF_KERNEL, w->page, 1);
+    bio_free(bio);
+    sema_up(&swap_write_sema);
+}
+
+/*页表项pte映射的页能否换出：只换出本进程独占的普通页，共享内存页、写时复制页和不复制给子进程的页都不动*/
+static bool swap_candidate(uint32_t pte)
+{
+    if(!(pte & PG_P_1) || (pte & (PG_COW | PG_SHARED | PG_PRIVATE))) {
+        return false;
+    }
+    return page_ref_cnt(pte & 0xfffff000) == 1;
+}
+
+/*进程p的用户堆能否扫描。别的cpu上正在运行的进程不动，换出后没法让那个cpu的tlb失效*/
+static bool swap_proc_ok(struct task_struct* p)
+{
+    if(p->group_leader != p || p->pgdir == NULL || p->heap_brk <= USER_HEAP_BASE) {
+        return false;
+    }
+    if(p->status == TASK_HANGING || p->status == TASK_DIED) {
+        return false;
+    }
+    return p->cpu == smp_cpu_id() || (p->status != TASK_RUNNING && p->thread_cnt == 0);
+}
+
+/*从时钟指针处扫描进程p的用户堆，访问位为1的页清掉访问位再给一次机会，访问位为0的页换出到交换槽slot，
+  页内容复制到page后释放页框。换出了一页返回true，扫到堆末尾返回false。需关中断调用*/
+static bool swap_scan(struct task_struct* p, void* page, uint32_t slot)
+{
+    bool is_cur = running_thread()->pgdir == p->pgdir;   //当前进程的页表项改动后要刷tlb
+    uint32_t pg_phy_addr = 0;
+    while(hand_vaddr < p->heap_brk && pg_phy_addr == 0) {
+        uint32_t pde = p->pgdir[hand_vaddr >> 22];
+        uint32_t pt_end = (hand_vaddr & 0xffc00000) + 0x400000;   //本页表管辖的末尾
+        if(pt_end > p->heap_brk) {
+            pt_end = p->heap_brk;
+        }
+        if(!(pde & PG_P_1) || (pde & PG_PS)) {   //大页没有页表，也不换出
+            hand_vaddr = pt_end;
+            continue;
+        }
+        uint32_t* pt = kmap_window(pde & 0xfffff000);
+        for(; hand_vaddr < pt_end; hand_vaddr += PG_SIZE) {
+            uint32_t* pte = &pt[(hand_vaddr >> 12) & 0x3ff];
+            if(!swap_candidate(*pte)) {
+                continue;
+            }
+            if(*pte & PG_A) {
+                *pte &= ~PG_A;
+            } else {
+                pg_phy_addr = *pte & 0xfffff000;
+                *pte = swap_pte(slot, *pte & PG_RW_W);
+            }
+            if(is_cur) {
+                asm volatile ("invlpg %0" : : "m"(*(uint8_t*)hand_vaddr) : "memory");
+            }
+            if(pg_phy_addr != 0) {
+                hand_vaddr += PG_SIZE;
+                break;
+            }
+        }
+        kunmap_window();
+    }
+    if(pg_phy_addr == 0) {
+        return false;
+    }
+    memcpy(page, kmap_window(pg_phy_addr), PG_SIZE);
+    kunmap_window();
+    pfree(pg_phy_addr);
+    return true;
+}
+
+/*按时钟算法在各进程的用户堆中换出一页到交换槽slot，页内容复制到page，换出了一页返回true。
+  从时钟指针处转两圈，第一圈清掉的访问位在第二圈还是0时才换出*/
+static bool swap_out_one(void* page, uint32_t slot)
+{
+    bool done = false;
+    enum intr_status old_status = read_lock(&thread_all_lock);
+    struct list_elem* head = thread_all_list.head.next;
+    struct list_elem* elem = head;
+    while(elem != &thread_all_list.tail) {
+        struct task_struct* p = elem2entry(struct task_struct, all_list_tag, elem);
+        if(p->pid == hand_pid) {
+            break;
+        }
+        elem = elem->next;
+    }
+    if(elem == &thread_all_list.tail) {   //时钟指针所在的进程已经退出
+        elem = head;
+        hand_vaddr = USER_HEAP_BASE;
+    }
+    uint32_t visits = list_len(&thread_all_list) * 2 + 1;
+    while(visits-- > 0 && elem != &thread_all_list.tail) {
+        struct task_struct* p = elem2entry(struct task_struct, all_list_tag, elem);
+        if(swap_proc_ok(p)) {
+            hand_pid = p->pid;
+            if(swap_scan(p, page, slot)) {
+                done = true;
+                break;
+            }
+        }
+        elem = elem->next == &thread_all_list.tail ? head : elem->next;
+        hand_vaddr = USER_HEAP_BASE;
+    }
+    read_unlock(&thread_all_lock, old_status);
+    return done;
+}
+
+/*换出最多pg_cnt个用户页，返回换出的页数。没有交换区、交换区满或找不到可换出的页时提前返回。
+  换出的页复制一份后异步写入交换区，不等写完*/
+uint32_t swap_reclaim(uint32_t pg_cnt)
+{
+    uint32_t done = 0;
+    while(done < pg_cnt && swap_part != NULL) {
+        int32_t slot = swap_slot_alloc();
+        if(slot == -1) {
+            break;
+        }
+        sema_down(&swap_write_sema);
+        void* page = get_kernel_pages(1);
+        struct bio* bio = bio_alloc();
+        enum intr_status old_status = intr_disable();
+        struct swap_write* w = swap_writes;
+        while(w->busy) {   //信号量保证有空闲项
+            w++;
+        }
+        w->busy = true;
+        intr_set_status(old_status);
+        w->slot = slot;
+        w->page = page;
+        if(page == NULL || bio == NULL || !swap_out_one(page, slot)) {
+            w->busy = false;
+            if(page != NULL) {
+                mfree_page(PF_KERNEL, page, 1);
+            }
+            if(bio != NULL) {
+                bio_free(bio);
+            }
+            sema_up(&swap_write_sema);
+            swap_free(slot);
+            swap_free(slot);
+            break;
+        }
+        bio_init(bio, swap_part->my_disk, swap_part->start_lba + slot * SWAP_SECS_PER_SLOT, page, SWAP_SECS_PER_SLOT, true);
+        bio->end_io = swap_write_done;
+        bio->private = w;
+        ide_submit(bio);
+        counter_inc(swap_out_counter);
+        done++;
+    }
+    return done;
+}
+
+/*处理换出到交换区的页引起的页错误，读回页内容重新映射并返回true，不是换出的页返回false。
+  读盘期间可能有同进程的别的线程先换入或释放了这页，映射前重新检查页表项*/
+bool swap_page_fault(uint32_t vaddr)
+{
+    if(running_thread()->pgdir == NULL || vaddr >= 0xc0000000) {
+        return false;
+    }
+    uint32_t* pde = pde_ptr(vaddr);
+    if(!(*pde & PG_P_1) || (*pde & PG_PS)) {   //大页不换出
+        return false;
+    }
+    uint32_t* pte = pte_ptr(vaddr);
+    uint32_t entry = *pte;
+    if(!pte_is_swap(entry)) {
+        return false;
+    }
+    uint32_t slot = pte_swap_slot(entry);
+    uint32_t pg_phy_addr = page_frame_alloc(PF_USER);
+    void* buf = get_kernel_pages(1);
+    if(pg_phy_addr == 0 || buf == NULL) {
+        if(pg_phy_addr != 0) {
+            pfree(pg_phy_addr);
+        }
+        if(buf != NULL) {
+            mfree_page(PF_KERNEL, buf, 1);
+        }
+        return false;
+    }
+
+    //换出写还没完成时页副本还在，不必读盘
+    enum intr_status old_status = intr_disable();
+    uint32_t idx;
+    for(idx = 0; idx < SWAP_WRITE_MAX; idx++) {
+        if(swap_writes[idx].busy && swap_writes[idx].slot == slot) {
+            memcpy(buf, swap_writes[idx].page, PG_SIZE);
+            break;
+        }
+    }
+    intr_set_status(old_status);
+    if(idx == SWAP_WRITE_MAX) {
+        ide_read(swap_part->my_disk, swap_part->start_lba + slot * SWAP_SECS_PER_SLOT, buf, SWAP_SECS_PER_SLOT);
+    }
+
+    old_status = intr_disable();
+    if(*pde & PG_P_1 && *pte == entry) {
+        memcpy(kmap_window(pg_phy_addr), buf, PG_SIZE);
+        kunmap_window();
+        *pte = pg_phy_addr | PG_US_U | (entry & PG_RW_W) | PG_P_1;
+        asm volatile ("invlpg %0" : : "m"(*(uint8_t*)(vaddr & 0xfffff000)) : "memory");
+        swap_free(slot);
+        counter_inc(swap_in_counter);
+    } else {
+        pfree(pg_phy_addr);
+    }
+    intr_set_status(old_status);
+    mfree_page(PF_KERNEL, buf, 1);
+    return true;
+}
+
+/*list_traversal的回调，找名为arg的分区*/
+static bool swap_part_match(struct list_elem* pelem, int arg)
+{
+    struct partition* part = elem2entry(struct partition, part_tag, pelem);
+    return !strcmp(part->name, (char*)arg);
+}
+
+/*启用SWAP_PART_NAME分区作为交换区，分区不存在时不使用交换区。交换区不跨开机保存内容，不需要格式化*/
+void swap_init(void)
+{
+    put_str("swap_init start\n");
+    sema_init(&swap_write_sema, SWAP_WRITE_MAX);
+    hand_vaddr = USER_HEAP_BASE;
+    swap_out_counter = counter_register("swap_out");
+    swap_in_counter = counter_register("swap_in");
+    struct list_elem* elem = list_traversal(&partition_list, swap_part_match, (int)SWAP_PART_NAME);
+    if(elem == NULL) {
+        printk("swap partition %s not found, swap disabled\n", SWAP_PART_NAME);
+        return;
+    }
+    struct partition* part = elem2entry(struct partition, part_tag, elem);
+    uint32_t slot_cnt = part->sec_cnt / SWAP_SECS_PER_SLOT;
+    if(slot_cnt > SWAP_SLOTS_MAX) {
+        slot_cnt = SWAP_SLOTS_MAX;
+    }
+    swap_map = slot_cnt > 0 ? get_kernel_pages(DIV_ROUND_UP(slot_cnt, PG_SIZE)) : NULL;
+    if(swap_map == NULL) {
+        printk("swap on %s failed, swap disabled\n", part->name);
+        return;
+    }
+    swap_slot_cnt = slot_cnt;
+    swap_part = part;
+    printk("swap on %s, %d pages\n", part->name, slot_cnt);
+    put_str("swap_init done\n");
+}
@@ -0,0 +1,28 @@
+#ifndef __KERNEL_SWAP_H
+#define __KERNEL_SWAP_H
+#include "stdint.h"
+#include "global.h"
+#include "memory.h"
+
+#define SWAP_PART_NAME "sdb2"   //用作交换区的分区，开机时不格式化成文件系统
+#define SWAP_RECLAIM_BATCH 8   //用户内存池分配不到页框时一次换出的页数
+
+/*换出的页在页表项中记为交换项：P位和US位为0，PG_COW位为1，高20位是交换槽号，保留原来的RW位。
+  普通页解除映射后只清P位，US位仍为1，不会被当成交换项*/
+#define SWAP_PTE_FLAG PG_COW
+#define swap_pte(slot, rw) (((slot) << 12) | SWAP_PTE_FLAG | (rw))
+#define pte_is_swap(pte) (((pte) & (PG_P_1 | PG_US_U | SWAP_PTE_FLAG)) == SWAP_PTE_FLAG)
+#define pte_swap_slot(pte) ((pte) >> 12)
+
+/*交换槽slot多了一个页表项引用，fork复制交换项时调用*/
+void swap_dup(uint32_t slot);
+/*放掉交换槽slot的一个引用，减为0时交换槽空闲*/
+void swap_free(uint32_t slot);
+/*换出最多pg_cnt个用户页，返回换出的页数*/
+uint32_t swap_reclaim(uint32_t pg_cnt);
+/*处理换出到交换区的页引起的页错误，读回页内容重新映射并返回true，不是换出的页返回false*/
+bool swap_page_fault(uint32_t vaddr);
+/*启用SWAP_PART_NAME分区作为交换区*/
+void swap_init(void);
+
+#endif
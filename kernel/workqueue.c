@@ -0,0 +1,225 @@
+#include "workqueue.h"
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "debug.h"
+#include "interrupt.h"
+#include "thread.h"
+#include "stdio.h"
+#include "print.h"
+#include "hrtimer.h"
+
+/*以下状态都在关中断、持大内核锁时修改*/
+static struct list work_list;   //待处理的工作项，先进先出
+static struct list idle_workers;   //等工作的空闲工作线程，借用general_tag串起来
+static struct list flush_waiters;   //flush_work和flush_workqueue中等待的线程，每完成一个工作项全部唤醒重查
+static uint32_t worker_cnt;   //已创建的工作线程数，含还没开始运行的
+static uint32_t starting_cnt;   //已创建、还没开始运行的工作线程数
+static uint32_t busy_cnt;   //正在执行工作项的工作线程数
+static uint32_t running_cnt;   //正在执行工作项且没有阻塞的工作线程数
+static struct task_struct* manager;   //负责创建工作线程的管理线程
+static bool manager_idle;   //管理线程是否阻塞着等通知
+
+/*有待处理的工作，但没有空闲的、刚创建的或正在运行的工作线程能接手，说明已有的都阻塞在工作项中*/
+static bool wq_need_worker(void)
+{
+    return !list_empty(&work_list) && list_empty(&idle_workers) && starting_cnt == 0 && \
+           running_cnt == 0 && worker_cnt < WQ_MAX_WORKERS;
+}
+
+/*需要更多工作线程时唤醒管理线程*/
+static void wq_maybe_grow(void)
+{
+    if(manager_idle && wq_need_worker()) {
+        manager_idle = false;
+        thread_unblock(manager);
+    }
+}
+
+/*正在执行工作项的工作线程要阻塞时由thread_block关中断调用*/
+void wq_worker_sleeping(void)
+{
+    running_cnt--;
+    wq_maybe_grow();
+}
+
+/*正在执行工作项的工作线程被唤醒时由thread_unblock关中断调用*/
+void wq_worker_waking(void)
+{
+    running_cnt++;
+}
+
+/*把已标记为排队的work挂上待处理队列，有空闲的工作线程就唤醒一个，需关中断调用*/
+static void wq_insert(struct work_struct* work)
+{
+    list_append(&work_list, &work->tag);
+    if(!list_empty(&idle_workers)) {
+        thread_unblock(elem2entry(struct task_struct, general_tag, list_pop(&idle_workers)));
+    } else {
+        wq_maybe_grow();
+    }
+}
+
+/*唤醒所有等flush的线程，由它们重新检查条件，需关中断调用*/
+static void wq_wake_flushers(void)
+{
+    while(!list_empty(&flush_waiters)) {
+        thread_unblock(elem2entry(struct task_struct, general_tag, list_pop(&flush_waiters)));
+    }
+}
+
+/*工作线程：逐个取出工作项开着中断执行，没有工作时挂上空闲队列阻塞*/
+static void wq_worker(void* arg UNUSED)
+{
+    struct task_struct* cur = running_thread();
+    intr_disable();
+    starting_cnt--;
+    while(1) {
+        while(list_empty(&work_list)) {
+            list_append(&idle_workers, &cur->general_tag);
+            thread_block(TASK_BLOCKED);
+        }
+        struct work_struct* work = elem2entry(struct work_struct, tag, list_pop(&work_list));
+        work->pending = false;
+        work->running++;
+        busy_cnt++;
+        running_cnt++;
+        cur->wq_busy = true;
+        intr_enable();
+
+        work->func(work);   //执行完之前work不能被释放，调用者释放前先flush_work
+
+        intr_disable();
+        cur->wq_busy = false;
+        running_cnt--;
+        busy_cnt--;
+        work->running--;
+        wq_wake_flushers();
+    }
+}
+
+/*管理线程：已有的工作线程都阻塞在工作项中而还有待处理的工作时，再创建一个工作线程。
+  创建线程要分配内存，可能阻塞，所以不能在thread_block中直接做*/
+static void wq_manager(void* arg UNUSED)
+{
+    while(1) {
+        enum intr_status old_status = intr_disable();
+        while(!wq_need_worker()) {
+            manager_idle = true;
+            thread_block(TASK_BLOCKED);
+        }
+        uint32_t id = worker_cnt++;
+        starting_cnt++;
+        intr_set_status(old_status);
+
+        char name[16];
+        sprintf(name, "kworker%d", id);
+        thread_start(name, 31, wq_worker, NULL);
+    }
+}
+
+/*初始化工作项，之后才能排队*/
+void work_init(struct work_struct* work, work_func func)
+{
+    work->func = func;
+    work->pending = false;
+    work->running = 0;
+}
+
+/*初始化延迟工作项*/
+void delayed_work_init(struct delayed_work* dwork, work_func func)
+{
+    work_init(&dwork->work, func);
+    dwork->timer.pending = false;
+}
+
+/*把work排入待处理队列，已在排队时返回false。可在中断处理函数中调用*/
+bool queue_work(struct work_struct* work)
+{
+    enum intr_status old_status = intr_disable();
+    bool queued = !work->pending;
+    if(queued) {
+        work->pending = true;
+        wq_insert(work);
+    }
+    intr_set_status(old_status);
+    return queued;
+}
+
+/*延迟工作项的定时到期，在0号cpu上关中断调用*/
+static void delayed_work_timer(struct hrtimer* timer)
+{
+    struct delayed_work* dwork = elem2entry(struct delayed_work, timer, timer);
+    wq_insert(&dwork->work);
+}
+
+/*ms毫秒后把dwork排入待处理队列，ms为0时立即排队，已在排队时返回false。可在中断处理函数中调用*/
+bool queue_delayed_work(struct delayed_work* dwork, uint32_t ms)
+{
+    enum intr_status old_status = intr_disable();
+    bool queued = !dwork->work.pending;
+    if(queued) {
+        dwork->work.pending = true;
+        if(ms == 0) {
+            wq_insert(&dwork->work);
+        } else {
+            hrtimer_start(&dwork->timer, ms > 0xffffffff / 1000 ? 0xffffffff : ms * 1000, delayed_work_timer);
+        }
+    }
+    intr_set_status(old_status);
+    return queued;
+}
+
+/*取消还没到期的延迟工作项，取消返回true，已排入队列或正在执行时返回false*/
+bool cancel_delayed_work(struct delayed_work* dwork)
+{
+    enum intr_status old_status = intr_disable();
+    bool canceled = hrtimer_cancel(&dwork->timer);
+    if(canceled) {
+        dwork->work.pending = false;
+        wq_wake_flushers();
+    }
+    intr_set_status(old_status);
+    return canceled;
+}
+
+/*等work不再排队也不在执行，延迟工作项还要等定时到期后执行完。不能在work自己的func中调用*/
+void flush_work(struct work_struct* work)
+{
+    enum intr_status old_status = intr_disable();
+    while(work->pending || work->running > 0) {
+        list_append(&flush_waiters, &running_thread()->general_tag);
+        thread_block(TASK_BLOCKED);
+    }
+    intr_set_status(old_status);
+}
+
+/*等待处理队列排空、所有正在执行的工作项完成，还没到期的延迟工作项不等。不能在工作项中调用*/
+void flush_workqueue(void)
+{
+    enum intr_status old_status = intr_disable();
+    while(!list_empty(&work_list) || busy_cnt > 0) {
+        list_append(&flush_waiters, &running_thread()->general_tag);
+        thread_block(TASK_BLOCKED);
+    }
+    intr_set_status(old_status);
+}
+
+/*创建WQ_MIN_WORKERS个工作线程和管理线程*/
+void workqueue_init(void)
+{
+    put_str("workqueue_init start\n");
+    list_init(&work_list);
+    list_init(&idle_workers);
+    list_init(&flush_waiters);
+    uint32_t idx;
+    for(idx = 0; idx < WQ_MIN_WORKERS; idx++) {
+        char name[16];
+        sprintf(name, "kworker%d", idx);
+        worker_cnt++;
+        starting_cnt++;
+        thread_start(name, 31, wq_worker, NULL);
+    }
+    manager = thread_start("kworker_mgr", 31, wq_manager, NULL);
+    put_str("workqueue_init done\n");
+}
@@ -0,0 +1,52 @@
+#ifndef __KERNEL_WORKQUEUE_H
+#define __KERNEL_WORKQUEUE_H
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "hrtimer.h"
+
+#define WQ_MIN_WORKERS 2   //启动时创建的工作线程数
+#define WQ_MAX_WORKERS 8   //工作项阻塞时工作线程池最多增长到的线程数
+
+struct work_struct;
+typedef void (*work_func)(struct work_struct* work);
+
+/*工作项，由工作线程在线程上下文中调用func，func可以阻塞。调用者通常把它嵌在自己的结构中，用elem2entry取回，
+  排队和执行期间不能释放*/
+struct work_struct
+{
+    work_func func;
+    struct list_elem tag;   //在待处理队列中的标记
+    bool pending;   //已排队(含延迟工作项的定时还没到)而还没开始执行
+    uint8_t running;   //正在执行它的工作线程数，执行中再次排队时可能被另一个工作线程同时执行
+};
+
+/*延迟工作项，定时到期后才排入待处理队列*/
+struct delayed_work
+{
+    struct work_struct work;
+    struct hrtimer timer;
+};
+
+/*初始化工作项，之后才能排队*/
+void work_init(struct work_struct* work, work_func func);
+/*初始化延迟工作项*/
+void delayed_work_init(struct delayed_work* dwork, work_func func);
+/*把work排入待处理队列，已在排队时返回false。可在中断处理函数中调用*/
+bool queue_work(struct work_struct* work);
+/*ms毫秒后把dwork排入待处理队列，ms为0时立即排队，已在排队时返回false。可在中断处理函数中调用*/
+bool queue_delayed_work(struct delayed_work* dwork, uint32_t ms);
+/*取消还没到期的延迟工作项，取消返回true，已排入队列或正在执行时返回false*/
+bool cancel_delayed_work(struct delayed_work* dwork);
+/*等work不再排队也不在执行，不能在work自己的func中调用*/
+void flush_work(struct work_struct* work);
+/*等待处理队列排空、所有正在执行的工作项完成，不能在工作项中调用*/
+void flush_workqueue(void);
+/*创建工作线程池和管理线程*/
+void workqueue_init(void);
+/*正在执行工作项的工作线程要阻塞时由thread_block关中断调用*/
+void wq_worker_sleeping(void);
+/*正在执行工作项的工作线程被唤醒时由thread_unblock关中断调用*/
+void wq_worker_waking(void);
+
+#endif
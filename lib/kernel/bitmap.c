@@ -5,10 +5,92 @@
 #include "interrupt.h"
 #include "debug.h"
 
+/*返回val中最低的1所在的位，val不能为0*/
+static inline uint32_t bit_first_set(uint32_t val)
+{
+    uint32_t idx;
+    asm volatile ("bsfl %1, %0" : "=r"(idx) : "rm"(val));
+    return idx;
+}
+
+/*位图按32位字计算的长度，最后一个字可能不完整*/
+static uint32_t bitmap_word_cnt(struct bitmap* btmp)
+{
+    return DIV_ROUND_UP(btmp->btmp_bytes_len, 4);
+}
+
+/*读取位图的第word_idx个32位字，超出btmp_bytes_len的字节视为已占用*/
+static uint32_t bitmap_word(struct bitmap* btmp, uint32_t word_idx)
+{
+    uint32_t byte_idx = word_idx * 4;
+    if(byte_idx + 4 <= btmp->btmp_bytes_len) {
+        return *(uint32_t*)(btmp->bits + byte_idx);
+    }
+
+    //不完整的最后一个字逐字节拼出，缺的字节填1
+    uint32_t word = BITMAP_WORD_FULL, byte_off = 0;
+    while(byte_idx + byte_off < btmp->btmp_bytes_len) {
+        word &= ~(0xff << (byte_off * 8));
+        word |= (uint32_t)btmp->bits[byte_idx + byte_off] << (byte_off * 8);
+        byte_off++;
+    }
+    return word;
+}
+
+/*根据第word_idx个字是否已满更新摘要中对应的位*/
+static void bitmap_summary_update(struct bitmap* btmp, uint32_t word_idx)
+{
+    uint32_t mask = 1U << (word_idx % 32);
+    if(bitmap_word(btmp, word_idx) == BITMAP_WORD_FULL) {
+        btmp->summary[word_idx / 32] |= mask;
+    } else {
+        btmp->summary[word_idx / 32] &= ~mask;
+    }
+}
+
+/*从第word_idx个字起找第一个未满的字，成功返回其下标，找不到返回字数*/
+static uint32_t bitmap_next_free_word(struct bitmap* btmp, uint32_t word_idx)
+{
+    uint32_t word_cnt = bitmap_word_cnt(btmp);
+    if(btmp->summary == NULL) {
+        while(word_idx < word_cnt && bitmap_word(btmp, word_idx) == BITMAP_WORD_FULL) {
+            word_idx++;
+        }
+        return word_idx;
+    }
+
+    //有摘要时一次跳过32个已满的字
+    while(word_idx < word_cnt) {
+        uint32_t sum = btmp->summary[word_idx / 32] | ((1U << (word_idx % 32)) - 1);
+        if(sum != BITMAP_WORD_FULL) {
+            word_idx = (word_idx & ~31) + bit_first_set(~sum);
+            return word_idx < word_cnt ? word_idx : word_cnt;
+        }
+        word_idx = (word_idx & ~31) + 32;
+    }
+    return word_cnt;
+}
+
 /*将位图btmp初始化*/
 void bitmap_init(struct bitmap* btmp)
 {
     memset(btmp->bits, 0, btmp->btmp_bytes_len);
+    if(btmp->summary != NULL) {
+        memset(btmp->summary, 0, BITMAP_SUMMARY_BYTES(btmp->btmp_bytes_len));
+        //不完整的最后一个字可能一开始就是满的
+        bitmap_summary_update(btmp, bitmap_word_cnt(btmp) - 1);
+    }
+}
+
+/*为位图挂上摘要summary，并按当前位图内容重建摘要。位图内容被整体改写（如从硬盘读入）后也要调用*/
+void bitmap_summary_init(struct bitmap* btmp, uint32_t* summary)
+{
+    btmp->summary = summary;
+    memset(summary, 0, BITMAP_SUMMARY_BYTES(btmp->btmp_bytes_len));
+    uint32_t word_idx, word_cnt = bitmap_word_cnt(btmp);
+    for(word_idx = 0; word_idx < word_cnt; word_idx++) {
+        bitmap_summary_update(btmp, word_idx);
+    }
 }
 
 /*判断bit_idx位是否为1，若为1，则返回true，否则返回false*/
@@ -22,46 +104,52 @@ bool bitmap_scan_test(struct bitmap* btmp, uint32_t bit_idx)
 /*在位图中申请连续cnt个位，成功，则返回其起始下标，失败，返回-1*/
 int bitmap_scan(struct bitmap* btmp, uint32_t cnt)
 {
-    uint32_t idx_byte = 0;   //用于记录空闲位所在的字节
-    while(( 0xff == btmp->bits[idx_byte]) && (idx_byte < btmp->btmp_bytes_len)) {
-        idx_byte++;
-    }
-    
-    ASSERT(idx_byte < btmp->btmp_bytes_len);
-    if(idx_byte == btmp->btmp_bytes_len) {
+    uint32_t word_cnt = bitmap_word_cnt(btmp);
+    uint32_t word_idx = bitmap_next_free_word(btmp, 0);   //第一个有空闲位的字
+    if(word_idx == word_cnt || cnt == 0) {
         return -1;
     }
 
-    //若位图数组范围内的某字节内找到了空闲位，在该字节内逐位对比，返回空闲位的索引
-    int idx_bit = 0;
-    //和btmp->bits[inx_byte]这个字节逐位对比
-    while((uint8_t)(BITMAP_MASK << idx_bit) & btmp->bits[idx_byte]) {
-        idx_bit++;
-    }
-
-    int bit_idx_start = idx_byte * 8 + idx_bit;   //空闲位在位图内的下标
+    //一个空闲位时直接用bsf在字内找第一个0
     if(cnt == 1) {
-        return bit_idx_start;
+        return word_idx * 32 + bit_first_set(~bitmap_word(btmp, word_idx));
     }
 
-    uint32_t bit_left = (btmp->btmp_bytes_len * 8 - bit_idx_start);   //记录还有多少位可用
-    uint32_t next_bit = bit_idx_start + 1;
-    uint32_t count = 1;   //用于记录找到空闲位的个数
-
-    bit_idx_start = -1;   //置为-1，若找不到连续的位就直接返回
-    while(bit_left-- > 0) {
-        if(!(bitmap_scan_test(btmp, next_bit))) {   //若next_bit为0
-            count++;
-        } else {
-            count = 0;
+    //连续多个空闲位时按字统计0的游程长度，全0的字一次累加32位
+    uint32_t run_start = 0, run_len = 0;
+    while(word_idx < word_cnt) {
+        uint32_t word = bitmap_word(btmp, word_idx);
+        if(word == 0) {
+            if(run_len == 0) {
+                run_start = word_idx * 32;
+            }
+            run_len += 32;
+        } else if(word == BITMAP_WORD_FULL) {
+            run_len = 0;
+            word_idx = bitmap_next_free_word(btmp, word_idx + 1);   //跳过已满的字
+            continue;
+        } else {   //部分占用的字逐位统计
+            uint32_t bit_odd = 0;
+            while(bit_odd < 32) {
+                if(word & (1U << bit_odd)) {
+                    run_len = 0;
+                } else {
+                    if(run_len == 0) {
+                        run_start = word_idx * 32 + bit_odd;
+                    }
+                    if(++run_len == cnt) {
+                        return run_start;
+                    }
+                }
+                bit_odd++;
+            }
         }
-        if(count == cnt) {
-            bit_idx_start = next_bit - cnt + 1;
-            break;
+        if(run_len >= cnt) {
+            return run_start;
         }
-        next_bit++;
+        word_idx++;
     }
-    return bit_idx_start;
+    return -1;
 }
 
 /*将位图btmp的bit_idx位置为value*/
@@ -78,4 +166,22 @@ void bitmap_set(struct bitmap* btmp, uint32_t bit_idx, int8_t value)
     } else {
         btmp->bits[byte_idx] &= ~(BITMAP_MASK << bit_odd);
     }
+
+    if(btmp->summary != NULL) {
+        bitmap_summary_update(btmp, bit_idx / 32);
+    }
+}
+
+/*统计位图中为0的位数，即空闲的个数，超出btmp_bytes_len的部分不计*/
+uint32_t bitmap_count_zero(struct bitmap* btmp)
+{
+    uint32_t cnt = 0, word_idx;
+    for(word_idx = 0; word_idx < bitmap_word_cnt(btmp); word_idx++) {
+        uint32_t word = ~bitmap_word(btmp, word_idx);
+        while(word != 0) {
+            word &= word - 1;   //每次去掉最低的一个1
+            cnt++;
+        }
+    }
+    return cnt;
 }
@@ -3,16 +3,25 @@
 #include "global.h"
 
 #define BITMAP_MASK 1
+#define BITMAP_WORD_FULL 0xffffffff   //32位字中的位全部被占用
+
+/*位图btmp_bytes_len字节对应的一级摘要所需的字节数，摘要中一位表示位图的一个32位字*/
+#define BITMAP_SUMMARY_BYTES(btmp_bytes_len) (DIV_ROUND_UP(DIV_ROUND_UP(btmp_bytes_len, 4), 32) * 4)
 
 struct bitmap
 {
     uint32_t btmp_bytes_len;
     uint8_t* bits;   //在遍历位图时，整体上以字节为单位，细节上是以位为单位。所以位图的指针必须是单字节
+    uint32_t* summary;   //可选的一级摘要，第i位为1表示bits的第i个32位字已满，为NULL时不使用摘要
 };
 
 void bitmap_init(struct bitmap* btmp);
+/*为位图挂上摘要summary，并按当前位图内容重建摘要*/
+void bitmap_summary_init(struct bitmap* btmp, uint32_t* summary);
 bool bitmap_scan_test(struct bitmap* btmp, uint32_t bit_idx);
 int bitmap_scan(struct bitmap* btmp, uint32_t cnt);
 void bitmap_set(struct bitmap* btmp, uint32_t bit_idx, int8_t value);
+/*统计位图中为0的位数，即空闲的个数*/
+uint32_t bitmap_count_zero(struct bitmap* btmp);
 
-#endif
\ No newline at end of file
+#endif
@@ -9,6 +9,14 @@ void list_init(struct list* list)
     list->head.next = &list->tail;
     list->tail.prev = &list->head;
     list->tail.next = NULL;
+    list->head.owner = list->tail.owner = list;
+}
+
+/*初始化不在任何链表中的节点elem*/
+void list_elem_init(struct list_elem* elem)
+{
+    elem->prev = elem->next = NULL;
+    elem->owner = NULL;
 }
 
 /*把链表元素elem插入在元素before之前*/
@@ -20,6 +28,7 @@ void list_insert_before(struct list_elem* before, struct list_elem* elem)
     elem->prev = before->prev;
     elem->next = before;
     before->prev = elem;
+    elem->owner = before->owner;
 
     intr_set_status(old_status);
 }
@@ -36,6 +45,23 @@ void list_append(struct list* plist, struct list_elem* elem)
     list_insert_before(&plist->tail, elem);   //在队尾的前面插入
 }
 
+/*追加elem到队尾，先填好elem的指针再接入，不加锁顺着next遍历的读者不会看到半初始化的节点。
+  写者之间仍要互斥，摘下用list_remove，它保留被摘节点的next，站在上面的读者还能走下去*/
+void list_append_rcu(struct list* plist, struct list_elem* elem)
+{
+    enum intr_status old_status = intr_disable();
+
+    struct list_elem* before = &plist->tail;
+    elem->prev = before->prev;
+    elem->next = before;
+    elem->owner = plist;
+    asm volatile ("" : : : "memory");   //x86的写不会重排，只需挡住编译器
+    before->prev->next = elem;
+    before->prev = elem;
+
+    intr_set_status(old_status);
+}
+
 /*使元素pelem脱离链表*/
 void list_remove(struct list_elem* pelem)
 {
@@ -43,6 +69,7 @@ void list_remove(struct list_elem* pelem)
 
     pelem->prev->next = pelem->next;
     pelem->next->prev = pelem->prev;
+    pelem->owner = NULL;
 
     intr_set_status(old_status);
 }
@@ -55,17 +82,10 @@ struct list_elem* list_pop(struct list* plist)
     return elem;
 }
 
-/*从链表中查找元素obj_elem，成功返回true，失败返回false*/
+/*判断元素obj_elem是否在链表plist中，是返回true，否则返回false。节点记录了所在的链表，不用遍历*/
 bool elem_find(struct list* plist, struct list_elem* obj_elem)
 {
-    struct list_elem* elem = plist->head.next;
-    while(elem != &plist->tail) {
-        if(elem == obj_elem) {
-            return true;
-        }
-        elem = elem->next;
-    }
-    return false;
+    return obj_elem->owner == plist;
 }
 
 /*把列表plist中的每个元素elem和arg传给回调函数func，arg给func用来判断elem是否符合条件*/
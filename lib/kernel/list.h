@@ -6,11 +6,14 @@
 #define elem2entry(struct_type, struct_member_name, elem_ptr) \
             (struct_type*)((int)elem_ptr - offset(struct_type, struct_member_name))
 
+struct list;
+
 /******* 定义链表节点成员结构 *******/
 struct list_elem
 {
     struct list_elem* prev;   //前驱节点
     struct list_elem* next;   //后继节点
+    struct list* owner;   //节点所在的链表，不在任何链表中时为NULL，判断是否在某链表中只需比较它。必须是最后一个成员
 };
 
 /*链表结构，用来实现队列*/
@@ -24,10 +27,14 @@ struct list
 typedef bool (function)(struct list_elem*, int arg);
 
 void list_init(struct list* list);
+/*初始化不在任何链表中的节点elem*/
+void list_elem_init(struct list_elem* elem);
 void list_insert_before(struct list_elem* before, struct list_elem* elem);
 void list_push(struct list* plist, struct list_elem* elem);
 void list_iterate(struct list* plist);
 void list_append(struct list* plist, struct list_elem* elem);
+/*追加elem到队尾，供不加锁遍历的读者安全看到*/
+void list_append_rcu(struct list* plist, struct list_elem* elem);
 void list_remove(struct list_elem* pelem);
 struct list_elem* list_pop(struct list* plist);
 bool list_empty(struct list* list);
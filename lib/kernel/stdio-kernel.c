@@ -1,18 +1,19 @@
 #include "stdio-kernel.h"
 #include "stdio.h"
 #include "print.h"
-#include "console.h"
+#include "klog.h"
 #include "global.h"
 
 #define va_start(args, first_fix) args = (va_list)&first_fix
 #define va_end(args) args = NULL
 
+/*格式化输出到内核日志，由klogd输出到控制台，不会因为控制台被占用而阻塞*/
 void printk(const char* format, ...)
 {
     va_list args;
     va_start(args, format);
     char buf[1024] = {0};
-    vsprintf(buf, format, args);
+    uint32_t len = vsprintf(buf, format, args);
     va_end(args);
-    console_put_str(buf);
+    klog_write(buf, len);
 }
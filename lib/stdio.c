@@ -4,6 +4,7 @@
 #include "syscall.h"
 #include "string.h"
 #include "interrupt.h"
+#include "stream.h"
 
 #define va_start(ap, v) ap = (va_list)&v   //把ap指向第一个固定参数v，二级指针&v强制转换为一级指针再赋值给ap
 #define va_arg(ap, t) *((t*)(ap += 4))   //ap指向下一个参数并返回其值
@@ -79,13 +80,24 @@ uint32_t sprintf(char* buf, const char* format, ...)
     return retval;
 }
 
-/*格式化输出字符串format*/
+/*格式化输出字符串format，经stdout的缓冲区写出，tty上遇到换行才进内核*/
 uint32_t printf(const char* format, ...)
 {
     va_list args;
     va_start(args, format);   //使args指向format
     char buf[1024] = {0};   //用于存储拼接后的字符串
-    vsprintf(buf, format, args);
+    uint32_t len = vsprintf(buf, format, args);
     va_end(args);
-    return write(1, buf, strlen(buf));
+    return fwrite(buf, 1, len, stdout);
+}
+
+/*格式化字符串format写入流fp*/
+uint32_t fprintf(FILE* fp, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    char buf[1024] = {0};
+    uint32_t len = vsprintf(buf, format, args);
+    va_end(args);
+    return fwrite(buf, 1, len, fp);
 }
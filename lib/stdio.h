@@ -4,10 +4,14 @@
 
 typedef char* va_list;
 
+struct stream;
+
 uint32_t vsprintf(char* str, const char* format, va_list ap);
 /*格式化字符串format输出到buf中*/
 uint32_t sprintf(char* buf, const char* format, ...);
-/*格式化输出字符串format*/
+/*格式化输出字符串format，经stdout的缓冲区写出*/
 uint32_t printf(const char* format, ...);
+/*格式化字符串format写入流fp*/
+uint32_t fprintf(struct stream* fp, const char* format, ...);
 
 #endif
\ No newline at end of file
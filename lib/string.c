@@ -3,33 +3,87 @@
 #include "debug.h"
 #include "stdint.h"
 
-/*将dst_起始的size个字节置为value*/
+#define WORD_ONES 0x01010101
+#define WORD_HIGHS 0x80808080
+#define WORD_HAS_ZERO(w) (((w) - WORD_ONES) & ~(w) & WORD_HIGHS)   //整字w中有为0的字节时非0
+
+/*将dst_起始的size个字节置为value。先逐字节写到4字节对齐，中间用rep stosl每次写4字节，剩下不足4字节的再逐字节写*/
 void memset(void* dst_, uint8_t value, uint32_t size)
 {
     ASSERT(dst_ != NULL);
     uint8_t* dst = (uint8_t*)dst_;
+    while(size > 0 && ((uint32_t)dst & 3)) {
+        *dst++ = value;
+        size--;
+    }
+    uint32_t word = value * WORD_ONES;   //value铺满4个字节
+    uint32_t cnt = size / 4;
+    asm volatile ("cld; rep stosl" : "+D"(dst), "+c"(cnt) : "a"(word) : "memory");
+    size %= 4;
     while(size-- > 0) {
         *dst++ = value;
     }
 }
 
-/*将src_起始的size个字节复制到dst_*/
+/*将src_起始的size个字节复制到dst_，两者不能重叠(dst_在src_之前时可以，memmove利用了这一点)。
+  先逐字节复制到dst对齐4字节，中间用rep movsl每次复制4字节，剩下的再逐字节复制*/
 void memcpy(void* dst_, const void* src_, uint32_t size)
 {
     ASSERT(dst_ != NULL && src_ != NULL);
     uint8_t* dst = dst_;
     const uint8_t* src = src_;
+    while(size > 0 && ((uint32_t)dst & 3)) {
+        *dst++ = *src++;
+        size--;
+    }
+    uint32_t cnt = size / 4;
+    asm volatile ("cld; rep movsl" : "+D"(dst), "+S"(src), "+c"(cnt) : : "memory");
+    size %= 4;
     while(size-- > 0) {
         *dst++ = *src++;
     }
 }
 
-/*连续比较以地址a_和地址b_开头的size个字节*/
+/*将src_起始的size个字节复制到dst_，两者可以重叠。dst_在src_之后且重叠时从尾部往前复制*/
+void memmove(void* dst_, const void* src_, uint32_t size)
+{
+    ASSERT(dst_ != NULL && src_ != NULL);
+    if((uint32_t)dst_ <= (uint32_t)src_ || (uint32_t)dst_ >= (uint32_t)src_ + size) {
+        memcpy(dst_, src_, size);
+        return;
+    }
+    uint8_t* dst = (uint8_t*)dst_ + size;
+    const uint8_t* src = (const uint8_t*)src_ + size;
+    while(size > 0 && ((uint32_t)dst & 3)) {
+        *--dst = *--src;
+        size--;
+    }
+    uint32_t cnt = size / 4;
+    if(cnt > 0) {
+        //std后rep movsl从最后一个字往前复制，结束后edi、esi停在已复制部分的前一个字
+        dst -= 4;
+        src -= 4;
+        asm volatile ("std; rep movsl; cld" : "+D"(dst), "+S"(src), "+c"(cnt) : : "memory");
+        dst += 4;
+        src += 4;
+    }
+    size %= 4;
+    while(size-- > 0) {
+        *--dst = *--src;
+    }
+}
+
+/*连续比较以地址a_和地址b_开头的size个字节。先按4字节整字比较跳过相同的部分，再逐字节找出第一个不同的字节*/
 int memcmp(const void* a_, const void* b_, uint32_t size)
 {
     const char* a = a_;
     const char* b = b_;
     ASSERT(a != NULL && b != NULL);
+    while(size >= 4 && *(const uint32_t*)a == *(const uint32_t*)b) {
+        a += 4;
+        b += 4;
+        size -= 4;
+    }
     while(size-- > 0) {
         if(*a != *b) {
             return *a > *b ? 1 : -1;
@@ -40,28 +94,72 @@ int memcmp(const void* a_, const void* b_, uint32_t size)
     return 0;
 }
 
-/*将字符串从src_复制到dst_*/
+/*将字符串从src_复制到dst_。两者4字节对齐的偏移相同时，对齐后按整字复制到含结尾0的那个字，
+  对齐的整字读取不会跨页，不会读到字符串所在页以外*/
 char* strcpy(char* dst_, const char* src_)
 {
     ASSERT(dst_ != NULL && src_ != NULL);
     char* r = dst_;   //用来返回目的字符串起始地址
+    if((((uint32_t)dst_ ^ (uint32_t)src_) & 3) == 0) {
+        while((uint32_t)src_ & 3) {
+            if((*dst_++ = *src_++) == 0) {
+                return r;
+            }
+        }
+        uint32_t* dst_word = (uint32_t*)dst_;
+        const uint32_t* src_word = (const uint32_t*)src_;
+        while(!WORD_HAS_ZERO(*src_word)) {
+            *dst_word++ = *src_word++;
+        }
+        dst_ = (char*)dst_word;
+        src_ = (const char*)src_word;
+    }
     while((*dst_++ = *src_++));
     return r;
 }
 
-/*返回字符串长度*/
+/*返回字符串长度。先逐字节到4字节对齐，再按整字找含0的字*/
 uint32_t strlen(const char* str)
 {
     ASSERT(str != NULL);
     const char* p = str;
-    while(*p++);
-    return (p - str -1);
+    while((uint32_t)p & 3) {
+        if(*p == 0) {
+            return p - str;
+        }
+        p++;
+    }
+    const uint32_t* word = (const uint32_t*)p;
+    while(!WORD_HAS_ZERO(*word)) {
+        word++;
+    }
+    p = (const char*)word;
+    while(*p) {
+        p++;
+    }
+    return p - str;
 }
 
-/*比较两个字符串*/
+/*比较两个字符串。两者对齐偏移相同时，对齐后按整字跳过相同且不含0的部分*/
 int8_t strcmp(const char* a, const char* b)
 {
     ASSERT(a != NULL && b != NULL);
+    if((((uint32_t)a ^ (uint32_t)b) & 3) == 0) {
+        while(((uint32_t)a & 3) && *a != 0 && *a == *b) {
+            a++;
+            b++;
+        }
+        if(((uint32_t)a & 3) == 0) {
+            const uint32_t* wa = (const uint32_t*)a;
+            const uint32_t* wb = (const uint32_t*)b;
+            while(*wa == *wb && !WORD_HAS_ZERO(*wa)) {
+                wa++;
+                wb++;
+            }
+            a = (const char*)wa;
+            b = (const char*)wb;
+        }
+    }
     while(*a != 0 && *a == *b) {
         a++;
         b++;
@@ -69,10 +167,58 @@ int8_t strcmp(const char* a, const char* b)
     return *a < *b ? -1 : *a > *b;
 }
 
-/*从左到右查找字符串str中首次出现字符ch的地址*/
+/*比较两个字符串，最多比较size个字节，用于可能占满数组而没有结尾0的名字，如目录项的文件名*/
+int8_t strncmp(const char* a, const char* b, uint32_t size)
+{
+    ASSERT(a != NULL && b != NULL);
+    if((((uint32_t)a ^ (uint32_t)b) & 3) == 0) {
+        while(size > 0 && ((uint32_t)a & 3) && *a != 0 && *a == *b) {
+            a++;
+            b++;
+            size--;
+        }
+        if(((uint32_t)a & 3) == 0) {
+            const uint32_t* wa = (const uint32_t*)a;
+            const uint32_t* wb = (const uint32_t*)b;
+            while(size >= 4 && *wa == *wb && !WORD_HAS_ZERO(*wa)) {
+                wa++;
+                wb++;
+                size -= 4;
+            }
+            a = (const char*)wa;
+            b = (const char*)wb;
+        }
+    }
+    while(size > 0 && *a != 0 && *a == *b) {
+        a++;
+        b++;
+        size--;
+    }
+    if(size == 0) {
+        return 0;
+    }
+    return *a < *b ? -1 : *a > *b;
+}
+
+/*从左到右查找字符串str中首次出现字符ch的地址。对齐后按整字跳过既不含ch也不含0的字*/
 char* strchr(const char* str, const uint8_t ch)
 {
     ASSERT(str != NULL);
+    while((uint32_t)str & 3) {
+        if(*str == 0) {
+            return NULL;
+        }
+        if(*str == ch) {
+            return (char*)str;
+        }
+        str++;
+    }
+    uint32_t pattern = ch * WORD_ONES;   //ch铺满4个字节
+    const uint32_t* word = (const uint32_t*)str;
+    while(!WORD_HAS_ZERO(*word) && !WORD_HAS_ZERO(*word ^ pattern)) {
+        word++;
+    }
+    str = (const char*)word;
     while(*str != 0) {
         if(*str == ch) {
             return (char*)str;
@@ -82,11 +228,35 @@ char* strchr(const char* str, const uint8_t ch)
     return NULL;
 }
 
-/*从后往前找字符串str中首次出现字符ch的地址*/
+/*从后往前找字符串str中首次出现字符ch的地址。对齐后按整字扫描，只在含ch的字里逐字节找*/
 char* strrchr(const char* str, const uint8_t ch)
 {
     ASSERT(str != NULL);
     const char* last_char = NULL;
+    while((uint32_t)str & 3) {
+        if(*str == 0) {
+            return (char*)last_char;
+        }
+        if(*str == ch) {
+            last_char = str;
+        }
+        str++;
+    }
+    uint32_t pattern = ch * WORD_ONES;
+    const uint32_t* word = (const uint32_t*)str;
+    while(!WORD_HAS_ZERO(*word)) {
+        if(WORD_HAS_ZERO(*word ^ pattern)) {
+            const char* p = (const char*)word;
+            uint32_t idx;
+            for(idx = 0; idx < 4; idx++) {
+                if(p[idx] == ch) {
+                    last_char = p + idx;
+                }
+            }
+        }
+        word++;
+    }
+    str = (const char*)word;
     while(*str != 0) {
         if(*str == ch) {
             last_char = str;
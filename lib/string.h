@@ -4,10 +4,12 @@
 
 void memset(void* dst_, uint8_t value, uint32_t size);
 void memcpy(void* dst_, const void* src_, uint32_t size);
+void memmove(void* dst_, const void* src_, uint32_t size);
 int memcmp(const void* a_, const void* b_, uint32_t size);
 char* strcpy(char* dst_, const char* src_);
 uint32_t strlen(const char* str);
 int8_t strcmp(const char* a, const char* b);
+int8_t strncmp(const char* a, const char* b, uint32_t size);
 char* strchr(const char* str, const uint8_t ch);
 char* strrchr(const char* str, const uint8_t ch);
 char* strcat(char* dst_, const char* src);
@@ -1,6 +1,8 @@
 #include "assert.h"
 #include "stdio.h"
+#include "stream.h"
 void user_spin(char* filename, int line, const char* func, const char* condition) {
    printf("\n\n\n\nfilename %s\nline %d\nfunction %s\ncondition %s\n", filename, line, func, condition);
+   fflush(stdout);   //之后不再返回，stdout是管道时也要先写出
    while(1);
 }
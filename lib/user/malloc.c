@@ -0,0 +1,190 @@
+#include "syscall.h"
+#include "stdint.h"
+#include "global.h"
+#include "mutex.h"
+#include "mmap.h"
+
+#define MALLOC_CLASS_CNT 7   //小块的规格数，16字节起每种翻倍，最大1024字节
+#define MALLOC_MIN_BLOCK 16   //最小的块
+#define MALLOC_MAX_BLOCK (MALLOC_MIN_BLOCK << (MALLOC_CLASS_CNT - 1))   //超过它按整页分配
+#define MALLOC_TRIM_PAGES 16   //堆末尾连续空闲的页超过这么多时还给内核
+#define MALLOC_HUGE_MIN 0x400000   //不小于4MB的请求不占堆，单独建一个用大页的匿名映射区
+#define MALLOC_HUGE_CLASS (MALLOC_CLASS_CNT + 1)   //单独映射的大块的规格号
+
+/*空闲的小块，串在所属规格的空闲链表上*/
+struct malloc_block
+{
+    struct malloc_block* next;
+};
+
+/*每次从堆上取来的页开头的元信息，free按块所在页找到它*/
+struct malloc_arena
+{
+    uint32_t class_idx;   //小块所属的规格，整页分配的大块为MALLOC_CLASS_CNT，单独映射的为MALLOC_HUGE_CLASS
+    uint32_t pg_cnt;   //大块连同本头部占用的页数
+};
+
+/*空闲的连续页，按地址从低到高串起来，相邻的合并*/
+struct malloc_span
+{
+    struct malloc_span* next;
+    uint32_t pg_cnt;
+};
+
+/*分配器的状态，放在堆区的第一页，进程各有一份，fork后随页表写时复制。
+  页由内核在第一次访问时清零，全0就是初始状态，不必另外初始化*/
+struct malloc_state
+{
+    struct mutex lock;   //进程的各线程共用一个堆，无竞争时加解锁不进内核
+    struct malloc_block* free_blocks[MALLOC_CLASS_CNT];   //各规格的空闲块
+    struct malloc_span* free_spans;   //空闲的页
+};
+
+#define mstate ((struct malloc_state*)USER_LIB_MALLOC_DATA)
+
+/*从空闲的页中或堆的末尾取pg_cnt个连续页，需持有锁，失败返回NULL*/
+static void* pages_get(uint32_t pg_cnt)
+{
+    struct malloc_span** link = &mstate->free_spans;
+    while(*link != NULL) {
+        struct malloc_span* span = *link;
+        if(span->pg_cnt == pg_cnt) {
+            *link = span->next;
+            return span;
+        }
+        if(span->pg_cnt > pg_cnt) {   //从段尾切下，段头留在链表里不动
+            span->pg_cnt -= pg_cnt;
+            return (uint8_t*)span + span->pg_cnt * PG_SIZE;
+        }
+        link = &span->next;
+    }
+    //堆的末尾总是页对齐的，分配器只按整页移动它
+    void* pages = sbrk(pg_cnt * PG_SIZE);
+    return pages == (void*)-1 ? NULL : pages;
+}
+
+/*把从pages起的pg_cnt个页放回空闲页中，和前后相邻的合并，需持有锁。合并后位于堆末尾的大段还给内核*/
+static void pages_put(void* pages, uint32_t pg_cnt)
+{
+    struct malloc_span* span = pages;
+    struct malloc_span* prev = NULL;
+    struct malloc_span* next = mstate->free_spans;
+    while(next != NULL && next < span) {
+        prev = next;
+        next = next->next;
+    }
+    span->pg_cnt = pg_cnt;
+    span->next = next;
+    if(next != NULL && (uint8_t*)span + span->pg_cnt * PG_SIZE == (uint8_t*)next) {
+        span->pg_cnt += next->pg_cnt;
+        span->next = next->next;
+    }
+    if(prev != NULL && (uint8_t*)prev + prev->pg_cnt * PG_SIZE == (uint8_t*)span) {
+        prev->pg_cnt += span->pg_cnt;
+        prev->next = span->next;
+        span = prev;
+    } else if(prev != NULL) {
+        prev->next = span;
+    } else {
+        mstate->free_spans = span;
+    }
+
+    if(span->next != NULL || span->pg_cnt < MALLOC_TRIM_PAGES \
+       || (uint8_t*)span + span->pg_cnt * PG_SIZE != sbrk(0)) {
+        return;
+    }
+    struct malloc_span** link = &mstate->free_spans;
+    while(*link != span) {
+        link = &(*link)->next;
+    }
+    *link = NULL;
+    sbrk(-(int32_t)(span->pg_cnt * PG_SIZE));
+}
+
+/*取一页切成class_idx规格的块放进空闲链表，需持有锁*/
+static void arena_fill(uint32_t class_idx)
+{
+    struct malloc_arena* a = pages_get(1);
+    if(a == NULL) {
+        return;
+    }
+    a->class_idx = class_idx;
+    a->pg_cnt = 1;
+    uint32_t block_size = MALLOC_MIN_BLOCK << class_idx;
+    uint32_t block_cnt = (PG_SIZE - sizeof(struct malloc_arena)) / block_size;
+    uint8_t* block = (uint8_t*)(a + 1);
+    while(block_cnt-- > 0) {
+        struct malloc_block* b = (struct malloc_block*)block;
+        b->next = mstate->free_blocks[class_idx];
+        mstate->free_blocks[class_idx] = b;
+        block += block_size;
+    }
+}
+
+/*申请size字节大小的内存，并返回结果，失败返回NULL。
+  全在用户态完成：小块按规格从空闲链表取，链表空了才从堆上取一页来切；大块按整页取，堆不够时才用sbrk进内核*/
+void* malloc(uint32_t size)
+{
+    if(size == 0 || size > USER_HEAP_MAX) {
+        return NULL;
+    }
+    //很大的块用大页映射，少走缺页和tlb未命中，释放时整个映射区还给内核。映射区用完时退回堆上分配
+    if(size >= MALLOC_HUGE_MIN) {
+        uint32_t pg_cnt = DIV_ROUND_UP(size + sizeof(struct malloc_arena), PG_SIZE);
+        struct malloc_arena* a = mmap(NULL, pg_cnt * PG_SIZE, PROT_READ | PROT_WRITE, \
+                                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGE, -1, 0);
+        if(a != MAP_FAILED) {
+            a->class_idx = MALLOC_HUGE_CLASS;
+            a->pg_cnt = pg_cnt;
+            return a + 1;
+        }
+    }
+    void* ret = NULL;
+    mutex_lock(&mstate->lock);
+    if(size > MALLOC_MAX_BLOCK) {
+        uint32_t pg_cnt = DIV_ROUND_UP(size + sizeof(struct malloc_arena), PG_SIZE);
+        struct malloc_arena* a = pages_get(pg_cnt);
+        if(a != NULL) {
+            a->class_idx = MALLOC_CLASS_CNT;
+            a->pg_cnt = pg_cnt;
+            ret = a + 1;
+        }
+    } else {
+        uint32_t class_idx = 0;
+        while((uint32_t)(MALLOC_MIN_BLOCK << class_idx) < size) {
+            class_idx++;
+        }
+        if(mstate->free_blocks[class_idx] == NULL) {
+            arena_fill(class_idx);
+        }
+        struct malloc_block* b = mstate->free_blocks[class_idx];
+        if(b != NULL) {
+            mstate->free_blocks[class_idx] = b->next;
+            ret = b;
+        }
+    }
+    mutex_unlock(&mstate->lock);
+    return ret;
+}
+
+/*释放ptr指向的内存。小块放回所属规格的空闲链表，大块的页放回空闲页中*/
+void free(void* ptr)
+{
+    if(ptr == NULL) {
+        return;
+    }
+    struct malloc_arena* a = (struct malloc_arena*)((uint32_t)ptr & 0xfffff000);
+    if(a->class_idx == MALLOC_HUGE_CLASS) {   //单独的映射区不在堆上，不用加锁
+        munmap(a, a->pg_cnt * PG_SIZE);
+        return;
+    }
+    mutex_lock(&mstate->lock);
+    if(a->class_idx == MALLOC_CLASS_CNT) {
+        pages_put(a, a->pg_cnt);
+    } else {
+        struct malloc_block* b = ptr;
+        b->next = mstate->free_blocks[a->class_idx];
+        mstate->free_blocks[a->class_idx] = b;
+    }
+    mutex_unlock(&mstate->lock);
+}
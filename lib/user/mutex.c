@@ -0,0 +1,89 @@
+#include "mutex.h"
+#include "stdint.h"
+#include "syscall.h"
+
+/*若*addr等于old则将其改为new，返回*addr原来的值*/
+static uint32_t atomic_cmpxchg(volatile uint32_t* addr, uint32_t old, uint32_t new)
+{
+    asm volatile ("lock cmpxchgl %2, %1" : "+a"(old), "+m"(*addr) : "r"(new) : "memory");
+    return old;
+}
+
+/*将*addr改为val，返回原来的值*/
+static uint32_t atomic_xchg(volatile uint32_t* addr, uint32_t val)
+{
+    asm volatile ("xchgl %0, %1" : "+r"(val), "+m"(*addr) : : "memory");
+    return val;
+}
+
+/*给*addr加上delta，返回原来的值*/
+static uint32_t atomic_fetch_add(volatile uint32_t* addr, uint32_t delta)
+{
+    asm volatile ("lock xaddl %0, %1" : "+r"(delta), "+m"(*addr) : : "memory");
+    return delta;
+}
+
+/*初始化互斥锁m*/
+void mutex_init(struct mutex* m)
+{
+    m->state = 0;
+}
+
+/*对m加锁*/
+void mutex_lock(struct mutex* m)
+{
+    uint32_t c = atomic_cmpxchg(&m->state, 0, 1);
+    if(c == 0) {
+        return;   //无竞争，不进内核
+    }
+    //有竞争时把状态置为2，告诉持有者解锁时要唤醒等待者
+    if(c != 2) {
+        c = atomic_xchg(&m->state, 2);
+    }
+    while(c != 0) {
+        futex_wait((uint32_t*)&m->state, 2);
+        c = atomic_xchg(&m->state, 2);
+    }
+}
+
+/*对m解锁*/
+void mutex_unlock(struct mutex* m)
+{
+    if(atomic_fetch_add(&m->state, (uint32_t)-1) != 1) {
+        //原来是2，可能有人在等
+        m->state = 0;
+        futex_wake((uint32_t*)&m->state, 1);
+    }
+}
+
+/*初始化条件变量c*/
+void cond_init(struct cond* c)
+{
+    c->seq = 0;
+}
+
+/*释放m并等待c被通知，返回前重新获得m*/
+void cond_wait(struct cond* c, struct mutex* m)
+{
+    uint32_t seq = c->seq;
+    mutex_unlock(m);
+    futex_wait((uint32_t*)&c->seq, seq);   //seq已变说明通知已经发出，futex_wait会立即返回
+    //被唤醒的任务可能不止一个，按有竞争的方式加锁，保证解锁时会唤醒其他等待者
+    while(atomic_xchg(&m->state, 2) != 0) {
+        futex_wait((uint32_t*)&m->state, 2);
+    }
+}
+
+/*唤醒一个在c上等待的任务*/
+void cond_signal(struct cond* c)
+{
+    atomic_fetch_add(&c->seq, 1);
+    futex_wake((uint32_t*)&c->seq, 1);
+}
+
+/*唤醒所有在c上等待的任务*/
+void cond_broadcast(struct cond* c)
+{
+    atomic_fetch_add(&c->seq, 1);
+    futex_wake((uint32_t*)&c->seq, 0xffffffff);
+}
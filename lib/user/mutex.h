@@ -0,0 +1,29 @@
+#ifndef __LIB_USER_MUTEX_H
+#define __LIB_USER_MUTEX_H
+#include "stdint.h"
+
+/*用户态互斥锁，state为0表示未上锁，1表示上锁且无人等待，2表示上锁且可能有人等待。
+  无竞争时加锁解锁只是一条原子指令，不进入内核*/
+struct mutex
+{
+    volatile uint32_t state;
+};
+
+/*用户态条件变量，seq每次通知时加1，等待者在seq上futex_wait*/
+struct cond
+{
+    volatile uint32_t seq;
+};
+
+void mutex_init(struct mutex* m);
+void mutex_lock(struct mutex* m);
+void mutex_unlock(struct mutex* m);
+void cond_init(struct cond* c);
+/*释放m并等待c被通知，返回前重新获得m*/
+void cond_wait(struct cond* c, struct mutex* m);
+/*唤醒一个在c上等待的任务*/
+void cond_signal(struct cond* c);
+/*唤醒所有在c上等待的任务*/
+void cond_broadcast(struct cond* c);
+
+#endif
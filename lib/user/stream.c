@@ -0,0 +1,188 @@
+#include "stream.h"
+#include "stdint.h"
+#include "global.h"
+#include "mutex.h"
+#include "string.h"
+#include "syscall.h"
+#include "mmap.h"
+#include "file.h"
+
+/*标准流的状态，放在用户库数据页里。页由内核在第一次访问时清零，inited为false时按需初始化*/
+struct stream_state
+{
+    struct mutex lock;   //保护inited和open_list
+    bool inited;
+    FILE std_streams[2];   //stdout和stderr
+    FILE* open_list;   //fopen打开的流
+    char stdout_buf[STREAM_BUF_SIZE];
+};
+
+#define sstate ((struct stream_state*)USER_LIB_STREAM_DATA)
+
+/*把fp缓冲区中的内容全部写出，需持有fp的锁，成功返回0，失败返回-1*/
+static int32_t stream_drain(FILE* fp)
+{
+    uint32_t len = fp->len;
+    fp->len = 0;
+    if(len > 0 && write(fp->fd, fp->buf, len) != len) {
+        return -1;
+    }
+    return 0;
+}
+
+/*把data中的len字节放进fp的缓冲区，需持有fp的锁，成功返回0，失败返回-1。
+  放不下时先写出已缓冲的，比缓冲区还大的直接写出；行缓冲的流写入了换行符就写出*/
+static int32_t stream_put(FILE* fp, const char* data, uint32_t len)
+{
+    if(fp->mode == STREAM_UNBUF) {
+        return write(fp->fd, data, len) == len ? 0 : -1;
+    }
+    if(fp->len + len > STREAM_BUF_SIZE) {
+        if(stream_drain(fp) == -1) {
+            return -1;
+        }
+        if(len >= STREAM_BUF_SIZE) {
+            return write(fp->fd, data, len) == len ? 0 : -1;
+        }
+    }
+    memcpy(fp->buf + fp->len, data, len);
+    fp->len += len;
+    if(fp->mode == STREAM_LINEBUF) {
+        uint32_t idx;
+        for(idx = 0; idx < len; idx++) {
+            if(data[idx] == '\n') {
+                return stream_drain(fp);
+            }
+        }
+    }
+    return 0;
+}
+
+/*返回标准输出或标准错误fd对应的流。第一次用时初始化：stdout是tty时行缓冲，是管道时全缓冲，stderr不缓冲*/
+FILE* stream_std(int32_t fd)
+{
+    if(!sstate->inited) {
+        mutex_lock(&sstate->lock);
+        if(!sstate->inited) {
+            FILE* out = &sstate->std_streams[0];
+            out->fd = stdout_no;
+            out->mode = isatty(stdout_no) ? STREAM_LINEBUF : STREAM_FULLBUF;
+            out->buf = sstate->stdout_buf;
+            FILE* err = &sstate->std_streams[1];
+            err->fd = stderr_no;
+            err->mode = STREAM_UNBUF;
+            sstate->inited = true;
+        }
+        mutex_unlock(&sstate->lock);
+    }
+    return &sstate->std_streams[fd == stderr_no ? 1 : 0];
+}
+
+/*按mode打开path，成功返回全缓冲的流，失败返回NULL。
+  只支持写："w"先删掉原文件再新建，文件系统没有截断；"a"打开后移到末尾，不存在时新建*/
+FILE* fopen(const char* path, const char* mode)
+{
+    int32_t fd = -1;
+    if(!strcmp(mode, "w")) {
+        unlink(path);   //原文件不存在时失败，不影响新建
+        fd = open((char*)path, O_CREAT | O_WRONLY);
+    } else if(!strcmp(mode, "a")) {
+        fd = open((char*)path, O_WRONLY);
+        if(fd == -1) {
+            fd = open((char*)path, O_CREAT | O_WRONLY);
+        } else if(lseek(fd, 0, SEEK_END) == -1) {
+            close(fd);
+            return NULL;
+        }
+    }
+    if(fd == -1) {
+        return NULL;
+    }
+    FILE* fp = malloc(sizeof(FILE) + STREAM_BUF_SIZE);
+    if(fp == NULL) {
+        close(fd);
+        return NULL;
+    }
+    memset(fp, 0, sizeof(FILE));
+    fp->fd = fd;
+    fp->mode = STREAM_FULLBUF;
+    fp->buf = (char*)(fp + 1);
+    mutex_lock(&sstate->lock);
+    fp->next = sstate->open_list;
+    sstate->open_list = fp;
+    mutex_unlock(&sstate->lock);
+    return fp;
+}
+
+/*写出fp的缓冲区并关闭文件，从打开的流中摘下后释放，成功返回0，失败返回-1*/
+int32_t fclose(FILE* fp)
+{
+    mutex_lock(&sstate->lock);
+    FILE** link = &sstate->open_list;
+    while(*link != NULL && *link != fp) {
+        link = &(*link)->next;
+    }
+    if(*link == NULL) {   //不是fopen打开的流
+        mutex_unlock(&sstate->lock);
+        return -1;
+    }
+    *link = fp->next;
+    mutex_unlock(&sstate->lock);
+    int32_t ret = stream_drain(fp);
+    if(close(fp->fd) == -1) {
+        ret = -1;
+    }
+    free(fp);
+    return ret;
+}
+
+/*把buf中cnt个size字节的元素写入fp，返回写入的元素数，出错时返回0*/
+uint32_t fwrite(const void* buf, uint32_t size, uint32_t cnt, FILE* fp)
+{
+    mutex_lock(&fp->lock);
+    int32_t ret = stream_put(fp, buf, size * cnt);
+    mutex_unlock(&fp->lock);
+    return ret == -1 ? 0 : cnt;
+}
+
+/*把字符串str写入fp，成功返回0，失败返回-1*/
+int32_t fputs(const char* str, FILE* fp)
+{
+    mutex_lock(&fp->lock);
+    int32_t ret = stream_put(fp, str, strlen(str));
+    mutex_unlock(&fp->lock);
+    return ret;
+}
+
+/*把字符c写入fp，成功返回c，失败返回-1*/
+int32_t fputc(int32_t c, FILE* fp)
+{
+    char ch = c;
+    mutex_lock(&fp->lock);
+    int32_t ret = stream_put(fp, &ch, 1);
+    mutex_unlock(&fp->lock);
+    return ret == -1 ? -1 : c;
+}
+
+/*写出fp缓冲区中的内容，fp为NULL时写出标准输出和所有fopen打开的流，成功返回0，失败返回-1*/
+int32_t fflush(FILE* fp)
+{
+    if(fp != NULL) {
+        mutex_lock(&fp->lock);
+        int32_t ret = stream_drain(fp);
+        mutex_unlock(&fp->lock);
+        return ret;
+    }
+    int32_t ret = 0;
+    if(sstate->inited && fflush(stdout) == -1) {   //还没用过标准流就不必初始化它
+        ret = -1;
+    }
+    mutex_lock(&sstate->lock);
+    for(fp = sstate->open_list; fp != NULL; fp = fp->next) {
+        if(fflush(fp) == -1) {
+            ret = -1;
+        }
+    }
+    mutex_unlock(&sstate->lock);
+    return ret;
+}
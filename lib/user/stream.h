@@ -0,0 +1,46 @@
+#ifndef __LIB_USER_STREAM_H
+#define __LIB_USER_STREAM_H
+#include "stdint.h"
+#include "global.h"
+#include "mutex.h"
+
+#define STREAM_BUF_SIZE 1024   //每个流的缓冲区大小
+
+/*流的缓冲方式*/
+enum stream_buf_mode
+{
+    STREAM_UNBUF,   //不缓冲，每次写都直接进内核，如stderr
+    STREAM_LINEBUF,   //行缓冲，写入换行符或缓冲区满时写出，用于tty
+    STREAM_FULLBUF   //全缓冲，缓冲区满、fflush或fclose时才写出，用于文件和管道
+};
+
+/*带缓冲的输出流。fopen打开的流和缓冲区一起从用户堆分配，标准流放在用户库数据页里，进程各有一份*/
+typedef struct stream
+{
+    int32_t fd;
+    enum stream_buf_mode mode;
+    char* buf;
+    uint32_t len;   //缓冲区中还没写出的字节数
+    struct mutex lock;   //进程的各线程共用一个流
+    struct stream* next;   //fopen打开的流串成链表，exit时逐个写出
+} FILE;
+
+/*返回标准输出或标准错误fd对应的流，第一次用时按fd是不是tty决定缓冲方式*/
+FILE* stream_std(int32_t fd);
+#define stdout stream_std(1)
+#define stderr stream_std(2)
+
+/*按mode打开path，成功返回流，失败返回NULL。只支持写："w"删掉原文件重建，"a"追加到末尾，不存在时新建*/
+FILE* fopen(const char* path, const char* mode);
+/*写出fp的缓冲区并关闭文件，成功返回0，失败返回-1*/
+int32_t fclose(FILE* fp);
+/*把buf中cnt个size字节的元素写入fp，返回写入的元素数*/
+uint32_t fwrite(const void* buf, uint32_t size, uint32_t cnt, FILE* fp);
+/*把字符串str写入fp，成功返回0，失败返回-1*/
+int32_t fputs(const char* str, FILE* fp);
+/*把字符c写入fp，成功返回c，失败返回-1*/
+int32_t fputc(int32_t c, FILE* fp);
+/*写出fp缓冲区中的内容，fp为NULL时写出所有的流，成功返回0，失败返回-1*/
+int32_t fflush(FILE* fp);
+
+#endif
@@ -1,91 +1,110 @@
 #include "syscall.h"
 #include "thread.h"
+#include "stream.h"
+#include "file.h"
 
-/*无参数的系统调用*/
-#define _syscall0(NUMBER) ({ \
-    int retval; \
-    asm volatile ( \
-        "int $0x80" \
-        : "=a"(retval) \
-        : "a"(NUMBER) \
-        : "memory" \
-    ); \
-    retval; \
-})
-
-#define _syscall1(NUMBER, ARG1) ({ \
-    int retval; \
-    asm volatile ( \
-        "int $0x80" \
-        : "=a"(retval) \
-        : "a"(NUMBER), "b"(ARG1) \
-        : "memory" \
-    ); \
-    retval; \
-})
-
-#define _syscall2(NUMBER, ARG1, ARG2) ({ \
-    int retval; \
-    asm volatile ( \
-        "int $0x80" \
-        : "=a"(retval) \
-        : "a"(NUMBER), "b"(ARG1), "c"(ARG2) \
-        : "memory" \
-    ); \
-    retval; \
-})
-
-#define _syscall3(NUMBER, ARG1, ARG2, ARG3) ({ \
-    int retval; \
-    asm volatile ( \
-        "int $0x80" \
-        : "=a"(retval) \
-        : "a"(NUMBER), "b"(ARG1), "c"(ARG2), "d"(ARG3) \
-        : "memory" \
-    ); \
-    retval; \
-})
+/*系统调用的进入方式，第一次系统调用时检测*/
+enum syscall_gate
+{
+    GATE_UNKNOWN,   //还没检测
+    GATE_INT80,   //int 0x80
+    GATE_SYSENTER   //cpu支持sysenter/sysexit，内核在tss_init中按同样的条件设置好了入口
+};
 
-/*返回当前任务的pid*/
-uint32_t getpid()
+static enum syscall_gate syscall_gate = GATE_UNKNOWN;
+
+/*按cpuid检测能否用sysenter，条件与内核中的cpu_has_sep相同：SEP位置1且不是早期的Pentium Pro*/
+static enum syscall_gate syscall_gate_probe(void)
 {
-    return _syscall0(SYS_GETPID);
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if(!(edx & (1 << 11))) {
+        return GATE_INT80;
+    }
+    uint32_t family = (eax >> 8) & 0xf, model = (eax >> 4) & 0xf, stepping = eax & 0xf;
+    return family == 6 && model < 3 && stepping < 3 ? GATE_INT80 : GATE_SYSENTER;
 }
 
-uint32_t write(int32_t fd, const void* buf, uint32_t count)
+/*发起NUMBER号系统调用，参数依次放在ebx、ecx、edx中，返回值在eax中。
+  用户态能用sysenter时走sysenter，返回地址放在esi、用户栈放在ebp交给内核，sysexit返回时ecx和edx被改写。
+  内核线程也会调用这些函数，sysexit只能回到3特权级，所以0特权级下总是用int 0x80*/
+static int syscall_enter(uint32_t number, uint32_t arg1, uint32_t arg2, uint32_t arg3)
 {
-    return _syscall3(SYS_WRITE, fd, buf, count);
+    int retval;
+    uint32_t cs;
+    if(syscall_gate == GATE_UNKNOWN) {
+        syscall_gate = syscall_gate_probe();
+    }
+    asm ("movl %%cs, %0" : "=r"(cs));
+    if(syscall_gate == GATE_SYSENTER && (cs & 3) == RPL3) {
+        asm volatile (
+            "pushl %%ebp\n\t"
+            "movl %%esp, %%ebp\n\t"
+            "movl $1f, %%esi\n\t"
+            "sysenter\n"
+            "1:\n\t"
+            "popl %%ebp"
+            : "=a"(retval), "+c"(arg2), "+d"(arg3)
+            : "0"(number), "b"(arg1)
+            : "esi", "memory"
+        );
+    } else {
+        asm volatile (
+            "int $0x80"
+            : "=a"(retval)
+            : "0"(number), "b"(arg1), "c"(arg2), "d"(arg3)
+            : "memory"
+        );
+    }
+    return retval;
 }
 
-/*申请size字节大小的内存，并返回结果*/
-void* malloc(uint32_t size)
+/*无参数的系统调用*/
+#define _syscall0(NUMBER) syscall_enter(NUMBER, 0, 0, 0)
+
+#define _syscall1(NUMBER, ARG1) syscall_enter(NUMBER, (uint32_t)(ARG1), 0, 0)
+
+#define _syscall2(NUMBER, ARG1, ARG2) syscall_enter(NUMBER, (uint32_t)(ARG1), (uint32_t)(ARG2), 0)
+
+#define _syscall3(NUMBER, ARG1, ARG2, ARG3) syscall_enter(NUMBER, (uint32_t)(ARG1), (uint32_t)(ARG2), (uint32_t)(ARG3))
+
+/*返回当前任务的pid*/
+uint32_t getpid()
 {
-    return (void*)_syscall1(SYS_MALLOC, size);
+    return _syscall0(SYS_GETPID);
 }
 
-/*释放ptr指向的内存*/
-void free(void* ptr)
+uint32_t write(int32_t fd, const void* buf, uint32_t count)
 {
-    _syscall1(SYS_FREE, ptr);
+    return _syscall3(SYS_WRITE, fd, buf, count);
 }
 
+/*fork前先写出各流的缓冲区，免得父子进程各写一遍*/
 pid_t fork(void)
 {
+    fflush(NULL);
     return _syscall0(SYS_FORK);
 }
 
+/*从标准输入读之前先写出各流的缓冲区，没有换行的提示符才能先显示出来*/
 int32_t read(int32_t fd, void* buf, uint32_t count)
 {
+    if(fd == stdin_no) {
+        fflush(NULL);
+    }
     return _syscall3(SYS_READ, fd, buf, count);
 }
 
+/*经stdout的缓冲区输出一个字符*/
 void putchar(char char_asci)
 {
-    _syscall1(SYS_PUTCHAR, char_asci);
+    fputc(char_asci, stdout);
 }
 
+/*清屏前先写出各流的缓冲区，免得清屏后才显示出来*/
 void clear(void)
 {
+    fflush(NULL);
     _syscall0(SYS_CLEAR);
 }
 
@@ -107,6 +126,18 @@ int32_t close(int32_t fd)
     return _syscall1(SYS_CLOSE, fd);
 }
 
+/*复制文件描述符fd到最小的空闲描述符，成功返回新的描述符，失败返回-1*/
+int32_t dup(int32_t fd)
+{
+    return _syscall1(SYS_DUP, fd);
+}
+
+/*使new_fd指向old_fd打开的文件，标准输入输出只能重定向为管道或改回控制台，成功返回new_fd，失败返回-1*/
+int32_t dup2(int32_t old_fd, int32_t new_fd)
+{
+    return _syscall2(SYS_DUP2, old_fd, new_fd);
+}
+
 /*设置文件偏移量*/
 int32_t lseek(int32_t fd, int32_t offset, uint32_t whence)
 {
@@ -167,29 +198,386 @@ int32_t chdir(const char* path)
     return _syscall1(SYS_CHDIR, path);
 }
 
-/*显示任务列表*/
+/*显示任务列表。内核直接输出到控制台，先写出各流的缓冲区保证先后顺序*/
 void ps(void)
 {
+    fflush(NULL);
     _syscall0(SYS_PS);
 }
 
-/*execv*/
+/*execv，换映像时用户堆连同各流的缓冲区一起丢掉，先写出*/
 int execv(const char* path, const char* argv[])
 {
+    fflush(NULL);
     return _syscall2(SYS_EXECV, path, argv);
 }
 
 pid_t wait(int32_t* status)
 {
-    return _syscall1(SYS_WAIT, status);
+    return _syscall2(SYS_WAIT, status, 0);
 }
 
+/*同wait，options含WNOHANG时不阻塞，有子进程但都还没退出返回0*/
+pid_t waitopt(int32_t* status, uint32_t options)
+{
+    return _syscall2(SYS_WAIT, status, options);
+}
+
+/*退出前写出各流的缓冲区*/
 void exit(int32_t status)
 {
+    fflush(NULL);
     return _syscall1(SYS_EXIT, status);
 }
 
 void help(void)
 {
     return _syscall0(SYS_HELP);
-}
\ No newline at end of file
+}
+
+/*获取内存统计信息*/
+int32_t meminfo(struct meminfo* info)
+{
+    return _syscall1(SYS_MEMINFO, info);
+}
+
+/*若*addr仍等于expected则睡眠等待futex_wake*/
+int32_t futex_wait(uint32_t* addr, uint32_t expected)
+{
+    return _syscall2(SYS_FUTEX_WAIT, addr, expected);
+}
+
+/*唤醒最多n个在addr上等待的任务*/
+int32_t futex_wake(uint32_t* addr, uint32_t n)
+{
+    return _syscall2(SYS_FUTEX_WAKE, addr, n);
+}
+
+/*读取最近的至多cnt条调度事件到buf*/
+int32_t sched_trace(struct sched_event* buf, uint32_t cnt)
+{
+    return _syscall2(SYS_SCHED_TRACE, buf, cnt);
+}
+
+/*把所有缓存的修改写回硬盘*/
+void sync(void)
+{
+    _syscall0(SYS_SYNC);
+}
+
+/*把缓存的修改写回硬盘后关机，不返回*/
+void poweroff(void)
+{
+    _syscall0(SYS_POWEROFF);
+}
+
+/*把文件fd的修改写回硬盘*/
+int32_t fsync(int32_t fd)
+{
+    return _syscall1(SYS_FSYNC, fd);
+}
+
+/*返回开机以来的时钟滴答数，每秒100次*/
+uint32_t uptime(void)
+{
+    return _syscall0(SYS_UPTIME);
+}
+
+/*读取各硬盘和分区的io统计到buf，最多cnt项，返回项数*/
+int32_t iostat(struct iostat_entry* buf, uint32_t cnt)
+{
+    return _syscall2(SYS_IOSTAT, buf, cnt);
+}
+
+/*把文件fd从offset起映射或建立匿名映射，成功返回起始地址，失败返回MAP_FAILED。参数超过3个，打包成结构体传入*/
+void* mmap(void* addr, uint32_t len, uint32_t prot, uint32_t flags, int32_t fd, uint32_t offset)
+{
+    struct mmap_args args = {addr, len, prot, flags, fd, offset};
+    return (void*)_syscall1(SYS_MMAP, &args);
+}
+
+/*解除从addr起len字节的映射，成功返回0，失败返回-1*/
+int32_t munmap(void* addr, uint32_t len)
+{
+    return _syscall2(SYS_MUNMAP, addr, len);
+}
+
+/*创建管道，pipefd[0]是读端，pipefd[1]是写端，成功返回0，失败返回-1*/
+int32_t pipe(int32_t pipefd[2])
+{
+    return _syscall1(SYS_PIPE, pipefd);
+}
+
+/*在内核中把普通文件in_fd的最多count个字节送到out_fd，返回送出的字节数。参数超过3个，打包成结构体传入*/
+int32_t sendfile(int32_t out_fd, int32_t in_fd, uint32_t* offset, uint32_t count)
+{
+    struct sendfile_args args = {out_fd, in_fd, offset, count};
+    return _syscall1(SYS_SENDFILE, &args);
+}
+
+/*在内核中把in_fd的最多count个字节搬到out_fd，至少一端是管道，返回搬运的字节数*/
+int32_t splice(int32_t in_fd, int32_t out_fd, uint32_t count)
+{
+    return _syscall3(SYS_SPLICE, in_fd, out_fd, count);
+}
+
+/*从目录dir中接着读出目录项填入buf，最多填count字节，返回填入的字节数，读完时返回0*/
+int32_t getdents(struct dir* dir, struct dir_entry* buf, uint32_t count)
+{
+    return _syscall3(SYS_GETDENTS, dir, buf, count);
+}
+
+/*同getdents，每项还带上文件大小*/
+int32_t getdents_stat(struct dir* dir, struct dir_entry_stat* buf, uint32_t count)
+{
+    return _syscall3(SYS_GETDENTS_STAT, dir, buf, count);
+}
+
+/*将文件描述符fd所指文件的属性填入buf*/
+int32_t fstat(int32_t fd, struct stat* buf)
+{
+    return _syscall2(SYS_FSTAT, fd, buf);
+}
+
+/*将当前分区的容量信息填入buf*/
+int32_t statfs(struct statfs* buf)
+{
+    return _syscall1(SYS_STATFS, buf);
+}
+
+/*检查当前分区的元数据是否一致，结果填入report，返回不一致数，无法检查时返回-1*/
+int32_t fsck(struct fsck_report* report)
+{
+    return _syscall1(SYS_FSCK, report);
+}
+
+/*对文件描述符fd执行cmd命令，目前只支持F_GETPIPE_SZ和F_SETPIPE_SZ，成功返回管道缓冲区大小，失败返回-1*/
+int32_t fcntl(int32_t fd, uint32_t cmd, uint32_t arg)
+{
+    return _syscall3(SYS_FCNTL, fd, cmd, arg);
+}
+
+/*取得key对应的共享内存段，flags含IPC_CREAT时按size字节新建，成功返回段号，失败返回-1*/
+int32_t shmget(int32_t key, uint32_t size, uint32_t flags)
+{
+    return _syscall3(SYS_SHMGET, key, size, flags);
+}
+
+/*把段shmid挂接到本进程，shmaddr须为NULL，成功返回挂接地址，失败返回SHM_FAILED*/
+void* shmat(int32_t shmid, const void* shmaddr, uint32_t flags)
+{
+    return (void*)_syscall3(SYS_SHMAT, shmid, shmaddr, flags);
+}
+
+/*解除从shmaddr起的共享内存挂接，成功返回0，失败返回-1*/
+int32_t shmdt(const void* shmaddr)
+{
+    return _syscall1(SYS_SHMDT, shmaddr);
+}
+
+/*对段shmid执行cmd命令，目前只支持IPC_RMID，成功返回0，失败返回-1*/
+int32_t shmctl(int32_t shmid, uint32_t cmd, void* buf)
+{
+    return _syscall3(SYS_SHMCTL, shmid, cmd, buf);
+}
+
+/*新建能存放slot_cnt条、每条最多msg_size字节消息的队列，成功返回队列号，失败返回-1*/
+int32_t msgq_create(uint32_t msg_size, uint32_t slot_cnt)
+{
+    return _syscall2(SYS_MSGQ_CREATE, msg_size, slot_cnt);
+}
+
+/*删除队列qid，成功返回0，失败返回-1*/
+int32_t msgq_destroy(int32_t qid)
+{
+    return _syscall1(SYS_MSGQ_DESTROY, qid);
+}
+
+/*把msg开始的len字节作为一条消息放入队列qid，队列满时等待，成功返回0，失败返回-1*/
+int32_t msgq_send(int32_t qid, const void* msg, uint32_t len)
+{
+    return _syscall3(SYS_MSGQ_SEND, qid, msg, len);
+}
+
+/*从队列qid取出一条消息到buf，最多等timeout毫秒，成功返回消息的字节数，超时或失败返回-1*/
+int32_t msgq_recv(int32_t qid, void* buf, uint32_t timeout)
+{
+    return _syscall3(SYS_MSGQ_RECV, qid, buf, timeout);
+}
+
+/*等待fds中的nfds个描述符就绪，最多等timeout毫秒，为-1时一直等，返回就绪的描述符数，出错返回-1*/
+int32_t poll(struct pollfd* fds, uint32_t nfds, int32_t timeout)
+{
+    return _syscall3(SYS_POLL, fds, nfds, timeout);
+}
+
+/*对文件描述符fd执行cmd命令，目前只支持控制台tty的TTY_GET_MODE和TTY_SET_MODE，成功返回模式，失败返回-1*/
+int32_t ioctl(int32_t fd, uint32_t cmd, uint32_t arg)
+{
+    return _syscall3(SYS_IOCTL, fd, cmd, arg);
+}
+
+/*fd是控制台tty时返回1，否则返回0*/
+int32_t isatty(int32_t fd)
+{
+    return _syscall1(SYS_ISATTY, fd);
+}
+
+/*把内核日志中最近的至多count字节复制到buf，返回复制的字节数*/
+uint32_t dmesg(char* buf, uint32_t count)
+{
+    return _syscall2(SYS_DMESG, buf, count);
+}
+
+/*把iov中iovcnt个缓冲区的数据依次写入fd，返回写入的总字节数，失败返回-1*/
+int32_t writev(int32_t fd, const struct iovec* iov, uint32_t iovcnt)
+{
+    return _syscall3(SYS_WRITEV, fd, iov, iovcnt);
+}
+
+/*从fd依次读入iov中iovcnt个缓冲区，返回读出的总字节数，到文件尾或失败返回-1*/
+int32_t readv(int32_t fd, const struct iovec* iov, uint32_t iovcnt)
+{
+    return _syscall3(SYS_READV, fd, iov, iovcnt);
+}
+
+/*新建一个运行path程序的子进程，参数为以NULL结尾的argv，返回子进程的pid，失败返回-1*/
+pid_t spawn(const char* path, const char* argv[])
+{
+    fflush(NULL);   //子进程直接写控制台，先写出缓冲区保证先后顺序
+    return _syscall2(SYS_SPAWN, path, argv);
+}
+
+/*解析path得到普通文件的inode号，并把当前的目录项删除次数存入gen，成功返回inode号，失败返回-1*/
+int32_t exec_lookup(const char* path, uint32_t* gen)
+{
+    return _syscall2(SYS_EXEC_LOOKUP, path, gen);
+}
+
+/*新建子进程运行exec_lookup解析出的i_no号程序，不再解析路径。gen表明解析结果已失效时返回-1，成功返回子进程的pid*/
+pid_t spawn_inode(uint32_t i_no, uint32_t gen, const char* argv[])
+{
+    fflush(NULL);
+    return _syscall3(SYS_SPAWN_INODE, i_no, gen, argv);
+}
+
+/*休眠us微秒，很短的休眠在内核中忙等，返回0*/
+int32_t usleep(uint32_t us)
+{
+    return _syscall1(SYS_USLEEP, us);
+}
+
+/*把内核各计数器的名字和各cpu上的合计复制到buf，最多cnt项，返回复制的项数*/
+int32_t stats(struct counter_entry* buf, uint32_t cnt)
+{
+    return _syscall2(SYS_STATS, buf, cnt);
+}
+
+/*取宿主机共享目录中第idx个文件的名字和大小存入entry，成功返回0，文件名太长返回1，没有这一项返回-1*/
+int32_t hostshare_list(uint32_t idx, struct hostshare_entry* entry)
+{
+    return _syscall2(SYS_HOSTSHARE_LIST, idx, entry);
+}
+
+/*把宿主机共享目录中的文件name复制到path，返回复制的字节数，失败返回-1*/
+int32_t hostshare_import(const char* name, const char* path)
+{
+    return _syscall2(SYS_HOSTSHARE_IMPORT, name, path);
+}
+
+/*clone新建的线程从这里开始执行，func返回后以0结束线程，线程也可以自己调用exit传出退出状态*/
+static void clone_start(void (*func)(void*), void* arg)
+{
+    func(arg);
+    exit(0);
+}
+
+/*在当前进程中新建一个线程执行func(arg)，stack为调用者分配的线程用户栈的栈顶，线程结束前要一直有效，返回线程的pid，失败返回-1。
+  新线程和当前进程共用地址空间和文件描述符，在栈顶为clone_start摆好返回地址和参数，内核让线程从clone_start开始执行*/
+pid_t clone(void (*func)(void*), void* arg, void* stack)
+{
+    uint32_t* sp = (uint32_t*)((uint32_t)stack & 0xfffffff0) - 3;
+    sp[0] = 0;   //clone_start的返回地址，它不会返回
+    sp[1] = (uint32_t)func;
+    sp[2] = (uint32_t)arg;
+    return _syscall2(SYS_CLONE, clone_start, sp);
+}
+
+/*等待当前进程中的线程tid结束，将其退出状态存入status，成功返回0，失败返回-1*/
+int32_t thread_join(pid_t tid, int32_t* status)
+{
+    return _syscall2(SYS_THREAD_JOIN, tid, status);
+}
+
+/*把堆的末尾移动increment字节，返回原来的末尾，失败返回(void*)-1。堆由malloc管理，一般不直接调用*/
+void* sbrk(int32_t increment)
+{
+    return (void*)_syscall1(SYS_SBRK, increment);
+}
+
+/*执行ring中最多to_submit个已提交的请求，结果放入完成环，返回执行的请求数，出错返回-1。
+  一批读写请求只进一次内核，完成环满时余下的请求留在提交环中*/
+int32_t uring_enter(struct uring* ring, uint32_t to_submit)
+{
+    return _syscall2(SYS_URING_ENTER, ring, to_submit);
+}
+
+/*把各任务的资源使用统计复制到buf，最多cnt项，返回复制的项数*/
+int32_t taskstats(struct taskstat_entry* buf, uint32_t cnt)
+{
+    return _syscall2(SYS_TASKSTATS, buf, cnt);
+}
+
+/*把各系统调用号的调用次数和耗时复制到buf，最多cnt项，返回复制的项数，下标就是系统调用号*/
+int32_t syscall_stats(struct syscall_stat* buf, uint32_t cnt)
+{
+    return _syscall2(SYS_SYSCALL_STATS, buf, cnt);
+}
+
+/*把各启动阶段的耗时复制到buf，最多cnt项，返回复制的项数*/
+int32_t boot_stats(struct boot_stage* buf, uint32_t cnt)
+{
+    return _syscall2(SYS_BOOT_STATS, buf, cnt);
+}
+
+/*取第idx项内核微基准的名字和循环次数存入res，run为true时运行它并存入统计。成功返回0，idx超出范围返回-1*/
+int32_t bench(uint32_t idx, struct bench_result* res, bool run)
+{
+    return _syscall3(SYS_BENCH, idx, res, run);
+}
+
+/*执行采样命令cmd。START成功返回0；STOP返回开始以来的样本总数；DUMP返回复制的样本数；失败返回-1*/
+int32_t profile(uint32_t cmd, uint32_t arg, struct profile_sample* buf)
+{
+    return _syscall3(SYS_PROFILE, cmd, arg, buf);
+}
+
+/*把addr所在的内核函数名复制到name，至多len字节含结尾的0，返回addr相对函数起点的偏移，找不到返回-1*/
+int32_t ksym(uint32_t addr, char* name, uint32_t len)
+{
+    return _syscall3(SYS_KSYM, addr, name, len);
+}
+
+/*新建cpu带宽控制组，每period个滴答中组内进程合计最多运行quota个滴答，quota为0表示不限制，返回组号，失败返回-1*/
+int32_t cpugroup_create(uint32_t quota, uint32_t period)
+{
+    return _syscall2(SYS_CPUGROUP_CREATE, quota, period);
+}
+
+/*修改组gid的配额，从现在开始新的周期，成功返回0，失败返回-1*/
+int32_t cpugroup_set(int32_t gid, uint32_t quota, uint32_t period)
+{
+    return _syscall3(SYS_CPUGROUP_SET, gid, quota, period);
+}
+
+/*把pid所在的进程移到组gid，gid为0表示移回默认组，成功返回0，失败返回-1*/
+int32_t cpugroup_attach(pid_t pid, int32_t gid)
+{
+    return _syscall2(SYS_CPUGROUP_ATTACH, pid, gid);
+}
+
+/*删除组gid，组内的进程移回默认组，成功返回0，失败返回-1*/
+int32_t cpugroup_destroy(int32_t gid)
+{
+    return _syscall1(SYS_CPUGROUP_DESTROY, gid);
+}
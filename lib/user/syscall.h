@@ -3,6 +3,22 @@
 #include "stdint.h"
 #include "thread.h"
 #include "dir.h"
+#include "sched_trace.h"
+#include "ide.h"
+#include "mmap.h"
+#include "shm.h"
+#include "msgq.h"
+#include "poll.h"
+#include "tty.h"
+#include "klog.h"
+#include "uring.h"
+#include "syscall-init.h"
+#include "wait_exit.h"
+#include "init.h"
+#include "bench.h"
+#include "profile.h"
+#include "counter.h"
+#include "hostshare.h"
 
 enum SYSCALL_NR
 {
@@ -31,12 +47,69 @@ enum SYSCALL_NR
     SYS_EXECV,
     SYS_WAIT,
     SYS_EXIT,
-    SYS_HELP
+    SYS_HELP,
+    SYS_MEMINFO,
+    SYS_FUTEX_WAIT,
+    SYS_FUTEX_WAKE,
+    SYS_SCHED_TRACE,
+    SYS_SYNC,
+    SYS_FSYNC,
+    SYS_UPTIME,
+    SYS_IOSTAT,
+    SYS_MMAP,
+    SYS_MUNMAP,
+    SYS_PIPE,
+    SYS_SENDFILE,
+    SYS_SPLICE,
+    SYS_GETDENTS,
+    SYS_GETDENTS_STAT,
+    SYS_FSTAT,
+    SYS_STATFS,
+    SYS_FSCK,
+    SYS_FCNTL,
+    SYS_SHMGET,
+    SYS_SHMAT,
+    SYS_SHMDT,
+    SYS_SHMCTL,
+    SYS_MSGQ_CREATE,
+    SYS_MSGQ_DESTROY,
+    SYS_MSGQ_SEND,
+    SYS_MSGQ_RECV,
+    SYS_POLL,
+    SYS_IOCTL,
+    SYS_DMESG,
+    SYS_READV,
+    SYS_WRITEV,
+    SYS_SPAWN,
+    SYS_CLONE,
+    SYS_THREAD_JOIN,
+    SYS_SBRK,
+    SYS_URING_ENTER,
+    SYS_TASKSTATS,
+    SYS_SYSCALL_STATS,
+    SYS_ISATTY,
+    SYS_BOOT_STATS,
+    SYS_BENCH,
+    SYS_PROFILE,
+    SYS_KSYM,
+    SYS_DUP,
+    SYS_DUP2,
+    SYS_EXEC_LOOKUP,
+    SYS_SPAWN_INODE,
+    SYS_USLEEP,
+    SYS_STATS,
+    SYS_HOSTSHARE_LIST,
+    SYS_HOSTSHARE_IMPORT,
+    SYS_POWEROFF,
+    SYS_CPUGROUP_CREATE,
+    SYS_CPUGROUP_SET,
+    SYS_CPUGROUP_ATTACH,
+    SYS_CPUGROUP_DESTROY
 };
 
 uint32_t getpid(void);
 uint32_t write(int32_t fd, const void* buf, uint32_t count);
-/*申请size字节大小的内存，并返回结果*/
+/*申请size字节大小的内存，并返回结果，在用户态的堆上分配，实现在malloc.c*/
 void* malloc(uint32_t size);
 /*释放ptr指向的内存*/
 void free(void* ptr);
@@ -50,6 +123,10 @@ char* getcwd(char* buf, uint32_t size);
 int32_t open(char* pathname, uint8_t flag);
 /*关闭文件*/
 int32_t close(int32_t fd);
+/*复制文件描述符fd到最小的空闲描述符，成功返回新的描述符，失败返回-1*/
+int32_t dup(int32_t fd);
+/*使new_fd指向old_fd打开的文件，标准输入输出只能重定向为管道或改回控制台，成功返回new_fd，失败返回-1*/
+int32_t dup2(int32_t old_fd, int32_t new_fd);
 /*设置文件偏移量*/
 int32_t lseek(int32_t fd, int32_t offset, uint32_t whence);
 /*删除文件*/
@@ -75,7 +152,119 @@ void ps(void);
 /*execv*/
 int execv(const char* path, const char* argv[]);
 pid_t wait(int32_t* status);
+/*同wait，options含WNOHANG时不阻塞，有子进程但都还没退出返回0*/
+pid_t waitopt(int32_t* status, uint32_t options);
 void exit(int32_t status);
 void help(void);
+/*获取内存统计信息*/
+int32_t meminfo(struct meminfo* info);
+/*若*addr仍等于expected则睡眠等待futex_wake*/
+int32_t futex_wait(uint32_t* addr, uint32_t expected);
+/*唤醒最多n个在addr上等待的任务*/
+int32_t futex_wake(uint32_t* addr, uint32_t n);
+/*读取最近的至多cnt条调度事件到buf*/
+int32_t sched_trace(struct sched_event* buf, uint32_t cnt);
+/*把所有缓存的修改写回硬盘*/
+void sync(void);
+/*把文件fd的修改写回硬盘*/
+int32_t fsync(int32_t fd);
+/*把缓存的修改写回硬盘后关机，不返回*/
+void poweroff(void);
+/*返回开机以来的时钟滴答数，每秒100次*/
+uint32_t uptime(void);
+/*读取各硬盘和分区的io统计到buf，最多cnt项，返回项数*/
+int32_t iostat(struct iostat_entry* buf, uint32_t cnt);
+/*把文件fd从offset起映射或建立匿名映射，成功返回起始地址，失败返回MAP_FAILED*/
+void* mmap(void* addr, uint32_t len, uint32_t prot, uint32_t flags, int32_t fd, uint32_t offset);
+/*解除从addr起len字节的映射，成功返回0，失败返回-1*/
+int32_t munmap(void* addr, uint32_t len);
+/*创建管道，pipefd[0]是读端，pipefd[1]是写端，成功返回0，失败返回-1*/
+int32_t pipe(int32_t pipefd[2]);
+/*在内核中把普通文件in_fd的最多count个字节送到out_fd，offset不为NULL时从*offset处读并更新它，返回送出的字节数*/
+int32_t sendfile(int32_t out_fd, int32_t in_fd, uint32_t* offset, uint32_t count);
+/*在内核中把in_fd的最多count个字节搬到out_fd，至少一端是管道，返回搬运的字节数*/
+int32_t splice(int32_t in_fd, int32_t out_fd, uint32_t count);
+/*从目录dir中接着读出目录项填入buf，最多填count字节，返回填入的字节数，读完时返回0*/
+int32_t getdents(struct dir* dir, struct dir_entry* buf, uint32_t count);
+/*同getdents，每项还带上文件大小*/
+int32_t getdents_stat(struct dir* dir, struct dir_entry_stat* buf, uint32_t count);
+/*将文件描述符fd所指文件的属性填入buf*/
+int32_t fstat(int32_t fd, struct stat* buf);
+/*将当前分区的容量信息填入buf*/
+int32_t statfs(struct statfs* buf);
+/*检查当前分区的元数据是否一致，结果填入report，返回不一致数，无法检查时返回-1*/
+int32_t fsck(struct fsck_report* report);
+/*对文件描述符fd执行cmd命令，目前只支持F_GETPIPE_SZ和F_SETPIPE_SZ，成功返回管道缓冲区大小，失败返回-1*/
+int32_t fcntl(int32_t fd, uint32_t cmd, uint32_t arg);
+/*取得key对应的共享内存段，flags含IPC_CREAT时按size字节新建，成功返回段号，失败返回-1*/
+int32_t shmget(int32_t key, uint32_t size, uint32_t flags);
+/*把段shmid挂接到本进程，shmaddr须为NULL，成功返回挂接地址，失败返回SHM_FAILED*/
+void* shmat(int32_t shmid, const void* shmaddr, uint32_t flags);
+/*解除从shmaddr起的共享内存挂接，成功返回0，失败返回-1*/
+int32_t shmdt(const void* shmaddr);
+/*对段shmid执行cmd命令，目前只支持IPC_RMID，成功返回0，失败返回-1*/
+int32_t shmctl(int32_t shmid, uint32_t cmd, void* buf);
+/*新建能存放slot_cnt条、每条最多msg_size字节消息的队列，成功返回队列号，失败返回-1*/
+int32_t msgq_create(uint32_t msg_size, uint32_t slot_cnt);
+/*删除队列qid，成功返回0，失败返回-1*/
+int32_t msgq_destroy(int32_t qid);
+/*把msg开始的len字节作为一条消息放入队列qid，队列满时等待，成功返回0，失败返回-1*/
+int32_t msgq_send(int32_t qid, const void* msg, uint32_t len);
+/*从队列qid取出一条消息到buf，最多等timeout毫秒，成功返回消息的字节数，超时或失败返回-1*/
+int32_t msgq_recv(int32_t qid, void* buf, uint32_t timeout);
+/*等待fds中的nfds个描述符就绪，最多等timeout毫秒，为-1时一直等，返回就绪的描述符数，出错返回-1*/
+int32_t poll(struct pollfd* fds, uint32_t nfds, int32_t timeout);
+/*对文件描述符fd执行cmd命令，目前只支持控制台tty的TTY_GET_MODE和TTY_SET_MODE，成功返回模式，失败返回-1*/
+int32_t ioctl(int32_t fd, uint32_t cmd, uint32_t arg);
+/*fd是控制台tty时返回1，否则返回0*/
+int32_t isatty(int32_t fd);
+/*把内核日志中最近的至多count字节复制到buf，返回复制的字节数*/
+uint32_t dmesg(char* buf, uint32_t count);
+/*把iov中iovcnt个缓冲区的数据依次写入fd，返回写入的总字节数，失败返回-1*/
+int32_t writev(int32_t fd, const struct iovec* iov, uint32_t iovcnt);
+/*从fd依次读入iov中iovcnt个缓冲区，返回读出的总字节数，到文件尾或失败返回-1*/
+int32_t readv(int32_t fd, const struct iovec* iov, uint32_t iovcnt);
+/*新建一个运行path程序的子进程，参数为以NULL结尾的argv，返回子进程的pid，失败返回-1*/
+pid_t spawn(const char* path, const char* argv[]);
+/*解析path得到普通文件的inode号，并把当前的目录项删除次数存入gen，成功返回inode号，失败返回-1*/
+int32_t exec_lookup(const char* path, uint32_t* gen);
+/*新建子进程运行exec_lookup解析出的i_no号程序，不再解析路径。gen表明解析结果已失效时返回-1，成功返回子进程的pid*/
+pid_t spawn_inode(uint32_t i_no, uint32_t gen, const char* argv[]);
+/*休眠us微秒，很短的休眠在内核中忙等，返回0*/
+int32_t usleep(uint32_t us);
+/*把内核各计数器的名字和各cpu上的合计复制到buf，最多cnt项，返回复制的项数*/
+int32_t stats(struct counter_entry* buf, uint32_t cnt);
+/*取宿主机共享目录中第idx个文件的名字和大小存入entry，成功返回0，文件名太长返回1，没有这一项返回-1*/
+int32_t hostshare_list(uint32_t idx, struct hostshare_entry* entry);
+/*把宿主机共享目录中的文件name复制到path，返回复制的字节数，失败返回-1*/
+int32_t hostshare_import(const char* name, const char* path);
+/*在当前进程中新建一个线程执行func(arg)，stack为调用者分配的线程用户栈的栈顶，返回线程的pid，失败返回-1*/
+pid_t clone(void (*func)(void*), void* arg, void* stack);
+/*等待当前进程中的线程tid结束，将其退出状态存入status，成功返回0，失败返回-1*/
+int32_t thread_join(pid_t tid, int32_t* status);
+/*把堆的末尾移动increment字节，返回原来的末尾，失败返回(void*)-1*/
+void* sbrk(int32_t increment);
+/*执行ring中最多to_submit个已提交的请求，结果放入完成环，返回执行的请求数，出错返回-1*/
+int32_t uring_enter(struct uring* ring, uint32_t to_submit);
+/*把各任务的资源使用统计复制到buf，最多cnt项，返回复制的项数*/
+int32_t taskstats(struct taskstat_entry* buf, uint32_t cnt);
+/*把各系统调用号的调用次数和耗时复制到buf，最多cnt项，返回复制的项数*/
+int32_t syscall_stats(struct syscall_stat* buf, uint32_t cnt);
+/*把各启动阶段的耗时复制到buf，最多cnt项，返回复制的项数*/
+int32_t boot_stats(struct boot_stage* buf, uint32_t cnt);
+/*取第idx项内核微基准的名字和循环次数存入res，run为true时运行它并存入统计。成功返回0，idx超出范围返回-1*/
+int32_t bench(uint32_t idx, struct bench_result* res, bool run);
+/*执行采样命令cmd。START成功返回0；STOP返回开始以来的样本总数；DUMP返回复制的样本数；失败返回-1*/
+int32_t profile(uint32_t cmd, uint32_t arg, struct profile_sample* buf);
+/*把addr所在的内核函数名复制到name，至多len字节含结尾的0，返回addr相对函数起点的偏移，找不到返回-1*/
+int32_t ksym(uint32_t addr, char* name, uint32_t len);
+/*新建cpu带宽控制组，每period个滴答中组内进程合计最多运行quota个滴答，quota为0表示不限制，返回组号，失败返回-1*/
+int32_t cpugroup_create(uint32_t quota, uint32_t period);
+/*修改组gid的配额，从现在开始新的周期，成功返回0，失败返回-1*/
+int32_t cpugroup_set(int32_t gid, uint32_t quota, uint32_t period);
+/*把pid所在的进程移到组gid，gid为0表示移回默认组，成功返回0，失败返回-1*/
+int32_t cpugroup_attach(pid_t pid, int32_t gid);
+/*删除组gid，组内的进程移回默认组，成功返回0，失败返回-1*/
+int32_t cpugroup_destroy(int32_t gid);
 
 #endif
@@ -0,0 +1,104 @@
+#include "vdso.h"
+#include "stdint.h"
+#include "global.h"
+#include "vdata.h"
+
+#define vdata ((const struct vdata*)VDATA_VADDR)
+#define vdata_proc ((const struct vdata_proc*)VDATA_PROC_VADDR)
+
+/*返回开机以来的时钟滴答数，同uptime*/
+uint32_t vdso_uptime(void)
+{
+    return vdata->ticks;
+}
+
+/*返回当前进程的进程号，第一次访问时由内核建立进程数据页*/
+pid_t vdso_getpid(void)
+{
+    return vdata_proc->pid;
+}
+
+/*从bochs的半虚拟时钟读出开机以来的纳秒数，没有注册半虚拟时钟时返回false。
+  前后两次读到的version相同且为偶数才算读到一致的内容*/
+static bool pvclock_read_ns(uint64_t* ns)
+{
+    const struct pvclock* pv = &vdata->pvclock;
+    uint32_t version, mul;
+    uint64_t stamp, system_time, tsc;
+    int8_t shift;
+    do {
+        version = pv->version;
+        if(version == 0) {
+            return false;
+        }
+        asm volatile ("" : : : "memory");
+        stamp = pv->tsc_timestamp;
+        system_time = pv->system_time;
+        mul = pv->tsc_to_system_mul;
+        shift = pv->tsc_shift;
+        asm volatile ("rdtsc" : "=A"(tsc));
+        asm volatile ("" : : : "memory");
+    } while((version & 1) || pv->version != version);
+
+    uint64_t delta = tsc - stamp;
+    if((int64_t)delta < 0) {   //其他cpu的时间戳计数器可能略慢于0号cpu
+        delta = 0;
+    }
+    delta = shift >= 0 ? delta << shift : delta >> -shift;
+    //delta * mul >> 32，分成高低两个32位的乘法，不用96位的中间结果
+    *ns = system_time + (((uint64_t)(uint32_t)delta * mul) >> 32) + (uint64_t)(uint32_t)(delta >> 32) * mul;
+    return true;
+}
+
+/*返回开机以来的纳秒数，有半虚拟时钟时直接由时间戳计数器换算，否则由vdso_clock_us换算*/
+uint64_t vdso_clock_ns(void)
+{
+    uint64_t ns;
+    if(pvclock_read_ns(&ns)) {
+        return ns;
+    }
+    return vdso_clock_us() * 1000;
+}
+
+/*返回开机以来的微秒数。有半虚拟时钟时由纳秒数除以1000得到，分高低两次divl，不用64位除法。
+  否则按seq读出一致的滴答数和最近一次时钟中断时的时间戳，再用tsc_per_tick推算滴答内过去的部分*/
+uint64_t vdso_clock_us(void)
+{
+    uint64_t ns;
+    if(pvclock_read_ns(&ns)) {
+        uint32_t hi = (uint32_t)(ns >> 32), lo, rem;
+        asm ("divl %4" : "=a"(lo), "=d"(rem) : "a"((uint32_t)ns), "d"(hi % 1000), "rm"(1000));
+        return ((uint64_t)(hi / 1000) << 32) | lo;
+    }
+
+    uint32_t seq, cur_ticks, tsc_lo, tsc_hi, tsc_per_tick;
+    do {
+        while((seq = vdata->seq) & 1);   //内核正在更新
+        asm volatile ("" : : : "memory");
+        cur_ticks = vdata->ticks;
+        tsc_lo = vdata->tick_tsc_lo;
+        tsc_hi = vdata->tick_tsc_hi;
+        tsc_per_tick = vdata->tsc_per_tick;
+        asm volatile ("" : : : "memory");
+    } while(vdata->seq != seq);
+
+    uint32_t us_per_tick = 1000000 / vdata->tick_hz;
+    uint64_t us = (uint64_t)cur_ticks * us_per_tick;
+    if(tsc_per_tick == 0) {
+        return us;
+    }
+    uint64_t tsc;
+    asm volatile ("rdtsc" : "=A"(tsc));
+    int64_t elapsed = (int64_t)(tsc - (((uint64_t)tsc_hi << 32) | tsc_lo));
+    if(elapsed <= 0) {   //其他cpu的时间戳计数器可能略慢于0号cpu
+        return us;
+    }
+    //elapsed * us_per_tick / tsc_per_tick，商不超过32位时才用divl，否则只精确到滴答
+    uint64_t prod = (uint64_t)elapsed * us_per_tick;
+    if((uint32_t)(prod >> 32) >= tsc_per_tick) {
+        return us;
+    }
+    uint32_t part, rem;
+    asm ("divl %4" : "=a"(part), "=d"(rem) : "a"((uint32_t)prod), "d"((uint32_t)(prod >> 32)), "rm"(tsc_per_tick));
+    return us + part;
+}
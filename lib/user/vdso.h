@@ -0,0 +1,19 @@
+#ifndef __LIB_USER_VDSO_H
+#define __LIB_USER_VDSO_H
+#include "stdint.h"
+#include "global.h"
+#include "thread.h"
+
+/*以下函数直接读内核映射到每个进程的只读数据页，不进入内核，适合在计时循环里频繁调用*/
+
+/*返回开机以来的时钟滴答数，同uptime*/
+uint32_t vdso_uptime(void);
+/*返回当前进程的进程号，即主线程的pid，进程中的各线程调用得到的都一样*/
+pid_t vdso_getpid(void);
+/*返回开机以来的微秒数。bochs开了半虚拟时钟时按时间戳计数器精确换算，
+  否则是滴答数加上按时间戳计数器推算的当前滴答内的部分，内核还没校准出每个滴答的时钟周期数时只精确到滴答，相邻两个滴答处可能有校准误差大小的回跳*/
+uint64_t vdso_clock_us(void);
+/*返回开机以来的纳秒数，bochs开了半虚拟时钟时按时间戳计数器精确换算，否则只有vdso_clock_us的精度*/
+uint64_t vdso_clock_ns(void);
+
+#endif
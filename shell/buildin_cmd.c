@@ -4,10 +4,19 @@
 #include "fs.h"
 #include "file.h"
 #include "string.h"
+#include "stdio.h"
+#include "stream.h"
+#include "ksym.h"
 #include "syscall.h"
 #include "shell.h"
 #include "syscall.h"
 
+#define LS_BATCH_ENTRIES 16   //ls每次用getdents取回的目录项数
+#define TOP_MAX_TASKS 64   //top最多统计的任务数
+#define TOP_ROWS 16   //top列出的任务数，一屏能显示下
+#define TOP_SYSCALL_ROWS 4   //top列出的最耗时的系统调用数
+#define TOP_INTERVAL 1000   //top刷新的间隔，毫秒
+
 /*将路径old_abs_path中的..和.转换为实际路径后存入new_abs_path*/
 static void wash_path(char* old_abs_path, char* new_abs_path)
 {
@@ -52,13 +61,11 @@ static void wash_path(char* old_abs_path, char* new_abs_path)
 void make_clear_abs_path(char* path, char* final_path)
 {
     char abs_path[MAX_PATH_LEN] = {0};
-    //判断是否输入的是绝对路径
+    //判断是否输入的是绝对路径，相对路径接在shell缓存的当前目录后，不必每次经getcwd系统调用从磁盘上逐级找回目录名
     if(path[0] != '/') {
-        memset(abs_path, 0, MAX_PATH_LEN);
-        if(getcwd(abs_path, MAX_PATH_LEN) != NULL) {
-            if(!((abs_path[0] == '/') && (abs_path[1] == 0))) {
-                strcat(abs_path, "/");
-            }
+        strcpy(abs_path, cwd_cache);
+        if(!((abs_path[0] == '/') && (abs_path[1] == 0))) {
+            strcat(abs_path, "/");
         }
     }
     strcat(abs_path, path);
@@ -101,6 +108,37 @@ char* buildin_cd(uint32_t argc, char** argv)
     return final_path;
 }
 
+/*ls一次取回的一批目录项*/
+struct ls_batch
+{
+    union {
+        struct dir_entry entries[LS_BATCH_ENTRIES];
+        struct dir_entry_stat stats[LS_BATCH_ENTRIES];
+    };
+    bool with_size;   //为true时用getdents_stat连同文件大小一起取回
+    uint32_t cnt;   //entries或stats中有效的个数
+    uint32_t next;   //下一个要返回的下标
+};
+
+/*返回dir的下一个目录项，with_size时把文件大小存入size，取完一批后再取一批，读完时返回NULL*/
+static struct dir_entry* ls_next_entry(struct dir* dir, struct ls_batch* batch, uint32_t* size)
+{
+    if(batch->next == batch->cnt) {
+        int32_t bytes = batch->with_size ? getdents_stat(dir, batch->stats, sizeof(batch->stats)) \
+                                         : getdents(dir, batch->entries, sizeof(batch->entries));
+        if(bytes <= 0) {
+            return NULL;
+        }
+        batch->cnt = bytes / (batch->with_size ? sizeof(struct dir_entry_stat) : sizeof(struct dir_entry));
+        batch->next = 0;
+    }
+    if(batch->with_size) {
+        *size = batch->stats[batch->next].st_size;
+        return &batch->stats[batch->next++].entry;
+    }
+    return &batch->entries[batch->next++];
+}
+
 /* ls命令的内建函数 */
 void buildin_ls(uint32_t argc, char** argv)
 {
@@ -152,34 +190,23 @@ void buildin_ls(uint32_t argc, char** argv)
     if(file_stat.st_filetype == FT_DIRECTORY) {
         struct dir* dir = opendir(pathname);
         struct dir_entry* dir_e = NULL;
-        char sub_pathname[MAX_PATH_LEN] = {0};
-        uint32_t pathname_len = strlen(pathname);
-        uint32_t last_char_idx = pathname_len - 1;
-        memcpy(sub_pathname, pathname, pathname_len);
-        if(sub_pathname[last_char_idx] != '/') {
-	        sub_pathname[pathname_len] = '/';
-	        pathname_len++;
-        }
         rewinddir(dir);
+        struct ls_batch batch;
+        batch.cnt = batch.next = 0;
+        batch.with_size = long_info;   //-l时大小随目录项一起取回，不必逐个stat
+        uint32_t size = 0;
         if(long_info) {
 	        char ftype;
 	        printf("total: %d\n", file_stat.st_size);
-	        while((dir_e = readdir(dir))) {
+	        while((dir_e = ls_next_entry(dir, &batch, &size))) {
 	            ftype = 'd';
 	            if(dir_e->f_type == FT_REGULAR) {
 	                ftype = '-';
 	            } 
-	            sub_pathname[pathname_len] = 0;
-	            strcat(sub_pathname, dir_e->filename);
-	            memset(&file_stat, 0, sizeof(struct stat));
-	            if(stat(sub_pathname, &file_stat) == -1) {
-	                printf("ls: cannot access %s: No such file or directory\n", dir_e->filename);
-	                return;
-	            }
-	            printf("%c  %d  %d  %s\n", ftype, dir_e->i_no, file_stat.st_size, dir_e->filename);
+	            printf("%c  %d  %d  %s\n", ftype, dir_e->i_no, size, dir_e->filename);
 	        }
         } else {
-	        while((dir_e = readdir(dir))) {
+	        while((dir_e = ls_next_entry(dir, &batch, &size))) {
 	           printf("%s ", dir_e->filename);
 	        }
 	        printf("\n");
@@ -204,6 +231,706 @@ void buildin_ps(uint32_t argc, char** argv UNUSED)
     ps();
 }
 
+/*打印一个内存池的使用情况，以页为单位*/
+static void print_pool_info(const char* name, struct pool_info* pool)
+{
+    printf("%s  %d  %d  %d  %d  %d\n", name, pool->total_pages, 
+           pool->total_pages - pool->free_pages - pool->zero_pages, pool->free_pages, pool->zero_pages, pool->peak_used_pages);
+}
+
+/*打印各规格内存块的使用情况*/
+static void print_desc_info(const char* name, struct desc_info* descs)
+{
+    uint32_t desc_idx;
+    printf("%s blocks (size/arenas/free):", name);
+    for(desc_idx = 0; desc_idx < DESC_CNT; desc_idx++) {
+        printf(" %d/%d/%d", descs[desc_idx].block_size, descs[desc_idx].arena_cnt, descs[desc_idx].free_blocks);
+    }
+    printf("\n");
+}
+
+/*free和meminfo命令的内建函数，显示内存使用情况*/
+void buildin_free(uint32_t argc, char** argv)
+{
+    if(argc != 1) {
+        printf("%s: no argument support!\n", argv[0]);
+        return;
+    }
+    struct meminfo info;
+    if(meminfo(&info) == -1) {
+        printf("%s: get meminfo failed!\n", argv[0]);
+        return;
+    }
+
+    printf("pages   total  used  free  zeroed  peak\n");
+    print_pool_info("kernel", &info.k_pool);
+    print_pool_info("user  ", &info.u_pool);
+    print_desc_info("kernel", info.k_descs);
+    print_desc_info("user", info.u_descs);
+    printf("large allocs: %d, kernel live: %d (%d pages)\n", info.large_allocs, info.k_large_cnt, info.k_large_pages);
+
+    uint32_t hist_idx;
+    printf("malloc sizes:");
+    for(hist_idx = 0; hist_idx < MALLOC_HIST_CNT - 1; hist_idx++) {
+        printf(" <=%d:%d", 16 << hist_idx, info.malloc_hist[hist_idx]);
+    }
+    printf(" >%d:%d\n", 16 << (MALLOC_HIST_CNT - 2), info.malloc_hist[MALLOC_HIST_CNT - 1]);
+}
+
+#define SCHED_PID_SLOTS 64   //汇总时按pid取模跟踪任务状态的槽位数
+#define SCHED_DUMP_CNT 40   //sched -d列出的事件条数，一屏能显示下
+
+/*一项延迟的统计，单位是1024个时钟周期*/
+struct sched_stat
+{
+    uint32_t cnt;
+    uint32_t sum;
+    uint32_t max;
+};
+
+/*把以时钟周期计的延迟delta计入stat*/
+static void sched_stat_add(struct sched_stat* stat, uint64_t delta)
+{
+    uint32_t k_cycles = (uint32_t)(delta >> 10);
+    stat->cnt++;
+    stat->sum += k_cycles;
+    if(k_cycles > stat->max) {
+        stat->max = k_cycles;
+    }
+}
+
+static void print_sched_stat(const char* name, struct sched_stat* stat)
+{
+    printf("%s: %d times, avg %dK, max %dK cycles\n", name, stat->cnt, \
+           stat->cnt ? stat->sum / stat->cnt : 0, stat->max);
+}
+
+/*输出内核地址addr所在的函数名和偏移，找不到时只输出地址*/
+static void print_ksym(uint32_t addr)
+{
+    char name[KSYM_NAME_LEN];
+    int32_t offset = ksym(addr, name, KSYM_NAME_LEN);
+    if(offset == -1) {
+        printf("0x%x", addr);
+    } else {
+        printf("%s+0x%x", name, offset);
+    }
+}
+
+/*逐条列出最近的调度事件，时间是相对第一条事件的千周期数*/
+static void sched_dump(struct sched_event* evs, int32_t cnt)
+{
+    static const char* reasons[] = {"preempt", "yield", "block", "exit"};
+    int32_t idx = cnt > SCHED_DUMP_CNT ? cnt - SCHED_DUMP_CNT : 0;
+    for(; idx < cnt; idx++) {
+        struct sched_event* ev = &evs[idx];
+        printf("%d cpu%d ", (uint32_t)((ev->tsc - evs[0].tsc) >> 10), ev->cpu);
+        switch(ev->type) {
+            case SEV_SWITCH:
+                printf("switch %d -> %d (%s)\n", ev->pid, ev->next_pid, ev->arg <= SWITCH_EXIT ? reasons[ev->arg] : "?");
+                break;
+            case SEV_BLOCK:
+                printf("block %d state %d at ", ev->pid, ev->arg);
+                print_ksym(ev->eip);
+                printf("\n");
+                break;
+            case SEV_WAKEUP:
+                printf("wakeup %d by %d\n", ev->pid, ev->next_pid);
+                break;
+            case SEV_IRQ_ENTER:
+                printf("irq 0x%x enter, pid %d\n", ev->arg, ev->pid);
+                break;
+            case SEV_IRQ_EXIT:
+                printf("irq 0x%x exit, pid %d\n", ev->arg, ev->pid);
+                break;
+        }
+    }
+}
+
+/*汇总就绪队列中的等待、时间片长度和唤醒到运行的延迟*/
+static void sched_summary(struct sched_event* evs, int32_t cnt)
+{
+    uint64_t ready_tsc[SCHED_PID_SLOTS] = {0};   //任务进入就绪队列的时刻
+    bool woken[SCHED_PID_SLOTS] = {0};   //进入就绪队列是否因为被唤醒
+    uint64_t run_tsc[SCHED_PID_SLOTS] = {0};   //任务被换上cpu的时刻
+    struct sched_stat rq_wait = {0}, wakeup_run = {0}, slice = {0};
+    uint32_t reason_cnt[SWITCH_EXIT + 1] = {0};
+    uint32_t irq_cnt = 0;
+
+    int32_t idx;
+    for(idx = 0; idx < cnt; idx++) {
+        struct sched_event* ev = &evs[idx];
+        uint32_t slot = ev->pid % SCHED_PID_SLOTS;
+        if(ev->type == SEV_WAKEUP) {
+            ready_tsc[slot] = ev->tsc;
+            woken[slot] = true;
+        } else if(ev->type == SEV_IRQ_ENTER) {
+            irq_cnt++;
+        } else if(ev->type == SEV_SWITCH) {
+            if(ev->arg <= SWITCH_EXIT) {
+                reason_cnt[ev->arg]++;
+            }
+            if(run_tsc[slot] != 0) {
+                sched_stat_add(&slice, ev->tsc - run_tsc[slot]);
+                run_tsc[slot] = 0;
+            }
+            if(ev->arg == SWITCH_PREEMPT || ev->arg == SWITCH_YIELD) {   //仍然就绪，回到队列中等待
+                ready_tsc[slot] = ev->tsc;
+                woken[slot] = false;
+            }
+            uint32_t next_slot = ev->next_pid % SCHED_PID_SLOTS;
+            if(ready_tsc[next_slot] != 0) {
+                sched_stat_add(&rq_wait, ev->tsc - ready_tsc[next_slot]);
+                if(woken[next_slot]) {
+                    sched_stat_add(&wakeup_run, ev->tsc - ready_tsc[next_slot]);
+                }
+                ready_tsc[next_slot] = 0;
+            }
+            run_tsc[next_slot] = ev->tsc;
+        }
+    }
+
+    printf("%d events over %dK cycles, %d irqs\n", cnt, (uint32_t)((evs[cnt - 1].tsc - evs[0].tsc) >> 10), irq_cnt);
+    printf("switches: preempt %d, yield %d, block %d, exit %d\n", \
+           reason_cnt[SWITCH_PREEMPT], reason_cnt[SWITCH_YIELD], reason_cnt[SWITCH_BLOCK], reason_cnt[SWITCH_EXIT]);
+    print_sched_stat("run queue wait", &rq_wait);
+    print_sched_stat("wakeup to run", &wakeup_run);
+    print_sched_stat("time slice", &slice);
+}
+
+/*sched命令的内建函数，汇总最近的调度事件，-d时逐条列出*/
+void buildin_sched(uint32_t argc, char** argv)
+{
+    if(argc > 2 || (argc == 2 && strcmp(argv[1], "-d"))) {
+        printf("usage: sched [-d]\n");
+        return;
+    }
+    struct sched_event* evs = malloc(SCHED_TRACE_CNT * sizeof(struct sched_event));
+    if(evs == NULL) {
+        printf("sched: malloc failed!\n");
+        return;
+    }
+    int32_t cnt = sched_trace(evs, SCHED_TRACE_CNT);
+    if(cnt <= 0) {
+        printf("sched: no events\n");
+    } else if(argc == 2) {
+        sched_dump(evs, cnt);
+    } else {
+        sched_summary(evs, cnt);
+    }
+    free(evs);
+}
+
+/*iostat命令的内建函数，显示各硬盘和分区的io统计。
+  util是有请求未完成的时间占开机以来的百分比，avgq是忙碌时的平均队列深度*/
+void buildin_iostat(uint32_t argc, char** argv UNUSED)
+{
+    if(argc != 1) {
+        printf("iostat: no argument support!\n");
+        return;
+    }
+    struct iostat_entry* entries = malloc(IOSTAT_MAX * sizeof(struct iostat_entry));
+    if(entries == NULL) {
+        printf("iostat: malloc failed!\n");
+        return;
+    }
+    int32_t cnt = iostat(entries, IOSTAT_MAX);
+    uint32_t now = uptime();
+    if(now == 0) {
+        now = 1;
+    }
+    int32_t idx;
+    for(idx = 0; idx < cnt; idx++) {
+        struct iostat_entry* entry = &entries[idx];
+        struct io_stats* st = &entry->stats;
+        uint32_t avgq = st->busy_ticks == 0 ? 0 : st->queue_ticks * 10 / st->busy_ticks;   //保留一位小数
+        printf("%s%s: read %d (%d secs), write %d (%d secs), merged %d\n", \
+               entry->is_disk ? "" : "  ", entry->name, st->reads, st->read_secs, st->writes, st->write_secs, st->merged);
+        printf("%s    inflight %d, busy %d ticks, util %d percent, avgq %d.%d\n", \
+               entry->is_disk ? "" : "  ", st->in_flight, st->busy_ticks, st->busy_ticks * 100 / now, avgq / 10, avgq % 10);
+    }
+    free(entries);
+}
+
+/*一次采样：各任务的统计和各系统调用号的统计*/
+struct top_sample
+{
+    struct taskstat_entry tasks[TOP_MAX_TASKS];
+    int32_t task_cnt;
+    struct syscall_stat calls[syscall_nr];
+    uint32_t tick;   //采样时的滴答数
+};
+
+/*在last中找pid的任务，没有返回NULL*/
+static struct taskstat_entry* top_find(struct top_sample* last, pid_t pid)
+{
+    int32_t idx;
+    for(idx = 0; idx < last->task_cnt; idx++) {
+        if(last->tasks[idx].pid == pid) {
+            return &last->tasks[idx];
+        }
+    }
+    return NULL;
+}
+
+/*在line末尾追加text，用空格补足width列*/
+static void top_field(char* line, const char* text, uint32_t width)
+{
+    uint32_t len = strlen(text);
+    strcat(line, text);
+    line += strlen(line);
+    while(len++ < width) {
+        *line++ = ' ';
+    }
+    *line = 0;
+}
+
+/*在line末尾追加数值val，用空格补足width列*/
+static void top_num(char* line, uint32_t val, uint32_t width)
+{
+    char buf[12];
+    sprintf(buf, "%d", val);
+    top_field(line, buf, width);
+}
+
+/*按两次采样之差显示一屏，任务按这段时间占用的滴答数从多到少排列。除USR、SYS外各列都是这段时间内的增量*/
+static void top_show(struct top_sample* last, struct top_sample* now)
+{
+    struct task_stats delta[TOP_MAX_TASKS];
+    int32_t order[TOP_MAX_TASKS];
+    int32_t idx, pos;
+    for(idx = 0; idx < now->task_cnt; idx++) {
+        struct task_stats* cur = &now->tasks[idx].stats;
+        struct taskstat_entry* old = top_find(last, now->tasks[idx].pid);
+        delta[idx] = *cur;
+        if(old != NULL) {
+            delta[idx].utime -= old->stats.utime;
+            delta[idx].stime -= old->stats.stime;
+            delta[idx].syscalls -= old->stats.syscalls;
+            delta[idx].page_faults -= old->stats.page_faults;
+            delta[idx].read_secs -= old->stats.read_secs;
+            delta[idx].write_secs -= old->stats.write_secs;
+            delta[idx].nvcsw -= old->stats.nvcsw;
+            delta[idx].nivcsw -= old->stats.nivcsw;
+        }
+        //插入排序，任务不多
+        uint32_t busy = delta[idx].utime + delta[idx].stime;
+        for(pos = idx; pos > 0 && delta[order[pos - 1]].utime + delta[order[pos - 1]].stime < busy; pos--) {
+            order[pos] = order[pos - 1];
+        }
+        order[pos] = idx;
+    }
+
+    uint32_t interval = now->tick - last->tick;
+    if(interval == 0) {
+        interval = 1;
+    }
+    clear();
+    printf("top: up %d ticks, %d tasks, last %d ticks, press q to quit\n", now->tick, now->task_cnt, interval);
+    printf("PID   PPID  S  CPU   USR     SYS     CALLS  FAULT  RDSEC  WRSEC  VCSW  IVCSW  NAME\n");
+    for(pos = 0; pos < now->task_cnt && pos < TOP_ROWS; pos++) {
+        struct taskstat_entry* entry = &now->tasks[order[pos]];
+        struct task_stats* d = &delta[order[pos]];
+        char line[128] = {0};
+        top_num(line, entry->pid, 6);
+        if(entry->parent_pid == -1) {
+            top_field(line, "-", 6);
+        } else {
+            top_num(line, entry->parent_pid, 6);
+        }
+        char stat[2] = {entry->status <= TASK_DIED ? "RrBWHD"[entry->status] : '?', 0};   //运行、就绪、阻塞、等待、挂起、死亡
+        top_field(line, stat, 3);
+        top_num(line, (d->utime + d->stime) * 100 / interval, 6);
+        top_num(line, entry->stats.utime, 8);
+        top_num(line, entry->stats.stime, 8);
+        top_num(line, d->syscalls, 7);
+        top_num(line, d->page_faults, 7);
+        top_num(line, d->read_secs, 7);
+        top_num(line, d->write_secs, 7);
+        top_num(line, d->nvcsw, 6);
+        top_num(line, d->nivcsw, 7);
+        top_field(line, entry->name, 0);
+        printf("%s\n", line);
+    }
+
+    //这段时间内耗时最多的几个系统调用，周期数按1024取整，免得做64位除法
+    int32_t top_nr[TOP_SYSCALL_ROWS];
+    uint32_t top_k[TOP_SYSCALL_ROWS];
+    int32_t top_cnt = 0;
+    for(idx = 0; idx < syscall_nr; idx++) {
+        uint32_t k_cycles = (uint32_t)((now->calls[idx].cycles - last->calls[idx].cycles) >> 10);
+        if(now->calls[idx].cnt == last->calls[idx].cnt) {
+            continue;
+        }
+        for(pos = top_cnt < TOP_SYSCALL_ROWS ? top_cnt++ : TOP_SYSCALL_ROWS; pos > 0 && top_k[pos - 1] < k_cycles; pos--) {
+            if(pos < TOP_SYSCALL_ROWS) {
+                top_nr[pos] = top_nr[pos - 1];
+                top_k[pos] = top_k[pos - 1];
+            }
+        }
+        if(pos < TOP_SYSCALL_ROWS) {
+            top_nr[pos] = idx;
+            top_k[pos] = k_cycles;
+        }
+    }
+    for(pos = 0; pos < top_cnt; pos++) {
+        uint32_t calls = now->calls[top_nr[pos]].cnt - last->calls[top_nr[pos]].cnt;
+        printf("syscall %d: %d calls, %dK cycles, avg %dK\n", top_nr[pos], calls, top_k[pos], top_k[pos] / calls);
+    }
+}
+
+/*top命令的内建函数，每隔TOP_INTERVAL毫秒刷新各任务的cpu占用、系统调用、页错误、读写扇区和切换次数，按q退出，按其他键立即刷新*/
+void buildin_top(uint32_t argc, char** argv UNUSED)
+{
+    if(argc != 1) {
+        printf("top: no argument support!\n");
+        return;
+    }
+    struct top_sample* samples = malloc(2 * sizeof(struct top_sample));
+    if(samples == NULL) {
+        printf("top: malloc failed!\n");
+        return;
+    }
+    struct top_sample* last = &samples[0];
+    struct top_sample* now = &samples[1];
+    memset(last, 0, sizeof(struct top_sample));   //第一屏显示开机以来的累计值
+    int32_t old_mode = ioctl(stdin_no, TTY_GET_MODE, 0);
+    ioctl(stdin_no, TTY_SET_MODE, 0);   //按键不必回车，也不回显
+
+    while(1) {
+        now->tick = uptime();
+        now->task_cnt = taskstats(now->tasks, TOP_MAX_TASKS);
+        syscall_stats(now->calls, syscall_nr);
+        if(now->task_cnt < 0) {
+            printf("top: taskstats failed!\n");
+            break;
+        }
+        top_show(last, now);
+        struct top_sample* tmp = last;
+        last = now;
+        now = tmp;
+
+        struct pollfd pfd = {stdin_no, POLLIN, 0};
+        char key = 0;
+        if(poll(&pfd, 1, TOP_INTERVAL) > 0 && read(stdin_no, &key, 1) == 1 && key == 'q') {
+            break;
+        }
+    }
+    if(old_mode != -1) {
+        ioctl(stdin_no, TTY_SET_MODE, old_mode);
+    }
+    free(samples);
+}
+
+/*df命令的内建函数，显示当前分区的空间和inode使用情况*/
+void buildin_df(uint32_t argc, char** argv UNUSED)
+{
+    if(argc != 1) {
+        printf("df: no argument support!\n");
+        return;
+    }
+    struct statfs info;
+    if(statfs(&info) == -1) {
+        printf("df: statfs failed!\n");
+        return;
+    }
+    uint32_t kb_per_block = info.f_bsize / 1024;
+    uint32_t used = info.f_blocks - info.f_bfree;
+    printf("filesystem  size(KB)  used(KB)  free(KB)  use  inodes  ifree\n");
+    printf("%s        %d  %d  %d  %d percent  %d  %d\n", info.f_name, info.f_blocks * kb_per_block, used * kb_per_block, \
+           info.f_bfree * kb_per_block, info.f_blocks == 0 ? 0 : used * 100 / info.f_blocks, info.f_files, info.f_ffree);
+}
+
+/*fsck命令的内建函数，检查当前分区的元数据，不一致的详情由内核打印*/
+void buildin_fsck(uint32_t argc, char** argv UNUSED)
+{
+    if(argc != 1) {
+        printf("fsck: no argument support!\n");
+        return;
+    }
+    struct fsck_report report;
+    if(fsck(&report) == -1) {
+        printf("fsck: check failed!\n");
+        return;
+    }
+    printf("fsck: %d dirs, %d files, %d blocks, %d errors\n", report.dirs, report.files, report.blocks, report.errors);
+}
+
+/*dmesg命令的内建函数，输出内核日志缓冲区中保留的内容*/
+void buildin_dmesg(uint32_t argc, char** argv UNUSED)
+{
+    if(argc != 1) {
+        printf("dmesg: no argument support!\n");
+        return;
+    }
+    char* buf = malloc(KLOG_BUF_SIZE);
+    if(buf == NULL) {
+        printf("dmesg: malloc failed!\n");
+        return;
+    }
+    uint32_t len = dmesg(buf, KLOG_BUF_SIZE);
+    fwrite(buf, 1, len, stdout);
+    free(buf);
+}
+
+/*boottime命令的内建函数，显示init_all中各启动阶段的耗时，嵌套的阶段缩进显示*/
+void buildin_boottime(uint32_t argc, char** argv UNUSED)
+{
+    if(argc != 1) {
+        printf("boottime: no argument support!\n");
+        return;
+    }
+    struct boot_stage* stages = malloc(BOOT_STAGE_MAX * sizeof(struct boot_stage));
+    if(stages == NULL) {
+        printf("boottime: malloc failed!\n");
+        return;
+    }
+    int32_t cnt = boot_stats(stages, BOOT_STAGE_MAX);
+    int32_t idx;
+    for(idx = 0; idx < cnt; idx++) {
+        struct boot_stage* stage = &stages[idx];
+        uint32_t depth;
+        for(depth = 0; depth < stage->depth; depth++) {
+            printf("  ");
+        }
+        printf("%s: %dK cycles, %d ticks\n", stage->name, (uint32_t)(stage->cycles >> 10), stage->ticks);
+    }
+    free(stages);
+}
+
+#define BENCH_USER_ITERS 256   //用户态基准的循环次数
+#define BENCH_FORK_ITERS 32   //fork+wait基准的循环次数
+
+/*用户态null syscall基准：getpid直接进内核，不经过vdso*/
+static void bench_null_syscall(void)
+{
+    getpid();
+}
+
+/*用户态fork+wait基准：子进程立即退出，父进程等它*/
+static void bench_fork_wait(void)
+{
+    pid_t pid = fork();
+    if(pid == 0) {
+        exit(0);
+    }
+    if(pid != -1) {
+        int32_t status;
+        wait(&status);
+    }
+}
+
+/*在用户态运行iters次body，统计最小值、中位数和99分位数存入res*/
+static void bench_user_run(void (*body)(void), uint32_t iters, struct bench_result* res)
+{
+    uint64_t* samples = malloc(iters * sizeof(uint64_t));
+    if(samples == NULL) {
+        res->iters = 0;
+        return;
+    }
+    uint32_t i, j;
+    for(i = 0; i < iters; i++) {
+        uint64_t start, end;
+        asm volatile ("rdtsc" : "=A"(start));
+        body();
+        asm volatile ("rdtsc" : "=A"(end));
+        samples[i] = end - start;
+    }
+    for(i = 1; i < iters; i++) {   //样本不多，用插入排序
+        uint64_t cur = samples[i];
+        for(j = i; j > 0 && samples[j - 1] > cur; j--) {
+            samples[j] = samples[j - 1];
+        }
+        samples[j] = cur;
+    }
+    res->iters = iters;
+    res->min = samples[0];
+    res->median = samples[iters / 2];
+    res->p99 = samples[iters * 99 / 100];
+    free(samples);
+}
+
+/*输出一项基准的结果，单位为时钟周期*/
+static void bench_show(struct bench_result* res)
+{
+    if(res->iters == 0) {
+        printf("%s: setup failed\n", res->name);
+        return;
+    }
+    printf("%s: %d iters, min %d, median %d, p99 %d cycles\n", res->name, res->iters, \
+           (uint32_t)res->min, (uint32_t)res->median, (uint32_t)res->p99);
+}
+
+/*bench命令的内建函数，运行用户态和内核中的各项微基准，有参数时只运行名字以它开头的*/
+void buildin_bench(uint32_t argc, char** argv)
+{
+    if(argc > 2) {
+        printf("bench: only support 1 argument!\n");
+        return;
+    }
+    const char* prefix = argc == 2 ? argv[1] : "";
+    uint32_t prefix_len = strlen(prefix);
+    struct bench_result res;
+    memset(&res, 0, sizeof(res));
+    strcpy(res.name, "null syscall");
+    if(!strncmp(res.name, prefix, prefix_len)) {
+        bench_user_run(bench_null_syscall, BENCH_USER_ITERS, &res);
+        bench_show(&res);
+    }
+    strcpy(res.name, "fork+wait");
+    if(!strncmp(res.name, prefix, prefix_len)) {
+        bench_user_run(bench_fork_wait, BENCH_FORK_ITERS, &res);
+        bench_show(&res);
+    }
+    uint32_t idx;
+    for(idx = 0; bench(idx, &res, false) == 0; idx++) {
+        if(!strncmp(res.name, prefix, prefix_len)) {
+            bench(idx, &res, true);
+            bench_show(&res);
+        }
+    }
+}
+
+#define PROF_MAX_PIDS 32   //prof dump分别统计的进程数，更多的进程不单独列出
+#define PROF_EIP_SLOTS 1024   //统计各eip样本数的散列表大小，需为2的幂
+#define PROF_TOP_EIPS 10   //列出样本最多的eip个数
+
+/*一个进程或一个eip的样本数*/
+struct prof_count
+{
+    uint32_t key;   //pid或eip
+    uint32_t user;   //用户态的样本数
+    uint32_t kernel;   //内核态的样本数
+};
+
+/*在cnt项的散列表table中找key的项，没有时占一个空项，表满返回NULL。key为0的项是空项*/
+static struct prof_count* prof_slot(struct prof_count* table, uint32_t cnt, uint32_t key)
+{
+    uint32_t idx = (key * 2654435761U) & (cnt - 1);
+    uint32_t probe;
+    for(probe = 0; probe < cnt; probe++) {
+        struct prof_count* slot = &table[(idx + probe) & (cnt - 1)];
+        if(slot->key == key || slot->key == 0) {
+            slot->key = key;
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/*按进程和eip汇总样本，输出各进程用户态、内核态的样本数和样本最多的几个eip*/
+static void prof_report(struct profile_sample* samples, uint32_t cnt)
+{
+    struct prof_count* pids = malloc(PROF_MAX_PIDS * sizeof(struct prof_count));
+    struct prof_count* eips = malloc(PROF_EIP_SLOTS * sizeof(struct prof_count));
+    if(pids == NULL || eips == NULL) {
+        printf("prof: malloc failed!\n");
+        free(pids);
+        free(eips);
+        return;
+    }
+    memset(pids, 0, PROF_MAX_PIDS * sizeof(struct prof_count));
+    memset(eips, 0, PROF_EIP_SLOTS * sizeof(struct prof_count));
+    uint32_t idx;
+    for(idx = 0; idx < cnt; idx++) {
+        struct profile_sample* s = &samples[idx];
+        struct prof_count* p = prof_slot(pids, PROF_MAX_PIDS, s->pid);
+        struct prof_count* e = prof_slot(eips, PROF_EIP_SLOTS, s->eip);
+        if(p != NULL) {
+            *(s->cpl == 0 ? &p->kernel : &p->user) += 1;
+        }
+        if(e != NULL) {
+            *(s->cpl == 0 ? &e->kernel : &e->user) += 1;
+        }
+    }
+    printf("pid  user  kernel\n");
+    for(idx = 0; idx < PROF_MAX_PIDS; idx++) {
+        if(pids[idx].key != 0) {
+            printf("%d  %d  %d\n", pids[idx].key, pids[idx].user, pids[idx].kernel);
+        }
+    }
+    printf("eip  user  kernel\n");
+    uint32_t top;
+    for(top = 0; top < PROF_TOP_EIPS; top++) {   //每次挑出剩下的样本最多的一项，输出后清掉
+        struct prof_count* max = NULL;
+        for(idx = 0; idx < PROF_EIP_SLOTS; idx++) {
+            struct prof_count* e = &eips[idx];
+            if(e->key != 0 && (max == NULL || e->user + e->kernel > max->user + max->kernel)) {
+                max = e;
+            }
+        }
+        if(max == NULL) {
+            break;
+        }
+        printf("0x%x  %d  %d", max->key, max->user, max->kernel);
+        if(max->kernel != 0) {
+            printf("  ");
+            print_ksym(max->key);
+        }
+        printf("\n");
+        max->key = 0;
+    }
+    free(pids);
+    free(eips);
+}
+
+/*prof命令的内建函数：start [hz]按hz采样，省略时每个滴答采样一次；stop停止采样；dump汇总输出样本*/
+void buildin_prof(uint32_t argc, char** argv)
+{
+    if(argc == 2 && !strcmp(argv[1], "stop")) {
+        int32_t total = profile(PROFILE_STOP, 0, NULL);
+        printf("prof: stopped, %d samples\n", total);
+        return;
+    }
+    if(argc == 2 && !strcmp(argv[1], "dump")) {
+        struct profile_sample* samples = malloc(PROFILE_MAX_SAMPLES * sizeof(struct profile_sample));
+        if(samples == NULL) {
+            printf("prof: malloc failed!\n");
+            return;
+        }
+        int32_t cnt = profile(PROFILE_DUMP, PROFILE_MAX_SAMPLES, samples);
+        if(cnt <= 0) {
+            printf("prof: no samples\n");
+        } else {
+            prof_report(samples, cnt);
+        }
+        free(samples);
+        return;
+    }
+    if((argc == 2 || argc == 3) && !strcmp(argv[1], "start")) {
+        uint32_t hz = 0;
+        char* digit = argc == 3 ? argv[2] : "";
+        while(*digit >= '0' && *digit <= '9') {
+            hz = hz * 10 + (*digit++ - '0');
+        }
+        if(*digit != 0 || profile(PROFILE_START, hz, NULL) == -1) {
+            printf("prof: start failed\n");
+        }
+        return;
+    }
+    printf("usage: prof start [hz] | stop | dump\n");
+}
+
+/*stats命令的内建函数，列出内核各计数器在各cpu上的合计*/
+void buildin_stats(uint32_t argc, char** argv UNUSED)
+{
+    if(argc != 1) {
+        printf("stats: no argument support!\n");
+        return;
+    }
+    struct counter_entry* entries = malloc(COUNTER_MAX * sizeof(struct counter_entry));
+    if(entries == NULL) {
+        printf("stats: malloc failed!\n");
+        return;
+    }
+    int32_t cnt = stats(entries, COUNTER_MAX);
+    int32_t idx;
+    for(idx = 0; idx < cnt; idx++) {
+        printf("%s: %d\n", entries[idx].name, entries[idx].value);
+    }
+    free(entries);
+}
+
 /*clear命令内建函数*/
 void buildin_clear(uint32_t argc, char** argv UNUSED)
 {
@@ -284,3 +1011,127 @@ void buildin_help(int32_t argc, char** argv)
         help();
     }
 }
+
+#define CMD_HASH_SLOTS 16   //命令查找缓存的项数，需为2的幂
+#define CMD_HASH_PATH_LEN 64   //缓存的路径最长的字节数，含结尾的0，更长的不缓存
+
+/*命令查找缓存的一项：清洗后的绝对路径解析出的程序inode号*/
+struct cmd_hash
+{
+    char path[CMD_HASH_PATH_LEN];   //空串表示空项
+    uint32_t i_no;
+    uint32_t gen;   //解析时的目录项删除次数，删除过目录项后spawn_inode拒绝旧的解析结果
+    uint32_t hits;   //跳过路径解析的次数
+};
+
+static struct cmd_hash cmd_hashes[CMD_HASH_SLOTS];
+
+/*返回path在缓存中对应的槽，按路径的散列值直接映射，冲突的路径互相替换*/
+static struct cmd_hash* cmd_hash_slot(const char* path)
+{
+    uint32_t hash = 0;
+    while(*path) {
+        hash = hash * 31 + (uint8_t)*path++;
+    }
+    return &cmd_hashes[hash & (CMD_HASH_SLOTS - 1)];
+}
+
+/*用spawn_inode运行绝对路径为path的外部命令argv，path在缓存中时跳过路径解析，不在缓存中或已失效时重新解析并记下。
+  返回子进程的pid，失败返回-1。标准输出此时可能是管道，出错信息写到标准错误*/
+int32_t cmd_hash_spawn(const char* path, char** argv)
+{
+    struct cmd_hash* entry = cmd_hash_slot(path);
+    bool cached = !strcmp(entry->path, path);
+    if(cached) {
+        pid_t pid = spawn_inode(entry->i_no, entry->gen, (const char**)argv);
+        if(pid != -1) {
+            entry->hits++;
+            return pid;
+        }
+    }
+    uint32_t gen;
+    int32_t i_no = exec_lookup(path, &gen);
+    if(i_no == -1) {
+        if(cached) {
+            entry->path[0] = 0;
+        }
+        fprintf(stderr, "my_shell: cannot access %s: No such file\n", path);
+        return -1;
+    }
+    if(strlen(path) < CMD_HASH_PATH_LEN) {
+        if(!cached) {
+            strcpy(entry->path, path);
+            entry->hits = 0;
+        }
+        entry->i_no = i_no;
+        entry->gen = gen;
+    }
+    pid_t pid = spawn_inode(i_no, gen, (const char**)argv);
+    if(pid == -1) {
+        fprintf(stderr, "my_shell: spawn %s failed\n", path);
+    }
+    return pid;
+}
+
+/*hash命令的内建函数，列出命令查找缓存中的各项，-r清空缓存*/
+void buildin_hash(uint32_t argc, char** argv)
+{
+    if(argc == 2 && !strcmp(argv[1], "-r")) {
+        memset(cmd_hashes, 0, sizeof(cmd_hashes));
+        return;
+    }
+    if(argc != 1) {
+        printf("usage: hash [-r]\n");
+        return;
+    }
+    printf("hits  inode  command\n");
+    uint32_t idx;
+    for(idx = 0; idx < CMD_HASH_SLOTS; idx++) {
+        if(cmd_hashes[idx].path[0] != 0) {
+            printf("%d  %d  %s\n", cmd_hashes[idx].hits, cmd_hashes[idx].i_no, cmd_hashes[idx].path);
+        }
+    }
+}
+
+/*把宿主机共享目录中的文件name导入到dest，dest为NULL时导入到当前目录下的同名文件*/
+static void import_one(const char* name, char* dest)
+{
+    char path[MAX_PATH_LEN];
+    make_clear_abs_path(dest != NULL ? dest : (char*)name, path);
+    int32_t bytes = hostshare_import(name, path);
+    if(bytes == -1) {
+        printf("import: copy %s to %s failed\n", name, path);
+    } else {
+        printf("%s -> %s, %d bytes\n", name, path, bytes);
+    }
+}
+
+/*import命令的内建函数。不带参数时列出宿主机共享目录中的文件，-a导入全部文件到当前目录，
+  import name [dest]导入一个文件，已有的同名文件被替换*/
+void buildin_import(uint32_t argc, char** argv)
+{
+    struct hostshare_entry entry;
+    uint32_t idx = 0;
+    int32_t ret;
+    if(argc == 1 || (argc == 2 && !strcmp(argv[1], "-a"))) {
+        bool all = argc == 2;
+        while((ret = hostshare_list(idx++, &entry)) != -1) {
+            if(ret == 1) {
+                printf("%s...: name too long, skipped\n", entry.name);
+            } else if(all) {
+                import_one(entry.name, NULL);
+            } else {
+                printf("%d  %s\n", entry.size, entry.name);
+            }
+        }
+        if(idx == 1) {
+            printf("import: no host share or it is empty\n");
+        }
+        return;
+    }
+    if(argc > 3 || argv[1][0] == '-') {
+        printf("usage: import [-a | name [dest]]\n");
+        return;
+    }
+    import_one(argv[1], argc == 3 ? argv[2] : NULL);
+}
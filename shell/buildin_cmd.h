@@ -12,6 +12,28 @@ char* buildin_cd(uint32_t argc, char** argv);
 char* buildin_cd(uint32_t argc, char** argv);
 /* ls命令的内建函数 */
 void buildin_ls(uint32_t argc, char** argv);
+/*free和meminfo命令的内建函数*/
+void buildin_free(uint32_t argc, char** argv);
+/*sched命令的内建函数*/
+void buildin_sched(uint32_t argc, char** argv);
+/*iostat命令的内建函数*/
+void buildin_iostat(uint32_t argc, char** argv);
+/*top命令的内建函数*/
+void buildin_top(uint32_t argc, char** argv UNUSED);
+/*df命令的内建函数*/
+void buildin_df(uint32_t argc, char** argv UNUSED);
+/*fsck命令的内建函数*/
+void buildin_fsck(uint32_t argc, char** argv UNUSED);
+/*dmesg命令的内建函数*/
+void buildin_dmesg(uint32_t argc, char** argv UNUSED);
+/*boottime命令的内建函数*/
+void buildin_boottime(uint32_t argc, char** argv UNUSED);
+/*bench命令的内建函数*/
+void buildin_bench(uint32_t argc, char** argv);
+/*prof命令的内建函数*/
+void buildin_prof(uint32_t argc, char** argv);
+/*stats命令的内建函数*/
+void buildin_stats(uint32_t argc, char** argv UNUSED);
 /*clear命令内建函数*/
 void buildin_clear(uint32_t argc, char** argv UNUSED);
 /*mkdir命令内建函数*/
@@ -21,5 +43,11 @@ int32_t buildin_rmdir(uint32_t argc, char** argv);
 /*rm命令内建函数*/
 int32_t buildin_rm(uint32_t argc, char** argv);
 void buildin_help(int32_t argc, char** argv);
+/*用spawn_inode运行绝对路径为path的外部命令argv，path在命令查找缓存中时跳过路径解析，返回子进程的pid，失败返回-1*/
+int32_t cmd_hash_spawn(const char* path, char** argv);
+/*hash命令的内建函数*/
+void buildin_hash(uint32_t argc, char** argv);
+/*import命令的内建函数*/
+void buildin_import(uint32_t argc, char** argv);
 
 #endif
\ No newline at end of file
@@ -4,76 +4,284 @@
 #include "global.h"
 #include "file.h"
 #include "memory.h"
-#include "ioqueue.h"
+#include "thread.h"
+#include "interrupt.h"
+#include "string.h"
+#include "stdio-kernel.h"
+#include "sync.h"
+#include "poll.h"
+
+static int32_t pipe_file_read(struct file* file, void* buf, uint32_t count);
+static int32_t pipe_file_write(struct file* file, const void* buf, uint32_t count);
+static int32_t pipe_release(struct file* file);
+
+const struct file_operations pipe_fops = {pipe_file_read, pipe_file_write, pipe_release};
 
 /*判断文件描述符local_fd是否是管道*/
 bool is_pipe(uint32_t local_fd)
 {
-    uint32_t global_fd = fd_local2global(local_fd);
-    return file_table[global_fd].fd_flag == PIPE_FLAG;
+    struct file* file = fd_local2file(local_fd);
+    return file != NULL && file->fd_ops == &pipe_fops;
 }
 
-/*创建管道，成功返回0，失败返回-1*/
-int32_t sys_pipe(int32_t pipefd[2])
+/*返回file所属的管道，file不是管道时返回NULL*/
+static struct pipe* pipe_of(struct file* file)
 {
-    int32_t global_fd = get_free_slot_in_global();
+    if(file == NULL || file->fd_ops != &pipe_fops) {
+        return NULL;
+    }
+    return file->fd_private;
+}
 
-    //申请一页内核内存做环形缓冲区
-    file_table[global_fd].fd_inode = get_kernel_pages(1);
+/*把pipe中最早的n个字节复制到dst，不移动读位置。数据最多分成到缓冲区末尾和绕回开头两段*/
+static void pipe_copy_out(struct pipe* pipe, char* dst, uint32_t n)
+{
+    uint32_t first = pipe->size - pipe->tail;
+    if(first > n) {
+        first = n;
+    }
+    memcpy(dst, pipe->buf + pipe->tail, first);
+    memcpy(dst + first, pipe->buf, n - first);
+}
 
-    //初始化环形缓冲区
-    ioqueue_init((struct ioqueue*)file_table[global_fd].fd_inode);
-    if(file_table[global_fd].fd_inode == NULL) {
+/*把src中的n个字节接在pipe已有数据之后，调用者保证空间足够*/
+static void pipe_copy_in(struct pipe* pipe, const char* src, uint32_t n)
+{
+    uint32_t head = (pipe->tail + pipe->len) % pipe->size;
+    uint32_t first = pipe->size - head;
+    if(first > n) {
+        first = n;
+    }
+    memcpy(pipe->buf + head, src, first);
+    memcpy(pipe->buf, src + first, n - first);
+    pipe->len += n;
+}
+
+/*创建管道，pipefd[0]是读端，pipefd[1]是写端，成功返回0，失败返回-1*/
+int32_t sys_pipe(int32_t pipefd[2])
+{
+    //申请一页内核内存，开头放管道结构，剩下的做环形缓冲区
+    struct pipe* pipe = get_kernel_pages(1);
+    if(pipe == NULL) {
+        return -1;
+    }
+    struct file* rd_file = file_alloc();
+    struct file* wr_file = rd_file == NULL ? NULL : file_alloc();
+    if(wr_file == NULL) {
+        if(rd_file != NULL) {
+            file_free(rd_file);
+        }
+        mfree_page(PF_KERNEL, pipe, 1);
         return -1;
     }
 
-    //将fd_flag复用为管道标志
-    file_table[global_fd].fd_flag = PIPE_FLAG;
+    pipe->buf = (char*)(pipe + 1);
+    pipe->size = PG_SIZE - sizeof(struct pipe);
+    pipe->pg_cnt = 0;
+    pipe->tail = pipe->len = 0;
+    pipe->readers = pipe->writers = 1;
+    wait_queue_init(&pipe->read_wq);
+    wait_queue_init(&pipe->write_wq);
+
+    rd_file->fd_flag = O_RDONLY;
+    wr_file->fd_flag = O_WRONLY;
+    rd_file->fd_ops = wr_file->fd_ops = &pipe_fops;
+    rd_file->fd_private = wr_file->fd_private = pipe;
 
-    //将fd_pos复用为管道打开次数
-    file_table[global_fd].fd_pos = 2;
-    pipefd[0] = pcb_fd_install(global_fd);
-    pipefd[1] = pcb_fd_install(global_fd);
+    pipefd[0] = pcb_fd_install(rd_file);
+    pipefd[1] = pipefd[0] == -1 ? -1 : pcb_fd_install(wr_file);
+    if(pipefd[1] == -1) {
+        if(pipefd[0] != -1) {
+            pcb_fd_uninstall(pipefd[0]);
+        }
+        file_free(rd_file);
+        file_free(wr_file);
+        mfree_page(PF_KERNEL, pipe, 1);
+        return -1;
+    }
     return 0;
 }
 
-/*管道中读数据*/
-uint32_t pipe_read(int32_t fd, void* buf, uint32_t count)
+/*从管道读端file读出最多count个字节，没有数据时等待，写端都关闭后返回0，成功返回读出的字节数，失败返回-1*/
+static int32_t pipe_file_read(struct file* file, void* buf, uint32_t count)
 {
-    char* buffer = buf;
-    uint32_t bytes_read = 0;
-    uint32_t global_fd = fd_local2global(fd);
-
-    //获取管道的环形缓冲区
-    struct ioqueue* ioq = (struct ioqueue*)file_table[global_fd].fd_inode;
-
-    //选择较小的数据读取量，避免阻塞
-    uint32_t ioq_len = ioq_length(ioq);
-    uint32_t size = ioq_len > count ? count : ioq_len;
-    while(bytes_read < size) {
-        *buffer = ioq_getchar(ioq);
-        bytes_read++;
-        buffer++;
-    }
-    return bytes_read;
+    struct pipe* pipe = pipe_of(file);
+    if(pipe == NULL || (file->fd_flag & O_WRONLY)) {
+        printk("pipe_read: fd is not a pipe read end\n");
+        return -1;
+    }
+    if(count == 0) {
+        return 0;
+    }
+
+    enum intr_status old_status = intr_disable();
+    while(pipe->len == 0) {
+        if(pipe->writers == 0) {   //没有数据也不会再有了
+            intr_set_status(old_status);
+            return 0;
+        }
+        wait_queue_sleep(&pipe->read_wq);
+    }
+    uint32_t size = count < pipe->len ? count : pipe->len;
+    pipe_copy_out(pipe, buf, size);
+    pipe->tail = (pipe->tail + size) % pipe->size;
+    pipe->len -= size;
+    wait_queue_wake_all(&pipe->write_wq);   //一次读完只唤醒一次写者
+    intr_set_status(old_status);
+    return size;
 }
 
-/*管道中写数据*/
-uint32_t pipe_write(int32_t fd, const void* buf, uint32_t count)
+/*把count个字节全部写入管道，满了等读端取走，读端都关闭后返回-1，成功返回count。
+  不超过PIPE_BUF的写入等到空间足够时一次放入，更大的写入有多少空间放多少*/
+static int32_t pipe_file_write(struct file* file, const void* buf, uint32_t count)
 {
-    uint32_t bytes_write = 0;
-    uint32_t global_fd = fd_local2global(fd);
-    struct ioqueue* ioq = (struct ioqueue*)file_table[global_fd].fd_inode;
+    struct pipe* pipe = pipe_of(file);
+    if(pipe == NULL || !(file->fd_flag & O_WRONLY)) {
+        printk("pipe_write: fd is not a pipe write end\n");
+        return -1;
+    }
+    const char* src = buf;
+    uint32_t written = 0;
 
-    //选择较小的数据写入量，避免阻塞
-    uint32_t ioq_left = bufsize - ioq_length(ioq);
-    uint32_t size = ioq_left > count ? count : ioq_left;
+    enum intr_status old_status = intr_disable();
+    while(written < count) {
+        if(pipe->readers == 0) {   //没人读了，已写入的部分照常返回
+            break;
+        }
+        uint32_t space = pipe->size - pipe->len;
+        uint32_t left = count - written;
+        if(space == 0 || (count <= PIPE_BUF && space < left)) {
+            wait_queue_sleep(&pipe->write_wq);
+            continue;
+        }
+        uint32_t size = left < space ? left : space;
+        pipe_copy_in(pipe, src + written, size);
+        written += size;
+        wait_queue_wake_all(&pipe->read_wq);
+    }
+    intr_set_status(old_status);
+    return written == 0 && count > 0 ? -1 : (int32_t)written;
+}
 
-    const char* buffer = buf;
-    while(bytes_write < size) {
-        ioq_putchar(ioq, *buffer);
-        bytes_write++;
-        buffer++;
+/*从管道fd读出最多count个字节，没有数据时等待，写端都关闭后返回0，成功返回读出的字节数，失败返回-1*/
+int32_t pipe_read(int32_t fd, void* buf, uint32_t count)
+{
+    return pipe_file_read(fd_local2file(fd), buf, count);
+}
+
+/*把count个字节全部写入管道fd，满了等读端取走，读端都关闭后返回-1，成功返回count*/
+int32_t pipe_write(int32_t fd, const void* buf, uint32_t count)
+{
+    return pipe_file_write(fd_local2file(fd), buf, count);
+}
+
+/*返回管道fd的就绪事件，pt不为NULL时登记到对应的等待队列，需关中断调用。
+  读端有数据时可读，写端都关闭后报告POLLHUP；写端空闲不少于PIPE_BUF时可写，读端都关闭后报告POLLERR*/
+uint32_t pipe_poll(int32_t fd, struct poll_table* pt)
+{
+    struct file* file = fd_local2file(fd);
+    struct pipe* pipe = pipe_of(file);
+    uint32_t mask = 0;
+    if(!(file->fd_flag & O_WRONLY)) {
+        poll_wait(&pipe->read_wq, pt);
+        if(pipe->len > 0) {
+            mask |= POLLIN;
+        }
+        if(pipe->writers == 0) {
+            mask |= POLLHUP;
+        }
+    } else {
+        poll_wait(&pipe->write_wq, pt);
+        if(pipe->size - pipe->len >= PIPE_BUF) {
+            mask |= POLLOUT;
+        }
+        if(pipe->readers == 0) {
+            mask |= POLLERR;
+        }
     }
-    return bytes_write;
+    return mask;
+}
+
+/*返回管道fd中现有的数据长度*/
+uint32_t pipe_length(int32_t fd)
+{
+    return pipe_of(fd_local2file(fd))->len;
+}
+
+/*返回管道fd的缓冲区大小*/
+uint32_t pipe_get_size(int32_t fd)
+{
+    return pipe_of(fd_local2file(fd))->size;
+}
+
+/*把管道fd的缓冲区改为能放size个字节，成功返回新的大小，失败返回-1。
+  一页剩下的部分放得下时用管道结构所在页，否则另外分配按页取整的缓冲区，已有数据多于新大小时失败*/
+int32_t pipe_set_size(int32_t fd, uint32_t size)
+{
+    struct pipe* pipe = pipe_of(fd_local2file(fd));
+    uint32_t pg_cnt = size <= PG_SIZE - sizeof(struct pipe) ? 0 : DIV_ROUND_UP(size, PG_SIZE);
+    if(pg_cnt > PIPE_MAX_PAGES) {
+        printk("pipe_set_size: size exceeds %d pages\n", PIPE_MAX_PAGES);
+        return -1;
+    }
+    if(pg_cnt == pipe->pg_cnt) {
+        return pipe->size;
+    }
+    char* new_buf = (char*)(pipe + 1);
+    uint32_t new_size = PG_SIZE - sizeof(struct pipe);
+    if(pg_cnt > 0) {
+        new_buf = get_kernel_pages(pg_cnt);
+        if(new_buf == NULL) {
+            printk("pipe_set_size: get_kernel_pages failed\n");
+            return -1;
+        }
+        new_size = pg_cnt * PG_SIZE;
+    }
+
+    enum intr_status old_status = intr_disable();
+    if(pipe->len > new_size) {
+        intr_set_status(old_status);
+        if(pg_cnt > 0) {
+            mfree_page(PF_KERNEL, new_buf, pg_cnt);
+        }
+        printk("pipe_set_size: pipe holds more data than new size\n");
+        return -1;
+    }
+    pipe_copy_out(pipe, new_buf, pipe->len);   //数据摆到新缓冲区开头
+    char* old_buf = pipe->buf;
+    uint32_t old_pg_cnt = pipe->pg_cnt;
+    pipe->buf = new_buf;
+    pipe->size = new_size;
+    pipe->pg_cnt = pg_cnt;
+    pipe->tail = 0;
+    wait_queue_wake_all(&pipe->write_wq);   //变大后等空间的写者可以继续
+    intr_set_status(old_status);
+
+    if(old_pg_cnt > 0) {
+        mfree_page(PF_KERNEL, old_buf, old_pg_cnt);
+    }
+    return new_size;
+}
+
+/*管道一端的最后一个引用释放时由file_put调用，唤醒对端的等待者，两端都关闭后释放管道*/
+static int32_t pipe_release(struct file* file)
+{
+    struct pipe* pipe = pipe_of(file);
+    enum intr_status old_status = intr_disable();
+    if(!(file->fd_flag & O_WRONLY)) {
+        pipe->readers--;
+        wait_queue_wake_all(&pipe->write_wq);   //写者醒来发现没有读端就返回
+    } else {
+        pipe->writers--;
+        wait_queue_wake_all(&pipe->read_wq);   //读者醒来读完剩下的数据后得到0
+    }
+    bool last = pipe->readers == 0 && pipe->writers == 0;
+    intr_set_status(old_status);
+    if(last) {
+        if(pipe->pg_cnt > 0) {
+            mfree_page(PF_KERNEL, pipe->buf, pipe->pg_cnt);
+        }
+        mfree_page(PF_KERNEL, pipe, 1);
+    }
+    return 0;
 }
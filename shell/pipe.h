@@ -2,16 +2,46 @@
 #define __SHELL_PIPE_H
 #include "stdint.h"
 #include "global.h"
+#include "sync.h"
 
-#define PIPE_FLAG 0xFFFF
+#define PIPE_BUF 512   //不超过这么多字节的写入是原子的，不会和别的写者交错
+#define PIPE_MAX_PAGES 16   //管道缓冲区最多占用的页数
+
+/*管道，占一页内核内存，缓冲区默认是这一页剩下的部分，扩大后另外分配*/
+struct pipe
+{
+    char* buf;   //环形缓冲区
+    uint32_t size;   //缓冲区大小
+    uint32_t pg_cnt;   //另外分配的缓冲区页数，为0表示用的是本页剩下的部分
+    uint32_t tail;   //数据从这里读出
+    uint32_t len;   //缓冲区中的数据长度
+    uint32_t readers;   //打开的读端数
+    uint32_t writers;   //打开的写端数
+    struct wait_queue read_wq;   //等数据的读者
+    struct wait_queue write_wq;   //等空间的写者
+};
+
+struct file;
+struct poll_table;
+
+/*管道两端的文件操作，读端以O_RDONLY打开，写端以O_WRONLY打开，fd_private指向管道*/
+extern const struct file_operations pipe_fops;
 
 /*判断文件描述符local_fd是否是管道*/
 bool is_pipe(uint32_t local_fd);
-/*创建管道，成功返回0，失败返回-1*/
+/*创建管道，pipefd[0]是读端，pipefd[1]是写端，成功返回0，失败返回-1*/
 int32_t sys_pipe(int32_t pipefd[2]);
-/*管道中读数据*/
-uint32_t pipe_read(int32_t fd, void* buf, uint32_t count);
-/*管道中写数据*/
-uint32_t pipe_write(int32_t fd, const void* buf, uint32_t count);
+/*从管道读出最多count个字节，没有数据时等待，写端都关闭后返回0，成功返回读出的字节数，失败返回-1*/
+int32_t pipe_read(int32_t fd, void* buf, uint32_t count);
+/*把count个字节全部写入管道，满了等读端取走，读端都关闭后返回-1，成功返回count*/
+int32_t pipe_write(int32_t fd, const void* buf, uint32_t count);
+/*返回管道fd的就绪事件，pt不为NULL时登记到对应的等待队列*/
+uint32_t pipe_poll(int32_t fd, struct poll_table* pt);
+/*返回管道fd中现有的数据长度*/
+uint32_t pipe_length(int32_t fd);
+/*返回管道fd的缓冲区大小*/
+uint32_t pipe_get_size(int32_t fd);
+/*把管道fd的缓冲区改为能放size个字节，按页取整，成功返回新的大小，失败返回-1*/
+int32_t pipe_set_size(int32_t fd, uint32_t size);
 
 #endif
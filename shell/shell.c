@@ -10,6 +10,8 @@
 #include "file.h"
 #include "buildin_cmd.h"
 #include "stdio.h"
+#include "stream.h"
+#include "pipe.h"
 
 #define cmd_len 512   //最大支持键入128个字符的命令行输入
 #define MAX_ARG_NR 16   //加上命令外，最多支持15个参数
@@ -27,51 +29,36 @@ void print_prompt(void)
     printf("huloves@huloves:~%s $ ", cwd_cache);
 }
 
-/*从键盘缓冲区中最多读入count个字节到buf*/
+/*从标准输入读入一行命令到buf，最多count个字节。退格、ctrl+u和回显由内核的tty按行处理，
+  ctrl+l也会结束一次读入，此时清屏后重画提示符和已键入的内容，接着读*/
 static void readline(char* buf, int32_t count)
 {
     assert(buf != NULL && count > 0);
     char* pos = buf;
-    while(read(stdin_no, pos, 1) != -1 && (pos - buf) < count) {
-        switch(*pos) {
-            //找到回车或换行符后认为键入的命令结束，直接返回
-            case '\n':
-            case '\r':
-                *pos = 0;   //添加cmd_line的终止字符
-                putchar('\n');
-                return;
-            
-            case '\b':
-                if(buf[0] != '\b') {   //阻止删除非本次输入的信息
-                    --pos;   //退回到缓冲区cmd_line中上一个字符
-                    putchar('\b');
-                }
-                break;
-
-            case 'l'-'a':
-                //1. 先将当前字置为0
-                *pos = 0;
-                //2. 在清空屏幕
-                clear();
-                //3. 打印提示符
-                print_prompt();
-                //将之前键入的内容再次打印
-                printf("%s", buf);
-                break;
-
-            case 'u'-'a':
-                while(buf != pos) {
-                    putchar('\b');
-                    *(pos--) = 0;
-                }
-                break;
-
-            //非控制键则输出字符
-            default:
-                putchar(*pos);
-                pos++;
+    while(pos - buf < count) {
+        int32_t len = read(stdin_no, pos, count - (pos - buf));
+        if(len <= 0) {
+            break;
+        }
+        pos += len;
+        if(pos[-1] == '\n') {   //一行结束
+            pos[-1] = 0;
+            return;
+        }
+        if(pos[-1] == 'l'-'a') {
+            *(--pos) = 0;
+            clear();
+            print_prompt();
+            printf("%s", buf);
+        }
+    }
+    //行太长，丢掉余下的部分
+    if(pos - buf == count) {
+        char discard = 0;
+        while(discard != '\n' && read(stdin_no, &discard, 1) > 0) {
         }
     }
+    buf[0] = 0;
     printf("readline: can't find entry_key in the cmd_line, max num of char is 128\n");
 }
 
@@ -116,8 +103,187 @@ static int32_t cmd_parse(char* cmd_str, char** argv, char token)
     return argc;
 }
 
-char* argv[MAX_ARG_NR];   //argv必须为全局变量，为了以后exec的程序可访问参数
-char argc = -1;
+#define MAX_PIPE_STAGES 8   //以'|'连接的命令最多的条数
+
+/*管道线中各条命令的参数，外部命令的argv[0]换成清洗后存在stage_path中的绝对路径*/
+static char* stage_argv[MAX_PIPE_STAGES][MAX_ARG_NR];
+static int32_t stage_argc[MAX_PIPE_STAGES];
+static char stage_path[MAX_PIPE_STAGES][MAX_PATH_LEN];
+
+/*内建命令名，与run_buildin中处理的一致*/
+static const char* buildin_names[] = {
+    "ls", "cd", "pwd", "ps", "free", "meminfo", "sched", "iostat", "top", "df", "fsck", "dmesg",
+    "boottime", "bench", "prof", "stats", "sync", "clear", "mkdir", "rmdir", "rm", "help", "hash",
+    "import", "poweroff"
+};
+
+/*判断cmd是否是内建命令*/
+static bool is_buildin(const char* cmd)
+{
+    uint32_t idx;
+    for(idx = 0; idx < sizeof(buildin_names) / sizeof(buildin_names[0]); idx++) {
+        if(!strcmp(buildin_names[idx], cmd)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*在shell中直接执行内建命令argv*/
+static void run_buildin(int32_t argc, char** argv)
+{
+    if(!strcmp("ls", argv[0])) {
+        buildin_ls(argc, argv);
+    } else if(!strcmp("cd", argv[0])) {
+        if(buildin_cd(argc, argv) != NULL) {
+            memset(cwd_cache, 0, MAX_PATH_LEN);
+            printf("final_path=%s\n", final_path);
+            strcpy(cwd_cache, final_path);
+        }
+    } else if(!strcmp("pwd", argv[0])) {
+        buildin_pwd(argc, argv);
+    } else if(!strcmp("ps", argv[0])) {
+        buildin_ps(argc, argv);
+    } else if(!strcmp("free", argv[0]) || !strcmp("meminfo", argv[0])) {
+        buildin_free(argc, argv);
+    } else if(!strcmp("sched", argv[0])) {
+        buildin_sched(argc, argv);
+    } else if(!strcmp("iostat", argv[0])) {
+        buildin_iostat(argc, argv);
+    } else if(!strcmp("top", argv[0])) {
+        buildin_top(argc, argv);
+    } else if(!strcmp("df", argv[0])) {
+        buildin_df(argc, argv);
+    } else if(!strcmp("fsck", argv[0])) {
+        buildin_fsck(argc, argv);
+    } else if(!strcmp("dmesg", argv[0])) {
+        buildin_dmesg(argc, argv);
+    } else if(!strcmp("boottime", argv[0])) {
+        buildin_boottime(argc, argv);
+    } else if(!strcmp("bench", argv[0])) {
+        buildin_bench(argc, argv);
+    } else if(!strcmp("prof", argv[0])) {
+        buildin_prof(argc, argv);
+    } else if(!strcmp("stats", argv[0])) {
+        buildin_stats(argc, argv);
+    } else if(!strcmp("sync", argv[0])) {
+        sync();
+    } else if(!strcmp("clear", argv[0])) {
+        buildin_clear(argc, argv);
+    } else if(!strcmp("mkdir", argv[0])) {
+        buildin_mkdir(argc, argv);
+    } else if(!strcmp("rmdir", argv[0])) {
+        buildin_rmdir(argc, argv);
+    } else if(!strcmp("rm", argv[0])) {
+        buildin_rm(argc, argv);
+    } else if(!strcmp("help", argv[0])) {
+        buildin_help(argc, argv[0]);
+    } else if(!strcmp("hash", argv[0])) {
+        buildin_hash(argc, argv);
+    } else if(!strcmp("import", argv[0])) {
+        buildin_import(argc, argv);
+    } else if(!strcmp("poweroff", argv[0])) {
+        poweroff();
+    }
+}
+
+/*用spawn直接建子进程运行外部命令argv，不必先fork复制整个shell再exec。路径清洗后存入path，
+  经命令查找缓存跳过重复的路径解析，返回子进程的pid，失败返回-1*/
+static int32_t spawn_cmd(char** argv, char* path)
+{
+    make_clear_abs_path(argv[0], path);
+    argv[0] = path;
+    return cmd_hash_spawn(path, argv);
+}
+
+/*把命令行按'|'分成各条命令并分别分析参数，返回命令条数，有空命令或超出限制时返回-1*/
+static int32_t pipeline_parse(char* line)
+{
+    int32_t cnt = 0;
+    char* cmd = line;
+    while(1) {
+        char* bar = strchr(cmd, '|');
+        if(bar != NULL) {
+            *bar = 0;
+        }
+        if(cnt == MAX_PIPE_STAGES) {
+            printf("my_shell: more than %d commands in a pipeline\n", MAX_PIPE_STAGES);
+            return -1;
+        }
+        int32_t argc = cmd_parse(cmd, stage_argv[cnt], ' ');
+        if(argc == -1) {
+            printf("num of arguments exceed %d\n", MAX_ARG_NR);
+            return -1;
+        }
+        if(argc == 0) {
+            printf("my_shell: syntax error near '|'\n");
+            return -1;
+        }
+        stage_argc[cnt++] = argc;
+        if(bar == NULL) {
+            return cnt;
+        }
+        cmd = bar + 1;
+    }
+}
+
+/*从左到右执行cnt条以管道相连的命令，只有一条时就是普通的命令。外部命令用spawn建子进程，全部启动后再一起等待，
+  各条同时运行；内建命令不另建进程，在shell中把标准输入输出临时重定向后直接执行。
+  内建命令执行完下一条才启动，它的输出先存在放大了的管道缓冲区中；下一条也是内建命令时不读输入，管道读端直接关掉，写入的数据被丢弃。
+  外部命令会继承自己输出管道的读端，读者提前退出时写者写满后等待而不是出错*/
+static void run_pipeline(int32_t cnt)
+{
+    int32_t child_cnt = 0;   //启动的外部命令数
+    int32_t in_fd = -1;   //本条命令的输入管道读端，-1为控制台
+    int32_t idx;
+    for(idx = 0; idx < cnt; idx++) {
+        char** argv = stage_argv[idx];
+        bool buildin = is_buildin(argv[0]);
+        int32_t pipefd[2] = {-1, -1};
+        fflush(NULL);   //重定向前把已缓冲的输出写到原来的地方
+        if(idx + 1 < cnt) {
+            if(pipe(pipefd) == -1) {
+                printf("my_shell: pipe failed\n");
+                break;
+            }
+            dup2(pipefd[1], stdout_no);
+            close(pipefd[1]);
+            if(is_buildin(stage_argv[idx + 1][0])) {
+                close(pipefd[0]);
+                pipefd[0] = -1;
+            } else if(buildin) {
+                fcntl(stdout_no, F_SETPIPE_SZ, PIPE_MAX_PAGES * PG_SIZE);
+            }
+        }
+        if(in_fd != -1) {
+            dup2(in_fd, stdin_no);
+            close(in_fd);
+        }
+        if(buildin) {
+            run_buildin(stage_argc[idx], argv);
+            fflush(NULL);
+        } else {
+            if(spawn_cmd(argv, stage_path[idx]) != -1) {
+                child_cnt++;
+            }
+        }
+        //关闭重定向过的标准输入输出即改回控制台，没有重定向时close什么也不做
+        close(stdin_no);
+        close(stdout_no);
+        in_fd = pipefd[0];
+    }
+    if(in_fd != -1) {
+        close(in_fd);
+    }
+    while(child_cnt-- > 0) {
+        int32_t status;
+        int32_t child_pid = wait(&status);   //此时子进程若没有执行exit，my_shell会被阻塞，不再响应键入的命令
+        if(child_pid == -1) {
+            panic("my_shell: no child\n");
+        }
+        printf("child_pid %d, it's status: %d\n", child_pid, status);
+    }
+}
 
 /*简单的shell*/
 void my_shell(void)
@@ -128,66 +294,12 @@ void my_shell(void)
         memset(final_path, 0, MAX_PATH_LEN);
         memset(cmd_line, 0, MAX_PATH_LEN);
         readline(cmd_line, MAX_PATH_LEN);
-        // strcpy(cmd_line, "./prog_no_arg");
-        // printf("!!!!!!\n");
         if(cmd_line[0] == 0) {
             continue;
         }
-        argc = -1;
-        argc = cmd_parse(cmd_line, argv, ' ');   //记录输入参数的个数，和参数，参数存储在argv
-        if(argc == -1) {
-            printf("num of arguments exceed %d\n", MAX_ARG_NR);
-            continue;
-        }
-        if(!strcmp("ls", argv[0])) {
-            buildin_ls(argc, argv);
-        } else if(!strcmp("cd", argv[0])) {
-            if(buildin_cd(argc, argv) != NULL) {
-                memset(cwd_cache, 0, MAX_PATH_LEN);
-                printf("final_path=%s\n", final_path);
-                strcpy(cwd_cache, final_path);
-            }
-        } else if(!strcmp("pwd", argv[0])) {
-            buildin_pwd(argc, argv);
-        } else if(!strcmp("ps", argv[0])) {
-            buildin_ps(argc, argv);
-        } else if(!strcmp("clear", argv[0])) {
-            buildin_clear(argc, argv);
-        } else if(!strcmp("mkdir", argv[0])) {
-            buildin_mkdir(argc, argv);
-        } else if(!strcmp("rmdir", argv[0])) {
-            buildin_rmdir(argc, argv);
-        } else if(!strcmp("rm", argv[0])) {
-            buildin_rm(argc, argv);
-        } else if(!strcmp("help", argv[0])) {
-            buildin_help(argc, argv[0]);
-        } else {   //如果是外部命令
-            int32_t pid = fork();
-            if(pid) {
-                int32_t status;
-                int32_t child_pid = wait(&status);   //此时子进程若没有执行exit，my_shell会被阻塞，不再响应键入的命令
-                if(child_pid == -1) {
-                    panic("my_shell: no child\n");
-                }
-                printf("child_pid %d, it's status: %d\n", child_pid, status);
-            } else {
-                make_clear_abs_path(argv[0], final_path);
-                argv[0] = final_path;
-                //先判断文件是否存在
-                struct stat file_stat;
-                memset(&file_stat, 0, sizeof(struct stat));
-                if(stat(argv[0], &file_stat) == -1) {
-                    printf("my_shell: cannot access %s: No such file or directory\n", argv[0]);
-                    exit(-1);
-                } else {
-                    execv(argv[0], argv);
-                }
-            }
-        }
-        int32_t arg_idx = 0;
-        while(arg_idx < MAX_ARG_NR) {
-            argv[arg_idx] = NULL;
-            arg_idx++;
+        int32_t cnt = pipeline_parse(cmd_line);
+        if(cnt > 0) {
+            run_pipeline(cnt);
         }
     }
     panic("my_shell: should not be here");
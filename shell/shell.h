@@ -8,5 +8,6 @@ void print_prompt(void);
 void my_shell(void);
 
 extern char final_path[MAX_PATH_LEN];
+extern char cwd_cache[MAX_PATH_LEN];
 
 #endif
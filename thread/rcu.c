@@ -0,0 +1,92 @@
+#include "rcu.h"
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "sync.h"
+#include "interrupt.h"
+#include "debug.h"
+
+/*读者按进入时纪元的奇偶计在两个计数之一。宽限期开始时翻转纪元，之后进来的读者计入另一个计数，
+  旧计数降到0说明宽限期开始前进来的读者都已退出，开始前摘下的节点不会再被访问*/
+static volatile uint32_t rcu_epoch;
+static volatile uint32_t rcu_readers[2];
+
+static struct spinlock rcu_lock;   //保护下面两个回调队列和rcu_gp_active
+static struct list rcu_next;   //还没开始等宽限期的回调
+static struct list rcu_wait;   //在等当前宽限期的回调
+static bool rcu_gp_active;   //是否有宽限期在进行
+
+/*把from中的回调依次移到to的队尾*/
+static void rcu_list_move(struct list* to, struct list* from)
+{
+    while(!list_empty(from)) {
+        list_append(to, list_pop(from));
+    }
+}
+
+/*进入读侧临界区，返回进入时的纪元，退出时交给rcu_read_unlock。
+  不关中断也不加锁，期间可以被抢占和阻塞，遍历到的节点在退出前不会被释放*/
+uint32_t rcu_read_lock(void)
+{
+    while(1) {
+        uint32_t idx = rcu_epoch & 1;
+        asm volatile ("lock incl %0" : "+m"(rcu_readers[idx]) : : "memory");
+        //取纪元和加计数之间纪元可能被翻转，写者可能已看到旧计数为0，要按新纪元重来
+        if((rcu_epoch & 1) == idx) {
+            return idx;
+        }
+        asm volatile ("lock decl %0" : "+m"(rcu_readers[idx]) : : "memory");
+    }
+}
+
+/*退出纪元为idx的读侧临界区*/
+void rcu_read_unlock(uint32_t idx)
+{
+    ASSERT(rcu_readers[idx] > 0);
+    asm volatile ("lock decl %0" : "+m"(rcu_readers[idx]) : : "memory");
+}
+
+/*等此刻已在读侧临界区的读者都退出后调用func(head)，可在关中断时调用*/
+void call_rcu(struct rcu_head* head, void (*func)(struct rcu_head* head))
+{
+    head->func = func;
+    enum intr_status old_status = spin_lock_irqsave(&rcu_lock);
+    list_append(&rcu_next, &head->tag);
+    spin_unlock_irqrestore(&rcu_lock, old_status);
+}
+
+/*由0号cpu的时钟中断调用，推进宽限期，宽限期结束时运行等到的回调。
+  没有宽限期在进行时把攒下的回调一起开始一个，翻转纪元后旧计数为0就结束，读者不多时同一个滴答内就能完成*/
+void rcu_tick(void)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    struct list done;
+    list_init(&done);
+    spin_lock(&rcu_lock);
+    if(!rcu_gp_active && !list_empty(&rcu_next)) {
+        rcu_list_move(&rcu_wait, &rcu_next);
+        uint32_t epoch = rcu_epoch + 1;
+        asm volatile ("xchgl %0, %1" : "+r"(epoch), "+m"(rcu_epoch) : : "memory");   //xchg带锁，翻转先于下面读计数
+        rcu_gp_active = true;
+    }
+    if(rcu_gp_active && rcu_readers[(rcu_epoch & 1) ^ 1] == 0) {
+        rcu_list_move(&done, &rcu_wait);
+        rcu_gp_active = false;
+    }
+    spin_unlock(&rcu_lock);
+
+    while(!list_empty(&done)) {
+        struct rcu_head* head = elem2entry(struct rcu_head, tag, list_pop(&done));
+        head->func(head);
+    }
+}
+
+void rcu_init(void)
+{
+    rcu_epoch = 0;
+    rcu_readers[0] = rcu_readers[1] = 0;
+    spin_init(&rcu_lock);
+    list_init(&rcu_next);
+    list_init(&rcu_wait);
+    rcu_gp_active = false;
+}
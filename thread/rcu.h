@@ -0,0 +1,26 @@
+#ifndef __THREAD_RCU_H
+#define __THREAD_RCU_H
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+
+/*延迟释放的回调，嵌在要释放的结构中*/
+struct rcu_head
+{
+    struct list_elem tag;   //挂在等待宽限期的回调队列上
+    void (*func)(struct rcu_head* head);
+};
+
+/*进入读侧临界区，返回进入时的纪元，退出时交给rcu_read_unlock。
+  不关中断也不加锁，期间可以被抢占和阻塞，遍历到的节点在退出前不会被释放*/
+uint32_t rcu_read_lock(void);
+/*退出纪元为idx的读侧临界区*/
+void rcu_read_unlock(uint32_t idx);
+/*等此刻已在读侧临界区的读者都退出后调用func(head)，可在关中断时调用。
+  调用前节点要已从链表上摘下，回调在0号cpu的时钟中断中运行，不能阻塞*/
+void call_rcu(struct rcu_head* head, void (*func)(struct rcu_head* head));
+/*由0号cpu的时钟中断调用，推进宽限期，宽限期结束时运行等到的回调*/
+void rcu_tick(void);
+void rcu_init(void);
+
+#endif
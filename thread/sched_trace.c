@@ -0,0 +1,43 @@
+#include "sched_trace.h"
+#include "stdint.h"
+#include "global.h"
+#include "string.h"
+#include "smp.h"
+
+static struct sched_event trace_ring[SCHED_TRACE_CNT];   //开机以来的调度事件，写满后覆盖最旧的
+static volatile uint32_t trace_head;   //下一条事件的序号，只增不减，取模得到下标
+
+/*记录一条调度事件，可在关中断或中断上下文中调用。
+  各cpu用lock xaddl各自占一个槽位，不加锁，写入时被并发读到的半条事件由读者容忍*/
+void sched_trace_record(uint8_t type, int16_t pid, int16_t next_pid, uint16_t arg, uint32_t eip)
+{
+    uint32_t seq = 1;
+    asm volatile ("lock xaddl %0, %1" : "+r"(seq), "+m"(trace_head) : : "memory");
+    struct sched_event* ev = &trace_ring[seq & (SCHED_TRACE_CNT - 1)];
+    asm volatile ("rdtsc" : "=A"(ev->tsc));
+    ev->pid = pid;
+    ev->next_pid = next_pid;
+    ev->type = type;
+    ev->cpu = smp_cpu_id();
+    ev->arg = arg;
+    ev->eip = eip;
+}
+
+/*把最近的至多cnt条事件按时间先后复制到buf，返回复制的条数*/
+int32_t sys_sched_trace(struct sched_event* buf, uint32_t cnt)
+{
+    if(buf == NULL) {
+        return -1;
+    }
+    //不关中断，复制时用户缓冲区可能缺页，期间新写入的事件可能覆盖正在复制的旧事件
+    uint32_t head = trace_head;
+    uint32_t avail = head < SCHED_TRACE_CNT ? head : SCHED_TRACE_CNT;
+    if(cnt > avail) {
+        cnt = avail;
+    }
+    uint32_t seq;
+    for(seq = head - cnt; seq != head; seq++) {
+        *buf++ = trace_ring[seq & (SCHED_TRACE_CNT - 1)];
+    }
+    return cnt;
+}
@@ -0,0 +1,43 @@
+#ifndef __THREAD_SCHED_TRACE_H
+#define __THREAD_SCHED_TRACE_H
+#include "stdint.h"
+
+#define SCHED_TRACE_CNT 1024   //环形缓冲区能容纳的事件数，须为2的幂
+
+/*事件类型*/
+enum sched_event_type
+{
+    SEV_SWITCH,   //schedule切换任务，pid换下，next_pid换上，arg为换下的原因
+    SEV_BLOCK,   //pid阻塞自己，arg为阻塞后的状态
+    SEV_WAKEUP,   //next_pid唤醒了pid
+    SEV_IRQ_ENTER,   //进入中断处理，arg为中断向量号，pid为被打断的任务
+    SEV_IRQ_EXIT   //中断处理完毕，arg为中断向量号
+};
+
+/*任务被换下的原因*/
+enum switch_reason
+{
+    SWITCH_PREEMPT,   //时间片用完
+    SWITCH_YIELD,   //主动让出cpu
+    SWITCH_BLOCK,   //阻塞等待
+    SWITCH_EXIT   //任务结束
+};
+
+/*一条调度事件，时间戳为rdtsc读出的时钟周期数*/
+struct sched_event
+{
+    uint64_t tsc;
+    int16_t pid;
+    int16_t next_pid;
+    uint8_t type;
+    uint8_t cpu;
+    uint16_t arg;
+    uint32_t eip;   //SEV_BLOCK时为调用thread_block的位置，其余为0
+};
+
+/*记录一条调度事件，可在关中断或中断上下文中调用*/
+void sched_trace_record(uint8_t type, int16_t pid, int16_t next_pid, uint16_t arg, uint32_t eip);
+/*把最近的至多cnt条事件按时间先后复制到buf，返回复制的条数*/
+int32_t sys_sched_trace(struct sched_event* buf, uint32_t cnt);
+
+#endif
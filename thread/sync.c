@@ -4,6 +4,7 @@
 #include "global.h"
 #include "interrupt.h"
 #include "debug.h"
+#include "timer.h"
 
 /*初始化信号量*/
 void sema_init(struct semaphore* psema, uint8_t value)
@@ -26,11 +27,8 @@ void sema_down(struct semaphore* psema)
     //关中断来保证原子操作
     enum intr_status old_status = intr_disable();
     while(psema->value == 0) {   //若value为0，表示已经被别人持有
+        //当前线程不应该已在信号量的waiters队列中。遍历等待队列只在调试时做，免得关中断的时间随等待者增长
         ASSERT(!elem_find(&psema->waiters, &running_thread()->general_tag));
-        //当前线程不应该已在信号量的waiters队列中
-        if(elem_find(&psema->waiters, &running_thread()->general_tag)) {
-            PANIC("sema_down: thread block has been in waiters_list\n");
-        }
         //若信号量的值等于0，则当前线程把自己加入该锁的等待队列，然后阻塞自己
         list_append(&psema->waiters, &running_thread()->general_tag);
         thread_block(TASK_BLOCKED);   //阻塞线程，直到被唤醒
@@ -84,4 +82,271 @@ void lock_release(struct lock* plock)
     plock->holder = NULL;   //吧锁的持有者置空放在V操作之前
     plock->holder_repeat_nr = 0;
     sema_up(&plock->semaphore);   //信号量V操作，也是原子操作
+    preempt_check_resched();   //释放锁是抢占点，唤醒的等待者级别更靠前时让它先运行
+}
+
+/*初始化自旋锁lock*/
+void spin_init(struct spinlock* lock)
+{
+    lock->next = 0;
+    lock->owner = 0;
+}
+
+/*获取自旋锁，不改变中断状态。先原子地取号，再等到叫号*/
+void spin_lock(struct spinlock* lock)
+{
+    uint16_t ticket = 1;
+    asm volatile ("lock xaddw %0, %1" : "+r"(ticket), "+m"(lock->next) : : "memory");
+    while(lock->owner != ticket) {
+        asm volatile ("pause" : : : "memory");
+    }
+}
+
+/*释放自旋锁，不改变中断状态*/
+void spin_unlock(struct spinlock* lock)
+{
+    ASSERT(lock->owner != lock->next);
+    asm volatile ("" : : : "memory");   //临界区内的访存不能被挪到叫号之后
+    lock->owner++;
+}
+
+/*关中断后获取自旋锁，返回之前的中断状态。持锁时被中断处理程序再申请同一把锁会死锁，因此要关中断*/
+enum intr_status spin_lock_irqsave(struct spinlock* lock)
+{
+    enum intr_status old_status = intr_disable();
+    spin_lock(lock);
+    return old_status;
+}
+
+/*释放自旋锁并恢复中断状态为old_status*/
+void spin_unlock_irqrestore(struct spinlock* lock, enum intr_status old_status)
+{
+    spin_unlock(lock);
+    intr_set_status(old_status);
+}
+
+/*初始化读写锁rw*/
+void rwlock_init(struct rwlock* rw)
+{
+    spin_init(&rw->guard);
+    rw->readers = 0;
+    rw->writers_waiting = 0;
+    rw->writer = false;
+}
+
+/*关中断后获取读锁，返回之前的中断状态*/
+enum intr_status read_lock(struct rwlock* rw)
+{
+    enum intr_status old_status = intr_disable();
+    while(1) {
+        spin_lock(&rw->guard);
+        if(!rw->writer && rw->writers_waiting == 0) {
+            rw->readers++;
+            spin_unlock(&rw->guard);
+            break;
+        }
+        spin_unlock(&rw->guard);
+        asm volatile ("pause" : : : "memory");
+    }
+    return old_status;
+}
+
+/*释放读锁并恢复中断状态*/
+void read_unlock(struct rwlock* rw, enum intr_status old_status)
+{
+    spin_lock(&rw->guard);
+    ASSERT(rw->readers > 0);
+    rw->readers--;
+    spin_unlock(&rw->guard);
+    intr_set_status(old_status);
+}
+
+/*关中断后获取写锁，返回之前的中断状态*/
+enum intr_status write_lock(struct rwlock* rw)
+{
+    enum intr_status old_status = intr_disable();
+    spin_lock(&rw->guard);
+    rw->writers_waiting++;
+    while(rw->writer || rw->readers > 0) {
+        spin_unlock(&rw->guard);
+        asm volatile ("pause" : : : "memory");
+        spin_lock(&rw->guard);
+    }
+    rw->writers_waiting--;
+    rw->writer = true;
+    spin_unlock(&rw->guard);
+    return old_status;
+}
+
+/*释放写锁并恢复中断状态*/
+void write_unlock(struct rwlock* rw, enum intr_status old_status)
+{
+    spin_lock(&rw->guard);
+    ASSERT(rw->writer);
+    rw->writer = false;
+    spin_unlock(&rw->guard);
+    intr_set_status(old_status);
+}
+
+/*初始化可睡眠的读写锁rw*/
+void rwsem_init(struct rw_semaphore* rw)
+{
+    rw->readers = 0;
+    rw->writers_waiting = 0;
+    rw->writer = NULL;
+    rw->writer_repeat_nr = 0;
+    list_init(&rw->waiters);
+}
+
+/*唤醒rw上所有等待者，各自重新检查能否拿到锁，拿不到的再排回队尾，需关中断调用*/
+static void rwsem_wake_all(struct rw_semaphore* rw)
+{
+    while(!list_empty(&rw->waiters)) {
+        thread_unblock(elem2entry(struct task_struct, general_tag, list_pop(&rw->waiters)));
+    }
+}
+
+/*获取读锁，有写者持有或在等时阻塞。已持有写锁的线程再申请读锁算作写锁的一次重复申请*/
+void down_read(struct rw_semaphore* rw)
+{
+    struct task_struct* cur = running_thread();
+    enum intr_status old_status = intr_disable();
+    if(rw->writer == cur) {
+        rw->writer_repeat_nr++;
+    } else {
+        while(rw->writer != NULL || rw->writers_waiting > 0) {
+            list_append(&rw->waiters, &cur->general_tag);
+            thread_block(TASK_BLOCKED);
+        }
+        rw->readers++;
+    }
+    intr_set_status(old_status);
+}
+
+/*释放读锁，最后一个读者离开时唤醒等待者*/
+void up_read(struct rw_semaphore* rw)
+{
+    enum intr_status old_status = intr_disable();
+    if(rw->writer == running_thread()) {
+        ASSERT(rw->writer_repeat_nr > 1);
+        rw->writer_repeat_nr--;
+    } else {
+        ASSERT(rw->readers > 0);
+        if(--rw->readers == 0) {
+            rwsem_wake_all(rw);
+        }
+    }
+    intr_set_status(old_status);
+}
+
+/*获取写锁，有读者或别的写者持有时阻塞，同一线程可嵌套申请*/
+void down_write(struct rw_semaphore* rw)
+{
+    struct task_struct* cur = running_thread();
+    enum intr_status old_status = intr_disable();
+    if(rw->writer == cur) {
+        rw->writer_repeat_nr++;
+    } else {
+        rw->writers_waiting++;
+        while(rw->writer != NULL || rw->readers > 0) {
+            list_append(&rw->waiters, &cur->general_tag);
+            thread_block(TASK_BLOCKED);
+        }
+        rw->writers_waiting--;
+        rw->writer = cur;
+        rw->writer_repeat_nr = 1;
+    }
+    intr_set_status(old_status);
+}
+
+/*释放写锁，最外层释放时唤醒等待者*/
+void up_write(struct rw_semaphore* rw)
+{
+    enum intr_status old_status = intr_disable();
+    ASSERT(rw->writer == running_thread() && rw->writer_repeat_nr > 0);
+    if(--rw->writer_repeat_nr == 0) {
+        rw->writer = NULL;
+        rwsem_wake_all(rw);
+    }
+    intr_set_status(old_status);
+}
+
+/*初始化等待队列wq*/
+void wait_queue_init(struct wait_queue* wq)
+{
+    list_init(&wq->waiters);
+}
+
+/*把当前线程作为entry挂到wq上但不阻塞，timed表示之后会带超时阻塞，需关中断调用*/
+void wait_entry_add(struct wait_queue* wq, struct wait_entry* entry, bool timed)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    entry->thread = running_thread();
+    entry->timed = timed;
+    entry->woken = false;
+    list_append(&wq->waiters, &entry->tag);
+}
+
+/*在wq上睡眠直到被唤醒，需关中断调用，醒来后调用者要重新检查条件*/
+void wait_queue_sleep(struct wait_queue* wq)
+{
+    struct wait_entry entry;
+    wait_entry_add(wq, &entry, false);
+    thread_block(TASK_BLOCKED);
+}
+
+/*在wq上睡眠直到被唤醒或到滴答数deadline，需关中断调用，被唤醒返回true，超时返回false。
+  先到期的话时钟中断处理函数唤醒本线程，节点还在wq上，由自己摘下*/
+bool wait_queue_sleep_until(struct wait_queue* wq, uint32_t deadline)
+{
+    if((int32_t)(deadline - sys_uptime()) <= 0) {
+        return false;
+    }
+    struct wait_entry entry;
+    wait_entry_add(wq, &entry, true);
+    timer_block_until(deadline);
+    wait_entry_del(&entry);
+    return entry.woken;
+}
+
+/*entry还没被唤醒时把它从队列上摘下，需关中断调用*/
+void wait_entry_del(struct wait_entry* entry)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    if(!entry->woken) {
+        list_remove(&entry->tag);
+    }
+}
+
+/*把entry从等待队列上摘下并唤醒它的线程。线程已被时钟或它挂着的别的节点唤醒时只需标记，它醒来后按被唤醒处理*/
+static void wait_entry_wake(struct wait_entry* entry)
+{
+    list_remove(&entry->tag);
+    entry->woken = true;
+    if(entry->thread->status != TASK_BLOCKED) {
+        return;
+    }
+    if(entry->timed) {
+        timer_wakeup_early(entry->thread);
+    } else {
+        thread_unblock(entry->thread);
+    }
+}
+
+/*唤醒wq上最早的一个等待者，需关中断调用*/
+void wait_queue_wake_one(struct wait_queue* wq)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    if(!list_empty(&wq->waiters)) {
+        wait_entry_wake(elem2entry(struct wait_entry, tag, wq->waiters.head.next));
+    }
+}
+
+/*唤醒wq上的全部等待者，需关中断调用*/
+void wait_queue_wake_all(struct wait_queue* wq)
+{
+    ASSERT(intr_get_status() == INTR_OFF);
+    while(!list_empty(&wq->waiters)) {
+        wait_entry_wake(elem2entry(struct wait_entry, tag, wq->waiters.head.next));
+    }
 }
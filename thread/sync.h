@@ -3,6 +3,7 @@
 #include "stdint.h"
 #include "list.h"
 #include "thread.h"
+#include "interrupt.h"
 
 /*信号量结构*/
 struct semaphore
@@ -19,6 +20,50 @@ struct lock
     uint32_t holder_repeat_nr;    //锁的持有者重复申请锁的次数
 };
 
+/*排队自旋锁，按申请的先后顺序获得。持有期间不能阻塞，只用于很短的临界区*/
+struct spinlock
+{
+    volatile uint16_t next;   //下一个申请者拿到的号
+    volatile uint16_t owner;   //当前持有者的号
+};
+
+/*读写锁，读者之间可以并发，写者独占。建立在自旋锁上，持有期间同样不能阻塞。
+  有写者在等时新来的读者也要等，避免写者饿死*/
+struct rwlock
+{
+    struct spinlock guard;   //保护下面的字段
+    uint32_t readers;   //持有读锁的读者数
+    uint32_t writers_waiting;   //正在等待的写者数
+    bool writer;   //是否有写者持有
+};
+
+/*可睡眠的读写锁，读者之间可以并发，写者独占，拿不到时阻塞，持有期间可以等硬盘。
+  有写者在等时新来的读者也要等，避免写者饿死。写者可以嵌套申请写锁和读锁*/
+struct rw_semaphore
+{
+    uint32_t readers;   //持有读锁的读者数
+    uint32_t writers_waiting;   //正在等待的写者数
+    struct task_struct* writer;   //持有写锁的线程，为NULL表示没有
+    uint32_t writer_repeat_nr;   //写者重复申请的次数
+    struct list waiters;   //阻塞在这把锁上的读者和写者
+};
+
+/*等待队列，可以挂任意多个等待者，等待者可以带超时。
+  等待者的节点放在它自己的内核栈上，不占general_tag，带超时的等待者同时挂在休眠队列上*/
+struct wait_queue
+{
+    struct list waiters;
+};
+
+/*等待队列上的一个等待者。同一线程可以用多个节点同时挂在几个队列上，任意一个被唤醒线程就醒来*/
+struct wait_entry
+{
+    struct list_elem tag;   //挂在wait_queue的waiters上
+    struct task_struct* thread;
+    bool timed;   //带超时，线程同时挂在休眠队列上
+    bool woken;   //已被唤醒者从队列上摘下
+};
+
 void sema_init(struct semaphore* psema, uint8_t value);
 void lock_init(struct lock* plock);
 /*信号量down操作*/
@@ -29,5 +74,45 @@ void sema_up(struct semaphore* psema);
 void lock_acquire(struct lock* plock);
 /*释放锁plock*/
 void lock_release(struct lock* plock);
+void spin_init(struct spinlock* lock);
+/*获取自旋锁，不改变中断状态*/
+void spin_lock(struct spinlock* lock);
+/*释放自旋锁，不改变中断状态*/
+void spin_unlock(struct spinlock* lock);
+/*关中断后获取自旋锁，返回之前的中断状态*/
+enum intr_status spin_lock_irqsave(struct spinlock* lock);
+/*释放自旋锁并恢复中断状态为old_status*/
+void spin_unlock_irqrestore(struct spinlock* lock, enum intr_status old_status);
+void rwlock_init(struct rwlock* rw);
+/*关中断后获取读锁，返回之前的中断状态*/
+enum intr_status read_lock(struct rwlock* rw);
+/*释放读锁并恢复中断状态*/
+void read_unlock(struct rwlock* rw, enum intr_status old_status);
+/*关中断后获取写锁，返回之前的中断状态*/
+enum intr_status write_lock(struct rwlock* rw);
+/*释放写锁并恢复中断状态*/
+void write_unlock(struct rwlock* rw, enum intr_status old_status);
+void wait_queue_init(struct wait_queue* wq);
+/*在wq上睡眠直到被唤醒，需关中断调用，醒来后调用者要重新检查条件*/
+void wait_queue_sleep(struct wait_queue* wq);
+/*在wq上睡眠直到被唤醒或到滴答数deadline，需关中断调用，被唤醒返回true，超时返回false*/
+bool wait_queue_sleep_until(struct wait_queue* wq, uint32_t deadline);
+/*把当前线程作为entry挂到wq上但不阻塞，timed表示之后会带超时阻塞，需关中断调用*/
+void wait_entry_add(struct wait_queue* wq, struct wait_entry* entry, bool timed);
+/*entry还没被唤醒时把它从队列上摘下，需关中断调用*/
+void wait_entry_del(struct wait_entry* entry);
+/*唤醒wq上最早的一个等待者，需关中断调用*/
+void wait_queue_wake_one(struct wait_queue* wq);
+/*唤醒wq上的全部等待者，需关中断调用*/
+void wait_queue_wake_all(struct wait_queue* wq);
+void rwsem_init(struct rw_semaphore* rw);
+/*获取读锁，有写者持有或在等时阻塞*/
+void down_read(struct rw_semaphore* rw);
+/*释放读锁*/
+void up_read(struct rw_semaphore* rw);
+/*获取写锁，有读者或别的写者持有时阻塞*/
+void down_write(struct rw_semaphore* rw);
+/*释放写锁*/
+void up_write(struct rw_semaphore* rw);
 
 #endif
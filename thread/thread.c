@@ -12,38 +12,97 @@
 #include "stdio.h"
 #include "file.h"
 #include "bitmap.h"
+#include "smp.h"
+#include "fpu.h"
+#include "timer.h"
+#include "sched_trace.h"
+#include "workqueue.h"
+#include "rcu.h"
+#include "counter.h"
+#include "softirq.h"
 
 #define PG_SIZE 4096
 
+#define PID_MAX_CNT (128 * 8)   //pid的个数
+
 /*pid的位图，最大支持1024个pid*/
 uint8_t pid_bitmap_bits[128] = {0};
+uint32_t pid_bitmap_summary[BITMAP_SUMMARY_BYTES(128) / 4] = {0};
+
+/*一个cpu的多级就绪队列*/
+struct run_queue
+{
+    struct list levels[RQ_LEVELS];   //每级内部先进先出
+    uint32_t bitmap;   //第i位为1表示第i级队列非空
+    uint32_t nr_ready;   //队列中的任务总数
+};
+
+static struct run_queue run_queues[MAX_CPUS];
+
+/*cpu带宽控制组：每period个滴答中组内任务在各cpu上合计最多运行quota个滴答，用完后组被限流，
+  组内任务从就绪队列摘下挂到parked上，到下一个周期开始时才放回。0号是不限制的默认组*/
+struct cpu_group
+{
+    bool used;
+    uint32_t quota;   //每个周期的配额，0表示不限制
+    uint32_t period;   //周期的滴答数
+    uint32_t runtime;   //本周期已经用掉的滴答数
+    uint32_t period_start;   //本周期开始时的滴答数
+    bool throttled;   //本周期的配额已用完
+    struct list parked;   //被限流摘下的就绪任务，借用general_tag串起来
+};
+
+static struct cpu_group cpu_groups[CPU_GROUP_MAX];
+static uint32_t cpu_group_throttle_counter;
 
 /*pid池*/
 struct pid_pool
 {
     struct bitmap pid_bitmap;   //pid位图
     uint32_t pid_start;   //起始pid
-    struct lock pid_lock;   //分配pid锁
+    struct spinlock pid_lock;   //分配pid锁，只保护位图操作，用自旋锁，thread_exit关中断时也能用
 }pid_pool;
 
 struct task_struct* main_thread;       //主线程PCB
 struct task_struct* idle_thread;       //idle线程，系统空闲时运行的线程
-struct list thread_ready_list;         //就绪队列
+struct kmem_cache* task_cache;       //pcb的对象缓存，每个pcb独占一页
+static struct task_struct* cpu_idle[MAX_CPUS];   //各cpu的idle线程，cpu_idle[0]即idle_thread
+static uint32_t rq_last_boost;         //上次恢复任务级别时的滴答数
 struct list thread_all_list;           //所有任务队列
-struct lock pid_lock;                  //分配pid锁
+struct rwlock thread_all_lock;         //写者修改thread_all_list、pid_table和各任务的children时持有，只遍历thread_all_list用rcu
+static struct task_struct* pid_table[PID_MAX_CNT];   //pid到pcb的映射，下标为pid - pid_start
 static struct list_elem* thread_tag;   //用于保存队列中的线程节点
+static uint32_t ctx_switch_counter;
 
 extern void switch_to(struct task_struct* cur, struct task_struct* next);
 extern void init(void);
+extern uint32_t ticks;
+
+static void rq_remove(struct task_struct* pthread);
 
 /*系统空闲时运行的线程*/
 static void idle(void* arg UNUSED)
 {
     while(1) {
         thread_block(TASK_BLOCKED);
+        //没有其他任务就绪时，顺便预建进程的地址空间、把空闲页框清零备用。清零窗口只有一个，只让0号cpu做
+        while(smp_cpu_id() == 0 && thread_ready_empty() && (addr_space_prebuild() || page_prezero()));
+        //hlt期间不占着大内核锁，让其他cpu能进入内核，醒来后再拿回
+        intr_disable();
+        //8253和休眠队列归0号cpu管，它空闲时停掉周期时钟，一直睡到最早的休眠任务到期
+        if(smp_cpu_id() == 0 && thread_ready_empty()) {
+            timer_tickless_enter();
+        }
+        bkl_release();
         //执行hlt时必须保证目前处在开中断的情况下
         asm volatile ("sti; \
                        hlt" : : : "memory");
+        intr_disable();
+        bkl_acquire();
+        if(smp_cpu_id() == 0) {
+            timer_tickless_exit();
+        }
+        intr_enable();
     }
 }
 
@@ -70,50 +129,68 @@ static void pid_pool_init(void)
     pid_pool.pid_start = 1;
     pid_pool.pid_bitmap.bits = pid_bitmap_bits;
     pid_pool.pid_bitmap.btmp_bytes_len = 128;
+    pid_pool.pid_bitmap.summary = pid_bitmap_summary;
     bitmap_init(&pid_pool.pid_bitmap);
-    lock_init(&pid_pool.pid_lock);
+    spin_init(&pid_pool.pid_lock);
 }
 
 /*分配pid*/
 static pid_t allocate_pid(void)
 {
-    lock_acquire(&pid_pool.pid_lock);
+    enum intr_status old_status = spin_lock_irqsave(&pid_pool.pid_lock);
     int32_t bit_idx = bitmap_scan(&pid_pool.pid_bitmap, 1);
     bitmap_set(&pid_pool.pid_bitmap, bit_idx, 1);
-    lock_release(&pid_pool.pid_lock);
+    spin_unlock_irqrestore(&pid_pool.pid_lock, old_status);
     return (bit_idx + pid_pool.pid_start);
 }
 
 /*释放pid*/
 void release_pid(pid_t pid)
 {
-    lock_acquire(&pid_pool.pid_lock);
+    enum intr_status old_status = spin_lock_irqsave(&pid_pool.pid_lock);
     int32_t bit_idx = pid - pid_pool.pid_start;
     bitmap_set(&pid_pool.pid_bitmap, bit_idx, 0);
-    lock_release(&pid_pool.pid_lock);
+    spin_unlock_irqrestore(&pid_pool.pid_lock, old_status);
+}
+
+/*宽限期过后回收退出任务的pcb*/
+static void task_free_rcu(struct rcu_head* head)
+{
+    kmem_cache_free(task_cache, elem2entry(struct task_struct, rcu, head));
 }
 
 /*回收thread_over的pcb和页表，并将其从调度队列中去除*/
 void thread_exit(struct task_struct* thread_over, bool need_schedule)
 {
+    //归还fpu保存区可能阻塞，要在置TASK_DIED之前
+    fpu_release(thread_over);
+
     //保证schedule在关中断情况下调用
     intr_disable();
     thread_over->status = TASK_DIED;
 
-    //如果thread_over不是当前线程，就有可能还在就绪队列中，将其删除
-    if(elem_find(&thread_ready_list, &thread_over->general_tag)) {
+    //如果thread_over不是当前线程，就有可能还在就绪队列中或因所属组被限流挂在组的parked上，将其删除
+    if(elem_find(&run_queues[thread_over->cpu].levels[thread_over->rq_level], &thread_over->general_tag)) {
+        rq_remove(thread_over);
+    } else if(elem_find(&cpu_groups[thread_over->cpu_group].parked, &thread_over->general_tag)) {
         list_remove(&thread_over->general_tag);
     }
-    if(thread_over->pgdir) {   //如果是进程，回收进程的页目录表
+    if(thread_over->pgdir && thread_over->group_leader == thread_over) {   //如果是进程，回收进程的页目录表，线程和主线程共用页目录
         mfree_page(PF_KERNEL, thread_over->pgdir, 1);
     }
 
-    //从all_thread_list中取出任务
+    //从all_thread_list、pid表和父进程的子进程队列中取出任务
+    enum intr_status old_status = write_lock(&thread_all_lock);
     list_remove(&thread_over->all_list_tag);
+    pid_table[thread_over->pid - pid_pool.pid_start] = NULL;
+    if(thread_over->child_tag.owner != NULL) {
+        list_remove(&thread_over->child_tag);
+    }
+    write_unlock(&thread_all_lock, old_status);
 
-    //回收pcb所在的页，主线程pcb不在堆中，跨过
+    //回收pcb所在的页，主线程pcb不在堆中，跨过。不加锁遍历的读者可能还站在这个pcb上，等宽限期过后再回收
     if(thread_over != main_thread) {
-        mfree_page(PF_KERNEL, thread_over, 1);
+        call_rcu(&thread_over->rcu, task_free_rcu);
     }
 
     //归还pid
@@ -126,25 +203,251 @@ void thread_exit(struct task_struct* thread_over, bool need_schedule)
     }
 }
 
-/*对比任务的pid*/
-static bool pid_check(struct list_elem* pelem, int32_t pid)
+/*根据pid找pcb，若找到则返回pcb，否则返回NULL。
+  pid表项是对齐的指针，读一次是原子的，不加锁。返回的pcb在调用者的rcu读侧临界区内都不会被回收*/
+struct task_struct* pid2thread(int32_t pid)
 {
-    struct task_struct* pthread = elem2entry(struct task_struct, all_list_tag, pelem);
-    if(pthread->pid == pid) {
-        return true;
+    if(pid < (int32_t)pid_pool.pid_start || pid >= (int32_t)(pid_pool.pid_start + PID_MAX_CNT)) {
+        return NULL;
+    }
+    return ((struct task_struct* volatile*)pid_table)[pid - pid_pool.pid_start];
+}
+
+/*将pthread加入全部任务队列和pid表，有父进程的同时加入父进程的子进程队列*/
+void thread_all_append(struct task_struct* pthread)
+{
+    enum intr_status old_status = write_lock(&thread_all_lock);
+    ASSERT(!elem_find(&thread_all_list, &pthread->all_list_tag));
+    list_append_rcu(&thread_all_list, &pthread->all_list_tag);
+    pid_table[pthread->pid - pid_pool.pid_start] = pthread;
+    if(pthread->parent_pid != -1) {
+        struct task_struct* parent = pid_table[pthread->parent_pid - pid_pool.pid_start];
+        ASSERT(parent != NULL);
+        list_append(&parent->children, &pthread->child_tag);
+    }
+    write_unlock(&thread_all_lock, old_status);
+}
+
+/*把退出的pthread从父进程的children队列移到zombies队尾，返回父进程。父进程wait时直接取队首，不必扫描子进程*/
+struct task_struct* thread_zombie_append(struct task_struct* pthread)
+{
+    enum intr_status old_status = write_lock(&thread_all_lock);
+    struct task_struct* parent = pid_table[pthread->parent_pid - pid_pool.pid_start];
+    ASSERT(parent != NULL && pthread->child_tag.owner == &parent->children);
+    list_remove(&pthread->child_tag);
+    list_append(&parent->zombies, &pthread->child_tag);
+    write_unlock(&thread_all_lock, old_status);
+    return parent;
+}
+
+/*将pthread的子进程全部过继给init，其中已经退出的子进程移到init的zombies队列由init来收获*/
+void thread_orphan_children(struct task_struct* pthread)
+{
+    enum intr_status old_status = write_lock(&thread_all_lock);
+    struct task_struct* init_thread = pid_table[1 - pid_pool.pid_start];
+    ASSERT(init_thread != NULL && init_thread != pthread);
+    while(!list_empty(&pthread->children)) {
+        struct task_struct* child = elem2entry(struct task_struct, child_tag, list_pop(&pthread->children));
+        child->parent_pid = 1;
+        list_append(&init_thread->children, &child->child_tag);
+    }
+    bool hanging = !list_empty(&pthread->zombies);
+    while(!list_empty(&pthread->zombies)) {
+        struct task_struct* child = elem2entry(struct task_struct, child_tag, list_pop(&pthread->zombies));
+        child->parent_pid = 1;
+        list_append(&init_thread->zombies, &child->child_tag);
+    }
+    write_unlock(&thread_all_lock, old_status);
+
+    if(hanging && init_thread->status == TASK_WAITING) {
+        thread_unblock(init_thread);
+    }
+}
+
+/*由优先级prio得到任务的初始级别，优先级越高级别越靠前*/
+static uint8_t prio_level(uint8_t prio)
+{
+    uint8_t p = prio > 31 ? 31 : prio;
+    return (31 - p) / (32 / RQ_LEVELS);
+}
+
+/*将pthread加入其所属cpu的就绪队列中相应级别的队尾，需关中断调用*/
+static void rq_append(struct task_struct* pthread)
+{
+    struct run_queue* rq = &run_queues[pthread->cpu];
+    struct list* level = &rq->levels[pthread->rq_level];
+    ASSERT(!elem_find(level, &pthread->general_tag));
+    list_append(level, &pthread->general_tag);
+    rq->bitmap |= 1U << pthread->rq_level;
+    rq->nr_ready++;
+}
+
+/*将就绪队列中的pthread摘下，需关中断调用*/
+static void rq_remove(struct task_struct* pthread)
+{
+    struct run_queue* rq = &run_queues[pthread->cpu];
+    list_remove(&pthread->general_tag);
+    if(list_empty(&rq->levels[pthread->rq_level])) {
+        rq->bitmap &= ~(1U << pthread->rq_level);
+    }
+    rq->nr_ready--;
+}
+
+/*弹出rq中级别最靠前的就绪任务，需关中断调用*/
+static struct task_struct* rq_pop(struct run_queue* rq)
+{
+    ASSERT(rq->bitmap != 0);
+    uint32_t level;
+    asm volatile ("bsfl %1, %0" : "=r"(level) : "rm"(rq->bitmap));
+    thread_tag = rq->levels[level].head.next;
+    struct task_struct* pthread = elem2entry(struct task_struct, general_tag, thread_tag);
+    rq_remove(pthread);
+    return pthread;
+}
+
+/*pthread所在的进程有多个线程时返回true。这些线程共用页表，都固定在主线程所在的cpu上，免得别的cpu上留着过时的tlb*/
+static bool task_pinned(struct task_struct* pthread)
+{
+    return pthread->group_leader->thread_cnt > 0;
+}
+
+/*本cpu无事可做时，从就绪任务最多的cpu那里偷一个级别最靠后的任务，成功返回true。固定在cpu上的线程不偷*/
+static bool rq_steal(uint8_t cpu_id)
+{
+    uint8_t victim = cpu_id, idx;
+    for(idx = 0; idx < cpu_cnt; idx++) {
+        if(run_queues[idx].nr_ready > run_queues[victim].nr_ready) {
+            victim = idx;
+        }
+    }
+    if(victim == cpu_id || run_queues[victim].nr_ready == 0) {
+        return false;
+    }
+
+    //偷最不紧迫的任务，对被偷的cpu影响最小
+    struct run_queue* rq = &run_queues[victim];
+    int32_t level;
+    for(level = RQ_LEVELS - 1; level >= 0; level--) {
+        struct list_elem* elem = rq->levels[level].tail.prev;
+        while(elem != &rq->levels[level].head) {
+            struct task_struct* pthread = elem2entry(struct task_struct, general_tag, elem);
+            if(!task_pinned(pthread)) {
+                rq_remove(pthread);
+                pthread->cpu = cpu_id;
+                rq_append(pthread);
+                return true;
+            }
+            elem = elem->prev;
+        }
     }
     return false;
 }
 
-/*根据pid找pcb，若找到则返回pcb，否则返回NULL*/
-struct task_struct* pid2thread(int32_t pid)
+/*返回就绪任务最少的cpu，新任务放到那里*/
+static uint8_t rq_least_loaded(void)
 {
-    struct list_elem* pelem = list_traversal(&thread_all_list, pid_check, pid);
-    if(pelem == NULL) {
-        return NULL;
+    uint8_t target = 0, idx;
+    for(idx = 1; idx < cpu_cnt; idx++) {
+        if(run_queues[idx].nr_ready < run_queues[target].nr_ready) {
+            target = idx;
+        }
     }
-    struct task_struct* thread = elem2entry(struct task_struct, all_list_tag, pelem);
-    return thread;
+    return target;
+}
+
+/*把所有cpu上降过级的就绪任务恢复到初始级别，需关中断调用*/
+static void rq_boost(void)
+{
+    uint8_t cpu_id;
+    uint32_t level;
+    for(cpu_id = 0; cpu_id < cpu_cnt; cpu_id++) {
+        struct run_queue* rq = &run_queues[cpu_id];
+        for(level = 1; level < RQ_LEVELS; level++) {
+            struct list_elem* elem = rq->levels[level].head.next;
+            while(elem != &rq->levels[level].tail) {
+                struct list_elem* next_elem = elem->next;
+                struct task_struct* pthread = elem2entry(struct task_struct, general_tag, elem);
+                uint8_t base = prio_level(pthread->priority);
+                if(base < level) {
+                    rq_remove(pthread);
+                    pthread->rq_level = base;
+                    rq_append(pthread);
+                }
+                elem = next_elem;
+            }
+        }
+    }
+}
+
+/*把组group中被限流摘下的任务放回各自cpu的就绪队列，并解除限流，需关中断调用*/
+static void cpu_group_unthrottle(struct cpu_group* group)
+{
+    group->throttled = false;
+    while(!list_empty(&group->parked)) {
+        struct task_struct* pthread = elem2entry(struct task_struct, general_tag, list_pop(&group->parked));
+        rq_append(pthread);
+    }
+}
+
+/*时钟滴答时把当前任务运行的这个滴答记到所属组上，组的配额用完时限流并标记需要调度，需关中断调用。
+  组内在别的cpu上运行的任务到它们自己的下一个滴答时再换下*/
+void cpu_group_charge(struct task_struct* cur)
+{
+    struct cpu_group* group = &cpu_groups[cur->cpu_group];
+    if(group->quota == 0) {
+        return;
+    }
+    if(!group->throttled && ++group->runtime >= group->quota) {
+        group->throttled = true;
+        counter_inc(cpu_group_throttle_counter);
+    }
+    if(group->throttled) {
+        cur->need_resched = true;
+    }
+}
+
+/*0号cpu每个滴答调用，给到了新周期的组重新计时，把被限流的任务放回就绪队列，需关中断调用*/
+void cpu_group_tick(void)
+{
+    uint32_t gid;
+    for(gid = 1; gid < CPU_GROUP_MAX; gid++) {
+        struct cpu_group* group = &cpu_groups[gid];
+        if(!group->used || group->quota == 0 || ticks - group->period_start < group->period) {
+            continue;
+        }
+        group->period_start = ticks;
+        group->runtime = 0;
+        if(group->throttled) {
+            cpu_group_unthrottle(group);
+        }
+    }
+}
+
+/*有组被限流时返回true，这时0号cpu空闲也要保持周期性时钟中断，按时解除限流*/
+bool cpu_group_need_tick(void)
+{
+    uint32_t gid;
+    for(gid = 1; gid < CPU_GROUP_MAX; gid++) {
+        if(cpu_groups[gid].throttled) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*将新建的任务pthread加入就绪队列，多线程进程的线程放到主线程所在的cpu上*/
+void thread_ready(struct task_struct* pthread)
+{
+    enum intr_status old_status = intr_disable();
+    pthread->cpu = task_pinned(pthread) ? pthread->group_leader->cpu : rq_least_loaded();
+    rq_append(pthread);
+    intr_set_status(old_status);
+}
+
+/*本cpu是否没有就绪的任务*/
+bool thread_ready_empty(void)
+{
+    return run_queues[smp_cpu_id()].bitmap == 0;
 }
 
 /*为进程分配pid*/
@@ -185,22 +488,20 @@ void init_thread(struct task_struct* pthread, char* name, int prio)
     pthread->self_kstack = (uint32_t*)((uint32_t)pthread + PG_SIZE);
     pthread->priority = prio;
     pthread->ticks = prio;
+    pthread->rq_level = prio_level(prio);
+    pthread->bkl_depth = 1;   //线程总是从内核里开始运行，此时cpu持有大内核锁
     pthread->elapsed_ticks = 0;
     pthread->pgdir = NULL;
 
-    //预留标准输入输出
-    pthread->fd_table[0] = 0;
-    pthread->fd_table[1] = 1;
-    pthread->fd_table[2] = 2;
-    //其余的全置为-1
-    uint8_t fd_idx = 3;
-    while(fd_idx < MAX_FILES_OPEN_PER_PROC) {
-        pthread->fd_table[fd_idx] = -1;
-        fd_idx++;
-    }
+    //预留标准输入输出，其余的置为空闲
+    fd_table_init(pthread);
 
     pthread->cwd_inode_nr = 0;   //以根目录作为默认工作路径
     pthread->parent_pid = -1;   //是任务的父进程默认为-1
+    list_init(&pthread->children);
+    list_init(&pthread->zombies);
+    list_elem_init(&pthread->child_tag);
+    pthread->group_leader = pthread;
     pthread->stack_magic = 0x19870916;   //自定义魔数
 }
 
@@ -208,20 +509,16 @@ void init_thread(struct task_struct* pthread, char* name, int prio)
 struct task_struct* thread_start(char* name, int prio, thread_func function, void* func_arg) 
 {
     //pcb都位于内核空间，包括用户进程的pcb也是内核空间
-    struct task_struct* thread = get_kernel_pages(1);
+    struct task_struct* thread = kmem_cache_alloc(task_cache);
 
     init_thread(thread, name, prio);
     thread_create(thread, function, func_arg);
 
-    //确保之前不在队列中
-    ASSERT(!elem_find(&thread_ready_list, &thread->general_tag));
     //加入就绪线程队列
-    list_append(&thread_ready_list, &thread->general_tag);
+    thread_ready(thread);
 
-    //确保之前不在队列中
-    ASSERT(!elem_find(&thread_all_list, &thread->all_list_tag));
     //加入到全部线程队列
-    list_append(&thread_all_list, &thread->all_list_tag);
+    thread_all_append(thread);
 
     return thread;
 }
@@ -234,9 +531,33 @@ static void make_main_thread(void)
     main_thread = running_thread();
     init_thread(main_thread, "main", 31);
 
-    //main函数是当前线程，当前线程不在thread_ready_list中，所以只将其加载thread_all_list中
-    ASSERT(!elem_find(&thread_all_list, &main_thread->all_list_tag));
-    list_append(&thread_all_list, &main_thread->all_list_tag);
+    //main函数是当前线程，当前线程不在就绪队列中，所以只将其加载thread_all_list中
+    thread_all_append(main_thread);
+}
+
+/*为cpu_id号cpu创建idle线程，该cpu启动后以它的pcb所在页为栈，直接作为这个线程运行*/
+struct task_struct* thread_ap_idle_create(uint8_t cpu_id)
+{
+    struct task_struct* thread = kmem_cache_alloc(task_cache);
+    if(thread == NULL) {
+        return NULL;
+    }
+    char name[16];
+    sprintf(name, "idle%d", cpu_id);
+    init_thread(thread, name, 10);
+    thread->status = TASK_RUNNING;
+    thread->cpu = cpu_id;
+    thread->bkl_depth = 0;   //该cpu启动后自己去拿大内核锁
+    cpu_idle[cpu_id] = thread;
+
+    thread_all_append(thread);
+    return thread;
+}
+
+/*从处理器进入idle线程，不再返回*/
+void thread_ap_idle(void)
+{
+    idle(NULL);
 }
 
 /*实现任务调度*/
@@ -245,29 +566,70 @@ void schedule()
     ASSERT(intr_get_status() == INTR_OFF);
 
     struct task_struct* cur = running_thread();
-    if(cur->status == TASK_RUNNING) {   //若此线程只是cpu时间片到了，将其加入到就绪队列尾
-        ASSERT(!elem_find(&thread_ready_list, &cur->general_tag));
-        list_append(&thread_ready_list, &cur->general_tag);
-        cur->ticks = cur->priority;   //重新将当前线程的ticks在重置为其priority
+    uint8_t cpu_id = smp_cpu_id();
+    struct run_queue* rq = &run_queues[cpu_id];
+    //换下的原因，按进入schedule时的状态区分，thread_yield进来时已是TASK_READY
+    uint16_t reason = SWITCH_BLOCK;
+    if(cur->status == TASK_RUNNING) {
+        reason = SWITCH_PREEMPT;
+    } else if(cur->status == TASK_READY) {
+        reason = SWITCH_YIELD;
+    } else if(cur->status == TASK_DIED) {
+        reason = SWITCH_EXIT;
+    }
+    if(reason == SWITCH_PREEMPT) {
+        cur->stats.nivcsw++;
+    } else {
+        cur->stats.nvcsw++;
+    }
+    if(cur == cpu_idle[cpu_id] && cur->status == TASK_RUNNING) {
+        //idle不参与排队，只在没有就绪任务时被唤醒
+        cur->ticks = cur->priority;
+        cur->status = TASK_BLOCKED;
+    } else if(cur->status == TASK_RUNNING) {   //被抢占的线程加入到就绪队列尾
+        //时间片用完的降一级，并重新将ticks置为priority。被级别更靠前的任务抢占的保留级别和剩余的时间片
+        if(cur->ticks == 0) {
+            if(cur->rq_level < RQ_LEVELS - 1) {
+                cur->rq_level++;
+            }
+            cur->ticks = cur->priority;
+        }
+        cur->cpu = cpu_id;
+        rq_append(cur);
         cur->status = TASK_READY;
     } else {
         //若此线程需要某时间发生后才能继续上cpu运行，不需要将其加入队列，因为当前线程不在就绪队列中
     }
 
-    if(list_empty(&thread_ready_list)) {
-        thread_unblock(idle_thread);
+    //定期恢复降级任务的级别，避免低级别的任务饿死
+    if(ticks - rq_last_boost >= RQ_BOOST_INTERVAL) {
+        rq_boost();
+        rq_last_boost = ticks;
     }
 
-    ASSERT(!list_empty(&thread_ready_list));
-    thread_tag = NULL;   //thread_tag清空
-    //将thread_ready_list队列中的第一个就绪线程弹出，准备将其调度上cpu
-    thread_tag = list_pop(&thread_ready_list);
-    struct task_struct* next = elem2entry(struct task_struct, general_tag, thread_tag);
+    //弹出级别最靠前的就绪线程，准备将其调度上cpu。所属组被限流的挂到组上，到下个周期再放回
+    struct task_struct* next;
+    while(1) {
+        //本cpu没有就绪任务时先从别的cpu偷，偷不到才运行idle
+        if(rq->bitmap == 0 && !rq_steal(cpu_id)) {
+            thread_unblock(cpu_idle[cpu_id]);
+        }
+        next = rq_pop(rq);
+        if(!cpu_groups[next->cpu_group].throttled) {
+            break;
+        }
+        list_append(&cpu_groups[next->cpu_group].parked, &next->general_tag);
+    }
     next->status = TASK_RUNNING;
 
     //激活任务页表等
     process_activate(next);
+    //next的fpu状态不在寄存器里时置上TS，等它用到fpu时再换入
+    fpu_switch(cur, next);
 
+    sched_trace_record(SEV_SWITCH, cur->pid, next->pid, reason, 0);
+    counter_inc(ctx_switch_counter);
+    cur->need_resched = false;
     switch_to(cur, next);
 }
 
@@ -278,7 +640,11 @@ void thread_block(enum task_status stat)
     ASSERT(((stat == TASK_BLOCKED) || (stat == TASK_WAITING) || (stat == TASK_HANGING)));
     enum intr_status old_status = intr_disable();
     struct task_struct* cur_thread = running_thread();
+    if(cur_thread->wq_busy) {   //工作项阻塞了，工作队列可能要增加工作线程
+        wq_worker_sleeping();
+    }
     cur_thread->status = stat;   //置其状态为stat
+    sched_trace_record(SEV_BLOCK, cur_thread->pid, 0, stat, (uint32_t)__builtin_return_address(0));
     schedule();   //将当前线程换下处理器
     //待当前线程被接触阻塞后才继续运行下面的intr_set_status
     intr_set_status(old_status);
@@ -290,12 +656,20 @@ void thread_unblock(struct task_struct* pthread)
     enum intr_status old_status = intr_disable();
     ASSERT(((pthread->status == TASK_BLOCKED) || (pthread->status == TASK_WAITING) || (pthread->status == TASK_HANGING)));
     if(pthread->status != TASK_READY) {
-        ASSERT(!elem_find(&thread_ready_list, &pthread->general_tag));
-        if(elem_find(&thread_ready_list, &pthread->general_tag)) {
-            PANIC("thread_unblock: block thread in ready list\n");
-        }
-        list_push(&thread_ready_list, &pthread->general_tag);   //放到队列的最前面，使其尽快得到调度
+        //被唤醒的任务多是交互型或等待io的，恢复其初始级别，使其尽快得到调度
+        pthread->rq_level = prio_level(pthread->priority);
+        rq_append(pthread);
         pthread->status = TASK_READY;
+        if(pthread->wq_busy) {
+            wq_worker_waking();
+        }
+        //唤醒的任务在本cpu上且级别比正在运行的任务靠前时，让正在运行的任务到下一个抢占点让出cpu。idle不参与比较
+        struct task_struct* cur = running_thread();
+        if(pthread->cpu == smp_cpu_id() && pthread != cpu_idle[pthread->cpu] && cur != cpu_idle[pthread->cpu] \
+           && pthread->rq_level < cur->rq_level) {
+            cur->need_resched = true;
+        }
+        sched_trace_record(SEV_WAKEUP, pthread->pid, cur->pid, 0, 0);
     }
     intr_set_status(old_status);
 }
@@ -305,13 +679,57 @@ void thread_yield(void)
 {
     struct task_struct* cur = running_thread();
     enum intr_status ole_status = intr_disable();
-    ASSERT(!elem_find(&thread_ready_list, &cur->general_tag));
-    list_append(&thread_ready_list, &cur->general_tag);
+    cur->cpu = smp_cpu_id();
+    rq_append(cur);   //主动让出不算用完时间片，保持级别不变
     cur->status = TASK_READY;
     schedule();
     intr_set_status(ole_status);
 }
 
+/*禁止当前任务被抢占，可以嵌套。期间时钟和唤醒只标记need_resched，任务自己阻塞时照常换下*/
+void preempt_disable(void)
+{
+    running_thread()->preempt_count++;
+}
+
+/*恢复当前任务可被抢占，最外层恢复时若期间被标记需要调度就换下*/
+void preempt_enable(void)
+{
+    struct task_struct* cur = running_thread();
+    ASSERT(cur->preempt_count > 0);
+    if(--cur->preempt_count == 0) {
+        preempt_check_resched();
+    }
+}
+
+/*抢占点：当前任务被标记需要调度、没有禁止抢占且不在软中断中时换下它。
+  中断返回、释放锁、系统调用返回前调用，这些地方都可以睡眠*/
+void preempt_check_resched(void)
+{
+    struct task_struct* cur = running_thread();
+    if(!cur->need_resched || cur->preempt_count > 0 || cur->status != TASK_RUNNING || in_softirq()) {
+        return;
+    }
+    enum intr_status old_status = intr_disable();
+    schedule();
+    intr_set_status(old_status);
+}
+
+/*长时间运行的内核路径中的显式抢占点，只在可以睡眠的地方调用。
+  系统调用关着中断运行，先开一下中断让挂起的时钟、键盘等中断进来，
+  时间片用完或唤醒了交互任务时，在中断返回处或下面被换下*/
+void cond_resched(void)
+{
+    struct task_struct* cur = running_thread();
+    if(cur->preempt_count > 0 || in_softirq()) {
+        return;
+    }
+    if(intr_get_status() == INTR_OFF) {
+        asm volatile ("sti; nop; cli" : : : "memory");   //sti之后还要执行一条指令才响应中断
+    }
+    preempt_check_resched();
+}
+
 /*以填充空格的方式输出buf*/
 static void pad_print(char* buf, int32_t buf_len, void* ptr, char format)
 {
@@ -382,18 +800,177 @@ void sys_ps(void)
 {
     char* ps_title = "PID            PPID           STAT           TICKS         COMMAND\n";
     sys_write(stdout_no, ps_title, strlen(ps_title));
+    //打印时可能在控制台锁上阻塞，在rcu读侧临界区中遍历，不关中断也不挡住退出的任务
+    uint32_t rcu_idx = rcu_read_lock();
     list_traversal(&thread_all_list, elem2thread_info, 0);
+    rcu_read_unlock(rcu_idx);
+}
+
+/*把各任务的资源使用统计复制到buf，最多cnt项，返回复制的项数，失败返回-1。
+  在rcu读侧临界区中遍历，写用户缓冲区时缺页也不要紧*/
+int32_t sys_taskstats(struct taskstat_entry* buf, uint32_t cnt)
+{
+    if(buf == NULL) {
+        return -1;
+    }
+    memset(buf, 0, cnt * sizeof(struct taskstat_entry));
+    uint32_t entry_cnt = 0;
+    uint32_t rcu_idx = rcu_read_lock();
+    struct list_elem* elem = thread_all_list.head.next;
+    while(elem != &thread_all_list.tail && entry_cnt < cnt) {
+        struct task_struct* pthread = elem2entry(struct task_struct, all_list_tag, elem);
+        struct taskstat_entry* entry = &buf[entry_cnt++];
+        entry->pid = pthread->pid;
+        entry->parent_pid = pthread->parent_pid;
+        entry->group_pid = pthread->group_leader->pid;
+        entry->status = pthread->status;
+        strcpy(entry->name, pthread->name);
+        entry->stats = pthread->stats;
+        elem = elem->next;
+    }
+    rcu_read_unlock(rcu_idx);
+    return entry_cnt;
+}
+
+/*检查组号gid是否指向一个已建立的组，默认组只在allow_default为true时算数*/
+static bool cpu_group_valid(int32_t gid, bool allow_default)
+{
+    if(gid == 0) {
+        return allow_default;
+    }
+    return gid > 0 && gid < CPU_GROUP_MAX && cpu_groups[gid].used;
+}
+
+/*新建cpu带宽控制组，每period个滴答中组内任务合计最多运行quota个滴答，quota为0表示不限制，返回组号，失败返回-1。
+  配额按所有cpu合计，多cpu时quota可以大于period*/
+int32_t sys_cpugroup_create(uint32_t quota, uint32_t period)
+{
+    if(period == 0) {
+        return -1;
+    }
+    enum intr_status old_status = intr_disable();
+    int32_t gid;
+    for(gid = 1; gid < CPU_GROUP_MAX; gid++) {
+        struct cpu_group* group = &cpu_groups[gid];
+        if(!group->used) {
+            group->used = true;
+            group->quota = quota;
+            group->period = period;
+            group->runtime = 0;
+            group->period_start = ticks;
+            group->throttled = false;
+            intr_set_status(old_status);
+            return gid;
+        }
+    }
+    intr_set_status(old_status);
+    return -1;
+}
+
+/*修改组gid的配额，从现在开始新的周期，被限流的任务立即放回，成功返回0，失败返回-1*/
+int32_t sys_cpugroup_set(int32_t gid, uint32_t quota, uint32_t period)
+{
+    if(period == 0 || !cpu_group_valid(gid, false)) {
+        return -1;
+    }
+    enum intr_status old_status = intr_disable();
+    struct cpu_group* group = &cpu_groups[gid];
+    group->quota = quota;
+    group->period = period;
+    group->runtime = 0;
+    group->period_start = ticks;
+    cpu_group_unthrottle(group);
+    intr_set_status(old_status);
+    return 0;
+}
+
+/*把pthread移到组gid，它因原来的组被限流而挂着时放回就绪队列，需关中断调用*/
+static void cpu_group_move(struct task_struct* pthread, uint8_t gid)
+{
+    struct cpu_group* old_group = &cpu_groups[pthread->cpu_group];
+    if(elem_find(&old_group->parked, &pthread->general_tag)) {
+        list_remove(&pthread->general_tag);
+        rq_append(pthread);
+    }
+    pthread->cpu_group = gid;
+}
+
+/*把pid所在进程的全部线程移到组gid，gid为0表示移回默认组，成功返回0，失败返回-1。
+  关着中断在rcu读侧临界区中遍历thread_all_list，期间没有任务能退出*/
+int32_t sys_cpugroup_attach(pid_t pid, int32_t gid)
+{
+    if(!cpu_group_valid(gid, true)) {
+        return -1;
+    }
+    enum intr_status old_status = intr_disable();
+    uint32_t rcu_idx = rcu_read_lock();
+    struct task_struct* target = pid2thread(pid);
+    if(target == NULL || target->pgdir == NULL) {   //内核线程不受限
+        rcu_read_unlock(rcu_idx);
+        intr_set_status(old_status);
+        return -1;
+    }
+    struct task_struct* leader = target->group_leader;
+    struct list_elem* elem = thread_all_list.head.next;
+    while(elem != &thread_all_list.tail) {
+        struct task_struct* pthread = elem2entry(struct task_struct, all_list_tag, elem);
+        if(pthread->group_leader == leader && pthread->status != TASK_DIED) {
+            cpu_group_move(pthread, gid);
+        }
+        elem = elem->next;
+    }
+    rcu_read_unlock(rcu_idx);
+    intr_set_status(old_status);
+    return 0;
+}
+
+/*删除组gid，组内的任务移回默认组，成功返回0，失败返回-1*/
+int32_t sys_cpugroup_destroy(int32_t gid)
+{
+    if(!cpu_group_valid(gid, false)) {
+        return -1;
+    }
+    enum intr_status old_status = intr_disable();
+    cpu_group_unthrottle(&cpu_groups[gid]);
+    uint32_t rcu_idx = rcu_read_lock();
+    struct list_elem* elem = thread_all_list.head.next;
+    while(elem != &thread_all_list.tail) {
+        struct task_struct* pthread = elem2entry(struct task_struct, all_list_tag, elem);
+        if(pthread->cpu_group == gid) {
+            pthread->cpu_group = 0;
+        }
+        elem = elem->next;
+    }
+    rcu_read_unlock(rcu_idx);
+    cpu_groups[gid].used = false;
+    intr_set_status(old_status);
+    return 0;
 }
 
 /*初始化线程环境*/
 void thread_init(void)
 {
     put_str("thread_init start\n");
-    list_init(&thread_ready_list);
+    uint32_t cpu_id, level;
+    for(cpu_id = 0; cpu_id < MAX_CPUS; cpu_id++) {
+        for(level = 0; level < RQ_LEVELS; level++) {
+            list_init(&run_queues[cpu_id].levels[level]);
+        }
+        run_queues[cpu_id].bitmap = 0;
+        run_queues[cpu_id].nr_ready = 0;
+    }
+    uint32_t gid;
+    for(gid = 0; gid < CPU_GROUP_MAX; gid++) {
+        list_init(&cpu_groups[gid].parked);
+    }
+    cpu_groups[0].used = true;
     list_init(&thread_all_list);
+    rwlock_init(&thread_all_lock);
+    rcu_init();
+    ctx_switch_counter = counter_register("ctx_switches");
+    cpu_group_throttle_counter = counter_register("cpu_group_throttles");
     pid_pool_init();
-
-    //lock_init(&pid_lock);
+    task_cache = kmem_cache_create("task_struct", PG_SIZE, NULL);
 
     //先创建第一个用户进程init
     process_execute(init, "init");
@@ -403,6 +980,7 @@ void thread_init(void)
 
     //创建idle线程
     idle_thread = thread_start("idle", 10, idle, NULL);
+    cpu_idle[0] = idle_thread;
     
     put_str("thread_init done\n");
 }
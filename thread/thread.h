@@ -4,16 +4,30 @@
 #include "list.h"
 #include "bitmap.h"
 #include "memory.h"
+#include "rcu.h"
 
-#define MAX_FILES_OPEN_PER_PROC 8
+#define MAX_FILES_OPEN_PER_PROC 4096   //每个进程最多的文件描述符数
+#define FD_INLINE 8   //pcb中内嵌的文件描述符槽数，打开的文件多了再换成从内核分配的表，须是8的倍数
 #define TASK_NAME_LEN 16
+#define MAX_SEGS_PER_PROC 4   //每个进程最多记录的可加载段数
+#define MAX_MMAPS_PER_PROC 8   //每个进程最多的mmap映射区数
+#define MAX_SHM_ATTACHES_PER_PROC 4   //每个进程最多的共享内存挂接数
+
+struct inode;
+struct rwlock;
+struct file;
 
 /*自定义通用函数类型，它将在很多线程函数中作为参数类型*/
 typedef void thread_func(void*);
 typedef int16_t pid_t;
 
-extern struct list thread_ready_list;   //就绪队列
+#define RQ_LEVELS 8   //就绪队列的级别数，0级最先调度
+#define RQ_BOOST_INTERVAL 100   //每隔这么多滴答把降级的任务恢复到初始级别，防止饥饿
+#define CPU_GROUP_MAX 8   //cpu带宽控制组的个数，0号是不限制的默认组
+
 extern struct list thread_all_list;   //所有任务队列
+extern struct rwlock thread_all_lock;   //增删thread_all_list时持写锁，只遍历的读者在rcu读侧临界区中不加锁遍历
+extern struct kmem_cache* task_cache;   //pcb的对象缓存
 
 /*进程或线程的状态*/
 enum task_status
@@ -78,6 +92,59 @@ struct thread_stack
     void* func_arg;   //由kernel_thread所调用的函数所需的参数
 };
 
+/*进程映像中按需从文件加载的段，缺页时根据它填充页框*/
+struct load_segment
+{
+    uint32_t vaddr;   //段在内存中的起始虚拟地址
+    uint32_t filesz;   //段在文件中的大小，超出部分到memsz为止填0
+    uint32_t memsz;   //段在内存中的大小
+    uint32_t offset;   //段在文件中的偏移
+    bool writable;   //段是否可写，只读段的页不可写并在运行同一程序的进程间共享
+};
+
+/*mmap建立的映射区，页在缺页时才分配，文件映射从文件填充，匿名映射填0*/
+struct mmap_area
+{
+    uint32_t vaddr;   //映射区起始虚拟地址，页对齐，为0表示空闲
+    uint32_t len;   //映射区字节数，页的整数倍
+    struct inode* inode;   //映射的文件，匿名映射为NULL
+    uint32_t offset;   //映射区开头在文件中的偏移
+    uint32_t prot;   //PROT_READ、PROT_WRITE的组合
+    bool huge;   //匿名映射区要求用大页，整段覆盖的4MB对齐区域缺页时映射一个大页
+};
+
+/*共享内存段在进程中的一次挂接，页在挂接时就全部映射*/
+struct shm_attach
+{
+    uint32_t vaddr;   //挂接的起始虚拟地址，为0表示空闲
+    int32_t shmid;   //挂接的段
+};
+
+/*任务的资源使用统计，从任务创建时开始累计*/
+struct task_stats
+{
+    uint32_t utime;   //时钟滴答落在用户态的次数
+    uint32_t stime;   //时钟滴答落在内核态的次数，内核线程的都算在这里
+    uint32_t syscalls;   //系统调用次数
+    uint64_t syscall_cycles;   //在系统调用中经过的时钟周期数，含阻塞等待的时间
+    uint32_t page_faults;   //页错误次数
+    uint32_t read_secs;   //提交给硬盘读的扇区数
+    uint32_t write_secs;   //提交给硬盘写的扇区数，回写线程代写的记在回写线程上
+    uint32_t nvcsw;   //主动让出cpu的次数，阻塞、thread_yield和退出
+    uint32_t nivcsw;   //时间片用完被抢占的次数
+};
+
+/*sys_taskstats返回的一项，对应一个任务*/
+struct taskstat_entry
+{
+    pid_t pid;
+    pid_t parent_pid;
+    pid_t group_pid;   //所属进程主线程的pid，同一进程的线程相同
+    uint8_t status;   //enum task_status
+    char name[TASK_NAME_LEN];
+    struct task_stats stats;
+};
+
 /*进程或线程的pcb，程序控制块*/
 struct task_struct
 {
@@ -87,21 +154,53 @@ struct task_struct
     char name[16];
     uint8_t priority;   //线程优先级
     uint8_t ticks;   //每次处理器上执行的时间滴答数，任务的时间片
+    uint8_t rq_level;   //所在就绪队列的级别，用完时间片降一级，被唤醒时恢复为由priority决定的初始级别
+    uint8_t cpu;   //所在就绪队列属于哪个cpu
+    uint16_t bkl_depth;   //大内核锁的嵌套深度，大于0表示正在内核中运行，所在cpu持有大内核锁
+    uint16_t preempt_count;   //禁止抢占的嵌套深度，大于0时不在抢占点换下此任务
+    bool need_resched;   //时间片用完或唤醒了级别更靠前的任务，到下一个抢占点时换下此任务
+    uint8_t cpu_group;   //所属的cpu带宽控制组，fork和clone出的任务继承
 
     uint32_t elapsed_ticks;   //此任务自上cpu运行后至今占用了多少cpu滴答数，从运行开始到运行结束所经历的总时钟数
+    uint32_t wakeup_tick;   //休眠时到此滴答数被唤醒
+    struct task_stats stats;   //资源使用统计
 
-    int32_t fd_table[MAX_FILES_OPEN_PER_PROC];   //文件描述符数组
+    struct file** fd_table;   //文件描述符数组，指向文件结构，为NULL表示空闲。开始时指向fd_inline，不够用时翻倍换表
+    uint32_t fd_size;   //fd_table的槽数
+    struct bitmap fd_bitmap;   //fd_table的占用位图，用来找最小的空闲描述符
+    struct file* fd_inline[FD_INLINE];
+    uint8_t fd_inline_bits[FD_INLINE / 8];
 
     struct list_elem general_tag;   //的作用是用于线程在一般的队列中的节点，线程的标签
 
     struct list_elem all_list_tag;   //用于线程队列thread_all_list中的节点，用于线程被加入到全部线程队列时使用
+    struct rcu_head rcu;   //退出后等不加锁遍历thread_all_list的读者都离开再释放pcb
+    struct list children;   //还在运行的子进程队列
+    struct list zombies;   //已经exit等待收获的子进程，按退出的先后排列，wait直接取队首
+    struct list_elem child_tag;   //父进程children或zombies队列中的节点
+    struct task_struct* group_leader;   //所属进程的主线程，页表以外的进程资源都记在主线程的pcb里，进程和内核线程指向自己
+    uint16_t thread_cnt;   //只在主线程中有效，进程中还没退出的其他线程数，大于0时进程的各线程都固定在主线程所在的cpu上
+    struct task_struct* joiner;   //在thread_join中等本线程退出的线程
 
     uint32_t* pgdir;   //进程自己页表的虚拟地址
+    uint32_t pde_used[USER_PDE_CNT / 32];   //只在主线程中有效，用户空间建立过页表的页目录项，页表建立后不再拆除，fork和退出时只看这些页表
     struct virtual_addr userprog_vaddr;   //用户进程的虚拟地址
     struct mem_block_desc u_block_desc[DESC_CNT];   //用户进程内存块描述符表
+    struct mem_magazine k_mags[DESC_CNT];   //内核内存块缓存，每种规格一个
+    struct mem_magazine u_mags[DESC_CNT];   //用户内存块缓存，每种规格一个
     uint32_t cwd_inode_nr;   //进程所在的工作目录的inode编号
+    struct inode* exec_inode;   //进程映像所在文件的inode，缺页时从中读取，内核函数创建的进程为NULL
+    struct load_segment segs[MAX_SEGS_PER_PROC];   //进程映像的可加载段
+    uint8_t seg_cnt;   //segs中有效的段数
+    struct mmap_area mmaps[MAX_MMAPS_PER_PROC];   //mmap建立的映射区
+    uint32_t heap_brk;   //用户堆的当前末尾，为0表示进程还没有堆
+    struct shm_attach shm_attaches[MAX_SHM_ATTACHES_PER_PROC];   //挂接的共享内存段
     pid_t parent_pid;   //父进程的pid
     int8_t exit_status;   //进程结束时自己调用exit传出的参数
+    void* fpu_state;   //fpu保存区，第一次使用fpu时才分配
+    bool fpu_used;   //fpu_state中是否有有效的fpu状态
+    uint8_t journal_nest;   //journal_begin的嵌套层数，大于0时写入块缓存的元数据记入日志
+    bool wq_busy;   //是正在执行工作项的工作线程，阻塞和被唤醒时通知工作队列
     uint32_t stack_magic;   //栈的边界标记，用于检测栈的溢出
 };
 
@@ -112,6 +211,12 @@ void release_pid(pid_t pid);
 void thread_exit(struct task_struct* thread_over, bool need_schedule);
 /*根据pid找pcb，若找到则返回pcb，否则返回NULL*/
 struct task_struct* pid2thread(int32_t pid);
+/*将pthread加入全部任务队列和pid表，有父进程的同时加入父进程的子进程队列*/
+void thread_all_append(struct task_struct* pthread);
+/*将pthread的子进程全部过继给init*/
+void thread_orphan_children(struct task_struct* pthread);
+/*把退出的pthread从父进程的children队列移到zombies队列，返回父进程*/
+struct task_struct* thread_zombie_append(struct task_struct* pthread);
 /*为进程分配pid*/
 pid_t fork_pid();
 void thread_create(struct task_struct* pthread, thread_func function, void* func_arg);
@@ -120,10 +225,42 @@ struct task_struct* thread_start(char* name, int prio, thread_func function, voi
 void schedule(void);
 void thread_block(enum task_status stat);
 void thread_unblock(struct task_struct* pthread);
+/*将新建的任务pthread加入就绪队列*/
+void thread_ready(struct task_struct* pthread);
+/*本cpu是否没有就绪的任务*/
+bool thread_ready_empty(void);
+/*为cpu_id号cpu创建idle线程*/
+struct task_struct* thread_ap_idle_create(uint8_t cpu_id);
+/*从处理器进入idle线程，不再返回*/
+void thread_ap_idle(void);
 /*主动让出cpu，换其他线程运行*/
 void thread_yield(void);
+/*禁止当前任务被抢占，可以嵌套*/
+void preempt_disable(void);
+/*恢复当前任务可被抢占，最外层恢复时补上期间错过的调度*/
+void preempt_enable(void);
+/*抢占点：当前任务被标记需要调度且可以被抢占时换下它*/
+void preempt_check_resched(void);
+/*长时间运行的内核路径中的显式抢占点，只在可以睡眠的地方调用*/
+void cond_resched(void);
+/*时钟滴答时把当前任务运行的这个滴答记到所属组上，组的配额用完时限流并标记需要调度，需关中断调用*/
+void cpu_group_charge(struct task_struct* cur);
+/*0号cpu每个滴答调用，给到了新周期的组重新计时，把被限流的任务放回就绪队列，需关中断调用*/
+void cpu_group_tick(void);
+/*有组被限流时返回true，这时0号cpu空闲也要保持周期性时钟中断，按时解除限流*/
+bool cpu_group_need_tick(void);
+/*新建cpu带宽控制组，每period个滴答中组内任务合计最多运行quota个滴答，quota为0表示不限制，返回组号，失败返回-1*/
+int32_t sys_cpugroup_create(uint32_t quota, uint32_t period);
+/*修改组gid的配额，从现在开始新的周期，成功返回0，失败返回-1*/
+int32_t sys_cpugroup_set(int32_t gid, uint32_t quota, uint32_t period);
+/*把pid所在进程的全部线程移到组gid，gid为0表示移回默认组，成功返回0，失败返回-1*/
+int32_t sys_cpugroup_attach(pid_t pid, int32_t gid);
+/*删除组gid，组内的任务移回默认组，成功返回0，失败返回-1*/
+int32_t sys_cpugroup_destroy(int32_t gid);
 /*打印任务列表*/
 void sys_ps(void);
+/*把各任务的资源使用统计复制到buf，最多cnt项，返回复制的项数*/
+int32_t sys_taskstats(struct taskstat_entry* buf, uint32_t cnt);
 void thread_init(void);
 
 #endif
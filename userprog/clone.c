@@ -0,0 +1,151 @@
+#include "clone.h"
+#include "stdint.h"
+#include "global.h"
+#include "thread.h"
+#include "memory.h"
+#include "process.h"
+#include "string.h"
+#include "interrupt.h"
+#include "list.h"
+#include "sync.h"
+#include "debug.h"
+#include "stdio-kernel.h"
+
+extern void bkl_intr_exit(void);   //外部函数，释放大内核锁后中断退出
+
+/*在当前进程中新建一个线程，从用户态的entry开始执行，用户栈顶为stack，返回线程的pid，失败返回-1。
+  新线程和进程的其他线程共用页表、虚拟地址池、用户堆、文件描述符和工作目录，这些都记在主线程的pcb里，
+  自己只有pcb、内核栈和调用者准备好的用户栈*/
+pid_t sys_clone(void* entry, void* stack)
+{
+    struct task_struct* cur = running_thread();
+    struct task_struct* leader = cur->group_leader;
+    if(cur->pgdir == NULL || (uint32_t)entry < USER_VADDR_START || (uint32_t)entry >= 0xc0000000 \
+       || (uint32_t)stack <= USER_VADDR_START || (uint32_t)stack > 0xc0000000) {
+        printk("sys_clone: bad entry or stack\n");
+        return -1;
+    }
+    struct task_struct* thread = kmem_cache_alloc(task_cache);
+    if(thread == NULL) {
+        return -1;
+    }
+    init_thread(thread, leader->name, cur->priority);
+    thread->pgdir = leader->pgdir;
+    thread->userprog_vaddr = leader->userprog_vaddr;   //位图和区段树都是指针，各线程分配地址时操作的是同一份
+    thread->group_leader = leader;
+    thread->cpu_group = cur->cpu_group;
+
+    //中断栈照抄调用者的段寄存器和eflags，返回用户态后从entry开始执行
+    struct intr_stack* cur_stack = (struct intr_stack*)((uint32_t)cur + PG_SIZE - sizeof(struct intr_stack));
+    struct intr_stack* intr_0_stack = (struct intr_stack*)((uint32_t)thread + PG_SIZE - sizeof(struct intr_stack));
+    memcpy(intr_0_stack, cur_stack, sizeof(struct intr_stack));
+    intr_0_stack->edi = intr_0_stack->esi = intr_0_stack->ebp = intr_0_stack->esp_dummy = 0;
+    intr_0_stack->ebx = intr_0_stack->edx = intr_0_stack->ecx = intr_0_stack->eax = 0;
+    intr_0_stack->eip = entry;
+    intr_0_stack->esp = stack;
+
+    //紧挨中断栈之下为switch_to准备ebp、ebx、edi、esi和返回地址，同fork的子进程一样经bkl_intr_exit回到用户态
+    uint32_t* thread_stack = (uint32_t*)intr_0_stack - 5;
+    memset(thread_stack, 0, 4 * sizeof(uint32_t));
+    thread_stack[4] = (uint32_t)bkl_intr_exit;
+    thread->self_kstack = thread_stack;
+
+    enum intr_status old_status = intr_disable();
+    leader->thread_cnt++;   //先计数，thread_ready才会把新线程放到主线程所在的cpu上
+    thread_ready(thread);
+    thread_all_append(thread);   //parent_pid为-1，线程不进父进程的子进程队列，wait等不到它
+    intr_set_status(old_status);
+    return thread->pid;
+}
+
+/*等待当前进程中的线程tid结束，将其退出状态存入status，成功返回0。
+  tid不是本进程中主线程以外的其他线程，或已有别的线程在等它时返回-1*/
+int32_t sys_thread_join(pid_t tid, int32_t* status)
+{
+    struct task_struct* cur = running_thread();
+    while(1) {
+        //从检查线程状态到阻塞自己之间要关中断，否则会错过线程退出时的唤醒
+        enum intr_status old_status = intr_disable();
+        struct task_struct* thread = pid2thread(tid);
+        if(thread == NULL || thread == cur || thread->group_leader != cur->group_leader \
+           || thread->group_leader == thread || (thread->joiner != NULL && thread->joiner != cur)) {
+            intr_set_status(old_status);
+            return -1;
+        }
+        if(thread->status == TASK_HANGING) {
+            intr_set_status(old_status);
+            if(status != NULL) {
+                *status = thread->exit_status;
+            }
+            thread_exit(thread, false);
+            return 0;
+        }
+        thread->joiner = cur;
+        thread_block(TASK_WAITING);
+        intr_set_status(old_status);
+    }
+}
+
+/*主线程以外的线程调用exit时结束自己，挂起等thread_join或主线程退出时回收pcb，不再返回*/
+void clone_exit(int32_t status)
+{
+    struct task_struct* cur = running_thread();
+    struct task_struct* leader = cur->group_leader;
+    ASSERT(leader != cur);
+    cur->exit_status = status;
+    mem_magazine_drain(cur);   //线程自己的只有内核内存块缓存，其余资源属于进程
+
+    enum intr_status old_status = intr_disable();
+    leader->thread_cnt--;
+    if(cur->joiner != NULL && cur->joiner->status == TASK_WAITING) {
+        thread_unblock(cur->joiner);
+    }
+    //主线程可能在clone_wait_all中等，在wait中等子进程时被唤醒也只是多查一次
+    if(leader != cur->joiner && leader->status == TASK_WAITING) {
+        thread_unblock(leader);
+    }
+    thread_block(TASK_HANGING);
+    intr_set_status(old_status);
+    PANIC("clone_exit: should not be here\n");
+}
+
+/*在leader的进程中找一个主线程以外的线程，没有返回NULL*/
+static struct task_struct* find_group_thread(struct task_struct* leader)
+{
+    struct task_struct* found = NULL;
+    uint32_t rcu_idx = rcu_read_lock();
+    struct list_elem* elem = thread_all_list.head.next;
+    while(elem != &thread_all_list.tail) {
+        struct task_struct* pthread = elem2entry(struct task_struct, all_list_tag, elem);
+        if(pthread != leader && pthread->group_leader == leader) {
+            found = pthread;
+            break;
+        }
+        elem = elem->next;
+    }
+    rcu_read_unlock(rcu_idx);
+    return found;
+}
+
+/*主线程结束进程前调用，等进程中的其他线程都结束，再回收没有被thread_join的线程的pcb*/
+void clone_wait_all(struct task_struct* leader)
+{
+    while(1) {
+        enum intr_status old_status = intr_disable();
+        if(leader->thread_cnt == 0) {
+            intr_set_status(old_status);
+            break;
+        }
+        thread_block(TASK_WAITING);
+        intr_set_status(old_status);
+    }
+
+    struct task_struct* pthread = NULL;
+    while((pthread = find_group_thread(leader)) != NULL) {
+        if(pthread->status != TASK_HANGING) {   //已计过数，还没来得及挂起
+            thread_yield();
+            continue;
+        }
+        thread_exit(pthread, false);
+    }
+}
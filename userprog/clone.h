@@ -0,0 +1,16 @@
+#ifndef __USERPROG_CLONE_H
+#define __USERPROG_CLONE_H
+#include "stdint.h"
+#include "global.h"
+#include "thread.h"
+
+/*在当前进程中新建一个线程，从用户态的entry开始执行，用户栈顶为stack，返回线程的pid，失败返回-1*/
+pid_t sys_clone(void* entry, void* stack);
+/*等待当前进程中的线程tid结束，将其退出状态存入status，成功返回0，失败返回-1*/
+int32_t sys_thread_join(pid_t tid, int32_t* status);
+/*主线程以外的线程调用exit时结束自己，不再返回*/
+void clone_exit(int32_t status);
+/*主线程结束进程前调用，等进程中的其他线程都结束并回收它们的pcb*/
+void clone_wait_all(struct task_struct* leader);
+
+#endif
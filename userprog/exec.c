@@ -7,8 +7,18 @@
 #include "thread.h"
 #include "interrupt.h"
 #include "stdio.h"
+#include "file.h"
+#include "inode.h"
+#include "process.h"
+#include "fpu.h"
+#include "mmap.h"
+#include "shm.h"
+#include "wait_exit.h"
+#include "debug.h"
+#include "stdio-kernel.h"
+#include "vdata.h"
 
-extern void intr_exit(void);   //外部函数，中断退出
+extern void bkl_intr_exit(void);   //外部函数，释放大内核锁后中断退出
 typedef uint32_t Elf32_Word, Elf32_Addr, Elf32_Off;
 typedef uint16_t Elf32_Half;
 
@@ -56,68 +66,294 @@ enum segment_type
     PT_PHDR     //程序头表
 };
 
-/*将文件描述符fd指向的文件中，偏移为offset，大小为filesz的段加载到虚拟地址为vaddr的内存*/
-static bool segment_load(int32_t fd, uint32_t offset, uint32_t filesz, uint32_t vaddr)
-{
-    // printf("\n\n\n\nBBBBBBBBBBBBBBBBBBBBBBBBB\n");
-    uint32_t vaddr_first_page = vaddr & 0xfffff000;   //vaddr地址所在的页框
-    uint32_t size_in_first_page = PG_SIZE - (vaddr & 0x00000fff);   //加载到内存后，文件在第一个页框中占用的字节大小
-    uint32_t occupy_pages = 0;   //存储该段占用的总页框数
-
-    // printf("\n\n\n\nfilesz=%d\n", filesz);
-    // printf("vaddr=%x\n", vaddr);
-    // printf("size_in_first_page=%d\n", size_in_first_page);
-    //若一个页框容不下该段
-    if(filesz > size_in_first_page) {
-        uint32_t left_size = filesz - size_in_first_page;
-        occupy_pages = DIV_ROUND_UP(left_size, PG_SIZE) + 1;   //1指的是vaddr_first_page
-    } else {
-        occupy_pages = 1;
-    }
-
-    //为进程分配内存
-    uint32_t page_idx = 0;
-    uint32_t vaddr_page = vaddr_first_page;
-    while(page_idx < occupy_pages) {
-        uint32_t *pde = pde_ptr(vaddr_page);
-        uint32_t *pte = pte_ptr(vaddr_page);
+#define PF_W 0x2   //程序头p_flags中表示段可写的位
+#define EXEC_CACHE_PAGES (PG_SIZE / 4)   //每个映像最多缓存的页数，页框数组正好占一页
+
+/*映像缓存中的一项，记录part上i_no文件解析好的可加载段，并留住已从文件填充过的页框供后面运行它的进程共用*/
+struct exec_image
+{
+    struct partition* part;   //为NULL表示空闲
+    uint32_t i_no;
+    int32_t entry;   //程序入口
+    struct load_segment segs[MAX_SEGS_PER_PROC];
+    uint8_t seg_cnt;
+    uint32_t base;   //最低的段所在页的起始地址，frames按页相对它的序号索引
+    uint32_t* frames;   //各页填充好的用户页框物理地址，为0表示还没缓存，缓存对每个页框持有一次引用
+    uint32_t last_use;   //最近一次使用时的exec_cache_tick，缓存满时换出最小的
+};
+
+static struct exec_image exec_images[EXEC_CACHE_CNT];
+static uint32_t exec_cache_tick;
+static uint32_t exec_cache_gen;   //缓存项每次失效或换出加1，填充一页期间变了，读到的可能是旧内容，不放入缓存
 
-        //如果pde不存在，或者pte不存在就分配内存
+/*释放当前进程在[vaddr_start, vaddr_end)内的页：已映射的连同页框一起释放，
+  只占了虚拟地址还未加载的页（旧映像的段）只释放虚拟地址*/
+static void segment_unmap(uint32_t vaddr_start, uint32_t vaddr_end)
+{
+    struct virtual_addr* vpool = &running_thread()->userprog_vaddr;
+    uint32_t vaddr_page = vaddr_start & 0xfffff000;
+    while(vaddr_page < vaddr_end) {
+        uint32_t *pde = pde_ptr(vaddr_page);
         //pde的判断要在pte之前，否则pde若不存在会导致判断pte时缺页异常
-        if(!(*pde & 0x00000001) || !(*pte & 0x00000001)) {
-            if(get_a_page(PF_USER, vaddr_page) == NULL) {
-                return false;
-            }
-        }   //如果原进程的页表已经分配了，利用现有的物理页直接覆盖进程体
+        if((*pde & 0x00000001) && (*pte_ptr(vaddr_page) & 0x00000001)) {
+            mfree_page(PF_USER, (void*)vaddr_page, 1);
+        } else if(bitmap_scan_test(&vpool->vaddr_bitmap, (vaddr_page - vpool->vaddr_start) / PG_SIZE)) {
+            vaddr_remove(PF_USER, (void*)vaddr_page, 1);
+        }
         vaddr_page += PG_SIZE;
-        page_idx++;
     }
-    sys_lseek(fd, offset, SEEK_SET);
-    sys_read(fd, (void*)vaddr, filesz);
+}
+
+/*在映像缓存中查找part上i_no文件，需关中断调用*/
+static struct exec_image* exec_cache_find(struct partition* part, uint32_t i_no)
+{
+    uint32_t idx;
+    for(idx = 0; idx < EXEC_CACHE_CNT; idx++) {
+        if(exec_images[idx].part == part && exec_images[idx].i_no == i_no) {
+            return &exec_images[idx];
+        }
+    }
+    return NULL;
+}
+
+/*释放已从缓存中摘下的映像对各页框的引用和页框数组，还映射着这些页框的进程照常使用*/
+static void exec_image_free(uint32_t* frames)
+{
+    uint32_t pg_idx;
+    for(pg_idx = 0; pg_idx < EXEC_CACHE_PAGES; pg_idx++) {
+        if(frames[pg_idx] != 0) {
+            pfree(frames[pg_idx]);
+        }
+    }
+    mfree_page(PF_KERNEL, frames, 1);
+}
+
+/*在缓存中查找part上i_no文件，命中时把段复制到segs和seg_cnt中并返回程序入口，否则返回-1*/
+static int32_t exec_cache_lookup(struct partition* part, uint32_t i_no, struct load_segment* segs, uint8_t* seg_cnt)
+{
+    int32_t entry = -1;
+    enum intr_status old_status = intr_disable();
+    struct exec_image* image = exec_cache_find(part, i_no);
+    if(image != NULL) {
+        memcpy(segs, image->segs, sizeof(image->segs));
+        *seg_cnt = image->seg_cnt;
+        entry = image->entry;
+        image->last_use = ++exec_cache_tick;
+    }
+    intr_set_status(old_status);
+    return entry;
+}
+
+/*把解析好的part上i_no文件的映像放入缓存，缓存满时换出最久没用的一项，内存紧张时不缓存*/
+static void exec_cache_insert(struct partition* part, uint32_t i_no, int32_t entry, const struct load_segment* segs, uint8_t seg_cnt)
+{
+    uint32_t* frames = get_kernel_pages(1);
+    if(frames == NULL) {
+        return;
+    }
+    uint32_t* old_frames = NULL;
+    enum intr_status old_status = intr_disable();
+    if(exec_cache_find(part, i_no) != NULL) {   //分配页框期间别的进程已经放进来了
+        intr_set_status(old_status);
+        mfree_page(PF_KERNEL, frames, 1);
+        return;
+    }
+    struct exec_image* image = &exec_images[0];
+    uint32_t idx;
+    for(idx = 0; idx < EXEC_CACHE_CNT && image->part != NULL; idx++) {
+        if(exec_images[idx].part == NULL || exec_images[idx].last_use < image->last_use) {
+            image = &exec_images[idx];
+        }
+    }
+    if(image->part != NULL) {
+        old_frames = image->frames;
+        exec_cache_gen++;
+    }
+    image->part = part;
+    image->i_no = i_no;
+    image->entry = entry;
+    memcpy(image->segs, segs, sizeof(image->segs));
+    image->seg_cnt = seg_cnt;
+    image->base = 0xc0000000;
+    for(idx = 0; idx < seg_cnt; idx++) {
+        if((segs[idx].vaddr & 0xfffff000) < image->base) {
+            image->base = segs[idx].vaddr & 0xfffff000;
+        }
+    }
+    image->frames = frames;
+    image->last_use = ++exec_cache_tick;
+    intr_set_status(old_status);
+    if(old_frames != NULL) {
+        exec_image_free(old_frames);
+    }
+}
+
+/*part上i_no文件被写入或删除时调用，丢掉它的缓存项，已映射了缓存页框的进程继续用加载时的内容*/
+void exec_cache_invalidate(struct partition* part, uint32_t i_no)
+{
+    uint32_t* frames = NULL;
+    enum intr_status old_status = intr_disable();
+    struct exec_image* image = exec_cache_find(part, i_no);
+    if(image != NULL) {
+        frames = image->frames;
+        image->part = NULL;
+        exec_cache_gen++;
+    }
+    intr_set_status(old_status);
+    if(frames != NULL) {
+        exec_image_free(frames);
+    }
+}
+
+/*返回缓存项image中vaddr_page这一页在frames中的下标，超出缓存范围返回-1*/
+static int32_t exec_image_pg_idx(struct exec_image* image, uint32_t vaddr_page)
+{
+    if(vaddr_page < image->base || (vaddr_page - image->base) / PG_SIZE >= EXEC_CACHE_PAGES) {
+        return -1;
+    }
+    return (vaddr_page - image->base) / PG_SIZE;
+}
+
+/*返回缓存中part上i_no文件vaddr_page这一页的页框物理地址，没有返回0，gen带回当前的版本号*/
+static uint32_t exec_cache_frame(struct partition* part, uint32_t i_no, uint32_t vaddr_page, uint32_t* gen)
+{
+    uint32_t pg_phy_addr = 0;
+    enum intr_status old_status = intr_disable();
+    *gen = exec_cache_gen;
+    struct exec_image* image = exec_cache_find(part, i_no);
+    if(image != NULL) {
+        int32_t pg_idx = exec_image_pg_idx(image, vaddr_page);
+        if(pg_idx != -1) {
+            pg_phy_addr = image->frames[pg_idx];
+        }
+    }
+    intr_set_status(old_status);
+    return pg_phy_addr;
+}
+
+/*把当前进程刚填充好的vaddr_page这一页的页框pg_phy_addr放入缓存并加一次引用，放入返回true。
+  填充期间缓存项失效或换出过，或别的进程已经放入了这一页时不放入*/
+static bool exec_cache_add_frame(struct partition* part, uint32_t i_no, uint32_t vaddr_page, uint32_t pg_phy_addr, uint32_t gen)
+{
+    bool added = false;
+    enum intr_status old_status = intr_disable();
+    struct exec_image* image = exec_cache_find(part, i_no);
+    if(image != NULL && gen == exec_cache_gen) {
+        int32_t pg_idx = exec_image_pg_idx(image, vaddr_page);
+        if(pg_idx != -1 && image->frames[pg_idx] == 0) {
+            page_ref_inc(pg_phy_addr);
+            image->frames[pg_idx] = pg_phy_addr;
+            added = true;
+        }
+    }
+    intr_set_status(old_status);
+    return added;
+}
+
+/*处理进程映像按需加载引起的页错误，vaddr所在页属于某个可加载段时从文件填充并返回true。
+  映像缓存中已有这一页时直接映射缓存的页框：只读页共用，可写页写时复制，否则从文件填充后放入缓存*/
+bool segment_page_fault(uint32_t vaddr)
+{
+    struct task_struct* cur = running_thread()->group_leader;   //进程映像的段记在主线程里
+    if(cur->pgdir == NULL || cur->exec_inode == NULL || vaddr >= 0xc0000000) {
+        return false;
+    }
+    uint32_t* pde = pde_ptr(vaddr);
+    if((*pde & 0x00000001) && (*pte_ptr(vaddr) & 0x00000001)) {   //页已存在，不是缺页
+        return false;
+    }
+
+    //找出vaddr所在的段
+    uint8_t seg_idx = 0;
+    while(seg_idx < cur->seg_cnt) {
+        struct load_segment* seg = &cur->segs[seg_idx];
+        if(vaddr >= seg->vaddr && vaddr < seg->vaddr + seg->memsz) {
+            break;
+        }
+        seg_idx++;
+    }
+    if(seg_idx == cur->seg_cnt) {
+        return false;
+    }
+
+    //相邻的段可能落在同一页内，重叠的段中有一个可写本页就可写，有文件内容的页才放进映像缓存
+    uint32_t vaddr_page = vaddr & 0xfffff000;
+    bool writable = false, file_backed = false;
+    for(seg_idx = 0; seg_idx < cur->seg_cnt; seg_idx++) {
+        struct load_segment* seg = &cur->segs[seg_idx];
+        if(seg->vaddr < vaddr_page + PG_SIZE && seg->vaddr + seg->memsz > vaddr_page) {
+            writable = writable || seg->writable;
+            file_backed = file_backed || (seg->filesz > 0 && seg->vaddr + seg->filesz > vaddr_page);
+        }
+    }
+
+    uint32_t i_no = cur->exec_inode->i_no, gen = 0;
+    if(file_backed) {
+        uint32_t pg_phy_addr = exec_cache_frame(cur_part, i_no, vaddr_page, &gen);
+        if(pg_phy_addr != 0) {
+            if(writable) {
+                page_map_cow(vaddr_page, pg_phy_addr);
+            } else {
+                page_map_shared(vaddr_page, pg_phy_addr, false);
+            }
+            return true;
+        }
+    }
+
+    //整页都是.bss，读的时候先映射零页，写入时才分配页框
+    if(!file_backed && zero_page_fault(vaddr, writable)) {
+        return true;
+    }
+
+    if(get_a_page(PF_USER, vaddr_page) == NULL) {
+        return false;
+    }
+    memset((void*)vaddr_page, 0, PG_SIZE);   //.bss及段间空隙都要是0
+
+    //相邻的段可能落在同一页内，把与本页重叠的文件内容都读进来
+    for(seg_idx = 0; seg_idx < cur->seg_cnt; seg_idx++) {
+        struct load_segment* seg = &cur->segs[seg_idx];
+        uint32_t start = seg->vaddr > vaddr_page ? seg->vaddr : vaddr_page;
+        uint32_t end = seg->vaddr + seg->filesz;
+        if(end > vaddr_page + PG_SIZE) {
+            end = vaddr_page + PG_SIZE;
+        }
+        if(start < end) {
+            struct file seg_file;
+            seg_file.fd_pos = seg->offset + (start - seg->vaddr);
+            seg_file.fd_flag = O_RDONLY;
+            seg_file.fd_inode = cur->exec_inode;
+            seg_file.ra_pos = seg_file.fd_pos;   //缺页大多按地址顺序发生，直接用较大的预读窗口
+            seg_file.ra_window = FILE_RA_MAX / 2;
+            file_read(&seg_file, (void*)start, end - start);
+        }
+    }
+
+    //放入缓存的可写页也被缓存引用着，自己第一次写时同样要复制一份
+    bool cached = file_backed && exec_cache_add_frame(cur_part, i_no, vaddr_page, addr_v2p(vaddr_page), gen);
+    uint32_t* pte = pte_ptr(vaddr_page);
+    if(!writable) {
+        *pte &= ~PG_RW_W;
+    } else if(cached) {
+        *pte = (*pte & ~PG_RW_W) | PG_COW;
+    }
+    if(!writable || cached) {
+        asm volatile ("invlpg %0" : : "m"(*(uint8_t*)vaddr_page) : "memory");
+    }
     return true;
 }
 
-/*从文件系统上加载用户程序pathname，成功则返回程序的起始地址，否则返回-1*/
-static int32_t load(const char* pathname)
+/*从已打开的程序文件fd中读出并校验elf头和各程序头，可加载段记录到segs和seg_cnt中，成功返回程序入口，否则返回-1*/
+static int32_t elf_parse(int32_t fd, struct load_segment* segs, uint8_t* seg_cnt)
 {
-    // printf("\n\n\n!!!!!!!!!!!!!\n\n\n");
-    int32_t ret = -1;
     struct Elf32_Ehdr elf_header;
     struct Elf32_Phdr prog_header;
     memset(&elf_header, 0, sizeof(struct Elf32_Ehdr));
 
-    int32_t fd = sys_open(pathname, O_RDONLY);
-    if(fd == -1) {
-        return -1;
-    }
-
     if(sys_read(fd, &elf_header, sizeof(struct Elf32_Ehdr)) != sizeof(struct Elf32_Ehdr)) {
-        ret = -1;
-        goto done;
+        return -1;
     }
 
-    // printf("\n\n\n!!!!!!!!!!!!\n\n\n");
-
     //校验elf头
     if(memcmp(elf_header.e_ident, "\177ELF\1\1\1", 7) \
        || elf_header.e_type != 2 \
@@ -125,20 +361,16 @@ static int32_t load(const char* pathname)
        || elf_header.e_version != 1 \
        || elf_header.e_phnum > 1024 \
        || elf_header.e_phentsize != sizeof(struct Elf32_Phdr)) {
-           ret = -1;
-           goto done;
+           return -1;
     }
 
-    // printf("\n\n\n!!!!!!!!!!!!!\n\n\n");
-
     Elf32_Off prog_header_offset = elf_header.e_phoff;
     Elf32_Off prog_header_size = elf_header.e_phentsize;
 
-    //遍历所有程序头
+    //遍历所有程序头，先全部校验并记录下来，出错时原进程映像不受影响
     uint32_t prog_idx = 0;
-    int idx = 1;
+    *seg_cnt = 0;
     while(prog_idx < elf_header.e_phnum) {
-        // printf("\n\n\nprogment_num=%d\n", idx++);
         memset(&prog_header, 0, prog_header_size);
 
         //将文件的指针定位到程序头
@@ -146,31 +378,114 @@ static int32_t load(const char* pathname)
 
         //置获取程序头
         if(sys_read(fd, &prog_header, prog_header_size) != prog_header_size) {
-            ret = -1;
-            goto done;
+            return -1;
         }
 
-        //如果是可加载段就调用segment_load加载到内存
+        //记录可加载段
         if(PT_LOAD == prog_header.p_type) {
-            if(!segment_load(fd, prog_header.p_offset, prog_header.p_filesz, prog_header.p_vaddr)) {
-                ret = -1;
-                goto done;
+            if(*seg_cnt == MAX_SEGS_PER_PROC \
+               || prog_header.p_filesz > prog_header.p_memsz \
+               || prog_header.p_vaddr < USER_VADDR_START \
+               || prog_header.p_vaddr + prog_header.p_memsz > 0xc0000000 - PG_SIZE \
+               || (prog_header.p_vaddr < USER_HEAP_BASE + USER_HEAP_MAX \
+                   && prog_header.p_vaddr + prog_header.p_memsz > USER_HEAP_BASE)) {   //最高的一页是用户栈，堆区的位置是固定的
+                return -1;
             }
+            struct load_segment* seg = &segs[*seg_cnt];
+            seg->vaddr = prog_header.p_vaddr;
+            seg->filesz = prog_header.p_filesz;
+            seg->memsz = prog_header.p_memsz;
+            seg->offset = prog_header.p_offset;
+            seg->writable = (prog_header.p_flags & PF_W) != 0;
+            (*seg_cnt)++;
         }
 
         //更新下一个程序头的偏移
         prog_header_offset += elf_header.e_phentsize;
         prog_idx++;
     }
-    ret = elf_header.e_entry;
+    return elf_header.e_entry;
+}
+
+/*从已打开的程序文件fd加载用户程序并关闭fd，成功则返回程序的起始地址，否则返回-1。
+  段只登记到pcb中，内容在缺页时才从文件读入。解析好的段按inode记在映像缓存里，再次加载同一程序时不必重读程序头*/
+static int32_t load_fd(int32_t fd)
+{
+    int32_t ret = -1;
+    struct load_segment segs[MAX_SEGS_PER_PROC];
+    uint8_t seg_cnt = 0;
+    memset(segs, 0, sizeof(segs));
+
+    uint32_t i_no = fd_local2file(fd)->fd_inode->i_no;
+    int32_t entry = exec_cache_lookup(cur_part, i_no, segs, &seg_cnt);
+    if(entry == -1) {
+        entry = elf_parse(fd, segs, &seg_cnt);
+        if(entry == -1) {
+            goto done;
+        }
+        exec_cache_insert(cur_part, i_no, entry, segs, seg_cnt);
+    }
+
+    //换上新的映像：释放旧映像各段的地址，再为新映像的各段腾出并占住地址，免得堆分配落进尚未加载的段里
+    struct task_struct* cur = running_thread();
+    uint8_t seg_idx;
+    for(seg_idx = 0; seg_idx < cur->seg_cnt; seg_idx++) {
+        segment_unmap(cur->segs[seg_idx].vaddr, cur->segs[seg_idx].vaddr + cur->segs[seg_idx].memsz);
+    }
+    mmap_unmap_all();   //旧映像的映射区也不再需要
+    shm_detach_all();
+    heap_reset();
+    vdata_reserve();   //exec不换进程号，已建立的数据页映射留着
+    for(seg_idx = 0; seg_idx < seg_cnt; seg_idx++) {
+        uint32_t vaddr_first_page = segs[seg_idx].vaddr & 0xfffff000;
+        uint32_t vaddr_end = segs[seg_idx].vaddr + segs[seg_idx].memsz;
+        segment_unmap(vaddr_first_page, vaddr_end);
+        vaddr_mark(PF_USER, (void*)vaddr_first_page, DIV_ROUND_UP(vaddr_end - vaddr_first_page, PG_SIZE));
+    }
+    if(cur->exec_inode != NULL) {
+        inode_close(cur->exec_inode);
+    }
+    cur->exec_inode = inode_open(cur_part, i_no);
+    memcpy(cur->segs, segs, sizeof(segs));
+    cur->seg_cnt = seg_cnt;
+    ret = entry;
 done:
     sys_close(fd);
     return ret;
 }
 
+/*从文件系统上加载用户程序pathname，成功则返回程序的起始地址，否则返回-1*/
+static int32_t load(const char* pathname)
+{
+    int32_t fd = sys_open(pathname, O_RDONLY);
+    if(fd == -1) {
+        return -1;
+    }
+    return load_fd(fd);
+}
+
+/*加载exec_lookup解析出的i_no号程序，不再解析路径。gen不是当前的目录项删除次数时解析结果可能已失效，返回-1，成功返回程序的起始地址。
+  打开后文件在已打开文件链表中，unlink不会再删它*/
+static int32_t load_inode(uint32_t i_no, uint32_t gen)
+{
+    if(gen != dir_entry_gen) {
+        return -1;
+    }
+    int32_t fd = file_open(i_no, O_RDONLY);
+    if(fd == -1) {
+        return -1;
+    }
+    return load_fd(fd);
+}
+
 /*用path指向的程序替换当前进程*/
 int32_t sys_execv(const char* path, const char* argv[])
 {
+    struct task_struct* cur = running_thread();
+    if(cur->group_leader != cur || cur->thread_cnt > 0) {   //换映像会拆掉其他线程正在用的地址空间
+        printk("sys_execv: process has other threads\n");
+        return -1;
+    }
     uint32_t argc = 0;
     while(argv[argc]) {
         argc++;
@@ -180,10 +495,10 @@ int32_t sys_execv(const char* path, const char* argv[])
         return -1;
     }
 
-    struct task_struct* cur = running_thread();
     //修改进程名
     memcpy(cur->name, path, TASK_NAME_LEN);
     cur->name[TASK_NAME_LEN - 1] = 0;
+    fpu_exec(cur);   //新程序从干净的fpu状态开始
 
     struct intr_stack* intr_0_stack = (struct intr_stack*)((uint32_t)cur + PG_SIZE - sizeof(struct intr_stack));
     //参数传递给用户程序
@@ -195,9 +510,160 @@ int32_t sys_execv(const char* path, const char* argv[])
 
     //exec不同于fork，为使新进程更快被执行，直接从中断返回
     asm volatile ("movl %0, %%esp; \
-                   jmp intr_exit" \
+                   jmp bkl_intr_exit" \
                    : \
                    : "g"(intr_0_stack) \
                    : "memory");
     return 0;
 }
+
+/*spawn交给子进程的参数，和path、各参数字符串一起放在一页内核内存中*/
+struct spawn_args
+{
+    uint32_t i_no;   //为0时按path加载，否则是exec_lookup解析出的程序inode号
+    uint32_t gen;   //解析i_no时的目录项删除次数
+    uint32_t argc;
+    uint32_t str_len;   //strs中字符串的总长度，含各自结尾的0
+    char strs[];   //先是path，后面依次是argc个参数
+};
+
+/*spawn创建的子进程第一次被调度时从这里开始运行，已在自己的页表中。
+  把参数复制到新分配的用户栈顶，加载程序后直接从中断返回到程序入口，加载失败时以-1退出*/
+static void spawn_start(void* args_)
+{
+    struct spawn_args* args = args_;
+    struct task_struct* cur = running_thread();
+    cur->self_kstack += sizeof(struct thread_stack);
+    struct intr_stack* proc_stack = (struct intr_stack*)cur->self_kstack;
+    proc_stack->edi = proc_stack->esi = proc_stack->ebp = proc_stack->esp_dummy = 0;
+    proc_stack->ebx = proc_stack->edx = proc_stack->ecx = proc_stack->eax = 0;
+    proc_stack->gs = 0;
+    proc_stack->ds = proc_stack->es = proc_stack->fs = SELECTOR_U_DATA;
+    proc_stack->cs = SELECTOR_U_CODE;
+    proc_stack->eflags = (EFLAGS_IOPL_0 | EFLAGS_MBS | EFLAGS_IF_1);
+    proc_stack->ss = SELECTOR_U_DATA;
+
+    //用户栈顶依次放字符串和以NULL结尾的argv数组，栈从argv数组下面开始
+    void* stack_page = get_a_page(PF_USER, USER_STACK3_VADDR);
+    if(stack_page == NULL) {
+        mfree_page(PF_KERNEL, args, 1);
+        sys_exit(-1);
+    }
+    char* path = (char*)stack_page + PG_SIZE - args->str_len;
+    memcpy(path, args->strs, args->str_len);
+    uint32_t argc = args->argc;
+    uint32_t i_no = args->i_no, gen = args->gen;
+    mfree_page(PF_KERNEL, args, 1);
+    char** argv = (char**)((uint32_t)path & 0xfffffffc) - (argc + 1);
+    char* arg = path + strlen(path) + 1;
+    uint32_t arg_idx;
+    for(arg_idx = 0; arg_idx < argc; arg_idx++) {
+        argv[arg_idx] = arg;
+        arg += strlen(arg) + 1;
+    }
+    argv[argc] = NULL;
+
+    int32_t entry_point = i_no != 0 ? load_inode(i_no, gen) : load(path);
+    if(entry_point == -1) {
+        sys_exit(-1);
+    }
+    memcpy(cur->name, path, TASK_NAME_LEN);
+    cur->name[TASK_NAME_LEN - 1] = 0;
+    proc_stack->ebx = (int32_t)argv;
+    proc_stack->ecx = argc;
+    proc_stack->eip = (void*)entry_point;
+    proc_stack->esp = (void*)((uint32_t)argv & 0xfffffff0);
+    asm volatile ("movl %0, %%esp; \
+                   jmp bkl_intr_exit" : : "g"(proc_stack) : "memory");
+}
+
+/*释放spawn建了一半的子进程child*/
+static void spawn_abort(struct task_struct* child)
+{
+    if(child->userprog_vaddr.vaddr_bitmap.bits != NULL) {
+        mfree_page(PF_KERNEL, child->userprog_vaddr.vaddr_bitmap.bits, USER_VADDR_BITMAP_PAGES);
+    }
+    if(child->userprog_vaddr.extents != NULL) {
+        mfree_page(PF_KERNEL, child->userprog_vaddr.extents, 1);
+    }
+    if(child->pgdir != NULL) {
+        mfree_page(PF_KERNEL, child->pgdir, 1);
+    }
+    release_pid(child->pid);
+    kmem_cache_free(task_cache, child);
+}
+
+/*新建一个运行path程序的子进程，参数为以NULL结尾的argv，返回子进程的pid，失败返回-1。
+  子进程直接建在新的地址空间里，只继承文件描述符和工作目录，不像fork后exec那样先复制父进程的页表、位图和pcb再丢掉，
+  开销和父进程的大小无关。程序在子进程中加载，加载失败时子进程以-1退出。i_no不为0时按exec_lookup的解析结果加载，不再解析path*/
+static pid_t spawn_task(const char* path, const char* argv[], uint32_t i_no, uint32_t gen)
+{
+    struct task_struct* parent = running_thread()->group_leader;   //线程新建的子进程也归主线程所有
+    ASSERT(parent->pgdir != NULL);
+    struct spawn_args* args = get_kernel_pages(1);
+    if(args == NULL) {
+        return -1;
+    }
+
+    //参数在父进程的用户空间里，子进程看不到，先复制到内核
+    uint32_t len = strlen(path) + 1;
+    if(len > SPAWN_ARG_MAX) {
+        mfree_page(PF_KERNEL, args, 1);
+        return -1;
+    }
+    memcpy(args->strs, path, len);
+    args->argc = 0;
+    while(argv[args->argc] != NULL) {
+        uint32_t arg_len = strlen(argv[args->argc]) + 1;
+        if(args->argc == SPAWN_ARGC_MAX || len + arg_len > SPAWN_ARG_MAX) {
+            printk("sys_spawn: too many arguments\n");
+            mfree_page(PF_KERNEL, args, 1);
+            return -1;
+        }
+        memcpy(args->strs + len, argv[args->argc], arg_len);
+        len += arg_len;
+        args->argc++;
+    }
+    args->str_len = len;
+    args->i_no = i_no;
+    args->gen = gen;
+
+    struct task_struct* child = kmem_cache_alloc(task_cache);
+    if(child == NULL) {
+        mfree_page(PF_KERNEL, args, 1);
+        return -1;
+    }
+    init_thread(child, "spawn", parent->priority);
+    if(addr_space_alloc(child) == -1 || fd_table_inherit(child, parent) == -1) {
+        spawn_abort(child);
+        mfree_page(PF_KERNEL, args, 1);
+        return -1;
+    }
+    block_desc_init(child->u_block_desc);
+    child->cwd_inode_nr = parent->cwd_inode_nr;
+    child->parent_pid = parent->pid;
+    child->cpu_group = parent->cpu_group;
+    thread_create(child, spawn_start, args);
+
+    enum intr_status old_status = intr_disable();
+    thread_ready(child);
+    thread_all_append(child);
+    intr_set_status(old_status);
+    return child->pid;
+}
+
+/*新建一个运行path程序的子进程，参数为以NULL结尾的argv，返回子进程的pid，失败返回-1*/
+pid_t sys_spawn(const char* path, const char* argv[])
+{
+    return spawn_task(path, argv, 0, 0);
+}
+
+/*新建子进程运行exec_lookup解析出的i_no号程序，argv[0]作为进程名。gen表明解析结果已失效时返回-1，调用者应重新解析，
+  成功返回子进程的pid，失败返回-1*/
+pid_t sys_spawn_inode(uint32_t i_no, uint32_t gen, const char* argv[])
+{
+    if(gen != dir_entry_gen || i_no == 0 || argv[0] == NULL) {
+        return -1;
+    }
+    return spawn_task(argv[0], argv, i_no, gen);
+}
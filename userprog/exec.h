@@ -1,8 +1,24 @@
 #ifndef __USERPROG_EXEC_H
 #define __USERPROG_EXEC_h
 #include "stdint.h"
+#include "global.h"
+#include "thread.h"
 
 /*用path指向的程序替换当前进程*/
 int32_t sys_execv(const char* path, const char* argv[]);
+#define SPAWN_ARG_MAX 1024   //spawn的路径和参数字符串的总字节数上限，连同argv数组放在子进程用户栈顶
+#define SPAWN_ARGC_MAX 16   //spawn最多的参数个数
+#define EXEC_CACHE_CNT 8   //映像缓存最多记录的程序数
+
+struct partition;
+
+/*新建一个运行path程序的子进程，参数为以NULL结尾的argv，返回子进程的pid，失败返回-1*/
+pid_t sys_spawn(const char* path, const char* argv[]);
+/*新建子进程运行exec_lookup解析出的i_no号程序，不再解析路径。gen表明解析结果已失效时返回-1，成功返回子进程的pid*/
+pid_t sys_spawn_inode(uint32_t i_no, uint32_t gen, const char* argv[]);
+/*处理进程映像按需加载引起的页错误，vaddr所在页属于某个可加载段时从文件填充并返回true*/
+bool segment_page_fault(uint32_t vaddr);
+/*part上i_no文件被写入或删除时调用，丢掉它在映像缓存中的解析结果和缓存的页框*/
+void exec_cache_invalidate(struct partition* part, uint32_t i_no);
 
 #endif
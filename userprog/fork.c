@@ -10,8 +10,12 @@
 #include "interrupt.h"
 #include "list.h"
 #include "pipe.h"
+#include "fpu.h"
+#include "mmap.h"
+#include "shm.h"
+#include "stdio-kernel.h"
 
-extern void intr_exit(void);
+extern void bkl_intr_exit(void);
 
 /*将父进程的pcb拷贝给子进程*/
 static int32_t copy_pcb_vaddrbitmap_stack0(struct task_struct* child_thread, struct task_struct* parent_thread)
@@ -20,61 +24,39 @@ static int32_t copy_pcb_vaddrbitmap_stack0(struct task_struct* child_thread, str
     memcpy(child_thread, parent_thread, PG_SIZE);
     child_thread->pid = fork_pid();
     child_thread->elapsed_ticks = 0;
+    memset(&child_thread->stats, 0, sizeof(child_thread->stats));
     child_thread->status = TASK_READY;
     child_thread->ticks = parent_thread->priority;
     child_thread->parent_pid = parent_thread->pid;
-    child_thread->general_tag.prev = child_thread->general_tag.next = NULL;
-    child_thread->all_list_tag.prev = child_thread->all_list_tag.prev = NULL;
+    list_init(&child_thread->children);   //子进程列表不能继承，加入全部任务队列时再挂到父进程下
+    list_init(&child_thread->zombies);
+    list_elem_init(&child_thread->child_tag);
+    child_thread->group_leader = child_thread;   //子进程只有调用fork的这一个线程
+    child_thread->thread_cnt = 0;
+    child_thread->joiner = NULL;
+    child_thread->bkl_depth = 1;   //子进程被换上cpu时处在内核中，由bkl_intr_exit释放
+    list_elem_init(&child_thread->general_tag);
+    list_elem_init(&child_thread->all_list_tag);
     block_desc_init(child_thread->u_block_desc);   //初始化进程自己的内存块描述符
-    //b. 复制父进程的虚拟地址池的位图
-    uint32_t bitmap_pg_cnt = DIV_ROUND_UP((0xc0000000 - USER_VADDR_START) / PG_SIZE / 8, PG_SIZE);   //位图占内存页数
-    void* vaddr_bitmap = get_kernel_pages(bitmap_pg_cnt);
-    //此时child_thread->userprog_vaddr.vaddr_bitmap.bits指向父进程虚拟地址的位图地址
-    memcpy(vaddr_bitmap, child_thread->userprog_vaddr.vaddr_bitmap.bits, bitmap_pg_cnt * PG_SIZE);
-    child_thread->userprog_vaddr.vaddr_bitmap.bits = vaddr_bitmap;
+    //内存块缓存不能继承，否则父子进程会共用同一批内核内存块
+    memset(child_thread->k_mags, 0, sizeof(child_thread->k_mags));
+    memset(child_thread->u_mags, 0, sizeof(child_thread->u_mags));
+    fpu_fork(child_thread, parent_thread);   //fpu保存区不能共用，复制一份
+    //b. 取一套只含内核部分的页目录和新的位图、区段树，再复制父进程的虚拟地址池的位图
+    child_thread->pgdir = NULL;
+    if(addr_space_alloc(child_thread) == -1) {
+        return -1;
+    }
+    memcpy(child_thread->userprog_vaddr.vaddr_bitmap.bits, parent_thread->userprog_vaddr.vaddr_bitmap.bits, \
+           parent_thread->userprog_vaddr.vaddr_bitmap.btmp_bytes_len);
+    //空闲区段树的节点用下标互相引用，整页复制即可
+    memcpy(child_thread->userprog_vaddr.extents, parent_thread->userprog_vaddr.extents, PG_SIZE);
     //调试用
     ASSERT(strlen(child_thread->name) < 11);
     strcat(child_thread->name, "_fork");
     return 0;
 }
 
-/*复制子进程的进程体（代码和数据）及用户栈
-  buf_page必须是内核页，要用它作为所有进程的数据缓冲区
-  此函数的主要功能就是拷贝进程的代码和数据资源，也就是复制一份进程体*/
-static void copy_body_stack3(struct task_struct* child_thread, struct task_struct* parent_thread, void* buf_page)
-{
-    uint8_t* vaddr_btmp = parent_thread->userprog_vaddr.vaddr_bitmap.bits;
-    uint32_t btmp_bytes_len = parent_thread->userprog_vaddr.vaddr_bitmap.btmp_bytes_len;
-    uint32_t vaddr_start = parent_thread->userprog_vaddr.vaddr_start;
-    uint32_t idx_byte = 0;
-    uint32_t idx_bit = 0;
-    uint32_t prog_vaddr = 0;
-
-    //在父进程的用户空间中查找已有的页
-    while(idx_byte < btmp_bytes_len) {
-        if(vaddr_btmp[idx_byte]) {
-            idx_bit = 0;
-            while(idx_bit < 8) {
-                if((BITMAP_MASK << idx_bit) & vaddr_btmp[idx_byte]) {
-                    prog_vaddr = (idx_byte * 8 + idx_bit) * PG_SIZE + vaddr_start;
-
-                    memcpy(buf_page, (void*)prog_vaddr, PG_SIZE);
-
-                    page_dir_activate(child_thread);
-
-                    get_a_page_without_opvaddrbitmap(PF_USER, prog_vaddr);
-
-                    memcpy((void*)prog_vaddr, buf_page, PG_SIZE);
-
-                    page_dir_activate(parent_thread);
-                }
-                idx_bit++;
-            }
-        }
-        idx_byte++;
-    }
-}
-
 /*为子进程构建thread_stack和修改返回值*/
 static int32_t build_child_stack(struct task_struct* child_thread)
 {
@@ -95,8 +77,8 @@ static int32_t build_child_stack(struct task_struct* child_thread)
     //ebp在thread_stack中的地址便是当时esp（0级栈栈顶），即esp为(uint32_t*)intr_0_stack - 5
     uint32_t* ebp_ptr_in_thread_stack = (uint32_t*)intr_0_stack - 5;
 
-    //switch_to的返回地址更新为intr_exit，直接从中断返回
-    *ret_addr_in_thread_stack = (uint32_t)intr_exit;
+    //switch_to的返回地址更新为bkl_intr_exit，释放大内核锁后直接从中断返回
+    *ret_addr_in_thread_stack = (uint32_t)bkl_intr_exit;
 
     //下面这两行只是为了使构建的thread_stack更加清晰，其实不需要，因为在进入intr_exit后一系列的pop会把寄存器中的数据覆盖
     *ebp_ptr_in_thread_stack = *ebx_ptr_in_thread_stack = *edi_ptr_in_thread_stack = *esi_ptr_in_thread_stack = 0;
@@ -106,54 +88,40 @@ static int32_t build_child_stack(struct task_struct* child_thread)
     return 0;
 }
 
-/*更新inode打开数*/
+/*更新inode打开数。打开的文件由fd_table_fork增加文件结构的引用，父子进程共用文件结构，inode的打开数不变*/
 static void update_inode_open_cnts(struct task_struct* thread)
 {
-    int32_t local_fd = 3, global_fd = 0;
-    while(local_fd < MAX_FILES_OPEN_PER_PROC) {
-        global_fd = thread->fd_table[local_fd];
-        ASSERT(global_fd < MAX_FILE_OPEN);
-        if(global_fd != -1) {
-            if(is_pipe(local_fd)) {
-                file_table[global_fd].fd_pos++;
-            } else {
-                file_table[global_fd].fd_inode->i_open_cnts++;
-            }
-        }
-        local_fd++;
+    //子进程同样按需从程序文件加载映像
+    if(thread->exec_inode != NULL) {
+        thread->exec_inode->i_open_cnts++;
     }
+    mmap_fork(thread);
+    shm_fork(thread);
 }
 
 /*拷贝父进程本身所占资源给子进程*/
 static int32_t copy_process(struct task_struct* child_thread, struct task_struct* parent_thread)
 {
-    //内核缓冲区，作为父进程用户空间的数据复制到子进程用户空间的中转
-    void* buf_page = get_kernel_pages(1);
-    if(buf_page == NULL) {
-        return -1;
-    }
-
     //a 复制父进程pcb，虚拟地址位图、内核栈到子进程
     if(copy_pcb_vaddrbitmap_stack0(child_thread, parent_thread) == -1) {
         return -1;
     }
 
-    //b 为子进程创建页表，此页表仅包括内核空间
-    child_thread->pgdir = create_page_dir();
-    if(child_thread->pgdir == NULL) {
+    //复制文件描述符数组
+    if(fd_table_fork(child_thread, parent_thread) == -1) {
         return -1;
     }
 
-    //c 复制父进程体及用户栈给子进程
-    copy_body_stack3(child_thread, parent_thread, buf_page);
+    //c 父子进程以写时复制的方式共享进程体及用户栈，只复制页表
+    if(pgdir_copy_cow(child_thread->pgdir) == -1) {
+        return -1;
+    }
 
     //c 构建子进程thread_stack和修改返回值pid
     build_child_stack(child_thread);
 
     //e 更新文件inode的打开次数
     update_inode_open_cnts(child_thread);
-
-    mfree_page(PF_KERNEL, buf_page, 1);
     return 0;
 }
 
@@ -161,21 +129,24 @@ static int32_t copy_process(struct task_struct* child_thread, struct task_struct
 pid_t sys_fork(void)
 {
     struct task_struct* parent_thread = running_thread();
-    struct task_struct* child_thread = get_kernel_pages(1);   //为子进程创建pcb（task_struct结构）
+    struct task_struct* child_thread = kmem_cache_alloc(task_cache);   //为子进程创建pcb（task_struct结构）
     if(child_thread == NULL) {
         return -1;
     }
     ASSERT(INTR_OFF == intr_get_status() && parent_thread->pgdir != NULL);
+    if(parent_thread->group_leader != parent_thread) {   //进程的地址空间以外的资源记在主线程里，只有主线程能fork
+        printk("sys_fork: only the main thread can fork\n");
+        kmem_cache_free(task_cache, child_thread);
+        return -1;
+    }
 
     if(copy_process(child_thread, parent_thread) == -1) {
         return -1;
     }
 
     //添加到就绪线程队列和所有线程队列，子进程由调度器安排运行
-    ASSERT(!elem_find(&thread_ready_list, &child_thread->general_tag));
-    list_append(&thread_ready_list, &child_thread->general_tag);
-    ASSERT(!elem_find(&thread_all_list, &child_thread->all_list_tag));
-    list_append(&thread_all_list, &child_thread->all_list_tag);
+    thread_ready(child_thread);
+    thread_all_append(child_thread);
 
     return child_thread->pid;   //父进程返回子进程的pid
 }
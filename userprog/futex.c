@@ -0,0 +1,109 @@
+#include "futex.h"
+#include "stdint.h"
+#include "global.h"
+#include "list.h"
+#include "thread.h"
+#include "memory.h"
+#include "interrupt.h"
+#include "debug.h"
+
+#define FUTEX_HASH_SIZE 64   //等待队列哈希表的桶数，必须是2的幂
+
+/*在futex上等待的任务，节点放在等待者自己的内核栈上*/
+struct futex_waiter
+{
+    struct list_elem tag;   //挂在哈希桶的链表上
+    uint32_t key;   //等待的物理地址
+    struct task_struct* thread;
+};
+
+/*按物理地址散列的等待队列，以物理地址为键，写时复制之前共享同一页框的父子进程也能互相唤醒*/
+static struct list futex_queues[FUTEX_HASH_SIZE];
+
+/*返回key所在的哈希桶*/
+static struct list* futex_bucket(uint32_t key)
+{
+    return &futex_queues[((key >> 2) ^ (key >> 12)) & (FUTEX_HASH_SIZE - 1)];
+}
+
+/*取得用户地址addr映射的物理地址存入key，地址非法或未映射返回false*/
+static bool futex_key(uint32_t* addr, uint32_t* key)
+{
+    uint32_t vaddr = (uint32_t)addr;
+    if(vaddr >= 0xc0000000 || (vaddr & 0x3) != 0) {
+        return false;
+    }
+    uint32_t pde = *pde_ptr(vaddr);
+    if(!(pde & PG_P_1) || (!(pde & PG_PS) && !(*pte_ptr(vaddr) & PG_P_1))) {   //大页没有页表，页目录项存在即已映射
+        return false;
+    }
+    *key = addr_v2p(vaddr);
+    return true;
+}
+
+/*若*addr仍等于expected则阻塞，直到有人对同一地址调用futex_wake。被唤醒返回0，值已改变或地址非法返回-1*/
+int32_t sys_futex_wait(uint32_t* addr, uint32_t expected)
+{
+    if((uint32_t)addr >= 0xc0000000 || ((uint32_t)addr & 0x3) != 0) {
+        return -1;
+    }
+    //先在开中断时读一次，让按需加载的页错误在这里处理完
+    if(*(volatile uint32_t*)addr != expected) {
+        return -1;
+    }
+    //映射的是零页或写时复制的页框时先以不改值的写访问换成自己的页框，否则别人写入时换了页框，按物理地址就等不到唤醒
+    uint32_t pde = *pde_ptr((uint32_t)addr);
+    if((pde & PG_P_1) && !(pde & PG_PS) && (*pte_ptr((uint32_t)addr) & PG_COW)) {
+        asm volatile ("lock; addl $0, %0" : "+m"(*addr) : : "memory");
+    }
+
+    //比较和入队必须是原子的，否则可能错过在两者之间发出的唤醒
+    enum intr_status old_status = intr_disable();
+    uint32_t key;
+    if(!futex_key(addr, &key) || *(volatile uint32_t*)addr != expected) {
+        intr_set_status(old_status);
+        return -1;
+    }
+    struct futex_waiter waiter;
+    waiter.key = key;
+    waiter.thread = running_thread();
+    list_append(futex_bucket(key), &waiter.tag);
+    thread_block(TASK_BLOCKED);
+    intr_set_status(old_status);
+    return 0;
+}
+
+/*唤醒最多n个在addr上等待的任务，返回唤醒的个数*/
+int32_t sys_futex_wake(uint32_t* addr, uint32_t n)
+{
+    int32_t woken = 0;
+    enum intr_status old_status = intr_disable();
+    uint32_t key;
+    if(!futex_key(addr, &key)) {
+        intr_set_status(old_status);
+        return 0;
+    }
+    struct list* bucket = futex_bucket(key);
+    struct list_elem* elem = bucket->head.next;
+    while(elem != &bucket->tail && (uint32_t)woken < n) {
+        struct list_elem* next = elem->next;
+        struct futex_waiter* waiter = elem2entry(struct futex_waiter, tag, elem);
+        if(waiter->key == key) {
+            list_remove(elem);
+            thread_unblock(waiter->thread);
+            woken++;
+        }
+        elem = next;
+    }
+    intr_set_status(old_status);
+    return woken;
+}
+
+/*初始化futex等待队列*/
+void futex_init(void)
+{
+    uint32_t idx;
+    for(idx = 0; idx < FUTEX_HASH_SIZE; idx++) {
+        list_init(&futex_queues[idx]);
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef __USERPROG_FUTEX_H
+#define __USERPROG_FUTEX_H
+#include "stdint.h"
+
+/*若*addr仍等于expected则阻塞，直到有人对同一地址调用futex_wake。被唤醒返回0，值已改变或地址非法返回-1*/
+int32_t sys_futex_wait(uint32_t* addr, uint32_t expected);
+/*唤醒最多n个在addr上等待的任务，返回唤醒的个数*/
+int32_t sys_futex_wake(uint32_t* addr, uint32_t n);
+void futex_init(void);
+
+#endif
@@ -0,0 +1,305 @@
+#include "mmap.h"
+#include "stdint.h"
+#include "global.h"
+#include "thread.h"
+#include "memory.h"
+#include "fs.h"
+#include "file.h"
+#include "inode.h"
+#include "string.h"
+#include "pipe.h"
+#include "stdio-kernel.h"
+#include "swap.h"
+
+/*找出cur中包含vaddr的映射区，没有返回NULL*/
+static struct mmap_area* mmap_find(struct task_struct* cur, uint32_t vaddr)
+{
+    uint32_t area_idx;
+    for(area_idx = 0; area_idx < MAX_MMAPS_PER_PROC; area_idx++) {
+        struct mmap_area* area = &cur->mmaps[area_idx];
+        if(area->vaddr != 0 && vaddr >= area->vaddr && vaddr < area->vaddr + area->len) {
+            return area;
+        }
+    }
+    return NULL;
+}
+
+/*解除当前进程的映射区area：已填充的页连同页框一起释放，还没缺页的只释放虚拟地址，再关闭映射的文件*/
+static void mmap_area_unmap(struct mmap_area* area)
+{
+    uint32_t vaddr_page = area->vaddr;
+    while(vaddr_page < area->vaddr + area->len) {
+        uint32_t* pde = pde_ptr(vaddr_page);
+        if(*pde & PG_PS) {   //大页整个落在映射区内，从它的起点遍历到这里，一次释放
+            large_page_unmap(vaddr_page);
+            vaddr_remove(PF_USER, (void*)vaddr_page, LARGE_PG_PAGES);
+            vaddr_page += LARGE_PG_SIZE;
+            continue;
+        }
+        //pde的判断要在pte之前，否则pde若不存在会导致判断pte时缺页异常
+        if((*pde & PG_P_1) && (*pte_ptr(vaddr_page) & PG_P_1)) {
+            mfree_page(PF_USER, (void*)vaddr_page, 1);
+        } else {
+            vaddr_remove(PF_USER, (void*)vaddr_page, 1);
+        }
+        vaddr_page += PG_SIZE;
+    }
+    if(area->inode != NULL) {
+        inode_close(area->inode);
+    }
+    memset(area, 0, sizeof(struct mmap_area));
+}
+
+/*申请pg_cnt个起点按4MB对齐的用户虚拟页，先多申请不到4MB，再把头尾多出的部分归还。申请不到时退回不对齐的申请*/
+static void* vaddr_get_large(uint32_t pg_cnt)
+{
+    uint32_t start = (uint32_t)vaddr_get(PF_USER, pg_cnt + LARGE_PG_PAGES - 1);
+    if(start == 0) {
+        return vaddr_get(PF_USER, pg_cnt);
+    }
+    uint32_t aligned = DIV_ROUND_UP(start, LARGE_PG_SIZE) * LARGE_PG_SIZE;
+    uint32_t head = (aligned - start) / PG_SIZE;
+    if(head > 0) {
+        vaddr_remove(PF_USER, (void*)start, head);
+    }
+    if(LARGE_PG_PAGES - 1 - head > 0) {
+        vaddr_remove(PF_USER, (void*)(aligned + pg_cnt * PG_SIZE), LARGE_PG_PAGES - 1 - head);
+    }
+    return (void*)aligned;
+}
+
+/*按args建立映射，成功返回映射区起始地址，失败返回MAP_FAILED。
+  只支持私有映射，映射区只占住虚拟地址，页在缺页时才分配和填充，所以映射大文件也不必先读入*/
+void* sys_mmap(const struct mmap_args* args)
+{
+    struct task_struct* cur = running_thread()->group_leader;
+    if(cur->pgdir == NULL || args->len == 0 || args->offset % PG_SIZE != 0 \
+       || !(args->flags & MAP_PRIVATE) || !(args->prot & PROT_READ)) {
+        printk("sys_mmap: unsupported arguments\n");
+        return MAP_FAILED;
+    }
+
+    struct file* file = NULL;
+    if(!(args->flags & MAP_ANONYMOUS)) {
+        int32_t fd = args->fd;
+        if(fd < 3 || fd_local2file(fd) == NULL || is_pipe(fd)) {
+            printk("sys_mmap: fd error\n");
+            return MAP_FAILED;
+        }
+        file = fd_local2file(fd);
+        if(file->fd_flag & O_WRONLY) {   //只写打开的文件不能读出来映射
+            printk("sys_mmap: file is not readable\n");
+            return MAP_FAILED;
+        }
+    }
+
+    struct mmap_area* area = NULL;
+    uint32_t area_idx;
+    for(area_idx = 0; area_idx < MAX_MMAPS_PER_PROC; area_idx++) {
+        if(cur->mmaps[area_idx].vaddr == 0) {
+            area = &cur->mmaps[area_idx];
+            break;
+        }
+    }
+    if(area == NULL) {
+        printk("sys_mmap: exceed max mmap areas\n");
+        return MAP_FAILED;
+    }
+
+    uint32_t pg_cnt = DIV_ROUND_UP(args->len, PG_SIZE);
+    bool huge = file == NULL && (args->flags & MAP_HUGE) && pg_cnt >= LARGE_PG_PAGES;   //文件映射和不满一个大页的映射区忽略MAP_HUGE
+    void* vaddr = huge ? vaddr_get_large(pg_cnt) : vaddr_get(PF_USER, pg_cnt);
+    if(vaddr == NULL) {
+        printk("sys_mmap: no free virtual address\n");
+        return MAP_FAILED;
+    }
+    area->vaddr = (uint32_t)vaddr;
+    area->len = pg_cnt * PG_SIZE;
+    area->inode = file != NULL ? inode_open(cur_part, file->fd_inode->i_no) : NULL;   //映射期间文件关闭了也能访问
+    area->offset = args->offset;
+    area->prot = args->prot;
+    area->huge = huge;
+    return vaddr;
+}
+
+/*解除从addr起len字节的映射，须正好是一个完整的映射区，成功返回0，失败返回-1*/
+int32_t sys_munmap(void* addr, uint32_t len)
+{
+    struct mmap_area* area = mmap_find(running_thread()->group_leader, (uint32_t)addr);
+    if(area == NULL || area->vaddr != (uint32_t)addr || DIV_ROUND_UP(len, PG_SIZE) * PG_SIZE != area->len) {
+        printk("sys_munmap: not a whole mapped area\n");
+        return -1;
+    }
+    mmap_area_unmap(area);
+    return 0;
+}
+
+/*处理映射区引起的页错误，vaddr所在页属于某个映射区时分配页框填充内容并返回true。
+  文件内容经块缓存读入，文件末尾以后和匿名映射都是0，只读映射的页去掉写权限。
+  要求大页的匿名映射区整段覆盖vaddr所在的4MB对齐区域时，一次映射一个大页*/
+bool mmap_page_fault(uint32_t vaddr)
+{
+    struct task_struct* cur = running_thread()->group_leader;
+    if(cur->pgdir == NULL || vaddr >= 0xc0000000) {
+        return false;
+    }
+    uint32_t* pde = pde_ptr(vaddr);
+    //页已存在，不是缺页，写只读映射也到这里。大页没有页表，页目录项存在就是已映射
+    if((*pde & PG_PS) || ((*pde & PG_P_1) && (*pte_ptr(vaddr) & PG_P_1))) {
+        return false;
+    }
+    struct mmap_area* area = mmap_find(cur, vaddr);
+    if(area == NULL) {
+        return false;
+    }
+    uint32_t vaddr_large = vaddr & ~(LARGE_PG_SIZE - 1);
+    if(area->huge && vaddr_large >= area->vaddr && vaddr_large + LARGE_PG_SIZE <= area->vaddr + area->len \
+       && large_page_map(vaddr, area->prot & PROT_WRITE)) {
+        return true;
+    }
+
+    //匿名映射读的时候先映射零页，写入时才分配页框
+    if(area->inode == NULL && zero_page_fault(vaddr, area->prot & PROT_WRITE)) {
+        return true;
+    }
+
+    uint32_t vaddr_page = vaddr & 0xfffff000;
+    if(get_a_page(PF_USER, vaddr_page) == NULL) {
+        return false;
+    }
+    memset((void*)vaddr_page, 0, PG_SIZE);
+    if(area->inode != NULL) {
+        uint32_t pos = area->offset + (vaddr_page - area->vaddr);
+        if(pos < area->inode->i_size) {
+            uint32_t size = area->inode->i_size - pos;
+            if(size > PG_SIZE) {
+                size = PG_SIZE;
+            }
+            struct file map_file;
+            map_file.fd_pos = pos;
+            map_file.fd_flag = O_RDONLY;
+            map_file.fd_inode = area->inode;
+            map_file.ra_pos = pos;   //扫描映射区时缺页大多按地址顺序发生，直接用较大的预读窗口
+            map_file.ra_window = FILE_RA_MAX / 2;
+            file_read(&map_file, (void*)vaddr_page, size);
+        }
+    }
+    if(!(area->prot & PROT_WRITE)) {
+        *pte_ptr(vaddr_page) &= ~PG_RW_W;
+        asm volatile ("invlpg %0" : : "m"(*(uint8_t*)vaddr_page) : "memory");
+    }
+    return true;
+}
+
+/*解除当前进程的全部映射，exec换映像时调用*/
+void mmap_unmap_all(void)
+{
+    struct task_struct* cur = running_thread()->group_leader;
+    uint32_t area_idx;
+    for(area_idx = 0; area_idx < MAX_MMAPS_PER_PROC; area_idx++) {
+        if(cur->mmaps[area_idx].vaddr != 0) {
+            mmap_area_unmap(&cur->mmaps[area_idx]);
+        }
+    }
+}
+
+/*关闭pthread各映射区所映射的文件，进程退出时调用，页框和虚拟地址由退出流程统一回收*/
+void mmap_release(struct task_struct* pthread)
+{
+    uint32_t area_idx;
+    for(area_idx = 0; area_idx < MAX_MMAPS_PER_PROC; area_idx++) {
+        struct mmap_area* area = &pthread->mmaps[area_idx];
+        if(area->inode != NULL) {
+            inode_close(area->inode);
+        }
+        memset(area, 0, sizeof(struct mmap_area));
+    }
+}
+
+/*fork后为子进程child的各文件映射增加inode的打开次数，映射区的页随页表写时复制*/
+void mmap_fork(struct task_struct* child)
+{
+    uint32_t area_idx;
+    for(area_idx = 0; area_idx < MAX_MMAPS_PER_PROC; area_idx++) {
+        if(child->mmaps[area_idx].inode != NULL) {
+            child->mmaps[area_idx].inode->i_open_cnts++;
+        }
+    }
+}
+
+/*把当前进程的堆末尾移动increment字节，返回原来的末尾，失败返回(void*)-1。
+  堆区的虚拟地址早已占住，变大时只记下新的末尾，页在缺页时才分配；变小时整页落在新末尾以后的页框还给内核*/
+void* sys_sbrk(int32_t increment)
+{
+    struct task_struct* cur = running_thread()->group_leader;
+    if(cur->pgdir == NULL || cur->heap_brk == 0) {
+        return (void*)-1;
+    }
+    uint32_t old_brk = cur->heap_brk;
+    if((increment > 0 && (uint32_t)increment > USER_HEAP_BASE + USER_HEAP_MAX - old_brk) \
+       || (increment < 0 && (uint32_t)-increment > old_brk - (USER_HEAP_BASE + PG_SIZE))) {   //第一页不属于sbrk管
+        return (void*)-1;
+    }
+    uint32_t new_brk = old_brk + increment;
+    uint32_t vaddr_page = DIV_ROUND_UP(new_brk, PG_SIZE) * PG_SIZE;
+    while(vaddr_page < old_brk) {
+        uint32_t* pde = pde_ptr(vaddr_page);
+        if((*pde & PG_P_1) && (*pte_ptr(vaddr_page) & PG_P_1)) {
+            mfree_page(PF_USER, (void*)vaddr_page, 1);
+            vaddr_mark(PF_USER, (void*)vaddr_page, 1);   //虚拟地址仍留给堆
+        } else if((*pde & PG_P_1) && pte_is_swap(*pte_ptr(vaddr_page))) {   //换出的页只放掉交换槽
+            swap_free(pte_swap_slot(*pte_ptr(vaddr_page)));
+            *pte_ptr(vaddr_page) = 0;
+        }
+        vaddr_page += PG_SIZE;
+    }
+    cur->heap_brk = new_brk;
+    return (void*)old_brk;
+}
+
+/*处理用户堆引起的页错误，vaddr在堆的末尾以内时分配清零的页框并返回true，读引起的缺页先映射零页*/
+bool heap_page_fault(uint32_t vaddr)
+{
+    struct task_struct* cur = running_thread()->group_leader;
+    if(cur->pgdir == NULL || vaddr < USER_HEAP_BASE || vaddr >= cur->heap_brk) {
+        return false;
+    }
+    uint32_t* pde = pde_ptr(vaddr);
+    if((*pde & PG_P_1) && (*pte_ptr(vaddr) & PG_P_1)) {   //页已存在，不是缺页
+        return false;
+    }
+    if(zero_page_fault(vaddr, true)) {
+        return true;
+    }
+    uint32_t vaddr_page = vaddr & 0xfffff000;
+    if(get_a_page_without_opvaddrbitmap(PF_USER, vaddr_page) == NULL) {   //堆区的位图早已占住
+        return false;
+    }
+    memset((void*)vaddr_page, 0, PG_SIZE);
+    return true;
+}
+
+/*为当前进程建立空的用户堆，原有的堆连同页框一起释放，进程开始运行和exec换映像时调用。
+  堆区固定在USER_HEAP_BASE，整个区间先在位图中占住，免得mmap等分配落进来；第一页始终在堆内，给用户库存放数据*/
+void heap_reset(void)
+{
+    struct task_struct* cur = running_thread();
+    uint32_t heap_pages = USER_HEAP_MAX / PG_SIZE;
+    if(cur->heap_brk != 0) {
+        uint32_t vaddr_page = USER_HEAP_BASE;
+        while(vaddr_page < cur->heap_brk) {
+            uint32_t* pde = pde_ptr(vaddr_page);
+            if((*pde & PG_P_1) && (*pte_ptr(vaddr_page) & PG_P_1)) {
+                mfree_page(PF_USER, (void*)vaddr_page, 1);
+                vaddr_mark(PF_USER, (void*)vaddr_page, 1);
+            } else if((*pde & PG_P_1) && pte_is_swap(*pte_ptr(vaddr_page))) {
+                swap_free(pte_swap_slot(*pte_ptr(vaddr_page)));
+                *pte_ptr(vaddr_page) = 0;
+            }
+            vaddr_page += PG_SIZE;
+        }
+    } else {
+        vaddr_mark(PF_USER, (void*)USER_HEAP_BASE, heap_pages);
+    }
+    cur->heap_brk = USER_HEAP_BASE + PG_SIZE;
+}
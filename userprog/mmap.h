@@ -0,0 +1,52 @@
+#ifndef __USERPROG_MMAP_H
+#define __USERPROG_MMAP_H
+#include "stdint.h"
+#include "global.h"
+
+#define PROT_READ 1   //映射区可读
+#define PROT_WRITE 2   //映射区可写
+
+#define MAP_PRIVATE 0x02   //私有映射，写入只改自己的副本，不写回文件
+#define MAP_ANONYMOUS 0x20   //匿名映射，内容为0，不对应文件
+#define MAP_HUGE 0x40000   //匿名映射区优先用4MB的大页，映射区起点按4MB对齐。物理内存碎片化拿不到4MB的块时退回4KB页
+
+#define MAP_FAILED ((void*)-1)   //mmap失败时的返回值
+
+#define USER_HEAP_BASE 0x40000000   //用户堆区的固定起点，第一页留给用户库存放各进程一份的数据，如malloc的状态
+#define USER_HEAP_MAX 0x10000000   //用户堆区最大的字节数，整个区间的虚拟地址在进程开始运行时就占住
+#define USER_LIB_MALLOC_DATA USER_HEAP_BASE   //用户库数据页中malloc的状态
+#define USER_LIB_STREAM_DATA (USER_HEAP_BASE + 0x200)   //用户库数据页中标准流的状态
+
+/*mmap的参数，系统调用最多传3个参数，打包成结构体传指针*/
+struct mmap_args
+{
+    void* addr;   //建议的起始地址，目前忽略，由内核选择
+    uint32_t len;
+    uint32_t prot;
+    uint32_t flags;
+    int32_t fd;   //匿名映射时忽略
+    uint32_t offset;   //在文件中的偏移，须页对齐
+};
+
+struct task_struct;
+
+/*按args建立映射，成功返回映射区起始地址，失败返回MAP_FAILED。映射区的页在缺页时才分配和填充*/
+void* sys_mmap(const struct mmap_args* args);
+/*解除从addr起len字节的映射，须正好是一个完整的映射区，成功返回0，失败返回-1*/
+int32_t sys_munmap(void* addr, uint32_t len);
+/*处理映射区引起的页错误，vaddr所在页属于某个映射区时分配页框填充内容并返回true*/
+bool mmap_page_fault(uint32_t vaddr);
+/*解除当前进程的全部映射，exec换映像时调用*/
+void mmap_unmap_all(void);
+/*关闭pthread各映射区所映射的文件，进程退出时调用，页框由退出流程统一回收*/
+void mmap_release(struct task_struct* pthread);
+/*fork后为子进程child的各文件映射增加inode的打开次数*/
+void mmap_fork(struct task_struct* child);
+/*把当前进程的堆末尾移动increment字节，返回原来的末尾，失败返回(void*)-1*/
+void* sys_sbrk(int32_t increment);
+/*处理用户堆引起的页错误，vaddr在堆的末尾以内时分配清零的页框并返回true*/
+bool heap_page_fault(uint32_t vaddr);
+/*为当前进程建立空的用户堆，原有的堆连同页框一起释放，进程开始运行和exec换映像时调用*/
+void heap_reset(void);
+
+#endif
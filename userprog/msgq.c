@@ -0,0 +1,186 @@
+#include "msgq.h"
+#include "stdint.h"
+#include "global.h"
+#include "memory.h"
+#include "sync.h"
+#include "interrupt.h"
+#include "timer.h"
+#include "string.h"
+#include "stdio-kernel.h"
+
+/*消息队列中的一个槽，data占msg_size字节*/
+struct msgq_slot
+{
+    uint32_t len;   //消息的字节数
+    char data[0];
+};
+
+/*消息队列，各槽连续存放在一段内核内存中，组成环*/
+struct msgq
+{
+    bool used;
+    uint32_t gen;   //每次新建加1，等待者醒来后据此发现队列已被删除
+    uint32_t msg_size;
+    uint32_t slot_cnt;
+    uint32_t slot_bytes;   //每个槽占的字节数
+    uint32_t pg_cnt;   //槽占用的页数
+    uint32_t head;   //下一条消息放入的槽
+    uint32_t cnt;   //队列中的消息数
+    uint8_t* slots;
+    struct wait_queue recv_wq;   //等消息的接收者
+    struct wait_queue send_wq;   //等空槽的发送者
+};
+
+static struct msgq msgqs[MSGQ_MAX];
+
+/*初始化消息队列表*/
+void msgq_init(void)
+{
+    memset(msgqs, 0, sizeof(msgqs));
+}
+
+/*返回q中第idx个槽*/
+static struct msgq_slot* msgq_slot(struct msgq* q, uint32_t idx)
+{
+    return (struct msgq_slot*)(q->slots + idx * q->slot_bytes);
+}
+
+/*队列号qid有效时返回对应的队列，否则返回NULL*/
+static struct msgq* msgq_of(int32_t qid)
+{
+    if(qid < 0 || qid >= MSGQ_MAX || !msgqs[qid].used) {
+        return NULL;
+    }
+    return &msgqs[qid];
+}
+
+/*新建能存放slot_cnt条、每条最多msg_size字节消息的队列，槽一次分配好，成功返回队列号，失败返回-1*/
+int32_t sys_msgq_create(uint32_t msg_size, uint32_t slot_cnt)
+{
+    if(msg_size == 0 || msg_size > MSGQ_MAX_MSG_SIZE || slot_cnt == 0 || slot_cnt > MSGQ_MAX_SLOTS) {
+        printk("sys_msgq_create: size error\n");
+        return -1;
+    }
+    uint32_t slot_bytes = (sizeof(struct msgq_slot) + msg_size + 3) & ~3;
+    uint32_t pg_cnt = DIV_ROUND_UP(slot_bytes * slot_cnt, PG_SIZE);
+    uint8_t* slots = get_kernel_pages(pg_cnt);   //可能阻塞，先分配再找空闲的表项
+    if(slots == NULL) {
+        printk("sys_msgq_create: get_kernel_pages failed\n");
+        return -1;
+    }
+
+    enum intr_status old_status = intr_disable();
+    int32_t qid;
+    for(qid = 0; qid < MSGQ_MAX; qid++) {
+        if(!msgqs[qid].used) {
+            break;
+        }
+    }
+    if(qid == MSGQ_MAX) {
+        intr_set_status(old_status);
+        mfree_page(PF_KERNEL, slots, pg_cnt);
+        printk("sys_msgq_create: exceed max queues\n");
+        return -1;
+    }
+    struct msgq* q = &msgqs[qid];
+    q->used = true;
+    q->gen++;
+    q->msg_size = msg_size;
+    q->slot_cnt = slot_cnt;
+    q->slot_bytes = slot_bytes;
+    q->pg_cnt = pg_cnt;
+    q->head = q->cnt = 0;
+    q->slots = slots;
+    wait_queue_init(&q->recv_wq);
+    wait_queue_init(&q->send_wq);
+    intr_set_status(old_status);
+    return qid;
+}
+
+/*删除队列qid，正在等待的收发者醒来后发现队列已删除返回-1，成功返回0，失败返回-1*/
+int32_t sys_msgq_destroy(int32_t qid)
+{
+    enum intr_status old_status = intr_disable();
+    struct msgq* q = msgq_of(qid);
+    if(q == NULL) {
+        intr_set_status(old_status);
+        printk("sys_msgq_destroy: qid error\n");
+        return -1;
+    }
+    q->used = false;
+    wait_queue_wake_all(&q->recv_wq);
+    wait_queue_wake_all(&q->send_wq);
+    uint8_t* slots = q->slots;
+    uint32_t pg_cnt = q->pg_cnt;
+    q->slots = NULL;
+    intr_set_status(old_status);
+    mfree_page(PF_KERNEL, slots, pg_cnt);
+    return 0;
+}
+
+/*把msg开始的len字节作为一条消息放入队列qid，队列满时等待，放入后直接唤醒一个接收者，成功返回0，失败返回-1*/
+int32_t sys_msgq_send(int32_t qid, const void* msg, uint32_t len)
+{
+    enum intr_status old_status = intr_disable();
+    struct msgq* q = msgq_of(qid);
+    if(q == NULL || len > q->msg_size) {
+        intr_set_status(old_status);
+        printk("sys_msgq_send: qid or len error\n");
+        return -1;
+    }
+    uint32_t gen = q->gen;
+    while(q->cnt == q->slot_cnt) {
+        wait_queue_sleep(&q->send_wq);
+        if(!q->used || q->gen != gen) {   //等待期间队列被删除了
+            intr_set_status(old_status);
+            return -1;
+        }
+    }
+    struct msgq_slot* slot = msgq_slot(q, q->head);
+    slot->len = len;
+    memcpy(slot->data, msg, len);
+    q->head = (q->head + 1) % q->slot_cnt;
+    q->cnt++;
+    wait_queue_wake_one(&q->recv_wq);
+    intr_set_status(old_status);
+    return 0;
+}
+
+/*从队列qid取出最早的一条消息到buf，buf须能放下msg_size字节，成功返回消息的字节数，超时或失败返回-1。
+  没有消息时timeout为MSGQ_NOWAIT立即返回，为MSGQ_WAIT_FOREVER一直等，否则最多等timeout毫秒*/
+int32_t sys_msgq_recv(int32_t qid, void* buf, uint32_t timeout)
+{
+    enum intr_status old_status = intr_disable();
+    struct msgq* q = msgq_of(qid);
+    if(q == NULL) {
+        intr_set_status(old_status);
+        printk("sys_msgq_recv: qid error\n");
+        return -1;
+    }
+    uint32_t gen = q->gen;
+    uint32_t deadline = sys_uptime() + timer_ms_to_ticks(timeout);
+    while(q->cnt == 0) {
+        if(timeout == MSGQ_NOWAIT) {
+            intr_set_status(old_status);
+            return -1;
+        }
+        if(timeout == MSGQ_WAIT_FOREVER) {
+            wait_queue_sleep(&q->recv_wq);
+        } else if(!wait_queue_sleep_until(&q->recv_wq, deadline)) {
+            intr_set_status(old_status);
+            return -1;
+        }
+        if(!q->used || q->gen != gen) {
+            intr_set_status(old_status);
+            return -1;
+        }
+    }
+    uint32_t tail = (q->head + q->slot_cnt - q->cnt) % q->slot_cnt;
+    struct msgq_slot* slot = msgq_slot(q, tail);
+    uint32_t len = slot->len;
+    memcpy(buf, slot->data, len);
+    q->cnt--;
+    wait_queue_wake_one(&q->send_wq);
+    intr_set_status(old_status);
+    return len;
+}
@@ -0,0 +1,25 @@
+#ifndef __USERPROG_MSGQ_H
+#define __USERPROG_MSGQ_H
+#include "stdint.h"
+#include "global.h"
+
+#define MSGQ_MAX 16   //系统中最多的消息队列数
+#define MSGQ_MAX_MSG_SIZE 1024   //每条消息的最大字节数
+#define MSGQ_MAX_SLOTS 64   //每个队列最多的消息槽数
+
+#define MSGQ_NOWAIT 0   //msgq_recv的超时，没有消息时立即返回
+#define MSGQ_WAIT_FOREVER 0xffffffff   //msgq_recv的超时，一直等到有消息
+
+/*初始化消息队列表*/
+void msgq_init(void);
+/*新建能存放slot_cnt条、每条最多msg_size字节消息的队列，槽一次分配好，成功返回队列号，失败返回-1*/
+int32_t sys_msgq_create(uint32_t msg_size, uint32_t slot_cnt);
+/*删除队列qid，正在等待的收发者返回-1，成功返回0，失败返回-1*/
+int32_t sys_msgq_destroy(int32_t qid);
+/*把msg开始的len字节作为一条消息放入队列qid，队列满时等待，成功返回0，失败返回-1*/
+int32_t sys_msgq_send(int32_t qid, const void* msg, uint32_t len);
+/*从队列qid取出最早的一条消息到buf，buf须能放下msg_size字节，没有消息时最多等timeout毫秒，
+  成功返回消息的字节数，超时或失败返回-1*/
+int32_t sys_msgq_recv(int32_t qid, void* buf, uint32_t timeout);
+
+#endif
@@ -9,8 +9,10 @@
 #include "interrupt.h"
 #include "list.h"
 #include "memory.h"
+#include "mmap.h"
+#include "vdata.h"
 
-extern void intr_exit(void);   //外部函数，从中断返回
+extern void bkl_intr_exit(void);   //外部函数，释放大内核锁后从中断返回
 
 /*构建用户进程初始上下文信息，用户进程是从文件系统加载到内存的，进程名是进程的文件名*/
 void start_process(void* filename_)
@@ -26,13 +28,15 @@ void start_process(void* filename_)
     proc_stack->eip = function;   //待执行的用户程序地址
     proc_stack->cs = SELECTOR_U_CODE;
     proc_stack->eflags = (EFLAGS_IOPL_0 | EFLAGS_MBS | EFLAGS_IF_1);
+    heap_reset();   //用户堆区先占住虚拟地址，页在用到时才分配
+    vdata_reserve();
     proc_stack->esp = (void*)((uint32_t)get_a_page(PF_USER, USER_STACK3_VADDR) + PG_SIZE);
     proc_stack->ss = SELECTOR_U_DATA;
     asm volatile ("movl %0, %%esp; \
-                   jmp intr_exit" : : "g"(proc_stack) : "memory");
+                   jmp bkl_intr_exit" : : "g"(proc_stack) : "memory");
 }
 
-/*激活页表*/
+/*激活页表。与当前的页目录相同时不重新加载cr3，内核线程之间、同一进程的线程之间切换不刷新tlb*/
 void page_dir_activate(struct task_struct* p_thread)
 {
     /**执行此函数时，当前任务可能是线程。
@@ -44,8 +48,13 @@ void page_dir_activate(struct task_struct* p_thread)
         pagedir_phy_addr = addr_v2p((uint32_t)p_thread->pgdir);
     }
 
-    //更新页目录寄存器cr3，使新页表生效
-    asm volatile ("movl %0, %%cr3" : : "r"(pagedir_phy_addr) : "memory");
+    //更新页目录寄存器cr3，使新页表生效。进程退出时先释放页目录再切换，换上的任务页目录一定与它不同，
+    //所以相同时不会留下已释放页目录的tlb项
+    uint32_t cur_cr3;
+    asm volatile ("movl %%cr3, %0" : "=r"(cur_cr3));
+    if(cur_cr3 != pagedir_phy_addr) {
+        asm volatile ("movl %0, %%cr3" : : "r"(pagedir_phy_addr) : "memory");
+    }
 }
 
 /*激活线程或进程的页表，更新tss中的esp0为进程的特权级0的栈*/
@@ -60,6 +69,18 @@ void process_activate(struct task_struct* p_thread)
     }
 }
 
+/*把内核空间的pde复制到清零的页目录page_dir_vaddr中，并让最后一项指向页目录自己*/
+static void page_dir_init(uint32_t* page_dir_vaddr)
+{
+    //1. 复制页表 page_dir_vaddr + 0x300(768) * 4 是内核页目录的第768项。内核空间的页表在loader中就已建好，复制后不会过时
+    memcpy((uint32_t*)((uint32_t)page_dir_vaddr + 0x300 * 4), (uint32_t*)(0xfffff000 + 0x300 * 4), 1024);   //复制内核内存空间
+    
+    //2. 更新页目录地址
+    uint32_t new_page_dir_phy_addr = addr_v2p((uint32_t)page_dir_vaddr);   //将page_dir_vaddr虚拟地址转换为物理地址
+    page_dir_vaddr[1023] = new_page_dir_phy_addr | PG_US_U | PG_RW_W | PG_P_1;//页目录地址是存入在页目录的最后一项，
+                                                                              //更新页目录地址为新页目录的物理地址
+}
+
 /**创建用户进程的页目录表，将当前页表的表示内核空间的pde复制，成功返回页目录的虚拟地址，否则返回NULL**/
 uint32_t* create_page_dir(void)
 {
@@ -69,28 +90,88 @@ uint32_t* create_page_dir(void)
         console_put_str("create_page_dir: get_kernel_page failed!\n");
         return NULL;
     }
-
-    //1. 复制页表 page_dir_vaddr + 0x300(768) * 4 是内核页目录的第768项
-    memcpy((uint32_t*)((uint32_t)page_dir_vaddr + 0x300 * 4), (uint32_t*)(0xfffff000 + 0x300 * 4), 1024);   //复制内核内存空间
-    
-    //2. 更新页目录地址
-    uint32_t new_page_dir_phy_addr = addr_v2p((uint32_t)page_dir_vaddr);   //将page_dir_vaddr虚拟地址转换为物理地址
-    page_dir_vaddr[1023] = new_page_dir_phy_addr | PG_US_U | PG_RW_W | PG_P_1;//页目录地址是存入在页目录的最后一项，
-                                                                              //更新页目录地址为新页目录的物理地址
-
+    page_dir_init(page_dir_vaddr);
     return page_dir_vaddr;
 }
 
 //每天看着代码也没有觉得烦，偶尔想一些想见的人就开始烦。
 
-/*创建用户进程虚拟地址位图*/
-void create_user_vaddr_bitmap(struct task_struct* user_prog)
+/*一套建好的用户地址空间：只有内核部分的页目录、清零的虚拟地址位图和覆盖整个用户空间的空闲区段树*/
+struct addr_space
 {
+    uint32_t* pgdir;
+    uint8_t* vaddr_bits;
+    struct vaddr_extents* extents;
+};
+
+static struct addr_space addr_space_pool[ADDR_SPACE_POOL_CNT];   //idle线程预先建好的地址空间
+static uint32_t addr_space_cnt;
+
+/*用alloc分配页框建一套地址空间存入as，成功返回true，失败时已分配的都释放掉。
+  分配的页都已清零，位图不必再初始化*/
+static bool addr_space_build(struct addr_space* as, void* (*alloc)(uint32_t pg_cnt))
+{
+    as->pgdir = alloc(1);
+    as->vaddr_bits = alloc(USER_VADDR_BITMAP_PAGES);
+    as->extents = alloc(1);
+    if(as->pgdir == NULL || as->vaddr_bits == NULL || as->extents == NULL) {
+        if(as->pgdir != NULL) {
+            mfree_page(PF_KERNEL, as->pgdir, 1);
+        }
+        if(as->vaddr_bits != NULL) {
+            mfree_page(PF_KERNEL, as->vaddr_bits, USER_VADDR_BITMAP_PAGES);
+        }
+        if(as->extents != NULL) {
+            mfree_page(PF_KERNEL, as->extents, 1);
+        }
+        return false;
+    }
+    page_dir_init(as->pgdir);
+    //空闲区段树覆盖整个用户空间，最高的一页留作用户栈
+    extents_init(as->extents, 0, (0xc0000000 - USER_VADDR_START) / PG_SIZE - 1);
+    return true;
+}
+
+/*为用户进程user_prog装上页目录、虚拟地址位图和空闲区段树，成功返回0，失败返回-1。
+  优先从idle线程预建的池中取，建一套要清零二十多页，进程创建时就不必等了，池空时才现建*/
+int32_t addr_space_alloc(struct task_struct* user_prog)
+{
+    struct addr_space as;
+    bool found = false;
+    enum intr_status old_status = intr_disable();
+    if(addr_space_cnt > 0) {
+        as = addr_space_pool[--addr_space_cnt];
+        found = true;
+    }
+    intr_set_status(old_status);
+    if(!found && !addr_space_build(&as, get_kernel_pages)) {
+        console_put_str("addr_space_alloc: get_kernel_pages failed!\n");
+        return -1;
+    }
+
+    user_prog->pgdir = as.pgdir;
     user_prog->userprog_vaddr.vaddr_start = USER_VADDR_START;   //USER_VADDR_START(0x8048000)为用户进程的起始地址，是Linux用户程序入口地址
-    uint32_t bitmap_pg_cnt = DIV_ROUND_UP((0xc0000000 - USER_VADDR_START) / PG_SIZE / 8, PG_SIZE);   //记录位图需要的内存页框数
-    user_prog->userprog_vaddr.vaddr_bitmap.bits = get_kernel_pages(bitmap_pg_cnt);
+    user_prog->userprog_vaddr.vaddr_bitmap.bits = as.vaddr_bits;
     user_prog->userprog_vaddr.vaddr_bitmap.btmp_bytes_len = (0xc0000000 - USER_VADDR_START) / PG_SIZE / 8;
-    bitmap_init(&user_prog->userprog_vaddr.vaddr_bitmap);
+    user_prog->userprog_vaddr.vaddr_bitmap.summary = NULL;   //用户进程的位图较大，不使用摘要
+    user_prog->userprog_vaddr.extents = as.extents;
+    return 0;
+}
+
+/*预建一套地址空间放入池中，由idle线程在系统空闲时调用。池已满或内核内存池的锁被占用、页框不够时返回false*/
+bool addr_space_prebuild(void)
+{
+    if(addr_space_cnt >= ADDR_SPACE_POOL_CNT) {
+        return false;
+    }
+    struct addr_space as;
+    if(!addr_space_build(&as, get_kernel_pages_try)) {
+        return false;
+    }
+    enum intr_status old_status = intr_disable();
+    addr_space_pool[addr_space_cnt++] = as;
+    intr_set_status(old_status);
+    return true;
 }
 
 /*创建用户进程*/
@@ -98,19 +179,21 @@ void create_user_vaddr_bitmap(struct task_struct* user_prog)
 void process_execute(void* filename, char* name)
 {
     //pcb内核的数据结构，由内核来维护进程信息，因此要在内核内存池中申请
-    struct task_struct* thread = get_kernel_pages(1);   //申请一页的pcb
+    struct task_struct* thread = kmem_cache_alloc(task_cache);   //申请一页的pcb
     init_thread(thread, name, default_prio);   //初始化pcb信息
-    create_user_vaddr_bitmap(thread);   //初始化用户进程起始虚拟地址，创建用户进程的内存位图，并写入pcb.userprog_vaddr.vaddr_bit_map
+    //初始化用户进程的页目录表、起始虚拟地址和内存位图，写入pcb.pgdir和pcb.userprog_vaddr
+    if(addr_space_alloc(thread) == -1) {
+        release_pid(thread->pid);
+        kmem_cache_free(task_cache, thread);
+        return;
+    }
     thread_create(thread, start_process, filename);   //初始化线程栈，start_process的作用是初始化中断栈
-    thread->pgdir = create_page_dir();   //初始化用户进程的页目录表
     block_desc_init(thread->u_block_desc);   //初始化用户内存块描述符表
 
     enum intr_status ole_status = intr_disable();
-    ASSERT(!elem_find(&thread_ready_list, &thread->general_tag));
-    list_append(&thread_ready_list, &thread->general_tag);   //将用户进程pcb加入到就绪队列
+    thread_ready(thread);   //将用户进程pcb加入到就绪队列
 
-    ASSERT(!elem_find(&thread_all_list, &thread->all_list_tag));
-    list_append(&thread_all_list, &thread->all_list_tag);   //将用户进程pcb加入到全部任务队列中
+    thread_all_append(thread);   //将用户进程pcb加入到全部任务队列中
     
     intr_set_status(ole_status);
 }
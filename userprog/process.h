@@ -6,14 +6,18 @@
 #define default_prio 31
 #define USER_STACK3_VADDR  (0xc0000000 - 0x1000)
 #define USER_VADDR_START 0x8048000
+#define USER_VADDR_BITMAP_PAGES DIV_ROUND_UP((0xc0000000 - USER_VADDR_START) / PG_SIZE / 8, PG_SIZE)   //用户虚拟地址位图占的页数
+#define ADDR_SPACE_POOL_CNT 4   //idle线程预建的地址空间套数
 
 void start_process(void* filename_);
 void page_dir_activate(struct task_struct* p_thread);
 void process_activate(struct task_struct* p_thread);
 /**创建用户进程的页目录表，将当前页表的表示内核空间的pde复制，成功返回页目录的虚拟地址，否则返回NULL**/
 uint32_t* create_page_dir(void);
-/*创建用户进程虚拟地址位图*/
-void create_user_vaddr_bitmap(struct task_struct* user_prog);
+/*为用户进程user_prog装上页目录、虚拟地址位图和空闲区段树，优先取预建好的，成功返回0，失败返回-1*/
+int32_t addr_space_alloc(struct task_struct* user_prog);
+/*预建一套地址空间放入池中，由idle线程调用，池已满或分配不到时返回false*/
+bool addr_space_prebuild(void);
 /*创建用户进程*/
 void process_execute(void* filename, char* name);
 
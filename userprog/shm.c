@@ -0,0 +1,268 @@
+#include "shm.h"
+#include "stdint.h"
+#include "global.h"
+#include "thread.h"
+#include "memory.h"
+#include "sync.h"
+#include "string.h"
+#include "stdio-kernel.h"
+
+/*共享内存段，页框在新建时一次分配，段本身占每个页框的一次引用，挂接的进程各再占一次*/
+struct shm_segment
+{
+    bool used;   //段表中的这一项是否在用
+    bool removed;   //已标记删除，不能再被shmget找到，最后一个挂接解除后释放
+    int32_t key;
+    uint32_t pg_cnt;
+    uint32_t attach_cnt;   //各进程的挂接数
+    uint32_t* frames;   //各页框的物理地址，占一页内核内存
+};
+
+static struct shm_segment shm_segs[SHM_MAX_SEGS];
+static struct lock shm_lock;   //保护shm_segs
+
+/*初始化共享内存段表*/
+void shm_init(void)
+{
+    memset(shm_segs, 0, sizeof(shm_segs));
+    lock_init(&shm_lock);
+}
+
+/*释放seg的页框和页框地址表，需持有shm_lock*/
+static void shm_destroy(struct shm_segment* seg)
+{
+    uint32_t pg_idx;
+    for(pg_idx = 0; pg_idx < seg->pg_cnt; pg_idx++) {
+        pfree(seg->frames[pg_idx]);
+    }
+    mfree_page(PF_KERNEL, seg->frames, 1);
+    memset(seg, 0, sizeof(struct shm_segment));
+}
+
+/*减去段shmid的一次挂接，已标记删除且没有挂接时释放，需持有shm_lock*/
+static void shm_put(int32_t shmid)
+{
+    struct shm_segment* seg = &shm_segs[shmid];
+    if(--seg->attach_cnt == 0 && seg->removed) {
+        shm_destroy(seg);
+    }
+}
+
+/*段号shmid有效时返回对应的段，否则返回NULL*/
+static struct shm_segment* shm_of(int32_t shmid)
+{
+    if(shmid < 0 || shmid >= SHM_MAX_SEGS || !shm_segs[shmid].used) {
+        return NULL;
+    }
+    return &shm_segs[shmid];
+}
+
+/*新建key对应的大小为pg_cnt页的段，页框全部清零，成功返回段号，失败返回-1，需持有shm_lock*/
+static int32_t shm_create(int32_t key, uint32_t pg_cnt)
+{
+    int32_t shmid;
+    for(shmid = 0; shmid < SHM_MAX_SEGS; shmid++) {
+        if(!shm_segs[shmid].used) {
+            break;
+        }
+    }
+    if(shmid == SHM_MAX_SEGS) {
+        printk("shm_create: exceed max segments\n");
+        return -1;
+    }
+    struct shm_segment* seg = &shm_segs[shmid];
+    seg->frames = get_kernel_pages(1);
+    if(seg->frames == NULL) {
+        printk("shm_create: get_kernel_pages failed\n");
+        return -1;
+    }
+    uint32_t pg_idx;
+    for(pg_idx = 0; pg_idx < pg_cnt; pg_idx++) {
+        seg->frames[pg_idx] = page_frame_alloc(PF_USER);
+        if(seg->frames[pg_idx] == 0) {
+            printk("shm_create: out of user memory\n");
+            seg->pg_cnt = pg_idx;
+            shm_destroy(seg);
+            return -1;
+        }
+    }
+    seg->used = true;
+    seg->removed = false;
+    seg->key = key;
+    seg->pg_cnt = pg_cnt;
+    seg->attach_cnt = 0;
+    return shmid;
+}
+
+/*取得key对应的共享内存段，成功返回段号，失败返回-1。
+  key为IPC_PRIVATE时总是新建，否则先找同key的段，找不到且flags含IPC_CREAT时新建大小为size字节的段*/
+int32_t sys_shmget(int32_t key, uint32_t size, uint32_t flags)
+{
+    uint32_t pg_cnt = DIV_ROUND_UP(size, PG_SIZE);
+    lock_acquire(&shm_lock);
+    int32_t shmid = -1;
+    if(key != IPC_PRIVATE) {
+        int32_t idx;
+        for(idx = 0; idx < SHM_MAX_SEGS; idx++) {
+            if(shm_segs[idx].used && !shm_segs[idx].removed && shm_segs[idx].key == key) {
+                shmid = idx;
+                break;
+            }
+        }
+    }
+    if(shmid != -1) {
+        if((flags & IPC_CREAT) && (flags & IPC_EXCL)) {
+            printk("sys_shmget: key %d exists\n", key);
+            shmid = -1;
+        } else if(pg_cnt > shm_segs[shmid].pg_cnt) {
+            printk("sys_shmget: size larger than segment\n");
+            shmid = -1;
+        }
+    } else if(key != IPC_PRIVATE && !(flags & IPC_CREAT)) {
+        printk("sys_shmget: key %d not found\n", key);
+    } else if(pg_cnt == 0 || pg_cnt > SHM_MAX_PAGES) {
+        printk("sys_shmget: size error\n");
+    } else {
+        shmid = shm_create(key, pg_cnt);
+    }
+    lock_release(&shm_lock);
+    return shmid;
+}
+
+/*把段shmid挂接到当前进程，成功返回挂接的起始地址，失败返回SHM_FAILED。
+  shmaddr须为NULL由内核选择地址，挂接时把段的全部页框映射进来，之后访问不再缺页*/
+void* sys_shmat(int32_t shmid, const void* shmaddr, uint32_t flags)
+{
+    struct task_struct* cur = running_thread()->group_leader;
+    if(cur->pgdir == NULL || shmaddr != NULL) {
+        printk("sys_shmat: unsupported arguments\n");
+        return SHM_FAILED;
+    }
+    struct shm_attach* attach = NULL;
+    uint32_t attach_idx;
+    for(attach_idx = 0; attach_idx < MAX_SHM_ATTACHES_PER_PROC; attach_idx++) {
+        if(cur->shm_attaches[attach_idx].vaddr == 0) {
+            attach = &cur->shm_attaches[attach_idx];
+            break;
+        }
+    }
+    if(attach == NULL) {
+        printk("sys_shmat: exceed max attaches\n");
+        return SHM_FAILED;
+    }
+
+    lock_acquire(&shm_lock);
+    struct shm_segment* seg = shm_of(shmid);
+    if(seg == NULL) {
+        lock_release(&shm_lock);
+        printk("sys_shmat: shmid error\n");
+        return SHM_FAILED;
+    }
+    void* vaddr = vaddr_get(PF_USER, seg->pg_cnt);
+    if(vaddr == NULL) {
+        lock_release(&shm_lock);
+        printk("sys_shmat: no free virtual address\n");
+        return SHM_FAILED;
+    }
+    uint32_t pg_idx;
+    for(pg_idx = 0; pg_idx < seg->pg_cnt; pg_idx++) {
+        page_map_shared((uint32_t)vaddr + pg_idx * PG_SIZE, seg->frames[pg_idx], !(flags & SHM_RDONLY));
+    }
+    seg->attach_cnt++;
+    lock_release(&shm_lock);
+
+    attach->vaddr = (uint32_t)vaddr;
+    attach->shmid = shmid;
+    return vaddr;
+}
+
+/*解除当前进程的挂接attach：去掉映射并放弃对页框的引用，需持有shm_lock*/
+static void shm_attach_unmap(struct shm_attach* attach)
+{
+    mfree_page(PF_USER, (void*)attach->vaddr, shm_segs[attach->shmid].pg_cnt);
+    shm_put(attach->shmid);
+    attach->vaddr = 0;
+    attach->shmid = 0;
+}
+
+/*解除从shmaddr起的共享内存挂接，shmaddr须是sys_shmat返回的地址，成功返回0，失败返回-1*/
+int32_t sys_shmdt(const void* shmaddr)
+{
+    struct task_struct* cur = running_thread()->group_leader;
+    uint32_t attach_idx;
+    for(attach_idx = 0; attach_idx < MAX_SHM_ATTACHES_PER_PROC; attach_idx++) {
+        struct shm_attach* attach = &cur->shm_attaches[attach_idx];
+        if(attach->vaddr != 0 && attach->vaddr == (uint32_t)shmaddr) {
+            lock_acquire(&shm_lock);
+            shm_attach_unmap(attach);
+            lock_release(&shm_lock);
+            return 0;
+        }
+    }
+    printk("sys_shmdt: not an attached address\n");
+    return -1;
+}
+
+/*对段shmid执行cmd命令，目前只支持IPC_RMID，buf忽略，成功返回0，失败返回-1。
+  标记删除后段不能再被shmget找到，没有挂接时立即释放，否则等最后一个挂接解除*/
+int32_t sys_shmctl(int32_t shmid, uint32_t cmd, void* buf UNUSED)
+{
+    if(cmd != IPC_RMID) {
+        printk("sys_shmctl: unsupported cmd %d\n", cmd);
+        return -1;
+    }
+    lock_acquire(&shm_lock);
+    struct shm_segment* seg = shm_of(shmid);
+    int32_t ret = -1;
+    if(seg != NULL && !seg->removed) {
+        seg->removed = true;
+        if(seg->attach_cnt == 0) {
+            shm_destroy(seg);
+        }
+        ret = 0;
+    }
+    lock_release(&shm_lock);
+    return ret;
+}
+
+/*解除当前进程的全部挂接，exec换映像时调用*/
+void shm_detach_all(void)
+{
+    struct task_struct* cur = running_thread()->group_leader;
+    lock_acquire(&shm_lock);
+    uint32_t attach_idx;
+    for(attach_idx = 0; attach_idx < MAX_SHM_ATTACHES_PER_PROC; attach_idx++) {
+        if(cur->shm_attaches[attach_idx].vaddr != 0) {
+            shm_attach_unmap(&cur->shm_attaches[attach_idx]);
+        }
+    }
+    lock_release(&shm_lock);
+}
+
+/*进程退出时减去pthread各挂接的计数，页框上挂接的引用已随页表回收，这里只处理段本身*/
+void shm_release(struct task_struct* pthread)
+{
+    lock_acquire(&shm_lock);
+    uint32_t attach_idx;
+    for(attach_idx = 0; attach_idx < MAX_SHM_ATTACHES_PER_PROC; attach_idx++) {
+        struct shm_attach* attach = &pthread->shm_attaches[attach_idx];
+        if(attach->vaddr != 0) {
+            shm_put(attach->shmid);
+            attach->vaddr = 0;
+        }
+    }
+    lock_release(&shm_lock);
+}
+
+/*fork后为子进程child继承的各挂接增加计数，页表中的共享页不做写时复制，父子进程看到同一份内容*/
+void shm_fork(struct task_struct* child)
+{
+    lock_acquire(&shm_lock);
+    uint32_t attach_idx;
+    for(attach_idx = 0; attach_idx < MAX_SHM_ATTACHES_PER_PROC; attach_idx++) {
+        if(child->shm_attaches[attach_idx].vaddr != 0) {
+            shm_segs[child->shm_attaches[attach_idx].shmid].attach_cnt++;
+        }
+    }
+    lock_release(&shm_lock);
+}
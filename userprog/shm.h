@@ -0,0 +1,36 @@
+#ifndef __USERPROG_SHM_H
+#define __USERPROG_SHM_H
+#include "stdint.h"
+#include "global.h"
+
+#define SHM_MAX_SEGS 16   //系统中最多的共享内存段数
+#define SHM_MAX_PAGES 1024   //每段最多的页数，页框地址表正好占一页
+
+#define IPC_PRIVATE 0   //shmget的key，总是新建一段，别的进程只能经fork继承
+#define IPC_CREAT 1   //shmget的flags，key对应的段不存在时新建
+#define IPC_EXCL 2   //shmget的flags，和IPC_CREAT一起用，段已存在时失败
+#define SHM_RDONLY 1   //shmat的flags，只读挂接
+#define IPC_RMID 0   //shmctl的cmd，标记删除，最后一个挂接解除后释放
+
+#define SHM_FAILED ((void*)-1)   //shmat失败时的返回值
+
+struct task_struct;
+
+/*初始化共享内存段表*/
+void shm_init(void);
+/*取得key对应的共享内存段，按flags新建大小为size字节的段，成功返回段号，失败返回-1*/
+int32_t sys_shmget(int32_t key, uint32_t size, uint32_t flags);
+/*把段shmid挂接到当前进程，shmaddr须为NULL由内核选择地址，成功返回挂接的起始地址，失败返回SHM_FAILED*/
+void* sys_shmat(int32_t shmid, const void* shmaddr, uint32_t flags);
+/*解除从shmaddr起的共享内存挂接，成功返回0，失败返回-1*/
+int32_t sys_shmdt(const void* shmaddr);
+/*对段shmid执行cmd命令，目前只支持IPC_RMID，buf忽略，成功返回0，失败返回-1*/
+int32_t sys_shmctl(int32_t shmid, uint32_t cmd, void* buf);
+/*解除当前进程的全部挂接，exec换映像时调用*/
+void shm_detach_all(void);
+/*进程退出时减去pthread各挂接的计数，页框由退出流程随页表回收*/
+void shm_release(struct task_struct* pthread);
+/*fork后为子进程child继承的各挂接增加计数，页表中的共享页不做写时复制*/
+void shm_fork(struct task_struct* child);
+
+#endif
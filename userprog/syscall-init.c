@@ -7,13 +7,34 @@
 #include "string.h"
 #include "memory.h"
 #include "fs.h"
+#include "fsck.h"
 #include "fork.h"
 #include "exec.h"
 #include "wait_exit.h"
+#include "futex.h"
+#include "sched_trace.h"
+#include "timer.h"
+#include "ide.h"
+#include "mmap.h"
+#include "pipe.h"
+#include "shm.h"
+#include "msgq.h"
+#include "poll.h"
+#include "klog.h"
+#include "clone.h"
+#include "uring.h"
+#include "init.h"
+#include "bench.h"
+#include "profile.h"
+#include "ksym.h"
+#include "hrtimer.h"
+#include "counter.h"
+#include "hostshare.h"
 
-#define syscall_nr 32
 typedef void* syscall;
 syscall syscall_table[syscall_nr];
+static struct syscall_stat syscall_counters[syscall_nr];   //各系统调用号的统计，持大内核锁时更新
+static uint32_t syscall_counter;   //全部系统调用的次数，按cpu分开计
 
 /*返回当前任务的pid*/
 uint32_t sys_getpid(void)
@@ -21,10 +42,45 @@ uint32_t sys_getpid(void)
     return running_thread()->pid;
 }
 
+/*系统调用入口在取得大内核锁后调用，执行nr号系统调用并记入统计，nr无效时返回-1。
+  次数在调用前记，exit等不返回的调用也算一次，时间在返回后记*/
+uint32_t syscall_dispatch(uint32_t nr, uint32_t arg1, uint32_t arg2, uint32_t arg3)
+{
+    if(nr >= syscall_nr || syscall_table[nr] == NULL) {
+        return -1;
+    }
+    struct task_struct* cur = running_thread();
+    cur->stats.syscalls++;
+    syscall_counters[nr].cnt++;
+    counter_inc(syscall_counter);
+    uint64_t start, end;
+    asm volatile ("rdtsc" : "=A"(start));
+    uint32_t ret = ((uint32_t (*)(uint32_t, uint32_t, uint32_t))syscall_table[nr])(arg1, arg2, arg3);
+    asm volatile ("rdtsc" : "=A"(end));
+    cur->stats.syscall_cycles += end - start;
+    syscall_counters[nr].cycles += end - start;
+    preempt_check_resched();   //返回用户态前是抢占点，系统调用中唤醒了级别更靠前的任务时在这里让出cpu
+    return ret;
+}
+
+/*把各系统调用号的统计复制到buf，最多cnt项，返回复制的项数，失败返回-1*/
+int32_t sys_syscall_stats(struct syscall_stat* buf, uint32_t cnt)
+{
+    if(buf == NULL) {
+        return -1;
+    }
+    if(cnt > syscall_nr) {
+        cnt = syscall_nr;
+    }
+    memcpy(buf, syscall_counters, cnt * sizeof(struct syscall_stat));
+    return cnt;
+}
+
 /*初始化系统调用*/
 void syscall_init(void)
 {
     put_str("syscall_init start\n");
+    syscall_counter = counter_register("syscalls");
     syscall_table[SYS_GETPID] = sys_getpid;
     syscall_table[SYS_WRITE] = sys_write;
     syscall_table[SYS_MALLOC] = sys_malloc;
@@ -51,5 +107,65 @@ void syscall_init(void)
     syscall_table[SYS_WAIT] = sys_wait;
     syscall_table[SYS_EXIT] = sys_exit;
     syscall_table[SYS_HELP] = sys_help;
+    syscall_table[SYS_MEMINFO] = sys_meminfo;
+    syscall_table[SYS_FUTEX_WAIT] = sys_futex_wait;
+    syscall_table[SYS_FUTEX_WAKE] = sys_futex_wake;
+    syscall_table[SYS_SCHED_TRACE] = sys_sched_trace;
+    syscall_table[SYS_SYNC] = sys_sync;
+    syscall_table[SYS_FSYNC] = sys_fsync;
+    syscall_table[SYS_UPTIME] = sys_uptime;
+    syscall_table[SYS_IOSTAT] = sys_iostat;
+    syscall_table[SYS_MMAP] = sys_mmap;
+    syscall_table[SYS_MUNMAP] = sys_munmap;
+    syscall_table[SYS_PIPE] = sys_pipe;
+    syscall_table[SYS_SENDFILE] = sys_sendfile;
+    syscall_table[SYS_SPLICE] = sys_splice;
+    syscall_table[SYS_GETDENTS] = sys_getdents;
+    syscall_table[SYS_GETDENTS_STAT] = sys_getdents_stat;
+    syscall_table[SYS_FSTAT] = sys_fstat;
+    syscall_table[SYS_STATFS] = sys_statfs;
+    syscall_table[SYS_FSCK] = sys_fsck;
+    syscall_table[SYS_FCNTL] = sys_fcntl;
+    syscall_table[SYS_SHMGET] = sys_shmget;
+    syscall_table[SYS_SHMAT] = sys_shmat;
+    syscall_table[SYS_SHMDT] = sys_shmdt;
+    syscall_table[SYS_SHMCTL] = sys_shmctl;
+    syscall_table[SYS_MSGQ_CREATE] = sys_msgq_create;
+    syscall_table[SYS_MSGQ_DESTROY] = sys_msgq_destroy;
+    syscall_table[SYS_MSGQ_SEND] = sys_msgq_send;
+    syscall_table[SYS_MSGQ_RECV] = sys_msgq_recv;
+    syscall_table[SYS_POLL] = sys_poll;
+    syscall_table[SYS_IOCTL] = sys_ioctl;
+    syscall_table[SYS_DMESG] = sys_dmesg;
+    syscall_table[SYS_READV] = sys_readv;
+    syscall_table[SYS_WRITEV] = sys_writev;
+    syscall_table[SYS_SPAWN] = sys_spawn;
+    syscall_table[SYS_CLONE] = sys_clone;
+    syscall_table[SYS_THREAD_JOIN] = sys_thread_join;
+    syscall_table[SYS_SBRK] = sys_sbrk;
+    syscall_table[SYS_URING_ENTER] = sys_uring_enter;
+    syscall_table[SYS_TASKSTATS] = sys_taskstats;
+    syscall_table[SYS_SYSCALL_STATS] = sys_syscall_stats;
+    syscall_table[SYS_ISATTY] = sys_isatty;
+    syscall_table[SYS_BOOT_STATS] = sys_boot_stats;
+    syscall_table[SYS_BENCH] = sys_bench;
+    syscall_table[SYS_PROFILE] = sys_profile;
+    syscall_table[SYS_KSYM] = sys_ksym;
+    syscall_table[SYS_DUP] = sys_dup;
+    syscall_table[SYS_DUP2] = sys_dup2;
+    syscall_table[SYS_EXEC_LOOKUP] = sys_exec_lookup;
+    syscall_table[SYS_SPAWN_INODE] = sys_spawn_inode;
+    syscall_table[SYS_USLEEP] = sys_usleep;
+    syscall_table[SYS_STATS] = sys_stats;
+    syscall_table[SYS_HOSTSHARE_LIST] = sys_hostshare_list;
+    syscall_table[SYS_HOSTSHARE_IMPORT] = sys_hostshare_import;
+    syscall_table[SYS_POWEROFF] = sys_poweroff;
+    syscall_table[SYS_CPUGROUP_CREATE] = sys_cpugroup_create;
+    syscall_table[SYS_CPUGROUP_SET] = sys_cpugroup_set;
+    syscall_table[SYS_CPUGROUP_ATTACH] = sys_cpugroup_attach;
+    syscall_table[SYS_CPUGROUP_DESTROY] = sys_cpugroup_destroy;
+    futex_init();
+    shm_init();
+    msgq_init();
     put_str("syscall_init done\n");
 }
@@ -2,8 +2,21 @@
 #define __USERPROG_SYSCALLINIT_H
 #include "stdint.h"
 
+#define syscall_nr 96   //系统调用表的项数
+
+/*一个系统调用号的累计统计，sys_syscall_stats返回的一项*/
+struct syscall_stat
+{
+    uint32_t cnt;   //调用次数
+    uint64_t cycles;   //经过的时钟周期数，含阻塞等待的时间
+};
+
 /*返回当前任务的pid*/
 uint32_t sys_getpid(void);
+/*系统调用入口在取得大内核锁后调用，执行nr号系统调用并记入统计，nr无效时返回-1*/
+uint32_t syscall_dispatch(uint32_t nr, uint32_t arg1, uint32_t arg2, uint32_t arg3);
+/*把各系统调用号的统计复制到buf，最多cnt项，返回复制的项数*/
+int32_t sys_syscall_stats(struct syscall_stat* buf, uint32_t cnt);
 /*初始化系统调用*/
 void syscall_init(void);
 
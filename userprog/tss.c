@@ -5,6 +5,21 @@
 #include "print.h"
 #include "memory.h"
 #include "string.h"
+#include "debug.h"
+#include "smp.h"
+
+/*gdt中描述符的个数：空描述符、内核代码段、内核数据段、显存段、0号cpu的tss、用户代码段、用户数据段，
+  之后依次是1号起各cpu的tss，最后是sysenter用的4个描述符*/
+#define SYSENTER_DESC_IDX (7 + MAX_CPUS - 1)
+#define GDT_DESC_CNT (SYSENTER_DESC_IDX + 4)
+
+#define MSR_SYSENTER_CS 0x174   //sysenter进入内核时的代码段选择子，栈段为其后一项，sysexit返回的代码段和栈段为再后两项
+#define MSR_SYSENTER_ESP 0x175   //sysenter进入内核时的栈顶
+#define MSR_SYSENTER_EIP 0x176   //sysenter进入内核时的入口地址
+
+extern void sysenter_entry(void);   //smp.c中sysenter的入口
+
+bool sysenter_enabled = false;   //cpu支持sysenter并已设置好msr
 
 /*任务状态段tss结构*/
 struct tss
@@ -38,12 +53,41 @@ struct tss
     uint32_t io_base;
 };
 
-static struct tss tss;
+static struct tss tss[MAX_CPUS];   //每个cpu一个tss
+
+/*写模型专用寄存器msr*/
+static void wrmsr(uint32_t msr, uint32_t value)
+{
+    asm volatile ("wrmsr" : : "c"(msr), "a"(value), "d"(0));
+}
+
+/*cpuid是否报告支持sysenter/sysexit，早期Pentium Pro虽然置了SEP位但并不支持*/
+static bool cpu_has_sep(void)
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if(!(edx & (1 << 11))) {
+        return false;
+    }
+    uint32_t family = (eax >> 8) & 0xf, model = (eax >> 4) & 0xf, stepping = eax & 0xf;
+    return !(family == 6 && model < 3 && stepping < 3);
+}
 
-/*更新tss中esp0字段的值为pthread的0级栈*/
+/*更新本cpu的tss中esp0字段的值为pthread的0级栈，sysenter进入内核时也用这个栈*/
 void update_tss_esp(struct task_struct* pthread)
 {
-    tss.esp0 = (uint32_t*)((uint32_t)pthread + PG_SIZE);    
+    tss[smp_cpu_id()].esp0 = (uint32_t*)((uint32_t)pthread + PG_SIZE);    
+    if(sysenter_enabled) {
+        wrmsr(MSR_SYSENTER_ESP, (uint32_t)pthread + PG_SIZE);
+    }
+}
+
+/*设置本cpu的sysenter入口，栈顶在换上用户进程时由update_tss_esp填写*/
+static void sysenter_msr_init(void)
+{
+    wrmsr(MSR_SYSENTER_CS, SYSENTER_DESC_IDX << 3);
+    wrmsr(MSR_SYSENTER_ESP, 0);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
 }
 
 /*创建gdt描述符*/
@@ -64,20 +108,50 @@ static struct gdt_desc make_gdt_desc(uint32_t* desc_addr, uint32_t limit, uint8_
 void tss_init()
 {
     put_str("tss_init start\n");
-    uint32_t tss_size = sizeof(tss);
-    memset(&tss, 0, tss_size);
-    tss.ss0 = SELECTOR_K_STACK;
-    tss.io_base = tss_size;
+    uint32_t tss_size = sizeof(struct tss);
+    memset(&tss[0], 0, tss_size);
+    tss[0].ss0 = SELECTOR_K_STACK;
+    tss[0].io_base = tss_size;
 
     //gdt段基址为0x900，把tss放到第4个位置，也就是0x900+0x20的位置
     //在gdt中添加dpl为0的tss描述符
-    *((struct gdt_desc*)0xc0000920) = make_gdt_desc((uint32_t*)&tss, tss_size-1, TSS_ATTR_LOW, TSS_ATTR_HIGH);
+    *((struct gdt_desc*)0xc0000920) = make_gdt_desc((uint32_t*)&tss[0], tss_size-1, TSS_ATTR_LOW, TSS_ATTR_HIGH);
     //在gdt中添加dpl为3的数据段和代码段
     *((struct gdt_desc*)0xc0000928) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_CODE_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
     *((struct gdt_desc*)0xc0000930) = make_gdt_desc((uint32_t*)0, 0xfffff, GDT_DATA_ATTR_LOW_DPL3, GDT_ATTR_HIGH);
-    //gdt 32位的段基址 16位的limit
-    uint64_t gdt_operand = ((8 * 7 - 1) | ((uint64_t)(uint32_t)0xc0000900 << 16));   //7个描述符大小
+    //sysenter和sysexit按固定顺序取内核代码段、内核数据段、用户代码段、用户数据段，在gdt末尾复制一份这样排列的描述符
+    struct gdt_desc* gdt = (struct gdt_desc*)0xc0000900;
+    gdt[SYSENTER_DESC_IDX] = gdt[SELECTOR_K_CODE >> 3];
+    gdt[SYSENTER_DESC_IDX + 1] = gdt[SELECTOR_K_DATA >> 3];
+    gdt[SYSENTER_DESC_IDX + 2] = gdt[SELECTOR_U_CODE >> 3];
+    gdt[SYSENTER_DESC_IDX + 3] = gdt[SELECTOR_U_DATA >> 3];
+    //gdt 32位的段基址 16位的limit，其他cpu的tss描述符以后再填，界限先按全部描述符算
+    uint64_t gdt_operand = ((8 * GDT_DESC_CNT - 1) | ((uint64_t)(uint32_t)0xc0000900 << 16));
     asm volatile ("lgdt %0" : : "m"(gdt_operand));
     asm volatile ("ltr %w0" : : "r"(SELECTOR_TSS));
+    if(cpu_has_sep()) {
+        sysenter_msr_init();
+        sysenter_enabled = true;
+        put_str("tss_init: sysenter enabled\n");
+    }
     put_str("tss_init and ltr done\n");
 }
+
+/*在从处理器cpu_id上加载gdt并安装它自己的tss，1号cpu的tss描述符在gdt的第7项，依次往后*/
+void tss_ap_init(uint8_t cpu_id)
+{
+    ASSERT(cpu_id > 0 && cpu_id < MAX_CPUS);
+    uint32_t tss_size = sizeof(struct tss);
+    memset(&tss[cpu_id], 0, tss_size);
+    tss[cpu_id].ss0 = SELECTOR_K_STACK;
+    tss[cpu_id].io_base = tss_size;
+
+    uint32_t desc_idx = 6 + cpu_id;
+    *((struct gdt_desc*)(0xc0000900 + desc_idx * 8)) = make_gdt_desc((uint32_t*)&tss[cpu_id], tss_size-1, TSS_ATTR_LOW, TSS_ATTR_HIGH);
+    uint64_t gdt_operand = ((8 * GDT_DESC_CNT - 1) | ((uint64_t)(uint32_t)0xc0000900 << 16));
+    asm volatile ("lgdt %0" : : "m"(gdt_operand));
+    asm volatile ("ltr %w0" : : "r"((uint16_t)(desc_idx << 3)));
+    if(sysenter_enabled) {   //msr是每个cpu各自的
+        sysenter_msr_init();
+    }
+}
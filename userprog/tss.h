@@ -4,5 +4,7 @@
 
 void update_tss_esp(struct task_struct* pthread);
 void tss_init(void);
+/*在从处理器cpu_id上加载gdt并安装它自己的tss*/
+void tss_ap_init(uint8_t cpu_id);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "vdata.h"
+#include "stdint.h"
+#include "global.h"
+#include "thread.h"
+#include "memory.h"
+#include "string.h"
+#include "bitmap.h"
+#include "debug.h"
+
+extern uint32_t ticks;
+
+static struct vdata* vdata_page;   //全局数据页的内核地址
+
+/*bochs开了半虚拟时钟(cpu: pvclock=1)时，把全局数据页中的pvclock注册给当前cpu，bochs随即填好，
+  之后用户读时间不用等时钟中断校准。cpuid先看有没有虚拟机，再核对签名*/
+static void pvclock_init(void)
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if(!(ecx & (1 << 31))) {
+        return;
+    }
+    eax = 0x40000000;
+    asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if(eax < 0x40000001 || ebx != PVCLOCK_SIGNATURE_EBX || ecx != PVCLOCK_SIGNATURE_ECX || edx != PVCLOCK_SIGNATURE_EDX) {
+        return;
+    }
+    eax = 0x40000001;
+    asm volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if(!(eax & PVCLOCK_FEATURE)) {
+        return;
+    }
+    uint32_t paddr = addr_v2p((uint32_t)&vdata_page->pvclock);
+    asm volatile ("wrmsr" : : "c"(MSR_PVCLOCK), "a"(paddr | 1), "d"(0));
+}
+
+/*分配全局数据页，tick_hz为每秒的滴答数。页框从内核内存池分配，内核一直持有一次引用，进程退出时不会被释放*/
+void vdata_init(uint32_t tick_hz)
+{
+    vdata_page = get_kernel_pages(1);
+    if(vdata_page == NULL) {
+        PANIC("vdata_init: alloc memory failed!");
+    }
+    vdata_page->tick_hz = tick_hz;
+    pvclock_init();
+}
+
+/*时钟中断改了滴答数后由0号cpu关中断调用，更新全局数据页。
+  calibrate为true且距上次更新正好一个滴答时，用这段间隔的时钟周期数校准tsc_per_tick，按1/8的权重平滑*/
+void vdata_tick(bool calibrate)
+{
+    uint64_t tsc;
+    asm volatile ("rdtsc" : "=A"(tsc));
+    struct vdata* vd = vdata_page;
+    uint64_t last_tsc = ((uint64_t)vd->tick_tsc_hi << 32) | vd->tick_tsc_lo;
+    vd->seq++;   //变为奇数，读者读到就重读
+    asm volatile ("" : : : "memory");
+    if(calibrate && last_tsc != 0 && ticks - vd->ticks == 1 && tsc - last_tsc < 0xffffffff) {
+        uint32_t delta = (uint32_t)(tsc - last_tsc);
+        vd->tsc_per_tick = vd->tsc_per_tick == 0 ? delta : vd->tsc_per_tick - vd->tsc_per_tick / 8 + delta / 8;
+    }
+    vd->ticks = ticks;
+    vd->tick_tsc_lo = (uint32_t)tsc;
+    vd->tick_tsc_hi = (uint32_t)(tsc >> 32);
+    asm volatile ("" : : : "memory");
+    vd->seq++;
+}
+
+/*在当前进程的虚拟地址池中占住两个数据页的地址，免得mmap等分配落进来，已占住时不重复占。
+  页表项要到第一次访问时才建立*/
+void vdata_reserve(void)
+{
+    struct virtual_addr* vpool = &running_thread()->userprog_vaddr;
+    if(!bitmap_scan_test(&vpool->vaddr_bitmap, (VDATA_VADDR - vpool->vaddr_start) / PG_SIZE)) {
+        vaddr_mark(PF_USER, (void*)VDATA_VADDR, 2);
+    }
+}
+
+/*处理数据页引起的页错误，vaddr落在两个数据页中时建立映射并返回true。
+  全局数据页映射为只读的共享页；进程数据页新分配一个页框写入进程号后改为只读，打上PG_PRIVATE，fork时不复制给子进程*/
+bool vdata_page_fault(uint32_t vaddr)
+{
+    struct task_struct* cur = running_thread();
+    uint32_t vaddr_page = vaddr & 0xfffff000;
+    if(cur->pgdir == NULL || (vaddr_page != VDATA_VADDR && vaddr_page != VDATA_PROC_VADDR)) {
+        return false;
+    }
+    uint32_t* pde = pde_ptr(vaddr);
+    if((*pde & PG_P_1) && (*pte_ptr(vaddr) & PG_P_1)) {   //页已存在，是写了只读的数据页
+        return false;
+    }
+    if(vaddr_page == VDATA_VADDR) {
+        page_map_shared(VDATA_VADDR, addr_v2p((uint32_t)vdata_page), false);
+        return true;
+    }
+    if(get_a_page_without_opvaddrbitmap(PF_USER, VDATA_PROC_VADDR) == NULL) {
+        return false;
+    }
+    struct vdata_proc* vp = (struct vdata_proc*)VDATA_PROC_VADDR;
+    memset(vp, 0, PG_SIZE);
+    vp->pid = cur->group_leader->pid;
+    uint32_t* pte = pte_ptr(VDATA_PROC_VADDR);
+    *pte = (*pte & ~PG_RW_W) | PG_PRIVATE;
+    asm volatile ("invlpg %0" : : "m"(*(uint8_t*)VDATA_PROC_VADDR) : "memory");
+    return true;
+}
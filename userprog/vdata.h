@@ -0,0 +1,59 @@
+#ifndef __USERPROG_VDATA_H
+#define __USERPROG_VDATA_H
+#include "stdint.h"
+#include "global.h"
+#include "thread.h"
+
+#define VDATA_VADDR 0xbfffd000   //全局数据页在每个进程中的固定地址，紧挨用户栈页之下的第二页
+#define VDATA_PROC_VADDR 0xbfffe000   //进程数据页的固定地址，紧挨用户栈页之下
+
+#define PVCLOCK_SIGNATURE_EBX 0x68636f42   //cpuid 0x40000000返回的"BochsPVClock"
+#define PVCLOCK_SIGNATURE_ECX 0x43565073
+#define PVCLOCK_SIGNATURE_EDX 0x6b636f6c
+#define PVCLOCK_FEATURE (1 << 3)   //cpuid 0x40000001的eax中有半虚拟时钟
+#define MSR_PVCLOCK 0x4b564d01   //写入时钟结构的物理地址，最低位为1表示启用
+
+/*bochs的半虚拟时钟，布局同KVM的pvclock_vcpu_time_info，由bochs在注册时和时间戳计数器被改写时填写。
+  开机以来的纳秒数为system_time + ((tsc - tsc_timestamp) << tsc_shift) * tsc_to_system_mul >> 32，tsc_shift为负时右移。
+  version为0表示没有注册，为奇数表示bochs正在改写*/
+struct pvclock
+{
+    volatile uint32_t version;
+    uint32_t pad0;
+    volatile uint64_t tsc_timestamp;
+    volatile uint64_t system_time;
+    volatile uint32_t tsc_to_system_mul;
+    volatile int8_t tsc_shift;
+    volatile uint8_t flags;
+    uint8_t pad[2];
+};
+
+/*全局数据页，所有进程共用同一个页框，只读映射。内核改写时seq先变为奇数，写完再变为偶数，
+  用户读到前后两次seq相同且为偶数才算读到一致的内容*/
+struct vdata
+{
+    volatile uint32_t seq;
+    volatile uint32_t ticks;   //开机以来的时钟滴答数，同uptime
+    volatile uint32_t tick_tsc_lo;   //最近一次时钟中断时0号cpu的时间戳计数器
+    volatile uint32_t tick_tsc_hi;
+    volatile uint32_t tsc_per_tick;   //每个滴答的时钟周期数，按相邻两次周期中断校准，为0表示还没校准
+    uint32_t tick_hz;   //每秒的滴答数
+    struct pvclock pvclock;   //bochs开了半虚拟时钟时由0号cpu注册，不按seq读
+};
+
+/*进程数据页，每个进程一页，只读映射，fork时不复制，子进程第一次访问时另建自己的一页*/
+struct vdata_proc
+{
+    pid_t pid;   //进程号，即主线程的pid，进程中的各线程读到的都一样
+};
+
+/*分配全局数据页，tick_hz为每秒的滴答数*/
+void vdata_init(uint32_t tick_hz);
+/*时钟中断改了滴答数后由0号cpu关中断调用，更新全局数据页，calibrate为true时用这次的间隔校准时间戳计数器*/
+void vdata_tick(bool calibrate);
+/*在当前进程的虚拟地址池中占住两个数据页的地址，已占住时不重复占，进程开始运行和exec换映像时调用*/
+void vdata_reserve(void);
+/*处理数据页引起的页错误，vaddr落在两个数据页中时建立映射并返回true*/
+bool vdata_page_fault(uint32_t vaddr);
+
+#endif
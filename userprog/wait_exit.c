@@ -6,149 +6,143 @@
 #include "debug.h"
 #include "pipe.h"
 #include "file.h"
-
-/*释放用户进程资源，页表中对应的物理页，虚拟内存池占物理页框，打开的文件*/
+#include "inode.h"
+#include "sync.h"
+#include "mmap.h"
+#include "shm.h"
+#include "clone.h"
+
+/*释放用户进程资源，页表中对应的物理页，虚拟内存池占物理页框，打开的文件。
+  只遍历进程建立过的页表，每张页表的页框成批交还伙伴系统，退出的开销随进程实际占用的内存而定*/
 static void release_prog_resource(struct task_struct* release_thread)
 {
     uint32_t* pgdir_vaddr = release_thread->pgdir;
-    uint16_t user_pde_nr = 768, pde_idx = 0;
-    uint32_t pde = 0;
-    uint32_t* v_pde_ptr = NULL;   //v表示var，和函数pde_ptr区分
-
-    uint16_t user_pte_nr = 1024, pte_idx = 0;
-    uint32_t pte = 0;
-    uint32_t* v_pte_ptr = NULL;
-
-    uint32_t* first_pte_vaddr_in_pde = NULL;   //记录pde中第一个pte指向的物理页起始地址
-    uint32_t pg_phy_addr = 0;
+    int32_t pde_idx = -1;
 
     //回收页表中用户空间的页框
-    while(pde_idx < user_pde_nr) {
-        v_pde_ptr = pgdir_vaddr + pde_idx;
-        pde = *v_pde_ptr;
-        if(pde & 0x00000001) {
-            first_pte_vaddr_in_pde = pte_ptr(pde_idx * 0x400000);   //一个页表表示的内存容量是4MB，即0x400000
-            pte_idx = 0;
-            while(pte_idx < user_pte_nr) {
-                v_pte_ptr = first_pte_vaddr_in_pde + pte_idx;
-                pte = * v_pte_ptr;
-                if(pte & 0x00000001) {
-                    pg_phy_addr = pte & 0xfffff000;
-                    free_a_phy_addr(pg_phy_addr);
-                }
-                pte_idx++;
-            }
+    while((pde_idx = user_pde_next(release_thread, pde_idx + 1)) != -1) {
+        uint32_t pde = pgdir_vaddr[pde_idx];
+        if(pde & PG_PS) {   //大页直接映射4MB的页框，没有页表
+            large_page_free(pde & 0xffc00000);
+        } else if(pde & PG_P_1) {
+            pfree_ptes(pte_ptr(pde_idx * 0x400000), 1024);   //一个页表表示的内存容量是4MB，即0x400000
             //将pde中记录的物理页框直接在相应内存池的位图中清0
-            pg_phy_addr = pde & 0xfffff000;
-            free_a_phy_addr(pg_phy_addr);
+            free_a_phy_addr(pde & 0xfffff000);
         }
-        pde_idx++;
     }
 
     //回收用户虚拟地址池所占的物理内存
-    uint32_t bitmap_pg_cnt = (release_thread->userprog_vaddr.vaddr_bitmap.btmp_bytes_len) / PG_SIZE;
+    uint32_t bitmap_pg_cnt = DIV_ROUND_UP(release_thread->userprog_vaddr.vaddr_bitmap.btmp_bytes_len, PG_SIZE);
     uint8_t* user_vaddr_pool_bitmap = release_thread->userprog_vaddr.vaddr_bitmap.bits;
     mfree_page(PF_KERNEL, user_vaddr_pool_bitmap, bitmap_pg_cnt);
-
-    //关闭进程打开的文件
-    uint8_t fd_idx = 3;
-    while(fd_idx < MAX_FILES_OPEN_PER_PROC) {
-        if(release_thread->fd_table[fd_idx] != -1) {
-            if(is_pipe(fd_idx)) {
-                uint32_t global_fd = fd_local2global(fd_idx);
-                if(--file_table[global_fd].fd_pos == 0) {
-                    mfree_page(PF_KERNEL, file_table[global_fd].fd_inode, 1);
-                    file_table[global_fd].fd_inode = NULL;
-                }
-            } else {
-                sys_close(fd_idx);
-            }
+    mfree_page(PF_KERNEL, release_thread->userprog_vaddr.extents, 1);
+
+    //关闭进程打开的文件，和别的进程共用的文件结构只减引用。重定向为管道的标准描述符也要关闭，读端才能读到文件尾
+    uint32_t fd_idx;
+    for(fd_idx = 0; fd_idx < release_thread->fd_size; fd_idx++) {
+        if(fd_idx % 8 == 0 && release_thread->fd_bitmap.bits[fd_idx / 8] == 0) {   //按位图整字节跳过空闲的描述符
+            fd_idx += 7;
+            continue;
+        }
+        if(release_thread->fd_table[fd_idx] != NULL) {
+            sys_close(fd_idx);
         }
-        fd_idx++;
     }
-}
+    fd_table_release(release_thread);
 
-/*list_traversal的回调函数，查找pelem的parent_pid是否是ppid，成功返回true，失败返回false*/
-static bool find_child(struct list_elem* pelem, int32_t ppid)
-{
-    struct task_struct* pthread = elem2entry(struct task_struct, all_list_tag, pelem);
-    if(pthread->parent_pid == ppid) {
-        return true;
+    //关闭进程映像所在的程序文件
+    if(release_thread->exec_inode != NULL) {
+        inode_close(release_thread->exec_inode);
+        release_thread->exec_inode = NULL;
     }
-    return false;
-}
+    mmap_release(release_thread);   //映射区的页框已随页表回收
+    shm_release(release_thread);   //共享内存页框上挂接的引用同样已随页表回收
 
-/*list_traversal的回调函数，查找状态为TASK_HANGING的任务*/
-static bool find_hanging_child(struct list_elem* pelem, int32_t ppid)
-{
-    struct task_struct* pthread = elem2entry(struct task_struct, all_list_tag, pelem);
-    if(pthread->parent_pid == ppid && pthread->status == TASK_HANGING) {
-        return true;
-    }
-    return false;
-}
-
-/*回调函数，将一个子进程过继给init*/
-static bool init_adopt_a_child(struct list_elem* pelem, int32_t pid)
-{
-    struct task_struct* pthread = elem2entry(struct task_struct, all_list_tag, pelem);
-    if(pthread->parent_pid == pid) {   //若该进程的parent_pid为pid，返回
-        pthread->parent_pid = 1;
-    }
-    return false;   //遍历下一个元素
+    //关闭文件时释放的内存块也会进缓存，所以最后归还内核内存块缓存
+    mem_magazine_drain(release_thread);
 }
 
-/*等待子进程调用exit，将子进程的退出状态保存到status指向的变量，成功返回子进程的pid，失败返回-1*/
-pid_t sys_wait(int32_t* status)
+/*等待子进程调用exit，将子进程的退出状态保存到status指向的变量，成功返回子进程的pid，没有子进程返回-1。
+  退出的子进程由exit挂到父进程的zombies队列，这里直接取队首，收获的开销与子进程数无关。
+  options含WNOHANG时不阻塞，有子进程但都还没退出返回0*/
+pid_t sys_wait(int32_t* status, uint32_t options)
 {
     struct task_struct* parent_thread = running_thread();
     while(1) {
-        //优先处理已经是挂起状态的任务
-        struct list_elem* child_elem = list_traversal(&thread_all_list, find_hanging_child, parent_thread->pid);
-        if(child_elem != NULL) {
-            struct task_struct* child_thread = elem2entry(struct task_struct, all_list_tag, child_elem);
-            *status = child_thread->exit_status;
+        //从检查子进程到阻塞自己之间要关中断，否则会错过子进程退出时的唤醒
+        enum intr_status old_status = intr_disable();
+        enum intr_status lock_status = read_lock(&thread_all_lock);
+        struct task_struct* child_thread = NULL;
+        if(!list_empty(&parent_thread->zombies)) {
+            child_thread = elem2entry(struct task_struct, child_tag, parent_thread->zombies.head.next);
+        }
+        bool has_child = child_thread != NULL || !list_empty(&parent_thread->children);
+        read_unlock(&thread_all_lock, lock_status);
+
+        //优先处理已经退出的子进程
+        if(child_thread != NULL) {
+            intr_set_status(old_status);
+            if(child_thread->status != TASK_HANGING) {   //已进队列，还没来得及挂起
+                thread_yield();
+                continue;
+            }
+            if(status != NULL) {
+                *status = child_thread->exit_status;
+            }
 
             //thread_exit之后，pcb会被回收，因此提前获取pid
             uint16_t child_pid = child_thread->pid;
 
-            // 从就绪队列和全部任务队列中删除进程表项
+            //从就绪队列、全部任务队列和zombies队列中删除进程表项
             thread_exit(child_thread, false);   //传入false，使thread_exit调用后回到此处
 
             return child_pid;
         }
 
         //判断是否有子进程
-        child_elem = list_traversal(&thread_all_list, find_child, parent_thread->pid);
-        if(child_elem == NULL) {
+        if(!has_child) {
+            intr_set_status(old_status);
             return -1;
+        } else if(options & WNOHANG) {
+            intr_set_status(old_status);
+            return 0;
         } else {   //若子进程还未运行完成，即未调用exit，则将自己挂起，知道子进程在执行exit时将自己唤醒
             thread_block(TASK_WAITING);
+            intr_set_status(old_status);
         }
     }
 }
 
-/*子进程用来结束自己时调用*/
+/*子进程用来结束自己时调用。主线程以外的线程只结束自己，主线程要等进程中的其他线程都结束后才结束进程*/
 void sys_exit(int32_t status)
 {
     struct task_struct* child_thread = running_thread();
+    if(child_thread->group_leader != child_thread) {
+        clone_exit(status);
+    }
     child_thread->exit_status = status;
     if(child_thread->parent_pid == -1) {
         PANIC("sys_exit: child_thread->parent_pid is -1\n");
     }
+
+    //其他线程还在用进程的地址空间和文件，等它们都结束后再回收
+    clone_wait_all(child_thread);
     
     //将进程child_thread的所有子进程都过继给init
-    list_traversal(&thread_all_list, init_adopt_a_child, child_thread->pid);
+    thread_orphan_children(child_thread);
 
     //回收进程child_thread的资源
     release_prog_resource(child_thread);
 
-    //如果父进程正在等待子进程退出，将父进程唤醒
-    struct task_struct* parent_thread = pid2thread(child_thread->parent_pid);
+    //挂到父进程的zombies队列，如果父进程正在等待子进程退出，将父进程唤醒。
+    //从进队列到挂起之间关着中断，父进程取到自己时自己已经是TASK_HANGING
+    enum intr_status old_status = intr_disable();
+    struct task_struct* parent_thread = thread_zombie_append(child_thread);
     if(parent_thread->status == TASK_WAITING) {
         thread_unblock(parent_thread);
     }
 
     //将自己挂起，等待父进程收获其status，并回收pcb
     thread_block(TASK_HANGING);
+    intr_set_status(old_status);
 }
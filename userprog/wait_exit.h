@@ -2,8 +2,11 @@
 #define USERPROG_WAIT_EXIT_H
 #include "thread.h"
 
-/*等待子进程调用exit，将子进程的退出状态保存到status指向的变量，成功返回子进程的pid，失败返回-1*/
-pid_t sys_wait(int32_t* status);
+#define WNOHANG 1   //wait的options，没有已退出的子进程时不阻塞，立即返回0
+
+/*等待子进程调用exit，将子进程的退出状态保存到status指向的变量，成功返回子进程的pid，失败返回-1。
+  options含WNOHANG时不阻塞，有子进程但都还没退出返回0*/
+pid_t sys_wait(int32_t* status, uint32_t options);
 /*子进程用来结束自己时调用*/
 void sys_exit(int32_t status);
 